@@ -11,6 +11,7 @@
 #ifndef HTTP_CONNECTION_MANAGER_HPP
 #define HTTP_CONNECTION_MANAGER_HPP
 
+#include <mutex>
 #include <set>
 #include "connection.hpp"
 
@@ -40,6 +41,9 @@ public:
 private:
   /// The managed connections.
   std::set<connection_ptr> connections_;
+
+  /// Guards connections_, as the server may be run by several threads.
+  std::mutex mutex_;
 };
 
 } // namespace server
@@ -110,9 +110,28 @@ server::handle_request(const request& req, reply& rep)
         params = request_path.substr(pos);
     }
 
+    // a route also serves the paths below it, getting the rest of the path
+    // as its params
+    pos = command.find('/');
+    if (mRoutes.find(command) == mRoutes.end() && pos != std::string::npos &&
+        mRoutes.find(command.substr(0, pos)) != mRoutes.end())
+    {
+        params = command.substr(pos) + params;
+        command = command.substr(0, pos);
+    }
+
     if (mRoutes.find(command) != mRoutes.end())
     {
-        mRoutes[command](params, rep.content);
+        try
+        {
+            mRoutes[command](params, rep.content);
+        }
+        catch (reply::status_type status)
+        {
+            // routes throw a status to answer with a stock reply
+            rep = reply::stock_reply(status);
+            return;
+        }
 
         rep.status = reply::ok;
         rep.headers.resize(2);
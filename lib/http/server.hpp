@@ -41,6 +41,9 @@ public:
                     const std::string& address, unsigned short port, int maxClient);
     ~server();
 
+    // A route also serves the paths below it ("name/..."), getting the rest
+    // of the path ahead of the query as its params. It can throw a
+    // reply::status_type to answer with that stock reply instead.
     void addRoute(const std::string& routeName, routeHandler callback);
     void add404(routeHandler callback);
 
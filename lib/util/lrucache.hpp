@@ -112,6 +112,13 @@ namespace cache {
             return _cache_items_map.size();
         }
 
+        template<typename F>
+        void for_each(const F &f) const {
+            for (auto const& kv : _cache_items_list) {
+                f(kv.first, kv.second);
+            }
+        }
+
     private:
         std::list<key_value_pair_t> _cache_items_list;
         std::unordered_map<key_t, list_iterator_t> _cache_items_map;
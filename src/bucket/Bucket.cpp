@@ -8,6 +8,9 @@
 #include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketApplicator.h"
+#include "bucket/BucketDBChecker.h"
+#include "bucket/BucketIndex.h"
+#include "bucket/BucketInputIterator.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketOutputIterator.h"
@@ -24,6 +27,7 @@
 #include "ledger/TrustFrame.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "medida/histogram.h"
 #include "medida/medida.h"
 #include "util/Fs.h"
 #include "util/LogSlowExecution.h"
@@ -31,14 +35,17 @@
 #include "util/TmpDir.h"
 #include "util/XDRStream.h"
 #include "xdrpp/message.h"
+#include <algorithm>
 #include <cassert>
 #include <future>
+#include <limits>
 
 namespace stellar
 {
 
-Bucket::Bucket(std::string const& filename, Hash const& hash)
-    : mFilename(filename), mHash(hash)
+Bucket::Bucket(std::string const& filename, Hash const& hash,
+               FileIOMetrics* readMetrics)
+    : mFilename(filename), mHash(hash), mReadMetrics(readMetrics)
 {
     assert(filename.empty() || fs::exists(filename));
     if (!filename.empty())
@@ -64,40 +71,149 @@ Bucket::getFilename() const
     return mFilename;
 }
 
+FileIOMetrics*
+Bucket::getReadMetrics() const
+{
+    return mReadMetrics;
+}
+
 bool
 Bucket::containsBucketIdentity(BucketEntry const& id) const
 {
-    BucketEntryIdCmp cmp;
-    BucketInputIterator iter(shared_from_this());
-    while (iter)
+    BucketEntry e;
+    return getBucketEntry(BucketIndex::getBucketEntryKey(id), e);
+}
+
+std::shared_ptr<BucketIndex const>
+Bucket::getIndex() const
+{
+    if (mFilename.empty())
+    {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mIndex)
     {
-        if (!(cmp(*iter, id) || cmp(id, *iter)))
+        auto fileSize = fs::size(mFilename);
+        mIndex = BucketIndex::load(getIndexFilename(), mHash, fileSize);
+        if (!mIndex)
         {
-            return true;
+            CLOG(DEBUG, "Bucket") << "Building index for bucket " << mFilename;
+            mIndex = BucketIndex::build(shared_from_this());
+            mIndex->save(getIndexFilename(), mHash, fileSize);
         }
-        ++iter;
     }
-    return false;
+    return mIndex;
 }
 
-std::pair<size_t, size_t>
-Bucket::countLiveAndDeadEntries() const
+size_t
+Bucket::getMemoryBytes() const
+{
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    return sizeof(*this) + mFilename.capacity() +
+           (mIndex ? mIndex->getMemoryBytes() : 0) +
+           (mEntries ? mEntries->capacity() * sizeof(BucketEntry) : 0);
+}
+
+std::shared_ptr<std::vector<BucketEntry> const>
+Bucket::getEntries() const
+{
+    if (mFilename.empty())
+    {
+        static auto const empty =
+            std::make_shared<std::vector<BucketEntry> const>();
+        return empty;
+    }
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    return mEntries;
+}
+
+void
+Bucket::setEntries(
+    std::shared_ptr<std::vector<BucketEntry> const> entries) const
 {
-    size_t live = 0, dead = 0;
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mEntries)
+    {
+        mEntries = entries;
+    }
+}
+
+void
+Bucket::setIndex(std::shared_ptr<BucketIndex const> index) const
+{
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mIndex)
+    {
+        mIndex = index;
+        if (!mFilename.empty() && !fs::exists(getIndexFilename()))
+        {
+            mIndex->save(getIndexFilename(), mHash, fs::size(mFilename));
+        }
+    }
+}
+
+std::string
+Bucket::getIndexFilename() const
+{
+    return mFilename.empty() ? mFilename : mFilename + ".index";
+}
+
+bool
+Bucket::getBucketEntry(LedgerKey const& key, BucketEntry& out) const
+{
+    LedgerEntryIdCmp cmp;
+    auto entries = getEntries();
+    if (entries)
+    {
+        auto before = [&](BucketEntry const& e, LedgerKey const& k) {
+            return cmp(BucketIndex::getBucketEntryKey(e), k);
+        };
+        auto it =
+            std::lower_bound(entries->begin(), entries->end(), key, before);
+        if (it == entries->end() ||
+            cmp(key, BucketIndex::getBucketEntryKey(*it)))
+        {
+            return false;
+        }
+        out = *it;
+        return true;
+    }
+
+    auto index = getIndex();
+    size_t offset = 0;
+    if (!index || !index->mayContain(key) || !index->findPage(key, offset))
+    {
+        return false;
+    }
+
     BucketInputIterator iter(shared_from_this());
-    while (iter)
+    iter.seek(offset);
+    for (size_t i = 0; iter && i < BucketIndex::PAGE_SIZE; ++iter, ++i)
     {
-        if ((*iter).type() == LIVEENTRY)
+        auto k = BucketIndex::getBucketEntryKey(*iter);
+        if (cmp(key, k))
         {
-            ++live;
+            break;
         }
-        else
+        if (!cmp(k, key))
         {
-            ++dead;
+            out = *iter;
+            return true;
         }
-        ++iter;
     }
-    return std::make_pair(live, dead);
+    return false;
+}
+
+std::pair<size_t, size_t>
+Bucket::countLiveAndDeadEntries() const
+{
+    auto index = getIndex();
+    if (!index)
+    {
+        return std::make_pair(0, 0);
+    }
+    return std::make_pair(index->getLiveEntries(), index->getDeadEntries());
 }
 
 void
@@ -110,143 +226,390 @@ Bucket::apply(Database& db) const
     }
 }
 
+// Writes `entries`, sorted and with no two for the same key, to a bucket that
+// keeps them in memory. Its file is only synced later, on a worker thread.
+static std::shared_ptr<Bucket>
+writeInMemory(BucketManager& bucketManager,
+              std::shared_ptr<std::vector<BucketEntry>> entries)
+{
+    auto options = bucketManager.getWriteOptions();
+    bool sync = options.mSync;
+    options.mSync = false;
+    BucketOutputIterator out(bucketManager.getTmpDir(), true, options);
+    for (auto const& e : *entries)
+    {
+        out.put(e);
+    }
+    auto bucket = out.getBucket(bucketManager);
+    if (!bucket->getFilename().empty())
+    {
+        bucket->setEntries(std::move(entries));
+        if (sync)
+        {
+            bucketManager.syncLater(bucket);
+        }
+    }
+    return bucket;
+}
+
 std::shared_ptr<Bucket>
 Bucket::fresh(BucketManager& bucketManager,
               std::vector<LedgerEntry> const& liveEntries,
               std::vector<LedgerKey> const& deadEntries)
 {
-    std::vector<BucketEntry> live, dead, combined;
-    live.reserve(liveEntries.size());
-    dead.reserve(deadEntries.size());
+    auto entries = std::make_shared<std::vector<BucketEntry>>();
+    auto& v = *entries;
+    v.reserve(liveEntries.size() + deadEntries.size());
 
     for (auto const& e : liveEntries)
     {
-        BucketEntry ce;
-        ce.type(LIVEENTRY);
-        ce.liveEntry() = e;
-        live.push_back(ce);
+        v.emplace_back();
+        v.back().type(LIVEENTRY);
+        v.back().liveEntry() = e;
     }
 
     for (auto const& e : deadEntries)
     {
-        BucketEntry ce;
-        ce.type(DEADENTRY);
-        ce.deadEntry() = e;
-        dead.push_back(ce);
+        v.emplace_back();
+        v.back().type(DEADENTRY);
+        v.back().deadEntry() = e;
     }
 
-    std::sort(live.begin(), live.end(), BucketEntryIdCmp());
+    // The sort keeps dead entries after live ones for the same key, and the
+    // last entry for a key is kept: dead entries win, as they used to when
+    // the live and dead entries were written apart and then merged.
+    BucketEntryIdCmp cmp;
+    std::stable_sort(v.begin(), v.end(), cmp);
+    size_t n = 0;
+    for (size_t i = 0; i < v.size(); ++i)
+    {
+        if (n > 0 && !cmp(v[n - 1], v[i]))
+        {
+            v[n - 1] = std::move(v[i]);
+        }
+        else
+        {
+            if (n != i)
+            {
+                v[n] = std::move(v[i]);
+            }
+            ++n;
+        }
+    }
+    v.erase(v.begin() + n, v.end());
+
+    auto timer = LogSlowExecution("Bucket fresh");
+    return writeInMemory(bucketManager, std::move(entries));
+}
 
-    std::sort(dead.begin(), dead.end(), BucketEntryIdCmp());
+namespace
+{
+// Answers whether the keys of a merge, which come in increasing order, are in
+// a shadow bucket. Rather than stepping through the whole shadow alongside the
+// merge, it skips keys the shadow's bloom filter rules out and otherwise seeks
+// forward to the page that would hold the key, through the shadow's index.
+class ShadowLookup
+{
+    std::shared_ptr<BucketIndex const> mIndex;
+    BucketRawInputIterator mIter;
 
-    BucketOutputIterator liveOut(bucketManager.getTmpDir(), true);
-    BucketOutputIterator deadOut(bucketManager.getTmpDir(), true);
-    for (auto const& e : live)
+  public:
+    explicit ShadowLookup(std::shared_ptr<Bucket> const& shadow)
+        : mIndex(shadow->getIndex()), mIter(shadow)
     {
-        liveOut.put(e);
     }
-    for (auto const& e : dead)
+
+    bool
+    contains(LedgerKey const& key)
     {
-        deadOut.put(e);
+        size_t offset = 0;
+        if (!mIndex || !mIndex->mayContain(key) ||
+            !mIndex->findPage(key, offset))
+        {
+            return false;
+        }
+        // Keys only go up, so the iterator only moves forward: it is either
+        // still before the page, or somewhere at or after its start.
+        if (!mIter || mIter.pos() < offset)
+        {
+            mIter.seek(offset);
+        }
+        LedgerEntryIdCmp cmp;
+        while (mIter && cmp(mIter.key(), key))
+        {
+            ++mIter;
+        }
+        return mIter && !cmp(key, mIter.key());
     }
 
-    auto liveBucket = liveOut.getBucket(bucketManager);
-    auto deadBucket = deadOut.getBucket(bucketManager);
-
-    std::shared_ptr<Bucket> bucket;
+    size_t
+    bytesRead() const
     {
-        auto timer = LogSlowExecution("Bucket merge");
-        bucket = Bucket::merge(bucketManager, liveBucket, deadBucket);
+        return mIter.bytesRead();
     }
-    return bucket;
+};
 }
 
 inline void
-maybePut(BucketOutputIterator& out, BucketEntry const& entry,
-         std::vector<BucketInputIterator>& shadowIterators)
+maybePut(BucketOutputIterator& out, BucketRawInputIterator const& entry,
+         std::vector<ShadowLookup>& shadowLookups)
 {
-    BucketEntryIdCmp cmp;
-    for (auto& si : shadowIterators)
+    for (auto& sl : shadowLookups)
     {
-        // Advance the shadowIterator while it's less than the candidate
-        while (si && cmp(*si, entry))
+        if (sl.contains(entry.key()))
         {
-            ++si;
-        }
-        // We have stepped si forward to the point that either si is exhausted,
-        // or else *si >= entry; we now check the opposite direction to see if
-        // we have equality.
-        if (si && !cmp(entry, *si))
-        {
-            // If so, then entry is shadowed in at least one level and we will
-            // not be doing a 'put'; we return early. There is no need to
-            // advance the other iterators, they will advance as and if
-            // necessary in future calls to maybePut.
+            // The entry is shadowed in at least one level and we will not be
+            // doing a 'put'.
             return;
         }
     }
     // Nothing shadowed.
-    out.put(entry);
+    out.putRaw(entry.key(), entry.isDead(), entry.data(), entry.size());
 }
 
-std::shared_ptr<Bucket>
-Bucket::merge(BucketManager& bucketManager,
-              std::shared_ptr<Bucket> const& oldBucket,
-              std::shared_ptr<Bucket> const& newBucket,
-              std::vector<std::shared_ptr<Bucket>> const& shadows,
-              bool keepDeadEntries)
+// Moves `iter` forward to the first entry with a key >= `key`.
+static void
+seekToKey(BucketRawInputIterator& iter,
+          std::shared_ptr<BucketIndex const> const& index, LedgerKey const& key)
 {
-    // This is the key operation in the scheme: merging two (read-only)
-    // buckets together into a new 3rd bucket, while calculating its hash,
-    // in a single pass.
-
-    assert(oldBucket);
-    assert(newBucket);
-
-    BucketInputIterator oi(oldBucket);
-    BucketInputIterator ni(newBucket);
+    size_t offset = 0;
+    if (index && index->findPage(key, offset) && iter && iter.pos() < offset)
+    {
+        iter.seek(offset);
+    }
+    LedgerEntryIdCmp cmp;
+    while (iter && cmp(iter.key(), key))
+    {
+        ++iter;
+    }
+}
 
-    std::vector<BucketInputIterator> shadowIterators(shadows.begin(),
-                                                     shadows.end());
+// Merges the entries of `oldBucket` and `newBucket` with keys in [begin, end)
+// into `out`, where a null bound is open. Returns the bytes of shadows read.
+static size_t
+mergeRange(BucketOutputIterator& out, std::shared_ptr<Bucket> const& oldBucket,
+           std::shared_ptr<Bucket> const& newBucket,
+           std::vector<std::shared_ptr<Bucket>> const& shadows,
+           LedgerKey const* begin, LedgerKey const* end)
+{
+    BucketRawInputIterator oi(oldBucket);
+    BucketRawInputIterator ni(newBucket);
+    if (begin)
+    {
+        seekToKey(oi, oldBucket->getIndex(), *begin);
+        seekToKey(ni, newBucket->getIndex(), *begin);
+    }
 
-    auto timer = bucketManager.getMergeTimer().TimeScope();
-    BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries);
+    std::vector<ShadowLookup> shadowLookups;
+    shadowLookups.reserve(shadows.size());
+    for (auto const& s : shadows)
+    {
+        shadowLookups.emplace_back(s);
+    }
 
-    BucketEntryIdCmp cmp;
-    while (oi || ni)
+    LedgerEntryIdCmp cmp;
+    auto inRange = [&](BucketRawInputIterator const& iter) {
+        return iter && (!end || cmp(iter.key(), *end));
+    };
+    for (bool o = inRange(oi), n = inRange(ni); o || n;
+         o = inRange(oi), n = inRange(ni))
     {
-        if (!ni)
+        if (!n)
         {
             // Out of new entries, take old entries.
-            maybePut(out, *oi, shadowIterators);
+            maybePut(out, oi, shadowLookups);
             ++oi;
         }
-        else if (!oi)
+        else if (!o)
         {
             // Out of old entries, take new entries.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, ni, shadowLookups);
             ++ni;
         }
-        else if (cmp(*oi, *ni))
+        else if (cmp(oi.key(), ni.key()))
         {
             // Next old-entry has smaller key, take it.
-            maybePut(out, *oi, shadowIterators);
+            maybePut(out, oi, shadowLookups);
             ++oi;
         }
-        else if (cmp(*ni, *oi))
+        else if (cmp(ni.key(), oi.key()))
         {
             // Next new-entry has smaller key, take it.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, ni, shadowLookups);
             ++ni;
         }
         else
         {
             // Old and new are for the same key, take new.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, ni, shadowLookups);
             ++oi;
             ++ni;
         }
     }
+
+    size_t shadowBytes = 0;
+    for (auto const& sl : shadowLookups)
+    {
+        shadowBytes += sl.bytesRead();
+    }
+    return shadowBytes;
+}
+
+// Merges two buckets that keep their entries in memory, with no shadows, into
+// another such bucket.
+static std::shared_ptr<Bucket>
+mergeInMemory(BucketManager& bucketManager,
+              std::vector<BucketEntry> const& oldEntries,
+              std::vector<BucketEntry> const& newEntries, bool keepDeadEntries)
+{
+    auto entries = std::make_shared<std::vector<BucketEntry>>();
+    entries->reserve(oldEntries.size() + newEntries.size());
+    auto take = [&](BucketEntry const& e) {
+        if (keepDeadEntries || e.type() != DEADENTRY)
+        {
+            entries->push_back(e);
+        }
+    };
+
+    BucketEntryIdCmp cmp;
+    auto oi = oldEntries.begin();
+    auto ni = newEntries.begin();
+    while (oi != oldEntries.end() || ni != newEntries.end())
+    {
+        if (ni == newEntries.end() ||
+            (oi != oldEntries.end() && cmp(*oi, *ni)))
+        {
+            take(*oi++);
+        }
+        else if (oi == oldEntries.end() || cmp(*ni, *oi))
+        {
+            take(*ni++);
+        }
+        else
+        {
+            // Old and new are for the same key, take new.
+            take(*ni++);
+            ++oi;
+        }
+    }
+    return writeInMemory(bucketManager, std::move(entries));
+}
+
+// Keys splitting the larger of `a` and `b` into at most `parts` runs of
+// roughly as many entries (see BucketIndex::getShardOffsets).
+static std::vector<LedgerKey>
+splitKeys(std::shared_ptr<Bucket> const& a, std::shared_ptr<Bucket> const& b,
+          size_t parts)
+{
+    std::vector<LedgerKey> keys;
+    if (parts <= 1)
+    {
+        return keys;
+    }
+    auto ai = a->getIndex();
+    auto bi = b->getIndex();
+    auto const& larger = (!bi || (ai && ai->size() >= bi->size())) ? a : b;
+    auto index = larger == a ? ai : bi;
+    if (!index || index->size() == 0)
+    {
+        return keys;
+    }
+    auto offsets = index->getShardOffsets(parts);
+    BucketRawInputIterator iter(larger);
+    for (size_t i = 1; i < offsets.size(); ++i)
+    {
+        iter.seek(offsets[i]);
+        assert(iter);
+        keys.emplace_back(iter.key());
+    }
+    return keys;
+}
+
+std::shared_ptr<Bucket>
+Bucket::merge(BucketManager& bucketManager,
+              std::shared_ptr<Bucket> const& oldBucket,
+              std::shared_ptr<Bucket> const& newBucket,
+              std::vector<std::shared_ptr<Bucket>> const& shadows,
+              bool keepDeadEntries, size_t parts)
+{
+    // This is the key operation in the scheme: merging two (read-only)
+    // buckets together into a new 3rd bucket, while calculating its hash,
+    // in a single pass.
+    //
+    // Only the keys of entries are decoded; the entries that make it into
+    // the output are copied over as they are, which produces the same bytes
+    // (and so the same hash) as decoding and re-encoding them would.
+    //
+    // Since buckets are sorted, key ranges of the inputs can also be merged
+    // independently. When asked to, we cut the key space at page boundaries
+    // of the larger input and merge each range on its own thread (this one
+    // doing the first) into an unhashed part file; the parts are then
+    // appended to the output in order, which hashes them as a single pass
+    // would have.
+    //
+    // Small buckets that keep their entries in memory (see fresh()) are
+    // merged from those, when there are no shadows to consult and no parts
+    // asked for.
+
+    assert(oldBucket);
+    assert(newBucket);
+
+    auto timer = bucketManager.getMergeTimer().TimeScope();
+    if (shadows.empty() && parts <= 1)
+    {
+        auto oldEntries = oldBucket->getEntries();
+        auto newEntries = newBucket->getEntries();
+        if (oldEntries && newEntries)
+        {
+            return mergeInMemory(bucketManager, *oldEntries, *newEntries,
+                                 keepDeadEntries);
+        }
+    }
+
+    auto const& tmpDir = bucketManager.getTmpDir();
+    auto const& options = bucketManager.getWriteOptions();
+    BucketOutputIterator out(tmpDir, keepDeadEntries, options);
+
+    size_t shadowBytes = 0;
+    auto bounds = splitKeys(oldBucket, newBucket, parts);
+    if (bounds.empty())
+    {
+        shadowBytes = mergeRange(out, oldBucket, newBucket, shadows, nullptr,
+                                 nullptr);
+    }
+    else
+    {
+        // parts are read back right away, syncing them would be wasted
+        auto partOptions = options;
+        partOptions.mSync = false;
+        std::vector<std::unique_ptr<BucketOutputIterator>> partOuts;
+        for (size_t i = 0; i <= bounds.size(); ++i)
+        {
+            partOuts.emplace_back(std::make_unique<BucketOutputIterator>(
+                tmpDir, keepDeadEntries, partOptions, false));
+        }
+        std::vector<std::future<size_t>> done;
+        for (size_t i = 1; i <= bounds.size(); ++i)
+        {
+            auto end = i < bounds.size() ? &bounds[i] : nullptr;
+            done.emplace_back(std::async(std::launch::async, [&, i, end]() {
+                return mergeRange(*partOuts[i], oldBucket, newBucket, shadows,
+                                  &bounds[i - 1], end);
+            }));
+        }
+        shadowBytes = mergeRange(*partOuts[0], oldBucket, newBucket, shadows,
+                                 nullptr, &bounds[0]);
+        for (auto& f : done)
+        {
+            shadowBytes += f.get();
+        }
+        for (auto& part : partOuts)
+        {
+            out.append(*part);
+        }
+    }
+
+    bucketManager.getMergeShadowBytes().Update(shadowBytes);
     return out.getBucket(bucketManager);
 }
 
@@ -262,17 +625,17 @@ compareSizes(std::string const& objType, uint64_t inDatabase,
     }
 }
 
-// FIXME issue NNN: this should be refactored to run in a read-transaction on a
-// background thread and take a soci::session& rather than Database&. For now we
-// code it to run on main thread because there's a bunch of code to move around
-// in the ledger frames and db layer to make that work.
+// Runs on the main thread so that the database stays put while it is compared
+// with the bucket list; the comparison itself is spread over worker threads
+// (see BucketDBChecker).
 
 void
-checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
-                      BucketManager& bucketManager, Database& db,
-                      BucketList& bl)
+checkDBAgainstBuckets(Application& app)
 {
     CLOG(INFO, "Bucket") << "CheckDB starting";
+    auto& metrics = app.getMetrics();
+    auto& bucketManager = app.getBucketManager();
+    auto& bl = bucketManager.getBucketList();
     auto execTimer =
         metrics.NewTimer({"bucket", "checkdb", "execute"}).TimeScope();
 
@@ -315,54 +678,31 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
 
     CLOG(INFO, "Bucket") << "CheckDB starting object comparison";
 
-    // Step 3: scan the superbucket, checking each object against the DB and
-    // counting objects along the way.
-    uint64_t nAccounts = 0, nTrustLines = 0, nOffers = 0, nData = 0;
+    // Step 3: check the superbucket against the DB, counting objects along
+    // the way.
+    BucketDBChecker::Result result;
     {
         auto& meter = metrics.NewMeter({"bucket", "checkdb", "object-compare"},
                                        "comparison");
         auto compareTimer =
             metrics.NewTimer({"bucket", "checkdb", "compare"}).TimeScope();
-        for (BucketInputIterator iter(superBucket); iter; ++iter)
+        result = BucketDBChecker::check(
+            app, superBucket, 0, std::numeric_limits<uint32_t>::max(), meter);
+        if (!result.mError.empty())
         {
-            meter.Mark();
-            auto& e = *iter;
-            if (e.type() == LIVEENTRY)
-            {
-                switch (e.liveEntry().data.type())
-                {
-                case ACCOUNT:
-                    ++nAccounts;
-                    break;
-                case TRUSTLINE:
-                    ++nTrustLines;
-                    break;
-                case OFFER:
-                    ++nOffers;
-                    break;
-                case DATA:
-                    ++nData;
-                    break;
-                }
-                auto s = EntryFrame::checkAgainstDatabase(e.liveEntry(), db);
-                if (!s.empty())
-                {
-                    throw std::runtime_error{s};
-                }
-                if (meter.count() % 100 == 0)
-                {
-                    CLOG(INFO, "Bucket")
-                        << "CheckDB compared " << meter.count() << " objects";
-                }
-            }
+            throw std::runtime_error{result.mError};
         }
+        CLOG(INFO, "Bucket")
+            << "CheckDB compared " << meter.count() << " objects";
     }
 
     // Step 4: confirm size of datasets matches size of datasets in DB.
-    soci::session& sess = db.getSession();
-    compareSizes("account", AccountFrame::countObjects(sess), nAccounts);
-    compareSizes("trustline", TrustFrame::countObjects(sess), nTrustLines);
-    compareSizes("offer", OfferFrame::countObjects(sess), nOffers);
-    compareSizes("data", DataFrame::countObjects(sess), nData);
+    soci::session& sess = app.getDatabase().getSession();
+    compareSizes("account", AccountFrame::countObjects(sess),
+                 result.mAccounts);
+    compareSizes("trustline", TrustFrame::countObjects(sess),
+                 result.mTrustLines);
+    compareSizes("offer", OfferFrame::countObjects(sess), result.mOffers);
+    compareSizes("data", DataFrame::countObjects(sess), result.mData);
 }
 }
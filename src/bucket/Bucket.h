@@ -9,7 +9,10 @@
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include "util/XDRStream.h"
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace medida
 {
@@ -30,9 +33,12 @@ namespace stellar
  * merged in sorted order, and all elements are hashed while being added.
  */
 
+class Application;
+class BucketIndex;
 class BucketManager;
 class BucketList;
 class Database;
+class FileIOMetrics;
 
 class Bucket : public std::enable_shared_from_this<Bucket>,
                public NonMovableOrCopyable
@@ -40,6 +46,17 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
 
     std::string const mFilename;
     Hash const mHash;
+    FileIOMetrics* const mReadMetrics{nullptr};
+
+    // Point-lookup index; set when the bucket is produced by fresh/merge, or
+    // built lazily on first use for buckets loaded from disk.
+    mutable std::mutex mIndexMutex;
+    mutable std::shared_ptr<BucketIndex const> mIndex;
+
+    // The bucket's entries, in order, for small buckets made by fresh() or by
+    // merging two such buckets without shadows; null otherwise. Guarded by
+    // mIndexMutex.
+    mutable std::shared_ptr<std::vector<BucketEntry> const> mEntries;
 
   public:
     // Create an empty bucket. The empty bucket has hash '000000...' and its
@@ -48,18 +65,50 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
 
     // Construct a bucket with a given filename and hash. Asserts that the file
     // exists, but does not check that the hash is the bucket's hash. Caller
-    // needs to ensure that.
-    Bucket(std::string const& filename, Hash const& hash);
+    // needs to ensure that. Reads of the file are reported to `readMetrics`,
+    // if not null.
+    Bucket(std::string const& filename, Hash const& hash,
+           FileIOMetrics* readMetrics = nullptr);
 
     Hash const& getHash() const;
     std::string const& getFilename() const;
+    FileIOMetrics* getReadMetrics() const;
 
     // Returns true if a BucketEntry that is key-wise identical to the given
     // BucketEntry exists in the bucket. For testing.
     bool containsBucketIdentity(BucketEntry const& id) const;
 
-    // Return the count of live and dead BucketEntries in the bucket. For
-    // testing.
+    // Return the bucket's index, reading it from getIndexFilename() or else
+    // building it (and saving it there) if the bucket doesn't have one yet.
+    // Returns nullptr for the empty bucket.
+    std::shared_ptr<BucketIndex const> getIndex() const;
+
+    // Approximate bytes the bucket holds in memory, mostly its index if it
+    // has one loaded; does not load it.
+    size_t getMemoryBytes() const;
+
+    // Attach an index built while writing the bucket, if it has none yet,
+    // saving it to getIndexFilename().
+    void setIndex(std::shared_ptr<BucketIndex const> index) const;
+
+    // The bucket's entries if it keeps them in memory (see fresh()), else
+    // null. The empty bucket has an empty vector of them.
+    std::shared_ptr<std::vector<BucketEntry> const> getEntries() const;
+
+    // Keep `entries`, which must be the bucket's entries in order, in memory.
+    void
+    setEntries(std::shared_ptr<std::vector<BucketEntry> const> entries) const;
+
+    // File the bucket's index is kept in, next to the bucket's file.
+    std::string getIndexFilename() const;
+
+    // Look up the entry (live or dead) for `key` using the bucket's index,
+    // reading at most one index page from the file. Returns true and sets
+    // `out` if found.
+    bool getBucketEntry(LedgerKey const& key, BucketEntry& out) const;
+
+    // Return the count of live and dead BucketEntries in the bucket, as
+    // recorded by its index.
     std::pair<size_t, size_t> countLiveAndDeadEntries() const;
 
     // "Applies" the bucket to the database. For each entry in the bucket, if
@@ -71,6 +120,12 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // Create a fresh bucket from a given vector of live LedgerEntries and
     // dead LedgerEntryKeys. The bucket will be sorted, hashed, and adopted
     // in the provided BucketManager.
+    //
+    // The bucket keeps its entries in memory, and so do the buckets merged
+    // from two such buckets without shadows (those of levels 0 and 1 of the
+    // BucketList); those merges are done in memory. The file of such a bucket
+    // is written and hashed at once, but only synced to disk later, on a
+    // worker thread (see BucketManager::syncLater).
     static std::shared_ptr<Bucket>
     fresh(BucketManager& bucketManager,
           std::vector<LedgerEntry> const& liveEntries,
@@ -80,16 +135,17 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // are overridden in the fresh bucket by keywise-equal entries in
     // `newBucket`. Entries are inhibited from the fresh bucket by keywise-equal
     // entries in any of the buckets in the provided `shadows` vector.
+    //
+    // With `parts` > 1 the key space is split into up to that many ranges,
+    // merged at once on threads of their own.
     static std::shared_ptr<Bucket>
     merge(BucketManager& bucketManager,
           std::shared_ptr<Bucket> const& oldBucket,
           std::shared_ptr<Bucket> const& newBucket,
           std::vector<std::shared_ptr<Bucket>> const& shadows =
               std::vector<std::shared_ptr<Bucket>>(),
-          bool keepDeadEntries = true);
+          bool keepDeadEntries = true, size_t parts = 1);
 };
 
-void checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
-                           BucketManager& bucketManager, Database& db,
-                           BucketList& bl);
+void checkDBAgainstBuckets(Application& app);
 }
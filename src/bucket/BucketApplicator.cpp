@@ -5,54 +5,114 @@
 #include "util/asio.h"
 #include "bucket/BucketApplicator.h"
 #include "bucket/Bucket.h"
-#include "ledger/LedgerDelta.h"
+#include "ledger/EntryFrame.h"
 #include "util/Logging.h"
 
 namespace stellar
 {
 
+size_t const BucketApplicator::BATCH_SIZE = 0x100;
+
 BucketApplicator::BucketApplicator(Database& db,
-                                   std::shared_ptr<const Bucket> bucket)
-    : mDb(db), mBucketIter(bucket)
+                                   std::shared_ptr<const Bucket> bucket,
+                                   WorkerLanes* workerLanes)
+    : mDb(db), mBucketIter(bucket, true), mWorkerLanes(workerLanes)
+{
+    // Start decoding right away: when several applicators are created up
+    // front (eg. snap and curr of a level) the later ones have their first
+    // batch ready by the time the earlier ones are done.
+    prefetchBatch();
+}
+
+BucketApplicator::~BucketApplicator()
 {
+    // The worker task references mBucketIter, so it must finish before the
+    // iterator is destroyed.
+    if (mNextBatch.valid())
+    {
+        mNextBatch.wait();
+    }
 }
 
 BucketApplicator::operator bool() const
 {
-    return (bool)mBucketIter;
+    // mBucketIter must not be touched while a worker task owns it.
+    return mNextBatch.valid() || (bool)mBucketIter;
+}
+
+std::vector<BucketEntry>
+BucketApplicator::readBatch()
+{
+    std::vector<BucketEntry> batch;
+    batch.reserve(BATCH_SIZE);
+    while (mBucketIter && batch.size() < BATCH_SIZE)
+    {
+        batch.emplace_back(*mBucketIter);
+        ++mBucketIter;
+    }
+    mReadPos = mBucketIter.pos();
+    return batch;
+}
+
+void
+BucketApplicator::prefetchBatch()
+{
+    if (!mWorkerLanes || !mBucketIter)
+    {
+        return;
+    }
+
+    using task_t = std::packaged_task<std::vector<BucketEntry>()>;
+    std::shared_ptr<task_t> task =
+        std::make_shared<task_t>([this]() { return readBatch(); });
+    mNextBatch = task->get_future();
+    mWorkerLanes->post(WorkerLane::CATCHUP,
+                       bind(&task_t::operator(), task));
 }
 
 void
 BucketApplicator::advance()
 {
-    soci::transaction sqlTx(mDb.getSession());
-    while (mBucketIter)
+    std::vector<BucketEntry> batch;
+    if (mNextBatch.valid())
+    {
+        batch = mNextBatch.get();
+        // read before the worker task below moves it on
+        mPos = mReadPos;
+        // Decode the following batch while this one is written out.
+        prefetchBatch();
+    }
+    else
     {
-        LedgerHeader lh;
-        LedgerDelta delta(lh, mDb, false);
+        batch = readBatch();
+        mPos = mReadPos;
+    }
 
-        auto const& entry = *mBucketIter;
+    std::vector<LedgerEntry> live;
+    std::vector<LedgerKey> dead;
+    for (auto const& entry : batch)
+    {
         if (entry.type() == LIVEENTRY)
         {
-            EntryFrame::pointer ep = EntryFrame::FromXDR(entry.liveEntry());
-            ep->storeAddOrChange(delta, mDb);
+            live.emplace_back(entry.liveEntry());
         }
         else
         {
-            EntryFrame::storeDelete(delta, mDb, entry.deadEntry());
-        }
-        ++mBucketIter;
-        // No-op, just to avoid needless rollback.
-        delta.commit();
-        if ((++mSize & 0xff) == 0xff)
-        {
-            break;
+            dead.emplace_back(entry.deadEntry());
         }
     }
+
+    // Keys are unique within a bucket, so the upserts and deletes of a batch
+    // can be issued as a few multi-row statements in any order.
+    soci::transaction sqlTx(mDb.getSession());
+    EntryFrame::storeAddOrChangeBulk(mDb, live);
+    EntryFrame::storeDeleteBulk(mDb, dead);
     sqlTx.commit();
-    mDb.clearPreparedStatementCache();
+    mDb.trimPreparedStatementCache();
 
-    if (!mBucketIter || (mSize & 0xfff) == 0xfff)
+    size_t prevSize = mSize;
+    mSize += batch.size();
+    if (!*this || (prevSize >> 12) != (mSize >> 12))
     {
         CLOG(INFO, "Bucket")
             << "Bucket-apply: committed " << mSize << " entries";
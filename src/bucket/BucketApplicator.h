@@ -4,11 +4,15 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketInputIterator.h"
 #include "database/Database.h"
+#include "util/WorkerLanes.h"
 #include "util/XDRStream.h"
+#include <future>
 #include <memory>
+#include <vector>
 
 namespace stellar
 {
@@ -18,16 +22,46 @@ class Database;
 // Class that represents a single apply-bucket-to-database operation in
 // progress. Used during history catchup to split up the task of applying
 // bucket into scheduler-friendly, bite-sized pieces.
+//
+// If constructed with the worker lanes, reading and decoding of the next
+// batch of entries is done on a worker thread while the current batch is
+// written to the database. All database writes still happen, in bucket
+// order, on the thread calling advance().
 
 class BucketApplicator
 {
     Database& mDb;
     BucketInputIterator mBucketIter;
     size_t mSize{0};
+    // bucket file offset after the last batch read, and applied
+    size_t mReadPos{0};
+    size_t mPos{0};
+
+    WorkerLanes* mWorkerLanes;
+    std::future<std::vector<BucketEntry>> mNextBatch;
+
+    std::vector<BucketEntry> readBatch();
+    void prefetchBatch();
 
   public:
-    BucketApplicator(Database& db, std::shared_ptr<const Bucket> bucket);
+    static size_t const BATCH_SIZE;
+
+    BucketApplicator(Database& db, std::shared_ptr<const Bucket> bucket,
+                     WorkerLanes* workerLanes = nullptr);
+    ~BucketApplicator();
     operator bool() const;
     void advance();
+
+    // Number of entries, and bytes of the bucket file, applied so far.
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+    size_t
+    pos() const
+    {
+        return mPos;
+    }
 };
 }
@@ -0,0 +1,243 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketApplicator.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "crypto/SHA.h"
+#include "database/Database.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "xdrpp/autocheck.h"
+#include "xdrpp/marshal.h"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Benchmarks of the bucket code paths that dominate catchup. Each logs the
+// entries/s and bytes/s (of bucket file, or of XDR for addBatch) it achieves
+// and the peak RSS of the process so far; as the latter never goes down, run
+// them one at a time (eg. --test "bucket merge benchmark") to see the peak of
+// each.
+
+namespace stellar
+{
+
+namespace
+{
+
+size_t
+peakRSS()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+void
+report(std::string const& what, size_t entries, size_t bytes,
+       std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    LOG(INFO) << "Bucket bench " << what << ": " << entries << " entries, "
+              << bytes << " bytes in " << elapsed.count() << "s, "
+              << (entries / elapsed.count()) << " entries/s, "
+              << (bytes / elapsed.count() / (1024 * 1024)) << " MiB/s, "
+              << (peakRSS() / (1024 * 1024)) << " MiB peak RSS";
+}
+
+std::vector<LedgerKey>
+deadKeys(size_t n)
+{
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerKey> dead(n);
+    for (auto& k : dead)
+    {
+        k = deadGen(3);
+    }
+    return dead;
+}
+}
+
+TEST_CASE("bucket fresh benchmark", "[bucketbench][bench][!hide]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    auto& bm = app->getBucketManager();
+
+    for (size_t n : {10000, 100000, 500000})
+    {
+        auto live = LedgerTestUtils::generateValidLedgerEntries(n);
+        auto dead = deadKeys(n / 10);
+
+        auto start = std::chrono::steady_clock::now();
+        auto b = Bucket::fresh(bm, live, dead);
+        report("fresh", live.size() + dead.size(),
+               fileSize(b->getFilename()), start);
+    }
+}
+
+TEST_CASE("bucket merge benchmark", "[bucketbench][bench][!hide]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    auto& bm = app->getBucketManager();
+
+    size_t const n = 200000;
+    auto oldLive = LedgerTestUtils::generateValidLedgerEntries(n);
+    auto oldBucket = Bucket::fresh(bm, oldLive, deadKeys(n / 10));
+
+    for (size_t overlap : {0, 10, 50, 100})
+    {
+        // the new bucket updates `overlap` percent of the old entries
+        auto newLive = LedgerTestUtils::generateValidLedgerEntries(n / 10);
+        for (size_t i = 0; i < newLive.size() * overlap / 100; ++i)
+        {
+            newLive[i] = oldLive[i * 10];
+        }
+        auto newBucket = Bucket::fresh(bm, newLive, deadKeys(n / 100));
+
+        for (size_t nShadows : {0, 1, 4})
+        {
+            // shadows hold entries of the old bucket, as those of the levels
+            // above it do
+            std::vector<std::shared_ptr<Bucket>> shadows;
+            for (size_t s = 0; s < nShadows; ++s)
+            {
+                std::vector<LedgerEntry> shadowLive(
+                    oldLive.begin() + s * (n / 20),
+                    oldLive.begin() + (s + 1) * (n / 20));
+                shadows.push_back(Bucket::fresh(bm, shadowLive, {}));
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            auto merged = Bucket::merge(bm, oldBucket, newBucket, shadows);
+            auto counts = merged->countLiveAndDeadEntries();
+            report("merge " + std::to_string(overlap) + "% overlap " +
+                       std::to_string(nShadows) + " shadows",
+                   counts.first + counts.second,
+                   fileSize(merged->getFilename()), start);
+        }
+    }
+}
+
+TEST_CASE("bucket hash benchmark", "[bucketbench][bench][!hide]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(500000);
+    auto b = Bucket::fresh(app->getBucketManager(), live, {});
+
+    // as VerifyBucketWork hashes downloaded buckets
+    auto start = std::chrono::steady_clock::now();
+    auto hasher = SHA256::create();
+    std::ifstream in(b->getFilename(), std::ifstream::binary);
+    char buf[4096];
+    while (in)
+    {
+        in.read(buf, sizeof(buf));
+        hasher->add(ByteSlice(buf, in.gcount()));
+    }
+    REQUIRE(hasher->finish() == b->getHash());
+    report("hash", live.size(), fileSize(b->getFilename()), start);
+}
+
+TEST_CASE("bucket applicator benchmark", "[bucketbench][bench][!hide]")
+{
+    auto runtest = [](Config::TestDbMode mode, std::string const& name) {
+        VirtualClock clock;
+        Application::pointer app =
+            createTestApplication(clock, getTestConfig(0, mode));
+        app->start();
+
+        std::vector<LedgerEntry> live(100000);
+        for (auto& l : live)
+        {
+            l.data.type(ACCOUNT);
+            l.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        }
+        auto b = Bucket::fresh(app->getBucketManager(), live, {});
+
+        auto start = std::chrono::steady_clock::now();
+        BucketApplicator applicator(app->getDatabase(), b,
+                                    &app->getWorkerLanes());
+        while (applicator)
+        {
+            applicator.advance();
+        }
+        report("apply " + name, applicator.size(), applicator.pos(), start);
+    };
+
+    SECTION("sqlite")
+    {
+        runtest(Config::TESTDB_ON_DISK_SQLITE, "sqlite");
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runtest(Config::TESTDB_POSTGRESQL, "postgresql");
+    }
+#endif
+}
+
+TEST_CASE("bucket list addBatch benchmark", "[bucketbench][bench][!hide]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+
+    for (size_t batchSize : {10, 100, 1000})
+    {
+        // generated beforehand, so that only addBatch and the merges it
+        // waits for are timed
+        uint32_t const ledgers = 1024;
+        std::vector<std::vector<LedgerEntry>> batches;
+        size_t entries = 0;
+        size_t bytes = 0;
+        for (uint32_t i = 0; i < ledgers; ++i)
+        {
+            batches.push_back(
+                LedgerTestUtils::generateValidLedgerEntries(batchSize));
+            for (auto const& e : batches.back())
+            {
+                bytes += xdr::xdr_size(e);
+            }
+            entries += batchSize;
+        }
+        auto dead = deadKeys(batchSize / 10);
+
+        BucketList bl;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < ledgers; ++i)
+        {
+            bl.addBatch(*app, i + 1, batches[i], dead);
+        }
+        report("addBatch " + std::to_string(batchSize) + " entries x " +
+                   std::to_string(ledgers) + " ledgers",
+               entries, bytes, start);
+    }
+}
+}
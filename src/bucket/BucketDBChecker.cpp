@@ -0,0 +1,285 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// ASIO is somewhat particular about when it gets included -- it wants to be the
+// first to include <windows.h> -- so we try to include it before everything
+// else.
+#include "util/asio.h"
+#include "bucket/BucketDBChecker.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/LedgerCmp.h"
+#include "database/Database.h"
+#include "database/EntryCache.h"
+#include "ledger/EntryFrame.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "medida/meter.h"
+#include "util/GlobalChecks.h"
+#include "util/Logging.h"
+#include "xdrpp/printer.h"
+
+#include <future>
+#include <limits>
+#include <unordered_map>
+
+namespace stellar
+{
+
+namespace
+{
+
+struct Shard
+{
+    size_t mBegin;
+    size_t mEnd;
+    BucketDBChecker::Result mResult;
+    BucketEntry mFirst;
+    BucketEntry mLast;
+};
+
+// Check `batch` (in bucket order) against the database, returning the error
+// for its first entry that does not match.
+std::string
+checkBatch(soci::session& sess, std::vector<BucketEntry> const& batch)
+{
+    std::vector<LedgerKey> keys;
+    keys.reserve(batch.size());
+    for (auto const& e : batch)
+    {
+        keys.emplace_back(BucketIndex::getBucketEntryKey(e));
+    }
+
+    std::unordered_map<LedgerKey, LedgerEntry, LedgerKeyHash> fromDb;
+    EntryFrame::loadBulk(sess, keys, [&fromDb](LedgerEntry const& le) {
+        fromDb.emplace(LedgerEntryKey(le), le);
+    });
+
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        auto it = fromDb.find(keys[i]);
+        if (batch[i].type() == LIVEENTRY)
+        {
+            auto s = EntryFrame::checkAgainstLoaded(
+                batch[i].liveEntry(),
+                it == fromDb.end() ? nullptr : &it->second);
+            if (!s.empty())
+            {
+                return s;
+            }
+        }
+        else if (it != fromDb.end())
+        {
+            std::string s = "Entry with type DEADENTRY found in database ";
+            s += xdr::xdr_to_string(it->second, "db");
+            return s;
+        }
+    }
+    return {};
+}
+
+std::string
+checkEntry(BucketEntry const& e, uint32_t oldestLedger, uint32_t newestLedger,
+           BucketDBChecker::Result& result)
+{
+    if (e.type() != LIVEENTRY)
+    {
+        return {};
+    }
+
+    if (e.liveEntry().lastModifiedLedgerSeq < oldestLedger)
+    {
+        auto s = fmt::format("lastModifiedLedgerSeq beneath lower"
+                             " bound for this bucket ({} < {}): ",
+                             e.liveEntry().lastModifiedLedgerSeq, oldestLedger);
+        s += xdr::xdr_to_string(e.liveEntry(), "live");
+        return s;
+    }
+    if (e.liveEntry().lastModifiedLedgerSeq > newestLedger)
+    {
+        auto s = fmt::format("lastModifiedLedgerSeq above upper"
+                             " bound for this bucket ({} > {}): ",
+                             e.liveEntry().lastModifiedLedgerSeq, newestLedger);
+        s += xdr::xdr_to_string(e.liveEntry(), "live");
+        return s;
+    }
+
+    switch (e.liveEntry().data.type())
+    {
+    case ACCOUNT:
+        ++result.mAccounts;
+        break;
+    case TRUSTLINE:
+        ++result.mTrustLines;
+        break;
+    case OFFER:
+        ++result.mOffers;
+        break;
+    case DATA:
+        ++result.mData;
+        break;
+    default:
+        abort();
+    }
+    return {};
+}
+
+std::string
+outOfOrder(BucketEntry const& previous, BucketEntry const& current)
+{
+    std::string s = "Bucket has out of order entries: ";
+    s += xdr::xdr_to_string(previous, "previous");
+    s += xdr::xdr_to_string(current, "current");
+    return s;
+}
+
+void
+checkShard(soci::session& sess, std::shared_ptr<Bucket const> bucket,
+           uint32_t oldestLedger, uint32_t newestLedger, medida::Meter& meter,
+           Shard& shard)
+{
+    auto& result = shard.mResult;
+    std::vector<BucketEntry> batch;
+    bool first = true;
+    BucketInputIterator iter(bucket, true);
+    if (shard.mBegin != 0)
+    {
+        iter.seek(shard.mBegin);
+    }
+    for (; iter && iter.pos() < shard.mEnd; ++iter)
+    {
+        meter.Mark();
+        auto const& e = *iter;
+        if (first)
+        {
+            shard.mFirst = e;
+            first = false;
+        }
+        else if (!BucketEntryIdCmp{}(shard.mLast, e))
+        {
+            result.mError = outOfOrder(shard.mLast, e);
+        }
+        shard.mLast = e;
+
+        if (result.mError.empty())
+        {
+            result.mError = checkEntry(e, oldestLedger, newestLedger, result);
+        }
+        if (!result.mError.empty())
+        {
+            // entries before this one come first
+            auto s = checkBatch(sess, batch);
+            if (!s.empty())
+            {
+                result.mError = s;
+            }
+            return;
+        }
+
+        batch.emplace_back(e);
+        if (batch.size() == BucketDBChecker::BATCH_SIZE)
+        {
+            result.mError = checkBatch(sess, batch);
+            if (!result.mError.empty())
+            {
+                return;
+            }
+            batch.clear();
+        }
+    }
+    result.mError = checkBatch(sess, batch);
+}
+}
+
+BucketDBChecker::Result
+BucketDBChecker::check(Application& app, std::shared_ptr<Bucket const> bucket,
+                       uint32_t oldestLedger, uint32_t newestLedger,
+                       medida::Meter& meter)
+{
+    assertThreadIsMain();
+    auto& db = app.getDatabase();
+
+    std::vector<size_t> offsets{0};
+    auto threads = app.getConfig().CHECKDB_THREADS;
+    if (db.canUsePool() && threads > 1)
+    {
+        auto index = bucket->getIndex();
+        if (index && index->size() != 0)
+        {
+            offsets = index->getShardOffsets(threads);
+        }
+    }
+
+    std::vector<Shard> shards(offsets.size());
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+        shards[i].mBegin = offsets[i];
+        shards[i].mEnd = i + 1 < offsets.size()
+                             ? offsets[i + 1]
+                             : std::numeric_limits<size_t>::max();
+    }
+
+    if (!db.canUsePool())
+    {
+        checkShard(db.getSession(), bucket, oldestLedger, newestLedger, meter,
+                   shards[0]);
+    }
+    else
+    {
+        auto& pool = db.getPool();
+        std::vector<std::future<void>> done;
+        for (auto& shard : shards)
+        {
+            using task_t = std::packaged_task<void()>;
+            auto task = std::make_shared<task_t>(
+                [&pool, &shard, &meter, bucket, oldestLedger, newestLedger]() {
+                    soci::session sess(pool);
+                    checkShard(sess, bucket, oldestLedger, newestLedger, meter,
+                               shard);
+                });
+            done.emplace_back(task->get_future());
+            app.getWorkerIOService().post(std::bind(&task_t::operator(), task));
+        }
+        for (auto& f : done)
+        {
+            while (f.wait_for(std::chrono::seconds(5)) !=
+                   std::future_status::ready)
+            {
+                CLOG(INFO, "Bucket") << "Checked " << meter.count()
+                                     << " bucket entries against database";
+            }
+        }
+        // rethrow database errors
+        for (auto& f : done)
+        {
+            f.get();
+        }
+    }
+
+    // Combine shards in bucket order, stopping at the first error.
+    Result result;
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+        auto const& r = shards[i].mResult;
+        result.mAccounts += r.mAccounts;
+        result.mTrustLines += r.mTrustLines;
+        result.mOffers += r.mOffers;
+        result.mData += r.mData;
+        if (!r.mError.empty())
+        {
+            result.mError = r.mError;
+            break;
+        }
+        if (i + 1 < shards.size() &&
+            !BucketEntryIdCmp{}(shards[i].mLast, shards[i + 1].mFirst))
+        {
+            result.mError = outOfOrder(shards[i].mLast, shards[i + 1].mFirst);
+            break;
+        }
+    }
+    return result;
+}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+class Bucket;
+
+/**
+ * Compares the entries of a bucket with the database, for checkDB and the
+ * BucketListIsConsistentWithDatabase invariant.
+ *
+ * Entries are read in order and checked to be strictly increasing; live ones
+ * to have been last modified within [oldestLedger, newestLedger], to be in the
+ * database and to match it; dead ones to be absent from it. Live entries are
+ * counted by type so that the caller can compare with the database's counts.
+ *
+ * The bucket is split into CHECKDB_THREADS shards (see
+ * BucketIndex::getShardOffsets) checked at once on worker threads, each
+ * through its own session of the database's connection pool and looking its
+ * entries up in batches (see EntryFrame::loadBulk). check() blocks until all
+ * shards are done so that the database does not change under it, and reports
+ * the first error in bucket order, as a sequential scan would. Without a pool
+ * (in-memory sqlite) the bucket is checked as one shard on the main session.
+ */
+class BucketDBChecker
+{
+  public:
+    // Bucket entries looked up in the database at once by each shard.
+    static size_t const BATCH_SIZE = 0x400;
+
+    struct Result
+    {
+        // Empty when the bucket matches the database.
+        std::string mError;
+
+        uint64_t mAccounts{0};
+        uint64_t mTrustLines{0};
+        uint64_t mOffers{0};
+        uint64_t mData{0};
+    };
+
+    // Marks `meter` for every entry checked.
+    static Result check(Application& app, std::shared_ptr<Bucket const> bucket,
+                        uint32_t oldestLedger, uint32_t newestLedger,
+                        medida::Meter& meter);
+};
+}
@@ -0,0 +1,300 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketIndex.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/LedgerCmp.h"
+#include "crypto/Random.h"
+#include "crypto/SHA.h"
+#include "ledger/EntryFrame.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sodium.h>
+
+namespace stellar
+{
+
+uint32_t const BucketIndex::FILE_MAGIC;
+uint32_t const BucketIndex::FILE_VERSION;
+
+uint64_t
+BucketIndex::hashKey(LedgerKey const& key)
+{
+    // Indexes only live in memory, so a per-process key is fine and keeps the
+    // filter from being degraded by keys chosen to collide.
+    static std::vector<uint8_t> const sipKey =
+        randomBytes(crypto_shorthash_KEYBYTES);
+    auto bytes = xdr::xdr_to_opaque(key);
+    uint64_t h = 0;
+    static_assert(crypto_shorthash_BYTES == sizeof(h), "unexpected hash size");
+    crypto_shorthash(reinterpret_cast<unsigned char*>(&h), bytes.data(),
+                     bytes.size(), sipKey.data());
+    return h;
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::build(std::shared_ptr<Bucket const> bucket)
+{
+    auto index = std::make_unique<BucketIndex>();
+    for (BucketInputIterator iter(bucket, true); iter; ++iter)
+    {
+        index->add(getBucketEntryKey(*iter), iter.pos(),
+                   (*iter).type() == DEADENTRY);
+    }
+    index->finish();
+    return index;
+}
+
+LedgerKey
+BucketIndex::getBucketEntryKey(BucketEntry const& e)
+{
+    if (e.type() == LIVEENTRY)
+    {
+        return LedgerEntryKey(e.liveEntry());
+    }
+    return e.deadEntry();
+}
+
+void
+BucketIndex::add(LedgerKey const& key, size_t offset, bool dead)
+{
+    assert(mBloom.empty());
+    if (mPageKeys.empty() || mEntries - mLastPageStart == PAGE_SIZE)
+    {
+        mPageKeys.emplace_back(key);
+        mPageOffsets.emplace_back(offset);
+        mLastPageStart = mEntries;
+    }
+    mKeyHashes.emplace_back(hashKey(key));
+    ++mEntries;
+    if (dead)
+    {
+        ++mDeadEntries;
+    }
+}
+
+void
+BucketIndex::append(BucketIndex const& other, size_t offset)
+{
+    assert(mBloom.empty());
+    assert(other.mBloom.empty());
+    if (other.mEntries == 0)
+    {
+        return;
+    }
+    mPageKeys.insert(mPageKeys.end(), other.mPageKeys.begin(),
+                     other.mPageKeys.end());
+    for (auto o : other.mPageOffsets)
+    {
+        mPageOffsets.emplace_back(o + offset);
+    }
+    mKeyHashes.insert(mKeyHashes.end(), other.mKeyHashes.begin(),
+                      other.mKeyHashes.end());
+    mLastPageStart = mEntries + other.mLastPageStart;
+    mEntries += other.mEntries;
+    mDeadEntries += other.mDeadEntries;
+}
+
+void
+BucketIndex::finish()
+{
+    size_t words = std::max<size_t>(
+        1, (mEntries * BLOOM_BITS_PER_ENTRY + 63) / 64);
+    mBloom.assign(words, 0);
+    uint64_t nbits = words * 64;
+    for (auto h : mKeyHashes)
+    {
+        // Double hashing: probe i is h1 + i*h2, from the two halves of h.
+        uint64_t h1 = h & 0xffffffff;
+        uint64_t h2 = (h >> 32) | 1;
+        for (size_t i = 0; i < BLOOM_PROBES; ++i)
+        {
+            uint64_t bit = (h1 + i * h2) % nbits;
+            mBloom[bit / 64] |= (uint64_t(1) << (bit % 64));
+        }
+    }
+    mKeyHashes.clear();
+    mKeyHashes.shrink_to_fit();
+}
+
+bool
+BucketIndex::mayContain(LedgerKey const& key) const
+{
+    assert(!mBloom.empty());
+    if (mEntries == 0)
+    {
+        return false;
+    }
+    uint64_t nbits = mBloom.size() * 64;
+    uint64_t h = hashKey(key);
+    uint64_t h1 = h & 0xffffffff;
+    uint64_t h2 = (h >> 32) | 1;
+    for (size_t i = 0; i < BLOOM_PROBES; ++i)
+    {
+        uint64_t bit = (h1 + i * h2) % nbits;
+        if ((mBloom[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+BucketIndex::findPage(LedgerKey const& key, size_t& offset) const
+{
+    // First page whose first key is > key; the page before it is the only
+    // one that can hold key.
+    auto it = std::upper_bound(mPageKeys.begin(), mPageKeys.end(), key,
+                               LedgerEntryIdCmp{});
+    if (it == mPageKeys.begin())
+    {
+        return false;
+    }
+    --it;
+    offset = mPageOffsets.at(it - mPageKeys.begin());
+    return true;
+}
+
+size_t
+BucketIndex::size() const
+{
+    return mEntries;
+}
+
+size_t
+BucketIndex::getMemoryBytes() const
+{
+    size_t bytes = sizeof(*this);
+    for (auto const& k : mPageKeys)
+    {
+        bytes += xdr::xdr_size(k);
+    }
+    return bytes + mPageOffsets.capacity() * sizeof(mPageOffsets[0]) +
+           mKeyHashes.capacity() * sizeof(mKeyHashes[0]) +
+           mBloom.capacity() * sizeof(mBloom[0]);
+}
+
+size_t
+BucketIndex::getLiveEntries() const
+{
+    return mEntries - mDeadEntries;
+}
+
+size_t
+BucketIndex::getDeadEntries() const
+{
+    return mDeadEntries;
+}
+
+void
+BucketIndex::save(std::string const& filename, Hash const& bucketHash,
+                  uint64_t bucketFileSize) const
+{
+    assert(!mBloom.empty());
+    auto body = xdr::xdr_to_opaque(
+        FILE_MAGIC, FILE_VERSION, bucketHash, bucketFileSize,
+        static_cast<uint64_t>(mEntries - mDeadEntries),
+        static_cast<uint64_t>(mDeadEntries), static_cast<uint32_t>(PAGE_SIZE),
+        mPageOffsets, mPageKeys, mBloom);
+    auto checksum = sha256(body);
+
+    // Written under another name and renamed, so that a crash never leaves a
+    // partial index behind under the real one.
+    auto tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp, std::ofstream::binary | std::ofstream::trunc);
+        out.write(reinterpret_cast<char const*>(body.data()), body.size());
+        out.write(reinterpret_cast<char const*>(checksum.data()),
+                  checksum.size());
+        if (!out)
+        {
+            CLOG(WARNING, "Bucket") << "Failed to write bucket index " << tmp;
+            out.close();
+            std::remove(tmp.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        CLOG(WARNING, "Bucket") << "Failed to rename bucket index " << tmp;
+        std::remove(tmp.c_str());
+    }
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::load(std::string const& filename, Hash const& bucketHash,
+                  uint64_t bucketFileSize)
+{
+    std::ifstream in(filename, std::ifstream::binary);
+    if (!in)
+    {
+        return nullptr;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+                               std::istreambuf_iterator<char>());
+    Hash checksum;
+    if (bytes.size() < checksum.size())
+    {
+        return nullptr;
+    }
+    std::vector<uint8_t> body(bytes.begin(), bytes.end() - checksum.size());
+    std::copy(bytes.end() - checksum.size(), bytes.end(), checksum.begin());
+    if (sha256(body) != checksum)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring damaged bucket index " << filename;
+        return nullptr;
+    }
+
+    auto index = std::make_unique<BucketIndex>();
+    uint32_t magic = 0, version = 0, pageSize = 0;
+    Hash hash;
+    uint64_t fileSize = 0, live = 0, dead = 0;
+    try
+    {
+        xdr::xdr_from_opaque(body, magic, version, hash, fileSize, live, dead,
+                             pageSize, index->mPageOffsets, index->mPageKeys,
+                             index->mBloom);
+    }
+    catch (xdr::xdr_runtime_error& e)
+    {
+        CLOG(WARNING, "Bucket")
+            << "Ignoring malformed bucket index " << filename << ": "
+            << e.what();
+        return nullptr;
+    }
+    if (magic != FILE_MAGIC || version != FILE_VERSION || hash != bucketHash ||
+        fileSize != bucketFileSize || pageSize != PAGE_SIZE ||
+        index->mBloom.empty() ||
+        index->mPageOffsets.size() != index->mPageKeys.size())
+    {
+        CLOG(DEBUG, "Bucket") << "Ignoring stale bucket index " << filename;
+        return nullptr;
+    }
+    index->mEntries = live + dead;
+    index->mDeadEntries = dead;
+    return index;
+}
+
+std::vector<size_t>
+BucketIndex::getShardOffsets(size_t n) const
+{
+    size_t pages = mPageOffsets.size();
+    n = std::min(n, pages);
+    std::vector<size_t> offsets;
+    offsets.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        offsets.emplace_back(mPageOffsets[i * pages / n]);
+    }
+    return offsets;
+}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <vector>
+
+namespace stellar
+{
+
+class Bucket;
+
+/**
+ * BucketIndex answers "where in this bucket file would key K be" without
+ * scanning the whole file. It holds two structures:
+ *
+ *   - A sparse index: the key and byte offset of every PAGE_SIZE'th entry.
+ *     Since buckets are sorted by key, K can only be in the page starting at
+ *     the greatest indexed key <= K.
+ *
+ *   - A bloom filter over every key in the bucket, so that lookups for keys
+ *     that are absent (the common case when probing many buckets) usually
+ *     skip reading the file at all.
+ *
+ * It also counts the live and dead entries of the bucket.
+ *
+ * An index is built incrementally by calling add() for each entry in bucket
+ * order and then finish(); BucketOutputIterator does this while writing a
+ * fresh or merged bucket, and Bucket::getIndex builds one by scanning for
+ * buckets that were loaded from disk. Once finished it is immutable and may be
+ * shared between threads.
+ *
+ * A finished index can be saved next to its bucket file (see
+ * Bucket::getIndexFilename) so that it need not be rebuilt after a restart.
+ * The bucket file itself is left as it is: its bytes are what the bucket's
+ * hash and the history archives are defined over. An index file is the XDR of
+ *
+ *     uint32 magic; uint32 version;
+ *     Hash bucketHash; uint64 bucketFileSize;
+ *     uint64 liveEntries; uint64 deadEntries; uint32 pageSize;
+ *     uint64 pageOffsets<>; LedgerKey pageKeys<>; uint64 bloom<>;
+ *
+ * followed by the SHA256 of all of that. load() only accepts a file with a
+ * valid checksum that matches the bucket, so a stale or damaged one is rebuilt.
+ */
+class BucketIndex : NonMovableOrCopyable
+{
+    xdr::xvector<LedgerKey> mPageKeys;
+    xdr::xvector<uint64_t> mPageOffsets;
+    std::vector<uint64_t> mKeyHashes;
+    xdr::xvector<uint64_t> mBloom;
+    size_t mEntries{0};
+    size_t mDeadEntries{0};
+    size_t mLastPageStart{0};
+
+    static uint64_t hashKey(LedgerKey const& key);
+
+    // Start ("BIDX") and layout version of index files.
+    static uint32_t const FILE_MAGIC = 0x42494458;
+    static uint32_t const FILE_VERSION = 1;
+
+  public:
+    // Number of entries between consecutive sparse index keys.
+    static size_t const PAGE_SIZE = 0x40;
+
+    // Bloom filter bits per entry and probes per key; together these give a
+    // false-positive rate a little under 1%.
+    static size_t const BLOOM_BITS_PER_ENTRY = 10;
+    static size_t const BLOOM_PROBES = 7;
+
+    BucketIndex() = default;
+
+    // Scan `bucket` and build its index.
+    static std::unique_ptr<BucketIndex>
+    build(std::shared_ptr<Bucket const> bucket);
+
+    // Key of the ledger entry a BucketEntry refers to, live or dead.
+    static LedgerKey getBucketEntryKey(BucketEntry const& e);
+
+    // Record the entry with key `key` at byte `offset`, a tombstone if `dead`.
+    // Entries must be added in bucket order.
+    void add(LedgerKey const& key, size_t offset, bool dead);
+
+    // Add the entries of `other`, also not finished yet, as if they came next
+    // in the bucket with their offsets shifted by `offset`; for joining the
+    // parts of a split merge. Pages are not merged across the join, so one
+    // may hold fewer than PAGE_SIZE entries.
+    void append(BucketIndex const& other, size_t offset);
+
+    // Build the bloom filter; no more add() calls are allowed after this.
+    void finish();
+
+    // Returns false if `key` is definitely not in the bucket.
+    bool mayContain(LedgerKey const& key) const;
+
+    // If `key` could be in the bucket, returns true and sets `offset` to the
+    // start of the page that would contain it.
+    bool findPage(LedgerKey const& key, size_t& offset) const;
+
+    // Number of entries indexed.
+    size_t size() const;
+
+    // Number of live and dead entries indexed.
+    size_t getLiveEntries() const;
+    size_t getDeadEntries() const;
+
+    // Approximate bytes the index holds in memory.
+    size_t getMemoryBytes() const;
+
+    // Write the finished index of the bucket with hash `bucketHash`, whose
+    // file is `bucketFileSize` bytes long, to `filename`.
+    void save(std::string const& filename, Hash const& bucketHash,
+              uint64_t bucketFileSize) const;
+
+    // Read an index saved by save(); returns nullptr if there is no such
+    // file or it is not a valid index of that bucket.
+    static std::unique_ptr<BucketIndex> load(std::string const& filename,
+                                             Hash const& bucketHash,
+                                             uint64_t bucketFileSize);
+
+    // Offsets (for BucketInputIterator::seek) of the first entries of at most
+    // `n` consecutive runs of roughly as many entries that split the bucket,
+    // the first one starting at its first entry. Runs start on page
+    // boundaries, so there are no more of them than pages.
+    std::vector<size_t> getShardOffsets(size_t n) const;
+};
+}
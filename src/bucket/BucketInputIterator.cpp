@@ -4,6 +4,7 @@
 
 #include "bucket/BucketInputIterator.h"
 #include "bucket/Bucket.h"
+#include "xdrpp/marshal.h"
 
 namespace stellar
 {
@@ -14,6 +15,7 @@ namespace stellar
 void
 BucketInputIterator::loadEntry()
 {
+    mEntryPos = mIn.pos();
     if (mIn.readOne(mEntry))
     {
         mEntryPtr = &mEntry;
@@ -34,14 +36,23 @@ BucketEntry const& BucketInputIterator::operator*()
     return *mEntryPtr;
 }
 
-BucketInputIterator::BucketInputIterator(std::shared_ptr<Bucket const> bucket)
+BucketInputIterator::BucketInputIterator(std::shared_ptr<Bucket const> bucket,
+                                         bool mapped)
     : mBucket(bucket), mEntryPtr(nullptr)
 {
     if (!mBucket->getFilename().empty())
     {
         CLOG(TRACE, "Bucket") << "BucketInputIterator opening file to read: "
                               << mBucket->getFilename();
-        mIn.open(mBucket->getFilename());
+        mIn.setMetrics(mBucket->getReadMetrics());
+        if (mapped)
+        {
+            mIn.openMapped(mBucket->getFilename());
+        }
+        else
+        {
+            mIn.open(mBucket->getFilename());
+        }
         loadEntry();
     }
 }
@@ -63,4 +74,139 @@ BucketInputIterator& BucketInputIterator::operator++()
     }
     return *this;
 }
+
+size_t
+BucketInputIterator::pos() const
+{
+    return mEntryPos;
+}
+
+void
+BucketInputIterator::seek(size_t offset)
+{
+    if (mBucket->getFilename().empty())
+    {
+        return;
+    }
+    mIn.seek(offset);
+    loadEntry();
+}
+
+void
+BucketRawInputIterator::loadEntry()
+{
+    mEntryPos = mIn.pos();
+    mValid = mIn.readRaw(mData, mSize);
+    if (!mValid)
+    {
+        return;
+    }
+    mBytesRead += mSize + 4;
+
+    // A BucketEntry is its type followed by either a LedgerEntry or a
+    // LedgerKey. The fields a LedgerKey is made of come first in the data of
+    // a LedgerEntry, after lastModifiedLedgerSeq, so in both cases the key
+    // can be decoded from the front of the record.
+    xdr::xdr_get g(mData, mData + mSize);
+    BucketEntryType type;
+    xdr::xdr_argpack_archive(g, type);
+    mDead = type == DEADENTRY;
+    if (!mDead)
+    {
+        uint32_t lastModifiedLedgerSeq;
+        xdr::xdr_argpack_archive(g, lastModifiedLedgerSeq);
+    }
+    xdr::xdr_argpack_archive(g, mKey);
+}
+
+BucketRawInputIterator::BucketRawInputIterator(
+    std::shared_ptr<Bucket const> bucket, bool mapped)
+    : mBucket(bucket)
+{
+    if (!mBucket->getFilename().empty())
+    {
+        CLOG(TRACE, "Bucket") << "BucketRawInputIterator opening file to read: "
+                              << mBucket->getFilename();
+        mIn.setMetrics(mBucket->getReadMetrics());
+        if (mapped)
+        {
+            mIn.openMapped(mBucket->getFilename());
+        }
+        else
+        {
+            mIn.open(mBucket->getFilename());
+        }
+        loadEntry();
+    }
+}
+
+BucketRawInputIterator::~BucketRawInputIterator()
+{
+    mIn.close();
+}
+
+BucketRawInputIterator::operator bool() const
+{
+    return mValid;
+}
+
+BucketRawInputIterator& BucketRawInputIterator::operator++()
+{
+    if (mIn)
+    {
+        loadEntry();
+    }
+    else
+    {
+        mValid = false;
+    }
+    return *this;
+}
+
+LedgerKey const&
+BucketRawInputIterator::key() const
+{
+    return mKey;
+}
+
+bool
+BucketRawInputIterator::isDead() const
+{
+    return mDead;
+}
+
+char const*
+BucketRawInputIterator::data() const
+{
+    return mData;
+}
+
+uint32_t
+BucketRawInputIterator::size() const
+{
+    return mSize;
+}
+
+size_t
+BucketRawInputIterator::pos() const
+{
+    return mEntryPos;
+}
+
+void
+BucketRawInputIterator::seek(size_t offset)
+{
+    if (mBucket->getFilename().empty())
+    {
+        return;
+    }
+    mIn.seek(offset);
+    loadEntry();
+}
+
+size_t
+BucketRawInputIterator::bytesRead() const
+{
+    return mBytesRead;
+}
 }
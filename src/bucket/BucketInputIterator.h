@@ -26,6 +26,7 @@ class BucketInputIterator
     BucketEntry const* mEntryPtr;
     XDRInputFileStream mIn;
     BucketEntry mEntry;
+    size_t mEntryPos{0};
 
     void loadEntry();
 
@@ -34,10 +35,69 @@ class BucketInputIterator
 
     BucketEntry const& operator*();
 
-    BucketInputIterator(std::shared_ptr<Bucket const> bucket);
+    // If `mapped` is set the bucket file is read through a memory mapping
+    // (see XDRInputFileStream::openMapped) rather than an ifstream; this
+    // suits the long sequential scans of merge, apply and checkdb.
+    BucketInputIterator(std::shared_ptr<Bucket const> bucket,
+                        bool mapped = false);
 
     ~BucketInputIterator();
 
     BucketInputIterator& operator++();
+
+    // Byte offset of the current entry within the bucket file.
+    size_t pos() const;
+
+    // Reposition the iterator at the entry starting at byte `offset`, as
+    // previously returned by pos().
+    void seek(size_t offset);
+};
+
+// Reads through the entries of a bucket without decoding them: each entry is
+// exposed as its raw XDR, along with the key it is for, which is decoded from
+// the front of the record. Used by merges, which only compare keys and can
+// copy the entries they keep byte for byte (see
+// BucketOutputIterator::putRaw).
+class BucketRawInputIterator
+{
+    std::shared_ptr<Bucket const> mBucket;
+    XDRInputFileStream mIn;
+    bool mValid{false};
+    bool mDead{false};
+    LedgerKey mKey;
+    char const* mData{nullptr};
+    uint32_t mSize{0};
+    size_t mEntryPos{0};
+    size_t mBytesRead{0};
+
+    void loadEntry();
+
+  public:
+    BucketRawInputIterator(std::shared_ptr<Bucket const> bucket,
+                           bool mapped = true);
+
+    BucketRawInputIterator(BucketRawInputIterator&&) = default;
+
+    ~BucketRawInputIterator();
+
+    operator bool() const;
+
+    BucketRawInputIterator& operator++();
+
+    // Key of the current entry, live or dead.
+    LedgerKey const& key() const;
+
+    bool isDead() const;
+
+    // XDR of the current entry; valid until the iterator moves.
+    char const* data() const;
+    uint32_t size() const;
+
+    // As for BucketInputIterator.
+    size_t pos() const;
+    void seek(size_t offset);
+
+    // Bytes of the entries the iterator has been at so far.
+    size_t bytesRead() const;
 };
 }
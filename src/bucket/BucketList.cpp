@@ -14,6 +14,10 @@
 #include "util/XDRStream.h"
 #include "util/types.h"
 #include <cassert>
+#include <chrono>
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 namespace stellar
 {
@@ -119,7 +123,7 @@ BucketLevel::prepare(Application& app, uint32_t currLedger,
         }
     }
 
-    mNextCurr = FutureBucket(app, curr, snap, shadows,
+    mNextCurr = FutureBucket(app, curr, snap, shadows, mLevel,
                              BucketList::keepDeadEntries(mLevel));
     assert(mNextCurr.isMerging());
 }
@@ -294,6 +298,25 @@ BucketList::getHash() const
     return hsh->finish();
 }
 
+std::shared_ptr<LedgerEntry const>
+BucketList::getLedgerEntry(LedgerKey const& key) const
+{
+    BucketEntry e;
+    for (auto const& lev : mLevels)
+    {
+        for (auto const& b : {lev.getCurr(), lev.getSnap()})
+        {
+            if (b->getBucketEntry(key, e))
+            {
+                return e.type() == LIVEENTRY
+                           ? std::make_shared<LedgerEntry const>(e.liveEntry())
+                           : nullptr;
+            }
+        }
+    }
+    return nullptr;
+}
+
 bool
 BucketList::levelShouldSpill(uint32_t ledger, uint32_t level)
 {
@@ -325,6 +348,29 @@ BucketList::getLevel(uint32_t i)
     return mLevels.at(i);
 }
 
+// Commits `level`, timing how long it has to wait for the level's merge
+// when it is not done yet.
+static void
+commitLevel(Application& app, BucketLevel& level, uint32_t i)
+{
+    auto& next = level.getNext();
+    if (!next.isMerging() || next.mergeComplete())
+    {
+        level.commit();
+        return;
+    }
+    auto& timer = app.getMetrics().NewTimer(
+        {"bucket", "merge-wait", "level-" + std::to_string(i)});
+    auto start = std::chrono::steady_clock::now();
+    level.commit();
+    auto waited = std::chrono::steady_clock::now() - start;
+    timer.Update(waited);
+    CLOG(DEBUG, "Bucket")
+        << "Waited "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(waited).count()
+        << "ms for merge on level " << i;
+}
+
 void
 BucketList::addBatch(Application& app, uint32_t currLedger,
                      std::vector<LedgerEntry> const& liveEntries,
@@ -409,7 +455,7 @@ BucketList::addBatch(Application& app, uint32_t currLedger,
             //           << " element snap from level " << i-1
             //           << " to level " << i;
 
-            mLevels[i].commit();
+            commitLevel(app, mLevels[i], i);
             mLevels[i].prepare(app, currLedger, snap, shadows);
         }
     }
@@ -419,7 +465,7 @@ BucketList::addBatch(Application& app, uint32_t currLedger,
         app, currLedger,
         Bucket::fresh(app.getBucketManager(), liveEntries, deadEntries),
         shadows);
-    mLevels[0].commit();
+    commitLevel(app, mLevels[0], 0);
 }
 
 void
@@ -431,7 +477,7 @@ BucketList::restartMerges(Application& app)
         auto& next = level.getNext();
         if (next.hasHashes() && !next.isLive())
         {
-            next.makeLive(app, keepDeadEntries(i));
+            next.makeLive(app, i, keepDeadEntries(i));
             if (next.isMerging())
             {
                 CLOG(INFO, "Bucket")
@@ -339,6 +339,14 @@ class BucketList
     // of the concatenation of the hashes of the `curr` and `snap` buckets.
     Hash getHash() const;
 
+    // Returns the newest version of the entry with `key` in the BucketList,
+    // or nullptr if it does not exist (never added, or deleted since). Looks
+    // the key up in each bucket, newest first, through its index, stopping at
+    // the first bucket holding it live or dead. Main-thread only, like the
+    // rest of the BucketList.
+    std::shared_ptr<LedgerEntry const>
+    getLedgerEntry(LedgerKey const& key) const;
+
     // Restart any merges that might be running on background worker threads,
     // merging buckets between levels. This needs to be called after forcing a
     // BucketList to adopt a new state, either at application restart or when
@@ -0,0 +1,478 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketListExporter.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/LedgerCmp.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SecretKey.h"
+#include "crypto/SignerKey.h"
+#include "lib/util/format.h"
+#include "util/Decoder.h"
+#include "util/Fs.h"
+#include "util/types.h"
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <thread>
+
+namespace stellar
+{
+
+namespace
+{
+
+struct Table
+{
+    char const* mName;
+    std::vector<char const*> mColumns;
+};
+
+// the columns of the tables of AccountFrame, TrustFrame, OfferFrame and
+// DataFrame, in the order of their storeAddOrChangeBulk
+Table const ACCOUNTS{"accounts",
+                     {"accountid", "balance", "seqnum", "numsubentries",
+                      "inflationdest", "homedomain", "thresholds", "flags",
+                      "lastmodified", "buyingliabilities",
+                      "sellingliabilities"}};
+Table const SIGNERS{"signers", {"accountid", "publickey", "weight"}};
+Table const TRUSTLINES{"trustlines",
+                       {"accountid", "assettype", "issuer", "assetcode",
+                        "balance", "tlimit", "flags", "lastmodified",
+                        "buyingliabilities", "sellingliabilities"}};
+Table const OFFERS{"offers",
+                   {"sellerid", "offerid", "sellingassettype",
+                    "sellingassetcode", "sellingissuer", "buyingassettype",
+                    "buyingassetcode", "buyingissuer", "amount", "pricen",
+                    "priced", "price", "flags", "lastmodified"}};
+Table const ACCOUNTDATA{"accountdata",
+                        {"accountid", "dataname", "datavalue",
+                         "lastmodified"}};
+
+std::string
+columnList(Table const& table)
+{
+    std::string res;
+    for (auto const& c : table.mColumns)
+    {
+        res += res.empty() ? "" : ",";
+        res += c;
+    }
+    return res;
+}
+
+// A line in the CSV format COPY reads: an empty field is NULL, so strings are
+// quoted when empty, or when they hold a separator, quote or line break.
+class CsvLine
+{
+    std::string mLine;
+    bool mFirst{true};
+
+    void
+    next()
+    {
+        if (!mFirst)
+        {
+            mLine += ',';
+        }
+        mFirst = false;
+    }
+
+  public:
+    CsvLine&
+    null()
+    {
+        next();
+        return *this;
+    }
+
+    template <typename T>
+    CsvLine&
+    num(T v)
+    {
+        next();
+        mLine += std::to_string(v);
+        return *this;
+    }
+
+    CsvLine&
+    str(std::string const& s)
+    {
+        next();
+        if (!s.empty() && s.find_first_of(",\"\r\n") == std::string::npos)
+        {
+            mLine += s;
+            return *this;
+        }
+        mLine += '"';
+        for (auto c : s)
+        {
+            if (c == '"')
+            {
+                mLine += '"';
+            }
+            mLine += c;
+        }
+        mLine += '"';
+        return *this;
+    }
+
+    std::string const&
+    finish()
+    {
+        mLine += '\n';
+        return mLine;
+    }
+};
+
+// The files of one key range.
+class PartWriter
+{
+    std::string const& mDir;
+    size_t const mPart;
+    std::map<std::string, std::ofstream> mFiles;
+
+  public:
+    BucketListExporter::Result mResult;
+
+    PartWriter(std::string const& dir, size_t part) : mDir(dir), mPart(part)
+    {
+    }
+
+    void
+    write(Table const& table, std::string const& line)
+    {
+        auto& out = mFiles[table.mName];
+        if (!out.is_open())
+        {
+            auto name = fmt::format("{:s}-{:04d}.csv", table.mName, mPart);
+            out.open(mDir + "/" + name, std::ios::out | std::ios::binary);
+            out << columnList(table) << "\n";
+            mResult.mFiles.emplace_back(name);
+        }
+        out << line;
+        if (!out)
+        {
+            throw std::runtime_error(fmt::format(
+                "writing {:s}-{:04d}.csv failed", table.mName, mPart));
+        }
+        ++mResult.mRows[table.mName];
+    }
+};
+
+// Sets `code` and `issuer` for a credit asset; returns false for native.
+bool
+getAssetFields(Asset const& asset, std::string& code, std::string& issuer)
+{
+    switch (asset.type())
+    {
+    case ASSET_TYPE_CREDIT_ALPHANUM4:
+        assetCodeToStr(asset.alphaNum4().assetCode, code);
+        issuer = KeyUtils::toStrKey(asset.alphaNum4().issuer);
+        return true;
+    case ASSET_TYPE_CREDIT_ALPHANUM12:
+        assetCodeToStr(asset.alphaNum12().assetCode, code);
+        issuer = KeyUtils::toStrKey(asset.alphaNum12().issuer);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void
+addOfferAsset(CsvLine& line, Asset const& asset)
+{
+    std::string code, issuer;
+    line.num(static_cast<int>(asset.type()));
+    if (getAssetFields(asset, code, issuer))
+    {
+        line.str(code).str(issuer);
+    }
+    else
+    {
+        line.null().null();
+    }
+}
+
+template <typename T>
+void
+addLiabilities(CsvLine& line, T const& ext)
+{
+    if (ext.v() == 1)
+    {
+        line.num(ext.v1().liabilities.buying)
+            .num(ext.v1().liabilities.selling);
+    }
+    else
+    {
+        line.null().null();
+    }
+}
+
+void
+writeEntry(PartWriter& out, LedgerEntry const& e)
+{
+    switch (e.data.type())
+    {
+    case ACCOUNT:
+    {
+        auto const& a = e.data.account();
+        auto id = KeyUtils::toStrKey(a.accountID);
+        CsvLine line;
+        line.str(id).num(a.balance).num(a.seqNum).num(a.numSubEntries);
+        if (a.inflationDest)
+        {
+            line.str(KeyUtils::toStrKey(*a.inflationDest));
+        }
+        else
+        {
+            line.null();
+        }
+        line.str(a.homeDomain)
+            .str(decoder::encode_b64(a.thresholds))
+            .num(a.flags)
+            .num(e.lastModifiedLedgerSeq);
+        addLiabilities(line, a.ext);
+        out.write(ACCOUNTS, line.finish());
+        for (auto const& s : a.signers)
+        {
+            CsvLine signer;
+            signer.str(id).str(KeyUtils::toStrKey(s.key)).num(s.weight);
+            out.write(SIGNERS, signer.finish());
+        }
+        break;
+    }
+    case TRUSTLINE:
+    {
+        auto const& tl = e.data.trustLine();
+        std::string code, issuer;
+        getAssetFields(tl.asset, code, issuer);
+        CsvLine line;
+        line.str(KeyUtils::toStrKey(tl.accountID))
+            .num(static_cast<int>(tl.asset.type()))
+            .str(issuer)
+            .str(code)
+            .num(tl.balance)
+            .num(tl.limit)
+            .num(tl.flags)
+            .num(e.lastModifiedLedgerSeq);
+        addLiabilities(line, tl.ext);
+        out.write(TRUSTLINES, line.finish());
+        break;
+    }
+    case OFFER:
+    {
+        auto const& o = e.data.offer();
+        CsvLine line;
+        line.str(KeyUtils::toStrKey(o.sellerID)).num(o.offerID);
+        addOfferAsset(line, o.selling);
+        addOfferAsset(line, o.buying);
+        // full precision, as OfferFrame stores it
+        line.num(o.amount)
+            .num(o.price.n)
+            .num(o.price.d)
+            .str(fmt::format("{:.17g}",
+                             double(o.price.n) / double(o.price.d)))
+            .num(o.flags)
+            .num(e.lastModifiedLedgerSeq);
+        out.write(OFFERS, line.finish());
+        break;
+    }
+    case DATA:
+    {
+        auto const& d = e.data.data();
+        CsvLine line;
+        line.str(KeyUtils::toStrKey(d.accountID))
+            .str(d.dataName)
+            .str(decoder::encode_b64(d.dataValue))
+            .num(e.lastModifiedLedgerSeq);
+        out.write(ACCOUNTDATA, line.finish());
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Exports the keys in [begin, end) of `buckets`, newest first; a null bound
+// is open. Returns the number of entries read.
+uint64_t
+exportRange(std::vector<std::shared_ptr<Bucket const>> const& buckets,
+            LedgerKey const* begin, LedgerKey const* end,
+            std::set<LedgerEntryType> const& types, PartWriter& out)
+{
+    LedgerEntryIdCmp less;
+    std::vector<BucketRawInputIterator> iters;
+    iters.reserve(buckets.size());
+    for (auto const& b : buckets)
+    {
+        iters.emplace_back(b, true);
+        auto& it = iters.back();
+        size_t offset;
+        if (begin && b->getIndex()->findPage(*begin, offset))
+        {
+            it.seek(offset);
+        }
+        while (begin && it && less(it.key(), *begin))
+        {
+            ++it;
+        }
+    }
+
+    // A linear scan for the smallest key: there are only a couple of dozen
+    // buckets, and most entries are in the deepest ones anyway.
+    uint64_t read = 0;
+    BucketEntry entry;
+    LedgerKey key;
+    while (true)
+    {
+        // on ties the newest bucket, which comes first, is kept
+        BucketRawInputIterator* newest = nullptr;
+        for (auto& it : iters)
+        {
+            if (it && (!end || less(it.key(), *end)) &&
+                (!newest || less(it.key(), newest->key())))
+            {
+                newest = &it;
+            }
+        }
+        if (!newest)
+        {
+            break;
+        }
+
+        key = newest->key();
+        if (!newest->isDead() && (types.empty() || types.count(key.type())))
+        {
+            xdr::xdr_get g(newest->data(), newest->data() + newest->size());
+            xdr::xdr_argpack_archive(g, entry);
+            writeEntry(out, entry.liveEntry());
+        }
+
+        // the older entries for the key are shadowed
+        for (auto& it : iters)
+        {
+            if (it && !less(key, it.key()))
+            {
+                ++it;
+                ++read;
+            }
+        }
+    }
+    return read;
+}
+}
+
+BucketListExporter::Result
+BucketListExporter::exportEntries(
+    std::vector<std::shared_ptr<Bucket const>> const& buckets,
+    Options const& options)
+{
+    if (!fs::exists(options.mDir) && !fs::mkpath(options.mDir))
+    {
+        throw std::runtime_error("can't create " + options.mDir);
+    }
+
+    // indexes are read or built here, once, rather than by the threads
+    std::vector<std::shared_ptr<Bucket const>> nonEmpty;
+    std::shared_ptr<Bucket const> largest;
+    for (auto const& b : buckets)
+    {
+        if (b->getFilename().empty())
+        {
+            continue;
+        }
+        nonEmpty.emplace_back(b);
+        if (!largest || b->getIndex()->size() > largest->getIndex()->size())
+        {
+            largest = b;
+        }
+    }
+
+    auto threads = options.mThreads;
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<LedgerKey> splits;
+    if (largest && threads > 1)
+    {
+        auto offsets = largest->getIndex()->getShardOffsets(threads);
+        for (size_t i = 1; i < offsets.size(); ++i)
+        {
+            BucketRawInputIterator it(largest, true);
+            it.seek(offsets[i]);
+            if (it)
+            {
+                splits.emplace_back(it.key());
+            }
+        }
+    }
+
+    std::vector<PartWriter> parts;
+    parts.reserve(splits.size() + 1);
+    for (size_t i = 0; i <= splits.size(); ++i)
+    {
+        parts.emplace_back(options.mDir, i);
+    }
+    auto run = [&](size_t i) {
+        auto begin = i == 0 ? nullptr : &splits[i - 1];
+        auto end = i == splits.size() ? nullptr : &splits[i];
+        parts[i].mResult.mEntriesRead =
+            exportRange(nonEmpty, begin, end, options.mTypes, parts[i]);
+    };
+    if (parts.size() == 1)
+    {
+        run(0);
+    }
+    else
+    {
+        std::vector<std::future<void>> running;
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            running.emplace_back(std::async(std::launch::async, run, i));
+        }
+        for (auto& f : running)
+        {
+            f.get();
+        }
+    }
+
+    Result res;
+    std::map<std::string, Table const*> tables;
+    for (auto const* t : {&ACCOUNTS, &SIGNERS, &TRUSTLINES, &OFFERS,
+                          &ACCOUNTDATA})
+    {
+        tables[t->mName] = t;
+    }
+    for (auto const& p : parts)
+    {
+        res.mEntriesRead += p.mResult.mEntriesRead;
+        for (auto const& kv : p.mResult.mRows)
+        {
+            res.mRows[kv.first] += kv.second;
+        }
+        res.mFiles.insert(res.mFiles.end(), p.mResult.mFiles.begin(),
+                          p.mResult.mFiles.end());
+    }
+    std::sort(res.mFiles.begin(), res.mFiles.end());
+
+    // for psql, run from the directory
+    std::ofstream copy(options.mDir + "/copy.sql");
+    for (auto const& f : res.mFiles)
+    {
+        auto const& table = *tables.at(f.substr(0, f.find('-')));
+        copy << "\\copy " << table.mName << " (" << columnList(table)
+             << ") FROM '" << f << "' WITH (FORMAT csv, HEADER true)\n";
+    }
+    if (!copy)
+    {
+        throw std::runtime_error("writing copy.sql failed");
+    }
+    return res;
+}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+class Bucket;
+
+/**
+ * Writes the ledger entries a BucketList holds to CSV files, straight from
+ * its bucket files, for the --export-state command: a dump of the ledger
+ * state that puts no load on the database.
+ *
+ * There is a file per table of the database the entries go to (accounts,
+ * signers, trustlines, offers, accountdata), with the same columns and
+ * encodings, and a header line, so that each loads as it is with PostgreSQL's
+ * COPY ... WITH (FORMAT csv, HEADER true); copy.sql lists those commands.
+ *
+ * Buckets are sorted by key, so the entry for a key is found by walking all
+ * the buckets at once, newest first: the newest bucket that has the key
+ * shadows the older ones, and a tombstone there means the entry is gone. The
+ * key space is split into ranges of about as many entries of the largest
+ * bucket (see BucketIndex::getShardOffsets), walked at once on threads of
+ * their own, each writing files of its own: `<table>-<range>.csv`.
+ */
+class BucketListExporter
+{
+  public:
+    struct Options
+    {
+        // Where the files go; created if missing.
+        std::string mDir;
+        // The ledger entry types exported, all of them if empty.
+        std::set<LedgerEntryType> mTypes;
+        // Key ranges exported at once, 0 for the number of cores.
+        size_t mThreads{1};
+    };
+
+    struct Result
+    {
+        // Entries read from the buckets, live or dead, shadowed or not.
+        uint64_t mEntriesRead{0};
+        // Rows written, by table.
+        std::map<std::string, uint64_t> mRows;
+        // Files written, in the order of copy.sql.
+        std::vector<std::string> mFiles;
+    };
+
+    // Exports the entries of `buckets`, which lists the buckets of a
+    // BucketList newest first: curr then snap of each level, from level 0.
+    static Result exportEntries(
+        std::vector<std::shared_ptr<Bucket const>> const& buckets,
+        Options const& options);
+};
+}
@@ -11,11 +11,18 @@
 
 #include "medida/timer_context.h"
 
+namespace medida
+{
+class Histogram;
+}
+
 namespace stellar
 {
 
 class Application;
 class BucketList;
+class BucketMergeScheduler;
+struct XDRWriteOptions;
 struct LedgerHeader;
 struct HistoryArchiveState;
 
@@ -56,6 +63,19 @@ class BucketManager : NonMovableOrCopyable
 
     virtual medida::Timer& getMergeTimer() = 0;
 
+    // Bytes of shadow buckets read by each merge.
+    virtual medida::Histogram& getMergeShadowBytes() = 0;
+
+    // Scheduler that orders and bounds the BucketList's background merges.
+    virtual BucketMergeScheduler& getMergeScheduler() = 0;
+
+    // How bucket files are written, from the BUCKET_WRITE_* settings.
+    virtual XDRWriteOptions const& getWriteOptions() const = 0;
+
+    // Sync the file of `bucket`, written without syncing it, to disk on a
+    // worker thread. Threadsafe.
+    virtual void syncLater(std::shared_ptr<Bucket> const& bucket) = 0;
+
     // Get a reference to a persistent bucket (in the BucketManager's bucket
     // directory), from the BucketManager's shared bucket-set.
     //
@@ -74,17 +94,46 @@ class BucketManager : NonMovableOrCopyable
     // Return a bucket by hash if we have it, else return nullptr.
     virtual std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) = 0;
 
+    // Whether the file of bucket `hash` in the bucket directory is known to
+    // hash to `hash`: it was written (or adopted after verification) by this
+    // node, or recorded with recordBucketFileVerified(), and its size and
+    // modification time have not changed since. The record is kept in a file
+    // in the bucket directory, so that it survives restarts.
+    virtual bool isBucketFileVerified(uint256 const& hash) = 0;
+    virtual void recordBucketFileVerified(uint256 const& hash) = 0;
+
     // Forget any buckets not referenced by the current BucketList. This will
     // not immediately cause the buckets to delete themselves, if someone else
     // is using them via a shared_ptr<>, but the BucketManager will no longer
     // independently keep them alive.
     virtual void forgetUnreferencedBuckets() = 0;
 
+    // Keep the buckets named by `hashes` in the bucket directory, even while
+    // the BucketList does not reference them, until releaseRetainedBuckets().
+    // The set is saved in the database so that a catchup started again, after
+    // a failure or a restart, finds the buckets it already downloaded.
+    virtual void retainBuckets(std::vector<std::string> const& hashes) = 0;
+    virtual void releaseRetainedBuckets() = 0;
+
+    // Set the {"bucket", "memory", "shared-bytes"} counter to the approximate
+    // bytes held in memory by the buckets the BucketManager keeps; too costly
+    // to keep up to date as buckets come and go, see
+    // Application::syncMemoryMetrics.
+    virtual void syncMemoryMetrics() = 0;
+
     // Feed a new batch of entries to the bucket list.
     virtual void addBatch(Application& app, uint32_t currLedger,
                           std::vector<LedgerEntry> const& liveEntries,
                           std::vector<LedgerKey> const& deadEntries) = 0;
 
+    // Returns the entry with `key` as of the last batch added (nullptr if it
+    // does not exist), looked up in the BucketList (see
+    // BucketList::getLedgerEntry) behind a small cache of recently loaded
+    // entries, which addBatch and assumeState keep up to date. Unlike the
+    // Database this does not see the changes of a ledger being closed.
+    virtual std::shared_ptr<LedgerEntry const>
+    loadLedgerEntry(LedgerKey const& key) = 0;
+
     // Update the given LedgerHeader's bucketListHash to reflect the current
     // state of the bucket list.
     virtual void snapshotLedger(LedgerHeader& currentHeader) = 0;
@@ -4,22 +4,30 @@
 
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/BucketList.h"
+#include "bucket/BucketMergeScheduler.h"
+#include "bucket/BucketTombstoneStats.h"
 #include "crypto/Hex.h"
 #include "history/HistoryManager.h"
+#include "ledger/EntryFrame.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "main/PersistentState.h"
 #include "overlay/StellarXDR.h"
 #include "util/Fs.h"
 #include "util/LogSlowExecution.h"
 #include "util/Logging.h"
 #include "util/TmpDir.h"
+#include "util/WorkerLanes.h"
 #include "util/types.h"
+#include <chrono>
 #include <fstream>
 #include <map>
 #include <regex>
 #include <set>
+#include <sstream>
 
 #include "medida/counter.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
@@ -63,10 +71,30 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
           app.getMetrics().NewMeter({"bucket", "byte", "insert"}, "byte"))
     , mBucketAddBatch(app.getMetrics().NewTimer({"bucket", "batch", "add"}))
     , mBucketSnapMerge(app.getMetrics().NewTimer({"bucket", "snap", "merge"}))
+    , mBucketMergeShadowBytes(
+          app.getMetrics().NewHistogram({"bucket", "merge", "shadow-bytes"}))
     , mSharedBucketsSize(
           app.getMetrics().NewCounter({"bucket", "memory", "shared"}))
-
+    , mSharedBucketsBytes(
+          app.getMetrics().NewCounter({"bucket", "memory", "shared-bytes"}))
+    , mReadIO(app.getMetrics(), "bucket-read")
+    , mWriteIO(app.getMetrics(), "bucket-write")
+    , mSyncIO(app.getMetrics(), "fsync")
+    , mRenameIO(app.getMetrics(), "rename")
+    , mMergeScheduler(std::make_unique<BucketMergeScheduler>(app))
+    , mTombstoneStats(std::make_unique<BucketTombstoneStats>(app))
+    , mLookupHit(
+          app.getMetrics().NewMeter({"bucket", "lookup", "hit"}, "entry"))
+    , mLookupMiss(
+          app.getMetrics().NewMeter({"bucket", "lookup", "miss"}, "entry"))
+    , mLookupLoad(app.getMetrics().NewTimer({"bucket", "lookup", "load"}))
 {
+    auto const& cfg = app.getConfig();
+    mWriteOptions.mBufferSize = cfg.BUCKET_WRITE_BUFFER_SIZE;
+    mWriteOptions.mDirect = cfg.BUCKET_WRITE_DIRECT;
+    mWriteOptions.mSync = cfg.BUCKET_FSYNC;
+    mWriteOptions.mMetrics = &mWriteIO;
+    mWriteOptions.mSyncMetrics = &mSyncIO;
 }
 
 const std::string BucketManagerImpl::kLockFilename = "stellar-core.lock";
@@ -82,7 +110,7 @@ bucketBasename(std::string const& bucketHexHash)
 bool
 isBucketFile(std::string const& name)
 {
-    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz)?$");
+    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz|\\.index)?$");
     return std::regex_match(name, re);
 };
 
@@ -160,6 +188,48 @@ BucketManagerImpl::getMergeTimer()
     return mBucketSnapMerge;
 }
 
+medida::Histogram&
+BucketManagerImpl::getMergeShadowBytes()
+{
+    return mBucketMergeShadowBytes;
+}
+
+BucketMergeScheduler&
+BucketManagerImpl::getMergeScheduler()
+{
+    return *mMergeScheduler;
+}
+
+XDRWriteOptions const&
+BucketManagerImpl::getWriteOptions() const
+{
+    return mWriteOptions;
+}
+
+void
+BucketManagerImpl::syncLater(std::shared_ptr<Bucket> const& bucket)
+{
+    // a bucket forgotten in the meantime has had its file removed
+    std::weak_ptr<Bucket> weak = bucket;
+    auto metrics = &mSyncIO;
+    mApp.getWorkerLanes().post(WorkerLane::BACKGROUND, [weak, metrics]() {
+        auto b = weak.lock();
+        if (!b)
+        {
+            return;
+        }
+        auto const& filename = b->getFilename();
+        auto start = std::chrono::steady_clock::now();
+        bool synced = fs::syncFile(filename);
+        metrics->record(0, std::chrono::steady_clock::now() - start);
+        if (!synced && fs::exists(filename))
+        {
+            CLOG(WARNING, "Bucket")
+                << "Failed to sync bucket file " << filename;
+        }
+    });
+}
+
 std::shared_ptr<Bucket>
 BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
                                      uint256 const& hash, size_t nObjects,
@@ -184,7 +254,10 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
         std::string canonicalName = bucketFilename(hash);
         CLOG(DEBUG, "Bucket")
             << "Adopting bucket file " << filename << " as " << canonicalName;
-        if (rename(filename.c_str(), canonicalName.c_str()) != 0)
+        auto start = std::chrono::steady_clock::now();
+        bool renamed = rename(filename.c_str(), canonicalName.c_str()) == 0;
+        mRenameIO.record(0, std::chrono::steady_clock::now() - start);
+        if (!renamed)
         {
             std::string err("Failed to rename bucket :");
             err += strerror(errno);
@@ -198,11 +271,13 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
             }
         }
 
-        b = std::make_shared<Bucket>(canonicalName, hash);
+        b = std::make_shared<Bucket>(canonicalName, hash, &mReadIO);
         {
             mSharedBuckets.insert(std::make_pair(hash, b));
             mSharedBucketsSize.set_count(mSharedBuckets.size());
         }
+        // callers hashed the file while writing or verifying it
+        recordBucketFileVerified(hash);
     }
     assert(b);
     return b;
@@ -230,7 +305,7 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
         CLOG(TRACE, "Bucket")
             << "BucketManager::getBucketByHash(" << binToHex(hash)
             << ") found no bucket, making new one";
-        auto p = std::make_shared<Bucket>(canonicalName, hash);
+        auto p = std::make_shared<Bucket>(canonicalName, hash, &mReadIO);
         mSharedBuckets.insert(std::make_pair(hash, p));
         mSharedBucketsSize.set_count(mSharedBuckets.size());
         return p;
@@ -238,6 +313,91 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
     return std::shared_ptr<Bucket>();
 }
 
+std::string
+BucketManagerImpl::verifiedFilesFilename()
+{
+    return getBucketDir() + "/verified-buckets.txt";
+}
+
+// One "hash size mtime" line per bucket file.
+void
+BucketManagerImpl::loadVerifiedFiles()
+{
+    if (mVerifiedFilesLoaded)
+    {
+        return;
+    }
+    mVerifiedFilesLoaded = true;
+    std::ifstream in(verifiedFilesFilename());
+    std::string h;
+    size_t size;
+    int64_t mtime;
+    while (in >> h >> size >> mtime)
+    {
+        try
+        {
+            mVerifiedFiles[hexToBin256(h)] = std::make_pair(size, mtime);
+        }
+        catch (std::exception&)
+        {
+            CLOG(WARNING, "Bucket")
+                << "Ignoring bad line in " << verifiedFilesFilename();
+        }
+    }
+}
+
+void
+BucketManagerImpl::saveVerifiedFiles()
+{
+    auto filename = verifiedFilesFilename();
+    auto tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp, std::ofstream::trunc);
+        for (auto const& f : mVerifiedFiles)
+        {
+            out << binToHex(f.first) << " " << f.second.first << " "
+                << f.second.second << "\n";
+        }
+        if (!out)
+        {
+            CLOG(WARNING, "Bucket") << "Failed to write " << tmp;
+            return;
+        }
+    }
+    if (rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        CLOG(WARNING, "Bucket") << "Failed to rename " << tmp;
+        return;
+    }
+    mVerifiedFilesChanged = false;
+}
+
+bool
+BucketManagerImpl::isBucketFileVerified(uint256 const& hash)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    loadVerifiedFiles();
+    auto i = mVerifiedFiles.find(hash);
+    if (i == mVerifiedFiles.end())
+    {
+        return false;
+    }
+    auto filename = bucketFilename(hash);
+    return fs::exists(filename) && fs::size(filename) == i->second.first &&
+           fs::lastModified(filename) == i->second.second;
+}
+
+void
+BucketManagerImpl::recordBucketFileVerified(uint256 const& hash)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    loadVerifiedFiles();
+    auto filename = bucketFilename(hash);
+    mVerifiedFiles[hash] =
+        std::make_pair(fs::size(filename), fs::lastModified(filename));
+    mVerifiedFilesChanged = true;
+}
+
 std::set<Hash>
 BucketManagerImpl::getReferencedBuckets() const
 {
@@ -253,6 +413,8 @@ BucketManagerImpl::getReferencedBuckets() const
         }
     }
 
+    referenced.insert(mRetainedBuckets.begin(), mRetainedBuckets.end());
+
     // Implicitly retain any buckets that are referenced by a state in
     // the publish queue.
     auto pub = mApp.getHistoryManager().getBucketsReferencedByPublishQueue();
@@ -273,6 +435,7 @@ void
 BucketManagerImpl::cleanupStaleFiles()
 {
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    loadRetainedBuckets();
     auto referenced = getReferencedBuckets();
     std::transform(std::begin(mSharedBuckets), std::end(mSharedBuckets),
                    std::inserter(referenced, std::end(referenced)),
@@ -298,6 +461,7 @@ void
 BucketManagerImpl::forgetUnreferencedBuckets()
 {
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    loadRetainedBuckets();
     auto referenced = getReferencedBuckets();
 
     for (auto i = mSharedBuckets.begin(); i != mSharedBuckets.end();)
@@ -330,11 +494,91 @@ BucketManagerImpl::forgetUnreferencedBuckets()
                 std::remove(filename.c_str());
                 auto gzfilename = filename + ".gz";
                 std::remove(gzfilename.c_str());
+                auto indexFilename = j->second->getIndexFilename();
+                std::remove(indexFilename.c_str());
+            }
+            loadVerifiedFiles();
+            if (mVerifiedFiles.erase(j->first) != 0)
+            {
+                mVerifiedFilesChanged = true;
             }
             mSharedBuckets.erase(j);
         }
     }
     mSharedBucketsSize.set_count(mSharedBuckets.size());
+    if (mVerifiedFilesChanged)
+    {
+        saveVerifiedFiles();
+    }
+}
+
+void
+BucketManagerImpl::loadRetainedBuckets()
+{
+    if (mRetainedBucketsLoaded)
+    {
+        return;
+    }
+    std::istringstream in(
+        mApp.getPersistentState().getState(PersistentState::kRetainedBuckets));
+    std::string h;
+    while (in >> h)
+    {
+        mRetainedBuckets.insert(hexToBin256(h));
+    }
+    mRetainedBucketsLoaded = true;
+}
+
+void
+BucketManagerImpl::saveRetainedBuckets()
+{
+    std::ostringstream out;
+    for (auto const& h : mRetainedBuckets)
+    {
+        out << binToHex(h) << " ";
+    }
+    mApp.getPersistentState().setState(PersistentState::kRetainedBuckets,
+                                       out.str());
+}
+
+void
+BucketManagerImpl::retainBuckets(std::vector<std::string> const& hashes)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    loadRetainedBuckets();
+    auto size = mRetainedBuckets.size();
+    for (auto const& h : hashes)
+    {
+        mRetainedBuckets.insert(hexToBin256(h));
+    }
+    if (mRetainedBuckets.size() != size)
+    {
+        saveRetainedBuckets();
+    }
+}
+
+void
+BucketManagerImpl::releaseRetainedBuckets()
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    loadRetainedBuckets();
+    if (!mRetainedBuckets.empty())
+    {
+        mRetainedBuckets.clear();
+        saveRetainedBuckets();
+    }
+}
+
+void
+BucketManagerImpl::syncMemoryMetrics()
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    size_t bytes = 0;
+    for (auto const& b : mSharedBuckets)
+    {
+        bytes += sizeof(b) + b.second->getMemoryBytes();
+    }
+    mSharedBucketsBytes.set_count(bytes);
 }
 
 void
@@ -344,6 +588,55 @@ BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
 {
     auto timer = mBucketAddBatch.TimeScope();
     mBucketList.addBatch(app, currLedger, liveEntries, deadEntries);
+    mTombstoneStats->update(mBucketList);
+    for (auto const& e : liveEntries)
+    {
+        forgetLoadedEntry(LedgerEntryKey(e));
+    }
+    for (auto const& k : deadEntries)
+    {
+        forgetLoadedEntry(k);
+    }
+}
+
+std::shared_ptr<LedgerEntry const>
+BucketManagerImpl::loadLedgerEntry(LedgerKey const& key)
+{
+    HashedLedgerKey hkey(key);
+    auto it = mLoadedEntriesByKey.find(hkey);
+    if (it != mLoadedEntriesByKey.end())
+    {
+        mLookupHit.Mark();
+        mLoadedEntries.splice(mLoadedEntries.begin(), mLoadedEntries,
+                              it->second);
+        return it->second->second;
+    }
+
+    mLookupMiss.Mark();
+    std::shared_ptr<LedgerEntry const> entry;
+    {
+        auto timer = mLookupLoad.TimeScope();
+        entry = mBucketList.getLedgerEntry(key);
+    }
+    mLoadedEntries.emplace_front(hkey, entry);
+    mLoadedEntriesByKey.emplace(std::move(hkey), mLoadedEntries.begin());
+    if (mLoadedEntries.size() > LOADED_ENTRIES_SIZE)
+    {
+        mLoadedEntriesByKey.erase(mLoadedEntries.back().first);
+        mLoadedEntries.pop_back();
+    }
+    return entry;
+}
+
+void
+BucketManagerImpl::forgetLoadedEntry(HashedLedgerKey const& key)
+{
+    auto it = mLoadedEntriesByKey.find(key);
+    if (it != mLoadedEntriesByKey.end())
+    {
+        mLoadedEntries.erase(it->second);
+        mLoadedEntriesByKey.erase(it);
+    }
 }
 
 // updates the given LedgerHeader to reflect the current state of the bucket
@@ -410,9 +703,20 @@ BucketManagerImpl::assumeState(HistoryArchiveState const& has)
         mBucketList.getLevel(i).setCurr(curr);
         mBucketList.getLevel(i).setSnap(snap);
         mBucketList.getLevel(i).setNext(has.currentBuckets.at(i).next);
+
+        // load (or build) the indexes in the background rather than on the
+        // first lookup into each bucket
+        for (auto const& b : {curr, snap})
+        {
+            mApp.getWorkerLanes().post(WorkerLane::BACKGROUND,
+                                       [b]() { b->getIndex(); });
+        }
     }
 
     mBucketList.restartMerges(mApp);
+    mTombstoneStats->update(mBucketList);
+    mLoadedEntries.clear();
+    mLoadedEntriesByKey.clear();
     cleanupStaleFiles();
 }
 
@@ -2,13 +2,18 @@
 
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
+#include "ledger/LedgerHashUtils.h"
 #include "overlay/StellarXDR.h"
+#include "util/FileIOMetrics.h"
+#include "util/XDRStream.h"
 
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 
 // Copyright 2015 Stellar Development Foundation and contributors. Licensed
 // under the Apache License, Version 2.0. See the COPYING file at the root
@@ -19,6 +24,7 @@ namespace medida
 class Timer;
 class Meter;
 class Counter;
+class Histogram;
 }
 
 namespace stellar
@@ -28,6 +34,8 @@ class TmpDir;
 class Application;
 class Bucket;
 class BucketList;
+class BucketMergeScheduler;
+class BucketTombstoneStats;
 struct HistoryArchiveState;
 
 class BucketManagerImpl : public BucketManager
@@ -44,10 +52,44 @@ class BucketManagerImpl : public BucketManager
     medida::Meter& mBucketByteInsert;
     medida::Timer& mBucketAddBatch;
     medida::Timer& mBucketSnapMerge;
+    medida::Histogram& mBucketMergeShadowBytes;
     medida::Counter& mSharedBucketsSize;
+    medida::Counter& mSharedBucketsBytes;
+    FileIOMetrics mReadIO;
+    FileIOMetrics mWriteIO;
+    FileIOMetrics mSyncIO;
+    FileIOMetrics mRenameIO;
+    std::unique_ptr<BucketMergeScheduler> mMergeScheduler;
+    std::unique_ptr<BucketTombstoneStats> mTombstoneStats;
+    XDRWriteOptions mWriteOptions;
 
+    // see loadLedgerEntry: most recently used first
+    typedef std::pair<HashedLedgerKey, std::shared_ptr<LedgerEntry const>>
+        LoadedEntry;
+    std::list<LoadedEntry> mLoadedEntries;
+    std::unordered_map<HashedLedgerKey, std::list<LoadedEntry>::iterator>
+        mLoadedEntriesByKey;
+    medida::Meter& mLookupHit;
+    medida::Meter& mLookupMiss;
+    medida::Timer& mLookupLoad;
+    // see retainBuckets, loaded from the database on first use
+    std::set<Hash> mRetainedBuckets;
+    bool mRetainedBucketsLoaded{false};
+    // see isBucketFileVerified: size and modification time of each verified
+    // bucket file, loaded from the bucket directory on first use and saved
+    // by forgetUnreferencedBuckets
+    std::map<Hash, std::pair<size_t, int64_t>> mVerifiedFiles;
+    bool mVerifiedFilesLoaded{false};
+    bool mVerifiedFilesChanged{false};
+
+    void loadRetainedBuckets();
+    void saveRetainedBuckets();
+    std::string verifiedFilesFilename();
+    void loadVerifiedFiles();
+    void saveVerifiedFiles();
     std::set<Hash> getReferencedBuckets() const;
     void cleanupStaleFiles();
+    void forgetLoadedEntry(HashedLedgerKey const& key);
 
   protected:
     void calculateSkipValues(LedgerHeader& currentHeader);
@@ -55,22 +97,36 @@ class BucketManagerImpl : public BucketManager
     std::string bucketFilename(Hash const& hash);
 
   public:
+    // entries kept by loadLedgerEntry
+    static size_t const LOADED_ENTRIES_SIZE = 4096;
+
     BucketManagerImpl(Application& app);
     ~BucketManagerImpl() override;
     std::string const& getTmpDir() override;
     std::string const& getBucketDir() override;
     BucketList& getBucketList() override;
     medida::Timer& getMergeTimer() override;
+    medida::Histogram& getMergeShadowBytes() override;
+    BucketMergeScheduler& getMergeScheduler() override;
+    XDRWriteOptions const& getWriteOptions() const override;
+    void syncLater(std::shared_ptr<Bucket> const& bucket) override;
     std::shared_ptr<Bucket> adoptFileAsBucket(std::string const& filename,
                                               uint256 const& hash,
                                               size_t nObjects,
                                               size_t nBytes) override;
     std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) override;
+    bool isBucketFileVerified(uint256 const& hash) override;
+    void recordBucketFileVerified(uint256 const& hash) override;
 
     void forgetUnreferencedBuckets() override;
+    void retainBuckets(std::vector<std::string> const& hashes) override;
+    void releaseRetainedBuckets() override;
+    void syncMemoryMetrics() override;
     void addBatch(Application& app, uint32_t currLedger,
                   std::vector<LedgerEntry> const& liveEntries,
                   std::vector<LedgerKey> const& deadEntries) override;
+    std::shared_ptr<LedgerEntry const>
+    loadLedgerEntry(LedgerKey const& key) override;
     void snapshotLedger(LedgerHeader& currentHeader) override;
 
     std::vector<std::string>
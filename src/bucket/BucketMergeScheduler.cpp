@@ -0,0 +1,167 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+
+#include "bucket/BucketList.h"
+#include "bucket/BucketMergeScheduler.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+#include "util/WorkerLanes.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace stellar
+{
+
+double const BucketMergeScheduler::URGENT_FRACTION = 0.5;
+
+BucketMergeScheduler::BucketMergeScheduler(Application& app)
+    : mApp(app)
+    , mMaxRunning(app.getWorkerThreadCount())
+    , mMaxRunningDeep(std::max<size_t>(1, app.getWorkerThreadCount() / 2))
+    , mAdaptive(app.getConfig().MERGE_ADAPTIVE_PRIORITY)
+    , mQueues(BucketList::kNumLevels)
+    , mUrgentMerges(
+          app.getMetrics().NewMeter({"bucket", "merge", "urgent"}, "merge"))
+{
+    for (uint32_t i = 0; i < mQueues.size(); ++i)
+    {
+        auto lev = "level-" + std::to_string(i);
+        mQueueDepth.push_back(
+            &app.getMetrics().NewCounter({"bucket", "merge-queue", lev}));
+        mMergeTime.push_back(
+            &app.getMetrics().NewTimer({"bucket", "merge-time", lev}));
+    }
+}
+
+void
+BucketMergeScheduler::enqueue(uint32_t level, std::function<void()> merge)
+{
+    // Levels past the ones we know about (only possible in tests that deepen
+    // the BucketList) share the deepest queue.
+    uint32_t maxLevel = static_cast<uint32_t>(mQueues.size() - 1);
+    level = std::min(level, maxLevel);
+
+    auto ledgers = level == 0 ? 0 : BucketList::levelHalf(level - 1);
+    auto deadline = std::chrono::steady_clock::now() +
+                    ledgers * mApp.getConfig().getExpectedLedgerCloseTime();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQueues[level].push_back({std::move(merge), deadline});
+    mQueueDepth[level]->inc();
+    CLOG(TRACE, "Bucket") << "Queued merge on level " << level << " ("
+                          << mRunning << " running)";
+    dispatchReady();
+}
+
+size_t
+BucketMergeScheduler::getQueuedMerges() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t n = 0;
+    for (auto const& q : mQueues)
+    {
+        n += q.size();
+    }
+    return n;
+}
+
+size_t
+BucketMergeScheduler::getRunningMerges() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mRunning;
+}
+
+bool
+BucketMergeScheduler::isUrgent(uint32_t level, QueuedMerge const& merge,
+                               std::chrono::steady_clock::time_point now) const
+{
+    // Level 0 merges are needed at once and always go first anyway.
+    auto const& timer = *mMergeTime[level];
+    if (!mAdaptive || level == 0 || timer.count() == 0)
+    {
+        return false;
+    }
+    // The timer's unit is milliseconds.
+    std::chrono::duration<double, std::milli> predicted(timer.mean());
+    return now >= merge.mDeadline ||
+           predicted > URGENT_FRACTION * (merge.mDeadline - now);
+}
+
+void
+BucketMergeScheduler::dispatchFront(uint32_t level)
+{
+    auto& q = mQueues[level];
+    auto merge = std::move(q.front().mMerge);
+    q.pop_front();
+    mQueueDepth[level]->dec();
+    ++mRunning;
+    if (level >= DEEP_LEVEL)
+    {
+        ++mRunningDeep;
+    }
+    mApp.getWorkerLanes().post(
+        level >= DEEP_LEVEL ? WorkerLane::BACKGROUND : WorkerLane::MERGE,
+        [this, level, merge]() { run(level, merge); });
+}
+
+void
+BucketMergeScheduler::dispatchReady()
+{
+    // Urgent merges first, deepest (longest) first, ignoring the deep cap.
+    auto now = std::chrono::steady_clock::now();
+    for (uint32_t level = static_cast<uint32_t>(mQueues.size()); level-- > 0;)
+    {
+        auto& q = mQueues[level];
+        while (!q.empty() && mRunning < mMaxRunning &&
+               isUrgent(level, q.front(), now))
+        {
+            CLOG(DEBUG, "Bucket")
+                << "Dispatching urgent merge on level " << level;
+            mUrgentMerges.Mark();
+            dispatchFront(level);
+        }
+    }
+
+    for (uint32_t level = 0; level < mQueues.size(); ++level)
+    {
+        auto& q = mQueues[level];
+        bool deep = level >= DEEP_LEVEL;
+        while (!q.empty() && mRunning < mMaxRunning &&
+               (!deep || mRunningDeep < mMaxRunningDeep))
+        {
+            dispatchFront(level);
+        }
+        if (mRunning >= mMaxRunning)
+        {
+            break;
+        }
+    }
+}
+
+void
+BucketMergeScheduler::run(uint32_t level, std::function<void()> const& merge)
+{
+    {
+        auto timer = mMergeTime[level]->TimeScope();
+        merge();
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    --mRunning;
+    if (level >= DEEP_LEVEL)
+    {
+        --mRunningDeep;
+    }
+    dispatchReady();
+}
+}
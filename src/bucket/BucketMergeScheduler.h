@@ -0,0 +1,99 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Meter;
+class Timer;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * BucketMergeScheduler sits between FutureBucket and the worker io_service,
+ * deciding which pending merge runs next. Merges are queued per BucketList
+ * level and dispatched shallowest-level-first, with a bound on the total
+ * number of merges in flight (so the queue, not the io_service, decides the
+ * order) and a tighter bound on merges of deep levels, which can run for a
+ * long time and should not starve the small merges that addBatch waits on at
+ * the next ledger close.
+ *
+ * Every queued merge is eventually dispatched: slots are released by the
+ * worker that finished a merge, so a caller blocking on a still-queued merge
+ * (FutureBucket::resolve) will wake once an earlier merge completes.
+ *
+ * A merge on level i is needed when level i-1 next spills, half of level i-1's
+ * size in ledgers after it is queued (at once for level 0). With
+ * MERGE_ADAPTIVE_PRIORITY, a queued merge whose level's mean merge time is more
+ * than URGENT_FRACTION of the time left until then is "urgent": it is
+ * dispatched before any other and regardless of the deep-merge cap.
+ *
+ * Methods are threadsafe; enqueue is called from the main thread and the
+ * dispatch bookkeeping runs on worker threads.
+ */
+class BucketMergeScheduler : NonMovableOrCopyable
+{
+  public:
+    // Levels at or above this are "deep" and subject to the deep-merge cap.
+    static uint32_t const DEEP_LEVEL = 5;
+
+    // Share of the time until a merge is needed that it may be predicted to
+    // take before it is urgent.
+    static double const URGENT_FRACTION;
+
+    BucketMergeScheduler(Application& app);
+
+    // Queue `merge` to run on a worker thread once a slot for `level` frees
+    // up. `merge` must not throw; FutureBucket wraps it in a packaged_task.
+    void enqueue(uint32_t level, std::function<void()> merge);
+
+    // Number of merges queued but not yet dispatched, across all levels.
+    size_t getQueuedMerges() const;
+
+    // Number of merges currently dispatched to worker threads.
+    size_t getRunningMerges() const;
+
+  private:
+    struct QueuedMerge
+    {
+        std::function<void()> mMerge;
+        std::chrono::steady_clock::time_point mDeadline;
+    };
+
+    Application& mApp;
+    size_t const mMaxRunning;
+    size_t const mMaxRunningDeep;
+    bool const mAdaptive;
+
+    mutable std::mutex mMutex;
+    std::vector<std::deque<QueuedMerge>> mQueues;
+    size_t mRunning{0};
+    size_t mRunningDeep{0};
+
+    std::vector<medida::Counter*> mQueueDepth;
+    std::vector<medida::Timer*> mMergeTime;
+    medida::Meter& mUrgentMerges;
+
+    bool isUrgent(uint32_t level, QueuedMerge const& merge,
+                  std::chrono::steady_clock::time_point now) const;
+    // Post the merge at the front of `level`'s queue. Call with mMutex held.
+    void dispatchFront(uint32_t level);
+    // Post as many queued merges as the caps allow. Call with mMutex held.
+    void dispatchReady();
+    void run(uint32_t level, std::function<void()> const& merge);
+};
+}
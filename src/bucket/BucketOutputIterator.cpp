@@ -4,8 +4,10 @@
 
 #include "bucket/BucketOutputIterator.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Random.h"
+#include "util/Fs.h"
 
 namespace stellar
 {
@@ -30,18 +32,22 @@ randomBucketName(std::string const& tmpDir)
 
 /**
  * Helper class that points to an output tempfile. Absorbs BucketEntries and
- * hashes them while writing to either destination. Produces a Bucket when done.
+ * hashes and indexes them while writing to either destination. Produces a
+ * Bucket when done.
  */
 BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
-                                           bool keepDeadEntries)
+                                           bool keepDeadEntries,
+                                           XDRWriteOptions const& options,
+                                           bool hashed)
     : mFilename(randomBucketName(tmpDir))
     , mBuf(nullptr)
-    , mHasher(SHA256::create())
+    , mHasher(hashed ? SHA256::create() : nullptr)
+    , mIndex(std::make_shared<BucketIndex>())
     , mKeepDeadEntries(keepDeadEntries)
 {
     CLOG(TRACE, "Bucket") << "BucketOutputIterator opening file to write: "
                           << mFilename;
-    mOut.open(mFilename);
+    mOut.open(mFilename, false, options);
 }
 
 void
@@ -63,8 +69,7 @@ BucketOutputIterator::put(BucketEntry const& e)
         // merely replace (same identity), the buffered entry.
         if (mCmp(*mBuf, e))
         {
-            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-            mObjectsPut++;
+            writeBuffered();
         }
     }
     else
@@ -76,17 +81,71 @@ BucketOutputIterator::put(BucketEntry const& e)
     *mBuf = e;
 }
 
+void
+BucketOutputIterator::putRaw(LedgerKey const& key, bool dead,
+                             char const* data, uint32_t size)
+{
+    assert(!mBuf);
+    if (!mKeepDeadEntries && dead)
+    {
+        return;
+    }
+    mIndex->add(key, mBytesPut, dead);
+    mOut.writeRaw(data, size, mHasher.get(), &mBytesPut);
+    mObjectsPut++;
+}
+
+void
+BucketOutputIterator::writeBuffered()
+{
+    mIndex->add(BucketIndex::getBucketEntryKey(*mBuf), mBytesPut,
+                mBuf->type() == DEADENTRY);
+    mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
+    mObjectsPut++;
+}
+
+void
+BucketOutputIterator::append(BucketOutputIterator& part)
+{
+    assert(mOut);
+    assert(part.mOut);
+    if (mBuf)
+    {
+        writeBuffered();
+        mBuf.reset();
+    }
+    if (part.mBuf)
+    {
+        part.writeBuffered();
+        part.mBuf.reset();
+    }
+    part.mOut.close();
+
+    if (part.mBytesPut != 0)
+    {
+        mIndex->append(*part.mIndex, mBytesPut);
+        fs::MappedFile in(part.mFilename);
+        assert(in.size() == part.mBytesPut);
+        mOut.writeFramed(in.data(), in.size(), mHasher.get(), &mBytesPut);
+        mObjectsPut += part.mObjectsPut;
+    }
+    std::remove(part.mFilename.c_str());
+    part.mBytesPut = 0;
+    part.mObjectsPut = 0;
+}
+
 std::shared_ptr<Bucket>
 BucketOutputIterator::getBucket(BucketManager& bucketManager)
 {
     assert(mOut);
+    assert(mHasher);
     if (mBuf)
     {
-        mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-        mObjectsPut++;
+        writeBuffered();
         mBuf.reset();
     }
 
+    // syncs the file, if asked to, before it becomes a bucket
     mOut.close();
     if (mObjectsPut == 0 || mBytesPut == 0)
     {
@@ -96,7 +155,10 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager)
         std::remove(mFilename.c_str());
         return std::make_shared<Bucket>();
     }
-    return bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
-                                           mObjectsPut, mBytesPut);
+    mIndex->finish();
+    auto b = bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
+                                             mObjectsPut, mBytesPut);
+    b->setIndex(mIndex);
+    return b;
 }
 }
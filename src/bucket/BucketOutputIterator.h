@@ -15,6 +15,7 @@ namespace stellar
 {
 
 class Bucket;
+class BucketIndex;
 class BucketManager;
 
 // Helper class that writes new elements to a file and returns a bucket
@@ -26,15 +27,35 @@ class BucketOutputIterator
     BucketEntryIdCmp mCmp;
     std::unique_ptr<BucketEntry> mBuf;
     std::unique_ptr<SHA256> mHasher;
+    std::shared_ptr<BucketIndex> mIndex;
     size_t mBytesPut{0};
     size_t mObjectsPut{0};
     bool mKeepDeadEntries{true};
 
+    void writeBuffered();
+
   public:
-    BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries);
+    // An iterator that is not `hashed` can only be appended to another one,
+    // not turned into a bucket. `options` says how the file is written (see
+    // BucketManager::getWriteOptions).
+    BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries,
+                         XDRWriteOptions const& options = XDRWriteOptions(),
+                         bool hashed = true);
 
     void put(BucketEntry const& e);
 
+    // Writes an entry given as the raw XDR of a BucketEntry for `key` (see
+    // BucketRawInputIterator), without decoding it. Unlike put(), entries
+    // must come in strictly increasing key order, and the two must not be
+    // mixed on one iterator.
+    void putRaw(LedgerKey const& key, bool dead, char const* data,
+                uint32_t size);
+
+    // Move everything written to `part` after what was written here, hashing
+    // and indexing it; the keys in `part` must all be greater. Consumes
+    // `part`, removing its file.
+    void append(BucketOutputIterator& part);
+
     std::shared_ptr<Bucket> getBucket(BucketManager& bucketManager);
 };
 }
@@ -7,31 +7,52 @@
 // else.
 #include "util/asio.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketApplicator.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketInputIterator.h"
 #include "bucket/BucketList.h"
+#include "bucket/BucketListExporter.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketManagerImpl.h"
+#include "bucket/BucketMergeScheduler.h"
+#include "bucket/BucketOutputIterator.h"
+#include "bucket/BucketTombstoneStats.h"
 #include "bucket/LedgerCmp.h"
 #include "crypto/Hex.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "main/PersistentState.h"
+#include "medida/counter.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
+#include "simulation/LoadGenerator.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
 #include "util/types.h"
 #include "xdrpp/autocheck.h"
 #include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <future>
+#include <limits>
+#include <map>
+#include <set>
+#include <thread>
+#include <unordered_map>
 
 using namespace stellar;
 
@@ -458,6 +479,150 @@ TEST_CASE("bucket tombstones expire at bottom level", "[bucket][tombstones]")
     REQUIRE(pair2.second == 0);
 }
 
+TEST_CASE("bucket tombstone analysis", "[bucket][tombstones]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto a = LedgerTestUtils::generateValidLedgerEntry(5);
+    auto b = LedgerTestUtils::generateValidLedgerEntry(5);
+    auto c = LedgerTestUtils::generateValidLedgerEntry(5);
+    std::vector<LedgerKey> dead{LedgerEntryKey(a), LedgerEntryKey(b),
+                                LedgerEntryKey(c)};
+
+    // newest first: a is live further down, b is nowhere, and the nearest
+    // older entry for c is a tombstone
+    std::vector<std::shared_ptr<Bucket>> buckets{
+        Bucket::fresh(bm, {}, dead), Bucket::fresh(bm, {}, {dead[2]}),
+        Bucket::fresh(bm, {a, c}, {})};
+
+    auto counts = BucketTombstoneStats::countBucket(buckets, 0, true);
+    REQUIRE(counts.mLive == 0);
+    REQUIRE(counts.mDead == 3);
+    REQUIRE(counts.mDroppable == 2);
+    REQUIRE(counts.mDroppableBytes > 0);
+    REQUIRE(counts.mDroppableBytes < fs::size(buckets[0]->getFilename()));
+
+    counts = BucketTombstoneStats::countBucket(buckets, 1, true);
+    REQUIRE(counts.mDead == 1);
+    REQUIRE(counts.mDroppable == 0);
+
+    counts = BucketTombstoneStats::countBucket(buckets, 2, false);
+    REQUIRE(counts.mLive == 2);
+    REQUIRE(counts.mDead == 0);
+    REQUIRE(counts.mDroppable == 0);
+}
+
+TEST_CASE("merge scheduler bounds deep merges", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& sched = app->getBucketManager().getMergeScheduler();
+
+    size_t const nMerges = 16;
+    size_t const maxDeep =
+        std::max<size_t>(1, std::thread::hardware_concurrency() / 2);
+    std::atomic<size_t> running{0};
+    std::atomic<size_t> maxRunning{0};
+    std::vector<std::future<void>> done;
+    for (size_t i = 0; i < nMerges; ++i)
+    {
+        auto p = std::make_shared<std::promise<void>>();
+        done.push_back(p->get_future());
+        sched.enqueue(BucketList::kNumLevels - 1, [&running, &maxRunning, p]() {
+            size_t n = ++running;
+            size_t m = maxRunning;
+            while (n > m && !maxRunning.compare_exchange_weak(m, n))
+            {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            --running;
+            p->set_value();
+        });
+    }
+    for (auto& f : done)
+    {
+        f.wait();
+    }
+    REQUIRE(maxRunning <= maxDeep);
+    REQUIRE(sched.getQueuedMerges() == 0);
+    auto& depth = app->getMetrics().NewCounter(
+        {"bucket", "merge-queue",
+         "level-" + std::to_string(BucketList::kNumLevels - 1)});
+    REQUIRE(depth.count() == 0);
+}
+
+TEST_CASE("merge scheduler runs urgent deep merges past the cap", "[bucket]")
+{
+    size_t const workers =
+        std::max<size_t>(1, std::thread::hardware_concurrency());
+    size_t const maxDeep = std::max<size_t>(1, workers / 2);
+    if (workers == maxDeep)
+    {
+        return;
+    }
+
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& sched = app->getBucketManager().getMergeScheduler();
+
+    // merges on this level took an hour so far, far past the time until one
+    // queued now is needed
+    uint32_t const level = BucketMergeScheduler::DEEP_LEVEL;
+    app->getMetrics()
+        .NewTimer({"bucket", "merge-time", "level-" + std::to_string(level)})
+        .Update(std::chrono::hours(1));
+
+    std::atomic<size_t> running{0};
+    std::atomic<size_t> maxRunning{0};
+    std::vector<std::future<void>> done;
+    for (size_t i = 0; i < workers; ++i)
+    {
+        auto p = std::make_shared<std::promise<void>>();
+        done.push_back(p->get_future());
+        sched.enqueue(level, [&running, &maxRunning, p]() {
+            size_t n = ++running;
+            size_t m = maxRunning;
+            while (n > m && !maxRunning.compare_exchange_weak(m, n))
+            {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            --running;
+            p->set_value();
+        });
+    }
+    for (auto& f : done)
+    {
+        f.wait();
+    }
+    REQUIRE(maxRunning > maxDeep);
+    REQUIRE(app->getMetrics()
+                .NewMeter({"bucket", "merge", "urgent"}, "merge")
+                .count() == workers);
+}
+
+TEST_CASE("bucket list times waits for merges", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    BucketList bl;
+    autocheck::generator<std::vector<LedgerKey>> deadGen;
+    for (uint32_t i = 1; i < 130; ++i)
+    {
+        bl.addBatch(*app, i, LedgerTestUtils::generateValidLedgerEntries(8),
+                    deadGen(4));
+    }
+    // level 0 commits its merge right after starting it
+    auto& waits =
+        app->getMetrics().NewTimer({"bucket", "merge-wait", "level-0"});
+    REQUIRE(waits.count() != 0);
+}
+
 TEST_CASE("file-backed buckets", "[bucket][bucketbench]")
 {
     VirtualClock clock;
@@ -492,6 +657,683 @@ TEST_CASE("file-backed buckets", "[bucket][bucketbench]")
     CLOG(DEBUG, "Bucket") << "Spill file size: " << fileSize(b1->getFilename());
 }
 
+TEST_CASE("bucket index point lookups", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> live(
+        LedgerTestUtils::generateValidLedgerEntries(1000));
+    std::vector<LedgerKey> dead(100);
+    for (auto& e : dead)
+        e = deadGen(3);
+    auto b = Bucket::fresh(app->getBucketManager(), live, dead);
+
+    // A second Bucket object on the same file has no index until first use,
+    // and then reads the one saved next to the bucket file.
+    auto reloaded = std::make_shared<Bucket>(b->getFilename(), b->getHash());
+
+    size_t n = 0;
+    for (BucketInputIterator iter(b); iter; ++iter, ++n)
+    {
+        auto key = BucketIndex::getBucketEntryKey(*iter);
+        BucketEntry e1, e2;
+        REQUIRE(b->getBucketEntry(key, e1));
+        REQUIRE(reloaded->getBucketEntry(key, e2));
+        REQUIRE(e1 == *iter);
+        REQUIRE(e2 == *iter);
+    }
+    REQUIRE(b->getIndex()->size() == n);
+    REQUIRE(reloaded->getIndex()->size() == n);
+
+    // Keys not in the bucket are never found, whether or not the bloom
+    // filter lets them through.
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        auto key = deadGen(3);
+        bool scanned = false;
+        for (BucketInputIterator iter(b); iter; ++iter)
+        {
+            if (BucketIndex::getBucketEntryKey(*iter) == key)
+            {
+                scanned = true;
+                break;
+            }
+        }
+        BucketEntry e;
+        REQUIRE(b->getBucketEntry(key, e) == scanned);
+    }
+
+    // Shards start at increasing entry offsets and together cover the bucket.
+    auto offsets = b->getIndex()->getShardOffsets(4);
+    REQUIRE(offsets.size() == 4);
+    REQUIRE(offsets[0] == 0);
+    size_t covered = 0;
+    for (size_t i = 0; i < offsets.size(); ++i)
+    {
+        size_t end = i + 1 < offsets.size() ? offsets[i + 1]
+                                            : std::numeric_limits<size_t>::max();
+        BucketInputIterator iter(b);
+        iter.seek(offsets[i]);
+        for (; iter && iter.pos() < end; ++iter)
+        {
+            ++covered;
+        }
+    }
+    REQUIRE(covered == n);
+
+    BucketEntry e;
+    auto empty = std::make_shared<Bucket>();
+    REQUIRE(!empty->getIndex());
+    REQUIRE(!empty->getBucketEntry(deadGen(3), e));
+}
+
+TEST_CASE("bucket list point lookups", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto& bl = bm.getBucketList();
+
+    // what the bucket list should hold, and the keys of what it should not
+    std::unordered_map<HashedLedgerKey, LedgerEntry> live;
+    std::vector<LedgerKey> dead;
+    auto check = [&]() {
+        for (auto const& kv : live)
+        {
+            auto e = bl.getLedgerEntry(kv.first.key());
+            REQUIRE(e);
+            REQUIRE(*e == kv.second);
+            auto loaded = bm.loadLedgerEntry(kv.first.key());
+            REQUIRE(loaded);
+            REQUIRE(*loaded == kv.second);
+        }
+        for (auto const& k : dead)
+        {
+            REQUIRE(!bl.getLedgerEntry(k));
+            REQUIRE(!bm.loadLedgerEntry(k));
+        }
+    };
+
+    for (uint32_t i = 1; !app->getClock().getIOService().stopped() && i < 200;
+         ++i)
+    {
+        app->getClock().crank(false);
+        auto liveBatch = LedgerTestUtils::generateValidLedgerEntries(5);
+        std::vector<LedgerKey> deadBatch;
+        if (i % 3 == 0)
+        {
+            // change an entry added earlier, now likely on a deeper level
+            auto it = live.begin();
+            std::advance(it, rand_uniform<size_t>(0, live.size() - 1));
+            it->second.lastModifiedLedgerSeq = i;
+            liveBatch.push_back(it->second);
+        }
+        if (i % 7 == 0)
+        {
+            auto it = live.begin();
+            std::advance(it, rand_uniform<size_t>(0, live.size() - 1));
+            deadBatch.push_back(it->first.key());
+        }
+        for (auto const& e : liveBatch)
+        {
+            live[LedgerEntryKey(e)] = e;
+        }
+        for (auto const& k : deadBatch)
+        {
+            live.erase(k);
+            dead.push_back(k);
+        }
+        bm.addBatch(*app, i, liveBatch, deadBatch);
+        if (i % 20 == 0)
+        {
+            check();
+        }
+    }
+    check();
+}
+
+TEST_CASE("bucket list export", "[bucket][export]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto& bl = bm.getBucketList();
+
+    std::unordered_map<HashedLedgerKey, LedgerEntry> live;
+    for (uint32_t i = 1; !app->getClock().getIOService().stopped() && i < 130;
+         ++i)
+    {
+        app->getClock().crank(false);
+        auto liveBatch = LedgerTestUtils::generateValidLedgerEntries(8);
+        std::vector<LedgerKey> deadBatch;
+        if (i % 3 == 0)
+        {
+            // shadows an older entry, likely on a deeper level
+            auto it = live.begin();
+            std::advance(it, rand_uniform<size_t>(0, live.size() - 1));
+            it->second.lastModifiedLedgerSeq = i;
+            liveBatch.push_back(it->second);
+        }
+        if (i % 5 == 0)
+        {
+            auto it = live.begin();
+            std::advance(it, rand_uniform<size_t>(0, live.size() - 1));
+            deadBatch.push_back(it->first.key());
+        }
+        for (auto const& e : liveBatch)
+        {
+            live[LedgerEntryKey(e)] = e;
+        }
+        for (auto const& k : deadBatch)
+        {
+            live.erase(k);
+        }
+        bm.addBatch(*app, i, liveBatch, deadBatch);
+    }
+
+    std::vector<std::shared_ptr<Bucket const>> buckets;
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        buckets.push_back(bl.getLevel(i).getCurr());
+        buckets.push_back(bl.getLevel(i).getSnap());
+    }
+
+    std::map<std::string, uint64_t> expected;
+    std::string accountLine;
+    for (auto const& kv : live)
+    {
+        auto const& d = kv.second.data;
+        switch (d.type())
+        {
+        case ACCOUNT:
+            ++expected["accounts"];
+            if (!d.account().signers.empty())
+            {
+                expected["signers"] += d.account().signers.size();
+            }
+            accountLine = KeyUtils::toStrKey(d.account().accountID) + "," +
+                          std::to_string(d.account().balance) + ",";
+            break;
+        case TRUSTLINE:
+            ++expected["trustlines"];
+            break;
+        case OFFER:
+            ++expected["offers"];
+            break;
+        case DATA:
+            ++expected["accountdata"];
+            break;
+        default:
+            break;
+        }
+    }
+
+    auto dir = app->getTmpDirManager().tmpDir("export");
+    auto exportLines = [&](BucketListExporter::Options options) {
+        auto res = BucketListExporter::exportEntries(buckets, options);
+        std::multiset<std::string> lines;
+        for (auto const& f : res.mFiles)
+        {
+            std::ifstream in(options.mDir + "/" + f);
+            std::string line;
+            std::getline(in, line); // header
+            while (std::getline(in, line))
+            {
+                lines.insert(line);
+            }
+        }
+        REQUIRE(fs::exists(options.mDir + "/copy.sql"));
+        return std::make_pair(res, lines);
+    };
+
+    BucketListExporter::Options options;
+    options.mDir = dir.getName() + "/one";
+    auto one = exportLines(options);
+    REQUIRE(one.first.mRows == expected);
+    if (!accountLine.empty())
+    {
+        REQUIRE(std::any_of(one.second.begin(), one.second.end(),
+                            [&](std::string const& l) {
+                                return l.compare(0, accountLine.size(),
+                                                 accountLine) == 0;
+                            }));
+    }
+
+    SECTION("in key ranges on threads")
+    {
+        options.mDir = dir.getName() + "/four";
+        options.mThreads = 4;
+        auto four = exportLines(options);
+        REQUIRE(four.first.mRows == expected);
+        REQUIRE(four.first.mEntriesRead == one.first.mEntriesRead);
+        REQUIRE(four.second == one.second);
+    }
+
+    SECTION("some types")
+    {
+        options.mDir = dir.getName() + "/offers";
+        options.mTypes = {OFFER};
+        auto offers = exportLines(options);
+        std::map<std::string, uint64_t> onlyOffers;
+        if (expected.count("offers"))
+        {
+            onlyOffers["offers"] = expected["offers"];
+        }
+        REQUIRE(offers.first.mRows == onlyOffers);
+    }
+}
+
+TEST_CASE("bucket index files", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> live(
+        LedgerTestUtils::generateValidLedgerEntries(500));
+    std::vector<LedgerKey> dead(50);
+    for (auto& e : dead)
+        e = deadGen(3);
+    auto b = Bucket::fresh(app->getBucketManager(), live, dead);
+    auto const& indexFile = b->getIndexFilename();
+    auto fileSize = fs::size(b->getFilename());
+    REQUIRE(fs::exists(indexFile));
+
+    auto index = BucketIndex::load(indexFile, b->getHash(), fileSize);
+    REQUIRE(index);
+    REQUIRE(index->size() == b->getIndex()->size());
+    REQUIRE(index->getLiveEntries() == b->getIndex()->getLiveEntries());
+    REQUIRE(index->getDeadEntries() == b->getIndex()->getDeadEntries());
+    for (BucketInputIterator iter(b); iter; ++iter)
+    {
+        REQUIRE(index->mayContain(BucketIndex::getBucketEntryKey(*iter)));
+    }
+
+    // not the index of another bucket or of another version of the file
+    REQUIRE(!BucketIndex::load(indexFile, HashUtils::random(), fileSize));
+    REQUIRE(!BucketIndex::load(indexFile, b->getHash(), fileSize + 1));
+
+    // a damaged index is ignored, and rebuilt on first use
+    {
+        std::fstream f(indexFile,
+                       std::ios::in | std::ios::out | std::ios::binary);
+        char c;
+        f.seekg(40);
+        f.get(c);
+        f.seekp(40);
+        f.put(static_cast<char>(c ^ 0xff));
+    }
+    REQUIRE(!BucketIndex::load(indexFile, b->getHash(), fileSize));
+    std::remove(indexFile.c_str());
+    auto reloaded = std::make_shared<Bucket>(b->getFilename(), b->getHash());
+    REQUIRE(reloaded->countLiveAndDeadEntries() ==
+            b->countLiveAndDeadEntries());
+    REQUIRE(BucketIndex::load(indexFile, b->getHash(), fileSize));
+}
+
+TEST_CASE("mapped bucket input matches stream input", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    autocheck::generator<LedgerKey> deadGen;
+    std::vector<LedgerEntry> live(900);
+    std::vector<LedgerKey> dead(100);
+    for (auto& e : live)
+        e = LedgerTestUtils::generateValidLedgerEntry(3);
+    for (auto& e : dead)
+        e = deadGen(3);
+    std::shared_ptr<Bucket> b =
+        Bucket::fresh(app->getBucketManager(), live, dead);
+
+    BucketInputIterator streamed(b);
+    BucketInputIterator mapped(b, true);
+    size_t n = 0;
+    for (; streamed && mapped; ++streamed, ++mapped, ++n)
+    {
+        REQUIRE(*streamed == *mapped);
+    }
+    REQUIRE(!streamed);
+    REQUIRE(!mapped);
+    REQUIRE(n == b->countLiveAndDeadEntries().first +
+                     b->countLiveAndDeadEntries().second);
+
+    std::shared_ptr<Bucket> empty = std::make_shared<Bucket>();
+    REQUIRE(!BucketInputIterator(empty, true));
+}
+
+TEST_CASE("merging copies raw entries", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    autocheck::generator<bool> flip;
+    std::vector<LedgerEntry> live(200), shadowLive;
+    std::vector<LedgerKey> dead, noDead;
+    for (auto& e : live)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    std::shared_ptr<Bucket> oldBucket = Bucket::fresh(bm, live, noDead);
+    for (auto& e : live)
+    {
+        if (flip())
+        {
+            dead.push_back(LedgerEntryKey(e));
+        }
+        else if (flip())
+        {
+            shadowLive.push_back(e);
+        }
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    std::shared_ptr<Bucket> newBucket = Bucket::fresh(bm, live, dead);
+    std::shared_ptr<Bucket> shadow = Bucket::fresh(bm, shadowLive, noDead);
+
+    for (bool keepDead : {true, false})
+    {
+        auto merged =
+            Bucket::merge(bm, oldBucket, newBucket, {shadow}, keepDead);
+
+        // the same merge, decoding and re-encoding every entry
+        BucketEntryIdCmp cmp;
+        BucketInputIterator oi(oldBucket), ni(newBucket), si(shadow);
+        BucketOutputIterator out(bm.getTmpDir(), keepDead);
+        auto put = [&](BucketEntry const& e) {
+            while (si && cmp(*si, e))
+            {
+                ++si;
+            }
+            if (!si || cmp(e, *si))
+            {
+                out.put(e);
+            }
+        };
+        while (oi || ni)
+        {
+            if (!ni || (oi && cmp(*oi, *ni)))
+            {
+                put(*oi);
+                ++oi;
+            }
+            else
+            {
+                if (oi && !cmp(*ni, *oi))
+                {
+                    ++oi;
+                }
+                put(*ni);
+                ++ni;
+            }
+        }
+        auto expected = out.getBucket(bm);
+        REQUIRE(merged->getHash() == expected->getHash());
+    }
+}
+
+TEST_CASE("merging seeks in shadows", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<LedgerEntry> shadowLive(4000), live(20);
+    std::vector<LedgerKey> noDead;
+    for (auto& e : shadowLive)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    for (size_t i = 0; i < live.size(); ++i)
+    {
+        // every other entry is shadowed
+        live[i] = i % 2 == 0 ? shadowLive[i * 197]
+                             : LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    std::shared_ptr<Bucket> shadow = Bucket::fresh(bm, shadowLive, noDead);
+    std::shared_ptr<Bucket> oldBucket = Bucket::fresh(bm, {}, noDead);
+    std::shared_ptr<Bucket> newBucket = Bucket::fresh(bm, live, noDead);
+
+    auto& shadowBytes = bm.getMergeShadowBytes();
+    auto merges = shadowBytes.count();
+    auto merged = Bucket::merge(bm, oldBucket, newBucket, {shadow});
+    REQUIRE(shadowBytes.count() == merges + 1);
+    REQUIRE(shadowBytes.max() > 0);
+    REQUIRE(shadowBytes.max() < fs::size(shadow->getFilename()) / 4);
+
+    BucketEntry e;
+    for (size_t i = 0; i < live.size(); ++i)
+    {
+        REQUIRE(merged->getBucketEntry(LedgerEntryKey(live[i]), e) ==
+                (i % 2 != 0));
+    }
+}
+
+TEST_CASE("merging in parts matches merging in one pass", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    autocheck::generator<bool> flip;
+    std::vector<LedgerEntry> live(3000), newLive, shadowLive;
+    std::vector<LedgerKey> dead, noDead;
+    for (auto& e : live)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    std::shared_ptr<Bucket> oldBucket = Bucket::fresh(bm, live, noDead);
+    for (auto const& e : live)
+    {
+        if (flip())
+        {
+            dead.push_back(LedgerEntryKey(e));
+        }
+        else if (flip())
+        {
+            shadowLive.push_back(e);
+        }
+        if (flip())
+        {
+            newLive.push_back(LedgerTestUtils::generateValidLedgerEntry(5));
+        }
+    }
+    std::shared_ptr<Bucket> newBucket = Bucket::fresh(bm, newLive, dead);
+    std::shared_ptr<Bucket> shadow = Bucket::fresh(bm, shadowLive, noDead);
+
+    for (bool keepDead : {true, false})
+    {
+        auto whole = Bucket::merge(bm, oldBucket, newBucket, {shadow},
+                                   keepDead, 1);
+        for (size_t parts : {2, 4, 7})
+        {
+            auto split = Bucket::merge(bm, oldBucket, newBucket, {shadow},
+                                       keepDead, parts);
+            REQUIRE(split->getHash() == whole->getHash());
+        }
+    }
+
+    // the index of a merge in parts finds every entry
+    auto split = Bucket::merge(bm, oldBucket, newBucket, {}, true, 4);
+    BucketEntry e;
+    for (BucketInputIterator iter(split); iter; ++iter)
+    {
+        REQUIRE(split->getBucketEntry(BucketIndex::getBucketEntryKey(*iter),
+                                      e));
+        REQUIRE(e == *iter);
+    }
+}
+
+TEST_CASE("merging in memory matches merging files", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    autocheck::generator<bool> flip;
+    std::vector<LedgerEntry> live(300), newLive;
+    std::vector<LedgerKey> dead, noDead;
+    for (auto& e : live)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    for (auto const& e : live)
+    {
+        if (flip())
+        {
+            dead.push_back(LedgerEntryKey(e));
+        }
+        if (flip())
+        {
+            newLive.push_back(e);
+        }
+    }
+    auto oldBucket = Bucket::fresh(bm, live, noDead);
+    auto newBucket = Bucket::fresh(bm, newLive, dead);
+    REQUIRE(oldBucket->getEntries());
+    REQUIRE(newBucket->getEntries());
+
+    // dead entries win over live ones for the same key in a fresh bucket
+    BucketEntry e;
+    for (auto const& k : dead)
+    {
+        REQUIRE(newBucket->getBucketEntry(k, e));
+        REQUIRE(e.type() == DEADENTRY);
+    }
+
+    std::vector<std::vector<BucketEntry>> inputs{*oldBucket->getEntries(),
+                                                 *newBucket->getEntries()};
+    std::map<bool, Hash> inMemory;
+    for (bool keepDead : {true, false})
+    {
+        auto merged = Bucket::merge(bm, oldBucket, newBucket, {}, keepDead);
+        auto entries = merged->getEntries();
+        REQUIRE(entries);
+        size_t n = 0;
+        for (BucketInputIterator in(merged); in; ++in, ++n)
+        {
+            REQUIRE(*in == entries->at(n));
+        }
+        REQUIRE(n == entries->size());
+        inMemory[keepDead] = merged->getHash();
+    }
+
+    // the same inputs written again, as buckets that only have their files
+    oldBucket.reset();
+    newBucket.reset();
+    bm.forgetUnreferencedBuckets();
+    std::vector<std::shared_ptr<Bucket>> files;
+    for (auto const& entries : inputs)
+    {
+        BucketOutputIterator out(bm.getTmpDir(), true);
+        for (auto const& be : entries)
+        {
+            out.put(be);
+        }
+        files.push_back(out.getBucket(bm));
+        REQUIRE(!files.back()->getEntries());
+    }
+    for (bool keepDead : {true, false})
+    {
+        auto merged = Bucket::merge(bm, files[0], files[1], {}, keepDead);
+        REQUIRE(!merged->getEntries());
+        REQUIRE(merged->getHash() == inMemory[keepDead]);
+    }
+}
+
+TEST_CASE("bucket files written every way match", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<BucketEntry> entries(500);
+    for (auto& e : entries)
+    {
+        e.type(LIVEENTRY);
+        e.liveEntry() = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    std::sort(entries.begin(), entries.end(), BucketEntryIdCmp());
+
+    std::vector<XDRWriteOptions> ways(4);
+    // one entry at a time goes through a buffer this small
+    ways[1].mBufferSize = 1;
+    ways[2].mBufferSize = 0x10000;
+    ways[2].mSync = true;
+    ways[3].mBufferSize = 0x10000;
+    ways[3].mDirect = true;
+    ways[3].mSync = true;
+
+    Hash expected;
+    for (auto const& options : ways)
+    {
+        {
+            BucketOutputIterator out(bm.getTmpDir(), true, options);
+            for (auto const& e : entries)
+            {
+                out.put(e);
+            }
+            auto b = out.getBucket(bm);
+            if (isZero(expected))
+            {
+                expected = b->getHash();
+            }
+            REQUIRE(b->getHash() == expected);
+
+            size_t n = 0;
+            for (BucketInputIterator in(b); in; ++in, ++n)
+            {
+                REQUIRE((*in).liveEntry() == entries[n].liveEntry());
+            }
+            REQUIRE(n == entries.size());
+        }
+        // so that the next way writes a file of its own
+        bm.forgetUnreferencedBuckets();
+    }
+}
+
+TEST_CASE("bucket file io metrics", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+    auto& metrics = app->getMetrics();
+    auto& written = metrics.NewMeter({"fs", "bucket-write", "bytes"}, "byte");
+    auto& read = metrics.NewMeter({"fs", "bucket-read", "bytes"}, "byte");
+    auto& renames = metrics.NewTimer({"fs", "rename", "op"});
+
+    std::vector<LedgerEntry> live(100);
+    for (auto& e : live)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    auto writtenBefore = written.count();
+    auto renamesBefore = renames.count();
+    auto b = Bucket::fresh(bm, live, {});
+    auto size = fs::size(b->getFilename());
+    REQUIRE(written.count() - writtenBefore == size);
+    REQUIRE(renames.count() == renamesBefore + 1);
+
+    auto readBefore = read.count();
+    for (BucketInputIterator in(b); in; ++in)
+    {
+    }
+    REQUIRE(read.count() - readBefore == size);
+}
+
 TEST_CASE("merging bucket entries", "[bucket]")
 {
     VirtualClock clock;
@@ -701,6 +1543,78 @@ TEST_CASE("bucketmanager ownership", "[bucket]")
     CHECK(!fs::exists(filename));
 }
 
+TEST_CASE("bucketmanager retained buckets", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<LedgerEntry> live(
+        LedgerTestUtils::generateValidLedgerEntries(10));
+    std::vector<LedgerKey> dead{};
+
+    auto b = Bucket::fresh(bm, live, dead);
+    auto hash = b->getHash();
+    std::string filename = b->getFilename();
+    bm.retainBuckets({binToHex(hash)});
+    b.reset();
+
+    // not referenced by the BucketList, but retained
+    bm.forgetUnreferencedBuckets();
+    REQUIRE(fs::exists(filename));
+    REQUIRE(app->getPersistentState().getState(
+                PersistentState::kRetainedBuckets) == binToHex(hash) + " ");
+    REQUIRE(bm.getBucketByHash(hash));
+
+    bm.releaseRetainedBuckets();
+    REQUIRE(app->getPersistentState()
+                .getState(PersistentState::kRetainedBuckets)
+                .empty());
+    bm.forgetUnreferencedBuckets();
+    REQUIRE(!fs::exists(filename));
+}
+
+TEST_CASE("bucketmanager remembers verified bucket files", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<LedgerEntry> live(
+        LedgerTestUtils::generateValidLedgerEntries(10));
+    auto b = Bucket::fresh(bm, live, {});
+    auto hash = b->getHash();
+    std::string filename = b->getFilename();
+    std::string verified = bm.getBucketDir() + "/verified-buckets.txt";
+    auto readVerified = [&]() {
+        std::ifstream in(verified);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    };
+
+    // written by us, so known to be good
+    REQUIRE(bm.isBucketFileVerified(hash));
+    bm.retainBuckets({binToHex(hash)});
+    b.reset();
+    bm.forgetUnreferencedBuckets();
+    REQUIRE(readVerified().find(binToHex(hash)) != std::string::npos);
+
+    // a changed file is not trusted until verified again
+    {
+        std::ofstream out(filename, std::ofstream::app);
+        out << "x";
+    }
+    REQUIRE(!bm.isBucketFileVerified(hash));
+    bm.recordBucketFileVerified(hash);
+    REQUIRE(bm.isBucketFileVerified(hash));
+
+    bm.releaseRetainedBuckets();
+    bm.forgetUnreferencedBuckets();
+    REQUIRE(!bm.isBucketFileVerified(hash));
+    REQUIRE(readVerified().find(binToHex(hash)) == std::string::npos);
+}
+
 TEST_CASE("single entry bubbling up", "[bucket][bucketbubble]")
 {
     VirtualClock clock;
@@ -1039,7 +1953,7 @@ TEST_CASE("checkdb succeeding", "[bucket][checkdb]")
     std::vector<stellar::LedgerKey> emptySet;
 
     // Create accounts
-    app->generateLoad(true, 1000, 0, 0, 1000, 100, false);
+    app->generateLoad(LoadGenMode::CREATE, 1000, 0, 0, 1000, 100, false);
     auto& m = app->getMetrics();
     while (m.NewMeter({"loadgen", "run", "complete"}, "run").count() == 0)
     {
@@ -1068,6 +1982,44 @@ TEST_CASE("checkdb succeeding", "[bucket][checkdb]")
     }
 }
 
+TEST_CASE("checkdb in shards on worker threads", "[bucket][checkdb]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = true;
+    cfg.CHECKDB_THREADS = 4;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    app->generateLoad(LoadGenMode::CREATE, 1000, 0, 0, 1000, 100, false);
+    auto& m = app->getMetrics();
+    while (m.NewMeter({"loadgen", "run", "complete"}, "run").count() == 0)
+    {
+        clock.crank(false);
+    }
+
+    SECTION("successful checkdb")
+    {
+        app->checkDB();
+        while (m.NewTimer({"bucket", "checkdb", "execute"}).count() == 0)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(
+            m.NewMeter({"bucket", "checkdb", "object-compare"}, "comparison")
+                .count() >= 1000);
+    }
+
+    SECTION("failing checkdb")
+    {
+        app->checkDB();
+        app->getDatabase().getSession()
+            << ("UPDATE accounts SET balance = balance * 2"
+                " WHERE accountid = (SELECT MAX(accountid) FROM accounts);");
+        REQUIRE_THROWS(clock.crank(false));
+    }
+}
+
 TEST_CASE("bucket apply", "[bucket]")
 {
     VirtualClock clock;
@@ -1109,6 +2061,82 @@ TEST_CASE("bucket apply", "[bucket]")
     REQUIRE(count == 1);
 }
 
+TEST_CASE("bucket apply of all entry types", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    std::vector<LedgerEntry> live =
+        LedgerTestUtils::generateValidLedgerEntries(200);
+    std::vector<LedgerKey> dead, noDead;
+    for (auto const& e : live)
+    {
+        dead.emplace_back(LedgerEntryKey(e));
+    }
+
+    auto& db = app->getDatabase();
+    auto checkAll = [&]() {
+        for (auto const& e : live)
+        {
+            REQUIRE(EntryFrame::checkAgainstDatabase(e, db) == "");
+        }
+    };
+
+    Bucket::fresh(app->getBucketManager(), live, noDead)->apply(db);
+    checkAll();
+
+    // Re-applying modified entries updates rows in place.
+    for (auto& e : live)
+    {
+        ++e.lastModifiedLedgerSeq;
+    }
+    Bucket::fresh(app->getBucketManager(), live, noDead)->apply(db);
+    checkAll();
+
+    Bucket::fresh(app->getBucketManager(), {}, dead)->apply(db);
+    for (auto const& k : dead)
+    {
+        REQUIRE(!EntryFrame::exists(db, k));
+    }
+}
+
+TEST_CASE("bucket apply with worker prefetch", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    // Enough entries to span several batches.
+    std::vector<LedgerEntry> live(BucketApplicator::BATCH_SIZE * 3 + 7);
+    std::vector<LedgerKey> noDead;
+
+    for (auto& e : live)
+    {
+        e.data.type(ACCOUNT);
+        auto& a = e.data.account();
+        a = LedgerTestUtils::generateValidAccountEntry(5);
+        a.balance = 1000000000;
+    }
+
+    std::shared_ptr<Bucket> birth =
+        Bucket::fresh(app->getBucketManager(), live, noDead);
+
+    auto& db = app->getDatabase();
+    BucketApplicator applicator(db, birth, &app->getWorkerLanes());
+    size_t steps = 0;
+    while (applicator)
+    {
+        applicator.advance();
+        ++steps;
+    }
+    REQUIRE(steps == 4);
+    REQUIRE(AccountFrame::countObjects(db.getSession()) ==
+            live.size() + 1 /* root account */);
+}
+
 TEST_CASE("bucket apply bench", "[bucketbench][!hide]")
 {
     auto runtest = [](Config::TestDbMode mode) {
@@ -0,0 +1,169 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+
+#include "bucket/Bucket.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketTombstoneStats.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Logging.h"
+#include "util/WorkerLanes.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+BucketTombstoneStats::BucketTombstoneStats(Application& app)
+    : mApp(app), mAnalyze(app.getConfig().BUCKET_TOMBSTONE_ANALYSIS)
+{
+}
+
+BucketTombstoneStats::Counts
+BucketTombstoneStats::countBucket(
+    std::vector<std::shared_ptr<Bucket>> const& buckets, size_t i,
+    bool analyze)
+{
+    Counts res;
+    auto const& bucket = buckets.at(i);
+    if (!analyze)
+    {
+        auto counts = bucket->countLiveAndDeadEntries();
+        res.mLive = counts.first;
+        res.mDead = counts.second;
+        return res;
+    }
+
+    BucketEntry older;
+    for (BucketRawInputIterator iter(bucket); iter; ++iter)
+    {
+        if (!iter.isDead())
+        {
+            ++res.mLive;
+            continue;
+        }
+        ++res.mDead;
+        // the nearest older entry for the key decides whether this one is
+        // needed to hide it
+        bool needed = false;
+        for (size_t j = i + 1; j < buckets.size(); ++j)
+        {
+            if (buckets[j]->getBucketEntry(iter.key(), older))
+            {
+                needed = older.type() == LIVEENTRY;
+                break;
+            }
+        }
+        if (!needed)
+        {
+            ++res.mDroppable;
+            res.mDroppableBytes += iter.size();
+        }
+    }
+    return res;
+}
+
+void
+BucketTombstoneStats::update(BucketList const& bl)
+{
+    std::vector<std::shared_ptr<Bucket>> buckets;
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        buckets.push_back(bl.getLevel(i).getCurr());
+        buckets.push_back(bl.getLevel(i).getSnap());
+    }
+
+    mCounted.resize(buckets.size());
+
+    // Without analysis, only the changed buckets need counting; with it, the
+    // newer buckets may have gained or lost droppable tombstones too.
+    size_t first = buckets.size();
+    size_t last = 0;
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        if (buckets[i]->getHash() != mCounted[i])
+        {
+            first = std::min(first, i);
+            last = i + 1;
+        }
+    }
+    if (first == buckets.size() || mRunning.exchange(true))
+    {
+        return;
+    }
+    if (mAnalyze)
+    {
+        first = 0;
+    }
+
+    // the bucket list only gets deeper in tests
+    auto& metrics = mApp.getMetrics();
+    while (mMetrics.size() < BucketList::kNumLevels)
+    {
+        auto lev = "level-" + std::to_string(mMetrics.size());
+        mMetrics.push_back(
+            {&metrics.NewCounter({"bucket", "live-entries", lev}),
+             &metrics.NewCounter({"bucket", "dead-entries", lev}),
+             &metrics.NewCounter({"bucket", "tombstone-ratio", lev}),
+             &metrics.NewCounter({"bucket", "droppable-tombstones", lev}),
+             &metrics.NewCounter(
+                 {"bucket", "droppable-tombstone-bytes", lev})});
+    }
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        mCounted[i] = buckets[i]->getHash();
+    }
+
+    mApp.getWorkerLanes().post(
+        WorkerLane::BACKGROUND,
+        [this, buckets, first, last]() { count(buckets, first, last); });
+}
+
+void
+BucketTombstoneStats::count(std::vector<std::shared_ptr<Bucket>> buckets,
+                            size_t first, size_t last)
+{
+    mCounts.resize(buckets.size());
+    for (size_t i = first; i < last; ++i)
+    {
+        // without analysis, unchanged buckets in the range are cheap to
+        // recount: their index has the counts
+        mCounts[i] = countBucket(buckets, i, mAnalyze);
+    }
+
+    for (size_t level = 0; level < mMetrics.size(); ++level)
+    {
+        Counts sum;
+        for (size_t i = 2 * level; i < 2 * level + 2 && i < mCounts.size();
+             ++i)
+        {
+            sum.mLive += mCounts[i].mLive;
+            sum.mDead += mCounts[i].mDead;
+            sum.mDroppable += mCounts[i].mDroppable;
+            sum.mDroppableBytes += mCounts[i].mDroppableBytes;
+        }
+        auto const& m = mMetrics[level];
+        m.mLive->set_count(sum.mLive);
+        m.mDead->set_count(sum.mDead);
+        auto total = sum.mLive + sum.mDead;
+        m.mRatio->set_count(total == 0 ? 0 : sum.mDead * 1000 / total);
+        if (mAnalyze)
+        {
+            m.mDroppable->set_count(sum.mDroppable);
+            m.mDroppableBytes->set_count(sum.mDroppableBytes);
+            CLOG(DEBUG, "Bucket")
+                << "Level " << level << " has " << sum.mDead
+                << " tombstones, " << sum.mDroppable << " droppable ("
+                << sum.mDroppableBytes << " bytes)";
+        }
+    }
+    mRunning = false;
+}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+}
+
+namespace stellar
+{
+
+class Application;
+class Bucket;
+class BucketList;
+
+/**
+ * BucketTombstoneStats reports, per BucketList level, how many of the
+ * level's entries are tombstones (dead entries), as the metrics
+ * bucket.live-entries.level-N, bucket.dead-entries.level-N and
+ * bucket.tombstone-ratio.level-N (in thousandths).
+ *
+ * Tombstones are only dropped when merging into the deepest level, so the
+ * levels above it keep them long after they stopped hiding anything. With
+ * BUCKET_TOMBSTONE_ANALYSIS, it also counts the tombstones a compaction could
+ * drop without changing what the BucketList holds: those that no older
+ * bucket has a live entry for (their key is in no older bucket, or the
+ * nearest older entry for it is itself a tombstone). These go to
+ * bucket.droppable-tombstones.level-N and, in bytes of bucket file,
+ * bucket.droppable-tombstone-bytes.level-N. This only reads the buckets; the
+ * BucketList, and so its hash, is unchanged.
+ *
+ * Counting runs on a worker thread, one pass at a time, over the buckets
+ * that changed since the last pass (and, when analyzing, the newer buckets
+ * whose droppable tombstones they may change).
+ */
+class BucketTombstoneStats : NonMovableOrCopyable
+{
+  public:
+    struct Counts
+    {
+        uint64_t mLive{0};
+        uint64_t mDead{0};
+        uint64_t mDroppable{0};
+        uint64_t mDroppableBytes{0};
+    };
+
+    explicit BucketTombstoneStats(Application& app);
+
+    // Recount the buckets of `bl` that changed, on a worker thread, unless a
+    // previous pass is still running (they are then recounted by the next
+    // update). Called on the main thread when `bl` changes.
+    void update(BucketList const& bl);
+
+    // Counts of bucket `i` of `buckets`, which lists the buckets of a
+    // BucketList newest first: curr then snap of each level, from level 0.
+    // Droppable tombstones are only counted with `analyze`.
+    static Counts
+    countBucket(std::vector<std::shared_ptr<Bucket>> const& buckets, size_t i,
+                bool analyze);
+
+  private:
+    struct LevelMetrics
+    {
+        medida::Counter* mLive;
+        medida::Counter* mDead;
+        medida::Counter* mRatio;
+        medida::Counter* mDroppable;
+        medida::Counter* mDroppableBytes;
+    };
+
+    Application& mApp;
+    bool const mAnalyze;
+    std::vector<LevelMetrics> mMetrics;
+    // hashes of the buckets last counted, on the main thread
+    std::vector<Hash> mCounted;
+    // counts of each bucket, only touched by the pass running
+    std::vector<Counts> mCounts;
+    std::atomic<bool> mRunning{false};
+
+    void count(std::vector<std::shared_ptr<Bucket>> buckets, size_t first,
+               size_t last);
+};
+}
@@ -9,6 +9,7 @@
 
 #include "bucket/Bucket.h"
 #include "bucket/BucketManager.h"
+#include "bucket/BucketMergeScheduler.h"
 #include "bucket/FutureBucket.h"
 #include "crypto/Hex.h"
 #include "main/Application.h"
@@ -24,7 +25,7 @@ FutureBucket::FutureBucket(Application& app,
                            std::shared_ptr<Bucket> const& curr,
                            std::shared_ptr<Bucket> const& snap,
                            std::vector<std::shared_ptr<Bucket>> const& shadows,
-                           bool keepDeadEntries)
+                           uint32_t level, bool keepDeadEntries)
     : mState(FB_LIVE_INPUTS)
     , mInputCurrBucket(curr)
     , mInputSnapBucket(snap)
@@ -41,7 +42,7 @@ FutureBucket::FutureBucket(Application& app,
     {
         mInputShadowBucketHashes.push_back(binToHex(b->getHash()));
     }
-    startMerge(app, keepDeadEntries);
+    startMerge(app, level, keepDeadEntries);
 }
 
 void
@@ -251,7 +252,7 @@ FutureBucket::getOutputHash() const
 }
 
 void
-FutureBucket::startMerge(Application& app, bool keepDeadEntries)
+FutureBucket::startMerge(Application& app, uint32_t level, bool keepDeadEntries)
 {
     // NB: startMerge starts with FutureBucket in a half-valid state; the inputs
     // are live but the merge is not yet running. So you can't call checkState()
@@ -273,14 +274,20 @@ FutureBucket::startMerge(Application& app, bool keepDeadEntries)
 
     BucketManager& bm = app.getBucketManager();
 
+    // Deep merges are large enough to be worth splitting over threads.
+    size_t parts = level >= BucketMergeScheduler::DEEP_LEVEL
+                       ? app.getConfig().MERGE_SPLIT_THREADS
+                       : 1;
+
     using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
-    std::shared_ptr<task_t> task =
-        std::make_shared<task_t>([curr, snap, &bm, shadows, keepDeadEntries]() {
+    std::shared_ptr<task_t> task = std::make_shared<task_t>(
+        [curr, snap, &bm, shadows, keepDeadEntries, parts]() {
             CLOG(TRACE, "Bucket")
                 << "Worker merging curr=" << hexAbbrev(curr->getHash())
                 << " with snap=" << hexAbbrev(snap->getHash());
 
-            auto res = Bucket::merge(bm, curr, snap, shadows, keepDeadEntries);
+            auto res = Bucket::merge(bm, curr, snap, shadows, keepDeadEntries,
+                                     parts);
 
             CLOG(TRACE, "Bucket")
                 << "Worker finished merging curr=" << hexAbbrev(curr->getHash())
@@ -290,12 +297,12 @@ FutureBucket::startMerge(Application& app, bool keepDeadEntries)
         });
 
     mOutputBucket = task->get_future().share();
-    app.getWorkerIOService().post(bind(&task_t::operator(), task));
+    bm.getMergeScheduler().enqueue(level, bind(&task_t::operator(), task));
     checkState();
 }
 
 void
-FutureBucket::makeLive(Application& app, bool keepDeadEntries)
+FutureBucket::makeLive(Application& app, uint32_t level, bool keepDeadEntries)
 {
     checkState();
     assert(!isLive());
@@ -321,7 +328,7 @@ FutureBucket::makeLive(Application& app, bool keepDeadEntries)
             mInputShadowBuckets.push_back(b);
         }
         mState = FB_LIVE_INPUTS;
-        startMerge(app, keepDeadEntries);
+        startMerge(app, level, keepDeadEntries);
         assert(isLive());
     }
 }
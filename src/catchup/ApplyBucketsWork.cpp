@@ -14,17 +14,26 @@
 #include "invariant/InvariantManager.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/DataFrame.h"
+#include "ledger/EntryFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/OfferFrame.h"
 #include "ledger/TrustFrame.h"
 #include "main/Application.h"
+#include "main/Config.h"
+#include "main/PersistentState.h"
+#include "util/Fs.h"
 #include "util/format.h"
+#include <algorithm>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
 namespace stellar
 {
 
+// Upper bound on the BucketApplicator batches applied by a single run, however
+// cheap they turn out to be.
+static size_t const MAX_BATCHES_PER_RUN = 64;
+
 ApplyBucketsWork::ApplyBucketsWork(
     Application& app, WorkParent& parent,
     std::map<std::string, std::shared_ptr<Bucket>> const& buckets,
@@ -40,6 +49,16 @@ ApplyBucketsWork::ApplyBucketsWork(
           {"history", "bucket-apply", "success"}, "event"))
     , mBucketApplyFailure(app.getMetrics().NewMeter(
           {"history", "bucket-apply", "failure"}, "event"))
+    , mBucketApplyEntries(app.getMetrics().NewMeter(
+          {"history", "bucket-apply", "entries"}, "entry"))
+    , mBucketApplyBytes(app.getMetrics().NewMeter(
+          {"history", "bucket-apply", "bytes"}, "byte"))
+    , mBucketApplyIndexes(app.getMetrics().NewMeter(
+          {"history", "bucket-apply", "indexes-built"}, "index"))
+    , mSlicer(app.getClock(),
+              app.getMetrics().NewTimer({"history", "bucket-apply", "slice"}),
+              std::chrono::milliseconds(app.getConfig().CATCHUP_APPLY_SLICE_MS),
+              MAX_BATCHES_PER_RUN)
 {
 }
 
@@ -48,6 +67,12 @@ ApplyBucketsWork::~ApplyBucketsWork()
     clearChildren();
 }
 
+Work::ResourceClass
+ApplyBucketsWork::getResourceClass() const
+{
+    return RESOURCE_DB;
+}
+
 BucketLevel&
 ApplyBucketsWork::getBucketLevel(uint32_t level)
 {
@@ -65,6 +90,62 @@ ApplyBucketsWork::getBucket(std::string const& hash)
     return b;
 }
 
+size_t
+ApplyBucketsWork::getRemainingBytes() const
+{
+    size_t remaining = mLaterLevelsBytes;
+    if (mSnapApplicator)
+    {
+        remaining += mSnapBytes - std::min(mSnapBytes, mSnapApplicator->pos());
+    }
+    if (mCurrApplicator)
+    {
+        remaining += mCurrBytes - std::min(mCurrBytes, mCurrApplicator->pos());
+    }
+    return remaining;
+}
+
+void
+ApplyBucketsWork::advanceApplicator(BucketApplicator& applicator)
+{
+    auto entries = applicator.size();
+    auto pos = applicator.pos();
+    applicator.advance();
+    mBucketApplyEntries.Mark(applicator.size() - entries);
+    mBucketApplyBytes.Mark(applicator.pos() - pos);
+}
+
+void
+ApplyBucketsWork::dropIndexes()
+{
+    auto& ps = mApp.getPersistentState();
+    if (!mApp.getConfig().CATCHUP_REBUILD_INDEXES ||
+        !ps.getState(PersistentState::kDroppedIndexes).empty())
+    {
+        return;
+    }
+    CLOG(INFO, "History") << "ApplyBuckets : dropping secondary indexes";
+    ps.setState(PersistentState::kDroppedIndexes, "true");
+    EntryFrame::dropSecondaryIndexes(mApp.getDatabase());
+}
+
+void
+ApplyBucketsWork::rebuildIndexes()
+{
+    auto& ps = mApp.getPersistentState();
+    if (ps.getState(PersistentState::kDroppedIndexes).empty())
+    {
+        return;
+    }
+    CLOG(INFO, "History") << "ApplyBuckets : building secondary indexes";
+    EntryFrame::createSecondaryIndexes(
+        mApp.getDatabase(), [this](std::string const& name) {
+            mBucketApplyIndexes.Mark();
+            CLOG(INFO, "History") << "ApplyBuckets : built " << name;
+        });
+    ps.setState(PersistentState::kDroppedIndexes, "");
+}
+
 void
 ApplyBucketsWork::onReset()
 {
@@ -74,6 +155,7 @@ ApplyBucketsWork::onReset()
     mCurrBucket.reset();
     mSnapApplicator.reset();
     mCurrApplicator.reset();
+    mLaterLevelsBytes = 0;
 }
 
 void
@@ -86,6 +168,7 @@ ApplyBucketsWork::onStart()
     bool applyCurr = (i.curr != binToHex(level.getCurr()->getHash()));
     if (!mApplying && (applySnap || applyCurr))
     {
+        dropIndexes();
         uint32_t oldestLedger = applySnap
                                     ? BucketList::oldestLedgerInSnap(
                                           mApplyState.currentLedger, mLevel)
@@ -105,9 +188,11 @@ ApplyBucketsWork::onStart()
     {
         mSnapBucket = getBucket(i.snap);
         mSnapApplicator =
-            std::make_unique<BucketApplicator>(mApp.getDatabase(), mSnapBucket);
+            std::make_unique<BucketApplicator>(mApp.getDatabase(), mSnapBucket,
+                                               &mApp.getWorkerLanes());
         CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
                                << "].snap = " << i.snap;
+        mSnapBytes = fs::size(mSnapBucket->getFilename());
         mApplying = true;
         mBucketApplyStart.Mark();
     }
@@ -115,12 +200,35 @@ ApplyBucketsWork::onStart()
     {
         mCurrBucket = getBucket(i.curr);
         mCurrApplicator =
-            std::make_unique<BucketApplicator>(mApp.getDatabase(), mCurrBucket);
+            std::make_unique<BucketApplicator>(mApp.getDatabase(), mCurrBucket,
+                                               &mApp.getWorkerLanes());
         CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
                                << "].curr = " << i.curr;
+        mCurrBytes = fs::size(mCurrBucket->getFilename());
         mApplying = true;
         mBucketApplyStart.Mark();
     }
+
+    // only an estimate for the status, so it does not matter that some of
+    // these might turn out to be applied already
+    mLaterLevelsBytes = 0;
+    for (uint32_t l = 0; l < mLevel; ++l)
+    {
+        HistoryStateBucket const& b = mApplyState.currentBuckets.at(l);
+        for (auto const& hash : {b.snap, b.curr})
+        {
+            auto j = mBuckets.find(hash);
+            auto bucket =
+                (j != mBuckets.end())
+                    ? j->second
+                    : mApp.getBucketManager().getBucketByHash(
+                          hexToBin256(hash));
+            if (bucket)
+            {
+                mLaterLevelsBytes += fs::size(bucket->getFilename());
+            }
+        }
+    }
 }
 
 void
@@ -132,19 +240,33 @@ ApplyBucketsWork::onRun()
     //    database when the invariants for snap are checked.
     // 2. There is no reason to advance mSnapApplicator or mCurrApplicator
     //    if there is nothing to be applied.
+    BucketApplicator* applicator = nullptr;
     if (mSnapApplicator)
     {
         if (*mSnapApplicator)
         {
-            mSnapApplicator->advance();
+            applicator = mSnapApplicator.get();
         }
     }
     else if (mCurrApplicator)
     {
         if (*mCurrApplicator)
         {
-            mCurrApplicator->advance();
+            applicator = mCurrApplicator.get();
+        }
+    }
+
+    if (applicator)
+    {
+        // As many batches as fit in a slice of main thread time.
+        auto batches = mSlicer.start();
+        size_t applied = 0;
+        while (applied < batches && *applicator)
+        {
+            advanceApplicator(*applicator);
+            ++applied;
         }
+        mSlicer.finish(applied);
     }
     scheduleSuccess();
 }
@@ -187,8 +309,11 @@ ApplyBucketsWork::onSuccess()
         return WORK_PENDING;
     }
 
+    rebuildIndexes();
     CLOG(DEBUG, "History") << "ApplyBuckets : done, restarting merges";
     mApp.getBucketManager().assumeState(mApplyState);
+    // the BucketList references the downloaded buckets now
+    mApp.getBucketManager().releaseRetainedBuckets();
     return WORK_SUCCESS;
 }
 
@@ -203,6 +328,7 @@ void
 ApplyBucketsWork::onFailureRaise()
 {
     mBucketApplyFailure.Mark();
+    rebuildIndexes();
     Work::onFailureRaise();
 }
 }
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "util/TimeSlicer.h"
 #include "work/Work.h"
 
 namespace medida
@@ -32,13 +33,27 @@ class ApplyBucketsWork : public Work
     std::shared_ptr<Bucket const> mCurrBucket;
     std::unique_ptr<BucketApplicator> mSnapApplicator;
     std::unique_ptr<BucketApplicator> mCurrApplicator;
+    // file sizes of the buckets being applied and of those of later levels
+    size_t mSnapBytes{0};
+    size_t mCurrBytes{0};
+    size_t mLaterLevelsBytes{0};
 
     medida::Meter& mBucketApplyStart;
     medida::Meter& mBucketApplySuccess;
     medida::Meter& mBucketApplyFailure;
+    medida::Meter& mBucketApplyEntries;
+    medida::Meter& mBucketApplyBytes;
+    medida::Meter& mBucketApplyIndexes;
+    // batches of BucketApplicator applied per run
+    TimeSlicer mSlicer;
 
     std::shared_ptr<Bucket const> getBucket(std::string const& bucketHash);
     BucketLevel& getBucketLevel(uint32_t level);
+    void advanceApplicator(BucketApplicator& applicator);
+    // see Config::CATCHUP_REBUILD_INDEXES; whether they are dropped is kept
+    // in the PersistentState, for a later apply to build them if interrupted
+    void dropIndexes();
+    void rebuildIndexes();
 
   public:
     ApplyBucketsWork(
@@ -46,6 +61,11 @@ class ApplyBucketsWork : public Work
         std::map<std::string, std::shared_ptr<Bucket>> const& buckets,
         HistoryArchiveState const& applyState);
     ~ApplyBucketsWork();
+    ResourceClass getResourceClass() const override;
+
+    // Bytes of bucket files left to apply, counting every bucket of the
+    // levels below the current one.
+    size_t getRemainingBytes() const;
 
     void onReset() override;
     void onStart() override;
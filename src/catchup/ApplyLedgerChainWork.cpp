@@ -6,27 +6,39 @@
 #include "herder/LedgerCloseData.h"
 #include "history/FileTransferInfo.h"
 #include "history/HistoryManager.h"
+#include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "historywork/Progress.h"
 #include "ledger/CheckpointRange.h"
 #include "ledger/LedgerManager.h"
 #include "lib/xdrpp/xdrpp/printer.h"
 #include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
 #include "util/format.h"
+#include <algorithm>
+#include <cstdio>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
 namespace stellar
 {
 
+// Upper bound on the ledgers replayed by a single run, however cheap they
+// turn out to be.
+static size_t const MAX_LEDGERS_PER_RUN = 64;
+
 ApplyLedgerChainWork::ApplyLedgerChainWork(
     Application& app, WorkParent& parent, TmpDir const& downloadDir,
-    LedgerRange range, LedgerHeaderHistoryEntry& lastApplied)
+    LedgerRange range, LedgerHeaderHistoryEntry& lastApplied,
+    uint32_t lookahead)
     : Work(app, parent, std::string("apply-ledger-chain"))
     , mDownloadDir(downloadDir)
     , mRange(range)
     , mCurrSeq(
           mApp.getHistoryManager().checkpointContainingLedger(mRange.first()))
+    , mIO(app.getMetrics(), "history-temp")
     , mLastApplied(lastApplied)
+    , mLookahead(lookahead)
     , mApplyLedgerStart(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "start"}, "event"))
     , mApplyLedgerSkip(app.getMetrics().NewMeter(
@@ -43,14 +55,27 @@ ApplyLedgerChainWork::ApplyLedgerChainWork(
           {"history", "apply-ledger", "failure-tx-set-hash"}, "event"))
     , mApplyLedgerFailureInvalidResultHash(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "failure-result-hahs"}, "event"))
+    , mDownloadHeldBack(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "held-back"}, "event"))
+    , mSlicer(app.getClock(),
+              app.getMetrics().NewTimer({"history", "apply-ledger", "slice"}),
+              std::chrono::milliseconds(app.getConfig().CATCHUP_APPLY_SLICE_MS),
+              MAX_LEDGERS_PER_RUN)
 {
 }
 
 ApplyLedgerChainWork::~ApplyLedgerChainWork()
 {
+    endReplayBatch();
     clearChildren();
 }
 
+Work::ResourceClass
+ApplyLedgerChainWork::getResourceClass() const
+{
+    return RESOURCE_DB;
+}
+
 std::string
 ApplyLedgerChainWork::getStatus() const
 {
@@ -62,6 +87,13 @@ ApplyLedgerChainWork::getStatus() const
     return Work::getStatus();
 }
 
+uint32_t
+ApplyLedgerChainWork::getRemainingLedgers() const
+{
+    auto applied = std::max(mLastApplied.header.ledgerSeq + 1, mRange.first());
+    return mRange.last() >= applied ? mRange.last() - applied + 1 : 0;
+}
+
 void
 ApplyLedgerChainWork::onReset()
 {
@@ -75,8 +107,150 @@ ApplyLedgerChainWork::onReset()
                                  lm.getLastClosedLedgerHeader());
     mCurrSeq =
         mApp.getHistoryManager().checkpointContainingLedger(mRange.first());
+    if (mLookahead != 0)
+    {
+        // files of the checkpoints applied before a retry are gone
+        mCurrSeq = std::max(mCurrSeq,
+                            hm.checkpointContainingLedger(
+                                lm.getLastClosedLedgerNum() + 1));
+    }
+    endReplayBatch();
     mHdrIn.close();
     mTxIn.close();
+    mFilesOpen = false;
+    mWaiting = false;
+    mNextDownload = mCurrSeq;
+    mDownloads.clear();
+    mCounted.clear();
+    mScratchBytes = 0;
+    if (mLookahead != 0 && mApp.getConfig().CATCHUP_SCRATCH_MAX_BYTES != 0)
+    {
+        // ledger files of the range, and transactions left by a retry
+        mScratchBytes = mDownloadDir.getSize();
+    }
+    clearChildren();
+}
+
+void
+ApplyLedgerChainWork::countDownloaded()
+{
+    if (mApp.getConfig().CATCHUP_SCRATCH_MAX_BYTES == 0)
+    {
+        return;
+    }
+    for (auto const& d : mDownloads)
+    {
+        if (d.second->getState() == WORK_SUCCESS &&
+            mCounted.insert(d.first).second)
+        {
+            FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                                d.first);
+            auto bytes = fs::size(ft.localPath_nogz());
+            mScratchBytes += bytes;
+            mLargestTransactions = std::max(mLargestTransactions, bytes);
+        }
+    }
+}
+
+bool
+ApplyLedgerChainWork::scratchHasRoom() const
+{
+    auto maxBytes = mApp.getConfig().CATCHUP_SCRATCH_MAX_BYTES;
+    if (maxBytes == 0)
+    {
+        return true;
+    }
+    auto inFlight = mDownloads.size() - mCounted.size();
+    return mScratchBytes + (inFlight + 1) * mLargestTransactions <= maxBytes;
+}
+
+void
+ApplyLedgerChainWork::startDownloads()
+{
+    if (mLookahead == 0)
+    {
+        return;
+    }
+    countDownloaded();
+    auto& hm = mApp.getHistoryManager();
+    auto last = CheckpointRange{mRange, hm}.last();
+    auto windowEnd = static_cast<uint64_t>(mCurrSeq) +
+                     static_cast<uint64_t>(mLookahead) *
+                         hm.getCheckpointFrequency();
+    while (mNextDownload <= last && mNextDownload <= windowEnd)
+    {
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                            mNextDownload);
+        if (!fs::exists(ft.localPath_nogz()))
+        {
+            // the current checkpoint is needed whatever it takes
+            if (mNextDownload != mCurrSeq && !scratchHasRoom())
+            {
+                CLOG(DEBUG, "History")
+                    << "Holding back download of transactions for checkpoint "
+                    << mNextDownload << ", catchup files take "
+                    << mScratchBytes << " bytes";
+                mDownloadHeldBack.Mark();
+                break;
+            }
+            CLOG(DEBUG, "History") << "Downloading transactions for checkpoint "
+                                   << mNextDownload;
+            auto download = addWork<GetAndUnzipRemoteFileWork>(ft);
+            mDownloads[mNextDownload] = download;
+            // children only get advanced by a pending parent, this one is
+            // running
+            download->advance();
+        }
+        mNextDownload += hm.getCheckpointFrequency();
+    }
+}
+
+bool
+ApplyLedgerChainWork::currentTransactionsDownloaded()
+{
+    startDownloads();
+    auto download = mDownloads.find(mCurrSeq);
+    if (download == mDownloads.end())
+    {
+        return true;
+    }
+    switch (download->second->getState())
+    {
+    case WORK_SUCCESS:
+        return true;
+    case WORK_FAILURE_RAISE:
+    case WORK_FAILURE_FATAL:
+        throw std::runtime_error(fmt::format(
+            "could not download transactions for checkpoint {:d}", mCurrSeq));
+    default:
+        mWaiting = true;
+        return false;
+    }
+}
+
+void
+ApplyLedgerChainWork::finishCurrentCheckpoint()
+{
+    mHdrIn.close();
+    mTxIn.close();
+    mFilesOpen = false;
+    auto download = mDownloads.find(mCurrSeq);
+    if (download != mDownloads.end())
+    {
+        mChildren.erase(download->second->getUniqueName());
+        mDownloads.erase(download);
+    }
+    mCounted.erase(mCurrSeq);
+    FileTransferInfo hi(mDownloadDir, HISTORY_FILE_TYPE_LEDGER, mCurrSeq);
+    FileTransferInfo ti(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS, mCurrSeq);
+    if (mApp.getConfig().CATCHUP_SCRATCH_MAX_BYTES != 0)
+    {
+        auto bytes = fs::size(hi.localPath_nogz()) +
+                     fs::size(ti.localPath_nogz());
+        mScratchBytes -= std::min(mScratchBytes, bytes);
+    }
+    std::remove(hi.localPath_nogz().c_str());
+    std::remove(ti.localPath_nogz().c_str());
 }
 
 void
@@ -90,9 +264,12 @@ ApplyLedgerChainWork::openCurrentInputFiles()
                            << hi.localPath_nogz();
     CLOG(DEBUG, "History") << "Replaying transactions from "
                            << ti.localPath_nogz();
+    mHdrIn.setMetrics(&mIO);
+    mTxIn.setMetrics(&mIO);
     mHdrIn.open(hi.localPath_nogz());
     mTxIn.open(ti.localPath_nogz());
     mTxHistoryEntry = TransactionHistoryEntry();
+    mFilesOpen = true;
 }
 
 TxSetFramePtr
@@ -225,6 +402,15 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
             hexAbbrev(header.scpValue.txSetHash)));
     }
 
+    auto batchSize = mApp.getConfig().CATCHUP_REPLAY_BATCH_LEDGERS;
+    if (mBatched == 0 && batchSize > 1)
+    {
+        lm.beginReplayBatch();
+    }
+    if (batchSize > 1)
+    {
+        ++mBatched;
+    }
     LedgerCloseData closeData(header.ledgerSeq, txset, header.scpValue);
     lm.closeLedger(closeData);
 
@@ -243,13 +429,30 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
 
     mApplyLedgerSuccess.Mark();
     mLastApplied = hHeader;
+    if (mBatched >= batchSize || header.ledgerSeq == mRange.last())
+    {
+        endReplayBatch();
+    }
     return true;
 }
 
+void
+ApplyLedgerChainWork::endReplayBatch()
+{
+    if (mBatched != 0)
+    {
+        mBatched = 0;
+        mApp.getLedgerManager().endReplayBatch();
+    }
+}
+
 void
 ApplyLedgerChainWork::onStart()
 {
-    openCurrentInputFiles();
+    if (mLookahead == 0)
+    {
+        openCurrentInputFiles();
+    }
 }
 
 void
@@ -257,16 +460,53 @@ ApplyLedgerChainWork::onRun()
 {
     try
     {
-        if (!applyHistoryOfSingleLedger())
+        if (!mFilesOpen)
         {
-            mCurrSeq += mApp.getHistoryManager().getCheckpointFrequency();
+            if (!currentTransactionsDownloaded())
+            {
+                // run again by notify once downloaded
+                return;
+            }
             openCurrentInputFiles();
         }
+
+        // As many ledgers of the current checkpoint as fit in a slice of main
+        // thread time.
+        auto& lm = mApp.getLedgerManager();
+        auto ledgers = mSlicer.start();
+        size_t applied = 0;
+        while (applied < ledgers)
+        {
+            if (!applyHistoryOfSingleLedger())
+            {
+                if (mLookahead != 0)
+                {
+                    finishCurrentCheckpoint();
+                    mCurrSeq +=
+                        mApp.getHistoryManager().getCheckpointFrequency();
+                }
+                else
+                {
+                    mCurrSeq +=
+                        mApp.getHistoryManager().getCheckpointFrequency();
+                    openCurrentInputFiles();
+                }
+                break;
+            }
+            ++applied;
+            if (lm.getLastClosedLedgerNum() == mRange.last())
+            {
+                break;
+            }
+        }
+        mSlicer.finish(applied);
         scheduleSuccess();
     }
     catch (std::runtime_error& e)
     {
         CLOG(ERROR, "History") << "Replay failed: " << e.what();
+        // keep what was applied, as the ledger manager went past it already
+        endReplayBatch();
         scheduleFailure();
     }
 }
@@ -285,4 +525,16 @@ ApplyLedgerChainWork::onSuccess()
 
     return WORK_RUNNING;
 }
+
+void
+ApplyLedgerChainWork::notify(std::string const& child)
+{
+    // downloads finish while this work is running, which Work::notify
+    // ignores
+    if (mWaiting && getState() == WORK_RUNNING)
+    {
+        mWaiting = false;
+        scheduleRun();
+    }
+}
 }
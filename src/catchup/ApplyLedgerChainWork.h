@@ -6,11 +6,15 @@
 
 #include "herder/TxSetFrame.h"
 #include "ledger/LedgerRange.h"
+#include "util/TimeSlicer.h"
 #include "util/XDRStream.h"
 #include "work/Work.h"
 #include "xdr/Stellar-SCP.h"
 #include "xdr/Stellar-ledger.h"
 
+#include <map>
+#include <set>
+
 namespace medida
 {
 class Meter;
@@ -29,7 +33,8 @@ struct LedgerHeaderHistoryEntry;
  * used to read transactions that will be used and ledger files are used to
  * check if ledger hashes are matching.
  *
- * In each run it skips or applies transactions from one ledger. Skipping occurs
+ * In each run it skips or applies transactions from as many ledgers of a
+ * checkpoint as fit in CATCHUP_APPLY_SLICE_MS (see TimeSlicer). Skipping occurs
  * when ledger to by applied is older than LCL from local ledger. At LCL
  * boundary checks are made
  * to confirm that ledgers from files are knot up with LCL. If everything is OK,
@@ -41,16 +46,45 @@ struct LedgerHeaderHistoryEntry;
  * * range - range of ledgers to apply (low boundary can overlap with local
  * history)
  * * lastApplied - reference to last applied ledger header (which is LCL)
+ * * lookahead - when not 0, transaction files are not expected to be in
+ * downloadDir already: they are downloaded while applying, at most lookahead
+ * checkpoints ahead of the one being applied, and the files of each checkpoint
+ * are deleted once it is applied, so that disk usage stays bounded. With
+ * CATCHUP_SCRATCH_MAX_BYTES set, downloads ahead are also held back while
+ * the files in downloadDir, and those in flight, would take more than that:
+ * files are measured once on reset, then as they are downloaded and deleted,
+ * and a download in flight is expected to take as much as the largest
+ * transactions file downloaded so far
+ *
+ * Applied ledgers are committed to the database by batches of
+ * CATCHUP_REPLAY_BATCH_LEDGERS (see LedgerManager::beginReplayBatch); the
+ * resulting hash of each ledger is still checked as it is applied.
  */
 class ApplyLedgerChainWork : public Work
 {
     TmpDir const& mDownloadDir;
     LedgerRange mRange;
     uint32_t mCurrSeq;
+    FileIOMetrics mIO;
     XDRInputFileStream mHdrIn;
     XDRInputFileStream mTxIn;
     TransactionHistoryEntry mTxHistoryEntry;
     LedgerHeaderHistoryEntry& mLastApplied;
+    uint32_t const mLookahead;
+    bool mFilesOpen{false};
+    // waiting for the download of the current checkpoint's transactions
+    bool mWaiting{false};
+    uint32_t mNextDownload{0};
+    // transaction downloads not applied yet, by checkpoint
+    std::map<uint32_t, std::shared_ptr<Work>> mDownloads;
+    // those of them downloaded and counted in mScratchBytes
+    std::set<uint32_t> mCounted;
+    // bytes of the files in downloadDir, when CATCHUP_SCRATCH_MAX_BYTES is
+    // set
+    size_t mScratchBytes{0};
+    size_t mLargestTransactions{0};
+    // ledgers applied in the open replay batch
+    uint32_t mBatched{0};
 
     medida::Meter& mApplyLedgerStart;
     medida::Meter& mApplyLedgerSkip;
@@ -60,20 +94,34 @@ class ApplyLedgerChainWork : public Work
     medida::Meter& mApplyLedgerFailureInvalidLCLHash;
     medida::Meter& mApplyLedgerFailureInvalidTxSetHash;
     medida::Meter& mApplyLedgerFailureInvalidResultHash;
+    medida::Meter& mDownloadHeldBack;
+    // ledgers replayed per run
+    TimeSlicer mSlicer;
 
     TxSetFramePtr getCurrentTxSet();
     void openCurrentInputFiles();
     bool applyHistoryOfSingleLedger();
+    void startDownloads();
+    void countDownloaded();
+    bool scratchHasRoom() const;
+    bool currentTransactionsDownloaded();
+    void finishCurrentCheckpoint();
+    void endReplayBatch();
 
   public:
     ApplyLedgerChainWork(Application& app, WorkParent& parent,
                          TmpDir const& downloadDir, LedgerRange range,
-                         LedgerHeaderHistoryEntry& lastApplied);
+                         LedgerHeaderHistoryEntry& lastApplied,
+                         uint32_t lookahead = 0);
     ~ApplyLedgerChainWork();
+    ResourceClass getResourceClass() const override;
     std::string getStatus() const override;
+    // Ledgers of the range not applied yet.
+    uint32_t getRemainingLedgers() const;
     void onReset() override;
     void onStart() override;
     void onRun() override;
     Work::State onSuccess() override;
+    void notify(std::string const& child) override;
 };
 }
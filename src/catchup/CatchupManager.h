@@ -57,7 +57,7 @@ class CatchupManager
     // describe current catchup state. The `contiguous` argument is passed in
     // to describe whether the ledger-manager's view of current catchup tasks
     // is currently contiguous or discontiguous. Message is taken from current
-    // work item.
+    // work item; the status also shows its throughput, which is not logged.
     virtual void logAndUpdateCatchupStatus(bool contiguous) = 0;
 
     virtual ~CatchupManager(){};
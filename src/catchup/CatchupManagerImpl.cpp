@@ -9,8 +9,10 @@
 #include "catchup/CatchupManagerImpl.h"
 #include "catchup/CatchupConfiguration.h"
 #include "catchup/CatchupWork.h"
+#include "database/Database.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "util/Logging.h"
@@ -46,6 +48,8 @@ CatchupManagerImpl::~CatchupManagerImpl()
 void
 CatchupManagerImpl::historyCaughtup()
 {
+    // before the ledgers buffered meanwhile are closed
+    mApp.getDatabase().setRelaxedDurability(false);
     mCatchupWork.reset();
 }
 
@@ -60,6 +64,10 @@ CatchupManagerImpl::catchupHistory(CatchupConfiguration catchupConfiguration,
     }
 
     mCatchupStart.Mark();
+    if (mApp.getConfig().CATCHUP_RELAXED_DURABILITY)
+    {
+        mApp.getDatabase().setRelaxedDurability(true);
+    }
 
     mCatchupWork = mApp.getWorkManager().addWork<CatchupWork>(
         catchupConfiguration, manualCatchup, handler, Work::RETRY_NEVER);
@@ -91,8 +99,9 @@ CatchupManagerImpl::getCatchupFailureCount() const
 }
 
 void
-CatchupManagerImpl::logAndUpdateCatchupStatus(bool contiguous,
-                                              std::string const& message)
+CatchupManagerImpl::updateCatchupStatus(bool contiguous,
+                                        std::string const& message,
+                                        std::string const& throughput)
 {
     if (!message.empty())
     {
@@ -100,25 +109,45 @@ CatchupManagerImpl::logAndUpdateCatchupStatus(bool contiguous,
             contiguous ? "" : " (discontiguous; will fail and restart)";
         auto state =
             fmt::format("Catching up{}: {}", contiguousString, message);
-        auto existing = mApp.getStatusManager().getStatusMessage(
-            StatusCategory::HISTORY_CATCHUP);
-        if (existing != state)
+        if (mLoggedStatus != state)
         {
             CLOG(INFO, "History") << state;
-            mApp.getStatusManager().setStatusMessage(
-                StatusCategory::HISTORY_CATCHUP, state);
+            mLoggedStatus = state;
         }
+        if (!throughput.empty())
+        {
+            state = fmt::format("{}, {}", state, throughput);
+        }
+        mApp.getStatusManager().setStatusMessage(
+            StatusCategory::HISTORY_CATCHUP, state);
     }
     else
     {
+        mLoggedStatus.clear();
         mApp.getStatusManager().removeStatusMessage(
             StatusCategory::HISTORY_CATCHUP);
     }
 }
 
+void
+CatchupManagerImpl::logAndUpdateCatchupStatus(bool contiguous,
+                                              std::string const& message)
+{
+    updateCatchupStatus(contiguous, message, {});
+}
+
 void
 CatchupManagerImpl::logAndUpdateCatchupStatus(bool contiguous)
 {
-    logAndUpdateCatchupStatus(contiguous, getStatus());
+    if (mCatchupWork)
+    {
+        // the throughput would make every update a new line in the log
+        updateCatchupStatus(contiguous, mCatchupWork->getPhaseStatus(),
+                            mCatchupWork->getThroughput());
+    }
+    else
+    {
+        updateCatchupStatus(contiguous, {}, {});
+    }
 }
 }
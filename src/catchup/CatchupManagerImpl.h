@@ -21,7 +21,9 @@ class Work;
 class CatchupManagerImpl : public CatchupManager
 {
     Application& mApp;
-    std::shared_ptr<Work> mCatchupWork;
+    std::shared_ptr<CatchupWork> mCatchupWork;
+    // last status logged, which excludes the throughput of the catchup
+    std::string mLoggedStatus;
 
     medida::Meter& mCatchupStart;
     medida::Meter& mCatchupSuccess;
@@ -46,5 +48,9 @@ class CatchupManagerImpl : public CatchupManager
     void logAndUpdateCatchupStatus(bool contiguous,
                                    std::string const& message) override;
     void logAndUpdateCatchupStatus(bool contiguous) override;
+
+  private:
+    void updateCatchupStatus(bool contiguous, std::string const& message,
+                             std::string const& throughput);
 };
 }
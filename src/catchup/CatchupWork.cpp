@@ -13,12 +13,17 @@
 #include "historywork/BatchDownloadWork.h"
 #include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
+#include "historywork/Progress.h"
 #include "historywork/VerifyBucketWork.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "test/TestPrinter.h"
 #include "util/Logging.h"
+#include "util/TmpDir.h"
 #include <lib/util/format.h>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 namespace stellar
 {
@@ -31,9 +36,32 @@ CatchupWork::CatchupWork(Application& app, WorkParent& parent,
           app, parent, "catchup",
           app.getHistoryManager().getLastClosedHistoryArchiveState(),
           maxRetries)
+    , mScratchDir{std::make_unique<TmpDir>(
+          app.getScratchDirManager().tmpDir(getUniqueName() + "-scratch"))}
     , mCatchupConfiguration{catchupConfiguration}
     , mManualCatchup{manualCatchup}
     , mProgressHandler{progressHandler}
+    , mDownloadBytes{app.getMetrics().NewMeter({"history", "download", "bytes"},
+                                               "byte")}
+    , mDownloadLedgerSuccess{app.getMetrics().NewMeter(
+          {"history", "download-" + std::string(HISTORY_FILE_TYPE_LEDGER),
+           "success"},
+          "event")}
+    , mDownloadTransactionsSuccess{app.getMetrics().NewMeter(
+          {"history",
+           "download-" + std::string(HISTORY_FILE_TYPE_TRANSACTIONS),
+           "success"},
+          "event")}
+    , mVerifyLedgerSuccess{app.getMetrics().NewMeter(
+          {"history", "verify-ledger", "success"}, "event")}
+    , mVerifyBucketSuccess{app.getMetrics().NewMeter(
+          {"history", "verify-bucket", "success"}, "event")}
+    , mBucketApplyEntries{app.getMetrics().NewMeter(
+          {"history", "bucket-apply", "entries"}, "entry")}
+    , mBucketApplyBytes{app.getMetrics().NewMeter(
+          {"history", "bucket-apply", "bytes"}, "byte")}
+    , mApplyLedgerSuccess{app.getMetrics().NewMeter(
+          {"history", "apply-ledger", "success"}, "event")}
 {
 }
 
@@ -44,6 +72,79 @@ CatchupWork::~CatchupWork()
 
 std::string
 CatchupWork::getStatus() const
+{
+    auto status = getPhaseStatus();
+    auto throughput = getThroughput();
+    if (throughput.empty())
+    {
+        return status;
+    }
+    return fmt::format("{:s}, {:s}", status, throughput);
+}
+
+std::string
+CatchupWork::getThroughput() const
+{
+    if (mState != WORK_PENDING)
+    {
+        return {};
+    }
+
+    if (mApplyTransactionsWork)
+    {
+        auto rates = fmtRate(mApplyLedgerSuccess, "ledger");
+        if (mApp.getConfig().CATCHUP_LOOKAHEAD_CHECKPOINTS != 0)
+        {
+            // transactions are still being downloaded
+            rates += ", " + fmtRate(mDownloadBytes, "byte");
+        }
+        return fmt::format(
+            "{:s}, {:s}", rates,
+            fmtETA(mApplyLedgerSuccess,
+                   mApplyTransactionsWork->getRemainingLedgers()));
+    }
+    else if (mDownloadTransactionsWork)
+    {
+        return fmt::format(
+            "{:s}, {:s}", fmtRate(mDownloadBytes, "byte"),
+            fmtETA(mDownloadTransactionsSuccess,
+                   mDownloadTransactionsWork->getRemaining()));
+    }
+    else if (mApplyBucketsWork)
+    {
+        return fmt::format(
+            "{:s}, {:s}", fmtRate(mBucketApplyEntries, "entry"),
+            fmtETA(mBucketApplyBytes, mApplyBucketsWork->getRemainingBytes()));
+    }
+    else if (mDownloadBucketsWork)
+    {
+        return fmt::format(
+            "{:s}, {:s}, {:s}", fmtRate(mDownloadBytes, "byte"),
+            fmtRate(mVerifyBucketSuccess, "bucket"),
+            fmtETA(mVerifyBucketSuccess, mDownloadBucketsWork->getRemaining()));
+    }
+    else if (mGetBucketsHistoryArchiveStateWork)
+    {
+        return {};
+    }
+    else if (mVerifyLedgersWork)
+    {
+        return fmt::format(
+            "{:s}, {:s}", fmtRate(mVerifyLedgerSuccess, "ledger"),
+            fmtETA(mVerifyLedgerSuccess,
+                   mVerifyLedgersWork->getRemainingLedgers()));
+    }
+    else if (mDownloadLedgersWork)
+    {
+        return fmt::format("{:s}, {:s}", fmtRate(mDownloadBytes, "byte"),
+                           fmtETA(mDownloadLedgerSuccess,
+                                  mDownloadLedgersWork->getRemaining()));
+    }
+    return {};
+}
+
+std::string
+CatchupWork::getPhaseStatus() const
 {
     if (mState == WORK_PENDING)
     {
@@ -155,7 +256,7 @@ CatchupWork::downloadLedgers(CheckpointRange const& range)
         << "Catchup downloading ledger chain for checkpointRange ["
         << range.first() << ".." << range.last() << "]";
     mDownloadLedgersWork = addWork<BatchDownloadWork>(
-        range, HISTORY_FILE_TYPE_LEDGER, *mDownloadDir);
+        range, HISTORY_FILE_TYPE_LEDGER, *mScratchDir);
 
     return true;
 }
@@ -173,7 +274,7 @@ CatchupWork::verifyLedgers(LedgerRange const& range)
         << "Catchup verifying ledger chain for checkpointRange ["
         << range.first() << ".." << range.last() << "]";
     mVerifyLedgersWork = addWork<VerifyLedgerChainWork>(
-        *mDownloadDir, range, mManualCatchup, mFirstVerified, mLastVerified);
+        *mScratchDir, range, mManualCatchup, mFirstVerified, mLastVerified);
 
     return true;
 }
@@ -271,7 +372,7 @@ CatchupWork::downloadTransactions(CheckpointRange const& range)
                           << range.first() << ".." << range.last() << "]";
 
     mDownloadTransactionsWork = addWork<BatchDownloadWork>(
-        range, HISTORY_FILE_TYPE_TRANSACTIONS, *mDownloadDir);
+        range, HISTORY_FILE_TYPE_TRANSACTIONS, *mScratchDir);
 
     return true;
 }
@@ -288,8 +389,9 @@ CatchupWork::applyTransactions(LedgerRange const& range)
     CLOG(INFO, "History") << "Catchup applying transactions for range ["
                           << range.first() << ".." << range.last() << "]";
 
-    mApplyTransactionsWork =
-        addWork<ApplyLedgerChainWork>(*mDownloadDir, range, mLastApplied);
+    mApplyTransactionsWork = addWork<ApplyLedgerChainWork>(
+        *mScratchDir, range, mLastApplied,
+        mApp.getConfig().CATCHUP_LOOKAHEAD_CHECKPOINTS);
 
     return true;
 }
@@ -363,7 +465,9 @@ CatchupWork::onSuccess()
                               << checkpointRange.first() << " not needed";
     }
 
-    if (downloadTransactions(checkpointRange))
+    // with a look-ahead, transactions are downloaded while being applied
+    if (mApp.getConfig().CATCHUP_LOOKAHEAD_CHECKPOINTS == 0 &&
+        downloadTransactions(checkpointRange))
     {
         return WORK_PENDING;
     }
@@ -8,12 +8,22 @@
 #include "historywork/BucketDownloadWork.h"
 #include "ledger/LedgerRange.h"
 
+namespace medida
+{
+class Meter;
+}
+
 namespace stellar
 {
 
 class LedgerRange;
 class CheckpointRange;
 class HistoryManager;
+class ApplyBucketsWork;
+class ApplyLedgerChainWork;
+class BatchDownloadWork;
+class DownloadBucketsWork;
+class VerifyLedgerChainWork;
 
 // Range required to do a catchup.
 //
@@ -50,10 +60,21 @@ using CatchupRange = std::pair<LedgerRange, bool>;
 //
 // Then, depending on configuration, it can download, verify and apply buckets
 // (as in MINIMAL and RECENT catchups), and then download and apply
-// transactions (as in COMPLETE and RECENT catchups).
+// transactions (as in COMPLETE and RECENT catchups). Unless
+// CATCHUP_LOOKAHEAD_CHECKPOINTS is 0, transactions are downloaded by
+// ApplyLedgerChainWork a few checkpoints ahead of those it applies.
+//
+// Ledger and transaction files are downloaded to a directory of their own,
+// from Application::getScratchDirManager, while buckets are downloaded to
+// the bucket tmp dir, as they get moved into the bucket dir.
 //
 // After that, catchup is done and node can replay buffered ledgers and take
 // part in consensus protocol.
+//
+// The status of a running catchup reports the throughput of its current phase
+// (bytes downloaded, buckets verified, bucket entries applied or ledgers
+// verified or replayed per second, from the history.* meters) and an estimate
+// of the time the phase has left at that rate.
 class CatchupWork : public BucketDownloadWork
 {
   public:
@@ -101,6 +122,10 @@ class CatchupWork : public BucketDownloadWork
                 CatchupConfiguration catchupConfiguration, bool manualCatchup,
                 ProgressHandler progressHandler, size_t maxRetries);
     std::string getStatus() const override;
+    // getStatus() without the throughput, which changes all the time.
+    std::string getPhaseStatus() const;
+    // Rates and ETA of the current phase, or empty if it has none.
+    std::string getThroughput() const;
     void onReset() override;
     State onSuccess() override;
     void onFailureRaise() override;
@@ -108,25 +133,37 @@ class CatchupWork : public BucketDownloadWork
     ~CatchupWork();
 
   private:
+    // ledger and transaction files, apart from the buckets of mDownloadDir,
+    // see CATCHUP_SCRATCH_DIR_PATH
+    std::unique_ptr<TmpDir> mScratchDir;
     HistoryArchiveState mRemoteState;
     HistoryArchiveState mApplyBucketsRemoteState;
     uint32_t mLastClosedLedgerAtReset;
     CatchupConfiguration const mCatchupConfiguration;
     bool const mManualCatchup;
     std::shared_ptr<Work> mGetHistoryArchiveStateWork;
-    std::shared_ptr<Work> mDownloadLedgersWork;
-    std::shared_ptr<Work> mVerifyLedgersWork;
+    std::shared_ptr<BatchDownloadWork> mDownloadLedgersWork;
+    std::shared_ptr<VerifyLedgerChainWork> mVerifyLedgersWork;
     std::shared_ptr<Work> mGetBucketsHistoryArchiveStateWork;
-    std::shared_ptr<Work> mDownloadBucketsWork;
-    std::shared_ptr<Work> mApplyBucketsWork;
-    std::shared_ptr<Work> mDownloadTransactionsWork;
-    std::shared_ptr<Work> mApplyTransactionsWork;
+    std::shared_ptr<DownloadBucketsWork> mDownloadBucketsWork;
+    std::shared_ptr<ApplyBucketsWork> mApplyBucketsWork;
+    std::shared_ptr<BatchDownloadWork> mDownloadTransactionsWork;
+    std::shared_ptr<ApplyLedgerChainWork> mApplyTransactionsWork;
     LedgerHeaderHistoryEntry mFirstVerified;
     LedgerHeaderHistoryEntry mLastVerified;
     LedgerHeaderHistoryEntry mLastApplied;
     ProgressHandler mProgressHandler;
     bool mBucketsAppliedEmitted;
 
+    medida::Meter& mDownloadBytes;
+    medida::Meter& mDownloadLedgerSuccess;
+    medida::Meter& mDownloadTransactionsSuccess;
+    medida::Meter& mVerifyLedgerSuccess;
+    medida::Meter& mVerifyBucketSuccess;
+    medida::Meter& mBucketApplyEntries;
+    medida::Meter& mBucketApplyBytes;
+    medida::Meter& mApplyLedgerSuccess;
+
     bool hasAnyLedgersToCatchupTo() const;
     bool downloadLedgers(CheckpointRange const& range);
     bool verifyLedgers(LedgerRange const& range);
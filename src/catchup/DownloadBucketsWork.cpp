@@ -3,10 +3,12 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/DownloadBucketsWork.h"
+#include "bucket/BucketManager.h"
 #include "history/FileTransferInfo.h"
-#include "historywork/GetAndUnzipRemoteFileWork.h"
+#include "historywork/GetAndVerifyBucketWork.h"
 #include "historywork/VerifyBucketWork.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
@@ -21,6 +23,8 @@ DownloadBucketsWork::DownloadBucketsWork(
     , mBuckets{buckets}
     , mHashes{std::move(hashes)}
     , mDownloadDir{downloadDir}
+    , mDownloadBucketCached{app.getMetrics().NewMeter(
+          {"history", "download-bucket", "cached"}, "event")}
     , mDownloadBucketStart{app.getMetrics().NewMeter(
           {"history", "download-bucket", "start"}, "event")}
     , mDownloadBucketSuccess{app.getMetrics().NewMeter(
@@ -45,21 +49,57 @@ DownloadBucketsWork::getStatus() const
     return Work::getStatus();
 }
 
+size_t
+DownloadBucketsWork::getRemaining() const
+{
+    return mPending.size() + mChildren.size();
+}
+
+void
+DownloadBucketsWork::addNextDownload()
+{
+    auto hash = mPending.front();
+    mPending.pop_front();
+    FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_BUCKET, hash);
+    // Each bucket is downloaded, then unzipped and verified in one pass
+    addWork<GetAndVerifyBucketWork>(mBuckets, ft, hexToBin256(hash));
+    mDownloadBucketStart.Mark();
+}
+
 void
 DownloadBucketsWork::onReset()
 {
     clearChildren();
+    mPending.clear();
+
+    // kept until applied, so that a catchup failing or interrupted from here
+    // on does not download them again
+    mApp.getBucketManager().retainBuckets(mHashes);
 
     for (auto const& hash : mHashes)
     {
-        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_BUCKET, hash);
-        // Each bucket gets its own work-chain of
-        // download->gunzip->verify
+        auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
+        if (b)
+        {
+            CLOG(DEBUG, "History") << "Already have bucket " << hash;
+            mDownloadBucketCached.Mark();
+            if (mApp.getBucketManager().isBucketFileVerified(b->getHash()))
+            {
+                mBuckets[hash] = b;
+            }
+            else
+            {
+                addWork<VerifyBucketWork>(mBuckets, b);
+            }
+            continue;
+        }
+        mPending.push_back(hash);
+    }
 
-        auto verify = addWork<VerifyBucketWork>(mBuckets, ft.localPath_nogz(),
-                                                hexToBin256(hash));
-        verify->addWork<GetAndUnzipRemoteFileWork>(ft);
-        mDownloadBucketStart.Mark();
+    size_t nChildren = mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES;
+    while (mChildren.size() < nChildren && !mPending.empty())
+    {
+        addNextDownload();
     }
 }
 
@@ -74,20 +114,40 @@ DownloadBucketsWork::notify(std::string const& child)
         return;
     }
 
-    switch (i->second->getState())
+    // the download meters do not count verifications of buckets we have
+    if (!std::dynamic_pointer_cast<VerifyBucketWork>(i->second))
     {
-    case Work::WORK_SUCCESS:
-        mDownloadBucketSuccess.Mark();
-        break;
-    case Work::WORK_FAILURE_RETRY:
-    case Work::WORK_FAILURE_FATAL:
-    case Work::WORK_FAILURE_RAISE:
-        mDownloadBucketFailure.Mark();
-        break;
-    default:
-        break;
+        switch (i->second->getState())
+        {
+        case Work::WORK_SUCCESS:
+            mDownloadBucketSuccess.Mark();
+            break;
+        case Work::WORK_FAILURE_RETRY:
+        case Work::WORK_FAILURE_FATAL:
+        case Work::WORK_FAILURE_RAISE:
+            mDownloadBucketFailure.Mark();
+            break;
+        default:
+            break;
+        }
     }
 
+    std::vector<std::string> done;
+    for (auto const& c : mChildren)
+    {
+        if (c.second->getState() == WORK_SUCCESS)
+        {
+            done.push_back(c.first);
+        }
+    }
+    for (auto const& d : done)
+    {
+        mChildren.erase(d);
+        if (!mPending.empty())
+        {
+            addNextDownload();
+        }
+    }
     advance();
 }
 }
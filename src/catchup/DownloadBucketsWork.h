@@ -6,6 +6,8 @@
 
 #include "work/Work.h"
 
+#include <deque>
+
 namespace medida
 {
 class Meter;
@@ -19,21 +21,33 @@ class TmpDir;
 
 class DownloadBucketsWork : public Work
 {
-    std::map<std::string, std::shared_ptr<Bucket>> mBuckets;
+    std::map<std::string, std::shared_ptr<Bucket>>& mBuckets;
     std::vector<std::string> mHashes;
     TmpDir const& mDownloadDir;
+    // buckets left to download, in the order they are started
+    std::deque<std::string> mPending;
 
+    medida::Meter& mDownloadBucketCached;
     medida::Meter& mDownloadBucketStart;
     medida::Meter& mDownloadBucketSuccess;
     medida::Meter& mDownloadBucketFailure;
 
+    void addNextDownload();
+
   public:
+    // Buckets are downloaded at most MAX_CONCURRENT_SUBPROCESSES at a time,
+    // in the order of `hashes`: callers list the largest (deepest level)
+    // buckets first, as differingBuckets does, so that they start first.
+    // Buckets the BucketManager already has are not downloaded; their files
+    // are hashed first (VerifyBucketWork) unless they are known to be good.
     DownloadBucketsWork(Application& app, WorkParent& parent,
                         std::map<std::string, std::shared_ptr<Bucket>>& buckets,
                         std::vector<std::string> hashes,
                         TmpDir const& downloadDir);
     ~DownloadBucketsWork();
     std::string getStatus() const override;
+    // Buckets not downloaded and verified yet.
+    size_t getRemaining() const;
     void onReset() override;
     void notify(std::string const& child) override;
 };
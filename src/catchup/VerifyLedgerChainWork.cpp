@@ -9,8 +9,11 @@
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "util/XDRStream.h"
+#include "util/WorkerLanes.h"
+#include <algorithm>
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
+#include <thread>
 
 namespace stellar
 {
@@ -31,13 +34,18 @@ verifyLedgerHistoryEntry(LedgerHeaderHistoryEntry const& hhe)
     return HistoryManager::VERIFY_STATUS_OK;
 }
 
+// `hashVerified` is set when curr was already checked to hash to curr.hash
 static HistoryManager::LedgerVerificationStatus
-verifyLedgerHistoryLink(Hash const& prev, LedgerHeaderHistoryEntry const& curr)
+verifyLedgerHistoryLink(Hash const& prev, LedgerHeaderHistoryEntry const& curr,
+                        bool hashVerified)
 {
-    auto entryResult = verifyLedgerHistoryEntry(curr);
-    if (entryResult != HistoryManager::VERIFY_STATUS_OK)
+    if (!hashVerified)
     {
-        return entryResult;
+        auto entryResult = verifyLedgerHistoryEntry(curr);
+        if (entryResult != HistoryManager::VERIFY_STATUS_OK)
+        {
+            return entryResult;
+        }
     }
     if (prev != curr.header.previousLedgerHash)
     {
@@ -63,6 +71,8 @@ VerifyLedgerChainWork::VerifyLedgerChainWork(
     , mManualCatchup(manualCatchup)
     , mFirstVerified(firstVerified)
     , mLastVerified(lastVerified)
+    , mHashWindow(2 * app.getWorkerThreadCount())
+    , mNextToHash(mCurrCheckpoint)
     , mVerifyLedgerSuccessOld(app.getMetrics().NewMeter(
           {"history", "verify-ledger", "success-old"}, "event"))
     , mVerifyLedgerSuccess(app.getMetrics().NewMeter(
@@ -99,6 +109,15 @@ VerifyLedgerChainWork::getStatus() const
     return Work::getStatus();
 }
 
+uint32_t
+VerifyLedgerChainWork::getRemainingLedgers() const
+{
+    auto freq = mApp.getHistoryManager().getCheckpointFrequency();
+    auto from = mCurrCheckpoint >= freq ? mCurrCheckpoint - freq + 1 : 0;
+    from = std::max(from, mRange.first());
+    return mRange.last() >= from ? mRange.last() - from + 1 : 0;
+}
+
 void
 VerifyLedgerChainWork::onReset()
 {
@@ -117,6 +136,98 @@ VerifyLedgerChainWork::onReset()
     }
     mCurrCheckpoint =
         mApp.getHistoryManager().checkpointContainingLedger(mRange.first());
+    mNextToHash = mCurrCheckpoint;
+    // results of earlier runs still being computed are ignored
+    mHashed.clear();
+    mWaiting = false;
+}
+
+void
+VerifyLedgerChainWork::hashNextCheckpoints()
+{
+    auto& hm = mApp.getHistoryManager();
+    auto last = hm.checkpointContainingLedger(mRange.last());
+    while (mHashed.size() < mHashWindow && mNextToHash <= last)
+    {
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
+                            mNextToHash);
+        auto result = std::make_shared<HashedCheckpoint>();
+        mHashed[mNextToHash] = result;
+
+        auto& app = mApp;
+        auto checkpoint = mNextToHash;
+        auto path = ft.localPath_nogz();
+        std::weak_ptr<VerifyLedgerChainWork> weak(
+            std::static_pointer_cast<VerifyLedgerChainWork>(
+                shared_from_this()));
+        mApp.getWorkerLanes().post(
+            WorkerLane::CATCHUP, [&app, weak, checkpoint, path, result]() {
+                try
+                {
+                    FileIOMetrics io(app.getMetrics(), "history-temp");
+                    XDRInputFileStream hdrIn;
+                    hdrIn.setMetrics(&io);
+                    hdrIn.open(path);
+                    LedgerHeaderHistoryEntry curr;
+                    while (hdrIn && hdrIn.readOne(curr))
+                    {
+                        result->mHashOK.push_back(
+                            LedgerHeaderFrame(curr.header).getHash() ==
+                            curr.hash);
+                        result->mEntries.emplace_back(curr);
+                    }
+                    hdrIn.close();
+                }
+                catch (std::exception& e)
+                {
+                    result->mError = e.what();
+                }
+                app.getClock().getIOService().post(
+                    [weak, checkpoint, result]() {
+                        auto self = weak.lock();
+                        if (self)
+                        {
+                            self->hashed(checkpoint, result);
+                        }
+                    });
+            });
+
+        mNextToHash += hm.getCheckpointFrequency();
+    }
+}
+
+void
+VerifyLedgerChainWork::hashed(uint32_t checkpoint,
+                              std::shared_ptr<HashedCheckpoint> result)
+{
+    auto it = mHashed.find(checkpoint);
+    if (it == mHashed.end() || it->second != result)
+    {
+        return;
+    }
+    result->mDone = true;
+    if (mWaiting && checkpoint == mCurrCheckpoint &&
+        getState() == WORK_RUNNING)
+    {
+        mWaiting = false;
+        scheduleSuccess();
+    }
+}
+
+void
+VerifyLedgerChainWork::onRun()
+{
+    hashNextCheckpoints();
+    auto current = mHashed.find(mCurrCheckpoint);
+    if (current == mHashed.end() || current->second->mDone)
+    {
+        scheduleSuccess();
+    }
+    else
+    {
+        // scheduled by hashed() instead
+        mWaiting = true;
+    }
 }
 
 HistoryManager::LedgerVerificationStatus
@@ -124,8 +235,14 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
 {
     FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
                         mCurrCheckpoint);
-    XDRInputFileStream hdrIn;
-    hdrIn.open(ft.localPath_nogz());
+    auto hashedIt = mHashed.find(mCurrCheckpoint);
+    assert(hashedIt != mHashed.end() && hashedIt->second->mDone);
+    auto hashed = hashedIt->second;
+    mHashed.erase(hashedIt);
+    if (!hashed->mError.empty())
+    {
+        throw std::runtime_error(hashed->mError);
+    }
 
     LedgerHeaderHistoryEntry prev = mLastVerified;
     LedgerHeaderHistoryEntry curr;
@@ -134,8 +251,9 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
                            << ft.localPath_nogz() << " starting from ledger "
                            << LedgerManager::ledgerAbbrev(prev);
 
-    while (hdrIn && hdrIn.readOne(curr))
+    for (size_t i = 0; i < hashed->mEntries.size(); ++i)
     {
+        curr = hashed->mEntries[i];
         if (curr.header.ledgerVersion > Config::CURRENT_LEDGER_PROTOCOL_VERSION)
         {
             mVerifyLedgerFailureLedgerVersion.Mark();
@@ -169,7 +287,8 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
             mVerifyLedgerFailureOvershot.Mark();
             return HistoryManager::VERIFY_STATUS_ERR_OVERSHOT;
         }
-        auto linkResult = verifyLedgerHistoryLink(prev.hash, curr);
+        auto linkResult =
+            verifyLedgerHistoryLink(prev.hash, curr, hashed->mHashOK[i]);
         if (linkResult != HistoryManager::VERIFY_STATUS_OK)
         {
             mVerifyLedgerFailureLink.Mark();
@@ -7,6 +7,11 @@
 #include "history/HistoryManager.h"
 #include "ledger/LedgerRange.h"
 #include "work/Work.h"
+#include "xdr/Stellar-ledger.h"
+
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace medida
 {
@@ -17,10 +22,24 @@ namespace stellar
 {
 
 class TmpDir;
-struct LedgerHeaderHistoryEntry;
 
+// Checkpoints are verified in order, each one linked to the last verified
+// ledger. Re-hashing every header, which does not depend on other
+// checkpoints, is done ahead on worker threads for the next few checkpoints,
+// so that only the links are checked on the main thread.
 class VerifyLedgerChainWork : public Work
 {
+    struct HashedCheckpoint
+    {
+        // set on the main thread once the worker thread is done filling the
+        // rest
+        bool mDone{false};
+        std::string mError;
+        std::vector<LedgerHeaderHistoryEntry> mEntries;
+        // whether each entry hashes to the hash it claims
+        std::vector<bool> mHashOK;
+    };
+
     TmpDir const& mDownloadDir;
     LedgerRange mRange;
     uint32_t mCurrCheckpoint;
@@ -28,6 +47,13 @@ class VerifyLedgerChainWork : public Work
     LedgerHeaderHistoryEntry& mFirstVerified;
     LedgerHeaderHistoryEntry& mLastVerified;
 
+    size_t const mHashWindow;
+    uint32_t mNextToHash;
+    // checkpoints hashed or being hashed but not verified yet
+    std::map<uint32_t, std::shared_ptr<HashedCheckpoint>> mHashed;
+    // waiting for the current checkpoint to be hashed
+    bool mWaiting{false};
+
     medida::Meter& mVerifyLedgerSuccessOld;
     medida::Meter& mVerifyLedgerSuccess;
     medida::Meter& mVerifyLedgerFailureLedgerVersion;
@@ -38,6 +64,8 @@ class VerifyLedgerChainWork : public Work
     medida::Meter& mVerifyLedgerChainFailureEnd;
 
     HistoryManager::LedgerVerificationStatus verifyHistoryOfSingleCheckpoint();
+    void hashNextCheckpoints();
+    void hashed(uint32_t checkpoint, std::shared_ptr<HashedCheckpoint> result);
 
   public:
     VerifyLedgerChainWork(Application& app, WorkParent& parent,
@@ -47,7 +75,10 @@ class VerifyLedgerChainWork : public Work
                           LedgerHeaderHistoryEntry& lastVerified);
     ~VerifyLedgerChainWork();
     std::string getStatus() const override;
+    // Ledgers of the range not verified yet.
+    uint32_t getRemainingLedgers() const;
     void onReset() override;
+    void onRun() override;
     Work::State onSuccess() override;
 };
 }
@@ -10,11 +10,16 @@
 #include "crypto/StrKey.h"
 #include "lib/catch.hpp"
 #include "test/test.h"
+#include "util/Decoder.h"
 #include "util/Logging.h"
+#include "util/crc16.h"
+#include <atomic>
+#include <chrono>
 #include <autocheck/autocheck.hpp>
 #include <map>
 #include <regex>
 #include <sodium.h>
+#include <thread>
 
 using namespace stellar;
 
@@ -103,6 +108,41 @@ TEST_CASE("Stateful SHA256 tests", "[crypto]")
     }
 }
 
+TEST_CASE("SHA256 backends agree with libsodium", "[crypto]")
+{
+    std::vector<std::vector<uint8_t>> msgs;
+    for (size_t n = 0; n < 200; ++n)
+    {
+        msgs.emplace_back(randomBytes(n));
+    }
+    for (size_t n : {1000, 4095, 4096, 100000})
+    {
+        msgs.emplace_back(randomBytes(n));
+    }
+    std::vector<ByteSlice> bins(msgs.begin(), msgs.end());
+    auto many = sha256Many(bins);
+    REQUIRE(many.size() == msgs.size());
+
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        auto const& m = msgs[i];
+        uint256 expected;
+        crypto_hash_sha256(expected.data(), m.data(), m.size());
+        REQUIRE(sha256(m) == expected);
+        REQUIRE(many[i] == expected);
+
+        // in pieces that straddle block boundaries
+        auto h = SHA256::create();
+        for (size_t pos = 0, step = 1; pos < m.size(); step = step * 5 % 97)
+        {
+            auto n = std::min(step, m.size() - pos);
+            h->add(ByteSlice(m.data() + pos, n));
+            pos += n;
+        }
+        REQUIRE(h->finish() == expected);
+    }
+}
+
 TEST_CASE("HMAC test vector", "[crypto]")
 {
     HmacSha256Key k;
@@ -183,6 +223,104 @@ struct SignVerifyTestcase
     }
 };
 
+TEST_CASE("batch verify", "[crypto]")
+{
+    std::vector<SignVerifyTestcase> cases;
+    std::vector<PubKeyUtils::SigVerification> sigs;
+    for (size_t i = 0; i < 200; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+        if (i % 3 == 0)
+        {
+            cases.back().sig[4] ^= 1;
+        }
+    }
+    for (auto const& c : cases)
+    {
+        sigs.push_back({c.pub, c.sig, c.msg});
+    }
+
+    PubKeyUtils::clearVerifySigCache();
+    uint64_t hits, misses;
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+    std::vector<std::thread> helpers;
+    auto res = PubKeyUtils::verifySigs(sigs, 4, [&](std::function<void()> f) {
+        helpers.emplace_back(f);
+    });
+    for (auto& t : helpers)
+    {
+        t.join();
+    }
+
+    REQUIRE(res.size() == sigs.size());
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        REQUIRE(res[i] == (i % 3 != 0));
+    }
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == 0);
+    REQUIRE(misses == sigs.size());
+
+    // Everything is cached now.
+    for (size_t i = 0; i < sigs.size(); ++i)
+    {
+        REQUIRE(PubKeyUtils::verifySig(sigs[i].mKey, sigs[i].mSignature,
+                                       sigs[i].mBin) == (i % 3 != 0));
+    }
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits == sigs.size());
+    REQUIRE(misses == 0);
+}
+
+TEST_CASE("verify cache across threads", "[crypto]")
+{
+    std::vector<SignVerifyTestcase> cases;
+    for (size_t i = 0; i < 64; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+
+    uint64_t hits, misses;
+    // Small enough that shards evict while threads are hitting them.
+    PubKeyUtils::setVerifySigCacheSize(32);
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+
+    size_t const numThreads = 4;
+    size_t const rounds = 10;
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t)
+    {
+        threads.emplace_back([&]() {
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                for (auto const& c : cases)
+                {
+                    if (!PubKeyUtils::verifySig(c.pub, c.sig, c.msg))
+                    {
+                        ++failures;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    REQUIRE(failures == 0);
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses);
+    REQUIRE(hits + misses == numThreads * rounds * cases.size());
+    REQUIRE(misses >= cases.size());
+
+    PubKeyUtils::setVerifySigCacheSize(
+        PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE);
+}
+
 TEST_CASE("sign and verify benchmarking", "[crypto-bench][bench][!hide]")
 {
     size_t n = 100000;
@@ -325,3 +463,64 @@ TEST_CASE("StrKey tests", "[crypto]")
     LOG(INFO) << "CRC16 error-detection rate " << detectionRate;
     REQUIRE(detectionRate > 98.0);
 }
+
+TEST_CASE("StrKey and hex encoders match the reference ones", "[crypto]")
+{
+    autocheck::generator<std::vector<uint8_t>> input;
+    uint8_t version = 6;
+
+    for (int size = 0; size < 100; size++)
+    {
+        std::vector<uint8_t> in(input(size));
+
+        // as strKey::toStrKey encoded before encoding on the stack
+        std::vector<uint8_t> toEncode(in);
+        toEncode.insert(toEncode.begin(), static_cast<uint8_t>(version << 3));
+        uint16_t crc = crc16((char*)toEncode.data(), (int)toEncode.size());
+        toEncode.emplace_back(static_cast<uint8_t>(crc & 0xFF));
+        toEncode.emplace_back(static_cast<uint8_t>(crc >> 8));
+        auto expected = decoder::encode_b32(toEncode);
+        REQUIRE(strKey::toStrKey(version, in).value == expected);
+        REQUIRE(strKey::toStrKeyPrefix(version, in, 5) ==
+                expected.substr(0, 5));
+
+        std::vector<char> hex(in.size() * 2 + 1);
+        sodium_bin2hex(hex.data(), hex.size(), in.data(), in.size());
+        REQUIRE(binToHex(in) == std::string(hex.data()));
+    }
+
+    auto pk = SecretKey::random().getPublicKey();
+    REQUIRE(KeyUtils::toShortString(pk) == KeyUtils::toStrKey(pk).substr(0, 5));
+}
+
+TEST_CASE("StrKey encoding benchmark", "[crypto-bench][bench][!hide]")
+{
+    size_t const n = 1000000;
+    auto pk = SecretKey::random().getPublicKey();
+    std::vector<uint8_t> toEncode(35, 0);
+    std::copy(pk.ed25519().begin(), pk.ed25519().end(), toEncode.begin() + 1);
+
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        toEncode[1] = static_cast<uint8_t>(i);
+        bytes += decoder::encode_b32(toEncode).size();
+    }
+    std::chrono::duration<double> reference =
+        std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        pk.ed25519()[0] = static_cast<uint8_t>(i);
+        bytes -= KeyUtils::toStrKey(pk).size();
+    }
+    std::chrono::duration<double> fast =
+        std::chrono::steady_clock::now() - start;
+
+    REQUIRE(bytes == 0);
+    LOG(INFO) << "StrKey encoding of " << n << " keys: bn::encode_b32 alone "
+              << reference.count() << "s, KeyUtils::toStrKey " << fast.count()
+              << "s";
+}
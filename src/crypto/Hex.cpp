@@ -11,19 +11,23 @@ namespace stellar
 std::string
 binToHex(ByteSlice const& bin)
 {
-    // NB: C++ standard says we can't go modifying the contents of a std::string
-    // just by const_cast'ing away const on .data(), so we use a vector<char> to
-    // write to.
-    if (bin.empty())
-        return "";
-    std::vector<char> hex(bin.size() * 2 + 1, '\0');
-    if (sodium_bin2hex(hex.data(), hex.size(), bin.data(), bin.size()) !=
-        hex.data())
+    std::string res(bin.size() * 2, '\0');
+    binToHex(bin, &res[0]);
+    return res;
+}
+
+char*
+binToHex(ByteSlice const& bin, char* out)
+{
+    // lowercase, as sodium_bin2hex
+    static char const digits[] = "0123456789abcdef";
+    auto p = bin.data();
+    for (size_t i = 0; i < bin.size(); ++i)
     {
-        throw std::runtime_error(
-            "error in stellar::binToHex(std::vector<uint8_t>)");
+        out[2 * i] = digits[p[i] >> 4];
+        out[2 * i + 1] = digits[p[i] & 0xf];
     }
-    return std::string(hex.begin(), hex.end() - 1);
+    return out + 2 * bin.size();
 }
 
 std::string
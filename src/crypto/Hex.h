@@ -13,6 +13,10 @@ namespace stellar
 // Hex-encode a ByteSlice.
 std::string binToHex(ByteSlice const& bin);
 
+// Hex-encode a ByteSlice into `out`, which must have room for 2 * bin.size()
+// characters; returns the end of the output.
+char* binToHex(ByteSlice const& bin, char* out);
+
 // Hex-encode a ByteSlice and return a 6-character prefix of it (for logging).
 std::string hexAbbrev(ByteSlice const& bin);
 
@@ -58,14 +58,17 @@ template <typename T>
 typename std::enable_if<!std::is_same<T, SecretKey>::value, std::string>::type
 toShortString(T const& key)
 {
-    return toStrKey(key).substr(0, 5);
+    return strKey::toStrKeyPrefix(KeyFunctions<T>::toKeyVersion(key.type()),
+                                  KeyFunctions<T>::getKeyValue(key), 5);
 }
 
 template <typename T>
 typename std::enable_if<std::is_same<T, SecretKey>::value, SecretValue>::type
 toShortString(T const& key)
 {
-    return SecretValue{toStrKey(key).value.substr(0, 5)};
+    return SecretValue{
+        strKey::toStrKeyPrefix(KeyFunctions<T>::toKeyVersion(key.type()),
+                               KeyFunctions<T>::getKeyValue(key), 5)};
 }
 
 std::size_t getKeyVersionSize(strKey::StrKeyVersionByte keyVersion);
@@ -5,15 +5,424 @@
 #include "crypto/SHA.h"
 #include "crypto/ByteSlice.h"
 #include "util/NonCopyable.h"
+#include <algorithm>
+#include <cstring>
 #include <sodium.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define STELLAR_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 namespace stellar
 {
 
+// SHA-256 is computed by libsodium unless the CPU has something faster: the
+// SHA extensions (SHA-NI) for single messages, AVX2 for hashing eight
+// messages at once in sha256Many. Those kernels are compiled for their
+// instruction sets with target attributes and only called once CPUID says
+// they can run.
+
+namespace
+{
+
+uint32_t const K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+uint32_t const H256[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// Runs the compression function over `n` consecutive 64-byte blocks.
+using CompressFn = void (*)(uint32_t state[8], unsigned char const* blocks,
+                            size_t n);
+
+// Writes the padding that ends a message of `size` bytes, whose last
+// `size % 64` bytes are `tail`, into `out`; returns the number of blocks
+// written (1 or 2).
+size_t
+padTail(unsigned char const* tail, uint64_t size, unsigned char out[128])
+{
+    size_t rem = size % 64;
+    size_t blocks = rem < 56 ? 1 : 2;
+    std::memset(out, 0, blocks * 64);
+    std::memcpy(out, tail, rem);
+    out[rem] = 0x80;
+    uint64_t bits = size * 8;
+    for (int i = 0; i < 8; ++i)
+    {
+        out[blocks * 64 - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    return blocks;
+}
+
+void
+stateToDigest(uint32_t const state[8], unsigned char* out)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        out[4 * i] = static_cast<unsigned char>(state[i] >> 24);
+        out[4 * i + 1] = static_cast<unsigned char>(state[i] >> 16);
+        out[4 * i + 2] = static_cast<unsigned char>(state[i] >> 8);
+        out[4 * i + 3] = static_cast<unsigned char>(state[i]);
+    }
+}
+
+#ifdef STELLAR_SHA256_X86
+
+__attribute__((target("sha,sse4.1"))) void
+compressShaNi(uint32_t state[8], unsigned char const* blocks, size_t n)
+{
+    __m128i const byteSwap =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // the instructions want the state as ABEF and CDGH
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state));
+    __m128i state1 =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 4));
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);
+    state1 = _mm_shuffle_epi32(state1, 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (; n != 0; --n, blocks += 64)
+    {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i w[4];
+        for (int i = 0; i < 16; ++i)
+        {
+            __m128i& wi = w[i % 4];
+            if (i < 4)
+            {
+                wi = _mm_shuffle_epi8(
+                    _mm_loadu_si128(
+                        reinterpret_cast<__m128i const*>(blocks + 16 * i)),
+                    byteSwap);
+            }
+            else
+            {
+                // w[i-4] is the slot being replaced
+                __m128i w1 = w[(i - 1) % 4];
+                __m128i t = _mm_sha256msg1_epu32(wi, w[(i - 3) % 4]);
+                t = _mm_add_epi32(t, _mm_alignr_epi8(w1, w[(i - 2) % 4], 4));
+                wi = _mm_sha256msg2_epu32(t, w1);
+            }
+            __m128i msg = _mm_add_epi32(
+                wi,
+                _mm_loadu_si128(reinterpret_cast<__m128i const*>(K256 + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0e);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+
+__attribute__((target("avx2"))) inline __m256i
+rotr8(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, n),
+                           _mm256_slli_epi32(x, 32 - n));
+}
+
+// Hashes messages in eight lanes, one SHA-256 state per 32-bit lane. Lane l
+// goes through the blocks of `data[l]` followed by those of `tails[l]` (its
+// padding), `blocks[l]` in all; its digest goes to `out[l]`.
+__attribute__((target("avx2"))) void
+hash8Avx2(unsigned char const* const data[8], size_t const full[8],
+          unsigned char const tails[8][128], size_t const blocks[8],
+          uint256* const out[8])
+{
+    __m256i const byteSwap = _mm256_set_epi64x(
+        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL,
+        0x0405060700010203ULL);
+    __m256i s[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        s[i] = _mm256_set1_epi32(static_cast<int>(H256[i]));
+    }
+    size_t maxBlocks = *std::max_element(blocks, blocks + 8);
+
+    for (size_t b = 0; b < maxBlocks; ++b)
+    {
+        // load the block of each lane (a finished lane repeats its last
+        // one) and transpose them into one vector per message word
+        __m256i w[64];
+        for (int half = 0; half < 2; ++half)
+        {
+            __m256i r[8];
+            for (int l = 0; l < 8; ++l)
+            {
+                size_t lb = std::min(b, blocks[l] - 1);
+                unsigned char const* p =
+                    lb < full[l] ? data[l] + 64 * lb
+                                 : tails[l] + 64 * (lb - full[l]);
+                r[l] = _mm256_shuffle_epi8(
+                    _mm256_loadu_si256(
+                        reinterpret_cast<__m256i const*>(p + 32 * half)),
+                    byteSwap);
+            }
+            __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+            __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+            __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+            __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+            __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+            __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+            __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+            __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+            __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+            __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+            __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+            __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+            __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+            __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+            __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+            __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+            __m256i* col = w + 8 * half;
+            col[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+            col[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+            col[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+            col[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+            col[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+            col[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+            col[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+            col[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            __m256i w15 = w[i - 15];
+            __m256i w2 = w[i - 2];
+            __m256i sig0 =
+                _mm256_xor_si256(_mm256_xor_si256(rotr8(w15, 7), rotr8(w15, 18)),
+                                 _mm256_srli_epi32(w15, 3));
+            __m256i sig1 =
+                _mm256_xor_si256(_mm256_xor_si256(rotr8(w2, 17), rotr8(w2, 19)),
+                                 _mm256_srli_epi32(w2, 10));
+            w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], sig0),
+                                    _mm256_add_epi32(w[i - 7], sig1));
+        }
+
+        __m256i a = s[0], b1 = s[1], c = s[2], d = s[3];
+        __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            __m256i bigSig1 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                          _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(
+                _mm256_add_epi32(_mm256_add_epi32(h, bigSig1),
+                                 _mm256_add_epi32(ch, w[i])),
+                _mm256_set1_epi32(static_cast<int>(K256[i])));
+            __m256i bigSig0 = _mm256_xor_si256(
+                _mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+            __m256i maj = _mm256_or_si256(
+                _mm256_and_si256(a, b1),
+                _mm256_and_si256(c, _mm256_or_si256(a, b1)));
+            __m256i t2 = _mm256_add_epi32(bigSig0, maj);
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b1;
+            b1 = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+        s[0] = _mm256_add_epi32(s[0], a);
+        s[1] = _mm256_add_epi32(s[1], b1);
+        s[2] = _mm256_add_epi32(s[2], c);
+        s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e);
+        s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g);
+        s[7] = _mm256_add_epi32(s[7], h);
+
+        alignas(32) uint32_t lanes[8][8];
+        bool stored = false;
+        for (int l = 0; l < 8; ++l)
+        {
+            if (blocks[l] != b + 1)
+            {
+                continue;
+            }
+            if (!stored)
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[i]),
+                                       s[i]);
+                }
+                stored = true;
+            }
+            uint32_t state[8];
+            for (int i = 0; i < 8; ++i)
+            {
+                state[i] = lanes[i][l];
+            }
+            stateToDigest(state, out[l]->data());
+        }
+    }
+}
+
+struct CpuFeatures
+{
+    bool mShaNi{false};
+    bool mAvx2{false};
+
+    CpuFeatures()
+    {
+        unsigned int a, b, c, d;
+        if (!__get_cpuid(1, &a, &b, &c, &d))
+        {
+            return;
+        }
+        bool sse41 = (c & bit_SSE4_1) != 0;
+        bool ssse3 = (c & bit_SSSE3) != 0;
+        // AVX also needs the OS to save the YMM registers
+        bool avx = false;
+        if ((c & bit_OSXSAVE) != 0 && (c & bit_AVX) != 0)
+        {
+            uint32_t lo, hi;
+            __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            avx = (lo & 6) == 6;
+        }
+        if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+        {
+            return;
+        }
+        mShaNi = (b & bit_SHA) != 0 && sse41 && ssse3;
+        mAvx2 = (b & bit_AVX2) != 0 && avx;
+    }
+};
+
+CpuFeatures const&
+cpuFeatures()
+{
+    static CpuFeatures const features;
+    return features;
+}
+
+#endif
+
+CompressFn
+getCompressFn()
+{
+#ifdef STELLAR_SHA256_X86
+    if (cpuFeatures().mShaNi)
+    {
+        return compressShaNi;
+    }
+#endif
+    return nullptr;
+}
+
+bool
+haveHash8()
+{
+#ifdef STELLAR_SHA256_X86
+    return cpuFeatures().mAvx2;
+#else
+    return false;
+#endif
+}
+
+// Incremental SHA256 over a compression function of our own.
+class SHA256Blocks : public SHA256, NonCopyable
+{
+    CompressFn const mCompress;
+    uint32_t mState[8];
+    unsigned char mBuf[64];
+    uint64_t mSize;
+    bool mFinished;
+
+  public:
+    explicit SHA256Blocks(CompressFn compress) : mCompress(compress)
+    {
+        reset();
+    }
+
+    void
+    reset() override
+    {
+        std::copy(H256, H256 + 8, mState);
+        mSize = 0;
+        mFinished = false;
+    }
+
+    void
+    add(ByteSlice const& bin) override
+    {
+        if (mFinished)
+        {
+            throw std::runtime_error("adding bytes to finished SHA256");
+        }
+        auto data = bin.data();
+        auto size = bin.size();
+        size_t used = mSize % 64;
+        mSize += size;
+        if (used != 0)
+        {
+            auto n = std::min(size, 64 - used);
+            std::memcpy(mBuf + used, data, n);
+            data += n;
+            size -= n;
+            if (used + n < 64)
+            {
+                return;
+            }
+            mCompress(mState, mBuf, 1);
+        }
+        mCompress(mState, data, size / 64);
+        std::memcpy(mBuf, data + size / 64 * 64, size % 64);
+    }
+
+    uint256
+    finish() override
+    {
+        if (mFinished)
+        {
+            throw std::runtime_error("finishing already-finished SHA256");
+        }
+        mFinished = true;
+        unsigned char tail[128];
+        mCompress(mState, tail, padTail(mBuf, mSize, tail));
+        uint256 out;
+        stateToDigest(mState, out.data());
+        return out;
+    }
+};
+}
+
 // Plain SHA256
 uint256
 sha256(ByteSlice const& bin)
 {
+    if (auto compress = getCompressFn())
+    {
+        SHA256Blocks h(compress);
+        h.add(bin);
+        return h.finish();
+    }
     uint256 out;
     if (crypto_hash_sha256(out.data(), bin.data(), bin.size()) != 0)
     {
@@ -22,6 +431,43 @@ sha256(ByteSlice const& bin)
     return out;
 }
 
+std::vector<uint256>
+sha256Many(std::vector<ByteSlice> const& bins)
+{
+    std::vector<uint256> out(bins.size());
+    size_t i = 0;
+#ifdef STELLAR_SHA256_X86
+    // SHA-NI hashes one message about as fast as AVX2 hashes eight
+    if (haveHash8() && !getCompressFn())
+    {
+        unsigned char const* data[8];
+        size_t full[8];
+        unsigned char tails[8][128];
+        size_t blocks[8];
+        uint256* outs[8];
+        for (; i + 8 <= bins.size(); i += 8)
+        {
+            for (size_t l = 0; l < 8; ++l)
+            {
+                auto const& bin = bins[i + l];
+                data[l] = bin.data();
+                full[l] = bin.size() / 64;
+                blocks[l] =
+                    full[l] + padTail(bin.data() + full[l] * 64, bin.size(),
+                                      tails[l]);
+                outs[l] = &out[i + l];
+            }
+            hash8Avx2(data, full, tails, blocks, outs);
+        }
+    }
+#endif
+    for (; i < bins.size(); ++i)
+    {
+        out[i] = sha256(bins[i]);
+    }
+    return out;
+}
+
 class SHA256Impl : public SHA256, NonCopyable
 {
     crypto_hash_sha256_state mState;
@@ -37,6 +483,10 @@ class SHA256Impl : public SHA256, NonCopyable
 std::unique_ptr<SHA256>
 SHA256::create()
 {
+    if (auto compress = getCompressFn())
+    {
+        return std::make_unique<SHA256Blocks>(compress);
+    }
     return std::make_unique<SHA256Impl>();
 }
 
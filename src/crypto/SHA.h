@@ -7,6 +7,7 @@
 #include "crypto/ByteSlice.h"
 #include "xdr/Stellar-types.h"
 #include <memory>
+#include <vector>
 
 namespace stellar
 {
@@ -14,6 +15,11 @@ namespace stellar
 // Plain SHA256
 uint256 sha256(ByteSlice const& bin);
 
+// SHA256 of each of `bins`. On CPUs with AVX2 but without the SHA extensions
+// this hashes eight messages at a time, much faster than one by one for
+// many small messages.
+std::vector<uint256> sha256Many(std::vector<ByteSlice> const& bins);
+
 // SHA256 in incremental mode, for large inputs.
 class SHA256
 {
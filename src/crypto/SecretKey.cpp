@@ -11,6 +11,9 @@
 #include "transactions/SignatureUtils.h"
 #include "util/HashOfHash.h"
 #include "util/lrucache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <sodium.h>
@@ -25,12 +28,50 @@ namespace stellar
 // to the state of the process; caching its results centrally
 // makes all signature-verification in the program faster and
 // has no effect on correctness.
+//
+// It is split into shards, picked by the first byte of the cache key (itself
+// a SHA256), each with its own lock, LRU list and hit/miss counts, so that
+// verifications running on several threads rarely contend.
+
+namespace
+{
+struct VerifySigCacheShard
+{
+    std::mutex mMutex;
+    std::unique_ptr<cache::lru_cache<Hash, bool>> mCache;
+    uint64_t mHits{0};
+    uint64_t mMisses{0};
+};
+
+size_t const VERIFY_SIG_CACHE_SHARDS = 16;
+std::array<VerifySigCacheShard, VERIFY_SIG_CACHE_SHARDS> gVerifySigCache;
+
+size_t
+shardCapacity(size_t totalSize)
+{
+    return std::max<size_t>(
+        1, (totalSize + VERIFY_SIG_CACHE_SHARDS - 1) / VERIFY_SIG_CACHE_SHARDS);
+}
 
-static std::mutex gVerifySigCacheMutex;
-static cache::lru_cache<Hash, bool> gVerifySigCache(0xffff);
-static std::unique_ptr<SHA256> gHasher = SHA256::create();
-static uint64_t gVerifyCacheHit = 0;
-static uint64_t gVerifyCacheMiss = 0;
+VerifySigCacheShard&
+getVerifySigCacheShard(Hash const& cacheKey)
+{
+    return gVerifySigCache[cacheKey[0] % VERIFY_SIG_CACHE_SHARDS];
+}
+
+// Must be called with the shard locked. Caches are created on first use, so
+// that a size set at startup does not first allocate the default one.
+cache::lru_cache<Hash, bool>&
+getShardCache(VerifySigCacheShard& shard)
+{
+    if (!shard.mCache)
+    {
+        shard.mCache = std::make_unique<cache::lru_cache<Hash, bool>>(
+            shardCapacity(PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE));
+    }
+    return *shard.mCache;
+}
+}
 
 static Hash
 verifySigCacheKey(PublicKey const& key, Signature const& signature,
@@ -38,11 +79,12 @@ verifySigCacheKey(PublicKey const& key, Signature const& signature,
 {
     assert(key.type() == PUBLIC_KEY_TYPE_ED25519);
 
-    gHasher->reset();
-    gHasher->add(key.ed25519());
-    gHasher->add(signature);
-    gHasher->add(bin);
-    return gHasher->finish();
+    // Called from verifySigs helpers too, so each call gets its own hasher.
+    auto hasher = SHA256::create();
+    hasher->add(key.ed25519());
+    hasher->add(signature);
+    hasher->add(bin);
+    return hasher->finish();
 }
 
 SecretKey::SecretKey() : mKeyType(PUBLIC_KEY_TYPE_ED25519)
@@ -187,18 +229,60 @@ SecretKey::fromStrKeySeed(std::string const& strKeySeed)
 void
 PubKeyUtils::clearVerifySigCache()
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.clear();
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mCache)
+        {
+            shard.mCache->clear();
+        }
+    }
+}
+
+void
+PubKeyUtils::setVerifySigCacheSize(size_t size)
+{
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache =
+            std::make_unique<cache::lru_cache<Hash, bool>>(shardCapacity(size));
+    }
 }
 
 void
 PubKeyUtils::flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses)
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    hits = gVerifyCacheHit;
-    misses = gVerifyCacheMiss;
-    gVerifyCacheHit = 0;
-    gVerifyCacheMiss = 0;
+    hits = 0;
+    misses = 0;
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        hits += shard.mHits;
+        misses += shard.mMisses;
+        shard.mHits = 0;
+        shard.mMisses = 0;
+    }
+}
+
+size_t
+PubKeyUtils::getVerifySigCacheBytes()
+{
+    // each result is in the LRU list and in the map pointing into it
+    size_t const itemBytes = sizeof(std::pair<Hash, bool>) +
+                             2 * sizeof(void*) + sizeof(Hash) +
+                             3 * sizeof(void*);
+    size_t bytes = 0;
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        bytes += sizeof(shard);
+        if (shard.mCache)
+        {
+            bytes += shard.mCache->size() * itemBytes;
+        }
+    }
+    return bytes;
 }
 
 std::string
@@ -280,24 +364,87 @@ PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
 
     auto cacheKey = verifySigCacheKey(key, signature, bin);
 
+    auto& shard = getVerifySigCacheShard(cacheKey);
     {
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        if (gVerifySigCache.exists(cacheKey))
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        auto& cache = getShardCache(shard);
+        if (cache.exists(cacheKey))
         {
-            ++gVerifyCacheHit;
-            return gVerifySigCache.get(cacheKey);
+            ++shard.mHits;
+            return cache.get(cacheKey);
         }
     }
 
-    ++gVerifyCacheMiss;
     bool ok =
         (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
                                      key.ed25519().data()) == 0);
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.put(cacheKey, ok);
+    std::lock_guard<std::mutex> guard(shard.mMutex);
+    ++shard.mMisses;
+    getShardCache(shard).put(cacheKey, ok);
     return ok;
 }
 
+namespace
+{
+// Shared between verifySigs and its helpers, which may only get to run
+// after verifySigs has returned: by then every check has been claimed, so
+// late helpers exit without touching `mSigs`.
+struct VerifySigsState
+{
+    std::vector<SigVerification> const* mSigs;
+    size_t const mSize;
+    std::vector<char> mResults;
+    std::atomic<size_t> mNext{0};
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    size_t mRemaining;
+
+    VerifySigsState(std::vector<SigVerification> const& sigs)
+        : mSigs(&sigs)
+        , mSize(sigs.size())
+        , mResults(sigs.size())
+        , mRemaining(sigs.size())
+    {
+    }
+
+    void
+    run()
+    {
+        size_t i;
+        while ((i = mNext++) < mSize)
+        {
+            auto const& s = (*mSigs)[i];
+            mResults[i] = PubKeyUtils::verifySig(s.mKey, s.mSignature, s.mBin);
+            std::lock_guard<std::mutex> guard(mMutex);
+            if (--mRemaining == 0)
+            {
+                mDone.notify_all();
+            }
+        }
+    }
+};
+}
+
+std::vector<bool>
+PubKeyUtils::verifySigs(
+    std::vector<SigVerification> const& sigs, size_t numHelpers,
+    std::function<void(std::function<void()>)> const& post)
+{
+    auto state = std::make_shared<VerifySigsState>(sigs);
+    // No point in waking up more helpers than there are checks to share.
+    numHelpers = std::min(numHelpers, sigs.size() / 2);
+    for (size_t i = 0; i < numHelpers; ++i)
+    {
+        post([state]() { state->run(); });
+    }
+    state->run();
+    {
+        std::unique_lock<std::mutex> lock(state->mMutex);
+        state->mDone.wait(lock, [&state]() { return state->mRemaining == 0; });
+    }
+    return std::vector<bool>(state->mResults.begin(), state->mResults.end());
+}
+
 PublicKey
 PubKeyUtils::random()
 {
@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/ByteSlice.h"
 #include "crypto/KeyUtils.h"
 #include "util/XDROperators.h"
 #include "xdr/Stellar-types.h"
@@ -11,11 +12,11 @@
 #include <array>
 #include <functional>
 #include <ostream>
+#include <vector>
 
 namespace stellar
 {
 
-class ByteSlice;
 struct SecretValue;
 struct SignerKey;
 
@@ -101,8 +102,34 @@ namespace PubKeyUtils
 bool verifySig(PublicKey const& key, Signature const& signature,
                ByteSlice const& bin);
 
+// One check for verifySigs. `bin` is not copied: it must outlive the call.
+struct SigVerification
+{
+    PublicKey mKey;
+    Signature mSignature;
+    ByteSlice mBin;
+};
+
+// Verify every element of `sigs` like verifySig does (filling its cache), and
+// return the results in the same order. The checks are shared between the
+// calling thread and up to `numHelpers` tasks handed to `post`, typically to
+// run on the worker pool. The calling thread also takes checks itself, so it
+// never waits for a helper that has not started yet; a busy pool only makes
+// the sweep less parallel.
+std::vector<bool>
+verifySigs(std::vector<SigVerification> const& sigs, size_t numHelpers,
+           std::function<void(std::function<void()>)> const& post);
+
+// Total number of results kept by the process-wide verify cache, unless
+// changed with setVerifySigCacheSize.
+size_t const DEFAULT_VERIFY_SIG_CACHE_SIZE = 0xffff;
+
 void clearVerifySigCache();
+// Resizes (and clears) the verify cache.
+void setVerifySigCacheSize(size_t size);
 void flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses);
+// Approximate bytes held by the verify cache.
+size_t getVerifySigCacheBytes();
 
 PublicKey random();
 }
@@ -7,6 +7,10 @@
 #include "util/SecretValue.h"
 #include "util/crc16.h"
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+
 namespace stellar
 {
 namespace strKey
@@ -15,20 +19,50 @@ namespace strKey
 SecretValue
 toStrKey(uint8_t ver, ByteSlice const& bin)
 {
-    ver <<= 3; // promote to 8 bits
-    std::vector<uint8_t> toEncode;
-    toEncode.reserve(1 + bin.size() + 2);
-    toEncode.emplace_back(ver);
-    toEncode.insert(toEncode.end(), bin.begin(), bin.end());
+    std::string res(getStrKeySize(bin.size()), '\0');
+    toStrKey(ver, bin, &res[0]);
+    return SecretValue{std::move(res)};
+}
+
+char*
+toStrKey(uint8_t ver, ByteSlice const& bin, char* out)
+{
+    // version, data, crc: on the stack for keys and hashes
+    std::array<uint8_t, 1 + 64 + 2> buf;
+    std::vector<uint8_t> large;
+    uint8_t* toEncode = buf.data();
+    size_t size = 1 + bin.size() + 2;
+    if (size > buf.size())
+    {
+        large.resize(size);
+        toEncode = large.data();
+    }
 
-    uint16_t crc = crc16((char*)toEncode.data(), (int)toEncode.size());
-    toEncode.emplace_back(static_cast<uint8_t>(crc & 0xFF));
-    crc >>= 8;
-    toEncode.emplace_back(static_cast<uint8_t>(crc & 0xFF));
+    toEncode[0] = static_cast<uint8_t>(ver << 3); // promote to 8 bits
+    std::copy(bin.begin(), bin.end(), toEncode + 1);
+    uint16_t crc = crc16((char*)toEncode, (int)(size - 2));
+    toEncode[size - 2] = static_cast<uint8_t>(crc & 0xFF);
+    toEncode[size - 1] = static_cast<uint8_t>(crc >> 8);
 
-    std::string res;
-    res = decoder::encode_b32(toEncode);
-    return SecretValue{res};
+    return decoder::encode_b32(toEncode, size, out);
+}
+
+std::string
+toStrKeyPrefix(uint8_t ver, ByteSlice const& bin, size_t n)
+{
+    assert(n <= 8);
+    if (bin.size() < 4)
+    {
+        // the first group includes the crc
+        return toStrKey(ver, bin).value.substr(0, n);
+    }
+    // the first 8 characters only depend on the version and 4 data bytes
+    auto d = bin.data();
+    uint8_t group[5] = {static_cast<uint8_t>(ver << 3), d[0], d[1], d[2],
+                        d[3]};
+    char out[8];
+    decoder::encode_b32(group, sizeof(group), out);
+    return std::string(out, n);
 }
 
 size_t
@@ -26,6 +26,14 @@ enum StrKeyVersionByte : uint8_t
 // Encode a version byte and ByteSlice into StrKey
 SecretValue toStrKey(uint8_t ver, ByteSlice const& bin);
 
+// Same, into `out`, which must have room for getStrKeySize(bin.size())
+// characters; returns the end of the output.
+char* toStrKey(uint8_t ver, ByteSlice const& bin, char* out);
+
+// The first `n` (at most 8) characters of the StrKey of a version byte and
+// ByteSlice, as used in logs, encoding only the bytes they depend on.
+std::string toStrKeyPrefix(uint8_t ver, ByteSlice const& bin, size_t n);
+
 // computes the size of the StrKey that would result from encoding
 // a ByteSlice of dataSize bytes
 size_t getStrKeySize(size_t dataSize);
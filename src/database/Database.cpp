@@ -4,6 +4,7 @@
 
 #include "database/Database.h"
 #include "crypto/Hex.h"
+#include "crypto/SHA.h"
 #include "database/DatabaseConnectionString.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -15,6 +16,7 @@
 
 #include "bucket/BucketManager.h"
 #include "herder/HerderPersistence.h"
+#include "herder/SCPHistoryFileStore.h"
 #include "herder/Upgrades.h"
 #include "history/HistoryManager.h"
 #include "ledger/AccountFrame.h"
@@ -26,12 +28,16 @@
 #include "main/PersistentState.h"
 #include "overlay/BanManager.h"
 #include "overlay/OverlayManager.h"
+#include "overlay/PeerTable.h"
 #include "transactions/TransactionFrame.h"
 
 #include "medida/counter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
@@ -54,7 +60,7 @@ using namespace std;
 
 bool Database::gDriversRegistered = false;
 
-static unsigned long const SCHEMA_VERSION = 7;
+static unsigned long const SCHEMA_VERSION = 9;
 
 static void
 setSerializable(soci::session& sess)
@@ -82,7 +88,12 @@ Database::Database(Application& app)
           app.getMetrics().NewMeter({"database", "query", "exec"}, "query"))
     , mStatementsSize(
           app.getMetrics().NewCounter({"database", "memory", "statements"}))
-    , mEntryCache(4096)
+    , mEntryCache(app.getMetrics(), app.getConfig().LEDGER_STATE_IN_MEMORY
+                                        ? SIZE_MAX
+                                        : app.getConfig().ENTRY_CACHE_SIZE)
+    , mOrderBook(app.getMetrics(), app.getConfig().ORDER_BOOK_CACHE_SIZE)
+    , mLedgerHeaderCache(app.getMetrics())
+    , mPeerTable(std::make_unique<PeerTable>(app.getMetrics()))
     , mExcludedQueryTime(0)
     , mExcludedTotalTime(0)
     , mLastIdleQueryTime(0)
@@ -100,6 +111,9 @@ Database::Database(Application& app)
         // busy_timeout gives room for external processes
         // that may lock the database for some time
         mSession << "PRAGMA busy_timeout = 10000";
+        // INSERT OR REPLACE then fires the delete triggers of the rows it
+        // replaces (see AccountFrame::createInflationVotes)
+        mSession << "PRAGMA recursive_triggers = ON";
     }
     else
     {
@@ -107,6 +121,10 @@ Database::Database(Application& app)
     }
 }
 
+Database::~Database()
+{
+}
+
 void
 Database::applySchemaUpgrade(unsigned long vers)
 {
@@ -158,6 +176,14 @@ Database::applySchemaUpgrade(unsigned long vers)
                     "CHECK (sellingliabilities >= 0)";
         break;
 
+    case 8:
+        mSession << OfferFrame::kSQLCreateBestOfferIndex;
+        break;
+
+    case 9:
+        AccountFrame::createInflationVotes(*this);
+        break;
+
     default:
         throw std::runtime_error("Unknown DB schema version");
         break;
@@ -184,6 +210,15 @@ Database::upgradeToCurrentSchema()
         putSchemaVersion(vers);
     }
     assert(vers == SCHEMA_VERSION);
+
+    if (!isSqlite() &&
+        mApp.getConfig().TX_HISTORY_BINARY_COLUMNS != isTxHistoryBinary())
+    {
+        CLOG(WARNING, "Database")
+            << "TX_HISTORY_BINARY_COLUMNS only applies to new databases, "
+            << "txhistory keeps its "
+            << (isTxHistoryBinary() ? "binary" : "base64") << " columns";
+    }
 }
 
 void
@@ -219,46 +254,58 @@ Database::getAppSchemaVersion()
     return SCHEMA_VERSION;
 }
 
-medida::TimerContext
+HistogramTimerContext
 Database::getInsertTimer(std::string const& entityName)
 {
     mEntityTypes.insert(entityName);
     mQueryMeter.Mark();
-    return mApp.getMetrics()
+    mWriteQueries++;
+    return mApp.getLatencyHistograms()
         .NewTimer({"database", "insert", entityName})
         .TimeScope();
 }
 
-medida::TimerContext
+HistogramTimerContext
 Database::getSelectTimer(std::string const& entityName)
 {
     mEntityTypes.insert(entityName);
     mQueryMeter.Mark();
-    return mApp.getMetrics()
+    mReadQueries++;
+    return mApp.getLatencyHistograms()
         .NewTimer({"database", "select", entityName})
         .TimeScope();
 }
 
-medida::TimerContext
+HistogramTimerContext
 Database::getDeleteTimer(std::string const& entityName)
 {
     mEntityTypes.insert(entityName);
     mQueryMeter.Mark();
-    return mApp.getMetrics()
+    mWriteQueries++;
+    return mApp.getLatencyHistograms()
         .NewTimer({"database", "delete", entityName})
         .TimeScope();
 }
 
-medida::TimerContext
+HistogramTimerContext
 Database::getUpdateTimer(std::string const& entityName)
 {
     mEntityTypes.insert(entityName);
     mQueryMeter.Mark();
-    return mApp.getMetrics()
+    mWriteQueries++;
+    return mApp.getLatencyHistograms()
         .NewTimer({"database", "update", entityName})
         .TimeScope();
 }
 
+void
+Database::markAvoidedUpdate(std::string const& entityName)
+{
+    mApp.getMetrics()
+        .NewMeter({"database", "avoided-update", entityName}, "query")
+        .Mark();
+}
+
 void
 Database::setCurrentTransactionReadOnly()
 {
@@ -278,6 +325,82 @@ Database::isSqlite() const
            std::string::npos;
 }
 
+bool
+Database::isTxHistoryBinary()
+{
+    if (!mTxHistoryBinaryLoaded)
+    {
+        // databases initialized before there was a choice have no state
+        assertThreadIsMain();
+        mTxHistoryBinary = mApp.getPersistentState().getState(
+                               PersistentState::kTxHistoryBinary) == "true";
+        mTxHistoryBinaryLoaded = true;
+    }
+    return mTxHistoryBinary;
+}
+
+// mmap_size of the main SQLite session while durability is relaxed
+static int64_t const RELAXED_SQLITE_MMAP_SIZE = int64_t(1) << 30;
+
+void
+Database::setRelaxedDurability(bool relaxed)
+{
+    if (relaxed == hasRelaxedDurability())
+    {
+        return;
+    }
+
+    if (relaxed)
+    {
+        CLOG(INFO, "Database") << "Relaxing durability until caught up";
+        if (isSqlite())
+        {
+            // as they are if the pragmas return nothing
+            std::string synchronous = "FULL", mmapSize = "0";
+            mSession << "PRAGMA synchronous", soci::into(synchronous);
+            mSession << "PRAGMA mmap_size", soci::into(mmapSize);
+            mStrictDurability = {synchronous, mmapSize};
+            mSession << "PRAGMA synchronous = OFF";
+            mSession << "PRAGMA mmap_size = " +
+                            std::to_string(RELAXED_SQLITE_MMAP_SIZE);
+        }
+        else
+        {
+            std::string synchronousCommit;
+            mSession << "SHOW synchronous_commit",
+                soci::into(synchronousCommit);
+            mStrictDurability = {synchronousCommit};
+            mSession << "SET synchronous_commit = off";
+        }
+        return;
+    }
+
+    CLOG(INFO, "Database") << "Restoring durability";
+    if (isSqlite())
+    {
+        mSession << "PRAGMA synchronous = " + mStrictDurability[0];
+        mSession << "PRAGMA mmap_size = " + mStrictDurability[1];
+        // copies the WAL into the database file, syncing both
+        mSession << "PRAGMA wal_checkpoint(TRUNCATE)";
+    }
+    else
+    {
+        mSession << "SET synchronous_commit = " + mStrictDurability[0];
+        // a transaction with an id commits synchronously, which flushes the
+        // WAL up to it, including the asynchronous commits before it
+        soci::transaction tx(mSession);
+        mSession << "SELECT txid_current()";
+        tx.commit();
+    }
+    mStrictDurability.clear();
+}
+
+bool
+Database::hasRelaxedDurability() const
+{
+    return !mStrictDurability.empty();
+}
+
 bool
 Database::canUsePool() const
 {
@@ -291,12 +414,58 @@ Database::clearPreparedStatementCache()
     // and will conflict with any DROP TABLE commands issued below
     for (auto st : mStatements)
     {
-        st.second->clean_up(true);
+        st.second.mStatement->clean_up(true);
     }
     mStatements.clear();
     mStatementsSize.set_count(mStatements.size());
 }
 
+void
+Database::trimPreparedStatementCache()
+{
+    std::vector<uint64_t> uses;
+    uses.reserve(mStatements.size());
+    for (auto& st : mStatements)
+    {
+        uses.emplace_back(st.second.mUses);
+    }
+    if (uses.size() > PREPARED_STATEMENT_CACHE_SIZE)
+    {
+        // statements used less than the most used ones go, ties included
+        auto nth = uses.begin() + PREPARED_STATEMENT_CACHE_SIZE - 1;
+        std::nth_element(uses.begin(), nth, uses.end(),
+                         std::greater<uint64_t>());
+        auto minUses = *nth;
+        size_t kept = 0;
+        for (auto it = mStatements.begin(); it != mStatements.end();)
+        {
+            if (it->second.mUses < minUses ||
+                (it->second.mUses == minUses &&
+                 kept >= PREPARED_STATEMENT_CACHE_SIZE))
+            {
+                it->second.mStatement->clean_up(true);
+                it = mStatements.erase(it);
+            }
+            else
+            {
+                ++kept;
+                ++it;
+            }
+        }
+    }
+    for (auto& st : mStatements)
+    {
+        st.second.mUses /= 2;
+    }
+    mStatementsSize.set_count(mStatements.size());
+}
+
+std::string
+Database::getStatementID(std::string const& query)
+{
+    return hexAbbrev(sha256(query));
+}
+
 void
 Database::initialize()
 {
@@ -306,6 +475,10 @@ Database::initialize()
 
     // only time this section should be modified is when
     // consolidating changes found in applySchemaUpgrade here
+    mTxHistoryBinary =
+        !isSqlite() && mApp.getConfig().TX_HISTORY_BINARY_COLUMNS;
+    mTxHistoryBinaryLoaded = true;
+
     AccountFrame::dropAll(*this);
     OfferFrame::dropAll(*this);
     TrustFrame::dropAll(*this);
@@ -316,6 +489,9 @@ Database::initialize()
     TransactionFrame::dropAll(*this);
     HistoryManager::dropAll(*this);
     BucketManager::dropAll(mApp);
+    SCPHistoryFileStore::dropAll(mApp);
+    mApp.getPersistentState().setState(PersistentState::kTxHistoryBinary,
+                                       mTxHistoryBinary ? "true" : "false");
     putSchemaVersion(1);
 }
 
@@ -327,6 +503,30 @@ Database::getSession()
     return mSession;
 }
 
+std::unique_ptr<soci::connection_pool>
+Database::makePool(std::string const& connectionString)
+{
+    size_t n = mApp.getWorkerThreadCount();
+    LOG(INFO) << "Establishing " << n << "-entry connection pool to: "
+              << removePasswordFromConnectionString(connectionString);
+    auto pool = std::make_unique<soci::connection_pool>(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        LOG(DEBUG) << "Opening pool entry " << i;
+        soci::session& sess = pool->at(i);
+        sess.open(connectionString);
+        if (connectionString.find("sqlite3:") == std::string::npos)
+        {
+            setSerializable(sess);
+        }
+        else
+        {
+            sess << "PRAGMA recursive_triggers = ON";
+        }
+    }
+    return pool;
+}
+
 soci::connection_pool&
 Database::getPool()
 {
@@ -339,86 +539,137 @@ Database::getPool()
             s += removePasswordFromConnectionString(c.value);
             throw std::runtime_error(s);
         }
-        size_t n = std::thread::hardware_concurrency();
-        LOG(INFO) << "Establishing " << n << "-entry connection pool to: "
-                  << removePasswordFromConnectionString(c.value);
-        mPool = std::make_unique<soci::connection_pool>(n);
-        for (size_t i = 0; i < n; ++i)
-        {
-            LOG(DEBUG) << "Opening pool entry " << i;
-            soci::session& sess = mPool->at(i);
-            sess.open(c.value);
-            if (!isSqlite())
-            {
-                setSerializable(sess);
-            }
-        }
+        mPool = makePool(c.value);
     }
     assert(mPool);
     return *mPool;
 }
 
-cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>&
+std::unique_ptr<soci::session>
+Database::getQuerySession()
+{
+    auto const& replica = mApp.getConfig().DATABASE_READ_REPLICA.value;
+    if (!replica.empty())
+    {
+        if (!mReplicaPool)
+        {
+            mReplicaPool = makePool(replica);
+        }
+        return std::make_unique<soci::session>(*mReplicaPool);
+    }
+    if (canUsePool())
+    {
+        return std::make_unique<soci::session>(getPool());
+    }
+    return nullptr;
+}
+
+EntryCache&
 Database::getEntryCache()
 {
     return mEntryCache;
 }
 
-class SQLLogContext : NonCopyable
+OrderBook&
+Database::getOrderBook()
 {
-    std::string mName;
-    soci::session& mSess;
-    std::ostringstream mCapture;
+    return mOrderBook;
+}
 
-  public:
-    SQLLogContext(std::string const& name, soci::session& sess)
-        : mName(name), mSess(sess)
+LedgerHeaderCache&
+Database::getLedgerHeaderCache()
+{
+    return mLedgerHeaderCache;
+}
+
+PeerTable&
+Database::getPeerTable()
+{
+    return *mPeerTable;
+}
+
+SQLLogContext::SQLLogContext(std::string const& name, soci::session& sess,
+                             bool log)
+    : mName(name), mSess(sess), mPrevious(sess.get_log_stream()), mLog(log)
+{
+    mSess.set_log_stream(&mCapture);
+}
+
+SQLLogContext::~SQLLogContext()
+{
+    mSess.set_log_stream(mPrevious);
+    if (!mLog)
     {
-        mSess.set_log_stream(&mCapture);
+        return;
     }
-    ~SQLLogContext()
+    std::string captured = mCapture.str();
+    std::istringstream rd(captured);
+    std::string buf;
+    CLOG(INFO, "Database") << "";
+    CLOG(INFO, "Database") << "";
+    CLOG(INFO, "Database") << "[SQL] -----------------------";
+    CLOG(INFO, "Database") << "[SQL] begin capture: " << mName;
+    CLOG(INFO, "Database") << "[SQL] -----------------------";
+    while (std::getline(rd, buf))
     {
-        mSess.set_log_stream(nullptr);
-        std::string captured = mCapture.str();
-        std::istringstream rd(captured);
-        std::string buf;
-        CLOG(INFO, "Database") << "";
-        CLOG(INFO, "Database") << "";
-        CLOG(INFO, "Database") << "[SQL] -----------------------";
-        CLOG(INFO, "Database") << "[SQL] begin capture: " << mName;
-        CLOG(INFO, "Database") << "[SQL] -----------------------";
-        while (std::getline(rd, buf))
+        CLOG(INFO, "Database") << "[SQL:" << mName << "] " << buf;
+        buf.clear();
+    }
+    CLOG(INFO, "Database") << "[SQL] -----------------------";
+    CLOG(INFO, "Database") << "[SQL] end capture: " << mName;
+    CLOG(INFO, "Database") << "[SQL] -----------------------";
+    CLOG(INFO, "Database") << "";
+    CLOG(INFO, "Database") << "";
+}
+
+std::map<std::string, size_t>
+SQLLogContext::getStatementCounts() const
+{
+    std::map<std::string, size_t> res;
+    std::istringstream rd(mCapture.str());
+    std::string buf;
+    while (std::getline(rd, buf))
+    {
+        if (!buf.empty())
         {
-            CLOG(INFO, "Database") << "[SQL:" << mName << "] " << buf;
-            buf.clear();
+            res[buf]++;
         }
-        CLOG(INFO, "Database") << "[SQL] -----------------------";
-        CLOG(INFO, "Database") << "[SQL] end capture: " << mName;
-        CLOG(INFO, "Database") << "[SQL] -----------------------";
-        CLOG(INFO, "Database") << "";
-        CLOG(INFO, "Database") << "";
     }
-};
+    return res;
+}
 
 StatementContext
 Database::getPreparedStatement(std::string const& query)
 {
     auto i = mStatements.find(query);
-    std::shared_ptr<soci::statement> p;
     if (i == mStatements.end())
     {
-        p = std::make_shared<soci::statement>(mSession);
+        auto p = std::make_shared<soci::statement>(mSession);
         p->alloc();
         p->prepare(query);
-        mStatements.insert(std::make_pair(query, p));
+        auto id = getStatementID(query);
+        CLOG(DEBUG, "Database") << "Prepared statement " << id << ": "
+                                << query;
+        auto& timer = mApp.getMetrics().NewTimer({"database", "statement", id});
+        i = mStatements.emplace(query, PreparedStatement{p, timer, 0}).first;
         mStatementsSize.set_count(mStatements.size());
     }
-    else
+    ++i->second.mUses;
+    StatementContext sc(i->second.mStatement, &i->second.mTimer);
+    return sc;
+}
+
+StatementContext::~StatementContext()
+{
+    if (mStmt)
     {
-        p = i->second;
+        mStmt->clean_up(false);
+    }
+    if (mTimer)
+    {
+        mTimer->Update(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - mStart));
     }
-    StatementContext sc(p);
-    return sc;
 }
 
 std::shared_ptr<SQLLogContext>
@@ -427,12 +678,48 @@ Database::captureAndLogSQL(std::string contextName)
     return make_shared<SQLLogContext>(contextName, mSession);
 }
 
+std::shared_ptr<SQLLogContext>
+Database::captureSQL(std::string contextName)
+{
+    return make_shared<SQLLogContext>(contextName, mSession, false);
+}
+
 medida::Meter&
 Database::getQueryMeter()
 {
     return mQueryMeter;
 }
 
+uint64_t
+Database::getReadQueryCount() const
+{
+    return mReadQueries;
+}
+
+uint64_t
+Database::getWriteQueryCount() const
+{
+    return mWriteQueries;
+}
+
+std::map<std::string, uint64_t>
+Database::getQueryCounts() const
+{
+    std::map<std::string, uint64_t> res;
+    for (auto const& q : {"insert", "delete", "select", "update"})
+    {
+        for (auto const& e : mEntityTypes)
+        {
+            auto& timer = mApp.getMetrics().NewTimer({"database", q, e});
+            if (timer.count() != 0)
+            {
+                res[std::string(q) + " " + e] = timer.count();
+            }
+        }
+    }
+    return res;
+}
+
 std::chrono::nanoseconds
 Database::totalQueryTime() const
 {
@@ -4,13 +4,19 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "database/EntryCache.h"
+#include "ledger/LedgerHeaderCache.h"
+#include "ledger/OrderBook.h"
 #include "medida/timer_context.h"
 #include "overlay/StellarXDR.h"
+#include "util/LatencyHistogram.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
-#include "util/lrucache.hpp"
+#include <chrono>
+#include <map>
 #include <set>
 #include <soci.h>
+#include <sstream>
 #include <string>
 
 namespace medida
@@ -23,34 +29,60 @@ class Counter;
 namespace stellar
 {
 class Application;
-class SQLLogContext;
+class PeerTable;
+
+/**
+ * Helper class capturing all SQL statements made on a session while it is
+ * alive. Returned by Database::captureAndLogSQL, which logs the statements
+ * when the context is destroyed, and by Database::captureSQL, which only
+ * keeps them for getStatementCounts.
+ */
+class SQLLogContext : NonCopyable
+{
+    std::string mName;
+    soci::session& mSess;
+    std::ostream* mPrevious;
+    std::ostringstream mCapture;
+    bool mLog;
+
+  public:
+    SQLLogContext(std::string const& name, soci::session& sess,
+                  bool log = true);
+    ~SQLLogContext();
+
+    // Number of times each distinct statement was captured so far. soci
+    // logs a prepared statement when it is prepared rather than on each
+    // execution, see Database::getQueryCounts for those.
+    std::map<std::string, size_t> getStatementCounts() const;
+};
 
 /**
  * Helper class for borrowing a SOCI prepared statement handle into a local
  * scope and cleaning it up once done with it. Returned by
- * Database::getPreparedStatement below.
+ * Database::getPreparedStatement below. The time the statement is borrowed
+ * for is recorded in the statement's timer, if any.
  */
 class StatementContext : NonCopyable
 {
     std::shared_ptr<soci::statement> mStmt;
+    medida::Timer* mTimer;
+    std::chrono::steady_clock::time_point mStart;
 
   public:
-    StatementContext(std::shared_ptr<soci::statement> stmt) : mStmt(stmt)
+    StatementContext(std::shared_ptr<soci::statement> stmt,
+                     medida::Timer* timer = nullptr)
+        : mStmt(stmt), mTimer(timer), mStart(std::chrono::steady_clock::now())
     {
         mStmt->clean_up(false);
     }
     StatementContext(StatementContext&& other)
+        : mTimer(other.mTimer), mStart(other.mStart)
     {
         mStmt = other.mStmt;
         other.mStmt.reset();
+        other.mTimer = nullptr;
     }
-    ~StatementContext()
-    {
-        if (mStmt)
-        {
-            mStmt->clean_up(false);
-        }
-    }
+    ~StatementContext();
     soci::statement&
     statement()
     {
@@ -78,6 +110,11 @@ class StatementContext : NonCopyable
  * pool will connect to the same target and only one connection will be made per
  * worker thread.
  *
+ * Read-only queries that are not part of consensus (HTTP commands) use a query
+ * pool instead of the main connection: the pool above, or one connected to
+ * Config::DATABASE_READ_REPLICA when set, in which case their results may lag
+ * behind the main connection's.
+ *
  * All database connections and transactions are set to snapshot isolation level
  * (SQL isolation level 'SERIALIZABLE' in Postgresql and Sqlite, neither of
  * which provide true serializability).
@@ -88,39 +125,71 @@ class Database : NonMovableOrCopyable
     medida::Meter& mQueryMeter;
     soci::session mSession;
     std::unique_ptr<soci::connection_pool> mPool;
+    std::unique_ptr<soci::connection_pool> mReplicaPool;
 
-    std::map<std::string, std::shared_ptr<soci::statement>> mStatements;
+    struct PreparedStatement
+    {
+        std::shared_ptr<soci::statement> mStatement;
+        medida::Timer& mTimer;
+        // uses since the statement was prepared, halved by each
+        // trimPreparedStatementCache so that recent uses weigh more
+        uint64_t mUses;
+    };
+    std::map<std::string, PreparedStatement> mStatements;
     medida::Counter& mStatementsSize;
 
-    cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
-        mEntryCache;
+    EntryCache mEntryCache;
+    OrderBook mOrderBook;
+    LedgerHeaderCache mLedgerHeaderCache;
+    std::unique_ptr<PeerTable> mPeerTable;
 
     // Helpers for maintaining the total query time and calculating
     // idle percentage.
     std::set<std::string> mEntityTypes;
+    uint64_t mReadQueries{0};
+    uint64_t mWriteQueries{0};
     std::chrono::nanoseconds mExcludedQueryTime;
     std::chrono::nanoseconds mExcludedTotalTime;
     std::chrono::nanoseconds mLastIdleQueryTime;
     VirtualClock::time_point mLastIdleTotalTime;
 
+    // layout of txhistory and txfeehistory, see isTxHistoryBinary
+    bool mTxHistoryBinary{false};
+    bool mTxHistoryBinaryLoaded{false};
+
+    // see setRelaxedDurability: the settings it overrode, empty if none
+    std::vector<std::string> mStrictDurability;
+
     static bool gDriversRegistered;
     static void registerDrivers();
+    std::unique_ptr<soci::connection_pool>
+    makePool(std::string const& connectionString);
     void applySchemaUpgrade(unsigned long vers);
 
   public:
     // Instantiate object and connect to app.getConfig().DATABASE;
     // if there is a connection error, this will throw.
     Database(Application& app);
+    ~Database();
 
     // Return a crude meter of total queries to the db, for use in
     // overlay/LoadManager.
     medida::Meter& getQueryMeter();
 
+    // Numbers of reading (select) and writing (insert, update, delete)
+    // queries timed since app startup.
+    uint64_t getReadQueryCount() const;
+    uint64_t getWriteQueryCount() const;
+
     // Number of nanoseconds spent processing queries since app startup,
     // without any reference to excluded time or running counters.
     // Strictly a sum of measured time.
     std::chrono::nanoseconds totalQueryTime() const;
 
+    // Number of queries run since app startup, by kind and entity type
+    // (eg. "select account"), as counted by the per-query timers below.
+    std::map<std::string, uint64_t> getQueryCounts() const;
+
     // Subtract a number of nanoseconds from the running time counts,
     // due to database usage spikes, specifically during ledger-close.
     void excludeTime(std::chrono::nanoseconds const& queryTime,
@@ -136,23 +205,44 @@ class Database : NonMovableOrCopyable
     // to the process' log for diagnostics. For testing and perf tuning.
     std::shared_ptr<SQLLogContext> captureAndLogSQL(std::string contextName);
 
+    // Same, without the logging: statements are only counted.
+    std::shared_ptr<SQLLogContext> captureSQL(std::string contextName);
+
+    // Number of prepared statements kept by trimPreparedStatementCache.
+    static size_t const PREPARED_STATEMENT_CACHE_SIZE = 128;
+
     // Return a helper object that borrows, from the Database, a prepared
     // statement handle for the provided query. The prepared statement handle
     // is ceated if necessary before borrowing, and reset (unbound from data)
     // when the statement context is destroyed.
+    //
+    // Each distinct query has its own timer, {"database", "statement", id}
+    // where id abbreviates the hash of the query (logged with the query when
+    // first prepared), counting its executions and how long they take.
     StatementContext getPreparedStatement(std::string const& query);
 
     // Purge all cached prepared statements, closing their handles with the
     // database.
     void clearPreparedStatementCache();
 
+    // Purge the least used cached prepared statements, keeping at most
+    // PREPARED_STATEMENT_CACHE_SIZE of them.
+    void trimPreparedStatementCache();
+
+    // Id of the timer of `query`, see getPreparedStatement.
+    static std::string getStatementID(std::string const& query);
+
     // Return metric-gathering timers for various families of SQL operation.
     // These timers automatically count the time they are alive for,
     // so only acquire them immediately before executing an SQL statement.
-    medida::TimerContext getInsertTimer(std::string const& entityName);
-    medida::TimerContext getSelectTimer(std::string const& entityName);
-    medida::TimerContext getDeleteTimer(std::string const& entityName);
-    medida::TimerContext getUpdateTimer(std::string const& entityName);
+    HistogramTimerContext getInsertTimer(std::string const& entityName);
+    HistogramTimerContext getSelectTimer(std::string const& entityName);
+    HistogramTimerContext getDeleteTimer(std::string const& entityName);
+    HistogramTimerContext getUpdateTimer(std::string const& entityName);
+
+    // Marks an update that was not issued because the stored entry was
+    // already up to date.
+    void markAvoidedUpdate(std::string const& entityName);
 
     // If possible (i.e. "on postgres") issue an SQL pragma that marks
     // the current transaction as read-only. The effects of this last
@@ -162,6 +252,21 @@ class Database : NonMovableOrCopyable
     // Return true if the Database target is SQLite, otherwise false.
     bool isSqlite() const;
 
+    // Trades durability for throughput while catching up (see
+    // Config::CATCHUP_RELAXED_DURABILITY): commits of the main session stop
+    // waiting for the WAL to reach the disk (synchronous_commit = off on
+    // postgres; synchronous = OFF and memory-mapped reads on SQLite).
+    // Setting it back to false restores the previous settings and makes
+    // sure what was committed meanwhile is on disk.
+    void setRelaxedDurability(bool relaxed);
+    bool hasRelaxedDurability() const;
+
+    // Return true if txhistory and txfeehistory hold raw XDR in BYTEA
+    // columns (see Config::TX_HISTORY_BINARY_COLUMNS), false if they hold it
+    // in base64 in TEXT columns. Decided by initialize, as recorded in the
+    // storestate table.
+    bool isTxHistoryBinary();
+
     // Return true if a connection pool is available for worker threads
     // to read from the database through, otherwise false.
     bool canUsePool() const;
@@ -189,12 +294,24 @@ class Database : NonMovableOrCopyable
     // threads. Throws an error if !canUsePool().
     soci::connection_pool& getPool();
 
+    // Return a session for read-only queries that are not part of consensus,
+    // from the query pool, or nullptr when there is none (the main session
+    // should be used then).
+    std::unique_ptr<soci::session> getQuerySession();
+
     // Access the LedgerEntry cache. Note: clients are responsible for
     // invalidating entries in this cache as they perform statements
     // against the database. It's kept here only for ease of access.
-    typedef cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
-        EntryCache;
     EntryCache& getEntryCache();
+
+    // Access the cache of order books, maintained the same way.
+    OrderBook& getOrderBook();
+
+    // Access the cache of ledger headers, see LedgerHeaderFrame.
+    LedgerHeaderCache& getLedgerHeaderCache();
+
+    // Access the in-memory copy of the peers table, see PeerRecord.
+    PeerTable& getPeerTable();
 };
 
 class DBTimeExcluder : NonCopyable
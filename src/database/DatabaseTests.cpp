@@ -4,18 +4,30 @@
 
 #include "util/asio.h"
 #include "crypto/Hex.h"
+#include "crypto/KeyUtils.h"
 #include "database/Database.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerManager.h"
+#include "ledger/LedgerTestUtils.h"
+#include "ledger/OfferFrame.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/TestAccount.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
+#include <chrono>
 #include <random>
 
 using namespace stellar;
+using namespace stellar::txtest;
 
 void
 transactionTest(Application::pointer app)
@@ -337,3 +349,369 @@ TEST_CASE("schema test", "[db]")
     auto av = db.getAppSchemaVersion();
     REQUIRE(dbv == av);
 }
+
+TEST_CASE("transaction history columns", "[db]")
+{
+    auto runtest = [](Config::TestDbMode mode, bool binary) {
+        Config cfg = getTestConfig(0, mode);
+        cfg.TX_HISTORY_BINARY_COLUMNS = true;
+        VirtualClock clock;
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        REQUIRE(app->getDatabase().isTxHistoryBinary() == binary);
+
+        auto& lm = app->getLedgerManager();
+        auto root = TestAccount::createRoot(*app);
+        auto sn = root.getLastSequenceNumber();
+        auto balance = lm.getMinBalance(0);
+        std::vector<TransactionFramePtr> txs = {
+            root.tx({createAccount(getAccount("a").getPublicKey(), balance)},
+                    sn + 1),
+            root.tx({createAccount(getAccount("b").getPublicKey(), balance)},
+                    sn + 2)};
+
+        // both rows of each transaction are written, and read back, at once
+        auto res = closeLedgerOn(*app, lm.getLedgerNum(), 1, 1, 2017, txs);
+        REQUIRE(res.size() == 2);
+        for (size_t i = 0; i < res.size(); ++i)
+        {
+            REQUIRE(res[i].first.transactionHash ==
+                    txs[i]->getContentsHash());
+            REQUIRE(res[i].first.result.result.code() == txSUCCESS);
+            REQUIRE(!res[i].second.empty());
+        }
+    };
+
+    SECTION("sqlite")
+    {
+        // binary columns are only used on postgres
+        runtest(Config::TESTDB_IN_MEMORY_SQLITE, false);
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgresql")
+    {
+        runtest(Config::TESTDB_POSTGRESQL, true);
+    }
+#endif
+}
+
+TEST_CASE("transaction meta disabled", "[db]")
+{
+    auto closeWith = [](bool disableMeta) {
+        Config cfg = getTestConfig();
+        cfg.DISABLE_TX_META = disableMeta;
+        VirtualClock clock;
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+
+        auto& lm = app->getLedgerManager();
+        auto root = TestAccount::createRoot(*app);
+        auto sn = root.getLastSequenceNumber();
+        auto balance = lm.getMinBalance(0);
+        std::vector<TransactionFramePtr> txs = {
+            root.tx({createAccount(getAccount("a").getPublicKey(), balance)},
+                    sn + 1)};
+        auto res = closeLedgerOn(*app, lm.getLedgerNum(), 1, 1, 2017, txs);
+        REQUIRE(res.size() == 1);
+        REQUIRE(res[0].first.result.result.code() == txSUCCESS);
+        REQUIRE(res[0].second.empty() == disableMeta);
+        return lm.getLastClosedLedgerHeader().hash;
+    };
+
+    // the results, and so the ledger, do not depend on it
+    REQUIRE(closeWith(true) == closeWith(false));
+}
+
+TEST_CASE("query sessions", "[db]")
+{
+    SECTION("none for in-memory databases")
+    {
+        Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+        VirtualClock clock;
+        Application::pointer app = createTestApplication(clock, cfg);
+        REQUIRE(!app->getDatabase().getQuerySession());
+    }
+
+    SECTION("read from the replica")
+    {
+        Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+        cfg.DATABASE_READ_REPLICA = cfg.DATABASE;
+        VirtualClock clock;
+        Application::pointer app = createTestApplication(clock, cfg);
+        auto& db = app->getDatabase();
+        db.getSession() << "INSERT INTO ban (nodeid) VALUES ('GA')";
+
+        auto sess = db.getQuerySession();
+        REQUIRE(sess);
+        std::string nodeID;
+        *sess << "SELECT nodeid FROM ban", soci::into(nodeID);
+        REQUIRE(nodeID == "GA");
+    }
+}
+
+TEST_CASE("prepared statement cache", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& db = app->getDatabase();
+    db.clearPreparedStatementCache();
+
+    auto run = [&](int i) {
+        int res = 0;
+        auto prep = db.getPreparedStatement("SELECT " + std::to_string(i));
+        auto& st = prep.statement();
+        st.exchange(soci::into(res));
+        st.define_and_bind();
+        st.execute(true);
+        REQUIRE(res == i);
+    };
+    auto const n = static_cast<int>(Database::PREPARED_STATEMENT_CACHE_SIZE);
+    // the first n statements are used more than the last 10
+    for (int i = 0; i < n + 10; ++i)
+    {
+        run(i);
+        if (i < n)
+        {
+            run(i);
+        }
+    }
+
+    auto& statements =
+        app->getMetrics().NewCounter({"database", "memory", "statements"});
+    REQUIRE(statements.count() == n + 10);
+    db.trimPreparedStatementCache();
+    REQUIRE(statements.count() == n);
+
+    auto& timer = app->getMetrics().NewTimer(
+        {"database", "statement", Database::getStatementID("SELECT 0")});
+    REQUIRE(timer.count() == 2);
+
+    // kept, then evicted and prepared again
+    run(0);
+    REQUIRE(statements.count() == n);
+    run(n);
+    REQUIRE(statements.count() == n + 1);
+}
+
+TEST_CASE("best offers read from index", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& session = app->getDatabase().getSession();
+
+    // same shape as the query of OfferFrame::loadBestOffers
+    auto plan = [&](std::string const& where) {
+        std::string sql = "EXPLAIN QUERY PLAN SELECT offerid FROM offers "
+                          "WHERE " +
+                          where + " ORDER BY price, offerid LIMIT 5 OFFSET 0";
+        soci::rowset<soci::row> rs = (session.prepare << sql);
+        std::string res;
+        for (auto const& r : rs)
+        {
+            // the last column is the description of the step
+            res += r.get<std::string>(r.size() - 1) + "\n";
+        }
+        return res;
+    };
+
+    auto check = [&](std::string const& where) {
+        auto p = plan(where);
+        INFO(p);
+        REQUIRE(p.find("bestofferindex") != std::string::npos);
+        // rows come out of the index in order
+        REQUIRE(p.find("TEMP B-TREE") == std::string::npos);
+    };
+
+    check("sellingassettype = 0 AND sellingissuer IS NULL AND "
+          "sellingassetcode IS NULL AND buyingissuer = 'GA' AND "
+          "buyingassetcode = 'USD'");
+    check("sellingissuer = 'GA' AND sellingassetcode = 'USD' AND "
+          "buyingassettype = 0 AND buyingissuer IS NULL AND "
+          "buyingassetcode IS NULL");
+    check("sellingissuer = 'GA' AND sellingassetcode = 'USD' AND "
+          "buyingissuer = 'GB' AND buyingassetcode = 'EUR'");
+}
+
+TEST_CASE("secondary indexes dropped and built again", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+    auto count = [&](std::string const& type, std::string const& name) {
+        int n = 0;
+        session << "SELECT COUNT(*) FROM sqlite_master WHERE type = :t AND "
+                   "name = :n",
+            soci::into(n), soci::use(type), soci::use(name);
+        return n;
+    };
+    std::vector<std::string> indexes{
+        "signersaccount",    "accountbalances", "sellingissuerindex",
+        "buyingissuerindex", "priceindex",      "bestofferindex",
+        "inflationvotesbyvotes"};
+
+    EntryFrame::dropSecondaryIndexes(db);
+    for (auto const& name : indexes)
+    {
+        REQUIRE(count("index", name) == 0);
+    }
+    REQUIRE(count("table", "inflationvotes") == 0);
+    REQUIRE(count("trigger", "inflationvotesinsert") == 0);
+
+    // written without the tallies
+    auto dest = SecretKey::random().getPublicKey();
+    std::vector<LedgerEntry> accounts(2);
+    for (auto& e : accounts)
+    {
+        e.data.type(ACCOUNT);
+        auto& a = e.data.account();
+        a = LedgerTestUtils::generateValidAccountEntry();
+        a.balance = 2000000000;
+        a.inflationDest.activate() = dest;
+    }
+    EntryFrame::storeAddOrChangeBulk(db, accounts);
+
+    std::vector<std::string> built;
+    EntryFrame::createSecondaryIndexes(
+        db, [&](std::string const& name) { built.emplace_back(name); });
+    REQUIRE(built.size() == indexes.size());
+    for (auto const& name : indexes)
+    {
+        REQUIRE(count("index", name) == 1);
+    }
+    REQUIRE(count("trigger", "inflationvotesinsert") == 1);
+
+    std::string destStr = KeyUtils::toStrKey(dest);
+    int64_t votes = 0;
+    session << "SELECT votes FROM inflationvotes WHERE inflationdest = :d",
+        soci::into(votes), soci::use(destStr);
+    REQUIRE(votes == 4000000000);
+
+    // building again leaves them as they are
+    EntryFrame::createSecondaryIndexes(db, [](std::string const&) {});
+    REQUIRE(count("index", "priceindex") == 1);
+}
+
+TEST_CASE("relaxed durability", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+    auto synchronous = [&]() {
+        int n = -1;
+        session << "PRAGMA synchronous", soci::into(n);
+        return n;
+    };
+    int strict = synchronous();
+    REQUIRE(strict != 0);
+    REQUIRE(!db.hasRelaxedDurability());
+
+    db.setRelaxedDurability(true);
+    REQUIRE(db.hasRelaxedDurability());
+    REQUIRE(synchronous() == 0);
+    // relaxing again keeps what is to be restored
+    db.setRelaxedDurability(true);
+
+    db.setRelaxedDurability(false);
+    REQUIRE(!db.hasRelaxedDurability());
+    REQUIRE(synchronous() == strict);
+    db.setRelaxedDurability(false);
+    REQUIRE(synchronous() == strict);
+}
+
+TEST_CASE("best offers performance", "[db][bench][!hide]")
+{
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    // every lookup goes to the database
+    cfg.ORDER_BOOK_CACHE_SIZE = 0;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+
+    // roughly the size of the public network's offers table, over a few
+    // hundred pairs
+    size_t const nbOffers = 100000;
+    size_t const nbAssets = 20;
+    std::vector<Asset> assets(1);
+    while (assets.size() < nbAssets)
+    {
+        auto a = LedgerTestUtils::generateValidOfferEntry().selling;
+        if (a.type() != ASSET_TYPE_NATIVE)
+        {
+            assets.emplace_back(a);
+        }
+    }
+
+    std::default_random_engine gen;
+    std::uniform_int_distribution<size_t> assetDist(0, nbAssets - 1);
+    std::uniform_int_distribution<int32_t> priceDist(1, 1000000);
+    {
+        soci::transaction sqltx(db.getSession());
+        std::vector<LedgerEntry> entries;
+        for (size_t i = 0; i < nbOffers; ++i)
+        {
+            LedgerEntry e;
+            e.data.type(OFFER);
+            auto& o = e.data.offer();
+            o = LedgerTestUtils::generateValidOfferEntry();
+            o.offerID = i + 1;
+            auto s = assetDist(gen);
+            o.selling = assets[s];
+            o.buying = assets[(s + 1 + assetDist(gen) % (nbAssets - 1)) %
+                              nbAssets];
+            o.price.n = priceDist(gen);
+            o.price.d = priceDist(gen);
+            entries.emplace_back(e);
+            if (entries.size() == 1000)
+            {
+                EntryFrame::storeAddOrChangeBulk(db, entries);
+                entries.clear();
+            }
+        }
+        EntryFrame::storeAddOrChangeBulk(db, entries);
+        sqltx.commit();
+    }
+
+    auto timeLookups = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nbAssets; ++i)
+        {
+            for (size_t j = 0; j < nbAssets; ++j)
+            {
+                if (i != j)
+                {
+                    std::vector<OfferFrame::pointer> offers;
+                    OfferFrame::loadBestOffers(5, 0, assets[i], assets[j],
+                                               offers, db);
+                }
+            }
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    };
+
+    LOG(INFO) << "best offers of " << nbAssets * (nbAssets - 1)
+              << " pairs out of " << nbOffers << " offers";
+    LOG(INFO) << "with bestofferindex: " << timeLookups() << "us";
+    db.getSession() << "DROP INDEX bestofferindex";
+    db.clearPreparedStatementCache();
+    LOG(INFO) << "without bestofferindex: " << timeLookups() << "us";
+}
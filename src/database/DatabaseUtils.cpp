@@ -3,12 +3,14 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "DatabaseUtils.h"
+#include <algorithm>
+#include <cassert>
 
 namespace stellar
 {
 namespace DatabaseUtils
 {
-void
+uint32_t
 deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq, uint32_t count,
                        std::string const& tableName,
                        std::string const& ledgerSeqColumn)
@@ -28,7 +30,282 @@ deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq, uint32_t count,
         uint64 m = static_cast<uint32>(m64);
         sess << "DELETE FROM " << tableName << " WHERE " << ledgerSeqColumn
              << " <= " << m;
+        return static_cast<uint32_t>(m);
+    }
+    return ledgerSeq;
+}
+
+BulkColumn::BulkColumn(std::string const& name, std::string const& sqlType)
+    : mName(name), mSqlType(sqlType)
+{
+}
+
+void
+BulkColumn::push(std::string const& value)
+{
+    mValues.emplace_back(value);
+    mInds.emplace_back(soci::i_ok);
+}
+
+void
+BulkColumn::pushNull()
+{
+    mValues.emplace_back();
+    mInds.emplace_back(soci::i_null);
+}
+
+size_t
+BulkColumn::size() const
+{
+    return mValues.size();
+}
+
+std::string
+marshalToPGArray(BulkColumn const& column)
+{
+    std::string res = "{";
+    for (size_t i = 0; i < column.size(); ++i)
+    {
+        if (i != 0)
+        {
+            res += ',';
+        }
+        if (column.mInds[i] == soci::i_null)
+        {
+            res += "NULL";
+            continue;
+        }
+        res += '"';
+        for (char c : column.mValues[i])
+        {
+            if (c == '"' || c == '\\')
+            {
+                res += '\\';
+            }
+            res += c;
+        }
+        res += '"';
+    }
+    res += '}';
+    return res;
+}
+
+static std::string
+columnList(std::vector<BulkColumn> const& columns)
+{
+    std::string res;
+    for (auto const& c : columns)
+    {
+        if (!res.empty())
+        {
+            res += ", ";
+        }
+        res += c.mName;
+    }
+    return res;
+}
+
+static std::string
+unnestList(std::vector<BulkColumn> const& columns)
+{
+    std::string res = "unnest(";
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        if (i != 0)
+        {
+            res += ", ";
+        }
+        res += "CAST(:v" + std::to_string(i) + " AS " + columns[i].mSqlType +
+               "[])";
+    }
+    res += ")";
+    return res;
+}
+
+static size_t
+checkColumns(std::vector<BulkColumn> const& columns)
+{
+    assert(!columns.empty());
+    size_t n = columns.front().size();
+    for (auto const& c : columns)
+    {
+        if (c.size() != n)
+        {
+            throw std::runtime_error("mismatched bulk column sizes");
+        }
     }
+    return n;
+}
+
+static void
+executeBulk(Database& db, std::string const& sql,
+            std::vector<BulkColumn>& columns)
+{
+    auto prep = db.getPreparedStatement(sql);
+    auto& st = prep.statement();
+    if (db.isSqlite())
+    {
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            st.exchange(soci::use(columns[i].mValues, columns[i].mInds,
+                                  "v" + std::to_string(i)));
+        }
+        st.define_and_bind();
+        st.execute(true);
+    }
+    else
+    {
+        std::vector<std::string> arrays;
+        arrays.reserve(columns.size());
+        for (auto const& c : columns)
+        {
+            arrays.emplace_back(marshalToPGArray(c));
+        }
+        for (size_t i = 0; i < arrays.size(); ++i)
+        {
+            st.exchange(soci::use(arrays[i], "v" + std::to_string(i)));
+        }
+        st.define_and_bind();
+        st.execute(true);
+    }
+}
+
+void
+bulkUpsert(Database& db, std::string const& entityName,
+           std::string const& tableName,
+           std::vector<std::string> const& keyColumns,
+           std::vector<BulkColumn>& columns)
+{
+    if (checkColumns(columns) == 0)
+    {
+        return;
+    }
+
+    std::string sql;
+    if (db.isSqlite())
+    {
+        sql = "INSERT OR REPLACE INTO " + tableName + " (" +
+              columnList(columns) + ") VALUES (";
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            sql += (i == 0 ? ":v" : ", :v") + std::to_string(i);
+        }
+        sql += ")";
+    }
+    else
+    {
+        std::string keys, updates;
+        for (auto const& k : keyColumns)
+        {
+            keys += (keys.empty() ? "" : ", ") + k;
+        }
+        for (auto const& c : columns)
+        {
+            if (std::find(keyColumns.begin(), keyColumns.end(), c.mName) ==
+                keyColumns.end())
+            {
+                updates += (updates.empty() ? "" : ", ") + c.mName +
+                           " = excluded." + c.mName;
+            }
+        }
+        sql = "INSERT INTO " + tableName + " (" + columnList(columns) +
+              ") SELECT * FROM " + unnestList(columns) + " ON CONFLICT (" +
+              keys + ") DO " +
+              (updates.empty() ? "NOTHING" : "UPDATE SET " + updates);
+    }
+
+    auto timer = db.getInsertTimer(entityName);
+    executeBulk(db, sql, columns);
+}
+
+void
+bulkInsert(Database& db, std::string const& entityName,
+           std::string const& tableName, std::vector<BulkColumn>& columns)
+{
+    if (checkColumns(columns) == 0)
+    {
+        return;
+    }
+
+    std::string sql =
+        "INSERT INTO " + tableName + " (" + columnList(columns) + ") ";
+    if (db.isSqlite())
+    {
+        sql += "VALUES (";
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            sql += (i == 0 ? ":v" : ", :v") + std::to_string(i);
+        }
+        sql += ")";
+    }
+    else
+    {
+        sql += "SELECT * FROM " + unnestList(columns);
+    }
+
+    auto timer = db.getInsertTimer(entityName);
+    executeBulk(db, sql, columns);
+}
+
+void
+bulkDelete(Database& db, std::string const& entityName,
+           std::string const& tableName, std::vector<BulkColumn>& keyColumns)
+{
+    if (checkColumns(keyColumns) == 0)
+    {
+        return;
+    }
+
+    std::string sql = "DELETE FROM " + tableName + " WHERE ";
+    if (db.isSqlite())
+    {
+        for (size_t i = 0; i < keyColumns.size(); ++i)
+        {
+            sql += (i == 0 ? "" : " AND ") + keyColumns[i].mName + " = :v" +
+                   std::to_string(i);
+        }
+    }
+    else
+    {
+        sql += "(" + columnList(keyColumns) + ") IN (SELECT * FROM " +
+               unnestList(keyColumns) + ")";
+    }
+
+    auto timer = db.getDeleteTimer(entityName);
+    executeBulk(db, sql, keyColumns);
+}
+std::string
+placeholderList(size_t n)
+{
+    std::string res = "(";
+    for (size_t i = 0; i < n; ++i)
+    {
+        res += (i == 0 ? ":p" : ", :p") + std::to_string(i);
+    }
+    res += ")";
+    return res;
+}
+
+std::shared_ptr<soci::statement>
+prepare(soci::session& sess, std::string const& query)
+{
+    auto st = std::make_shared<soci::statement>(sess);
+    st->alloc();
+    st->prepare(query);
+    return st;
+}
+
+std::vector<std::vector<std::string>>
+makeLoadBatches(std::vector<std::string> const& keys)
+{
+    std::vector<std::vector<std::string>> res;
+    for (size_t i = 0; i < keys.size(); i += BULK_LOAD_BATCH_SIZE)
+    {
+        auto end = std::min(keys.size(), i + BULK_LOAD_BATCH_SIZE);
+        res.emplace_back(keys.begin() + i, keys.begin() + end);
+        res.back().resize(BULK_LOAD_BATCH_SIZE, keys[end - 1]);
+    }
+    return res;
+}
 }
 }
-}
\ No newline at end of file
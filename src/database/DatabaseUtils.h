@@ -5,13 +5,74 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "Database.h"
+#include <string>
+#include <vector>
 
 namespace stellar
 {
 namespace DatabaseUtils
 {
-void deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
-                            uint32_t count, std::string const& tableName,
-                            std::string const& ledgerSeqColumn);
+// Deletes the rows of at most `count` ledgers up to `ledgerSeq`, starting
+// from the oldest; returns the ledger up to which the table is now empty,
+// `ledgerSeq` once nothing is left to delete.
+uint32_t deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
+                                uint32_t count, std::string const& tableName,
+                                std::string const& ledgerSeqColumn);
+
+// One column of a multi-row statement. Values are kept in their textual SQL
+// form; `sqlType` is the element type used to cast the column on postgres.
+struct BulkColumn
+{
+    std::string mName;
+    std::string mSqlType;
+    std::vector<std::string> mValues;
+    std::vector<soci::indicator> mInds;
+
+    BulkColumn(std::string const& name, std::string const& sqlType);
+
+    void push(std::string const& value);
+    void pushNull();
+    size_t size() const;
+};
+
+// Marshal a column into a postgres array literal, eg. {"a",NULL,"b"}.
+std::string marshalToPGArray(BulkColumn const& column);
+
+// Write all the rows described by `columns` to `tableName`, replacing any row
+// that has the same values in `keyColumns`. On postgres this is a single
+// INSERT ... ON CONFLICT statement over unnest()-ed array parameters; on
+// sqlite it is one prepared INSERT OR REPLACE executed with vector bindings.
+void bulkUpsert(Database& db, std::string const& entityName,
+                std::string const& tableName,
+                std::vector<std::string> const& keyColumns,
+                std::vector<BulkColumn>& columns);
+
+// Same as bulkUpsert for rows that can't collide with existing ones.
+void bulkInsert(Database& db, std::string const& entityName,
+                std::string const& tableName,
+                std::vector<BulkColumn>& columns);
+
+// Delete all rows of `tableName` matching any of the rows in `keyColumns`.
+void bulkDelete(Database& db, std::string const& entityName,
+                std::string const& tableName,
+                std::vector<BulkColumn>& keyColumns);
+
+// Number of keys bound to each "WHERE x IN (...)" query by the bulk loaders.
+// Batches are padded to this size by repeating a key, so that every batch
+// shares one prepared statement.
+size_t const BULK_LOAD_BATCH_SIZE = 64;
+
+// Returns "(:p0, :p1, ..., :p<n-1>)".
+std::string placeholderList(size_t n);
+
+// Split `keys` into batches of BULK_LOAD_BATCH_SIZE, padding the last one.
+std::vector<std::vector<std::string>>
+makeLoadBatches(std::vector<std::string> const& keys);
+
+// Prepare `query` on `sess` rather than through the Database's cache of
+// prepared statements, which only serves the main session (eg. for a session
+// of the pool used by a worker thread).
+std::shared_ptr<soci::statement> prepare(soci::session& sess,
+                                         std::string const& query);
 }
 }
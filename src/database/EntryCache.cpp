@@ -0,0 +1,241 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/EntryCache.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace stellar
+{
+
+namespace
+{
+char const*
+entryTypeName(LedgerEntryType type)
+{
+    // Matches the names LedgerDelta uses for its per-type meters.
+    switch (type)
+    {
+    case ACCOUNT:
+        return "account";
+    case TRUSTLINE:
+        return "trust";
+    case OFFER:
+        return "offer";
+    case DATA:
+        return "data";
+    }
+    throw std::runtime_error("unknown ledger entry type");
+}
+}
+
+EntryCache::EntryCache(medida::MetricsRegistry& metrics, size_t maxBytes)
+    : mMaxBytes(maxBytes)
+    , mBytesCounter(metrics.NewCounter({"database", "memory", "entry-cache"}))
+    , mPrefetchLoads(metrics.NewMeter({"ledger", "prefetch", "load"}, "entry"))
+    , mPrefetchHits(metrics.NewMeter({"ledger", "prefetch", "hit"}, "entry"))
+{
+    for (auto type : xdr::xdr_traits<LedgerEntryType>::enum_values())
+    {
+        assert(static_cast<size_t>(type) == mShards.size());
+        mShards.emplace_back();
+        mComplete.push_back(false);
+        mUnknown.emplace_back();
+        auto name = entryTypeName(static_cast<LedgerEntryType>(type));
+        mHits.push_back(&metrics.NewMeter({"ledger", name, "cache-hit"},
+                                          "entry"));
+        mMisses.push_back(&metrics.NewMeter({"ledger", name, "cache-miss"},
+                                            "entry"));
+    }
+}
+
+EntryCache::Shard&
+EntryCache::shardFor(LedgerEntryType type)
+{
+    return mShards.at(static_cast<size_t>(type));
+}
+
+EntryCache::Shard const&
+EntryCache::shardFor(LedgerEntryType type) const
+{
+    return mShards.at(static_cast<size_t>(type));
+}
+
+void
+EntryCache::eraseItem(Shard& shard, Shard::iterator it)
+{
+    mBytes -= it->second->mBytes;
+    mItems.erase(it->second);
+    shard.erase(it);
+}
+
+void
+EntryCache::evict()
+{
+    while (mBytes > mMaxBytes && !mItems.empty())
+    {
+        auto& last = mItems.back();
+        auto& shard = shardFor(last.mKey.key().type());
+        forget(last.mKey);
+        eraseItem(shard, shard.find(last.mKey));
+    }
+    mBytesCounter.set_count(mBytes);
+}
+
+bool
+EntryCache::knownAbsent(HashedLedgerKey const& key) const
+{
+    auto type = key.key().type();
+    return mComplete[type] && mUnknown[type].find(key) == mUnknown[type].end();
+}
+
+void
+EntryCache::forget(HashedLedgerKey const& key)
+{
+    if (mComplete[key.key().type()])
+    {
+        mUnknown[key.key().type()].insert(key);
+    }
+}
+
+bool
+EntryCache::exists(HashedLedgerKey const& key)
+{
+    bool found = contains(key);
+    if (found)
+    {
+        mHits[key.key().type()]->Mark();
+    }
+    else
+    {
+        mMisses[key.key().type()]->Mark();
+    }
+    return found;
+}
+
+EntryCache::Value const&
+EntryCache::get(HashedLedgerKey const& key)
+{
+    auto& shard = shardFor(key.key().type());
+    auto it = shard.find(key);
+    if (it == shard.end())
+    {
+        if (knownAbsent(key))
+        {
+            return mAbsent;
+        }
+        throw std::range_error("There is no such key in cache");
+    }
+    mItems.splice(mItems.begin(), mItems, it->second);
+    if (it->second->mPrefetched)
+    {
+        it->second->mPrefetched = false;
+        mPrefetchHits.Mark();
+    }
+    return it->second->mValue;
+}
+
+bool
+EntryCache::contains(HashedLedgerKey const& key) const
+{
+    auto const& shard = shardFor(key.key().type());
+    return shard.find(key) != shard.end() || knownAbsent(key);
+}
+
+void
+EntryCache::markComplete(LedgerEntryType type)
+{
+    mComplete[type] = true;
+    mUnknown[type].clear();
+}
+
+bool
+EntryCache::isComplete(LedgerEntryType type) const
+{
+    return mComplete[type];
+}
+
+void
+EntryCache::put(HashedLedgerKey const& key, Value value, bool prefetched)
+{
+    auto& shard = shardFor(key.key().type());
+    auto it = shard.find(key);
+    if (it != shard.end())
+    {
+        eraseItem(shard, it);
+    }
+    if (mComplete[key.key().type()])
+    {
+        mUnknown[key.key().type()].erase(key);
+        if (!value)
+        {
+            // known not to exist without holding an item
+            mBytesCounter.set_count(mBytes);
+            return;
+        }
+    }
+
+    size_t bytes = ITEM_OVERHEAD + xdr::xdr_size(key.key());
+    if (value)
+    {
+        bytes += xdr::xdr_size(*value);
+    }
+    if (prefetched)
+    {
+        mPrefetchLoads.Mark();
+    }
+    mItems.push_front(Item{key, std::move(value), bytes, prefetched});
+    shard.emplace(key, mItems.begin());
+    mBytes += bytes;
+    evict();
+}
+
+void
+EntryCache::eraseIfExists(HashedLedgerKey const& key)
+{
+    forget(key);
+    auto& shard = shardFor(key.key().type());
+    auto it = shard.find(key);
+    if (it != shard.end())
+    {
+        eraseItem(shard, it);
+        mBytesCounter.set_count(mBytes);
+    }
+}
+
+void
+EntryCache::clear()
+{
+    for (auto& shard : mShards)
+    {
+        shard.clear();
+    }
+    for (auto& unknown : mUnknown)
+    {
+        unknown.clear();
+    }
+    mComplete.assign(mComplete.size(), false);
+    mItems.clear();
+    mBytes = 0;
+    mBytesCounter.set_count(mBytes);
+}
+
+size_t
+EntryCache::size() const
+{
+    return mItems.size();
+}
+
+size_t
+EntryCache::getBytes() const
+{
+    return mBytes;
+}
+}
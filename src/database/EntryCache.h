@@ -0,0 +1,149 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+#include "util/XDROperators.h"
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Meter;
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+/**
+ * EntryCache is the Database's LRU cache of LedgerEntries, keyed directly by
+ * LedgerKey. A cached nullptr records that the entry is known not to exist.
+ * Keys are taken as HashedLedgerKey, so that the several lookups done for
+ * one key (the item, then the unknown keys of its type) hash it only once.
+ *
+ * Capacity is a budget in bytes, estimated from the XDR size of each cached
+ * key and entry plus a fixed per-item overhead, so that a cache of large
+ * accounts (many signers) and one of small offers cost about the same memory.
+ *
+ * Items share a single recency list but are indexed in one hash map per
+ * LedgerEntryType, so the type-specific sweeps done when rolling back to an
+ * earlier ledger (eraseIf) only visit entries of that type.
+ *
+ * Hits and misses are metered per entry type. Entries put as `prefetched` are
+ * also counted as prefetch loads, and as prefetch hits the first time they
+ * are then looked up, which gives the fraction of prefetched entries that
+ * were actually used. Like the rest of Database this is main-thread only.
+ *
+ * An entry type can be marked complete once every existing entry of that
+ * type was put in the cache (see LEDGER_STATE_IN_MEMORY). A key of a
+ * complete type that is not cached is then known not to exist, without
+ * holding a nullptr for it, unless it was erased since: erasing (or evicting)
+ * a key of a complete type remembers it as unknown until it is put again.
+ */
+class EntryCache : NonMovableOrCopyable
+{
+  public:
+    typedef std::shared_ptr<LedgerEntry const> Value;
+
+  private:
+    struct Item
+    {
+        HashedLedgerKey mKey;
+        Value mValue;
+        size_t mBytes;
+        // Loaded ahead of use by a prefetch and not looked up since.
+        bool mPrefetched;
+    };
+    typedef std::list<Item> ItemList;
+    typedef std::unordered_map<HashedLedgerKey, ItemList::iterator> Shard;
+    typedef std::unordered_set<HashedLedgerKey> KeySet;
+
+    size_t const mMaxBytes;
+    size_t mBytes{0};
+    ItemList mItems;
+    std::vector<Shard> mShards;
+    // by entry type
+    std::vector<bool> mComplete;
+    std::vector<KeySet> mUnknown;
+    Value const mAbsent;
+
+    std::vector<medida::Meter*> mHits;
+    std::vector<medida::Meter*> mMisses;
+    medida::Meter& mPrefetchLoads;
+    medida::Meter& mPrefetchHits;
+    medida::Counter& mBytesCounter;
+
+    Shard& shardFor(LedgerEntryType type);
+    Shard const& shardFor(LedgerEntryType type) const;
+    void eraseItem(Shard& shard, Shard::iterator it);
+    void evict();
+    // whether `key`, not cached, is known not to exist
+    bool knownAbsent(HashedLedgerKey const& key) const;
+    void forget(HashedLedgerKey const& key);
+
+  public:
+    // Rough per-item bookkeeping cost (list node, map node, shared_ptr
+    // control block) added to the XDR sizes when accounting bytes.
+    static size_t const ITEM_OVERHEAD = 128;
+
+    EntryCache(medida::MetricsRegistry& metrics, size_t maxBytes);
+
+    // Whether `key` is cached (possibly as nullptr) or known not to exist.
+    // Counts a hit or a miss.
+    bool exists(HashedLedgerKey const& key);
+
+    // Precondition: exists(key). Returns the cached value (nullptr if known
+    // not to exist) and marks it most recently used. Throws std::range_error
+    // if absent.
+    Value const& get(HashedLedgerKey const& key);
+
+    // Like exists(key), without counting a hit or a miss.
+    bool contains(HashedLedgerKey const& key) const;
+
+    // Records that every entry of `type` that exists is cached.
+    void markComplete(LedgerEntryType type);
+    bool isComplete(LedgerEntryType type) const;
+
+    void put(HashedLedgerKey const& key, Value value, bool prefetched = false);
+
+    void eraseIfExists(HashedLedgerKey const& key);
+
+    // Erase every cached entry of `type` for which `f(value)` is true. Those
+    // are not remembered as unknown: this is used after deleting the
+    // matching rows.
+    template <typename F>
+    void
+    eraseIf(LedgerEntryType type, F const& f)
+    {
+        auto& shard = shardFor(type);
+        for (auto it = shard.begin(); it != shard.end();)
+        {
+            auto next = std::next(it);
+            if (f(it->second->mValue))
+            {
+                eraseItem(shard, it);
+            }
+            it = next;
+        }
+    }
+
+    // Also marks all entry types incomplete.
+    void clear();
+
+    // Number of cached items.
+    size_t size() const;
+
+    // Estimated bytes held by cached items.
+    size_t getBytes() const;
+};
+}
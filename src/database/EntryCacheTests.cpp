@@ -0,0 +1,171 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/EntryCache.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "xdrpp/marshal.h"
+
+using namespace stellar;
+
+static EntryCache::Value
+makeAccount(uint32_t lastModified)
+{
+    auto e = std::make_shared<LedgerEntry>();
+    e->lastModifiedLedgerSeq = lastModified;
+    e->data.type(ACCOUNT);
+    e->data.account() = LedgerTestUtils::generateValidAccountEntry();
+    return e;
+}
+
+static EntryCache::Value
+makeOffer(uint32_t lastModified)
+{
+    auto e = std::make_shared<LedgerEntry>();
+    e->lastModifiedLedgerSeq = lastModified;
+    e->data.type(OFFER);
+    e->data.offer() = LedgerTestUtils::generateValidOfferEntry();
+    return e;
+}
+
+TEST_CASE("entry cache hits misses and negative entries", "[entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    EntryCache cache(metrics, 1 << 20);
+    auto& hits = metrics.NewMeter({"ledger", "account", "cache-hit"}, "entry");
+    auto& misses =
+        metrics.NewMeter({"ledger", "account", "cache-miss"}, "entry");
+
+    auto acc = makeAccount(1);
+    auto key = LedgerEntryKey(*acc);
+    REQUIRE(!cache.exists(key));
+    REQUIRE_THROWS_AS(cache.get(key), std::range_error);
+    cache.put(key, acc);
+    REQUIRE(cache.exists(key));
+    REQUIRE(*cache.get(key) == *acc);
+
+    auto other = LedgerEntryKey(*makeAccount(1));
+    cache.put(other, nullptr);
+    REQUIRE(cache.exists(other));
+    REQUIRE(cache.get(other) == nullptr);
+
+    REQUIRE(hits.count() == 2);
+    REQUIRE(misses.count() == 1);
+
+    cache.eraseIfExists(key);
+    REQUIRE(!cache.exists(key));
+    REQUIRE(cache.size() == 1);
+    cache.clear();
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.getBytes() == 0);
+}
+
+TEST_CASE("entry cache evicts least recently used within byte budget",
+          "[entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    std::vector<EntryCache::Value> entries;
+    size_t bytes = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        entries.emplace_back(makeAccount(1));
+        bytes += EntryCache::ITEM_OVERHEAD + xdr::xdr_size(*entries.back()) +
+                 xdr::xdr_size(LedgerEntryKey(*entries.back()));
+    }
+
+    // Room for everything but the last entry, give or take.
+    auto& lastEntry = *entries.back();
+    size_t lastBytes = EntryCache::ITEM_OVERHEAD + xdr::xdr_size(lastEntry) +
+                       xdr::xdr_size(LedgerEntryKey(lastEntry));
+    EntryCache cache(metrics, bytes - lastBytes);
+
+    for (size_t i = 0; i + 1 < entries.size(); ++i)
+    {
+        cache.put(LedgerEntryKey(*entries[i]), entries[i]);
+    }
+    REQUIRE(cache.size() == entries.size() - 1);
+
+    // Touch the oldest so that the second-oldest is evicted instead.
+    cache.get(LedgerEntryKey(*entries[0]));
+    cache.put(LedgerEntryKey(lastEntry), entries.back());
+    REQUIRE(cache.getBytes() <= bytes - lastBytes);
+    REQUIRE(cache.exists(LedgerEntryKey(*entries[0])));
+    REQUIRE(!cache.exists(LedgerEntryKey(*entries[1])));
+    REQUIRE(cache.exists(LedgerEntryKey(lastEntry)));
+}
+
+TEST_CASE("entry cache eraseIf only visits one entry type", "[entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    EntryCache cache(metrics, 1 << 20);
+
+    auto oldAcc = makeAccount(1);
+    auto newAcc = makeAccount(5);
+    auto newOffer = makeOffer(5);
+    for (auto const& e : {oldAcc, newAcc, newOffer})
+    {
+        cache.put(LedgerEntryKey(*e), e);
+    }
+
+    cache.eraseIf(ACCOUNT, [](EntryCache::Value const& le) {
+        return le && le->lastModifiedLedgerSeq >= 5;
+    });
+    REQUIRE(cache.exists(LedgerEntryKey(*oldAcc)));
+    REQUIRE(!cache.exists(LedgerEntryKey(*newAcc)));
+    REQUIRE(cache.exists(LedgerEntryKey(*newOffer)));
+    REQUIRE(cache.size() == 2);
+}
+
+TEST_CASE("entry cache of a complete entry type", "[entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    EntryCache cache(metrics, 1 << 20);
+
+    auto acc = makeAccount(1);
+    auto key = LedgerEntryKey(*acc);
+    auto missing = LedgerEntryKey(*makeAccount(1));
+    auto offer = LedgerEntryKey(*makeOffer(1));
+    cache.put(key, acc);
+    cache.markComplete(ACCOUNT);
+    REQUIRE(cache.isComplete(ACCOUNT));
+    REQUIRE(!cache.isComplete(OFFER));
+
+    // known not to exist without being cached
+    REQUIRE(cache.exists(missing));
+    REQUIRE(cache.get(missing) == nullptr);
+    REQUIRE(!cache.exists(offer));
+    cache.put(missing, nullptr);
+    REQUIRE(cache.size() == 1);
+
+    // erased keys are unknown until put again
+    cache.eraseIfExists(key);
+    cache.eraseIfExists(missing);
+    REQUIRE(!cache.exists(key));
+    REQUIRE(!cache.exists(missing));
+    cache.put(missing, nullptr);
+    REQUIRE(cache.exists(missing));
+    cache.put(key, acc);
+    REQUIRE(*cache.get(key) == *acc);
+
+    cache.clear();
+    REQUIRE(!cache.isComplete(ACCOUNT));
+    REQUIRE(!cache.exists(missing));
+}
+
+TEST_CASE("hashed ledger keys", "[entrycache]")
+{
+    auto acc = makeAccount(1);
+    auto key = LedgerEntryKey(*acc);
+    HashedLedgerKey hashed(key);
+    REQUIRE(hashed.key() == key);
+    REQUIRE(hashed.hash() == LedgerKeyHash()(key));
+    REQUIRE(hashed == HashedLedgerKey(key));
+
+    // same hash would not be enough
+    auto other = LedgerEntryKey(*makeOffer(1));
+    REQUIRE(hashed != HashedLedgerKey(other));
+}
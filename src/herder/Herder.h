@@ -96,6 +96,12 @@ class Herder
     // the current reality as best as possible.
     virtual void syncMetrics() = 0;
 
+    // Set the {*, "memory", "*-bytes"} counters of the structures the Herder
+    // owns (SCP slots, pending envelopes and the fetchers of their data) to
+    // the approximate bytes they hold; too costly to keep up to date on every
+    // change, see Application::syncMemoryMetrics.
+    virtual void syncMemoryMetrics() = 0;
+
     virtual void bootstrap() = 0;
 
     // restores Herder's state from disk
@@ -108,12 +114,20 @@ class Herder
     virtual TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) = 0;
     virtual void peerDoesntHave(stellar::MessageType type,
                                 uint256 const& itemID, Peer::pointer peer) = 0;
+    // Part of a transaction set being fetched arrived (see TX_SET_CHUNK).
+    virtual void recvTxSetProgress(Hash const& hash) = 0;
     virtual TxSetFramePtr getTxSet(Hash const& hash) = 0;
     virtual SCPQuorumSetPtr getQSet(Hash const& qSetHash) = 0;
 
     // We are learning about a new envelope.
     virtual EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope) = 0;
 
+    // We are learning about a new envelope from a peer: its signature is
+    // checked on the worker threads, along with those of the envelopes
+    // received meanwhile, before it goes to recvSCPEnvelope. Envelopes go
+    // there in the order received; badly signed ones are dropped.
+    virtual void queueSCPEnvelope(SCPEnvelope const& envelope) = 0;
+
     // We are learning about a new fully-fetched envelope.
     virtual EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope,
                                            const SCPQuorumSet& qset,
@@ -147,5 +161,10 @@ class Herder
     virtual Json::Value getJsonInfo(size_t limit) = 0;
     virtual Json::Value getJsonQuorumInfo(NodeID const& id, bool summary,
                                           uint64 index = 0) = 0;
+
+    // Starts checking, on a worker thread, that any two quorums of the nodes
+    // whose quorum set is known intersect, unless a check is running already;
+    // returns the outcome of the last check completed, if any.
+    virtual Json::Value checkQuorumIntersection() = 0;
 };
 }
@@ -6,6 +6,7 @@
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "herder/HerderPersistence.h"
 #include "herder/HerderUtils.h"
 #include "herder/LedgerCloseData.h"
@@ -19,17 +20,23 @@
 #include "scp/LocalNode.h"
 #include "scp/Slot.h"
 #include "util/Logging.h"
+#include "util/Profiler.h"
 #include "util/StatusManager.h"
 #include "util/Timer.h"
+#include "util/WorkerLanes.h"
 
 #include "medida/counter.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "util/Decoder.h"
+#include "util/HashOfHash.h"
 #include "util/XDRStream.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
 #include <ctime>
+#include <functional>
+#include <unordered_set>
 #include <lib/util/format.h>
 
 using namespace std;
@@ -51,11 +58,23 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewMeter({"scp", "envelope", "emit"}, "envelope"))
     , mEnvelopeReceive(
           app.getMetrics().NewMeter({"scp", "envelope", "receive"}, "envelope"))
+    , mEnvelopeInvalidSig(app.getMetrics().NewMeter(
+          {"scp", "envelope", "invalidsig"}, "envelope"))
+    , mStateCacheHit(
+          app.getMetrics().NewMeter({"scp", "state-cache", "hit"}, "slot"))
+    , mStateCacheMiss(
+          app.getMetrics().NewMeter({"scp", "state-cache", "miss"}, "slot"))
 
     , mKnownSlotsSize(
           app.getMetrics().NewCounter({"scp", "memory", "known-slots"}))
     , mCumulativeStatements(app.getMetrics().NewCounter(
           {"scp", "memory", "cumulative-statements"}))
+    , mKnownSlotsBytes(app.getMetrics().NewCounter(
+          {"scp", "memory", "known-slots-bytes"}))
+    , mPendingEnvelopesBytes(app.getMetrics().NewCounter(
+          {"scp", "memory", "pending-envelopes-bytes"}))
+    , mItemFetchBytes(app.getMetrics().NewCounter(
+          {"overlay", "memory", "item-fetch-map-bytes"}))
 
     , mHerderPendingTxs0(
           app.getMetrics().NewCounter({"herder", "pending-txs", "age0"}))
@@ -65,16 +84,29 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewCounter({"herder", "pending-txs", "age2"}))
     , mHerderPendingTxs3(
           app.getMetrics().NewCounter({"herder", "pending-txs", "age3"}))
+    , mHerderPendingTxsBytes(
+          app.getMetrics().NewCounter({"herder", "pending-txs", "bytes"}))
+    , mHerderPendingTxsEvicted(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "evicted"}, "transaction"))
+    , mHerderPendingTxsRebroadcast(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "rebroadcast"}, "transaction"))
+    , mHerderPendingTxsRebroadcastBytes(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "rebroadcast-bytes"}, "byte"))
+    , mHerderPendingTxsRebroadcastDeferred(app.getMetrics().NewMeter(
+          {"herder", "pending-txs", "rebroadcast-deferred"}, "transaction"))
 {
 }
 
 HerderImpl::HerderImpl(Application& app)
-    : mPendingTransactions(4)
+    : mPendingTransactions(4, app.getConfig().PENDING_TRANSACTIONS_MAX_BYTES)
     , mPendingEnvelopes(app, *this)
     , mHerderSCPDriver(app, *this, mUpgrades, mPendingEnvelopes)
     , mLastSlotSaved(0)
-    , mTrackingTimer(app)
-    , mTriggerTimer(app)
+    , mTrackingTimer(app, "herder-tracking")
+    , mEnvelopeVerification(std::make_shared<EnvelopeVerificationQueue>(*this))
+    , mQuorumIntersection(std::make_shared<QuorumIntersectionState>())
+    , mFlushEmittedTimer(app)
+    , mTriggerTimer(app, "herder-trigger")
     , mRebroadcastTimer(app)
     , mApp(app)
     , mLedgerManager(app.getLedgerManager())
@@ -87,6 +119,7 @@ HerderImpl::HerderImpl(Application& app)
 
 HerderImpl::~HerderImpl()
 {
+    mQuorumIntersection->mInterrupt = true;
 }
 
 Herder::State
@@ -107,6 +140,16 @@ HerderImpl::syncMetrics()
     mHerderSCPDriver.syncMetrics();
 }
 
+void
+HerderImpl::syncMemoryMetrics()
+{
+    mSCPMetrics.mKnownSlotsBytes.set_count(getSCP().getMemoryBytes());
+    mSCPMetrics.mPendingEnvelopesBytes.set_count(
+        mPendingEnvelopes.getMemoryBytes());
+    mSCPMetrics.mItemFetchBytes.set_count(
+        mPendingEnvelopes.getFetchersMemoryBytes());
+}
+
 std::string
 HerderImpl::getStateHuman() const
 {
@@ -136,37 +179,11 @@ HerderImpl::updateSCPCounters()
         getSCP().getCumulativeStatemtCount());
 }
 
-static uint64_t
-countTxs(HerderImpl::AccountTxMap const& acc)
-{
-    uint64_t sz = 0;
-    for (auto const& a : acc)
-    {
-        sz += a.second->mTransactions.size();
-    }
-    return sz;
-}
-
-static std::shared_ptr<HerderImpl::TxMap>
-findOrAdd(HerderImpl::AccountTxMap& acc, AccountID const& aid)
-{
-    std::shared_ptr<HerderImpl::TxMap> txmap = nullptr;
-    auto i = acc.find(aid);
-    if (i == acc.end())
-    {
-        txmap = std::make_shared<HerderImpl::TxMap>();
-        acc.insert(std::make_pair(aid, txmap));
-    }
-    else
-    {
-        txmap = i->second;
-    }
-    return txmap;
-}
-
 void
 HerderImpl::valueExternalized(uint64 slotIndex, StellarValue const& value)
 {
+    invalidateJsonInfo();
+
     // record metrics
     getHerderSCPDriver().recordSCPExecutionMetrics(slotIndex);
     updateSCPCounters();
@@ -191,15 +208,23 @@ HerderImpl::valueExternalized(uint64 slotIndex, StellarValue const& value)
 
     TxSetFramePtr externalizedSet = mPendingEnvelopes.getTxSet(value.txSetHash);
 
+    // our statements, up to the externalize one, are saved before the
+    // ledger closes
+    flushEmittedEnvelopes();
+
     // trigger will be recreated when the ledger is closed
     // we do not want it to trigger while downloading the current set
     // and there is no point in taking a position after the round is over
     mTriggerTimer.cancel();
 
-    // save the SCP messages in the database
-    mApp.getHerderPersistence().saveSCPHistory(
-        static_cast<uint32>(slotIndex),
-        getSCP().getExternalizingState(slotIndex));
+    // save the SCP messages in the database, for the history archives a
+    // watcher does not publish to
+    if (!mApp.getConfig().WATCHER_MODE)
+    {
+        mApp.getHerderPersistence().saveSCPHistory(
+            static_cast<uint32>(slotIndex),
+            getSCP().getExternalizingState(slotIndex));
+    }
 
     // reflect upgrades with the ones included in this SCP round
     {
@@ -212,6 +237,8 @@ HerderImpl::valueExternalized(uint64 slotIndex, StellarValue const& value)
         }
     }
 
+    prepareNextLedger(*externalizedSet);
+
     // tell the LedgerManager that this value got externalized
     // LedgerManager will perform the proper action based on its internal
     // state: apply, trigger catchup, etc
@@ -227,6 +254,8 @@ HerderImpl::valueExternalized(uint64 slotIndex, StellarValue const& value)
     {
         getSCP().purgeSlots(slotIndex - MAX_SLOTS_TO_REMEMBER);
     }
+    // and reduce the older ones to what peers may still ask of them
+    getSCP().compactSlots(slotIndex);
 
     ledgerClosed();
 
@@ -238,16 +267,21 @@ HerderImpl::valueExternalized(uint64 slotIndex, StellarValue const& value)
 void
 HerderImpl::rebroadcast()
 {
+    // the envelopes only go to the peers that neither sent them to us nor
+    // were sent them since they last changed (peers that connected since
+    // included), except every REBROADCAST_FORCE_PERIOD times, for peers that
+    // may have dropped them
+    bool force = ++mRebroadcastCount % REBROADCAST_FORCE_PERIOD == 0;
     for (auto const& e :
          getSCP().getLatestMessagesSend(mLedgerManager.getLedgerNum()))
     {
-        broadcast(e);
+        broadcast(e, force);
     }
     startRebroadcastTimer();
 }
 
 void
-HerderImpl::broadcast(SCPEnvelope const& e)
+HerderImpl::broadcast(SCPEnvelope const& e, bool force)
 {
     if (!mApp.getConfig().MANUAL_CLOSE)
     {
@@ -260,7 +294,7 @@ HerderImpl::broadcast(SCPEnvelope const& e)
                               << " i:" << e.statement.slotIndex;
 
         mSCPMetrics.mEnvelopeEmit.Mark();
-        mApp.getOverlayManager().broadcastMessage(m, true);
+        mApp.getOverlayManager().broadcastMessage(m, force);
     }
 }
 
@@ -276,6 +310,8 @@ HerderImpl::startRebroadcastTimer()
 void
 HerderImpl::emitEnvelope(SCPEnvelope const& envelope)
 {
+    invalidateJsonInfo();
+
     uint64 slotIndex = envelope.statement.slotIndex;
 
     if (Logging::logDebug("Herder"))
@@ -284,42 +320,54 @@ HerderImpl::emitEnvelope(SCPEnvelope const& envelope)
             << " s:" << envelope.statement.pledges.type() << " i:" << slotIndex
             << " a:" << mApp.getStateHuman();
 
-    persistSCPState(slotIndex);
-
-    broadcast(envelope);
-
-    // this resets the re-broadcast timer
-    startRebroadcastTimer();
+    queueEmittedEnvelope(envelope);
 }
 
 void
-HerderImpl::TxMap::addTx(TransactionFramePtr tx)
+HerderImpl::queueEmittedEnvelope(SCPEnvelope const& envelope)
 {
-    auto const& h = tx->getFullHash();
-    if (mTransactions.find(h) != mTransactions.end())
+    if (mEmittedEnvelopes.empty())
     {
-        return;
+        mFlushEmittedTimer.expires_from_now(std::chrono::milliseconds(0));
+        mFlushEmittedTimer.async_wait(
+            std::bind(&HerderImpl::flushEmittedEnvelopes, this),
+            &VirtualTimer::onFailureNoop);
     }
-    mTransactions.insert(std::make_pair(h, tx));
-    mMaxSeq = std::max(tx->getSeqNum(), mMaxSeq);
-    mTotalFees += tx->getFee();
+    mEmittedEnvelopes.emplace_back(envelope);
 }
 
 void
-HerderImpl::TxMap::recalculate()
+HerderImpl::flushEmittedEnvelopes()
 {
-    mMaxSeq = 0;
-    mTotalFees = 0;
-    for (auto const& pair : mTransactions)
+    if (mEmittedEnvelopes.empty())
     {
-        mMaxSeq = std::max(pair.second->getSeqNum(), mMaxSeq);
-        mTotalFees += pair.second->getFee();
+        return;
+    }
+    mFlushEmittedTimer.cancel();
+
+    auto envelopes = std::move(mEmittedEnvelopes);
+    mEmittedEnvelopes.clear();
+
+    uint64 slotIndex = 0;
+    for (auto const& e : envelopes)
+    {
+        slotIndex = std::max(slotIndex, e.statement.slotIndex);
     }
+    persistSCPState(slotIndex);
+
+    for (auto const& e : envelopes)
+    {
+        broadcast(e);
+    }
+
+    // this resets the re-broadcast timer
+    startRebroadcastTimer();
 }
 
 Herder::TransactionSubmitStatus
 HerderImpl::recvTransaction(TransactionFramePtr tx)
 {
+    ProfileScope profileScope("herder-tx");
     soci::transaction sqltx(mApp.getDatabase().getSession());
     mApp.getDatabase().setCurrentTransactionReadOnly();
 
@@ -328,26 +376,15 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
 
     // determine if we have seen this tx before and if not if it has the right
     // seq num
-    int64_t totFee = tx->getFee();
-    SequenceNumber highSeq = 0;
-
-    for (auto& map : mPendingTransactions)
+    if (mPendingTransactions.contains(txID))
     {
-        auto i = map.find(acc);
-        if (i != map.end())
-        {
-            auto& txmap = i->second;
-            auto j = txmap->mTransactions.find(txID);
-            if (j != txmap->mTransactions.end())
-            {
-                return TX_STATUS_DUPLICATE;
-            }
-            totFee += txmap->mTotalFees;
-            highSeq = std::max(highSeq, txmap->mMaxSeq);
-        }
+        return TX_STATUS_DUPLICATE;
     }
 
-    if (!tx->checkValid(mApp, highSeq))
+    auto state = mPendingTransactions.getAccountState(acc);
+    int64_t totFee = tx->getFee() + state.mTotalFees;
+
+    if (!tx->checkValid(mApp, state.mMaxSeq))
     {
         return TX_STATUS_ERROR;
     }
@@ -362,8 +399,19 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
         CLOG(TRACE, "Herder") << "recv transaction " << hexAbbrev(txID)
                               << " for " << KeyUtils::toShortString(acc);
 
-    auto txmap = findOrAdd(mPendingTransactions[0], acc);
-    txmap->addTx(tx);
+    bool fits;
+    auto evicted = mPendingTransactions.makeRoomFor(tx, fits);
+    mSCPMetrics.mHerderPendingTxsEvicted.Mark(evicted);
+    if (!fits)
+    {
+        // the queue is full of transactions paying at least as much
+        tx->getResult().result.code(txINSUFFICIENT_FEE);
+        return TX_STATUS_ERROR;
+    }
+
+    mPendingTransactions.add(tx);
+    mSCPMetrics.mHerderPendingTxsBytes.set_count(
+        mPendingTransactions.getBytes());
 
     return TX_STATUS_PENDING;
 }
@@ -371,6 +419,7 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
 Herder::EnvelopeStatus
 HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
 {
+    ProfileScope profileScope("herder-scp");
     if (mApp.getConfig().MANUAL_CLOSE)
     {
         return Herder::ENVELOPE_STATUS_DISCARDED;
@@ -393,6 +442,29 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
 
     mSCPMetrics.mEnvelopeReceive.Mark();
 
+    if (!isSlotInRange(envelope.statement.slotIndex))
+    {
+        return Herder::ENVELOPE_STATUS_DISCARDED;
+    }
+
+    if (mPendingEnvelopes.isNodeInQuorum(envelope.statement.nodeID))
+    {
+        mHerderSCPDriver.envelopeReceived(envelope.statement.slotIndex,
+                                          envelope.statement.nodeID);
+    }
+
+    invalidateJsonInfo();
+    auto status = mPendingEnvelopes.recvSCPEnvelope(envelope);
+    if (status == Herder::ENVELOPE_STATUS_READY)
+    {
+        processSCPQueue();
+    }
+    return status;
+}
+
+bool
+HerderImpl::isSlotInRange(uint64 slotIndex)
+{
     uint32_t minLedgerSeq = getCurrentLedgerSeq();
     if (minLedgerSeq > MAX_SLOTS_TO_REMEMBER)
     {
@@ -415,21 +487,122 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
     }
 
     // If envelopes are out of our validity brackets, we just ignore them.
-    if (envelope.statement.slotIndex > maxLedgerSeq ||
-        envelope.statement.slotIndex < minLedgerSeq)
+    if (slotIndex > maxLedgerSeq || slotIndex < minLedgerSeq)
     {
         CLOG(DEBUG, "Herder") << "Ignoring SCPEnvelope outside of range: "
-                              << envelope.statement.slotIndex << "( "
-                              << minLedgerSeq << "," << maxLedgerSeq << ")";
-        return Herder::ENVELOPE_STATUS_DISCARDED;
+                              << slotIndex << "( " << minLedgerSeq << ","
+                              << maxLedgerSeq << ")";
+        return false;
     }
+    return true;
+}
 
-    auto status = mPendingEnvelopes.recvSCPEnvelope(envelope);
-    if (status == Herder::ENVELOPE_STATUS_READY)
+void
+HerderImpl::queueSCPEnvelope(SCPEnvelope const& envelope)
+{
+    // not worth checking what recvSCPEnvelope would drop anyway; the range
+    // is checked again then, as it may have moved meanwhile
+    if (mApp.getConfig().MANUAL_CLOSE ||
+        envelope.statement.nodeID == getSCP().getLocalNode()->getNodeID())
     {
-        processSCPQueue();
+        return;
+    }
+    if (!isSlotInRange(envelope.statement.slotIndex))
+    {
+        mSCPMetrics.mEnvelopeReceive.Mark();
+        return;
+    }
+    // nor to check, or fetch anything for, envelopes of nodes that have no
+    // say in what we externalize
+    if (!mPendingEnvelopes.isNodeInQuorum(envelope.statement.nodeID))
+    {
+        CLOG(DEBUG, "Herder")
+            << "Dropping envelope from "
+            << mApp.getConfig().toShortString(envelope.statement.nodeID)
+            << " (not in quorum)";
+        mSCPMetrics.mEnvelopeReceive.Mark();
+        return;
+    }
+
+    mEnvelopeVerification->mEnvelopes.push_back(envelope);
+    if (mEnvelopeVerification->mInFlight == 0)
+    {
+        verifyQueuedEnvelopes();
+    }
+}
+
+void
+HerderImpl::verifyQueuedEnvelopes()
+{
+    auto& queue = *mEnvelopeVerification;
+    queue.mInFlight = queue.mEnvelopes.size();
+    std::vector<SCPEnvelope> batch(queue.mEnvelopes.begin(),
+                                   queue.mEnvelopes.end());
+
+    std::weak_ptr<EnvelopeVerificationQueue> weak = mEnvelopeVerification;
+    auto& app = mApp;
+    auto networkID = mApp.getNetworkID();
+    auto& workers = mApp.getWorkerLanes();
+    size_t numHelpers = mApp.getWorkerThreadCount() - 1;
+    workers.post(WorkerLane::CRYPTO, [&app, &workers, weak, batch, networkID,
+                                      numHelpers]() {
+        std::vector<xdr::opaque_vec<>> bins;
+        bins.reserve(batch.size());
+        std::vector<PubKeyUtils::SigVerification> sigs;
+        for (auto const& e : batch)
+        {
+            bins.emplace_back(
+                xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_SCP, e.statement));
+            sigs.push_back({e.statement.nodeID, e.signature, bins.back()});
+        }
+        auto valid = PubKeyUtils::verifySigs(
+            sigs, numHelpers,
+            [&workers](std::function<void()> f) {
+                workers.post(WorkerLane::CRYPTO, f);
+            });
+
+        app.getClock().getIOService().post([weak, valid]() {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->mHerder.envelopesVerified(valid);
+            }
+        });
+    });
+}
+
+void
+HerderImpl::envelopesVerified(std::vector<bool> const& valid)
+{
+    auto& queue = *mEnvelopeVerification;
+    assert(valid.size() == queue.mInFlight);
+    auto end = queue.mEnvelopes.begin() + queue.mInFlight;
+    std::vector<SCPEnvelope> batch(std::make_move_iterator(
+                                       queue.mEnvelopes.begin()),
+                                   std::make_move_iterator(end));
+    queue.mEnvelopes.erase(queue.mEnvelopes.begin(), end);
+    queue.mInFlight = 0;
+
+    // the next batch gets checked while this one is processed
+    if (!queue.mEnvelopes.empty())
+    {
+        verifyQueuedEnvelopes();
+    }
+
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        if (valid[i])
+        {
+            recvSCPEnvelope(batch[i]);
+        }
+        else
+        {
+            CLOG(DEBUG, "Herder")
+                << "Dropping badly signed envelope from "
+                << mApp.getConfig().toShortString(batch[i].statement.nodeID);
+            mSCPMetrics.mEnvelopeInvalidSig.Mark();
+        }
     }
-    return status;
 }
 
 Herder::EnvelopeStatus
@@ -457,30 +630,64 @@ HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer)
         return;
     }
 
-    auto minSeq =
-        std::max(ledgerSeq, static_cast<uint32_t>(getSCP().getLowSlotIndex()));
+    auto lowSeq = static_cast<uint32_t>(getSCP().getLowSlotIndex());
+    auto minSeq = std::max(ledgerSeq, lowSeq);
     auto maxSeq = static_cast<uint32_t>(getSCP().getHighSlotIndex());
 
+    // slots SCP no longer knows about
+    mSCPStateCache.erase(mSCPStateCache.begin(),
+                         mSCPStateCache.lower_bound(lowSeq));
+
+    // all queued back to back, so that the peer writes them out together
     for (uint32_t seq = minSeq; seq <= maxSeq; seq++)
     {
-        auto const& envelopes = getSCP().getCurrentState(seq);
+        auto const& state = getSCPStateCache(seq);
 
-        if (envelopes.size() != 0)
+        if (state.mMessages.size() != 0)
         {
-            CLOG(DEBUG, "Herder")
-                << "Send state " << envelopes.size() << " for ledger " << seq;
+            CLOG(DEBUG, "Herder") << "Send state " << state.mMessages.size()
+                                  << " for ledger " << seq;
 
-            for (auto const& e : envelopes)
+            for (size_t i = 0; i < state.mMessages.size(); i++)
             {
-                StellarMessage m;
-                m.type(SCP_MESSAGE);
-                m.envelope() = e;
-                peer->sendMessage(m);
+                peer->sendMessage(state.mMessages[i], state.mBytes[i]);
             }
         }
     }
 }
 
+HerderImpl::SCPStateCache const&
+HerderImpl::getSCPStateCache(uint64 slotIndex)
+{
+    auto envelopes = getSCP().getCurrentState(slotIndex);
+    auto& cache = mSCPStateCache[slotIndex];
+
+    if (cache.mMessages.size() == envelopes.size() &&
+        std::equal(envelopes.begin(), envelopes.end(), cache.mMessages.begin(),
+                   [](SCPEnvelope const& e, StellarMessage const& m) {
+                       return e == m.envelope();
+                   }))
+    {
+        mSCPMetrics.mStateCacheHit.Mark();
+        return cache;
+    }
+
+    mSCPMetrics.mStateCacheMiss.Mark();
+    cache.mMessages.clear();
+    cache.mBytes.clear();
+    cache.mMessages.reserve(envelopes.size());
+    cache.mBytes.reserve(envelopes.size());
+    for (auto& e : envelopes)
+    {
+        StellarMessage m;
+        m.type(SCP_MESSAGE);
+        m.envelope() = std::move(e);
+        cache.mBytes.emplace_back(xdr::xdr_to_opaque(m));
+        cache.mMessages.emplace_back(std::move(m));
+    }
+    return cache;
+}
+
 void
 HerderImpl::processSCPQueue()
 {
@@ -522,6 +729,7 @@ HerderImpl::processSCPQueueUpToIndex(uint64 slotIndex)
         SCPEnvelope env;
         if (mPendingEnvelopes.pop(slotIndex, env))
         {
+            invalidateJsonInfo();
             getSCP().receiveEnvelope(env);
         }
         else
@@ -534,6 +742,7 @@ HerderImpl::processSCPQueueUpToIndex(uint64 slotIndex)
 void
 HerderImpl::ledgerClosed()
 {
+    invalidateJsonInfo();
     mTriggerTimer.cancel();
 
     updateSCPCounters();
@@ -594,60 +803,75 @@ HerderImpl::ledgerClosed()
                                  &VirtualTimer::onFailureNoop);
 }
 
+size_t
+HerderImpl::getMaxTxSetCandidates() const
+{
+    // with an apply budget, take more candidates than fit so that the ones
+    // paying the most per estimated apply cost can be kept
+    size_t maxTxs = mLedgerManager.getMaxTxSetSize();
+    return mApp.getConfig().TX_SET_APPLY_BUDGET_MS == 0 ? maxTxs : 2 * maxTxs;
+}
+
 void
-HerderImpl::removeReceivedTxs(std::vector<TransactionFramePtr> const& dropTxs)
+HerderImpl::prepareNextLedger(TxSetFrame const& applying)
 {
-    for (auto& m : mPendingTransactions)
+    // the next set needs the hash of the ledger being closed, and the state
+    // it leaves, so only what depends on neither can be done meanwhile
+    if (!getSCP().isValidator() || !mLedgerManager.isSynced())
     {
-        if (m.empty())
-        {
-            continue;
-        }
-
-        std::set<std::shared_ptr<TxMap>> toRecalculate;
-
-        for (auto const& tx : dropTxs)
-        {
-            auto const& acc = tx->getSourceID();
-            auto const& txID = tx->getFullHash();
-            auto i = m.find(acc);
-            if (i != m.end())
-            {
-                auto& txs = i->second->mTransactions;
-                auto j = txs.find(txID);
-                if (j != txs.end())
-                {
-                    txs.erase(j);
-                    if (txs.empty())
-                    {
-                        m.erase(i);
-                    }
-                    else
-                    {
-                        toRecalculate.insert(i->second);
-                    }
-                }
-            }
-        }
+        return;
+    }
 
-        for (auto txm : toRecalculate)
+    std::unordered_set<Hash> applied;
+    for (auto const& tx : applying.mTransactions)
+    {
+        applied.emplace(tx->getFullHash());
+    }
+    Hash h;
+    TxSetFrame next(h);
+    for (auto const& tx :
+         mPendingTransactions.getTopTransactions(getMaxTxSetCandidates()))
+    {
+        if (applied.find(tx->getFullHash()) == applied.end())
         {
-            txm->recalculate();
+            next.add(tx);
         }
     }
+    next.startMasterKeySignatureChecks(mApp);
+}
+
+void
+HerderImpl::removeReceivedTxs(std::vector<TransactionFramePtr> const& dropTxs)
+{
+    mPendingTransactions.remove(dropTxs);
+    mSCPMetrics.mHerderPendingTxsBytes.set_count(
+        mPendingTransactions.getBytes());
 }
 
 bool
 HerderImpl::recvSCPQuorumSet(Hash const& hash, const SCPQuorumSet& qset)
 {
+    invalidateJsonInfo();
     return mPendingEnvelopes.recvSCPQuorumSet(hash, qset);
 }
 
 bool
 HerderImpl::recvTxSet(Hash const& hash, const TxSetFrame& t)
 {
+    invalidateJsonInfo();
     TxSetFramePtr txset(new TxSetFrame(t));
-    return mPendingEnvelopes.recvTxSet(hash, txset);
+    if (!mPendingEnvelopes.recvTxSet(hash, txset))
+    {
+        return false;
+    }
+    // a set building on a ledger not closed yet can only be validated once
+    // it is, its signatures can be checked meanwhile
+    if (txset->previousLedgerHash() !=
+        mLedgerManager.getLastClosedLedgerHeader().hash)
+    {
+        txset->startMasterKeySignatureChecks(mApp);
+    }
+    return true;
 }
 
 void
@@ -657,6 +881,12 @@ HerderImpl::peerDoesntHave(MessageType type, uint256 const& itemID,
     mPendingEnvelopes.peerDoesntHave(type, itemID, peer);
 }
 
+void
+HerderImpl::recvTxSetProgress(Hash const& hash)
+{
+    mPendingEnvelopes.recvTxSetProgress(hash);
+}
+
 TxSetFramePtr
 HerderImpl::getTxSet(Hash const& hash)
 {
@@ -692,17 +922,7 @@ HerderImpl::getCurrentLedgerSeq() const
 SequenceNumber
 HerderImpl::getMaxSeqInPendingTxs(AccountID const& acc)
 {
-    SequenceNumber highSeq = 0;
-    for (auto const& m : mPendingTransactions)
-    {
-        auto i = m.find(acc);
-        if (i == m.end())
-        {
-            continue;
-        }
-        highSeq = std::max(i->second->mMaxSeq, highSeq);
-    }
-    return highSeq;
+    return mPendingTransactions.getAccountState(acc).mMaxSeq;
 }
 
 // called to take a position during the next round
@@ -710,6 +930,7 @@ HerderImpl::getMaxSeqInPendingTxs(AccountID const& acc)
 void
 HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
 {
+    ProfileScope profileScope("herder-trigger");
     if (!mHerderSCPDriver.trackingSCP() || !mLedgerManager.isSynced())
     {
         CLOG(DEBUG, "Herder") << "triggerNextLedger: skipping (out of sync) : "
@@ -721,24 +942,45 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
     // our first choice for this round's set is all the tx we have collected
     // during last ledger close
     auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
-    auto proposedSet = std::make_shared<TxSetFrame>(lcl.hash);
+    TxSetFramePtr proposedSet;
+
+    size_t maxTxs = mLedgerManager.getMaxTxSetSize();
+    if (mPendingTransactions.size() > maxTxs)
+    {
+        CLOG(WARNING, "Herder")
+            << "surge pricing in effect! " << mPendingTransactions.size();
+    }
 
-    for (auto const& m : mPendingTransactions)
+    auto budget =
+        std::chrono::milliseconds(mApp.getConfig().TX_SET_APPLY_BUDGET_MS);
+    size_t maxCandidates = getMaxTxSetCandidates();
+
+    // only the best paying transactions are candidates (surge pricing), if
+    // some of them turn out to be invalid they make room for the next ones
+    for (;;)
     {
-        for (auto const& pair : m)
+        proposedSet = std::make_shared<TxSetFrame>(lcl.hash);
+        auto candidates =
+            mPendingTransactions.getTopTransactions(maxCandidates);
+        for (auto const& tx : candidates)
         {
-            for (auto const& tx : pair.second->mTransactions)
-            {
-                proposedSet->add(tx.second);
-            }
+            proposedSet->add(tx);
         }
-    }
 
-    std::vector<TransactionFramePtr> removed;
-    proposedSet->trimInvalid(mApp, removed);
-    removeReceivedTxs(removed);
+        std::vector<TransactionFramePtr> removed;
+        proposedSet->trimInvalid(mApp, removed);
+        removeReceivedTxs(removed);
+        if (removed.empty() || candidates.size() < maxCandidates)
+        {
+            break;
+        }
+    }
 
-    proposedSet->surgePricingFilter(mLedgerManager);
+    if (budget.count() != 0)
+    {
+        proposedSet->applyCostFilter(mLedgerManager.getApplyCostModel(),
+                                     maxTxs, budget);
+    }
 
     if (!proposedSet->checkValid(mApp))
     {
@@ -867,21 +1109,174 @@ HerderImpl::resolveNodeID(std::string const& s, PublicKey& retKey)
 Json::Value
 HerderImpl::getJsonInfo(size_t limit)
 {
+    auto it = mJsonInfoCache.find(limit);
+    if (it != mJsonInfoCache.end())
+    {
+        return it->second;
+    }
+
     Json::Value ret;
     ret["you"] =
         mApp.getConfig().toStrKey(mApp.getConfig().NODE_SEED.getPublicKey());
 
     ret["scp"] = getSCP().getJsonInfo(limit);
     ret["queue"] = mPendingEnvelopes.getJsonInfo(limit);
+    mJsonInfoCache.emplace(limit, ret);
     return ret;
 }
 
 Json::Value
 HerderImpl::getJsonQuorumInfo(NodeID const& id, bool summary, uint64 index)
 {
+    auto key = std::make_tuple(id, summary, index);
+    auto it = mJsonQuorumInfoCache.find(key);
+    if (it != mJsonQuorumInfoCache.end())
+    {
+        return it->second;
+    }
+
     Json::Value ret;
     ret["node"] = mApp.getConfig().toStrKey(id);
     ret["slots"] = getSCP().getJsonQuorumInfo(id, summary, index);
+    mJsonQuorumInfoCache.emplace(key, ret);
+    return ret;
+}
+
+void
+HerderImpl::invalidateJsonInfo()
+{
+    mJsonInfoCache.clear();
+    mJsonQuorumInfoCache.clear();
+}
+
+QuorumIntersectionChecker::QuorumMap
+HerderImpl::getCurrentQuorumMap()
+{
+    // copies, as the checker reads them from another thread
+    QuorumIntersectionChecker::QuorumMap qmap;
+    qmap[getSCP().getLocalNodeID()] =
+        std::make_shared<SCPQuorumSet>(getSCP().getLocalQuorumSet());
+    if (!getSCP().empty())
+    {
+        for (auto slot = getSCP().getLowSlotIndex();
+             slot <= getSCP().getHighSlotIndex(); ++slot)
+        {
+            for (auto const& e : getSCP().getCurrentState(slot))
+            {
+                auto qset = getQSet(
+                    Slot::getCompanionQuorumSetHashFromStatement(e.statement));
+                if (qset)
+                {
+                    qmap[e.statement.nodeID] =
+                        std::make_shared<SCPQuorumSet>(*qset);
+                }
+            }
+        }
+    }
+
+    std::function<void(SCPQuorumSet const&)> noteNodes =
+        [&](SCPQuorumSet const& qset) {
+            for (auto const& v : qset.validators)
+            {
+                qmap.emplace(v, nullptr);
+            }
+            for (auto const& inner : qset.innerSets)
+            {
+                noteNodes(inner);
+            }
+        };
+    std::vector<std::shared_ptr<SCPQuorumSet const>> known;
+    for (auto const& q : qmap)
+    {
+        if (q.second)
+        {
+            known.push_back(q.second);
+        }
+    }
+    for (auto const& qset : known)
+    {
+        noteNodes(*qset);
+    }
+    return qmap;
+}
+
+Json::Value
+HerderImpl::checkQuorumIntersection()
+{
+    auto state = mQuorumIntersection;
+    std::lock_guard<std::mutex> lock(state->mMutex);
+
+    Json::Value ret;
+    ret["running"] = state->mRunning;
+    if (state->mChecked)
+    {
+        ret["ledger"] = state->mLedger;
+        ret["node_count"] = static_cast<Json::UInt64>(state->mNodeCount);
+        ret["main_component_size"] =
+            static_cast<Json::UInt64>(state->mMainComponentSize);
+        ret["time_ms"] = static_cast<Json::UInt64>(state->mDuration.count());
+        switch (state->mResult)
+        {
+        case QuorumIntersectionChecker::Result::INTERSECTING:
+            ret["result"] = "intersecting";
+            break;
+        case QuorumIntersectionChecker::Result::SPLIT:
+        {
+            ret["result"] = "split";
+            auto& split = ret["split"];
+            for (auto const& nodes :
+                 {state->mSplit.first, state->mSplit.second})
+            {
+                Json::Value quorum(Json::arrayValue);
+                for (auto const& n : nodes)
+                {
+                    quorum.append(mApp.getConfig().toStrKey(n));
+                }
+                split.append(quorum);
+            }
+            break;
+        }
+        default:
+            ret["result"] = "unknown";
+            break;
+        }
+    }
+
+    if (!state->mRunning)
+    {
+        state->mRunning = true;
+        auto qmap = getCurrentQuorumMap();
+        auto ledger = getCurrentLedgerSeq();
+        std::chrono::milliseconds timeout(
+            mApp.getConfig().QUORUM_INTERSECTION_CHECK_TIMEOUT_MS);
+        mApp.getWorkerLanes().post(WorkerLane::BACKGROUND, [state, qmap,
+                                                            ledger,
+                                                            timeout]() {
+            auto start = std::chrono::steady_clock::now();
+            QuorumIntersectionChecker checker(qmap, timeout,
+                                              &state->mInterrupt);
+            auto result = checker.check();
+            auto duration =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start);
+            if (result == QuorumIntersectionChecker::Result::SPLIT)
+            {
+                CLOG(WARNING, "Herder")
+                    << "Quorums of the network do not all intersect, see "
+                       "/quorum?check=true";
+            }
+
+            std::lock_guard<std::mutex> lock(state->mMutex);
+            state->mRunning = false;
+            state->mChecked = true;
+            state->mLedger = ledger;
+            state->mResult = result;
+            state->mSplit = checker.getSplit();
+            state->mNodeCount = checker.getNodeCount();
+            state->mMainComponentSize = checker.getMainComponentSize();
+            state->mDuration = duration;
+        });
+    }
     return ret;
 }
 
@@ -983,6 +1378,7 @@ HerderImpl::restoreSCPState()
             Hash hash = sha256(xdr::xdr_to_opaque(qset));
             mPendingEnvelopes.addSCPQuorumSet(hash, qset);
         }
+        invalidateJsonInfo();
         for (auto const& e : latestEnvs)
         {
             getSCP().setStateFromEnvelope(e.statement.slotIndex, e);
@@ -1062,38 +1458,53 @@ HerderImpl::updatePendingTransactions(
     // remove all these tx from mPendingTransactions
     removeReceivedTxs(applied);
 
-    // drop the highest level
-    mPendingTransactions.erase(--mPendingTransactions.end());
-
-    // shift entries up
-    mPendingTransactions.emplace_front();
+    // shift entries up, dropping the highest level
+    mPendingTransactions.shift();
 
-    // rebroadcast entries, sorted in apply-order to maximize chances of
-    // propagation
+    // rebroadcast entries to the peers not known to have them (see
+    // Floodgate), those of the best paying accounts first, each account's in
+    // sequence number order so that they can be applied as they arrive, up
+    // to PENDING_TRANSACTIONS_REBROADCAST_BYTES (counting advertised ones as
+    // sent); the rest waits for the next ledger
     {
-        Hash h;
-        TxSetFrame toBroadcast(h);
-        for (auto const& l : mPendingTransactions)
+        auto maxBytes = mApp.getConfig().PENDING_TRANSACTIONS_REBROADCAST_BYTES;
+        auto txs = mPendingTransactions.getTopTransactions(
+            mPendingTransactions.size());
+        size_t sentBytes = 0;
+        size_t sent = 0;
+        size_t processed = 0;
+        for (; processed < txs.size(); ++processed)
         {
-            for (auto const& pair : l)
+            if (maxBytes != 0 && sentBytes >= maxBytes)
             {
-                for (auto const& tx : pair.second->mTransactions)
-                {
-                    toBroadcast.add(tx.second);
-                }
+                break;
+            }
+            auto const& tx = txs[processed];
+            auto bytes = tx->toStellarMessageBytes();
+            auto told = mApp.getOverlayManager().broadcastMessage(
+                tx->toStellarMessage(), bytes);
+            if (told != 0)
+            {
+                sentBytes += told * bytes.size();
+                ++sent;
             }
         }
-        for (auto tx : toBroadcast.sortForApply())
-        {
-            auto msg = tx->toStellarMessage();
-            mApp.getOverlayManager().broadcastMessage(msg);
-        }
+        mSCPMetrics.mHerderPendingTxsRebroadcast.Mark(sent);
+        mSCPMetrics.mHerderPendingTxsRebroadcastBytes.Mark(sentBytes);
+        mSCPMetrics.mHerderPendingTxsRebroadcastDeferred.Mark(txs.size() -
+                                                              processed);
     }
 
-    mSCPMetrics.mHerderPendingTxs0.set_count(countTxs(mPendingTransactions[0]));
-    mSCPMetrics.mHerderPendingTxs1.set_count(countTxs(mPendingTransactions[1]));
-    mSCPMetrics.mHerderPendingTxs2.set_count(countTxs(mPendingTransactions[2]));
-    mSCPMetrics.mHerderPendingTxs3.set_count(countTxs(mPendingTransactions[3]));
+    mSCPMetrics.mHerderPendingTxs0.set_count(
+        mPendingTransactions.countAtAge(0));
+    mSCPMetrics.mHerderPendingTxs1.set_count(
+        mPendingTransactions.countAtAge(1));
+    mSCPMetrics.mHerderPendingTxs2.set_count(
+        mPendingTransactions.countAtAge(2));
+    mSCPMetrics.mHerderPendingTxs3.set_count(
+        mPendingTransactions.countAtAge(3));
+    mSCPMetrics.mHerderPendingTxsBytes.set_count(
+        mPendingTransactions.getBytes());
 }
 
 void
@@ -7,11 +7,16 @@
 #include "PendingEnvelopes.h"
 #include "herder/Herder.h"
 #include "herder/HerderSCPDriver.h"
+#include "herder/QuorumIntersectionChecker.h"
+#include "herder/TransactionQueue.h"
 #include "herder/Upgrades.h"
 #include "util/Timer.h"
 #include "util/XDROperators.h"
 #include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -34,6 +39,10 @@ class HerderSCPDriver;
 class HerderImpl : public Herder
 {
   public:
+    // Every this many rebroadcasts, our latest envelopes go to all peers,
+    // see rebroadcast.
+    static uint64_t const REBROADCAST_FORCE_PERIOD = 5;
+
     HerderImpl(Application& app);
     ~HerderImpl();
 
@@ -41,6 +50,7 @@ class HerderImpl : public Herder
     std::string getStateHuman() const override;
 
     void syncMetrics() override;
+    void syncMemoryMetrics() override;
 
     // Bootstraps the HerderImpl if we're creating a new Network
     void bootstrap() override;
@@ -60,6 +70,7 @@ class HerderImpl : public Herder
     TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) override;
 
     EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope) override;
+    void queueSCPEnvelope(SCPEnvelope const& envelope) override;
     EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope,
                                    const SCPQuorumSet& qset,
                                    TxSetFrame txset) override;
@@ -70,6 +81,7 @@ class HerderImpl : public Herder
     bool recvTxSet(Hash const& hash, const TxSetFrame& txset) override;
     void peerDoesntHave(MessageType type, uint256 const& itemID,
                         Peer::pointer peer) override;
+    void recvTxSetProgress(Hash const& hash) override;
     TxSetFramePtr getTxSet(Hash const& hash) override;
     SCPQuorumSetPtr getQSet(Hash const& qSetHash) override;
 
@@ -89,34 +101,69 @@ class HerderImpl : public Herder
     Json::Value getJsonInfo(size_t limit) override;
     Json::Value getJsonQuorumInfo(NodeID const& id, bool summary,
                                   uint64 index) override;
-
-    struct TxMap
-    {
-        SequenceNumber mMaxSeq{0};
-        int64_t mTotalFees{0};
-        std::unordered_map<Hash, TransactionFramePtr> mTransactions;
-        void addTx(TransactionFramePtr);
-        void recalculate();
-    };
-    typedef std::unordered_map<AccountID, std::shared_ptr<TxMap>> AccountTxMap;
+    Json::Value checkQuorumIntersection() override;
 
   private:
     void ledgerClosed();
     void removeReceivedTxs(std::vector<TransactionFramePtr> const& txs);
 
+    // Most pending transactions considered for a transaction set.
+    size_t getMaxTxSetCandidates() const;
+
+    // Has the workers check, while the ledger `applying` closes, the
+    // signatures of the transactions likely to be nominated next: those of
+    // the candidates that verify against their source account's master key
+    // hit the verify cache once triggerNextLedger trims the set.
+    void prepareNextLedger(TxSetFrame const& applying);
+
     void startRebroadcastTimer();
     void rebroadcast();
-    void broadcast(SCPEnvelope const& e);
+    // to all peers if `force`, otherwise to those the Floodgate does not
+    // know to have `e`
+    void broadcast(SCPEnvelope const& e, bool force = true);
 
     void updateSCPCounters();
 
     void processSCPQueueUpToIndex(uint64 slotIndex);
 
+    // whether envelopes for `slotIndex` are worth processing
+    bool isSlotInRange(uint64 slotIndex);
+
+    // Envelopes queued by queueSCPEnvelope, the first mInFlight of which
+    // are being checked by a worker. The worker hands the results back only
+    // if this is still around.
+    struct EnvelopeVerificationQueue
+    {
+        HerderImpl& mHerder;
+        std::deque<SCPEnvelope> mEnvelopes;
+        size_t mInFlight{0};
+
+        EnvelopeVerificationQueue(HerderImpl& herder) : mHerder(herder)
+        {
+        }
+    };
+    std::shared_ptr<EnvelopeVerificationQueue> mEnvelopeVerification;
+    // checks the signatures of all the envelopes queued
+    void verifyQueuedEnvelopes();
+    // passes on the envelopes in flight, `valid` telling which are signed
+    void envelopesVerified(std::vector<bool> const& valid);
+
+    // SCP_MESSAGEs for the current state of a slot, serialized once and
+    // reused by sendSCPStateToPeer for as long as that state is unchanged
+    struct SCPStateCache
+    {
+        std::vector<StellarMessage> mMessages;
+        std::vector<xdr::opaque_vec<>> mBytes;
+    };
+    std::map<uint64, SCPStateCache> mSCPStateCache;
+    SCPStateCache const& getSCPStateCache(uint64 slotIndex);
+
+    // transactions by age:
     // 0- tx we got during ledger close
     // 1- one ledger ago. rebroadcast
     // 2- two ledgers ago. rebroadcast
     // ...
-    std::deque<AccountTxMap> mPendingTransactions;
+    TransactionQueue mPendingTransactions;
 
     void
     updatePendingTransactions(std::vector<TransactionFramePtr> const& applied);
@@ -136,6 +183,45 @@ class HerderImpl : public Herder
 
     // saves the SCP messages that the instance sent out last
     void persistSCPState(uint64 slot);
+
+    // Results of getJsonInfo and getJsonQuorumInfo, which monitoring polls,
+    // kept until SCP or pending envelope state may have changed: envelopes
+    // received, emitted or restored, items fetched, and ledgers closed.
+    std::map<size_t, Json::Value> mJsonInfoCache;
+    std::map<std::tuple<NodeID, bool, uint64>, Json::Value>
+        mJsonQuorumInfoCache;
+    void invalidateJsonInfo();
+
+    // The latest quorum set of each node in the SCP state of the slots known,
+    // or nullptr for the nodes named whose quorum set is not known.
+    QuorumIntersectionChecker::QuorumMap getCurrentQuorumMap();
+
+    // Outcome of checkQuorumIntersection, shared with the worker thread
+    // running it; interrupted when the herder goes away.
+    struct QuorumIntersectionState
+    {
+        std::mutex mMutex;
+        bool mRunning{false};
+        bool mChecked{false};
+        uint32_t mLedger{0};
+        QuorumIntersectionChecker::Result mResult{
+            QuorumIntersectionChecker::Result::UNKNOWN};
+        std::pair<std::vector<NodeID>, std::vector<NodeID>> mSplit;
+        size_t mNodeCount{0};
+        size_t mMainComponentSize{0};
+        std::chrono::milliseconds mDuration{0};
+        std::atomic<bool> mInterrupt{false};
+    };
+    std::shared_ptr<QuorumIntersectionState> mQuorumIntersection;
+
+    // Envelopes emitted during a crank are queued, the SCP state saved once
+    // for all of them at the end of the crank, and only then broadcast: the
+    // state must be persisted before peers see the statements it holds.
+    // Flushed early before a value is externalized.
+    void queueEmittedEnvelope(SCPEnvelope const& envelope);
+    void flushEmittedEnvelopes();
+    std::vector<SCPEnvelope> mEmittedEnvelopes;
+    VirtualTimer mFlushEmittedTimer;
     // restores SCP state based on the last messages saved on disk
     void restoreSCPState();
 
@@ -151,6 +237,7 @@ class HerderImpl : public Herder
     VirtualTimer mTriggerTimer;
 
     VirtualTimer mRebroadcastTimer;
+    uint64_t mRebroadcastCount{0};
 
     Application& mApp;
     LedgerManager& mLedgerManager;
@@ -163,6 +250,10 @@ class HerderImpl : public Herder
 
         medida::Meter& mEnvelopeEmit;
         medida::Meter& mEnvelopeReceive;
+        medida::Meter& mEnvelopeInvalidSig;
+
+        medida::Meter& mStateCacheHit;
+        medida::Meter& mStateCacheMiss;
 
         // Counters for stuff in parent class (SCP)
         // that we monitor on a best-effort basis from
@@ -173,11 +264,22 @@ class HerderImpl : public Herder
         // SCP maps: Slots and Nodes
         medida::Counter& mCumulativeStatements;
 
+        // Approximate bytes, see syncMemoryMetrics
+        medida::Counter& mKnownSlotsBytes;
+        medida::Counter& mPendingEnvelopesBytes;
+        medida::Counter& mItemFetchBytes;
+
         // Pending tx buffer sizes
         medida::Counter& mHerderPendingTxs0;
         medida::Counter& mHerderPendingTxs1;
         medida::Counter& mHerderPendingTxs2;
         medida::Counter& mHerderPendingTxs3;
+        medida::Counter& mHerderPendingTxsBytes;
+        medida::Meter& mHerderPendingTxsEvicted;
+        // sent again after a ledger closed, see updatePendingTransactions
+        medida::Meter& mHerderPendingTxsRebroadcast;
+        medida::Meter& mHerderPendingTxsRebroadcastBytes;
+        medida::Meter& mHerderPendingTxsRebroadcastDeferred;
 
         SCPMetrics(Application& app);
     };
@@ -32,12 +32,25 @@ class HerderPersistence
     virtual void saveSCPHistory(uint32_t seq,
                                 std::vector<SCPEnvelope> const& envs) = 0;
 
+    // Writes the SCP history of ledgers [ledgerSeq, ledgerSeq + ledgerCount)
+    // to `scpHistory`, from the SCP history store when SCP_HISTORY_DIR_PATH
+    // is set, from the database (through `sess`) otherwise. Returns the
+    // number of messages written.
+    virtual size_t copySCPHistoryToStream(soci::session& sess,
+                                          uint32_t ledgerSeq,
+                                          uint32_t ledgerCount,
+                                          XDROutputFileStream& scpHistory) = 0;
+    // Deletes old SCP history from the database and, when enabled, from the
+    // SCP history store (where it goes one checkpoint at a time). Returns
+    // the ledger up to which the database holds no more of it.
+    virtual uint32_t deleteOldEntries(uint32_t ledgerSeq, uint32_t count) = 0;
+
     static size_t copySCPHistoryToStream(Database& db, soci::session& sess,
                                          uint32_t ledgerSeq,
                                          uint32_t ledgerCount,
                                          XDROutputFileStream& scpHistory);
     static void dropAll(Database& db);
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                 uint32_t count);
+    static uint32_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                     uint32_t count);
 };
 }
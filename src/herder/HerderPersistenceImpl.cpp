@@ -7,11 +7,14 @@
 #include "database/Database.h"
 #include "database/DatabaseUtils.h"
 #include "herder/Herder.h"
+#include "history/HistoryManager.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "scp/Slot.h"
 #include "util/Decoder.h"
 #include "util/XDRStream.h"
 
+#include <algorithm>
 #include <soci.h>
 #include <xdrpp/marshal.h>
 
@@ -32,6 +35,23 @@ HerderPersistenceImpl::~HerderPersistenceImpl()
 {
 }
 
+SCPHistoryFileStore*
+HerderPersistenceImpl::getFileStore()
+{
+    auto const& dir = mApp.getConfig().SCP_HISTORY_DIR_PATH;
+    if (dir.empty())
+    {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mFileStoreMutex);
+    if (!mFileStore)
+    {
+        mFileStore = std::make_unique<SCPHistoryFileStore>(
+            dir, mApp.getHistoryManager().getCheckpointFrequency());
+    }
+    return mFileStore.get();
+}
+
 void
 HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
                                       std::vector<SCPEnvelope> const& envs)
@@ -41,7 +61,21 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
         return;
     }
 
-    auto usedQSets = std::unordered_map<Hash, SCPQuorumSetPtr>{};
+    auto usedQSets = std::map<Hash, SCPQuorumSetPtr>{};
+    auto store = getFileStore();
+    if (store)
+    {
+        for (auto const& e : envs)
+        {
+            auto const& qHash =
+                Slot::getCompanionQuorumSetHashFromStatement(e.statement);
+            usedQSets.insert(
+                std::make_pair(qHash, mApp.getHerder().getQSet(qHash)));
+        }
+        store->save(seq, envs, usedQSets);
+        return;
+    }
+
     auto& db = mApp.getDatabase();
 
     soci::transaction txscope(db.getSession());
@@ -58,6 +92,11 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
             st.execute(true);
         }
     }
+    // all the envelopes, then all the quorum sets, in one statement each
+    using DatabaseUtils::BulkColumn;
+    std::vector<BulkColumn> envCols{{"nodeid", "TEXT"},
+                                    {"ledgerseq", "INT"},
+                                    {"envelope", "TEXT"}};
     for (auto const& e : envs)
     {
         auto const& qHash =
@@ -65,78 +104,54 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
         usedQSets.insert(
             std::make_pair(qHash, mApp.getHerder().getQSet(qHash)));
 
-        std::string nodeIDStrKey = KeyUtils::toStrKey(e.statement.nodeID);
-
-        auto envelopeBytes(xdr::xdr_to_opaque(e));
-
-        std::string envelopeEncoded;
-        envelopeEncoded = decoder::encode_b64(envelopeBytes);
-
-        auto prepEnv =
-            db.getPreparedStatement("INSERT INTO scphistory "
-                                    "(nodeid, ledgerseq, envelope) VALUES "
-                                    "(:n, :l, :e)");
-
-        auto& st = prepEnv.statement();
-        st.exchange(soci::use(nodeIDStrKey));
-        st.exchange(soci::use(seq));
-        st.exchange(soci::use(envelopeEncoded));
-        st.define_and_bind();
-        {
-            auto timer = db.getInsertTimer("scphistory");
-            st.execute(true);
-        }
-        if (st.get_affected_rows() != 1)
-        {
-            throw std::runtime_error("Could not update data in SQL");
-        }
+        envCols[0].push(KeyUtils::toStrKey(e.statement.nodeID));
+        envCols[1].push(std::to_string(seq));
+        envCols[2].push(decoder::encode_b64(xdr::xdr_to_opaque(e)));
     }
+    DatabaseUtils::bulkInsert(db, "scphistory", "scphistory", envCols);
 
+    std::vector<BulkColumn> qSetCols{{"qsethash", "TEXT"},
+                                     {"lastledgerseq", "INT"},
+                                     {"qset", "TEXT"}};
     for (auto const& p : usedQSets)
     {
-        std::string qSetH = binToHex(p.first);
-
-        auto prepUpQSet =
-            db.getPreparedStatement("UPDATE scpquorums SET "
-                                    "lastledgerseq = :l WHERE qsethash = :h");
-
-        auto& stUp = prepUpQSet.statement();
-        stUp.exchange(soci::use(seq));
-        stUp.exchange(soci::use(qSetH));
-        stUp.define_and_bind();
-        {
-            auto timer = db.getInsertTimer("scpquorums");
-            stUp.execute(true);
-        }
-        if (stUp.get_affected_rows() != 1)
-        {
-            auto qSetBytes(xdr::xdr_to_opaque(*p.second));
-
-            std::string qSetEncoded;
-            qSetEncoded = decoder::encode_b64(qSetBytes);
+        qSetCols[0].push(binToHex(p.first));
+        qSetCols[1].push(std::to_string(seq));
+        qSetCols[2].push(decoder::encode_b64(xdr::xdr_to_opaque(*p.second)));
+    }
+    DatabaseUtils::bulkUpsert(db, "scpquorums", "scpquorums", {"qsethash"},
+                              qSetCols);
 
-            auto prepInsQSet = db.getPreparedStatement(
-                "INSERT INTO scpquorums "
-                "(qsethash, lastledgerseq, qset) VALUES "
-                "(:h, :l, :v);");
+    txscope.commit();
+}
 
-            auto& stIns = prepInsQSet.statement();
-            stIns.exchange(soci::use(qSetH));
-            stIns.exchange(soci::use(seq));
-            stIns.exchange(soci::use(qSetEncoded));
-            stIns.define_and_bind();
-            {
-                auto timer = db.getInsertTimer("scpquorums");
-                stIns.execute(true);
-            }
-            if (stIns.get_affected_rows() != 1)
-            {
-                throw std::runtime_error("Could not update data in SQL");
-            }
-        }
+size_t
+HerderPersistenceImpl::copySCPHistoryToStream(soci::session& sess,
+                                              uint32_t ledgerSeq,
+                                              uint32_t ledgerCount,
+                                              XDROutputFileStream& scpHistory)
+{
+    auto store = getFileStore();
+    if (store)
+    {
+        return store->copyToStream(ledgerSeq, ledgerCount, scpHistory);
     }
+    return HerderPersistence::copySCPHistoryToStream(
+        mApp.getDatabase(), sess, ledgerSeq, ledgerCount, scpHistory);
+}
 
-    txscope.commit();
+uint32_t
+HerderPersistenceImpl::deleteOldEntries(uint32_t ledgerSeq, uint32_t count)
+{
+    // history saved before the store was enabled stays in the database
+    auto res = HerderPersistence::deleteOldEntries(mApp.getDatabase(),
+                                                   ledgerSeq, count);
+    auto store = getFileStore();
+    if (store)
+    {
+        store->deleteOldEntries(ledgerSeq, count);
+    }
+    return res;
 }
 
 size_t
@@ -266,13 +281,14 @@ HerderPersistence::dropAll(Database& db)
                        ")";
 }
 
-void
+uint32_t
 HerderPersistence::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                     uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "scphistory", "ledgerseq");
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "scpquorums", "lastledgerseq");
+    auto envs = DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "scphistory", "ledgerseq");
+    auto qsets = DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "scpquorums", "lastledgerseq");
+    return std::min(envs, qsets);
 }
 }
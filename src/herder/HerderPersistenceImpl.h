@@ -5,6 +5,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "herder/HerderPersistence.h"
+#include "herder/SCPHistoryFileStore.h"
+
+#include <memory>
+#include <mutex>
 
 namespace stellar
 {
@@ -19,8 +23,18 @@ class HerderPersistenceImpl : public HerderPersistence
 
     void saveSCPHistory(uint32_t seq,
                         std::vector<SCPEnvelope> const& envs) override;
+    size_t copySCPHistoryToStream(soci::session& sess, uint32_t ledgerSeq,
+                                  uint32_t ledgerCount,
+                                  XDROutputFileStream& scpHistory) override;
+    uint32_t deleteOldEntries(uint32_t ledgerSeq, uint32_t count) override;
 
   private:
     Application& mApp;
+
+    // opened on first use, as it needs the history manager
+    std::mutex mFileStoreMutex;
+    std::unique_ptr<SCPHistoryFileStore> mFileStore;
+    // nullptr unless SCP_HISTORY_DIR_PATH is set
+    SCPHistoryFileStore* getFileStore();
 };
 }
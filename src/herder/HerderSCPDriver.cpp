@@ -15,6 +15,9 @@
 #include "util/Logging.h"
 #include "xdr/Stellar-SCP.h"
 #include "xdr/Stellar-ledger-entries.h"
+#include <algorithm>
+#include <medida/counter.h>
+#include <medida/histogram.h>
 #include <medida/metrics_registry.h>
 #include <util/format.h>
 #include <xdrpp/marshal.h>
@@ -53,13 +56,18 @@ HerderSCPDriver::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewCounter({"herder", "state", "current"}))
     , mHerderStateChanges(
           app.getMetrics().NewTimer({"herder", "state", "changes"}))
-    , mNominateToPrepare(
-          app.getMetrics().NewTimer({"scp", "timing", "nominated"}))
-    , mPrepareToExternalize(
-          app.getMetrics().NewTimer({"scp", "timing", "externalized"}))
+    , mNominateToPrepare(app.getLatencyHistograms().NewTimer(
+          {"scp", "timing", "nominated"}))
+    , mPrepareToExternalize(app.getLatencyHistograms().NewTimer(
+          {"scp", "timing", "externalized"}))
+    , mTimeout(app.getMetrics().NewHistogram({"scp", "timeout", "computed"}))
+    , mLatencyEstimate(
+          app.getMetrics().NewCounter({"scp", "timeout", "latency"}))
 {
 }
 
+std::chrono::milliseconds const HerderSCPDriver::MIN_ADAPTIVE_TIMEOUT(250);
+
 HerderSCPDriver::HerderSCPDriver(Application& app, HerderImpl& herder,
                                  Upgrades const& upgrades,
                                  PendingEnvelopes& pendingEnvelopes)
@@ -73,6 +81,7 @@ HerderSCPDriver::HerderSCPDriver(Application& app, HerderImpl& herder,
     , mSCPMetrics{mApp}
     , mLastStateChange{mApp.getClock().now()}
 {
+    mSCP.setMaxStatementsHistory(mApp.getConfig().SCP_MAX_STATEMENTS_HISTORY);
 }
 
 HerderSCPDriver::~HerderSCPDriver()
@@ -448,7 +457,8 @@ HerderSCPDriver::setupTimer(uint64_t slotIndex, int timerID,
     auto it = slotTimers.find(timerID);
     if (it == slotTimers.end())
     {
-        it = slotTimers.emplace(timerID, std::make_unique<VirtualTimer>(mApp))
+        it = slotTimers
+                 .emplace(timerID, std::make_unique<VirtualTimer>(mApp, "scp"))
                  .first;
     }
     auto& timer = *it->second;
@@ -460,6 +470,76 @@ HerderSCPDriver::setupTimer(uint64_t slotIndex, int timerID,
     }
 }
 
+std::chrono::milliseconds
+HerderSCPDriver::computeTimeout(uint32 roundNumber)
+{
+    auto timeout = SCPDriver::computeTimeout(roundNumber);
+    auto latency = getLatencyEstimate();
+    if (mApp.getConfig().SCP_ADAPTIVE_TIMEOUTS && latency)
+    {
+        auto step = std::max(MIN_ADAPTIVE_TIMEOUT,
+                             ADAPTIVE_TIMEOUT_FACTOR * *latency);
+        timeout = std::min(timeout, step * roundNumber);
+    }
+    mSCPMetrics.mTimeout.Update(timeout.count());
+    return timeout;
+}
+
+void
+HerderSCPDriver::envelopeReceived(uint64_t slotIndex, NodeID const& nodeID)
+{
+    auto now = mApp.getClock().now();
+    auto res = mSlotArrivals.emplace(slotIndex, SlotArrivals{now, {}});
+    auto& arrivals = res.first->second;
+    arrivals.mDelays.emplace(nodeID, now - arrivals.mFirst);
+}
+
+optional<std::chrono::milliseconds>
+HerderSCPDriver::getLatencyEstimate() const
+{
+    optional<std::chrono::milliseconds> res;
+    if (mSlotLatencies.size() >= ADAPTIVE_TIMEOUT_MIN_SLOTS)
+    {
+        auto latency =
+            *std::max_element(mSlotLatencies.begin(), mSlotLatencies.end());
+        // rounded up
+        res = make_optional<std::chrono::milliseconds>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                latency + std::chrono::milliseconds(1) -
+                std::chrono::nanoseconds(1)));
+    }
+    return res;
+}
+
+void
+HerderSCPDriver::recordSlotLatency(uint64_t slotIndex)
+{
+    auto it = mSlotArrivals.find(slotIndex);
+    if (it != mSlotArrivals.end())
+    {
+        std::vector<std::chrono::nanoseconds> delays;
+        for (auto const& d : it->second.mDelays)
+        {
+            delays.emplace_back(d.second);
+        }
+        // by when two thirds of the nodes heard from were
+        auto nth = delays.begin() + (delays.size() * 2 + 2) / 3 - 1;
+        std::nth_element(delays.begin(), nth, delays.end());
+        mSlotLatencies.emplace_back(*nth);
+        if (mSlotLatencies.size() > ADAPTIVE_TIMEOUT_SLOTS)
+        {
+            mSlotLatencies.pop_front();
+        }
+        auto latency = getLatencyEstimate();
+        if (latency)
+        {
+            mSCPMetrics.mLatencyEstimate.set_count(latency->count());
+        }
+    }
+    mSlotArrivals.erase(mSlotArrivals.begin(),
+                        mSlotArrivals.upper_bound(slotIndex));
+}
+
 // core SCP
 
 Value
@@ -616,6 +696,8 @@ HerderSCPDriver::valueExternalized(uint64_t slotIndex, Value const& value)
         return;
     }
 
+    recordSlotLatency(slotIndex);
+
     StellarValue b;
     try
     {
@@ -815,7 +897,7 @@ HerderSCPDriver::recordSCPExecutionMetrics(uint64_t slotIndex)
     auto& SCPTiming = SCPTimingIt->second;
 
     auto recordTiming = [&](VirtualClock::time_point start,
-                            VirtualClock::time_point end, medida::Timer& timer,
+                            VirtualClock::time_point end, HistogramTimer& timer,
                             std::string const& logStr) {
         auto delta =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
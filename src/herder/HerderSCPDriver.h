@@ -7,11 +7,15 @@
 #include "herder/Herder.h"
 #include "herder/TxSetFrame.h"
 #include "scp/SCPDriver.h"
+#include "util/LatencyHistogram.h"
 #include "xdr/Stellar-ledger.h"
 
+#include <deque>
+
 namespace medida
 {
 class Counter;
+class Histogram;
 class Meter;
 class Timer;
 }
@@ -110,6 +114,28 @@ class HerderSCPDriver : public SCPDriver
                     std::chrono::milliseconds timeout,
                     std::function<void()> cb) override;
 
+    // With SCP_ADAPTIVE_TIMEOUTS, the timeouts of the default schedule are
+    // shortened to what the latency of the quorum calls for: each round
+    // waits ADAPTIVE_TIMEOUT_FACTOR times the latency estimate (see
+    // getLatencyEstimate) more than the previous one, at least
+    // MIN_ADAPTIVE_TIMEOUT more.
+    std::chrono::milliseconds computeTimeout(uint32 roundNumber) override;
+
+    // Records when an envelope of `nodeID` for `slotIndex` came in, for the
+    // latency estimate.
+    void envelopeReceived(uint64_t slotIndex, NodeID const& nodeID);
+
+    // How long after the first envelope of a slot came in the envelopes of
+    // two thirds of the nodes heard from came in, at most, over the last
+    // ADAPTIVE_TIMEOUT_SLOTS slots externalized; none until
+    // ADAPTIVE_TIMEOUT_MIN_SLOTS were.
+    optional<std::chrono::milliseconds> getLatencyEstimate() const;
+
+    static size_t const ADAPTIVE_TIMEOUT_SLOTS = 20;
+    static size_t const ADAPTIVE_TIMEOUT_MIN_SLOTS = 5;
+    static uint32 const ADAPTIVE_TIMEOUT_FACTOR = 4;
+    static std::chrono::milliseconds const MIN_ADAPTIVE_TIMEOUT;
+
     // core SCP
     Value combineCandidates(uint64_t slotIndex,
                             std::set<Value> const& candidates) override;
@@ -170,8 +196,13 @@ class HerderSCPDriver : public SCPDriver
         medida::Timer& mHerderStateChanges;
 
         // Timers for nomination and ballot protocols
-        medida::Timer& mNominateToPrepare;
-        medida::Timer& mPrepareToExternalize;
+        HistogramTimer mNominateToPrepare;
+        HistogramTimer mPrepareToExternalize;
+
+        // Timeouts, in milliseconds, and the latency estimate they are based
+        // on
+        medida::Histogram& mTimeout;
+        medida::Counter& mLatencyEstimate;
 
         SCPMetrics(Application& app);
     };
@@ -189,6 +220,20 @@ class HerderSCPDriver : public SCPDriver
     // * first prepare to externalize
     std::map<uint64_t, SCPTiming> mSCPExecutionTimes;
 
+    struct SlotArrivals
+    {
+        VirtualClock::time_point mFirst;
+        // delay since mFirst of the first envelope of each node
+        std::map<NodeID, std::chrono::nanoseconds> mDelays;
+    };
+
+    // envelope arrivals of the slots not externalized yet, and the latency
+    // they showed, for the last slots that were
+    std::map<uint64_t, SlotArrivals> mSlotArrivals;
+    std::deque<std::chrono::nanoseconds> mSlotLatencies;
+
+    void recordSlotLatency(uint64_t slotIndex);
+
     uint32_t mLedgerSeqNominating;
     Value mCurrentValue;
 
@@ -17,10 +17,14 @@
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/CommandHandler.h"
 #include "overlay/OverlayManager.h"
 #include "test/TxTests.h"
+#include "transactions/ApplyCostModel.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "xdrpp/marshal.h"
 
 using namespace stellar;
@@ -218,6 +222,35 @@ TEST_CASE("standalone", "[herder]")
 //  account can't pay for all the tx
 //  account has just enough for all the tx
 //  tx from account not in the DB
+TEST_CASE("json info follows SCP state", "[herder]")
+{
+    SIMULATION_CREATE_NODE(0);
+
+    Config cfg(getTestConfig());
+    cfg.NODE_SEED = v0SecretKey;
+    cfg.QUORUM_SET.threshold = 1;
+    cfg.QUORUM_SET.validators.clear();
+    cfg.QUORUM_SET.validators.push_back(v0NodeID);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& herder = app->getHerder();
+    auto info = herder.getJsonInfo(2);
+    auto quorum = herder.getJsonQuorumInfo(v0NodeID, false, 0);
+    REQUIRE(herder.getJsonInfo(2) == info);
+    REQUIRE(herder.getJsonQuorumInfo(v0NodeID, false, 0) == quorum);
+
+    auto lcl = app->getLedgerManager().getLastClosedLedgerNum();
+    while (app->getLedgerManager().getLastClosedLedgerNum() == lcl)
+    {
+        clock.crank(true);
+    }
+    REQUIRE(herder.getJsonInfo(2) != info);
+    REQUIRE(herder.getJsonQuorumInfo(v0NodeID, false, 0) != quorum);
+}
+
 TEST_CASE("recvTx", "[herder]")
 {
 }
@@ -365,11 +398,113 @@ TEST_CASE("txset", "[herder]")
     }
 }
 
+TEST_CASE("txset hash and apply order are cached", "[herder]")
+{
+    Config cfg(getTestConfig());
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a = root.create("a", app->getLedgerManager().getMinBalance(0) * 10);
+
+    TxSetFrame txSet(app->getLedgerManager().getLastClosedLedgerHeader().hash);
+    txSet.add(root.tx({payment(a, 100)}));
+    txSet.add(a.tx({payment(root, 100)}));
+
+    uint64_t hashes, applyOrders;
+    TxSetFrame::flushComputeCounts(hashes, applyOrders);
+
+    auto hash = txSet.getContentsHash();
+    auto order = txSet.sortForApply();
+    txSet.sortForHash();
+    REQUIRE(txSet.getContentsHash() == hash);
+    REQUIRE(txSet.sortForApply() == order);
+    TxSetFrame::flushComputeCounts(hashes, applyOrders);
+    REQUIRE(hashes == 1);
+    REQUIRE(applyOrders == 1);
+
+    SECTION("invalidated by changes")
+    {
+        auto tx = root.tx({payment(a, 200)});
+        txSet.add(tx);
+        REQUIRE(txSet.getContentsHash() != hash);
+        REQUIRE(txSet.sortForApply().size() == 3);
+
+        txSet.removeTx(tx);
+        REQUIRE(txSet.getContentsHash() == hash);
+        REQUIRE(txSet.sortForApply() == order);
+        TxSetFrame::flushComputeCounts(hashes, applyOrders);
+        REQUIRE(hashes == 2);
+        REQUIRE(applyOrders == 2);
+    }
+    SECTION("copies keep the cached values")
+    {
+        TxSetFrame copy(txSet);
+        REQUIRE(copy.getContentsHash() == hash);
+        REQUIRE(copy.sortForApply() == order);
+        TxSetFrame::flushComputeCounts(hashes, applyOrders);
+        REQUIRE(hashes == 0);
+        REQUIRE(applyOrders == 0);
+    }
+}
+
 // under surge
 // over surge
 // make sure it drops the correct txs
 // txs with high fee but low ratio
 // txs from same account high ratio with high seq
+TEST_CASE("txset partition for apply", "[herder]")
+{
+    Config cfg(getTestConfig());
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    int64_t const amount = app->getLedgerManager().getMinBalance(0) * 10;
+    auto a = root.create("a", amount);
+    auto b = root.create("b", amount);
+    auto c = root.create("c", amount);
+    auto d = root.create("d", amount);
+    auto e = root.create("e", amount);
+    auto f = root.create("f", amount);
+    auto usd = makeAsset(f, "USD");
+
+    std::vector<TransactionFramePtr> txs = {
+        a.tx({payment(b, 100)}), c.tx({payment(d, 100)}),
+        // shares b with the first
+        b.tx({payment(root, 100)}),
+        // unknown footprints end up together
+        e.tx({inflation()}),
+        f.tx({manageOffer(0, usd, makeNativeAsset(), Price{1, 1}, 100)}),
+        // a native-to-native path payment with no hops is a plain payment
+        a.tx({pathPayment(c, makeNativeAsset(), 100, makeNativeAsset(), 100,
+                          {})})};
+
+    SECTION("joined through shared accounts")
+    {
+        auto groups = TxSetFrame::partitionForApply(txs);
+        REQUIRE(groups.size() == 2);
+        REQUIRE(groups[0] == std::vector<TransactionFramePtr>{
+                                 txs[0], txs[1], txs[2], txs[5]});
+        REQUIRE(groups[1] == std::vector<TransactionFramePtr>{txs[3], txs[4]});
+    }
+    SECTION("independent")
+    {
+        txs.pop_back();
+        auto groups = TxSetFrame::partitionForApply(txs);
+        REQUIRE(groups.size() == 3);
+        REQUIRE(groups[0] == std::vector<TransactionFramePtr>{txs[0], txs[2]});
+        REQUIRE(groups[1] == std::vector<TransactionFramePtr>{txs[1]});
+        REQUIRE(groups[2] == std::vector<TransactionFramePtr>{txs[3], txs[4]});
+    }
+}
+
 TEST_CASE("surge", "[herder]")
 {
     Config cfg(getTestConfig());
@@ -483,10 +618,86 @@ TEST_CASE("surge", "[herder]")
     }
 }
 
+TEST_CASE("apply cost filter", "[herder]")
+{
+    using namespace std::chrono;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto destAccount = root.create("destAccount", 500000000);
+    auto accountB = root.create("accountB", 5000000000);
+
+    ApplyCostModel costs;
+    REQUIRE(costs.getOperationCost(PAYMENT) == ApplyCostModel::DEFAULT_COST);
+    costs.record(PAYMENT, microseconds(10));
+    costs.record(MANAGE_DATA, microseconds(1000));
+    REQUIRE(costs.getOperationCost(PAYMENT) == microseconds(10));
+    // not measured yet: the average of the others
+    REQUIRE(costs.getOperationCost(BUMP_SEQUENCE) == microseconds(505));
+    costs.record(PAYMENT, microseconds(30));
+    REQUIRE(costs.getOperationCost(PAYMENT) == microseconds(11));
+    costs.record(PAYMENT, microseconds(10));
+    REQUIRE(costs.getOperationCost(PAYMENT) > microseconds(10));
+    REQUIRE(costs.getOperationCost(PAYMENT) < microseconds(11));
+
+    TxSetFramePtr txSet = std::make_shared<TxSetFrame>(
+        app->getLedgerManager().getLastClosedLedgerHeader().hash);
+
+    // accountB pays more per operation, but much less per apply cost
+    DataValue value(std::vector<uint8_t>{1});
+    for (int n = 0; n < 5; n++)
+    {
+        txSet->add(root.tx({payment(destAccount, n + 10)}));
+        auto tx = accountB.tx({manageData("data" + std::to_string(n), &value)});
+        tx->getEnvelope().tx.fee = tx->getEnvelope().tx.fee * 2;
+        txSet->add(tx);
+    }
+
+    auto countFrom = [&](TestAccount const& account) {
+        return std::count_if(
+            txSet->mTransactions.begin(), txSet->mTransactions.end(),
+            [&](TransactionFramePtr const& tx) {
+                return tx->getSourceID() == account.getPublicKey();
+            });
+    };
+
+    SECTION("budget")
+    {
+        txSet->applyCostFilter(costs, 10, microseconds(1100));
+        REQUIRE(txSet->mTransactions.size() == 6);
+        REQUIRE(countFrom(root) == 5);
+        REQUIRE(countFrom(accountB) == 1);
+        REQUIRE(txSet->checkValid(*app));
+    }
+
+    SECTION("count")
+    {
+        txSet->applyCostFilter(costs, 3, hours(1));
+        REQUIRE(txSet->mTransactions.size() == 3);
+        REQUIRE(countFrom(root) == 3);
+        REQUIRE(txSet->checkValid(*app));
+    }
+
+    SECTION("first transaction always fits")
+    {
+        txSet->applyCostFilter(costs, 10, nanoseconds(1));
+        REQUIRE(txSet->mTransactions.size() == 1);
+        REQUIRE(countFrom(root) == 1);
+        REQUIRE(txSet->checkValid(*app));
+    }
+}
+
 TEST_CASE("SCP Driver", "[herder]")
 {
     Config cfg(getTestConfig());
     cfg.TESTING_UPGRADE_MAX_TX_PER_LEDGER = 5;
+    // the envelopes below come from root, which must be in quorum for them
+    // not to be dropped
+    cfg.QUORUM_SET.validators.emplace_back(
+        getRoot(sha256(cfg.NETWORK_PASSPHRASE)).getPublicKey());
 
     VirtualClock clock;
     Application::pointer app = createTestApplication(clock, cfg);
@@ -515,6 +726,7 @@ TEST_CASE("SCP Driver", "[herder]")
         // herder must want the TxSet before receiving it, so we are sending it
         // fake envelope
         auto envelope = SCPEnvelope{};
+        envelope.statement.nodeID = root.getPublicKey();
         envelope.statement.slotIndex = slotIndex;
         envelope.statement.pledges.type(SCP_ST_PREPARE);
         envelope.statement.pledges.prepare().ballot.value = p.first;
@@ -1128,3 +1340,110 @@ TEST_CASE("In quorum filtering", "[herder]")
         REQUIRE(!found[0]);
     });
 }
+
+TEST_CASE("quorum intersection check", "[herder][quorumcheck]")
+{
+    auto mode = Simulation::OVER_LOOPBACK;
+    auto networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+
+    auto sim = Topologies::core(4, 0.75, mode, networkID, [](int i) {
+        return getTestConfig(i, Config::TESTDB_ON_DISK_SQLITE);
+    });
+    sim->startAllNodes();
+    sim->crankUntil([&]() { return sim->haveAllExternalized(2, 1); },
+                    std::chrono::seconds(1), false);
+
+    // the check runs in the background, its outcome is there on a later call
+    auto node0 = sim->getNode(sim->getNodeIDs()[0]);
+    Json::Value res;
+    sim->crankUntil(
+        [&]() {
+            res = node0->getHerder().checkQuorumIntersection();
+            return res.isMember("result");
+        },
+        std::chrono::seconds(10), false);
+
+    REQUIRE(res["result"].asString() == "intersecting");
+    REQUIRE(res["node_count"].asUInt64() == 4);
+    REQUIRE(res["main_component_size"].asUInt64() == 4);
+}
+
+TEST_CASE("SCP envelope signature verification", "[herder]")
+{
+    auto sk = SecretKey::random();
+    Config cfg(getTestConfig());
+    cfg.QUORUM_SET.validators.emplace_back(sk.getPublicKey());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& herder = app->getHerder();
+    auto& receive =
+        app->getMetrics().NewMeter({"scp", "envelope", "receive"}, "envelope");
+    auto& invalidSig = app->getMetrics().NewMeter(
+        {"scp", "envelope", "invalidsig"}, "envelope");
+    auto received = receive.count();
+
+    auto makeEnvelope = [&](uint32_t ballot) {
+        SCPEnvelope envelope;
+        envelope.statement.nodeID = sk.getPublicKey();
+        envelope.statement.slotIndex = herder.getCurrentLedgerSeq();
+        envelope.statement.pledges.type(SCP_ST_PREPARE);
+        envelope.statement.pledges.prepare().ballot.counter = ballot;
+        envelope.signature = sk.sign(xdr::xdr_to_opaque(
+            app->getNetworkID(), ENVELOPE_TYPE_SCP, envelope.statement));
+        return envelope;
+    };
+
+    auto good = makeEnvelope(1);
+    auto bad = makeEnvelope(2);
+    bad.signature = good.signature;
+    herder.queueSCPEnvelope(good);
+    herder.queueSCPEnvelope(bad);
+    herder.queueSCPEnvelope(good);
+    // nothing reaches recvSCPEnvelope before its signature is checked
+    REQUIRE(receive.count() == received);
+
+    while (receive.count() < received + 2 || invalidSig.count() < 1)
+    {
+        clock.crank(true);
+    }
+    REQUIRE(receive.count() == received + 2);
+    REQUIRE(invalidSig.count() == 1);
+}
+
+TEST_CASE("adaptive SCP timeouts", "[herder]")
+{
+    auto mode = Simulation::OVER_LOOPBACK;
+    auto networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+
+    auto sim = Topologies::core(3, 1, mode, networkID, [](int i) {
+        auto cfg = getTestConfig(i, Config::TESTDB_ON_DISK_SQLITE);
+        cfg.SCP_ADAPTIVE_TIMEOUTS = true;
+        return cfg;
+    });
+    sim->startAllNodes();
+
+    auto node0 = sim->getNode(sim->getNodeIDs()[0]);
+    auto& driver =
+        static_cast<HerderImpl&>(node0->getHerder()).getHerderSCPDriver();
+    REQUIRE(!driver.getLatencyEstimate());
+    REQUIRE(driver.computeTimeout(1) == std::chrono::seconds(1));
+
+    auto lcl = node0->getLedgerManager().getLastClosedLedgerNum();
+    auto slots =
+        static_cast<uint32>(HerderSCPDriver::ADAPTIVE_TIMEOUT_MIN_SLOTS);
+    sim->crankUntil(
+        [&]() { return sim->haveAllExternalized(lcl + slots, 1); },
+        2 * slots * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    // the loopback quorum has next to no latency
+    auto latency = driver.getLatencyEstimate();
+    REQUIRE(latency);
+    REQUIRE(*latency < HerderSCPDriver::MIN_ADAPTIVE_TIMEOUT);
+    REQUIRE(driver.computeTimeout(1) == HerderSCPDriver::MIN_ADAPTIVE_TIMEOUT);
+    REQUIRE(driver.computeTimeout(4) ==
+            4 * HerderSCPDriver::MIN_ADAPTIVE_TIMEOUT);
+    // never beyond the fixed schedule
+    REQUIRE(driver.computeTimeout(100000) == std::chrono::minutes(30));
+}
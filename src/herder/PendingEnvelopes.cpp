@@ -6,31 +6,76 @@
 #include "herder/TxSetFrame.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "scp/LocalNode.h"
 #include "scp/QuorumSetUtils.h"
+#include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
 #include <overlay/OverlayManager.h>
 #include <scp/Slot.h>
 #include <xdrpp/marshal.h>
 
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <limits>
+
 using namespace std;
 
-#define QSET_CACHE_SIZE 10000
-#define TXSET_CACHE_SIZE 10000
-#define NODES_QUORUM_CACHE_SIZE 1000
 
 namespace stellar
 {
 
+namespace
+{
+// Erases the least recently used items of `cache` not in `keep` until its
+// `bytes` are within `maxBytes`; returns the bytes left.
+template <typename V, typename F>
+size_t
+evictLeastRecentlyUsed(cache::lru_cache<Hash, V>& cache, size_t bytes,
+                       size_t maxBytes, std::unordered_set<Hash> const& keep,
+                       F getBytes, medida::Meter& evicted)
+{
+    // for_each goes from the most recently used item on
+    std::vector<std::pair<Hash, size_t>> candidates;
+    cache.for_each([&](Hash const& h, V const& v) {
+        if (keep.find(h) == keep.end())
+        {
+            candidates.emplace_back(h, getBytes(v));
+        }
+    });
+    for (auto it = candidates.rbegin();
+         it != candidates.rend() && bytes > maxBytes; ++it)
+    {
+        cache.erase_if_exists(it->first);
+        bytes -= it->second;
+        evicted.Mark();
+    }
+    return bytes;
+}
+}
+
+PendingEnvelopes::CacheMetrics::CacheMetrics(Application& app,
+                                             std::string const& name)
+    : mHit(app.getMetrics().NewMeter({"scp", name, "hit"}, "item"))
+    , mMiss(app.getMetrics().NewMeter({"scp", name, "miss"}, "item"))
+    , mEvicted(app.getMetrics().NewMeter({"scp", name, "evicted"}, "item"))
+    , mBytes(app.getMetrics().NewCounter({"scp", name, "bytes"}))
+{
+}
+
 PendingEnvelopes::PendingEnvelopes(Application& app, HerderImpl& herder)
     : mApp(app)
     , mHerder(herder)
-    , mQsetCache(QSET_CACHE_SIZE)
+    , mQsetCache(std::numeric_limits<size_t>::max())
+    , mQsetCacheMetrics(app, "qset-cache")
     , mTxSetFetcher(
           app, [](Peer::pointer peer, Hash hash) { peer->sendGetTxSet(hash); })
     , mQuorumSetFetcher(app, [](Peer::pointer peer,
                                 Hash hash) { peer->sendGetQuorumSet(hash); })
-    , mTxSetCache(TXSET_CACHE_SIZE)
-    , mNodesInQuorum(NODES_QUORUM_CACHE_SIZE)
+    , mTxSetCache(std::numeric_limits<size_t>::max())
+    , mTxSetCacheMetrics(app, "txset-cache")
+    , mQuorumTracker(app.getConfig().NODE_SEED.getPublicKey())
     , mReadyEnvelopesSize(
           app.getMetrics().NewCounter({"scp", "memory", "pending-envelopes"}))
 {
@@ -58,6 +103,12 @@ PendingEnvelopes::peerDoesntHave(MessageType type, Hash const& itemID,
     }
 }
 
+void
+PendingEnvelopes::recvTxSetProgress(Hash const& hash)
+{
+    mTxSetFetcher.recvProgress(hash);
+}
+
 void
 PendingEnvelopes::addSCPQuorumSet(Hash hash, const SCPQuorumSet& q)
 {
@@ -66,8 +117,13 @@ PendingEnvelopes::addSCPQuorumSet(Hash hash, const SCPQuorumSet& q)
     CLOG(TRACE, "Herder") << "Add SCPQSet " << hexAbbrev(hash);
 
     SCPQuorumSetPtr qset(new SCPQuorumSet(q));
-    mNodesInQuorum.clear();
+    if (mQsetCache.exists(hash))
+    {
+        mQsetCacheBytes -= getQSetBytes(*mQsetCache.get(hash));
+    }
     mQsetCache.put(hash, qset);
+    mQsetCacheBytes += getQSetBytes(*qset);
+    evictCachedItems();
 
     mQuorumSetFetcher.recv(hash);
 }
@@ -112,7 +168,14 @@ PendingEnvelopes::addTxSet(Hash hash, uint64 lastSeenSlotIndex,
 {
     CLOG(TRACE, "Herder") << "Add TxSet " << hexAbbrev(hash);
 
+    if (mTxSetCache.exists(hash))
+    {
+        mTxSetCacheBytes -= getTxSetBytes(*mTxSetCache.get(hash).second);
+    }
     mTxSetCache.put(hash, std::make_pair(lastSeenSlotIndex, txset));
+    mTxSetCacheBytes += getTxSetBytes(*txset);
+    evictCachedItems();
+
     mTxSetFetcher.recv(hash);
 }
 
@@ -134,26 +197,44 @@ PendingEnvelopes::recvTxSet(Hash hash, TxSetFramePtr txset)
 bool
 PendingEnvelopes::isNodeInQuorum(NodeID const& node)
 {
-    bool res;
-
-    res = mNodesInQuorum.exists(node);
-    if (res)
+    // the local node is always there once built
+    if (mQuorumTracker.getQuorum().empty())
     {
-        res = mNodesInQuorum.get(node);
+        rebuildQuorumTracker({});
     }
-    else
-    {
-        // search through the known slots
-        SCP::TriBool r = mHerder.getSCP().isNodeInQuorum(node);
-
-        // consider a node in quorum if it's either in quorum
-        // or we don't know if it is (until we get further evidence)
-        res = (r != SCP::TB_FALSE);
+    return mQuorumTracker.isNodeInQuorum(node);
+}
 
-        mNodesInQuorum.put(node, res);
+void
+PendingEnvelopes::rebuildQuorumTracker(QuorumTracker::QuorumMap latest)
+{
+    auto& scp = mHerder.getSCP();
+    latest[scp.getLocalNodeID()] =
+        std::make_shared<SCPQuorumSet>(scp.getLocalQuorumSet());
+    if (!scp.empty())
+    {
+        // from the most recent slot down, whose statements are authoritative
+        for (auto slot = scp.getHighSlotIndex() + 1;
+             slot-- > scp.getLowSlotIndex();)
+        {
+            for (auto const& e : scp.getCurrentState(slot))
+            {
+                auto h =
+                    Slot::getCompanionQuorumSetHashFromStatement(e.statement);
+                if (mQsetCache.exists(h))
+                {
+                    latest.emplace(e.statement.nodeID, mQsetCache.get(h));
+                }
+            }
+        }
     }
 
-    return res;
+    mQuorumTracker.rebuild([&](NodeID const& node) {
+        auto it = latest.find(node);
+        return it == latest.end() ? nullptr : it->second;
+    });
+    CLOG(DEBUG, "Herder") << "Transitive quorum rebuilt: "
+                          << mQuorumTracker.getQuorum().size() << " nodes";
 }
 
 // called from Peer and when an Item tracker completes
@@ -176,26 +257,25 @@ PendingEnvelopes::recvSCPEnvelope(SCPEnvelope const& envelope)
 
     try
     {
-        if (isDiscarded(envelope))
+        auto envHash = sha256(xdr::xdr_to_opaque(envelope));
+        if (isDiscarded(envelope.statement.slotIndex, envHash))
         {
             return Herder::ENVELOPE_STATUS_DISCARDED;
         }
 
         touchFetchCache(envelope);
 
-        auto& set = mEnvelopes[envelope.statement.slotIndex].mFetchingEnvelopes;
-        auto& processedList =
-            mEnvelopes[envelope.statement.slotIndex].mProcessedEnvelopes;
+        auto& envs = mEnvelopes[envelope.statement.slotIndex];
+        auto fetching = envs.mFetchingEnvelopes.find(envHash);
 
-        auto fetching = find(set.begin(), set.end(), envelope);
-
-        if (fetching == set.end())
+        if (fetching == envs.mFetchingEnvelopes.end())
         { // we aren't fetching this envelope
-            if (find(processedList.begin(), processedList.end(), envelope) ==
-                processedList.end())
+            if (envs.mProcessedEnvelopes.find(envHash) ==
+                envs.mProcessedEnvelopes.end())
             { // we haven't seen this envelope before
                 // insert it into the fetching set
-                fetching = set.insert(envelope).first;
+                fetching =
+                    envs.mFetchingEnvelopes.emplace(envHash, envelope).first;
                 startFetch(envelope);
             }
             else
@@ -210,8 +290,8 @@ PendingEnvelopes::recvSCPEnvelope(SCPEnvelope const& envelope)
         if (isFullyFetched(envelope))
         {
             // move the item from fetching to processed
-            processedList.emplace_back(*fetching);
-            set.erase(fetching);
+            envs.mProcessedEnvelopes.insert(envHash);
+            envs.mFetchingEnvelopes.erase(fetching);
             envelopeReady(envelope);
             return Herder::ENVELOPE_STATUS_READY;
         } // else just keep waiting for it to come in
@@ -232,20 +312,7 @@ PendingEnvelopes::discardSCPEnvelope(SCPEnvelope const& envelope)
 {
     try
     {
-        if (isDiscarded(envelope))
-        {
-            return;
-        }
-
-        auto& discardedSet =
-            mEnvelopes[envelope.statement.slotIndex].mDiscardedEnvelopes;
-        discardedSet.insert(envelope);
-
-        auto& fetchingSet =
-            mEnvelopes[envelope.statement.slotIndex].mFetchingEnvelopes;
-        fetchingSet.erase(envelope);
-
-        stopFetch(envelope);
+        discardSCPEnvelope(envelope, sha256(xdr::xdr_to_opaque(envelope)));
     }
     catch (xdr::xdr_runtime_error& e)
     {
@@ -255,19 +322,40 @@ PendingEnvelopes::discardSCPEnvelope(SCPEnvelope const& envelope)
     }
 }
 
+void
+PendingEnvelopes::discardSCPEnvelope(SCPEnvelope const& envelope,
+                                     Hash const& envHash)
+{
+    if (isDiscarded(envelope.statement.slotIndex, envHash))
+    {
+        return;
+    }
+
+    auto& envs = mEnvelopes[envelope.statement.slotIndex];
+    envs.mDiscardedEnvelopes.insert(envHash);
+    envs.mFetchingEnvelopes.erase(envHash);
+
+    stopFetch(envelope);
+}
+
 bool
 PendingEnvelopes::isDiscarded(SCPEnvelope const& envelope) const
 {
-    auto envelopes = mEnvelopes.find(envelope.statement.slotIndex);
+    return isDiscarded(envelope.statement.slotIndex,
+                       sha256(xdr::xdr_to_opaque(envelope)));
+}
+
+bool
+PendingEnvelopes::isDiscarded(uint64 slotIndex, Hash const& envHash) const
+{
+    auto envelopes = mEnvelopes.find(slotIndex);
     if (envelopes == mEnvelopes.end())
     {
         return false;
     }
 
-    auto& discardedSet = envelopes->second.mDiscardedEnvelopes;
-    auto discarded =
-        std::find(std::begin(discardedSet), std::end(discardedSet), envelope);
-    return discarded != discardedSet.end();
+    auto const& discarded = envelopes->second.mDiscardedEnvelopes;
+    return discarded.find(envHash) != discarded.end();
 }
 
 void
@@ -281,6 +369,17 @@ PendingEnvelopes::envelopeReady(SCPEnvelope const& envelope)
     mEnvelopes[envelope.statement.slotIndex].mReadyEnvelopes.push_back(
         envelope);
 
+    // its quorum set is known by now, and may widen the transitive quorum
+    auto const& nodeID = envelope.statement.nodeID;
+    auto qsetHash =
+        Slot::getCompanionQuorumSetHashFromStatement(envelope.statement);
+    auto qset = mQsetCache.exists(qsetHash) ? mQsetCache.get(qsetHash)
+                                            : SCPQuorumSetPtr();
+    if (qset && !mQuorumTracker.expand(nodeID, qset))
+    {
+        rebuildQuorumTracker({{nodeID, qset}});
+    }
+
     CLOG(TRACE, "Herder") << "Envelope ready i:" << envelope.statement.slotIndex
                           << " t:" << envelope.statement.pledges.type();
 }
@@ -403,7 +502,7 @@ PendingEnvelopes::eraseBelow(uint64 slotIndex)
 
     // 0 is special mark for data that we do not know the slot index
     // it is used for state loaded from database
-    mTxSetCache.erase_if([&](TxSetFramCacheItem const& i) {
+    eraseTxSetsIf([&](TxSetFramCacheItem const& i) {
         return i.first != 0 && i.first < slotIndex;
     });
 }
@@ -411,9 +510,6 @@ PendingEnvelopes::eraseBelow(uint64 slotIndex)
 void
 PendingEnvelopes::slotClosed(uint64 slotIndex)
 {
-    // force recomputing the quorums
-    mNodesInQuorum.clear();
-
     // stop processing envelopes & downloads for the slot falling off the
     // window
     if (slotIndex > Herder::MAX_SLOTS_TO_REMEMBER)
@@ -425,7 +521,7 @@ PendingEnvelopes::slotClosed(uint64 slotIndex)
         mTxSetFetcher.stopFetchingBelow(slotIndex + 1);
         mQuorumSetFetcher.stopFetchingBelow(slotIndex + 1);
 
-        mTxSetCache.erase_if(
+        eraseTxSetsIf(
             [&](TxSetFramCacheItem const& i) { return i.first == slotIndex; });
     }
 }
@@ -435,8 +531,10 @@ PendingEnvelopes::getTxSet(Hash const& hash)
 {
     if (mTxSetCache.exists(hash))
     {
+        mTxSetCacheMetrics.mHit.Mark();
         return mTxSetCache.get(hash).second;
     }
+    mTxSetCacheMetrics.mMiss.Mark();
 
     return TxSetFramePtr();
 }
@@ -446,12 +544,141 @@ PendingEnvelopes::getQSet(Hash const& hash)
 {
     if (mQsetCache.exists(hash))
     {
+        mQsetCacheMetrics.mHit.Mark();
         return mQsetCache.get(hash);
     }
+    mQsetCacheMetrics.mMiss.Mark();
 
     return SCPQuorumSetPtr();
 }
 
+size_t
+PendingEnvelopes::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (auto const& s : mEnvelopes)
+    {
+        auto const& envs = s.second;
+        bytes += sizeof(s);
+        bytes += (envs.mProcessedEnvelopes.size() +
+                  envs.mDiscardedEnvelopes.size()) *
+                 sizeof(Hash);
+        for (auto const& e : envs.mFetchingEnvelopes)
+        {
+            bytes += sizeof(Hash) + xdr::xdr_size(e.second);
+        }
+        for (auto const& e : envs.mReadyEnvelopes)
+        {
+            bytes += xdr::xdr_size(e);
+        }
+    }
+    return bytes + mQsetCacheBytes + mTxSetCacheBytes;
+}
+
+size_t
+PendingEnvelopes::getQSetBytes(SCPQuorumSet const& qset)
+{
+    return sizeof(Hash) + sizeof(SCPQuorumSetPtr) + xdr::xdr_size(qset);
+}
+
+size_t
+PendingEnvelopes::getTxSetBytes(TxSetFrame const& txSet)
+{
+    size_t bytes =
+        sizeof(Hash) + sizeof(TxSetFramCacheItem) + sizeof(TxSetFrame);
+    for (auto const& tx : txSet.mTransactions)
+    {
+        bytes += sizeof(TransactionFrame) + xdr::xdr_size(tx->getEnvelope());
+    }
+    return bytes;
+}
+
+void
+PendingEnvelopes::getReferencedItems(std::unordered_set<Hash>& qsets,
+                                     std::unordered_set<Hash>& txSets)
+{
+    auto note = [&](SCPEnvelope const& e) {
+        qsets.insert(Slot::getCompanionQuorumSetHashFromStatement(e.statement));
+        for (auto const& h : getTxSetHashes(e))
+        {
+            txSets.insert(h);
+        }
+    };
+    for (auto const& s : mEnvelopes)
+    {
+        for (auto const& e : s.second.mFetchingEnvelopes)
+        {
+            note(e.second);
+        }
+        for (auto const& e : s.second.mReadyEnvelopes)
+        {
+            note(e);
+        }
+    }
+
+    auto& scp = mHerder.getSCP();
+    qsets.insert(scp.getLocalNode()->getQuorumSetHash());
+    if (!scp.empty())
+    {
+        for (auto slot = scp.getLowSlotIndex(); slot <= scp.getHighSlotIndex();
+             ++slot)
+        {
+            for (auto const& e : scp.getCurrentState(slot))
+            {
+                note(e);
+            }
+        }
+    }
+}
+
+void
+PendingEnvelopes::evictCachedItems()
+{
+    auto const& cfg = mApp.getConfig();
+    if (mQsetCacheBytes > cfg.QSET_CACHE_MAX_BYTES ||
+        mTxSetCacheBytes > cfg.TX_SET_CACHE_MAX_BYTES)
+    {
+        std::unordered_set<Hash> qsets;
+        std::unordered_set<Hash> txSets;
+        getReferencedItems(qsets, txSets);
+
+        mQsetCacheBytes = evictLeastRecentlyUsed(
+            mQsetCache, mQsetCacheBytes, cfg.QSET_CACHE_MAX_BYTES, qsets,
+            [](SCPQuorumSetPtr const& q) { return getQSetBytes(*q); },
+            mQsetCacheMetrics.mEvicted);
+        mTxSetCacheBytes = evictLeastRecentlyUsed(
+            mTxSetCache, mTxSetCacheBytes, cfg.TX_SET_CACHE_MAX_BYTES, txSets,
+            [](TxSetFramCacheItem const& i) {
+                return getTxSetBytes(*i.second);
+            },
+            mTxSetCacheMetrics.mEvicted);
+    }
+    mQsetCacheMetrics.mBytes.set_count(mQsetCacheBytes);
+    mTxSetCacheMetrics.mBytes.set_count(mTxSetCacheBytes);
+}
+
+void
+PendingEnvelopes::eraseTxSetsIf(
+    std::function<bool(TxSetFramCacheItem const&)> f)
+{
+    mTxSetCache.erase_if([&](TxSetFramCacheItem const& i) {
+        if (f(i))
+        {
+            mTxSetCacheBytes -= getTxSetBytes(*i.second);
+            return true;
+        }
+        return false;
+    });
+    mTxSetCacheMetrics.mBytes.set_count(mTxSetCacheBytes);
+}
+
+size_t
+PendingEnvelopes::getFetchersMemoryBytes() const
+{
+    return mTxSetFetcher.getMemoryBytes() +
+           mQuorumSetFetcher.getMemoryBytes();
+}
+
 Json::Value
 PendingEnvelopes::getJsonInfo(size_t limit)
 {
@@ -467,7 +694,7 @@ PendingEnvelopes::getJsonInfo(size_t limit)
                 Json::Value& slot = ret[std::to_string(it->first)]["fetching"];
                 for (auto const& e : it->second.mFetchingEnvelopes)
                 {
-                    slot.append(mHerder.getSCP().envToStr(e));
+                    slot.append(mHerder.getSCP().envToStr(e.second));
                 }
             }
             if (it->second.mReadyEnvelopes.size() != 0)
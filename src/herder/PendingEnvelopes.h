@@ -1,14 +1,19 @@
 ﻿#pragma once
 #include "crypto/SecretKey.h"
 #include "herder/Herder.h"
+#include "herder/QuorumTracker.h"
 #include "lib/json/json.h"
 #include "lib/util/lrucache.hpp"
 #include "overlay/ItemFetcher.h"
+#include "util/HashOfHash.h"
 #include <autocheck/function.hpp>
+#include <functional>
 #include <map>
 #include <medida/medida.h>
 #include <queue>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <util/optional.h>
 
 /*
@@ -21,14 +26,16 @@ namespace stellar
 
 class HerderImpl;
 
+// Envelopes are known by the hash of their XDR, computed once as they are
+// received, rather than compared whole, signatures included.
 struct SlotEnvelopes
 {
-    // list of envelopes we have processed already
-    std::vector<SCPEnvelope> mProcessedEnvelopes;
-    // list of envelopes we have discarded already
-    std::set<SCPEnvelope> mDiscardedEnvelopes;
-    // list of envelopes we are fetching right now
-    std::set<SCPEnvelope> mFetchingEnvelopes;
+    // envelopes we have processed already
+    std::unordered_set<Hash> mProcessedEnvelopes;
+    // envelopes we have discarded already
+    std::unordered_set<Hash> mDiscardedEnvelopes;
+    // envelopes we are fetching right now
+    std::unordered_map<Hash, SCPEnvelope> mFetchingEnvelopes;
     // list of ready envelopes that haven't been sent to SCP yet
     std::vector<SCPEnvelope> mReadyEnvelopes;
 };
@@ -41,28 +48,64 @@ class PendingEnvelopes
     // ledger# and list of envelopes in various states
     std::map<uint64, SlotEnvelopes> mEnvelopes;
 
-    // all the quorum sets we have learned about
+    // hits, misses, evictions and bytes of one of the caches below
+    struct CacheMetrics
+    {
+        medida::Meter& mHit;
+        medida::Meter& mMiss;
+        medida::Meter& mEvicted;
+        medida::Counter& mBytes;
+
+        CacheMetrics(Application& app, std::string const& name);
+    };
+
+    // all the quorum sets we have learned about, up to
+    // Config::QSET_CACHE_MAX_BYTES, see evictCachedItems
     cache::lru_cache<Hash, SCPQuorumSetPtr> mQsetCache;
+    size_t mQsetCacheBytes{0};
+    CacheMetrics mQsetCacheMetrics;
 
     ItemFetcher mTxSetFetcher;
     ItemFetcher mQuorumSetFetcher;
 
     using TxSetFramCacheItem = std::pair<uint64, TxSetFramePtr>;
-    // all the txsets we have learned about per ledger#
+    // all the txsets we have learned about per ledger#, up to
+    // Config::TX_SET_CACHE_MAX_BYTES, see evictCachedItems
     cache::lru_cache<Hash, TxSetFramCacheItem> mTxSetCache;
-
-    // NodeIDs that are in quorum
-    cache::lru_cache<NodeID, bool> mNodesInQuorum;
+    size_t mTxSetCacheBytes{0};
+    CacheMetrics mTxSetCacheMetrics;
+
+    // approximate bytes an entry of each cache takes
+    static size_t getQSetBytes(SCPQuorumSet const& qset);
+    static size_t getTxSetBytes(TxSetFrame const& txSet);
+
+    // hashes of the quorum sets and transaction sets that the envelopes
+    // pending here or held by SCP refer to
+    void getReferencedItems(std::unordered_set<Hash>& qsets,
+                            std::unordered_set<Hash>& txSets);
+    // evicts, from the least recently used on, the items no envelope refers
+    // to while a cache is over its budget
+    void evictCachedItems();
+    void eraseTxSetsIf(std::function<bool(TxSetFramCacheItem const&)> f);
+
+    // nodes in the transitive quorum of the local node, kept up to date
+    // with the quorum sets of the envelopes that become ready
+    QuorumTracker mQuorumTracker;
 
     medida::Counter& mReadyEnvelopesSize;
 
-    // returns true if we think that the node is in quorum
-    bool isNodeInQuorum(NodeID const& node);
+    // rebuilds mQuorumTracker from the local quorum set and those of the
+    // latest statements SCP holds, `latest` overriding the latter
+    void rebuildQuorumTracker(QuorumTracker::QuorumMap latest);
 
     // discards all SCP envelopes thats use QSet with given hash,
     // as it is not sane QSet
     void discardSCPEnvelopesWithQSet(Hash hash);
 
+    // as their public counterparts, for the envelope of hash `envHash`
+    void discardSCPEnvelope(SCPEnvelope const& envelope, Hash const& envHash);
+    bool isDiscarded(uint64 slotIndex, Hash const& envHash) const;
+
   public:
     PendingEnvelopes(Application& app, HerderImpl& herder);
     ~PendingEnvelopes();
@@ -74,6 +117,10 @@ class PendingEnvelopes
      */
     Herder::EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope);
 
+    // returns true if the node is in the transitive quorum of the local node
+    // (only its envelopes are worth processing)
+    bool isNodeInQuorum(NodeID const& node);
+
     /**
      * Add @p qset identified by @p hash to local cache. Notifies
      * @see ItemFetcher about that event - it may cause calls to Herder's
@@ -112,6 +159,10 @@ class PendingEnvelopes
     void peerDoesntHave(MessageType type, Hash const& itemID,
                         Peer::pointer peer);
 
+    // Keeps fetching the transaction set identified by @p hash from the peers
+    // sending it, part of it having arrived.
+    void recvTxSetProgress(Hash const& hash);
+
     bool isDiscarded(SCPEnvelope const& envelope) const;
     bool isFullyFetched(SCPEnvelope const& envelope);
     void startFetch(SCPEnvelope const& envelope);
@@ -130,6 +181,13 @@ class PendingEnvelopes
 
     Json::Value getJsonInfo(size_t limit);
 
+    // approximate bytes held by the envelopes, quorum sets and transaction
+    // sets kept, the latter counted in full even when their transactions
+    // are shared with the pending transactions
+    size_t getMemoryBytes() const;
+    // approximate bytes held by the trackers of the two fetchers
+    size_t getFetchersMemoryBytes() const;
+
     TxSetFramePtr getTxSet(Hash const& hash);
     SCPQuorumSetPtr getQSet(Hash const& hash);
 };
@@ -13,12 +13,20 @@
 #include "test/test.h"
 #include "xdrpp/marshal.h"
 
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
 using namespace stellar;
 using namespace stellar::txtest;
 
 TEST_CASE("PendingEnvelopes::recvSCPEnvelope", "[herder]")
 {
     Config cfg(getTestConfig());
+    // the envelopes below come from root, which must be in quorum for them
+    // not to be dropped
+    cfg.QUORUM_SET.validators.emplace_back(
+        getRoot(sha256(cfg.NETWORK_PASSPHRASE)).getPublicKey());
     VirtualClock clock;
     Application::pointer app = createTestApplication(clock, cfg);
 
@@ -40,6 +48,7 @@ TEST_CASE("PendingEnvelopes::recvSCPEnvelope", "[herder]")
         // herder must want the TxSet before receiving it, so we are sending it
         // fake envelope
         auto envelope = SCPEnvelope{};
+        envelope.statement.nodeID = root.getPublicKey();
         envelope.statement.slotIndex = slotIndex;
         envelope.statement.pledges.type(SCP_ST_PREPARE);
         envelope.statement.pledges.prepare().ballot.value = p.first;
@@ -221,6 +230,28 @@ TEST_CASE("PendingEnvelopes::recvSCPEnvelope", "[herder]")
         }
     }
 
+    SECTION("return DISCARDED for nodes out of the transitive quorum")
+    {
+        auto otherEnvelope =
+            makeEnvelope(p, saneQSetHash, lcl.header.ledgerSeq + 1);
+        otherEnvelope.statement.nodeID = keys[0];
+        REQUIRE(!pendingEnvelopes.isNodeInQuorum(keys[0]));
+        REQUIRE(pendingEnvelopes.recvSCPEnvelope(otherEnvelope) ==
+                Herder::ENVELOPE_STATUS_DISCARDED);
+
+        // until a node in quorum turns out to name it in its quorum set
+        REQUIRE(pendingEnvelopes.recvSCPEnvelope(saneEnvelope) ==
+                Herder::ENVELOPE_STATUS_FETCHING);
+        REQUIRE(pendingEnvelopes.recvSCPQuorumSet(saneQSetHash, saneQSet));
+        REQUIRE(
+            pendingEnvelopes.recvTxSet(p.second->getContentsHash(), p.second));
+        REQUIRE(pendingEnvelopes.recvSCPEnvelope(saneEnvelope) ==
+                Herder::ENVELOPE_STATUS_READY);
+        REQUIRE(pendingEnvelopes.isNodeInQuorum(keys[0]));
+        REQUIRE(pendingEnvelopes.recvSCPEnvelope(otherEnvelope) ==
+                Herder::ENVELOPE_STATUS_READY);
+    }
+
     SECTION("envelopes from different slots asking for the same quorum set and "
             "tx set")
     {
@@ -261,3 +292,54 @@ TEST_CASE("PendingEnvelopes::recvSCPEnvelope", "[herder]")
         }
     }
 }
+
+TEST_CASE("PendingEnvelopes tx set cache budget", "[herder]")
+{
+    Config cfg(getTestConfig());
+    // too small for any tx set: only those referred to are kept
+    cfg.TX_SET_CACHE_MAX_BYTES = 1;
+    cfg.QUORUM_SET.validators.emplace_back(
+        getRoot(sha256(cfg.NETWORK_PASSPHRASE)).getPublicKey());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    auto const& lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+    auto root = TestAccount::createRoot(*app);
+    auto makeTxSet = [&](int64_t amount) {
+        auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+        txSet->mTransactions.push_back(root.tx({payment(root, amount)}));
+        txSet->sortForHash();
+        return txSet;
+    };
+
+    PendingEnvelopes pendingEnvelopes{
+        *app, static_cast<HerderImpl&>(app->getHerder())};
+    auto& bytes = app->getMetrics().NewCounter({"scp", "txset-cache", "bytes"});
+    auto& evicted = app->getMetrics().NewMeter(
+        {"scp", "txset-cache", "evicted"}, "item");
+    auto slot = lcl.header.ledgerSeq + 1;
+
+    auto unused = makeTxSet(1);
+    pendingEnvelopes.addTxSet(unused->getContentsHash(), slot, unused);
+    REQUIRE(!pendingEnvelopes.getTxSet(unused->getContentsHash()));
+    REQUIRE(evicted.count() == 1);
+    REQUIRE(bytes.count() == 0);
+
+    // a tx set an envelope waits for stays
+    auto used = makeTxSet(2);
+    auto sv = StellarValue{used->getContentsHash(), 10, emptyUpgradeSteps, 0};
+    auto envelope = SCPEnvelope{};
+    envelope.statement.nodeID = root.getPublicKey();
+    envelope.statement.slotIndex = slot;
+    envelope.statement.pledges.type(SCP_ST_PREPARE);
+    envelope.statement.pledges.prepare().ballot.value =
+        xdr::xdr_to_opaque(sv);
+    envelope.signature =
+        root.getSecretKey().sign(xdr::xdr_to_opaque(envelope.statement));
+    REQUIRE(pendingEnvelopes.recvSCPEnvelope(envelope) ==
+            Herder::ENVELOPE_STATUS_FETCHING);
+    REQUIRE(pendingEnvelopes.recvTxSet(used->getContentsHash(), used));
+    REQUIRE(pendingEnvelopes.getTxSet(used->getContentsHash()));
+    REQUIRE(evicted.count() == 1);
+    REQUIRE(bytes.count() > 0);
+}
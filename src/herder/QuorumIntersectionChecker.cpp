@@ -0,0 +1,557 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/QuorumIntersectionChecker.h"
+#include "util/XDROperators.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace stellar
+{
+
+namespace
+{
+
+// A set of node numbers, one bit each.
+class NodeSet
+{
+    std::vector<uint64_t> mWords;
+
+  public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    explicit NodeSet(size_t size = 0) : mWords((size + 63) / 64)
+    {
+    }
+
+    void
+    set(size_t i)
+    {
+        mWords[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    void
+    unset(size_t i)
+    {
+        mWords[i / 64] &= ~(uint64_t(1) << (i % 64));
+    }
+
+    bool
+    test(size_t i) const
+    {
+        return (mWords[i / 64] >> (i % 64)) & 1;
+    }
+
+    size_t
+    count() const
+    {
+        size_t res = 0;
+        for (auto w : mWords)
+        {
+            for (; w != 0; w &= w - 1)
+            {
+                ++res;
+            }
+        }
+        return res;
+    }
+
+    bool
+    empty() const
+    {
+        return std::all_of(mWords.begin(), mWords.end(),
+                           [](uint64_t w) { return w == 0; });
+    }
+
+    // The first node from `i` on, or npos.
+    size_t
+    next(size_t i) const
+    {
+        for (size_t w = i / 64; w < mWords.size(); ++w)
+        {
+            auto bits = mWords[w];
+            if (w == i / 64)
+            {
+                bits &= ~uint64_t(0) << (i % 64);
+            }
+            for (size_t b = 0; bits != 0; ++b, bits >>= 1)
+            {
+                if (bits & 1)
+                {
+                    return w * 64 + b;
+                }
+            }
+        }
+        return npos;
+    }
+
+    bool
+    isSubsetOf(NodeSet const& other) const
+    {
+        for (size_t w = 0; w < mWords.size(); ++w)
+        {
+            if ((mWords[w] & ~other.mWords[w]) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    NodeSet&
+    operator|=(NodeSet const& other)
+    {
+        for (size_t w = 0; w < mWords.size(); ++w)
+        {
+            mWords[w] |= other.mWords[w];
+        }
+        return *this;
+    }
+
+    NodeSet&
+    operator&=(NodeSet const& other)
+    {
+        for (size_t w = 0; w < mWords.size(); ++w)
+        {
+            mWords[w] &= other.mWords[w];
+        }
+        return *this;
+    }
+
+    NodeSet&
+    operator-=(NodeSet const& other)
+    {
+        for (size_t w = 0; w < mWords.size(); ++w)
+        {
+            mWords[w] &= ~other.mWords[w];
+        }
+        return *this;
+    }
+
+    bool
+    operator==(NodeSet const& other) const
+    {
+        return mWords == other.mWords;
+    }
+};
+
+constexpr size_t NodeSet::npos;
+
+NodeSet
+operator|(NodeSet a, NodeSet const& b)
+{
+    return a |= b;
+}
+
+NodeSet
+operator&(NodeSet a, NodeSet const& b)
+{
+    return a &= b;
+}
+
+NodeSet
+operator-(NodeSet a, NodeSet const& b)
+{
+    return a -= b;
+}
+
+// A quorum set over node numbers, without the nodes that cannot be part of a
+// quorum.
+struct QSet
+{
+    uint32_t mThreshold{0};
+    NodeSet mNodes;
+    std::vector<QSet> mInner;
+    // every node named, at any depth
+    NodeSet mAll;
+
+    bool
+    hasSliceIn(NodeSet const& nodes) const
+    {
+        size_t have = (mNodes & nodes).count();
+        for (auto it = mInner.begin(); have < mThreshold && it != mInner.end();
+             ++it)
+        {
+            if (it->hasSliceIn(nodes))
+            {
+                ++have;
+            }
+        }
+        return have >= mThreshold;
+    }
+};
+}
+
+class QuorumIntersectionChecker::Impl
+{
+  public:
+    std::vector<NodeID> mNodes;
+    std::vector<QSet> mQSets;
+    // mSuccessors[i]: the nodes node i names in its quorum set
+    std::vector<NodeSet> mSuccessors;
+
+    std::chrono::milliseconds const mTimeout;
+    std::chrono::steady_clock::time_point mDeadline;
+    std::atomic<bool> const* const mInterrupt;
+    bool mGaveUp{false};
+
+    NodeSet mMainComponent;
+    // nodes of the main component naming each node, to pick the most named
+    std::vector<size_t> mInDegree;
+    size_t mMaxCommit{0};
+    size_t mBranches{0};
+    std::pair<std::vector<NodeID>, std::vector<NodeID>> mSplit;
+
+    Impl(QuorumMap const& qmap, std::chrono::milliseconds timeout,
+         std::atomic<bool> const* interrupt)
+        : mTimeout(timeout), mInterrupt(interrupt)
+    {
+        std::map<NodeID, size_t> numbers;
+        for (auto const& q : qmap)
+        {
+            if (q.second)
+            {
+                numbers.emplace(q.first, mNodes.size());
+                mNodes.push_back(q.first);
+            }
+        }
+        for (auto const& q : qmap)
+        {
+            if (q.second)
+            {
+                mQSets.push_back(convert(*q.second, numbers));
+                mSuccessors.push_back(mQSets.back().mAll);
+            }
+        }
+    }
+
+    QSet
+    convert(SCPQuorumSet const& qset, std::map<NodeID, size_t> const& numbers)
+    {
+        QSet res;
+        res.mThreshold = qset.threshold;
+        res.mNodes = NodeSet(mNodes.size());
+        for (auto const& v : qset.validators)
+        {
+            auto it = numbers.find(v);
+            if (it != numbers.end())
+            {
+                res.mNodes.set(it->second);
+            }
+        }
+        res.mAll = res.mNodes;
+        for (auto const& inner : qset.innerSets)
+        {
+            res.mInner.push_back(convert(inner, numbers));
+            res.mAll |= res.mInner.back().mAll;
+        }
+        return res;
+    }
+
+    std::vector<NodeID>
+    toNodeIDs(NodeSet const& nodes) const
+    {
+        std::vector<NodeID> res;
+        for (auto i = nodes.next(0); i != NodeSet::npos; i = nodes.next(i + 1))
+        {
+            res.push_back(mNodes[i]);
+        }
+        return res;
+    }
+
+    // The largest quorum within `nodes`, empty if there is none: the nodes
+    // without a slice in the rest are dropped until none is.
+    NodeSet
+    contractToQuorum(NodeSet nodes) const
+    {
+        while (true)
+        {
+            NodeSet kept(mNodes.size());
+            for (auto i = nodes.next(0); i != NodeSet::npos;
+                 i = nodes.next(i + 1))
+            {
+                if (mQSets[i].hasSliceIn(nodes))
+                {
+                    kept.set(i);
+                }
+            }
+            if (kept == nodes)
+            {
+                return nodes;
+            }
+            nodes = kept;
+        }
+    }
+
+    // Tarjan's algorithm.
+    std::vector<NodeSet>
+    components() const
+    {
+        auto n = mNodes.size();
+        std::vector<NodeSet> res;
+        std::vector<size_t> index(n, NodeSet::npos);
+        std::vector<size_t> lowLink(n, 0);
+        std::vector<bool> onStack(n, false);
+        std::vector<size_t> stack;
+        size_t nextIndex = 0;
+
+        std::function<void(size_t)> visit = [&](size_t v) {
+            index[v] = lowLink[v] = nextIndex++;
+            stack.push_back(v);
+            onStack[v] = true;
+            auto const& succ = mSuccessors[v];
+            for (auto w = succ.next(0); w != NodeSet::npos;
+                 w = succ.next(w + 1))
+            {
+                if (index[w] == NodeSet::npos)
+                {
+                    visit(w);
+                    lowLink[v] = std::min(lowLink[v], lowLink[w]);
+                }
+                else if (onStack[w])
+                {
+                    lowLink[v] = std::min(lowLink[v], index[w]);
+                }
+            }
+            if (lowLink[v] == index[v])
+            {
+                NodeSet component(n);
+                size_t w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    onStack[w] = false;
+                    component.set(w);
+                } while (w != v);
+                res.push_back(component);
+            }
+        };
+
+        for (size_t v = 0; v < n; ++v)
+        {
+            if (index[v] == NodeSet::npos)
+            {
+                visit(v);
+            }
+        }
+        return res;
+    }
+
+    bool
+    shouldGiveUp()
+    {
+        if (!mGaveUp)
+        {
+            mGaveUp = (mInterrupt && *mInterrupt) ||
+                      (mTimeout.count() != 0 &&
+                       std::chrono::steady_clock::now() >= mDeadline);
+        }
+        return mGaveUp;
+    }
+
+    // An undecided node of `qset`, which has no slice among `committed` yet:
+    // preferably of an inner set already partly committed, as those get
+    // completed soonest, else a direct one.
+    size_t
+    pickNodeIn(QSet const& qset, NodeSet const& committed,
+               NodeSet const& remaining) const
+    {
+        size_t fallback = NodeSet::npos;
+        for (auto const& inner : qset.mInner)
+        {
+            if (inner.hasSliceIn(committed))
+            {
+                continue;
+            }
+            auto node = pickNodeIn(inner, committed, remaining);
+            if (node != NodeSet::npos)
+            {
+                if (!(inner.mAll & committed).empty())
+                {
+                    return node;
+                }
+                if (fallback == NodeSet::npos)
+                {
+                    fallback = node;
+                }
+            }
+        }
+        auto direct = (qset.mNodes & remaining).next(0);
+        return direct != NodeSet::npos ? direct : fallback;
+    }
+
+    // The node to branch on: one completing the slice of a committed node,
+    // as a quorum containing it needs one, else the most named one.
+    size_t
+    pickNode(NodeSet const& committed, NodeSet const& remaining) const
+    {
+        for (auto i = committed.next(0); i != NodeSet::npos;
+             i = committed.next(i + 1))
+        {
+            if (!mQSets[i].hasSliceIn(committed))
+            {
+                auto node = pickNodeIn(mQSets[i], committed, remaining);
+                if (node != NodeSet::npos)
+                {
+                    return node;
+                }
+            }
+        }
+
+        size_t best = remaining.next(0);
+        for (auto i = remaining.next(best + 1); i != NodeSet::npos;
+             i = remaining.next(i + 1))
+        {
+            if (mInDegree[i] > mInDegree[best])
+            {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    // Whether a quorum containing `committed` and within `committed` and
+    // `remaining` has a quorum disjoint from it, recording both in mSplit.
+    bool
+    findSplit(NodeSet const& committed, NodeSet remaining)
+    {
+        ++mBranches;
+        if (shouldGiveUp() || committed.count() > mMaxCommit)
+        {
+            return false;
+        }
+
+        auto quorum = contractToQuorum(committed);
+        if (!quorum.empty())
+        {
+            // any quorum containing `committed` contains this one, and thus
+            // leaves no more room for a disjoint quorum
+            auto other = contractToQuorum(mMainComponent - quorum);
+            if (!other.empty())
+            {
+                mSplit = std::make_pair(toNodeIDs(quorum), toNodeIDs(other));
+                return true;
+            }
+            return false;
+        }
+
+        // nor does any quorum containing nodes every quorum needs
+        if (contractToQuorum(mMainComponent - committed).empty())
+        {
+            return false;
+        }
+
+        auto extension = contractToQuorum(committed | remaining);
+        if (extension.empty() || !committed.isSubsetOf(extension))
+        {
+            return false;
+        }
+        remaining = extension - committed;
+        if (remaining.empty())
+        {
+            return false;
+        }
+
+        auto node = pickNode(committed, remaining);
+        remaining.unset(node);
+        auto withNode = committed;
+        withNode.set(node);
+        return findSplit(withNode, remaining) ||
+               findSplit(committed, remaining);
+    }
+
+    Result
+    check()
+    {
+        mDeadline = std::chrono::steady_clock::now() + mTimeout;
+        mGaveUp = false;
+        mBranches = 0;
+        mSplit = {};
+
+        std::vector<NodeSet> quorums;
+        for (auto const& component : components())
+        {
+            auto quorum = contractToQuorum(component);
+            if (!quorum.empty())
+            {
+                mMainComponent = component;
+                quorums.push_back(quorum);
+            }
+        }
+        if (quorums.empty())
+        {
+            mMainComponent = NodeSet(mNodes.size());
+            return Result::INTERSECTING;
+        }
+        if (quorums.size() > 1)
+        {
+            mSplit =
+                std::make_pair(toNodeIDs(quorums[0]), toNodeIDs(quorums[1]));
+            return Result::SPLIT;
+        }
+
+        mInDegree.assign(mNodes.size(), 0);
+        for (auto i = mMainComponent.next(0); i != NodeSet::npos;
+             i = mMainComponent.next(i + 1))
+        {
+            auto succ = mSuccessors[i] & mMainComponent;
+            for (auto j = succ.next(0); j != NodeSet::npos;
+                 j = succ.next(j + 1))
+            {
+                ++mInDegree[j];
+            }
+        }
+        mMaxCommit = mMainComponent.count() / 2;
+
+        if (findSplit(NodeSet(mNodes.size()), mMainComponent))
+        {
+            return Result::SPLIT;
+        }
+        return mGaveUp ? Result::UNKNOWN : Result::INTERSECTING;
+    }
+};
+
+QuorumIntersectionChecker::QuorumIntersectionChecker(
+    QuorumMap const& qmap, std::chrono::milliseconds timeout,
+    std::atomic<bool> const* interrupt)
+    : mImpl(std::make_unique<Impl>(qmap, timeout, interrupt))
+{
+}
+
+QuorumIntersectionChecker::~QuorumIntersectionChecker()
+{
+}
+
+QuorumIntersectionChecker::Result
+QuorumIntersectionChecker::check()
+{
+    return mImpl->check();
+}
+
+std::pair<std::vector<NodeID>, std::vector<NodeID>> const&
+QuorumIntersectionChecker::getSplit() const
+{
+    return mImpl->mSplit;
+}
+
+size_t
+QuorumIntersectionChecker::getNodeCount() const
+{
+    return mImpl->mNodes.size();
+}
+
+size_t
+QuorumIntersectionChecker::getMainComponentSize() const
+{
+    return mImpl->mMainComponent.count();
+}
+
+size_t
+QuorumIntersectionChecker::getBranchCount() const
+{
+    return mImpl->mBranches;
+}
+}
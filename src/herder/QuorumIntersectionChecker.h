@@ -0,0 +1,78 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdr/Stellar-SCP.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Checks whether any two quorums of a network share a node, which SCP needs
+ * to stay safe, without enumerating the subsets of the network (that the
+ * check is co-NP-hard only bites for adversarial configurations).
+ *
+ * Every quorum contains one lying within a single strongly connected
+ * component of the graph of who names whom in their quorum set, so:
+ *   - two components containing a quorum each make two disjoint quorums;
+ *   - otherwise every quorum intersects the one component containing any,
+ *     the main one, and a split exists iff some quorum of the main component
+ *     has a quorum in its complement there. The smaller of two disjoint
+ *     quorums has at most half the nodes of the component, so the search
+ *     only commits up to that many nodes, branching on one node at a time
+ *     (nodes named by those committed first) and abandoning a branch as soon
+ *     as its committed nodes contain a quorum, or cannot be part of one.
+ *
+ * Nodes whose quorum set is unknown are left out: they cannot be part of a
+ * quorum, as nothing tells which slices they would accept.
+ *
+ * Self-contained, so that it can run on a worker thread.
+ */
+class QuorumIntersectionChecker
+{
+  public:
+    // Every node known, mapped to its quorum set or to nullptr if unknown.
+    using QuorumMap = std::map<NodeID, std::shared_ptr<SCPQuorumSet const>>;
+
+    enum class Result
+    {
+        INTERSECTING,
+        SPLIT,
+        // timed out or interrupted
+        UNKNOWN
+    };
+
+    // `timeout` of 0 for no limit; the check also gives up once `interrupt`,
+    // if given, is set.
+    QuorumIntersectionChecker(QuorumMap const& qmap,
+                              std::chrono::milliseconds timeout,
+                              std::atomic<bool> const* interrupt = nullptr);
+    ~QuorumIntersectionChecker();
+
+    Result check();
+
+    // Two disjoint quorums, once check() returned SPLIT.
+    std::pair<std::vector<NodeID>, std::vector<NodeID>> const&
+    getSplit() const;
+
+    // Nodes whose quorum set is known.
+    size_t getNodeCount() const;
+    // Nodes of the component containing the quorums, once check() returned.
+    size_t getMainComponentSize() const;
+    // Branches the search explored, once check() returned.
+    size_t getBranchCount() const;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> mImpl;
+};
+}
@@ -0,0 +1,162 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "herder/QuorumIntersectionChecker.h"
+#include "lib/catch.hpp"
+#include "util/XDROperators.h"
+
+#include <set>
+
+using namespace stellar;
+
+using QIC = QuorumIntersectionChecker;
+
+namespace
+{
+
+std::vector<NodeID>
+makeNodes(size_t n)
+{
+    std::vector<NodeID> res;
+    for (size_t i = 0; i < n; ++i)
+    {
+        res.push_back(SecretKey::random().getPublicKey());
+    }
+    return res;
+}
+
+// Organizations of `perOrg` of `nodes` each, `orgThreshold` of which stand
+// for their organization, and `threshold` organizations of which make a slice.
+std::shared_ptr<SCPQuorumSet>
+makeOrgsQSet(std::vector<NodeID> const& nodes, size_t perOrg,
+             uint32_t threshold, uint32_t orgThreshold)
+{
+    auto res = std::make_shared<SCPQuorumSet>();
+    res->threshold = threshold;
+    for (size_t i = 0; i < nodes.size(); i += perOrg)
+    {
+        SCPQuorumSet org;
+        org.threshold = orgThreshold;
+        org.validators.insert(org.validators.end(), nodes.begin() + i,
+                              nodes.begin() + i + perOrg);
+        res->innerSets.push_back(org);
+    }
+    return res;
+}
+
+void
+checkDisjoint(QIC const& checker)
+{
+    auto const& split = checker.getSplit();
+    REQUIRE(!split.first.empty());
+    REQUIRE(!split.second.empty());
+    std::set<NodeID> first(split.first.begin(), split.first.end());
+    for (auto const& n : split.second)
+    {
+        REQUIRE(first.find(n) == first.end());
+    }
+}
+}
+
+TEST_CASE("quorum intersection of organizations", "[herder][quorumcheck]")
+{
+    auto nodes = makeNodes(18);
+    QIC::QuorumMap qmap;
+
+    SECTION("4 of 6 organizations intersect")
+    {
+        auto qset = makeOrgsQSet(nodes, 3, 4, 2);
+        for (auto const& n : nodes)
+        {
+            qmap[n] = qset;
+        }
+        QIC checker(qmap, std::chrono::milliseconds(0));
+        REQUIRE(checker.check() == QIC::Result::INTERSECTING);
+        REQUIRE(checker.getNodeCount() == 18);
+        REQUIRE(checker.getMainComponentSize() == 18);
+    }
+
+    SECTION("3 of 6 organizations split")
+    {
+        auto qset = makeOrgsQSet(nodes, 3, 3, 2);
+        for (auto const& n : nodes)
+        {
+            qmap[n] = qset;
+        }
+        QIC checker(qmap, std::chrono::milliseconds(0));
+        REQUIRE(checker.check() == QIC::Result::SPLIT);
+        checkDisjoint(checker);
+    }
+
+    SECTION("interrupted")
+    {
+        auto qset = makeOrgsQSet(nodes, 3, 4, 2);
+        for (auto const& n : nodes)
+        {
+            qmap[n] = qset;
+        }
+        std::atomic<bool> interrupt{true};
+        QIC checker(qmap, std::chrono::milliseconds(0), &interrupt);
+        REQUIRE(checker.check() == QIC::Result::UNKNOWN);
+    }
+}
+
+TEST_CASE("quorum intersection of components", "[herder][quorumcheck]")
+{
+    auto nodes = makeNodes(6);
+    QIC::QuorumMap qmap;
+    auto left = std::make_shared<SCPQuorumSet>();
+    left->threshold = 2;
+    left->validators.assign(nodes.begin(), nodes.begin() + 3);
+    auto right = std::make_shared<SCPQuorumSet>();
+    right->threshold = 2;
+    right->validators.assign(nodes.begin() + 3, nodes.end());
+    for (size_t i = 0; i < 3; ++i)
+    {
+        qmap[nodes[i]] = left;
+        qmap[nodes[i + 3]] = right;
+    }
+
+    SECTION("two components with a quorum each split")
+    {
+        QIC checker(qmap, std::chrono::milliseconds(0));
+        REQUIRE(checker.check() == QIC::Result::SPLIT);
+        checkDisjoint(checker);
+        REQUIRE(checker.getBranchCount() == 0);
+    }
+
+    SECTION("nodes with an unknown quorum set are left out")
+    {
+        qmap[nodes[4]] = nullptr;
+        qmap[nodes[5]] = nullptr;
+        QIC checker(qmap, std::chrono::milliseconds(0));
+        REQUIRE(checker.check() == QIC::Result::INTERSECTING);
+        REQUIRE(checker.getNodeCount() == 4);
+        REQUIRE(checker.getMainComponentSize() == 3);
+    }
+}
+
+TEST_CASE("quorum intersection of many nodes following a core",
+          "[herder][quorumcheck]")
+{
+    // far past what enumerating the subsets of the nodes could do
+    auto core = makeNodes(15);
+    auto others = makeNodes(500);
+    QIC::QuorumMap qmap;
+    auto qset = makeOrgsQSet(core, 3, 4, 2);
+    for (auto const& n : core)
+    {
+        qmap[n] = qset;
+    }
+    for (auto const& n : others)
+    {
+        qmap[n] = qset;
+    }
+
+    QIC checker(qmap, std::chrono::milliseconds(0));
+    REQUIRE(checker.check() == QIC::Result::INTERSECTING);
+    REQUIRE(checker.getNodeCount() == 515);
+    REQUIRE(checker.getMainComponentSize() == 15);
+}
@@ -0,0 +1,74 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/QuorumTracker.h"
+#include "scp/LocalNode.h"
+#include "util/XDROperators.h"
+
+#include <vector>
+
+namespace stellar
+{
+
+QuorumTracker::QuorumTracker(NodeID const& localNodeID)
+    : mLocalNodeID(localNodeID)
+{
+}
+
+bool
+QuorumTracker::isNodeInQuorum(NodeID const& node) const
+{
+    return mQuorum.find(node) != mQuorum.end();
+}
+
+bool
+QuorumTracker::expand(NodeID const& node, SCPQuorumSetPtr qset)
+{
+    auto it = mQuorum.find(node);
+    if (it == mQuorum.end())
+    {
+        // not in the transitive quorum, nothing it names is either
+        return true;
+    }
+    if (!it->second)
+    {
+        it->second = qset;
+        LocalNode::forAllNodes(
+            *qset, [&](NodeID const& n) { mQuorum.emplace(n, nullptr); });
+        return true;
+    }
+    return it->second == qset || *it->second == *qset;
+}
+
+void
+QuorumTracker::rebuild(std::function<SCPQuorumSetPtr(NodeID const&)> lookup)
+{
+    mQuorum.clear();
+    std::vector<NodeID> backlog{mLocalNodeID};
+    mQuorum.emplace(mLocalNodeID, nullptr);
+    while (!backlog.empty())
+    {
+        auto node = backlog.back();
+        backlog.pop_back();
+        auto qset = lookup(node);
+        if (!qset)
+        {
+            continue;
+        }
+        mQuorum[node] = qset;
+        LocalNode::forAllNodes(*qset, [&](NodeID const& n) {
+            if (mQuorum.emplace(n, nullptr).second)
+            {
+                backlog.push_back(n);
+            }
+        });
+    }
+}
+
+QuorumTracker::QuorumMap const&
+QuorumTracker::getQuorum() const
+{
+    return mQuorum;
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "scp/SCP.h"
+
+#include <functional>
+#include <unordered_map>
+
+namespace stellar
+{
+
+/**
+ * Nodes in the transitive quorum of the local node: the local node and the
+ * nodes named by the quorum set of any node in it. Grows as the quorum sets
+ * of its nodes become known, and only gets rebuilt from scratch when one of
+ * them changes.
+ */
+class QuorumTracker
+{
+  public:
+    // every node of the transitive quorum, mapped to its quorum set or to
+    // nullptr while not known
+    using QuorumMap = std::unordered_map<NodeID, SCPQuorumSetPtr>;
+
+    explicit QuorumTracker(NodeID const& localNodeID);
+
+    bool isNodeInQuorum(NodeID const& node) const;
+
+    // Notes that `node` uses `qset`, adding the nodes it names if `node` is
+    // in the transitive quorum. Returns false if `node` was known to use
+    // another quorum set, in which case the tracker needs a rebuild.
+    bool expand(NodeID const& node, SCPQuorumSetPtr qset);
+
+    // Recomputes the transitive quorum from the local node, `lookup` giving
+    // the quorum set of each node reached, or nullptr if not known.
+    void rebuild(std::function<SCPQuorumSetPtr(NodeID const&)> lookup);
+
+    QuorumMap const& getQuorum() const;
+
+  private:
+    NodeID const mLocalNodeID;
+    QuorumMap mQuorum;
+};
+}
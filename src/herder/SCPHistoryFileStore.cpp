@@ -0,0 +1,301 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/SCPHistoryFileStore.h"
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "scp/Slot.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+
+#include <xdrpp/marshal.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+namespace stellar
+{
+
+SCPHistoryFileStore::SCPHistoryFileStore(std::string const& dir,
+                                         uint32_t checkpointFrequency)
+    : mDir(dir), mCheckpointFrequency(checkpointFrequency)
+{
+    if (!fs::exists(mDir) && !fs::mkpath(mDir))
+    {
+        throw std::runtime_error("Unable to create SCP history directory: " +
+                                 mDir);
+    }
+
+    // scp-<8 hex digits>.xdr
+    auto files = fs::findfiles(mDir, [](std::string const& name) {
+        return name.size() == 16 && name.compare(0, 4, "scp-") == 0 &&
+               name.compare(12, 4, ".xdr") == 0;
+    });
+    for (auto const& f : files)
+    {
+        indexSegment(
+            static_cast<uint32_t>(std::stoul(f.substr(4, 8), nullptr, 16)));
+    }
+}
+
+void
+SCPHistoryFileStore::dropAll(Application& app)
+{
+    std::string d = app.getConfig().SCP_HISTORY_DIR_PATH;
+
+    if (!d.empty() && fs::exists(d))
+    {
+        CLOG(DEBUG, "Herder") << "Deleting SCP history directory: " << d;
+        fs::deltree(d);
+    }
+}
+
+uint32_t
+SCPHistoryFileStore::checkpointContaining(uint32_t ledgerSeq) const
+{
+    return (ledgerSeq / mCheckpointFrequency + 1) * mCheckpointFrequency - 1;
+}
+
+std::string
+SCPHistoryFileStore::segmentPath(uint32_t checkpoint) const
+{
+    return mDir + "/" + fs::baseName("scp", fs::hexStr(checkpoint), "xdr");
+}
+
+void
+SCPHistoryFileStore::indexSegment(uint32_t checkpoint)
+{
+    auto path = segmentPath(checkpoint);
+    size_t fileSize;
+    {
+        std::ifstream f(path, std::ifstream::binary | std::ifstream::ate);
+        fileSize = static_cast<size_t>(f.tellg());
+    }
+
+    Segment seg;
+    XDRInputFileStream in;
+    in.open(path);
+    SCPHistoryEntry hEntry;
+    try
+    {
+        while (true)
+        {
+            auto offset = seg.mSize;
+            if (!in.readOne(hEntry))
+            {
+                break;
+            }
+            seg.mSize = in.pos();
+            seg.mOffsets[hEntry.v0().ledgerMessages.ledgerSeq] = offset;
+            for (auto const& q : hEntry.v0().quorumSets)
+            {
+                seg.mQSets.emplace(sha256(xdr::xdr_to_opaque(q)), q);
+            }
+        }
+    }
+    catch (xdr::xdr_runtime_error&)
+    {
+    }
+    in.close();
+
+    if (seg.mSize != fileSize)
+    {
+        // an entry was only partially written, most likely because of a
+        // crash: keep the entries before it
+        CLOG(WARNING, "Herder") << "Dropping " << (fileSize - seg.mSize)
+                                << " bytes of incomplete SCP history from "
+                                << path;
+        std::vector<char> good(seg.mSize);
+        {
+            std::ifstream f(path, std::ifstream::binary);
+            f.read(good.data(), good.size());
+        }
+        std::ofstream f(path, std::ofstream::binary | std::ofstream::trunc);
+        f.write(good.data(), good.size());
+        if (!f)
+        {
+            throw std::runtime_error("Unable to rewrite SCP history file: " +
+                                     path);
+        }
+    }
+
+    mSegments[checkpoint] = std::move(seg);
+}
+
+void
+SCPHistoryFileStore::save(uint32_t ledgerSeq,
+                          std::vector<SCPEnvelope> const& envs,
+                          std::map<Hash, SCPQuorumSetPtr> const& qSets)
+{
+    auto checkpoint = checkpointContaining(ledgerSeq);
+
+    SCPHistoryEntry hEntryV;
+    hEntryV.v(0);
+    auto& hEntry = hEntryV.v0();
+    auto& lm = hEntry.ledgerMessages;
+    lm.ledgerSeq = ledgerSeq;
+    lm.messages = envs;
+    // same order as the scphistory table is read back in
+    std::sort(lm.messages.begin(), lm.messages.end(),
+              [](SCPEnvelope const& a, SCPEnvelope const& b) {
+                  return KeyUtils::toStrKey(a.statement.nodeID) <
+                         KeyUtils::toStrKey(b.statement.nodeID);
+              });
+
+    std::map<Hash, SCPQuorumSet> newQSets;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto const& known = mSegments[checkpoint].mQSets;
+        for (auto const& q : qSets)
+        {
+            if (known.find(q.first) == known.end())
+            {
+                newQSets.emplace(q.first, *q.second);
+                hEntry.quorumSets.emplace_back(*q.second);
+            }
+        }
+    }
+
+    if (!mOutOpen || mOutCheckpoint != checkpoint)
+    {
+        if (mOutOpen)
+        {
+            mOut.close();
+        }
+        mOut.open(segmentPath(checkpoint), true);
+        mOutOpen = true;
+        mOutCheckpoint = checkpoint;
+    }
+    size_t bytes = 0;
+    mOut.writeOne(hEntryV, nullptr, &bytes);
+    mOut.flush();
+
+    // only index the entry once it is entirely in the file
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& seg = mSegments[checkpoint];
+    seg.mOffsets[ledgerSeq] = seg.mSize;
+    seg.mSize += bytes;
+    seg.mQSets.insert(newQSets.begin(), newQSets.end());
+}
+
+size_t
+SCPHistoryFileStore::copyToStream(uint32_t ledgerSeq, uint32_t ledgerCount,
+                                  XDROutputFileStream& scpHistory)
+{
+    uint64_t end = static_cast<uint64_t>(ledgerSeq) + ledgerCount;
+
+    // entries to copy, by checkpoint; taken from the index up front so that
+    // the files are read without holding the lock
+    std::map<uint32_t, std::vector<size_t>> offsets;
+    std::map<uint32_t, std::map<Hash, SCPQuorumSet>> qSets;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto it = mSegments.lower_bound(ledgerSeq);
+             it != mSegments.end() &&
+             it->first - (mCheckpointFrequency - 1) < end;
+             ++it)
+        {
+            auto const& seg = it->second;
+            for (auto o = seg.mOffsets.lower_bound(ledgerSeq);
+                 o != seg.mOffsets.end() && o->first < end; ++o)
+            {
+                offsets[it->first].emplace_back(o->second);
+            }
+            if (!seg.mOffsets.empty())
+            {
+                qSets[it->first] = seg.mQSets;
+            }
+        }
+    }
+
+    size_t n = 0;
+    for (auto const& o : offsets)
+    {
+        auto const& segQSets = qSets[o.first];
+        XDRInputFileStream in;
+        in.open(segmentPath(o.first));
+        for (auto offset : o.second)
+        {
+            SCPHistoryEntry hEntryV;
+            in.seek(offset);
+            if (!in.readOne(hEntryV))
+            {
+                throw std::runtime_error(
+                    "corrupt SCP history file: missing entry");
+            }
+            auto& hEntry = hEntryV.v0();
+            if (hEntry.ledgerMessages.messages.empty())
+            {
+                continue;
+            }
+
+            // the quorum sets used by this ledger's messages
+            hEntry.quorumSets.clear();
+            std::set<Hash> added;
+            for (auto const& env : hEntry.ledgerMessages.messages)
+            {
+                Hash const& qSetHash =
+                    Slot::getCompanionQuorumSetHashFromStatement(env.statement);
+                if (!added.insert(qSetHash).second)
+                {
+                    continue;
+                }
+                auto q = segQSets.find(qSetHash);
+                if (q == segQSets.end())
+                {
+                    throw std::runtime_error(
+                        "corrupt SCP history file: missing quorum set");
+                }
+                hEntry.quorumSets.emplace_back(q->second);
+            }
+
+            n += hEntry.ledgerMessages.messages.size();
+            scpHistory.writeOne(hEntryV);
+        }
+    }
+    return n;
+}
+
+void
+SCPHistoryFileStore::deleteOldEntries(uint32_t ledgerSeq, uint32_t count)
+{
+    std::vector<uint32_t> deleted;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto first = mSegments.begin();
+        while (first != mSegments.end() && first->second.mOffsets.empty())
+        {
+            ++first;
+        }
+        if (first == mSegments.end())
+        {
+            return;
+        }
+        uint64_t m = std::min<uint64_t>(
+            static_cast<uint64_t>(first->second.mOffsets.begin()->first) +
+                count,
+            ledgerSeq);
+        for (auto it = mSegments.begin();
+             it != mSegments.end() && it->first <= m;)
+        {
+            deleted.emplace_back(it->first);
+            it = mSegments.erase(it);
+        }
+    }
+
+    for (auto checkpoint : deleted)
+    {
+        if (mOutOpen && mOutCheckpoint == checkpoint)
+        {
+            mOut.close();
+            mOutOpen = false;
+        }
+        std::remove(segmentPath(checkpoint).c_str());
+    }
+}
+}
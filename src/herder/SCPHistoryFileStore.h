@@ -0,0 +1,86 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+#include "util/XDROperators.h"
+#include "util/XDRStream.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+class Application;
+
+/**
+ * Append-only store of the SCP messages that externalized each ledger, kept
+ * in files instead of the scphistory and scpquorums tables when
+ * SCP_HISTORY_DIR_PATH is set.
+ *
+ * There is one file per checkpoint, named after the checkpoint like history
+ * archive files (scp-<hex of its last ledger>.xdr), holding one
+ * SCPHistoryEntry per saved ledger. Each entry carries the quorum sets that
+ * were not in the file yet. Saving a ledger again appends an entry that
+ * supersedes the previous one.
+ *
+ * A small index of each file (offset of every ledger's latest entry, quorum
+ * sets seen) is rebuilt by scanning the files when the store is opened, so
+ * that reading back a range of ledgers seeks straight to its entries. A
+ * partially written entry left by a crash is dropped then.
+ *
+ * Saving and deleting happen on the main thread; copying to a stream may
+ * also run on a worker thread, while publishing history.
+ */
+class SCPHistoryFileStore : NonMovableOrCopyable
+{
+    struct Segment
+    {
+        std::map<uint32_t, size_t> mOffsets;
+        std::map<Hash, SCPQuorumSet> mQSets;
+        size_t mSize{0};
+    };
+
+    std::string const mDir;
+    uint32_t const mCheckpointFrequency;
+
+    // protects mSegments
+    std::mutex mMutex;
+    // by checkpoint (last ledger)
+    std::map<uint32_t, Segment> mSegments;
+
+    // file being appended to, of checkpoint mOutCheckpoint
+    XDROutputFileStream mOut;
+    bool mOutOpen{false};
+    uint32_t mOutCheckpoint{0};
+
+    uint32_t checkpointContaining(uint32_t ledgerSeq) const;
+    std::string segmentPath(uint32_t checkpoint) const;
+    void indexSegment(uint32_t checkpoint);
+
+  public:
+    SCPHistoryFileStore(std::string const& dir, uint32_t checkpointFrequency);
+
+    // Deletes the store configured for `app`, if any.
+    static void dropAll(Application& app);
+
+    // `qSets` must hold the quorum sets of all of `envs`.
+    void save(uint32_t ledgerSeq, std::vector<SCPEnvelope> const& envs,
+              std::map<Hash, SCPQuorumSetPtr> const& qSets);
+
+    // See HerderPersistence::copySCPHistoryToStream.
+    size_t copyToStream(uint32_t ledgerSeq, uint32_t ledgerCount,
+                        XDROutputFileStream& scpHistory);
+
+    // Deletes the files whose ledgers are all at most
+    // min(first ledger stored + count, ledgerSeq), like
+    // DatabaseUtils::deleteOldEntriesHelper does with rows.
+    void deleteOldEntries(uint32_t ledgerSeq, uint32_t count);
+};
+}
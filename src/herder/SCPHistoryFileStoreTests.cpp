@@ -0,0 +1,123 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/SCPHistoryFileStore.h"
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "lib/catch.hpp"
+#include "util/TmpDir.h"
+#include "xdrpp/marshal.h"
+
+#include <fstream>
+
+using namespace stellar;
+
+namespace
+{
+SCPEnvelope
+makeEnvelope(std::string const& node, uint32_t ledgerSeq,
+             SCPQuorumSetPtr const& qSet)
+{
+    SCPEnvelope env;
+    env.statement.nodeID = SecretKey::fromSeed(sha256(node)).getPublicKey();
+    env.statement.slotIndex = ledgerSeq;
+    env.statement.pledges.type(SCP_ST_EXTERNALIZE);
+    env.statement.pledges.externalize().commitQuorumSetHash =
+        sha256(xdr::xdr_to_opaque(*qSet));
+    return env;
+}
+
+std::vector<SCPHistoryEntry>
+copyAll(SCPHistoryFileStore& store, std::string const& path,
+        uint32_t ledgerSeq, uint32_t ledgerCount, size_t& n)
+{
+    {
+        XDROutputFileStream out;
+        out.open(path);
+        n = store.copyToStream(ledgerSeq, ledgerCount, out);
+    }
+    std::vector<SCPHistoryEntry> res;
+    XDRInputFileStream in;
+    in.open(path);
+    SCPHistoryEntry entry;
+    while (in.readOne(entry))
+    {
+        res.emplace_back(entry);
+    }
+    return res;
+}
+}
+
+TEST_CASE("SCP history file store", "[herder][scphistory]")
+{
+    TmpDir tmp("scphistory");
+    auto dir = tmp.getName() + "/store";
+    auto outPath = tmp.getName() + "/out.xdr";
+
+    auto q1 = std::make_shared<SCPQuorumSet>();
+    q1->threshold = 1;
+    auto q2 = std::make_shared<SCPQuorumSet>();
+    q2->threshold = 2;
+    std::map<Hash, SCPQuorumSetPtr> qSets;
+    qSets[sha256(xdr::xdr_to_opaque(*q1))] = q1;
+    qSets[sha256(xdr::xdr_to_opaque(*q2))] = q2;
+
+    size_t n;
+    {
+        SCPHistoryFileStore store(dir, 64);
+        store.save(10, {makeEnvelope("A", 10, q1), makeEnvelope("B", 10, q2)},
+                   qSets);
+        store.save(11, {makeEnvelope("A", 11, q1)}, qSets);
+        // saved again, supersedes the first one
+        store.save(10, {makeEnvelope("C", 10, q1)}, qSets);
+        store.save(70, {makeEnvelope("A", 70, q2)}, qSets);
+
+        auto entries = copyAll(store, outPath, 10, 64, n);
+        REQUIRE(n == 3);
+        REQUIRE(entries.size() == 3);
+        REQUIRE(entries[0].v0().ledgerMessages.ledgerSeq == 10);
+        REQUIRE(entries[0].v0().ledgerMessages.messages.size() == 1);
+        REQUIRE(entries[1].v0().ledgerMessages.ledgerSeq == 11);
+        REQUIRE(entries[2].v0().ledgerMessages.ledgerSeq == 70);
+        // only the quorum sets used by each ledger
+        REQUIRE(entries[1].v0().quorumSets.size() == 1);
+        REQUIRE(entries[1].v0().quorumSets[0] == *q1);
+        REQUIRE(entries[2].v0().quorumSets[0] == *q2);
+
+        REQUIRE(copyAll(store, outPath, 12, 52, n).empty());
+        REQUIRE(n == 0);
+    }
+
+    SECTION("reopened")
+    {
+        SCPHistoryFileStore store(dir, 64);
+        REQUIRE(copyAll(store, outPath, 0, 100, n).size() == 3);
+        REQUIRE(n == 3);
+    }
+
+    SECTION("incomplete entry dropped when reopened")
+    {
+        {
+            std::ofstream f(dir + "/scp-0000007f.xdr",
+                            std::ofstream::binary | std::ofstream::app);
+            f.write("\x80\x00\x01", 3);
+        }
+        SCPHistoryFileStore store(dir, 64);
+        REQUIRE(copyAll(store, outPath, 70, 1, n).size() == 1);
+        store.save(71, {makeEnvelope("A", 71, q1)}, qSets);
+        REQUIRE(copyAll(store, outPath, 64, 64, n).size() == 2);
+    }
+
+    SECTION("old entries deleted by checkpoint")
+    {
+        SCPHistoryFileStore store(dir, 64);
+        // ledgers up to 20 are too old, but 21 to 63 are not
+        store.deleteOldEntries(21, 100);
+        REQUIRE(copyAll(store, outPath, 0, 100, n).size() == 3);
+        store.deleteOldEntries(65, 100);
+        auto entries = copyAll(store, outPath, 0, 100, n);
+        REQUIRE(entries.size() == 1);
+        REQUIRE(entries[0].v0().ledgerMessages.ledgerSeq == 70);
+    }
+}
@@ -0,0 +1,299 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TransactionQueue.h"
+#include "crypto/SecretKey.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+bool
+TransactionQueue::FeeRateKey::hasLowerRate(FeeRateKey const& other) const
+{
+    return mFee * other.mOps < other.mFee * mOps;
+}
+
+bool
+TransactionQueue::FeeRateKey::operator<(FeeRateKey const& other) const
+{
+    if (hasLowerRate(other))
+    {
+        return true;
+    }
+    if (other.hasLowerRate(*this))
+    {
+        return false;
+    }
+    return mHash < other.mHash;
+}
+
+bool
+TransactionQueue::AccountRateKey::operator<(AccountRateKey const& other) const
+{
+    if (other.mMinRate.hasLowerRate(mMinRate))
+    {
+        return true;
+    }
+    if (mMinRate.hasLowerRate(other.mMinRate))
+    {
+        return false;
+    }
+    return mAccount < other.mAccount;
+}
+
+TransactionQueue::TransactionQueue(size_t maxAge, size_t maxBytes)
+    : mMaxAge(maxAge), mMaxBytes(maxBytes)
+{
+    mGenerations.resize(mMaxAge);
+    mCountByAge.resize(mMaxAge);
+}
+
+TransactionQueue::FeeRateKey
+TransactionQueue::feeRateKey(TransactionFramePtr const& tx)
+{
+    auto ops = std::max<int64_t>(1, tx->getOperations().size());
+    return FeeRateKey{tx->getFee(), ops, tx->getFullHash()};
+}
+
+bool
+TransactionQueue::contains(Hash const& fullHash) const
+{
+    return mTransactions.find(fullHash) != mTransactions.end();
+}
+
+TransactionQueue::AccountState
+TransactionQueue::getAccountState(AccountID const& account) const
+{
+    auto it = mAccounts.find(account);
+    if (it == mAccounts.end())
+    {
+        return AccountState{};
+    }
+    return it->second;
+}
+
+void
+TransactionQueue::add(TransactionFramePtr const& tx)
+{
+    auto const& h = tx->getFullHash();
+    if (contains(h))
+    {
+        return;
+    }
+    auto bytes = TX_OVERHEAD + tx->getEnvelopeBytes().size();
+    mTransactions.emplace(h, Entry{tx, mGeneration, bytes});
+    mBytes += bytes;
+
+    auto& acc = mAccounts[tx->getSourceID()];
+    unindexAccount(acc);
+    acc.mBySeq.emplace(tx->getSeqNum(), h);
+    acc.mMaxSeq = acc.mBySeq.rbegin()->first;
+    acc.mTotalFees += tx->getFee();
+    indexAccount(tx->getSourceID(), acc);
+
+    mByFeeRate.emplace(feeRateKey(tx));
+    mGenerations.front().emplace_back(h);
+    mCountByAge.front()++;
+}
+
+void
+TransactionQueue::erase(Hash const& hash)
+{
+    auto it = mTransactions.find(hash);
+    if (it == mTransactions.end())
+    {
+        return;
+    }
+    auto const& tx = it->second.mTx;
+
+    auto acc = mAccounts.find(tx->getSourceID());
+    unindexAccount(acc->second);
+    auto range = acc->second.mBySeq.equal_range(tx->getSeqNum());
+    for (auto s = range.first; s != range.second; ++s)
+    {
+        if (s->second == hash)
+        {
+            acc->second.mBySeq.erase(s);
+            break;
+        }
+    }
+    if (acc->second.mBySeq.empty())
+    {
+        mAccounts.erase(acc);
+    }
+    else
+    {
+        acc->second.mMaxSeq = acc->second.mBySeq.rbegin()->first;
+        acc->second.mTotalFees -= tx->getFee();
+        indexAccount(acc->first, acc->second);
+    }
+
+    mByFeeRate.erase(feeRateKey(tx));
+    mCountByAge[mGeneration - it->second.mGeneration]--;
+    mBytes -= it->second.mBytes;
+    mTransactions.erase(it);
+}
+
+void
+TransactionQueue::unindexAccount(AccountTxs const& acc)
+{
+    if (!acc.mBySeq.empty())
+    {
+        mAccountsByRate.erase(acc.mRateKey);
+    }
+}
+
+void
+TransactionQueue::indexAccount(AccountID const& id, AccountTxs& acc)
+{
+    if (acc.mBySeq.empty())
+    {
+        return;
+    }
+    bool first = true;
+    for (auto const& s : acc.mBySeq)
+    {
+        auto key = feeRateKey(mTransactions.find(s.second)->second.mTx);
+        if (first || key.hasLowerRate(acc.mRateKey.mMinRate))
+        {
+            acc.mRateKey.mMinRate = key;
+            first = false;
+        }
+    }
+    acc.mRateKey.mAccount = id;
+    mAccountsByRate.emplace(acc.mRateKey);
+}
+
+void
+TransactionQueue::remove(std::vector<TransactionFramePtr> const& txs)
+{
+    for (auto const& tx : txs)
+    {
+        erase(tx->getFullHash());
+    }
+}
+
+size_t
+TransactionQueue::evictFrom(Hash const& hash)
+{
+    auto const& tx = mTransactions.find(hash)->second.mTx;
+    auto const& acc = mAccounts.find(tx->getSourceID())->second;
+    std::vector<Hash> evicted;
+    for (auto it = acc.mBySeq.lower_bound(tx->getSeqNum());
+         it != acc.mBySeq.end(); ++it)
+    {
+        evicted.emplace_back(it->second);
+    }
+    for (auto const& h : evicted)
+    {
+        erase(h);
+    }
+    return evicted.size();
+}
+
+size_t
+TransactionQueue::makeRoomFor(TransactionFramePtr const& tx, bool& fits)
+{
+    size_t evicted = 0;
+    auto bytes = TX_OVERHEAD + tx->getEnvelopeBytes().size();
+    auto key = feeRateKey(tx);
+    auto it = mByFeeRate.begin();
+    while (mBytes + bytes > mMaxBytes && it != mByFeeRate.end() &&
+           it->hasLowerRate(key))
+    {
+        auto const& victim = mTransactions.find(it->mHash)->second.mTx;
+        if (victim->getSourceID() == tx->getSourceID())
+        {
+            // the account's own transactions are what `tx` builds on
+            ++it;
+            continue;
+        }
+        evicted += evictFrom(it->mHash);
+        // evicting invalidated `it`, start over from the lowest fee rate,
+        // skipping the (few) transactions of the account of `tx`
+        it = mByFeeRate.begin();
+    }
+    fits = mBytes + bytes <= mMaxBytes;
+    return evicted;
+}
+
+void
+TransactionQueue::shift()
+{
+    for (auto const& h : mGenerations.back())
+    {
+        auto it = mTransactions.find(h);
+        if (it != mTransactions.end() &&
+            mGeneration - it->second.mGeneration == mMaxAge - 1)
+        {
+            erase(h);
+        }
+    }
+    mGenerations.pop_back();
+    mGenerations.emplace_front();
+    mCountByAge.pop_back();
+    mCountByAge.emplace_front(0);
+    mGeneration++;
+}
+
+std::vector<TransactionFramePtr>
+TransactionQueue::getTransactions() const
+{
+    std::vector<TransactionFramePtr> res;
+    res.reserve(mTransactions.size());
+    for (size_t age = mMaxAge; age-- > 0;)
+    {
+        for (auto const& h : mGenerations[age])
+        {
+            // skip ids left behind by transactions removed (and maybe added
+            // again since)
+            auto it = mTransactions.find(h);
+            if (it != mTransactions.end() &&
+                mGeneration - it->second.mGeneration == age)
+            {
+                res.emplace_back(it->second.mTx);
+            }
+        }
+    }
+    return res;
+}
+
+std::vector<TransactionFramePtr>
+TransactionQueue::getTopTransactions(size_t maxTxs) const
+{
+    std::vector<TransactionFramePtr> res;
+    for (auto it = mAccountsByRate.begin();
+         it != mAccountsByRate.end() && res.size() < maxTxs; ++it)
+    {
+        auto const& acc = mAccounts.find(it->mAccount)->second;
+        for (auto s = acc.mBySeq.begin();
+             s != acc.mBySeq.end() && res.size() < maxTxs; ++s)
+        {
+            res.emplace_back(mTransactions.find(s->second)->second.mTx);
+        }
+    }
+    return res;
+}
+
+size_t
+TransactionQueue::size() const
+{
+    return mTransactions.size();
+}
+
+size_t
+TransactionQueue::countAtAge(size_t age) const
+{
+    return age < mCountByAge.size() ? mCountByAge[age] : 0;
+}
+
+size_t
+TransactionQueue::getBytes() const
+{
+    return mBytes;
+}
+}
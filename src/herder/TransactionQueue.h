@@ -0,0 +1,147 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/TransactionFrame.h"
+#include "util/HashOfHash.h"
+#include "util/NonCopyable.h"
+#include "util/XDROperators.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * TransactionQueue holds the transactions received by the herder that are
+ * not in a ledger yet.
+ *
+ * Transactions are indexed by full hash, queued per source account in
+ * sequence number order, and ordered by fee rate (fee per operation) across
+ * accounts. Each belongs to the ledger generation during which it was
+ * received. shift() ages every transaction by one ledger in constant time,
+ * only visiting the ones that reach the maximum age and get dropped.
+ *
+ * Accounts are also kept ordered by the lowest fee rate of their
+ * transactions, so that the candidates of the next transaction set are
+ * picked without sorting the whole queue when surge pricing is in effect.
+ *
+ * The queue is bounded by an estimate of the memory held by its transactions.
+ * Making room for a transaction evicts the transactions with the lowest fee
+ * rate first, taking along the later transactions of their account (which
+ * could not be applied without them).
+ */
+class TransactionQueue : NonMovableOrCopyable
+{
+  public:
+    // Rough per-transaction bookkeeping cost (frame, index nodes) added to
+    // the XDR size of the envelope when accounting bytes.
+    static size_t const TX_OVERHEAD = 512;
+
+    struct AccountState
+    {
+        SequenceNumber mMaxSeq{0};
+        int64_t mTotalFees{0};
+    };
+
+  private:
+    struct Entry
+    {
+        TransactionFramePtr mTx;
+        uint64_t mGeneration;
+        size_t mBytes;
+    };
+
+    // orders by fee per operation, then hash; compared by cross
+    // multiplication so that no rounding is involved
+    struct FeeRateKey
+    {
+        int64_t mFee;
+        int64_t mOps;
+        Hash mHash;
+        bool hasLowerRate(FeeRateKey const& other) const;
+        bool operator<(FeeRateKey const& other) const;
+    };
+
+    // orders accounts by the lowest fee rate of their transactions, highest
+    // first, then by account id (as TxSetFrame::surgePricingFilter does)
+    struct AccountRateKey
+    {
+        FeeRateKey mMinRate;
+        AccountID mAccount;
+        bool operator<(AccountRateKey const& other) const;
+    };
+
+    struct AccountTxs : AccountState
+    {
+        std::multimap<SequenceNumber, Hash> mBySeq;
+        // valid when mBySeq is not empty
+        AccountRateKey mRateKey;
+    };
+
+    size_t const mMaxAge;
+    size_t const mMaxBytes;
+    size_t mBytes{0};
+    // generation of the transactions received while the current ledger
+    // closes, i.e. of age 0
+    uint64_t mGeneration{0};
+
+    std::unordered_map<Hash, Entry> mTransactions;
+    std::unordered_map<AccountID, AccountTxs> mAccounts;
+    std::set<FeeRateKey> mByFeeRate;
+    std::set<AccountRateKey> mAccountsByRate;
+    // transactions by age, front is age 0; ids of removed transactions stay
+    // until their generation expires
+    std::deque<std::vector<Hash>> mGenerations;
+    std::deque<size_t> mCountByAge;
+
+    static FeeRateKey feeRateKey(TransactionFramePtr const& tx);
+    void erase(Hash const& hash);
+    void unindexAccount(AccountTxs const& acc);
+    void indexAccount(AccountID const& id, AccountTxs& acc);
+    // evicts `hash` along with the transactions of the same account with a
+    // higher sequence number
+    size_t evictFrom(Hash const& hash);
+
+  public:
+    // transactions are dropped once maxAge ledgers closed since they were
+    // received
+    TransactionQueue(size_t maxAge, size_t maxBytes);
+
+    bool contains(Hash const& fullHash) const;
+
+    // highest sequence number and total fees of the account's transactions
+    AccountState getAccountState(AccountID const& account) const;
+
+    // Makes room for `tx`, evicting transactions of other accounts with a
+    // lower fee rate as needed. Returns the number of transactions evicted;
+    // `fits` is set to whether `tx` now fits.
+    size_t makeRoomFor(TransactionFramePtr const& tx, bool& fits);
+
+    // Adds `tx` at age 0, unless already present.
+    void add(TransactionFramePtr const& tx);
+
+    void remove(std::vector<TransactionFramePtr> const& txs);
+
+    // ages all transactions by one ledger, dropping the oldest
+    void shift();
+
+    // all transactions, oldest generation first
+    std::vector<TransactionFramePtr> getTransactions() const;
+
+    // At most `maxTxs` transactions to nominate: the transactions of the
+    // best paying accounts, each account's in sequence number order. Only
+    // visits the transactions returned.
+    std::vector<TransactionFramePtr> getTopTransactions(size_t maxTxs) const;
+
+    size_t size() const;
+    size_t countAtAge(size_t age) const;
+    size_t getBytes() const;
+};
+}
@@ -0,0 +1,180 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TransactionQueue.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "xdrpp/marshal.h"
+
+#include <cstdint>
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+namespace
+{
+TransactionFramePtr
+makeTx(Application& app, SecretKey const& from, SequenceNumber seq,
+       uint32_t fee)
+{
+    auto tx = transactionFromOperations(app, from, seq, {inflation()});
+    tx->getEnvelope().tx.fee = fee;
+    tx->clearCached();
+    return tx;
+}
+
+bool
+queued(TransactionQueue const& queue, TransactionFramePtr const& tx)
+{
+    return queue.contains(tx->getFullHash());
+}
+}
+
+TEST_CASE("TransactionQueue", "[herder][txqueue]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+
+    auto a = getAccount("A");
+    auto b = getAccount("B");
+    auto c = getAccount("C");
+
+    SECTION("per account state")
+    {
+        TransactionQueue queue(4, SIZE_MAX);
+        auto a1 = makeTx(*app, a, 1, 100);
+        auto a2 = makeTx(*app, a, 2, 200);
+        auto b5 = makeTx(*app, b, 5, 100);
+
+        queue.add(a1);
+        queue.add(a2);
+        queue.add(b5);
+        queue.add(a2);
+        REQUIRE(queue.size() == 3);
+        REQUIRE(queued(queue, a1));
+
+        auto state = queue.getAccountState(a.getPublicKey());
+        REQUIRE(state.mMaxSeq == 2);
+        REQUIRE(state.mTotalFees == 300);
+        REQUIRE(queue.getAccountState(c.getPublicKey()).mMaxSeq == 0);
+
+        queue.remove({a2});
+        state = queue.getAccountState(a.getPublicKey());
+        REQUIRE(state.mMaxSeq == 1);
+        REQUIRE(state.mTotalFees == 100);
+
+        queue.remove({a1, b5});
+        REQUIRE(queue.size() == 0);
+        REQUIRE(queue.getBytes() == 0);
+        REQUIRE(queue.getAccountState(a.getPublicKey()).mTotalFees == 0);
+    }
+
+    SECTION("aging")
+    {
+        TransactionQueue queue(3, SIZE_MAX);
+        auto a1 = makeTx(*app, a, 1, 100);
+        auto b1 = makeTx(*app, b, 1, 100);
+        auto c1 = makeTx(*app, c, 1, 100);
+
+        queue.add(a1);
+        queue.shift();
+        queue.add(b1);
+        REQUIRE(queue.countAtAge(0) == 1);
+        REQUIRE(queue.countAtAge(1) == 1);
+
+        // a removed and received again transaction starts over at age 0
+        queue.remove({b1});
+        queue.shift();
+        queue.add(b1);
+        queue.add(c1);
+        REQUIRE(queue.countAtAge(0) == 2);
+        REQUIRE(queue.countAtAge(1) == 0);
+        REQUIRE(queue.countAtAge(2) == 1);
+        REQUIRE(queue.getTransactions() ==
+                std::vector<TransactionFramePtr>{a1, b1, c1});
+
+        queue.shift();
+        REQUIRE(!queued(queue, a1));
+        REQUIRE(queue.countAtAge(1) == 2);
+        queue.shift();
+        REQUIRE(queue.countAtAge(2) == 2);
+        queue.shift();
+        REQUIRE(queue.size() == 0);
+        REQUIRE(queue.getTransactions().empty());
+    }
+
+    SECTION("eviction by fee rate")
+    {
+        auto a1 = makeTx(*app, a, 1, 100);
+        auto txBytes =
+            TransactionQueue::TX_OVERHEAD + xdr::xdr_size(a1->getEnvelope());
+        TransactionQueue queue(4, 3 * txBytes);
+
+        auto a2 = makeTx(*app, a, 2, 300);
+        auto b1 = makeTx(*app, b, 1, 200);
+        queue.add(a1);
+        queue.add(a2);
+        queue.add(b1);
+        REQUIRE(queue.getBytes() == 3 * txBytes);
+
+        bool fits;
+        SECTION("nothing cheaper to evict")
+        {
+            auto c1 = makeTx(*app, c, 1, 100);
+            REQUIRE(queue.makeRoomFor(c1, fits) == 0);
+            REQUIRE(!fits);
+            REQUIRE(queue.size() == 3);
+        }
+        SECTION("evicts the account's later transactions along")
+        {
+            auto c1 = makeTx(*app, c, 1, 150);
+            REQUIRE(queue.makeRoomFor(c1, fits) == 2);
+            REQUIRE(fits);
+            REQUIRE(!queued(queue, a1));
+            REQUIRE(!queued(queue, a2));
+            REQUIRE(queued(queue, b1));
+            queue.add(c1);
+            REQUIRE(queue.getBytes() == 2 * txBytes);
+        }
+        SECTION("does not evict the transactions it builds on")
+        {
+            auto a3 = makeTx(*app, a, 3, 1000);
+            REQUIRE(queue.makeRoomFor(a3, fits) == 1);
+            REQUIRE(fits);
+            REQUIRE(queued(queue, a1));
+            REQUIRE(!queued(queue, b1));
+        }
+    }
+
+    SECTION("top transactions")
+    {
+        TransactionQueue queue(4, SIZE_MAX);
+        auto a1 = makeTx(*app, a, 1, 300);
+        auto a2 = makeTx(*app, a, 2, 100);
+        auto b1 = makeTx(*app, b, 1, 200);
+        auto c1 = makeTx(*app, c, 1, 500);
+        auto c2 = makeTx(*app, c, 2, 400);
+        queue.add(c2);
+        queue.add(a2);
+        queue.add(b1);
+        queue.add(c1);
+        queue.add(a1);
+
+        // accounts are ranked by their cheapest transaction
+        REQUIRE(queue.getTopTransactions(10) ==
+                std::vector<TransactionFramePtr>{c1, c2, b1, a1, a2});
+        REQUIRE(queue.getTopTransactions(4) ==
+                std::vector<TransactionFramePtr>{c1, c2, b1, a1});
+        REQUIRE(queue.getTopTransactions(0).empty());
+
+        queue.remove({a2});
+        REQUIRE(queue.getTopTransactions(2) ==
+                std::vector<TransactionFramePtr>{c1, c2});
+        REQUIRE(queue.getTopTransactions(3) ==
+                std::vector<TransactionFramePtr>{c1, c2, a1});
+    }
+}
@@ -7,13 +7,23 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "database/Database.h"
+#include "database/EntryCache.h"
+#include "ledger/EntryFrame.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "transactions/ApplyCostModel.h"
 #include "util/Logging.h"
+#include "util/WorkerLanes.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "xdrpp/printer.h"
 
@@ -22,6 +32,13 @@ namespace stellar
 
 using namespace std;
 
+namespace
+{
+// tx sets are also hashed by worker threads (catchup, history)
+std::atomic<uint64_t> gHashComputations{0};
+std::atomic<uint64_t> gApplyOrderComputations{0};
+}
+
 TxSetFrame::TxSetFrame(Hash const& previousLedgerHash)
     : mHashIsValid(false), mPreviousLedgerHash(previousLedgerHash)
 {
@@ -52,8 +69,28 @@ HashTxSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
 void
 TxSetFrame::sortForHash()
 {
-    std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
+    TransactionFrame::computeHashes(mTransactions);
+    if (!std::is_sorted(mTransactions.begin(), mTransactions.end(),
+                        HashTxSorter))
+    {
+        std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
+        invalidateCaches();
+    }
+}
+
+void
+TxSetFrame::invalidateCaches()
+{
     mHashIsValid = false;
+    mApplyOrderIsValid = false;
+    mApplyOrder.clear();
+}
+
+void
+TxSetFrame::flushComputeCounts(uint64_t& hashes, uint64_t& applyOrders)
+{
+    hashes = gHashComputations.exchange(0);
+    applyOrders = gApplyOrderComputations.exchange(0);
 }
 
 // We want to XOR the tx hash with the set hash.
@@ -92,6 +129,12 @@ SeqSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
 std::vector<TransactionFramePtr>
 TxSetFrame::sortForApply()
 {
+    if (mApplyOrderIsValid)
+    {
+        return mApplyOrder;
+    }
+    gApplyOrderComputations++;
+
     vector<TransactionFramePtr> retList;
 
     vector<vector<TransactionFramePtr>> txBatches(4);
@@ -117,11 +160,11 @@ TxSetFrame::sortForApply()
 
     retList.clear();
 
+    // randomize each batch using the hash of the transaction set
+    // as a way to randomize even more
+    ApplyTxSorter s(getContentsHash());
     for (auto& batch : txBatches)
     {
-        // randomize each batch using the hash of the transaction set
-        // as a way to randomize even more
-        ApplyTxSorter s(getContentsHash());
         std::sort(batch.begin(), batch.end(), s);
         for (auto tx : batch)
         {
@@ -129,9 +172,81 @@ TxSetFrame::sortForApply()
         }
     }
 
+    mApplyOrder = retList;
+    mApplyOrderIsValid = true;
     return retList;
 }
 
+std::vector<std::vector<TransactionFramePtr>>
+TxSetFrame::partitionForApply(std::vector<TransactionFramePtr> const& txs)
+{
+    // union-find over transaction indices, joined by shared keys
+    std::vector<size_t> parent(txs.size());
+    auto find = [&parent](size_t i) {
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+    auto join = [&](size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        // the root is always the earliest transaction of its group
+        if (a < b)
+        {
+            parent[b] = a;
+        }
+        else
+        {
+            parent[a] = b;
+        }
+    };
+
+    std::unordered_map<LedgerKey, size_t, LedgerKeyHash> owners;
+    size_t const none = txs.size();
+    size_t unknown = none;
+    for (size_t i = 0; i < txs.size(); i++)
+    {
+        parent[i] = i;
+        std::unordered_set<LedgerKey, LedgerKeyHash> keys;
+        if (!txs[i]->insertLedgerKeysToFootprint(keys))
+        {
+            if (unknown == none)
+            {
+                unknown = i;
+            }
+            else
+            {
+                join(unknown, i);
+            }
+        }
+        // keys added before giving up still have to be joined on
+        for (auto const& key : keys)
+        {
+            auto res = owners.emplace(key, i);
+            if (!res.second)
+            {
+                join(res.first->second, i);
+            }
+        }
+    }
+
+    std::vector<std::vector<TransactionFramePtr>> res;
+    std::unordered_map<size_t, size_t> groupOf;
+    for (size_t i = 0; i < txs.size(); i++)
+    {
+        auto it = groupOf.emplace(find(i), res.size()).first;
+        if (it->second == res.size())
+        {
+            res.emplace_back();
+        }
+        res[it->second].emplace_back(txs[i]);
+    }
+    return res;
+}
+
 struct SurgeSorter
 {
     map<AccountID, double>& mAccountFeeMap;
@@ -185,6 +300,146 @@ TxSetFrame::surgePricingFilter(LedgerManager const& lm)
     }
 }
 
+void
+TxSetFrame::applyCostFilter(ApplyCostModel const& costs, size_t maxTxs,
+                            std::chrono::nanoseconds budget)
+{
+    struct Candidate
+    {
+        TransactionFramePtr mTx;
+        std::chrono::nanoseconds mCost;
+    };
+
+    // an account pays what its worst paying transaction pays, as it cannot
+    // get its later transactions in without the earlier ones
+    map<AccountID, std::vector<Candidate>> byAccount;
+    map<AccountID, double> accountRate;
+    for (auto const& tx : mTransactions)
+    {
+        auto cost = costs.getTransactionCost(*tx);
+        double r = double(tx->getFee()) / double(cost.count());
+        auto const& id = tx->getSourceID();
+        byAccount[id].push_back({tx, cost});
+        auto it = accountRate.find(id);
+        if (it == accountRate.end())
+        {
+            accountRate.emplace(id, r);
+        }
+        else if (r < it->second)
+        {
+            it->second = r;
+        }
+    }
+
+    std::vector<AccountID> accounts;
+    for (auto const& a : byAccount)
+    {
+        accounts.emplace_back(a.first);
+    }
+    // byAccount is sorted by account id, which breaks ties
+    std::stable_sort(accounts.begin(), accounts.end(),
+                     [&](AccountID const& a, AccountID const& b) {
+                         return accountRate[a] > accountRate[b];
+                     });
+
+    std::vector<TransactionFramePtr> kept;
+    std::chrono::nanoseconds total{0};
+    for (auto const& id : accounts)
+    {
+        auto& txs = byAccount[id];
+        std::sort(txs.begin(), txs.end(),
+                  [](Candidate const& a, Candidate const& b) {
+                      return a.mTx->getSeqNum() < b.mTx->getSeqNum();
+                  });
+        for (auto const& c : txs)
+        {
+            if (kept.size() >= maxTxs ||
+                (!kept.empty() && total + c.mCost > budget))
+            {
+                break;
+            }
+            kept.emplace_back(c.mTx);
+            total += c.mCost;
+        }
+    }
+
+    if (kept.size() != mTransactions.size())
+    {
+        CLOG(DEBUG, "Herder")
+            << "apply cost filter kept " << kept.size() << " of "
+            << mTransactions.size() << " transactions, estimated "
+            << std::chrono::duration_cast<std::chrono::microseconds>(total)
+                   .count()
+            << "us";
+        mTransactions = std::move(kept);
+        invalidateCaches();
+    }
+}
+
+void
+TxSetFrame::startMasterKeySignatureChecks(Application& app)
+{
+    auto& workers = app.getWorkerLanes();
+    size_t numHelpers = app.getWorkerThreadCount();
+    auto post = [&workers](std::function<void()> f) {
+        workers.post(WorkerLane::CRYPTO, f);
+    };
+
+    auto masterSigs =
+        std::make_shared<std::vector<PubKeyUtils::SigVerification>>();
+    for (auto const& tx : mTransactions)
+    {
+        tx->addMasterKeySignatureVerifications(*masterSigs);
+    }
+    if (masterSigs->empty())
+    {
+        return;
+    }
+    // `txs` keeps alive the contents hashes the checks refer to
+    post([masterSigs, txs = mTransactions, numHelpers, post]() {
+        PubKeyUtils::verifySigs(*masterSigs, numHelpers - 1, post);
+    });
+}
+
+void
+TxSetFrame::verifySignatures(Application& app)
+{
+    auto& verifyTimer =
+        app.getMetrics().NewTimer({"herder", "txset", "verify-sigs"});
+    auto timer = verifyTimer.TimeScope();
+
+    auto& workers = app.getWorkerLanes();
+    size_t numHelpers = app.getWorkerThreadCount();
+    auto post = [&workers](std::function<void()> f) {
+        workers.post(WorkerLane::CRYPTO, f);
+    };
+
+    // The master key checks run on the worker pool while the accounts get
+    // loaded below. Whatever they got through by then is a verify cache hit.
+    startMasterKeySignatureChecks(app);
+
+    // load all the source accounts in a few queries rather than one by one
+    std::unordered_set<LedgerKey, LedgerKeyHash> keys;
+    for (auto const& tx : mTransactions)
+    {
+        for (auto const& id : tx->getSourceIDs())
+        {
+            LedgerKey key;
+            key.type(ACCOUNT);
+            key.account().accountID = id;
+            keys.emplace(key);
+        }
+    }
+    EntryFrame::prefetch(app.getDatabase(), keys);
+
+    std::vector<PubKeyUtils::SigVerification> sigs;
+    for (auto const& tx : mTransactions)
+    {
+        tx->addSignatureVerifications(app.getDatabase(), sigs);
+    }
+    PubKeyUtils::verifySigs(sigs, numHelpers, post);
+}
+
 bool
 TxSetFrame::checkOrTrim(
     Application& app,
@@ -209,6 +464,8 @@ TxSetFrame::checkOrTrim(
         lastHash = tx->getFullHash();
     }
 
+    verifySignatures(app);
+
     for (auto& item : accountTxMap)
     {
         // order by sequence number
@@ -332,8 +589,10 @@ TxSetFrame::removeTx(TransactionFramePtr tx)
 {
     auto it = std::find(mTransactions.begin(), mTransactions.end(), tx);
     if (it != mTransactions.end())
+    {
         mTransactions.erase(it);
-    mHashIsValid = false;
+        invalidateCaches();
+    }
 }
 
 Hash
@@ -341,12 +600,13 @@ TxSetFrame::getContentsHash()
 {
     if (!mHashIsValid)
     {
+        gHashComputations++;
         sortForHash();
         auto hasher = SHA256::create();
         hasher->add(mPreviousLedgerHash);
         for (unsigned int n = 0; n < mTransactions.size(); n++)
         {
-            hasher->add(xdr::xdr_to_opaque(mTransactions[n]->getEnvelope()));
+            hasher->add(mTransactions[n]->getEnvelopeBytes());
         }
         mHash = hasher->finish();
         mHashIsValid = true;
@@ -357,7 +617,7 @@ TxSetFrame::getContentsHash()
 Hash&
 TxSetFrame::previousLedgerHash()
 {
-    mHashIsValid = false;
+    invalidateCaches();
     return mPreviousLedgerHash;
 }
 
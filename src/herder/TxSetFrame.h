@@ -7,9 +7,12 @@
 #include "overlay/StellarXDR.h"
 #include "transactions/TransactionFrame.h"
 
+#include <chrono>
+
 namespace stellar
 {
 class Application;
+class ApplyCostModel;
 
 class TxSetFrame;
 typedef std::shared_ptr<TxSetFrame> TxSetFramePtr;
@@ -19,8 +22,29 @@ class TxSetFrame
     bool mHashIsValid;
     Hash mHash;
 
+    // memoized result of sortForApply, depends on mHash
+    bool mApplyOrderIsValid{false};
+    std::vector<TransactionFramePtr> mApplyOrder;
+
+    void invalidateCaches();
+
     Hash mPreviousLedgerHash;
 
+    // Runs the set's ed25519 signature checks in parallel on the worker pool
+    // so that the per-transaction checks that follow hit the verify cache.
+    // Also bulk-loads the source accounts those checks then look up,
+    // overlapping the load with the master key checks.
+    void verifySignatures(Application& app);
+
+  public:
+    // Starts the checks of the signatures by the source accounts' master
+    // keys on the worker pool and returns without waiting for them: they
+    // need no ledger state, and only fill the verify cache ahead of the
+    // checks done when the set is validated or applied.
+    void startMasterKeySignatureChecks(Application& app);
+
+  private:
+
     bool
     checkOrTrim(Application& app,
                 std::function<bool(TransactionFramePtr, SequenceNumber)>
@@ -29,6 +53,8 @@ class TxSetFrame
                     processLastInvalidTxLambda);
 
   public:
+    // Changes made directly to mTransactions rather than through add and
+    // removeTx must be followed by a call to sortForHash.
     std::vector<TransactionFramePtr> mTransactions;
 
     TxSetFrame(Hash const& previousLedgerHash);
@@ -44,22 +70,45 @@ class TxSetFrame
     Hash& previousLedgerHash();
     Hash const& previousLedgerHash() const;
 
+    // Sorts the transactions by hash unless they already are; the contents
+    // hash and apply order are kept when nothing moved.
     void sortForHash();
 
     std::vector<TransactionFramePtr> sortForApply();
 
+    // Reports, and resets, how many times contents hashes and apply orders
+    // got computed by all tx sets of the process.
+    static void flushComputeCounts(uint64_t& hashes, uint64_t& applyOrders);
+
+    // Splits `txs`, in apply order, into groups whose footprints (see
+    // TransactionFrame::insertLedgerKeysToFootprint) are pairwise disjoint,
+    // so that applying the groups one after the other in any order gives
+    // the same entries as applying `txs`. Groups keep their transactions in
+    // apply order and are sorted by their first one; all transactions with
+    // an unknown footprint share a group.
+    static std::vector<std::vector<TransactionFramePtr>>
+    partitionForApply(std::vector<TransactionFramePtr> const& txs);
+
     bool checkValid(Application& app);
     void trimInvalid(Application& app,
                      std::vector<TransactionFramePtr>& trimmed);
     void surgePricingFilter(LedgerManager const& lm);
 
+    // Keeps at most `maxTxs` transactions whose estimated apply costs (see
+    // ApplyCostModel) add up to at most `budget`, favoring the accounts
+    // whose transactions pay the most fee per cost. Transactions of an
+    // account are taken in sequence order until one does not fit; the first
+    // transaction taken fits whatever its cost.
+    void applyCostFilter(ApplyCostModel const& costs, size_t maxTxs,
+                         std::chrono::nanoseconds budget);
+
     void removeTx(TransactionFramePtr tx);
 
     void
     add(TransactionFramePtr tx)
     {
         mTransactions.push_back(tx);
-        mHashIsValid = false;
+        invalidateCaches();
     }
 
     size_t
@@ -21,6 +21,11 @@
 #include <lib/util/format.h>
 #include <xdrpp/marshal.h>
 
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <unordered_set>
+
 namespace cereal
 {
 template <class Archive>
@@ -382,11 +387,11 @@ Upgrades::storeUpgradeHistory(LedgerManager& ledgerManager,
     }
 }
 
-void
+uint32_t
 Upgrades::deleteOldEntries(Database& db, uint32_t ledgerSeq, uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "upgradehistory", "ledgerseq");
+    return DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "upgradehistory", "ledgerseq");
 }
 
 static void
@@ -409,22 +414,56 @@ addLiabilities(std::map<Asset, std::unique_ptr<int64_t>>& liabilities,
     }
 }
 
+enum class UpdateOfferResult
+{
+    Unchanged,
+    Adjusted,
+    AdjustedToZero,
+    Erased
+};
+
+// The state prepareLiabilities needs about an account with offers, loaded on
+// the main thread so that computing its liabilities does not touch the
+// database.
+struct AccountLiabilitiesInput
+{
+    AccountFrame::pointer mAccount;
+    std::vector<OfferFrame::pointer>* mOffers;
+    int64_t mBalance;
+    int64_t mBalanceAboveReserve;
+    // the trust lines of the non native assets of its offers, but for assets
+    // it issues; nullptr for those that do not exist
+    std::map<Asset, TrustFrame::pointer> mTrustLines;
+};
+
+// What prepareLiabilities does to an account with offers.
+struct AccountLiabilitiesPlan
+{
+    // same order as the offers of the input
+    std::vector<UpdateOfferResult> mOfferResults;
+    std::map<Asset, Liabilities> mLiabilities;
+};
+
+// Number of accounts with offers that prepareLiabilities loads, computes and
+// writes at once.
+static size_t const LIABILITIES_BATCH_SIZE = 1024;
+
 static int64_t
-getAvailableBalance(AccountID const& accountID, Asset const& asset,
-                    int64_t balanceAboveReserve, LedgerDelta& ld, Database& db)
+getAvailableBalance(AccountLiabilitiesInput const& input, Asset const& asset,
+                    int64_t balanceAboveReserve)
 {
     if (asset.type() == ASSET_TYPE_NATIVE)
     {
         return balanceAboveReserve;
     }
 
-    if (accountID == getIssuer(asset))
+    if (input.mAccount->getID() == getIssuer(asset))
     {
         return INT64_MAX;
     }
     else
     {
-        auto trust = TrustFrame::loadTrustLine(accountID, asset, db, &ld);
+        auto const& trust = input.mTrustLines.at(asset);
         if (trust && trust->isAuthorized())
         {
             return trust->getBalance();
@@ -437,21 +476,21 @@ getAvailableBalance(AccountID const& accountID, Asset const& asset,
 }
 
 static int64_t
-getAvailableLimit(AccountID const& accountID, Asset const& asset,
-                  int64_t balance, LedgerDelta& ld, Database& db)
+getAvailableLimit(AccountLiabilitiesInput const& input, Asset const& asset,
+                  int64_t balance)
 {
     if (asset.type() == ASSET_TYPE_NATIVE)
     {
         return INT64_MAX - balance;
     }
 
-    if (accountID == getIssuer(asset))
+    if (input.mAccount->getID() == getIssuer(asset))
     {
         return INT64_MAX;
     }
     else
     {
-        auto trust = TrustFrame::loadTrustLine(accountID, asset, db, &ld);
+        auto const& trust = input.mTrustLines.at(asset);
         if (trust && trust->isAuthorized())
         {
             return trust->getTrustLine().limit - trust->getBalance();
@@ -479,36 +518,29 @@ shouldDeleteOffer(Asset const& asset, int64_t effectiveBalance,
                         : true;
 }
 
-enum class UpdateOfferResult
-{
-    Unchanged,
-    Adjusted,
-    AdjustedToZero,
-    Erased
-};
-
+// Decides what happens to an offer, adjusting its amount (but not storing it)
+// and adding the liabilities of the offers that remain to `liabilities`.
 static UpdateOfferResult
 updateOffer(
-    OfferFrame& offerFrame, int64_t balance, int64_t balanceAboveReserve,
+    OfferFrame& offerFrame, AccountLiabilitiesInput const& input,
     std::map<Asset, Liabilities>& liabilities,
     std::map<Asset, std::unique_ptr<int64_t>> const& initialBuyingLiabilities,
-    std::map<Asset, std::unique_ptr<int64_t>> const& initialSellingLiabilities,
-    LedgerDelta& ld, Database& db)
+    std::map<Asset, std::unique_ptr<int64_t>> const& initialSellingLiabilities)
 {
     using namespace std::placeholders;
     auto& offer = offerFrame.getOffer();
 
-    auto availableBalanceBind = std::bind(getAvailableBalance, offer.sellerID,
-                                          _1, _2, std::ref(ld), std::ref(db));
-    auto availableLimitBind = std::bind(getAvailableLimit, offer.sellerID, _1,
-                                        _2, std::ref(ld), std::ref(db));
-
-    bool erase =
-        shouldDeleteOffer(offer.selling, balanceAboveReserve,
-                          initialSellingLiabilities, availableBalanceBind);
-    erase = erase ||
-            shouldDeleteOffer(offer.buying, balance, initialBuyingLiabilities,
-                              availableLimitBind);
+    auto availableBalanceBind =
+        std::bind(getAvailableBalance, std::cref(input), _1, _2);
+    auto availableLimitBind =
+        std::bind(getAvailableLimit, std::cref(input), _1, _2);
+
+    bool erase = shouldDeleteOffer(offer.selling, input.mBalanceAboveReserve,
+                                   initialSellingLiabilities,
+                                   availableBalanceBind);
+    erase = erase || shouldDeleteOffer(offer.buying, input.mBalance,
+                                       initialBuyingLiabilities,
+                                       availableLimitBind);
     UpdateOfferResult res =
         erase ? UpdateOfferResult::Erased : UpdateOfferResult::Unchanged;
 
@@ -526,11 +558,7 @@ updateOffer(
         res = UpdateOfferResult::AdjustedToZero;
     }
 
-    if (erase)
-    {
-        offerFrame.storeDelete(ld, db);
-    }
-    else
+    if (!erase)
     {
         // The same logic for adjustOffer discussed above applies here,
         // except that we now actually update the offer to reflect the
@@ -542,7 +570,6 @@ updateOffer(
             offer.amount = adjAmount;
             res = UpdateOfferResult::Adjusted;
         }
-        offerFrame.storeChange(ld, db);
 
         if (offer.buying.type() == ASSET_TYPE_NATIVE ||
             !(offer.sellerID == getIssuer(offer.buying)))
@@ -568,6 +595,142 @@ updateOffer(
     return res;
 }
 
+// Only reads `input` and updates the amounts of its offers, so that the plans
+// of different accounts can be computed on different threads.
+static AccountLiabilitiesPlan
+planAccountLiabilities(AccountLiabilitiesInput const& input)
+{
+    // The purpose of std::unique_ptr here is to have a special value
+    // (nullptr) to indicate that an integer overflow would have occured.
+    // Overflow is possible here because existing offers were not
+    // constrainted to have int64_t liabilities. This must be carefully
+    // handled in what follows.
+    std::map<Asset, std::unique_ptr<int64_t>> initialBuyingLiabilities;
+    std::map<Asset, std::unique_ptr<int64_t>> initialSellingLiabilities;
+    for (auto const& offerFrame : *input.mOffers)
+    {
+        auto const& offer = offerFrame->getOffer();
+        addLiabilities(initialBuyingLiabilities, offer.sellerID, offer.buying,
+                       offerFrame->getBuyingLiabilities());
+        addLiabilities(initialSellingLiabilities, offer.sellerID,
+                       offer.selling, offerFrame->getSellingLiabilities());
+    }
+
+    AccountLiabilitiesPlan plan;
+    plan.mOfferResults.reserve(input.mOffers->size());
+    for (auto const& offerFrame : *input.mOffers)
+    {
+        plan.mOfferResults.emplace_back(
+            updateOffer(*offerFrame, input, plan.mLiabilities,
+                        initialBuyingLiabilities, initialSellingLiabilities));
+    }
+    return plan;
+}
+
+// Computes the plans of `inputs` on up to hardware_concurrency threads.
+static std::vector<AccountLiabilitiesPlan>
+planLiabilities(std::vector<AccountLiabilitiesInput> const& inputs)
+{
+    size_t nThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk = (inputs.size() + nThreads - 1) / nThreads;
+
+    std::vector<AccountLiabilitiesPlan> plans(inputs.size());
+    std::vector<std::future<void>> tasks;
+    for (size_t begin = 0; begin < inputs.size(); begin += chunk)
+    {
+        size_t end = std::min(begin + chunk, inputs.size());
+        tasks.emplace_back(
+            std::async(std::launch::async, [&inputs, &plans, begin, end]() {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    plans[i] = planAccountLiabilities(inputs[i]);
+                }
+            }));
+    }
+    // waits for every task before rethrowing the first error
+    for (auto& t : tasks)
+    {
+        t.wait();
+    }
+    for (auto& t : tasks)
+    {
+        t.get();
+    }
+    return plans;
+}
+
+// Loads what planLiabilities needs about the accounts of `batch`, prefetching
+// the accounts and trust lines of the whole batch with a few queries first.
+static std::vector<AccountLiabilitiesInput>
+loadLiabilitiesInputs(
+    LedgerManager& ledgerManager, LedgerDelta& ld,
+    std::vector<std::pair<AccountID const, std::vector<OfferFrame::pointer>>*>
+        const& batch)
+{
+    auto& db = ledgerManager.getDatabase();
+
+    std::unordered_set<LedgerKey, LedgerKeyHash> keys;
+    for (auto accountOffers : batch)
+    {
+        LedgerKey key(ACCOUNT);
+        key.account().accountID = accountOffers->first;
+        keys.emplace(key);
+        for (auto const& offerFrame : accountOffers->second)
+        {
+            auto const& offer = offerFrame->getOffer();
+            for (auto const& asset : {offer.selling, offer.buying})
+            {
+                if (asset.type() != ASSET_TYPE_NATIVE &&
+                    !(offer.sellerID == getIssuer(asset)))
+                {
+                    LedgerKey trustKey(TRUSTLINE);
+                    trustKey.trustLine().accountID = offer.sellerID;
+                    trustKey.trustLine().asset = asset;
+                    keys.emplace(trustKey);
+                }
+            }
+        }
+    }
+    EntryFrame::prefetch(db, keys);
+
+    std::vector<AccountLiabilitiesInput> inputs;
+    inputs.reserve(batch.size());
+    for (auto accountOffers : batch)
+    {
+        AccountLiabilitiesInput input;
+        input.mAccount =
+            AccountFrame::loadAccount(ld, accountOffers->first, db);
+        if (!input.mAccount)
+        {
+            throw std::runtime_error("account does not exist");
+        }
+        input.mOffers = &accountOffers->second;
+
+        // balanceAboveReserve must exclude native selling liabilities, since
+        // these are in the process of being recalculated from scratch.
+        input.mBalance = input.mAccount->getBalance();
+        input.mBalanceAboveReserve =
+            input.mBalance - input.mAccount->getMinimumBalance(ledgerManager);
+
+        for (auto const& offerFrame : accountOffers->second)
+        {
+            auto const& offer = offerFrame->getOffer();
+            for (auto const& asset : {offer.selling, offer.buying})
+            {
+                if (asset.type() != ASSET_TYPE_NATIVE &&
+                    !(offer.sellerID == getIssuer(asset)) &&
+                    input.mTrustLines.find(asset) == input.mTrustLines.end())
+                {
+                    input.mTrustLines[asset] = TrustFrame::loadTrustLine(
+                        offer.sellerID, asset, db, &ld);
+                }
+            }
+        }
+        inputs.emplace_back(std::move(input));
+    }
+    return inputs;
+}
+
 // This function is used to bring offers and liabilities into a valid state.
 // For every account that has offers,
 //   1. Calculate total liabilities for each asset
@@ -578,61 +741,52 @@ updateOffer(
 // It is essential to note that the excess liabilities are determined only
 // using the initial result of step (1), so it does not matter what order the
 // offers are processed.
+//
+// Accounts are processed by batches of LIABILITIES_BATCH_SIZE: their entries
+// are prefetched together, steps (1) to (3) are computed on several threads,
+// and the offers of the batch are then written with bulk statements.
 static void
 prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
 {
     CLOG(INFO, "Ledger") << "Starting prepareLiabilities";
 
     auto& db = ledgerManager.getDatabase();
-    db.getEntryCache().clear();
+    // deferred writes are only held by the entry cache
+    bool clearCache = !ld.writesDeferred(ACCOUNT);
+    if (clearCache)
+    {
+        db.getEntryCache().clear();
+    }
     auto offersByAccount = OfferFrame::loadAllOffers(db);
 
     uint64_t nChangedAccounts = 0;
     uint64_t nChangedTrustLines = 0;
     std::map<UpdateOfferResult, uint64_t> nUpdatedOffers;
-    for (auto& accountOffers : offersByAccount)
-    {
-        // The purpose of std::unique_ptr here is to have a special value
-        // (nullptr) to indicate that an integer overflow would have occured.
-        // Overflow is possible here because existing offers were not
-        // constrainted to have int64_t liabilities. This must be carefully
-        // handled in what follows.
-        std::map<Asset, std::unique_ptr<int64_t>> initialBuyingLiabilities;
-        std::map<Asset, std::unique_ptr<int64_t>> initialSellingLiabilities;
-        for (auto const& offerFrame : accountOffers.second)
-        {
-            auto const& offer = offerFrame->getOffer();
-            addLiabilities(initialBuyingLiabilities, offer.sellerID,
-                           offer.buying, offerFrame->getBuyingLiabilities());
-            addLiabilities(initialSellingLiabilities, offer.sellerID,
-                           offer.selling, offerFrame->getSellingLiabilities());
-        }
 
-        auto accountFrame =
-            AccountFrame::loadAccount(ld, accountOffers.first, db);
-        if (!accountFrame)
-        {
-            throw std::runtime_error("account does not exist");
-        }
+    auto applyPlan = [&](AccountLiabilitiesInput const& input,
+                         AccountLiabilitiesPlan const& plan,
+                         std::vector<LedgerEntry>& changedOffers,
+                         std::vector<LedgerKey>& erasedOffers) {
+        auto& accountFrame = input.mAccount;
         AccountEntry const accountBefore = accountFrame->getAccount();
 
-        // balanceAboveReserve must exclude native selling liabilities, since
-        // these are in the process of being recalculated from scratch.
-        int64_t balance = accountFrame->getBalance();
-        int64_t minBalance = accountFrame->getMinimumBalance(ledgerManager);
-        int64_t balanceAboveReserve = balance - minBalance;
-
-        std::map<Asset, Liabilities> liabilities;
-        for (auto const& offerFrame : accountOffers.second)
+        for (size_t i = 0; i < input.mOffers->size(); ++i)
         {
-            auto offerID = offerFrame->getOfferID();
-            auto res = updateOffer(*offerFrame, balance, balanceAboveReserve,
-                                   liabilities, initialBuyingLiabilities,
-                                   initialSellingLiabilities, ld, db);
+            auto& offerFrame = *(*input.mOffers)[i];
+            auto offerID = offerFrame.getOfferID();
+            auto res = plan.mOfferResults[i];
             if (res == UpdateOfferResult::AdjustedToZero ||
                 res == UpdateOfferResult::Erased)
             {
                 accountFrame->addNumEntries(-1, ledgerManager);
+                ld.deleteEntry(offerFrame.getKey());
+                erasedOffers.emplace_back(offerFrame.getKey());
+            }
+            else
+            {
+                offerFrame.touch(ld);
+                ld.modEntry(offerFrame);
+                changedOffers.emplace_back(offerFrame.mEntry);
             }
 
             ++nUpdatedOffers[res];
@@ -658,7 +812,7 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
             }
         }
 
-        for (auto const& assetLiabilities : liabilities)
+        for (auto const& assetLiabilities : plan.mLiabilities)
         {
             Asset const& asset = assetLiabilities.first;
             Liabilities const& liab = assetLiabilities.second;
@@ -685,8 +839,11 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
             }
             else
             {
-                auto trustFrame = TrustFrame::loadTrustLine(accountOffers.first,
-                                                            asset, db, &ld);
+                auto const& trustFrame = input.mTrustLines.at(asset);
+                if (!trustFrame)
+                {
+                    throw std::runtime_error("trust line does not exist");
+                }
                 int64_t deltaSelling =
                     liab.selling -
                     trustFrame->getSellingLiabilities(ledgerManager);
@@ -719,9 +876,43 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
             ++nChangedAccounts;
         }
         accountFrame->storeChange(ld, db);
+    };
+
+    std::vector<std::pair<AccountID const, std::vector<OfferFrame::pointer>>*>
+        batch;
+    auto processBatch = [&]() {
+        auto inputs = loadLiabilitiesInputs(ledgerManager, ld, batch);
+        auto plans = planLiabilities(inputs);
+
+        std::vector<LedgerEntry> changedOffers;
+        std::vector<LedgerKey> erasedOffers;
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            applyPlan(inputs[i], plans[i], changedOffers, erasedOffers);
+        }
+        OfferFrame::storeDeleteBulk(db, erasedOffers);
+        OfferFrame::storeAddOrChangeBulk(db, changedOffers);
+
+        batch.clear();
+        if (clearCache)
+        {
+            db.getEntryCache().clear();
+        }
+    };
+
+    for (auto& accountOffers : offersByAccount)
+    {
+        batch.emplace_back(&accountOffers);
+        if (batch.size() == LIABILITIES_BATCH_SIZE)
+        {
+            processBatch();
+        }
+    }
+    if (!batch.empty())
+    {
+        processBatch();
     }
 
-    db.getEntryCache().clear();
     CLOG(INFO, "Ledger") << "prepareLiabilities completed with "
                          << nChangedAccounts << " accounts modified, "
                          << nChangedTrustLines << " trustlines modified, "
@@ -91,8 +91,8 @@ class Upgrades
                                     LedgerUpgrade const& upgrade,
                                     LedgerEntryChanges const& changes,
                                     int index);
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                 uint32_t count);
+    static uint32_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                     uint32_t count);
 
   private:
     UpgradeParameters mParams;
@@ -2,21 +2,28 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "database/Database.h"
 #include "herder/Herder.h"
 #include "herder/LedgerCloseData.h"
 #include "herder/Upgrades.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryTestsUtils.h"
+#include "ledger/EntryFrame.h"
 #include "lib/catch.hpp"
 #include "simulation/Simulation.h"
 #include "test/TestMarket.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
+#include "util/Logging.h"
 #include "util/StatusManager.h"
 #include "util/Timer.h"
 #include "util/optional.h"
 #include <xdrpp/marshal.h>
 
+#include <chrono>
+#include <random>
+
 using namespace stellar;
 
 struct LedgerUpgradeableData
@@ -1692,3 +1699,92 @@ TEST_CASE("simulate upgrades", "[herder][upgrades]")
         simulateUpgrade(nodes, checks);
     }
 }
+
+TEST_CASE("upgrade to version 10 performance", "[upgrades][bench][!hide]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.LEDGER_PROTOCOL_VERSION = 9;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& lm = app->getLedgerManager();
+
+    // accounts each with a trust line and a few offers, of which about one in
+    // four cannot cover its offers
+    size_t const nbAccounts = 50000;
+    size_t const offersPerAccount = 4;
+    auto issuer = SecretKey::random();
+    auto native = txtest::makeNativeAsset();
+    auto cur = txtest::makeAsset(issuer, "CUR1");
+
+    std::default_random_engine gen;
+    std::uniform_int_distribution<int64_t> amountDist(1, 1000000);
+    {
+        soci::transaction sqltx(db.getSession());
+        std::vector<LedgerEntry> entries;
+        int64_t offerID = 0;
+        for (size_t i = 0; i < nbAccounts; ++i)
+        {
+            LedgerEntry account;
+            account.data.type(ACCOUNT);
+            auto& a = account.data.account();
+            a.accountID = SecretKey::random().getPublicKey();
+            a.balance = lm.getMinBalance(offersPerAccount + 1) +
+                        amountDist(gen) * offersPerAccount;
+            a.numSubEntries = offersPerAccount + 1;
+            a.thresholds[0] = 1;
+            entries.emplace_back(account);
+
+            LedgerEntry trust;
+            trust.data.type(TRUSTLINE);
+            auto& t = trust.data.trustLine();
+            t.accountID = a.accountID;
+            t.asset = cur;
+            t.limit = INT64_MAX;
+            t.balance = amountDist(gen) * offersPerAccount;
+            t.flags = AUTHORIZED_FLAG;
+            entries.emplace_back(trust);
+
+            for (size_t j = 0; j < offersPerAccount; ++j)
+            {
+                LedgerEntry offer;
+                offer.data.type(OFFER);
+                auto& o = offer.data.offer();
+                o.sellerID = a.accountID;
+                o.offerID = ++offerID;
+                o.selling = j % 2 ? native : cur;
+                o.buying = j % 2 ? cur : native;
+                o.amount = amountDist(gen) * (i % 4 == 0 ? 4 : 1);
+                o.price = Price{1, 1};
+                entries.emplace_back(offer);
+            }
+
+            if (entries.size() >= 1000)
+            {
+                EntryFrame::storeAddOrChangeBulk(db, entries);
+                entries.clear();
+            }
+        }
+        EntryFrame::storeAddOrChangeBulk(db, entries);
+        sqltx.commit();
+    }
+
+    auto const& lcl = lm.getLastClosedLedgerHeader();
+    auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+    auto upgrades = xdr::xvector<UpgradeType, 6>{};
+    upgrades.push_back(toUpgradeType(makeProtocolVersionUpgrade(10)));
+    StellarValue sv{txSet->getContentsHash(), 2, upgrades, 0};
+    LedgerCloseData ledgerData(lcl.header.ledgerSeq + 1, txSet, sv);
+
+    auto start = std::chrono::steady_clock::now();
+    lm.closeLedger(ledgerData);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    REQUIRE(lm.getLastClosedLedgerHeader().header.ledgerVersion == 10);
+
+    LOG(INFO) << "upgrade to version 10 with " << nbAccounts << " accounts and "
+              << nbAccounts * offersPerAccount << " offers: "
+              << elapsed.count() << "ms";
+}
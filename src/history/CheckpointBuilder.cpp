@@ -0,0 +1,196 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/CheckpointBuilder.h"
+#include "herder/TxSetFrame.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryArchiveManager.h"
+#include "history/HistoryManager.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace stellar
+{
+
+size_t const CheckpointBuilder::MAX_COMPLETE = 8;
+
+CheckpointBuilder::CheckpointBuilder(Application& app)
+    : mApp(app)
+    , mTaken(app.getMetrics().NewMeter({"history", "checkpoint", "prebuilt"},
+                                       "checkpoint"))
+    , mIO(app.getMetrics(), "history-temp")
+{
+}
+
+CheckpointBuilder::~CheckpointBuilder()
+{
+}
+
+FileTransferInfo
+CheckpointBuilder::fileInfo(std::string const& type, uint32_t checkpoint)
+{
+    if (!mDir)
+    {
+        mDir = std::make_unique<TmpDir>(
+            mApp.getTmpDirManager().tmpDir("checkpoint"));
+    }
+    return FileTransferInfo(*mDir, type, checkpoint);
+}
+
+void
+CheckpointBuilder::removeFiles(uint32_t checkpoint)
+{
+    for (auto type : {HISTORY_FILE_TYPE_LEDGER, HISTORY_FILE_TYPE_TRANSACTIONS,
+                      HISTORY_FILE_TYPE_RESULTS})
+    {
+        std::remove(fileInfo(type, checkpoint).localPath_nogz().c_str());
+    }
+}
+
+void
+CheckpointBuilder::abandon()
+{
+    mLedgerOut.close();
+    mTxOut.close();
+    mResultOut.close();
+    removeFiles(mCheckpoint);
+    mWriting = false;
+}
+
+void
+CheckpointBuilder::appendLedger(LedgerHeaderHistoryEntry const& header,
+                                TxSetFrame const& txSet,
+                                TransactionResultSet const& results)
+{
+    if (!mApp.getHistoryArchiveManager().hasAnyWritableHistoryArchive())
+    {
+        return;
+    }
+    try
+    {
+        write(header, txSet, results);
+    }
+    catch (std::runtime_error& e)
+    {
+        // publishing dumps the checkpoint from the database instead
+        CLOG(WARNING, "History") << "Failed to write ledger "
+                                 << header.header.ledgerSeq
+                                 << " to checkpoint files: " << e.what();
+        if (mWriting)
+        {
+            abandon();
+        }
+    }
+}
+
+void
+CheckpointBuilder::write(LedgerHeaderHistoryEntry const& header,
+                         TxSetFrame const& txSet,
+                         TransactionResultSet const& results)
+{
+    auto& hm = mApp.getHistoryManager();
+    auto seq = header.header.ledgerSeq;
+    auto checkpoint = hm.checkpointContainingLedger(seq);
+    // ledger 0 does not exist, the first checkpoint starts at 1
+    auto first = std::max(hm.prevCheckpointLedger(seq), 1u);
+
+    if (mWriting && (checkpoint != mCheckpoint || seq != mNextLedger))
+    {
+        CLOG(DEBUG, "History") << "Ledger " << seq << " does not follow "
+                               << "checkpoint " << mCheckpoint
+                               << " being written, leaving it to publish";
+        abandon();
+    }
+    if (!mWriting)
+    {
+        if (seq != first)
+        {
+            return;
+        }
+        mCheckpoint = checkpoint;
+        mNextLedger = seq;
+        removeFiles(checkpoint);
+        mWriting = true;
+        XDRWriteOptions options;
+        options.mMetrics = &mIO;
+        mLedgerOut.open(
+            fileInfo(HISTORY_FILE_TYPE_LEDGER, checkpoint).localPath_nogz(),
+            false, options);
+        mTxOut.open(fileInfo(HISTORY_FILE_TYPE_TRANSACTIONS, checkpoint)
+                        .localPath_nogz(),
+                    false, options);
+        mResultOut.open(
+            fileInfo(HISTORY_FILE_TYPE_RESULTS, checkpoint).localPath_nogz(),
+            false, options);
+    }
+
+    mLedgerOut.writeOne(header);
+    // as StateSnapshot::writeHistoryBlocks writes them
+    TxSetFrame sorted(txSet);
+    if (sorted.size() != 0)
+    {
+        sorted.sortForHash();
+        TransactionHistoryEntry hist;
+        hist.ledgerSeq = seq;
+        sorted.toXDR(hist.txSet);
+        mTxOut.writeOne(hist);
+
+        TransactionHistoryResultEntry res;
+        res.ledgerSeq = seq;
+        res.txResultSet = results;
+        mResultOut.writeOne(res);
+    }
+    ++mNextLedger;
+
+    if (seq == checkpoint)
+    {
+        mLedgerOut.close();
+        mTxOut.close();
+        mResultOut.close();
+        mWriting = false;
+        mComplete.insert(checkpoint);
+        while (mComplete.size() > MAX_COMPLETE)
+        {
+            removeFiles(*mComplete.begin());
+            mComplete.erase(mComplete.begin());
+        }
+    }
+}
+
+bool
+CheckpointBuilder::takeCheckpoint(uint32_t checkpoint,
+                                  FileTransferInfo const& ledgers,
+                                  FileTransferInfo const& transactions,
+                                  FileTransferInfo const& results)
+{
+    if (mComplete.erase(checkpoint) == 0)
+    {
+        return false;
+    }
+    auto take = [&](std::string const& type, FileTransferInfo const& to) {
+        auto from = fileInfo(type, checkpoint).localPath_nogz();
+        return std::rename(from.c_str(), to.localPath_nogz().c_str()) == 0;
+    };
+    if (take(HISTORY_FILE_TYPE_LEDGER, ledgers) &&
+        take(HISTORY_FILE_TYPE_TRANSACTIONS, transactions) &&
+        take(HISTORY_FILE_TYPE_RESULTS, results))
+    {
+        CLOG(DEBUG, "History")
+            << "Using the files written while closing checkpoint "
+            << checkpoint;
+        mTaken.Mark();
+        return true;
+    }
+    CLOG(WARNING, "History") << "Failed to move files of checkpoint "
+                             << checkpoint << ", will dump them instead";
+    removeFiles(checkpoint);
+    return false;
+}
+}
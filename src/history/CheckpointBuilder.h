@@ -0,0 +1,88 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+#include "xdr/Stellar-ledger.h"
+
+#include <memory>
+#include <set>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+class FileTransferInfo;
+class TxSetFrame;
+
+/**
+ * CheckpointBuilder writes the ledger headers, transaction sets and
+ * transaction results of each checkpoint to their history files as ledgers
+ * close, so that publishing a checkpoint finds them complete instead of
+ * dumping them from the database at once (see
+ * StateSnapshot::writeHistoryBlocks). The files are identical to the dumped
+ * ones: one entry per ledger for headers, one per ledger with transactions
+ * for the other two.
+ *
+ * Only checkpoints whose every ledger was closed by this process are built:
+ * one started before a restart, or whose ledgers were not closed in sequence,
+ * is left to the database dump. Nothing is written without writable history
+ * archives. At most MAX_COMPLETE checkpoints are kept waiting to be
+ * published, the oldest being dropped first.
+ *
+ * Main thread only.
+ */
+class CheckpointBuilder : NonMovableOrCopyable
+{
+    Application& mApp;
+    std::unique_ptr<TmpDir> mDir;
+
+    // checkpoint being written, and the ledger it expects next
+    bool mWriting{false};
+    uint32_t mCheckpoint{0};
+    uint32_t mNextLedger{0};
+    XDROutputFileStream mLedgerOut;
+    XDROutputFileStream mTxOut;
+    XDROutputFileStream mResultOut;
+
+    // written entirely, not taken yet
+    std::set<uint32_t> mComplete;
+
+    medida::Meter& mTaken;
+    FileIOMetrics mIO;
+
+    FileTransferInfo fileInfo(std::string const& type, uint32_t checkpoint);
+    void removeFiles(uint32_t checkpoint);
+    // drops the checkpoint being written
+    void abandon();
+    void write(LedgerHeaderHistoryEntry const& header, TxSetFrame const& txSet,
+               TransactionResultSet const& results);
+
+  public:
+    static size_t const MAX_COMPLETE;
+
+    explicit CheckpointBuilder(Application& app);
+    ~CheckpointBuilder();
+
+    // Appends the ledger just closed, `txSet` having been applied with
+    // `results`.
+    void appendLedger(LedgerHeaderHistoryEntry const& header,
+                      TxSetFrame const& txSet,
+                      TransactionResultSet const& results);
+
+    // Moves the files of `checkpoint` to the given paths and returns true if
+    // it was built entirely, returns false otherwise.
+    bool takeCheckpoint(uint32_t checkpoint, FileTransferInfo const& ledgers,
+                        FileTransferInfo const& transactions,
+                        FileTransferInfo const& results);
+};
+}
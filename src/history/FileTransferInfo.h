@@ -25,6 +25,8 @@ class FileTransferInfo
     std::string mType;
     std::string mHexDigits;
     std::string mLocalPath;
+    // where it is compressed to, next to mLocalPath unless set otherwise
+    std::string mLocalPathGz;
     std::string mSuffix;
 
   public:
@@ -32,6 +34,18 @@ class FileTransferInfo
         : mType(HISTORY_FILE_TYPE_BUCKET)
         , mHexDigits(binToHex(bucket.getHash()))
         , mLocalPath(bucket.getFilename())
+        , mLocalPathGz(mLocalPath + ".gz")
+    {
+    }
+
+    // A bucket compressed into `gzDir` rather than the bucket directory, so
+    // that publishes running at once do not share (and overwrite) the
+    // compressed copy of a bucket they both send.
+    FileTransferInfo(Bucket const& bucket, TmpDir const& gzDir)
+        : mType(HISTORY_FILE_TYPE_BUCKET)
+        , mHexDigits(binToHex(bucket.getHash()))
+        , mLocalPath(bucket.getFilename())
+        , mLocalPathGz(gzDir.getName() + "/" + baseName_gz())
     {
     }
 
@@ -40,6 +54,7 @@ class FileTransferInfo
         : mType(snapType)
         , mHexDigits(fs::hexStr(checkpointLedger))
         , mLocalPath(snapDir.getName() + "/" + baseName_nogz())
+        , mLocalPathGz(mLocalPath + ".gz")
     {
     }
 
@@ -48,6 +63,7 @@ class FileTransferInfo
         : mType(snapType)
         , mHexDigits(hexDigits)
         , mLocalPath(snapDir.getName() + "/" + baseName_nogz())
+        , mLocalPathGz(mLocalPath + ".gz")
     {
     }
 
@@ -70,7 +86,7 @@ class FileTransferInfo
     std::string
     localPath_gz() const
     {
-        return mLocalPath + ".gz";
+        return mLocalPathGz;
     }
     std::string
     localPath_gz_tmp() const
@@ -305,7 +305,7 @@ HistoryArchive::~HistoryArchive()
 bool
 HistoryArchive::hasGetCmd() const
 {
-    return !mConfig.mGetCmd.empty();
+    return !mConfig.mGetCmd.empty() || !mConfig.mURL.empty();
 }
 
 bool
@@ -320,6 +320,24 @@ HistoryArchive::hasMkdirCmd() const
     return !mConfig.mMkdirCmd.empty();
 }
 
+bool
+HistoryArchive::hasURL() const
+{
+    return !mConfig.mURL.empty();
+}
+
+std::string const&
+HistoryArchive::getURL() const
+{
+    return mConfig.mURL;
+}
+
+bool
+HistoryArchive::isBucketsOnly() const
+{
+    return mConfig.mBucketsOnly;
+}
+
 std::string const&
 HistoryArchive::getName() const
 {
@@ -364,12 +382,35 @@ HistoryArchive::markFailure()
     mFailure++;
 }
 
+void
+HistoryArchive::markDownload(uint64_t bytes, std::chrono::nanoseconds duration)
+{
+    // weight of the latest download in the average
+    double const alpha = 0.2;
+    auto secs = std::chrono::duration<double>(duration).count();
+    if (secs <= 0)
+    {
+        return;
+    }
+    auto throughput = bytes / secs;
+    mThroughput = mThroughput == 0
+                      ? throughput
+                      : alpha * throughput + (1 - alpha) * mThroughput;
+}
+
+double
+HistoryArchive::getThroughput() const
+{
+    return mThroughput;
+}
+
 Json::Value
 HistoryArchive::getJsonInfo() const
 {
     Json::Value result;
     result["success"] = mSuccess;
     result["failure"] = mFailure;
+    result["throughput"] = static_cast<Json::UInt64>(mThroughput);
     return result;
 }
 }
@@ -9,6 +9,7 @@
 #include "xdr/Stellar-types.h"
 
 #include <cereal/cereal.hpp>
+#include <chrono>
 #include <lib/json/json.h>
 #include <memory>
 #include <string>
@@ -139,9 +140,17 @@ class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
   public:
     explicit HistoryArchive(HistoryArchiveConfiguration const& config);
     ~HistoryArchive();
+    // Whether the archive can be read from, with a get command or a url.
     bool hasGetCmd() const;
     bool hasPutCmd() const;
     bool hasMkdirCmd() const;
+    // Whether files are downloaded with HttpArchiveClient rather than by
+    // running the get command.
+    bool hasURL() const;
+    std::string const& getURL() const;
+    // Whether the archive only holds bucket files (see
+    // HistoryArchiveManager::selectBucketsOnlyHistoryArchive).
+    bool isBucketsOnly() const;
     std::string const& getName() const;
 
     std::string getFileCmd(std::string const& remote,
@@ -153,11 +162,19 @@ class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
     void markSuccess();
     void markFailure();
 
+    // Records a download of `bytes` that took `duration`, from which the
+    // throughput of the archive is estimated.
+    void markDownload(uint64_t bytes, std::chrono::nanoseconds duration);
+    // Moving average of the throughput of downloads, in bytes per second, or
+    // 0 before any download was recorded.
+    double getThroughput() const;
+
     Json::Value getJsonInfo() const;
 
   private:
     HistoryArchiveConfiguration mConfig;
     uint32_t mSuccess{0};
     uint32_t mFailure{0};
+    double mThroughput{0};
 };
 }
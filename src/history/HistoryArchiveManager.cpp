@@ -4,6 +4,7 @@
 
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryArchive.h"
+#include "history/HttpArchiveClient.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
 #include "main/Application.h"
@@ -12,7 +13,9 @@
 #include "util/Math.h"
 #include "work/WorkManager.h"
 
+#include <algorithm>
 #include <lib/json/json.h>
+#include <random>
 #include <vector>
 
 namespace stellar
@@ -33,10 +36,15 @@ HistoryArchiveManager::checkSensibleConfig() const
     std::vector<std::string> readWriteArchives;
     std::vector<std::string> writeOnlyArchives;
     std::vector<std::string> inertArchives;
+    std::vector<std::string> bucketsOnlyArchives;
 
     for (auto const& archive : mArchives)
     {
-        if (archive->hasGetCmd())
+        if (archive->isBucketsOnly() && archive->hasGetCmd())
+        {
+            bucketsOnlyArchives.push_back(archive->getName());
+        }
+        else if (archive->hasGetCmd())
         {
             if (archive->hasPutCmd())
             {
@@ -92,6 +100,12 @@ HistoryArchiveManager::checkSensibleConfig() const
             << "' has 'get' command only, will not be written";
     }
 
+    for (auto const& a : bucketsOnlyArchives)
+    {
+        CLOG(INFO, "History") << "Archive '" << a
+                              << "' is buckets only, will be read buckets from";
+    }
+
     if (readOnlyArchives.empty() && readWriteArchives.empty())
     {
         CLOG(FATAL, "History")
@@ -113,8 +127,8 @@ HistoryArchiveManager::checkSensibleConfig() const
     return true;
 }
 
-std::shared_ptr<HistoryArchive>
-HistoryArchiveManager::selectRandomReadableHistoryArchive() const
+std::vector<std::shared_ptr<HistoryArchive>>
+HistoryArchiveManager::getReadableHistoryArchives() const
 {
     std::vector<std::shared_ptr<HistoryArchive>> archives;
 
@@ -123,7 +137,8 @@ HistoryArchiveManager::selectRandomReadableHistoryArchive() const
     std::copy_if(std::begin(mArchives), std::end(mArchives),
                  std::back_inserter(archives),
                  [](std::shared_ptr<HistoryArchive> const& x) {
-                     return x->hasGetCmd() && !x->hasPutCmd();
+                     return x->hasGetCmd() && !x->hasPutCmd() &&
+                            !x->isBucketsOnly();
                  });
 
     // If we have none of those, accept those with get+put
@@ -132,7 +147,7 @@ HistoryArchiveManager::selectRandomReadableHistoryArchive() const
         std::copy_if(std::begin(mArchives), std::end(mArchives),
                      std::back_inserter(archives),
                      [](std::shared_ptr<HistoryArchive> const& x) {
-                         return x->hasGetCmd();
+                         return x->hasGetCmd() && !x->isBucketsOnly();
                      });
     }
 
@@ -140,7 +155,14 @@ HistoryArchiveManager::selectRandomReadableHistoryArchive() const
     {
         throw std::runtime_error("No GET-enabled history archive in config");
     }
-    else if (archives.size() == 1)
+    return archives;
+}
+
+std::shared_ptr<HistoryArchive>
+HistoryArchiveManager::selectRandomReadableHistoryArchive() const
+{
+    auto archives = getReadableHistoryArchives();
+    if (archives.size() == 1)
     {
         CLOG(DEBUG, "History")
             << "Fetching from sole readable history archive '"
@@ -157,6 +179,73 @@ HistoryArchiveManager::selectRandomReadableHistoryArchive() const
     }
 }
 
+std::vector<std::shared_ptr<HistoryArchive>>
+HistoryArchiveManager::selectRandomReadableHistoryArchives(size_t count) const
+{
+    auto archives = getReadableHistoryArchives();
+    std::shuffle(archives.begin(), archives.end(), gRandomEngine);
+    if (archives.size() > count)
+    {
+        archives.resize(std::max<size_t>(count, 1));
+    }
+    return archives;
+}
+
+std::shared_ptr<HistoryArchive>
+HistoryArchiveManager::selectFastReadableHistoryArchive() const
+{
+    return selectFastHistoryArchive(getReadableHistoryArchives());
+}
+
+std::shared_ptr<HistoryArchive>
+HistoryArchiveManager::selectBucketsOnlyHistoryArchive() const
+{
+    std::vector<std::shared_ptr<HistoryArchive>> archives;
+    std::copy_if(std::begin(mArchives), std::end(mArchives),
+                 std::back_inserter(archives),
+                 [](std::shared_ptr<HistoryArchive> const& x) {
+                     return x->hasGetCmd() && x->isBucketsOnly();
+                 });
+    if (archives.empty())
+    {
+        return nullptr;
+    }
+    return selectFastHistoryArchive(archives);
+}
+
+std::shared_ptr<HistoryArchive>
+HistoryArchiveManager::selectFastHistoryArchive(
+    std::vector<std::shared_ptr<HistoryArchive>> const& archives) const
+{
+    if (archives.size() == 1)
+    {
+        return archives[0];
+    }
+
+    double fastest = 0;
+    for (auto const& a : archives)
+    {
+        fastest = std::max(fastest, a->getThroughput());
+    }
+    if (fastest == 0)
+    {
+        return archives.at(rand_uniform<size_t>(0, archives.size() - 1));
+    }
+
+    std::vector<double> weights;
+    for (auto const& a : archives)
+    {
+        auto throughput = a->getThroughput();
+        weights.push_back(throughput == 0 ? fastest : throughput);
+    }
+    std::discrete_distribution<size_t> dist(weights.begin(), weights.end());
+    size_t i = dist(gRandomEngine);
+    CLOG(DEBUG, "History") << "Fetching from readable history archive #" << i
+                           << ", '" << archives[i]->getName() << "' at "
+                           << weights[i] << " bytes/s";
+    return archives[i];
+}
+
 bool
 HistoryArchiveManager::initializeHistoryArchive(std::string const& arch) const
 {
@@ -234,6 +323,18 @@ HistoryArchiveManager::getWritableHistoryArchives() const
     return result;
 }
 
+std::shared_ptr<HttpArchiveClient>
+HistoryArchiveManager::getHttpClient(HistoryArchive const& archive)
+{
+    assert(archive.hasURL());
+    auto& client = mHttpClients[archive.getName()];
+    if (!client)
+    {
+        client = std::make_shared<HttpArchiveClient>(mApp, archive.getURL());
+    }
+    return client;
+}
+
 Json::Value
 HistoryArchiveManager::getJsonInfo() const
 {
@@ -4,7 +4,9 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace Json
@@ -17,6 +19,7 @@ namespace stellar
 class Application;
 class Config;
 class HistoryArchive;
+class HttpArchiveClient;
 
 class HistoryArchiveManager
 {
@@ -30,6 +33,23 @@ class HistoryArchiveManager
     // select one at random.
     std::shared_ptr<HistoryArchive> selectRandomReadableHistoryArchive() const;
 
+    // Select up to `count` distinct readable history archives at random, to
+    // request the same file from all of them at once.
+    std::vector<std::shared_ptr<HistoryArchive>>
+    selectRandomReadableHistoryArchives(size_t count) const;
+
+    // Select any readable history archive at random, each one weighted by
+    // the throughput observed downloading from it. Archives nothing was
+    // downloaded from yet weigh as much as the fastest one, so that they get
+    // tried.
+    std::shared_ptr<HistoryArchive> selectFastReadableHistoryArchive() const;
+
+    // Select one of the archives configured with `buckets_only`, weighted
+    // by throughput like selectFastReadableHistoryArchive, or nullptr if
+    // there are none. Those archives are only read buckets from, and are
+    // never returned by the other select functions.
+    std::shared_ptr<HistoryArchive> selectBucketsOnlyHistoryArchive() const;
+
     // Initialize a named history archive by writing
     // .well-known/stellar-history.json to it.
     bool initializeHistoryArchive(std::string const& arch) const;
@@ -47,10 +67,27 @@ class HistoryArchiveManager
     std::vector<std::shared_ptr<HistoryArchive>>
     getWritableHistoryArchives() const;
 
+    // Returns the client downloading from the url of `archive`, created on
+    // first use and shared by all downloads from that archive.
+    std::shared_ptr<HttpArchiveClient>
+    getHttpClient(HistoryArchive const& archive);
+
     Json::Value getJsonInfo() const;
 
   private:
+    // Archives with only a get command if there are any, as these are the
+    // ones we're not publishing to, otherwise all readable archives. Leaves
+    // out buckets-only archives.
+    std::vector<std::shared_ptr<HistoryArchive>>
+    getReadableHistoryArchives() const;
+
+    // One of `archives`, weighted by throughput.
+    std::shared_ptr<HistoryArchive> selectFastHistoryArchive(
+        std::vector<std::shared_ptr<HistoryArchive>> const& archives) const;
+
     Application& mApp;
     std::vector<std::shared_ptr<HistoryArchive>> mArchives;
+    // by archive name
+    std::map<std::string, std::shared_ptr<HttpArchiveClient>> mHttpClients;
 };
 }
@@ -176,6 +176,7 @@ namespace stellar
 class Application;
 class Bucket;
 class BucketList;
+class CheckpointBuilder;
 class Config;
 class Database;
 class HistoryArchive;
@@ -298,6 +299,9 @@ class HistoryManager
     // tmpdir.
     virtual std::string localFilename(std::string const& basename) = 0;
 
+    // Return the writer of the history files of checkpoints being closed.
+    virtual CheckpointBuilder& getCheckpointBuilder() = 0;
+
     // Return the number of checkpoints that have been enqueued for
     // publication. This may be less than the number "started", but every
     // enqueued checkpoint should eventually start.
@@ -12,6 +12,7 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "herder/HerderImpl.h"
+#include "history/CheckpointBuilder.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManagerImpl.h"
@@ -64,7 +65,7 @@ HistoryManager::create(Application& app)
 HistoryManagerImpl::HistoryManagerImpl(Application& app)
     : mApp(app)
     , mWorkDir(nullptr)
-    , mPublishWork(nullptr)
+    , mCheckpointBuilder(std::make_unique<CheckpointBuilder>(app))
 
     , mPublishSkip(
           app.getMetrics().NewMeter({"history", "publish", "skip"}, "event"))
@@ -124,13 +125,17 @@ void
 HistoryManagerImpl::logAndUpdatePublishStatus()
 {
     std::stringstream stateStr;
-    if (mPublishWork)
+    if (!mPublishWorks.empty())
     {
         auto qlen = publishQueueLength();
         stateStr << "Publishing " << qlen << " queued checkpoints"
                  << " [" << getMinLedgerQueuedToPublish() << "-"
-                 << getMaxLedgerQueuedToPublish() << "]"
-                 << ": " << mPublishWork->getStatus();
+                 << getMaxLedgerQueuedToPublish() << "]";
+        if (mPublishWorks.size() > 1)
+        {
+            stateStr << ", " << mPublishWorks.size() << " at once";
+        }
+        stateStr << ": " << mPublishWorks.begin()->second->getStatus();
 
         auto current = stateStr.str();
         auto existing = mApp.getStatusManager().getStatusMessage(
@@ -179,6 +184,12 @@ HistoryManagerImpl::localFilename(std::string const& basename)
     return this->getTmpDir() + "/" + basename;
 }
 
+CheckpointBuilder&
+HistoryManagerImpl::getCheckpointBuilder()
+{
+    return *mCheckpointBuilder;
+}
+
 HistoryArchiveState
 HistoryManagerImpl::getLastClosedHistoryArchiveState() const
 {
@@ -284,44 +295,92 @@ HistoryManagerImpl::queueCurrentHistory()
     takeSnapshotAndPublish(has);
 }
 
-void
+bool
 HistoryManagerImpl::takeSnapshotAndPublish(HistoryArchiveState const& has)
 {
-    if (mPublishWork)
+    auto ledgerSeq = has.currentLedger;
+    if (mPublishWorks.size() >= mApp.getConfig().MAX_CONCURRENT_PUBLISHES ||
+        mPublishWorks.find(ledgerSeq) != mPublishWorks.end())
     {
         mPublishDelay.Mark();
-        return;
+        return false;
     }
-    auto ledgerSeq = has.currentLedger;
+
+    // the checkpoints before this one must all be publishing already, or it
+    // could take the slot of the one it would wait for
+    uint32_t queuedBefore = 0;
+    {
+        auto prep = mApp.getDatabase().getPreparedStatement(
+            "SELECT COUNT(*) FROM publishqueue WHERE ledger < :lg;");
+        auto& st = prep.statement();
+        st.exchange(soci::into(queuedBefore));
+        st.exchange(soci::use(ledgerSeq));
+        st.define_and_bind();
+        st.execute(true);
+    }
+    auto runningBefore = static_cast<uint32_t>(std::distance(
+        mPublishWorks.begin(), mPublishWorks.lower_bound(ledgerSeq)));
+    if (queuedBefore > runningBefore)
+    {
+        mPublishDelay.Mark();
+        return false;
+    }
+
     CLOG(DEBUG, "History") << "Activating publish for ledger " << ledgerSeq;
     auto snap = std::make_shared<StateSnapshot>(mApp, has);
 
     mPublishStart.Mark();
-    mPublishWork = mApp.getWorkManager().addWork<PublishWork>(snap);
+    mPublishWorks[ledgerSeq] =
+        mApp.getWorkManager().addWork<PublishWork>(snap);
     mApp.getWorkManager().advanceChildren();
+    return true;
 }
 
 size_t
 HistoryManagerImpl::publishQueuedHistory()
 {
-    std::string state;
+    auto max = mApp.getConfig().MAX_CONCURRENT_PUBLISHES;
+    if (mPublishWorks.size() >= max)
+    {
+        return 0;
+    }
 
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT state FROM publishqueue"
-        " ORDER BY ledger ASC LIMIT 1;");
-    auto& st = prep.statement();
-    soci::indicator stateIndicator;
-    st.exchange(soci::into(state, stateIndicator));
-    st.define_and_bind();
-    st.execute(true);
-    if (st.got_data() && stateIndicator == soci::indicator::i_ok)
+    // the oldest checkpoints, which include those publishing already
+    std::vector<HistoryArchiveState> states;
+    {
+        std::string state;
+        auto limit = static_cast<uint32_t>(max);
+        auto prep = mApp.getDatabase().getPreparedStatement(
+            "SELECT state FROM publishqueue"
+            " ORDER BY ledger ASC LIMIT :lim;");
+        auto& st = prep.statement();
+        soci::indicator stateIndicator;
+        st.exchange(soci::into(state, stateIndicator));
+        st.exchange(soci::use(limit));
+        st.define_and_bind();
+        st.execute(true);
+        while (st.got_data() && stateIndicator == soci::indicator::i_ok)
+        {
+            states.emplace_back();
+            states.back().fromString(state);
+            st.fetch();
+        }
+    }
+
+    size_t started = 0;
+    for (auto const& has : states)
     {
-        HistoryArchiveState has;
-        has.fromString(state);
-        takeSnapshotAndPublish(has);
-        return 1;
+        if (mPublishWorks.find(has.currentLedger) != mPublishWorks.end())
+        {
+            continue;
+        }
+        if (!takeSnapshotAndPublish(has))
+        {
+            break;
+        }
+        ++started;
     }
-    return 0;
+    return started;
 }
 
 std::vector<HistoryArchiveState>
@@ -413,7 +472,12 @@ HistoryManagerImpl::historyPublished(
     {
         this->mPublishFailure.Mark();
     }
-    mPublishWork.reset();
+    mPublishWorks.erase(ledgerSeq);
+    if (success && !mPublishWorks.empty())
+    {
+        // the oldest checkpoint left may have been waiting for this one
+        mPublishWorks.begin()->second->checkTurn();
+    }
     mApp.getClock().getIOService().post(
         [this]() { this->publishQueuedHistory(); });
 }
@@ -7,6 +7,7 @@
 #include "bucket/PublishQueueBuckets.h"
 #include "history/HistoryManager.h"
 #include "util/TmpDir.h"
+#include <map>
 #include <memory>
 
 namespace medida
@@ -18,13 +19,17 @@ namespace stellar
 {
 
 class Application;
-class Work;
+class CheckpointBuilder;
+class PublishWork;
 
 class HistoryManagerImpl : public HistoryManager
 {
     Application& mApp;
     std::unique_ptr<TmpDir> mWorkDir;
-    std::shared_ptr<Work> mPublishWork;
+    // publishes running, by checkpoint: always the oldest queued ones, so that
+    // the oldest, which the others wait for, is running too
+    std::map<uint32_t, std::shared_ptr<PublishWork>> mPublishWorks;
+    std::unique_ptr<CheckpointBuilder> mCheckpointBuilder;
     PublishQueueBuckets mPublishQueueBuckets;
     bool mPublishQueueBucketsFilled{false};
 
@@ -54,7 +59,10 @@ class HistoryManagerImpl : public HistoryManager
 
     void queueCurrentHistory() override;
 
-    void takeSnapshotAndPublish(HistoryArchiveState const& has);
+    // Starts publishing `has` unless MAX_CONCURRENT_PUBLISHES are running or
+    // an older queued checkpoint is not publishing yet; returns whether it
+    // started.
+    bool takeSnapshotAndPublish(HistoryArchiveState const& has);
 
     uint32_t getMinLedgerQueuedToPublish() override;
 
@@ -85,6 +93,8 @@ class HistoryManagerImpl : public HistoryManager
 
     std::string localFilename(std::string const& basename) override;
 
+    CheckpointBuilder& getCheckpointBuilder() override;
+
     uint64_t getPublishQueueCount() override;
     uint64_t getPublishDelayCount() override;
     uint64_t getPublishSuccessCount() override;
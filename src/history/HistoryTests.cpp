@@ -4,6 +4,10 @@
 
 #include "bucket/BucketManager.h"
 #include "catchup/CatchupWorkTests.h"
+#include "crypto/Hex.h"
+#include "crypto/Random.h"
+#include "database/Database.h"
+#include "history/FileTransferInfo.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
 #include "history/HistoryTestsUtils.h"
@@ -11,18 +15,28 @@
 #include "historywork/GunzipFileWork.h"
 #include "historywork/GzipFileWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
+#include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "main/ExternalQueue.h"
 #include "main/PersistentState.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "process/ProcessManager.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Compression.h"
 #include "util/Fs.h"
+#include "util/XDRStream.h"
+#include "util/types.h"
 #include "work/WorkManager.h"
 
 #include <lib/catch.hpp>
 #include <lib/util/format.h>
 
+#include <fstream>
+#include <sstream>
+
 using namespace stellar;
 using namespace historytestutils;
 
@@ -101,6 +115,144 @@ TEST_CASE("History publish", "[history]")
     catchupSimulation.generateAndPublishInitialHistory(1);
 }
 
+namespace
+{
+// The archive of TmpDirHistoryConfigurator, and a second writable one.
+class TwoArchivesHistoryConfigurator : public TmpDirHistoryConfigurator
+{
+    TmpDirManager mSecondTmp;
+    TmpDir mSecondDir;
+
+  public:
+    TwoArchivesHistoryConfigurator()
+        : mSecondTmp("archtmp-second-" + binToHex(randomBytes(8)))
+        , mSecondDir(mSecondTmp.tmpDir("archive"))
+    {
+    }
+
+    std::string
+    getSecondArchiveDirName() const
+    {
+        return mSecondDir.getName();
+    }
+
+    Config&
+    configure(Config& cfg, bool writable) const override
+    {
+        TmpDirHistoryConfigurator::configure(cfg, writable);
+        if (writable)
+        {
+            std::string d = mSecondDir.getName();
+            cfg.HISTORY["second"] = HistoryArchiveConfiguration{
+                "second", "cp " + d + "/{0} {1}", "cp {0} " + d + "/{1}",
+                "mkdir -p " + d + "/{0}"};
+        }
+        return cfg;
+    }
+};
+}
+
+TEST_CASE("History publish to two archives", "[history]")
+{
+    auto configurator = std::make_shared<TwoArchivesHistoryConfigurator>();
+    CatchupSimulation catchupSimulation{configurator};
+
+    catchupSimulation.generateAndPublishInitialHistory(2);
+
+    auto has = "/" + HistoryArchiveState::wellKnownRemoteName();
+    HistoryArchiveState first, second;
+    first.load(configurator->getArchiveDirName() + has);
+    second.load(configurator->getSecondArchiveDirName() + has);
+    REQUIRE(first.currentLedger != 0);
+    REQUIRE(first.currentLedger == second.currentLedger);
+    for (auto const& bucket : first.allBuckets())
+    {
+        if (!isZero(hexToBin256(bucket)))
+        {
+            REQUIRE(fs::exists(
+                configurator->getSecondArchiveDirName() + "/" +
+                fs::remoteName(HISTORY_FILE_TYPE_BUCKET, bucket, "xdr.gz")));
+        }
+    }
+}
+
+TEST_CASE("History catchup racing two archives", "[history][historycatchup]")
+{
+    auto configurator = std::make_shared<TwoArchivesHistoryConfigurator>();
+    CatchupSimulation catchupSimulation{configurator};
+
+    catchupSimulation.generateAndPublishInitialHistory(3);
+
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    auto cfg = getTestConfig(1);
+    cfg.CATCHUP_COMPLETE = true;
+    cfg.HISTORY_RACE_ARCHIVES = 2;
+    configurator->configure(cfg, false);
+    std::string d = configurator->getSecondArchiveDirName();
+    cfg.HISTORY["second"] =
+        HistoryArchiveConfiguration{"second", "cp " + d + "/{0} {1}", "", ""};
+    auto app = createTestApplication(catchupSimulation.getClock(), cfg);
+    app->start();
+    REQUIRE(catchupSimulation.catchupApplication(
+        initLedger, std::numeric_limits<uint32_t>::max(), false, app));
+
+    // each state was requested from both archives, and one of them lost
+    auto& lost = app->getMetrics().NewMeter(
+        {"history", "download-history-archive-state", "race-lost"}, "event");
+    REQUIRE(lost.count() > 0);
+}
+
+TEST_CASE("History publish of checkpoint files written while closing",
+          "[history]")
+{
+    CatchupSimulation catchupSimulation{};
+    catchupSimulation.generateAndPublishInitialHistory(2);
+
+    auto& app = catchupSimulation.getApp();
+    // the genesis ledger of the first checkpoint is not closed, so it is
+    // dumped from the database
+    REQUIRE(app.getMetrics()
+                .NewMeter({"history", "checkpoint", "prebuilt"}, "checkpoint")
+                .count() == 1);
+
+    auto freq = app.getHistoryManager().getCheckpointFrequency();
+    auto checkpoint = 2 * freq - 1;
+    auto dir = app.getTmpDirManager().tmpDir("compare");
+    auto& db = app.getDatabase();
+    {
+        XDROutputFileStream ledgers, txs, results;
+        ledgers.open(dir.getName() + "/ledger.db");
+        txs.open(dir.getName() + "/transactions.db");
+        results.open(dir.getName() + "/results.db");
+        LedgerHeaderFrame::copyLedgerHeadersToStream(db, db.getSession(), freq,
+                                                     freq, ledgers);
+        TransactionFrame::copyTransactionsToStream(app.getNetworkID(), db,
+                                                   db.getSession(), freq, freq,
+                                                   txs, results);
+    }
+
+    auto readFile = [](std::string const& name) {
+        std::ifstream in(name, std::ifstream::binary);
+        std::ostringstream out;
+        out << in.rdbuf();
+        return out.str();
+    };
+    for (auto type : {HISTORY_FILE_TYPE_LEDGER, HISTORY_FILE_TYPE_TRANSACTIONS,
+                      HISTORY_FILE_TYPE_RESULTS})
+    {
+        auto published = dir.getName() + "/" + type + ".published";
+        decompressFile(
+            catchupSimulation.getHistoryConfigurator().getArchiveDirName() +
+                "/" + fs::remoteName(type, fs::hexStr(checkpoint), "xdr.gz"),
+            published, CompressionFormat::GZIP);
+        REQUIRE(readFile(published) ==
+                readFile(dir.getName() + "/" + type + ".db"));
+    }
+}
+
 static std::string
 resumeModeName(uint32_t count)
 {
@@ -168,6 +320,69 @@ TEST_CASE("Full history catchup", "[history][historycatchup]")
     }
 }
 
+TEST_CASE("History catchup with replay batches", "[history][historycatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    catchupSimulation.generateAndPublishInitialHistory(3);
+
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    // batches not matching checkpoints, and one ledger per batch
+    for (auto batch : {5u, 1u})
+    {
+        auto cfg = getTestConfig(static_cast<int>(batch) + 1,
+                                 Config::TESTDB_ON_DISK_SQLITE);
+        cfg.CATCHUP_COMPLETE = true;
+        cfg.CATCHUP_REPLAY_BATCH_LEDGERS = batch;
+        auto app = createTestApplication(
+            catchupSimulation.getClock(),
+            catchupSimulation.getHistoryConfigurator().configure(cfg, false));
+        app->start();
+        REQUIRE(catchupSimulation.catchupApplication(
+            initLedger, std::numeric_limits<uint32_t>::max(), false, app));
+
+        auto& lm = app->getLedgerManager();
+        REQUIRE(app->getPersistentState().getState(
+                    PersistentState::kLastClosedLedger) ==
+                binToHex(lm.getLastClosedLedgerHeader().hash));
+    }
+}
+
+TEST_CASE("History catchup into a scratch dir with a budget",
+          "[history][historycatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    catchupSimulation.generateAndPublishInitialHistory(3);
+
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    TmpDirManager tdm("scratch-" + binToHex(randomBytes(8)));
+    auto scratch = tdm.tmpDir("scratch");
+
+    auto cfg = getTestConfig(1, Config::TESTDB_ON_DISK_SQLITE);
+    cfg.CATCHUP_COMPLETE = true;
+    cfg.CATCHUP_SCRATCH_DIR_PATH = scratch.getName();
+    // less than the ledger files: one checkpoint downloaded at a time
+    cfg.CATCHUP_SCRATCH_MAX_BYTES = 1;
+    auto app = createTestApplication(
+        catchupSimulation.getClock(),
+        catchupSimulation.getHistoryConfigurator().configure(cfg, false));
+    app->start();
+    REQUIRE(fs::exists(scratch.getName() + "/catchup"));
+    REQUIRE(catchupSimulation.catchupApplication(
+        initLedger, std::numeric_limits<uint32_t>::max(), false, app));
+
+    auto& heldBack = app->getMetrics().NewMeter(
+        {"history", "download-transactions", "held-back"}, "event");
+    REQUIRE(heldBack.count() > 0);
+}
+
 TEST_CASE("History publish queueing", "[history][historydelay][historycatchup]")
 {
     CatchupSimulation catchupSimulation{};
@@ -470,6 +685,70 @@ TEST_CASE("persist publish queue", "[history]")
     }
 }
 
+TEST_CASE("publish queued checkpoints concurrently", "[history]")
+{
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.MAX_CONCURRENT_SUBPROCESSES = 0;
+    cfg.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+    TmpDirHistoryConfigurator tcfg;
+    cfg = tcfg.configure(cfg, true);
+
+    {
+        VirtualClock clock;
+        Application::pointer app0 = createTestApplication(clock, cfg);
+        app0->start();
+        while (app0->getHistoryManager().getPublishQueueCount() < 5)
+        {
+            clock.crank(true);
+        }
+        while (clock.cancelAllEvents() ||
+               app0->getProcessManager().getNumRunningProcesses() > 0)
+        {
+            clock.crank(true);
+        }
+    }
+
+    cfg.MAX_CONCURRENT_SUBPROCESSES = 32;
+    cfg.MAX_CONCURRENT_PUBLISHES = 3;
+
+    VirtualClock clock;
+    Application::pointer app1 = Application::create(clock, cfg, false);
+    app1->getHistoryArchiveManager().initializeHistoryArchive("test");
+    app1->start();
+    auto& hm1 = app1->getHistoryManager();
+    auto wellKnown = tcfg.getArchiveDirName() + "/" +
+                     HistoryArchiveState::wellKnownRemoteName();
+    uint32_t published = 0;
+    while (hm1.getPublishSuccessCount() < 5)
+    {
+        clock.crank(true);
+        HistoryArchiveState has;
+        try
+        {
+            has.load(wellKnown);
+        }
+        catch (std::exception&)
+        {
+            // not there yet, or being copied
+            continue;
+        }
+        // the archive only ever moves forward, to a checkpoint whose
+        // predecessors are all published
+        REQUIRE(has.currentLedger >= published);
+        published = has.currentLedger;
+        auto minQueued = hm1.getMinLedgerQueuedToPublish();
+        REQUIRE((minQueued == 0 || published <= minQueued));
+    }
+    REQUIRE(hm1.getPublishFailureCount() == 0);
+    REQUIRE(published >= 39);
+
+    while (clock.cancelAllEvents() ||
+           app1->getProcessManager().getNumRunningProcesses() > 0)
+    {
+        clock.crank(true);
+    }
+}
+
 // The idea with this test is that we join a network and somehow get a gap
 // in the SCP voting sequence while we're trying to catchup. This will let
 // system catchup just before the gap.
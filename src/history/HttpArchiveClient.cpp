@@ -0,0 +1,772 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "history/HttpArchiveClient.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace stellar
+{
+
+using asio::ip::tcp;
+
+std::chrono::seconds const HttpArchiveClient::TIMEOUT(30);
+
+namespace
+{
+std::string
+toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+std::string
+trim(std::string const& s)
+{
+    auto b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos)
+    {
+        return "";
+    }
+    auto e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+}
+
+/**
+ * One persistent connection. Requests are written as soon as they are given
+ * to the connection and their responses are read back in the same order;
+ * mInFlight holds the requests not answered yet, the one being answered
+ * first.
+ */
+class HttpArchiveClient::Connection
+    : public std::enable_shared_from_this<Connection>
+{
+    enum Phase
+    {
+        HEADERS,
+        BODY,
+        UNTIL_CLOSE,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        TRAILER
+    };
+
+    std::weak_ptr<HttpArchiveClient> mClient;
+    std::string mHost;
+    size_t const mPipelineDepth;
+    tcp::resolver mResolver;
+    tcp::socket mSocket;
+    VirtualTimer mTimer;
+
+    bool mConnected{false};
+    bool mClosed{false};
+    bool mWriting{false};
+    // the server announced it closes the connection after this response
+    bool mCloseAfter{false};
+    // responses read on this connection
+    size_t mAnswered{0};
+    std::string mOutgoing;
+    std::string mWriteBuf;
+    std::deque<Request> mInFlight;
+
+    asio::streambuf mIn;
+    Phase mPhase{HEADERS};
+    int mStatus{0};
+    // the response carries the rest of a resumed file
+    bool mPartial{false};
+    uint64_t mRemaining{0};
+    std::ofstream mOut;
+
+    std::shared_ptr<HttpArchiveClient>
+    client()
+    {
+        return mClient.lock();
+    }
+
+    void
+    armTimer()
+    {
+        if (mInFlight.empty())
+        {
+            mTimer.cancel();
+            return;
+        }
+        auto self = shared_from_this();
+        mTimer.expires_from_now(TIMEOUT);
+        mTimer.async_wait(
+            [self]() {
+                self->fail(std::make_error_code(std::errc::timed_out));
+            },
+            VirtualTimer::onFailureNoop);
+    }
+
+    void
+    send()
+    {
+        if (!mConnected || mClosed || mWriting || mOutgoing.empty())
+        {
+            return;
+        }
+        mWriteBuf.swap(mOutgoing);
+        mOutgoing.clear();
+        mWriting = true;
+        auto self = shared_from_this();
+        asio::async_write(mSocket, asio::buffer(mWriteBuf),
+                          [self](asio::error_code const& ec, size_t) {
+                              self->mWriting = false;
+                              if (self->mClosed)
+                              {
+                                  return;
+                              }
+                              if (ec)
+                              {
+                                  self->fail(ec);
+                                  return;
+                              }
+                              self->send();
+                          });
+    }
+
+    void
+    readHeaders()
+    {
+        mPhase = HEADERS;
+        auto self = shared_from_this();
+        asio::async_read_until(
+            mSocket, mIn, "\r\n\r\n",
+            [self](asio::error_code const& ec, size_t n) {
+                if (!self->mClosed)
+                {
+                    self->onHeaders(ec, n);
+                }
+            });
+    }
+
+    void
+    onHeaders(asio::error_code const& ec, size_t n)
+    {
+        if (ec)
+        {
+            fail(ec);
+            return;
+        }
+        if (mInFlight.empty())
+        {
+            // nothing was asked for
+            fail(std::make_error_code(std::errc::protocol_error));
+            return;
+        }
+        armTimer();
+
+        auto begin = asio::buffers_begin(mIn.data());
+        std::string head(begin, begin + n);
+        mIn.consume(n);
+
+        std::istringstream lines(head);
+        std::string line;
+        std::getline(lines, line);
+        std::istringstream statusLine(line);
+        std::string version;
+        mStatus = 0;
+        statusLine >> version >> mStatus;
+        if (version.compare(0, 5, "HTTP/") != 0 || mStatus == 0)
+        {
+            fail(std::make_error_code(std::errc::protocol_error));
+            return;
+        }
+
+        bool hasLength = false;
+        bool chunked = false;
+        // keep-alive is the default from HTTP/1.1 on
+        bool keepAlive = version != "HTTP/1.0";
+        while (std::getline(lines, line))
+        {
+            auto colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            auto name = toLower(trim(line.substr(0, colon)));
+            auto value = toLower(trim(line.substr(colon + 1)));
+            if (name == "content-length")
+            {
+                try
+                {
+                    mRemaining = std::stoull(value);
+                }
+                catch (std::exception&)
+                {
+                    fail(std::make_error_code(std::errc::protocol_error));
+                    return;
+                }
+                hasLength = true;
+            }
+            else if (name == "transfer-encoding")
+            {
+                chunked = value.find("chunked") != std::string::npos;
+            }
+            else if (name == "connection")
+            {
+                if (value.find("close") != std::string::npos)
+                {
+                    keepAlive = false;
+                }
+                else if (value.find("keep-alive") != std::string::npos)
+                {
+                    keepAlive = true;
+                }
+            }
+        }
+        mCloseAfter = mCloseAfter || !keepAlive;
+
+        auto const& request = mInFlight.front();
+        mPartial = mStatus == 206 && request.mOffset != 0;
+        if (mStatus == 200)
+        {
+            mOut.open(request.mLocal,
+                      std::ofstream::binary | std::ofstream::trunc);
+        }
+        else if (mPartial)
+        {
+            mOut.open(request.mLocal,
+                      std::ofstream::binary | std::ofstream::app);
+        }
+
+        if (chunked)
+        {
+            mPhase = CHUNK_SIZE;
+        }
+        else if (hasLength)
+        {
+            mPhase = BODY;
+        }
+        else
+        {
+            // delimited by the end of the connection
+            mPhase = UNTIL_CLOSE;
+            mCloseAfter = true;
+        }
+        readBody();
+    }
+
+    // Writes up to `max` buffered body bytes, returns how many.
+    uint64_t
+    writeBuffered(uint64_t max)
+    {
+        auto n = std::min<uint64_t>(mIn.size(), max);
+        if (n != 0)
+        {
+            if (mOut.is_open())
+            {
+                mOut.write(asio::buffer_cast<char const*>(mIn.data()),
+                           static_cast<std::streamsize>(n));
+            }
+            mIn.consume(static_cast<size_t>(n));
+        }
+        return n;
+    }
+
+    void
+    readMore()
+    {
+        auto self = shared_from_this();
+        asio::async_read(mSocket, mIn, asio::transfer_at_least(1),
+                         [self](asio::error_code const& ec, size_t) {
+                             if (self->mClosed)
+                             {
+                                 return;
+                             }
+                             if (ec == asio::error::eof &&
+                                 self->mPhase == UNTIL_CLOSE)
+                             {
+                                 self->writeBuffered(self->mIn.size());
+                                 self->finishResponse();
+                                 return;
+                             }
+                             if (ec)
+                             {
+                                 self->fail(ec);
+                                 return;
+                             }
+                             self->armTimer();
+                             self->readBody();
+                         });
+    }
+
+    void
+    readLine()
+    {
+        auto self = shared_from_this();
+        asio::async_read_until(
+            mSocket, mIn, "\r\n", [self](asio::error_code const& ec, size_t n) {
+                if (self->mClosed)
+                {
+                    return;
+                }
+                if (ec)
+                {
+                    self->fail(ec);
+                    return;
+                }
+                auto begin = asio::buffers_begin(self->mIn.data());
+                std::string line = trim(std::string(begin, begin + n));
+                self->mIn.consume(n);
+                self->onLine(line);
+            });
+    }
+
+    void
+    onLine(std::string const& line)
+    {
+        switch (mPhase)
+        {
+        case CHUNK_SIZE:
+        {
+            auto size = line.substr(0, line.find(';'));
+            try
+            {
+                mRemaining = std::stoull(size, nullptr, 16);
+            }
+            catch (std::exception&)
+            {
+                fail(std::make_error_code(std::errc::protocol_error));
+                return;
+            }
+            mPhase = mRemaining == 0 ? TRAILER : CHUNK_DATA;
+            break;
+        }
+        case CHUNK_END:
+            if (!line.empty())
+            {
+                fail(std::make_error_code(std::errc::protocol_error));
+                return;
+            }
+            mPhase = CHUNK_SIZE;
+            break;
+        case TRAILER:
+            if (line.empty())
+            {
+                finishResponse();
+                return;
+            }
+            break;
+        default:
+            assert(false);
+        }
+        readBody();
+    }
+
+    void
+    readBody()
+    {
+        switch (mPhase)
+        {
+        case BODY:
+        case CHUNK_DATA:
+            mRemaining -= writeBuffered(mRemaining);
+            if (mRemaining != 0)
+            {
+                readMore();
+            }
+            else if (mPhase == BODY)
+            {
+                finishResponse();
+            }
+            else
+            {
+                mPhase = CHUNK_END;
+                readLine();
+            }
+            break;
+        case UNTIL_CLOSE:
+            writeBuffered(mIn.size());
+            readMore();
+            break;
+        case CHUNK_SIZE:
+        case CHUNK_END:
+        case TRAILER:
+            readLine();
+            break;
+        default:
+            assert(false);
+        }
+    }
+
+    void
+    finishResponse()
+    {
+        auto request = std::move(mInFlight.front());
+        mInFlight.pop_front();
+
+        std::error_code ec;
+        if (mStatus != 200 && !mPartial)
+        {
+            CLOG(DEBUG, "History") << "HTTP status " << mStatus << " for "
+                                   << mHost << request.mPath;
+            if (mStatus == 416)
+            {
+                // what was kept is not a prefix of the file, start over
+                request.mResume = false;
+            }
+            ec = std::make_error_code(mStatus == 404
+                                          ? std::errc::no_such_file_or_directory
+                                          : std::errc::protocol_error);
+        }
+        else
+        {
+            mOut.close();
+            if (!mOut)
+            {
+                ec = std::make_error_code(std::errc::io_error);
+            }
+        }
+        if (mOut.is_open())
+        {
+            mOut.close();
+        }
+        mOut.clear();
+        ++mAnswered;
+
+        auto c = client();
+        if (mCloseAfter)
+        {
+            close();
+        }
+        else
+        {
+            armTimer();
+            readHeaders();
+        }
+        if (c)
+        {
+            c->completed(request, ec);
+        }
+    }
+
+    void
+    fail(std::error_code const& ec)
+    {
+        if (mClosed)
+        {
+            return;
+        }
+        auto c = client();
+        bool midResponse = mPhase != HEADERS || mIn.size() != 0;
+        if (mOut.is_open())
+        {
+            mOut.close();
+        }
+        mOut.clear();
+        if (mInFlight.empty() || (!midResponse && mAnswered != 0))
+        {
+            // the server closed the connection between responses, which is
+            // how keep-alive connections end: whatever was in flight is
+            // sent again
+            close();
+            return;
+        }
+
+        // the request being answered is the one that failed, the others
+        // will be sent again
+        auto request = std::move(mInFlight.front());
+        mInFlight.pop_front();
+        CLOG(DEBUG, "History") << "HTTP request for " << mHost << request.mPath
+                               << " failed: " << ec.message();
+        close();
+        if (c)
+        {
+            c->completed(request, ec);
+        }
+    }
+
+  public:
+    Connection(Application& app, std::shared_ptr<HttpArchiveClient> client,
+               std::string const& host, size_t pipelineDepth)
+        : mClient(client)
+        , mHost(host)
+        , mPipelineDepth(pipelineDepth)
+        , mResolver(app.getClock().getIOService())
+        , mSocket(app.getClock().getIOService())
+        , mTimer(app)
+    {
+    }
+
+    void
+    start(std::string const& port)
+    {
+        auto self = shared_from_this();
+        armTimer();
+        tcp::resolver::query query(mHost, port);
+        mResolver.async_resolve(
+            query, [self](asio::error_code const& ec,
+                          tcp::resolver::iterator endpoints) {
+                if (self->mClosed)
+                {
+                    return;
+                }
+                if (ec)
+                {
+                    self->fail(ec);
+                    return;
+                }
+                auto onConnect = [self](asio::error_code const& ec,
+                                        tcp::resolver::iterator) {
+                    if (self->mClosed)
+                    {
+                        return;
+                    }
+                    if (ec)
+                    {
+                        self->fail(ec);
+                        return;
+                    }
+                    self->mConnected = true;
+                    self->send();
+                    self->readHeaders();
+                };
+                asio::async_connect(self->mSocket, endpoints, onConnect);
+            });
+    }
+
+    bool
+    canTake() const
+    {
+        return !mClosed && !mCloseAfter && mInFlight.size() < mPipelineDepth;
+    }
+
+    size_t
+    inFlight() const
+    {
+        return mInFlight.size();
+    }
+
+    void
+    take(Request request)
+    {
+        request.mOffset = 0;
+        if (request.mResume)
+        {
+            std::ifstream local(request.mLocal,
+                                std::ifstream::binary | std::ifstream::ate);
+            if (local.is_open())
+            {
+                request.mOffset = static_cast<uint64_t>(local.tellg());
+            }
+        }
+        std::ostringstream out;
+        out << "GET " << request.mPath << " HTTP/1.1\r\n"
+            << "Host: " << mHost << "\r\n"
+            << "User-Agent: stellar-core\r\n"
+            << "Accept: */*\r\n";
+        if (request.mOffset != 0)
+        {
+            out << "Range: bytes=" << request.mOffset << "-\r\n";
+            if (auto c = client())
+            {
+                c->mResumeMeter.Mark();
+            }
+        }
+        out << "\r\n";
+        mOutgoing += out.str();
+        mInFlight.emplace_back(std::move(request));
+        if (mInFlight.size() == 1)
+        {
+            armTimer();
+        }
+        send();
+    }
+
+    // Closes the socket; unanswered requests go back to the client unless
+    // it is going away.
+    void
+    close(bool notify = true)
+    {
+        if (mClosed)
+        {
+            return;
+        }
+        mClosed = true;
+        mTimer.cancel();
+        mResolver.cancel();
+        asio::error_code ec;
+        // ignore errors when closing
+        mSocket.close(ec);
+        auto c = client();
+        if (notify && c)
+        {
+            c->requeue(mInFlight);
+            c->closed(this);
+        }
+        mInFlight.clear();
+    }
+};
+
+bool
+HttpArchiveClient::parseURL(std::string const& url, std::string& host,
+                            std::string& port, std::string& path)
+{
+    std::string const scheme = "http://";
+    if (toLower(url.substr(0, scheme.size())) != scheme)
+    {
+        return false;
+    }
+    auto rest = url.substr(scheme.size());
+    auto slash = rest.find('/');
+    auto authority = rest.substr(0, slash);
+    path = slash == std::string::npos ? "" : rest.substr(slash);
+    while (!path.empty() && path.back() == '/')
+    {
+        path.pop_back();
+    }
+
+    auto colon = authority.find(':');
+    host = authority.substr(0, colon);
+    port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+    return !host.empty() && !port.empty() &&
+           port.find_first_not_of("0123456789") == std::string::npos;
+}
+
+HttpArchiveClient::HttpArchiveClient(Application& app, std::string const& url)
+    : mApp(app)
+    , mMaxConnections(std::max<size_t>(
+          1, app.getConfig().HISTORY_HTTP_CONNECTIONS))
+    , mPipelineDepth(std::max<size_t>(
+          1, app.getConfig().HISTORY_HTTP_PIPELINE_DEPTH))
+    , mRequestMeter(
+          app.getMetrics().NewMeter({"history", "http", "request"}, "request"))
+    , mFailureMeter(
+          app.getMetrics().NewMeter({"history", "http", "failure"}, "request"))
+    , mRetryMeter(
+          app.getMetrics().NewMeter({"history", "http", "retry"}, "request"))
+    , mConnectMeter(app.getMetrics().NewMeter(
+          {"history", "http", "connect"}, "connection"))
+    , mResumeMeter(
+          app.getMetrics().NewMeter({"history", "http", "resume"}, "request"))
+{
+    if (!parseURL(url, mHost, mPort, mPath))
+    {
+        throw std::invalid_argument("invalid history archive url: " + url);
+    }
+}
+
+HttpArchiveClient::~HttpArchiveClient()
+{
+    for (auto& c : mConnections)
+    {
+        c->close(false);
+    }
+}
+
+void
+HttpArchiveClient::get(std::string const& remote, std::string const& local,
+                       Handler handler, bool resume)
+{
+    mRequestMeter.Mark();
+    mQueue.emplace_back(
+        Request{mPath + "/" + remote, local, handler, resume, 0});
+    dispatch();
+}
+
+size_t
+HttpArchiveClient::getConnectionCount() const
+{
+    return mConnections.size();
+}
+
+size_t
+HttpArchiveClient::getQueuedCount() const
+{
+    return mQueue.size();
+}
+
+void
+HttpArchiveClient::dispatch()
+{
+    while (!mQueue.empty())
+    {
+        Connection* best = nullptr;
+        for (auto const& c : mConnections)
+        {
+            if (c->canTake() && (!best || c->inFlight() < best->inFlight()))
+            {
+                best = c.get();
+            }
+        }
+        // rather spread the requests on more connections than pipeline them
+        // deeper
+        if ((!best || best->inFlight() != 0) &&
+            mConnections.size() < mMaxConnections)
+        {
+            auto c = std::make_shared<Connection>(mApp, shared_from_this(),
+                                                  mHost, mPipelineDepth);
+            mConnections.emplace_back(c);
+            mConnectMeter.Mark();
+            c->start(mPort);
+            best = c.get();
+        }
+        if (!best)
+        {
+            break;
+        }
+        best->take(std::move(mQueue.front()));
+        mQueue.pop_front();
+    }
+}
+
+void
+HttpArchiveClient::requeue(std::deque<Request>& requests)
+{
+    mRetryMeter.Mark(requests.size());
+    while (!requests.empty())
+    {
+        mQueue.emplace_front(std::move(requests.back()));
+        requests.pop_back();
+    }
+}
+
+void
+HttpArchiveClient::completed(Request& request, std::error_code const& ec)
+{
+    if (ec)
+    {
+        mFailureMeter.Mark();
+        if (!request.mResume)
+        {
+            std::remove(request.mLocal.c_str());
+        }
+    }
+    request.mHandler(ec);
+    // room was made on a connection
+    dispatch();
+}
+
+void
+HttpArchiveClient::closed(Connection* connection)
+{
+    mConnections.erase(
+        std::remove_if(mConnections.begin(), mConnections.end(),
+                       [connection](std::shared_ptr<Connection> const& c) {
+                           return c.get() == connection;
+                       }),
+        mConnections.end());
+    dispatch();
+}
+}
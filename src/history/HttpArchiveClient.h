@@ -0,0 +1,111 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * HttpArchiveClient downloads files from a history archive served over plain
+ * HTTP, for archives configured with a `url` rather than a `get` command.
+ * Instead of spawning a process per file, requests are queued and sent over
+ * a pool of at most HISTORY_HTTP_CONNECTIONS persistent (keep-alive)
+ * connections, each pipelining up to HISTORY_HTTP_PIPELINE_DEPTH requests.
+ * Everything runs on the main thread's io_service; response bodies are
+ * streamed to the local files as they arrive.
+ *
+ * Requests still in flight on a connection the server closes before
+ * answering them are sent again on another connection. Any other error, or a
+ * status other than 200, fails the request (and removes the local file);
+ * retrying is left to the caller, as for get commands.
+ *
+ * Resumed requests keep what was downloaded so far when they fail, and ask
+ * for the rest of the file only (with a range request) the next time.
+ */
+class HttpArchiveClient
+    : public std::enable_shared_from_this<HttpArchiveClient>,
+      NonMovableOrCopyable
+{
+  public:
+    typedef std::function<void(std::error_code const&)> Handler;
+
+    // Time without progress after which a connection with requests in
+    // flight is given up on.
+    static std::chrono::seconds const TIMEOUT;
+
+    // Splits http://host[:port][/path] into its parts, returns false if
+    // `url` is not of that form.
+    static bool parseURL(std::string const& url, std::string& host,
+                         std::string& port, std::string& path);
+
+    HttpArchiveClient(Application& app, std::string const& url);
+    ~HttpArchiveClient();
+
+    // Downloads `remote` (relative to the url of the archive) into `local`,
+    // then calls `handler` on the main thread. With `resume`, an existing
+    // `local` is taken to be the start of the file.
+    void get(std::string const& remote, std::string const& local,
+             Handler handler, bool resume = false);
+
+    size_t getConnectionCount() const;
+    size_t getQueuedCount() const;
+
+  private:
+    class Connection;
+
+    struct Request
+    {
+        std::string mPath;
+        std::string mLocal;
+        Handler mHandler;
+        bool mResume;
+        // bytes already in mLocal when resumed
+        uint64_t mOffset;
+    };
+
+    Application& mApp;
+    std::string mHost;
+    std::string mPort;
+    std::string mPath;
+    size_t const mMaxConnections;
+    size_t const mPipelineDepth;
+
+    // not yet given to a connection
+    std::deque<Request> mQueue;
+    std::vector<std::shared_ptr<Connection>> mConnections;
+
+    medida::Meter& mRequestMeter;
+    medida::Meter& mFailureMeter;
+    medida::Meter& mRetryMeter;
+    medida::Meter& mConnectMeter;
+    medida::Meter& mResumeMeter;
+
+    // Gives queued requests to the least busy connections, opening new ones
+    // while all are busy.
+    void dispatch();
+    // Puts unanswered requests of a closed connection back in front of the
+    // queue, in order.
+    void requeue(std::deque<Request>& requests);
+    void completed(Request& request, std::error_code const& ec);
+    void closed(Connection* connection);
+};
+}
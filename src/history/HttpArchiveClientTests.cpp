@@ -0,0 +1,384 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "bucket/Bucket.h"
+#include "crypto/SHA.h"
+#include "history/FileTransferInfo.h"
+#include "history/HttpArchiveClient.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Compression.h"
+#include "util/Fs.h"
+#include "util/Timer.h"
+#include "util/TmpDir.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace stellar;
+using asio::ip::tcp;
+
+namespace
+{
+// Answers requests one at a time, in order, the way most servers handle
+// pipelined requests. The body of a file is its path; ranges starting at an
+// offset are honoured.
+class TestArchiveServer
+{
+    tcp::acceptor mAcceptor;
+
+    struct Session
+    {
+        tcp::socket mSocket;
+        asio::streambuf mIn;
+        std::string mOut;
+        explicit Session(asio::io_service& io) : mSocket(io)
+        {
+        }
+    };
+
+    static std::string
+    respond(std::string const& path, size_t offset, bool& close)
+    {
+        close = false;
+        std::ostringstream out;
+        if (path.find("missing") != std::string::npos)
+        {
+            out << "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\n"
+                << "not found";
+        }
+        else if (offset != 0)
+        {
+            out << "HTTP/1.1 206 Partial Content\r\nContent-Length: "
+                << path.size() - offset << "\r\n\r\n"
+                << path.substr(offset);
+        }
+        else if (path.find("chunked") != std::string::npos)
+        {
+            out << "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                << "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n";
+        }
+        else
+        {
+            close = path.find("close") != std::string::npos;
+            out << "HTTP/1.1 200 OK\r\nContent-Length: " << path.size()
+                << (close ? "\r\nConnection: close" : "") << "\r\n\r\n"
+                << path;
+        }
+        return out.str();
+    }
+
+    // Reads whatever the client still sends until it closes too, so that
+    // the response is not cut by a reset.
+    void
+    drain(std::shared_ptr<Session> s)
+    {
+        asio::async_read(s->mSocket, s->mIn, asio::transfer_at_least(1),
+                         [this, s](asio::error_code const& ec, size_t) {
+                             if (ec)
+                             {
+                                 s->mSocket.close();
+                                 return;
+                             }
+                             s->mIn.consume(s->mIn.size());
+                             drain(s);
+                         });
+    }
+
+    void
+    serve(std::shared_ptr<Session> s)
+    {
+        asio::async_read_until(
+            s->mSocket, s->mIn, "\r\n\r\n",
+            [this, s](asio::error_code const& ec, size_t n) {
+                if (ec)
+                {
+                    return;
+                }
+                ++mRequests;
+                auto begin = asio::buffers_begin(s->mIn.data());
+                std::istringstream request(std::string(begin, begin + n));
+                s->mIn.consume(n);
+                std::string method, path, line;
+                request >> method >> path;
+                size_t offset = 0;
+                while (std::getline(request, line))
+                {
+                    std::string const range = "Range: bytes=";
+                    if (line.compare(0, range.size(), range) == 0)
+                    {
+                        offset = std::stoul(line.substr(range.size()));
+                    }
+                }
+                bool close;
+                s->mOut = respond(path, offset, close);
+                asio::async_write(
+                    s->mSocket, asio::buffer(s->mOut),
+                    [this, s, close](asio::error_code const& ec, size_t) {
+                        if (ec)
+                        {
+                            s->mSocket.close();
+                            return;
+                        }
+                        if (close)
+                        {
+                            asio::error_code ignored;
+                            s->mSocket.shutdown(tcp::socket::shutdown_send,
+                                                ignored);
+                            drain(s);
+                            return;
+                        }
+                        serve(s);
+                    });
+            });
+    }
+
+    void
+    accept()
+    {
+        auto s = std::make_shared<Session>(mAcceptor.get_io_service());
+        mAcceptor.async_accept(s->mSocket,
+                               [this, s](asio::error_code const& ec) {
+                                   if (ec)
+                                   {
+                                       return;
+                                   }
+                                   ++mConnections;
+                                   serve(s);
+                                   accept();
+                               });
+    }
+
+  public:
+    size_t mConnections{0};
+    size_t mRequests{0};
+
+    explicit TestArchiveServer(asio::io_service& io)
+        : mAcceptor(io, tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+    {
+        accept();
+    }
+
+    ~TestArchiveServer()
+    {
+        asio::error_code ec;
+        mAcceptor.close(ec);
+    }
+
+    unsigned short
+    port() const
+    {
+        return mAcceptor.local_endpoint().port();
+    }
+};
+
+std::string
+readFile(std::string const& path)
+{
+    std::ifstream in(path, std::ifstream::binary);
+    std::ostringstream s;
+    s << in.rdbuf();
+    return s.str();
+}
+}
+
+TEST_CASE("http archive client url parsing", "[history][http]")
+{
+    std::string host, port, path;
+    REQUIRE(HttpArchiveClient::parseURL("http://example.com", host, port,
+                                        path));
+    REQUIRE(host == "example.com");
+    REQUIRE(port == "80");
+    REQUIRE(path.empty());
+
+    REQUIRE(HttpArchiveClient::parseURL("http://127.0.0.1:8080/a/b/", host,
+                                        port, path));
+    REQUIRE(host == "127.0.0.1");
+    REQUIRE(port == "8080");
+    REQUIRE(path == "/a/b");
+
+    REQUIRE(!HttpArchiveClient::parseURL("https://example.com/", host, port,
+                                         path));
+    REQUIRE(!HttpArchiveClient::parseURL("http://:80/", host, port, path));
+    REQUIRE(!HttpArchiveClient::parseURL("http://host:port/", host, port,
+                                         path));
+}
+
+TEST_CASE("http archive client", "[history][http]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto cfg = getTestConfig();
+    cfg.HISTORY_HTTP_CONNECTIONS = 2;
+    cfg.HISTORY_HTTP_PIPELINE_DEPTH = 4;
+    auto app = createTestApplication(clock, cfg);
+    TestArchiveServer server(clock.getIOService());
+    TmpDir dir("http-archive");
+
+    auto client = std::make_shared<HttpArchiveClient>(
+        *app, "http://127.0.0.1:" + std::to_string(server.port()) + "/arch/");
+
+    size_t pending = 0;
+    std::map<std::string, std::error_code> results;
+    auto get = [&](std::string const& name) {
+        ++pending;
+        client->get(name, dir.getName() + "/" + name,
+                    [&, name](std::error_code const& ec) {
+                        --pending;
+                        results[name] = ec;
+                    });
+    };
+    auto wait = [&]() {
+        auto deadline = clock.now() + std::chrono::seconds(10);
+        while (pending != 0 && clock.now() < deadline)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(pending == 0);
+    };
+
+    SECTION("many files over few connections")
+    {
+        for (int i = 0; i < 20; ++i)
+        {
+            get("file-" + std::to_string(i));
+        }
+        REQUIRE(client->getConnectionCount() == 2);
+        wait();
+        for (int i = 0; i < 20; ++i)
+        {
+            auto name = "file-" + std::to_string(i);
+            REQUIRE(!results[name]);
+            REQUIRE(readFile(dir.getName() + "/" + name) == "/arch/" + name);
+        }
+        REQUIRE(server.mConnections == 2);
+        REQUIRE(server.mRequests == 20);
+
+        // kept alive for the next downloads
+        get("again");
+        wait();
+        REQUIRE(!results["again"]);
+        REQUIRE(server.mConnections == 2);
+    }
+
+    SECTION("errors and chunked responses")
+    {
+        get("missing");
+        get("chunked");
+        wait();
+        REQUIRE(results["missing"] ==
+                std::make_error_code(std::errc::no_such_file_or_directory));
+        REQUIRE(!fs::exists(dir.getName() + "/missing"));
+        REQUIRE(!results["chunked"]);
+        REQUIRE(readFile(dir.getName() + "/chunked") == "hello world");
+    }
+
+    SECTION("resumed downloads")
+    {
+        {
+            std::ofstream partial(dir.getName() + "/resumed");
+            partial << "/arch/re";
+        }
+        ++pending;
+        client->get("resumed", dir.getName() + "/resumed",
+                    [&](std::error_code const& ec) {
+                        --pending;
+                        results["resumed"] = ec;
+                    },
+                    true);
+        wait();
+        REQUIRE(!results["resumed"]);
+        REQUIRE(readFile(dir.getName() + "/resumed") == "/arch/resumed");
+
+        // kept for the next attempt when failing
+        {
+            std::ofstream partial(dir.getName() + "/missing");
+            partial << "/arch/mi";
+        }
+        ++pending;
+        client->get("missing", dir.getName() + "/missing",
+                    [&](std::error_code const& ec) {
+                        --pending;
+                        results["missing"] = ec;
+                    },
+                    true);
+        wait();
+        REQUIRE(results["missing"]);
+        REQUIRE(readFile(dir.getName() + "/missing") == "/arch/mi");
+    }
+
+    SECTION("requests pipelined behind a closing response are sent again")
+    {
+        get("close");
+        get("a");
+        get("b");
+        get("c");
+        get("d");
+        get("e");
+        wait();
+        for (auto const& r : results)
+        {
+            REQUIRE(!r.second);
+        }
+        REQUIRE(readFile(dir.getName() + "/e") == "/arch/e");
+        REQUIRE(server.mConnections == 3);
+    }
+}
+
+TEST_CASE("buckets served to other nodes", "[history][http]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto cfg = getTestConfig();
+    cfg.HISTORY_SERVE_PORT = cfg.HTTP_PORT;
+    cfg.HTTP_PORT = 0;
+    cfg.HTTP_IO_THREADS = 1;
+    auto app = createTestApplication(clock, cfg);
+    TmpDir dir("http-archive");
+
+    auto bucket =
+        Bucket::fresh(app->getBucketManager(),
+                      LedgerTestUtils::generateValidLedgerEntries(100),
+                      std::vector<LedgerKey>{});
+    FileTransferInfo ft(*bucket);
+    auto client = std::make_shared<HttpArchiveClient>(
+        *app, "http://127.0.0.1:" + std::to_string(cfg.HISTORY_SERVE_PORT));
+
+    size_t pending = 0;
+    std::map<std::string, std::error_code> results;
+    auto get = [&](std::string const& remote, std::string const& local) {
+        ++pending;
+        client->get(remote, dir.getName() + "/" + local,
+                    [&, local](std::error_code const& ec) {
+                        --pending;
+                        results[local] = ec;
+                    });
+    };
+    get(ft.remoteName(), ft.baseName_gz());
+    get("bucket/00/00/00/bucket-" + std::string(64, '0') + ".xdr.gz",
+        "missing");
+    get("ledger/00/00/00/ledger-0000003f.xdr.gz", "ledger");
+    auto deadline = clock.now() + std::chrono::seconds(10);
+    while (pending != 0 && clock.now() < deadline)
+    {
+        clock.crank(false);
+    }
+    REQUIRE(pending == 0);
+
+    // as GetAndVerifyBucketWork checks what it downloads
+    REQUIRE(!results[ft.baseName_gz()]);
+    auto hasher = SHA256::create();
+    decompressFile(dir.getName() + "/" + ft.baseName_gz(),
+                   dir.getName() + "/" + ft.baseName_nogz(),
+                   CompressionFormat::GZIP, hasher.get());
+    REQUIRE(hasher->finish() == bucket->getHash());
+
+    REQUIRE(results["missing"] ==
+            std::make_error_code(std::errc::no_such_file_or_directory));
+    REQUIRE(results["ledger"] ==
+            std::make_error_code(std::errc::no_such_file_or_directory));
+}
@@ -9,6 +9,7 @@
 #include "crypto/Hex.h"
 #include "database/Database.h"
 #include "herder/HerderPersistence.h"
+#include "history/CheckpointBuilder.h"
 #include "history/FileTransferInfo.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryManager.h"
@@ -16,17 +17,52 @@
 #include "main/Application.h"
 #include "main/Config.h"
 #include "transactions/TransactionFrame.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
 #include "util/XDRStream.h"
 
 #include "medida/counter.h"
 #include "medida/metrics_registry.h"
 
+#include <future>
 #include <soci.h>
 
 namespace stellar
 {
 
+namespace
+{
+// Runs `copy` on a thread of its own, with a session of `pool` leased for the
+// time it runs in a transaction of its own, if one is free right away;
+// otherwise runs it now with `sess`, which is already in a transaction.
+std::future<size_t>
+copyConcurrently(soci::connection_pool* pool, soci::session& sess,
+                 std::function<size_t(soci::session&)> copy)
+{
+    size_t pos;
+    if (pool && pool->try_lease(pos, 0))
+    {
+        return std::async(std::launch::async, [pool, pos, copy]() {
+            struct GiveBack
+            {
+                soci::connection_pool& mPool;
+                size_t mPos;
+                ~GiveBack()
+                {
+                    mPool.give_back(mPos);
+                }
+            } giveBack{*pool, pos};
+            auto& s = pool->at(pos);
+            soci::transaction tx(s);
+            return copy(s);
+        });
+    }
+    std::promise<size_t> done;
+    done.set_value(copy(sess));
+    return done.get_future();
+}
+}
+
 StateSnapshot::StateSnapshot(Application& app, HistoryArchiveState const& state)
     : mApp(app)
     , mLocalState(state)
@@ -45,6 +81,9 @@ StateSnapshot::StateSnapshot(Application& app, HistoryArchiveState const& state)
 
 {
     makeLive();
+    mPrebuilt = app.getHistoryManager().getCheckpointBuilder().takeCheckpoint(
+        mLocalState.currentLedger, *mLedgerSnapFile, *mTransactionSnapFile,
+        *mTransactionResultSnapFile);
 }
 
 void
@@ -56,19 +95,43 @@ StateSnapshot::makeLive()
         auto& hb = mLocalState.currentBuckets[i];
         if (hb.next.hasHashes() && !hb.next.isLive())
         {
-            hb.next.makeLive(mApp, BucketList::keepDeadEntries(i));
+            hb.next.makeLive(mApp, i, BucketList::keepDeadEntries(i));
         }
     }
 }
 
+std::vector<std::shared_ptr<FileTransferInfo>>
+StateSnapshot::differingHASFiles(HistoryArchiveState const& other)
+{
+    std::vector<std::shared_ptr<FileTransferInfo>> files;
+    for (auto const& f : {mLedgerSnapFile, mTransactionSnapFile,
+                          mTransactionResultSnapFile, mSCPHistorySnapFile})
+    {
+        if (f && fs::exists(f->localPath_nogz()))
+        {
+            files.push_back(f);
+        }
+    }
+
+    for (auto const& hash : mLocalState.differingBuckets(other))
+    {
+        auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
+        assert(b);
+        // compressed next to the other files of the snapshot: a bucket can be
+        // in several snapshots published at once
+        files.push_back(std::make_shared<FileTransferInfo>(*b, mSnapDir));
+    }
+    return files;
+}
+
 bool
 StateSnapshot::writeHistoryBlocks() const
 {
+    auto& db = mApp.getDatabase();
+    auto* pool = db.canUsePool() ? &db.getPool() : nullptr;
     std::unique_ptr<soci::session> snapSess(
-        mApp.getDatabase().canUsePool()
-            ? std::make_unique<soci::session>(mApp.getDatabase().getPool())
-            : nullptr);
-    soci::session& sess(snapSess ? *snapSess : mApp.getDatabase().getSession());
+        pool ? std::make_unique<soci::session>(*pool) : nullptr);
+    soci::session& sess(snapSess ? *snapSess : db.getSession());
     soci::transaction tx(sess);
 
     // The current "history block" is stored in _four_ files, one just ledger
@@ -78,13 +141,20 @@ StateSnapshot::writeHistoryBlocks() const
     // All files are streamed out of the database, entry-by-entry.
     size_t nbSCPMessages;
     uint32_t begin, count;
-    size_t nHeaders;
+    size_t nHeaders = 0;
     {
+        FileIOMetrics io(mApp.getMetrics(), "history-temp");
+        XDRWriteOptions options;
+        options.mMetrics = &io;
         XDROutputFileStream ledgerOut, txOut, txResultOut, scpHistory;
-        ledgerOut.open(mLedgerSnapFile->localPath_nogz());
-        txOut.open(mTransactionSnapFile->localPath_nogz());
-        txResultOut.open(mTransactionResultSnapFile->localPath_nogz());
-        scpHistory.open(mSCPHistorySnapFile->localPath_nogz());
+        if (!mPrebuilt)
+        {
+            ledgerOut.open(mLedgerSnapFile->localPath_nogz(), false, options);
+            txOut.open(mTransactionSnapFile->localPath_nogz(), false, options);
+            txResultOut.open(mTransactionResultSnapFile->localPath_nogz(),
+                             false, options);
+        }
+        scpHistory.open(mSCPHistorySnapFile->localPath_nogz(), false, options);
 
         // 'mLocalState' describes the LCL, so its currentLedger will usually be
         // 63,
@@ -98,20 +168,39 @@ StateSnapshot::writeHistoryBlocks() const
         CLOG(DEBUG, "History") << "Streaming " << count
                                << " ledgers worth of history, from " << begin;
 
-        nHeaders = LedgerHeaderFrame::copyLedgerHeadersToStream(
-            mApp.getDatabase(), sess, begin, count, ledgerOut);
-        size_t nTxs = TransactionFrame::copyTransactionsToStream(
-            mApp.getNetworkID(), mApp.getDatabase(), sess, begin, count, txOut,
-            txResultOut);
-        CLOG(DEBUG, "History") << "Wrote " << nHeaders << " ledger headers to "
-                               << mLedgerSnapFile->localPath_nogz();
-        CLOG(DEBUG, "History")
-            << "Wrote " << nTxs << " transactions to "
-            << mTransactionSnapFile->localPath_nogz() << " and "
-            << mTransactionResultSnapFile->localPath_nogz();
+        // The headers and the SCP messages are each read on a thread of their
+        // own, with a session of the pool, when one is free: the ledgers of
+        // the checkpoint are all committed, the sessions see the same rows.
+        std::future<size_t> headersDone, scpDone;
+        if (!mPrebuilt)
+        {
+            headersDone = copyConcurrently(pool, sess, [&](soci::session& s) {
+                return LedgerHeaderFrame::copyLedgerHeadersToStream(
+                    db, s, begin, count, ledgerOut);
+            });
+        }
+        scpDone = copyConcurrently(pool, sess, [&](soci::session& s) {
+            return mApp.getHerderPersistence().copySCPHistoryToStream(
+                s, begin, count, scpHistory);
+        });
+
+        if (!mPrebuilt)
+        {
+            // transactions and results come from the same rows
+            size_t nTxs = TransactionFrame::copyTransactionsToStream(
+                mApp.getNetworkID(), db, sess, begin, count, txOut,
+                txResultOut);
+            nHeaders = headersDone.get();
+            CLOG(DEBUG, "History")
+                << "Wrote " << nHeaders << " ledger headers to "
+                << mLedgerSnapFile->localPath_nogz();
+            CLOG(DEBUG, "History")
+                << "Wrote " << nTxs << " transactions to "
+                << mTransactionSnapFile->localPath_nogz() << " and "
+                << mTransactionResultSnapFile->localPath_nogz();
+        }
 
-        nbSCPMessages = HerderPersistence::copySCPHistoryToStream(
-            mApp.getDatabase(), sess, begin, count, scpHistory);
+        nbSCPMessages = scpDone.get();
 
         CLOG(DEBUG, "History")
             << "Wrote " << nbSCPMessages << " SCP messages to "
@@ -134,7 +223,8 @@ StateSnapshot::writeHistoryBlocks() const
     // transaction-isolation level -- the highest offered! -- as txns only have
     // to be applied in isolation and in _some_ order, not the wall-clock order
     // we issued them. Anyway this is transient and should go away upon retry.
-    if (!((begin == 0 && nHeaders == count - 1) || nHeaders == count))
+    if (!mPrebuilt &&
+        !((begin == 0 && nHeaders == count - 1) || nHeaders == count))
     {
         CLOG(WARNING, "History")
             << "Only wrote " << nHeaders << " ledger headers for "
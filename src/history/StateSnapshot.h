@@ -26,9 +26,16 @@ struct StateSnapshot : public std::enable_shared_from_this<StateSnapshot>
     std::shared_ptr<FileTransferInfo> mTransactionSnapFile;
     std::shared_ptr<FileTransferInfo> mTransactionResultSnapFile;
     std::shared_ptr<FileTransferInfo> mSCPHistorySnapFile;
+    // ledger, transaction and result files written as the ledgers closed
+    bool mPrebuilt{false};
 
     StateSnapshot(Application& app, HistoryArchiveState const& state);
     void makeLive();
     bool writeHistoryBlocks() const;
+
+    // The files of the snapshot, and the buckets of mLocalState that `other`
+    // does not have, that an archive in state `other` needs to be sent.
+    std::vector<std::shared_ptr<FileTransferInfo>>
+    differingHASFiles(HistoryArchiveState const& other);
 };
 }
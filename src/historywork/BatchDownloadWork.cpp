@@ -53,6 +53,17 @@ BatchDownloadWork::getStatus() const
     return Work::getStatus();
 }
 
+uint32_t
+BatchDownloadWork::getRemaining() const
+{
+    uint32_t remaining = static_cast<uint32_t>(mRunning.size());
+    if (mNext <= mRange.last())
+    {
+        remaining += (mRange.last() - mNext) / mRange.frequency() + 1;
+    }
+    return remaining;
+}
+
 void
 BatchDownloadWork::addNextDownloadWorker()
 {
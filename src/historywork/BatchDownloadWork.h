@@ -47,6 +47,8 @@ class BatchDownloadWork : public Work
                       TmpDir const& downloadDir);
     ~BatchDownloadWork();
     std::string getStatus() const override;
+    // Checkpoints whose file is not downloaded yet.
+    uint32_t getRemaining() const;
     void onReset() override;
     void notify(std::string const& child) override;
 };
@@ -31,7 +31,7 @@ FetchRecentQsetsWork::onReset()
     clearChildren();
     mDownloadSCPMessagesWork.reset();
     mDownloadDir = std::make_unique<TmpDir>(
-        mApp.getTmpDirManager().tmpDir(getUniqueName()));
+        mApp.getScratchDirManager().tmpDir(getUniqueName()));
 }
 
 Work::State
@@ -0,0 +1,175 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/GetAndVerifyBucketWork.h"
+#include "bucket/BucketManager.h"
+#include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "history/HistoryArchiveManager.h"
+#include "historywork/GetRemoteFileWork.h"
+#include "main/Application.h"
+#include "util/Compression.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/WorkerLanes.h"
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
+
+namespace stellar
+{
+
+GetAndVerifyBucketWork::GetAndVerifyBucketWork(
+    Application& app, WorkParent& parent,
+    std::map<std::string, std::shared_ptr<Bucket>>& buckets,
+    FileTransferInfo ft, uint256 const& hash,
+    std::shared_ptr<HistoryArchive> archive, size_t maxRetries)
+    : Work(app, parent,
+           std::string("get-and-verify-bucket ") + ft.remoteName(),
+           maxRetries)
+    , mBuckets(buckets)
+    , mFt(std::move(ft))
+    , mHash(hash)
+    , mArchive(archive)
+    , mVerifyBucketSuccess{app.getMetrics().NewMeter(
+          {"history", "verify-bucket", "success"}, "event")}
+    , mVerifyBucketFailure{app.getMetrics().NewMeter(
+          {"history", "verify-bucket", "failure"}, "event")}
+{
+}
+
+GetAndVerifyBucketWork::~GetAndVerifyBucketWork()
+{
+    clearChildren();
+}
+
+std::string
+GetAndVerifyBucketWork::getStatus() const
+{
+    if (mState == WORK_PENDING && mGetRemoteFileWork)
+    {
+        return mGetRemoteFileWork->getStatus();
+    }
+    return Work::getStatus();
+}
+
+void
+GetAndVerifyBucketWork::onReset()
+{
+    clearChildren();
+    mVerifying = false;
+    // the partial .gz of a failed download is kept to be resumed; the
+    // verifying task removes it when it is bad
+    std::remove(mFt.localPath_nogz().c_str());
+
+    auto archive = mArchive;
+    if (!archive && !mTriedBucketsOnly)
+    {
+        mTriedBucketsOnly = true;
+        archive =
+            mApp.getHistoryArchiveManager().selectBucketsOnlyHistoryArchive();
+        mFromBucketsOnly = archive != nullptr;
+    }
+    else if (mFromBucketsOnly)
+    {
+        // a node compresses its buckets its own way: what it sent can not
+        // be resumed from another archive
+        mFromBucketsOnly = false;
+        std::remove(mFt.localPath_gz().c_str());
+    }
+
+    CLOG(DEBUG, "History") << "Downloading and verifying " << mFt.remoteName()
+                           << ": downloading";
+    mGetRemoteFileWork = addWork<GetRemoteFileWork>(
+        mFt.remoteName(), mFt.localPath_gz(), archive, RETRY_NEVER, true);
+}
+
+void
+GetAndVerifyBucketWork::onStart()
+{
+    std::string filenameGz = mFt.localPath_gz();
+    std::string filename = mFt.localPath_nogz();
+    uint256 hash = mHash;
+    Application& app = this->mApp;
+    auto handler = callComplete();
+    mVerifying = true;
+    CLOG(DEBUG, "History") << "Downloading and verifying " << mFt.remoteName()
+                           << ": unzipping and hashing";
+    app.getWorkerLanes().post(WorkerLane::CATCHUP, [&app, filenameGz,
+                                                    filename, handler,
+                                                    hash]() {
+        asio::error_code ec;
+        auto hasher = SHA256::create();
+        try
+        {
+            decompressFile(filenameGz, filename, CompressionFormat::GZIP,
+                           hasher.get());
+            uint256 vHash = hasher->finish();
+            if (vHash == hash)
+            {
+                CLOG(DEBUG, "History") << "Verified hash (" << hexAbbrev(hash)
+                                       << ") for " << filename;
+            }
+            else
+            {
+                CLOG(WARNING, "History")
+                    << "FAILED verifying hash for " << filename;
+                CLOG(WARNING, "History") << "expected hash: " << binToHex(hash);
+                CLOG(WARNING, "History")
+                    << "computed hash: " << binToHex(vHash);
+                ec = std::make_error_code(std::errc::io_error);
+            }
+        }
+        catch (std::runtime_error& e)
+        {
+            CLOG(WARNING, "History")
+                << "FAILED decompressing " << filenameGz << ": " << e.what();
+            ec = std::make_error_code(std::errc::io_error);
+        }
+        std::remove(filenameGz.c_str());
+        if (ec)
+        {
+            std::remove(filename.c_str());
+        }
+        app.getClock().getIOService().post([ec, handler]() { handler(ec); });
+    });
+}
+
+void
+GetAndVerifyBucketWork::onRun()
+{
+    // Do nothing: we spawned the decompress-and-verify task in onStart().
+}
+
+Work::State
+GetAndVerifyBucketWork::onSuccess()
+{
+    auto b =
+        mApp.getBucketManager().adoptFileAsBucket(mFt.localPath_nogz(), mHash);
+    mBuckets[binToHex(mHash)] = b;
+    mVerifyBucketSuccess.Mark();
+    return WORK_SUCCESS;
+}
+
+void
+GetAndVerifyBucketWork::onFailureRetry()
+{
+    if (mVerifying)
+    {
+        mVerifyBucketFailure.Mark();
+    }
+    Work::onFailureRetry();
+}
+
+void
+GetAndVerifyBucketWork::onFailureRaise()
+{
+    if (mVerifying)
+    {
+        mVerifyBucketFailure.Mark();
+    }
+    std::remove(mFt.localPath_nogz().c_str());
+    std::remove(mFt.localPath_gz().c_str());
+    Work::onFailureRaise();
+}
+}
@@ -0,0 +1,69 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "history/FileTransferInfo.h"
+#include "work/Work.h"
+#include "xdr/Stellar-types.h"
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Bucket;
+class HistoryArchive;
+
+// Downloads a gzipped bucket and then, in a single pass on a worker thread,
+// decompresses it, hashes the decompressed bytes and writes the final bucket
+// file. This replaces the GetAndUnzipRemoteFileWork + VerifyBucketWork chain,
+// which wrote the bucket and then read all of it again to hash it.
+//
+// On success the bucket is adopted by the BucketManager and recorded in
+// `buckets`. A hash mismatch is retried like a failed download, since the
+// retry may pick a different archive. A failed download is resumed where it
+// stopped on retry (see GetRemoteFileWork), a file that failed to verify is
+// downloaded again from the start.
+//
+// Without a given archive, the first try is from a buckets-only archive
+// (such as a nearby node serving its bucket dir) when one is configured,
+// the retries from the regular archives.
+class GetAndVerifyBucketWork : public Work
+{
+    std::map<std::string, std::shared_ptr<Bucket>>& mBuckets;
+    FileTransferInfo mFt;
+    uint256 mHash;
+    std::shared_ptr<HistoryArchive> mArchive;
+    std::shared_ptr<Work> mGetRemoteFileWork;
+    bool mVerifying{false};
+    bool mTriedBucketsOnly{false};
+    bool mFromBucketsOnly{false};
+
+    medida::Meter& mVerifyBucketSuccess;
+    medida::Meter& mVerifyBucketFailure;
+
+  public:
+    // Passing `nullptr` for the archive argument will cause the work to
+    // select a new readable history archive at random each time it runs /
+    // retries.
+    GetAndVerifyBucketWork(
+        Application& app, WorkParent& parent,
+        std::map<std::string, std::shared_ptr<Bucket>>& buckets,
+        FileTransferInfo ft, uint256 const& hash,
+        std::shared_ptr<HistoryArchive> archive = nullptr,
+        size_t maxRetries = Work::RETRY_A_LOT);
+    ~GetAndVerifyBucketWork();
+    std::string getStatus() const override;
+    void onReset() override;
+    void onStart() override;
+    void onRun() override;
+    Work::State onSuccess() override;
+    void onFailureRetry() override;
+    void onFailureRaise() override;
+};
+}
@@ -4,10 +4,12 @@
 
 #include "historywork/GetHistoryArchiveStateWork.h"
 #include "history/HistoryArchive.h"
+#include "history/HistoryArchiveManager.h"
 #include "historywork/GetRemoteFileWork.h"
 #include "ledger/LedgerManager.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "util/Logging.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
@@ -33,6 +35,9 @@ GetHistoryArchiveStateWork::GetHistoryArchiveStateWork(
           {"history", "download-history-archive-state", "success"}, "event"))
     , mGetHistoryArchiveStateFailure(app.getMetrics().NewMeter(
           {"history", "download-history-archive-state", "failure"}, "event"))
+    , mGetHistoryArchiveStateRaceLost(app.getMetrics().NewMeter(
+          {"history", "download-history-archive-state", "race-lost"},
+          "event"))
 {
 }
 
@@ -52,17 +57,110 @@ GetHistoryArchiveStateWork::getStatus() const
     return Work::getStatus();
 }
 
+std::string
+GetHistoryArchiveStateWork::remoteName() const
+{
+    return mSeq == 0 ? HistoryArchiveState::wellKnownRemoteName()
+                     : HistoryArchiveState::remoteName(mSeq);
+}
+
 void
 GetHistoryArchiveStateWork::onReset()
 {
     clearChildren();
+    for (auto const& r : mRacing)
+    {
+        std::remove(r.second.c_str());
+    }
+    mRacing.clear();
+    mLocalFilename =
+        mArchive ? HistoryArchiveState::localName(mApp, mArchive->getName())
+                 : mApp.getHistoryManager().localFilename(
+                       HistoryArchiveState::baseName());
     std::remove(mLocalFilename.c_str());
-    addWork<GetRemoteFileWork>(mSeq == 0
-                                   ? HistoryArchiveState::wellKnownRemoteName()
-                                   : HistoryArchiveState::remoteName(mSeq),
-                               mLocalFilename, mArchive, getMaxRetries());
-
     mGetHistoryArchiveStateStart.Mark();
+
+    auto race = mApp.getConfig().HISTORY_RACE_ARCHIVES;
+    if (!mArchive && race > 1)
+    {
+        auto archives = mApp.getHistoryArchiveManager()
+                            .selectRandomReadableHistoryArchives(race);
+        if (archives.size() > 1)
+        {
+            // the whole race is retried rather than each of its downloads
+            for (auto const& archive : archives)
+            {
+                auto local =
+                    HistoryArchiveState::localName(mApp, archive->getName());
+                std::remove(local.c_str());
+                auto w = addWork<GetRemoteFileWork>(remoteName(), local,
+                                                    archive, RETRY_NEVER);
+                mRacing[w->getUniqueName()] = local;
+            }
+            return;
+        }
+    }
+
+    addWork<GetRemoteFileWork>(remoteName(), mLocalFilename, mArchive,
+                               getMaxRetries());
+}
+
+void
+GetHistoryArchiveStateWork::notify(std::string const& child)
+{
+    auto i = mChildren.find(child);
+    auto racing = mRacing.find(child);
+    if (i == mChildren.end() || racing == mRacing.end())
+    {
+        Work::notify(child);
+        return;
+    }
+
+    auto state = i->second->getState();
+    if (state == WORK_SUCCESS)
+    {
+        try
+        {
+            HistoryArchiveState has;
+            has.load(racing->second);
+
+            // the first valid state wins, the other downloads are abandoned
+            CLOG(DEBUG, "History") << "Using history archive state from "
+                                   << child << ", first of " << mRacing.size();
+            mLocalFilename = racing->second;
+            auto winner = i->second;
+            mGetHistoryArchiveStateRaceLost.Mark(mChildren.size() - 1);
+            clearChildren();
+            mChildren.insert(std::make_pair(child, winner));
+            mRacing.clear();
+            advance();
+            return;
+        }
+        catch (std::runtime_error& e)
+        {
+            CLOG(WARNING, "History")
+                << "error loading history state from " << child << ": "
+                << e.what();
+        }
+    }
+    else if (state != WORK_FAILURE_RAISE && state != WORK_FAILURE_FATAL)
+    {
+        advance();
+        return;
+    }
+
+    // this download lost without a state; the race fails once all have
+    std::remove(racing->second.c_str());
+    mRacing.erase(racing);
+    mChildren.erase(i);
+    if (mChildren.empty())
+    {
+        scheduleFailure();
+    }
+    else
+    {
+        advance();
+    }
 }
 
 void
@@ -17,16 +17,28 @@ namespace stellar
 class HistoryArchive;
 struct HistoryArchiveState;
 
+// Downloads and loads the history archive state of checkpoint `seq`, or the
+// latest one if `seq` is 0, from `archive`.
+//
+// Without an archive, it is requested from HISTORY_RACE_ARCHIVES readable
+// archives at once (one at a time if that is 1): the first download that
+// loads is used and the others are abandoned. The work fails only if all of
+// them fail.
 class GetHistoryArchiveStateWork : public Work
 {
     HistoryArchiveState& mState;
     uint32_t mSeq;
     std::shared_ptr<HistoryArchive> mArchive;
     std::string mLocalFilename;
+    // racing downloads: local file by child name
+    std::map<std::string, std::string> mRacing;
 
     medida::Meter& mGetHistoryArchiveStateStart;
     medida::Meter& mGetHistoryArchiveStateSuccess;
     medida::Meter& mGetHistoryArchiveStateFailure;
+    medida::Meter& mGetHistoryArchiveStateRaceLost;
+
+    std::string remoteName() const;
 
   public:
     GetHistoryArchiveStateWork(
@@ -38,6 +50,7 @@ class GetHistoryArchiveStateWork : public Work
     std::string getStatus() const override;
     void onReset() override;
     void onRun() override;
+    void notify(std::string const& child) override;
 
     State onSuccess() override;
     void onFailureRetry() override;
@@ -6,7 +6,12 @@
 #include "history/HistoryArchive.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
+#include "history/HttpArchiveClient.h"
 #include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 namespace stellar
 {
@@ -15,12 +20,15 @@ GetRemoteFileWork::GetRemoteFileWork(Application& app, WorkParent& parent,
                                      std::string const& remote,
                                      std::string const& local,
                                      std::shared_ptr<HistoryArchive> archive,
-                                     size_t maxRetries)
+                                     size_t maxRetries, bool resume)
     : RunCommandWork(app, parent, std::string("get-remote-file ") + remote,
                      maxRetries)
     , mRemote(remote)
     , mLocal(local)
     , mArchive(archive)
+    , mResume(resume)
+    , mDownloadBytes(app.getMetrics().NewMeter(
+          {"history", "download", "bytes"}, "byte"))
 {
 }
 
@@ -29,24 +37,54 @@ GetRemoteFileWork::~GetRemoteFileWork()
     clearChildren();
 }
 
+Work::ResourceClass
+GetRemoteFileWork::getResourceClass() const
+{
+    return RESOURCE_NETWORK;
+}
+
 void
-GetRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+GetRemoteFileWork::onStart()
 {
     mCurrentArchive = mArchive;
     if (!mCurrentArchive)
     {
-        mCurrentArchive = mApp.getHistoryArchiveManager()
-                              .selectRandomReadableHistoryArchive();
+        auto& ham = mApp.getHistoryArchiveManager();
+        mCurrentArchive = mApp.getConfig().HISTORY_RACE_ARCHIVES > 1
+                              ? ham.selectFastReadableHistoryArchive()
+                              : ham.selectRandomReadableHistoryArchive();
     }
+    mStartTime = mApp.getClock().now();
     assert(mCurrentArchive);
     assert(mCurrentArchive->hasGetCmd());
+    if (mCurrentArchive->hasURL())
+    {
+        mResumedBytes = mResume ? fs::size(mLocal) : 0;
+        mApp.getHistoryArchiveManager()
+            .getHttpClient(*mCurrentArchive)
+            ->get(mRemote, mLocal, callComplete(), mResume);
+    }
+    else
+    {
+        mResumedBytes = 0;
+        RunCommandWork::onStart();
+    }
+}
+
+void
+GetRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+{
+    assert(mCurrentArchive);
     cmdLine = mCurrentArchive->getFileCmd(mRemote, mLocal);
 }
 
 void
 GetRemoteFileWork::onReset()
 {
-    std::remove(mLocal.c_str());
+    if (!mResume)
+    {
+        std::remove(mLocal.c_str());
+    }
 }
 
 Work::State
@@ -54,6 +92,13 @@ GetRemoteFileWork::onSuccess()
 {
     assert(mCurrentArchive);
     mCurrentArchive->markSuccess();
+    auto size = fs::size(mLocal);
+    if (size > mResumedBytes)
+    {
+        mDownloadBytes.Mark(size - mResumedBytes);
+        mCurrentArchive->markDownload(size - mResumedBytes,
+                                      mApp.getClock().now() - mStartTime);
+    }
     return RunCommandWork::onSuccess();
 }
 
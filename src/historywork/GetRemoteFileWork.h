@@ -6,6 +6,11 @@
 
 #include "historywork/RunCommandWork.h"
 
+namespace medida
+{
+class Meter;
+}
+
 namespace stellar
 {
 
@@ -17,18 +22,31 @@ class GetRemoteFileWork : public RunCommandWork
     std::string mLocal;
     std::shared_ptr<HistoryArchive> mArchive;
     std::shared_ptr<HistoryArchive> mCurrentArchive;
+    bool const mResume;
+    // bytes of `local` kept from an earlier attempt
+    size_t mResumedBytes{0};
+    VirtualClock::time_point mStartTime;
+    medida::Meter& mDownloadBytes;
     void getCommand(std::string& cmdLine, std::string& outFile) override;
 
   public:
     // Passing `nullptr` for the archive argument will cause the work to
     // select a new readable history archive at random each time it runs /
-    // retries.
+    // retries (weighted by their throughput if HISTORY_RACE_ARCHIVES is
+    // above 1).
+    //
+    // With `resume`, a partial `local` left by an earlier attempt is kept and
+    // only the rest of the file is downloaded, when the archive is read over
+    // HTTP (get commands always download the whole file).
     GetRemoteFileWork(Application& app, WorkParent& parent,
                       std::string const& remote, std::string const& local,
                       std::shared_ptr<HistoryArchive> archive = nullptr,
-                      size_t maxRetries = Work::RETRY_A_LOT);
+                      size_t maxRetries = Work::RETRY_A_LOT,
+                      bool resume = false);
     ~GetRemoteFileWork();
+    ResourceClass getResourceClass() const override;
     void onReset() override;
+    void onStart() override;
 
     Work::State onSuccess() override;
     void onFailureRaise() override;
@@ -3,7 +3,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/GunzipFileWork.h"
+#include "main/Application.h"
+#include "util/Compression.h"
 #include "util/Fs.h"
+#include "util/Logging.h"
 
 namespace stellar
 {
@@ -11,8 +14,7 @@ namespace stellar
 GunzipFileWork::GunzipFileWork(Application& app, WorkParent& parent,
                                std::string const& filenameGz, bool keepExisting,
                                size_t maxRetries)
-    : RunCommandWork(app, parent, std::string("gunzip-file ") + filenameGz,
-                     maxRetries)
+    : Work(app, parent, std::string("gunzip-file ") + filenameGz, maxRetries)
     , mFilenameGz(filenameGz)
     , mKeepExisting(keepExisting)
 {
@@ -24,16 +26,38 @@ GunzipFileWork::~GunzipFileWork()
     clearChildren();
 }
 
-void
-GunzipFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+Work::ResourceClass
+GunzipFileWork::getResourceClass() const
+{
+    return RESOURCE_DISK;
+}
+
+bool
+GunzipFileWork::runsOnWorker() const
+{
+    return true;
+}
+
+Work::CompleteResult
+GunzipFileWork::onWorkerRun()
 {
-    cmdLine = "gzip -d ";
-    if (mKeepExisting)
+    std::string filenameNoGz = mFilenameGz.substr(0, mFilenameGz.size() - 3);
+    try
+    {
+        decompressFile(mFilenameGz, filenameNoGz, CompressionFormat::GZIP);
+        if (!mKeepExisting)
+        {
+            std::remove(mFilenameGz.c_str());
+        }
+        return WORK_COMPLETE_OK;
+    }
+    catch (std::runtime_error& e)
     {
-        cmdLine += "-c ";
-        outFile = mFilenameGz.substr(0, mFilenameGz.size() - 3);
+        CLOG(WARNING, "History")
+            << "FAILED decompressing " << mFilenameGz << ": " << e.what();
+        std::remove(filenameNoGz.c_str());
+        return WORK_COMPLETE_FAILURE;
     }
-    cmdLine += mFilenameGz;
 }
 
 void
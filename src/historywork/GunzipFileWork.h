@@ -4,22 +4,27 @@
 
 #pragma once
 
-#include "historywork/RunCommandWork.h"
+#include "work/Work.h"
 
 namespace stellar
 {
 
-class GunzipFileWork : public RunCommandWork
+// Decompresses `filenameGz` next to itself on a worker thread, in-process
+// (see util/Compression.h). Unless `keepExisting` is set the compressed file
+// is removed afterwards, as `gzip -d` would.
+class GunzipFileWork : public Work
 {
     std::string mFilenameGz;
     bool mKeepExisting;
-    void getCommand(std::string& cmdLine, std::string& outFile) override;
 
   public:
     GunzipFileWork(Application& app, WorkParent& parent,
                    std::string const& filenameGz, bool keepExisting = false,
                    size_t maxRetries = Work::RETRY_NEVER);
     ~GunzipFileWork();
+    ResourceClass getResourceClass() const override;
+    bool runsOnWorker() const override;
+    CompleteResult onWorkerRun() override;
     void onReset() override;
 };
 }
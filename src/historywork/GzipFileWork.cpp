@@ -3,18 +3,24 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/GzipFileWork.h"
+#include "main/Application.h"
+#include "util/Compression.h"
 #include "util/Fs.h"
+#include "util/Logging.h"
 
 namespace stellar
 {
 
 GzipFileWork::GzipFileWork(Application& app, WorkParent& parent,
-                           std::string const& filenameNoGz, bool keepExisting)
-    : RunCommandWork(app, parent, std::string("gzip-file ") + filenameNoGz)
+                           std::string const& filenameNoGz, bool keepExisting,
+                           std::string const& filenameGz)
+    : Work(app, parent, std::string("gzip-file ") + filenameNoGz)
     , mFilenameNoGz(filenameNoGz)
+    , mFilenameGz(filenameGz.empty() ? filenameNoGz + ".gz" : filenameGz)
     , mKeepExisting(keepExisting)
 {
     fs::checkNoGzipSuffix(mFilenameNoGz);
+    fs::checkGzipSuffix(mFilenameGz);
 }
 
 GzipFileWork::~GzipFileWork()
@@ -22,22 +28,41 @@ GzipFileWork::~GzipFileWork()
     clearChildren();
 }
 
+Work::ResourceClass
+GzipFileWork::getResourceClass() const
+{
+    return RESOURCE_DISK;
+}
+
 void
 GzipFileWork::onReset()
 {
-    std::string filenameGz = mFilenameNoGz + ".gz";
-    std::remove(filenameGz.c_str());
+    std::remove(mFilenameGz.c_str());
 }
 
-void
-GzipFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+bool
+GzipFileWork::runsOnWorker() const
 {
-    cmdLine = "gzip ";
-    if (mKeepExisting)
+    return true;
+}
+
+Work::CompleteResult
+GzipFileWork::onWorkerRun()
+{
+    try
+    {
+        compressFile(mFilenameNoGz, mFilenameGz, CompressionFormat::GZIP);
+        if (!mKeepExisting)
+        {
+            std::remove(mFilenameNoGz.c_str());
+        }
+        return WORK_COMPLETE_OK;
+    }
+    catch (std::runtime_error& e)
     {
-        cmdLine += "-c ";
-        outFile = mFilenameNoGz + ".gz";
+        CLOG(WARNING, "History")
+            << "FAILED compressing " << mFilenameNoGz << ": " << e.what();
+        return WORK_COMPLETE_FAILURE;
     }
-    cmdLine += mFilenameNoGz;
 }
 }
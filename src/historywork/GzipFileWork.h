@@ -4,21 +4,28 @@
 
 #pragma once
 
-#include "historywork/RunCommandWork.h"
+#include "work/Work.h"
 
 namespace stellar
 {
 
-class GzipFileWork : public RunCommandWork
+// Compresses a file to `filenameNoGz`.gz, or to `filenameGz` if given, on a
+// worker thread, in-process (see util/Compression.h). Unless `keepExisting`
+// is set the uncompressed file is removed afterwards, as `gzip` would.
+class GzipFileWork : public Work
 {
     std::string mFilenameNoGz;
+    std::string mFilenameGz;
     bool mKeepExisting;
-    void getCommand(std::string& cmdLine, std::string& outFile) override;
 
   public:
     GzipFileWork(Application& app, WorkParent& parent,
-                 std::string const& filenameNoGz, bool keepExisting = false);
+                 std::string const& filenameNoGz, bool keepExisting = false,
+                 std::string const& filenameGz = "");
     ~GzipFileWork();
+    ResourceClass getResourceClass() const override;
+    bool runsOnWorker() const override;
+    CompleteResult onWorkerRun() override;
     void onReset() override;
 };
 }
@@ -24,6 +24,12 @@ MakeRemoteDirWork::~MakeRemoteDirWork()
     clearChildren();
 }
 
+Work::ResourceClass
+MakeRemoteDirWork::getResourceClass() const
+{
+    return RESOURCE_NETWORK;
+}
+
 void
 MakeRemoteDirWork::getCommand(std::string& cmdLine, std::string& outFile)
 {
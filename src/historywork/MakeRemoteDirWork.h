@@ -22,6 +22,7 @@ class MakeRemoteDirWork : public RunCommandWork
                       std::string const& dir,
                       std::shared_ptr<HistoryArchive> archive);
     ~MakeRemoteDirWork();
+    ResourceClass getResourceClass() const override;
 
     Work::State onSuccess() override;
     void onFailureRaise() override;
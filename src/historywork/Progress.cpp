@@ -6,6 +6,7 @@
 #include "history/HistoryManager.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include <medida/meter.h>
 
 namespace stellar
 {
@@ -36,4 +37,38 @@ fmtProgress(Application& app, std::string const& task, uint32_t first,
     auto pct = (100 * done) / total;
     return fmt::format("{:s} {:d}/{:d} ({:d}%)", task, done, total, pct);
 }
+
+std::string
+fmtRate(medida::Meter& meter, std::string const& unit)
+{
+    auto rate = meter.one_minute_rate();
+    std::string prefix;
+    for (auto p : {"k", "M", "G"})
+    {
+        if (rate < 1000.0)
+        {
+            break;
+        }
+        rate /= 1000.0;
+        prefix = p;
+    }
+    return fmt::format("{:.1f} {:s}{:s}/s", rate, prefix, unit);
+}
+
+std::string
+fmtETA(medida::Meter& meter, uint64_t remaining)
+{
+    auto rate = meter.one_minute_rate();
+    if (remaining == 0)
+    {
+        return "ETA 0:00:00";
+    }
+    if (rate <= 0.0)
+    {
+        return "ETA unknown";
+    }
+    auto secs = static_cast<uint64_t>(remaining / rate);
+    return fmt::format("ETA {:d}:{:02d}:{:02d}", secs / 3600, (secs / 60) % 60,
+                       secs % 60);
+}
 }
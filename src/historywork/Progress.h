@@ -4,6 +4,11 @@
 
 #include <string>
 
+namespace medida
+{
+class Meter;
+}
+
 namespace stellar
 {
 
@@ -11,4 +16,11 @@ class Application;
 
 std::string fmtProgress(Application& app, std::string const& task,
                         uint32_t first, uint32_t last, uint32_t curr);
+
+// One minute rate of `meter`, counting `unit`s, eg. "3.2 Mbyte/s".
+std::string fmtRate(medida::Meter& meter, std::string const& unit);
+
+// Time left to process `remaining` events at the one minute rate of `meter`,
+// eg. "ETA 1:04:09", or "ETA unknown" while the meter has no rate yet.
+std::string fmtETA(medida::Meter& meter, uint64_t remaining);
 }
@@ -6,6 +6,9 @@
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
 #include "history/StateSnapshot.h"
+#include "historywork/GetHistoryArchiveStateWork.h"
+#include "historywork/GzipFileWork.h"
+#include "historywork/PutHistoryArchiveStateWork.h"
 #include "historywork/PutSnapshotFilesWork.h"
 #include "historywork/ResolveSnapshotWork.h"
 #include "historywork/WriteSnapshotWork.h"
@@ -13,6 +16,8 @@
 #include "main/Application.h"
 #include "util/Logging.h"
 
+#include <set>
+
 namespace stellar
 {
 
@@ -35,19 +40,36 @@ PublishWork::getStatus() const
 {
     if (mState == WORK_PENDING)
     {
-        if (mResolveSnapshotWork)
+        // the latest phase started is the one in progress
+        if (mPutStatesWork)
         {
-            return mResolveSnapshotWork->getStatus();
+            return mPutStatesWork->getStatus();
+        }
+        else if (mUpdateArchivesWork)
+        {
+            return mUpdateArchivesWork->getStatus();
+        }
+        else if (mCompressFilesWork)
+        {
+            return mCompressFilesWork->getStatus();
+        }
+        else if (mGetRemoteStatesWork)
+        {
+            return mGetRemoteStatesWork->getStatus();
         }
         else if (mWriteSnapshotWork)
         {
             return mWriteSnapshotWork->getStatus();
         }
-        else if (mUpdateArchivesWork)
+        else if (mResolveSnapshotWork)
         {
-            return mUpdateArchivesWork->getStatus();
+            return mResolveSnapshotWork->getStatus();
         }
     }
+    else if (mWaitingForTurn)
+    {
+        return "Awaiting older checkpoints";
+    }
     return Work::getStatus();
 }
 
@@ -58,7 +80,40 @@ PublishWork::onReset()
 
     mResolveSnapshotWork.reset();
     mWriteSnapshotWork.reset();
+    mRemoteStates.clear();
+    mGetRemoteStatesWork.reset();
+    mCompressFilesWork.reset();
     mUpdateArchivesWork.reset();
+    mWaitingForTurn = false;
+    mPutStatesWork.reset();
+}
+
+bool
+PublishWork::isOldestQueued() const
+{
+    return mSnapshot->mLocalState.currentLedger ==
+           mApp.getHistoryManager().getMinLedgerQueuedToPublish();
+}
+
+void
+PublishWork::onRun()
+{
+    if (mWaitingForTurn)
+    {
+        // run again by checkTurn
+        return;
+    }
+    Work::onRun();
+}
+
+void
+PublishWork::checkTurn()
+{
+    if (mWaitingForTurn && getState() == WORK_RUNNING)
+    {
+        mWaitingForTurn = false;
+        scheduleRun();
+    }
 }
 
 Work::State
@@ -78,15 +133,68 @@ PublishWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 3: update archives
+    auto archives =
+        mApp.getHistoryArchiveManager().getWritableHistoryArchives();
+
+    // Phase 3: fetch the states of all archives
+    if (!mGetRemoteStatesWork)
+    {
+        mGetRemoteStatesWork = addWork<Work>("get-archive-states");
+        for (auto const& archive : archives)
+        {
+            mGetRemoteStatesWork->addWork<GetHistoryArchiveStateWork>(
+                "get-history-archive-state-" + archive->getName(),
+                mRemoteStates[archive->getName()], 0, archive);
+        }
+        return WORK_PENDING;
+    }
+
+    // Phase 4: compress, once, every file some archive needs
+    if (!mCompressFilesWork)
+    {
+        mCompressFilesWork = addWork<Work>("compress-files");
+        std::set<std::string> files;
+        for (auto const& state : mRemoteStates)
+        {
+            for (auto const& f : mSnapshot->differingHASFiles(state.second))
+            {
+                if (files.insert(f->localPath_gz()).second)
+                {
+                    mCompressFilesWork->addWork<GzipFileWork>(
+                        f->localPath_nogz(), true, f->localPath_gz());
+                }
+            }
+        }
+        return WORK_PENDING;
+    }
+
+    // Phase 5: put the files to all archives concurrently, each retrying on
+    // its own
     if (!mUpdateArchivesWork)
     {
         mUpdateArchivesWork = addWork<Work>("update-archives");
-        for (auto& writableArchive :
-             mApp.getHistoryArchiveManager().getWritableHistoryArchives())
+        for (auto const& archive : archives)
+        {
+            mUpdateArchivesWork->addWork<PutSnapshotFilesWork>(
+                archive, mSnapshot, mRemoteStates[archive->getName()], false);
+        }
+        return WORK_PENDING;
+    }
+
+    // Phase 6: once the checkpoints before this one are published, update
+    // the states of all archives
+    if (!mPutStatesWork)
+    {
+        if (!isOldestQueued())
+        {
+            mWaitingForTurn = true;
+            return WORK_RUNNING;
+        }
+        mPutStatesWork = addWork<Work>("put-archive-states");
+        for (auto const& archive : archives)
         {
-            mUpdateArchivesWork->addWork<PutSnapshotFilesWork>(writableArchive,
-                                                               mSnapshot);
+            mPutStatesWork->addWork<PutHistoryArchiveStateWork>(
+                mSnapshot->mLocalState, archive);
         }
         return WORK_PENDING;
     }
@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include "history/HistoryArchive.h"
 #include "work/Work.h"
 
+#include <map>
+
 namespace stellar
 {
 
@@ -18,7 +21,17 @@ class PublishWork : public Work
 
     std::shared_ptr<Work> mResolveSnapshotWork;
     std::shared_ptr<Work> mWriteSnapshotWork;
+    // states of the writable archives, by name
+    std::map<std::string, HistoryArchiveState> mRemoteStates;
+    std::shared_ptr<Work> mGetRemoteStatesWork;
+    std::shared_ptr<Work> mCompressFilesWork;
     std::shared_ptr<Work> mUpdateArchivesWork;
+    // set while the files are up and an older checkpoint is still being
+    // published, see checkTurn
+    bool mWaitingForTurn{false};
+    std::shared_ptr<Work> mPutStatesWork;
+
+    bool isOldestQueued() const;
 
   public:
     PublishWork(Application& app, WorkParent& parent,
@@ -26,7 +39,14 @@ class PublishWork : public Work
     ~PublishWork();
     std::string getStatus() const override;
     void onReset() override;
+    void onRun() override;
     void onFailureRaise() override;
     Work::State onSuccess() override;
+
+    // Publishes of several checkpoints run at once, but each archive's state
+    // names the checkpoints in order: once its files are up, a publish waits
+    // for its checkpoint to be the oldest in the publish queue before putting
+    // the states. The HistoryManager calls this when the oldest changes.
+    void checkTurn();
 };
 }
@@ -27,6 +27,12 @@ PutRemoteFileWork::~PutRemoteFileWork()
     clearChildren();
 }
 
+Work::ResourceClass
+PutRemoteFileWork::getResourceClass() const
+{
+    return RESOURCE_NETWORK;
+}
+
 void
 PutRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
 {
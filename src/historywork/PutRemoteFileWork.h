@@ -23,6 +23,7 @@ class PutRemoteFileWork : public RunCommandWork
                       std::string const& remote, std::string const& local,
                       std::shared_ptr<HistoryArchive> archive);
     ~PutRemoteFileWork();
+    ResourceClass getResourceClass() const override;
 
     Work::State onSuccess() override;
     void onFailureRaise() override;
@@ -3,7 +3,6 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/PutSnapshotFilesWork.h"
-#include "bucket/BucketManager.h"
 #include "history/FileTransferInfo.h"
 #include "history/StateSnapshot.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
@@ -19,10 +18,13 @@ namespace stellar
 PutSnapshotFilesWork::PutSnapshotFilesWork(
     Application& app, WorkParent& parent,
     std::shared_ptr<HistoryArchive> archive,
-    std::shared_ptr<StateSnapshot> snapshot)
+    std::shared_ptr<StateSnapshot> snapshot,
+    HistoryArchiveState const& remoteState, bool putState)
     : Work(app, parent, "put-snapshot-files-" + archive->getName())
     , mArchive(archive)
     , mSnapshot(snapshot)
+    , mRemoteState(remoteState)
+    , mPutState(putState)
 {
 }
 
@@ -44,8 +46,8 @@ PutSnapshotFilesWork::onReset()
 Work::State
 PutSnapshotFilesWork::onSuccess()
 {
-    // Phase 1: fetch remote history archive state
-    if (!mGetHistoryArchiveStateWork)
+    // Phase 1: fetch remote history archive state, when retrying
+    if (!mRemoteStateKnown && !mGetHistoryArchiveStateWork)
     {
         mGetHistoryArchiveStateWork = addWork<GetHistoryArchiveStateWork>(
             "get-history-archive-state", mRemoteState, 0, mArchive);
@@ -55,38 +57,26 @@ PutSnapshotFilesWork::onSuccess()
     // Phase 2: put all requisite data files
     if (!mPutFilesWork)
     {
+        mRemoteStateKnown = true;
         mPutFilesWork = addWork<Work>("put-files");
 
-        std::vector<std::shared_ptr<FileTransferInfo>> files = {
-            mSnapshot->mLedgerSnapFile, mSnapshot->mTransactionSnapFile,
-            mSnapshot->mTransactionResultSnapFile,
-            mSnapshot->mSCPHistorySnapFile};
-
-        std::vector<std::string> bucketsToSend =
-            mSnapshot->mLocalState.differingBuckets(mRemoteState);
-
-        for (auto const& hash : bucketsToSend)
-        {
-            auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
-            assert(b);
-            files.push_back(std::make_shared<FileTransferInfo>(*b));
-        }
-        for (auto f : files)
+        for (auto const& f : mSnapshot->differingHASFiles(mRemoteState))
         {
-            if (f && fs::exists(f->localPath_nogz()))
+            auto put = mPutFilesWork->addWork<PutRemoteFileWork>(
+                f->localPath_gz(), f->remoteName(), mArchive);
+            auto mkdir =
+                put->addWork<MakeRemoteDirWork>(f->remoteDir(), mArchive);
+            if (!fs::exists(f->localPath_gz()))
             {
-                auto put = mPutFilesWork->addWork<PutRemoteFileWork>(
-                    f->localPath_gz(), f->remoteName(), mArchive);
-                auto mkdir =
-                    put->addWork<MakeRemoteDirWork>(f->remoteDir(), mArchive);
-                mkdir->addWork<GzipFileWork>(f->localPath_nogz(), true);
+                mkdir->addWork<GzipFileWork>(f->localPath_nogz(), true,
+                                             f->localPath_gz());
             }
         }
         return WORK_PENDING;
     }
 
     // Phase 3: update remote history archive state
-    if (!mPutHistoryArchiveStateWork)
+    if (mPutState && !mPutHistoryArchiveStateWork)
     {
         mPutHistoryArchiveStateWork = addWork<PutHistoryArchiveStateWork>(
             mSnapshot->mLocalState, mArchive);
@@ -95,4 +85,12 @@ PutSnapshotFilesWork::onSuccess()
 
     return WORK_SUCCESS;
 }
+
+void
+PutSnapshotFilesWork::onFailureRetry()
+{
+    // the archive may have changed in the meantime
+    mRemoteStateKnown = false;
+    Work::onFailureRetry();
+}
 }
@@ -12,11 +12,20 @@ namespace stellar
 
 struct StateSnapshot;
 
+/**
+ * Sends the files of a snapshot that one archive lacks, then its history
+ * archive state unless `putState` is false. PublishWork runs one per writable
+ * archive, concurrently, after fetching their states and compressing the
+ * files they need once for all of them: only retries fetch the state again,
+ * and compress the files they need that are not compressed already.
+ */
 class PutSnapshotFilesWork : public Work
 {
     std::shared_ptr<HistoryArchive> mArchive;
     std::shared_ptr<StateSnapshot> mSnapshot;
     HistoryArchiveState mRemoteState;
+    bool mRemoteStateKnown{true};
+    bool mPutState;
 
     std::shared_ptr<Work> mGetHistoryArchiveStateWork;
     std::shared_ptr<Work> mPutFilesWork;
@@ -25,9 +34,12 @@ class PutSnapshotFilesWork : public Work
   public:
     PutSnapshotFilesWork(Application& app, WorkParent& parent,
                          std::shared_ptr<HistoryArchive> archive,
-                         std::shared_ptr<StateSnapshot> snapshot);
+                         std::shared_ptr<StateSnapshot> snapshot,
+                         HistoryArchiveState const& remoteState,
+                         bool putState = true);
     ~PutSnapshotFilesWork();
     void onReset() override;
     Work::State onSuccess() override;
+    void onFailureRetry() override;
 };
 }
@@ -6,9 +6,11 @@
 #include "bucket/BucketManager.h"
 #include "history/FileTransferInfo.h"
 #include "history/HistoryManager.h"
-#include "historywork/GetAndUnzipRemoteFileWork.h"
+#include "historywork/GetAndVerifyBucketWork.h"
 #include "historywork/VerifyBucketWork.h"
 #include "main/Application.h"
+#include "util/types.h"
+#include <set>
 
 namespace stellar
 {
@@ -42,10 +44,26 @@ RepairMissingBucketsWork::onReset()
     for (auto const& hash : bucketsToFetch)
     {
         FileTransferInfo ft(*mDownloadDir, HISTORY_FILE_TYPE_BUCKET, hash);
-        // Each bucket gets its own work-chain of download->gunzip->verify
-        auto verify = addWork<VerifyBucketWork>(mBuckets, ft.localPath_nogz(),
-                                                hexToBin256(hash));
-        verify->addWork<GetAndUnzipRemoteFileWork>(ft);
+        // Each bucket is downloaded, then unzipped and verified in one pass
+        addWork<GetAndVerifyBucketWork>(mBuckets, ft, hexToBin256(hash));
+    }
+
+    // the buckets we do have are hashed before being used again, unless
+    // known to be good
+    auto allBuckets = mLocalState.allBuckets();
+    std::set<std::string> localBuckets(allBuckets.begin(), allBuckets.end());
+    for (auto const& hash : localBuckets)
+    {
+        auto h = hexToBin256(hash);
+        if (isZero(h) || bucketsToFetch.count(hash) != 0)
+        {
+            continue;
+        }
+        auto b = mApp.getBucketManager().getBucketByHash(h);
+        if (b && !mApp.getBucketManager().isBucketFileVerified(h))
+        {
+            addWork<VerifyBucketWork>(mBuckets, b);
+        }
     }
 }
 
@@ -3,6 +3,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/VerifyBucketWork.h"
+#include "bucket/Bucket.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
@@ -20,18 +21,19 @@ namespace stellar
 VerifyBucketWork::VerifyBucketWork(
     Application& app, WorkParent& parent,
     std::map<std::string, std::shared_ptr<Bucket>>& buckets,
-    std::string const& bucketFile, uint256 const& hash)
-    : Work(app, parent, std::string("verify-bucket-hash ") + bucketFile,
+    std::shared_ptr<Bucket> bucket)
+    : Work(app, parent,
+           std::string("verify-bucket-hash ") + bucket->getFilename(),
            RETRY_NEVER)
     , mBuckets(buckets)
-    , mBucketFile(bucketFile)
-    , mHash(hash)
+    , mBucket(bucket)
+    , mBucketFile(bucket->getFilename())
+    , mHash(bucket->getHash())
     , mVerifyBucketSuccess{app.getMetrics().NewMeter(
           {"history", "verify-bucket", "success"}, "event")}
     , mVerifyBucketFailure{app.getMetrics().NewMeter(
           {"history", "verify-bucket", "failure"}, "event")}
 {
-    fs::checkNoGzipSuffix(mBucketFile);
 }
 
 VerifyBucketWork::~VerifyBucketWork()
@@ -39,57 +41,53 @@ VerifyBucketWork::~VerifyBucketWork()
     clearChildren();
 }
 
-void
-VerifyBucketWork::onStart()
+Work::ResourceClass
+VerifyBucketWork::getResourceClass() const
 {
-    std::string filename = mBucketFile;
-    uint256 hash = mHash;
-    Application& app = this->mApp;
-    auto handler = callComplete();
-    app.getWorkerIOService().post([&app, filename, handler, hash]() {
-        auto hasher = SHA256::create();
-        asio::error_code ec;
-        char buf[4096];
-        {
-            // ensure that the stream gets its own scope to avoid race with
-            // main thread
-            std::ifstream in(filename, std::ifstream::binary);
-            while (in)
-            {
-                in.read(buf, sizeof(buf));
-                hasher->add(ByteSlice(buf, in.gcount()));
-            }
-            uint256 vHash = hasher->finish();
-            if (vHash == hash)
-            {
-                CLOG(DEBUG, "History") << "Verified hash (" << hexAbbrev(hash)
-                                       << ") for " << filename;
-            }
-            else
-            {
-                CLOG(WARNING, "History")
-                    << "FAILED verifying hash for " << filename;
-                CLOG(WARNING, "History") << "expected hash: " << binToHex(hash);
-                CLOG(WARNING, "History")
-                    << "computed hash: " << binToHex(vHash);
-                ec = std::make_error_code(std::errc::io_error);
-            }
-        }
-        app.getClock().getIOService().post([ec, handler]() { handler(ec); });
-    });
+    return RESOURCE_NONE;
 }
 
-void
-VerifyBucketWork::onRun()
+bool
+VerifyBucketWork::runsOnWorker() const
+{
+    return true;
+}
+
+Work::CompleteResult
+VerifyBucketWork::onWorkerRun()
 {
-    // Do nothing: we spawned the verifier in onStart().
+    auto hasher = SHA256::create();
+    char buf[0x10000];
+    std::ifstream in(mBucketFile, std::ifstream::binary);
+    while (in)
+    {
+        if (isCancelled())
+        {
+            return WORK_COMPLETE_FAILURE;
+        }
+        in.read(buf, sizeof(buf));
+        hasher->add(ByteSlice(buf, in.gcount()));
+    }
+    uint256 vHash = hasher->finish();
+    if (vHash == mHash)
+    {
+        CLOG(DEBUG, "History") << "Verified hash (" << hexAbbrev(mHash)
+                               << ") for " << mBucketFile;
+        return WORK_COMPLETE_OK;
+    }
+
+    CLOG(ERROR, "History") << "FAILED verifying hash for " << mBucketFile
+                           << ", the file is corrupt and must be removed";
+    CLOG(ERROR, "History") << "expected hash: " << binToHex(mHash);
+    CLOG(ERROR, "History") << "computed hash: " << binToHex(vHash);
+    return WORK_COMPLETE_FAILURE;
 }
 
 Work::State
 VerifyBucketWork::onSuccess()
 {
-    auto b = mApp.getBucketManager().adoptFileAsBucket(mBucketFile, mHash);
-    mBuckets[binToHex(mHash)] = b;
+    mApp.getBucketManager().recordBucketFileVerified(mHash);
+    mBuckets[binToHex(mHash)] = mBucket;
     mVerifyBucketSuccess.Mark();
     return WORK_SUCCESS;
 }
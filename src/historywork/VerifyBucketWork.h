@@ -17,9 +17,18 @@ namespace stellar
 
 class Bucket;
 
+// Hashes the file of a bucket the BucketManager already has, on a worker
+// thread, before it is trusted by catchup or repair (see
+// BucketManager::isBucketFileVerified). On success the bucket is recorded as
+// verified and put in `buckets`; a file that does not match its hash fails
+// the work, as the bucket directory then needs fixing by hand.
+//
+// It holds no resource slot: the worker threads bound how many run at once,
+// so that verifications queued together use every core.
 class VerifyBucketWork : public Work
 {
     std::map<std::string, std::shared_ptr<Bucket>>& mBuckets;
+    std::shared_ptr<Bucket> mBucket;
     std::string mBucketFile;
     uint256 mHash;
 
@@ -29,10 +38,11 @@ class VerifyBucketWork : public Work
   public:
     VerifyBucketWork(Application& app, WorkParent& parent,
                      std::map<std::string, std::shared_ptr<Bucket>>& buckets,
-                     std::string const& bucketFile, uint256 const& hash);
+                     std::shared_ptr<Bucket> bucket);
     ~VerifyBucketWork();
-    void onRun() override;
-    void onStart() override;
+    ResourceClass getResourceClass() const override;
+    bool runsOnWorker() const override;
+    CompleteResult onWorkerRun() override;
     Work::State onSuccess() override;
     void onFailureRetry() override;
     void onFailureRaise() override;
@@ -9,6 +9,7 @@
 #include "ledger/LedgerHeaderFrame.h"
 #include "main/Application.h"
 #include "util/XDRStream.h"
+#include "util/WorkerLanes.h"
 
 namespace stellar
 {
@@ -44,7 +45,7 @@ WriteSnapshotWork::onStart()
     // otherwise run on main thread.
     if (mApp.getDatabase().canUsePool())
     {
-        mApp.getWorkerIOService().post(work);
+        mApp.getWorkerLanes().post(WorkerLane::BACKGROUND, work);
     }
     else
     {
@@ -35,6 +35,25 @@ std::string
 AccountSubEntriesCountIsValid::checkOnOperationApply(
     Operation const& operation, OperationResult const& result,
     LedgerDelta const& delta)
+{
+    return check(delta);
+}
+
+bool
+AccountSubEntriesCountIsValid::hasLedgerCloseCheck() const
+{
+    // the checks add up over the changes of many operations
+    return true;
+}
+
+std::string
+AccountSubEntriesCountIsValid::checkOnLedgerClose(LedgerDelta const& opsDelta)
+{
+    return check(opsDelta);
+}
+
+std::string
+AccountSubEntriesCountIsValid::check(LedgerDelta const& delta) const
 {
     std::unordered_map<AccountID, SubEntriesChange> subEntriesChange;
     countChangedSubEntries(subEntriesChange, delta.added().begin(),
@@ -31,7 +31,12 @@ class AccountSubEntriesCountIsValid : public Invariant
                           OperationResult const& result,
                           LedgerDelta const& delta) override;
 
+    virtual bool hasLedgerCloseCheck() const override;
+
+    virtual std::string checkOnLedgerClose(LedgerDelta const& opsDelta) override;
+
   private:
+    std::string check(LedgerDelta const& delta) const;
     struct SubEntriesChange
     {
         int32_t numSubEntries;
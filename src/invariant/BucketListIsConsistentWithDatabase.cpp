@@ -4,7 +4,7 @@
 
 #include "invariant/BucketListIsConsistentWithDatabase.h"
 #include "bucket/Bucket.h"
-#include "bucket/BucketInputIterator.h"
+#include "bucket/BucketDBChecker.h"
 #include "crypto/Hex.h"
 #include "database/Database.h"
 #include "invariant/InvariantManager.h"
@@ -15,6 +15,7 @@
 #include "ledger/TrustFrame.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "medida/metrics_registry.h"
 #include "xdrpp/printer.h"
 
 namespace stellar
@@ -24,13 +25,12 @@ std::shared_ptr<Invariant>
 BucketListIsConsistentWithDatabase::registerInvariant(Application& app)
 {
     return app.getInvariantManager()
-        .registerInvariant<BucketListIsConsistentWithDatabase>(
-            app.getDatabase());
+        .registerInvariant<BucketListIsConsistentWithDatabase>(app);
 }
 
 BucketListIsConsistentWithDatabase::BucketListIsConsistentWithDatabase(
-    Database& db)
-    : Invariant(true), mDb{db}
+    Application& app)
+    : Invariant(true), mApp{app}
 {
 }
 
@@ -45,104 +45,42 @@ BucketListIsConsistentWithDatabase::checkOnBucketApply(
     std::shared_ptr<Bucket const> bucket, uint32_t oldestLedger,
     uint32_t newestLedger)
 {
-    uint64_t nAccounts = 0, nTrustLines = 0, nOffers = 0, nData = 0;
-    bool hasPreviousEntry = false;
-    BucketEntry previousEntry;
-    for (BucketInputIterator iter(bucket); iter; ++iter)
+    auto& meter = mApp.getMetrics().NewMeter(
+        {"invariant", "bucket-db-consistency", "entry"}, "entry");
+    auto result = BucketDBChecker::check(mApp, bucket, oldestLedger,
+                                         newestLedger, meter);
+    if (!result.mError.empty())
     {
-        auto const& e = *iter;
-        if (hasPreviousEntry && !BucketEntryIdCmp{}(previousEntry, e))
-        {
-            std::string s = "Bucket has out of order entries: ";
-            s += xdr::xdr_to_string(previousEntry, "previous");
-            s += xdr::xdr_to_string(e, "current");
-            return s;
-        }
-        previousEntry = e;
-        hasPreviousEntry = true;
-
-        if (e.type() == LIVEENTRY)
-        {
-            if (e.liveEntry().lastModifiedLedgerSeq < oldestLedger)
-            {
-                auto s = fmt::format("lastModifiedLedgerSeq beneath lower"
-                                     " bound for this bucket ({} < {}): ",
-                                     e.liveEntry().lastModifiedLedgerSeq,
-                                     oldestLedger);
-                s += xdr::xdr_to_string(e.liveEntry(), "live");
-                return s;
-            }
-            if (e.liveEntry().lastModifiedLedgerSeq > newestLedger)
-            {
-                auto s = fmt::format("lastModifiedLedgerSeq above upper"
-                                     " bound for this bucket ({} > {}): ",
-                                     e.liveEntry().lastModifiedLedgerSeq,
-                                     newestLedger);
-                s += xdr::xdr_to_string(e.liveEntry(), "live");
-                return s;
-            }
-
-            switch (e.liveEntry().data.type())
-            {
-            case ACCOUNT:
-                ++nAccounts;
-                break;
-            case TRUSTLINE:
-                ++nTrustLines;
-                break;
-            case OFFER:
-                ++nOffers;
-                break;
-            case DATA:
-                ++nData;
-                break;
-            default:
-                abort();
-            }
-            auto s = EntryFrame::checkAgainstDatabase(e.liveEntry(), mDb);
-            if (!s.empty())
-            {
-                return s;
-            }
-        }
-        else if (e.type() == DEADENTRY)
-        {
-            if (EntryFrame::exists(mDb, e.deadEntry()))
-            {
-                auto fromDb = EntryFrame::storeLoad(e.deadEntry(), mDb);
-                std::string s = "Entry with type DEADENTRY found in database ";
-                s += xdr::xdr_to_string(fromDb->mEntry, "db");
-                return s;
-            }
-        }
+        return result.mError;
     }
 
-    auto& sess = mDb.getSession();
+    auto& sess = mApp.getDatabase().getSession();
     std::string countFormat = "Incorrect {} count: Bucket = {} Database = {}";
     uint64_t nAccountsInDb =
         AccountFrame::countObjects(sess, {oldestLedger, newestLedger});
-    if (nAccountsInDb != nAccounts)
+    if (nAccountsInDb != result.mAccounts)
     {
-        return fmt::format(countFormat, "Account", nAccounts, nAccountsInDb);
+        return fmt::format(countFormat, "Account", result.mAccounts,
+                           nAccountsInDb);
     }
     uint64_t nTrustLinesInDb =
         TrustFrame::countObjects(sess, {oldestLedger, newestLedger});
-    if (nTrustLinesInDb != nTrustLines)
+    if (nTrustLinesInDb != result.mTrustLines)
     {
-        return fmt::format(countFormat, "TrustLine", nTrustLines,
+        return fmt::format(countFormat, "TrustLine", result.mTrustLines,
                            nTrustLinesInDb);
     }
     uint64_t nOffersInDb =
         OfferFrame::countObjects(sess, {oldestLedger, newestLedger});
-    if (nOffersInDb != nOffers)
+    if (nOffersInDb != result.mOffers)
     {
-        return fmt::format(countFormat, "Offer", nOffers, nOffersInDb);
+        return fmt::format(countFormat, "Offer", result.mOffers, nOffersInDb);
     }
     uint64_t nDataInDb =
         DataFrame::countObjects(sess, {oldestLedger, newestLedger});
-    if (nDataInDb != nData)
+    if (nDataInDb != result.mData)
     {
-        return fmt::format(countFormat, "Data", nData, nDataInDb);
+        return fmt::format(countFormat, "Data", result.mData, nDataInDb);
     }
     return {};
 }
@@ -10,7 +10,6 @@ namespace stellar
 {
 
 class Application;
-class Database;
 class LedgerDelta;
 
 // This Invariant is used to validate that the BucketList and Database are
@@ -25,13 +24,13 @@ class LedgerDelta;
 // The first two conditions show that every entry in the bucket matches the
 // database, while the third condition shows that the database does not
 // contain any entry in the appropriate ledger range other than those in
-// the bucket.
+// the bucket. The bucket is checked in shards by BucketDBChecker.
 class BucketListIsConsistentWithDatabase : public Invariant
 {
   public:
     static std::shared_ptr<Invariant> registerInvariant(Application& app);
 
-    explicit BucketListIsConsistentWithDatabase(Database& db);
+    explicit BucketListIsConsistentWithDatabase(Application& app);
 
     virtual std::string getName() const override;
 
@@ -40,6 +39,6 @@ class BucketListIsConsistentWithDatabase : public Invariant
                                            uint32_t newestLedger) override;
 
   private:
-    Database& mDb;
+    Application& mApp;
 };
 }
@@ -30,13 +30,25 @@ CacheIsConsistentWithDatabase::getName() const
     return "CacheIsConsistentWithDatabase";
 }
 
+bool
+CacheIsConsistentWithDatabase::canCheckDeferred() const
+{
+    // the database moves on once the operation is applied
+    return false;
+}
+
 std::string
 CacheIsConsistentWithDatabase::checkOnOperationApply(
     Operation const& operation, OperationResult const& result,
     LedgerDelta const& delta)
 {
+    // deferred entries are not in the database yet
     for (auto const& l : delta.getLiveEntries())
     {
+        if (delta.writesDeferred(l.data.type()))
+        {
+            continue;
+        }
         auto s = EntryFrame::checkAgainstDatabase(l, mDb);
         if (!s.empty())
         {
@@ -45,6 +57,10 @@ CacheIsConsistentWithDatabase::checkOnOperationApply(
     }
     for (auto const& d : delta.getDeadEntries())
     {
+        if (delta.writesDeferred(d.type()))
+        {
+            continue;
+        }
         if (EntryFrame::exists(mDb, d))
         {
             return fmt::format(
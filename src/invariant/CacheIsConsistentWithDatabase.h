@@ -31,6 +31,8 @@ class CacheIsConsistentWithDatabase : public Invariant
 
     virtual std::string getName() const override;
 
+    virtual bool canCheckDeferred() const override;
+
     virtual std::string
     checkOnOperationApply(Operation const& operation,
                           OperationResult const& result,
@@ -39,6 +39,15 @@ class Invariant
         return mStrict;
     }
 
+    // False if checkOnOperationApply reads more than its arguments (eg. the
+    // database), in which case it can't be deferred to after the operation is
+    // applied (see InvariantManager::deferInvariant).
+    virtual bool
+    canCheckDeferred() const
+    {
+        return true;
+    }
+
     virtual std::string
     checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                        uint32_t oldestLedger, uint32_t newestLedger)
@@ -53,5 +62,23 @@ class Invariant
     {
         return std::string{};
     }
+
+    // True if checkOnLedgerClose can replace checkOnOperationApply (see
+    // InvariantManager::checkPerLedger).
+    virtual bool
+    hasLedgerCloseCheck() const
+    {
+        return false;
+    }
+
+    // Same as checkOnOperationApply for `opsDelta` holding the changes of all
+    // the operations of the successful transactions of a ledger, merged (each
+    // entry once, with its value before the first of them and after the last
+    // of them). Fees and sequence numbers are not included.
+    virtual std::string
+    checkOnLedgerClose(LedgerDelta const& opsDelta)
+    {
+        return std::string{};
+    }
 };
 }
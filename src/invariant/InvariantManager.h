@@ -44,10 +44,32 @@ class InvariantManager
                                        OperationResult const& opres,
                                        LedgerDelta const& delta) = 0;
 
+    // Called with the changes made by the operations of each successful
+    // transaction, before they are committed, and once the transactions of a
+    // ledger are applied; see checkPerLedger.
+    virtual void addAppliedOperations(LedgerDelta const& opsDelta) = 0;
+    virtual void checkOnLedgerClose() = 0;
+
     virtual void registerInvariant(std::shared_ptr<Invariant> invariant) = 0;
 
     virtual void enableInvariant(std::string const& name) = 0;
 
+    // Check the enabled invariants matching `invPattern` on one operation in
+    // `rate` (1 checks every operation).
+    virtual void setOperationSampleRate(std::string const& invPattern,
+                                        uint32_t rate) = 0;
+
+    // Check the enabled invariants matching `invPattern`, which must not be
+    // strict, on a snapshot of each operation's delta once the ledger being
+    // closed is applied, rather than while applying the operation.
+    virtual void deferInvariant(std::string const& invPattern) = 0;
+
+    // Check the enabled invariants matching `invPattern` once per ledger, on
+    // the merged changes of its operations (see Invariant::checkOnLedgerClose),
+    // rather than on each operation: entries changed by many operations are
+    // only checked once.
+    virtual void checkPerLedger(std::string const& invPattern) = 0;
+
     template <typename T, typename... Args>
     std::shared_ptr<T>
     registerInvariant(Args&&... args)
@@ -13,10 +13,12 @@
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "util/Logging.h"
+#include "util/Timer.h"
 #include "xdrpp/printer.h"
 
 #include "medida/counter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 #include <memory>
 #include <numeric>
@@ -28,11 +30,20 @@ namespace stellar
 std::unique_ptr<InvariantManager>
 InvariantManager::create(Application& app)
 {
-    return std::make_unique<InvariantManagerImpl>(app.getMetrics());
+    return std::make_unique<InvariantManagerImpl>(app);
 }
 
-InvariantManagerImpl::InvariantManagerImpl(medida::MetricsRegistry& registry)
-    : mMetricsRegistry(registry)
+InvariantManagerImpl::InvariantManagerImpl(Application& app)
+    : mApp(app)
+    , mMetricsRegistry(app.getMetrics())
+    , mOperationCheckTimer(
+          app.getMetrics().NewTimer({"invariant", "operation", "check"}))
+    , mLedgerCheckTimer(
+          app.getMetrics().NewTimer({"invariant", "ledger", "check"}))
+{
+}
+
+InvariantManagerImpl::~InvariantManagerImpl()
 {
 }
 
@@ -63,7 +74,7 @@ InvariantManagerImpl::getEnabledInvariants() const
     std::vector<std::string> res;
     for (auto const& p : mEnabled)
     {
-        res.emplace_back(p->getName());
+        res.emplace_back(p.mInvariant->getName());
     }
     return res;
 }
@@ -79,8 +90,9 @@ InvariantManagerImpl::checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
     uint32_t newestLedger = oldestLedger - 1 +
                             (isCurr ? BucketList::sizeOfCurr(ledger, level)
                                     : BucketList::sizeOfSnap(ledger, level));
-    for (auto invariant : mEnabled)
+    for (auto const& enabled : mEnabled)
     {
+        auto invariant = enabled.mInvariant;
         auto result =
             invariant->checkOnBucketApply(bucket, oldestLedger, newestLedger);
         if (result.empty())
@@ -106,19 +118,120 @@ InvariantManagerImpl::checkOnOperationApply(Operation const& operation,
         return;
     }
 
-    for (auto invariant : mEnabled)
+    auto timer = mOperationCheckTimer.TimeScope();
+    std::vector<EnabledInvariant> deferred;
+    for (auto& enabled : mEnabled)
+    {
+        if (enabled.mPerLedger ||
+            enabled.mOperations++ % enabled.mSampleRate != 0)
+        {
+            continue;
+        }
+        if (enabled.mDeferred)
+        {
+            deferred.emplace_back(enabled);
+            continue;
+        }
+        checkOperation(enabled, operation, opres, delta);
+    }
+
+    if (!deferred.empty())
+    {
+        // Runs once the ledger being closed is applied, on a copy as the
+        // delta is committed into its parent before that.
+        std::shared_ptr<LedgerDelta const> snapshot = delta.snapshot();
+        mApp.getClock().getIOService().post(
+            [this, deferred, operation, opres, snapshot]() {
+                for (auto const& enabled : deferred)
+                {
+                    checkOperation(enabled, operation, opres, *snapshot);
+                }
+            });
+    }
+}
+
+void
+InvariantManagerImpl::addAppliedOperations(LedgerDelta const& opsDelta)
+{
+    if (!mHasPerLedger || opsDelta.getHeader().ledgerVersion < 8)
+    {
+        return;
+    }
+
+    // left over from a ledger that failed to close
+    if (mLedgerOpsDelta && mLedgerOpsDelta->getHeader().ledgerSeq !=
+                               opsDelta.getHeader().ledgerSeq)
+    {
+        mLedgerOpsDelta.reset();
+    }
+
+    if (mLedgerOpsDelta)
+    {
+        mLedgerOpsDelta->append(opsDelta);
+    }
+    else
+    {
+        mLedgerOpsDelta = opsDelta.snapshot();
+    }
+}
+
+void
+InvariantManagerImpl::checkOnLedgerClose()
+{
+    if (!mLedgerOpsDelta)
+    {
+        return;
+    }
+    std::unique_ptr<LedgerDelta> opsDelta;
+    std::swap(opsDelta, mLedgerOpsDelta);
+
+    auto ledgerTimer = mLedgerCheckTimer.TimeScope();
+    for (auto const& enabled : mEnabled)
     {
-        auto result = invariant->checkOnOperationApply(operation, opres, delta);
+        if (!enabled.mPerLedger)
+        {
+            continue;
+        }
+        auto invariant = enabled.mInvariant;
+        std::string result;
+        {
+            auto timer = enabled.mOperationCheckTimer->TimeScope();
+            result = invariant->checkOnLedgerClose(*opsDelta);
+        }
         if (result.empty())
         {
             continue;
         }
 
+        auto ledgerSeq = opsDelta->getHeader().ledgerSeq;
         auto message = fmt::format(
-            R"(Invariant "{}" does not hold on operation: {}{}{})",
-            invariant->getName(), result, "\n", xdr::xdr_to_string(operation));
-        onInvariantFailure(invariant, message, delta.getHeader().ledgerSeq);
+            R"(Invariant "{}" does not hold on the operations of ledger {}: {})",
+            invariant->getName(), ledgerSeq, result);
+        onInvariantFailure(invariant, message, ledgerSeq);
+    }
+}
+
+void
+InvariantManagerImpl::checkOperation(EnabledInvariant const& enabled,
+                                     Operation const& operation,
+                                     OperationResult const& opres,
+                                     LedgerDelta const& delta)
+{
+    auto invariant = enabled.mInvariant;
+    std::string result;
+    {
+        auto timer = enabled.mOperationCheckTimer->TimeScope();
+        result = invariant->checkOnOperationApply(operation, opres, delta);
     }
+    if (result.empty())
+    {
+        return;
+    }
+
+    auto message = fmt::format(
+        R"(Invariant "{}" does not hold on operation: {}{}{})",
+        invariant->getName(), result, "\n", xdr::xdr_to_string(operation));
+    onInvariantFailure(invariant, message, delta.getHeader().ledgerSeq);
 }
 
 void
@@ -142,21 +255,7 @@ InvariantManagerImpl::registerInvariant(std::shared_ptr<Invariant> invariant)
 void
 InvariantManagerImpl::enableInvariant(std::string const& invPattern)
 {
-    if (invPattern.empty())
-    {
-        throw std::invalid_argument("Invariant pattern must be non empty");
-    }
-
-    std::regex r;
-    try
-    {
-        r = std::regex(invPattern, std::regex::ECMAScript | std::regex::icase);
-    }
-    catch (std::regex_error& e)
-    {
-        throw std::invalid_argument(fmt::format(
-            "Invalid invariant pattern '{}': {}", invPattern, e.what()));
-    }
+    auto r = makePattern(invPattern);
 
     bool enabledSome = false;
     for (auto const& inv : mInvariants)
@@ -164,11 +263,18 @@ InvariantManagerImpl::enableInvariant(std::string const& invPattern)
         auto const& name = inv.first;
         if (std::regex_match(name, r, std::regex_constants::match_not_null))
         {
-            auto iter = std::find(mEnabled.begin(), mEnabled.end(), inv.second);
+            auto iter = std::find_if(mEnabled.begin(), mEnabled.end(),
+                                     [&inv](EnabledInvariant const& e) {
+                                         return e.mInvariant == inv.second;
+                                     });
             if (iter == mEnabled.end())
             {
                 enabledSome = true;
-                mEnabled.push_back(inv.second);
+                EnabledInvariant enabled;
+                enabled.mInvariant = inv.second;
+                enabled.mOperationCheckTimer = &mMetricsRegistry.NewTimer(
+                    {"invariant", "operation-check", name});
+                mEnabled.push_back(enabled);
                 CLOG(INFO, "Invariant") << "Enabled invariant '" << name << "'";
             }
             else
@@ -201,6 +307,109 @@ InvariantManagerImpl::enableInvariant(std::string const& invPattern)
     }
 }
 
+void
+InvariantManagerImpl::setOperationSampleRate(std::string const& invPattern,
+                                             uint32_t rate)
+{
+    if (rate == 0)
+    {
+        throw std::invalid_argument("Invariant sample rate must be positive");
+    }
+    for (auto enabled : matchEnabled(invPattern))
+    {
+        enabled->mSampleRate = rate;
+        CLOG(INFO, "Invariant")
+            << "Checking invariant '" << enabled->mInvariant->getName()
+            << "' on one operation in " << rate;
+    }
+}
+
+void
+InvariantManagerImpl::deferInvariant(std::string const& invPattern)
+{
+    auto matched = matchEnabled(invPattern);
+    for (auto enabled : matched)
+    {
+        auto const& invariant = enabled->mInvariant;
+        if (invariant->isStrict() || !invariant->canCheckDeferred())
+        {
+            throw std::runtime_error{"Invariant " + invariant->getName() +
+                                     " can't be deferred"};
+        }
+    }
+    for (auto enabled : matched)
+    {
+        enabled->mDeferred = true;
+        CLOG(INFO, "Invariant") << "Deferred invariant '"
+                                << enabled->mInvariant->getName() << "'";
+    }
+}
+
+void
+InvariantManagerImpl::checkPerLedger(std::string const& invPattern)
+{
+    auto matched = matchEnabled(invPattern);
+    for (auto enabled : matched)
+    {
+        auto const& invariant = enabled->mInvariant;
+        if (!invariant->hasLedgerCloseCheck())
+        {
+            throw std::runtime_error{"Invariant " + invariant->getName() +
+                                     " can't be checked per ledger"};
+        }
+    }
+    for (auto enabled : matched)
+    {
+        enabled->mPerLedger = true;
+        CLOG(INFO, "Invariant") << "Checking invariant '"
+                                << enabled->mInvariant->getName()
+                                << "' once per ledger";
+    }
+    mHasPerLedger = true;
+}
+
+std::regex
+InvariantManagerImpl::makePattern(std::string const& invPattern)
+{
+    if (invPattern.empty())
+    {
+        throw std::invalid_argument("Invariant pattern must be non empty");
+    }
+
+    try
+    {
+        return std::regex(invPattern,
+                          std::regex::ECMAScript | std::regex::icase);
+    }
+    catch (std::regex_error& e)
+    {
+        throw std::invalid_argument(fmt::format(
+            "Invalid invariant pattern '{}': {}", invPattern, e.what()));
+    }
+}
+
+std::vector<InvariantManagerImpl::EnabledInvariant*>
+InvariantManagerImpl::matchEnabled(std::string const& invPattern)
+{
+    auto r = makePattern(invPattern);
+    std::vector<EnabledInvariant*> res;
+    for (auto& enabled : mEnabled)
+    {
+        if (std::regex_match(enabled.mInvariant->getName(), r,
+                             std::regex_constants::match_not_null))
+        {
+            res.emplace_back(&enabled);
+        }
+    }
+    if (res.empty())
+    {
+        throw std::runtime_error{fmt::format(
+            "Invariant pattern '{}' did not match any enabled invariants.",
+            invPattern)};
+    }
+    return res;
+}
+
 void
 InvariantManagerImpl::onInvariantFailure(std::shared_ptr<Invariant> invariant,
                                          std::string const& message,
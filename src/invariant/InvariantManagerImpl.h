@@ -6,11 +6,13 @@
 
 #include "invariant/InvariantManager.h"
 #include <map>
+#include <regex>
 #include <vector>
 
 namespace medida
 {
 class MetricsRegistry;
+class Timer;
 }
 
 namespace stellar
@@ -18,9 +20,27 @@ namespace stellar
 
 class InvariantManagerImpl : public InvariantManager
 {
+    struct EnabledInvariant
+    {
+        std::shared_ptr<Invariant> mInvariant;
+        medida::Timer* mOperationCheckTimer;
+        uint32_t mSampleRate{1};
+        uint64_t mOperations{0};
+        bool mDeferred{false};
+        bool mPerLedger{false};
+    };
+
+    Application& mApp;
     std::map<std::string, std::shared_ptr<Invariant>> mInvariants;
-    std::vector<std::shared_ptr<Invariant>> mEnabled;
+    std::vector<EnabledInvariant> mEnabled;
     medida::MetricsRegistry& mMetricsRegistry;
+    medida::Timer& mOperationCheckTimer;
+    medida::Timer& mLedgerCheckTimer;
+
+    // Changes of the operations applied in the current ledger, kept while
+    // some invariants are checked per ledger.
+    bool mHasPerLedger{false};
+    std::unique_ptr<LedgerDelta> mLedgerOpsDelta;
 
     struct InvariantFailureInformation
     {
@@ -30,7 +50,8 @@ class InvariantManagerImpl : public InvariantManager
     std::map<std::string, InvariantFailureInformation> mFailureInformation;
 
   public:
-    InvariantManagerImpl(medida::MetricsRegistry& registry);
+    InvariantManagerImpl(Application& app);
+    ~InvariantManagerImpl();
 
     virtual Json::Value getJsonInfo() override;
 
@@ -40,6 +61,10 @@ class InvariantManagerImpl : public InvariantManager
                                        OperationResult const& opres,
                                        LedgerDelta const& delta) override;
 
+    virtual void addAppliedOperations(LedgerDelta const& opsDelta) override;
+
+    virtual void checkOnLedgerClose() override;
+
     virtual void checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                                     uint32_t ledger, uint32_t level,
                                     bool isCurr) override;
@@ -49,7 +74,24 @@ class InvariantManagerImpl : public InvariantManager
 
     virtual void enableInvariant(std::string const& name) override;
 
+    virtual void setOperationSampleRate(std::string const& invPattern,
+                                        uint32_t rate) override;
+
+    virtual void deferInvariant(std::string const& invPattern) override;
+
+    virtual void checkPerLedger(std::string const& invPattern) override;
+
   private:
+    static std::regex makePattern(std::string const& invPattern);
+
+    // The enabled invariants matching `invPattern`; throws if there are none.
+    std::vector<EnabledInvariant*>
+    matchEnabled(std::string const& invPattern);
+
+    void checkOperation(EnabledInvariant const& enabled,
+                        Operation const& operation,
+                        OperationResult const& opres, LedgerDelta const& delta);
+
     void onInvariantFailure(std::shared_ptr<Invariant> invariant,
                             std::string const& message, uint32_t ledger);
 
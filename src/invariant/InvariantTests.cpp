@@ -72,6 +72,45 @@ class TestInvariant : public Invariant
     int mInvariantID;
     bool mShouldFail;
 };
+
+class CountingInvariant : public Invariant
+{
+  public:
+    CountingInvariant() : Invariant(false)
+    {
+    }
+
+    virtual std::string
+    getName() const override
+    {
+        return "CountingInvariant";
+    }
+
+    virtual std::string
+    checkOnOperationApply(Operation const& operation,
+                          OperationResult const& result,
+                          LedgerDelta const& delta) override
+    {
+        ++mChecked;
+        return {};
+    }
+
+    virtual bool
+    hasLedgerCloseCheck() const override
+    {
+        return true;
+    }
+
+    virtual std::string
+    checkOnLedgerClose(LedgerDelta const& opsDelta) override
+    {
+        ++mLedgersChecked;
+        return {};
+    }
+
+    int mChecked{0};
+    int mLedgersChecked{0};
+};
 }
 
 using namespace InvariantTests;
@@ -213,3 +252,83 @@ TEST_CASE("onOperationApply fail/succeed", "[invariant]")
             app->getInvariantManager().checkOnOperationApply({}, res, ld));
     }
 }
+
+TEST_CASE("onOperationApply sampled/deferred", "[invariant]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.INVARIANT_CHECKS = {};
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    OperationResult res;
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta ld(lh, app->getDatabase());
+
+    auto& im = app->getInvariantManager();
+    auto counting = im.registerInvariant<CountingInvariant>();
+    im.enableInvariant("CountingInvariant");
+
+    SECTION("sampled")
+    {
+        im.setOperationSampleRate("CountingInvariant", 3);
+        for (int i = 0; i < 7; ++i)
+        {
+            im.checkOnOperationApply({}, res, ld);
+        }
+        REQUIRE(counting->mChecked == 3);
+    }
+    SECTION("deferred")
+    {
+        im.deferInvariant("CountingInvariant");
+        im.checkOnOperationApply({}, res, ld);
+        im.checkOnOperationApply({}, res, ld);
+        REQUIRE(counting->mChecked == 0);
+        for (int i = 0; i < 10 && counting->mChecked < 2; ++i)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(counting->mChecked == 2);
+    }
+    SECTION("strict invariants are not deferred")
+    {
+        im.registerInvariant<TestInvariant>(0, true);
+        im.enableInvariant(TestInvariant::toString(0, true));
+        REQUIRE_THROWS_AS(im.deferInvariant(TestInvariant::toString(0, true)),
+                          std::runtime_error);
+    }
+}
+
+TEST_CASE("onLedgerClose per ledger", "[invariant]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.INVARIANT_CHECKS = {};
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    OperationResult res;
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta ld(lh, app->getDatabase());
+
+    auto& im = app->getInvariantManager();
+    auto counting = im.registerInvariant<CountingInvariant>();
+    im.enableInvariant("CountingInvariant");
+    im.checkPerLedger("CountingInvariant");
+
+    for (int i = 0; i < 3; ++i)
+    {
+        im.checkOnOperationApply({}, res, ld);
+        im.addAppliedOperations(ld);
+    }
+    im.checkOnLedgerClose();
+    REQUIRE(counting->mChecked == 0);
+    REQUIRE(counting->mLedgersChecked == 1);
+
+    // nothing applied since
+    im.checkOnLedgerClose();
+    REQUIRE(counting->mLedgersChecked == 1);
+
+    im.registerInvariant<TestInvariant>(0, true);
+    im.enableInvariant(TestInvariant::toString(0, true));
+    REQUIRE_THROWS_AS(im.checkPerLedger(TestInvariant::toString(0, true)),
+                      std::runtime_error);
+}
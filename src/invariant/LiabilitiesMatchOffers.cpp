@@ -35,10 +35,38 @@ LiabilitiesMatchOffers::getName() const
     return "MinimumAccountBalance";
 }
 
+bool
+LiabilitiesMatchOffers::canCheckDeferred() const
+{
+    // reads the ledger version and base reserve from the LedgerManager, which
+    // an upgrade can change once the operation is applied
+    return false;
+}
+
 std::string
 LiabilitiesMatchOffers::checkOnOperationApply(Operation const& operation,
                                               OperationResult const& result,
                                               LedgerDelta const& delta)
+{
+    return check(delta);
+}
+
+bool
+LiabilitiesMatchOffers::hasLedgerCloseCheck() const
+{
+    // changes in liabilities add up over many operations; balances are only
+    // checked for accounts whose balance decreased over the whole ledger
+    return true;
+}
+
+std::string
+LiabilitiesMatchOffers::checkOnLedgerClose(LedgerDelta const& opsDelta)
+{
+    return check(opsDelta);
+}
+
+std::string
+LiabilitiesMatchOffers::check(LedgerDelta const& delta) const
 {
     if (delta.getHeader().ledgerVersion >= 10)
     {
@@ -30,12 +30,19 @@ class LiabilitiesMatchOffers : public Invariant
 
     virtual std::string getName() const override;
 
+    virtual bool canCheckDeferred() const override;
+
     virtual std::string
     checkOnOperationApply(Operation const& operation,
                           OperationResult const& result,
                           LedgerDelta const& delta) override;
 
+    virtual bool hasLedgerCloseCheck() const override;
+
+    virtual std::string checkOnLedgerClose(LedgerDelta const& opsDelta) override;
+
   private:
+    std::string check(LedgerDelta const& delta) const;
     template <typename IterType>
     void addCurrentLiabilities(
         std::map<AccountID, std::map<Asset, Liabilities>>& deltaLiabilities,
@@ -9,6 +9,7 @@
 #include "crypto/SecretKey.h"
 #include "crypto/SignerKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerRange.h"
 #include "lib/util/format.h"
@@ -80,7 +81,7 @@ AccountFrame::AccountFrame(AccountID const& id) : AccountFrame()
 AccountFrame::pointer
 AccountFrame::makeAuthOnlyAccount(AccountID const& id)
 {
-    AccountFrame::pointer ret = make_shared<AccountFrame>(id);
+    AccountFrame::pointer ret = makePooled<AccountFrame>(id);
     // puts a negative balance to trip any attempt to save this
     ret->mAccountEntry.balance = INT64_MIN;
 
@@ -321,6 +322,11 @@ AccountFrame::getLowThreshold() const
     return mAccountEntry.thresholds[THRESHOLD_LOW];
 }
 
+static const char* accountColumnSelector =
+    "SELECT accountid, balance, seqnum, numsubentries, inflationdest, "
+    "homedomain, thresholds, flags, lastmodified, buyingliabilities, "
+    "sellingliabilities FROM accounts";
+
 AccountFrame::pointer
 AccountFrame::loadAccount(LedgerDelta& delta, AccountID const& accountID,
                           Database& db)
@@ -336,33 +342,77 @@ AccountFrame::loadAccount(LedgerDelta& delta, AccountID const& accountID,
 AccountFrame::pointer
 AccountFrame::loadAccount(AccountID const& accountID, Database& db)
 {
-    LedgerKey key;
-    key.type(ACCOUNT);
-    key.account().accountID = accountID;
+    LedgerKey k;
+    k.type(ACCOUNT);
+    k.account().accountID = accountID;
+    HashedLedgerKey key(std::move(k));
     if (cachedEntryExists(key, db))
     {
         auto p = getCachedEntry(key, db);
-        return p ? std::make_shared<AccountFrame>(*p) : nullptr;
+        if (!p)
+        {
+            return nullptr;
+        }
+        // cached entries hold the signers as stored
+        auto res = makePooled<AccountFrame>(*p);
+        res->mUpdateSigners = false;
+        return res;
     }
 
     std::string actIDStrKey = KeyUtils::toStrKey(accountID);
 
-    std::string publicKey, inflationDest, creditAuthKey;
-    std::string homeDomain, thresholds;
+    auto query = std::string(accountColumnSelector);
+    query += " WHERE accountid = :v1";
+    auto prep = db.getPreparedStatement(query);
+    auto& st = prep.statement();
+    st.exchange(use(actIDStrKey));
+
+    AccountFrame::pointer res;
+    {
+        auto timer = db.getSelectTimer("account");
+        loadAccounts(prep, [&res](LedgerEntry const& account) {
+            res = makePooled<AccountFrame>(account);
+        });
+    }
+    if (!res)
+    {
+        putCachedEntry(key, nullptr, db);
+        return nullptr;
+    }
+
+    AccountEntry& account = res->getAccount();
+    account.signers.clear();
+
+    if (account.numSubEntries != 0)
+    {
+        auto signers = loadSigners(db, actIDStrKey);
+        account.signers.insert(account.signers.begin(), signers.begin(),
+                               signers.end());
+    }
+
+    res->normalize();
+    res->mUpdateSigners = false;
+    res->mKeyCalculated = false;
+    res->putCachedEntry(db);
+    return res;
+}
+
+void
+AccountFrame::loadAccounts(
+    StatementContext& prep,
+    std::function<void(LedgerEntry const&)> accountProcessor)
+{
+    std::string actIDStrKey, inflationDest, homeDomain, thresholds;
     Liabilities liabilities;
     soci::indicator inflationDestInd;
     soci::indicator buyingLiabilitiesInd, sellingLiabilitiesInd;
 
-    AccountFrame::pointer res = make_shared<AccountFrame>(accountID);
-    AccountEntry& account = res->getAccount();
+    LedgerEntry le;
+    le.data.type(ACCOUNT);
+    AccountEntry& account = le.data.account();
 
-    auto prep =
-        db.getPreparedStatement("SELECT balance, seqnum, numsubentries, "
-                                "inflationdest, homedomain, thresholds, "
-                                "flags, lastmodified, buyingliabilities, "
-                                "sellingliabilities "
-                                "FROM accounts WHERE accountid=:v1");
     auto& st = prep.statement();
+    st.exchange(into(actIDStrKey));
     st.exchange(into(account.balance));
     st.exchange(into(account.seqNum));
     st.exchange(into(account.numSubEntries));
@@ -370,53 +420,238 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     st.exchange(into(homeDomain));
     st.exchange(into(thresholds));
     st.exchange(into(account.flags));
-    st.exchange(into(res->getLastModified()));
+    st.exchange(into(le.lastModifiedLedgerSeq));
     st.exchange(into(liabilities.buying, buyingLiabilitiesInd));
     st.exchange(into(liabilities.selling, sellingLiabilitiesInd));
-    st.exchange(use(actIDStrKey));
     st.define_and_bind();
+
+    st.execute(true);
+    while (st.got_data())
     {
-        auto timer = db.getSelectTimer("account");
-        st.execute(true);
+        account.accountID = KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
+        account.homeDomain = homeDomain;
+
+        decoder::decode_b64(thresholds.begin(), thresholds.end(),
+                            account.thresholds.begin());
+
+        if (inflationDestInd == soci::i_ok)
+        {
+            account.inflationDest.activate() =
+                KeyUtils::fromStrKey<PublicKey>(inflationDest);
+        }
+        else
+        {
+            account.inflationDest.reset();
+        }
+
+        assert(buyingLiabilitiesInd == sellingLiabilitiesInd);
+        if (buyingLiabilitiesInd == soci::i_ok)
+        {
+            account.ext.v(1);
+            account.ext.v1().liabilities = liabilities;
+        }
+        else
+        {
+            account.ext.v(0);
+        }
+
+        accountProcessor(le);
+
+        st.fetch();
     }
-    if (!st.got_data())
+}
+
+void
+AccountFrame::prefetch(Database& db, std::vector<AccountID> const& accountIDs)
+{
+    if (accountIDs.empty())
     {
-        putCachedEntry(key, nullptr, db);
-        return nullptr;
+        return;
     }
 
-    account.homeDomain = homeDomain;
+    std::vector<std::string> strKeys;
+    strKeys.reserve(accountIDs.size());
+    for (auto const& id : accountIDs)
+    {
+        strKeys.emplace_back(KeyUtils::toStrKey(id));
+    }
 
-    decoder::decode_b64(thresholds.begin(), thresholds.end(),
-                        res->mAccountEntry.thresholds.begin());
+    auto inList = DatabaseUtils::placeholderList(
+        DatabaseUtils::BULK_LOAD_BATCH_SIZE);
+    auto query = std::string(accountColumnSelector);
+    query += " WHERE accountid IN " + inList;
+    auto signersQuery = std::string("SELECT accountid, publickey, weight "
+                                    "FROM signers WHERE accountid IN ") +
+                        inList;
 
-    if (inflationDestInd == soci::i_ok)
+    std::unordered_map<AccountID, std::shared_ptr<LedgerEntry>> found;
+    for (auto& batch : DatabaseUtils::makeLoadBatches(strKeys))
     {
-        account.inflationDest.activate() =
-            KeyUtils::fromStrKey<PublicKey>(inflationDest);
+        bool needSigners = false;
+        {
+            auto prep = db.getPreparedStatement(query);
+            auto& st = prep.statement();
+            for (auto const& k : batch)
+            {
+                st.exchange(use(k));
+            }
+            auto timer = db.getSelectTimer("account");
+            loadAccounts(prep, [&](LedgerEntry const& le) {
+                auto const& a = le.data.account();
+                needSigners = needSigners || a.numSubEntries != 0;
+                found[a.accountID] = std::make_shared<LedgerEntry>(le);
+            });
+        }
+
+        if (!needSigners)
+        {
+            continue;
+        }
+
+        std::string actIDStrKey, pubKey;
+        Signer signer;
+        auto prep = db.getPreparedStatement(signersQuery);
+        auto& st = prep.statement();
+        for (auto const& k : batch)
+        {
+            st.exchange(use(k));
+        }
+        st.exchange(into(actIDStrKey));
+        st.exchange(into(pubKey));
+        st.exchange(into(signer.weight));
+        st.define_and_bind();
+        {
+            auto timer = db.getSelectTimer("signer");
+            st.execute(true);
+        }
+        while (st.got_data())
+        {
+            auto it = found.find(KeyUtils::fromStrKey<PublicKey>(actIDStrKey));
+            if (it != found.end())
+            {
+                signer.key = KeyUtils::fromStrKey<SignerKey>(pubKey);
+                it->second->data.account().signers.push_back(signer);
+            }
+            st.fetch();
+        }
     }
 
-    account.signers.clear();
+    for (auto const& id : accountIDs)
+    {
+        LedgerKey key;
+        key.type(ACCOUNT);
+        key.account().accountID = id;
+        auto it = found.find(id);
+        if (it == found.end())
+        {
+            db.getEntryCache().put(key, nullptr, true);
+            continue;
+        }
+        auto& signers = it->second->data.account().signers;
+        std::sort(signers.begin(), signers.end(), &AccountFrame::signerCompare);
+        db.getEntryCache().put(key, it->second, true);
+    }
+}
 
-    if (account.numSubEntries != 0)
+void
+AccountFrame::loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+                       std::function<void(LedgerEntry const&)> processor)
+{
+    std::vector<std::string> strKeys;
+    strKeys.reserve(keys.size());
+    for (auto const& k : keys)
     {
-        auto signers = loadSigners(db, actIDStrKey);
-        account.signers.insert(account.signers.begin(), signers.begin(),
-                               signers.end());
+        strKeys.emplace_back(KeyUtils::toStrKey(k.account().accountID));
     }
 
-    assert(buyingLiabilitiesInd == sellingLiabilitiesInd);
-    if (buyingLiabilitiesInd == soci::i_ok)
+    auto inList = DatabaseUtils::placeholderList(
+        DatabaseUtils::BULK_LOAD_BATCH_SIZE);
+    auto accounts = DatabaseUtils::prepare(
+        sess, std::string(accountColumnSelector) + " WHERE accountid IN " +
+                  inList);
+    auto signers = DatabaseUtils::prepare(
+        sess, "SELECT accountid, publickey, weight "
+              "FROM signers WHERE accountid IN " +
+                  inList);
+
+    for (auto& batch : DatabaseUtils::makeLoadBatches(strKeys))
     {
-        account.ext.v(1);
-        account.ext.v1().liabilities = liabilities;
+        // batches are padded with duplicate keys
+        std::unordered_map<AccountID, LedgerEntry> found;
+        bool needSigners = false;
+        {
+            StatementContext prep(accounts);
+            auto& st = prep.statement();
+            for (auto const& k : batch)
+            {
+                st.exchange(use(k));
+            }
+            loadAccounts(prep, [&](LedgerEntry const& le) {
+                auto const& a = le.data.account();
+                needSigners = needSigners || a.numSubEntries != 0;
+                found[a.accountID] = le;
+            });
+        }
+
+        if (needSigners)
+        {
+            std::string actIDStrKey, pubKey;
+            Signer signer;
+            StatementContext prep(signers);
+            auto& st = prep.statement();
+            for (auto const& k : batch)
+            {
+                st.exchange(use(k));
+            }
+            st.exchange(into(actIDStrKey));
+            st.exchange(into(pubKey));
+            st.exchange(into(signer.weight));
+            st.define_and_bind();
+            st.execute(true);
+            while (st.got_data())
+            {
+                auto it =
+                    found.find(KeyUtils::fromStrKey<PublicKey>(actIDStrKey));
+                if (it != found.end())
+                {
+                    signer.key = KeyUtils::fromStrKey<SignerKey>(pubKey);
+                    it->second.data.account().signers.push_back(signer);
+                }
+                st.fetch();
+            }
+        }
+
+        for (auto& f : found)
+        {
+            auto& s = f.second.data.account().signers;
+            std::sort(s.begin(), s.end(), &AccountFrame::signerCompare);
+            processor(f.second);
+        }
     }
+}
 
-    res->normalize();
-    res->mUpdateSigners = false;
-    res->mKeyCalculated = false;
-    res->putCachedEntry(db);
-    return res;
+void
+AccountFrame::loadAllIntoCache(Database& db)
+{
+    std::vector<AccountID> accountIDs;
+    {
+        std::string actIDStrKey;
+        auto prep = db.getPreparedStatement("SELECT accountid FROM accounts");
+        auto& st = prep.statement();
+        st.exchange(into(actIDStrKey));
+        st.define_and_bind();
+        {
+            auto timer = db.getSelectTimer("account");
+            st.execute(true);
+        }
+        while (st.got_data())
+        {
+            accountIDs.emplace_back(
+                KeyUtils::fromStrKey<PublicKey>(actIDStrKey));
+            st.fetch();
+        }
+    }
+    prefetch(db, accountIDs);
 }
 
 std::vector<Signer>
@@ -452,9 +687,10 @@ AccountFrame::loadSigners(Database& db, std::string const& actIDStrKey)
 bool
 AccountFrame::exists(Database& db, LedgerKey const& key)
 {
-    if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
+    HashedLedgerKey cacheKey(key);
+    if (cachedEntryExists(cacheKey, db))
     {
-        return true;
+        return getCachedEntry(cacheKey, db) != nullptr;
     }
 
     std::string actIDStrKey = KeyUtils::toStrKey(key.account().accountID);
@@ -495,10 +731,9 @@ void
 AccountFrame::deleteAccountsModifiedOnOrAfterLedger(Database& db,
                                                     uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == ACCOUNT &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+    db.getEntryCache().eraseIf(
+        ACCOUNT, [oldestLedger](EntryCache::Value const& le) -> bool {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
 
     {
@@ -530,6 +765,13 @@ void
 AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
                           LedgerKey const& key)
 {
+    if (delta.writesDeferred(ACCOUNT))
+    {
+        putCachedEntry(key, nullptr, db);
+        delta.deleteEntry(key);
+        return;
+    }
+
     flushCachedEntry(key, db);
 
     std::string actIDStrKey = KeyUtils::toStrKey(key.account().accountID);
@@ -554,11 +796,131 @@ AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
     delta.deleteEntry(key);
 }
 
+void
+AccountFrame::storeAddOrChangeBulk(Database& db,
+                                   std::vector<LedgerEntry> const& entries)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+
+    using DatabaseUtils::BulkColumn;
+    std::vector<BulkColumn> cols{{"accountid", "TEXT"},
+                                 {"balance", "BIGINT"},
+                                 {"seqnum", "BIGINT"},
+                                 {"numsubentries", "INT"},
+                                 {"inflationdest", "TEXT"},
+                                 {"homedomain", "TEXT"},
+                                 {"thresholds", "TEXT"},
+                                 {"flags", "INT"},
+                                 {"lastmodified", "INT"},
+                                 {"buyingliabilities", "BIGINT"},
+                                 {"sellingliabilities", "BIGINT"}};
+    std::vector<BulkColumn> accountIDs{{"accountid", "TEXT"}};
+    std::vector<BulkColumn> signerCols{
+        {"accountid", "TEXT"}, {"publickey", "TEXT"}, {"weight", "INT"}};
+
+    for (auto const& e : entries)
+    {
+        auto const& a = e.data.account();
+        std::string actIDStrKey = KeyUtils::toStrKey(a.accountID);
+        cols[0].push(actIDStrKey);
+        cols[1].push(std::to_string(a.balance));
+        cols[2].push(std::to_string(a.seqNum));
+        cols[3].push(std::to_string(a.numSubEntries));
+        if (a.inflationDest)
+        {
+            cols[4].push(KeyUtils::toStrKey(*a.inflationDest));
+        }
+        else
+        {
+            cols[4].pushNull();
+        }
+        cols[5].push(a.homeDomain);
+        cols[6].push(decoder::encode_b64(a.thresholds));
+        cols[7].push(std::to_string(a.flags));
+        cols[8].push(std::to_string(e.lastModifiedLedgerSeq));
+        if (a.ext.v() == 1)
+        {
+            cols[9].push(std::to_string(a.ext.v1().liabilities.buying));
+            cols[10].push(std::to_string(a.ext.v1().liabilities.selling));
+        }
+        else
+        {
+            cols[9].pushNull();
+            cols[10].pushNull();
+        }
+
+        accountIDs[0].push(actIDStrKey);
+        for (auto const& s : a.signers)
+        {
+            signerCols[0].push(actIDStrKey);
+            signerCols[1].push(KeyUtils::toStrKey(s.key));
+            signerCols[2].push(std::to_string(s.weight));
+        }
+    }
+
+    DatabaseUtils::bulkUpsert(db, "account", "accounts", {"accountid"}, cols);
+    // Signers are replaced wholesale rather than diffed as in applySigners.
+    DatabaseUtils::bulkDelete(db, "signer", "signers", accountIDs);
+    DatabaseUtils::bulkUpsert(db, "signer", "signers",
+                              {"accountid", "publickey"}, signerCols);
+}
+
+void
+AccountFrame::storeDeleteBulk(Database& db, std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    std::vector<DatabaseUtils::BulkColumn> accountIDs{{"accountid", "TEXT"}};
+    for (auto const& k : keys)
+    {
+        accountIDs[0].push(KeyUtils::toStrKey(k.account().accountID));
+    }
+    DatabaseUtils::bulkDelete(db, "account", "accounts", accountIDs);
+    DatabaseUtils::bulkDelete(db, "signer", "signers", accountIDs);
+}
+
 void
 AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
 {
     touch(delta);
 
+    if (!insert && isCachedAsIs(db, "account"))
+    {
+        // signers included
+        delta.modEntry(*this);
+        return;
+    }
+
+    if (delta.writesDeferred(ACCOUNT))
+    {
+        // written by LedgerDelta::flushDeferredWrites
+        normalize();
+        putCachedEntry(db);
+        if (insert)
+        {
+            delta.addEntry(*this);
+        }
+        else
+        {
+            delta.modEntry(*this);
+        }
+        return;
+    }
+
+    // the signers as stored, if cached, so that applySigners does not have
+    // to load them
+    std::shared_ptr<LedgerEntry const> stored;
+    if (mUpdateSigners && !insert && cachedEntryExists(getKey(), db))
+    {
+        stored = getCachedEntry(getKey(), db);
+    }
+
     flushCachedEntry(db);
 
     std::string actIDStrKey = KeyUtils::toStrKey(mAccountEntry.accountID);
@@ -641,20 +1003,27 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
 
     if (mUpdateSigners)
     {
-        applySigners(db, insert);
+        applySigners(db, insert,
+                     stored ? &stored->data.account().signers : nullptr);
     }
 }
 
 void
-AccountFrame::applySigners(Database& db, bool insert)
+AccountFrame::applySigners(Database& db, bool insert,
+                           xdr::xvector<Signer, 20> const* stored)
 {
     std::string actIDStrKey = KeyUtils::toStrKey(mAccountEntry.accountID);
 
     // generates a diff with the signers stored in the database
 
-    // first, load the signers stored in the database for this account
+    // first, get the signers stored in the database for this account
     std::vector<Signer> signers;
-    if (!insert)
+    if (stored)
+    {
+        signers.assign(stored->begin(), stored->end());
+        std::sort(signers.begin(), signers.end(), &AccountFrame::signerCompare);
+    }
+    else if (!insert)
     {
         signers = loadSigners(db, actIDStrKey);
     }
@@ -786,13 +1155,13 @@ AccountFrame::processForInflation(
     InflationVotes v;
     std::string inflationDest;
 
+    // kept up to date by the triggers of createInflationVotes, rather than
+    // summed over the whole accounts table here
     soci::statement st =
-        (session.prepare
-             << "SELECT"
-                " sum(balance) AS votes, inflationdest FROM accounts WHERE"
-                " inflationdest IS NOT NULL"
-                " AND balance >= 1000000000 GROUP BY inflationdest"
-                " ORDER BY votes DESC, inflationdest DESC LIMIT :lim",
+        (session.prepare << "SELECT votes, inflationdest FROM inflationvotes"
+                            " WHERE votes > 0"
+                            " ORDER BY votes DESC, inflationdest DESC"
+                            " LIMIT :lim",
          into(v.mVotes), into(inflationDest), use(maxWinners));
 
     st.execute(true);
@@ -865,10 +1234,107 @@ AccountFrame::dropAll(Database& db)
 {
     db.getSession() << "DROP TABLE IF EXISTS accounts;";
     db.getSession() << "DROP TABLE IF EXISTS signers;";
+    db.getSession() << "DROP TABLE IF EXISTS inflationvotes;";
 
     db.getSession() << kSQLCreateStatement1;
     db.getSession() << kSQLCreateStatement2;
     db.getSession() << kSQLCreateStatement3;
     db.getSession() << kSQLCreateStatement4;
 }
+
+std::vector<std::pair<std::string, std::string>>
+AccountFrame::getSecondaryIndexes()
+{
+    return {{"signersaccount", kSQLCreateStatement3},
+            {"accountbalances", kSQLCreateStatement4}};
+}
+
+void
+AccountFrame::dropInflationVotes(Database& db)
+{
+    auto& sess = db.getSession();
+    if (db.isSqlite())
+    {
+        sess << "DROP TRIGGER IF EXISTS inflationvotesinsert";
+        sess << "DROP TRIGGER IF EXISTS inflationvotesupdate";
+        sess << "DROP TRIGGER IF EXISTS inflationvotesdelete";
+    }
+    else
+    {
+        sess << "DROP TRIGGER IF EXISTS inflationvotes ON accounts";
+    }
+    sess << "DROP TABLE IF EXISTS inflationvotes";
+}
+
+void
+AccountFrame::createInflationVotes(Database& db)
+{
+    auto& sess = db.getSession();
+    dropInflationVotes(db);
+    sess << "CREATE TABLE inflationvotes"
+            "("
+            "inflationdest   VARCHAR(56)  PRIMARY KEY,"
+            "votes           BIGINT       NOT NULL"
+            ")";
+    sess << "CREATE INDEX inflationvotesbyvotes ON inflationvotes "
+            "(votes, inflationdest)";
+
+    // An account votes with its balance when it has an inflation destination
+    // and at least 100 XLM. Rows of destinations are only added, so that
+    // the triggers never conflict with an existing row: an INSERT OR REPLACE
+    // into accounts would make SQLite replace it.
+    if (db.isSqlite())
+    {
+        std::string addNew =
+            "INSERT INTO inflationvotes (inflationdest, votes)"
+            " SELECT NEW.inflationdest, 0"
+            " WHERE NEW.inflationdest IS NOT NULL"
+            " AND NEW.balance >= 1000000000 AND NOT EXISTS"
+            " (SELECT 1 FROM inflationvotes"
+            " WHERE inflationdest = NEW.inflationdest);"
+            "UPDATE inflationvotes SET votes = votes + NEW.balance"
+            " WHERE inflationdest = NEW.inflationdest"
+            " AND NEW.balance >= 1000000000;";
+        std::string removeOld =
+            "UPDATE inflationvotes SET votes = votes - OLD.balance"
+            " WHERE inflationdest = OLD.inflationdest"
+            " AND OLD.balance >= 1000000000;";
+        sess << "CREATE TRIGGER inflationvotesinsert AFTER INSERT ON accounts "
+                "BEGIN " +
+                    addNew + " END";
+        sess << "CREATE TRIGGER inflationvotesupdate AFTER UPDATE OF "
+                "balance, inflationdest ON accounts BEGIN " +
+                    removeOld + addNew + " END";
+        sess << "CREATE TRIGGER inflationvotesdelete AFTER DELETE ON accounts "
+                "BEGIN " +
+                    removeOld + " END";
+    }
+    else
+    {
+        sess << "CREATE OR REPLACE FUNCTION inflationvotesupdate() "
+                "RETURNS trigger AS $$ BEGIN "
+                "IF TG_OP <> 'INSERT' AND OLD.inflationdest IS NOT NULL "
+                "AND OLD.balance >= 1000000000 THEN "
+                "UPDATE inflationvotes SET votes = votes - OLD.balance "
+                "WHERE inflationdest = OLD.inflationdest; "
+                "END IF; "
+                "IF TG_OP <> 'DELETE' AND NEW.inflationdest IS NOT NULL "
+                "AND NEW.balance >= 1000000000 THEN "
+                "INSERT INTO inflationvotes (inflationdest, votes) "
+                "VALUES (NEW.inflationdest, NEW.balance) "
+                "ON CONFLICT (inflationdest) DO UPDATE "
+                "SET votes = inflationvotes.votes + NEW.balance; "
+                "END IF; "
+                "RETURN NULL; "
+                "END $$ LANGUAGE plpgsql";
+        sess << "CREATE TRIGGER inflationvotes AFTER INSERT OR DELETE OR "
+                "UPDATE OF balance, inflationdest ON accounts "
+                "FOR EACH ROW EXECUTE PROCEDURE inflationvotesupdate()";
+    }
+
+    sess << "INSERT INTO inflationvotes (inflationdest, votes)"
+            " SELECT inflationdest, sum(balance) FROM accounts"
+            " WHERE inflationdest IS NOT NULL AND balance >= 1000000000"
+            " GROUP BY inflationdest";
+}
 }
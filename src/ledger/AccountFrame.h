@@ -22,6 +22,7 @@ namespace stellar
 {
 class LedgerManager;
 class LedgerRange;
+class StatementContext;
 
 int64_t getBuyingLiabilities(AccountEntry const& acc, LedgerManager const& lm);
 int64_t getSellingLiabilities(AccountEntry const& acc, LedgerManager const& lm);
@@ -37,7 +38,14 @@ class AccountFrame : public EntryFrame
 
     static std::vector<Signer> loadSigners(Database& db,
                                            std::string const& actIDStrKey);
-    void applySigners(Database& db, bool insert);
+    // Decodes each row of an accountColumnSelector query; signers are left
+    // empty.
+    static void
+    loadAccounts(StatementContext& prep,
+                 std::function<void(LedgerEntry const&)> accountProcessor);
+    // `stored` are the signers in the database, loaded when not given.
+    void applySigners(Database& db, bool insert,
+                      xdr::xvector<Signer, 20> const* stored);
 
   public:
     typedef std::shared_ptr<AccountFrame> pointer;
@@ -53,7 +61,7 @@ class AccountFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<AccountFrame>(*this);
+        return makePooled<AccountFrame>(*this);
     }
 
     void
@@ -129,6 +137,13 @@ class AccountFrame : public EntryFrame
     // Static helper that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+    // Bulk writes used by EntryFrame::storeAddOrChangeBulk,
+    // EntryFrame::storeDeleteBulk and LedgerDelta::flushDeferredWrites; the
+    // db entry cache is not flushed here.
+    static void storeAddOrChangeBulk(Database& db,
+                                     std::vector<LedgerEntry> const& entries);
+    static void storeDeleteBulk(Database& db,
+                                std::vector<LedgerKey> const& keys);
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
@@ -142,6 +157,21 @@ class AccountFrame : public EntryFrame
     static AccountFrame::pointer loadAccount(AccountID const& accountID,
                                              Database& db);
 
+    // Loads the given accounts (and their signers) into the entry cache with
+    // a few multi-key queries, caching nullptr for the ones that do not
+    // exist. Ids must be unique and not already cached.
+    static void prefetch(Database& db,
+                         std::vector<AccountID> const& accountIDs);
+    // Loads every account into the entry cache (see
+    // EntryFrame::loadLedgerStateIntoCache).
+    static void loadAllIntoCache(Database& db);
+    // Calls `processor` with those of `keys` (all of this type) that are in
+    // the database, loaded through `sess` with a few multi-key queries and
+    // without going through the entry cache (see EntryFrame::loadBulk).
+    static void
+    loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+             std::function<void(LedgerEntry const&)> processor);
+
     // compare signers, ignores weight
     static bool signerCompare(Signer const& s1, Signer const& s2);
 
@@ -153,6 +183,8 @@ class AccountFrame : public EntryFrame
         AccountID mInflationDest;
     };
 
+    // Votes are read from the inflationvotes table, ordered by votes then
+    // destination, both descending.
     // inflationProcessor returns true to continue processing, false otherwise
     static void processForInflation(
         std::function<bool(InflationVotes const&)> inflationProcessor,
@@ -164,6 +196,19 @@ class AccountFrame : public EntryFrame
 
     static void dropAll(Database& db);
 
+    // Creates the inflationvotes table, which holds for each inflation
+    // destination the sum of the balances of the accounts voting for it with
+    // at least 100 XLM, and the triggers keeping it up to date as accounts
+    // are written; fills it from the accounts table.
+    static void createInflationVotes(Database& db);
+    // Drops the inflationvotes table and its triggers.
+    static void dropInflationVotes(Database& db);
+
+    // The non-unique indexes of the accounts and signers tables, by name (see
+    // EntryFrame::dropSecondaryIndexes).
+    static std::vector<std::pair<std::string, std::string>>
+    getSecondaryIndexes();
+
   private:
     static const char* kSQLCreateStatement1;
     static const char* kSQLCreateStatement2;
@@ -8,10 +8,12 @@
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
 #include "ledger/LedgerRange.h"
 #include "transactions/ManageDataOpFrame.h"
 #include "util/Decoder.h"
 #include "util/types.h"
+#include <unordered_set>
 
 using namespace std;
 using namespace soci;
@@ -90,12 +92,48 @@ DataFrame::loadData(AccountID const& accountID, std::string dataName,
 
     auto timer = db.getSelectTimer("data");
     loadData(prep, [&retData](LedgerEntry const& data) {
-        retData = make_shared<DataFrame>(data);
+        retData = makePooled<DataFrame>(data);
     });
 
     return retData;
 }
 
+void
+DataFrame::loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+                    std::function<void(LedgerEntry const&)> processor)
+{
+    std::unordered_set<LedgerKey, LedgerKeyHash> wanted(keys.begin(),
+                                                        keys.end());
+    std::unordered_set<AccountID> accounts;
+    std::vector<std::string> strKeys;
+    for (auto const& k : keys)
+    {
+        if (accounts.insert(k.data().accountID).second)
+        {
+            strKeys.emplace_back(KeyUtils::toStrKey(k.data().accountID));
+        }
+    }
+
+    auto st = DatabaseUtils::prepare(
+        sess, std::string(dataColumnSelector) + " WHERE accountid IN " +
+                  DatabaseUtils::placeholderList(
+                      DatabaseUtils::BULK_LOAD_BATCH_SIZE));
+    for (auto& batch : DatabaseUtils::makeLoadBatches(strKeys))
+    {
+        StatementContext prep(st);
+        for (auto const& k : batch)
+        {
+            prep.statement().exchange(use(k));
+        }
+        loadData(prep, [&](LedgerEntry const& data) {
+            if (wanted.erase(LedgerEntryKey(data)) != 0)
+            {
+                processor(data);
+            }
+        });
+    }
+}
+
 void
 DataFrame::loadData(StatementContext& prep,
                     std::function<void(LedgerEntry const&)> dataProcessor)
@@ -145,7 +183,7 @@ DataFrame::loadAllData(Database& db)
     auto timer = db.getSelectTimer("data");
     loadData(prep, [&retData](LedgerEntry const& of) {
         auto& thisUserData = retData[of.data.data().accountID];
-        thisUserData.emplace_back(make_shared<DataFrame>(of));
+        thisUserData.emplace_back(makePooled<DataFrame>(of));
     });
     return retData;
 }
@@ -191,10 +229,9 @@ void
 DataFrame::deleteDataModifiedOnOrAfterLedger(Database& db,
                                              uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == DATA &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+    db.getEntryCache().eraseIf(
+        DATA, [oldestLedger](EntryCache::Value const& le) -> bool {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
 
     {
@@ -229,6 +266,51 @@ DataFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
     delta.deleteEntry(key);
 }
 
+void
+DataFrame::storeAddOrChangeBulk(Database& db,
+                                std::vector<LedgerEntry> const& entries)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+
+    using DatabaseUtils::BulkColumn;
+    std::vector<BulkColumn> cols{{"accountid", "TEXT"},
+                                 {"dataname", "TEXT"},
+                                 {"datavalue", "TEXT"},
+                                 {"lastmodified", "INT"}};
+    for (auto const& e : entries)
+    {
+        auto const& d = e.data.data();
+        cols[0].push(KeyUtils::toStrKey(d.accountID));
+        cols[1].push(d.dataName);
+        cols[2].push(decoder::encode_b64(d.dataValue));
+        cols[3].push(std::to_string(e.lastModifiedLedgerSeq));
+    }
+
+    DatabaseUtils::bulkUpsert(db, "data", "accountdata",
+                              {"accountid", "dataname"}, cols);
+}
+
+void
+DataFrame::storeDeleteBulk(Database& db, std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    using DatabaseUtils::BulkColumn;
+    std::vector<BulkColumn> cols{{"accountid", "TEXT"}, {"dataname", "TEXT"}};
+    for (auto const& k : keys)
+    {
+        cols[0].push(KeyUtils::toStrKey(k.data().accountID));
+        cols[1].push(k.data().dataName);
+    }
+    DatabaseUtils::bulkDelete(db, "data", "accountdata", cols);
+}
+
 void
 DataFrame::storeChange(LedgerDelta& delta, Database& db)
 {
@@ -40,7 +40,7 @@ class DataFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<DataFrame>(*this);
+        return makePooled<DataFrame>(*this);
     }
 
     std::string const& getName() const;
@@ -67,6 +67,12 @@ class DataFrame : public EntryFrame
     // Static helpers that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+    // Bulk writes used by EntryFrame::storeAddOrChangeBulk and
+    // EntryFrame::storeDeleteBulk; the db entry cache is not flushed here.
+    static void storeAddOrChangeBulk(Database& db,
+                                     std::vector<LedgerEntry> const& entries);
+    static void storeDeleteBulk(Database& db,
+                                std::vector<LedgerKey> const& keys);
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
@@ -77,6 +83,12 @@ class DataFrame : public EntryFrame
     // database utilities
     static pointer loadData(AccountID const& accountID, std::string dataName,
                             Database& db);
+    // Calls `processor` with those of `keys` (all of this type) that are in
+    // the database, loaded through `sess` with a few multi-key queries and
+    // without going through the entry cache (see EntryFrame::loadBulk).
+    static void
+    loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+             std::function<void(LedgerEntry const&)> processor);
 
     // load all data entries from the database (very slow)
     static std::unordered_map<AccountID, std::vector<DataFrame::pointer>>
@@ -15,6 +15,9 @@
 #include "xdrpp/marshal.h"
 #include "xdrpp/printer.h"
 
+#include <cassert>
+#include <future>
+
 namespace stellar
 {
 EntryFrame::pointer
@@ -25,16 +28,16 @@ EntryFrame::FromXDR(LedgerEntry const& from)
     switch (from.data.type())
     {
     case ACCOUNT:
-        res = std::make_shared<AccountFrame>(from);
+        res = makePooled<AccountFrame>(from);
         break;
     case TRUSTLINE:
-        res = std::make_shared<TrustFrame>(from);
+        res = makePooled<TrustFrame>(from);
         break;
     case OFFER:
-        res = std::make_shared<OfferFrame>(from);
+        res = makePooled<OfferFrame>(from);
         break;
     case DATA:
-        res = std::make_shared<DataFrame>(from);
+        res = makePooled<DataFrame>(from);
         break;
     }
     return res;
@@ -106,32 +109,28 @@ EntryFrame::touch(LedgerDelta const& delta)
 }
 
 void
-EntryFrame::flushCachedEntry(LedgerKey const& key, Database& db)
+EntryFrame::flushCachedEntry(HashedLedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    db.getEntryCache().erase_if_exists(s);
+    db.getEntryCache().eraseIfExists(key);
 }
 
 bool
-EntryFrame::cachedEntryExists(LedgerKey const& key, Database& db)
+EntryFrame::cachedEntryExists(HashedLedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().exists(s);
+    return db.getEntryCache().exists(key);
 }
 
 std::shared_ptr<LedgerEntry const>
-EntryFrame::getCachedEntry(LedgerKey const& key, Database& db)
+EntryFrame::getCachedEntry(HashedLedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().get(s);
+    return db.getEntryCache().get(key);
 }
 
 void
-EntryFrame::putCachedEntry(LedgerKey const& key,
+EntryFrame::putCachedEntry(HashedLedgerKey const& key,
                            std::shared_ptr<LedgerEntry const> p, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    db.getEntryCache().put(s, p);
+    db.getEntryCache().put(key, p);
 }
 
 void
@@ -146,21 +145,45 @@ EntryFrame::putCachedEntry(Database& db) const
     putCachedEntry(getKey(), std::make_shared<LedgerEntry const>(mEntry), db);
 }
 
+bool
+EntryFrame::isCachedAsIs(Database& db, std::string const& entityName) const
+{
+    HashedLedgerKey key(getKey());
+    if (!cachedEntryExists(key, db))
+    {
+        return false;
+    }
+    auto p = getCachedEntry(key, db);
+    if (p && *p == mEntry)
+    {
+        db.markAvoidedUpdate(entityName);
+        return true;
+    }
+    return false;
+}
+
 std::string
 EntryFrame::checkAgainstDatabase(LedgerEntry const& entry, Database& db)
 {
     auto key = LedgerEntryKey(entry);
     flushCachedEntry(key, db);
     auto const& fromDb = EntryFrame::storeLoad(key, db);
+    return checkAgainstLoaded(entry, fromDb ? &fromDb->mEntry : nullptr);
+}
+
+std::string
+EntryFrame::checkAgainstLoaded(LedgerEntry const& entry,
+                               LedgerEntry const* fromDb)
+{
     if (fromDb != nullptr)
     {
-        if (fromDb->mEntry == entry)
+        if (*fromDb == entry)
         {
             return {};
         }
 
         std::string s{"Inconsistent state between objects: "};
-        s += xdr::xdr_to_string(fromDb->mEntry, "db");
+        s += xdr::xdr_to_string(*fromDb, "db");
         s += xdr::xdr_to_string(entry, "live");
         return s;
     }
@@ -245,6 +268,201 @@ EntryFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
     }
 }
 
+void
+EntryFrame::storeAddOrChangeBulk(Database& db,
+                                 std::vector<LedgerEntry> const& entries)
+{
+    std::vector<LedgerEntry> accounts, trustLines, offers, data;
+    for (auto const& e : entries)
+    {
+        flushCachedEntry(LedgerEntryKey(e), db);
+        switch (e.data.type())
+        {
+        case ACCOUNT:
+            accounts.emplace_back(e);
+            break;
+        case TRUSTLINE:
+            trustLines.emplace_back(e);
+            break;
+        case OFFER:
+            offers.emplace_back(e);
+            break;
+        case DATA:
+            data.emplace_back(e);
+            break;
+        }
+    }
+    AccountFrame::storeAddOrChangeBulk(db, accounts);
+    TrustFrame::storeAddOrChangeBulk(db, trustLines);
+    OfferFrame::storeAddOrChangeBulk(db, offers);
+    DataFrame::storeAddOrChangeBulk(db, data);
+}
+
+void
+EntryFrame::storeDeleteBulk(Database& db, std::vector<LedgerKey> const& keys)
+{
+    std::vector<LedgerKey> accounts, trustLines, offers, data;
+    for (auto const& k : keys)
+    {
+        flushCachedEntry(k, db);
+        switch (k.type())
+        {
+        case ACCOUNT:
+            accounts.emplace_back(k);
+            break;
+        case TRUSTLINE:
+            trustLines.emplace_back(k);
+            break;
+        case OFFER:
+            offers.emplace_back(k);
+            break;
+        case DATA:
+            data.emplace_back(k);
+            break;
+        }
+    }
+    AccountFrame::storeDeleteBulk(db, accounts);
+    TrustFrame::storeDeleteBulk(db, trustLines);
+    OfferFrame::storeDeleteBulk(db, offers);
+    DataFrame::storeDeleteBulk(db, data);
+}
+
+void
+EntryFrame::prefetch(Database& db,
+                     std::unordered_set<LedgerKey, LedgerKeyHash> const& keys)
+{
+    std::vector<AccountID> accounts;
+    std::vector<LedgerKey> trustLines;
+    for (auto const& k : keys)
+    {
+        if (db.getEntryCache().contains(k))
+        {
+            continue;
+        }
+        switch (k.type())
+        {
+        case ACCOUNT:
+            accounts.emplace_back(k.account().accountID);
+            break;
+        case TRUSTLINE:
+            trustLines.emplace_back(k);
+            break;
+        default:
+            break;
+        }
+    }
+    AccountFrame::prefetch(db, accounts);
+    TrustFrame::prefetch(db, trustLines);
+}
+
+static std::vector<std::pair<std::string, std::string>>
+getSecondaryIndexes()
+{
+    auto res = AccountFrame::getSecondaryIndexes();
+    for (auto const& index : OfferFrame::getSecondaryIndexes())
+    {
+        res.emplace_back(index);
+    }
+    return res;
+}
+
+void
+EntryFrame::dropSecondaryIndexes(Database& db)
+{
+    for (auto const& index : getSecondaryIndexes())
+    {
+        db.getSession() << "DROP INDEX IF EXISTS " + index.first;
+    }
+    AccountFrame::dropInflationVotes(db);
+}
+
+void
+EntryFrame::createSecondaryIndexes(
+    Database& db, std::function<void(std::string const&)> built)
+{
+    auto indexes = getSecondaryIndexes();
+    auto create = [](soci::session& sess, std::string sql) {
+        std::string const prefix = "CREATE INDEX ";
+        assert(sql.compare(0, prefix.size(), prefix) == 0);
+        sql.insert(prefix.size(), "IF NOT EXISTS ");
+        sess << sql;
+    };
+
+    std::vector<std::future<void>> done;
+    if (db.isSqlite())
+    {
+        for (auto const& index : indexes)
+        {
+            create(db.getSession(), index.second);
+            built(index.first);
+        }
+    }
+    else
+    {
+        auto& pool = db.getPool();
+        for (auto const& index : indexes)
+        {
+            auto sql = index.second;
+            done.emplace_back(
+                std::async(std::launch::async, [&pool, create, sql]() {
+                    soci::session sess(pool);
+                    create(sess, sql);
+                }));
+        }
+    }
+
+    // the tallies only read the accounts table, which the indexes being built
+    // meanwhile do not prevent
+    AccountFrame::createInflationVotes(db);
+    built("inflationvotes");
+    for (size_t i = 0; i < done.size(); ++i)
+    {
+        done[i].get();
+        built(indexes[i].first);
+    }
+}
+
+void
+EntryFrame::loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+                     std::function<void(LedgerEntry const&)> processor)
+{
+    std::vector<LedgerKey> accounts, trustLines, offers, data;
+    for (auto const& k : keys)
+    {
+        switch (k.type())
+        {
+        case ACCOUNT:
+            accounts.emplace_back(k);
+            break;
+        case TRUSTLINE:
+            trustLines.emplace_back(k);
+            break;
+        case OFFER:
+            offers.emplace_back(k);
+            break;
+        case DATA:
+            data.emplace_back(k);
+            break;
+        }
+    }
+    if (!accounts.empty())
+    {
+        AccountFrame::loadBulk(sess, accounts, processor);
+    }
+    if (!trustLines.empty())
+    {
+        TrustFrame::loadBulk(sess, trustLines, processor);
+    }
+    if (!offers.empty())
+    {
+        OfferFrame::loadBulk(sess, offers, processor);
+    }
+    if (!data.empty())
+    {
+        DataFrame::loadBulk(sess, data, processor);
+    }
+}
+
 LedgerKey
 LedgerEntryKey(LedgerEntry const& e)
 {
@@ -278,4 +496,20 @@ LedgerEntryKey(LedgerEntry const& e)
     }
     return k;
 }
+
+void
+EntryFrame::loadLedgerStateIntoCache(Database& db)
+{
+    auto& cache = db.getEntryCache();
+    if (!cache.isComplete(ACCOUNT))
+    {
+        AccountFrame::loadAllIntoCache(db);
+        cache.markComplete(ACCOUNT);
+    }
+    if (!cache.isComplete(TRUSTLINE))
+    {
+        TrustFrame::loadAllIntoCache(db);
+        cache.markComplete(TRUSTLINE);
+    }
+}
 }
@@ -5,8 +5,17 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/LedgerCmp.h"
+#include "database/EntryCache.h"
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
+#include "util/PoolAllocator.h"
+#include <functional>
+#include <unordered_set>
+
+namespace soci
+{
+class session;
+}
 
 /*
 Frame
@@ -44,11 +53,11 @@ class EntryFrame : public NonMovableOrCopyable
     static pointer storeLoad(LedgerKey const& key, Database& db);
 
     // Static helpers for working with the DB LedgerEntry cache.
-    static void flushCachedEntry(LedgerKey const& key, Database& db);
-    static bool cachedEntryExists(LedgerKey const& key, Database& db);
+    static void flushCachedEntry(HashedLedgerKey const& key, Database& db);
+    static bool cachedEntryExists(HashedLedgerKey const& key, Database& db);
     static std::shared_ptr<LedgerEntry const>
-    getCachedEntry(LedgerKey const& key, Database& db);
-    static void putCachedEntry(LedgerKey const& key,
+    getCachedEntry(HashedLedgerKey const& key, Database& db);
+    static void putCachedEntry(HashedLedgerKey const& key,
                                std::shared_ptr<LedgerEntry const> p,
                                Database& db);
 
@@ -65,8 +74,17 @@ class EntryFrame : public NonMovableOrCopyable
     void flushCachedEntry(Database& db) const;
     void putCachedEntry(Database& db) const;
 
+    // True when the entry cache holds this exact entry, ie. when storing it
+    // would not change the database. Such updates are counted as avoided for
+    // `entityName`.
+    bool isCachedAsIs(Database& db, std::string const& entityName) const;
+
     static std::string checkAgainstDatabase(LedgerEntry const& entry,
                                             Database& db);
+    // Same as checkAgainstDatabase for `fromDb` already loaded (nullptr when
+    // not found).
+    static std::string checkAgainstLoaded(LedgerEntry const& entry,
+                                          LedgerEntry const* fromDb);
 
     virtual EntryFrame::pointer copy() const = 0;
 
@@ -80,6 +98,51 @@ class EntryFrame : public NonMovableOrCopyable
     static bool exists(Database& db, LedgerKey const& key);
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+
+    // Bulk variants of storeAddOrChange and storeDelete, used when applying
+    // buckets. Entries are written as-is (lastModified is not touched),
+    // without existence checks and without being recorded in a LedgerDelta.
+    // Keys must be unique within each call.
+    static void storeAddOrChangeBulk(Database& db,
+                                     std::vector<LedgerEntry> const& entries);
+    static void storeDeleteBulk(Database& db,
+                                std::vector<LedgerKey> const& keys);
+
+    // Bulk-load the accounts and trustlines among `keys` that are not cached
+    // yet into the entry cache, ahead of a batch of loads (eg. applying a
+    // transaction set). Other entry types are left to be loaded on demand.
+    static void
+    prefetch(Database& db,
+             std::unordered_set<LedgerKey, LedgerKeyHash> const& keys);
+
+    // Drops the non-unique indexes of the ledger entry tables and the
+    // inflation vote tallies, all otherwise maintained row by row, ahead of
+    // bulk writes of many entries (eg. applying buckets to an empty
+    // database).
+    static void dropSecondaryIndexes(Database& db);
+    // Creates what dropSecondaryIndexes drops, indexes that exist being left
+    // as they are, and calls `built` with the name of each once done. On
+    // postgres indexes are built in parallel through the connection pool.
+    static void
+    createSecondaryIndexes(Database& db,
+                           std::function<void(std::string const&)> built);
+
+    // Calls `processor` with those of `keys` that are in the database (in no
+    // particular order), loaded with multi-key queries of each type. Only uses
+    // `sess`, bypassing the entry cache and the prepared statement cache of
+    // the Database, so that it can run against a session of the pool on a
+    // worker thread (eg. to check the database against the buckets).
+    static void loadBulk(soci::session& sess,
+                         std::vector<LedgerKey> const& keys,
+                         std::function<void(LedgerEntry const&)> processor);
+
+    // Loads all accounts and trust lines into the entry cache, unless still
+    // there from a previous call, and marks them complete so that looking up
+    // one that does not exist does not query the database either. Used when
+    // LEDGER_STATE_IN_MEMORY is set, the cache then being unbounded. Changes
+    // are still written to the database as they are made; clearing the cache
+    // (eg. on upgrades) makes the next call load everything again.
+    static void loadLedgerStateIntoCache(Database& db);
 };
 
 // static helper for getting a LedgerKey from a LedgerEntry.
@@ -0,0 +1,233 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/HotKeys.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SecretKey.h"
+#include "util/XDROperators.h"
+#include "util/types.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+namespace
+{
+std::string
+describeAsset(Asset const& asset)
+{
+    std::string code;
+    switch (asset.type())
+    {
+    case ASSET_TYPE_NATIVE:
+        return "XLM";
+    case ASSET_TYPE_CREDIT_ALPHANUM4:
+        assetCodeToStr(asset.alphaNum4().assetCode, code);
+        return code + "-" + KeyUtils::toStrKey(asset.alphaNum4().issuer);
+    case ASSET_TYPE_CREDIT_ALPHANUM12:
+        assetCodeToStr(asset.alphaNum12().assetCode, code);
+        return code + "-" + KeyUtils::toStrKey(asset.alphaNum12().issuer);
+    default:
+        return "unknown";
+    }
+}
+
+Json::Value
+toJson(HotKeys::Entry const& e)
+{
+    Json::Value res;
+    res["key"] = HotKeys::describe(e.mKey);
+    res["count"] = static_cast<Json::UInt64>(e.mCount);
+    res["error"] = static_cast<Json::UInt64>(e.mError);
+    res["load"] = static_cast<Json::UInt64>(e.mLoads);
+    res["modify"] = static_cast<Json::UInt64>(e.mModifies);
+    res["write"] = static_cast<Json::UInt64>(e.mWrites);
+    return res;
+}
+}
+
+HotKeys::HotKeys(size_t capacity) : mCapacity(capacity)
+{
+    mCounters.reserve(capacity);
+    mIndex.reserve(capacity);
+}
+
+void
+HotKeys::record(LedgerKey const& key, Access access)
+{
+    if (mCapacity == 0)
+    {
+        return;
+    }
+    ++mAccesses;
+
+    HashedLedgerKey k(key);
+    Entry* e;
+    auto it = mIndex.find(k);
+    if (it != mIndex.end())
+    {
+        e = &mCounters[it->second];
+    }
+    else if (mCounters.size() < mCapacity)
+    {
+        mIndex.emplace(k, mCounters.size());
+        mCounters.emplace_back();
+        e = &mCounters.back();
+        e->mKey = key;
+    }
+    else
+    {
+        // the least touched key gives its counter up; the capacity is small,
+        // a scan is cheaper than keeping the counters ordered
+        auto min = std::min_element(
+            mCounters.begin(), mCounters.end(),
+            [](Entry const& a, Entry const& b) { return a.mCount < b.mCount; });
+        mIndex.erase(HashedLedgerKey(min->mKey));
+        mIndex.emplace(k, min - mCounters.begin());
+        e = &*min;
+        auto count = e->mCount;
+        *e = Entry();
+        e->mKey = key;
+        e->mCount = count;
+        e->mError = count;
+    }
+
+    ++e->mCount;
+    switch (access)
+    {
+    case Access::LOAD:
+        ++e->mLoads;
+        break;
+    case Access::MODIFY:
+        ++e->mModifies;
+        break;
+    case Access::WRITE:
+        ++e->mWrites;
+        break;
+    }
+}
+
+void
+HotKeys::ledgerClosed(uint32_t ledgerSeq)
+{
+    if (mCapacity == 0)
+    {
+        return;
+    }
+    mWindow.push_back(
+        LedgerTop{ledgerSeq, mAccesses, top(std::move(mCounters), mCapacity)});
+    if (mWindow.size() > WINDOW_LEDGERS)
+    {
+        mWindow.pop_front();
+    }
+    mCounters.clear();
+    mCounters.reserve(mCapacity);
+    mIndex.clear();
+    mAccesses = 0;
+}
+
+std::vector<HotKeys::Entry>
+HotKeys::top(std::vector<Entry> entries, size_t n)
+{
+    n = std::min(n, entries.size());
+    std::partial_sort(
+        entries.begin(), entries.begin() + n, entries.end(),
+        [](Entry const& a, Entry const& b) { return a.mCount > b.mCount; });
+    entries.resize(n);
+    return entries;
+}
+
+std::vector<HotKeys::Entry>
+HotKeys::getCurrentTop(size_t n) const
+{
+    return top(mCounters, n);
+}
+
+std::vector<HotKeys::Entry>
+HotKeys::getWindowTop(size_t n) const
+{
+    // space-saving summaries add up: a key missing from the top of a ledger
+    // was touched at most as many times as the last key of that top
+    std::unordered_map<HashedLedgerKey, Entry> sums;
+    for (auto const& l : mWindow)
+    {
+        for (auto const& e : l.mTop)
+        {
+            auto& s = sums[HashedLedgerKey(e.mKey)];
+            s.mKey = e.mKey;
+            s.mCount += e.mCount;
+            s.mError += e.mError;
+            s.mLoads += e.mLoads;
+            s.mModifies += e.mModifies;
+            s.mWrites += e.mWrites;
+        }
+    }
+    std::vector<Entry> res;
+    res.reserve(sums.size());
+    for (auto& kv : sums)
+    {
+        res.emplace_back(std::move(kv.second));
+    }
+    return top(std::move(res), n);
+}
+
+Json::Value
+HotKeys::getJson(size_t n) const
+{
+    Json::Value res;
+    res["tracked"] = static_cast<Json::UInt64>(mCapacity);
+    if (mWindow.empty())
+    {
+        return res;
+    }
+
+    auto const& last = mWindow.back();
+    auto& ledger = res["ledger"];
+    ledger["seq"] = last.mLedgerSeq;
+    ledger["accesses"] = static_cast<Json::UInt64>(last.mAccesses);
+    ledger["top"] = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < std::min(n, last.mTop.size()); ++i)
+    {
+        ledger["top"].append(toJson(last.mTop[i]));
+    }
+
+    auto& window = res["window"];
+    uint64_t accesses = 0;
+    for (auto const& l : mWindow)
+    {
+        accesses += l.mAccesses;
+    }
+    window["from"] = mWindow.front().mLedgerSeq;
+    window["to"] = last.mLedgerSeq;
+    window["accesses"] = static_cast<Json::UInt64>(accesses);
+    window["top"] = Json::Value(Json::arrayValue);
+    for (auto const& e : getWindowTop(n))
+    {
+        window["top"].append(toJson(e));
+    }
+    return res;
+}
+
+std::string
+HotKeys::describe(LedgerKey const& key)
+{
+    switch (key.type())
+    {
+    case ACCOUNT:
+        return "account " + KeyUtils::toStrKey(key.account().accountID);
+    case TRUSTLINE:
+        return "trustline " + KeyUtils::toStrKey(key.trustLine().accountID) +
+               ":" + describeAsset(key.trustLine().asset);
+    case OFFER:
+        return "offer " + KeyUtils::toStrKey(key.offer().sellerID) + ":" +
+               std::to_string(key.offer().offerID);
+    case DATA:
+        return "data " + KeyUtils::toStrKey(key.data().accountID) + ":" +
+               key.data().dataName;
+    default:
+        return "unknown";
+    }
+}
+}
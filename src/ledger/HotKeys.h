@@ -0,0 +1,108 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <deque>
+#include <lib/json/json.h>
+#include <unordered_map>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * The ledger entries touched most often, by the transactions of each ledger
+ * and over the last ledgers, to tell which accounts, trust lines and offers
+ * are contended for.
+ *
+ * Each ledger's accesses go through a space-saving sketch of a fixed number
+ * of counters: a key not counted yet takes over the counter of the least
+ * touched key once they are all taken, starting from its count (the error
+ * of its own count). Any key touched more than 1/capacity of the times is
+ * kept, with a count over its actual one by at most its error. The top keys
+ * of the last WINDOW_LEDGERS ledgers are kept, and added up for the window.
+ *
+ * Accesses are counted when the delta of a transaction (or of the fees and
+ * sequence numbers) is committed into the delta of the ledger, see
+ * LedgerDelta::trackHotKeys: once per transaction touching the key.
+ */
+class HotKeys : NonMovableOrCopyable
+{
+  public:
+    enum class Access
+    {
+        // loaded but left as it was
+        LOAD,
+        // changed
+        MODIFY,
+        // created or deleted
+        WRITE
+    };
+
+    struct Entry
+    {
+        LedgerKey mKey;
+        // accesses, as estimated by the sketch: at most mError more than
+        // there were
+        uint64_t mCount{0};
+        uint64_t mError{0};
+        // accesses of each kind since the key got its counter
+        uint64_t mLoads{0};
+        uint64_t mModifies{0};
+        uint64_t mWrites{0};
+    };
+
+    // Number of ledgers whose top keys are kept for the window.
+    static size_t const WINDOW_LEDGERS = 64;
+
+    // Tracks `capacity` keys per ledger; none if 0.
+    explicit HotKeys(size_t capacity);
+
+    bool
+    enabled() const
+    {
+        return mCapacity != 0;
+    }
+
+    void record(LedgerKey const& key, Access access);
+
+    // Ends the accesses of ledger `ledgerSeq`, which go to the window.
+    void ledgerClosed(uint32_t ledgerSeq);
+
+    // The `n` keys touched most by the ledger being closed, and by the
+    // window, most touched first.
+    std::vector<Entry> getCurrentTop(size_t n) const;
+    std::vector<Entry> getWindowTop(size_t n) const;
+
+    // The top `n` keys of the last ledger closed and of the window, for the
+    // hotkeys command.
+    Json::Value getJson(size_t n) const;
+
+    // A readable form of `key`, eg. "trustline GABC...:USD-GDEF...".
+    static std::string describe(LedgerKey const& key);
+
+  private:
+    size_t const mCapacity;
+
+    // the sketch of the ledger being closed
+    std::vector<Entry> mCounters;
+    std::unordered_map<HashedLedgerKey, size_t> mIndex;
+    uint64_t mAccesses{0};
+
+    struct LedgerTop
+    {
+        uint32_t mLedgerSeq;
+        uint64_t mAccesses;
+        std::vector<Entry> mTop;
+    };
+    std::deque<LedgerTop> mWindow;
+
+    static std::vector<Entry> top(std::vector<Entry> entries, size_t n);
+};
+}
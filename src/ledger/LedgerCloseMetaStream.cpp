@@ -0,0 +1,66 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerCloseMetaStream.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+namespace stellar
+{
+
+LedgerCloseMetaStream::LedgerCloseMetaStream(Application& app,
+                                             std::string const& path,
+                                             uint32_t rotateLedgers)
+    : mPath(path)
+    , mRotateLedgers(rotateLedgers)
+    , mLedgers(app.getMetrics().NewMeter({"ledger", "meta", "streamed"},
+                                         "ledger"))
+    , mBytes(
+          app.getMetrics().NewMeter({"ledger", "meta", "stream-bytes"}, "byte"))
+{
+}
+
+void
+LedgerCloseMetaStream::write(LedgerCloseMeta const& meta)
+{
+    auto ledgerSeq = meta.v0().ledgerHeader.header.ledgerSeq;
+    if (mOpen && mRotateLedgers != 0 && ledgerSeq >= mNextFile)
+    {
+        mOut.close();
+        mOpen = false;
+    }
+
+    if (!mOpen)
+    {
+        auto path = mPath;
+        if (mRotateLedgers != 0)
+        {
+            auto first = ledgerSeq - ledgerSeq % mRotateLedgers;
+            mNextFile = first + mRotateLedgers;
+            path += "." + std::to_string(first);
+        }
+        CLOG(INFO, "Ledger") << "Streaming ledger meta to " << path;
+        mOut.open(path, true);
+        mOpen = true;
+    }
+
+    size_t bytes = 0;
+    bool ok = mOut.writeOne(meta, nullptr, &bytes);
+    if (ok)
+    {
+        mOut.flush();
+        ok = static_cast<bool>(mOut);
+    }
+    if (!ok)
+    {
+        throw std::runtime_error("failed to stream meta of ledger " +
+                                 std::to_string(ledgerSeq));
+    }
+    mLedgers.Mark();
+    mBytes.Mark(bytes);
+}
+}
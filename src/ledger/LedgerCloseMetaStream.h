@@ -0,0 +1,57 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "util/XDRStream.h"
+#include "xdr/Stellar-ledger.h"
+
+#include <string>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+class Application;
+
+/**
+ * Writes the LedgerCloseMeta of each closed ledger to
+ * Config::METADATA_OUTPUT_STREAM, framed as the history files are (see
+ * XDROutputFileStream), so that whoever needs the changes made by each
+ * ledger can follow them instead of polling the txhistory tables.
+ *
+ * The output is appended to, and may be a named pipe: writing then blocks
+ * until a reader takes the data, and with it the close of the ledger. With
+ * Config::METADATA_OUTPUT_ROTATE_LEDGERS set, the ledgers go to a series of
+ * files PATH.FIRST instead, FIRST being a multiple of that count, each
+ * complete once the next one exists.
+ *
+ * A ledger is written before the database transaction closing it commits:
+ * after a crash, the last ledger written may be written again.
+ */
+class LedgerCloseMetaStream : NonMovableOrCopyable
+{
+    std::string const mPath;
+    uint32_t const mRotateLedgers;
+
+    XDROutputFileStream mOut;
+    bool mOpen{false};
+    // first ledger of the next file, when rotating
+    uint32_t mNextFile{0};
+
+    medida::Meter& mLedgers;
+    medida::Meter& mBytes;
+
+  public:
+    LedgerCloseMetaStream(Application& app, std::string const& path,
+                          uint32_t rotateLedgers);
+
+    // Writes and flushes `meta`; throws if that fails.
+    void write(LedgerCloseMeta const& meta);
+};
+}
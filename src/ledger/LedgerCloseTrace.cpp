@@ -0,0 +1,155 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerCloseTrace.h"
+#include "crypto/Hex.h"
+#include "database/Database.h"
+#include "ledger/HotKeys.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Logging.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+using namespace std::chrono;
+
+static double
+toMillis(nanoseconds d)
+{
+    return duration_cast<duration<double, std::milli>>(d).count();
+}
+
+static medida::Timer&
+getInvariantsTimer(Application& app)
+{
+    return app.getMetrics().NewTimer({"invariant", "operation", "check"});
+}
+
+LedgerCloseTrace::LedgerCloseTrace(Application& app, uint32_t ledgerSeq)
+    : mApp(app)
+    , mLedgerSeq(ledgerSeq)
+    , mThreshold(app.getConfig().LEDGER_CLOSE_TRACE_THRESHOLD_MS)
+    , mStart(Clock::now())
+    , mPhaseStart(mStart)
+    , mInvariantsBefore(0)
+{
+    if (mThreshold.count() != 0)
+    {
+        auto& db = mApp.getDatabase();
+        mQueriesBefore = db.getQueryCounts();
+        mSQL = db.captureSQL("ledger-close");
+        mInvariantsBefore = getInvariantsTimer(mApp).sum();
+    }
+}
+
+void
+LedgerCloseTrace::endPhase(Clock::time_point now)
+{
+    if (mPhaseTimer)
+    {
+        auto d = duration_cast<nanoseconds>(now - mPhaseStart);
+        mPhaseTimer->Update(d);
+        mPhases.emplace_back(mPhase, d);
+        mPhaseTimer = nullptr;
+    }
+    mPhaseStart = now;
+}
+
+void
+LedgerCloseTrace::phase(std::string const& name)
+{
+    endPhase(Clock::now());
+    mPhase = name;
+    mPhaseTimer = &mApp.getMetrics().NewTimer({"ledger", "close", name});
+}
+
+void
+LedgerCloseTrace::recordTransaction(TransactionFrame const& tx,
+                                    nanoseconds duration)
+{
+    if (mThreshold.count() != 0)
+    {
+        mTransactions.push_back(
+            {duration, tx.getFullHash(), tx.getOperations().size()});
+    }
+}
+
+void
+LedgerCloseTrace::finish()
+{
+    auto now = Clock::now();
+    endPhase(now);
+    auto total = duration_cast<nanoseconds>(now - mStart);
+    if (mThreshold.count() != 0 && total > mThreshold)
+    {
+        log(total);
+    }
+    mSQL.reset();
+}
+
+void
+LedgerCloseTrace::log(nanoseconds total)
+{
+    CLOG(WARNING, "Ledger")
+        << "Slow close of ledger " << mLedgerSeq << ": " << toMillis(total)
+        << "ms, " << mTransactions.size() << " transactions";
+    for (auto const& p : mPhases)
+    {
+        CLOG(WARNING, "Ledger")
+            << "  phase " << p.first << ": " << toMillis(p.second) << "ms";
+    }
+    CLOG(WARNING, "Ledger")
+        << "  invariants: "
+        << getInvariantsTimer(mApp).sum() - mInvariantsBefore << "ms";
+
+    auto n = std::min(TOP_TRANSACTIONS, mTransactions.size());
+    std::partial_sort(mTransactions.begin(), mTransactions.begin() + n,
+                      mTransactions.end(),
+                      [](TxTiming const& a, TxTiming const& b) {
+                          return a.mDuration > b.mDuration;
+                      });
+    for (size_t i = 0; i < n; i++)
+    {
+        auto const& tx = mTransactions[i];
+        CLOG(WARNING, "Ledger")
+            << "  tx " << hexAbbrev(tx.mHash) << ": "
+            << toMillis(tx.mDuration) << "ms, " << tx.mOperations << " ops";
+    }
+
+    for (auto const& e :
+         mApp.getLedgerManager().getHotKeys().getCurrentTop(TOP_HOT_KEYS))
+    {
+        CLOG(WARNING, "Ledger")
+            << "  entry " << HotKeys::describe(e.mKey) << ": " << e.mCount
+            << " txs (" << e.mLoads << " load, " << e.mModifies
+            << " modify, " << e.mWrites << " write)";
+    }
+
+    for (auto const& q : mApp.getDatabase().getQueryCounts())
+    {
+        auto before = mQueriesBefore.find(q.first);
+        auto count = q.second - (before == mQueriesBefore.end()
+                                     ? 0
+                                     : before->second);
+        if (count != 0)
+        {
+            CLOG(WARNING, "Ledger")
+                << "  sql " << q.first << ": " << count << " queries";
+        }
+    }
+    for (auto const& s : mSQL->getStatementCounts())
+    {
+        CLOG(WARNING, "Ledger")
+            << "  sql statement (" << s.second << "x): " << s.first;
+    }
+}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace medida
+{
+class Timer;
+}
+
+namespace stellar
+{
+class Application;
+class SQLLogContext;
+class TransactionFrame;
+
+/**
+ * Breaks the close of one ledger down into consecutive phases, each timed
+ * into the {"ledger", "close", <phase>} timer.
+ *
+ * If Config::LEDGER_CLOSE_TRACE_THRESHOLD_MS is set, a close that takes
+ * longer than that is also logged in detail: the time of each phase, the
+ * slowest transactions, the ledger entries they touched most, and the SQL
+ * queries run. The SQL statements are captured (see Database::captureSQL)
+ * for the whole close in that case, which has a cost of its own, so this is
+ * off by default.
+ */
+class LedgerCloseTrace : NonMovableOrCopyable
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct TxTiming
+    {
+        std::chrono::nanoseconds mDuration;
+        Hash mHash;
+        size_t mOperations;
+    };
+
+    Application& mApp;
+    uint32_t const mLedgerSeq;
+    std::chrono::milliseconds const mThreshold;
+
+    Clock::time_point const mStart;
+    Clock::time_point mPhaseStart;
+    std::string mPhase;
+    medida::Timer* mPhaseTimer{nullptr};
+    std::vector<std::pair<std::string, std::chrono::nanoseconds>> mPhases;
+
+    std::vector<TxTiming> mTransactions;
+    std::map<std::string, uint64_t> mQueriesBefore;
+    std::shared_ptr<SQLLogContext> mSQL;
+    double mInvariantsBefore;
+
+    void endPhase(Clock::time_point now);
+    void log(std::chrono::nanoseconds total);
+
+  public:
+    // Number of transactions listed in a trace.
+    static size_t const TOP_TRANSACTIONS = 10;
+    // Number of the most touched ledger entries listed, see HotKeys.
+    static size_t const TOP_HOT_KEYS = 5;
+
+    LedgerCloseTrace(Application& app, uint32_t ledgerSeq);
+
+    // Ends the current phase, if any, and starts `name`.
+    void phase(std::string const& name);
+
+    void recordTransaction(TransactionFrame const& tx,
+                           std::chrono::nanoseconds duration);
+
+    // Ends the last phase, and logs the trace if the close was slow.
+    void finish();
+};
+}
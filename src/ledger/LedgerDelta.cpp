@@ -3,14 +3,21 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/LedgerDelta.h"
+#include "database/Database.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/HotKeys.h"
+#include "ledger/LedgerManager.h"
+#include "ledger/TrustFrame.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "transactions/OperationMetrics.h"
 #include "medida/meter.h"
-#include "medida/metrics_registry.h"
 #include "util/XDROperators.h"
 #include "xdr/Stellar-ledger.h"
 #include "xdrpp/printer.h"
 
+#include <algorithm>
+
 namespace stellar
 {
 LedgerDelta::LedgerDelta(LedgerDelta& outerDelta)
@@ -20,6 +27,7 @@ LedgerDelta::LedgerDelta(LedgerDelta& outerDelta)
     , mPreviousHeaderValue(outerDelta.getHeader())
     , mDb(outerDelta.mDb)
     , mUpdateLastModified(outerDelta.mUpdateLastModified)
+    , mDeferWrites(outerDelta.mDeferWrites)
 {
 }
 
@@ -69,7 +77,7 @@ LedgerDelta::getPreviousHeader() const
 void
 LedgerDelta::checkState()
 {
-    if (mHeader == nullptr)
+    if (mHeader == nullptr && !mSnapshot)
     {
         throw std::runtime_error(
             "Invalid operation: delta is already committed");
@@ -79,33 +87,32 @@ LedgerDelta::checkState()
 void
 LedgerDelta::addEntry(EntryFrame const& entry)
 {
-    addEntry(entry.copy());
+    addLedgerEntry(entry.getKey(), entry.mEntry);
 }
 
 void
 LedgerDelta::deleteEntry(EntryFrame const& entry)
 {
-    deleteEntry(entry.copy());
+    deleteLedgerEntry(entry.getKey());
 }
 
 void
 LedgerDelta::modEntry(EntryFrame const& entry)
 {
-    modEntry(entry.copy());
+    modLedgerEntry(entry.getKey(), entry.mEntry);
 }
 
 void
 LedgerDelta::recordEntry(EntryFrame const& entry)
 {
-    recordEntry(entry.copy());
+    recordLedgerEntry(entry.getKey(), entry.mEntry);
 }
 
 void
-LedgerDelta::addEntry(EntryFrame::pointer entry)
+LedgerDelta::addLedgerEntry(HashedLedgerKey const& k, LedgerEntry const& entry)
 {
     checkState();
-    auto k = entry->getKey();
-    auto del_it = mDelete.find(k);
+    auto del_it = mDelete.find(k.key());
     if (del_it != mDelete.end())
     {
         // delete + new is an update
@@ -121,14 +128,13 @@ LedgerDelta::addEntry(EntryFrame::pointer entry)
 }
 
 void
-LedgerDelta::deleteEntry(EntryFrame::pointer entry)
+LedgerDelta::deleteEntry(LedgerKey const& key)
 {
-    auto k = entry->getKey();
-    deleteEntry(k);
+    deleteLedgerEntry(key);
 }
 
 void
-LedgerDelta::deleteEntry(LedgerKey const& k)
+LedgerDelta::deleteLedgerEntry(HashedLedgerKey const& k)
 {
     checkState();
     auto new_it = mNew.find(k);
@@ -141,19 +147,18 @@ LedgerDelta::deleteEntry(LedgerKey const& k)
     {
         // double delete here means there is buggy code upstream
         // and we cannot keep going as this may corrupt the bucket list
-        assert(mDelete.find(k) == mDelete.end());
+        assert(mDelete.find(k.key()) == mDelete.end());
 
         // mod + delete -> delete
         mMod.erase(k);
-        mDelete.insert(k);
+        mDelete.insert(k.key());
     }
 }
 
 void
-LedgerDelta::modEntry(EntryFrame::pointer entry)
+LedgerDelta::modLedgerEntry(HashedLedgerKey const& k, LedgerEntry const& entry)
 {
     checkState();
-    auto k = entry->getKey();
     auto mod_it = mMod.find(k);
     if (mod_it != mMod.end())
     {
@@ -170,54 +175,87 @@ LedgerDelta::modEntry(EntryFrame::pointer entry)
         }
         else
         {
-            assert(mDelete.find(k) == mDelete.end()); // delete + mod is illegal
+            // delete + mod is illegal
+            assert(mDelete.find(k.key()) == mDelete.end());
             mMod[k] = entry;
         }
     }
 }
 
 void
-LedgerDelta::recordEntry(EntryFrame::pointer entry)
+LedgerDelta::recordLedgerEntry(HashedLedgerKey const& k,
+                               LedgerEntry const& entry)
 {
     checkState();
     // keeps the old one around
-    mPrevious.insert(std::make_pair(entry->getKey(), entry));
+    mPrevious.emplace(k, entry);
 }
 
 void
-LedgerDelta::mergeEntries(LedgerDelta& other)
+LedgerDelta::mergeEntries(LedgerDelta const& other)
 {
     checkState();
 
     // propagates mPrevious for deleted & modified entries
     for (auto& d : other.mDelete)
     {
-        deleteEntry(d);
-        auto it = other.mPrevious.find(d);
+        HashedLedgerKey k(d);
+        deleteLedgerEntry(k);
+        auto it = other.mPrevious.find(k);
         if (it != other.mPrevious.end())
         {
-            recordEntry(*it->second);
+            recordLedgerEntry(k, it->second);
         }
     }
     for (auto& n : other.mNew)
     {
-        addEntry(n.second);
+        addLedgerEntry(n.first, n.second);
     }
     for (auto& m : other.mMod)
     {
-        modEntry(m.second);
+        modLedgerEntry(m.first, m.second);
         auto it = other.mPrevious.find(m.first);
         if (it != other.mPrevious.end())
         {
-            recordEntry(*it->second);
+            recordLedgerEntry(m.first, it->second);
         }
     }
 }
 
+void
+LedgerDelta::takeEntries(LedgerDelta& inner)
+{
+    checkState();
+    if (!mNew.empty() || !mMod.empty() || !mDelete.empty())
+    {
+        mergeEntries(inner);
+        return;
+    }
+
+    // Nothing of this delta to merge with (eg. the delta of the operations
+    // of a transaction, when its first operation commits): the maps of
+    // `inner` become those of this delta as they are, rather than entry by
+    // entry. Entries it recorded but did not change come along; they have
+    // the same value before this delta. Those recorded here were recorded
+    // first, and win.
+    std::swap(mNew, inner.mNew);
+    std::swap(mMod, inner.mMod);
+    std::swap(mDelete, inner.mDelete);
+    std::swap(mPrevious, inner.mPrevious);
+    for (auto& p : inner.mPrevious)
+    {
+        mPrevious[p.first] = p.second;
+    }
+}
+
 void
 LedgerDelta::commit()
 {
     checkState();
+    if (mSnapshot)
+    {
+        throw std::runtime_error("Invalid operation: delta is a snapshot");
+    }
     // checks if we about to override changes that were made
     // outside of this LedgerDelta
     if (!(mPreviousHeaderValue == *mHeader))
@@ -227,44 +265,196 @@ LedgerDelta::commit()
 
     if (mOuterDelta)
     {
-        mOuterDelta->mergeEntries(*this);
+        if (mOuterDelta->mHotKeys)
+        {
+            recordHotKeys(*mOuterDelta->mHotKeys);
+        }
+        mOuterDelta->takeEntries(*this);
         mOuterDelta = nullptr;
     }
     *mHeader = mCurrentHeader.mHeader;
     mHeader = nullptr;
 }
 
+bool
+LedgerDelta::invalidateOrderBooks(HashedLedgerKey const& key) const
+{
+    // the books of the offer's value before this delta (the one recorded
+    // here or the one held by an outer delta) and of its current value
+    auto& books = mDb.getOrderBook();
+    bool foundBefore = false;
+    auto invalidate = [&books](LedgerEntry const& e) {
+        auto const& o = e.data.offer();
+        books.invalidate(o.selling, o.buying);
+    };
+    for (auto d = this; d; d = d->mOuterDelta)
+    {
+        for (auto m : {&d->mNew, &d->mMod, &d->mPrevious})
+        {
+            auto it = m->find(key);
+            if (it != m->end())
+            {
+                invalidate(it->second);
+                foundBefore = foundBefore || d != this || m == &d->mPrevious;
+            }
+        }
+    }
+    return foundBefore;
+}
+
+void
+LedgerDelta::restoreDeferredEntry(HashedLedgerKey const& key) const
+{
+    // the innermost outer delta that changed it has its value before this
+    // one; otherwise it was not changed by this ledger and the database has
+    // it
+    for (auto d = mOuterDelta; d; d = d->mOuterDelta)
+    {
+        if (d->mDelete.find(key.key()) != d->mDelete.end())
+        {
+            EntryFrame::putCachedEntry(key, nullptr, mDb);
+            return;
+        }
+        for (auto m : {&d->mNew, &d->mMod})
+        {
+            auto it = m->find(key);
+            if (it != m->end())
+            {
+                auto value = std::make_shared<LedgerEntry const>(it->second);
+                EntryFrame::putCachedEntry(key, value, mDb);
+                return;
+            }
+        }
+    }
+    EntryFrame::flushCachedEntry(key, mDb);
+}
+
 void
 LedgerDelta::rollback()
 {
     checkState();
+    if (mSnapshot)
+    {
+        throw std::runtime_error("Invalid operation: delta is a snapshot");
+    }
     mHeader = nullptr;
 
+    // Offers are put back in the order books as they were before this
+    // delta, which is what the database holds once the SQL transaction this
+    // delta was applied in is rolled back too: failed path payments and
+    // offers leave the books they crossed loaded.
+    auto& books = mDb.getOrderBook();
+    bool clearOrderBooks = false;
+    auto restoreOffer = [&](HashedLedgerKey const& k) {
+        auto it = mPrevious.find(k);
+        if (it != mPrevious.end())
+        {
+            books.store(it->second);
+        }
+        else if (!invalidateOrderBooks(k))
+        {
+            clearOrderBooks = true;
+        }
+    };
+    auto restoreCached = [this](HashedLedgerKey const& k) {
+        if (writesDeferred(k.key().type()))
+        {
+            restoreDeferredEntry(k);
+        }
+        else
+        {
+            EntryFrame::flushCachedEntry(k, mDb);
+        }
+    };
     for (auto& d : mDelete)
     {
-        EntryFrame::flushCachedEntry(d, mDb);
+        HashedLedgerKey k(d);
+        restoreCached(k);
+        if (d.type() == OFFER)
+        {
+            restoreOffer(k);
+        }
     }
     for (auto& n : mNew)
     {
-        EntryFrame::flushCachedEntry(n.first, mDb);
+        restoreCached(n.first);
+        if (n.first.key().type() == OFFER)
+        {
+            // did not exist before this delta
+            books.erase(n.first.key().offer().offerID);
+        }
     }
     for (auto& m : mMod)
     {
-        EntryFrame::flushCachedEntry(m.first, mDb);
+        restoreCached(m.first);
+        if (m.first.key().type() == OFFER)
+        {
+            restoreOffer(m.first);
+        }
+    }
+    if (clearOrderBooks)
+    {
+        // some offer's books are not known
+        books.clear();
     }
 }
 
 void
 LedgerDelta::addCurrentMeta(LedgerEntryChanges& changes,
-                            LedgerKey const& key) const
+                            HashedLedgerKey const& key) const
 {
     auto it = mPrevious.find(key);
     if (it != mPrevious.end())
     {
-        auto const& e = it->second->mEntry;
         changes.emplace_back(LEDGER_ENTRY_STATE);
-        changes.back().state() = e;
+        changes.back().state() = it->second;
+    }
+}
+
+std::unique_ptr<LedgerDelta>
+LedgerDelta::snapshot() const
+{
+    LedgerHeader header = mPreviousHeaderValue;
+    auto res = std::make_unique<LedgerDelta>(header, mDb, mUpdateLastModified);
+    // nothing to commit to or roll back
+    res->mHeader = nullptr;
+    res->mSnapshot = true;
+    res->mCurrentHeader.mHeader = getHeader();
+    res->mDeferWrites = mDeferWrites;
+
+    res->mNew = mNew;
+    res->mMod = mMod;
+    res->mPrevious = mPrevious;
+    res->mDelete = mDelete;
+    return res;
+}
+
+void
+LedgerDelta::append(LedgerDelta const& later)
+{
+    if (!mSnapshot)
+    {
+        throw std::runtime_error("Invalid operation: delta is not a snapshot");
+    }
+    mergeEntries(later);
+    mCurrentHeader.mHeader = later.getHeader();
+}
+
+std::vector<LedgerDelta::KeyEntryMap::value_type const*>
+LedgerDelta::sortedEntries(KeyEntryMap const& m)
+{
+    std::vector<KeyEntryMap::value_type const*> res;
+    res.reserve(m.size());
+    for (auto const& e : m)
+    {
+        res.emplace_back(&e);
     }
+    std::sort(res.begin(), res.end(),
+              [](KeyEntryMap::value_type const* a,
+                 KeyEntryMap::value_type const* b) {
+                  return LedgerEntryIdCmp()(a->first.key(), b->first.key());
+              });
+    return res;
 }
 
 LedgerEntryChanges
@@ -272,16 +462,16 @@ LedgerDelta::getChanges() const
 {
     LedgerEntryChanges changes;
 
-    for (auto const& k : mNew)
+    for (auto k : sortedEntries(mNew))
     {
         changes.emplace_back(LEDGER_ENTRY_CREATED);
-        changes.back().created() = k.second->mEntry;
+        changes.back().created() = k->second;
     }
-    for (auto const& k : mMod)
+    for (auto k : sortedEntries(mMod))
     {
-        addCurrentMeta(changes, k.first);
+        addCurrentMeta(changes, k->first);
         changes.emplace_back(LEDGER_ENTRY_UPDATED);
-        changes.back().updated() = k.second->mEntry;
+        changes.back().updated() = k->second;
     }
 
     for (auto const& k : mDelete)
@@ -301,13 +491,13 @@ LedgerDelta::getLiveEntries() const
 
     live.reserve(mNew.size() + mMod.size());
 
-    for (auto const& k : mNew)
+    for (auto k : sortedEntries(mNew))
     {
-        live.push_back(k.second->mEntry);
+        live.push_back(k->second);
     }
-    for (auto const& k : mMod)
+    for (auto k : sortedEntries(mMod))
     {
-        live.push_back(k.second->mEntry);
+        live.push_back(k->second);
     }
 
     return live;
@@ -334,86 +524,124 @@ LedgerDelta::updateLastModified() const
 }
 
 void
-LedgerDelta::markMeters(Application& app) const
+LedgerDelta::deferWrites()
 {
-    for (auto const& ke : mNew)
+    assert(!mOuterDelta);
+    mDeferWrites = true;
+}
+
+bool
+LedgerDelta::writesDeferred(LedgerEntryType type) const
+{
+    return mDeferWrites && (type == ACCOUNT || type == TRUSTLINE);
+}
+
+void
+LedgerDelta::flushDeferredWrites()
+{
+    checkState();
+    if (!mDeferWrites)
+    {
+        return;
+    }
+
+    // the current value of every deferred entry, nullptr if deleted: outer
+    // deltas first, so that the changes of inner ones win
+    std::vector<LedgerDelta const*> deltas;
+    for (auto d = this; d; d = d->mOuterDelta)
+    {
+        deltas.emplace_back(d);
+    }
+    std::map<LedgerKey, LedgerEntry const*, LedgerEntryIdCmp> current;
+    for (auto d = deltas.rbegin(); d != deltas.rend(); ++d)
     {
-        switch (ke.first.type())
+        for (auto const& k : (*d)->mDelete)
         {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "add"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "add"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "add"}, "entry")
-                .Mark();
-            break;
-        case DATA:
-            app.getMetrics()
-                .NewMeter({"ledger", "data", "add"}, "entry")
-                .Mark();
-            break;
+            if (writesDeferred(k.type()))
+            {
+                current[k] = nullptr;
+            }
+        }
+        for (auto m : {&(*d)->mNew, &(*d)->mMod})
+        {
+            for (auto const& e : *m)
+            {
+                if (writesDeferred(e.first.key().type()))
+                {
+                    current[e.first.key()] = &e.second;
+                }
+            }
         }
     }
 
-    for (auto const& ke : mMod)
+    std::vector<LedgerEntry> accounts, trustLines;
+    std::vector<LedgerKey> deadAccounts, deadTrustLines;
+    for (auto const& c : current)
     {
-        switch (ke.first.type())
+        bool isAccount = c.first.type() == ACCOUNT;
+        if (c.second)
         {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "modify"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "modify"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "modify"}, "entry")
-                .Mark();
-            break;
-        case DATA:
-            app.getMetrics()
-                .NewMeter({"ledger", "data", "modify"}, "entry")
-                .Mark();
-            break;
+            (isAccount ? accounts : trustLines).emplace_back(*c.second);
         }
+        else
+        {
+            (isAccount ? deadAccounts : deadTrustLines).emplace_back(c.first);
+        }
+    }
+    AccountFrame::storeDeleteBulk(mDb, deadAccounts);
+    AccountFrame::storeAddOrChangeBulk(mDb, accounts);
+    TrustFrame::storeDeleteBulk(mDb, deadTrustLines);
+    TrustFrame::storeAddOrChangeBulk(mDb, trustLines);
+}
+
+void
+LedgerDelta::markMeters(Application& app) const
+{
+    auto& metrics = app.getLedgerManager().getOperationMetrics();
+    for (auto const& ke : mNew)
+    {
+        metrics.get(ke.first.key().type()).mAdd.Mark();
+    }
+    for (auto const& ke : mMod)
+    {
+        metrics.get(ke.first.key().type()).mModify.Mark();
+    }
+    for (auto const& k : mDelete)
+    {
+        metrics.get(k.type()).mDelete.Mark();
+    }
+}
+
+void
+LedgerDelta::trackHotKeys(HotKeys& hotKeys)
+{
+    if (hotKeys.enabled())
+    {
+        mHotKeys = &hotKeys;
     }
+}
 
-    for (auto const& ke : mDelete)
+void
+LedgerDelta::recordHotKeys(HotKeys& hotKeys) const
+{
+    for (auto const& ke : mNew)
+    {
+        hotKeys.record(ke.first.key(), HotKeys::Access::WRITE);
+    }
+    for (auto const& ke : mMod)
+    {
+        hotKeys.record(ke.first.key(), HotKeys::Access::MODIFY);
+    }
+    for (auto const& k : mDelete)
+    {
+        hotKeys.record(k, HotKeys::Access::WRITE);
+    }
+    for (auto const& ke : mPrevious)
     {
-        switch (ke.type())
+        if (mMod.find(ke.first) == mMod.end() &&
+            mDelete.find(ke.first.key()) == mDelete.end())
         {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "delete"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "delete"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "delete"}, "entry")
-                .Mark();
-            break;
-        case DATA:
-            app.getMetrics()
-                .NewMeter({"ledger", "data", "delete"}, "entry")
-                .Mark();
-            break;
+            hotKeys.record(ke.first.key(), HotKeys::Access::LOAD);
         }
     }
 }
@@ -501,7 +729,7 @@ template class LedgerDelta::IteratorRange<LedgerDelta::AddedIterator>;
 
 LedgerDelta::AddedLedgerEntry::AddedLedgerEntry(
     LedgerDelta const& delta, KeyEntryMap::value_type const& pair)
-    : key(pair.first), current(pair.second)
+    : key(pair.first.key()), current(EntryFrame::FromXDR(pair.second))
 {
 }
 
@@ -518,9 +746,9 @@ template class LedgerDelta::IteratorRange<LedgerDelta::ModifiedIterator>;
 
 LedgerDelta::ModifiedLedgerEntry::ModifiedLedgerEntry(
     LedgerDelta const& delta, KeyEntryMap::value_type const& pair)
-    : key(pair.first)
-    , current(pair.second)
-    , previous(delta.mPrevious.at(pair.first))
+    : key(pair.first.key())
+    , current(EntryFrame::FromXDR(pair.second))
+    , previous(EntryFrame::FromXDR(delta.mPrevious.at(pair.first)))
 {
 }
 
@@ -531,14 +759,13 @@ LedgerDelta::modified() const
             LedgerDelta::ModifiedIterator(*this, mMod.cend())};
 }
 
-template class LedgerDelta::Iterator<
-    std::set<LedgerKey, LedgerEntryIdCmp>::const_iterator,
-    LedgerDelta::DeletedLedgerEntry>;
+template class LedgerDelta::Iterator<LedgerDelta::KeySet::const_iterator,
+                                    LedgerDelta::DeletedLedgerEntry>;
 template class LedgerDelta::IteratorRange<LedgerDelta::DeletedIterator>;
 
 LedgerDelta::DeletedLedgerEntry::DeletedLedgerEntry(LedgerDelta const& delta,
                                                     LedgerKey const& value)
-    : key(value), previous(delta.mPrevious.at(value))
+    : key(value), previous(EntryFrame::FromXDR(delta.mPrevious.at(value)))
 {
 }
 
@@ -6,7 +6,9 @@
 
 #include "bucket/LedgerCmp.h"
 #include "ledger/EntryFrame.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "util/OpenAddressingMap.h"
 #include "xdrpp/marshal.h"
 #include <iterator>
 #include <map>
@@ -17,11 +19,16 @@ namespace stellar
 {
 class Application;
 class Database;
+class HotKeys;
 
 class LedgerDelta
 {
-    typedef std::map<LedgerKey, EntryFrame::pointer, LedgerEntryIdCmp>
-        KeyEntryMap;
+    // Entries are kept by value, in flat maps: deltas are created and torn
+    // down for every transaction and operation, and record or change entries
+    // all along. Set nodes come from BlockPool.
+    typedef OpenAddressingMap<HashedLedgerKey, LedgerEntry> KeyEntryMap;
+    typedef std::set<LedgerKey, LedgerEntryIdCmp, PoolAllocator<LedgerKey>>
+        KeySet;
 
     LedgerDelta*
         mOuterDelta;       // set when this delta is nested inside another delta
@@ -34,26 +41,50 @@ class LedgerDelta
     // ledger entries
     KeyEntryMap mNew;
     KeyEntryMap mMod;
-    std::set<LedgerKey, LedgerEntryIdCmp> mDelete;
+    KeySet mDelete;
     KeyEntryMap mPrevious;
 
     Database& mDb; // Used strictly for rollback of db entry cache.
 
     bool mUpdateLastModified;
+    bool mDeferWrites{false};
+    // set on the result of snapshot(), which has no mHeader
+    bool mSnapshot{false};
+    // see trackHotKeys
+    HotKeys* mHotKeys{nullptr};
 
     void checkState();
-    void addEntry(EntryFrame::pointer entry);
-    void deleteEntry(EntryFrame::pointer entry);
-    void modEntry(EntryFrame::pointer entry);
-    void recordEntry(EntryFrame::pointer entry);
+    void addLedgerEntry(HashedLedgerKey const& k, LedgerEntry const& entry);
+    void deleteLedgerEntry(HashedLedgerKey const& k);
+    void modLedgerEntry(HashedLedgerKey const& k, LedgerEntry const& entry);
+    void recordLedgerEntry(HashedLedgerKey const& k, LedgerEntry const& entry);
+
+    // entries of `m`, ordered by key, for output that must not depend on
+    // the hashes
+    static std::vector<KeyEntryMap::value_type const*>
+    sortedEntries(KeyEntryMap const& m);
 
     // merge "other" into current ledgerDelta
-    void mergeEntries(LedgerDelta& other);
+    void mergeEntries(LedgerDelta const& other);
+    // merge the changes of `inner`, being committed, into this delta: by
+    // taking its maps over when this delta changed nothing so far
+    void takeEntries(LedgerDelta& inner);
+
+    // Drops the order books an offer changed in this delta may have been
+    // in. Returns false if its books before this delta are not known.
+    bool invalidateOrderBooks(HashedLedgerKey const& key) const;
+
+    // Puts the value of a deferred entry before this delta back in the
+    // entry cache.
+    void restoreDeferredEntry(HashedLedgerKey const& key) const;
+
+    // counts the entries this delta touched in `hotKeys`
+    void recordHotKeys(HotKeys& hotKeys) const;
 
     // helper method that adds a meta entry to "changes"
     // with the previous value of an entry if needed
     void addCurrentMeta(LedgerEntryChanges& changes,
-                        LedgerKey const& key) const;
+                        HashedLedgerKey const& key) const;
 
   public:
     // keeps an internal reference to the outerDelta,
@@ -89,14 +120,43 @@ class LedgerDelta
 
     bool updateLastModified() const;
 
+    // Defers the SQL writes of the accounts and trust lines stored with this
+    // top level delta or its inner deltas: they are only applied to the entry
+    // cache, which must hold the whole ledger state (LEDGER_STATE_IN_MEMORY),
+    // until flushDeferredWrites. Must be called before inner deltas are
+    // created.
+    void deferWrites();
+    bool writesDeferred(LedgerEntryType type) const;
+
+    // Writes the deferred entries as seen from this delta, in bulk and sorted
+    // by key. Done by the top level delta before it is committed, and before
+    // queries reading those tables other than by key; entries written by
+    // inner deltas are written again by the top level delta.
+    void flushDeferredWrites();
+
     void markMeters(Application& app) const;
 
+    // Counts the entries touched by each delta committed into this one
+    // (not by their own inner deltas) in `hotKeys`: those it loaded, those
+    // it modified and those it created or deleted.
+    void trackHotKeys(HotKeys& hotKeys);
+
     // helper methods for generating data compatible with bucketlist
     std::vector<LedgerEntry> getLiveEntries() const;
     std::vector<LedgerKey> getDeadEntries() const;
 
     LedgerEntryChanges getChanges() const;
 
+    // Copy of the headers and entry changes of this delta, detached from the
+    // ledger: it can't be committed or rolled back and it outlives this delta
+    // (eg. to check invariants once the operation is applied).
+    std::unique_ptr<LedgerDelta> snapshot() const;
+
+    // Adds the changes of `later` to this snapshot, as committing it into
+    // this delta would, and takes its header (eg. to gather the changes made
+    // by all the operations of a ledger).
+    void append(LedgerDelta const& later);
+
     template <typename IterType, typename ValueType>
     class Iterator : public std::iterator<std::input_iterator_tag, ValueType>
     {
@@ -164,8 +224,7 @@ class LedgerDelta
         explicit DeletedLedgerEntry(LedgerDelta const& delta,
                                     LedgerKey const& value);
     };
-    typedef Iterator<std::set<LedgerKey, LedgerEntryIdCmp>::const_iterator,
-                     DeletedLedgerEntry>
+    typedef Iterator<KeySet::const_iterator, DeletedLedgerEntry>
         DeletedIterator;
     IteratorRange<DeletedIterator> deleted() const;
 };
@@ -296,6 +296,27 @@ TEST_CASE("Ledger delta", "[ledger][ledgerdelta]")
                              orgAccounts);
             }
         }
+        SECTION("modified entries, through a delta with no changes")
+        {
+            LedgerDelta delta2(delta);
+            MapAccounts modAccounts = accountsByKey;
+            {
+                LedgerDelta delta3(delta2);
+                size_t start = nbAccountsGroupSize * 2 / 3;
+                modEntries(start, start + nbAccountsGroupSize, delta3,
+                           modAccounts);
+                modEntries(nbAccountsGroupSize * 3, nbAccountsGroupSize * 4,
+                           delta3, modAccounts);
+                delta3.commit();
+            }
+            accountsByKey = modAccounts;
+            checkChanges(delta2, 0, nbAccountsGroupSize * 2, 0,
+                         nbAccountsGroupSize * 2, orgAccountsBeforeD2);
+            delta2.commit();
+            checkChanges(delta, nbAccountsGroupSize, nbAccountsGroupSize * 2,
+                         nbAccountsGroupSize, nbAccountsGroupSize * 3,
+                         orgAccounts);
+        }
         SECTION("deleted entries")
         {
             LedgerDelta delta2(delta);
@@ -6,11 +6,16 @@
 #include "LedgerDelta.h"
 #include "OfferFrame.h"
 #include "TrustFrame.h"
+#include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
+#include "crypto/SignerKey.h"
 #include "database/Database.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
 #include "lib/catch.hpp"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "main/Application.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
@@ -18,6 +23,7 @@
 #include "util/Timer.h"
 #include "xdrpp/autocheck.h"
 #include "xdrpp/marshal.h"
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <utility>
@@ -274,4 +280,306 @@ TEST_CASE("Ledger Entry tests", "[ledgerentry]")
         app->getLedgerManager().checkDbState();
     }
 }
+
+TEST_CASE("prefetch loads accounts and trustlines", "[ledgerentry]")
+{
+    Config cfg(getTestConfig(0));
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    LedgerHeader lh;
+    LedgerDelta delta(lh, db, false);
+
+    // More than one batch worth of accounts, each with a trustline.
+    std::unordered_set<LedgerKey, LedgerKeyHash> keys;
+    for (int i = 0; i < 100; ++i)
+    {
+        LedgerEntry acc;
+        acc.data.type(ACCOUNT);
+        acc.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        std::make_shared<AccountFrame>(acc)->storeAdd(delta, db);
+        keys.emplace(LedgerEntryKey(acc));
+
+        LedgerEntry tl;
+        tl.data.type(TRUSTLINE);
+        tl.data.trustLine() = LedgerTestUtils::generateValidTrustLineEntry(5);
+        tl.data.trustLine().accountID = acc.data.account().accountID;
+        std::make_shared<TrustFrame>(tl)->storeAdd(delta, db);
+        keys.emplace(LedgerEntryKey(tl));
+
+        if (i % 10 == 0)
+        {
+            // An entry that does not exist.
+            auto missing = LedgerEntryKey(tl);
+            missing.trustLine().asset =
+                LedgerTestUtils::generateValidTrustLineEntry(5).asset;
+            keys.emplace(missing);
+        }
+    }
+    LedgerEntry missing;
+    missing.data.type(ACCOUNT);
+    missing.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    keys.emplace(LedgerEntryKey(missing));
+
+    auto& cache = db.getEntryCache();
+    cache.clear();
+    auto& loads = app->getMetrics().NewMeter({"ledger", "prefetch", "load"},
+                                             "entry");
+    auto& hits =
+        app->getMetrics().NewMeter({"ledger", "prefetch", "hit"}, "entry");
+    auto loadsBefore = loads.count();
+    auto hitsBefore = hits.count();
+
+    EntryFrame::prefetch(db, keys);
+    REQUIRE(cache.size() == keys.size());
+    REQUIRE(loads.count() - loadsBefore == keys.size());
+
+    // Prefetched entries match what loading them one at a time gives.
+    std::unordered_map<LedgerKey, EntryCache::Value, LedgerKeyHash> fetched;
+    for (auto const& k : keys)
+    {
+        REQUIRE(cache.contains(k));
+        fetched.emplace(k, cache.get(k));
+    }
+    REQUIRE(hits.count() - hitsBefore == keys.size());
+
+    cache.clear();
+    for (auto const& f : fetched)
+    {
+        auto fromDb = EntryFrame::storeLoad(f.first, db);
+        if (f.second)
+        {
+            REQUIRE(fromDb);
+            REQUIRE(fromDb->mEntry == *f.second);
+        }
+        else
+        {
+            REQUIRE(!fromDb);
+        }
+    }
+
+    // Already cached keys are not loaded again.
+    loadsBefore = loads.count();
+    EntryFrame::prefetch(db, keys);
+    REQUIRE(loads.count() == loadsBefore);
+}
+
+TEST_CASE("account signers stored from the entry cache", "[ledgerentry]")
+{
+    Config cfg(getTestConfig(0));
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    LedgerHeader lh;
+    LedgerDelta delta(lh, db, false);
+
+    LedgerEntry le;
+    le.data.type(ACCOUNT);
+    auto& ae = le.data.account();
+    ae = LedgerTestUtils::generateValidAccountEntry(5);
+    ae.signers.clear();
+    for (int i = 0; i < 3; ++i)
+    {
+        ae.signers.emplace_back(
+            KeyUtils::convertKey<SignerKey>(
+                SecretKey::random().getPublicKey()),
+            i + 1);
+    }
+    ae.numSubEntries = static_cast<uint32>(ae.signers.size());
+    std::make_shared<AccountFrame>(le)->storeAdd(delta, db);
+
+    auto& signerLoads =
+        app->getMetrics().NewTimer({"database", "select", "signer"});
+    auto loadsBefore = signerLoads.count();
+
+    // loaded once into the cache
+    auto a = AccountFrame::loadAccount(ae.accountID, db);
+    REQUIRE(AccountFrame::loadAccount(ae.accountID, db));
+    REQUIRE(signerLoads.count() == loadsBefore + 1);
+
+    // not rewritten when unchanged
+    a = AccountFrame::loadAccount(ae.accountID, db);
+    a->getAccount().balance += 1;
+    a->storeChange(delta, db);
+    REQUIRE(signerLoads.count() == loadsBefore + 1);
+
+    // changed signers are diffed against the cached ones
+    a = AccountFrame::loadAccount(ae.accountID, db);
+    auto& signers = a->getAccount().signers;
+    REQUIRE(signers.size() == 3);
+    loadsBefore = signerLoads.count();
+    signers.erase(signers.begin());
+    signers[0].weight = 10;
+    signers.emplace_back(
+        KeyUtils::convertKey<SignerKey>(SecretKey::random().getPublicKey()),
+        5);
+    a->setUpdateSigners();
+    a->storeChange(delta, db);
+    REQUIRE(signerLoads.count() == loadsBefore);
+
+    db.getEntryCache().clear();
+    auto fromDb = AccountFrame::loadAccount(ae.accountID, db);
+    REQUIRE(fromDb->getAccount().signers == a->getAccount().signers);
+}
+
+TEST_CASE("inflation votes follow account changes", "[ledgerentry]")
+{
+    Config cfg(getTestConfig(0));
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    LedgerHeader lh;
+    LedgerDelta delta(lh, db, false);
+
+    auto votes = [&](std::string const& sql) {
+        std::map<std::string, int64_t> res;
+        std::string dest;
+        int64_t v;
+        soci::statement st = (db.getSession().prepare << sql, soci::into(v),
+                              soci::into(dest));
+        st.execute(true);
+        while (st.got_data())
+        {
+            res[dest] = v;
+            st.fetch();
+        }
+        return res;
+    };
+    auto check = [&]() {
+        auto expected = votes(
+            "SELECT sum(balance), inflationdest FROM accounts"
+            " WHERE inflationdest IS NOT NULL AND balance >= 1000000000"
+            " GROUP BY inflationdest");
+        REQUIRE(!expected.empty());
+        REQUIRE(votes("SELECT votes, inflationdest FROM inflationvotes"
+                      " WHERE votes > 0") == expected);
+    };
+
+    std::vector<AccountID> dests;
+    for (int i = 0; i < 3; ++i)
+    {
+        dests.emplace_back(SecretKey::random().getPublicKey());
+    }
+    autocheck::generator<int> gen;
+    auto randomize = [&](AccountEntry& ae) {
+        // around the 100 XLM needed to vote
+        ae.balance = 500000000 + std::abs(gen(1000)) * 1000000;
+        auto d = std::abs(gen(100)) % (dests.size() + 1);
+        ae.inflationDest.reset();
+        if (d < dests.size())
+        {
+            ae.inflationDest.activate() = dests[d];
+        }
+    };
+
+    std::vector<LedgerEntry> entries(40);
+    for (auto& le : entries)
+    {
+        le.data.type(ACCOUNT);
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        le.data.account().signers.clear();
+        le.data.account().numSubEntries = 0;
+        randomize(le.data.account());
+        std::make_shared<AccountFrame>(le)->storeAdd(delta, db);
+    }
+    check();
+
+    for (size_t i = 0; i < entries.size(); i += 2)
+    {
+        auto a = AccountFrame::loadAccount(entries[i].data.account().accountID,
+                                           db);
+        randomize(a->getAccount());
+        a->storeChange(delta, db);
+        entries[i] = a->mEntry;
+    }
+    check();
+
+    // replaced and deleted in bulk, as deferred writes and bucket apply do
+    std::vector<LedgerEntry> changed;
+    for (size_t i = 1; i < entries.size(); i += 3)
+    {
+        randomize(entries[i].data.account());
+        changed.push_back(entries[i]);
+    }
+    db.getEntryCache().clear();
+    AccountFrame::storeAddOrChangeBulk(db, changed);
+    check();
+
+    std::vector<LedgerKey> deleted;
+    for (size_t i = 0; i < entries.size(); i += 4)
+    {
+        deleted.push_back(LedgerEntryKey(entries[i]));
+    }
+    AccountFrame::storeDeleteBulk(db, deleted);
+    db.getEntryCache().clear();
+    check();
+}
+
+TEST_CASE("unchanged entries are not updated", "[ledgerentry]")
+{
+    Config cfg(getTestConfig(0));
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    LedgerHeader lh;
+    lh.ledgerSeq = 5;
+    LedgerDelta delta(lh, db, true);
+
+    LedgerEntry acc;
+    acc.data.type(ACCOUNT);
+    acc.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    std::make_shared<AccountFrame>(acc)->storeAdd(delta, db);
+
+    LedgerEntry tl;
+    tl.data.type(TRUSTLINE);
+    tl.data.trustLine() = LedgerTestUtils::generateValidTrustLineEntry(5);
+    tl.data.trustLine().accountID = acc.data.account().accountID;
+    std::make_shared<TrustFrame>(tl)->storeAdd(delta, db);
+
+    auto& avoided = app->getMetrics().NewMeter(
+        {"database", "avoided-update", "account"}, "query");
+    auto& updates =
+        app->getMetrics().NewTimer({"database", "update", "account"});
+    auto& avoidedTrust = app->getMetrics().NewMeter(
+        {"database", "avoided-update", "trust"}, "query");
+
+    auto a = AccountFrame::loadAccount(acc.data.account().accountID, db);
+    auto t = TrustFrame::loadTrustLine(tl.data.trustLine().accountID,
+                                       tl.data.trustLine().asset, db);
+    REQUIRE(a);
+    REQUIRE(t);
+
+    auto avoidedBefore = avoided.count();
+    auto updatesBefore = updates.count();
+    a->storeChange(delta, db);
+    t->storeChange(delta, db);
+    REQUIRE(avoided.count() == avoidedBefore + 1);
+    REQUIRE(avoidedTrust.count() == 1);
+    REQUIRE(updates.count() == updatesBefore);
+
+    // still recorded as modified
+    REQUIRE(delta.getChanges().size() == 2);
+
+    // changed entries are written
+    a = AccountFrame::loadAccount(acc.data.account().accountID, db);
+    a->getAccount().balance += 1;
+    a->storeChange(delta, db);
+    REQUIRE(updates.count() == updatesBefore + 1);
+    db.getEntryCache().clear();
+    REQUIRE(AccountFrame::loadAccount(acc.data.account().accountID, db)
+                ->getAccount()
+                .balance == a->getAccount().balance);
+}
 }
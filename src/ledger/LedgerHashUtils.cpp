@@ -0,0 +1,113 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHashUtils.h"
+#include "util/XDROperators.h"
+
+#include <string>
+
+namespace stellar
+{
+
+namespace
+{
+void
+hashCombine(size_t& seed, size_t v)
+{
+    seed ^= v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+template <typename T>
+void
+hashBytes(size_t& seed, T const& bytes)
+{
+    // Fold the whole value in, 8 bytes at a time: account IDs are chosen by
+    // their owners, so hashing just a prefix would be easy to collide.
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8)
+    {
+        uint64_t w = 0;
+        for (size_t j = 0; j < 8; ++j)
+        {
+            w = (w << 8) | static_cast<uint8_t>(bytes[i + j]);
+        }
+        hashCombine(seed, static_cast<size_t>(w));
+    }
+    for (; i < bytes.size(); ++i)
+    {
+        hashCombine(seed, static_cast<uint8_t>(bytes[i]));
+    }
+}
+
+void
+hashAccount(size_t& seed, AccountID const& id)
+{
+    hashBytes(seed, id.ed25519());
+}
+
+void
+hashAsset(size_t& seed, Asset const& asset)
+{
+    hashCombine(seed, asset.type());
+    switch (asset.type())
+    {
+    case ASSET_TYPE_NATIVE:
+        break;
+    case ASSET_TYPE_CREDIT_ALPHANUM4:
+        hashBytes(seed, asset.alphaNum4().assetCode);
+        hashAccount(seed, asset.alphaNum4().issuer);
+        break;
+    case ASSET_TYPE_CREDIT_ALPHANUM12:
+        hashBytes(seed, asset.alphaNum12().assetCode);
+        hashAccount(seed, asset.alphaNum12().issuer);
+        break;
+    }
+}
+}
+
+size_t
+LedgerKeyHash::operator()(LedgerKey const& key) const
+{
+    size_t res = key.type();
+    switch (key.type())
+    {
+    case ACCOUNT:
+        hashAccount(res, key.account().accountID);
+        break;
+    case TRUSTLINE:
+        hashAccount(res, key.trustLine().accountID);
+        hashAsset(res, key.trustLine().asset);
+        break;
+    case OFFER:
+        hashAccount(res, key.offer().sellerID);
+        hashCombine(res, std::hash<uint64_t>()(key.offer().offerID));
+        break;
+    case DATA:
+        hashAccount(res, key.data().accountID);
+        hashCombine(res, std::hash<std::string>()(key.data().dataName));
+        break;
+    }
+    return res;
+}
+
+HashedLedgerKey::HashedLedgerKey() : mHash(LedgerKeyHash()(mKey))
+{
+}
+
+HashedLedgerKey::HashedLedgerKey(LedgerKey const& key)
+    : mKey(key), mHash(LedgerKeyHash()(mKey))
+{
+}
+
+HashedLedgerKey::HashedLedgerKey(LedgerKey&& key)
+    : mKey(std::move(key)), mHash(LedgerKeyHash()(mKey))
+{
+}
+
+bool
+HashedLedgerKey::operator==(HashedLedgerKey const& other) const
+{
+    return mHash == other.mHash && mKey == other.mKey;
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+
+#include <functional>
+
+namespace stellar
+{
+
+// Hashes the fields identifying the entry, see LedgerEntryIdCmp.
+struct LedgerKeyHash
+{
+    size_t operator()(LedgerKey const& key) const;
+};
+
+/**
+ * LedgerKey carrying its hash, computed once when the key is built instead
+ * of on every lookup. Keys with different hashes compare unequal without
+ * looking at their fields, which spares comparing account IDs, asset codes
+ * and data names whenever a lookup probes past other keys.
+ *
+ * Converts implicitly from LedgerKey, so maps keyed by it can be used with
+ * plain keys; callers looking up one key in several maps should build the
+ * HashedLedgerKey once.
+ */
+class HashedLedgerKey
+{
+    LedgerKey mKey;
+    size_t mHash;
+
+  public:
+    HashedLedgerKey();
+    HashedLedgerKey(LedgerKey const& key);
+    HashedLedgerKey(LedgerKey&& key);
+
+    LedgerKey const&
+    key() const
+    {
+        return mKey;
+    }
+
+    size_t
+    hash() const
+    {
+        return mHash;
+    }
+
+    bool operator==(HashedLedgerKey const& other) const;
+    bool
+    operator!=(HashedLedgerKey const& other) const
+    {
+        return !(*this == other);
+    }
+};
+}
+
+namespace std
+{
+template <> struct hash<stellar::HashedLedgerKey>
+{
+    size_t
+    operator()(stellar::HashedLedgerKey const& key) const noexcept
+    {
+        return key.hash();
+    }
+};
+}
@@ -0,0 +1,127 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHeaderCache.h"
+#include "util/XDROperators.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+namespace stellar
+{
+
+LedgerHeaderCache::LedgerHeaderCache(medida::MetricsRegistry& metrics)
+    : mRecent(RECENT_HEADERS)
+    , mOlder(OLDER_HEADERS)
+    , mSeqByHash(RECENT_HEADERS + OLDER_HEADERS)
+    , mHits(metrics.NewMeter({"ledger", "header-cache", "hit"}, "header"))
+    , mMisses(metrics.NewMeter({"ledger", "header-cache", "miss"}, "header"))
+{
+}
+
+LedgerHeaderCache::Entry const*
+LedgerHeaderCache::find(uint32_t seq)
+{
+    auto const& recent = mRecent[seq % RECENT_HEADERS];
+    if (recent.mValid && recent.mHeader.ledgerSeq == seq)
+    {
+        return &recent;
+    }
+    if (mOlder.exists(seq))
+    {
+        return &mOlder.get(seq);
+    }
+    return nullptr;
+}
+
+void
+LedgerHeaderCache::putRecent(Hash const& hash, LedgerHeader const& header)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& e = mRecent[header.ledgerSeq % RECENT_HEADERS];
+    e.mValid = true;
+    e.mHash = hash;
+    e.mHeader = header;
+    mOlder.erase_if_exists(header.ledgerSeq);
+    mSeqByHash.put(hash, header.ledgerSeq);
+}
+
+void
+LedgerHeaderCache::putLoaded(Hash const& hash, LedgerHeader const& header)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (find(header.ledgerSeq))
+    {
+        return;
+    }
+    Entry e;
+    e.mValid = true;
+    e.mHash = hash;
+    e.mHeader = header;
+    mOlder.put(header.ledgerSeq, e);
+    mSeqByHash.put(hash, header.ledgerSeq);
+}
+
+bool
+LedgerHeaderCache::getBySequence(uint32_t seq, Hash& hash,
+                                 LedgerHeader& header)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto e = find(seq);
+    if (!e)
+    {
+        mMisses.Mark();
+        return false;
+    }
+    mHits.Mark();
+    hash = e->mHash;
+    header = e->mHeader;
+    return true;
+}
+
+bool
+LedgerHeaderCache::getByHash(Hash const& hash, LedgerHeader& header)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mSeqByHash.exists(hash))
+    {
+        // the header may have been evicted or erased since
+        auto e = find(mSeqByHash.get(hash));
+        if (e && e->mHash == hash)
+        {
+            mHits.Mark();
+            header = e->mHeader;
+            return true;
+        }
+        mSeqByHash.erase_if_exists(hash);
+    }
+    mMisses.Mark();
+    return false;
+}
+
+void
+LedgerHeaderCache::eraseUpTo(uint32_t seq)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& e : mRecent)
+    {
+        if (e.mValid && e.mHeader.ledgerSeq <= seq)
+        {
+            e.mValid = false;
+        }
+    }
+    mOlder.erase_if(
+        [seq](Entry const& e) { return e.mHeader.ledgerSeq <= seq; });
+    mSeqByHash.erase_if([seq](uint32_t s) { return s <= seq; });
+}
+
+void
+LedgerHeaderCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRecent.assign(RECENT_HEADERS, Entry());
+    mOlder.clear();
+    mSeqByHash.clear();
+}
+}
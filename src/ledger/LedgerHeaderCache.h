@@ -0,0 +1,78 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/HashOfHash.h"
+#include "util/NonCopyable.h"
+#include "util/lrucache.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+/**
+ * LedgerHeaderCache is the Database's cache of rows of the ledgerheaders
+ * table, which never change once written: the headers of the last
+ * RECENT_HEADERS ledgers stored, in a ring indexed by sequence, and the
+ * OLDER_HEADERS most recently loaded others, in an LRU. Headers are looked
+ * up by sequence or by hash.
+ *
+ * Rows are only ever deleted by LedgerHeaderFrame::deleteOldEntries and
+ * dropAll, which erase the matching headers here. Unlike the rest of
+ * Database this can be used from any thread: history publishing loads
+ * headers through its own session on a worker thread.
+ */
+class LedgerHeaderCache : NonMovableOrCopyable
+{
+  public:
+    static size_t const RECENT_HEADERS = 64;
+    static size_t const OLDER_HEADERS = 256;
+
+  private:
+    struct Entry
+    {
+        bool mValid{false};
+        Hash mHash;
+        LedgerHeader mHeader;
+    };
+
+    std::mutex mMutex;
+    // by ledgerSeq % RECENT_HEADERS
+    std::vector<Entry> mRecent;
+    cache::lru_cache<uint32_t, Entry> mOlder;
+    cache::lru_cache<Hash, uint32_t> mSeqByHash;
+
+    medida::Meter& mHits;
+    medida::Meter& mMisses;
+
+    Entry const* find(uint32_t seq);
+
+  public:
+    explicit LedgerHeaderCache(medida::MetricsRegistry& metrics);
+
+    // Adds the header of a ledger just stored.
+    void putRecent(Hash const& hash, LedgerHeader const& header);
+    // Adds a header loaded from the database.
+    void putLoaded(Hash const& hash, LedgerHeader const& header);
+
+    // Copy `header` and `hash` out of the cached header of `seq` (resp. of
+    // hash `hash`), if cached. Counts a hit or a miss.
+    bool getBySequence(uint32_t seq, Hash& hash, LedgerHeader& header);
+    bool getByHash(Hash const& hash, LedgerHeader& header);
+
+    // Erases the headers of sequence at most `seq`.
+    void eraseUpTo(uint32_t seq);
+    void clear();
+};
+}
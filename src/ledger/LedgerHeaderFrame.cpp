@@ -128,6 +128,7 @@ LedgerHeaderFrame::storeInsert(LedgerManager& ledgerManager) const
     {
         throw std::runtime_error("Could not update data in SQL");
     }
+    db.getLedgerHeaderCache().putRecent(mHash, mHeader);
 }
 
 LedgerHeaderFrame::pointer
@@ -153,6 +154,13 @@ LedgerHeaderFrame::pointer
 LedgerHeaderFrame::loadByHash(Hash const& hash, Database& db)
 {
     LedgerHeaderFrame::pointer lhf;
+    LedgerHeader header;
+    if (db.getLedgerHeaderCache().getByHash(hash, header))
+    {
+        lhf = make_shared<LedgerHeaderFrame>(header);
+        lhf->mHash = hash;
+        return lhf;
+    }
 
     string hash_s(binToHex(hash));
     string headerEncoded;
@@ -175,6 +183,10 @@ LedgerHeaderFrame::loadByHash(Hash const& hash, Database& db)
             // wrong hash
             lhf.reset();
         }
+        else
+        {
+            db.getLedgerHeaderCache().putLoaded(hash, lhf->mHeader);
+        }
     }
 
     return lhf;
@@ -185,6 +197,14 @@ LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
                                   soci::session& sess)
 {
     LedgerHeaderFrame::pointer lhf;
+    Hash hash;
+    LedgerHeader header;
+    if (db.getLedgerHeaderCache().getBySequence(seq, hash, header))
+    {
+        lhf = make_shared<LedgerHeaderFrame>(header);
+        lhf->mHash = hash;
+        return lhf;
+    }
 
     string headerEncoded;
     {
@@ -205,6 +225,7 @@ LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
                             "loaded ledger {} contains {}",
                             seq, loadedSeq));
         }
+        db.getLedgerHeaderCache().putLoaded(lhf->getHash(), lhf->mHeader);
     }
 
     return lhf;
@@ -221,42 +242,56 @@ LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
     size_t n = 0;
 
     string headerEncoded;
+    uint32_t curLedgerSeq;
 
     assert(begin <= end);
 
     soci::statement st =
-        (sess.prepare << "SELECT data FROM ledgerheaders "
+        (sess.prepare << "SELECT ledgerseq, data FROM ledgerheaders "
                          "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
                          "BY ledgerseq ASC",
-         into(headerEncoded), use(begin), use(end));
+         into(curLedgerSeq), into(headerEncoded), use(begin), use(end));
 
+    // A LedgerHeaderHistoryEntry is the hash of the header, the header as
+    // stored, and an empty extension: it is written as such rather than
+    // decoded and encoded again.
+    std::vector<uint8_t> entry;
     st.execute(true);
     while (st.got_data())
     {
-        LedgerHeaderHistoryEntry lhe;
-        LedgerHeaderFrame::pointer lhf = decodeFromData(headerEncoded);
-        lhe.hash = lhf->getHash();
-        lhe.header = lhf->mHeader;
-        CLOG(DEBUG, "Ledger")
-            << "Streaming ledger-header " << lhe.header.ledgerSeq;
-        headersOut.writeOne(lhe);
+        entry.resize(sizeof(Hash));
+        decoder::decode_b64(headerEncoded.begin(), headerEncoded.end(),
+                            std::back_inserter(entry));
+        auto hash = sha256(ByteSlice(entry.data() + sizeof(Hash),
+                                     entry.size() - sizeof(Hash)));
+        std::copy(hash.begin(), hash.end(), entry.begin());
+        entry.insert(entry.end(), 4, 0);
+        CLOG(DEBUG, "Ledger") << "Streaming ledger-header " << curLedgerSeq;
+        if (!headersOut.writeRaw(reinterpret_cast<char const*>(entry.data()),
+                                 static_cast<uint32_t>(entry.size())))
+        {
+            throw std::runtime_error("failed to write ledger headers");
+        }
         ++n;
         st.fetch();
     }
     return n;
 }
 
-void
+uint32_t
 LedgerHeaderFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                     uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "ledgerheaders", "ledgerseq");
+    auto deleted = DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "ledgerheaders", "ledgerseq");
+    db.getLedgerHeaderCache().eraseUpTo(deleted);
+    return deleted;
 }
 
 void
 LedgerHeaderFrame::dropAll(Database& db)
 {
+    db.getLedgerHeaderCache().clear();
     db.getSession() << "DROP TABLE IF EXISTS ledgerheaders;";
 
     db.getSession() << "CREATE TABLE ledgerheaders ("
@@ -55,8 +55,8 @@ class LedgerHeaderFrame
                                             uint32_t ledgerCount,
                                             XDROutputFileStream& headersOut);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                 uint32_t count);
+    static uint32_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                     uint32_t count);
 
     static void dropAll(Database& db);
 
@@ -3,11 +3,16 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "util/asio.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/LedgerHeaderCache.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Logging.h"
@@ -89,6 +94,36 @@ TEST_CASE("ledgerheader", "[ledger]")
         REQUIRE(saved ==
                 app2->getLedgerManager().getLastClosedLedgerHeader().hash);
     }
+
+    SECTION("ledger is known before the BucketList is restored")
+    {
+        Config cfg2(cfg);
+        cfg2.FORCE_SCP = false;
+        VirtualClock clock2;
+        Application::pointer app2 = Application::create(clock2, cfg2, false);
+        auto& lm = app2->getLedgerManager();
+
+        bool done = false;
+        lm.loadLastKnownLedger([&done](asio::error_code const& ec) {
+            REQUIRE(!ec);
+            done = true;
+        });
+        REQUIRE(saved == lm.getLastClosedLedgerHeader().hash);
+        REQUIRE(!lm.isReadyToCloseLedgers());
+
+        while (!done && clock2.crank(true))
+            ;
+        REQUIRE(lm.isReadyToCloseLedgers());
+        REQUIRE(app2->getBucketManager().getBucketList().getHash() ==
+                lm.getLastClosedLedgerHeader().header.bucketListHash);
+
+        auto& metrics = app2->getMetrics();
+        REQUIRE(metrics.NewTimer({"app", "startup", "load-ledger"}).count() ==
+                1);
+        REQUIRE(
+            metrics.NewTimer({"app", "startup", "restore-buckets"}).count() ==
+            1);
+    }
 }
 
 TEST_CASE("base reserve", "[ledger]")
@@ -112,3 +147,49 @@ TEST_CASE("base reserve", "[ledger]")
         REQUIRE(app->getLedgerManager().getMinBalance(n) == expectedReserve);
     });
 }
+
+TEST_CASE("ledger header cache", "[ledger]")
+{
+    medida::MetricsRegistry metrics;
+    LedgerHeaderCache cache(metrics);
+    auto header = [](uint32_t seq) {
+        LedgerHeader lh;
+        lh.ledgerSeq = seq;
+        return lh;
+    };
+    auto hash = [](uint32_t seq) {
+        Hash h;
+        h[0] = static_cast<uint8_t>(seq);
+        h[1] = static_cast<uint8_t>(seq >> 8);
+        return h;
+    };
+
+    uint32_t const last = LedgerHeaderCache::RECENT_HEADERS + 10;
+    for (uint32_t seq = 1; seq <= last; ++seq)
+    {
+        cache.putRecent(hash(seq), header(seq));
+    }
+
+    Hash h;
+    LedgerHeader lh;
+    REQUIRE(cache.getBySequence(last, h, lh));
+    REQUIRE(h == hash(last));
+    REQUIRE(lh.ledgerSeq == last);
+    REQUIRE(cache.getByHash(hash(last - 1), lh));
+    REQUIRE(lh.ledgerSeq == last - 1);
+
+    // pushed out of the ring by later ledgers
+    REQUIRE(!cache.getBySequence(5, h, lh));
+    REQUIRE(!cache.getByHash(hash(5), lh));
+    cache.putLoaded(hash(5), header(5));
+    REQUIRE(cache.getBySequence(5, h, lh));
+    REQUIRE(cache.getByHash(hash(5), lh));
+
+    cache.eraseUpTo(last - 1);
+    REQUIRE(!cache.getBySequence(5, h, lh));
+    REQUIRE(!cache.getBySequence(last - 1, h, lh));
+    REQUIRE(cache.getBySequence(last, h, lh));
+
+    cache.clear();
+    REQUIRE(!cache.getBySequence(last, h, lh));
+}
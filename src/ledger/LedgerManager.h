@@ -6,6 +6,7 @@
 
 #include "catchup/CatchupManager.h"
 #include "history/HistoryManager.h"
+#include <chrono>
 #include <memory>
 
 namespace stellar
@@ -13,7 +14,11 @@ namespace stellar
 
 class LedgerHeaderFrame;
 class LedgerCloseData;
+class LedgerStateSnapshot;
 class Database;
+class ApplyCostModel;
+class HotKeys;
+class OperationMetrics;
 
 /**
  * LedgerManager maintains, in memory, a logical pair of ledgers:
@@ -145,14 +150,46 @@ class LedgerManager
 
     virtual Database& getDatabase() = 0;
 
+    // Apply times measured per operation type, see ApplyCostModel.
+    virtual ApplyCostModel& getApplyCostModel() = 0;
+
+    // Metrics updated for every operation applied, see OperationMetrics.
+    virtual OperationMetrics& getOperationMetrics() = 0;
+
+    // Ledger entries touched most by the last ledgers, see HotKeys.
+    virtual HotKeys& getHotKeys() = 0;
+
     // Called by application lifecycle events, system startup.
     virtual void startNewLedger() = 0;
 
+    // Calls `callback` after each ledger closed from now on, with the time
+    // closeLedger took, until removeLedgerClosedCallback is called with the
+    // returned id.
+    using LedgerClosedCallback = std::function<void(
+        LedgerCloseData const&, std::chrono::nanoseconds closeTime)>;
+    virtual uint64_t addLedgerClosedCallback(LedgerClosedCallback callback) = 0;
+    virtual void removeLedgerClosedCallback(uint64_t id) = 0;
+
+    // A read-only view of the ledger state as of the last closed ledger, for
+    // other threads to read from while ledgers close (see
+    // LedgerStateSnapshot). Callers asking for the same ledger share a
+    // snapshot while any of them holds it. nullptr when the database cannot
+    // provide one. Main thread only.
+    virtual std::shared_ptr<LedgerStateSnapshot> getLastClosedSnapshot() = 0;
+
     // loads the last ledger information from the database
     // if handler is set, also loads bucket information and invokes handler.
+    // The bucket information is loaded after this returns, from the main
+    // io_service (downloading missing buckets first if needed), so that the
+    // caller can start serving peers and HTTP in the meantime; ledgers
+    // externalized until then are held back and closed once it is loaded.
     virtual void loadLastKnownLedger(
         std::function<void(asio::error_code const& ec)> handler) = 0;
 
+    // False while loadLastKnownLedger is restoring the BucketList, when no
+    // ledger can be closed.
+    virtual bool isReadyToCloseLedgers() const = 0;
+
     // Forcibly switch the application into catchup mode, treating `toLedger`
     // as the destination ledger number and count as the number of past ledgers
     // that should be replayed. Normally this happens automatically when
@@ -189,9 +226,19 @@ class LedgerManager
     // permit testing.
     virtual void closeLedger(LedgerCloseData const& ledgerData) = 0;
 
-    // deletes old entries stored in the database
-    virtual void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                  uint32_t count) = 0;
+    // Ledgers closed between beginReplayBatch() and endReplayBatch() are
+    // committed to the database together at the end, as done when replaying
+    // history. Starting queued history publication and forgetting
+    // unreferenced buckets are left to endReplayBatch() too, as the buckets
+    // referenced by the last committed state must stay around until then.
+    // The caller must end the batch, whether the closes succeeded or not.
+    virtual void beginReplayBatch() = 0;
+    virtual void endReplayBatch() = 0;
+
+    // deletes old entries stored in the database, at most `count` ledgers
+    // of each table; returns the ledger up to which they are all gone
+    virtual uint32_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                      uint32_t count) = 0;
 
     // checks the database for inconsistencies between objects
     virtual void checkDbState() = 0;
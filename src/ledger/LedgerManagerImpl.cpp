@@ -17,25 +17,31 @@
 #include "herder/LedgerCloseData.h"
 #include "herder/TxSetFrame.h"
 #include "herder/Upgrades.h"
+#include "history/CheckpointBuilder.h"
 #include "history/HistoryManager.h"
 #include "invariant/InvariantDoesNotHold.h"
 #include "invariant/InvariantManager.h"
+#include "ledger/EntryFrame.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerStateSnapshot.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
 #include "util/Logging.h"
+#include "util/Profiler.h"
 #include "util/XDROperators.h"
 #include "util/format.h"
 
 #include "medida/counter.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "xdrpp/printer.h"
 #include "xdrpp/types.h"
 
+#include <algorithm>
 #include <chrono>
 #include <sstream>
 
@@ -111,9 +117,14 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     : mApp(app)
     , mTransactionApply(
           app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
+    , mTransactionPrefetch(
+          app.getMetrics().NewTimer({"ledger", "transaction", "prefetch"}))
     , mTransactionCount(
           app.getMetrics().NewHistogram({"ledger", "transaction", "count"}))
-    , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
+    , mTransactionPartitions(app.getMetrics().NewHistogram(
+          {"ledger", "transaction", "partitions"}))
+    , mLedgerClose(
+          app.getLatencyHistograms().NewTimer({"ledger", "ledger", "close"}))
     , mLedgerAgeClosed(app.getMetrics().NewTimer({"ledger", "age", "closed"}))
     , mLedgerAge(
           app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
@@ -125,9 +136,29 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mLastStateChange(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "syncing-ledgers"}))
+    , mStartupLoadLedger(
+          app.getMetrics().NewTimer({"app", "startup", "load-ledger"}))
+    , mStartupRestoreBuckets(
+          app.getMetrics().NewTimer({"app", "startup", "restore-buckets"}))
+    , mOperationMetrics(app.getMetrics())
+    , mHotKeys(app.getConfig().HOT_KEYS_TRACKED)
     , mState(LM_BOOTING_STATE)
 
 {
+    auto const& cfg = app.getConfig();
+    if (!cfg.METADATA_OUTPUT_STREAM.empty())
+    {
+        mMetaStream = std::make_unique<LedgerCloseMetaStream>(
+            app, cfg.METADATA_OUTPUT_STREAM,
+            cfg.METADATA_OUTPUT_ROTATE_LEDGERS);
+    }
+}
+
+LedgerManagerImpl::~LedgerManagerImpl()
+{
+    // The database is gone by now, and an unfinished batch with it: there is
+    // nothing left to roll back.
+    mReplayBatch.release();
 }
 
 void
@@ -205,6 +236,9 @@ LedgerManagerImpl::startNewLedger(LedgerHeader genesisLedger)
 {
     DBTimeExcluder qtExclude(mApp);
     auto ledgerTime = mLedgerClose.TimeScope();
+    mCloseTrace = std::make_unique<LedgerCloseTrace>(
+        mApp, mCurrentLedger->mHeader.ledgerSeq);
+    closePhase("prefetch");
     SecretKey skey = SecretKey::fromSeed(mApp.getNetworkID());
 
     AccountFrame masterAccount(skey.getPublicKey());
@@ -241,6 +275,7 @@ LedgerManagerImpl::loadLastKnownLedger(
 {
     DBTimeExcluder qtExclude(mApp);
     auto ledgerTime = mLedgerClose.TimeScope();
+    auto loadTime = mStartupLoadLedger.TimeScope();
 
     string lastLedger =
         mApp.getPersistentState().getState(PersistentState::kLastClosedLedger);
@@ -261,6 +296,16 @@ LedgerManagerImpl::loadLastKnownLedger(
             throw std::runtime_error("Could not load ledger from database");
         }
 
+        if (mApp.getConfig().LEDGER_STATE_IN_MEMORY)
+        {
+            LOG(INFO) << "Loading ledger state into memory";
+            EntryFrame::loadLedgerStateIntoCache(getDatabase());
+        }
+
+        CLOG(INFO, "Ledger") << "Loaded last known ledger: "
+                             << ledgerAbbrev(mCurrentLedger);
+        advanceLedgerPointers();
+
         if (handler)
         {
             string hasString = mApp.getPersistentState().getState(
@@ -268,49 +313,90 @@ LedgerManagerImpl::loadLastKnownLedger(
             HistoryArchiveState has;
             has.fromString(hasString);
 
-            auto continuation = [this, handler,
-                                 has](asio::error_code const& ec) {
-                if (ec)
-                {
-                    handler(ec);
-                }
-                else
-                {
-                    mApp.getBucketManager().assumeState(has);
-
-                    CLOG(INFO, "Ledger") << "Loaded last known ledger: "
-                                         << ledgerAbbrev(mCurrentLedger);
+            mReadyToClose = false;
+            mApp.getClock().getIOService().post(
+                [this, has, handler]() { restoreBuckets(has, handler); });
+        }
+    }
+}
 
-                    advanceLedgerPointers();
-                    handler(ec);
-                }
-            };
-
-            auto missing =
-                mApp.getBucketManager().checkForMissingBucketsFiles(has);
-            auto pubmissing = mApp.getHistoryManager()
-                                  .getMissingBucketsReferencedByPublishQueue();
-            missing.insert(missing.end(), pubmissing.begin(), pubmissing.end());
-            if (!missing.empty())
-            {
-                CLOG(WARNING, "Ledger")
-                    << "Some buckets are missing in '"
-                    << mApp.getBucketManager().getBucketDir() << "'.";
-                CLOG(WARNING, "Ledger")
-                    << "Attempting to recover from the history store.";
-                mApp.getHistoryManager().downloadMissingBuckets(has,
-                                                                continuation);
-            }
-            else
-            {
-                continuation(asio::error_code());
-            }
+void
+LedgerManagerImpl::restoreBuckets(
+    HistoryArchiveState const& has,
+    function<void(asio::error_code const& ec)> handler)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto continuation = [this, handler, has,
+                         start](asio::error_code const& ec) {
+        if (ec)
+        {
+            handler(ec);
+            return;
         }
-        else
+        mApp.getBucketManager().assumeState(has);
+        mStartupRestoreBuckets.Update(std::chrono::steady_clock::now() -
+                                      start);
+        CLOG(INFO, "Ledger") << "Restored BucketList, ready to close ledgers";
+        mReadyToClose = true;
+
+        auto held = std::move(mHeldBackLedgers);
+        mHeldBackLedgers.clear();
+        for (auto const& ledgerData : held)
         {
-            advanceLedgerPointers();
+            valueExternalized(ledgerData);
         }
+        handler(ec);
+    };
+
+    auto missing = mApp.getBucketManager().checkForMissingBucketsFiles(has);
+    auto pubmissing =
+        mApp.getHistoryManager().getMissingBucketsReferencedByPublishQueue();
+    missing.insert(missing.end(), pubmissing.begin(), pubmissing.end());
+    if (!missing.empty())
+    {
+        CLOG(WARNING, "Ledger") << "Some buckets are missing in '"
+                                << mApp.getBucketManager().getBucketDir()
+                                << "'.";
+        CLOG(WARNING, "Ledger")
+            << "Attempting to recover from the history store.";
+        mApp.getHistoryManager().downloadMissingBuckets(has, continuation);
     }
+    else
+    {
+        continuation(asio::error_code());
+    }
+}
+
+bool
+LedgerManagerImpl::isReadyToCloseLedgers() const
+{
+    return mReadyToClose;
+}
+
+uint64_t
+LedgerManagerImpl::addLedgerClosedCallback(LedgerClosedCallback callback)
+{
+    auto id = mNextLedgerClosedCallback++;
+    mLedgerClosedCallbacks.emplace(id, callback);
+    return id;
+}
+
+void
+LedgerManagerImpl::removeLedgerClosedCallback(uint64_t id)
+{
+    mLedgerClosedCallbacks.erase(id);
+}
+
+std::shared_ptr<LedgerStateSnapshot>
+LedgerManagerImpl::getLastClosedSnapshot()
+{
+    auto res = mLastClosedSnapshot.lock();
+    if (!res || res->getLedgerSeq() != getLastClosedLedgerNum())
+    {
+        res = LedgerStateSnapshot::create(mApp);
+        mLastClosedSnapshot = res;
+    }
+    return res;
 }
 
 Database&
@@ -319,6 +405,24 @@ LedgerManagerImpl::getDatabase()
     return mApp.getDatabase();
 }
 
+ApplyCostModel&
+LedgerManagerImpl::getApplyCostModel()
+{
+    return mApplyCostModel;
+}
+
+OperationMetrics&
+LedgerManagerImpl::getOperationMetrics()
+{
+    return mOperationMetrics;
+}
+
+HotKeys&
+LedgerManagerImpl::getHotKeys()
+{
+    return mHotKeys;
+}
+
 uint32_t
 LedgerManagerImpl::getTxFee() const
 {
@@ -402,6 +506,15 @@ LedgerManagerImpl::valueExternalized(LedgerCloseData const& ledgerData)
         << ", tx_count=" << ledgerData.getTxSet()->size()
         << ", sv: " << stellarValueToString(ledgerData.getValue()) << "]";
 
+    if (!mReadyToClose)
+    {
+        CLOG(INFO, "Ledger") << "Holding back ledger "
+                             << ledgerData.getLedgerSeq()
+                             << " until the BucketList is restored";
+        mHeldBackLedgers.push_back(ledgerData);
+        return;
+    }
+
     auto st = getState();
     switch (st)
     {
@@ -553,6 +666,9 @@ LedgerManagerImpl::addToSyncingLedgers(LedgerCloseData const& ledgerData)
         CLOG(INFO, "Ledger")
             << "Close of ledger " << ledgerData.getLedgerSeq() << " buffered";
         mSyncingLedgersSize.set_count(mSyncingLedgers.size());
+        // the workers check its signatures while catchup goes on, so that
+        // replaying it after catchup mostly hits the verify cache
+        ledgerData.getTxSet()->startMasterKeySignatureChecks(mApp);
         return;
     case SyncingLedgerChainAddResult::TOO_OLD:
         CLOG(INFO, "Ledger")
@@ -720,9 +836,28 @@ LedgerManagerImpl::historyCaughtup(asio::error_code const& ec,
                              << ledgerAbbrev(mLastClosedLedger);
         mApp.getCatchupManager().historyCaughtup();
 
-        // Now replay remaining txs from buffered local network history.
-        for (auto const& lcd : mSyncingLedgers)
+        // Now replay remaining txs from buffered local network history,
+        // loading the entries of the next few ledgers in bulk ahead of them
+        // rather than a ledger at a time.
+        auto prefetchedEnd = mSyncingLedgers.begin();
+        for (auto it = mSyncingLedgers.begin(); it != mSyncingLedgers.end();
+             ++it)
         {
+            if (it == prefetchedEnd)
+            {
+                auto window = static_cast<ptrdiff_t>(REPLAY_PREFETCH_LEDGERS);
+                prefetchedEnd =
+                    it + std::min(window, mSyncingLedgers.end() - it);
+                std::vector<TransactionFramePtr> txs;
+                for (auto next = it; next != prefetchedEnd; ++next)
+                {
+                    auto applyOrder = next->getTxSet()->sortForApply();
+                    txs.insert(txs.end(), applyOrder.begin(),
+                               applyOrder.end());
+                }
+                prefetchTransactionData(txs);
+            }
+            auto const& lcd = *it;
             assert(lcd.getLedgerSeq() ==
                    mLastClosedLedger.header.ledgerSeq + 1);
             CLOG(INFO, "Ledger")
@@ -779,6 +914,8 @@ during replays.
 void
 LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
 {
+    auto closeStart = std::chrono::steady_clock::now();
+    ProfileScope profileScope("ledger-close");
     DBTimeExcluder qtExclude(mApp);
     CLOG(DEBUG, "Ledger") << "starting closeLedger() on ledgerSeq="
                           << mCurrentLedger->mHeader.ledgerSeq;
@@ -820,6 +957,12 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         throw std::runtime_error("corrupt transaction set");
     }
 
+    if (mApp.getConfig().LEDGER_STATE_IN_MEMORY)
+    {
+        // only does something after the cache was cleared
+        EntryFrame::loadLedgerStateIntoCache(getDatabase());
+    }
+
     soci::transaction txscope(getDatabase().getSession());
 
     auto ledgerTime = mLedgerClose.TimeScope();
@@ -828,19 +971,54 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     mCurrentLedger->mHeader.scpValue = sv;
 
     LedgerDelta ledgerDelta(mCurrentLedger->mHeader, getDatabase());
+    if (mApp.getConfig().DEFER_LEDGER_WRITES)
+    {
+        ledgerDelta.deferWrites();
+    }
+    ledgerDelta.trackHotKeys(mHotKeys);
 
     // the transaction set that was agreed upon by consensus
     // was sorted by hash; we reorder it so that transactions are
     // sorted such that sequence numbers are respected
     vector<TransactionFramePtr> txs = ledgerData.getTxSet()->sortForApply();
 
+    // load the accounts and trustlines the set will touch in bulk, rather
+    // than one query at a time as each transaction is applied
+    prefetchTransactionData(txs);
+
+    // the history rows of the ledger, written at commit
+    TransactionHistoryRows historyRows;
+
     // first, charge fees
-    processFeesSeqNums(txs, ledgerDelta);
+    closePhase("fees");
+    processFeesSeqNums(txs, ledgerDelta, historyRows);
 
     TransactionResultSet txResultSet;
     txResultSet.results.reserve(txs.size());
 
-    applyTransactions(txs, ledgerDelta, txResultSet);
+    closePhase("apply");
+    applyTransactions(txs, ledgerDelta, txResultSet, historyRows);
+    mApp.getInvariantManager().checkOnLedgerClose();
+
+    // the meta of the ledger, if streamed
+    std::unique_ptr<LedgerCloseMeta> meta;
+    if (mMetaStream)
+    {
+        meta = std::make_unique<LedgerCloseMeta>();
+        meta->v(0);
+        ledgerData.getTxSet()->toXDR(meta->v0().txSet);
+        auto& txProcessing = meta->v0().txProcessing;
+        txProcessing.resize(txResultSet.results.size());
+        for (size_t i = 0; i < txProcessing.size(); i++)
+        {
+            // decoded back from the history rows, only when streaming
+            txProcessing[i].result = txResultSet.results[i];
+            xdr::xdr_from_opaque(historyRows.mFees[i].mValues[0],
+                                 txProcessing[i].feeProcessing);
+            xdr::xdr_from_opaque(historyRows.mTxs[i].mValues[2],
+                                 txProcessing[i].txApplyProcessing);
+        }
+    }
 
     ledgerDelta.getHeader().txSetResultHash =
         sha256(xdr::xdr_to_opaque(txResultSet));
@@ -848,6 +1026,7 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     // apply any upgrades that were decided during consensus
     // this must be done after applying transactions as the txset
     // was validated before upgrades
+    closePhase("upgrades");
     LedgerHeader headerBeforeUpgrades = getCurrentLedgerHeader();
     for (size_t i = 0; i < sv.upgrades.size(); i++)
     {
@@ -870,11 +1049,20 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
             Upgrades::applyTo(lupgrade, *this, upgradeDelta);
             // Note: Index from 1 rather than 0 to match the behavior of
             // storeTransaction and storeTransactionFee.
-            Upgrades::storeUpgradeHistory(*this, lupgrade,
-                                          upgradeDelta.getChanges(),
-                                          static_cast<int>(i + 1));
+            Upgrades::storeUpgradeHistory(
+                *this, lupgrade,
+                mApp.getConfig().DISABLE_TX_META ? LedgerEntryChanges{}
+                                                 : upgradeDelta.getChanges(),
+                static_cast<int>(i + 1));
             upgradeDelta.commit();
             upgradeScope.commit();
+            if (meta)
+            {
+                meta->v0().upgradesProcessing.emplace_back();
+                auto& um = meta->v0().upgradesProcessing.back();
+                um.upgrade = lupgrade;
+                um.changes = upgradeDelta.getChanges();
+            }
         }
         catch (std::runtime_error& e)
         {
@@ -891,9 +1079,24 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     // the consistency checks enforced by LedgerDelta::commit.
     getCurrentLedgerHeader() = headerBeforeUpgrades;
 
+    closePhase("commit");
+    TransactionFrame::storeTransactionHistory(getDatabase(), historyRows);
+    ledgerDelta.flushDeferredWrites();
     ledgerDelta.commit();
     ledgerClosed(ledgerDelta);
 
+    if (meta)
+    {
+        closePhase("meta-stream");
+        meta->v0().ledgerHeader = mLastClosedLedger;
+        mMetaStream->write(*meta);
+    }
+
+    // before queueing, which may snapshot the checkpoint right away
+    closePhase("checkpoint-files");
+    mApp.getHistoryManager().getCheckpointBuilder().appendLedger(
+        mLastClosedLedger, *ledgerData.getTxSet(), txResultSet);
+
     // The next 4 steps happen in a relatively non-obvious, subtle order.
     // This is unfortunate and it would be nice if we could make it not
     // be so subtle, but for the time being this is where we are.
@@ -912,33 +1115,89 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     // 4. GC unreferenced buckets. Only do this once publishes are in progress.
 
     // step 1
+    closePhase("queue-history");
     auto& hm = mApp.getHistoryManager();
     hm.maybeQueueHistoryCheckpoint();
 
     // step 2
-    mApp.getDatabase().clearPreparedStatementCache();
+    closePhase("sql-commit");
+    mApp.getDatabase().trimPreparedStatementCache();
     txscope.commit();
 
-    // step 3
+    // steps 3 and 4 wait for the batch to be committed when replaying
+    if (!mReplayBatch)
+    {
+        // step 3
+        closePhase("publish-history");
+        hm.publishQueuedHistory();
+        hm.logAndUpdatePublishStatus();
+
+        // step 4
+        closePhase("forget-buckets");
+        mApp.getBucketManager().forgetUnreferencedBuckets();
+    }
+
+    mCloseTrace->finish();
+    mCloseTrace.reset();
+    mHotKeys.ledgerClosed(ledgerData.getLedgerSeq());
+
+    // a callback may remove itself
+    auto closeTime = std::chrono::steady_clock::now() - closeStart;
+    auto callbacks = mLedgerClosedCallbacks;
+    for (auto const& kv : callbacks)
+    {
+        kv.second(ledgerData, closeTime);
+    }
+}
+
+void
+LedgerManagerImpl::beginReplayBatch()
+{
+    assert(!mReplayBatch);
+    // the transaction of each closeLedger becomes a savepoint of this one
+    mReplayBatch =
+        std::make_unique<soci::transaction>(getDatabase().getSession());
+}
+
+void
+LedgerManagerImpl::endReplayBatch()
+{
+    assert(mReplayBatch);
+    CLOG(DEBUG, "Ledger") << "Committing replayed ledgers up to "
+                          << ledgerAbbrev(mLastClosedLedger);
+    mReplayBatch->commit();
+    mReplayBatch.reset();
+
+    auto& hm = mApp.getHistoryManager();
     hm.publishQueuedHistory();
     hm.logAndUpdatePublishStatus();
-
-    // step 4
     mApp.getBucketManager().forgetUnreferencedBuckets();
 }
 
 void
+LedgerManagerImpl::closePhase(std::string const& name)
+{
+    if (mCloseTrace)
+    {
+        mCloseTrace->phase(name);
+    }
+}
+
+uint32_t
 LedgerManagerImpl::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                     uint32_t count)
 {
     soci::transaction txscope(db.getSession());
     db.clearPreparedStatementCache();
-    LedgerHeaderFrame::deleteOldEntries(db, ledgerSeq, count);
-    TransactionFrame::deleteOldEntries(db, ledgerSeq, count);
-    HerderPersistence::deleteOldEntries(db, ledgerSeq, count);
-    Upgrades::deleteOldEntries(db, ledgerSeq, count);
+    auto& hp = mApp.getHerderPersistence();
+    uint32_t res = std::min(
+        {LedgerHeaderFrame::deleteOldEntries(db, ledgerSeq, count),
+         TransactionFrame::deleteOldEntries(db, ledgerSeq, count),
+         hp.deleteOldEntries(ledgerSeq, count),
+         Upgrades::deleteOldEntries(db, ledgerSeq, count)});
     db.clearPreparedStatementCache();
     txscope.commit();
+    return res;
 }
 
 void
@@ -1020,22 +1279,48 @@ LedgerManagerImpl::advanceLedgerPointers()
                           << mCurrentLedger->mHeader.ledgerSeq;
 }
 
+void
+LedgerManagerImpl::prefetchTransactionData(
+    std::vector<TransactionFramePtr> const& txs)
+{
+    auto timer = mTransactionPrefetch.TimeScope();
+    std::unordered_set<LedgerKey, LedgerKeyHash> keys;
+    for (auto const& tx : txs)
+    {
+        tx->insertLedgerKeysToPrefetch(keys);
+    }
+    EntryFrame::prefetch(getDatabase(), keys);
+}
+
 void
 LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
-                                      LedgerDelta& delta)
+                                      LedgerDelta& delta,
+                                      TransactionHistoryRows& historyRows)
 {
     CLOG(DEBUG, "Ledger") << "processing fees and sequence numbers";
     int index = 0;
+    bool withMeta = !mApp.getConfig().DISABLE_TX_META;
     try
     {
         soci::transaction sqlTx(mApp.getDatabase().getSession());
+        // each source account is loaded and stored once, however many
+        // transactions it has in the set
+        std::unordered_map<AccountID, AccountFrame::pointer> sourceAccounts;
         for (auto tx : txs)
         {
             LedgerDelta thisTxDelta(delta);
-            tx->processFeeSeqNum(thisTxDelta, *this);
-            tx->storeTransactionFee(*this, thisTxDelta.getChanges(), ++index);
+            tx->processFeeSeqNum(thisTxDelta, *this,
+                                 sourceAccounts[tx->getSourceID()]);
+            tx->storeTransactionFee(*this,
+                                    withMeta ? thisTxDelta.getChanges()
+                                             : LedgerEntryChanges{},
+                                    ++index, historyRows);
             thisTxDelta.commit();
         }
+        for (auto const& account : sourceAccounts)
+        {
+            account.second->storeChange(delta, getDatabase());
+        }
         sqlTx.commit();
     }
     catch (std::exception& e)
@@ -1049,7 +1334,8 @@ LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
 void
 LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
                                      LedgerDelta& ledgerDelta,
-                                     TransactionResultSet& txResultSet)
+                                     TransactionResultSet& txResultSet,
+                                     TransactionHistoryRows& historyRows)
 {
     CLOG(DEBUG, "Tx") << "applyTransactions: ledger = "
                       << mCurrentLedger->mHeader.ledgerSeq;
@@ -1060,11 +1346,21 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
     if (numTxs > 0)
     {
         mTransactionCount.Update(static_cast<int64_t>(numTxs));
+
+        // Transactions are still applied one at a time, in order: apply
+        // goes through the single database session and entry cache, which
+        // are main-thread only. This tracks how many independent groups a
+        // ledger would split into, see TxSetFrame::partitionForApply.
+        auto partitions = TxSetFrame::partitionForApply(txs);
+        mTransactionPartitions.Update(static_cast<int64_t>(partitions.size()));
+        CLOG(DEBUG, "Tx") << "applyTransactions: " << numTxs << " txs in "
+                          << partitions.size() << " independent groups";
     }
 
     for (auto tx : txs)
     {
         auto txTime = mTransactionApply.TimeScope();
+        auto txStart = std::chrono::steady_clock::now();
         TransactionMeta tm(1);
         try
         {
@@ -1088,7 +1384,12 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
             CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
             tx->getResult().result.code(txINTERNAL_ERROR);
         }
-        tx->storeTransaction(*this, tm, ++index, txResultSet);
+        tx->storeTransaction(*this, tm, ++index, txResultSet, historyRows);
+        if (mCloseTrace)
+        {
+            mCloseTrace->recordTransaction(
+                *tx, std::chrono::steady_clock::now() - txStart);
+        }
     }
 }
 
@@ -1123,11 +1424,13 @@ void
 LedgerManagerImpl::ledgerClosed(LedgerDelta const& delta)
 {
     delta.markMeters(mApp);
+    closePhase("add-batch");
     mApp.getBucketManager().addBatch(mApp, mCurrentLedger->mHeader.ledgerSeq,
                                      delta.getLiveEntries(),
                                      delta.getDeadEntries());
 
     mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
+    closePhase("store-ledger");
     storeCurrentLedger();
     advanceLedgerPointers();
 }
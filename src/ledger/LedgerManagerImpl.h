@@ -6,13 +6,21 @@
 #include "util/asio.h"
 
 #include "history/HistoryManager.h"
+#include "ledger/HotKeys.h"
+#include "ledger/LedgerCloseMetaStream.h"
+#include "ledger/LedgerCloseTrace.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/SyncingLedgerChain.h"
 #include "main/PersistentState.h"
+#include "transactions/ApplyCostModel.h"
+#include "transactions/OperationMetrics.h"
 #include "transactions/TransactionFrame.h"
+#include "util/LatencyHistogram.h"
 #include "util/Timer.h"
 #include "xdr/Stellar-ledger.h"
+#include <map>
+#include <memory>
 #include <string>
 
 /*
@@ -21,6 +29,11 @@ Applies the tx set to the last ledger to get the next one
 Hands the old ledger off to the history
 */
 
+namespace soci
+{
+class transaction;
+}
+
 namespace medida
 {
 class Timer;
@@ -41,8 +54,10 @@ class LedgerManagerImpl : public LedgerManager
 
     Application& mApp;
     medida::Timer& mTransactionApply;
+    medida::Timer& mTransactionPrefetch;
     medida::Histogram& mTransactionCount;
-    medida::Timer& mLedgerClose;
+    medida::Histogram& mTransactionPartitions;
+    HistogramTimer mLedgerClose;
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
     medida::Counter& mLedgerStateCurrent;
@@ -51,12 +66,45 @@ class LedgerManagerImpl : public LedgerManager
     VirtualClock::time_point mLastStateChange;
 
     medida::Counter& mSyncingLedgersSize;
+    medida::Timer& mStartupLoadLedger;
+    medida::Timer& mStartupRestoreBuckets;
+
+    std::map<uint64_t, LedgerClosedCallback> mLedgerClosedCallbacks;
+    uint64_t mNextLedgerClosedCallback{0};
+
+    // see getLastClosedSnapshot; not kept alive here, so that it does not hold
+    // a connection of the pool when nobody reads from it
+    std::weak_ptr<LedgerStateSnapshot> mLastClosedSnapshot;
+
+    // see isReadyToCloseLedgers; ledgers externalized while not ready
+    bool mReadyToClose{true};
+    std::vector<LedgerCloseData> mHeldBackLedgers;
+    void restoreBuckets(
+        HistoryArchiveState const& has,
+        std::function<void(asio::error_code const& ec)> handler);
 
     SyncingLedgerChain mSyncingLedgers;
     uint32_t mCatchupTriggerLedger{0};
+    // Buffered ledgers replayed after catchup have the entries their
+    // transactions touch loaded in bulk this many ledgers at a time.
+    static size_t const REPLAY_PREFETCH_LEDGERS = 4;
 
     CatchupState mCatchupState{CatchupState::NONE};
 
+    // Set for the duration of closeLedger.
+    std::unique_ptr<LedgerCloseTrace> mCloseTrace;
+    void closePhase(std::string const& name);
+
+    // Set if Config::METADATA_OUTPUT_STREAM is.
+    std::unique_ptr<LedgerCloseMetaStream> mMetaStream;
+
+    ApplyCostModel mApplyCostModel;
+    OperationMetrics mOperationMetrics;
+    HotKeys mHotKeys;
+
+    // Set between beginReplayBatch and endReplayBatch.
+    std::unique_ptr<soci::transaction> mReplayBatch;
+
     void initializeCatchup(LedgerCloseData const& ledgerData);
     void continueCatchup(LedgerCloseData const& ledgerData);
     void finalizeCatchup(LedgerCloseData const& ledgerData);
@@ -68,11 +116,14 @@ class LedgerManagerImpl : public LedgerManager
                          CatchupWork::ProgressState progressState,
                          LedgerHeaderHistoryEntry const& lastClosed);
 
+    void prefetchTransactionData(std::vector<TransactionFramePtr> const& txs);
     void processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
-                            LedgerDelta& delta);
+                            LedgerDelta& delta,
+                            TransactionHistoryRows& historyRows);
     void applyTransactions(std::vector<TransactionFramePtr>& txs,
                            LedgerDelta& ledgerDelta,
-                           TransactionResultSet& txResultSet);
+                           TransactionResultSet& txResultSet,
+                           TransactionHistoryRows& historyRows);
 
     void ledgerClosed(LedgerDelta const& delta);
     void storeCurrentLedger();
@@ -92,6 +143,7 @@ class LedgerManagerImpl : public LedgerManager
 
   public:
     LedgerManagerImpl(Application& app);
+    ~LedgerManagerImpl();
 
     void bootstrap() override;
     State getState() const override;
@@ -113,6 +165,10 @@ class LedgerManagerImpl : public LedgerManager
     void startNewLedger() override;
     void loadLastKnownLedger(
         std::function<void(asio::error_code const& ec)> handler) override;
+    bool isReadyToCloseLedgers() const override;
+    uint64_t addLedgerClosedCallback(LedgerClosedCallback callback) override;
+    void removeLedgerClosedCallback(uint64_t id) override;
+    std::shared_ptr<LedgerStateSnapshot> getLastClosedSnapshot() override;
 
     LedgerHeaderHistoryEntry const& getLastClosedLedgerHeader() const override;
     LedgerHeader const& getCurrentLedgerHeader() const override;
@@ -121,6 +177,10 @@ class LedgerManagerImpl : public LedgerManager
 
     Database& getDatabase() override;
 
+    ApplyCostModel& getApplyCostModel() override;
+    OperationMetrics& getOperationMetrics() override;
+    HotKeys& getHotKeys() override;
+
     void startCatchup(CatchupConfiguration configuration,
                       bool manualCatchup) override;
 
@@ -128,8 +188,10 @@ class LedgerManagerImpl : public LedgerManager
     verifyCatchupCandidate(LedgerHeaderHistoryEntry const&,
                            bool manualCatchup) const override;
     void closeLedger(LedgerCloseData const& ledgerData) override;
-    void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                          uint32_t count) override;
+    void beginReplayBatch() override;
+    void endReplayBatch() override;
+    uint32_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                              uint32_t count) override;
     void checkDbState() override;
 };
 }
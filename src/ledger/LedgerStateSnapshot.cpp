@@ -0,0 +1,92 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerStateSnapshot.h"
+#include "database/Database.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "util/GlobalChecks.h"
+#include "util/Logging.h"
+
+#include <soci.h>
+
+namespace stellar
+{
+
+LedgerStateSnapshot::LedgerStateSnapshot(
+    soci::connection_pool& pool, size_t pos,
+    LedgerHeaderHistoryEntry const& header)
+    : mPool(pool), mPos(pos), mHeader(header)
+{
+}
+
+std::shared_ptr<LedgerStateSnapshot>
+LedgerStateSnapshot::create(Application& app)
+{
+    assertThreadIsMain();
+    auto& db = app.getDatabase();
+    size_t pos;
+    if (!db.canUsePool() || !db.getPool().try_lease(pos, 0))
+    {
+        return nullptr;
+    }
+
+    // not make_shared: the constructor is private
+    std::shared_ptr<LedgerStateSnapshot> res(new LedgerStateSnapshot(
+        db.getPool(), pos,
+        app.getLedgerManager().getLastClosedLedgerHeader()));
+    auto& sess = db.getPool().at(pos);
+    res->mTx = std::make_unique<soci::transaction>(sess);
+    if (!db.isSqlite())
+    {
+        sess << "SET TRANSACTION ISOLATION LEVEL REPEATABLE READ READ ONLY";
+    }
+
+    // the first read of the transaction is what pins its view, on SQLite
+    uint32_t lastSeq = 0;
+    soci::indicator ind;
+    sess << "SELECT MAX(ledgerseq) FROM ledgerheaders",
+        soci::into(lastSeq, ind);
+    if (ind != soci::i_ok || lastSeq != res->getLedgerSeq())
+    {
+        CLOG(DEBUG, "Ledger")
+            << "No snapshot of ledger " << res->getLedgerSeq()
+            << ", the database is at ledger " << lastSeq;
+        return nullptr;
+    }
+    return res;
+}
+
+LedgerStateSnapshot::~LedgerStateSnapshot()
+{
+    mTx.reset();
+    mPool.give_back(mPos);
+}
+
+void
+LedgerStateSnapshot::loadBulk(std::vector<LedgerKey> const& keys,
+                              std::function<void(LedgerEntry const&)> processor)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    EntryFrame::loadBulk(mPool.at(mPos), keys, processor);
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerStateSnapshot::load(LedgerKey const& key)
+{
+    std::shared_ptr<LedgerEntry const> res;
+    loadBulk({key}, [&res](LedgerEntry const& e) {
+        res = std::make_shared<LedgerEntry const>(e);
+    });
+    return res;
+}
+
+void
+LedgerStateSnapshot::query(std::function<void(soci::session&)> const& reader)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    reader(mPool.at(mPos));
+}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace soci
+{
+class connection_pool;
+class session;
+class transaction;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * LedgerStateSnapshot is a read-only view of the ledger state as of a
+ * closed ledger, which other threads can read from while the main thread
+ * goes on closing ledgers (eg. to answer queries, check invariants or
+ * pre-validate transactions).
+ *
+ * It holds a session of the Database's connection pool with a read
+ * transaction open since it was created: repeatable read on postgres, and
+ * a read of the WAL as of that point on SQLite. It thus keeps that
+ * connection for as long as it lives, and should not be held on to for
+ * longer than needed, nor past the Application. Its reads are serialized,
+ * and it can be used from any thread.
+ */
+class LedgerStateSnapshot : NonMovableOrCopyable
+{
+    soci::connection_pool& mPool;
+    size_t mPos;
+    std::unique_ptr<soci::transaction> mTx;
+    LedgerHeaderHistoryEntry const mHeader;
+    std::mutex mMutex;
+
+    LedgerStateSnapshot(soci::connection_pool& pool, size_t pos,
+                        LedgerHeaderHistoryEntry const& header);
+
+  public:
+    // Creates a snapshot of the state as of the last closed ledger, on the
+    // main thread. Returns nullptr when the database cannot provide one:
+    // there is no connection pool (in-memory SQLite), every session of the
+    // pool is in use, or the last closed ledger is not committed yet (during
+    // a replay batch).
+    static std::shared_ptr<LedgerStateSnapshot> create(Application& app);
+
+    ~LedgerStateSnapshot();
+
+    LedgerHeaderHistoryEntry const&
+    getLedgerHeader() const
+    {
+        return mHeader;
+    }
+
+    uint32_t
+    getLedgerSeq() const
+    {
+        return mHeader.header.ledgerSeq;
+    }
+
+    // Calls `processor` with those of `keys` that are in the snapshot, in no
+    // particular order (see EntryFrame::loadBulk).
+    void loadBulk(std::vector<LedgerKey> const& keys,
+                  std::function<void(LedgerEntry const&)> processor);
+
+    // The entry for `key` in the snapshot, nullptr if there is none.
+    std::shared_ptr<LedgerEntry const> load(LedgerKey const& key);
+
+    // Runs `reader` against the snapshot, for reads other than by key. It must
+    // not write.
+    void query(std::function<void(soci::session&)> const& reader);
+};
+}
@@ -0,0 +1,85 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerStateSnapshot.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Timer.h"
+
+#include <future>
+#include <soci.h>
+
+using namespace stellar;
+
+TEST_CASE("ledger state snapshot", "[ledger][snapshot]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = TestAccount{*app, txtest::getAccount("A")};
+    auto ledgerSeq = lm.getLedgerNum();
+    txtest::closeLedgerOn(*app, ledgerSeq, 1, 1, 2017,
+                          {root.tx({txtest::createAccount(a1, 1000000000)})});
+
+    LedgerKey key(ACCOUNT);
+    key.account().accountID = a1.getPublicKey();
+    auto balanceIn = [&](std::shared_ptr<LedgerStateSnapshot> const& s) {
+        // from another thread
+        return std::async(std::launch::async, [s, &key]() {
+                   auto e = s->load(key);
+                   return e ? e->data.account().balance : int64_t(-1);
+               })
+            .get();
+    };
+
+    auto snapshot = lm.getLastClosedSnapshot();
+    REQUIRE(snapshot);
+    REQUIRE(snapshot->getLedgerSeq() == ledgerSeq);
+    REQUIRE(snapshot->getLedgerHeader().hash ==
+            lm.getLastClosedLedgerHeader().hash);
+    REQUIRE(lm.getLastClosedSnapshot() == snapshot);
+    REQUIRE(balanceIn(snapshot) == 1000000000);
+
+    txtest::closeLedgerOn(*app, ledgerSeq + 1, 2, 1, 2017,
+                          {root.tx({txtest::payment(a1, 100)})});
+
+    SECTION("keeps the state it was created with")
+    {
+        REQUIRE(balanceIn(snapshot) == 1000000000);
+        int accounts = 0;
+        snapshot->query([&accounts](soci::session& sess) {
+            sess << "SELECT COUNT(*) FROM accounts", soci::into(accounts);
+        });
+        REQUIRE(accounts == 2);
+    }
+
+    SECTION("a new one is made for the next ledger")
+    {
+        auto next = lm.getLastClosedSnapshot();
+        REQUIRE(next);
+        REQUIRE(next != snapshot);
+        REQUIRE(next->getLedgerSeq() == ledgerSeq + 1);
+        REQUIRE(balanceIn(next) == 1000000100);
+    }
+}
+
+TEST_CASE("no ledger state snapshot of in-memory databases",
+          "[ledger][snapshot]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    REQUIRE(!app->getLedgerManager().getLastClosedSnapshot());
+}
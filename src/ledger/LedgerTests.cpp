@@ -7,16 +7,26 @@
 #include "herder/LedgerCloseData.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/EntryFrame.h"
+#include "ledger/HotKeys.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/TestAccount.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/TmpDir.h"
+#include "util/XDROperators.h"
+#include "util/XDRStream.h"
 #include "util/types.h"
+#include <algorithm>
 #include <xdrpp/autocheck.h>
 
 using namespace stellar;
@@ -63,6 +73,125 @@ TEST_CASE("single ledger entry insert SQL", "[singlesql][entrysql]")
     le->storeAddOrChange(delta, db);
 }
 
+TEST_CASE("ledger close phases are timed", "[ledger]")
+{
+    Config cfg(getTestConfig());
+    // traces every close, to run through the logging
+    cfg.LEDGER_CLOSE_TRACE_THRESHOLD_MS = 1;
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = TestAccount{*app, txtest::getAccount("A")};
+    auto& metrics = app->getMetrics();
+    auto& apply = metrics.NewTimer({"ledger", "close", "apply"});
+    auto& sqlCommit = metrics.NewTimer({"ledger", "close", "sql-commit"});
+    auto& createAccount =
+        metrics.NewTimer({"op-create-account", "apply", "time"});
+    auto applyBefore = apply.count();
+    auto sqlCommitBefore = sqlCommit.count();
+
+    auto ledgerSeq = app->getLedgerManager().getLedgerNum();
+    txtest::closeLedgerOn(
+        *app, ledgerSeq, 1, 1, 2017,
+        {root.tx({txtest::createAccount(a1, 1000000000)})});
+
+    REQUIRE(apply.count() == applyBefore + 1);
+    REQUIRE(sqlCommit.count() == sqlCommitBefore + 1);
+    REQUIRE(createAccount.count() == 1);
+
+    // the new account is inserted, the source is updated
+    auto& writes = metrics.NewMeter(
+        {"op-create-account", "apply", "sql-write"}, "query");
+    REQUIRE(writes.count() >= 2);
+}
+
+TEST_CASE("hot keys", "[ledger]")
+{
+    auto accountKey = [](std::string const& name) {
+        LedgerKey k(ACCOUNT);
+        k.account().accountID = txtest::getAccount(name.c_str()).getPublicKey();
+        return k;
+    };
+    auto a = accountKey("A");
+    auto b = accountKey("B");
+    auto c = accountKey("C");
+
+    SECTION("space-saving counters")
+    {
+        HotKeys hotKeys(2);
+        for (int i = 0; i < 3; i++)
+        {
+            hotKeys.record(a, HotKeys::Access::LOAD);
+        }
+        hotKeys.record(b, HotKeys::Access::MODIFY);
+        // takes the counter of b over
+        hotKeys.record(c, HotKeys::Access::WRITE);
+
+        auto top = hotKeys.getCurrentTop(3);
+        REQUIRE(top.size() == 2);
+        REQUIRE(top[0].mKey == a);
+        REQUIRE(top[0].mCount == 3);
+        REQUIRE(top[0].mError == 0);
+        REQUIRE(top[0].mLoads == 3);
+        REQUIRE(top[1].mKey == c);
+        REQUIRE(top[1].mCount == 2);
+        REQUIRE(top[1].mError == 1);
+        REQUIRE(top[1].mModifies == 0);
+        REQUIRE(top[1].mWrites == 1);
+
+        hotKeys.ledgerClosed(2);
+        REQUIRE(hotKeys.getCurrentTop(3).empty());
+        hotKeys.record(c, HotKeys::Access::MODIFY);
+        hotKeys.record(c, HotKeys::Access::MODIFY);
+        hotKeys.ledgerClosed(3);
+
+        auto window = hotKeys.getWindowTop(1);
+        REQUIRE(window.size() == 1);
+        REQUIRE(window[0].mKey == c);
+        REQUIRE(window[0].mCount == 4);
+        REQUIRE(window[0].mModifies == 2);
+        REQUIRE(window[0].mWrites == 1);
+
+        auto json = hotKeys.getJson(5);
+        REQUIRE(json["ledger"]["seq"].asUInt() == 3);
+        REQUIRE(json["window"]["from"].asUInt() == 2);
+        REQUIRE(json["window"]["accesses"].asUInt64() == 7);
+        REQUIRE(json["window"]["top"].size() == 2);
+    }
+
+    SECTION("counted as ledgers close")
+    {
+        VirtualClock clock;
+        Application::pointer app =
+            createTestApplication(clock, getTestConfig());
+        app->start();
+
+        auto root = TestAccount::createRoot(*app);
+        auto a1 = TestAccount{*app, txtest::getAccount("A")};
+        auto ledgerSeq = app->getLedgerManager().getLedgerNum();
+        txtest::closeLedgerOn(
+            *app, ledgerSeq, 1, 1, 2017,
+            {root.tx({txtest::createAccount(a1, 1000000000)})});
+
+        LedgerKey rootKey(ACCOUNT);
+        rootKey.account().accountID = root.getPublicKey();
+        auto top = app->getLedgerManager().getHotKeys().getWindowTop(10);
+        auto isRoot = [&](HotKeys::Entry const& e) {
+            return e.mKey == rootKey;
+        };
+        auto it = std::find_if(top.begin(), top.end(), isRoot);
+        REQUIRE(it != top.end());
+        // charged the fee, then the transaction applied
+        REQUIRE(it->mModifies >= 2);
+        REQUIRE(std::any_of(top.begin(), top.end(),
+                            [&](HotKeys::Entry const& e) {
+                                return e.mKey == a && e.mWrites == 1;
+                            }));
+    }
+}
+
 TEST_CASE("DB cache interaction with transactions", "[ledger][dbcache]")
 {
     Config::TestDbMode mode = Config::TESTDB_ON_DISK_SQLITE;
@@ -140,6 +269,161 @@ TEST_CASE("DB cache interaction with transactions", "[ledger][dbcache]")
     CHECK(balance0 == acc->getAccount().balance);
 }
 
+TEST_CASE("ledger close meta is streamed", "[ledger]")
+{
+    TmpDir tmp("meta-stream");
+    Config cfg(getTestConfig());
+    cfg.METADATA_OUTPUT_STREAM = tmp.getName() + "/meta.xdr";
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = TestAccount{*app, txtest::getAccount("A")};
+    auto& lm = app->getLedgerManager();
+    auto ledgerSeq = lm.getLedgerNum();
+    auto tx = root.tx({txtest::createAccount(a1, 1000000000)});
+    txtest::closeLedgerOn(*app, ledgerSeq, 1, 1, 2017, {tx});
+    txtest::closeLedgerOn(*app, ledgerSeq + 1, 2, 1, 2017);
+
+    XDRInputFileStream in;
+    in.open(cfg.METADATA_OUTPUT_STREAM);
+    LedgerCloseMeta meta;
+    REQUIRE(in.readOne(meta));
+    auto const& v0 = meta.v0();
+    REQUIRE(v0.ledgerHeader.header.ledgerSeq == ledgerSeq);
+    REQUIRE(v0.txSet.txs.size() == 1);
+    REQUIRE(v0.txProcessing.size() == 1);
+    auto const& txMeta = v0.txProcessing[0];
+    REQUIRE(txMeta.result.transactionHash == tx->getContentsHash());
+    REQUIRE(txMeta.result.result.result.code() == txSUCCESS);
+    // the fee and sequence number of the source
+    REQUIRE(!txMeta.feeProcessing.empty());
+    REQUIRE(txMeta.txApplyProcessing.v() == 1);
+    REQUIRE(txMeta.txApplyProcessing.v1().operations.size() == 1);
+
+    REQUIRE(in.readOne(meta));
+    REQUIRE(meta.v0().ledgerHeader.hash == lm.getLastClosedLedgerHeader().hash);
+    REQUIRE(meta.v0().txProcessing.empty());
+    REQUIRE(!in.readOne(meta));
+}
+
+TEST_CASE("fees of transactions from one account", "[ledger]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto& lm = app->getLedgerManager();
+    auto a1 = root.create("A", lm.getMinBalance(0) + 1000000);
+    auto before = a1.getBalance();
+
+    std::vector<TransactionFramePtr> txs;
+    for (int i = 0; i < 3; ++i)
+    {
+        txs.emplace_back(a1.tx({txtest::payment(root, 100)}));
+    }
+    auto ledgerSeq = lm.getLedgerNum();
+    auto res = txtest::closeLedgerOn(*app, ledgerSeq, 1, 1, 2017, txs);
+    REQUIRE(res.size() == 3);
+
+    // the fee of each transaction is charged on top of the previous ones
+    int64_t balance = before;
+    int64_t fees = 0;
+    for (auto const& r : res)
+    {
+        REQUIRE(r.first.result.result.code() == txSUCCESS);
+        auto const& changes = r.second;
+        REQUIRE(changes.size() == 2);
+        REQUIRE(changes[0].type() == LEDGER_ENTRY_STATE);
+        REQUIRE(changes[0].state().data.account().balance == balance);
+        REQUIRE(changes[1].type() == LEDGER_ENTRY_UPDATED);
+        auto fee = r.first.result.feeCharged;
+        balance -= fee;
+        fees += fee;
+        REQUIRE(changes[1].updated().data.account().balance == balance);
+        REQUIRE(changes[1].updated().lastModifiedLedgerSeq == ledgerSeq);
+    }
+    REQUIRE(a1.getBalance() == before - fees - 300);
+    REQUIRE(a1.loadSequenceNumber() == txs.back()->getSeqNum());
+}
+
+TEST_CASE("deferred ledger writes", "[ledger][dbcache]")
+{
+    Config cfg(getTestConfig(0));
+    cfg.LEDGER_STATE_IN_MEMORY = true;
+    cfg.DEFER_LEDGER_WRITES = true;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    LedgerEntry le;
+    le.data.type(ACCOUNT);
+    le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    auto const& accountID = le.data.account().accountID;
+    auto balance = le.data.account().balance;
+    auto accountsBefore = AccountFrame::countObjects(session);
+
+    {
+        soci::transaction sqltx(session);
+        auto header = app->getLedgerManager().getCurrentLedgerHeader();
+        LedgerDelta delta(header, db);
+        delta.deferWrites();
+
+        std::make_shared<AccountFrame>(le)->storeAdd(delta, db);
+        // only in the cache
+        REQUIRE(AccountFrame::countObjects(session) == accountsBefore);
+        REQUIRE(AccountFrame::loadAccount(accountID, db)->getBalance() ==
+                balance);
+
+        {
+            LedgerDelta inner(delta);
+            auto acc = AccountFrame::loadAccount(accountID, db);
+            acc->getAccount().balance -= 1;
+            acc->storeChange(inner, db);
+            REQUIRE(AccountFrame::loadAccount(accountID, db)->getBalance() ==
+                    balance - 1);
+            // rolled back to the value of the outer delta
+        }
+        REQUIRE(AccountFrame::loadAccount(accountID, db)->getBalance() ==
+                balance);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            LedgerDelta inner(delta);
+            auto acc = AccountFrame::loadAccount(accountID, db);
+            acc->getAccount().balance -= 1;
+            acc->storeChange(inner, db);
+            inner.commit();
+        }
+
+        {
+            LedgerDelta inner(delta);
+            AccountFrame::loadAccount(accountID, db)->storeDelete(inner, db);
+            REQUIRE(!AccountFrame::loadAccount(accountID, db));
+        }
+        REQUIRE(AccountFrame::loadAccount(accountID, db));
+
+        delta.flushDeferredWrites();
+        REQUIRE(AccountFrame::countObjects(session) == accountsBefore + 1);
+        delta.commit();
+        sqltx.commit();
+    }
+
+    // the database has the last value
+    db.getEntryCache().clear();
+    auto acc = AccountFrame::loadAccount(accountID, db);
+    REQUIRE(acc);
+    REQUIRE(acc->getBalance() == balance - 3);
+    REQUIRE(acc->getAccount().signers.size() ==
+            le.data.account().signers.size());
+}
+
 TEST_CASE("cannot close ledger with unsupported ledger version", "[ledger]")
 {
     VirtualClock clock;
@@ -8,8 +8,10 @@
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
 #include "ledger/LedgerRange.h"
 #include "ledger/TrustFrame.h"
+#include "lib/util/format.h"
 #include "transactions/ManageOfferOpFrame.h"
 #include "transactions/OfferExchange.h"
 #include "util/types.h"
@@ -48,6 +50,13 @@ const char* OfferFrame::kSQLCreateStatement3 =
 const char* OfferFrame::kSQLCreateStatement4 =
     "CREATE INDEX priceindex ON offers (price);";
 
+// matches the predicate and the ordering of loadBestOffers, so that the best
+// offers of a pair are read in order from the index
+const char* OfferFrame::kSQLCreateBestOfferIndex =
+    "CREATE INDEX bestofferindex ON offers "
+    "(sellingissuer, sellingassetcode, buyingissuer, buyingassetcode, price, "
+    "offerid)";
+
 static const char* offerColumnSelector =
     "SELECT sellerid,offerid,sellingassettype,sellingassetcode,sellingissuer,"
     "buyingassettype,buyingassetcode,buyingissuer,amount,pricen,priced,"
@@ -165,7 +174,7 @@ OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db,
 
     auto timer = db.getSelectTimer("offer");
     loadOffers(prep, [&retOffer](LedgerEntry const& offer) {
-        retOffer = make_shared<OfferFrame>(offer);
+        retOffer = makePooled<OfferFrame>(offer);
     });
 
     if (delta && retOffer)
@@ -176,6 +185,33 @@ OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db,
     return retOffer;
 }
 
+void
+OfferFrame::loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+                     std::function<void(LedgerEntry const&)> processor)
+{
+    // offerid is the primary key, the seller is only checked by the caller
+    std::vector<std::string> strKeys;
+    strKeys.reserve(keys.size());
+    for (auto const& k : keys)
+    {
+        strKeys.emplace_back(std::to_string(k.offer().offerID));
+    }
+
+    auto st = DatabaseUtils::prepare(
+        sess, std::string(offerColumnSelector) + " WHERE offerid IN " +
+                  DatabaseUtils::placeholderList(
+                      DatabaseUtils::BULK_LOAD_BATCH_SIZE));
+    for (auto& batch : DatabaseUtils::makeLoadBatches(strKeys))
+    {
+        StatementContext prep(st);
+        for (auto const& k : batch)
+        {
+            prep.statement().exchange(use(k));
+        }
+        loadOffers(prep, processor);
+    }
+}
+
 void
 OfferFrame::loadOffers(StatementContext& prep,
                        std::function<void(LedgerEntry const&)> offerProcessor)
@@ -274,6 +310,30 @@ void
 OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
                            Asset const& selling, Asset const& buying,
                            vector<OfferFrame::pointer>& retOffers, Database& db)
+{
+    auto processor = [&retOffers](LedgerEntry const& of) {
+        retOffers.emplace_back(makePooled<OfferFrame>(of));
+    };
+    auto& book = db.getOrderBook();
+    if (!book.isEnabled())
+    {
+        loadPairOffers(selling, buying, true, numOffers, offset, db,
+                       processor);
+        return;
+    }
+    book.forEachBest(
+        selling, buying, numOffers, offset,
+        [&](std::function<void(LedgerEntry const&)> loadOne) {
+            loadPairOffers(selling, buying, false, 0, 0, db, loadOne);
+        },
+        processor);
+}
+
+void
+OfferFrame::loadPairOffers(
+    Asset const& selling, Asset const& buying, bool limited, size_t numOffers,
+    size_t offset, Database& db,
+    std::function<void(LedgerEntry const&)> offerProcessor)
 {
     std::string sql = offerColumnSelector;
 
@@ -285,7 +345,10 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
 
     if (selling.type() == ASSET_TYPE_NATIVE)
     {
-        sql += " WHERE sellingassettype = 0 AND sellingissuer IS NULL";
+        // the asset code is NULL as well, which lets bestofferindex be used
+        // for both
+        sql += " WHERE sellingassettype = 0 AND sellingissuer IS NULL"
+               " AND sellingassetcode IS NULL";
     }
     else
     {
@@ -307,12 +370,13 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
         }
 
         useSellingAsset = true;
-        sql += " WHERE sellingassetcode = :pcur AND sellingissuer = :pi";
+        sql += " WHERE sellingissuer = :pi AND sellingassetcode = :pcur";
     }
 
     if (buying.type() == ASSET_TYPE_NATIVE)
     {
-        sql += " AND buyingassettype = 0 AND buyingissuer IS NULL";
+        sql += " AND buyingassettype = 0 AND buyingissuer IS NULL"
+               " AND buyingassetcode IS NULL";
     }
     else
     {
@@ -332,12 +396,16 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
         }
 
         useBuyingAsset = true;
-        sql += " AND buyingassetcode = :gcur AND buyingissuer = :gi";
+        sql += " AND buyingissuer = :gi AND buyingassetcode = :gcur";
     }
 
     // price is an approximation of the actual n/d (truncated math, 15 digits)
     // ordering by offerid gives precendence to older offers for fairness
-    sql += " ORDER BY price, offerid LIMIT :n OFFSET :o";
+    sql += " ORDER BY price, offerid";
+    if (limited)
+    {
+        sql += " LIMIT :n OFFSET :o";
+    }
 
     auto prep = db.getPreparedStatement(sql);
     auto& st = prep.statement();
@@ -354,13 +422,14 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
         st.exchange(use(buyingIssuerStrKey));
     }
 
-    st.exchange(use(numOffers));
-    st.exchange(use(offset));
+    if (limited)
+    {
+        st.exchange(use(numOffers));
+        st.exchange(use(offset));
+    }
 
     auto timer = db.getSelectTimer("offer");
-    loadOffers(prep, [&retOffers](LedgerEntry const& of) {
-        retOffers.emplace_back(make_shared<OfferFrame>(of));
-    });
+    loadOffers(prep, offerProcessor);
 }
 
 std::unordered_map<AccountID, std::vector<OfferFrame::pointer>>
@@ -374,7 +443,7 @@ OfferFrame::loadAllOffers(Database& db)
     auto timer = db.getSelectTimer("offer");
     loadOffers(prep, [&retOffers](LedgerEntry const& of) {
         auto& thisUserOffers = retOffers[of.data.offer().sellerID];
-        thisUserOffers.emplace_back(make_shared<OfferFrame>(of));
+        thisUserOffers.emplace_back(makePooled<OfferFrame>(of));
     });
     return retOffers;
 }
@@ -420,7 +489,7 @@ OfferFrame::loadOffersByAccountAndAsset(AccountID const& accountID,
 
     auto timer = db.getSelectTimer("offer");
     loadOffers(prep, [&retOffers](LedgerEntry const& of) {
-        retOffers.emplace_back(make_shared<OfferFrame>(of));
+        retOffers.emplace_back(makePooled<OfferFrame>(of));
     });
     return retOffers;
 }
@@ -465,11 +534,11 @@ void
 OfferFrame::deleteOffersModifiedOnOrAfterLedger(Database& db,
                                                 uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == OFFER &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+    db.getEntryCache().eraseIf(
+        OFFER, [oldestLedger](EntryCache::Value const& le) -> bool {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
+    db.getOrderBook().clear();
 
     {
         auto prep = db.getPreparedStatement(
@@ -496,6 +565,7 @@ OfferFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
     st.exchange(use(key.offer().offerID));
     st.define_and_bind();
     st.execute(true);
+    db.getOrderBook().erase(key.offer().offerID);
     delta.deleteEntry(key);
 }
 
@@ -505,6 +575,95 @@ OfferFrame::computePrice() const
     return double(mOffer.price.n) / double(mOffer.price.d);
 }
 
+static void
+pushAssetColumns(Asset const& asset, DatabaseUtils::BulkColumn& type,
+                 DatabaseUtils::BulkColumn& code,
+                 DatabaseUtils::BulkColumn& issuer)
+{
+    type.push(std::to_string(static_cast<int>(asset.type())));
+    std::string assetCode;
+    switch (asset.type())
+    {
+    case ASSET_TYPE_CREDIT_ALPHANUM4:
+        assetCodeToStr(asset.alphaNum4().assetCode, assetCode);
+        code.push(assetCode);
+        issuer.push(KeyUtils::toStrKey(asset.alphaNum4().issuer));
+        break;
+    case ASSET_TYPE_CREDIT_ALPHANUM12:
+        assetCodeToStr(asset.alphaNum12().assetCode, assetCode);
+        code.push(assetCode);
+        issuer.push(KeyUtils::toStrKey(asset.alphaNum12().issuer));
+        break;
+    default:
+        code.pushNull();
+        issuer.pushNull();
+        break;
+    }
+}
+
+void
+OfferFrame::storeAddOrChangeBulk(Database& db,
+                                 std::vector<LedgerEntry> const& entries)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+
+    using DatabaseUtils::BulkColumn;
+    std::vector<BulkColumn> cols{{"sellerid", "TEXT"},
+                                 {"offerid", "BIGINT"},
+                                 {"sellingassettype", "INT"},
+                                 {"sellingassetcode", "TEXT"},
+                                 {"sellingissuer", "TEXT"},
+                                 {"buyingassettype", "INT"},
+                                 {"buyingassetcode", "TEXT"},
+                                 {"buyingissuer", "TEXT"},
+                                 {"amount", "BIGINT"},
+                                 {"pricen", "INT"},
+                                 {"priced", "INT"},
+                                 {"price", "DOUBLE PRECISION"},
+                                 {"flags", "INT"},
+                                 {"lastmodified", "INT"}};
+
+    for (auto const& e : entries)
+    {
+        auto const& o = e.data.offer();
+        cols[0].push(KeyUtils::toStrKey(o.sellerID));
+        cols[1].push(std::to_string(o.offerID));
+        pushAssetColumns(o.selling, cols[2], cols[3], cols[4]);
+        pushAssetColumns(o.buying, cols[5], cols[6], cols[7]);
+        cols[8].push(std::to_string(o.amount));
+        cols[9].push(std::to_string(o.price.n));
+        cols[10].push(std::to_string(o.price.d));
+        // Full precision so the stored value matches computePrice().
+        cols[11].push(fmt::format(
+            "{:.17g}", double(o.price.n) / double(o.price.d)));
+        cols[12].push(std::to_string(o.flags));
+        cols[13].push(std::to_string(e.lastModifiedLedgerSeq));
+    }
+
+    DatabaseUtils::bulkUpsert(db, "offer", "offers", {"offerid"}, cols);
+    db.getOrderBook().clear();
+}
+
+void
+OfferFrame::storeDeleteBulk(Database& db, std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    std::vector<DatabaseUtils::BulkColumn> cols{{"offerid", "BIGINT"}};
+    for (auto const& k : keys)
+    {
+        cols[0].push(std::to_string(k.offer().offerID));
+    }
+    DatabaseUtils::bulkDelete(db, "offer", "offers", cols);
+    db.getOrderBook().clear();
+}
+
 void
 OfferFrame::storeChange(LedgerDelta& delta, Database& db)
 {
@@ -522,6 +681,19 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
 {
     touch(delta);
 
+    if (!insert)
+    {
+        // offers are not in the entry cache, but the loaded order books
+        // hold them as stored
+        auto stored = db.getOrderBook().find(mOffer.offerID);
+        if (stored && *stored == mEntry)
+        {
+            db.markAvoidedUpdate("offer");
+            delta.modEntry(*this);
+            return;
+        }
+    }
+
     std::string actIDStrKey = KeyUtils::toStrKey(mOffer.sellerID);
 
     unsigned int sellingType = mOffer.selling.type();
@@ -611,6 +783,8 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
         throw std::runtime_error("could not update SQL");
     }
 
+    db.getOrderBook().store(mEntry);
+
     if (insert)
     {
         delta.addEntry(*this);
@@ -621,9 +795,19 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
     }
 }
 
+std::vector<std::pair<std::string, std::string>>
+OfferFrame::getSecondaryIndexes()
+{
+    return {{"sellingissuerindex", kSQLCreateStatement2},
+            {"buyingissuerindex", kSQLCreateStatement3},
+            {"priceindex", kSQLCreateStatement4},
+            {"bestofferindex", kSQLCreateBestOfferIndex}};
+}
+
 void
 OfferFrame::dropAll(Database& db)
 {
+    db.getOrderBook().clear();
     db.getSession() << "DROP TABLE IF EXISTS offers;";
     db.getSession() << kSQLCreateStatement1;
     db.getSession() << kSQLCreateStatement2;
@@ -29,6 +29,13 @@ class OfferFrame : public EntryFrame
     loadOffers(StatementContext& prep,
                std::function<void(LedgerEntry const&)> offerProcessor);
 
+    // the offers of a pair in loadBestOffers order, all of them unless
+    // `limited`
+    static void
+    loadPairOffers(Asset const& selling, Asset const& buying, bool limited,
+                   size_t numOffers, size_t offset, Database& db,
+                   std::function<void(LedgerEntry const&)> offerProcessor);
+
     double computePrice() const;
 
     OfferEntry& mOffer;
@@ -52,7 +59,7 @@ class OfferFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<OfferFrame>(*this);
+        return makePooled<OfferFrame>(*this);
     }
 
     Price const& getPrice() const;
@@ -85,6 +92,12 @@ class OfferFrame : public EntryFrame
     // Static helpers that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+    // Bulk writes used by EntryFrame::storeAddOrChangeBulk and
+    // EntryFrame::storeDeleteBulk; the db entry cache is not flushed here.
+    static void storeAddOrChangeBulk(Database& db,
+                                     std::vector<LedgerEntry> const& entries);
+    static void storeDeleteBulk(Database& db,
+                                std::vector<LedgerKey> const& keys);
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
@@ -95,7 +108,14 @@ class OfferFrame : public EntryFrame
     // database utilities
     static pointer loadOffer(AccountID const& accountID, uint64_t offerID,
                              Database& db, LedgerDelta* delta = nullptr);
+    // Calls `processor` with those of `keys` (all of this type) that are in
+    // the database, loaded through `sess` with a few multi-key queries and
+    // without going through the entry cache (see EntryFrame::loadBulk).
+    static void
+    loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+             std::function<void(LedgerEntry const&)> processor);
 
+    // served from the database's OrderBook when enabled
     static void loadBestOffers(size_t numOffers, size_t offset,
                                Asset const& pays, Asset const& gets,
                                std::vector<OfferFrame::pointer>& retOffers,
@@ -111,6 +131,14 @@ class OfferFrame : public EntryFrame
 
     static void dropAll(Database& db);
 
+    // The non-unique indexes of the offers table, by name (see
+    // EntryFrame::dropSecondaryIndexes).
+    static std::vector<std::pair<std::string, std::string>>
+    getSecondaryIndexes();
+
+    // The index of loadBestOffers, added by schema version 8.
+    static const char* kSQLCreateBestOfferIndex;
+
     void releaseLiabilities(AccountFrame::pointer const& account,
                             TrustFrame::pointer const& buyingTrust,
                             TrustFrame::pointer const& sellingTrust,
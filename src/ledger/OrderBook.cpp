@@ -0,0 +1,246 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/OrderBook.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+namespace stellar
+{
+
+bool
+OrderBook::AssetPair::operator<(AssetPair const& other) const
+{
+    if (mSelling < other.mSelling)
+    {
+        return true;
+    }
+    if (other.mSelling < mSelling)
+    {
+        return false;
+    }
+    return mBuying < other.mBuying;
+}
+
+bool
+OrderBook::OfferKey::operator<(OfferKey const& other) const
+{
+    if (mPrice != other.mPrice)
+    {
+        return mPrice < other.mPrice;
+    }
+    return mOfferID < other.mOfferID;
+}
+
+OrderBook::OrderBook(medida::MetricsRegistry& metrics, size_t maxBytes)
+    : mMaxBytes(maxBytes)
+    , mHits(metrics.NewMeter({"ledger", "order-book", "hit"}, "query"))
+    , mLoads(metrics.NewMeter({"ledger", "order-book", "load"}, "query"))
+    , mBytesCounter(metrics.NewCounter({"database", "memory", "order-book"}))
+{
+}
+
+OrderBook::OfferKey
+OrderBook::offerKey(OfferEntry const& offer)
+{
+    // same computation as OfferFrame::computePrice, stored in the price
+    // column
+    return OfferKey{double(offer.price.n) / double(offer.price.d),
+                    offer.offerID};
+}
+
+size_t
+OrderBook::offerBytes(LedgerEntry const& offer)
+{
+    return OFFER_OVERHEAD + xdr::xdr_size(offer);
+}
+
+bool
+OrderBook::isEnabled() const
+{
+    return mMaxBytes != 0;
+}
+
+void
+OrderBook::insert(BookMap::iterator book, LedgerEntry const& offer)
+{
+    auto key = offerKey(offer.data.offer());
+    auto bytes = offerBytes(offer);
+    book->second.mOffers.emplace(key, offer);
+    book->second.mBytes += bytes;
+    mBytes += bytes;
+    mLocations[offer.data.offer().offerID] = Location{book, key};
+}
+
+void
+OrderBook::eraseLocation(
+    std::unordered_map<uint64_t, Location>::iterator location)
+{
+    auto& book = location->second.mBook->second;
+    auto it = book.mOffers.find(location->second.mKey);
+    auto bytes = offerBytes(it->second);
+    book.mBytes -= bytes;
+    mBytes -= bytes;
+    book.mOffers.erase(it);
+    mLocations.erase(location);
+}
+
+void
+OrderBook::dropBook(BookMap::iterator book)
+{
+    for (auto const& o : book->second.mOffers)
+    {
+        mLocations.erase(o.first.mOfferID);
+    }
+    mBytes -= book->second.mBytes;
+    mRecency.erase(book->second.mRecency);
+    mBooks.erase(book);
+}
+
+void
+OrderBook::evict()
+{
+    while (mBytes > mMaxBytes && !mRecency.empty())
+    {
+        dropBook(mBooks.find(mRecency.back()));
+    }
+    mBytesCounter.set_count(mBytes);
+}
+
+void
+OrderBook::forEachBest(
+    Asset const& selling, Asset const& buying, size_t numOffers, size_t offset,
+    std::function<void(std::function<void(LedgerEntry const&)>)> loadAll,
+    std::function<void(LedgerEntry const&)> f)
+{
+    auto book = mBooks.find(AssetPair{selling, buying});
+    if (book == mBooks.end())
+    {
+        mLoads.Mark();
+        book = mBooks.emplace(AssetPair{selling, buying}, Book{}).first;
+        mRecency.push_front(book->first);
+        book->second.mRecency = mRecency.begin();
+        try
+        {
+            loadAll([this, book](LedgerEntry const& offer) {
+                insert(book, offer);
+            });
+        }
+        catch (...)
+        {
+            dropBook(book);
+            throw;
+        }
+    }
+    else
+    {
+        mHits.Mark();
+        mRecency.splice(mRecency.begin(), mRecency, book->second.mRecency);
+    }
+
+    // copied out first: the book may be dropped below
+    std::vector<LedgerEntry> best;
+    auto const& offers = book->second.mOffers;
+    auto it = offers.begin();
+    for (size_t i = 0; i < offset && it != offers.end(); ++i)
+    {
+        ++it;
+    }
+    for (; it != offers.end() && best.size() < numOffers; ++it)
+    {
+        best.emplace_back(it->second);
+    }
+    if (book->second.mBytes > mMaxBytes)
+    {
+        // too large to cache, rather than evicting every other book for it
+        dropBook(book);
+        mBytesCounter.set_count(mBytes);
+    }
+    else
+    {
+        evict();
+    }
+
+    for (auto const& offer : best)
+    {
+        f(offer);
+    }
+}
+
+LedgerEntry const*
+OrderBook::find(uint64_t offerID) const
+{
+    auto location = mLocations.find(offerID);
+    if (location == mLocations.end())
+    {
+        return nullptr;
+    }
+    auto const& offers = location->second.mBook->second.mOffers;
+    return &offers.find(location->second.mKey)->second;
+}
+
+void
+OrderBook::store(LedgerEntry const& offer)
+{
+    auto const& o = offer.data.offer();
+    auto location = mLocations.find(o.offerID);
+    if (location != mLocations.end())
+    {
+        eraseLocation(location);
+    }
+    auto book = mBooks.find(AssetPair{o.selling, o.buying});
+    if (book != mBooks.end())
+    {
+        insert(book, offer);
+    }
+    evict();
+}
+
+void
+OrderBook::erase(uint64_t offerID)
+{
+    auto location = mLocations.find(offerID);
+    if (location != mLocations.end())
+    {
+        eraseLocation(location);
+        mBytesCounter.set_count(mBytes);
+    }
+}
+
+void
+OrderBook::invalidate(Asset const& selling, Asset const& buying)
+{
+    auto book = mBooks.find(AssetPair{selling, buying});
+    if (book != mBooks.end())
+    {
+        dropBook(book);
+        mBytesCounter.set_count(mBytes);
+    }
+}
+
+void
+OrderBook::clear()
+{
+    mBooks.clear();
+    mRecency.clear();
+    mLocations.clear();
+    mBytes = 0;
+    mBytesCounter.set_count(mBytes);
+}
+
+size_t
+OrderBook::size() const
+{
+    return mBooks.size();
+}
+
+size_t
+OrderBook::getBytes() const
+{
+    return mBytes;
+}
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+#include "util/XDROperators.h"
+
+#include <functional>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Meter;
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+/**
+ * OrderBook is the Database's cache of the offers of recently crossed asset
+ * pairs, each pair's offers sorted the way OfferFrame::loadBestOffers orders
+ * them (by price, then offer id), so that finding the best offers walks a
+ * sorted map instead of querying the offers table.
+ *
+ * A pair's book is loaded whole from the database the first time it is
+ * looked up, then kept up to date by the offer store paths (write-through)
+ * and by LedgerDelta::rollback, which puts back the earlier values of the
+ * offers it rolls back. Writes that cannot be applied precisely (bulk writes,
+ * rolled back offers whose earlier value is not known) drop the affected
+ * books, which are then loaded again on demand.
+ *
+ * Capacity is a budget in bytes, estimated like EntryCache's; the least
+ * recently used books are dropped first. A budget of 0 disables the cache.
+ * Like the rest of Database this is main-thread only.
+ */
+class OrderBook : NonMovableOrCopyable
+{
+    struct AssetPair
+    {
+        Asset mSelling;
+        Asset mBuying;
+        bool operator<(AssetPair const& other) const;
+    };
+
+    // price as stored in the offers table, then offer id
+    struct OfferKey
+    {
+        double mPrice;
+        uint64_t mOfferID;
+        bool operator<(OfferKey const& other) const;
+    };
+
+    struct Book
+    {
+        std::map<OfferKey, LedgerEntry> mOffers;
+        size_t mBytes{0};
+        std::list<AssetPair>::iterator mRecency;
+    };
+    typedef std::map<AssetPair, Book> BookMap;
+
+    struct Location
+    {
+        BookMap::iterator mBook;
+        OfferKey mKey;
+    };
+
+    size_t const mMaxBytes;
+    size_t mBytes{0};
+    BookMap mBooks;
+    // most recently used first
+    std::list<AssetPair> mRecency;
+    // offers of the loaded books, by offer id
+    std::unordered_map<uint64_t, Location> mLocations;
+
+    medida::Meter& mHits;
+    medida::Meter& mLoads;
+    medida::Counter& mBytesCounter;
+
+    static OfferKey offerKey(OfferEntry const& offer);
+    static size_t offerBytes(LedgerEntry const& offer);
+    void insert(BookMap::iterator book, LedgerEntry const& offer);
+    void eraseLocation(
+        std::unordered_map<uint64_t, Location>::iterator location);
+    void dropBook(BookMap::iterator book);
+    void evict();
+
+  public:
+    // Rough per-offer bookkeeping cost (map nodes) added to the XDR size of
+    // the entry when accounting bytes.
+    static size_t const OFFER_OVERHEAD = 128;
+
+    OrderBook(medida::MetricsRegistry& metrics, size_t maxBytes);
+
+    bool isEnabled() const;
+
+    // Calls `f` on the `numOffers` best offers selling `selling` for
+    // `buying`, skipping the first `offset`. The book is loaded with
+    // `loadAll` (which must call its argument on every offer of the pair)
+    // when not cached.
+    void
+    forEachBest(Asset const& selling, Asset const& buying, size_t numOffers,
+                size_t offset,
+                std::function<void(std::function<void(LedgerEntry const&)>)>
+                    loadAll,
+                std::function<void(LedgerEntry const&)> f);
+
+    // The offer as stored in the database if its book is loaded, nullptr
+    // otherwise.
+    LedgerEntry const* find(uint64_t offerID) const;
+
+    // `offer` was stored as-is in the database.
+    void store(LedgerEntry const& offer);
+    // The offer was deleted from the database.
+    void erase(uint64_t offerID);
+
+    // Drops the book of the pair, if loaded.
+    void invalidate(Asset const& selling, Asset const& buying);
+    void clear();
+
+    // Number of loaded books.
+    size_t size() const;
+
+    // Estimated bytes held by loaded books.
+    size_t getBytes() const;
+};
+}
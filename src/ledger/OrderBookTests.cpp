@@ -0,0 +1,121 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/OrderBook.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "medida/metrics_registry.h"
+
+using namespace stellar;
+
+namespace
+{
+LedgerEntry
+makeOffer(Asset const& selling, Asset const& buying, uint64_t offerID,
+          int32_t n, int32_t d)
+{
+    LedgerEntry e;
+    e.data.type(OFFER);
+    auto& o = e.data.offer();
+    o = LedgerTestUtils::generateValidOfferEntry();
+    o.selling = selling;
+    o.buying = buying;
+    o.offerID = offerID;
+    o.price.n = n;
+    o.price.d = d;
+    return e;
+}
+
+std::vector<uint64_t>
+bestIDs(OrderBook& book, Asset const& selling, Asset const& buying,
+        size_t numOffers, size_t offset,
+        std::vector<LedgerEntry> const& stored, int& loads)
+{
+    std::vector<uint64_t> res;
+    book.forEachBest(
+        selling, buying, numOffers, offset,
+        [&](std::function<void(LedgerEntry const&)> f) {
+            ++loads;
+            for (auto const& e : stored)
+            {
+                if (e.data.offer().selling == selling &&
+                    e.data.offer().buying == buying)
+                {
+                    f(e);
+                }
+            }
+        },
+        [&res](LedgerEntry const& e) {
+            res.emplace_back(e.data.offer().offerID);
+        });
+    return res;
+}
+}
+
+TEST_CASE("order book", "[ledger][orderbook]")
+{
+    medida::MetricsRegistry metrics;
+    OrderBook book(metrics, 1 << 20);
+
+    Asset native;
+    auto usd = LedgerTestUtils::generateValidOfferEntry().buying;
+    while (usd.type() == ASSET_TYPE_NATIVE)
+    {
+        usd = LedgerTestUtils::generateValidOfferEntry().buying;
+    }
+
+    // in the database, unsorted
+    std::vector<LedgerEntry> stored{makeOffer(native, usd, 3, 1, 2),
+                                    makeOffer(native, usd, 1, 1, 1),
+                                    makeOffer(native, usd, 2, 1, 2),
+                                    makeOffer(usd, native, 4, 1, 3)};
+    int loads = 0;
+
+    // by price, then offer id
+    REQUIRE(bestIDs(book, native, usd, 10, 0, stored, loads) ==
+            std::vector<uint64_t>{2, 3, 1});
+    REQUIRE(bestIDs(book, native, usd, 1, 1, stored, loads) ==
+            std::vector<uint64_t>{3});
+    REQUIRE(loads == 1);
+    REQUIRE(book.size() == 1);
+
+    SECTION("kept up to date by stores")
+    {
+        // offer 1 gets the best price, offer 2 is taken, offer 4 moves to
+        // the loaded book
+        book.store(makeOffer(native, usd, 1, 1, 4));
+        book.erase(2);
+        book.store(makeOffer(native, usd, 4, 1, 3));
+        REQUIRE(bestIDs(book, native, usd, 10, 0, stored, loads) ==
+                std::vector<uint64_t>{1, 4, 3});
+        book.store(makeOffer(usd, native, 4, 1, 3));
+        REQUIRE(bestIDs(book, native, usd, 10, 0, stored, loads) ==
+                std::vector<uint64_t>{1, 3});
+        REQUIRE(loads == 1);
+    }
+
+    SECTION("invalidated books are loaded again")
+    {
+        book.invalidate(native, usd);
+        REQUIRE(book.size() == 0);
+        REQUIRE(book.getBytes() == 0);
+        REQUIRE(bestIDs(book, native, usd, 10, 0, stored, loads).size() == 3);
+        REQUIRE(loads == 2);
+    }
+
+    SECTION("least recently used books are evicted")
+    {
+        auto oneBook = book.getBytes();
+        OrderBook small(metrics, oneBook + oneBook / 2);
+        bestIDs(small, native, usd, 1, 0, stored, loads);
+        bestIDs(small, usd, native, 1, 0, stored, loads);
+        REQUIRE(small.size() == 2);
+        // too large to keep with the other book
+        small.store(makeOffer(usd, native, 5, 1, 1));
+        small.store(makeOffer(usd, native, 6, 1, 1));
+        small.store(makeOffer(usd, native, 7, 1, 1));
+        REQUIRE(small.size() == 1);
+        REQUIRE(small.getBytes() <= oneBook + oneBook / 2);
+    }
+}
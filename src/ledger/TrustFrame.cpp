@@ -8,10 +8,12 @@
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerRange.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
+#include <unordered_set>
 
 using namespace std;
 using namespace soci;
@@ -274,9 +276,10 @@ TrustFrame::getMaxAmountReceive(LedgerManager& lm) const
 bool
 TrustFrame::exists(Database& db, LedgerKey const& key)
 {
-    if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
+    HashedLedgerKey cacheKey(key);
+    if (cachedEntryExists(cacheKey, db))
     {
-        return true;
+        return getCachedEntry(cacheKey, db) != nullptr;
     }
 
     std::string actIDStrKey, issuerStrKey, assetCode;
@@ -318,10 +321,9 @@ void
 TrustFrame::deleteTrustLinesModifiedOnOrAfterLedger(Database& db,
                                                     uint32_t oldestLedger)
 {
-    db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == TRUSTLINE &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+    db.getEntryCache().eraseIf(
+        TRUSTLINE, [oldestLedger](EntryCache::Value const& le) -> bool {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
 
     {
@@ -343,6 +345,13 @@ TrustFrame::storeDelete(LedgerDelta& delta, Database& db) const
 void
 TrustFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
 {
+    if (delta.writesDeferred(TRUSTLINE))
+    {
+        putCachedEntry(key, nullptr, db);
+        delta.deleteEntry(key);
+        return;
+    }
+
     flushCachedEntry(key, db);
 
     std::string actIDStrKey, issuerStrKey, assetCode;
@@ -356,17 +365,105 @@ TrustFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
     delta.deleteEntry(key);
 }
 
+void
+TrustFrame::storeAddOrChangeBulk(Database& db,
+                                 std::vector<LedgerEntry> const& entries)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+
+    using DatabaseUtils::BulkColumn;
+    std::vector<BulkColumn> cols{{"accountid", "TEXT"},
+                                 {"assettype", "INT"},
+                                 {"issuer", "TEXT"},
+                                 {"assetcode", "TEXT"},
+                                 {"balance", "BIGINT"},
+                                 {"tlimit", "BIGINT"},
+                                 {"flags", "INT"},
+                                 {"lastmodified", "INT"},
+                                 {"buyingliabilities", "BIGINT"},
+                                 {"sellingliabilities", "BIGINT"}};
+
+    for (auto const& e : entries)
+    {
+        auto const& tl = e.data.trustLine();
+        std::string actIDStrKey, issuerStrKey, assetCode;
+        getKeyFields(LedgerEntryKey(e), actIDStrKey, issuerStrKey, assetCode);
+        cols[0].push(actIDStrKey);
+        cols[1].push(std::to_string(static_cast<int>(tl.asset.type())));
+        cols[2].push(issuerStrKey);
+        cols[3].push(assetCode);
+        cols[4].push(std::to_string(tl.balance));
+        cols[5].push(std::to_string(tl.limit));
+        cols[6].push(std::to_string(tl.flags));
+        cols[7].push(std::to_string(e.lastModifiedLedgerSeq));
+        if (tl.ext.v() == 1)
+        {
+            cols[8].push(std::to_string(tl.ext.v1().liabilities.buying));
+            cols[9].push(std::to_string(tl.ext.v1().liabilities.selling));
+        }
+        else
+        {
+            cols[8].pushNull();
+            cols[9].pushNull();
+        }
+    }
+
+    DatabaseUtils::bulkUpsert(db, "trust", "trustlines",
+                              {"accountid", "issuer", "assetcode"}, cols);
+}
+
+void
+TrustFrame::storeDeleteBulk(Database& db, std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    using DatabaseUtils::BulkColumn;
+    std::vector<BulkColumn> cols{
+        {"accountid", "TEXT"}, {"issuer", "TEXT"}, {"assetcode", "TEXT"}};
+    for (auto const& k : keys)
+    {
+        std::string actIDStrKey, issuerStrKey, assetCode;
+        getKeyFields(k, actIDStrKey, issuerStrKey, assetCode);
+        cols[0].push(actIDStrKey);
+        cols[1].push(issuerStrKey);
+        cols[2].push(assetCode);
+    }
+    DatabaseUtils::bulkDelete(db, "trust", "trustlines", cols);
+}
+
 void
 TrustFrame::storeChange(LedgerDelta& delta, Database& db)
 {
     auto key = getKey();
-    flushCachedEntry(key, db);
 
     if (mIsIssuer)
+    {
+        flushCachedEntry(key, db);
         return;
+    }
 
     touch(delta);
 
+    if (isCachedAsIs(db, "trust"))
+    {
+        delta.modEntry(*this);
+        return;
+    }
+    if (delta.writesDeferred(TRUSTLINE))
+    {
+        // written by LedgerDelta::flushDeferredWrites
+        putCachedEntry(db);
+        delta.modEntry(*this);
+        return;
+    }
+    flushCachedEntry(key, db);
+
     std::string actIDStrKey, issuerStrKey, assetCode;
     getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
 
@@ -417,6 +514,14 @@ TrustFrame::storeAdd(LedgerDelta& delta, Database& db)
 
     touch(delta);
 
+    if (delta.writesDeferred(TRUSTLINE))
+    {
+        // written by LedgerDelta::flushDeferredWrites
+        putCachedEntry(db);
+        delta.addEntry(*this);
+        return;
+    }
+
     std::string actIDStrKey, issuerStrKey, assetCode;
     unsigned int assetType = getKey().trustLine().asset.type();
     getKeyFields(getKey(), actIDStrKey, issuerStrKey, assetCode);
@@ -468,7 +573,7 @@ static const char* trustLineColumnSelector =
 TrustFrame::pointer
 TrustFrame::createIssuerFrame(Asset const& issuer)
 {
-    pointer res = make_shared<TrustFrame>();
+    pointer res = makePooled<TrustFrame>();
     res->mIsIssuer = true;
     TrustLineEntry& tl = res->mEntry.data.trustLine();
 
@@ -497,22 +602,24 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
         }
     }
 
-    LedgerKey key;
-    key.type(TRUSTLINE);
-    key.trustLine().accountID = accountID;
-    key.trustLine().asset = asset;
+    LedgerKey k;
+    k.type(TRUSTLINE);
+    k.trustLine().accountID = accountID;
+    k.trustLine().asset = asset;
+    HashedLedgerKey key(std::move(k));
     if (cachedEntryExists(key, db))
     {
         auto p = getCachedEntry(key, db);
-        if (p)
+        if (!p)
         {
-            pointer ret = std::make_shared<TrustFrame>(*p);
-            if (delta)
-            {
-                delta->recordEntry(*ret);
-            }
-            return ret;
+            return nullptr;
+        }
+        pointer ret = makePooled<TrustFrame>(*p);
+        if (delta)
+        {
+            delta->recordEntry(*ret);
         }
+        return ret;
     }
 
     std::string accStr, issuerStr, assetStr;
@@ -542,7 +649,7 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
     pointer retLine;
     auto timer = db.getSelectTimer("trust");
     loadLines(prep, [&retLine](LedgerEntry const& trust) {
-        retLine = make_shared<TrustFrame>(trust);
+        retLine = makePooled<TrustFrame>(trust);
     });
 
     if (retLine)
@@ -648,10 +755,98 @@ TrustFrame::loadLines(AccountID const& accountID,
 
     auto timer = db.getSelectTimer("trust");
     loadLines(prep, [&retLines](LedgerEntry const& cur) {
-        retLines.emplace_back(make_shared<TrustFrame>(cur));
+        retLines.emplace_back(makePooled<TrustFrame>(cur));
     });
 }
 
+void
+TrustFrame::prefetch(Database& db, std::vector<LedgerKey> const& keys)
+{
+    if (keys.empty())
+    {
+        return;
+    }
+
+    // Lines are looked up by account, which the trustlines primary key
+    // leads with; only the requested ones are cached.
+    std::unordered_set<LedgerKey, LedgerKeyHash> wanted(keys.begin(),
+                                                        keys.end());
+    std::unordered_set<AccountID> accounts;
+    std::vector<std::string> strKeys;
+    for (auto const& k : keys)
+    {
+        if (accounts.insert(k.trustLine().accountID).second)
+        {
+            strKeys.emplace_back(KeyUtils::toStrKey(k.trustLine().accountID));
+        }
+    }
+
+    auto inList = DatabaseUtils::placeholderList(
+        DatabaseUtils::BULK_LOAD_BATCH_SIZE);
+    auto query = std::string(trustLineColumnSelector);
+    query += " WHERE accountid IN " + inList;
+    for (auto& batch : DatabaseUtils::makeLoadBatches(strKeys))
+    {
+        auto prep = db.getPreparedStatement(query);
+        auto& st = prep.statement();
+        for (auto const& k : batch)
+        {
+            st.exchange(use(k));
+        }
+        auto timer = db.getSelectTimer("trust");
+        loadLines(prep, [&](LedgerEntry const& trust) {
+            auto key = LedgerEntryKey(trust);
+            if (wanted.erase(key) != 0)
+            {
+                db.getEntryCache().put(
+                    key, std::make_shared<LedgerEntry const>(trust), true);
+            }
+        });
+    }
+
+    for (auto const& key : wanted)
+    {
+        db.getEntryCache().put(key, nullptr, true);
+    }
+}
+
+void
+TrustFrame::loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+                     std::function<void(LedgerEntry const&)> processor)
+{
+    // same lookup by account as prefetch
+    std::unordered_set<LedgerKey, LedgerKeyHash> wanted(keys.begin(),
+                                                        keys.end());
+    std::unordered_set<AccountID> accounts;
+    std::vector<std::string> strKeys;
+    for (auto const& k : keys)
+    {
+        if (accounts.insert(k.trustLine().accountID).second)
+        {
+            strKeys.emplace_back(KeyUtils::toStrKey(k.trustLine().accountID));
+        }
+    }
+
+    auto st = DatabaseUtils::prepare(
+        sess, std::string(trustLineColumnSelector) + " WHERE accountid IN " +
+                  DatabaseUtils::placeholderList(
+                      DatabaseUtils::BULK_LOAD_BATCH_SIZE));
+    for (auto& batch : DatabaseUtils::makeLoadBatches(strKeys))
+    {
+        StatementContext prep(st);
+        for (auto const& k : batch)
+        {
+            prep.statement().exchange(use(k));
+        }
+        loadLines(prep, [&](LedgerEntry const& trust) {
+            if (wanted.erase(LedgerEntryKey(trust)) != 0)
+            {
+                processor(trust);
+            }
+        });
+    }
+}
+
 std::unordered_map<AccountID, std::vector<TrustFrame::pointer>>
 TrustFrame::loadAllLines(Database& db)
 {
@@ -664,11 +859,22 @@ TrustFrame::loadAllLines(Database& db)
     auto timer = db.getSelectTimer("trust");
     loadLines(prep, [&retLines](LedgerEntry const& cur) {
         auto& thisUserLines = retLines[cur.data.trustLine().accountID];
-        thisUserLines.emplace_back(make_shared<TrustFrame>(cur));
+        thisUserLines.emplace_back(makePooled<TrustFrame>(cur));
     });
     return retLines;
 }
 
+void
+TrustFrame::loadAllIntoCache(Database& db)
+{
+    auto prep = db.getPreparedStatement(trustLineColumnSelector);
+    auto timer = db.getSelectTimer("trust");
+    loadLines(prep, [&db](LedgerEntry const& cur) {
+        db.getEntryCache().put(LedgerEntryKey(cur),
+                               std::make_shared<LedgerEntry const>(cur));
+    });
+}
+
 void
 TrustFrame::dropAll(Database& db)
 {
@@ -57,7 +57,7 @@ class TrustFrame : public EntryFrame
     EntryFrame::pointer
     copy() const override
     {
-        return std::make_shared<TrustFrame>(*this);
+        return makePooled<TrustFrame>(*this);
     }
 
     // Instance-based overrides of EntryFrame.
@@ -68,6 +68,13 @@ class TrustFrame : public EntryFrame
     // Static helper that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+    // Bulk writes used by EntryFrame::storeAddOrChangeBulk,
+    // EntryFrame::storeDeleteBulk and LedgerDelta::flushDeferredWrites; the
+    // db entry cache is not flushed here.
+    static void storeAddOrChangeBulk(Database& db,
+                                     std::vector<LedgerEntry> const& entries);
+    static void storeDeleteBulk(Database& db,
+                                std::vector<LedgerKey> const& keys);
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
@@ -85,6 +92,20 @@ class TrustFrame : public EntryFrame
                         Database& db, LedgerDelta& delta);
 
     // note: only returns trust lines stored in the database
+    // Loads the given trustlines into the entry cache with a few multi-key
+    // queries, caching nullptr for the ones that do not exist. Keys must be
+    // unique, not already cached, and not for an issuer's own asset.
+    static void prefetch(Database& db, std::vector<LedgerKey> const& keys);
+    // Loads every trust line into the entry cache (see
+    // EntryFrame::loadLedgerStateIntoCache).
+    static void loadAllIntoCache(Database& db);
+    // Calls `processor` with those of `keys` (all of this type) that are in
+    // the database, loaded through `sess` with a few multi-key queries and
+    // without going through the entry cache (see EntryFrame::loadBulk).
+    static void
+    loadBulk(soci::session& sess, std::vector<LedgerKey> const& keys,
+             std::function<void(LedgerEntry const&)> processor);
+
     static void loadLines(AccountID const& accountID,
                           std::vector<TrustFrame::pointer>& retLines,
                           Database& db);
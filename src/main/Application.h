@@ -29,18 +29,22 @@ class CatchupManager;
 class HistoryArchiveManager;
 class HistoryManager;
 class Maintainer;
+class ExternalQueue;
 class ProcessManager;
 class Herder;
 class HerderPersistence;
 class InvariantManager;
+class LatencyHistograms;
 class OverlayManager;
 class Database;
 class PersistentState;
 class LoadGenerator;
+enum class LoadGenMode;
 class CommandHandler;
 class WorkManager;
 class BanManager;
 class StatusManager;
+class WorkerLanes;
 
 class Application;
 void validateNetworkPassphrase(std::shared_ptr<Application> app);
@@ -178,6 +182,10 @@ class Application
     // reported through the administrative HTTP interface, see CommandHandler.
     virtual medida::MetricsRegistry& getMetrics() = 0;
 
+    // Get the fixed bucket histograms kept alongside the latency-critical
+    // timers of getMetrics(), see LatencyHistogram.
+    virtual LatencyHistograms& getLatencyHistograms() = 0;
+
     // Ensure any App-local metrics that are "current state" gauge-like counters
     // reflect the current reality as best as possible.
     virtual void syncOwnMetrics() = 0;
@@ -185,17 +193,30 @@ class Application
     // Call syncOwnMetrics on self and syncMetrics all objects owned by App.
     virtual void syncAllMetrics() = 0;
 
+    // Set the {*, "memory", "*-bytes"} counters of the major in-memory
+    // structures that are too costly to keep up to date on every change to
+    // the approximate bytes they hold. Called by syncAllMetrics.
+    virtual void syncMemoryMetrics() = 0;
+
+    // Approximate bytes held by each of the major in-memory structures and
+    // their total, after syncMemoryMetrics. See the /memory command.
+    virtual Json::Value getMemoryInfo() = 0;
+
     // Clear all metrics
     virtual void clearMetrics(std::string const& domain) = 0;
 
     // Get references to each of the "subsystem" objects.
     virtual TmpDirManager& getTmpDirManager() = 0;
+    // Where catchup downloads ledger and transaction files: the
+    // TmpDirManager unless CATCHUP_SCRATCH_DIR_PATH is set.
+    virtual TmpDirManager& getScratchDirManager() = 0;
     virtual LedgerManager& getLedgerManager() = 0;
     virtual BucketManager& getBucketManager() = 0;
     virtual CatchupManager& getCatchupManager() = 0;
     virtual HistoryArchiveManager& getHistoryArchiveManager() = 0;
     virtual HistoryManager& getHistoryManager() = 0;
     virtual Maintainer& getMaintainer() = 0;
+    virtual ExternalQueue& getExternalQueue() = 0;
     virtual ProcessManager& getProcessManager() = 0;
     virtual Herder& getHerder() = 0;
     virtual HerderPersistence& getHerderPersistence() = 0;
@@ -213,6 +234,21 @@ class Application
     // with caution.
     virtual asio::io_service& getWorkerIOService() = 0;
 
+    // Get the lanes ordering the work handed to the worker threads by urgency.
+    // Prefer these to posting to the worker IO service directly, so that
+    // latency-critical work does not queue behind long background jobs.
+    virtual WorkerLanes& getWorkerLanes() = 0;
+
+    // Number of threads serving the worker IO service (Config::WORKER_THREADS
+    // or, by default, one per hardware thread).
+    virtual size_t getWorkerThreadCount() const = 0;
+
+    // Get the IO service serving peer sockets: that of the clock unless
+    // Config::OVERLAY_IO_THREADS is set, in which case it is served by that
+    // many dedicated threads, and only hands work back to the main thread by
+    // posting it to the clock's IO service.
+    virtual asio::io_service& getOverlayIOService() = 0;
+
     // Perform actions necessary to transition from BOOTING_STATE to other
     // states. In particular: either reload or reinitialize the database, and
     // either restart or begin reacquiring SCP consensus (as instructed by
@@ -235,7 +271,7 @@ class Application
 
     // If config.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING=true, generate some load
     // against the current application.
-    virtual void generateLoad(bool isCreate, uint32_t nAccounts,
+    virtual void generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
                               uint32_t batchSize, bool autoRate) = 0;
 
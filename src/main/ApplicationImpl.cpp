@@ -16,6 +16,7 @@
 #include "database/Database.h"
 #include "herder/Herder.h"
 #include "herder/HerderPersistence.h"
+#include "herder/TxSetFrame.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
 #include "invariant/AccountSubEntriesCountIsValid.h"
@@ -42,7 +43,9 @@
 #include "scp/LocalNode.h"
 #include "scp/QuorumSetUtils.h"
 #include "simulation/LoadGenerator.h"
+#include "util/LatencyHistogram.h"
 #include "util/StatusManager.h"
+#include "util/WorkerLanes.h"
 #include "work/WorkManager.h"
 
 #include "util/Logging.h"
@@ -59,13 +62,17 @@ namespace stellar
 ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     : mVirtualClock(clock)
     , mConfig(cfg)
-    , mWorkerIOService(std::thread::hardware_concurrency())
+    , mWorkerIOService(cfg.WORKER_THREADS != 0
+                           ? cfg.WORKER_THREADS
+                           : std::thread::hardware_concurrency())
     , mWork(std::make_unique<asio::io_service::work>(mWorkerIOService))
+    , mOverlayIOService(std::max<unsigned>(cfg.OVERLAY_IO_THREADS, 1))
     , mWorkerThreads()
     , mStopSignals(clock.getIOService(), SIGINT)
     , mStopping(false)
     , mStoppingTimer(*this)
     , mMetrics(std::make_unique<medida::MetricsRegistry>())
+    , mLatencyHistograms(std::make_unique<LatencyHistograms>(*mMetrics))
     , mAppStateCurrent(mMetrics->NewCounter({"app", "state", "current"}))
     , mAppStateChanges(mMetrics->NewTimer({"app", "state", "changes"}))
     , mLastStateChange(clock.now())
@@ -81,8 +88,12 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     std::srand(static_cast<uint32>(clock.now().time_since_epoch().count()));
 
     mNetworkID = sha256(mConfig.NETWORK_PASSPHRASE);
+    PubKeyUtils::setVerifySigCacheSize(mConfig.VERIFY_SIG_CACHE_SIZE);
+    mVirtualClock.setMetrics(mMetrics.get());
 
-    unsigned t = std::thread::hardware_concurrency();
+    unsigned t = static_cast<unsigned>(getWorkerThreadCount());
+    mWorkerLanes =
+        std::make_unique<WorkerLanes>(mWorkerIOService, t, *mMetrics);
     LOG(DEBUG) << "Application constructing "
                << "(worker threads: " << t << ")";
     mStopSignals.async_wait([this](asio::error_code const& ec, int sig) {
@@ -97,15 +108,31 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     {
         mWorkerThreads.emplace_back([this, t]() { this->runWorkerThread(t); });
     }
+
+    if (mConfig.OVERLAY_IO_THREADS != 0)
+    {
+        mOverlayWork =
+            std::make_unique<asio::io_service::work>(mOverlayIOService);
+        for (unsigned i = 0; i < mConfig.OVERLAY_IO_THREADS; ++i)
+        {
+            mOverlayThreads.emplace_back([this]() { mOverlayIOService.run(); });
+        }
+    }
 }
 
 void
 ApplicationImpl::initialize()
 {
+    auto stepStart = std::chrono::steady_clock::now();
     mDatabase = std::make_unique<Database>(*this);
     mPersistentState = std::make_unique<PersistentState>(*this);
     mTmpDirManager =
         std::make_unique<TmpDirManager>(mConfig.BUCKET_DIR_PATH + "/tmp");
+    if (!mConfig.CATCHUP_SCRATCH_DIR_PATH.empty())
+    {
+        mScratchDirManager = std::make_unique<TmpDirManager>(
+            mConfig.CATCHUP_SCRATCH_DIR_PATH + "/catchup");
+    }
     mOverlayManager = createOverlayManager();
     mLedgerManager = LedgerManager::create(*this);
     mHerder = createHerder();
@@ -116,6 +143,7 @@ ApplicationImpl::initialize()
     mHistoryManager = HistoryManager::create(*this);
     mInvariantManager = createInvariantManager();
     mMaintainer = std::make_unique<Maintainer>(*this);
+    mExternalQueue = std::make_unique<ExternalQueue>(*this);
     mProcessManager = ProcessManager::create(*this);
     mCommandHandler = std::make_unique<CommandHandler>(*this);
     mWorkManager = WorkManager::create(*this);
@@ -136,6 +164,7 @@ ApplicationImpl::initialize()
             std::make_shared<NtpSynchronizationChecker>(*this,
                                                         mConfig.NTP_SERVER);
     }
+    recordStartupStep("initialize", stepStart);
 
     LOG(DEBUG) << "Application constructed";
 }
@@ -270,6 +299,34 @@ ApplicationImpl::getJsonInfo()
         info["history"] = historyArchiveInfo;
     }
 
+    auto const& cfg = getConfig();
+    if (cfg.WATCHER_MODE)
+    {
+        // the budgets the watcher profile runs with, see
+        // Config::applyWatcherProfile
+        auto& w = info["watcher"];
+        w["flood_map_bytes"] =
+            static_cast<Json::UInt64>(cfg.FLOOD_MAP_MAX_BYTES);
+        w["pending_txs_bytes"] =
+            static_cast<Json::UInt64>(cfg.PENDING_TRANSACTIONS_MAX_BYTES);
+        w["tx_set_cache_bytes"] =
+            static_cast<Json::UInt64>(cfg.TX_SET_CACHE_MAX_BYTES);
+        w["qset_cache_bytes"] =
+            static_cast<Json::UInt64>(cfg.QSET_CACHE_MAX_BYTES);
+        w["scp_statements_per_slot"] =
+            static_cast<Json::UInt64>(cfg.SCP_MAX_STATEMENTS_HISTORY);
+        w["scp_history_saved"] = false;
+        w["publishing"] = false;
+    }
+
+    for (auto const& step : mStartupSteps)
+    {
+        Json::Value s;
+        s["step"] = step.first;
+        s["ms"] = static_cast<Json::UInt64>(step.second.count());
+        info["startup"].append(s);
+    }
+
     return root;
 }
 
@@ -300,6 +357,11 @@ ApplicationImpl::~ApplicationImpl()
     reportCfgMetrics();
     shutdownMainIOService();
     joinAllThreads();
+    // the clock can outlive this application, or be shared with others
+    if (mVirtualClock.getMetrics() == mMetrics.get())
+    {
+        mVirtualClock.setMetrics(nullptr);
+    }
     LOG(INFO) << "Application destroyed";
 }
 
@@ -309,10 +371,25 @@ ApplicationImpl::timeNow()
     return VirtualClock::to_time_t(getClock().now());
 }
 
+void
+ApplicationImpl::recordStartupStep(std::string const& name,
+                                   std::chrono::steady_clock::time_point& since)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto took =
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - since);
+    LOG(INFO) << "Startup step " << name << " took " << took.count() << "ms";
+    mStartupSteps.emplace_back(name, took);
+    since = now;
+}
+
 void
 ApplicationImpl::start()
 {
+    auto startTime = std::chrono::steady_clock::now();
+    auto stepStart = startTime;
     mDatabase->upgradeToCurrentSchema();
+    recordStartupStep("upgrade-db", stepStart);
 
     if (mConfig.TESTING_UPGRADE_DATETIME.time_since_epoch().count() != 0)
     {
@@ -345,28 +422,27 @@ ApplicationImpl::start()
         throw std::invalid_argument(err);
     }
 
+    // Overlay comes up as soon as the last closed ledger is known; the
+    // BucketList is restored after that, and only then can ledgers be closed
+    // (see LedgerManager::isReadyToCloseLedgers) and publishing or forced SCP
+    // resume.
     bool done = false;
     mLedgerManager->loadLastKnownLedger(
-        [this, &done](asio::error_code const& ec) {
+        [this, &done, &stepStart, startTime](asio::error_code const& ec) {
             if (ec)
             {
                 throw std::runtime_error(
                     "Unable to restore last-known ledger state");
             }
+            recordStartupStep("restore-buckets", stepStart);
 
-            // restores Herder's state before starting overlay
-            mHerder->restoreState();
-            // set known cursors before starting maintenance job
-            ExternalQueue ps(*this);
-            ps.setInitialCursors(mConfig.KNOWN_CURSORS);
-            mMaintainer->start();
-            mOverlayManager->start();
             auto npub = mHistoryManager->publishQueuedHistory();
             if (npub != 0)
             {
                 CLOG(INFO, "Ledger")
                     << "Restarted publishing " << npub << " queued snapshots";
             }
+            recordStartupStep("publish-queue", stepStart);
             if (mConfig.FORCE_SCP)
             {
                 std::string flagClearedMsg = "";
@@ -385,8 +461,25 @@ ApplicationImpl::start()
 
                 mHerder->bootstrap();
             }
+            auto ready = std::chrono::steady_clock::now() - startTime;
+            mMetrics->NewTimer({"app", "startup", "ready"}).Update(ready);
+            LOG(INFO) << "Ready to close ledgers, "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(
+                             ready)
+                             .count()
+                      << "ms after start";
             done = true;
         });
+    recordStartupStep("load-ledger", stepStart);
+
+    // restores Herder's state before starting overlay
+    mHerder->restoreState();
+    recordStartupStep("restore-herder", stepStart);
+    // set known cursors before starting maintenance job
+    mExternalQueue->setInitialCursors(mConfig.KNOWN_CURSORS);
+    mMaintainer->start();
+    mOverlayManager->start();
+    recordStartupStep("start-overlay", stepStart);
 
     if (mNtpSynchronizationChecker)
     {
@@ -464,6 +557,18 @@ ApplicationImpl::joinAllThreads()
         w.join();
     }
     LOG(DEBUG) << "Joined all " << mWorkerThreads.size() << " threads";
+
+    // Unlike workers, overlay threads serve sockets that may never complete
+    // their pending operations: stop them outright.
+    if (mOverlayWork)
+    {
+        mOverlayWork.reset();
+        mOverlayIOService.stop();
+    }
+    for (auto& o : mOverlayThreads)
+    {
+        o.join();
+    }
 }
 
 bool
@@ -479,12 +584,12 @@ ApplicationImpl::manualClose()
 }
 
 void
-ApplicationImpl::generateLoad(bool isCreate, uint32_t nAccounts,
+ApplicationImpl::generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
                               uint32_t batchSize, bool autoRate)
 {
     getMetrics().NewMeter({"loadgen", "run", "start"}, "run").Mark();
-    getLoadGenerator().generateLoad(isCreate, nAccounts, offset, nTxs, txRate,
+    getLoadGenerator().generateLoad(mode, nAccounts, offset, nTxs, txRate,
                                     batchSize, autoRate);
 }
 
@@ -501,11 +606,7 @@ ApplicationImpl::getLoadGenerator()
 void
 ApplicationImpl::checkDB()
 {
-    getClock().getIOService().post([this] {
-        checkDBAgainstBuckets(this->getMetrics(), this->getBucketManager(),
-                              this->getDatabase(),
-                              this->getBucketManager().getBucketList());
-    });
+    getClock().getIOService().post([this] { checkDBAgainstBuckets(*this); });
 }
 
 void
@@ -582,6 +683,12 @@ ApplicationImpl::getMetrics()
     return *mMetrics;
 }
 
+LatencyHistograms&
+ApplicationImpl::getLatencyHistograms()
+{
+    return *mLatencyHistograms;
+}
+
 void
 ApplicationImpl::syncOwnMetrics()
 {
@@ -605,6 +712,18 @@ ApplicationImpl::syncOwnMetrics()
     mMetrics->NewMeter({"crypto", "verify", "total"}, "signature")
         .Mark(vhit + vmiss);
 
+    // Same for the tx set hash and apply order computations.
+    uint64_t txSetHashes = 0, txSetApplyOrders = 0;
+    TxSetFrame::flushComputeCounts(txSetHashes, txSetApplyOrders);
+    mMetrics->NewMeter({"herder", "txset", "hash-compute"}, "txset")
+        .Mark(txSetHashes);
+    mMetrics->NewMeter({"herder", "txset", "apply-order-compute"}, "txset")
+        .Mark(txSetApplyOrders);
+
+    // And log messages dropped by the asynchronous log writer.
+    mMetrics->NewMeter({"logging", "message", "dropped"}, "message")
+        .Mark(Logging::flushDroppedMessageCount());
+
     // Similarly, flush global process-table stats.
     mMetrics->NewCounter({"process", "memory", "handles"})
         .set_count(mProcessManager->getNumRunningProcesses());
@@ -615,9 +734,49 @@ ApplicationImpl::syncAllMetrics()
 {
     mHerder->syncMetrics();
     mLedgerManager->syncMetrics();
+    syncMemoryMetrics();
     syncOwnMetrics();
 }
 
+void
+ApplicationImpl::syncMemoryMetrics()
+{
+    mHerder->syncMemoryMetrics();
+    mBucketManager->syncMemoryMetrics();
+    mMetrics->NewCounter({"crypto", "memory", "verify-cache-bytes"})
+        .set_count(PubKeyUtils::getVerifySigCacheBytes());
+}
+
+Json::Value
+ApplicationImpl::getMemoryInfo()
+{
+    syncMemoryMetrics();
+
+    // counters kept up to date by their owners, or by syncMemoryMetrics
+    std::vector<medida::MetricName> counters = {
+        {"overlay", "memory", "flood-map-bytes"},
+        {"herder", "pending-txs", "bytes"},
+        {"scp", "memory", "pending-envelopes-bytes"},
+        {"overlay", "memory", "item-fetch-map-bytes"},
+        {"database", "memory", "entry-cache"},
+        {"database", "memory", "order-book"},
+        {"crypto", "memory", "verify-cache-bytes"},
+        {"scp", "memory", "known-slots-bytes"},
+        {"bucket", "memory", "shared-bytes"}};
+
+    Json::Value info;
+    uint64_t total = 0;
+    for (auto const& name : counters)
+    {
+        auto bytes = mMetrics->NewCounter(name).count();
+        info["bytes"][name.domain() + "." + name.type() + "." + name.name()] =
+            static_cast<Json::Int64>(bytes);
+        total += bytes;
+    }
+    info["total"] = static_cast<Json::UInt64>(total);
+    return info;
+}
+
 void
 ApplicationImpl::clearMetrics(std::string const& domain)
 {
@@ -630,6 +789,7 @@ ApplicationImpl::clearMetrics(std::string const& domain)
             kv.second->Process(resetter);
         }
     }
+    mLatencyHistograms->clear(domain);
 }
 
 TmpDirManager&
@@ -638,6 +798,12 @@ ApplicationImpl::getTmpDirManager()
     return *mTmpDirManager;
 }
 
+TmpDirManager&
+ApplicationImpl::getScratchDirManager()
+{
+    return mScratchDirManager ? *mScratchDirManager : *mTmpDirManager;
+}
+
 LedgerManager&
 ApplicationImpl::getLedgerManager()
 {
@@ -674,6 +840,12 @@ ApplicationImpl::getMaintainer()
     return *mMaintainer;
 }
 
+ExternalQueue&
+ApplicationImpl::getExternalQueue()
+{
+    return *mExternalQueue;
+}
+
 ProcessManager&
 ApplicationImpl::getProcessManager()
 {
@@ -746,6 +918,27 @@ ApplicationImpl::getWorkerIOService()
     return mWorkerIOService;
 }
 
+WorkerLanes&
+ApplicationImpl::getWorkerLanes()
+{
+    return *mWorkerLanes;
+}
+
+size_t
+ApplicationImpl::getWorkerThreadCount() const
+{
+    return mConfig.WORKER_THREADS != 0
+               ? mConfig.WORKER_THREADS
+               : std::max(1u, std::thread::hardware_concurrency());
+}
+
+asio::io_service&
+ApplicationImpl::getOverlayIOService()
+{
+    return mConfig.OVERLAY_IO_THREADS != 0 ? mOverlayIOService
+                                           : mVirtualClock.getIOService();
+}
+
 void
 ApplicationImpl::enableInvariantsFromConfig()
 {
@@ -753,6 +946,18 @@ ApplicationImpl::enableInvariantsFromConfig()
     {
         mInvariantManager->enableInvariant(name);
     }
+    for (auto const& rate : mConfig.INVARIANT_SAMPLE_RATES)
+    {
+        mInvariantManager->setOperationSampleRate(rate.first, rate.second);
+    }
+    for (auto name : mConfig.INVARIANT_CHECKS_DEFERRED)
+    {
+        mInvariantManager->deferInvariant(name);
+    }
+    for (auto name : mConfig.INVARIANT_CHECKS_PER_LEDGER)
+    {
+        mInvariantManager->checkPerLedger(name);
+    }
 }
 
 std::unique_ptr<Herder>
@@ -10,7 +10,9 @@
 #include "medida/timer_context.h"
 #include "util/MetricResetter.h"
 #include "util/Timer.h"
+#include <chrono>
 #include <thread>
+#include <vector>
 
 namespace medida
 {
@@ -49,16 +51,21 @@ class ApplicationImpl : public Application
     virtual bool isStopping() const override;
     virtual VirtualClock& getClock() override;
     virtual medida::MetricsRegistry& getMetrics() override;
+    virtual LatencyHistograms& getLatencyHistograms() override;
     virtual void syncOwnMetrics() override;
     virtual void syncAllMetrics() override;
+    virtual void syncMemoryMetrics() override;
+    virtual Json::Value getMemoryInfo() override;
     virtual void clearMetrics(std::string const& domain) override;
     virtual TmpDirManager& getTmpDirManager() override;
+    virtual TmpDirManager& getScratchDirManager() override;
     virtual LedgerManager& getLedgerManager() override;
     virtual BucketManager& getBucketManager() override;
     virtual CatchupManager& getCatchupManager() override;
     virtual HistoryArchiveManager& getHistoryArchiveManager() override;
     virtual HistoryManager& getHistoryManager() override;
     virtual Maintainer& getMaintainer() override;
+    virtual ExternalQueue& getExternalQueue() override;
     virtual ProcessManager& getProcessManager() override;
     virtual Herder& getHerder() override;
     virtual HerderPersistence& getHerderPersistence() override;
@@ -72,6 +79,9 @@ class ApplicationImpl : public Application
     virtual StatusManager& getStatusManager() override;
 
     virtual asio::io_service& getWorkerIOService() override;
+    virtual WorkerLanes& getWorkerLanes() override;
+    virtual size_t getWorkerThreadCount() const override;
+    virtual asio::io_service& getOverlayIOService() override;
 
     void newDB() override;
     virtual void start() override;
@@ -89,7 +99,7 @@ class ApplicationImpl : public Application
 
     virtual bool manualClose() override;
 
-    virtual void generateLoad(bool isCreate, uint32_t nAccounts,
+    virtual void generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
                               uint32_t batchSize, bool autoRate) override;
 
@@ -129,9 +139,13 @@ class ApplicationImpl : public Application
 
     asio::io_service mWorkerIOService;
     std::unique_ptr<asio::io_service::work> mWork;
+    asio::io_service mOverlayIOService;
+    std::unique_ptr<asio::io_service::work> mOverlayWork;
+    std::unique_ptr<WorkerLanes> mWorkerLanes;
 
     std::unique_ptr<Database> mDatabase;
     std::unique_ptr<TmpDirManager> mTmpDirManager;
+    std::unique_ptr<TmpDirManager> mScratchDirManager;
     std::unique_ptr<OverlayManager> mOverlayManager;
     std::unique_ptr<BucketManager> mBucketManager;
     std::unique_ptr<CatchupManager> mCatchupManager;
@@ -140,6 +154,7 @@ class ApplicationImpl : public Application
     std::unique_ptr<HistoryManager> mHistoryManager;
     std::unique_ptr<InvariantManager> mInvariantManager;
     std::unique_ptr<Maintainer> mMaintainer;
+    std::unique_ptr<ExternalQueue> mExternalQueue;
     std::shared_ptr<ProcessManager> mProcessManager;
     std::unique_ptr<CommandHandler> mCommandHandler;
     std::shared_ptr<WorkManager> mWorkManager;
@@ -150,6 +165,7 @@ class ApplicationImpl : public Application
     std::unique_ptr<StatusManager> mStatusManager;
 
     std::vector<std::thread> mWorkerThreads;
+    std::vector<std::thread> mOverlayThreads;
 
     asio::signal_set mStopSignals;
 
@@ -158,13 +174,24 @@ class ApplicationImpl : public Application
     VirtualTimer mStoppingTimer;
 
     std::unique_ptr<medida::MetricsRegistry> mMetrics;
+    std::unique_ptr<LatencyHistograms> mLatencyHistograms;
     medida::Counter& mAppStateCurrent;
     medida::Timer& mAppStateChanges;
     VirtualClock::time_point mLastStateChange;
     VirtualClock::time_point mStartedOn;
 
+    // durations of the steps of initialize() and start(), reported by
+    // getJsonInfo() so that startup time can be compared between releases
+    std::vector<std::pair<std::string, std::chrono::milliseconds>>
+        mStartupSteps;
+
     Hash mNetworkID;
 
+    // records the step `name` as having taken from `since` until now, and
+    // resets `since` to now for the next step
+    void recordStartupStep(std::string const& name,
+                           std::chrono::steady_clock::time_point& since);
+
     void shutdownMainIOService();
     void runWorkerThread(unsigned i);
 
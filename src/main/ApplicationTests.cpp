@@ -0,0 +1,72 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Timer.h"
+
+#include <set>
+
+using namespace stellar;
+
+TEST_CASE("startup steps are reported by info", "[application]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto startup = app->getJsonInfo()["info"]["startup"];
+    REQUIRE(startup.isArray());
+    std::set<std::string> steps;
+    for (auto const& step : startup)
+    {
+        REQUIRE(step["ms"].isIntegral());
+        steps.insert(step["step"].asString());
+    }
+    for (auto name : {"initialize", "upgrade-db", "load-ledger",
+                      "restore-herder", "start-overlay", "restore-buckets",
+                      "publish-queue"})
+    {
+        REQUIRE(steps.count(name) == 1);
+    }
+}
+
+TEST_CASE("memory info accounts for the major structures", "[application]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto checkTotal = [](Json::Value const& info) {
+        uint64_t total = 0;
+        for (auto const& b : info["bytes"])
+        {
+            REQUIRE(b.isIntegral());
+            total += b.asUInt64();
+        }
+        REQUIRE(info["total"].asUInt64() == total);
+    };
+
+    PubKeyUtils::clearVerifySigCache();
+    auto before = app->getMemoryInfo();
+    REQUIRE(before["bytes"].size() == 9);
+    checkTotal(before);
+    auto cacheBefore =
+        before["bytes"]["crypto.memory.verify-cache-bytes"].asUInt64();
+
+    auto key = SecretKey::random();
+    for (int i = 0; i < 100; ++i)
+    {
+        auto msg = std::to_string(i);
+        REQUIRE(
+            PubKeyUtils::verifySig(key.getPublicKey(), key.sign(msg), msg));
+    }
+    auto after = app->getMemoryInfo();
+    REQUIRE(after["bytes"]["crypto.memory.verify-cache-bytes"].asUInt64() >
+            cacheBefore);
+    checkTotal(after);
+}
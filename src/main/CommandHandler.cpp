@@ -6,6 +6,7 @@
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "herder/Herder.h"
+#include "ledger/HotKeys.h"
 #include "ledger/LedgerManager.h"
 #include "lib/http/server.hpp"
 #include "lib/json/json.h"
@@ -14,11 +15,21 @@
 #include "main/Config.h"
 #include "main/Maintainer.h"
 #include "overlay/BanManager.h"
+#include "overlay/LoadManager.h"
 #include "overlay/OverlayManager.h"
+#include "simulation/LoadGenerator.h"
+#include "util/AllocStats.h"
+#include "util/Compression.h"
 #include "util/Logging.h"
+#include "util/Profiler.h"
+#include "util/PrometheusReporter.h"
 #include "util/StatusManager.h"
+#include "util/Timer.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "medida/reporting/json_reporter.h"
+#include "medida/timer.h"
 #include "util/Decoder.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
@@ -28,6 +39,8 @@
 
 #include "test/TestAccount.h"
 #include "test/TxTests.h"
+#include <fstream>
+#include <future>
 #include <regex>
 
 using namespace stellar::txtest;
@@ -37,8 +50,15 @@ using std::placeholders::_2;
 
 namespace stellar
 {
-CommandHandler::CommandHandler(Application& app) : mApp(app)
+CommandHandler::CommandHandler(Application& app)
+    : mApp(app)
+    , mIOService(std::max<unsigned>(app.getConfig().HTTP_IO_THREADS, 1))
+    , mMainThreadId(std::this_thread::get_id())
+    , mAlive(std::make_shared<int>())
 {
+    auto& ioService = mApp.getConfig().HTTP_IO_THREADS != 0
+                          ? mIOService
+                          : app.getClock().getIOService();
     if (mApp.getConfig().HTTP_PORT)
     {
         std::string ipStr;
@@ -56,17 +76,16 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
         int httpMaxClient = mApp.getConfig().HTTP_MAX_CLIENT;
 
         mServer = std::make_unique<http::server::server>(
-            app.getClock().getIOService(), ipStr, mApp.getConfig().HTTP_PORT,
-            httpMaxClient);
+            ioService, ipStr, mApp.getConfig().HTTP_PORT, httpMaxClient);
     }
     else
     {
-        mServer = std::make_unique<http::server::server>(
-            app.getClock().getIOService());
+        mServer = std::make_unique<http::server::server>(ioService);
     }
 
     mServer->add404(std::bind(&CommandHandler::fileNotFound, this, _1, _2));
 
+    addRoute("allocstats", &CommandHandler::allocStats);
     addRoute("bans", &CommandHandler::bans);
     addRoute("catchup", &CommandHandler::catchup);
     addRoute("checkdb", &CommandHandler::checkdb);
@@ -75,29 +94,143 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
     addRoute("droppeer", &CommandHandler::dropPeer);
     addRoute("generateload", &CommandHandler::generateLoad);
     addRoute("getcursor", &CommandHandler::getcursor);
+    addRoute("hotkeys", &CommandHandler::hotKeys);
     addRoute("info", &CommandHandler::info);
     addRoute("ll", &CommandHandler::ll);
     addRoute("logrotate", &CommandHandler::logRotate);
     addRoute("maintenance", &CommandHandler::maintenance);
     addRoute("manualclose", &CommandHandler::manualClose);
+    addRoute("memory", &CommandHandler::memory);
     addRoute("metrics", &CommandHandler::metrics);
+    addRoute("prometheus", &CommandHandler::prometheus);
     addRoute("clearmetrics", &CommandHandler::clearMetrics);
     addRoute("peers", &CommandHandler::peers);
+    addRoute("profile", &CommandHandler::profile);
     addRoute("quorum", &CommandHandler::quorum);
     addRoute("setcursor", &CommandHandler::setcursor);
     addRoute("scp", &CommandHandler::scpInfo);
     addRoute("testacc", &CommandHandler::testAcc);
     addRoute("testtx", &CommandHandler::testTx);
-    addRoute("tx", &CommandHandler::tx);
+    addRoute("tx", &CommandHandler::tx, false);
+    addRoute("txs", &CommandHandler::txs, false);
     addRoute("upgrades", &CommandHandler::upgrades);
     addRoute("unban", &CommandHandler::unban);
+
+    if (mApp.getConfig().HISTORY_SERVE_PORT)
+    {
+        // open to other nodes, unlike HTTP_PORT, as it serves no commands
+        LOG(INFO) << "Serving buckets on 0.0.0.0:"
+                  << mApp.getConfig().HISTORY_SERVE_PORT;
+        mHistoryServer = std::make_unique<http::server::server>(
+            mIOService, "0.0.0.0", mApp.getConfig().HISTORY_SERVE_PORT,
+            mApp.getConfig().HTTP_MAX_CLIENT);
+        mHistoryServeBytes = &mApp.getMetrics().NewMeter(
+            {"history", "serve", "bytes"}, "byte");
+        mHistoryServer->addRoute(
+            "bucket", std::bind(&CommandHandler::serveBucket, this, _1, _2));
+    }
+
+    if ((mApp.getConfig().HTTP_PORT || mHistoryServer) &&
+        mApp.getConfig().HTTP_IO_THREADS != 0)
+    {
+        mWork = std::make_unique<asio::io_service::work>(mIOService);
+        for (unsigned i = 0; i < mApp.getConfig().HTTP_IO_THREADS; i++)
+        {
+            mThreads.emplace_back([this]() { mIOService.run(); });
+        }
+    }
+}
+
+CommandHandler::~CommandHandler()
+{
+    // requests waiting for the main thread give up, the server threads can
+    // then be stopped before the server goes
+    mAlive.reset();
+    mStopping = true;
+    mWork.reset();
+    mIOService.stop();
+    for (auto& t : mThreads)
+    {
+        t.join();
+    }
+
+    if (mProfileTimer && Profiler::isRunning())
+    {
+        Profiler::stop();
+    }
 }
 
 void
-CommandHandler::addRoute(std::string const& name, HandlerRoute route)
+CommandHandler::addRoute(std::string const& name, HandlerRoute route,
+                         bool onMainThread)
 {
-    mServer->addRoute(
-        name, std::bind(&CommandHandler::safeRouter, this, route, _1, _2));
+    // created here as the registry is not to be used off the main thread
+    auto& timer = mApp.getMetrics().NewTimer({"http", "route", name});
+    mServer->addRoute(name, [this, route, onMainThread, &timer](
+                                std::string const& params,
+                                std::string& retStr) {
+        auto scope = timer.TimeScope();
+        if (onMainThread)
+        {
+            try
+            {
+                runOnMainThread(
+                    [&]() { safeRouter(route, params, retStr); });
+            }
+            catch (std::exception& e)
+            {
+                retStr = (fmt::MemoryWriter()
+                          << "{\"exception\": \"" << e.what() << "\"}")
+                             .str();
+            }
+        }
+        else
+        {
+            safeRouter(route, params, retStr);
+        }
+    });
+}
+
+void
+CommandHandler::runOnMainThread(std::function<void()> f)
+{
+    if (mThreads.empty() || std::this_thread::get_id() == mMainThreadId)
+    {
+        f();
+        return;
+    }
+
+    // `f` refers to the stack of this thread: it must not run once this
+    // gave up waiting, which only happens when this gets destroyed, on the
+    // main thread, expiring `alive`
+    auto done = std::make_shared<std::promise<void>>();
+    auto future = done->get_future();
+    std::weak_ptr<int> alive = mAlive;
+    mApp.getClock().getIOService().post([alive, f, done]() {
+        if (!alive.lock())
+        {
+            return;
+        }
+        try
+        {
+            f();
+            done->set_value();
+        }
+        catch (...)
+        {
+            done->set_exception(std::current_exception());
+        }
+    });
+
+    while (future.wait_for(std::chrono::milliseconds(100)) !=
+           std::future_status::ready)
+    {
+        if (mStopping)
+        {
+            throw std::runtime_error("shutting down");
+        }
+    }
+    future.get();
 }
 
 void
@@ -237,6 +370,42 @@ CommandHandler::testTx(std::string const& params, std::string& retStr)
     retStr = root.toStyledString();
 }
 
+void
+CommandHandler::serveBucket(std::string const& params, std::string& retStr)
+{
+    static std::regex const re("^/[0-9a-f]{2}/[0-9a-f]{2}/[0-9a-f]{2}/"
+                               "(bucket-[0-9a-f]{64}\\.xdr)\\.gz$");
+    std::smatch m;
+    if (!std::regex_match(params, m, re))
+    {
+        throw http::server::reply::not_found;
+    }
+    std::ifstream in(mApp.getConfig().BUCKET_DIR_PATH + "/" + m[1].str(),
+                     std::ios::binary);
+    if (!in)
+    {
+        throw http::server::reply::not_found;
+    }
+
+    retStr.clear();
+    auto gz = StreamCodec::makeCompressor(
+        CompressionFormat::GZIP, [&retStr](char const* data, size_t size) {
+            retStr.append(data, size);
+        });
+    std::vector<char> buf(1 << 16);
+    while (in)
+    {
+        in.read(buf.data(), buf.size());
+        gz->write(buf.data(), static_cast<size_t>(in.gcount()));
+    }
+    if (in.bad())
+    {
+        throw http::server::reply::internal_server_error;
+    }
+    gz->finish();
+    mHistoryServeBytes->Mark(retStr.size());
+}
+
 void
 CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
 {
@@ -244,7 +413,12 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
     retStr += "supported commands:<p/>";
 
     retStr +=
-        "<p><h1> /bans</h1>"
+        "<p><h1> /allocstats?[arenas=true]</h1>"
+        "returns what the allocator (jemalloc if built with it, or the system "
+        "malloc) holds: bytes allocated, active and resident, fragmentation "
+        "and, with arenas, the threads, pages and thread cache bytes of each "
+        "jemalloc arena"
+        "</p><p><h1> /bans</h1>"
         "list current active bans"
         "</p><p><h1> /catchup?ledger=NNN[&mode=MODE]</h1>"
         "triggers the instance to catch up to ledger NNN from history; "
@@ -280,19 +454,38 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "rotate log files"
         "</p><p><h1> /manualclose</h1>"
         "close the current ledger; must be used with MANUAL_CLOSE set to true"
+        "</p><p><h1> /memory</h1>"
+        "returns the approximate bytes held by each of the major in-memory "
+        "structures"
         "</p><p><h1> /metrics</h1>"
         "returns a snapshot of the metrics registry (for monitoring and "
         "debugging purpose)"
+        "</p><p><h1> /prometheus</h1>"
+        "returns the metrics in the Prometheus text format, with fixed bucket "
+        "histograms of the ledger close, SCP, overlay and database timers"
         "</p><p><h1> /clearmetrics?[domain=DOMAIN]</h1>"
         "clear metrics for a specified domain. If no domain specified, "
         "clear all metrics (for testing purposes)"
-        "</p><p><h1> /peers</h1>"
-        "returns the list of known peers in JSON format"
-        "</p><p><h1> /quorum?[node=NODE_ID][&compact=true]</h1>"
+        "</p><p><h1> /peers?[costs=true]</h1>"
+        "returns the list of known peers in JSON format. If costs is set, "
+        "includes what each authenticated peer costs us, broken down by "
+        "message type"
+        "</p><p><h1> /profile[?seconds=N]</h1>"
+        "with seconds, samples the stacks of the main and worker threads for "
+        "N (at most 600) seconds of wall time; without, returns the stacks "
+        "of the last profile collapsed for flamegraph.pl, tagged main or "
+        "worker and with the subsystem (ledger-close, herder-..., "
+        "overlay-...) they were in, if any"
+        "</p><p><h1> /quorum?[node=NODE_ID][&compact=true][&check=true]</h1>"
         "returns information about the quorum for node NODE_ID (this node by"
         " default). NODE_ID is either a full key (`GABCD...`), an alias "
         "(`$name`) or an abbreviated ID(`@GABCD`)."
         "If compact is set, only returns a summary version."
+        " If check is set, also starts checking, in the background, that any"
+        " two quorums of the nodes whose quorum set this node knows share a "
+        "node, and returns the outcome of the last such check under "
+        "\"intersection\": \"intersecting\", \"split\" with two disjoint "
+        "quorums, or \"unknown\" if the check timed out."
         "</p><p><h1> /scp?[limit=n]</h1>"
         "returns a JSON object with the internal state of the SCP engine for "
         "the last n (default 2) ledgers."
@@ -302,6 +495,14 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "returns a JSON object<br>"
         "wasReceived: boolean, true if transaction was queued properly<br>"
         "result: base64 encoded, XDR serialized 'TransactionResult'<br>"
+        "</p><p><h1> /txs?blobs=BASE64,BASE64,...</h1>"
+        "submit a batch of transactions to the network, decoded in parallel "
+        "and submitted in order.<br>"
+        "blobs are base64 encoded XDR serialized 'TransactionEnvelope', "
+        "separated by commas<br>"
+        "returns a JSON object whose 'results' list has, for each "
+        "transaction, the 'status' and 'error' fields /tx returns, or "
+        "'exception' if it could not be decoded<br>"
         "</p><p><h1> /upgrades?mode=(get|set|clear)&[upgradetime=DATETIME]&"
         "[basefee=NUM]&[basereserve=NUM]&[maxtxsize=NUM]&[protocolversion=NUM]"
         "</h1>"
@@ -340,8 +541,8 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "</p><p><h1> /maintenance[?queue=true[&count=N]]</h1> Performs "
         "maintenance tasks on the instance."
         "<ul><li><i>queue</i> performs deletion of queue data. Deletes at most "
-        "count entries from each table (defaults to 50000). See setcursor for "
-        "more information</li></ul>"
+        "count entries from each table (defaults to 50000), in the background. "
+        "See setcursor for more information</li></ul>"
         "</p><p><h1> "
         "/unban?node=NODE_ID</h1>"
         "remove ban for PEER_ID"
@@ -422,25 +623,30 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
         std::map<std::string, std::string> map;
         http::server::server::parseParams(params, map);
 
-        bool isCreate;
         maybeParseParam<std::string>(map, "mode", mode);
-        if (mode == std::string("create"))
-        {
-            isCreate = true;
-        }
-        else if (mode == std::string("pay"))
-        {
-            isCreate = false;
-        }
-        else
-        {
-            throw std::runtime_error("Unknown mode.");
-        }
+        auto loadGenMode = LoadGenerator::modeFromString(mode);
+        bool isCreate = loadGenMode == LoadGenMode::CREATE;
 
+        LoadGenerator::ModeParams modeParams;
         maybeParseParam(map, "accounts", nAccounts);
         maybeParseParam(map, "txs", nTxs);
         maybeParseParam(map, "batchsize", batchSize);
         maybeParseParam(map, "offset", offset);
+        maybeParseParam(map, "offers", modeParams.mOffers);
+        maybeParseParam(map, "hops", modeParams.mHops);
+        maybeParseParam(map, "signers", modeParams.mSigners);
+        {
+            std::string arrival = "steady";
+            maybeParseParam<std::string>(map, "arrival", arrival);
+            if (arrival == "poisson")
+            {
+                modeParams.mPoisson = true;
+            }
+            else if (arrival != "steady")
+            {
+                throw std::runtime_error("Unknown arrival.");
+            }
+        }
         {
             auto i = map.find("txrate");
             if (i != map.end() && i->second == std::string("auto"))
@@ -462,8 +668,9 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
             batchSize = 100;
             retStr = "Setting batch size to its limit of 100.";
         }
-        mApp.generateLoad(isCreate, nAccounts, offset, nTxs, txRate, batchSize,
-                          autoRate);
+        mApp.getLoadGenerator().mModeParams = modeParams;
+        mApp.generateLoad(loadGenMode, nAccounts, offset, nTxs, txRate,
+                          batchSize, autoRate);
         retStr +=
             fmt::format(" Generating load: {:d} {:s}, {:d} tx/s = {:f} hours",
                         numItems, itemType, txRate, hours);
@@ -476,8 +683,12 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
 }
 
 void
-CommandHandler::peers(std::string const&, std::string& retStr)
+CommandHandler::peers(std::string const& params, std::string& retStr)
 {
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+    bool costs = retMap["costs"] == "true";
+
     Json::Value root;
 
     root["pending_peers"];
@@ -501,6 +712,21 @@ CommandHandler::peers(std::string const&, std::string& retStr)
             (int)peer.second->getRemoteOverlayVersion();
         root["authenticated_peers"][counter]["id"] =
             mApp.getConfig().toStrKey(peer.first);
+        root["authenticated_peers"][counter]["write_queue"] =
+            static_cast<Json::UInt64>(peer.second->getWriteQueueSize());
+        root["authenticated_peers"][counter]["write_queue_bytes"] =
+            static_cast<Json::UInt64>(peer.second->getWriteQueueBytes());
+        root["authenticated_peers"][counter]["bytes_in_flight"] =
+            static_cast<Json::UInt64>(peer.second->getBytesInFlight());
+        // smoothed round trip time, 0 until a PING is answered
+        root["authenticated_peers"][counter]["rtt_us"] =
+            static_cast<Json::UInt64>(peer.second->getRTT().count());
+        if (costs)
+        {
+            root["authenticated_peers"][counter]["costs"] =
+                mApp.getOverlayManager().getLoadManager().getJsonPeerCosts(
+                    peer.first);
+        }
 
         counter++;
     }
@@ -514,6 +740,34 @@ CommandHandler::info(std::string const&, std::string& retStr)
     retStr = mApp.getJsonInfo().toStyledString();
 }
 
+void
+CommandHandler::hotKeys(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    size_t lim = 10;
+    maybeParseParam(retMap, "limit", lim);
+
+    auto root = mApp.getLedgerManager().getHotKeys().getJson(lim);
+    retStr = root.toStyledString();
+}
+
+void
+CommandHandler::allocStats(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    retStr = AllocStats::getJson(retMap["arenas"] == "true").toStyledString();
+}
+
+void
+CommandHandler::memory(std::string const&, std::string& retStr)
+{
+    retStr = mApp.getMemoryInfo().toStyledString();
+}
+
 void
 CommandHandler::metrics(std::string const& params, std::string& retStr)
 {
@@ -522,6 +776,14 @@ CommandHandler::metrics(std::string const& params, std::string& retStr)
     retStr = jr.Report();
 }
 
+void
+CommandHandler::prometheus(std::string const& params, std::string& retStr)
+{
+    mApp.syncAllMetrics();
+    PrometheusReporter reporter(mApp.getMetrics(), mApp.getLatencyHistograms());
+    retStr = reporter.Report();
+}
+
 void
 CommandHandler::logRotate(std::string const& params, std::string& retStr)
 {
@@ -759,6 +1021,58 @@ CommandHandler::upgrades(std::string const& params, std::string& retStr)
     }
 }
 
+void
+CommandHandler::profile(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(params, map);
+
+    uint32_t seconds = 0;
+    if (!maybeParseParam(map, "seconds", seconds))
+    {
+        if (Profiler::isRunning())
+        {
+            retStr = "Profile still running";
+        }
+        else if (mLastProfile.empty())
+        {
+            retStr = "No profile, start one with /profile?seconds=N";
+        }
+        else
+        {
+            retStr = mLastProfile;
+        }
+        return;
+    }
+
+    if (seconds == 0 || seconds > 600)
+    {
+        throw std::runtime_error("seconds must be between 1 and 600");
+    }
+    if (!Profiler::start())
+    {
+        retStr = Profiler::isRunning() ? "Profile already running"
+                                       : "Profiling is not supported here";
+        return;
+    }
+    if (!mProfileTimer)
+    {
+        mProfileTimer = std::make_unique<VirtualTimer>(mApp);
+    }
+    mProfileTimer->expires_from_now(std::chrono::seconds(seconds));
+    mProfileTimer->async_wait(
+        [this]() {
+            mLastProfile = Profiler::stop();
+            CLOG(INFO, "Process")
+                << "Profile done, " << Profiler::getDropped()
+                << " samples dropped";
+        },
+        &VirtualTimer::onFailureNoop);
+    retStr = fmt::format(
+        "Profiling for {} seconds, get the result from /profile then",
+        seconds);
+}
+
 void
 CommandHandler::quorum(std::string const& params, std::string& retStr)
 {
@@ -783,6 +1097,10 @@ CommandHandler::quorum(std::string const& params, std::string& retStr)
 
     auto root =
         mApp.getHerder().getJsonQuorumInfo(n, retMap["compact"] == "true");
+    if (retMap["check"] == "true")
+    {
+        root["intersection"] = mApp.getHerder().checkQuorumIntersection();
+    }
     retStr = root.toStyledString();
 }
 
@@ -848,6 +1166,37 @@ CommandHandler::ll(std::string const& params, std::string& retStr)
     retStr = root.toStyledString();
 }
 
+namespace
+{
+// Decodes and hashes a base64 encoded TransactionEnvelope, which needs no
+// state: done by the thread serving the request, see the tx and txs routes.
+TransactionFramePtr
+decodeTransaction(Hash const& networkID, std::string const& blob)
+{
+    TransactionEnvelope envelope;
+    std::vector<uint8_t> binBlob;
+    decoder::decode_b64(blob, binBlob);
+
+    xdr::xdr_from_opaque(binBlob, envelope);
+    TransactionFramePtr transaction =
+        TransactionFrame::makeTransactionFromWire(networkID, envelope,
+                                                  binBlob);
+    transaction->getFullHash();
+    transaction->getContentsHash();
+    return transaction;
+}
+
+std::string
+encodeResult(TransactionFrame const& transaction)
+{
+    std::string resultBase64;
+    auto resultBin = xdr::xdr_to_opaque(transaction.getResult());
+    resultBase64.reserve(decoder::encoded_size64(resultBin.size()) + 1);
+    resultBase64 = decoder::encode_b64(resultBin);
+    return resultBase64;
+}
+}
+
 void
 CommandHandler::tx(std::string const& params, std::string& retStr)
 {
@@ -856,42 +1205,30 @@ CommandHandler::tx(std::string const& params, std::string& retStr)
     const std::string prefix("?blob=");
     if (params.compare(0, prefix.size(), prefix) == 0)
     {
-        TransactionEnvelope envelope;
-        std::string blob = params.substr(prefix.size());
-        std::vector<uint8_t> binBlob;
-        decoder::decode_b64(blob, binBlob);
-
-        xdr::xdr_from_opaque(binBlob, envelope);
-        TransactionFramePtr transaction =
-            TransactionFrame::makeTransactionFromWire(mApp.getNetworkID(),
-                                                      envelope);
+        TransactionFramePtr transaction = decodeTransaction(
+            mApp.getNetworkID(), params.substr(prefix.size()));
         if (transaction)
         {
             // add it to our current set
             // and make sure it is valid
-            Herder::TransactionSubmitStatus status =
-                mApp.getHerder().recvTransaction(transaction);
-
-            if (status == Herder::TX_STATUS_PENDING)
-            {
-                StellarMessage msg;
-                msg.type(TRANSACTION);
-                msg.transaction() = envelope;
-                mApp.getOverlayManager().broadcastMessage(msg);
-            }
+            Herder::TransactionSubmitStatus status;
+            runOnMainThread([&]() {
+                status = mApp.getHerder().recvTransaction(transaction);
+                if (status == Herder::TX_STATUS_PENDING)
+                {
+                    mApp.getOverlayManager().broadcastMessage(
+                        transaction->toStellarMessage(),
+                        transaction->toStellarMessageBytes());
+                }
+            });
 
             output << "{"
                    << "\"status\": "
                    << "\"" << Herder::TX_STATUS_STRING[status] << "\"";
             if (status == Herder::TX_STATUS_ERROR)
             {
-                std::string resultBase64;
-                auto resultBin = xdr::xdr_to_opaque(transaction->getResult());
-                resultBase64.reserve(decoder::encoded_size64(resultBin.size()) +
-                                     1);
-                resultBase64 = decoder::encode_b64(resultBin);
-
-                output << " , \"error\": \"" << resultBase64 << "\"";
+                output << " , \"error\": \"" << encodeResult(*transaction)
+                       << "\"";
             }
             output << "}";
         }
@@ -905,6 +1242,101 @@ CommandHandler::tx(std::string const& params, std::string& retStr)
     retStr = output.str();
 }
 
+void
+CommandHandler::txs(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+    auto blobs = retMap.find("blobs");
+    if (blobs == retMap.end())
+    {
+        throw std::invalid_argument("Must specify tx blobs: txs?blobs=<tx in "
+                                    "xdr format>,<tx in xdr format>...");
+    }
+
+    std::vector<std::string> items;
+    std::istringstream in(blobs->second);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        items.emplace_back(item);
+    }
+
+    // decode in as many slices as there are workers, the first one here
+    size_t n = items.size();
+    std::vector<TransactionFramePtr> transactions(n);
+    std::vector<std::string> errors(n);
+    auto decodeSlice = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            try
+            {
+                transactions[i] =
+                    decodeTransaction(mApp.getNetworkID(), items[i]);
+            }
+            catch (std::exception& e)
+            {
+                errors[i] = e.what();
+            }
+        }
+    };
+    size_t slices = std::max<size_t>(
+        std::min<size_t>(n, mApp.getWorkerThreadCount()), 1);
+    std::vector<std::future<void>> decoded;
+    for (size_t s = 1; s < slices; s++)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(
+            std::bind(decodeSlice, s * n / slices, (s + 1) * n / slices));
+        decoded.emplace_back(task->get_future());
+        mApp.getWorkerIOService().post([task]() { (*task)(); });
+    }
+    decodeSlice(0, n / slices);
+    for (auto& d : decoded)
+    {
+        d.get();
+    }
+
+    std::vector<Herder::TransactionSubmitStatus> statuses(
+        n, Herder::TX_STATUS_ERROR);
+    runOnMainThread([&]() {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (!transactions[i])
+            {
+                continue;
+            }
+            statuses[i] = mApp.getHerder().recvTransaction(transactions[i]);
+            if (statuses[i] == Herder::TX_STATUS_PENDING)
+            {
+                mApp.getOverlayManager().broadcastMessage(
+                    transactions[i]->toStellarMessage(),
+                    transactions[i]->toStellarMessageBytes());
+            }
+        }
+    });
+
+    Json::Value root(Json::objectValue);
+    root["results"] = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < n; i++)
+    {
+        Json::Value res;
+        if (!transactions[i])
+        {
+            res["exception"] = errors[i];
+        }
+        else
+        {
+            res["status"] = Herder::TX_STATUS_STRING[statuses[i]];
+            if (statuses[i] == Herder::TX_STATUS_ERROR)
+            {
+                res["error"] = encodeResult(*transactions[i]);
+            }
+        }
+        root["results"].append(res);
+    }
+    retStr = root.toStyledString();
+}
+
 void
 CommandHandler::dropcursor(std::string const& params, std::string& retStr)
 {
@@ -918,8 +1350,7 @@ CommandHandler::dropcursor(std::string const& params, std::string& retStr)
     }
     else
     {
-        ExternalQueue ps(mApp);
-        ps.deleteCursor(id);
+        mApp.getExternalQueue().deleteCursor(id);
         retStr = "Done";
     }
 }
@@ -939,8 +1370,7 @@ CommandHandler::setcursor(std::string const& params, std::string& retStr)
     }
     else
     {
-        ExternalQueue ps(mApp);
-        ps.setCursorForResource(id, cursor);
+        mApp.getExternalQueue().setCursorForResource(id, cursor);
         retStr = "Done";
     }
 }
@@ -958,10 +1388,9 @@ CommandHandler::getcursor(std::string const& params, std::string& retStr)
     // ExternalQueue and if an exception is thrown for
     // validity there, the ret format is technically more
     // correct for the mime type
-    ExternalQueue ps(mApp);
     std::map<std::string, uint32> curMap;
     int counter = 0;
-    ps.getCursorForResource(id, curMap);
+    mApp.getExternalQueue().getCursorForResource(id, curMap);
     root["cursors"][0];
     for (auto cursor : curMap)
     {
@@ -983,8 +1412,8 @@ CommandHandler::maintenance(std::string const& params, std::string& retStr)
         uint32_t count = 50000;
         maybeParseParam(map, "count", count);
 
-        mApp.getMaintainer().performMaintenance(count);
-        retStr = "Done";
+        mApp.getMaintainer().startMaintenance(count);
+        retStr = "Maintenance started";
     }
     else
     {
@@ -5,15 +5,32 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "lib/http/server.hpp"
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 /*
 handler functions for the http commands this server supports
+
+With Config::HTTP_IO_THREADS set, the server runs on threads of its own,
+which only parse requests and write replies: each command still runs on the
+main thread, the thread serving the request waiting for it there (see
+runOnMainThread). Commands with expensive parts that need no state, such as
+decoding a submitted transaction, do them before moving to the main thread.
 */
 
+namespace medida
+{
+class Meter;
+}
+
 namespace stellar
 {
 class Application;
+class VirtualTimer;
 
 class CommandHandler
 {
@@ -22,19 +39,50 @@ class CommandHandler
         HandlerRoute;
 
     Application& mApp;
+
+    // Serves mServer when Config::HTTP_IO_THREADS is set, so declared first.
+    asio::io_service mIOService;
+    std::unique_ptr<asio::io_service::work> mWork;
+    std::vector<std::thread> mThreads;
+    std::thread::id const mMainThreadId;
+    std::atomic<bool> mStopping{false};
+    // Expires when this is destroyed, see runOnMainThread.
+    std::shared_ptr<int> mAlive;
+
     std::unique_ptr<http::server::server> mServer;
+    // see Config::HISTORY_SERVE_PORT
+    std::unique_ptr<http::server::server> mHistoryServer;
+    medida::Meter* mHistoryServeBytes{nullptr};
 
-    void addRoute(std::string const& name, HandlerRoute route);
+    // see profile
+    std::unique_ptr<VirtualTimer> mProfileTimer;
+    std::string mLastProfile;
+
+    // Commands run on the main thread unless `onMainThread` is false, in
+    // which case they must call runOnMainThread for any state they access.
+    void addRoute(std::string const& name, HandlerRoute route,
+                  bool onMainThread = true);
     void safeRouter(HandlerRoute route, std::string const& params,
                     std::string& retStr);
+    // Runs `f` on the main thread and waits for it, rethrowing what it
+    // throws; runs it right away when already there. Throws if this gets
+    // destroyed before `f` had a chance to run.
+    void runOnMainThread(std::function<void()> f);
 
   public:
     CommandHandler(Application& app);
+    ~CommandHandler();
 
     void manualCmd(std::string const& cmd);
 
     void fileNotFound(std::string const& params, std::string& retStr);
 
+    // Serves bucket/xx/yy/zz/bucket-<hash>.xdr.gz, as laid out in a history
+    // archive, from the bucket dir: runs on the HTTP_IO_THREADS, not the
+    // main thread, and needs none of its state.
+    void serveBucket(std::string const& params, std::string& retStr);
+
+    void allocStats(std::string const& params, std::string& retStr);
     void bans(std::string const& params, std::string& retStr);
     void catchup(std::string const& params, std::string& retStr);
     void checkdb(std::string const& params, std::string& retStr);
@@ -42,19 +90,24 @@ class CommandHandler
     void dropcursor(std::string const& params, std::string& retStr);
     void dropPeer(std::string const& params, std::string& retStr);
     void generateLoad(std::string const& params, std::string& retStr);
+    void hotKeys(std::string const& params, std::string& retStr);
     void info(std::string const& params, std::string& retStr);
     void ll(std::string const& params, std::string& retStr);
     void logRotate(std::string const& params, std::string& retStr);
     void maintenance(std::string const& params, std::string& retStr);
     void manualClose(std::string const& params, std::string& retStr);
+    void memory(std::string const& params, std::string& retStr);
     void metrics(std::string const& params, std::string& retStr);
+    void prometheus(std::string const& params, std::string& retStr);
     void clearMetrics(std::string const& params, std::string& retStr);
     void peers(std::string const& params, std::string& retStr);
+    void profile(std::string const& params, std::string& retStr);
     void quorum(std::string const& params, std::string& retStr);
     void setcursor(std::string const& params, std::string& retStr);
     void getcursor(std::string const& params, std::string& retStr);
     void scpInfo(std::string const& params, std::string& retStr);
     void tx(std::string const& params, std::string& retStr);
+    void txs(std::string const& params, std::string& retStr);
     void testAcc(std::string const& params, std::string& retStr);
     void testTx(std::string const& params, std::string& retStr);
     void unban(std::string const& params, std::string& retStr);
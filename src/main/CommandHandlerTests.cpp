@@ -0,0 +1,108 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "lib/http/HttpClient.h"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/CommandHandler.h"
+#include "main/Config.h"
+#include "test/TestAccount.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Decoder.h"
+#include "util/Timer.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "xdrpp/marshal.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+TEST_CASE("http server threads", "[commandhandler]")
+{
+    Config cfg(getTestConfig());
+    cfg.HTTP_IO_THREADS = 2;
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    // the commands run on the main thread, which must keep cranking
+    std::atomic<int> done{0};
+    std::vector<int> codes(4);
+    std::vector<std::string> replies(codes.size());
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < codes.size(); i++)
+    {
+        clients.emplace_back([&, i]() {
+            codes[i] = http_request("127.0.0.1", i % 2 ? "/info" : "/peers",
+                                    cfg.HTTP_PORT, replies[i]);
+            ++done;
+        });
+    }
+    while (done != static_cast<int>(codes.size()))
+    {
+        clock.crank(false);
+    }
+    for (auto& c : clients)
+    {
+        c.join();
+    }
+
+    for (size_t i = 0; i < codes.size(); i++)
+    {
+        REQUIRE(codes[i] == 200);
+        REQUIRE(replies[i].find(i % 2 ? "\"info\"" : "\"pending_peers\"") !=
+                std::string::npos);
+    }
+    REQUIRE(app->getMetrics().NewTimer({"http", "route", "info"}).count() ==
+            2);
+
+    // still served on the main thread when called from there
+    app->getCommandHandler().manualCmd("info");
+    REQUIRE(app->getMetrics().NewTimer({"http", "route", "info"}).count() ==
+            3);
+}
+
+TEST_CASE("batch transaction submission", "[commandhandler]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a = root.create("A", app->getLedgerManager().getMinBalance(0) * 10);
+    auto b = root.create("B", app->getLedgerManager().getMinBalance(0) * 10);
+
+    auto blob = [](TransactionFramePtr tx) {
+        return decoder::encode_b64(xdr::xdr_to_opaque(tx->getEnvelope()));
+    };
+    auto tx1 = a.tx({payment(root, 1)});
+    auto tx2 = b.tx({payment(root, 1)});
+    // not enough to pay for its fee
+    auto tx3 = b.tx({payment(root, 1)});
+    tx3->getEnvelope().tx.fee = 1;
+
+    std::string reply;
+    app->getCommandHandler().txs("?blobs=" + blob(tx1) + "," + blob(tx2) +
+                                     "," + blob(tx1) + ",AAAA," + blob(tx3),
+                                 reply);
+
+    Json::Value res;
+    REQUIRE(Json::Reader().parse(reply, res));
+    auto const& results = res["results"];
+    REQUIRE(results.size() == 5);
+    REQUIRE(results[0]["status"].asString() == "PENDING");
+    REQUIRE(results[1]["status"].asString() == "PENDING");
+    REQUIRE(results[2]["status"].asString() == "DUPLICATE");
+    REQUIRE(results[3].isMember("exception"));
+    REQUIRE(results[4]["status"].asString() == "ERROR");
+    REQUIRE(results[4].isMember("error"));
+}
@@ -17,6 +17,8 @@
 #include "util/XDROperators.h"
 #include "util/types.h"
 
+#include <algorithm>
+#include <array>
 #include <functional>
 #include <lib/util/format.h>
 #include <sstream>
@@ -45,7 +47,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     LEDGER_PROTOCOL_VERSION = CURRENT_LEDGER_PROTOCOL_VERSION;
 
     OVERLAY_PROTOCOL_MIN_VERSION = 6;
-    OVERLAY_PROTOCOL_VERSION = 7;
+    OVERLAY_PROTOCOL_VERSION = 11;
 
     VERSION_STR = STELLAR_CORE_VERSION;
 
@@ -54,6 +56,12 @@ Config::Config() : NODE_SEED(SecretKey::random())
     MANUAL_CLOSE = false;
     CATCHUP_COMPLETE = false;
     CATCHUP_RECENT = 0;
+    CATCHUP_LOOKAHEAD_CHECKPOINTS = 16;
+    CATCHUP_SCRATCH_MAX_BYTES = 0;
+    CATCHUP_REPLAY_BATCH_LEDGERS = 64;
+    CATCHUP_APPLY_SLICE_MS = 100;
+    CATCHUP_REBUILD_INDEXES = false;
+    CATCHUP_RELAXED_DURABILITY = false;
     AUTOMATIC_MAINTENANCE_PERIOD = std::chrono::seconds{14400};
     AUTOMATIC_MAINTENANCE_COUNT = 50000;
     ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = false;
@@ -66,7 +74,10 @@ Config::Config() : NODE_SEED(SecretKey::random())
     UNSAFE_QUORUM = false;
 
     LOG_FILE_PATH = "stellar-core.%datetime{%Y.%M.%d-%H:%m:%s}.log";
+    LOG_ASYNC_BUFFER_SIZE = 8192;
+    LOG_ASYNC_DROP_WHEN_FULL = false;
     BUCKET_DIR_PATH = "buckets";
+    SCP_HISTORY_DIR_PATH = "";
 
     TESTING_UPGRADE_DESIRED_FEE = LedgerManager::GENESIS_LEDGER_BASE_FEE;
     TESTING_UPGRADE_RESERVE = LedgerManager::GENESIS_LEDGER_BASE_RESERVE;
@@ -75,19 +86,69 @@ Config::Config() : NODE_SEED(SecretKey::random())
     HTTP_PORT = DEFAULT_PEER_PORT + 1;
     PUBLIC_HTTP_PORT = false;
     HTTP_MAX_CLIENT = 128;
+    HTTP_IO_THREADS = 0;
+    HISTORY_SERVE_PORT = 0;
     PEER_PORT = DEFAULT_PEER_PORT;
     TARGET_PEER_CONNECTIONS = 8;
     MAX_ADDITIONAL_PEER_CONNECTIONS = -1;
     MAX_PEER_CONNECTIONS = 12;
     MAX_PENDING_CONNECTIONS = 500;
+    PEER_ACCEPT_RATE = 100;
+    PEER_ACCEPT_RATE_PER_IP = 10;
     PEER_AUTHENTICATION_TIMEOUT = 2;
     PEER_TIMEOUT = 30;
+    PEER_WRITE_BATCH_BYTES = 0x40000;
+    PEER_FLOOD_QUEUE_BYTES = 0x100000;
+    PEER_COMPRESSION = false;
+    PEER_COMPRESSION_MIN_BYTES = 512;
+    FLOOD_TX_PULL_MODE = false;
+    COMPACT_SCP_MESSAGES = false;
+    FLOOD_MAP_MAX_BYTES = 0x4000000;
+    TX_ADMISSION_RATE_PER_PEER = 0;
+    TX_ADMISSION_RATE_PER_ACCOUNT = 0;
+    TX_ADMISSION_MAX_DEFERRED = 10000;
+    OVERLAY_IO_THREADS = 0;
     PREFERRED_PEERS_ONLY = false;
 
     MINIMUM_IDLE_PERCENT = 0;
 
     MAX_CONCURRENT_SUBPROCESSES = 16;
+    WORK_NETWORK_SLOTS = 16;
+    WORK_DISK_SLOTS = 2;
+    WORK_CPU_SLOTS = 4;
+    WORK_DB_SLOTS = 1;
+    HISTORY_HTTP_CONNECTIONS = 8;
+    HISTORY_HTTP_PIPELINE_DEPTH = 4;
+    HISTORY_RACE_ARCHIVES = 1;
+    MAX_CONCURRENT_PUBLISHES = 4;
+    CHECKDB_THREADS = 2;
+    WORKER_THREADS = 0;
+    MERGE_SPLIT_THREADS = 4;
+    MERGE_ADAPTIVE_PRIORITY = true;
+    BUCKET_WRITE_BUFFER_SIZE = 0x100000;
+    BUCKET_WRITE_DIRECT = false;
+    BUCKET_FSYNC = true;
+    BUCKET_TOMBSTONE_ANALYSIS = false;
+    ENTRY_CACHE_SIZE = 0x2000000;
+    LEDGER_STATE_IN_MEMORY = false;
+    DEFER_LEDGER_WRITES = false;
+    TX_HISTORY_BINARY_COLUMNS = false;
+    DISABLE_TX_META = false;
+    METADATA_OUTPUT_ROTATE_LEDGERS = 0;
+    ORDER_BOOK_CACHE_SIZE = 0x1000000;
+    VERIFY_SIG_CACHE_SIZE = PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE;
+    PENDING_TRANSACTIONS_MAX_BYTES = 0x4000000;
+    PENDING_TRANSACTIONS_REBROADCAST_BYTES = 0x400000;
+    TX_SET_CACHE_MAX_BYTES = 0x4000000;
+    QSET_CACHE_MAX_BYTES = 0x800000;
+    TX_SET_APPLY_BUDGET_MS = 0;
+    SCP_MAX_STATEMENTS_HISTORY = 1000;
+    SCP_ADAPTIVE_TIMEOUTS = false;
+    LEDGER_CLOSE_TRACE_THRESHOLD_MS = 0;
+    HOT_KEYS_TRACKED = 32;
+    QUORUM_INTERSECTION_CHECK_TIMEOUT_MS = 60000;
     NODE_IS_VALIDATOR = false;
+    WATCHER_MODE = false;
 
     DATABASE = SecretValue{"sqlite3://:memory:"};
     NTP_SERVER = "pool.ntp.org";
@@ -282,6 +343,15 @@ Config::load(std::string const& filename)
             {
                 HTTP_MAX_CLIENT = readInt<unsigned short>(item, 0, UINT16_MAX);
             }
+            else if (item.first == "HTTP_IO_THREADS")
+            {
+                HTTP_IO_THREADS = readInt<unsigned short>(item, 0, 16);
+            }
+            else if (item.first == "HISTORY_SERVE_PORT")
+            {
+                HISTORY_SERVE_PORT =
+                    readInt<unsigned short>(item, 0, UINT16_MAX);
+            }
             else if (item.first == "PUBLIC_HTTP_PORT")
             {
                 PUBLIC_HTTP_PORT = readBool(item);
@@ -318,6 +388,35 @@ Config::load(std::string const& filename)
             {
                 CATCHUP_RECENT = readInt<uint32_t>(item, 0, UINT32_MAX - 1);
             }
+            else if (item.first == "CATCHUP_LOOKAHEAD_CHECKPOINTS")
+            {
+                CATCHUP_LOOKAHEAD_CHECKPOINTS = readInt<uint32_t>(item, 0);
+            }
+            else if (item.first == "CATCHUP_SCRATCH_DIR_PATH")
+            {
+                CATCHUP_SCRATCH_DIR_PATH = readString(item);
+            }
+            else if (item.first == "CATCHUP_SCRATCH_MAX_BYTES")
+            {
+                CATCHUP_SCRATCH_MAX_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "CATCHUP_REPLAY_BATCH_LEDGERS")
+            {
+                CATCHUP_REPLAY_BATCH_LEDGERS = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "CATCHUP_APPLY_SLICE_MS")
+            {
+                CATCHUP_APPLY_SLICE_MS = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "CATCHUP_REBUILD_INDEXES")
+            {
+                CATCHUP_REBUILD_INDEXES = readBool(item);
+            }
+            else if (item.first == "CATCHUP_RELAXED_DURABILITY")
+            {
+                CATCHUP_RELAXED_DURABILITY = readBool(item);
+            }
             else if (item.first == "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING")
             {
                 ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = readBool(item);
@@ -352,6 +451,14 @@ Config::load(std::string const& filename)
             {
                 LOG_FILE_PATH = readString(item);
             }
+            else if (item.first == "LOG_ASYNC_BUFFER_SIZE")
+            {
+                LOG_ASYNC_BUFFER_SIZE = readInt<uint32_t>(item);
+            }
+            else if (item.first == "LOG_ASYNC_DROP_WHEN_FULL")
+            {
+                LOG_ASYNC_DROP_WHEN_FULL = readBool(item);
+            }
             else if (item.first == "TMP_DIR_PATH")
             {
                 throw std::invalid_argument("TMP_DIR_PATH is not supported "
@@ -362,6 +469,10 @@ Config::load(std::string const& filename)
             {
                 BUCKET_DIR_PATH = readString(item);
             }
+            else if (item.first == "SCP_HISTORY_DIR_PATH")
+            {
+                SCP_HISTORY_DIR_PATH = readString(item);
+            }
             else if (item.first == "NODE_NAMES")
             {
                 auto names = readStringArray(item);
@@ -380,6 +491,10 @@ Config::load(std::string const& filename)
             {
                 NODE_IS_VALIDATOR = readBool(item);
             }
+            else if (item.first == "WATCHER_MODE")
+            {
+                WATCHER_MODE = readBool(item);
+            }
             else if (item.first == "TARGET_PEER_CONNECTIONS")
             {
                 TARGET_PEER_CONNECTIONS = readInt<unsigned short>(item, 1);
@@ -398,6 +513,15 @@ Config::load(std::string const& filename)
                 MAX_PENDING_CONNECTIONS =
                     readInt<unsigned short>(item, 1, UINT16_MAX);
             }
+            else if (item.first == "PEER_ACCEPT_RATE")
+            {
+                PEER_ACCEPT_RATE = readInt<unsigned short>(item, 0, UINT16_MAX);
+            }
+            else if (item.first == "PEER_ACCEPT_RATE_PER_IP")
+            {
+                PEER_ACCEPT_RATE_PER_IP =
+                    readInt<unsigned short>(item, 0, UINT16_MAX);
+            }
             else if (item.first == "PEER_AUTHENTICATION_TIMEOUT")
             {
                 PEER_AUTHENTICATION_TIMEOUT =
@@ -407,6 +531,59 @@ Config::load(std::string const& filename)
             {
                 PEER_TIMEOUT = readInt<unsigned short>(item, 1, UINT16_MAX);
             }
+            else if (item.first == "PEER_WRITE_BATCH_BYTES")
+            {
+                PEER_WRITE_BATCH_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 1));
+            }
+            else if (item.first == "PEER_FLOOD_QUEUE_BYTES")
+            {
+                PEER_FLOOD_QUEUE_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "PEER_COMPRESSION")
+            {
+                PEER_COMPRESSION = readBool(item);
+            }
+            else if (item.first == "PEER_COMPRESSION_MIN_BYTES")
+            {
+                PEER_COMPRESSION_MIN_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "OVERLAY_CAPTURE_FILE")
+            {
+                OVERLAY_CAPTURE_FILE = readString(item);
+            }
+            else if (item.first == "FLOOD_TX_PULL_MODE")
+            {
+                FLOOD_TX_PULL_MODE = readBool(item);
+            }
+            else if (item.first == "COMPACT_SCP_MESSAGES")
+            {
+                COMPACT_SCP_MESSAGES = readBool(item);
+            }
+            else if (item.first == "FLOOD_MAP_MAX_BYTES")
+            {
+                FLOOD_MAP_MAX_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "TX_ADMISSION_RATE_PER_PEER")
+            {
+                TX_ADMISSION_RATE_PER_PEER = readInt<uint32_t>(item, 0);
+            }
+            else if (item.first == "TX_ADMISSION_RATE_PER_ACCOUNT")
+            {
+                TX_ADMISSION_RATE_PER_ACCOUNT = readInt<uint32_t>(item, 0);
+            }
+            else if (item.first == "TX_ADMISSION_MAX_DEFERRED")
+            {
+                TX_ADMISSION_MAX_DEFERRED =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "OVERLAY_IO_THREADS")
+            {
+                OVERLAY_IO_THREADS = readInt<unsigned short>(item, 0, 16);
+            }
             else if (item.first == "PREFERRED_PEERS")
             {
                 PREFERRED_PEERS = readStringArray(item);
@@ -436,6 +613,161 @@ Config::load(std::string const& filename)
                 MAX_CONCURRENT_SUBPROCESSES =
                     static_cast<size_t>(readInt<int>(item, 1));
             }
+            else if (item.first == "WORK_NETWORK_SLOTS")
+            {
+                WORK_NETWORK_SLOTS = static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "WORK_DISK_SLOTS")
+            {
+                WORK_DISK_SLOTS = static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "WORK_CPU_SLOTS")
+            {
+                WORK_CPU_SLOTS = static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "WORK_DB_SLOTS")
+            {
+                WORK_DB_SLOTS = static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "HISTORY_HTTP_CONNECTIONS")
+            {
+                HISTORY_HTTP_CONNECTIONS =
+                    static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "HISTORY_HTTP_PIPELINE_DEPTH")
+            {
+                HISTORY_HTTP_PIPELINE_DEPTH =
+                    static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "HISTORY_RACE_ARCHIVES")
+            {
+                HISTORY_RACE_ARCHIVES =
+                    static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "MAX_CONCURRENT_PUBLISHES")
+            {
+                MAX_CONCURRENT_PUBLISHES =
+                    static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "CHECKDB_THREADS")
+            {
+                CHECKDB_THREADS = static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "WORKER_THREADS")
+            {
+                WORKER_THREADS = readInt<unsigned short>(item, 0, 1024);
+            }
+            else if (item.first == "MERGE_SPLIT_THREADS")
+            {
+                MERGE_SPLIT_THREADS =
+                    static_cast<size_t>(readInt<int>(item, 1));
+            }
+            else if (item.first == "MERGE_ADAPTIVE_PRIORITY")
+            {
+                MERGE_ADAPTIVE_PRIORITY = readBool(item);
+            }
+            else if (item.first == "BUCKET_WRITE_BUFFER_SIZE")
+            {
+                BUCKET_WRITE_BUFFER_SIZE =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "BUCKET_WRITE_DIRECT")
+            {
+                BUCKET_WRITE_DIRECT = readBool(item);
+            }
+            else if (item.first == "BUCKET_FSYNC")
+            {
+                BUCKET_FSYNC = readBool(item);
+            }
+            else if (item.first == "BUCKET_TOMBSTONE_ANALYSIS")
+            {
+                BUCKET_TOMBSTONE_ANALYSIS = readBool(item);
+            }
+            else if (item.first == "ENTRY_CACHE_SIZE")
+            {
+                ENTRY_CACHE_SIZE =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "LEDGER_STATE_IN_MEMORY")
+            {
+                LEDGER_STATE_IN_MEMORY = readBool(item);
+            }
+            else if (item.first == "DEFER_LEDGER_WRITES")
+            {
+                DEFER_LEDGER_WRITES = readBool(item);
+            }
+            else if (item.first == "TX_HISTORY_BINARY_COLUMNS")
+            {
+                TX_HISTORY_BINARY_COLUMNS = readBool(item);
+            }
+            else if (item.first == "DISABLE_TX_META")
+            {
+                DISABLE_TX_META = readBool(item);
+            }
+            else if (item.first == "METADATA_OUTPUT_STREAM")
+            {
+                METADATA_OUTPUT_STREAM = readString(item);
+            }
+            else if (item.first == "METADATA_OUTPUT_ROTATE_LEDGERS")
+            {
+                METADATA_OUTPUT_ROTATE_LEDGERS = readInt<uint32_t>(item);
+            }
+            else if (item.first == "ORDER_BOOK_CACHE_SIZE")
+            {
+                ORDER_BOOK_CACHE_SIZE =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "VERIFY_SIG_CACHE_SIZE")
+            {
+                VERIFY_SIG_CACHE_SIZE =
+                    static_cast<size_t>(readInt<int64_t>(item, 1));
+            }
+            else if (item.first == "PENDING_TRANSACTIONS_MAX_BYTES")
+            {
+                PENDING_TRANSACTIONS_MAX_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 1));
+            }
+            else if (item.first == "PENDING_TRANSACTIONS_REBROADCAST_BYTES")
+            {
+                PENDING_TRANSACTIONS_REBROADCAST_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "TX_SET_CACHE_MAX_BYTES")
+            {
+                TX_SET_CACHE_MAX_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 1));
+            }
+            else if (item.first == "QSET_CACHE_MAX_BYTES")
+            {
+                QSET_CACHE_MAX_BYTES =
+                    static_cast<size_t>(readInt<int64_t>(item, 1));
+            }
+            else if (item.first == "TX_SET_APPLY_BUDGET_MS")
+            {
+                TX_SET_APPLY_BUDGET_MS = readInt<uint32_t>(item);
+            }
+            else if (item.first == "SCP_MAX_STATEMENTS_HISTORY")
+            {
+                SCP_MAX_STATEMENTS_HISTORY =
+                    static_cast<size_t>(readInt<int64_t>(item, 0));
+            }
+            else if (item.first == "SCP_ADAPTIVE_TIMEOUTS")
+            {
+                SCP_ADAPTIVE_TIMEOUTS = readBool(item);
+            }
+            else if (item.first == "LEDGER_CLOSE_TRACE_THRESHOLD_MS")
+            {
+                LEDGER_CLOSE_TRACE_THRESHOLD_MS = readInt<uint32_t>(item, 0);
+            }
+            else if (item.first == "HOT_KEYS_TRACKED")
+            {
+                HOT_KEYS_TRACKED = readInt<uint32_t>(item, 0, 4096);
+            }
+            else if (item.first == "QUORUM_INTERSECTION_CHECK_TIMEOUT_MS")
+            {
+                QUORUM_INTERSECTION_CHECK_TIMEOUT_MS =
+                    readInt<uint32_t>(item, 0);
+            }
             else if (item.first == "MINIMUM_IDLE_PERCENT")
             {
                 MINIMUM_IDLE_PERCENT = readInt<uint32_t>(item, 0, 100);
@@ -454,7 +786,8 @@ Config::load(std::string const& filename)
                             throw std::invalid_argument(
                                 "malformed HISTORY config block");
                         }
-                        std::string get, put, mkdir;
+                        std::string get, put, mkdir, url;
+                        bool bucketsOnly = false;
                         for (auto const& c : *tab)
                         {
                             if (c.first == "get")
@@ -469,6 +802,23 @@ Config::load(std::string const& filename)
                             {
                                 mkdir = c.second->as<std::string>()->value();
                             }
+                            else if (c.first == "url")
+                            {
+                                url = c.second->as<std::string>()->value();
+                                // there is no TLS support: https archives
+                                // are read with a `get` command
+                                if (url.compare(0, 7, "http://") != 0)
+                                {
+                                    throw std::invalid_argument(
+                                        "only http:// urls are supported in "
+                                        "[HISTORY." +
+                                        archive.first + "]");
+                                }
+                            }
+                            else if (c.first == "buckets_only")
+                            {
+                                bucketsOnly = c.second->as<bool>()->value();
+                            }
                             else
                             {
                                 std::string err(
@@ -479,8 +829,15 @@ Config::load(std::string const& filename)
                                 throw std::invalid_argument(err);
                             }
                         }
+                        if (bucketsOnly && (!put.empty() || !mkdir.empty()))
+                        {
+                            throw std::invalid_argument(
+                                "buckets_only archives can not be published "
+                                "to, in [HISTORY." +
+                                archive.first + "]");
+                        }
                         HISTORY[archive.first] = HistoryArchiveConfiguration{
-                            archive.first, get, put, mkdir};
+                            archive.first, get, put, mkdir, url, bucketsOnly};
                     }
                 }
                 else
@@ -492,6 +849,10 @@ Config::load(std::string const& filename)
             {
                 DATABASE = SecretValue{readString(item)};
             }
+            else if (item.first == "DATABASE_READ_REPLICA")
+            {
+                DATABASE_READ_REPLICA = SecretValue{readString(item)};
+            }
             else if (item.first == "NETWORK_PASSPHRASE")
             {
                 NETWORK_PASSPHRASE = readString(item);
@@ -504,6 +865,28 @@ Config::load(std::string const& filename)
             {
                 INVARIANT_CHECKS = readStringArray(item);
             }
+            else if (item.first == "INVARIANT_SAMPLE_RATES")
+            {
+                auto rates = item.second->as_group();
+                if (!rates)
+                {
+                    throw std::invalid_argument(
+                        "malformed INVARIANT_SAMPLE_RATES config block");
+                }
+                for (auto const& rate : *rates)
+                {
+                    INVARIANT_SAMPLE_RATES[rate.first] =
+                        readInt<uint32_t>(rate, 1);
+                }
+            }
+            else if (item.first == "INVARIANT_CHECKS_DEFERRED")
+            {
+                INVARIANT_CHECKS_DEFERRED = readStringArray(item);
+            }
+            else if (item.first == "INVARIANT_CHECKS_PER_LEDGER")
+            {
+                INVARIANT_CHECKS_PER_LEDGER = readStringArray(item);
+            }
             else
             {
                 std::string err("Unknown configuration entry: '");
@@ -536,6 +919,10 @@ Config::load(std::string const& filename)
                 loadQset(qset->as_group(), QUORUM_SET, 0);
             }
         }
+        if (WATCHER_MODE)
+        {
+            applyWatcherProfile(g);
+        }
         if (MAX_ADDITIONAL_PEER_CONNECTIONS < 0)
         {
             MAX_ADDITIONAL_PEER_CONNECTIONS = TARGET_PEER_CONNECTIONS;
@@ -546,6 +933,23 @@ Config::load(std::string const& filename)
             throw std::invalid_argument(
                 "invalid MAX_ADDITIONAL_PEER_CONNECTIONS");
         }
+        if (DEFER_LEDGER_WRITES && !LEDGER_STATE_IN_MEMORY)
+        {
+            // deferred writes are only held by the entry cache
+            throw std::invalid_argument(
+                "DEFER_LEDGER_WRITES requires LEDGER_STATE_IN_MEMORY");
+        }
+        if (HISTORY_SERVE_PORT && HTTP_IO_THREADS == 0)
+        {
+            // compressing buckets would hold up the main thread
+            throw std::invalid_argument(
+                "HISTORY_SERVE_PORT requires HTTP_IO_THREADS");
+        }
+        if (DISABLE_TX_META && !METADATA_OUTPUT_STREAM.empty())
+        {
+            throw std::invalid_argument(
+                "METADATA_OUTPUT_STREAM requires DISABLE_TX_META=false");
+        }
         MAX_PEER_CONNECTIONS = std::max(
             MAX_PEER_CONNECTIONS,
             static_cast<unsigned short>(MAX_ADDITIONAL_PEER_CONNECTIONS +
@@ -574,6 +978,41 @@ Config::load(std::string const& filename)
     }
 }
 
+void
+Config::applyWatcherProfile(cpptoml::toml_group const& g)
+{
+    if (NODE_IS_VALIDATOR)
+    {
+        throw std::invalid_argument(
+            "WATCHER_MODE requires NODE_IS_VALIDATOR=false");
+    }
+    for (auto const& h : HISTORY)
+    {
+        if (!h.second.mPutCmd.empty())
+        {
+            throw std::invalid_argument(
+                "WATCHER_MODE can not publish to [HISTORY." + h.first + "]");
+        }
+    }
+
+    // A watcher only needs to follow the last few ledgers: it relays what
+    // it receives but has no transaction set to build, so the memory kept
+    // for flooding, pending transactions and the values of SCP envelopes is
+    // cut down, unless set explicitly.
+    auto shrink = [&](char const* name, size_t& value, size_t watcherValue) {
+        if (!g.contains(name))
+        {
+            value = watcherValue;
+        }
+    };
+    shrink("FLOOD_MAP_MAX_BYTES", FLOOD_MAP_MAX_BYTES, 0x1000000);
+    shrink("PENDING_TRANSACTIONS_MAX_BYTES", PENDING_TRANSACTIONS_MAX_BYTES,
+           0x1000000);
+    shrink("TX_SET_CACHE_MAX_BYTES", TX_SET_CACHE_MAX_BYTES, 0x1000000);
+    shrink("QSET_CACHE_MAX_BYTES", QSET_CACHE_MAX_BYTES, 0x200000);
+    shrink("SCP_MAX_STATEMENTS_HISTORY", SCP_MAX_STATEMENTS_HISTORY, 100);
+}
+
 void
 Config::validateConfig()
 {
@@ -723,12 +1162,19 @@ Config::parseNodeID(std::string configStr, PublicKey& retKey, SecretKey& sKey,
 std::string
 Config::toShortString(PublicKey const& pk) const
 {
-    std::string ret = KeyUtils::toStrKey(pk);
-    auto it = VALIDATOR_NAMES.find(ret);
-    if (it == VALIDATOR_NAMES.end())
-        return ret.substr(0, 5);
-    else
-        return it->second;
+    if (!VALIDATOR_NAMES.empty())
+    {
+        // 56 characters for an ed25519 key
+        std::array<char, 57> buf;
+        *strKey::toStrKey(KeyFunctions<PublicKey>::toKeyVersion(pk.type()),
+                          pk.ed25519(), buf.data()) = '\0';
+        auto it = VALIDATOR_NAMES.find(buf.data());
+        if (it != VALIDATOR_NAMES.end())
+        {
+            return it->second;
+        }
+    }
+    return KeyUtils::toShortString(pk);
 }
 
 std::string
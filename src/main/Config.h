@@ -24,11 +24,18 @@ struct HistoryArchiveConfiguration
     std::string mGetCmd;
     std::string mPutCmd;
     std::string mMkdirCmd;
+    // http:// url the archive is downloaded from by HttpArchiveClient,
+    // instead of running mGetCmd, when set
+    std::string mURL;
+    // only holds bucket files, such as another node serving its buckets
+    // (see HISTORY_SERVE_PORT): used for buckets only, ahead of the others
+    bool mBucketsOnly{false};
 };
 
 class Config : public std::enable_shared_from_this<Config>
 {
     void validateConfig();
+    void applyWatcherProfile(cpptoml::toml_group const& g);
     void loadQset(std::shared_ptr<cpptoml::toml_group> group,
                   SCPQuorumSet& qset, int level);
 
@@ -85,6 +92,35 @@ class Config : public std::enable_shared_from_this<Config>
     // If you want, say, a week of history, set this to 120000.
     uint32_t CATCHUP_RECENT;
 
+    // Number of checkpoints of transactions downloaded ahead of the one being
+    // applied when replaying history. 0 downloads all of them before applying
+    // any.
+    uint32_t CATCHUP_LOOKAHEAD_CHECKPOINTS;
+
+    // Directory for the ledger and transaction files downloaded by catchup,
+    // in a "catchup" subdirectory of it; empty for BUCKET_DIR_PATH/tmp.
+    std::string CATCHUP_SCRATCH_DIR_PATH;
+
+    // Bytes of catchup files past which no transactions are downloaded ahead
+    // of the checkpoint being applied; 0 for no limit.
+    size_t CATCHUP_SCRATCH_MAX_BYTES;
+
+    // Number of ledgers replayed from history that are committed to the
+    // database together. 1 commits every ledger on its own.
+    uint32_t CATCHUP_REPLAY_BATCH_LEDGERS;
+
+    // Main thread time, in milliseconds, that applying buckets or replaying
+    // ledgers aims to take between two chances for other events to run.
+    uint32_t CATCHUP_APPLY_SLICE_MS;
+
+    // Whether applying buckets drops the secondary indexes of the ledger
+    // entry tables first, and builds them again once done.
+    bool CATCHUP_REBUILD_INDEXES;
+
+    // Whether database commits stop waiting for the disk while catching up,
+    // see Database::setRelaxedDurability.
+    bool CATCHUP_RELAXED_DURABILITY;
+
     // Interval between automatic maintenance executions
     std::chrono::seconds AUTOMATIC_MAINTENANCE_PERIOD;
 
@@ -145,13 +181,27 @@ class Config : public std::enable_shared_from_this<Config>
     uint32_t OVERLAY_PROTOCOL_VERSION;     // max overlay version understood
     std::string VERSION_STR;
     std::string LOG_FILE_PATH;
+    // Messages that can wait to be written by a background thread, 0 to
+    // write them on the thread logging them.
+    uint32_t LOG_ASYNC_BUFFER_SIZE;
+    // Whether to drop messages, rather than wait, when that buffer is full.
+    bool LOG_ASYNC_DROP_WHEN_FULL;
     std::string BUCKET_DIR_PATH;
+    // where to keep the SCP history in files instead of the database, empty
+    // to use the database
+    std::string SCP_HISTORY_DIR_PATH;
     uint32_t TESTING_UPGRADE_DESIRED_FEE; // in stroops
     uint32_t TESTING_UPGRADE_RESERVE;     // in stroops
     uint32_t TESTING_UPGRADE_MAX_TX_PER_LEDGER;
     unsigned short HTTP_PORT; // what port to listen for commands
     bool PUBLIC_HTTP_PORT;    // if you accept commands from not localhost
     int HTTP_MAX_CLIENT;      // maximum number of http clients, i.e backlog
+    // Threads serving HTTP connections (see CommandHandler); 0 serves them
+    // from the main thread.
+    unsigned short HTTP_IO_THREADS;
+    // Port serving the files of the bucket dir to other nodes catching up,
+    // on the HTTP_IO_THREADS; 0 to not serve them.
+    unsigned short HISTORY_SERVE_PORT;
     std::string NETWORK_PASSPHRASE; // identifier for the network
 
     // overlay config
@@ -160,8 +210,44 @@ class Config : public std::enable_shared_from_this<Config>
     int MAX_ADDITIONAL_PEER_CONNECTIONS;
     unsigned short MAX_PEER_CONNECTIONS;
     unsigned short MAX_PENDING_CONNECTIONS;
+    // Inbound connections accepted per second, overall and from any one
+    // address, with bursts of as many; 0 for no limit. The others are closed
+    // before any handshake, see PeerDoor.
+    unsigned short PEER_ACCEPT_RATE;
+    unsigned short PEER_ACCEPT_RATE_PER_IP;
     unsigned short PEER_AUTHENTICATION_TIMEOUT;
     unsigned short PEER_TIMEOUT;
+    // Most bytes of queued messages handed to a peer's socket in one write.
+    size_t PEER_WRITE_BATCH_BYTES;
+    // Most bytes of flooded transactions queued for a peer, the oldest being
+    // dropped beyond that; 0 for no limit.
+    size_t PEER_FLOOD_QUEUE_BYTES;
+    // Compress the messages of at least PEER_COMPRESSION_MIN_BYTES sent to
+    // peers that can decompress them (see MessageCompressor).
+    bool PEER_COMPRESSION;
+    size_t PEER_COMPRESSION_MIN_BYTES;
+    // If set, the messages received from authenticated peers are appended to
+    // this file, to be replayed with --replay-overlay (see MessageCapture).
+    std::string OVERLAY_CAPTURE_FILE;
+    // Flood transactions to peers that support it by advertising their
+    // hashes, peers then demanding the ones they lack (see Floodgate).
+    bool FLOOD_TX_PULL_MODE;
+    // Send SCP messages to peers that support it with the values they
+    // already got from us replaced by short ids (see Peer::compactEnvelope).
+    bool COMPACT_SCP_MESSAGES;
+    // Estimated bytes of flood records kept by Floodgate, the oldest being
+    // forgotten beyond that; 0 for no limit.
+    size_t FLOOD_MAP_MAX_BYTES;
+    // Flooded transactions handed to the herder per second from any one
+    // peer, and for any one source account, with bursts of as many; 0 for
+    // no limit. The others wait, up to TX_ADMISSION_MAX_DEFERRED of them
+    // (0 for no limit), see TxAdmission.
+    uint32_t TX_ADMISSION_RATE_PER_PEER;
+    uint32_t TX_ADMISSION_RATE_PER_ACCOUNT;
+    size_t TX_ADMISSION_MAX_DEFERRED;
+    // Threads serving peer sockets (see Application::getOverlayIOService);
+    // 0 serves them from the main thread.
+    unsigned short OVERLAY_IO_THREADS;
 
     // Peers we will always try to stay connected to
     std::vector<std::string> PREFERRED_PEERS;
@@ -184,21 +270,163 @@ class Config : public std::enable_shared_from_this<Config>
     // process-management config
     size_t MAX_CONCURRENT_SUBPROCESSES;
 
+    // Work of each Work::ResourceClass allowed to run at once.
+    size_t WORK_NETWORK_SLOTS;
+    size_t WORK_DISK_SLOTS;
+    size_t WORK_CPU_SLOTS;
+    size_t WORK_DB_SLOTS;
+
+    // Connections opened to each history archive downloaded from over HTTP
+    // (those with a `url`), and requests pipelined on each of them.
+    size_t HISTORY_HTTP_CONNECTIONS;
+    size_t HISTORY_HTTP_PIPELINE_DEPTH;
+
+    // Number of readable archives history archive state files are requested
+    // from at once, the first valid one being used. Above 1, other files are
+    // downloaded from archives picked according to their throughput rather
+    // than uniformly at random.
+    size_t HISTORY_RACE_ARCHIVES;
+
+    // Number of queued checkpoints published at once. Their files go up
+    // concurrently; each archive's state file is still updated in ledger
+    // order, each checkpoint waiting for the ones before it.
+    size_t MAX_CONCURRENT_PUBLISHES;
+
+    // Number of shards of a bucket compared with the database at once, each on
+    // a worker thread with its own database connection, by checkdb and the
+    // BucketListIsConsistentWithDatabase invariant.
+    size_t CHECKDB_THREADS;
+
+    // Number of worker threads (see Application::getWorkerIOService); 0 for
+    // one per hardware thread.
+    unsigned short WORKER_THREADS;
+
+    // Number of key ranges a merge on a deep BucketList level is split into,
+    // each merged on its own thread.
+    size_t MERGE_SPLIT_THREADS;
+
+    // Whether a queued merge that is predicted to finish too close to the
+    // ledger that needs it is dispatched ahead of its turn (see
+    // BucketMergeScheduler).
+    bool MERGE_ADAPTIVE_PRIORITY;
+
+    // Size in bytes of the buffer bucket files are written through, 0 to
+    // use the standard library's; whether to write them around the page
+    // cache (O_DIRECT); and whether to sync each new bucket to disk before
+    // it is used. The last two need a buffer.
+    size_t BUCKET_WRITE_BUFFER_SIZE;
+    bool BUCKET_WRITE_DIRECT;
+    bool BUCKET_FSYNC;
+
+    // Count the tombstones of each BucketList level that no older bucket
+    // needs (see BucketTombstoneStats).
+    bool BUCKET_TOMBSTONE_ANALYSIS;
+
+    // Memory budget, in bytes, of the database's cache of ledger entries.
+    size_t ENTRY_CACHE_SIZE;
+
+    // Keep all accounts and trust lines in the cache of ledger entries
+    // (ignoring ENTRY_CACHE_SIZE), loaded at startup.
+    bool LEDGER_STATE_IN_MEMORY;
+
+    // Write the accounts and trust lines changed by a ledger once, in bulk,
+    // when it is committed rather than as each transaction is applied.
+    // Requires LEDGER_STATE_IN_MEMORY.
+    bool DEFER_LEDGER_WRITES;
+
+    // Create txhistory and txfeehistory with BYTEA columns holding the raw
+    // XDR, rather than TEXT columns holding it in base64. Postgres only,
+    // takes effect when the database is initialized (see --newdb).
+    bool TX_HISTORY_BINARY_COLUMNS;
+
+    // Do not build the ledger entry changes of transactions, fees and upgrades
+    // (the meta stored in txhistory and txfeehistory), for validators no one
+    // reads them from. Results, and the ledger, are the same.
+    bool DISABLE_TX_META;
+
+    // File or named pipe the LedgerCloseMeta of each closed ledger is
+    // streamed to, empty to disable (see LedgerCloseMetaStream).
+    std::string METADATA_OUTPUT_STREAM;
+    // When not 0, METADATA_OUTPUT_STREAM is the prefix of a series of files
+    // of this many ledgers each.
+    uint32_t METADATA_OUTPUT_ROTATE_LEDGERS;
+
+    // Memory budget, in bytes, of the cache of order books, 0 to disable.
+    size_t ORDER_BOOK_CACHE_SIZE;
+
+    // Number of signature verification results cached (process-wide).
+    size_t VERIFY_SIG_CACHE_SIZE;
+
+    // Memory budget, in bytes, of the transactions waiting to be included in
+    // a ledger; past it the lowest fee rate transactions are evicted.
+    size_t PENDING_TRANSACTIONS_MAX_BYTES;
+    // Bytes of pending transactions sent to peers again after a ledger
+    // closes, the best paying first; 0 for no limit.
+    size_t PENDING_TRANSACTIONS_REBROADCAST_BYTES;
+
+    // Memory budgets, in bytes, of the transaction sets and quorum sets SCP
+    // envelopes refer to; past them the least recently used ones no envelope
+    // pending or held by SCP refers to are evicted.
+    size_t TX_SET_CACHE_MAX_BYTES;
+    size_t QSET_CACHE_MAX_BYTES;
+
+    // Estimated time, in milliseconds, the transaction sets this node
+    // nominates may take to apply (see ApplyCostModel); 0 for no limit.
+    uint32_t TX_SET_APPLY_BUDGET_MS;
+
+    // Most SCP statements kept, for diagnostics, by each of the slots SCP
+    // remembers; 0 for no limit.
+    size_t SCP_MAX_STATEMENTS_HISTORY;
+
+    // Whether SCP timeouts follow the latency of the quorum rather than the
+    // fixed schedule, see HerderSCPDriver::computeTimeout.
+    bool SCP_ADAPTIVE_TIMEOUTS;
+
+    // Ledger closes slower than this many milliseconds are logged with a
+    // breakdown of where the time went, see LedgerCloseTrace. 0 disables.
+    uint32_t LEDGER_CLOSE_TRACE_THRESHOLD_MS;
+
+    // Number of ledger entries tracked as the most touched by each ledger,
+    // see HotKeys. 0 disables.
+    uint32_t HOT_KEYS_TRACKED;
+
+    // Time, in milliseconds, after which checking quorum intersection gives
+    // up (see QuorumIntersectionChecker); 0 for no limit.
+    uint32_t QUORUM_INTERSECTION_CHECK_TIMEOUT_MS;
+
     // SCP config
     SecretKey NODE_SEED;
     bool NODE_IS_VALIDATOR;
     stellar::SCPQuorumSet QUORUM_SET;
 
+    // Watcher profile: a node that neither validates nor publishes, only
+    // tracking the network and applying ledgers. Its SCP messages are not
+    // saved and the memory budgets above default to smaller values (see
+    // applyWatcherProfile).
+    bool WATCHER_MODE;
+
     // Invariants
     std::vector<std::string> INVARIANT_CHECKS;
-
-    std::map<std::string, std::string> VALIDATOR_NAMES;
+    // Invariant patterns to the number of operations each matching invariant
+    // is checked on one of.
+    std::map<std::string, uint32_t> INVARIANT_SAMPLE_RATES;
+    // Patterns of non-strict invariants checked once the ledger is applied.
+    std::vector<std::string> INVARIANT_CHECKS_DEFERRED;
+    // Patterns of invariants checked on the merged changes of the operations
+    // of each ledger rather than on every operation.
+    std::vector<std::string> INVARIANT_CHECKS_PER_LEDGER;
+
+    // by StrKey, looked up with StrKeys encoded on the stack
+    std::map<std::string, std::string, std::less<>> VALIDATOR_NAMES;
 
     // History config
     std::map<std::string, HistoryArchiveConfiguration> HISTORY;
 
     // Database config
     SecretValue DATABASE;
+    // Optional read replica of DATABASE, used by read-only queries that are
+    // not part of consensus (HTTP commands).
+    SecretValue DATABASE_READ_REPLICA;
 
     std::vector<std::string> COMMANDS;
     std::vector<std::string> REPORT_METRICS;
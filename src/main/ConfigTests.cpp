@@ -6,6 +6,9 @@
 #include "lib/catch.hpp"
 #include "main/Config.h"
 #include "test/test.h"
+#include "util/TmpDir.h"
+
+#include <fstream>
 
 using namespace stellar;
 
@@ -155,3 +158,53 @@ TEST_CASE("load example configs", "[config]")
         }
     }
 }
+
+TEST_CASE("watcher mode", "[config]")
+{
+    TmpDir tmp("config");
+    auto fn = tmp.getName() + "/watcher.cfg";
+    auto write = [&](std::string const& extra) {
+        std::ofstream out(fn);
+        out << "NETWORK_PASSPHRASE=\"Test SDF Network ; September 2015\"\n"
+            << "WATCHER_MODE=true\n"
+            << "FAILURE_SAFETY=0\n"
+            << "UNSAFE_QUORUM=true\n"
+            << extra << "[QUORUM_SET]\n"
+            << "THRESHOLD_PERCENT=100\n"
+            << "VALIDATORS=[\"GDKXE2OZMJIPOSLNA6N6F2BVCI3O777I2OOC4BV7VOYUEHYX"
+               "7RTRYA7Y\"]\n";
+    };
+
+    SECTION("budgets default to the watcher ones")
+    {
+        write("");
+        Config c;
+        c.load(fn);
+        REQUIRE(c.WATCHER_MODE);
+        REQUIRE(c.FLOOD_MAP_MAX_BYTES == 0x1000000);
+        REQUIRE(c.PENDING_TRANSACTIONS_MAX_BYTES == 0x1000000);
+        REQUIRE(c.TX_SET_CACHE_MAX_BYTES == 0x1000000);
+        REQUIRE(c.QSET_CACHE_MAX_BYTES == 0x200000);
+        REQUIRE(c.SCP_MAX_STATEMENTS_HISTORY == 100);
+    }
+    SECTION("explicit budgets are kept")
+    {
+        write("FLOOD_MAP_MAX_BYTES=1234\n");
+        Config c;
+        c.load(fn);
+        REQUIRE(c.FLOOD_MAP_MAX_BYTES == 1234);
+        REQUIRE(c.TX_SET_CACHE_MAX_BYTES == 0x1000000);
+    }
+    SECTION("validators can not be watchers")
+    {
+        write("NODE_IS_VALIDATOR=true\n");
+        Config c;
+        REQUIRE_THROWS_AS(c.load(fn), std::invalid_argument);
+    }
+    SECTION("watchers can not publish")
+    {
+        write("[HISTORY.test]\nget=\"cp {0} {1}\"\nput=\"cp {0} {1}\"\n");
+        Config c;
+        REQUIRE_THROWS_AS(c.load(fn), std::invalid_argument);
+    }
+}
@@ -8,6 +8,7 @@
 #include "database/Database.h"
 #include "ledger/LedgerManager.h"
 #include "util/Logging.h"
+#include <algorithm>
 #include <limits>
 #include <regex>
 
@@ -22,10 +23,52 @@ string ExternalQueue::kSQLCreateStatement =
     "lastread    INTEGER"
     "); ";
 
-ExternalQueue::ExternalQueue(Application& app) : mApp(app)
+ExternalQueue::ExternalQueue(Application& app)
+    : mApp(app), mMinCursor(std::numeric_limits<uint32>::max())
 {
 }
 
+void
+ExternalQueue::loadCursors()
+{
+    if (mCursorsLoaded)
+    {
+        return;
+    }
+
+    std::string n;
+    uint32_t v;
+
+    auto& db = mApp.getDatabase();
+    auto querySess = db.getQuerySession();
+    soci::session& sess(querySess ? *querySess : db.getSession());
+    soci::statement st =
+        (sess.prepare << "SELECT resid, lastread FROM pubsub;", soci::into(n),
+         soci::into(v));
+    {
+        auto timer = db.getSelectTimer("pubsub");
+        st.execute(true);
+    }
+
+    while (st.got_data())
+    {
+        mCursors[n] = v;
+        st.fetch();
+    }
+    mCursorsLoaded = true;
+    updateMinCursor();
+}
+
+void
+ExternalQueue::updateMinCursor()
+{
+    mMinCursor = std::numeric_limits<uint32>::max();
+    for (auto const& c : mCursors)
+    {
+        mMinCursor = std::min(mMinCursor, c.second);
+    }
+}
+
 void
 ExternalQueue::dropAll(Database& db)
 {
@@ -54,7 +97,9 @@ ExternalQueue::setInitialCursors(std::vector<std::string> const& initialResids)
 void
 ExternalQueue::addCursorForResource(std::string const& resid, uint32 cursor)
 {
-    if (getCursor(resid).empty())
+    checkID(resid);
+    loadCursors();
+    if (mCursors.find(resid) == mCursors.end())
     {
         setCursorForResource(resid, cursor);
     }
@@ -64,9 +109,9 @@ void
 ExternalQueue::setCursorForResource(std::string const& resid, uint32 cursor)
 {
     checkID(resid);
+    loadCursors();
 
-    std::string old(getCursor(resid));
-    if (old.empty())
+    if (mCursors.find(resid) == mCursors.end())
     {
         auto timer = mApp.getDatabase().getInsertTimer("pubsub");
         auto prep = mApp.getDatabase().getPreparedStatement(
@@ -95,6 +140,8 @@ ExternalQueue::setCursorForResource(std::string const& resid, uint32 cursor)
             st.execute(true);
         }
     }
+    mCursors[resid] = cursor;
+    updateMinCursor();
 }
 
 void
@@ -104,26 +151,8 @@ ExternalQueue::getCursorForResource(std::string const& resid,
     // no resid set, get all cursors
     if (resid.empty())
     {
-        std::string n;
-        uint32_t v;
-
-        auto& db = mApp.getDatabase();
-        auto prep =
-            db.getPreparedStatement("SELECT resid, lastread FROM pubsub;");
-        auto& st = prep.statement();
-        st.exchange(soci::into(n));
-        st.exchange(soci::into(v));
-        st.define_and_bind();
-        {
-            auto timer = db.getSelectTimer("pubsub");
-            st.execute(true);
-        }
-
-        while (st.got_data())
-        {
-            curMap[n] = v;
-            st.fetch();
-        }
+        loadCursors();
+        curMap.insert(mCursors.begin(), mCursors.end());
     }
     else
     {
@@ -149,31 +178,21 @@ ExternalQueue::deleteCursor(std::string const& resid)
     st.exchange(soci::use(resid));
     st.define_and_bind();
     st.execute(true);
+
+    loadCursors();
+    mCursors.erase(resid);
+    updateMinCursor();
 }
 
-void
+bool
 ExternalQueue::deleteOldEntries(uint32 count)
 {
-    auto& db = mApp.getDatabase();
-    int m;
-    soci::indicator minIndicator;
-    soci::statement st =
-        (db.getSession().prepare << "SELECT MIN(lastread) FROM pubsub",
-         soci::into(m, minIndicator));
-    {
-        auto timer = db.getSelectTimer("state");
-        st.execute(true);
-    }
-
     // rmin is the minimum of all last-reads, which means that remote
     // subscribers are ok with us deleting any history N <= rmin.
     // If we do not have subscribers, take this as maxint, and just
     // use the LCL/checkpoint number (see below) to control trimming.
-    uint32_t rmin = std::numeric_limits<uint32_t>::max();
-    if (st.got_data() && minIndicator == soci::indicator::i_ok)
-    {
-        rmin = static_cast<uint32_t>(m);
-    }
+    loadCursors();
+    uint32_t rmin = mMinCursor;
 
     // Next calculate the minimum of the LCL and/or any queued checkpoint.
     uint32_t lcl = mApp.getLedgerManager().getLastClosedLedgerNum();
@@ -191,11 +210,18 @@ ExternalQueue::deleteOldEntries(uint32 count)
     // publication and the requirements of our pubsub subscribers.
     uint32_t cmin = std::min(lmin, rmin);
 
-    CLOG(INFO, "History") << "Trimming history <= ledger " << cmin
-                          << " (rmin=" << rmin << ", qmin=" << qmin
-                          << ", lmin=" << lmin << ")";
+    if (cmin <= mDeletedUpTo)
+    {
+        return true;
+    }
+
+    CLOG(DEBUG, "History") << "Trimming history <= ledger " << cmin
+                           << " (rmin=" << rmin << ", qmin=" << qmin
+                           << ", lmin=" << lmin << ")";
 
-    mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(), cmin, count);
+    mDeletedUpTo = mApp.getLedgerManager().deleteOldEntries(
+        mApp.getDatabase(), cmin, count);
+    return cmin <= mDeletedUpTo;
 }
 
 void
@@ -211,25 +237,8 @@ std::string
 ExternalQueue::getCursor(std::string const& resid)
 {
     checkID(resid);
-    std::string res;
-
-    auto& db = mApp.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "SELECT lastread FROM pubsub WHERE resid = :n;");
-    auto& st = prep.statement();
-    st.exchange(soci::into(res));
-    st.exchange(soci::use(resid));
-    st.define_and_bind();
-    {
-        auto timer = db.getSelectTimer("pubsub");
-        st.execute(true);
-    }
-
-    if (!st.got_data())
-    {
-        res.clear();
-    }
-
-    return res;
+    loadCursors();
+    auto it = mCursors.find(resid);
+    return it == mCursors.end() ? std::string() : std::to_string(it->second);
 }
 }
@@ -6,11 +6,19 @@
 
 #include "main/Application.h"
 #include "xdr/Stellar-types.h"
+#include <map>
 #include <string>
 
 namespace stellar
 {
 
+/**
+ * Cursors of the subscribers to the history kept in the database (the pubsub
+ * table), which bound what maintenance may delete. The cursors are read
+ * once and then kept in memory, along with their minimum, so that
+ * maintenance does not query them for each of its chunks; the application
+ * owns the instance doing this (see Application::getExternalQueue).
+ */
 class ExternalQueue
 {
   public:
@@ -33,15 +41,26 @@ class ExternalQueue
     // deletes the subscription for the resource
     void deleteCursor(std::string const& resid);
 
-    // safely delete data, maximum count entries from each table
-    void deleteOldEntries(uint32 count);
+    // safely delete data, maximum count entries from each table; returns
+    // true when nothing is left that may be deleted, without touching the
+    // database when that was already the case
+    bool deleteOldEntries(uint32 count);
 
   private:
     void checkID(std::string const& resid);
     std::string getCursor(std::string const& resid);
+    void loadCursors();
+    void updateMinCursor();
 
     static std::string kSQLCreateStatement;
 
     Application& mApp;
+
+    bool mCursorsLoaded{false};
+    std::map<std::string, uint32> mCursors;
+    // minimum of mCursors, max when there is none
+    uint32 mMinCursor;
+    // all the history up to this ledger is known to be deleted
+    uint32 mDeletedUpTo{0};
 };
 }
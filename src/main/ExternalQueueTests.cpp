@@ -2,13 +2,16 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "history/HistoryManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/CommandHandler.h"
 #include "main/Config.h"
 #include "main/ExternalQueue.h"
+#include "main/Maintainer.h"
 #include "simulation/Simulation.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 
 using namespace stellar;
@@ -44,3 +47,83 @@ TEST_CASE("cursors", "[externalqueue]")
         REQUIRE(curMap.size() == 2);
     }
 }
+
+TEST_CASE("background maintenance", "[externalqueue]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    for (uint32_t i = 2; i <= 21; ++i)
+    {
+        txtest::closeLedgerOn(*app, i, i, 1, 2016);
+    }
+
+    auto& db = app->getDatabase();
+    auto minLedger = [&]() {
+        uint32_t res = 0;
+        db.getSession() << "SELECT MIN(ledgerseq) FROM ledgerheaders",
+            soci::into(res);
+        return res;
+    };
+    REQUIRE(minLedger() == 1);
+
+    auto& maintainer = app->getMaintainer();
+    auto count = Maintainer::MAINTENANCE_CHUNK_SIZE * 3;
+    maintainer.startMaintenance(count);
+    REQUIRE(maintainer.getRemaining() == count);
+    // runs on the main thread, not as part of the call
+    REQUIRE(minLedger() == 1);
+
+    while (maintainer.getRemaining() != 0)
+    {
+        clock.crank(true);
+    }
+    // everything but the last checkpoint's worth of ledgers
+    auto freq = app->getHistoryManager().getCheckpointFrequency();
+    REQUIRE(minLedger() == 21 - freq + 1);
+}
+
+TEST_CASE("cursors bound deletion", "[externalqueue]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    for (uint32_t i = 2; i <= 21; ++i)
+    {
+        txtest::closeLedgerOn(*app, i, i, 1, 2016);
+    }
+
+    auto& db = app->getDatabase();
+    auto minLedger = [&]() {
+        uint32_t res = 0;
+        db.getSession() << "SELECT MIN(ledgerseq) FROM ledgerheaders",
+            soci::into(res);
+        return res;
+    };
+
+    auto& queue = app->getExternalQueue();
+    queue.setCursorForResource("FOO", 5);
+    queue.setCursorForResource("BAR", 8);
+
+    // bounded by the lowest cursor, and done once it is reached
+    REQUIRE(!queue.deleteOldEntries(2));
+    REQUIRE(minLedger() == 4);
+    REQUIRE(queue.deleteOldEntries(100));
+    REQUIRE(minLedger() == 6);
+    REQUIRE(queue.deleteOldEntries(100));
+
+    queue.deleteCursor("FOO");
+    REQUIRE(queue.deleteOldEntries(100));
+    REQUIRE(minLedger() == 9);
+
+    std::map<std::string, uint32> curMap;
+    queue.getCursorForResource("", curMap);
+    REQUIRE(curMap.size() == 1);
+    REQUIRE(curMap["BAR"] == 8);
+}
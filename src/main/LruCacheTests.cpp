@@ -5,6 +5,8 @@
 #include "lib/catch.hpp"
 #include "lib/util/lrucache.hpp"
 
+#include <vector>
+
 namespace stellar
 {
 
@@ -129,4 +131,18 @@ TEST_CASE("erase_if removes all nodes", "[lru_cache]")
     REQUIRE(!c.exists(3));
     REQUIRE(!c.exists(4));
 }
+
+TEST_CASE("for_each visits items from the most recently used", "[lru_cache]")
+{
+    auto c = IntCache{5};
+    c.put(0, 10);
+    c.put(1, 11);
+    c.put(2, 12);
+    c.get(0);
+
+    std::vector<std::pair<int, int>> items;
+    c.for_each([&](int k, int v) { items.emplace_back(k, v); });
+    REQUIRE(items ==
+            std::vector<std::pair<int, int>>{{0, 10}, {2, 12}, {1, 11}});
+}
 }
@@ -3,14 +3,32 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "main/Maintainer.h"
+#include "main/Application.h"
 #include "main/Config.h"
 #include "main/ExternalQueue.h"
 #include "util/Logging.h"
 
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
 namespace stellar
 {
 
-Maintainer::Maintainer(Application& app) : mApp{app}, mTimer{mApp}
+std::chrono::milliseconds const Maintainer::MAINTENANCE_SLICE{50};
+
+Maintainer::Maintainer(Application& app)
+    : mApp{app}
+    , mTimer{mApp}
+    , mSliceTimer{mApp}
+    , mDeletedMeter{app.getMetrics().NewMeter(
+          {"maintenance", "ledger", "delete"}, "ledger")}
+    , mChunkTimer{app.getMetrics().NewTimer({"maintenance", "chunk", "time"})}
+    , mRemainingCounter{
+          app.getMetrics().NewCounter({"maintenance", "ledger", "remaining"})}
 {
 }
 
@@ -35,7 +53,7 @@ Maintainer::scheduleMaintenance()
 void
 Maintainer::tick()
 {
-    performMaintenance(mApp.getConfig().AUTOMATIC_MAINTENANCE_COUNT);
+    startMaintenance(mApp.getConfig().AUTOMATIC_MAINTENANCE_COUNT);
     scheduleMaintenance();
 }
 
@@ -43,7 +61,73 @@ void
 Maintainer::performMaintenance(uint32_t count)
 {
     LOG(INFO) << "Performing maintenance";
-    ExternalQueue ps{mApp};
-    ps.deleteOldEntries(count);
+    uint64_t remaining = count;
+    while (remaining > 0)
+    {
+        remaining -= deleteChunk(remaining);
+    }
+}
+
+void
+Maintainer::startMaintenance(uint32_t count)
+{
+    bool running = mRemaining != 0;
+    mRemaining += count;
+    mRemainingCounter.set_count(mRemaining);
+    if (!running && mRemaining != 0)
+    {
+        LOG(INFO) << "Starting maintenance";
+        scheduleSlice();
+    }
+}
+
+uint64_t
+Maintainer::getRemaining() const
+{
+    return mRemaining;
+}
+
+uint32_t
+Maintainer::deleteChunk(uint64_t count)
+{
+    auto n = static_cast<uint32_t>(
+        std::min<uint64_t>(count, MAINTENANCE_CHUNK_SIZE));
+    bool done;
+    {
+        auto timer = mChunkTimer.TimeScope();
+        done = mApp.getExternalQueue().deleteOldEntries(n);
+    }
+    mDeletedMeter.Mark(n);
+    // no need to go on once all that may be deleted is
+    return done ? count : n;
+}
+
+void
+Maintainer::scheduleSlice()
+{
+    mSliceTimer.expires_from_now(std::chrono::milliseconds(0));
+    mSliceTimer.async_wait([this]() { runSlice(); },
+                           VirtualTimer::onFailureNoop);
+}
+
+void
+Maintainer::runSlice()
+{
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        mRemaining -= deleteChunk(mRemaining);
+    } while (mRemaining > 0 &&
+             std::chrono::steady_clock::now() - start < MAINTENANCE_SLICE);
+    mRemainingCounter.set_count(mRemaining);
+
+    if (mRemaining > 0)
+    {
+        scheduleSlice();
+    }
+    else
+    {
+        LOG(INFO) << "Maintenance done";
+    }
 }
 }
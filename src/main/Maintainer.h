@@ -6,16 +6,36 @@
 
 #include "util/Timer.h"
 
+#include <chrono>
 #include <cstdint>
 
+namespace medida
+{
+class Counter;
+class Meter;
+class Timer;
+}
+
 namespace stellar
 {
 
 class Application;
 
+/**
+ * Maintainer deletes the history that is no longer needed (see
+ * ExternalQueue::deleteOldEntries) in chunks of MAINTENANCE_CHUNK_SIZE
+ * ledgers, each in its own transaction. Background maintenance holds the main
+ * thread for about MAINTENANCE_SLICE at a time, yielding to other work
+ * between slices, so that a long maintenance run does not stall consensus.
+ */
 class Maintainer
 {
   public:
+    // Ledgers deleted from each table in one transaction.
+    static uint32_t const MAINTENANCE_CHUNK_SIZE = 256;
+    // Time spent deleting before yielding to other work.
+    static std::chrono::milliseconds const MAINTENANCE_SLICE;
+
     explicit Maintainer(Application& app);
 
     // start automatic mainanining according to app.getConfig()
@@ -24,11 +44,28 @@ class Maintainer
     // removes maximum count entries from tables like txhistory or scphistory
     void performMaintenance(uint32_t count);
 
+    // same in the background, a slice at a time; adds to the count of a
+    // maintenance already in progress
+    void startMaintenance(uint32_t count);
+
+    // ledgers left to delete by background maintenance
+    uint64_t getRemaining() const;
+
   private:
     Application& mApp;
     VirtualTimer mTimer;
+    VirtualTimer mSliceTimer;
+    uint64_t mRemaining{0};
+
+    medida::Meter& mDeletedMeter;
+    medida::Timer& mChunkTimer;
+    medida::Counter& mRemainingCounter;
 
     void scheduleMaintenance();
     void tick();
+
+    uint32_t deleteChunk(uint64_t count);
+    void scheduleSlice();
+    void runSlice();
 };
 }
@@ -24,6 +24,9 @@ class PersistentState
         kDatabaseSchema,
         kNetworkPassphrase,
         kLedgerUpgrades,
+        kRetainedBuckets,
+        kTxHistoryBinary,
+        kDroppedIndexes,
         kLastEntry,
     };
 
@@ -1,4 +1,5 @@
 #include "main/dumpxdr.h"
+#include "crypto/Hex.h"
 #include "crypto/SecretKey.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Decoder.h"
@@ -6,10 +7,18 @@
 #include "util/XDROperators.h"
 #include "util/XDRStream.h"
 #include "util/format.h"
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <map>
 #include <regex>
+#include <thread>
 #include <xdrpp/printer.h>
 
+#include "lib/json/json.h"
+
 #if !defined(USE_TERMIOS) && !MSVC
 #define HAVE_TERMIOS 1
 #endif
@@ -41,48 +50,448 @@ xdr_printer(const PublicKey& pk)
     return KeyUtils::toStrKey<PublicKey>(pk);
 }
 
+namespace
+{
+
+// Records are decoded, filtered and printed by chunks of this many, each
+// on a thread of its own with DumpXdrOptions::mThreads.
+size_t const DUMP_CHUNK_RECORDS = 4096;
+
+struct RawRecord
+{
+    char const* mData;
+    uint32_t mSize;
+};
+
+struct RecordKind
+{
+    std::string mName;
+    bool mDead{false};
+
+    std::string
+    label() const
+    {
+        return mDead ? mName + " (dead)" : mName;
+    }
+};
+
+struct KindStats
+{
+    uint64_t mCount{0};
+    uint64_t mBytes{0};
+};
+
+struct DumpedChunk
+{
+    std::string mOut;
+    std::map<std::string, KindStats> mStats;
+};
+
+std::string
+entryTypeName(LedgerEntryType type)
+{
+    std::string res = xdr::xdr_traits<LedgerEntryType>::enum_name(type);
+    std::transform(res.begin(), res.end(), res.begin(), ::tolower);
+    return res;
+}
+
+uint32_t
+getUint32(char const* p)
+{
+    auto u = reinterpret_cast<uint8_t const*>(p);
+    return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) |
+           (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+}
+
 template <typename T>
-void
-dumpstream(XDRInputFileStream& in)
+bool
+concernsAccount(T const& e, AccountID const& account)
+{
+    switch (e.type())
+    {
+    case ACCOUNT:
+        return e.account().accountID == account;
+    case TRUSTLINE:
+        return e.trustLine().accountID == account;
+    case OFFER:
+        return e.offer().sellerID == account;
+    case DATA:
+        return e.data().accountID == account;
+    default:
+        return false;
+    }
+}
+
+// How the records of each kind of file are classified, filtered and
+// summed up in JSON. rawKind finds the kind without decoding the record,
+// where it can.
+template <typename T> struct DumpTraits;
+
+template <> struct DumpTraits<BucketEntry>
+{
+    static bool
+    rawKind(RawRecord const& r, RecordKind& kind)
+    {
+        // the entry type follows the BucketEntryType, and for live entries
+        // lastModifiedLedgerSeq
+        if (r.mSize < 12)
+        {
+            return false;
+        }
+        kind.mDead = getUint32(r.mData) == DEADENTRY;
+        auto type = getUint32(r.mData + (kind.mDead ? 4 : 8));
+        if (!xdr::xdr_traits<LedgerEntryType>::enum_name(
+                static_cast<LedgerEntryType>(type)))
+        {
+            return false;
+        }
+        kind.mName = entryTypeName(static_cast<LedgerEntryType>(type));
+        return true;
+    }
+    static RecordKind
+    kind(BucketEntry const& e)
+    {
+        RecordKind k;
+        k.mDead = e.type() == DEADENTRY;
+        k.mName = entryTypeName(k.mDead ? e.deadEntry().type()
+                                        : e.liveEntry().data.type());
+        return k;
+    }
+    static bool
+    concerns(BucketEntry const& e, AccountID const& account)
+    {
+        return e.type() == DEADENTRY
+                   ? concernsAccount(e.deadEntry(), account)
+                   : concernsAccount(e.liveEntry().data, account);
+    }
+    static void
+    addJson(BucketEntry const& e, Json::Value& v)
+    {
+        if (e.type() == LIVEENTRY)
+        {
+            v["lastModified"] = e.liveEntry().lastModifiedLedgerSeq;
+        }
+    }
+};
+
+template <> struct DumpTraits<LedgerHeaderHistoryEntry>
+{
+    static bool
+    rawKind(RawRecord const&, RecordKind& kind)
+    {
+        kind.mName = "ledger";
+        return true;
+    }
+    static RecordKind
+    kind(LedgerHeaderHistoryEntry const&)
+    {
+        return RecordKind{"ledger"};
+    }
+    static bool
+    concerns(LedgerHeaderHistoryEntry const&, AccountID const&)
+    {
+        return false;
+    }
+    static void
+    addJson(LedgerHeaderHistoryEntry const& e, Json::Value& v)
+    {
+        v["ledger"] = e.header.ledgerSeq;
+        v["hash"] = binToHex(e.hash);
+    }
+};
+
+template <> struct DumpTraits<TransactionHistoryEntry>
+{
+    static bool
+    rawKind(RawRecord const&, RecordKind& kind)
+    {
+        kind.mName = "transactions";
+        return true;
+    }
+    static RecordKind
+    kind(TransactionHistoryEntry const&)
+    {
+        return RecordKind{"transactions"};
+    }
+    static bool
+    concerns(TransactionHistoryEntry const& e, AccountID const& account)
+    {
+        for (auto const& tx : e.txSet.txs)
+        {
+            if (tx.tx.sourceAccount == account)
+            {
+                return true;
+            }
+            for (auto const& op : tx.tx.operations)
+            {
+                if (op.sourceAccount && *op.sourceAccount == account)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    static void
+    addJson(TransactionHistoryEntry const& e, Json::Value& v)
+    {
+        v["ledger"] = e.ledgerSeq;
+        v["txs"] = static_cast<Json::UInt>(e.txSet.txs.size());
+    }
+};
+
+template <> struct DumpTraits<TransactionHistoryResultEntry>
+{
+    static bool
+    rawKind(RawRecord const&, RecordKind& kind)
+    {
+        kind.mName = "results";
+        return true;
+    }
+    static RecordKind
+    kind(TransactionHistoryResultEntry const&)
+    {
+        return RecordKind{"results"};
+    }
+    static bool
+    concerns(TransactionHistoryResultEntry const&, AccountID const&)
+    {
+        return false;
+    }
+    static void
+    addJson(TransactionHistoryResultEntry const& e, Json::Value& v)
+    {
+        v["ledger"] = e.ledgerSeq;
+        v["results"] = static_cast<Json::UInt>(e.txResultSet.results.size());
+    }
+};
+
+template <> struct DumpTraits<SCPHistoryEntry>
+{
+    static bool
+    rawKind(RawRecord const&, RecordKind& kind)
+    {
+        kind.mName = "scp";
+        return true;
+    }
+    static RecordKind
+    kind(SCPHistoryEntry const&)
+    {
+        return RecordKind{"scp"};
+    }
+    static bool
+    concerns(SCPHistoryEntry const& e, AccountID const& account)
+    {
+        for (auto const& env : e.v0().ledgerMessages.messages)
+        {
+            if (env.statement.nodeID == account)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    static void
+    addJson(SCPHistoryEntry const& e, Json::Value& v)
+    {
+        auto const& msgs = e.v0().ledgerMessages;
+        v["ledger"] = msgs.ledgerSeq;
+        v["envelopes"] = static_cast<Json::UInt>(msgs.messages.size());
+    }
+};
+
+template <typename T>
+DumpedChunk
+dumpChunk(std::vector<RawRecord> const& records,
+          DumpXdrOptions const& options)
 {
+    using Traits = DumpTraits<T>;
+    DumpedChunk res;
+    Json::FastWriter writer;
     T tmp;
-    while (in && in.readOne(tmp))
+    for (auto const& r : records)
+    {
+        bool decoded = false;
+        auto decode = [&]() {
+            if (!decoded)
+            {
+                xdr::xdr_get g(r.mData, r.mData + r.mSize);
+                xdr::xdr_argpack_archive(g, tmp);
+                decoded = true;
+            }
+        };
+
+        // filtered before being printed, and decoded only if needed
+        RecordKind kind;
+        if (!Traits::rawKind(r, kind))
+        {
+            decode();
+            kind = Traits::kind(tmp);
+        }
+        if (!options.mKinds.empty() && options.mKinds.count(kind.mName) == 0)
+        {
+            continue;
+        }
+        if (options.mAccount)
+        {
+            decode();
+            if (!Traits::concerns(tmp, *options.mAccount))
+            {
+                continue;
+            }
+        }
+
+        if (options.mStats)
+        {
+            auto& s = res.mStats[kind.label()];
+            s.mCount++;
+            s.mBytes += r.mSize;
+        }
+        else if (options.mJson)
+        {
+            decode();
+            Json::Value v;
+            v["kind"] = kind.mName;
+            if (kind.mDead)
+            {
+                v["dead"] = true;
+            }
+            v["bytes"] = r.mSize;
+            Traits::addJson(tmp, v);
+            v["xdr"] = decoder::encode_b64(std::string(r.mData, r.mSize));
+            res.mOut += writer.write(v);
+        }
+        else
+        {
+            decode();
+            res.mOut += xdr::xdr_to_string(tmp);
+            res.mOut += "\n";
+        }
+    }
+    return res;
+}
+
+template <typename T>
+void
+dumpstream(std::string const& filename, DumpXdrOptions const& options)
+{
+    // mapped: the records stay where they are until the chunks referring
+    // to them are done
+    XDRInputFileStream in;
+    in.openMapped(filename);
+
+    auto threads = options.mThreads;
+    if (threads == 0)
     {
-        std::cout << xdr::xdr_to_string(tmp) << std::endl;
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::map<std::string, KindStats> stats;
+    auto output = [&](DumpedChunk const& c) {
+        std::cout << c.mOut;
+        for (auto const& kv : c.mStats)
+        {
+            stats[kv.first].mCount += kv.second.mCount;
+            stats[kv.first].mBytes += kv.second.mBytes;
+        }
+    };
+
+    // chunks being dumped, output in order
+    std::deque<std::future<DumpedChunk>> pending;
+    std::vector<RawRecord> chunk;
+    auto flushChunk = [&]() {
+        if (chunk.empty())
+        {
+            return;
+        }
+        if (threads == 1)
+        {
+            output(dumpChunk<T>(chunk, options));
+        }
+        else
+        {
+            pending.emplace_back(std::async(
+                std::launch::async,
+                [&options](std::vector<RawRecord> records) {
+                    return dumpChunk<T>(records, options);
+                },
+                std::move(chunk)));
+            if (pending.size() > 2 * threads)
+            {
+                output(pending.front().get());
+                pending.pop_front();
+            }
+        }
+        chunk.clear();
+    };
+
+    RawRecord r;
+    while (in.readRaw(r.mData, r.mSize))
+    {
+        chunk.emplace_back(r);
+        if (chunk.size() == DUMP_CHUNK_RECORDS)
+        {
+            flushChunk();
+        }
+    }
+    flushChunk();
+    while (!pending.empty())
+    {
+        output(pending.front().get());
+        pending.pop_front();
+    }
+    std::cout.flush();
+
+    if (options.mStats)
+    {
+        KindStats total;
+        std::cout << fmt::format("{:<24} {:>12} {:>16} {:>10}", "kind",
+                                 "count", "bytes", "avg bytes")
+                  << std::endl;
+        for (auto const& kv : stats)
+        {
+            total.mCount += kv.second.mCount;
+            total.mBytes += kv.second.mBytes;
+            std::cout << fmt::format("{:<24} {:>12} {:>16} {:>10}", kv.first,
+                                     kv.second.mCount, kv.second.mBytes,
+                                     kv.second.mBytes / kv.second.mCount)
+                      << std::endl;
+        }
+        std::cout << fmt::format("{:<24} {:>12} {:>16}", "total",
+                                 total.mCount, total.mBytes)
+                  << std::endl;
     }
 }
+}
 
 void
-dumpXdrStream(std::string const& filename)
+dumpXdrStream(std::string const& filename, DumpXdrOptions const& options)
 {
     std::regex rx(
         ".*(ledger|bucket|transactions|results|scp)-[[:xdigit:]]+\\.xdr");
     std::smatch sm;
     if (std::regex_match(filename, sm, rx))
     {
-        XDRInputFileStream in;
-        in.open(filename);
-
         if (sm[1] == "ledger")
         {
-            dumpstream<LedgerHeaderHistoryEntry>(in);
+            dumpstream<LedgerHeaderHistoryEntry>(filename, options);
         }
         else if (sm[1] == "bucket")
         {
-            dumpstream<BucketEntry>(in);
+            dumpstream<BucketEntry>(filename, options);
         }
         else if (sm[1] == "transactions")
         {
-            dumpstream<TransactionHistoryEntry>(in);
+            dumpstream<TransactionHistoryEntry>(filename, options);
         }
         else if (sm[1] == "results")
         {
-            dumpstream<TransactionHistoryResultEntry>(in);
+            dumpstream<TransactionHistoryResultEntry>(filename, options);
         }
         else
         {
             assert(sm[1] == "scp");
-            dumpstream<SCPHistoryEntry>(in);
+            dumpstream<SCPHistoryEntry>(filename, options);
         }
     }
     else
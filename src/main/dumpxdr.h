@@ -5,12 +5,39 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "overlay/StellarXDR.h"
+#include "util/optional.h"
+
+#include <set>
+#include <string>
 
 namespace stellar
 {
 
 extern const char* signtxn_network_id;
-void dumpXdrStream(std::string const& filename);
+
+// What dumpXdrStream keeps of the records of a file, and how it prints them.
+struct DumpXdrOptions
+{
+    // The kinds of records to keep, all of them if empty: for buckets the
+    // ledger entry types (account, trustline, offer, data), otherwise the
+    // kind of file (ledger, transactions, results, scp).
+    std::set<std::string> mKinds;
+    // If set, only the records concerning this account: the bucket entries
+    // it owns, the transaction sets with a transaction or operation it is
+    // the source of, the SCP messages it sent as a node.
+    optional<AccountID> mAccount;
+    // One line of JSON per record (kind, size, a few fields and the base64
+    // XDR) rather than the whole record pretty-printed.
+    bool mJson{false};
+    // Only count the records kept and their bytes by kind, and print that.
+    bool mStats{false};
+    // Threads decoding, filtering and printing chunks of records, in order;
+    // 0 for the number of cores.
+    size_t mThreads{1};
+};
+
+void dumpXdrStream(std::string const& filename,
+                   DumpXdrOptions const& options = DumpXdrOptions());
 void printXdr(std::string const& filename, std::string const& filetype,
               bool base64);
 void signtxn(std::string const& filename, bool base64);
@@ -3,15 +3,28 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "util/asio.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/BucketManager.h"
+#include "bucket/LedgerCmp.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "database/Database.h"
+#include "invariant/InvariantDoesNotHold.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerDelta.h"
+#include "ledger/LedgerManager.h"
+#include "ledger/LedgerTestUtils.h"
+#include "ledger/TrustFrame.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "main/StellarCoreVersion.h"
 #include "overlay/LoopbackPeer.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/TCPPeer.h"
+#include "test/TxTests.h"
 #include "test/test.h"
+#include "transactions/TransactionFrame.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
@@ -19,6 +32,9 @@
 
 #include "main/fuzz.h"
 
+#include <chrono>
+#include <map>
+#include <set>
 #include <signal.h>
 #include <xdrpp/autocheck.h>
 #include <xdrpp/printer.h>
@@ -30,14 +46,26 @@
  * It has two modes:
  *
  *   - In --genfuzz mode it spits out a small file containing a handful of
- *     random StellarMessages. This is the mode you use to generate seed data
- *     for the external fuzzer's corpus.
+ *     random inputs. This is the mode you use to generate seed data for the
+ *     external fuzzer's corpus.
  *
- *   - In --fuzz mode it reads back a file and appplies it to a pair of of
- *     stellar-cores in loopback mode, cranking the I/O loop to simulate
- *     receiving the messages one by one. It exits when it's read the input.
+ *   - In --fuzz mode it reads back a file and feeds it to the fuzz target.
  *     This is the mode the external fuzzer will run its mutant inputs through.
  *
+ * The target, picked with --fuzz-mode, is one of:
+ *
+ *   - overlay: a pair of stellar-cores in loopback mode, the file being
+ *     StellarMessages the acceptor receives one by one.
+ *
+ *   - tx: a ledger seeded with a few accounts trusting an asset, the file
+ *     being the Operations of a transaction applied to it.
+ *
+ *   - bucket-merge: the file being BucketEntries, split into buckets that
+ *     are merged together.
+ *
+ * The target is set up once, then given inputs, its state being reset in
+ * between, for as long as the fuzzer keeps the process (AFL persistent
+ * mode): setting up Applications takes far longer than running one input.
  */
 
 namespace stellar
@@ -91,8 +119,424 @@ tryRead(XDRInputFileStream& in, StellarMessage& m)
 #define PERSIST_MAX 1000
 static unsigned int persist_cnt = 0;
 
+namespace
+{
+
+// Seeded accounts of the tx target: the first issues FUZZ_ASSET_CODE, which
+// the others trust.
+size_t const FUZZ_ACCOUNTS = 8;
+int64_t const FUZZ_ACCOUNT_BALANCE = 1000000000000;
+int64_t const FUZZ_TRUST_BALANCE = 1000000000;
+char const* const FUZZ_ASSET_CODE = "FUZZ";
+
+SecretKey
+fuzzAccount(size_t i)
+{
+    return SecretKey::fromSeed(sha256("FUZZ_ACCOUNT_" + std::to_string(i)));
+}
+
+// Reads the XDR objects of `filename`, up to `max` of them, stopping at the
+// first one that does not decode.
+template <typename T>
+std::vector<T>
+readAll(std::string const& filename, size_t max)
+{
+    std::vector<T> res;
+    XDRInputFileStream in(MAX_MESSAGE_SIZE);
+    in.open(filename);
+    T t;
+    try
+    {
+        while (res.size() < max && in.readOne(t))
+        {
+            res.emplace_back(std::move(t));
+        }
+    }
+    catch (xdr::xdr_runtime_error& e)
+    {
+        LOG(INFO) << "Caught XDR error '" << e.what() << "' on input";
+    }
+    return res;
+}
+
+class FuzzTarget
+{
+  public:
+    virtual ~FuzzTarget()
+    {
+    }
+
+    // Runs the input in `filename`, leaving the target as it was set up.
+    virtual void inject(std::string const& filename) = 0;
+};
+
+class OverlayFuzzTarget : public FuzzTarget
+{
+    VirtualClock mClock;
+    Application::pointer mApp1;
+    Application::pointer mApp2;
+    std::unique_ptr<LoopbackPeerConnection> mLoop;
+
+    void
+    connect()
+    {
+        mLoop = std::make_unique<LoopbackPeerConnection>(*mApp1, *mApp2);
+        while (!(mLoop->getInitiator()->isAuthenticated() &&
+                 mLoop->getAcceptor()->isAuthenticated()))
+        {
+            mClock.crank(true);
+        }
+    }
+
+  public:
+    OverlayFuzzTarget(Config const& cfg1, Config const& cfg2)
+        : mApp1(Application::create(mClock, cfg1))
+        , mApp2(Application::create(mClock, cfg2))
+    {
+        connect();
+    }
+
+    void
+    inject(std::string const& filename) override
+    {
+        // most inputs get the connection dropped
+        if (!(mLoop->getInitiator()->isAuthenticated() &&
+              mLoop->getAcceptor()->isAuthenticated()))
+        {
+            mLoop.reset();
+            connect();
+        }
+
+        XDRInputFileStream in(MAX_MESSAGE_SIZE);
+        in.open(filename);
+        StellarMessage msg;
+        size_t i = 0;
+        while (tryRead(in, msg))
+        {
+            ++i;
+            LOG(INFO) << "Fuzzer injecting message " << i << ": "
+                      << msgSummary(msg);
+            auto peer = mLoop->getInitiator();
+            mClock.getIOService().post(
+                [peer, msg]() { peer->Peer::sendMessage(msg); });
+        }
+
+        // virtual time: a second of it passes as soon as the acceptor is
+        // done with the messages
+        bool done = false;
+        VirtualTimer timer(*mApp1);
+        timer.expires_from_now(std::chrono::seconds(1));
+        timer.async_wait([&done]() { done = true; },
+                         &VirtualTimer::onFailureNoop);
+        while (!done && mLoop->getAcceptor()->isConnected())
+        {
+            mClock.crank(true);
+        }
+    }
+};
+
+class TransactionFuzzTarget : public FuzzTarget
+{
+    VirtualClock mClock;
+    Application::pointer mApp;
+    std::vector<SecretKey> mAccounts;
+    Asset mAsset;
+
+    void
+    seedLedger()
+    {
+        auto& lm = mApp->getLedgerManager();
+        auto& db = mApp->getDatabase();
+        LedgerDelta delta(lm.getCurrentLedgerHeader(), db);
+
+        auto root = AccountFrame::loadAccount(
+            delta, txtest::getRoot(mApp->getNetworkID()).getPublicKey(), db);
+        for (size_t i = 0; i < mAccounts.size(); ++i)
+        {
+            AccountFrame account(mAccounts[i].getPublicKey());
+            account.getAccount().balance = FUZZ_ACCOUNT_BALANCE;
+            root->getAccount().balance -= FUZZ_ACCOUNT_BALANCE;
+            if (i != 0)
+            {
+                LedgerEntry le;
+                le.data.type(TRUSTLINE);
+                auto& tl = le.data.trustLine();
+                tl.accountID = mAccounts[i].getPublicKey();
+                tl.asset = mAsset;
+                tl.balance = FUZZ_TRUST_BALANCE;
+                tl.limit = INT64_MAX;
+                tl.flags = AUTHORIZED_FLAG;
+                TrustFrame(le).storeAdd(delta, db);
+                account.getAccount().numSubEntries = 1;
+            }
+            account.storeAdd(delta, db);
+        }
+        root->storeChange(delta, db);
+        delta.commit();
+    }
+
+    // Fuzzed account ids mostly do not exist: they are mapped to the seeded
+    // accounts, so that the fuzzer reaches them by changing any byte.
+    AccountID
+    remap(AccountID const& id) const
+    {
+        return mAccounts[id.ed25519()[0] % mAccounts.size()].getPublicKey();
+    }
+
+    void
+    remap(Asset& asset) const
+    {
+        switch (asset.type())
+        {
+        case ASSET_TYPE_CREDIT_ALPHANUM4:
+            asset.alphaNum4().issuer = remap(asset.alphaNum4().issuer);
+            break;
+        case ASSET_TYPE_CREDIT_ALPHANUM12:
+            asset.alphaNum12().issuer = remap(asset.alphaNum12().issuer);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void
+    remap(Operation& op, std::set<size_t>& signers) const
+    {
+        if (op.sourceAccount)
+        {
+            auto i = op.sourceAccount->ed25519()[0] % mAccounts.size();
+            *op.sourceAccount = mAccounts[i].getPublicKey();
+            signers.insert(i);
+        }
+        auto& body = op.body;
+        switch (body.type())
+        {
+        case PAYMENT:
+            body.paymentOp().destination =
+                remap(body.paymentOp().destination);
+            remap(body.paymentOp().asset);
+            break;
+        case PATH_PAYMENT:
+        {
+            auto& pp = body.pathPaymentOp();
+            pp.destination = remap(pp.destination);
+            remap(pp.sendAsset);
+            remap(pp.destAsset);
+            for (auto& a : pp.path)
+            {
+                remap(a);
+            }
+            break;
+        }
+        case MANAGE_OFFER:
+            remap(body.manageOfferOp().selling);
+            remap(body.manageOfferOp().buying);
+            break;
+        case CREATE_PASSIVE_OFFER:
+            remap(body.createPassiveOfferOp().selling);
+            remap(body.createPassiveOfferOp().buying);
+            break;
+        case CHANGE_TRUST:
+            remap(body.changeTrustOp().line);
+            break;
+        case ALLOW_TRUST:
+            body.allowTrustOp().trustor = remap(body.allowTrustOp().trustor);
+            break;
+        case ACCOUNT_MERGE:
+            body.destination() = remap(body.destination());
+            break;
+        default:
+            break;
+        }
+    }
+
+  public:
+    explicit TransactionFuzzTarget(Config const& cfg)
+        : mApp(Application::create(mClock, cfg))
+    {
+        for (size_t i = 0; i < FUZZ_ACCOUNTS; ++i)
+        {
+            mAccounts.emplace_back(fuzzAccount(i));
+        }
+        mAsset = txtest::makeAsset(mAccounts[0], FUZZ_ASSET_CODE);
+        seedLedger();
+    }
+
+    void
+    inject(std::string const& filename) override
+    {
+        auto ops = readAll<Operation>(filename, 100);
+        std::set<size_t> signers;
+        for (auto& op : ops)
+        {
+            remap(op, signers);
+        }
+        // the source of the transaction is the first seeded account, all
+        // the accounts it uses sign
+        auto tx =
+            txtest::transactionFromOperations(*mApp, mAccounts[0], 1, ops);
+        for (auto i : signers)
+        {
+            if (i != 0)
+            {
+                tx->addSignature(mAccounts[i]);
+            }
+        }
+        LOG(INFO) << "Fuzzer applying " << ops.size() << " operations";
+
+        auto& lm = mApp->getLedgerManager();
+        auto& db = mApp->getDatabase();
+        // rolled back: the next input gets the seeded ledger again
+        soci::transaction sqlTx(db.getSession());
+        LedgerDelta delta(lm.getCurrentLedgerHeader(), db);
+        if (tx->checkValid(*mApp, 0))
+        {
+            tx->processFeeSeqNum(delta, lm);
+            // as LedgerManagerImpl::applyTransactions: invariants not holding
+            // are what the fuzzer looks for
+            try
+            {
+                tx->apply(delta, *mApp);
+            }
+            catch (InvariantDoesNotHold&)
+            {
+                throw;
+            }
+            catch (std::runtime_error& e)
+            {
+                LOG(INFO) << "Exception during tx->apply: " << e.what();
+            }
+        }
+        LOG(INFO) << "Fuzzer transaction result: "
+                  << xdr::xdr_to_string(tx->getResult(), "result");
+        delta.rollback();
+    }
+};
+
+class BucketMergeFuzzTarget : public FuzzTarget
+{
+    VirtualClock mClock;
+    Application::pointer mApp;
+
+    // A bucket of the live and dead entries in [begin, end), the last one
+    // of each key winning as fresh() takes one of each.
+    std::shared_ptr<Bucket>
+    makeBucket(std::vector<BucketEntry>::const_iterator begin,
+               std::vector<BucketEntry>::const_iterator end)
+    {
+        std::map<LedgerKey, BucketEntry const*, LedgerEntryIdCmp> byKey;
+        for (auto it = begin; it != end; ++it)
+        {
+            byKey[it->type() == LIVEENTRY ? LedgerEntryKey(it->liveEntry())
+                                          : it->deadEntry()] = &*it;
+        }
+        std::vector<LedgerEntry> live;
+        std::vector<LedgerKey> dead;
+        for (auto const& kv : byKey)
+        {
+            if (kv.second->type() == LIVEENTRY)
+            {
+                live.emplace_back(kv.second->liveEntry());
+            }
+            else
+            {
+                dead.emplace_back(kv.first);
+            }
+        }
+        return Bucket::fresh(mApp->getBucketManager(), live, dead);
+    }
+
+    static void
+    checkSorted(std::shared_ptr<Bucket> const& b)
+    {
+        BucketEntryIdCmp cmp;
+        BucketEntry prev;
+        bool first = true;
+        for (BucketInputIterator in(b); in; ++in)
+        {
+            if (!first && !cmp(prev, *in))
+            {
+                LOG(FATAL) << "Merged bucket " << hexAbbrev(b->getHash())
+                           << " is not sorted";
+                abort();
+            }
+            prev = *in;
+            first = false;
+        }
+    }
+
+  public:
+    explicit BucketMergeFuzzTarget(Config const& cfg)
+        : mApp(Application::create(mClock, cfg))
+    {
+    }
+
+    void
+    inject(std::string const& filename) override
+    {
+        auto entries = readAll<BucketEntry>(filename, 3000);
+        LOG(INFO) << "Fuzzer merging " << entries.size() << " entries";
+        {
+            // the entries are the old, the new and the shadow buckets, in
+            // thirds
+            auto third = entries.size() / 3;
+            auto b = entries.cbegin();
+            auto oldBucket = makeBucket(b, b + third);
+            auto newBucket = makeBucket(b + third, b + 2 * third);
+            auto shadow = makeBucket(b + 2 * third, entries.cend());
+
+            // in memory, as on the first levels of the BucketList, then
+            // through the files with a shadow
+            checkSorted(
+                Bucket::merge(mApp->getBucketManager(), oldBucket, newBucket));
+            checkSorted(Bucket::merge(mApp->getBucketManager(), oldBucket,
+                                      newBucket, {shadow}));
+        }
+        mApp->getBucketManager().forgetUnreferencedBuckets();
+    }
+};
+
+Config
+fuzzConfig(int instance, std::string const& name)
+{
+    Config cfg = getTestConfig(instance);
+    cfg.HTTP_PORT = 0;
+    cfg.PUBLIC_HTTP_PORT = false;
+    cfg.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+    cfg.LOG_FILE_PATH = "fuzz-app-" + name + ".log";
+    cfg.BUCKET_DIR_PATH = "fuzz-buckets-" + name;
+    cfg.QUORUM_SET.threshold = 1;
+    cfg.QUORUM_SET.validators.clear();
+    cfg.QUORUM_SET.validators.push_back(
+        SecretKey::fromSeed(sha256(name)).getPublicKey());
+    return cfg;
+}
+}
+
+bool
+parseFuzzMode(std::string const& s, FuzzMode& mode)
+{
+    if (s == "overlay")
+    {
+        mode = FuzzMode::OVERLAY;
+    }
+    else if (s == "tx")
+    {
+        mode = FuzzMode::TRANSACTION;
+    }
+    else if (s == "bucket-merge")
+    {
+        mode = FuzzMode::BUCKET_MERGE;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
 void
-fuzz(std::string const& filename, el::Level logLevel,
+fuzz(std::string const& filename, FuzzMode mode, el::Level logLevel,
      std::vector<std::string> const& metrics)
 {
     Logging::setFmt("<fuzz>", false);
@@ -100,95 +544,110 @@ fuzz(std::string const& filename, el::Level logLevel,
     LOG(INFO) << "Fuzzing stellar-core " << STELLAR_CORE_VERSION;
     LOG(INFO) << "Fuzz input is in " << filename;
 
-    Config cfg1, cfg2;
-
-    cfg1 = getTestConfig(0);
-    cfg2 = getTestConfig(1);
-
-    cfg1.HTTP_PORT = 0;
-    cfg1.PUBLIC_HTTP_PORT = false;
-    cfg1.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
-    cfg1.LOG_FILE_PATH = "fuzz-app-1.log";
-    cfg1.BUCKET_DIR_PATH = "fuzz-buckets-1";
-    cfg1.QUORUM_SET.threshold = 1;
-    cfg1.QUORUM_SET.validators.clear();
-    cfg1.QUORUM_SET.validators.push_back(
-        SecretKey::fromSeed(sha256("a")).getPublicKey());
-
-    cfg2.HTTP_PORT = 0;
-    cfg2.PUBLIC_HTTP_PORT = false;
-    cfg2.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
-    cfg2.LOG_FILE_PATH = "fuzz-app-2.log";
-    cfg2.BUCKET_DIR_PATH = "fuzz-buckets-2";
-    cfg2.QUORUM_SET.threshold = 1;
-    cfg2.QUORUM_SET.validators.clear();
-    cfg2.QUORUM_SET.validators.push_back(
-        SecretKey::fromSeed(sha256("b")).getPublicKey());
+    Config cfg1 = fuzzConfig(0, "a");
+    Config cfg2 = fuzzConfig(1, "b");
 
     CfgDirGuard g1(cfg1);
     CfgDirGuard g2(cfg2);
 
-restart:
-{
-    VirtualClock clock;
-    Application::pointer app1 = Application::create(clock, cfg1);
-    Application::pointer app2 = Application::create(clock, cfg2);
-    LoopbackPeerConnection loop(*app1, *app2);
-    while (!(loop.getInitiator()->isAuthenticated() &&
-             loop.getAcceptor()->isAuthenticated()))
+    std::unique_ptr<FuzzTarget> target;
+    switch (mode)
     {
-        clock.crank(true);
+    case FuzzMode::OVERLAY:
+        target = std::make_unique<OverlayFuzzTarget>(cfg1, cfg2);
+        break;
+    case FuzzMode::TRANSACTION:
+        target = std::make_unique<TransactionFuzzTarget>(cfg1);
+        break;
+    case FuzzMode::BUCKET_MERGE:
+        target = std::make_unique<BucketMergeFuzzTarget>(cfg1);
+        break;
     }
 
-    XDRInputFileStream in(MAX_MESSAGE_SIZE);
-    in.open(filename);
-    StellarMessage msg;
-    size_t i = 0;
-    while (tryRead(in, msg))
+#ifdef __AFL_LOOP
+    // afl-clang-fast: fork from here, with the target set up, and run inputs
+    // in the forked process until told to stop
+    __AFL_INIT();
+    while (__AFL_LOOP(PERSIST_MAX))
     {
-        ++i;
-        LOG(INFO) << "Fuzzer injecting message " << i << ": "
-                  << msgSummary(msg);
-        auto peer = loop.getInitiator();
-        clock.getIOService().post(
-            [peer, msg]() { peer->Peer::sendMessage(msg); });
+        target->inject(filename);
     }
-    while (loop.getAcceptor()->isConnected())
-    {
-        clock.crank(true);
-    }
-}
-
-    if (getenv("AFL_PERSISTENT") && persist_cnt++ < PERSIST_MAX)
+#else
+    target->inject(filename);
+    while (getenv("AFL_PERSISTENT") && persist_cnt++ < PERSIST_MAX)
     {
 #ifndef _WIN32
         raise(SIGSTOP);
 #endif
-        goto restart;
+        target->inject(filename);
     }
+#endif
 }
 
 void
-genfuzz(std::string const& filename)
+genfuzz(std::string const& filename, FuzzMode mode)
 {
     Logging::setFmt("<fuzz>");
     size_t n = 3;
-    LOG(INFO) << "Writing " << n << "-message random fuzz file " << filename;
+    LOG(INFO) << "Writing " << n << "-item random fuzz file " << filename;
     XDROutputFileStream out;
     out.open(filename);
-    autocheck::generator<StellarMessage> gen;
-    for (size_t i = 0; i < n; ++i)
+    switch (mode)
+    {
+    case FuzzMode::OVERLAY:
     {
-        try
+        autocheck::generator<StellarMessage> gen;
+        for (size_t i = 0; i < n; ++i)
         {
-            StellarMessage m(gen(10));
-            out.writeOne(m);
-            LOG(INFO) << "Message " << i << ": " << msgSummary(m);
+            try
+            {
+                StellarMessage m(gen(10));
+                out.writeOne(m);
+                LOG(INFO) << "Message " << i << ": " << msgSummary(m);
+            }
+            catch (xdr::xdr_bad_discriminant const&)
+            {
+                LOG(INFO) << "Message " << i << ": malformed, omitted";
+            }
         }
-        catch (xdr::xdr_bad_discriminant const&)
+        break;
+    }
+    case FuzzMode::TRANSACTION:
+    {
+        autocheck::generator<Operation> gen;
+        for (size_t i = 0; i < n; ++i)
         {
-            LOG(INFO) << "Message " << i << ": malformed, omitted";
+            Operation op(gen(10));
+            // from one of the seeded accounts
+            op.sourceAccount.activate() =
+                fuzzAccount(i % FUZZ_ACCOUNTS).getPublicKey();
+            out.writeOne(op);
         }
+        break;
+    }
+    case FuzzMode::BUCKET_MERGE:
+    {
+        // n entries per bucket, the shadow one having dead or unchanged
+        // entries of the new one
+        auto entries = LedgerTestUtils::generateValidLedgerEntries(2 * n);
+        for (size_t i = 0; i < 3 * n; ++i)
+        {
+            BucketEntry e;
+            auto const& le = entries[i < 2 * n ? i : i - n];
+            if (i >= 2 * n && i % 2 == 0)
+            {
+                e.type(DEADENTRY);
+                e.deadEntry() = LedgerEntryKey(le);
+            }
+            else
+            {
+                e.type(LIVEENTRY);
+                e.liveEntry() = le;
+            }
+            out.writeOne(e);
+        }
+        break;
+    }
     }
 }
 }
@@ -9,7 +9,21 @@
 namespace stellar
 {
 
-void fuzz(std::string const& filename, el::Level logLevel,
+// What the fuzz inputs are fed to, see fuzz.cpp.
+enum class FuzzMode
+{
+    // StellarMessages, received by a peer of a pair of loopback nodes
+    OVERLAY,
+    // Operations, applied as a transaction to a seeded ledger
+    TRANSACTION,
+    // BucketEntries, merged as buckets
+    BUCKET_MERGE
+};
+
+// Parses "overlay", "tx" or "bucket-merge"; false if `s` is none of them.
+bool parseFuzzMode(std::string const& s, FuzzMode& mode);
+
+void fuzz(std::string const& filename, FuzzMode mode, el::Level logLevel,
           std::vector<std::string> const& metrics);
-void genfuzz(std::string const& filename);
+void genfuzz(std::string const& filename, FuzzMode mode);
 }
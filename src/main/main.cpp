@@ -3,6 +3,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 #include "util/asio.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketListExporter.h"
 #include "bucket/BucketManager.h"
 #include "catchup/CatchupConfiguration.h"
 #include "catchup/CatchupManager.h"
@@ -12,11 +13,14 @@
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
 #include "ledger/LedgerManager.h"
 #include "lib/http/HttpClient.h"
+#include "lib/http/server.hpp"
 #include "lib/util/getopt.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -26,15 +30,20 @@
 #include "main/StellarCoreVersion.h"
 #include "main/dumpxdr.h"
 #include "main/fuzz.h"
+#include "simulation/CloseBenchmark.h"
+#include "simulation/OverlayReplay.h"
 #include "test/test.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "util/optional.h"
 #include "work/WorkManager.h"
+#include <algorithm>
 #include <lib/util/format.h>
 #include <limits>
 #include <locale>
+#include <numeric>
+#include <sstream>
 #include <sodium.h>
 
 INITIALIZE_EASYLOGGINGPP
@@ -46,6 +55,8 @@ using namespace std;
 
 enum opttag
 {
+    OPT_BENCH_CLOSE,
+    OPT_BENCH_REPLAY,
     OPT_CATCHUP_AT,
     OPT_CATCHUP_COMPLETE,
     OPT_CATCHUP_RECENT,
@@ -56,9 +67,16 @@ enum opttag
     OPT_CHECKQUORUM,
     OPT_BASE64,
     OPT_DUMPXDR,
+    OPT_DUMP_ACCOUNT,
+    OPT_DUMP_FORMAT,
+    OPT_DUMP_STATS,
+    OPT_DUMP_THREADS,
+    OPT_DUMP_TYPE,
+    OPT_EXPORT_STATE,
     OPT_LOADXDR,
     OPT_FORCESCP,
     OPT_FUZZ,
+    OPT_FUZZ_MODE,
     OPT_GENFUZZ,
     OPT_GENSEED,
     OPT_GRAPHQUORUM,
@@ -66,6 +84,7 @@ enum opttag
     OPT_INFERQUORUM,
     OPT_OFFLINEINFO,
     OPT_OUTPUT_FILE,
+    OPT_REPLAY_OVERLAY,
     OPT_REPORT_LAST_HISTORY_CHECKPOINT,
     OPT_LOGLEVEL,
     OPT_METRIC,
@@ -81,6 +100,8 @@ enum opttag
 };
 
 static const struct option stellar_core_options[] = {
+    {"bench-close", required_argument, nullptr, OPT_BENCH_CLOSE},
+    {"bench-replay", required_argument, nullptr, OPT_BENCH_REPLAY},
     {"catchup-at", required_argument, nullptr, OPT_CATCHUP_AT},
     {"catchup-complete", no_argument, nullptr, OPT_CATCHUP_COMPLETE},
     {"catchup-recent", required_argument, nullptr, OPT_CATCHUP_RECENT},
@@ -91,6 +112,12 @@ static const struct option stellar_core_options[] = {
     {"checkquorum", optional_argument, nullptr, OPT_CHECKQUORUM},
     {"base64", no_argument, nullptr, OPT_BASE64},
     {"dumpxdr", required_argument, nullptr, OPT_DUMPXDR},
+    {"dump-account", required_argument, nullptr, OPT_DUMP_ACCOUNT},
+    {"dump-format", required_argument, nullptr, OPT_DUMP_FORMAT},
+    {"dump-stats", no_argument, nullptr, OPT_DUMP_STATS},
+    {"dump-threads", required_argument, nullptr, OPT_DUMP_THREADS},
+    {"dump-type", required_argument, nullptr, OPT_DUMP_TYPE},
+    {"export-state", required_argument, nullptr, OPT_EXPORT_STATE},
     {"printxdr", required_argument, nullptr, OPT_PRINTXDR},
     {"filetype", required_argument, nullptr, OPT_FILETYPE},
     {"signtxn", required_argument, nullptr, OPT_SIGNTXN},
@@ -98,6 +125,7 @@ static const struct option stellar_core_options[] = {
     {"loadxdr", required_argument, nullptr, OPT_LOADXDR},
     {"forcescp", optional_argument, nullptr, OPT_FORCESCP},
     {"fuzz", required_argument, nullptr, OPT_FUZZ},
+    {"fuzz-mode", required_argument, nullptr, OPT_FUZZ_MODE},
     {"genfuzz", required_argument, nullptr, OPT_GENFUZZ},
     {"genseed", no_argument, nullptr, OPT_GENSEED},
     {"graphquorum", optional_argument, nullptr, OPT_GRAPHQUORUM},
@@ -105,6 +133,7 @@ static const struct option stellar_core_options[] = {
     {"inferquorum", optional_argument, nullptr, OPT_INFERQUORUM},
     {"offlineinfo", no_argument, nullptr, OPT_OFFLINEINFO},
     {"output-file", required_argument, nullptr, OPT_OUTPUT_FILE},
+    {"replay-overlay", required_argument, nullptr, OPT_REPLAY_OVERLAY},
     {"report-last-history-checkpoint", no_argument, nullptr,
      OPT_REPORT_LAST_HISTORY_CHECKPOINT},
     {"sec2pub", no_argument, nullptr, OPT_SEC2PUB},
@@ -123,6 +152,19 @@ usage(int err = 1)
     os << "usage: stellar-core [OPTIONS]\n"
           "where OPTIONS can be any of:\n"
           "      --base64             Use base64 for --printtxn and --signtxn\n"
+          "      --bench-close SPEC   Reset the database (sqlite or "
+          "postgresql) and report how\n"
+          "                           fast it closes ledgers of generated "
+          "transactions, then quit\n"
+          "                           SPEC is like accounts=N&ledgers=M&txs=T&"
+          "mix=pay:6,offer:3,pathpay:1\n"
+          "      --bench-replay SPEC  Reset the database, catch up to a "
+          "ledger from a local\n"
+          "                           archive, then report how long "
+          "replaying each following\n"
+          "                           ledger takes, then quit\n"
+          "                           SPEC is like archive=DIR&from=N&to=M&"
+          "invariants=false\n"
           "      --catchup-at SEQ     Do a catchup at ledger SEQ, then quit\n"
           "                           Use current as SEQ to catchup to "
           "'current' history checkpoint\n"
@@ -138,20 +180,45 @@ usage(int err = 1)
           "default 'stellar-core.cfg')\n"
           "      --convertid ID       Displays ID in all known forms\n"
           "      --dumpxdr FILE       Dump an XDR file, for debugging\n"
+          "      --dump-type TYPE     Only dump, with --dumpxdr given after "
+          "it, the records of\n"
+          "                           TYPE (account, trustline, offer, data "
+          "for buckets);\n"
+          "                           can be repeated\n"
+          "      --dump-account ID    Only dump the records concerning "
+          "account ID\n"
+          "      --dump-format FMT    Dump as text (default) or json, one "
+          "line per record\n"
+          "      --dump-stats         Only count the records dumped and "
+          "their bytes by type\n"
+          "      --dump-threads NUM   Dump with NUM threads, 0 for one per "
+          "core (default 1)\n"
+          "      --export-state SPEC  Write the ledger state to CSV files "
+          "read by COPY, straight\n"
+          "                           from the buckets, then quit\n"
+          "                           SPEC is like dir=DIR&threads=0&"
+          "types=account,offer\n"
           "      --loadxdr FILE       Load an XDR bucket file, for testing\n"
           "      --forcescp           Next time stellar-core is run, SCP will "
           "start with the local ledger rather than waiting to hear from the "
           "network.\n"
           "      --fuzz FILE          Run a single fuzz input and exit\n"
+          "      --fuzz-mode MODE     What --fuzz and --genfuzz, given after "
+          "it, fuzz:\n"
+          "                           overlay (default), tx or bucket-merge\n"
           "      --genfuzz FILE       Generate a random fuzzer input file\n"
           "      --genseed            Generate and print a random node seed\n"
           "      --help               Display this string\n"
           "      --inferquorum        Print a quorum set inferred from "
-          "history\n"
+          "history, checking its\n"
+          "                           quorum intersection\n"
           "      --checkquorum        Check quorum intersection from history\n"
           "      --graphquorum        Print a quorum set graph from history\n"
-          "      --output-file        Output file for --graphquorum and "
-          "--report-last-history-checkpoint commands\n"
+          "      --output-file        Output file for --graphquorum, "
+          "--bench-close,\n"
+          "                           --bench-replay and "
+          "--report-last-history-checkpoint\n"
+          "                           commands\n"
           "      --offlineinfo        Return information for an offline "
           "instance\n"
           "      --ll LEVEL           Set the log level. (redundant with --c "
@@ -168,6 +235,14 @@ usage(int err = 1)
           "      --filetype "
           "[auto|ledgerheader|meta|result|resultpair|tx|txfee] toggle for type "
           "used for printxdr\n"
+          "      --replay-overlay SPEC\n"
+          "                           Reset the database, feed it the "
+          "messages captured by\n"
+          "                           OVERLAY_CAPTURE_FILE and report the "
+          "herder and overlay\n"
+          "                           metrics, then quit\n"
+          "                           SPEC is like file=FILE&speed=1 (0 for "
+          "as fast as possible)\n"
           "      --report-last-history-checkpoint\n"
           "                           Report information about last checkpoint "
           "available in history archives\n"
@@ -411,6 +486,43 @@ writeCatchupInfo(Json::Value const& catchupInfo, std::string const& outputFile)
     }
 }
 
+static int
+benchClose(Config const& cfg, std::string const& spec,
+           std::string const& outputFile)
+{
+    auto bench = CloseBenchmark::parse(spec);
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto app = Application::create(clock, cfg);
+    app->start();
+    while (!app->getLedgerManager().isReadyToCloseLedgers() &&
+           clock.crank(true))
+        ;
+
+    auto report = bench.run(*app);
+    app->gracefulStop();
+    while (clock.crank(true))
+        ;
+
+    std::string filename = outputFile.empty() ? "-" : outputFile;
+    auto content = report.toStyledString();
+    if (filename == "-")
+    {
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Close benchmark: " << content;
+        LOG(INFO) << "*";
+    }
+    else
+    {
+        std::ofstream out(filename);
+        out.write(content.c_str(), content.size());
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Wrote close benchmark to " << filename;
+        LOG(INFO) << "*";
+    }
+    return 0;
+}
+
 static int
 reportLastHistoryCheckpoint(Config const& cfg, std::string const& outputFile)
 {
@@ -494,6 +606,160 @@ parseLedgerCount(std::string const& str)
     return result;
 }
 
+static int
+benchReplay(Config cfg, std::string const& spec, std::string const& outputFile)
+{
+    std::map<std::string, std::string> params;
+    http::server::server::parseParams(spec, params);
+    if (params["archive"].empty() || params["from"].empty() ||
+        params["to"].empty())
+    {
+        throw std::runtime_error(
+            "--bench-replay needs archive, from and to parameters");
+    }
+    auto from = parseLedger(params["from"]);
+    auto to = parseLedger(params["to"]);
+    if (from == CatchupConfiguration::CURRENT || to <= from)
+    {
+        throw std::runtime_error(
+            fmt::format("{}..{} is not a valid ledger range", from, to));
+    }
+    auto invariants = params["invariants"] == "true";
+
+    HistoryArchiveConfiguration archive;
+    archive.mName = "bench";
+    archive.mGetCmd = "cp " + params["archive"] + "/{0} {1}";
+    cfg.HISTORY.clear();
+    cfg.HISTORY[archive.mName] = archive;
+    if (!invariants)
+    {
+        cfg.INVARIANT_CHECKS.clear();
+        cfg.INVARIANT_CHECKS_DEFERRED.clear();
+        cfg.INVARIANT_CHECKS_PER_LEDGER.clear();
+    }
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto app = Application::create(clock, cfg);
+    auto& lm = app->getLedgerManager();
+
+    // the state at `from` comes from the buckets, untimed
+    Json::Value catchupInfo;
+    auto result = catchup(app, from, 0, catchupInfo);
+    if (result == 0)
+    {
+        if (lm.getLastClosedLedgerNum() != from)
+        {
+            LOG(ERROR) << "Catchup reached ledger "
+                       << lm.getLastClosedLedgerNum() << " instead of "
+                       << from;
+            result = 1;
+        }
+    }
+
+    // then ApplyLedgerChainWork replays the range, timed closeLedger by
+    // closeLedger
+    Json::Value report;
+    std::vector<double> closeMs;
+    if (result == 0)
+    {
+        auto id = lm.addLedgerClosedCallback(
+            [&](LedgerCloseData const& ledgerData,
+                std::chrono::nanoseconds closeTime) {
+                auto ms =
+                    std::chrono::duration<double, std::milli>(closeTime)
+                        .count();
+                Json::Value ledger;
+                ledger["ledger"] = ledgerData.getLedgerSeq();
+                ledger["txs"] = static_cast<Json::UInt64>(
+                    ledgerData.getTxSet()->size());
+                ledger["ms"] = ms;
+                report["ledgers"].append(ledger);
+                closeMs.push_back(ms);
+            });
+        result = catchup(app, to, std::numeric_limits<uint32_t>::max(),
+                         catchupInfo);
+        lm.removeLedgerClosedCallback(id);
+    }
+    app->gracefulStop();
+    while (clock.crank(true))
+        ;
+    if (result != 0)
+    {
+        return result;
+    }
+
+    report["from"] = from;
+    report["to"] = to;
+    report["invariants"] = invariants;
+    report["seconds"] =
+        std::accumulate(closeMs.begin(), closeMs.end(), 0.0) / 1000;
+    std::sort(closeMs.begin(), closeMs.end());
+    if (!closeMs.empty())
+    {
+        report["close_ms"]["p50"] = closeMs[(closeMs.size() - 1) / 2];
+        report["close_ms"]["p99"] = closeMs[(closeMs.size() - 1) * 99 / 100];
+        report["close_ms"]["max"] = closeMs.back();
+    }
+
+    std::string filename = outputFile.empty() ? "-" : outputFile;
+    auto content = report.toStyledString();
+    if (filename == "-")
+    {
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Replay benchmark: " << content;
+        LOG(INFO) << "*";
+    }
+    else
+    {
+        std::ofstream out(filename);
+        out.write(content.c_str(), content.size());
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Wrote replay benchmark to " << filename;
+        LOG(INFO) << "*";
+    }
+    return 0;
+}
+
+static int
+replayOverlay(Config cfg, std::string const& spec,
+              std::string const& outputFile)
+{
+    auto replay = OverlayReplay::parse(spec);
+
+    // listens nowhere and connects to no one, but is otherwise the node
+    // configured, with SCP and ledgers closing as they would
+    cfg.RUN_STANDALONE = true;
+    cfg.HTTP_PORT = 0;
+    cfg.OVERLAY_CAPTURE_FILE.clear();
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto app = Application::create(clock, cfg);
+    app->start();
+
+    auto report = replay.run(*app);
+    app->gracefulStop();
+    while (clock.crank(true))
+        ;
+
+    std::string filename = outputFile.empty() ? "-" : outputFile;
+    auto content = report.toStyledString();
+    if (filename == "-")
+    {
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Overlay replay: " << content;
+        LOG(INFO) << "*";
+    }
+    else
+    {
+        std::ofstream out(filename);
+        out.write(content.c_str(), content.size());
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Wrote overlay replay to " << filename;
+        LOG(INFO) << "*";
+    }
+    return 0;
+}
+
 static void
 setForceSCPFlag(Config const& cfg, bool isOn)
 {
@@ -559,6 +825,78 @@ loadXdr(Config const& cfg, std::string const& bucketFile)
     }
 }
 
+static int
+exportState(Config const& cfg, std::string const& spec)
+{
+    std::map<std::string, std::string> params;
+    http::server::server::parseParams(spec, params);
+    BucketListExporter::Options options;
+    options.mDir = params["dir"];
+    if (options.mDir.empty())
+    {
+        throw std::runtime_error("--export-state needs a dir parameter");
+    }
+    options.mThreads =
+        params["threads"].empty() ? 0 : std::stoul(params["threads"]);
+    std::map<std::string, LedgerEntryType> const types{
+        {"account", ACCOUNT},
+        {"trustline", TRUSTLINE},
+        {"offer", OFFER},
+        {"data", DATA}};
+    std::istringstream typeList(params["types"]);
+    std::string type;
+    while (std::getline(typeList, type, ','))
+    {
+        auto it = types.find(type);
+        if (it == types.end())
+        {
+            throw std::runtime_error("unknown ledger entry type: " + type);
+        }
+        options.mTypes.insert(it->second);
+    }
+
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg, false);
+    if (!checkInitialized(app))
+    {
+        return 1;
+    }
+
+    // the buckets of the last closed ledger; the database is only read for
+    // the state naming them
+    HistoryArchiveState has;
+    has.fromString(app->getPersistentState().getState(
+        PersistentState::kHistoryArchiveState));
+    auto& bm = app->getBucketManager();
+    auto missing = bm.checkForMissingBucketsFiles(has);
+    if (!missing.empty())
+    {
+        LOG(ERROR) << "* ";
+        LOG(ERROR) << "* " << missing.size() << " buckets missing from "
+                   << bm.getBucketDir() << ", first " << missing.front();
+        LOG(ERROR) << "* ";
+        return 1;
+    }
+    std::vector<std::shared_ptr<Bucket const>> buckets;
+    for (auto const& level : has.currentBuckets)
+    {
+        buckets.emplace_back(bm.getBucketByHash(hexToBin256(level.curr)));
+        buckets.emplace_back(bm.getBucketByHash(hexToBin256(level.snap)));
+    }
+
+    auto res = BucketListExporter::exportEntries(buckets, options);
+    LOG(INFO) << "* ";
+    LOG(INFO) << "* Exported the state of ledger " << has.currentLedger
+              << " to " << options.mDir << ", " << res.mFiles.size()
+              << " files from " << res.mEntriesRead << " bucket entries";
+    for (auto const& kv : res.mRows)
+    {
+        LOG(INFO) << "*   " << kv.first << ": " << kv.second << " rows";
+    }
+    LOG(INFO) << "* ";
+    return 0;
+}
+
 static void
 inferQuorumAndWrite(Config const& cfg)
 {
@@ -570,6 +908,7 @@ inferQuorumAndWrite(Config const& cfg)
     }
     LOG(INFO) << "Inferred quorum";
     std::cout << iq.toString(cfg) << std::endl;
+    iq.checkQuorumIntersection(cfg);
 }
 
 static void
@@ -719,6 +1058,12 @@ main(int argc, char* const* argv)
     std::vector<std::string> newHistories;
     std::vector<std::string> metrics;
     string filetype = "auto";
+    FuzzMode fuzzMode = FuzzMode::OVERLAY;
+    DumpXdrOptions dumpOptions;
+    std::string benchCloseSpec;
+    std::string benchReplaySpec;
+    std::string replayOverlaySpec;
+    std::string exportStateSpec;
 
     int opt;
     while ((opt = getopt_long_only(argc, argv, "c:", stellar_core_options,
@@ -729,6 +1074,12 @@ main(int argc, char* const* argv)
         case OPT_BASE64:
             base64 = true;
             break;
+        case OPT_BENCH_CLOSE:
+            benchCloseSpec = optarg;
+            break;
+        case OPT_BENCH_REPLAY:
+            benchReplaySpec = optarg;
+            break;
         case OPT_CATCHUP_AT:
             doCatchupAt = true;
             catchupAtTarget = parseLedger(optarg);
@@ -757,8 +1108,35 @@ main(int argc, char* const* argv)
             StrKeyUtils::logKey(std::cout, std::string(optarg));
             return 0;
         case OPT_DUMPXDR:
-            dumpXdrStream(std::string(optarg));
+            dumpXdrStream(std::string(optarg), dumpOptions);
             return 0;
+        case OPT_DUMP_ACCOUNT:
+            dumpOptions.mAccount = make_optional<AccountID>(
+                KeyUtils::fromStrKey<PublicKey>(std::string(optarg)));
+            break;
+        case OPT_DUMP_FORMAT:
+        {
+            std::string format(optarg);
+            if (format != "text" && format != "json")
+            {
+                std::cerr << "unknown dump format: " << format << std::endl;
+                return 1;
+            }
+            dumpOptions.mJson = format == "json";
+            break;
+        }
+        case OPT_DUMP_STATS:
+            dumpOptions.mStats = true;
+            break;
+        case OPT_DUMP_THREADS:
+            dumpOptions.mThreads = std::stoul(std::string(optarg));
+            break;
+        case OPT_DUMP_TYPE:
+            dumpOptions.mKinds.emplace(optarg);
+            break;
+        case OPT_EXPORT_STATE:
+            exportStateSpec = optarg;
+            break;
         case OPT_PRINTXDR:
             printXdr(std::string(optarg), filetype, base64);
             return 0;
@@ -782,10 +1160,17 @@ main(int argc, char* const* argv)
                                            string(optarg) == "true");
             break;
         case OPT_FUZZ:
-            fuzz(std::string(optarg), logLevel, metrics);
+            fuzz(std::string(optarg), fuzzMode, logLevel, metrics);
             return 0;
+        case OPT_FUZZ_MODE:
+            if (!parseFuzzMode(std::string(optarg), fuzzMode))
+            {
+                std::cerr << "unknown fuzz mode: " << optarg << std::endl;
+                return 1;
+            }
+            break;
         case OPT_GENFUZZ:
-            genfuzz(std::string(optarg));
+            genfuzz(std::string(optarg), fuzzMode);
             return 0;
         case OPT_GENSEED:
         {
@@ -822,6 +1207,9 @@ main(int argc, char* const* argv)
         case OPT_NEWHIST:
             newHistories.push_back(std::string(optarg));
             break;
+        case OPT_REPLAY_OVERLAY:
+            replayOverlaySpec = optarg;
+            break;
         case OPT_REPORT_LAST_HISTORY_CHECKPOINT:
             doReportLastHistoryCheckpoint = true;
             break;
@@ -871,6 +1259,8 @@ main(int argc, char* const* argv)
         if (cfg.LOG_FILE_PATH.size())
             Logging::setLoggingToFile(cfg.LOG_FILE_PATH);
         Logging::setLogLevel(logLevel, nullptr);
+        Logging::setAsync(cfg.LOG_ASYNC_BUFFER_SIZE,
+                          cfg.LOG_ASYNC_DROP_WHEN_FULL);
 
         cfg.REPORT_METRICS = metrics;
 
@@ -929,6 +1319,25 @@ main(int argc, char* const* argv)
             setNoListen(cfg);
             return initializeHistories(cfg, newHistories);
         }
+        else if (!benchCloseSpec.empty())
+        {
+            setNoListen(cfg);
+            return benchClose(cfg, benchCloseSpec, outputFile);
+        }
+        else if (!benchReplaySpec.empty())
+        {
+            setNoListen(cfg);
+            return benchReplay(cfg, benchReplaySpec, outputFile);
+        }
+        else if (!replayOverlaySpec.empty())
+        {
+            return replayOverlay(cfg, replayOverlaySpec, outputFile);
+        }
+        else if (!exportStateSpec.empty())
+        {
+            setNoListen(cfg);
+            return exportState(cfg, exportStateSpec);
+        }
 
         if (cfg.MANUAL_CLOSE)
         {
@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "xdr/Stellar-types.h"
+#include <string>
 
 /**
  * Manages list of banned nodes.
@@ -34,6 +35,15 @@ class BanManager
     // List banned nodes
     virtual std::vector<std::string> getBans() = 0;
 
+    // Remember that banned node `nodeID` connected from `ip`, so that further
+    // connections from there are refused before any handshake. Kept in
+    // memory only, for the most recent addresses, until the node is unbanned.
+    virtual void banAddressOf(NodeID nodeID, std::string const& ip) = 0;
+
+    // Check, without touching the database, if a banned node connected from
+    // `ip`
+    virtual bool isAddressBanned(std::string const& ip) = 0;
+
     virtual ~BanManager()
     {
     }
@@ -5,9 +5,11 @@
 #include "overlay/BanManagerImpl.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
+#include "util/XDROperators.h"
 #include "database/Database.h"
 #include "main/Application.h"
 #include "util/Logging.h"
+#include <algorithm>
 
 namespace stellar
 {
@@ -20,7 +22,11 @@ BanManager::create(Application& app)
     return std::make_unique<BanManagerImpl>(app);
 }
 
-BanManagerImpl::BanManagerImpl(Application& app) : mApp(app)
+// most addresses of banned nodes remembered
+static const size_t BANNED_ADDRESSES_SIZE = 1024;
+
+BanManagerImpl::BanManagerImpl(Application& app)
+    : mApp(app), mBannedAddresses(BANNED_ADDRESSES_SIZE)
 {
 }
 
@@ -28,9 +34,35 @@ BanManagerImpl::~BanManagerImpl()
 {
 }
 
+void
+BanManagerImpl::ensureLoaded()
+{
+    if (mLoaded)
+    {
+        return;
+    }
+    std::string nodeIDString;
+    auto& db = mApp.getDatabase();
+    auto timer = db.getSelectTimer("ban");
+    soci::statement st = (db.getSession().prepare << "SELECT nodeid FROM ban",
+                          soci::into(nodeIDString));
+    st.execute(true);
+    while (st.got_data())
+    {
+        mBanned.insert(KeyUtils::fromStrKey<NodeID>(nodeIDString));
+        st.fetch();
+    }
+    mLoaded = true;
+}
+
 void
 BanManagerImpl::banNode(NodeID nodeID)
 {
+    ensureLoaded();
+    if (!mBanned.insert(nodeID).second)
+    {
+        return;
+    }
     auto nodeIDString = KeyUtils::toStrKey(nodeID);
     auto timer = mApp.getDatabase().getInsertTimer("ban");
     auto prep = mApp.getDatabase().getPreparedStatement(
@@ -45,6 +77,8 @@ BanManagerImpl::banNode(NodeID nodeID)
 void
 BanManagerImpl::unbanNode(NodeID nodeID)
 {
+    ensureLoaded();
+    mBanned.erase(nodeID);
     auto nodeIDString = KeyUtils::toStrKey(nodeID);
     auto timer = mApp.getDatabase().getDeleteTimer("ban");
     auto prep = mApp.getDatabase().getPreparedStatement(
@@ -53,44 +87,42 @@ BanManagerImpl::unbanNode(NodeID nodeID)
     st.exchange(soci::use(nodeIDString));
     st.define_and_bind();
     st.execute(true);
+
+    mBannedAddresses.erase_if([&](NodeID const& n) { return n == nodeID; });
 }
 
 bool
 BanManagerImpl::isBanned(NodeID nodeID)
 {
-    auto nodeIDString = KeyUtils::toStrKey(nodeID);
-    auto timer = mApp.getDatabase().getSelectTimer("ban");
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT count(*) FROM ban WHERE nodeid = :n");
-    uint32_t count;
-    auto& st = prep.statement();
-    st.exchange(soci::into(count));
-    st.exchange(soci::use(nodeIDString));
-    st.define_and_bind();
-    st.execute(true);
-    return count == 1;
+    ensureLoaded();
+    return mBanned.find(nodeID) != mBanned.end();
 }
 
 std::vector<std::string>
 BanManagerImpl::getBans()
 {
+    ensureLoaded();
     std::vector<std::string> result;
-    std::string nodeIDString;
-    auto timer = mApp.getDatabase().getSelectTimer("ban");
-    auto prep =
-        mApp.getDatabase().getPreparedStatement("SELECT nodeid FROM ban");
-    auto& st = prep.statement();
-    st.exchange(soci::into(nodeIDString));
-    st.define_and_bind();
-    st.execute(true);
-    while (st.got_data())
+    for (auto const& n : mBanned)
     {
-        result.push_back(nodeIDString);
-        st.fetch();
+        result.push_back(KeyUtils::toStrKey(n));
     }
+    std::sort(result.begin(), result.end());
     return result;
 }
 
+void
+BanManagerImpl::banAddressOf(NodeID nodeID, std::string const& ip)
+{
+    mBannedAddresses.put(ip, nodeID);
+}
+
+bool
+BanManagerImpl::isAddressBanned(std::string const& ip)
+{
+    return mBannedAddresses.exists(ip);
+}
+
 void
 BanManager::dropAll(Database& db)
 {
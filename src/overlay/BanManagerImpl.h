@@ -4,10 +4,14 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/SecretKey.h"
 #include "overlay/BanManager.h"
+#include "util/lrucache.hpp"
+#include <unordered_set>
 
 /*
- * Maintain banned set of nodes
+ * Maintain banned set of nodes, kept in memory (loaded from the database on
+ * first use) and written through to the database
  */
 namespace stellar
 {
@@ -17,6 +21,13 @@ class BanManagerImpl : public BanManager
   protected:
     Application& mApp;
 
+    std::unordered_set<NodeID> mBanned;
+    bool mLoaded{false};
+    void ensureLoaded();
+
+    // address -> banned node that connected from it
+    cache::lru_cache<std::string, NodeID> mBannedAddresses;
+
   public:
     BanManagerImpl(Application& app);
     ~BanManagerImpl();
@@ -25,5 +36,7 @@ class BanManagerImpl : public BanManager
     void unbanNode(NodeID nodeID) override;
     bool isBanned(NodeID nodeID) override;
     std::vector<std::string> getBans() override;
+    void banAddressOf(NodeID nodeID, std::string const& ip) override;
+    bool isAddressBanned(std::string const& ip) override;
 };
 }
@@ -0,0 +1,84 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/FetchStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace stellar
+{
+
+// smoothing factors of RFC 6298
+static double const LATENCY_ALPHA = 1.0 / 8;
+static double const VARIATION_BETA = 1.0 / 4;
+static double const MISS_ALPHA = 1.0 / 8;
+// so that a peer that never has the items is still asked eventually
+static double const MAX_MISS_RATE = 0.9;
+
+void
+FetchStats::recordReply(std::chrono::nanoseconds latency)
+{
+    double ms =
+        std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+            latency)
+            .count();
+    if (!mHasLatency)
+    {
+        mLatency = ms;
+        mVariation = ms / 2;
+        mHasLatency = true;
+    }
+    else
+    {
+        mVariation = (1 - VARIATION_BETA) * mVariation +
+                     VARIATION_BETA * std::abs(mLatency - ms);
+        mLatency = (1 - LATENCY_ALPHA) * mLatency + LATENCY_ALPHA * ms;
+    }
+    mMissRate = (1 - MISS_ALPHA) * mMissRate;
+}
+
+void
+FetchStats::recordDontHave()
+{
+    mMissRate = (1 - MISS_ALPHA) * mMissRate + MISS_ALPHA;
+}
+
+bool
+FetchStats::hasLatency() const
+{
+    return mHasLatency;
+}
+
+std::chrono::milliseconds
+FetchStats::getLatency() const
+{
+    return std::chrono::milliseconds(static_cast<int64_t>(mLatency));
+}
+
+double
+FetchStats::getMissRate() const
+{
+    return mMissRate;
+}
+
+std::chrono::milliseconds
+FetchStats::getHedgeDelay(std::chrono::milliseconds unknown) const
+{
+    if (!mHasLatency)
+    {
+        return unknown;
+    }
+    return std::chrono::milliseconds(
+        static_cast<int64_t>(std::ceil(mLatency + 4 * mVariation)));
+}
+
+double
+FetchStats::getExpectedCost(std::chrono::milliseconds unknown) const
+{
+    double latency =
+        mHasLatency ? mLatency : static_cast<double>(unknown.count());
+    return latency / (1 - std::min(mMissRate, MAX_MISS_RATE));
+}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <chrono>
+
+namespace stellar
+{
+
+/**
+ * How well a peer answers item fetch requests (GET_TX_SET,
+ * GET_SCP_QUORUMSET): a smoothed reply latency and its variation, estimated
+ * like TCP's round trip time (RFC 6298), and a smoothed rate of DONT_HAVE
+ * replies. Tracker uses them to ask the peers most likely to answer first,
+ * and to ask another peer when one is late rather than waiting for the full
+ * reply timeout.
+ */
+class FetchStats
+{
+    bool mHasLatency{false};
+    // milliseconds
+    double mLatency{0};
+    double mVariation{0};
+    double mMissRate{0};
+
+  public:
+    void recordReply(std::chrono::nanoseconds latency);
+    void recordDontHave();
+
+    bool hasLatency() const;
+    std::chrono::milliseconds getLatency() const;
+    double getMissRate() const;
+
+    // Time after which a reply is late: latency plus 4 times its variation.
+    // `unknown` when no reply was timed yet.
+    std::chrono::milliseconds
+    getHedgeDelay(std::chrono::milliseconds unknown) const;
+
+    // Expected time to get an item from the peer, accounting for the
+    // requests it can't answer; `unknown` stands for the latency of peers
+    // that have not replied yet. Lower is better.
+    double getExpectedCost(std::chrono::milliseconds unknown) const;
+};
+}
@@ -0,0 +1,56 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "overlay/FetchStats.h"
+
+using namespace stellar;
+
+TEST_CASE("fetch stats", "[overlay][fetchstats]")
+{
+    using namespace std::chrono;
+    auto const unknown = milliseconds(500);
+    FetchStats stats;
+    REQUIRE(!stats.hasLatency());
+    REQUIRE(stats.getHedgeDelay(unknown) == unknown);
+    REQUIRE(stats.getExpectedCost(unknown) == 500);
+
+    SECTION("steady replies")
+    {
+        for (int i = 0; i < 50; ++i)
+        {
+            stats.recordReply(milliseconds(100));
+        }
+        REQUIRE(stats.getLatency() == milliseconds(100));
+        // the variation decays towards 0
+        REQUIRE(stats.getHedgeDelay(unknown) < milliseconds(110));
+        REQUIRE(stats.getHedgeDelay(unknown) >= milliseconds(100));
+        REQUIRE(stats.getExpectedCost(unknown) == Approx(100));
+    }
+
+    SECTION("jittery replies are hedged later")
+    {
+        for (int i = 0; i < 50; ++i)
+        {
+            stats.recordReply(milliseconds(i % 2 == 0 ? 50 : 150));
+        }
+        REQUIRE(stats.getHedgeDelay(unknown) > milliseconds(250));
+    }
+
+    SECTION("don't haves make a peer more expensive")
+    {
+        stats.recordReply(milliseconds(100));
+        auto cost = stats.getExpectedCost(unknown);
+        stats.recordDontHave();
+        stats.recordDontHave();
+        REQUIRE(stats.getMissRate() > 0);
+        REQUIRE(stats.getExpectedCost(unknown) > cost);
+        for (int i = 0; i < 100; ++i)
+        {
+            stats.recordDontHave();
+        }
+        // capped
+        REQUIRE(stats.getExpectedCost(unknown) == Approx(100 / (1 - 0.9)));
+    }
+}
@@ -10,6 +10,11 @@
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "overlay/Floodgate.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerDoor.h"
 #include "simulation/Simulation.h"
@@ -24,6 +29,44 @@ namespace stellar
 {
 using namespace txtest;
 
+TEST_CASE("flood records memory cap", "[flood][overlay]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.FLOOD_MAP_MAX_BYTES = 10 * Floodgate::FLOOD_RECORD_OVERHEAD;
+    auto app = createTestApplication(clock, cfg);
+    Floodgate floodgate(*app);
+
+    auto message = [](uint32_t i) {
+        StellarMessage msg;
+        msg.type(GET_SCP_STATE);
+        msg.getSCPLedgerSeq() = i;
+        return msg;
+    };
+    for (uint32_t i = 0; i < 25; ++i)
+    {
+        REQUIRE(floodgate.addRecord(message(i), nullptr));
+    }
+    REQUIRE(floodgate.size() == 10);
+    REQUIRE(floodgate.getBytes() == cfg.FLOOD_MAP_MAX_BYTES);
+    REQUIRE(app->getMetrics()
+                .NewMeter({"overlay", "flood", "evicted"}, "record")
+                .count() == 15);
+    REQUIRE(app->getMetrics()
+                .NewCounter({"overlay", "memory", "flood-map-bytes"})
+                .count() == int64_t(floodgate.getBytes()));
+
+    // the oldest were forgotten, the latest are still known
+    REQUIRE(!floodgate.addRecord(message(24), nullptr));
+    REQUIRE(!floodgate.addRecord(message(15), nullptr));
+    REQUIRE(floodgate.addRecord(message(14), nullptr));
+    REQUIRE(floodgate.size() == 10);
+
+    floodgate.clearBelow(app->getHerder().getCurrentLedgerSeq() + 11);
+    REQUIRE(floodgate.size() == 0);
+    REQUIRE(floodgate.getBytes() == 0);
+}
+
 TEST_CASE("Flooding", "[flood][overlay]")
 {
     Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
@@ -182,6 +225,28 @@ TEST_CASE("Flooding", "[flood][overlay]")
             }
         }
 
+        SECTION("pull mode")
+        {
+            auto pullCfgGen = [&](int cfgNum) {
+                Config cfg = cfgGen(cfgNum);
+                cfg.FLOOD_TX_PULL_MODE = true;
+                return cfg;
+            };
+            simulation = Topologies::core(4, .666f, Simulation::OVER_LOOPBACK,
+                                          networkID, pullCfgGen);
+            test(injectTransaction, ackedTransactions);
+            for (auto n : nodes)
+            {
+                auto& m = n->getMetrics();
+                REQUIRE(m.NewMeter({"overlay", "send", "flood-advert"},
+                                   "message")
+                            .count() > 0);
+                // demanded once each, rather than pushed by every peer
+                REQUIRE(m.NewTimer({"overlay", "recv", "transaction"})
+                            .count() <= nbTx);
+            }
+        }
+
         SECTION("outer nodes")
         {
             SECTION("loopback")
@@ -341,6 +406,29 @@ TEST_CASE("Flooding", "[flood][overlay]")
                 test(injectSCP, ackedSCP);
             }
         }
+
+        SECTION("compact")
+        {
+            auto compactCfgGen = [&](int cfgNum) {
+                Config cfg = cfgGen(cfgNum);
+                cfg.COMPACT_SCP_MESSAGES = true;
+                return cfg;
+            };
+            simulation = Topologies::core(4, .666f, Simulation::OVER_TCP,
+                                          networkID, compactCfgGen,
+                                          quorumAdjuster);
+            test(injectSCP, ackedSCP);
+            for (auto n : nodes)
+            {
+                auto& m = n->getMetrics();
+                REQUIRE(m.NewMeter({"overlay", "send", "scp-message-compact"},
+                                   "message")
+                            .count() > 0);
+                REQUIRE(m.NewMeter({"overlay", "send", "scp-message"},
+                                   "message")
+                            .count() == 0);
+            }
+        }
     }
 }
 }
@@ -7,7 +7,9 @@
 #include "crypto/SHA.h"
 #include "herder/Herder.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "medida/counter.h"
+#include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "overlay/OverlayManager.h"
 #include "util/Logging.h"
@@ -16,103 +18,439 @@
 
 namespace stellar
 {
-Floodgate::FloodRecord::FloodRecord(StellarMessage const& msg, uint32_t ledger,
-                                    Peer::pointer peer)
-    : mLedgerSeq(ledger), mMessage(msg)
+
+std::chrono::milliseconds const Floodgate::FLOOD_DEMAND_TIMEOUT{1000};
+
+bool
+Floodgate::FloodRecord::told(size_t slot) const
+{
+    auto word = slot / 64;
+    return word < mPeersTold.size() &&
+           (mPeersTold[word] & (uint64_t(1) << (slot % 64))) != 0;
+}
+
+void
+Floodgate::FloodRecord::setTold(size_t slot)
+{
+    auto word = slot / 64;
+    if (word >= mPeersTold.size())
+    {
+        mPeersTold.resize(word + 1);
+    }
+    mPeersTold[word] |= uint64_t(1) << (slot % 64);
+}
+
+void
+Floodgate::FloodRecord::clearTold(size_t slot)
 {
-    if (peer)
-        mPeersTold.insert(peer);
+    auto word = slot / 64;
+    if (word < mPeersTold.size())
+    {
+        mPeersTold[word] &= ~(uint64_t(1) << (slot % 64));
+    }
 }
 
 Floodgate::Floodgate(Application& app)
-    : mApp(app)
+    : mDemandTimer(app)
+    , mMaxBytes(app.getConfig().FLOOD_MAP_MAX_BYTES)
+    , mApp(app)
     , mFloodMapSize(
           app.getMetrics().NewCounter({"overlay", "memory", "flood-map"}))
+    , mFloodMapBytes(app.getMetrics().NewCounter(
+          {"overlay", "memory", "flood-map-bytes"}))
+    , mEvicted(
+          app.getMetrics().NewMeter({"overlay", "flood", "evicted"}, "record"))
     , mSendFromBroadcast(app.getMetrics().NewMeter(
           {"overlay", "message", "send-from-broadcast"}, "message"))
+    , mAdvertised(app.getMetrics().NewMeter(
+          {"overlay", "flood", "advertised"}, "transaction"))
+    , mDemanded(app.getMetrics().NewMeter({"overlay", "flood", "demanded"},
+                                          "transaction"))
     , mShuttingDown(false)
 {
 }
 
+Floodgate::FloodRecord&
+Floodgate::newRecord(uint256 const& index)
+{
+    auto ledger = mApp.getHerder().getCurrentLedgerSeq();
+    auto& record = mFloodMap[index];
+    record.mLedgerSeq = ledger;
+    record.mPeersTold.clear();
+    record.mMessage.reset();
+    record.mMessageBytes = 0;
+    mGenerations[ledger].push_back(index);
+
+    // the peers that advertised it have it
+    auto demand = mDemands.find(index);
+    if (demand != mDemands.end())
+    {
+        for (auto const& p : demand->second.mAdvertisers)
+        {
+            if (auto peer = p.lock())
+            {
+                record.setTold(slotFor(peer));
+            }
+        }
+        mDemands.erase(demand);
+    }
+    updateBytes(record);
+    return record;
+}
+
+size_t
+Floodgate::recordBytes(FloodRecord const& record)
+{
+    return FLOOD_RECORD_OVERHEAD +
+           record.mPeersTold.size() * sizeof(record.mPeersTold[0]) +
+           record.mMessageBytes;
+}
+
+void
+Floodgate::updateBytes(FloodRecord& record)
+{
+    auto bytes = recordBytes(record);
+    mBytes = mBytes - record.mBytes + bytes;
+    record.mBytes = bytes;
+}
+
+void
+Floodgate::eraseRecord(std::unordered_map<uint256, FloodRecord>::iterator it)
+{
+    mBytes -= it->second.mBytes;
+    mFloodMap.erase(it);
+}
+
+void
+Floodgate::evict()
+{
+    while (mMaxBytes != 0 && mBytes > mMaxBytes && !mGenerations.empty())
+    {
+        auto generation = mGenerations.begin();
+        if (generation->second.empty())
+        {
+            mGenerations.erase(generation);
+            continue;
+        }
+        auto it = mFloodMap.find(generation->second.front());
+        generation->second.pop_front();
+        // records broadcast again since then moved to a later generation
+        if (it != mFloodMap.end() && it->second.mLedgerSeq == generation->first)
+        {
+            eraseRecord(it);
+            mEvicted.Mark();
+        }
+    }
+    updateSizeCounters();
+}
+
+void
+Floodgate::updateSizeCounters()
+{
+    mFloodMapSize.set_count(mFloodMap.size());
+    mFloodMapBytes.set_count(mBytes);
+}
+
+// Returns the slot of `peer`, giving it one if needed. Slots of peers that
+// are gone are handed out again, after clearing their bit in every record
+// so that the new peer does not inherit what the old one was told; that
+// costs a pass over the records, but only when peers churn.
+size_t
+Floodgate::slotFor(Peer::pointer const& peer)
+{
+    auto it = mSlotOfPeer.find(peer.get());
+    if (it != mSlotOfPeer.end())
+    {
+        if (mPeerSlots[it->second].mPeer.lock() == peer)
+        {
+            return it->second;
+        }
+        // a new peer at the address of one that is gone
+        releaseSlot(it->second);
+    }
+
+    size_t slot = 0;
+    for (; slot < mPeerSlots.size(); ++slot)
+    {
+        if (mPeerSlots[slot].mPeer.expired())
+        {
+            releaseSlot(slot);
+            break;
+        }
+    }
+    if (slot == mPeerSlots.size())
+    {
+        mPeerSlots.emplace_back();
+    }
+    mPeerSlots[slot] = PeerSlot{peer, peer.get()};
+    mSlotOfPeer[peer.get()] = slot;
+    return slot;
+}
+
+void
+Floodgate::releaseSlot(size_t slot)
+{
+    auto& s = mPeerSlots[slot];
+    auto it = mSlotOfPeer.find(s.mAddress);
+    if (it != mSlotOfPeer.end() && it->second == slot)
+    {
+        mSlotOfPeer.erase(it);
+    }
+    s = PeerSlot{};
+    for (auto& r : mFloodMap)
+    {
+        r.second.clearTold(slot);
+    }
+}
+
 // remove old flood records
 void
 Floodgate::clearBelow(uint32_t currentLedger)
 {
-    for (auto it = mFloodMap.cbegin(); it != mFloodMap.cend();)
+    // give one ledger of leeway
+    while (!mGenerations.empty() &&
+           mGenerations.begin()->first + 10 < currentLedger)
     {
-        // give one ledger of leeway
-        if (it->second->mLedgerSeq + 10 < currentLedger)
+        auto const& generation = *mGenerations.begin();
+        for (auto const& index : generation.second)
         {
-            mFloodMap.erase(it++);
+            // records broadcast again since then moved to a later generation
+            auto it = mFloodMap.find(index);
+            if (it != mFloodMap.end() &&
+                it->second.mLedgerSeq == generation.first)
+            {
+                eraseRecord(it);
+            }
+        }
+        mGenerations.erase(mGenerations.begin());
+    }
+    for (auto it = mDemands.begin(); it != mDemands.end();)
+    {
+        if (it->second.mLedgerSeq + 10 < currentLedger)
+        {
+            it = mDemands.erase(it);
         }
         else
         {
             ++it;
         }
     }
-    mFloodMapSize.set_count(mFloodMap.size());
+    updateSizeCounters();
 }
 
 bool
 Floodgate::addRecord(StellarMessage const& msg, Peer::pointer peer)
+{
+    return addRecord(xdr::xdr_to_opaque(msg), peer);
+}
+
+bool
+Floodgate::addRecord(ByteSlice const& msgBytes, Peer::pointer peer)
 {
     if (mShuttingDown)
     {
         return false;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    Hash index = sha256(msgBytes);
     auto result = mFloodMap.find(index);
     if (result == mFloodMap.end())
     { // we have never seen this message
-        mFloodMap[index] = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), peer);
-        mFloodMapSize.set_count(mFloodMap.size());
+        auto& record = newRecord(index);
+        if (peer)
+        {
+            record.setTold(slotFor(peer));
+            updateBytes(record);
+        }
+        evict();
         return true;
     }
     else
     {
-        result->second->mPeersTold.insert(peer);
+        if (peer)
+        {
+            result->second.setTold(slotFor(peer));
+            updateBytes(result->second);
+        }
         return false;
     }
 }
 
 // send message to anyone you haven't gotten it from
-void
-Floodgate::broadcast(StellarMessage const& msg, bool force)
+size_t
+Floodgate::broadcast(StellarMessage const& msg, ByteSlice const& msgBytes,
+                     bool force)
 {
     if (mShuttingDown)
     {
-        return;
+        return 0;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    // the same bytes for the hash and for every peer
+    Hash index = sha256(msgBytes);
     CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index);
 
     auto result = mFloodMap.find(index);
+    FloodRecord* record;
     if (result == mFloodMap.end() || force)
     { // no one has sent us this message
-        FloodRecord::pointer record = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), Peer::pointer());
-        result = mFloodMap.insert(std::make_pair(index, record)).first;
-        mFloodMapSize.set_count(mFloodMap.size());
+        record = &newRecord(index);
+    }
+    else
+    {
+        record = &result->second;
     }
-    // send it to people that haven't sent it to us
-    std::set<Peer::pointer>& peersTold = result->second->mPeersTold;
 
     // make a copy, in case peers gets modified
     auto peers = mApp.getOverlayManager().getAuthenticatedPeers();
 
+    size_t told = 0;
     for (auto peer : peers)
     {
         assert(peer.second->isAuthenticated());
-        if (peersTold.find(peer.second) == peersTold.end())
+        auto slot = slotFor(peer.second);
+        if (!record->told(slot))
         {
-            mSendFromBroadcast.Mark();
-            peer.second->sendMessage(msg);
-            peersTold.insert(peer.second);
+            if (msg.type() == TRANSACTION && peer.second->useFloodAdverts())
+            {
+                if (!record->mMessage)
+                {
+                    record->mMessage = std::make_shared<StellarMessage>(msg);
+                    record->mMessageBytes = msgBytes.size();
+                }
+                mAdvertised.Mark();
+                peer.second->queueFloodAdvert(index);
+            }
+            else
+            {
+                mSendFromBroadcast.Mark();
+                peer.second->sendMessage(msg, msgBytes);
+            }
+            record->setTold(slot);
+            told++;
         }
     }
+    updateBytes(*record);
+    evict();
     CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index) << " told "
-                           << peersTold.size();
+                           << told;
+    return told;
+}
+
+void
+Floodgate::recvFloodAdvert(FloodAdvert const& advert, Peer::pointer peer)
+{
+    if (mShuttingDown)
+    {
+        return;
+    }
+    auto now = mApp.getClock().now();
+    auto slot = slotFor(peer);
+    std::vector<Hash> wanted;
+    for (auto const& h : advert.txHashes)
+    {
+        auto record = mFloodMap.find(h);
+        if (record != mFloodMap.end())
+        {
+            // so that we don't advertise it back
+            record->second.setTold(slot);
+            updateBytes(record->second);
+            continue;
+        }
+
+        auto it = mDemands.find(h);
+        if (it == mDemands.end())
+        {
+            it = mDemands
+                     .emplace(h, Demand{mApp.getHerder().getCurrentLedgerSeq(),
+                                        {}, 0, now})
+                     .first;
+            it->second.mAdvertisers.emplace_back(peer);
+            it->second.mAsked = 1;
+            wanted.emplace_back(h);
+        }
+        else
+        {
+            it->second.mAdvertisers.emplace_back(peer);
+        }
+    }
+
+    if (!wanted.empty())
+    {
+        mDemanded.Mark(wanted.size());
+        peer->sendFloodDemand(wanted);
+    }
+    scheduleDemandRetry();
+}
+
+void
+Floodgate::recvFloodDemand(FloodDemand const& demand, Peer::pointer peer)
+{
+    if (mShuttingDown)
+    {
+        return;
+    }
+    for (auto const& h : demand.txHashes)
+    {
+        // only what was advertised can be demanded
+        auto record = mFloodMap.find(h);
+        if (record != mFloodMap.end() && record->second.mMessage)
+        {
+            peer->sendMessage(*record->second.mMessage);
+        }
+    }
+}
+
+void
+Floodgate::scheduleDemandRetry()
+{
+    if (mDemandTimerArmed || mDemands.empty())
+    {
+        return;
+    }
+    mDemandTimerArmed = true;
+    mDemandTimer.expires_from_now(FLOOD_DEMAND_TIMEOUT);
+    mDemandTimer.async_wait(
+        [this]() {
+            mDemandTimerArmed = false;
+            retryDemands();
+        },
+        VirtualTimer::onFailureNoop);
+}
+
+// demand again, from the next advertiser, the transactions that did not
+// arrive in time
+void
+Floodgate::retryDemands()
+{
+    if (mShuttingDown)
+    {
+        return;
+    }
+    auto now = mApp.getClock().now();
+    std::map<Peer::pointer, std::vector<Hash>> wanted;
+    for (auto& d : mDemands)
+    {
+        auto& demand = d.second;
+        if (now - demand.mDemanded < FLOOD_DEMAND_TIMEOUT)
+        {
+            continue;
+        }
+        while (demand.mAsked < demand.mAdvertisers.size())
+        {
+            auto peer = demand.mAdvertisers[demand.mAsked++].lock();
+            if (peer && peer->isAuthenticated())
+            {
+                demand.mDemanded = now;
+                wanted[peer].emplace_back(d.first);
+                break;
+            }
+        }
+    }
+    for (auto const& w : wanted)
+    {
+        mDemanded.Mark(w.second.size());
+        w.first->sendFloodDemand(w.second);
+    }
+    scheduleDemandRetry();
 }
 
 std::set<Peer::pointer>
@@ -122,7 +460,17 @@ Floodgate::getPeersKnows(Hash const& h)
     auto record = mFloodMap.find(h);
     if (record != mFloodMap.end())
     {
-        res = record->second->mPeersTold;
+        for (size_t slot = 0; slot < mPeerSlots.size(); ++slot)
+        {
+            if (record->second.told(slot))
+            {
+                auto peer = mPeerSlots[slot].mPeer.lock();
+                if (peer)
+                {
+                    res.insert(peer);
+                }
+            }
+        }
     }
     return res;
 }
@@ -131,6 +479,24 @@ void
 Floodgate::shutdown()
 {
     mShuttingDown = true;
+    mDemandTimer.cancel();
     mFloodMap.clear();
+    mBytes = 0;
+    mDemands.clear();
+    mGenerations.clear();
+    mPeerSlots.clear();
+    mSlotOfPeer.clear();
+}
+
+size_t
+Floodgate::size() const
+{
+    return mFloodMap.size();
+}
+
+size_t
+Floodgate::getBytes() const
+{
+    return mBytes;
 }
 }
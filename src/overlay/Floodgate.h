@@ -6,7 +6,12 @@
 
 #include "overlay/Peer.h"
 #include "overlay/StellarXDR.h"
+#include "util/HashOfHash.h"
+#include "util/Timer.h"
+#include <deque>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 /**
  * FloodGate keeps track of which peers have sent us which broadcast messages,
@@ -19,6 +24,24 @@
  * All messages are marked with the ledger sequence number to which they
  * relate, and all flood-management information for a given ledger number
  * is purged from the FloodGate when the ledger closes.
+ *
+ * Records are kept in a hash map by message hash, and the hashes added for
+ * each ledger in a per-ledger generation, so that purging a ledger only
+ * visits that ledger's records. Peers are given small integer slots, and a
+ * record only holds a bitset over those slots rather than a set of peers.
+ * A slot is reused once its peer is gone, see slotFor.
+ *
+ * Transactions are pushed whole to the peers that don't use pull mode (see
+ * Peer::useFloodAdverts). The others are sent the hash of the TRANSACTION
+ * message in a batched FLOOD_ADVERT and, if they don't have it, answer with a
+ * FLOOD_DEMAND for it, served from the message kept in the record. A hash
+ * advertised to us is demanded from one advertiser at a time, trying the next
+ * one if the transaction has not arrived after FLOOD_DEMAND_TIMEOUT. SCP
+ * messages are always pushed.
+ *
+ * The memory held by the records is estimated, and kept under
+ * Config::FLOOD_MAP_MAX_BYTES by forgetting the oldest records first, should
+ * ledgers stop closing while messages keep being flooded.
  */
 
 namespace medida
@@ -31,37 +54,100 @@ namespace stellar
 
 class Floodgate
 {
-    class FloodRecord
+    struct FloodRecord
     {
-      public:
-        typedef std::shared_ptr<FloodRecord> pointer;
-
         uint32_t mLedgerSeq;
-        StellarMessage mMessage;
-        std::set<Peer::pointer> mPeersTold;
+        // bit i is set once the peer in slot i sent us, or was sent, the
+        // message
+        std::vector<uint64_t> mPeersTold;
+        // the message, for transactions advertised to some peers
+        std::shared_ptr<StellarMessage const> mMessage;
+        size_t mMessageBytes{0};
+        // as accounted in mBytes, see recordBytes
+        size_t mBytes{0};
 
-        FloodRecord(StellarMessage const& msg, uint32_t ledger,
-                    Peer::pointer peer);
+        bool told(size_t slot) const;
+        void setTold(size_t slot);
+        void clearTold(size_t slot);
     };
 
-    std::map<uint256, FloodRecord::pointer> mFloodMap;
+    struct PeerSlot
+    {
+        std::weak_ptr<Peer> mPeer;
+        // only used as a key into mSlotOfPeer, never dereferenced
+        Peer const* mAddress;
+    };
+
+    // a transaction advertised to us that we don't have yet
+    struct Demand
+    {
+        uint32_t mLedgerSeq;
+        std::vector<std::weak_ptr<Peer>> mAdvertisers;
+        // advertisers demanded from so far
+        size_t mAsked{0};
+        VirtualClock::time_point mDemanded;
+    };
+
+    std::unordered_map<uint256, FloodRecord> mFloodMap;
+    std::unordered_map<uint256, Demand> mDemands;
+    VirtualTimer mDemandTimer;
+    bool mDemandTimerArmed{false};
+    // hashes added for each ledger, oldest first
+    std::map<uint32_t, std::deque<uint256>> mGenerations;
+    size_t mBytes{0};
+    size_t const mMaxBytes;
+    std::vector<PeerSlot> mPeerSlots;
+    std::unordered_map<Peer const*, size_t> mSlotOfPeer;
     Application& mApp;
     medida::Counter& mFloodMapSize;
+    medida::Counter& mFloodMapBytes;
+    medida::Meter& mEvicted;
     medida::Meter& mSendFromBroadcast;
+    medida::Meter& mAdvertised;
+    medida::Meter& mDemanded;
     bool mShuttingDown;
 
+    FloodRecord& newRecord(uint256 const& index);
+    static size_t recordBytes(FloodRecord const& record);
+    // accounts for changes to `record`
+    void updateBytes(FloodRecord& record);
+    void eraseRecord(std::unordered_map<uint256, FloodRecord>::iterator it);
+    // forgets the oldest records until under mMaxBytes
+    void evict();
+    void updateSizeCounters();
+    size_t slotFor(Peer::pointer const& peer);
+    void releaseSlot(size_t slot);
+    void scheduleDemandRetry();
+    void retryDemands();
+
   public:
+    static std::chrono::milliseconds const FLOOD_DEMAND_TIMEOUT;
+    // Rough bookkeeping cost of a record (hash map node, key and fields)
+    // added to what it holds when accounting bytes.
+    static size_t const FLOOD_RECORD_OVERHEAD = 128;
+
     Floodgate(Application& app);
     // Floodgate will be cleared after every ledger close
     void clearBelow(uint32_t currentLedger);
     // returns true if this is a new record
     bool addRecord(StellarMessage const& msg, Peer::pointer fromPeer);
+    // As above, given the XDR of the message.
+    bool addRecord(ByteSlice const& msgBytes, Peer::pointer fromPeer);
+
+    // Returns the number of peers told.
+    size_t broadcast(StellarMessage const& msg, ByteSlice const& msgBytes,
+                     bool force);
 
-    void broadcast(StellarMessage const& msg, bool force);
+    void recvFloodAdvert(FloodAdvert const& advert, Peer::pointer peer);
+    void recvFloodDemand(FloodDemand const& demand, Peer::pointer peer);
 
     // returns the list of peers that sent us the item with hash `h`
     std::set<Peer::pointer> getPeersKnows(Hash const& h);
 
     void shutdown();
+
+    // Number of records and their estimated bytes.
+    size_t size() const;
+    size_t getBytes() const;
 };
 }
@@ -133,6 +133,16 @@ ItemFetcher::doesntHave(Hash const& itemHash, Peer::pointer peer)
     }
 }
 
+void
+ItemFetcher::recvProgress(Hash const& itemHash)
+{
+    const auto& iter = mTrackers.find(itemHash);
+    if (iter != mTrackers.end() && !iter->second->empty())
+    {
+        iter->second->progress();
+    }
+}
+
 void
 ItemFetcher::recv(Hash itemHash)
 {
@@ -157,4 +167,15 @@ ItemFetcher::recv(Hash itemHash)
         tracker->cancel();
     }
 }
+
+size_t
+ItemFetcher::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (auto const& t : mTrackers)
+    {
+        bytes += sizeof(t) + t.second->getMemoryBytes();
+    }
+    return bytes;
+}
 }
@@ -84,6 +84,12 @@ class ItemFetcher : private NonMovableOrCopyable
      */
     void doesntHave(Hash const& itemHash, Peer::pointer peer);
 
+    /**
+     * Called when part of the data identified by @p itemHash was received,
+     * for data sent in several messages.
+     */
+    void recvProgress(Hash const& itemHash);
+
     /**
      * Called when data with given @p itemHash was received. All envelopes
      * added before with @see fetch and the same @p itemHash will be resent
@@ -91,6 +97,12 @@ class ItemFetcher : private NonMovableOrCopyable
      */
     void recv(Hash itemHash);
 
+    /**
+     * Return approximate bytes held by the trackers, mostly the envelopes
+     * they are waiting for.
+     */
+    size_t getMemoryBytes() const;
+
   protected:
     void stopFetchingBelowInternal(uint64 slotIndex);
 
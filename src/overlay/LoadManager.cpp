@@ -4,6 +4,7 @@
 
 #include "overlay/LoadManager.h"
 #include "database/Database.h"
+#include "lib/json/json.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -100,7 +101,8 @@ LoadManager::maybeShedExcessLoad(Application& app)
         auto peers = app.getOverlayManager().getAuthenticatedPeers();
         reportLoads(peers, app);
 
-        // Look for the worst-behaved of the current peers and kick them out.
+        // Look for the worst-behaved of the current peers and kick them out:
+        // the most expensive, least useful one.
         std::shared_ptr<Peer> victim;
         std::shared_ptr<LoadManager::PeerCosts> victimCost;
         for (auto peer : peers)
@@ -135,13 +137,33 @@ LoadManager::PeerCosts::PeerCosts()
     , mBytesSend("byte")
     , mBytesRecv("byte")
     , mSQLQueries("query")
+    , mMessageTime("nanoseconds")
+    , mFlooded("message")
+    , mDuplicates("message")
+    , mThrottled("message")
 {
 }
 
+double
+LoadManager::PeerCosts::getShedScore()
+{
+    double time = mTimeSpent.one_minute_rate() + mMessageTime.one_minute_rate();
+    double flooded = mFlooded.one_minute_rate();
+    double duplicates =
+        flooded > 0 ? mDuplicates.one_minute_rate() / flooded : 0.0;
+    return time * (1.0 + duplicates);
+}
+
 bool
 LoadManager::PeerCosts::isLessThan(
     std::shared_ptr<LoadManager::PeerCosts> other)
 {
+    auto ownScore = getShedScore();
+    auto otherScore = other->getShedScore();
+    if (ownScore != otherScore)
+    {
+        return ownScore < otherScore;
+    }
     double ownRates[4] = {
         mTimeSpent.one_minute_rate(), mBytesSend.one_minute_rate(),
         mBytesRecv.one_minute_rate(), static_cast<double>(mSQLQueries.count())};
@@ -165,6 +187,106 @@ LoadManager::getPeerCosts(NodeID const& node)
     return p;
 }
 
+void
+LoadManager::recordRecv(NodeID const& peer, MessageType type, size_t bytes,
+                        std::chrono::nanoseconds decodeTime)
+{
+    if (!isZero(peer.ed25519()))
+    {
+        auto pc = getPeerCosts(peer);
+        auto& mc = pc->mMessageCosts[type];
+        ++mc.mRecvCount;
+        mc.mBytesRecv += bytes;
+        mc.mDecodeTime += decodeTime;
+        pc->mMessageTime.Mark(decodeTime.count());
+    }
+}
+
+void
+LoadManager::recordHandled(NodeID const& peer, MessageType type,
+                           std::chrono::nanoseconds handlerTime)
+{
+    if (!isZero(peer.ed25519()))
+    {
+        auto pc = getPeerCosts(peer);
+        pc->mMessageCosts[type].mHandlerTime += handlerTime;
+        pc->mMessageTime.Mark(handlerTime.count());
+    }
+}
+
+void
+LoadManager::recordSend(NodeID const& peer, MessageType type, size_t bytes)
+{
+    if (!isZero(peer.ed25519()))
+    {
+        auto& mc = getPeerCosts(peer)->mMessageCosts[type];
+        ++mc.mSendCount;
+        mc.mBytesSend += bytes;
+    }
+}
+
+void
+LoadManager::recordFlooded(NodeID const& peer, MessageType type,
+                           bool duplicate)
+{
+    if (!isZero(peer.ed25519()))
+    {
+        auto pc = getPeerCosts(peer);
+        auto& mc = pc->mMessageCosts[type];
+        ++mc.mFloodCount;
+        pc->mFlooded.Mark();
+        if (duplicate)
+        {
+            ++mc.mDuplicates;
+            pc->mDuplicates.Mark();
+        }
+    }
+}
+
+void
+LoadManager::recordThrottled(NodeID const& peer, MessageType type)
+{
+    if (!isZero(peer.ed25519()))
+    {
+        auto pc = getPeerCosts(peer);
+        ++pc->mMessageCosts[type].mThrottled;
+        pc->mThrottled.Mark();
+    }
+}
+
+Json::Value
+LoadManager::getJsonPeerCosts(NodeID const& peer)
+{
+    Json::Value res;
+    auto pc = getPeerCosts(peer);
+    res["time"] = static_cast<Json::UInt64>(pc->mTimeSpent.count());
+    res["message_time"] = static_cast<Json::UInt64>(pc->mMessageTime.count());
+    res["sql_queries"] = static_cast<Json::UInt64>(pc->mSQLQueries.count());
+    res["shed_score"] = pc->getShedScore();
+    for (auto const& c : pc->mMessageCosts)
+    {
+        auto name = xdr::xdr_traits<MessageType>::enum_name(c.first);
+        auto& t = res["messages"][name ? name : std::to_string(c.first)];
+        auto const& mc = c.second;
+        t["recv"] = static_cast<Json::UInt64>(mc.mRecvCount);
+        t["recv_bytes"] = static_cast<Json::UInt64>(mc.mBytesRecv);
+        t["send"] = static_cast<Json::UInt64>(mc.mSendCount);
+        t["send_bytes"] = static_cast<Json::UInt64>(mc.mBytesSend);
+        t["decode_ns"] = static_cast<Json::UInt64>(mc.mDecodeTime.count());
+        t["handler_ns"] = static_cast<Json::UInt64>(mc.mHandlerTime.count());
+        if (mc.mFloodCount != 0)
+        {
+            t["duplicate_rate"] =
+                static_cast<double>(mc.mDuplicates) / mc.mFloodCount;
+        }
+        if (mc.mThrottled != 0)
+        {
+            t["throttled"] = static_cast<Json::UInt64>(mc.mThrottled);
+        }
+    }
+    return res;
+}
+
 LoadManager::PeerContext::PeerContext(Application& app, NodeID const& node)
     : mApp(app)
     , mNode(node)
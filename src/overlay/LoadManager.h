@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "crypto/SecretKey.h"
+#include "lib/json/json-forwards.h"
 #include "overlay/Peer.h"
 #include "util/HashOfHash.h"
 #include "util/lrucache.hpp"
@@ -16,6 +17,9 @@
 
 #include "util/Timer.h"
 
+#include <chrono>
+#include <map>
+
 namespace stellar
 {
 
@@ -46,16 +50,56 @@ class LoadManager
     // should we have ongoing churn in low-cost peers.
     struct PeerCosts
     {
+        // Cumulative costs of the messages of one type.
+        struct MessageCosts
+        {
+            uint64_t mRecvCount{0};
+            uint64_t mBytesRecv{0};
+            uint64_t mSendCount{0};
+            uint64_t mBytesSend{0};
+            std::chrono::nanoseconds mDecodeTime{0};
+            std::chrono::nanoseconds mHandlerTime{0};
+            // flooded messages we already had
+            uint64_t mFloodCount{0};
+            uint64_t mDuplicates{0};
+            // messages deferred or dropped by rate limits (see TxAdmission)
+            uint64_t mThrottled{0};
+        };
+
         PeerCosts();
         bool isLessThan(std::shared_ptr<PeerCosts> other);
+
+        // Rate of time spent on the peer, weighted up by the fraction of its
+        // flooded messages that were duplicates: higher is a better
+        // candidate for load shedding.
+        double getShedScore();
+
         medida::Meter mTimeSpent;
         medida::Meter mBytesSend;
         medida::Meter mBytesRecv;
         medida::Meter mSQLQueries;
+        // decode and handler time of received messages
+        medida::Meter mMessageTime;
+        medida::Meter mFlooded;
+        medida::Meter mDuplicates;
+        medida::Meter mThrottled;
+        std::map<MessageType, MessageCosts> mMessageCosts;
     };
 
     std::shared_ptr<PeerCosts> getPeerCosts(NodeID const& peer);
 
+    // Per message type accounting, ignored for peers not yet authenticated
+    // (zero ids), like PeerContext.
+    void recordRecv(NodeID const& peer, MessageType type, size_t bytes,
+                    std::chrono::nanoseconds decodeTime);
+    void recordHandled(NodeID const& peer, MessageType type,
+                       std::chrono::nanoseconds handlerTime);
+    void recordSend(NodeID const& peer, MessageType type, size_t bytes);
+    void recordFlooded(NodeID const& peer, MessageType type, bool duplicate);
+    void recordThrottled(NodeID const& peer, MessageType type);
+
+    Json::Value getJsonPeerCosts(NodeID const& peer);
+
   private:
     cache::lru_cache<NodeID, std::shared_ptr<PeerCosts>> mPeerCosts;
 
@@ -2,6 +2,8 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "lib/json/json.h"
+#include "overlay/LoadManager.h"
 #include "overlay/LoopbackPeer.h"
 #include "overlay/OverlayManager.h"
 #include "test/TestUtils.h"
@@ -54,3 +56,38 @@ TEST_CASE("disconnect peer when overloaded", "[overlay][LoadManager]")
                 .NewMeter({"overlay", "drop", "load-shed"}, "drop")
                 .count() != 0);
 }
+
+TEST_CASE("per message type peer costs", "[overlay][LoadManager]")
+{
+    LoadManager lm;
+    auto peer = SecretKey::random().getPublicKey();
+
+    lm.recordRecv(peer, TRANSACTION, 100, std::chrono::nanoseconds(10));
+    lm.recordRecv(peer, TRANSACTION, 150, std::chrono::nanoseconds(20));
+    lm.recordHandled(peer, TRANSACTION, std::chrono::nanoseconds(30));
+    lm.recordFlooded(peer, TRANSACTION, false);
+    lm.recordFlooded(peer, TRANSACTION, true);
+    lm.recordSend(peer, SCP_MESSAGE, 40);
+
+    auto const& costs = lm.getPeerCosts(peer)->mMessageCosts;
+    REQUIRE(costs.size() == 2);
+    auto const& tx = costs.at(TRANSACTION);
+    REQUIRE(tx.mRecvCount == 2);
+    REQUIRE(tx.mBytesRecv == 250);
+    REQUIRE(tx.mDecodeTime == std::chrono::nanoseconds(30));
+    REQUIRE(tx.mHandlerTime == std::chrono::nanoseconds(30));
+    REQUIRE(tx.mDuplicates == 1);
+    REQUIRE(costs.at(SCP_MESSAGE).mBytesSend == 40);
+    REQUIRE(lm.getPeerCosts(peer)->mMessageTime.count() == 60);
+
+    auto json = lm.getJsonPeerCosts(peer);
+    REQUIRE(json["messages"]["TRANSACTION"]["recv_bytes"].asUInt64() == 250);
+    REQUIRE(json["messages"]["TRANSACTION"]["duplicate_rate"].asDouble() ==
+            0.5);
+    REQUIRE(!json["messages"]["SCP_MESSAGE"].isMember("duplicate_rate"));
+
+    // not yet authenticated
+    NodeID zero;
+    lm.recordRecv(zero, HELLO, 100, std::chrono::nanoseconds(10));
+    REQUIRE(lm.getPeerCosts(zero)->mMessageCosts.empty());
+}
@@ -53,7 +53,7 @@ LoopbackPeer::getAuthCert()
 }
 
 void
-LoopbackPeer::sendMessage(xdr::msg_ptr&& msg)
+LoopbackPeer::sendMessage(MessageBufferPtr&& msg)
 {
     if (mRemote.expired())
     {
@@ -97,7 +97,7 @@ LoopbackPeer::drop(bool)
 }
 
 static bool
-damageMessage(default_random_engine& gen, xdr::msg_ptr& msg)
+damageMessage(default_random_engine& gen, MessageBufferPtr& msg)
 {
     size_t bitsFlipped = 0;
     char* d = msg->raw_data();
@@ -119,10 +119,10 @@ damageMessage(default_random_engine& gen, xdr::msg_ptr& msg)
     return bitsFlipped != 0;
 }
 
-static xdr::msg_ptr
-duplicateMessage(xdr::msg_ptr const& msg)
+static MessageBufferPtr
+duplicateMessage(MessageBufferPool& pool, MessageBufferPtr const& msg)
 {
-    xdr::msg_ptr msg2 = xdr::message_t::alloc(msg->size());
+    auto msg2 = pool.acquire(msg->size());
     memcpy(msg2->raw_data(), msg->raw_data(), msg->raw_size());
     return msg2;
 }
@@ -130,20 +130,37 @@ duplicateMessage(xdr::msg_ptr const& msg)
 void
 LoopbackPeer::processInQueue()
 {
-    if (!mInQueue.empty() && mState != CLOSING)
+    if (mState == CLOSING || mHelloPending)
     {
-        auto const& m = mInQueue.front();
-        receivedBytes(m->size(), true);
-        recvMessage(m);
-        mInQueue.pop();
-
-        if (!mInQueue.empty())
+        return;
+    }
+    MessageBufferPtr m;
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(mInQueueMutex);
+        if (mInQueue.empty())
         {
-            auto self = static_pointer_cast<LoopbackPeer>(shared_from_this());
-            mApp.getClock().getIOService().post(
-                [self]() { self->processInQueue(); });
+            return;
         }
+        m = std::move(mInQueue.front());
+        mInQueue.pop();
+        more = !mInQueue.empty();
     }
+    receivedBytes(m->size(), true);
+    recvMessage(m);
+
+    if (more)
+    {
+        auto self = static_pointer_cast<LoopbackPeer>(shared_from_this());
+        mApp.getClock().getIOService().post(
+            [self]() { self->processInQueue(); });
+    }
+}
+
+void
+LoopbackPeer::resumeRecv()
+{
+    processInQueue();
 }
 
 void
@@ -157,7 +174,7 @@ LoopbackPeer::deliverOne()
 
     if (!mOutQueue.empty() && !mCorked)
     {
-        xdr::msg_ptr msg = std::move(mOutQueue.front());
+        auto msg = std::move(mOutQueue.front());
         mOutQueue.pop_front();
 
         // CLOG(TRACE, "Overlay") << "LoopbackPeer dequeued message";
@@ -166,7 +183,8 @@ LoopbackPeer::deliverOne()
         if (mDuplicateProb(mGenerator))
         {
             CLOG(INFO, "Overlay") << "LoopbackPeer duplicated message";
-            mOutQueue.emplace_front(duplicateMessage(msg));
+            mOutQueue.emplace_front(duplicateMessage(
+                mApp.getOverlayManager().getMessageBufferPool(), msg));
             mStats.messagesDuplicated++;
         }
 
@@ -205,7 +223,10 @@ LoopbackPeer::deliverOne()
         if (remote)
         {
             // move msg to remote's in queue
-            remote->mInQueue.emplace(std::move(msg));
+            {
+                std::lock_guard<std::mutex> lock(remote->mInQueueMutex);
+                remote->mInQueue.emplace(std::move(msg));
+            }
             remote->getApp().getClock().getIOService().post(
                 [remote]() { remote->processInQueue(); });
         }
@@ -6,6 +6,7 @@
 
 #include "overlay/Peer.h"
 #include <deque>
+#include <mutex>
 #include <random>
 
 /*
@@ -25,8 +26,11 @@ class LoopbackPeer : public Peer
 {
   private:
     std::weak_ptr<LoopbackPeer> mRemote;
-    std::deque<xdr::msg_ptr> mOutQueue; // sending queue
-    std::queue<xdr::msg_ptr> mInQueue;  // receiving queue
+    std::deque<MessageBufferPtr> mOutQueue; // sending queue
+    std::queue<MessageBufferPtr> mInQueue;  // receiving queue
+    // the remote peer may run on another thread, see
+    // Simulation::OVER_LOOPBACK_THREADED
+    std::mutex mInQueueMutex;
 
     bool mCorked{false};
     size_t mMaxQueueDepth{0};
@@ -52,11 +56,12 @@ class LoopbackPeer : public Peer
 
     Stats mStats;
 
-    void sendMessage(xdr::msg_ptr&& xdrBytes) override;
+    void sendMessage(MessageBufferPtr&& xdrBytes) override;
     PeerBareAddress makeAddress(int remoteListeningPort) const override;
     AuthCert getAuthCert() override;
 
     void processInQueue();
+    void resumeRecv() override;
 
   public:
     virtual ~LoopbackPeer()
@@ -72,7 +77,7 @@ class LoopbackPeer : public Peer
     size_t getMessagesQueued() const;
 
     Stats const& getStats() const;
-    std::deque<xdr::msg_ptr>& getQueue();
+    std::deque<MessageBufferPtr>& getQueue();
     std::shared_ptr<LoopbackPeer> const& getTarget() const;
 
     bool getCorked() const;
@@ -0,0 +1,147 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/MessageBufferPool.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace stellar
+{
+
+namespace
+{
+// size class of a buffer of `rawSize` bytes, SIZE_CLASSES if none fits it
+size_t
+sizeClass(size_t rawSize)
+{
+    size_t c = 0;
+    while (c < MessageBufferPool::SIZE_CLASSES &&
+           (MessageBufferPool::MIN_BUFFER_SIZE << c) < rawSize)
+    {
+        ++c;
+    }
+    return c;
+}
+}
+
+struct MessageBufferPoolState
+{
+    std::mutex mMutex;
+    std::array<std::vector<std::unique_ptr<MessageBuffer>>,
+               MessageBufferPool::SIZE_CLASSES>
+        mFree;
+    medida::Meter& mHits;
+    medida::Meter& mMisses;
+
+    explicit MessageBufferPoolState(medida::MetricsRegistry& metrics)
+        : mHits(metrics.NewMeter({"overlay", "buffer-pool", "hit"}, "buffer"))
+        , mMisses(
+              metrics.NewMeter({"overlay", "buffer-pool", "miss"}, "buffer"))
+    {
+    }
+
+    void
+    release(MessageBuffer* buf)
+    {
+        std::unique_ptr<MessageBuffer> owned(buf);
+        auto c = sizeClass(buf->mCapacity + 4);
+        assert(c < MessageBufferPool::SIZE_CLASSES);
+        size_t maxFree = MessageBufferPool::MAX_FREE_BYTES /
+                         (MessageBufferPool::MIN_BUFFER_SIZE << c);
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mFree[c].size() < maxFree)
+        {
+            mFree[c].emplace_back(std::move(owned));
+        }
+    }
+};
+
+MessageBuffer::MessageBuffer(size_t capacity)
+    : mBytes(new char[capacity + 4]), mCapacity(capacity)
+{
+}
+
+void
+MessageBufferRecycler::operator()(MessageBuffer* buf) const
+{
+    // the buffer may hold the last reference to its pool
+    auto pool = std::move(buf->mPool);
+    if (pool)
+    {
+        pool->release(buf);
+    }
+    else
+    {
+        delete buf;
+    }
+}
+
+MessageBufferPool::MessageBufferPool(medida::MetricsRegistry& metrics)
+    : mState(std::make_shared<MessageBufferPoolState>(metrics))
+{
+}
+
+MessageBufferPtr
+MessageBufferPool::acquire(size_t size)
+{
+    assert(size < 0x80000000);
+    auto c = sizeClass(size + 4);
+    MessageBufferPtr res;
+    if (c < SIZE_CLASSES)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mState->mMutex);
+            auto& free = mState->mFree[c];
+            if (!free.empty())
+            {
+                res.reset(free.back().release());
+                free.pop_back();
+            }
+        }
+        if (res)
+        {
+            mState->mHits.Mark();
+        }
+        else
+        {
+            mState->mMisses.Mark();
+            res.reset(new MessageBuffer((MIN_BUFFER_SIZE << c) - 4));
+        }
+        res->mPool = mState;
+    }
+    else
+    {
+        res.reset(new MessageBuffer(size));
+    }
+
+    res->mSize = size;
+    // the last fragment bit, then the size, as xdr::message_t does
+    uint32_t mark = static_cast<uint32_t>(size) | 0x80000000;
+    auto p = reinterpret_cast<uint8_t*>(res->raw_data());
+    for (size_t i = 0; i < 4; ++i)
+    {
+        p[i] = static_cast<uint8_t>(mark >> (24 - 8 * i));
+    }
+    return res;
+}
+
+size_t
+MessageBufferPool::freeBuffers(size_t size) const
+{
+    auto c = sizeClass(size + 4);
+    if (c == SIZE_CLASSES)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(mState->mMutex);
+    return mState->mFree[c].size();
+}
+}
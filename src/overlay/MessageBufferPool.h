@@ -0,0 +1,120 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace medida
+{
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+struct MessageBufferPoolState;
+
+/**
+ * A message buffer from a MessageBufferPool, laid out like an xdr::message_t:
+ * a 4 byte XDR record mark, then the message itself.
+ */
+class MessageBuffer : NonMovableOrCopyable
+{
+    friend class MessageBufferPool;
+    friend struct MessageBufferRecycler;
+    friend struct MessageBufferPoolState;
+
+    std::unique_ptr<char[]> mBytes;
+    // of the message, past the record mark
+    size_t const mCapacity;
+    size_t mSize{0};
+    // while handed out, the pool it goes back to, if any
+    std::shared_ptr<MessageBufferPoolState> mPool;
+
+    explicit MessageBuffer(size_t capacity);
+
+  public:
+    char*
+    data()
+    {
+        return mBytes.get() + 4;
+    }
+    char const*
+    data() const
+    {
+        return mBytes.get() + 4;
+    }
+    char*
+    end()
+    {
+        return data() + mSize;
+    }
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+
+    // with the record mark
+    char*
+    raw_data()
+    {
+        return mBytes.get();
+    }
+    char const*
+    raw_data() const
+    {
+        return mBytes.get();
+    }
+    size_t
+    raw_size() const
+    {
+        return mSize + 4;
+    }
+};
+
+struct MessageBufferRecycler
+{
+    void operator()(MessageBuffer* buf) const;
+};
+
+typedef std::unique_ptr<MessageBuffer, MessageBufferRecycler> MessageBufferPtr;
+
+/**
+ * MessageBufferPool recycles the buffers of the messages peers send and
+ * receive, so that sending or receiving a message does not allocate once the
+ * pool has warmed up. Buffers are kept by size class, powers of two from
+ * MIN_BUFFER_SIZE, at most MAX_FREE_BYTES of each; larger messages get a
+ * buffer of their own.
+ *
+ * A buffer goes back to the pool when its MessageBufferPtr is destroyed,
+ * which may happen on any thread (TCPPeer releases the buffers it wrote on
+ * the overlay thread), and after the pool itself is gone. Copies of a pool
+ * share its buffers.
+ */
+class MessageBufferPool
+{
+  public:
+    static size_t const MIN_BUFFER_SIZE = 256;
+    static size_t const SIZE_CLASSES = 10;
+    static size_t const MAX_FREE_BYTES = 1024 * 1024;
+
+  private:
+    std::shared_ptr<MessageBufferPoolState> mState;
+
+  public:
+    explicit MessageBufferPool(medida::MetricsRegistry& metrics);
+
+    // A buffer for a message of `size` bytes, whose record mark is set.
+    // Counts a hit or a miss, for messages that fit a size class.
+    MessageBufferPtr acquire(size_t size);
+
+    // Number of free buffers in the size class of a `size` bytes message.
+    size_t freeBuffers(size_t size) const;
+};
+}
@@ -0,0 +1,62 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "overlay/MessageBufferPool.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+using namespace stellar;
+
+TEST_CASE("message buffer pool recycles buffers", "[overlay][bufferpool]")
+{
+    medida::MetricsRegistry metrics;
+    MessageBufferPool pool(metrics);
+    auto& hits = metrics.NewMeter({"overlay", "buffer-pool", "hit"}, "buffer");
+    auto& misses =
+        metrics.NewMeter({"overlay", "buffer-pool", "miss"}, "buffer");
+
+    auto buf = pool.acquire(100);
+    REQUIRE(buf->size() == 100);
+    REQUIRE(buf->raw_size() == 104);
+    REQUIRE(misses.count() == 1);
+    auto raw = buf->raw_data();
+    buf.reset();
+    REQUIRE(pool.freeBuffers(100) == 1);
+
+    SECTION("same size class")
+    {
+        auto again = pool.acquire(200);
+        REQUIRE(again->raw_data() == raw);
+        REQUIRE(again->size() == 200);
+        REQUIRE(hits.count() == 1);
+        REQUIRE(pool.freeBuffers(100) == 0);
+    }
+
+    SECTION("other size class")
+    {
+        auto larger = pool.acquire(MessageBufferPool::MIN_BUFFER_SIZE);
+        REQUIRE(larger->raw_data() != raw);
+        REQUIRE(misses.count() == 2);
+        REQUIRE(pool.freeBuffers(100) == 1);
+    }
+
+    SECTION("messages larger than the size classes")
+    {
+        size_t size = MessageBufferPool::MIN_BUFFER_SIZE
+                      << MessageBufferPool::SIZE_CLASSES;
+        pool.acquire(size).reset();
+        REQUIRE(pool.freeBuffers(size) == 0);
+        REQUIRE(hits.count() + misses.count() == 1);
+    }
+
+    SECTION("buffers outlive their pool")
+    {
+        auto kept = pool.acquire(100);
+        pool = MessageBufferPool(metrics);
+        kept.reset();
+        REQUIRE(pool.freeBuffers(100) == 0);
+    }
+}
@@ -0,0 +1,50 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/MessageCapture.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+namespace stellar
+{
+
+MessageCapture::MessageCapture(Application& app, std::string const& filename)
+    : mApp(app)
+    , mStart(app.getClock().now())
+    , mCaptured(
+          app.getMetrics().NewMeter({"overlay", "capture", "write"}, "message"))
+{
+    mOut.open(filename, true);
+    CLOG(INFO, "Overlay") << "Capturing the messages received to " << filename;
+}
+
+void
+MessageCapture::capture(NodeID const& peerID, StellarMessage const& msg)
+{
+    switch (msg.type())
+    {
+    case HELLO:
+    case AUTH:
+    case ERROR_MSG:
+    // captured once decompressed
+    case COMPRESSED:
+        return;
+    default:
+        break;
+    }
+
+    CapturedMessage captured;
+    captured.timeOffset = static_cast<uint64>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            mApp.getClock().now() - mStart)
+            .count());
+    captured.peerID = peerID;
+    captured.message = msg;
+    mOut.writeOne(captured);
+    mCaptured.Mark();
+}
+}
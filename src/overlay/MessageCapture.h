@@ -0,0 +1,45 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+#include "util/XDRStream.h"
+
+#include <string>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Writes the messages received from authenticated peers to a file, as
+ * CapturedMessages: the time since the capture started, the peer and the
+ * message, decompressed. Set up by OverlayManager when
+ * Config::OVERLAY_CAPTURE_FILE is, to replay the traffic of a node later
+ * with --replay-overlay (see OverlayReplay). Handshake messages are left
+ * out, as they are only valid on their own connection.
+ */
+class MessageCapture : NonMovableOrCopyable
+{
+    Application& mApp;
+    XDROutputFileStream mOut;
+    VirtualClock::time_point const mStart;
+    medida::Meter& mCaptured;
+
+  public:
+    // Appends to `filename` if it exists.
+    MessageCapture(Application& app, std::string const& filename);
+
+    void capture(NodeID const& peerID, StellarMessage const& msg);
+};
+}
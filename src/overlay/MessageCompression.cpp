@@ -0,0 +1,143 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/MessageCompression.h"
+#include "overlay/TCPPeer.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace stellar
+{
+
+namespace
+{
+// the fastest level of either format: messages are compressed on the way
+// out, and most of what there is to gain is repetition across messages
+int const MESSAGE_COMPRESSION_LEVEL = 1;
+
+// union discriminant (4 bytes) and sequence (8) before the message, mac (32)
+// after it, see Peer::encodeAuthenticatedMessage
+size_t const HEADER_SIZE = 4 + 8;
+size_t const MAC_SIZE = HmacSha256Mac().mac.size();
+}
+
+MessageCompressor::MessageCompressor(CompressionFormat fmt, size_t minBytes,
+                                     medida::MetricsRegistry& metrics)
+    : mMinBytes(minBytes)
+    , mRawBytes(metrics.NewMeter({"overlay", "compression", "raw"}, "byte"))
+    , mCompressedBytes(
+          metrics.NewMeter({"overlay", "compression", "compressed"}, "byte"))
+{
+    mCodec = StreamCodec::makeCompressor(
+        fmt,
+        [this](char const* data, size_t size) {
+            mOut.insert(mOut.end(), data, data + size);
+        },
+        MESSAGE_COMPRESSION_LEVEL);
+}
+
+bool
+MessageCompressor::compress(MessageBufferPtr& xdrBytes, MessageType type,
+                            MessageBufferPool& pool)
+{
+    // handshake messages are decoded before the peer knows what to
+    // decompress with
+    if (type == HELLO || type == AUTH || type == ERROR_MSG)
+    {
+        return false;
+    }
+    auto msgSize = xdrBytes->size() - HEADER_SIZE - MAC_SIZE;
+    if (msgSize < mMinBytes)
+    {
+        return false;
+    }
+
+    mOut.clear();
+    mCodec->write(xdrBytes->data() + HEADER_SIZE, msgSize);
+    mCodec->flush();
+
+    // the type (4 bytes), the length of the opaque (4) and its padded bytes
+    auto padded = (mOut.size() + 3) & ~size_t(3);
+    auto res = pool.acquire(HEADER_SIZE + 8 + padded + MAC_SIZE);
+    auto p = reinterpret_cast<uint8_t*>(res->data());
+    std::fill(p, p + res->size(), uint8_t(0));
+    auto putUint32 = [](uint8_t* q, uint32_t v) {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            q[i] = static_cast<uint8_t>(v >> (24 - 8 * i));
+        }
+    };
+    putUint32(p + HEADER_SIZE, COMPRESSED);
+    putUint32(p + HEADER_SIZE + 4, static_cast<uint32_t>(mOut.size()));
+    std::copy(mOut.begin(), mOut.end(), p + HEADER_SIZE + 8);
+
+    mRawBytes.Mark(msgSize);
+    mCompressedBytes.Mark(res->size() - HEADER_SIZE - MAC_SIZE);
+    xdrBytes = std::move(res);
+    return true;
+}
+
+MessageDecompressor::MessageDecompressor(CompressionFormat fmt)
+{
+    mCodec = StreamCodec::makeDecompressor(
+        fmt, [this](char const* data, size_t size) {
+            if (mOut.size() + size > MAX_MESSAGE_SIZE)
+            {
+                throw std::runtime_error("compressed message too large");
+            }
+            mOut.insert(mOut.end(), data, data + size);
+        });
+}
+
+std::vector<uint8_t> const&
+MessageDecompressor::decompress(ByteSlice const& compressed,
+                                StellarMessage& msg)
+{
+    mOut.clear();
+    mCodec->write(reinterpret_cast<char const*>(compressed.data()),
+                  compressed.size());
+    xdr::xdr_get g(mOut.data(), mOut.data() + mOut.size());
+    xdr::xdr_argpack_archive(g, msg);
+    g.done();
+    if (msg.type() == COMPRESSED)
+    {
+        throw std::runtime_error("compressed message compressed again");
+    }
+    return mOut;
+}
+
+int
+getCompressionAuthFlags()
+{
+    int flags = AUTH_COMPRESS_GZIP;
+    if (isCompressionFormatSupported(CompressionFormat::ZSTD))
+    {
+        flags |= AUTH_COMPRESS_ZSTD;
+    }
+    return flags;
+}
+
+bool
+chooseCompressionFormat(int localFlags, int remoteFlags,
+                        CompressionFormat& fmt)
+{
+    int shared = localFlags & remoteFlags;
+    if (shared & AUTH_COMPRESS_ZSTD)
+    {
+        fmt = CompressionFormat::ZSTD;
+        return true;
+    }
+    if (shared & AUTH_COMPRESS_GZIP)
+    {
+        fmt = CompressionFormat::GZIP;
+        return true;
+    }
+    return false;
+}
+}
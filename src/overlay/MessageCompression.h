@@ -0,0 +1,80 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+#include "overlay/MessageBufferPool.h"
+#include "overlay/StellarXDR.h"
+#include "util/Compression.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+/**
+ * Compression of the messages sent on a connection, negotiated with the
+ * AUTH messages (see Peer::recvAuth). What is sent each way is one
+ * compressed stream, flushed after every message, so that each message is
+ * compressed against the ones sent before it, which serve as a dictionary:
+ * transactions and transaction sets share most of their structure.
+ *
+ * A message is compressed before it is sealed, the COMPRESSED message taking
+ * its place (and sequence) covered by the MAC. As the stream needs every
+ * message compressed to be decompressed, in order, this is done where the
+ * sequence is assigned. Messages under a threshold, like most SCP messages,
+ * are sent as they are, not to delay them.
+ */
+class MessageCompressor : NonMovableOrCopyable
+{
+    std::unique_ptr<StreamCodec> mCodec;
+    std::vector<uint8_t> mOut;
+    size_t const mMinBytes;
+    medida::Meter& mRawBytes;
+    medida::Meter& mCompressedBytes;
+
+  public:
+    MessageCompressor(CompressionFormat fmt, size_t minBytes,
+                      medida::MetricsRegistry& metrics);
+
+    // If the StellarMessage in `xdrBytes`, laid out as by
+    // Peer::encodeAuthenticatedMessage and not sealed yet, is of `type` to
+    // be compressed and at least the threshold, replace it by a COMPRESSED
+    // one. Returns whether it did.
+    bool compress(MessageBufferPtr& xdrBytes, MessageType type,
+                  MessageBufferPool& pool);
+};
+
+class MessageDecompressor : NonMovableOrCopyable
+{
+    std::unique_ptr<StreamCodec> mCodec;
+    std::vector<uint8_t> mOut;
+
+  public:
+    explicit MessageDecompressor(CompressionFormat fmt);
+
+    // Decompress the contents of a COMPRESSED message into `msg`, throwing
+    // std::runtime_error or xdr::xdr_runtime_error if they are corrupt. The
+    // XDR of `msg` is returned, valid until the next call.
+    std::vector<uint8_t> const& decompress(ByteSlice const& compressed,
+                                           StellarMessage& msg);
+};
+
+// The AuthFlags of the compression formats this build can decompress.
+int getCompressionAuthFlags();
+
+// The format to compress with when both sides of a connection sent these
+// AuthFlags, the fastest they share; false if none.
+bool chooseCompressionFormat(int localFlags, int remoteFlags,
+                             CompressionFormat& fmt);
+}
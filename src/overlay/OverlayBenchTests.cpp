@@ -0,0 +1,310 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHA.h"
+#include "herder/Herder.h"
+#include "herder/HerderImpl.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerDelta.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "overlay/OverlayManager.h"
+#include "simulation/Simulation.h"
+#include "simulation/Topologies.h"
+#include "test/TestAccount.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace stellar
+{
+using namespace txtest;
+
+namespace
+{
+
+// Floods `nbItems` transactions and as many SCP envelopes, each of the
+// latter nominating a transaction set of its own that the other nodes fetch,
+// injected round robin at the nodes of a topology, and logs:
+// - messages/s and bytes/s read by all the nodes together
+// - the mean time Peer::recvMessage spends on each kind of message
+// - the flood latency: how long each node takes to get every item, from the
+//   start of the injection
+class FloodBench
+{
+    Hash mNetworkID;
+    size_t mItems;
+    std::vector<TestAccount> mSources;
+    std::vector<SecretKey> mKeys;
+    SequenceNumber mExpectedSeq{0};
+
+  public:
+    FloodBench(size_t nbItems)
+        : mNetworkID(sha256(getTestConfig().NETWORK_PASSPHRASE))
+        , mItems(nbItems)
+    {
+        for (size_t i = 0; i < mItems; ++i)
+        {
+            mKeys.emplace_back(SecretKey::random());
+        }
+    }
+
+    Hash const&
+    getNetworkID() const
+    {
+        return mNetworkID;
+    }
+
+    Simulation::ConfigGen
+    configGen() const
+    {
+        return [](int cfgNum) {
+            Config cfg = getTestConfig(cfgNum);
+            // no ledger closes in the middle of the flood
+            cfg.ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 10000;
+            return cfg;
+        };
+    }
+
+    // makes the nodes accept the envelopes of mKeys
+    Simulation::QuorumSetAdjuster
+    quorumAdjuster() const
+    {
+        return [this](SCPQuorumSet const& qSet) {
+            auto resQSet = qSet;
+            SCPQuorumSet sub;
+            for (auto const& k : mKeys)
+            {
+                sub.threshold++;
+                sub.validators.emplace_back(k.getPublicKey());
+            }
+            resQSet.threshold++;
+            resQSet.innerSets.emplace_back(sub);
+            return resQSet;
+        };
+    }
+
+    void run(std::string const& name, Simulation::pointer simulation);
+
+  private:
+    void createSources(std::vector<Application::pointer> const& nodes);
+    void inject(Application& app, size_t i);
+    bool received(Application& app);
+};
+
+void
+FloodBench::createSources(std::vector<Application::pointer> const& nodes)
+{
+    // clones of the root account, created directly on every node
+    auto root = TestAccount::createRoot(*nodes[0]);
+    auto rootA =
+        AccountFrame::loadAccount(root.getPublicKey(), nodes[0]->getDatabase());
+    LedgerEntry gen(rootA->mEntry);
+    auto& account = gen.data.account();
+    mSources.clear();
+    for (size_t i = 0; i < mItems; i++)
+    {
+        mSources.emplace_back(TestAccount{*nodes[0], SecretKey::random(), 0});
+        account.accountID = mSources.back();
+        auto newAccount = EntryFrame::FromXDR(gen);
+        for (auto const& n : nodes)
+        {
+            LedgerHeader lh;
+            Database& db = n->getDatabase();
+            LedgerDelta delta(lh, db, false);
+            newAccount->storeAdd(delta, db);
+        }
+    }
+    mExpectedSeq = root.getLastSequenceNumber() + 1;
+}
+
+void
+FloodBench::inject(Application& app, size_t i)
+{
+    auto& herder = app.getHerder();
+    auto account = TestAccount{app, mSources[i]};
+    auto tx = account.tx({createAccount(SecretKey::random().getPublicKey(),
+                                        10000000)},
+                         mExpectedSeq);
+    REQUIRE(herder.recvTransaction(tx) == Herder::TX_STATUS_PENDING);
+    app.getOverlayManager().broadcastMessage(tx->toStellarMessage());
+
+    // a transaction set no other node has, of a transaction of its own
+    auto other = account.tx({createAccount(SecretKey::random().getPublicKey(),
+                                           20000000)},
+                            mExpectedSeq);
+    auto const& lcl = app.getLedgerManager().getLastClosedLedgerHeader();
+    TxSetFrame txSet(lcl.hash);
+    txSet.add(other);
+    txSet.sortForHash();
+
+    SCPQuorumSet qset;
+    qset.threshold = 1;
+    qset.validators.emplace_back(mKeys[i].getPublicKey());
+
+    StellarValue sv(txSet.getContentsHash(),
+                    lcl.header.scpValue.closeTime + 1, emptyUpgradeSteps, 0);
+    SCPEnvelope envelope;
+    auto& st = envelope.statement;
+    st.slotIndex = lcl.header.ledgerSeq + 1;
+    st.pledges.type(SCP_ST_PREPARE);
+    auto& prep = st.pledges.prepare();
+    prep.ballot.value = xdr::xdr_to_opaque(sv);
+    prep.ballot.counter = 1;
+    prep.quorumSetHash = sha256(xdr::xdr_to_opaque(qset));
+    st.nodeID = mKeys[i].getPublicKey();
+    envelope.signature = mKeys[i].sign(
+        xdr::xdr_to_opaque(app.getNetworkID(), ENVELOPE_TYPE_SCP, st));
+    REQUIRE(herder.recvSCPEnvelope(envelope, qset, txSet) ==
+            Herder::ENVELOPE_STATUS_READY);
+}
+
+bool
+FloodBench::received(Application& app)
+{
+    auto& herder = *static_cast<HerderImpl*>(&app.getHerder());
+    for (auto const& s : mSources)
+    {
+        if (herder.getMaxSeqInPendingTxs(s) != mExpectedSeq)
+        {
+            return false;
+        }
+    }
+    auto const& lcl = app.getLedgerManager().getLastClosedLedgerHeader();
+    auto state = herder.getSCP().getCurrentState(lcl.header.ledgerSeq + 1);
+    for (auto const& k : mKeys)
+    {
+        if (std::none_of(state.begin(), state.end(),
+                         [&](SCPEnvelope const& e) {
+                             return e.statement.nodeID == k.getPublicKey();
+                         }))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+FloodBench::run(std::string const& name, Simulation::pointer simulation)
+{
+    simulation->startAllNodes();
+    auto nodes = simulation->getNodes();
+    createSources(nodes);
+    // enough for connections to be made
+    simulation->crankForAtLeast(std::chrono::seconds(1), false);
+
+    std::vector<std::string> kinds = {"transaction", "scp-message", "txset",
+                                      "get-txset"};
+    auto totals = [&]() {
+        // messages and bytes read, then count and sum of each recv timer
+        std::vector<double> res(2 + 2 * kinds.size(), 0);
+        for (auto const& n : nodes)
+        {
+            auto& m = n->getMetrics();
+            res[0] += m.NewMeter({"overlay", "message", "read"}, "message")
+                          .count();
+            res[1] += m.NewMeter({"overlay", "byte", "read"}, "byte").count();
+            for (size_t k = 0; k < kinds.size(); ++k)
+            {
+                auto& timer = m.NewTimer({"overlay", "recv", kinds[k]});
+                res[2 + 2 * k] += timer.count();
+                res[3 + 2 * k] += timer.sum();
+            }
+        }
+        return res;
+    };
+    auto before = totals();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < mItems; ++i)
+    {
+        inject(*nodes[i % nodes.size()], i);
+    }
+
+    // checking every node is not free, so only do it every few milliseconds
+    std::vector<double> latencies(nodes.size(), 0);
+    size_t done = 0;
+    auto nextCheck = start;
+    auto deadline = start + std::chrono::seconds(120);
+    while (done < nodes.size() && std::chrono::steady_clock::now() < deadline)
+    {
+        simulation->crankAllNodes();
+        auto now = std::chrono::steady_clock::now();
+        if (now < nextCheck)
+        {
+            continue;
+        }
+        nextCheck = now + std::chrono::milliseconds(10);
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            if (latencies[i] == 0 && received(*nodes[i]))
+            {
+                latencies[i] = std::chrono::duration<double>(now - start)
+                                   .count();
+                ++done;
+            }
+        }
+    }
+    REQUIRE(done == nodes.size());
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    auto after = totals();
+    std::sort(latencies.begin(), latencies.end());
+
+    LOG(INFO) << "Overlay bench " << name << ", " << nodes.size()
+              << " nodes, " << mItems << " txs and SCP envelopes: "
+              << (after[0] - before[0]) / elapsed.count() << " messages/s, "
+              << (after[1] - before[1]) / elapsed.count() / 1024
+              << " KiB/s, flood latency "
+              << latencies[latencies.size() / 2] << "s median, "
+              << latencies.back() << "s max";
+    for (size_t k = 0; k < kinds.size(); ++k)
+    {
+        auto count = after[2 + 2 * k] - before[2 + 2 * k];
+        auto sum = after[3 + 2 * k] - before[3 + 2 * k];
+        LOG(INFO) << "Overlay bench " << name << " recv " << kinds[k] << ": "
+                  << count << " messages, "
+                  << (count != 0 ? sum / count : 0) << "ms mean";
+    }
+    simulation->stopAllNodes();
+}
+}
+
+TEST_CASE("overlay flood benchmark", "[overlaybench][bench][!hide]")
+{
+    FloodBench bench(500);
+    auto const& networkID = bench.getNetworkID();
+
+    for (auto mode : {Simulation::OVER_LOOPBACK, Simulation::OVER_TCP})
+    {
+        std::string m = mode == Simulation::OVER_TCP ? " tcp" : " loopback";
+        bench.run("core 4" + m,
+                  Topologies::core(4, .666f, mode, networkID,
+                                   bench.configGen(), bench.quorumAdjuster()));
+        bench.run("core 10" + m,
+                  Topologies::core(10, .666f, mode, networkID,
+                                   bench.configGen(), bench.quorumAdjuster()));
+        bench.run("cycle 10" + m,
+                  Topologies::cycle(10, .666f, mode, networkID,
+                                    bench.configGen(),
+                                    bench.quorumAdjuster()));
+        bench.run("hierarchical 5+10" + m,
+                  Topologies::hierarchicalQuorumSimplified(
+                      5, 10, mode, networkID, bench.configGen(), 1,
+                      bench.quorumAdjuster()));
+    }
+}
+}
@@ -23,7 +23,7 @@
  * The `StellarMessage` union contains 3 logically distinct kinds of message:
  *
  *  - Messages directed to or from a specific peer, with or without a response:
- *    HELLO, GET_PEERS, PEERS, DONT_HAVE, ERROR_MSG
+ *    HELLO, GET_PEERS, PEERS, DONT_HAVE, ERROR_MSG, PING, PONG
  *
  *  - One-way broadcast messages informing other peers of an event:
  *    TRANSACTION and SCP_MESSAGE
@@ -50,6 +50,9 @@ class PeerAuth;
 class PeerBareAddress;
 class PeerRecord;
 class LoadManager;
+class MessageBufferPool;
+class TxAdmission;
+class MessageCapture;
 
 class OverlayManager
 {
@@ -65,9 +68,15 @@ class OverlayManager
     virtual void ledgerClosed(uint32_t lastClosedledgerSeq) = 0;
 
     // Send a given message to all peers, via the FloodGate. This is called by
-    // Herder.
-    virtual void broadcastMessage(StellarMessage const& msg,
-                                  bool force = false) = 0;
+    // Herder. Returns the number of peers it was sent (or advertised) to,
+    // those known to have it being skipped.
+    virtual size_t broadcastMessage(StellarMessage const& msg,
+                                    bool force = false) = 0;
+    // As above, `msgBytes` being the XDR of `msg`, for callers that have it
+    // (see TransactionFrame::toStellarMessageBytes).
+    virtual size_t broadcastMessage(StellarMessage const& msg,
+                                    ByteSlice const& msgBytes,
+                                    bool force = false) = 0;
 
     // Make a note in the FloodGate that a given peer has provided us with a
     // given broadcast message, so that it is inhibited from being resent to
@@ -75,6 +84,17 @@ class OverlayManager
     // that, call broadcastMessage, above.
     virtual void recvFloodedMsg(StellarMessage const& msg,
                                 Peer::pointer peer) = 0;
+    virtual void recvFloodedMsg(StellarMessage const& msg,
+                                ByteSlice const& msgBytes,
+                                Peer::pointer peer) = 0;
+
+    // Handle the transaction hashes advertised by `peer`, demanding the ones
+    // we don't have, and the transactions it demands from among those we
+    // advertised to it. See Floodgate.
+    virtual void recvFloodAdvert(FloodAdvert const& advert,
+                                 Peer::pointer peer) = 0;
+    virtual void recvFloodDemand(FloodDemand const& demand,
+                                 Peer::pointer peer) = 0;
 
     // Return a list of random peers from the set of authenticated peers.
     virtual std::vector<Peer::pointer> getRandomAuthenticatedPeers() = 0;
@@ -100,6 +120,15 @@ class OverlayManager
 
     virtual bool isPreferred(Peer* peer) = 0;
 
+    // Note the smoothed round trip time measured to the peer at `address`
+    // (see Peer::recvPong), used to favor nearby peers when connecting out.
+    virtual void recordPeerRTT(PeerBareAddress const& address,
+                               std::chrono::microseconds rtt) = 0;
+
+    // Return the last round trip time noted for `address`, zero if none.
+    virtual std::chrono::microseconds
+    getPeerRTT(PeerBareAddress const& address) const = 0;
+
     // Return the current in-memory set of pending peers.
     virtual std::vector<Peer::pointer> const& getPendingPeers() const = 0;
 
@@ -134,6 +163,16 @@ class OverlayManager
     // Return the persistent peer-load-accounting cache.
     virtual LoadManager& getLoadManager() = 0;
 
+    // Return the pool of the buffers of the messages peers send and receive.
+    virtual MessageBufferPool& getMessageBufferPool() = 0;
+
+    // Return the pacing of the transactions peers flood to us.
+    virtual TxAdmission& getTxAdmission() = 0;
+
+    // Return where received messages are captured, nullptr unless
+    // Config::OVERLAY_CAPTURE_FILE is set.
+    virtual MessageCapture* getMessageCapture() = 0;
+
     // start up all background tasks for overlay
     virtual void start() = 0;
     // drops all connections
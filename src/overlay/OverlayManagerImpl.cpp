@@ -12,6 +12,7 @@
 #include "overlay/PeerRecord.h"
 #include "overlay/TCPPeer.h"
 #include "util/Logging.h"
+#include "util/Profiler.h"
 #include "util/XDROperators.h"
 
 #include "medida/counter.h"
@@ -50,6 +51,8 @@ namespace stellar
 using namespace soci;
 using namespace std;
 
+std::chrono::seconds const OverlayManagerImpl::PEER_FLUSH_INTERVAL(60);
+
 std::unique_ptr<OverlayManager>
 OverlayManager::create(Application& app)
 {
@@ -60,6 +63,7 @@ OverlayManagerImpl::OverlayManagerImpl(Application& app)
     : mApp(app)
     , mDoor(mApp)
     , mAuth(mApp)
+    , mMessageBufferPool(app.getMetrics())
     , mShuttingDown(false)
     , mMessagesReceived(app.getMetrics().NewMeter(
           {"overlay", "message", "flood-receive"}, "message"))
@@ -78,7 +82,9 @@ OverlayManagerImpl::OverlayManagerImpl(Application& app)
     , mAuthenticatedPeersSize(app.getMetrics().NewCounter(
           {"overlay", "memory", "authenticated-peers"}))
     , mTimer(app)
+    , mFlushTimer(app)
     , mFloodGate(app)
+    , mTxAdmission(app)
 {
 }
 
@@ -90,6 +96,12 @@ void
 OverlayManagerImpl::start()
 {
     mDoor.start();
+    flushPeers();
+    auto const& captureFile = mApp.getConfig().OVERLAY_CAPTURE_FILE;
+    if (!captureFile.empty())
+    {
+        mCapture = std::make_unique<MessageCapture>(mApp, captureFile);
+    }
     mTimer.expires_from_now(std::chrono::seconds(2));
 
     if (!mApp.getConfig().RUN_STANDALONE)
@@ -232,13 +244,13 @@ OverlayManagerImpl::getPeersToConnectTo(int maxNum)
     // don't connect to too many peers at once
     maxNum = std::min(maxNum, 50);
 
-    // batch is how many peers to load from the database every time
-    const int batchSize = std::max(50, maxNum);
-
+    // load more candidates than needed, so that there is a choice of the
+    // nearest ones
+    auto poolSize = static_cast<size_t>(maxNum) * RTT_CANDIDATES_FACTOR;
     std::vector<PeerRecord> peers;
 
     PeerRecord::loadPeerRecords(
-        mApp.getDatabase(), batchSize, mApp.getClock().now(),
+        mApp.getDatabase(), mApp.getClock().now(),
         [&](PeerRecord const& pr) {
             // skip peers that we're already
             // connected/connecting to
@@ -246,8 +258,14 @@ OverlayManagerImpl::getPeersToConnectTo(int maxNum)
             {
                 peers.emplace_back(pr);
             }
-            return peers.size() < static_cast<size_t>(maxNum);
+            return peers.size() < poolSize;
         });
+
+    orderByRTT(peers);
+    if (peers.size() > static_cast<size_t>(maxNum))
+    {
+        peers.erase(peers.begin() + maxNum, peers.end());
+    }
     return peers;
 }
 
@@ -281,10 +299,52 @@ OverlayManagerImpl::orderByPreferredPeers(vector<PeerRecord>& peers)
     std::stable_partition(peers.begin(), peers.end(), isPreferredPredicate);
 }
 
+void
+OverlayManagerImpl::orderByRTT(vector<PeerRecord>& peers)
+{
+    // peers measured before go nearest first, alternating with peers never
+    // measured (in the order loaded), so that the nearest peers don't take
+    // all the slots and new ones still get a chance to be measured
+    vector<PeerRecord> measured;
+    vector<PeerRecord> unmeasured;
+    for (auto& pr : peers)
+    {
+        if (getPeerRTT(pr.getAddress()).count() != 0)
+        {
+            measured.emplace_back(pr);
+        }
+        else
+        {
+            unmeasured.emplace_back(pr);
+        }
+    }
+    std::stable_sort(measured.begin(), measured.end(),
+                     [this](PeerRecord const& x, PeerRecord const& y) {
+                         return getPeerRTT(x.getAddress()) <
+                                getPeerRTT(y.getAddress());
+                     });
+
+    peers.clear();
+    auto m = measured.begin();
+    auto u = unmeasured.begin();
+    while (m != measured.end() || u != unmeasured.end())
+    {
+        if (m != measured.end())
+        {
+            peers.emplace_back(*m++);
+        }
+        if (u != unmeasured.end())
+        {
+            peers.emplace_back(*u++);
+        }
+    }
+}
+
 // called every 2 seconds
 void
 OverlayManagerImpl::tick()
 {
+    ProfileScope profileScope("overlay-tick");
     CLOG(TRACE, "Overlay") << "OverlayManagerImpl tick";
 
     mLoad.maybeShedExcessLoad(mApp);
@@ -311,6 +371,15 @@ OverlayManagerImpl::tick()
     mTimer.async_wait([this]() { this->tick(); }, VirtualTimer::onFailureNoop);
 }
 
+void
+OverlayManagerImpl::flushPeers()
+{
+    PeerRecord::flush(mApp.getDatabase());
+    mFlushTimer.expires_from_now(PEER_FLUSH_INTERVAL);
+    mFlushTimer.async_wait([this]() { this->flushPeers(); },
+                           VirtualTimer::onFailureNoop);
+}
+
 Peer::pointer
 OverlayManagerImpl::getConnectedPeer(PeerBareAddress const& address)
 {
@@ -482,6 +551,20 @@ OverlayManagerImpl::getAuthenticatedPeersCount() const
     return static_cast<int>(mAuthenticatedPeers.size());
 }
 
+void
+OverlayManagerImpl::recordPeerRTT(PeerBareAddress const& address,
+                                  std::chrono::microseconds rtt)
+{
+    mPeerRTTs[address.toString()] = rtt;
+}
+
+std::chrono::microseconds
+OverlayManagerImpl::getPeerRTT(PeerBareAddress const& address) const
+{
+    auto it = mPeerRTTs.find(address.toString());
+    return it == mPeerRTTs.end() ? std::chrono::microseconds{0} : it->second;
+}
+
 bool
 OverlayManagerImpl::isPreferred(Peer* peer)
 {
@@ -528,15 +611,50 @@ void
 OverlayManagerImpl::recvFloodedMsg(StellarMessage const& msg,
                                    Peer::pointer peer)
 {
+    recvFloodedMsg(msg, xdr::xdr_to_opaque(msg), peer);
+}
+
+void
+OverlayManagerImpl::recvFloodedMsg(StellarMessage const& msg,
+                                   ByteSlice const& msgBytes,
+                                   Peer::pointer peer)
+{
+    ProfileScope profileScope("overlay-flood");
     mMessagesReceived.Mark();
-    mFloodGate.addRecord(msg, peer);
+    bool isNew = mFloodGate.addRecord(msgBytes, peer);
+    if (peer)
+    {
+        mLoad.recordFlooded(peer->getPeerID(), msg.type(), !isNew);
+    }
+}
+
+void
+OverlayManagerImpl::recvFloodAdvert(FloodAdvert const& advert,
+                                    Peer::pointer peer)
+{
+    mFloodGate.recvFloodAdvert(advert, peer);
 }
 
 void
+OverlayManagerImpl::recvFloodDemand(FloodDemand const& demand,
+                                    Peer::pointer peer)
+{
+    mFloodGate.recvFloodDemand(demand, peer);
+}
+
+size_t
 OverlayManagerImpl::broadcastMessage(StellarMessage const& msg, bool force)
 {
+    return broadcastMessage(msg, xdr::xdr_to_opaque(msg), force);
+}
+
+size_t
+OverlayManagerImpl::broadcastMessage(StellarMessage const& msg,
+                                     ByteSlice const& msgBytes, bool force)
+{
+    ProfileScope profileScope("overlay-broadcast");
     mMessagesBroadcast.Mark();
-    mFloodGate.broadcast(msg, force);
+    return mFloodGate.broadcast(msg, msgBytes, force);
 }
 
 void
@@ -563,6 +681,24 @@ OverlayManagerImpl::getLoadManager()
     return mLoad;
 }
 
+MessageBufferPool&
+OverlayManagerImpl::getMessageBufferPool()
+{
+    return mMessageBufferPool;
+}
+
+TxAdmission&
+OverlayManagerImpl::getTxAdmission()
+{
+    return mTxAdmission;
+}
+
+MessageCapture*
+OverlayManagerImpl::getMessageCapture()
+{
+    return mCapture.get();
+}
+
 void
 OverlayManagerImpl::shutdown()
 {
@@ -573,6 +709,10 @@ OverlayManagerImpl::shutdown()
     mShuttingDown = true;
     mDoor.close();
     mFloodGate.shutdown();
+    mTxAdmission.shutdown();
+    mCapture.reset();
+    mFlushTimer.cancel();
+    PeerRecord::flush(mApp.getDatabase());
     auto pendingPeersToStop = mPendingPeers;
     for (auto& p : pendingPeersToStop)
     {
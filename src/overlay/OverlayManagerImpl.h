@@ -12,8 +12,11 @@
 #include "herder/TxSetFrame.h"
 #include "overlay/Floodgate.h"
 #include "overlay/ItemFetcher.h"
+#include "overlay/MessageBufferPool.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/StellarXDR.h"
+#include "overlay/MessageCapture.h"
+#include "overlay/TxAdmission.h"
 #include "util/Timer.h"
 #include <set>
 #include <vector>
@@ -35,6 +38,9 @@ class OverlayManagerImpl : public OverlayManager
   protected:
     Application& mApp;
     std::set<std::string> mPreferredPeers;
+    // round trip times measured to peers, by address; kept in memory only,
+    // as they say little about a peer once the process restarts
+    std::map<std::string, std::chrono::microseconds> mPeerRTTs;
 
     // pending peers - connected, but not authenticated
     std::vector<Peer::pointer> mPendingPeers;
@@ -43,6 +49,7 @@ class OverlayManagerImpl : public OverlayManager
     PeerDoor mDoor;
     PeerAuth mAuth;
     LoadManager mLoad;
+    MessageBufferPool mMessageBufferPool;
     bool mShuttingDown;
 
     medida::Meter& mMessagesReceived;
@@ -57,6 +64,16 @@ class OverlayManagerImpl : public OverlayManager
     void tick();
     VirtualTimer mTimer;
 
+    // writes the peers changed in memory to the database, every
+    // PEER_FLUSH_INTERVAL and at shutdown
+    static std::chrono::seconds const PEER_FLUSH_INTERVAL;
+    void flushPeers();
+    VirtualTimer mFlushTimer;
+
+    // how many more candidates than free slots are loaded when connecting
+    // out, to pick the nearest among them (see orderByRTT)
+    static size_t const RTT_CANDIDATES_FACTOR = 4;
+
     void storePeerList(std::vector<std::string> const& list, bool resetBackOff,
                        bool preferred);
     void storeConfigPeers();
@@ -64,6 +81,8 @@ class OverlayManagerImpl : public OverlayManager
     friend class OverlayManagerTests;
 
     Floodgate mFloodGate;
+    TxAdmission mTxAdmission;
+    std::unique_ptr<MessageCapture> mCapture;
 
   public:
     OverlayManagerImpl(Application& app);
@@ -71,8 +90,17 @@ class OverlayManagerImpl : public OverlayManager
 
     void ledgerClosed(uint32_t lastClosedledgerSeq) override;
     void recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override;
-    void broadcastMessage(StellarMessage const& msg,
-                          bool force = false) override;
+    void recvFloodedMsg(StellarMessage const& msg, ByteSlice const& msgBytes,
+                        Peer::pointer peer) override;
+    void recvFloodAdvert(FloodAdvert const& advert,
+                         Peer::pointer peer) override;
+    void recvFloodDemand(FloodDemand const& demand,
+                         Peer::pointer peer) override;
+    size_t broadcastMessage(StellarMessage const& msg,
+                            bool force = false) override;
+    size_t broadcastMessage(StellarMessage const& msg,
+                            ByteSlice const& msgBytes,
+                            bool force = false) override;
     void connectTo(std::string const& addr) override;
     void connectTo(PeerRecord& pr) override;
     void connectTo(PeerBareAddress const& address) override;
@@ -81,6 +109,10 @@ class OverlayManagerImpl : public OverlayManager
     void dropPeer(Peer* peer) override;
     bool acceptAuthenticatedPeer(Peer::pointer peer) override;
     bool isPreferred(Peer* peer) override;
+    void recordPeerRTT(PeerBareAddress const& address,
+                       std::chrono::microseconds rtt) override;
+    std::chrono::microseconds
+    getPeerRTT(PeerBareAddress const& address) const override;
     std::vector<Peer::pointer> const& getPendingPeers() const override;
     int getPendingPeersCount() const override;
     std::map<NodeID, Peer::pointer> const&
@@ -98,6 +130,9 @@ class OverlayManagerImpl : public OverlayManager
     PeerAuth& getPeerAuth() override;
 
     LoadManager& getLoadManager() override;
+    MessageBufferPool& getMessageBufferPool() override;
+    TxAdmission& getTxAdmission() override;
+    MessageCapture* getMessageCapture() override;
 
     void start() override;
     void shutdown() override;
@@ -109,6 +144,7 @@ class OverlayManagerImpl : public OverlayManager
     std::vector<PeerRecord> getPeersToConnectTo(int maxNum);
 
     void orderByPreferredPeers(vector<PeerRecord>& peers);
+    void orderByRTT(vector<PeerRecord>& peers);
     bool moveToAuthenticated(Peer::pointer peer);
     void updateSizeCounters();
 };
@@ -50,7 +50,7 @@ class PeerStub : public Peer
     {
     }
     virtual void
-    sendMessage(xdr::msg_ptr&& xdrBytes) override
+    sendMessage(MessageBufferPtr&& xdrBytes) override
     {
         sent++;
     }
@@ -167,16 +167,41 @@ class OverlayManagerTests
         for (auto p : pm.mAuthenticatedPeers)
             if (i++ == 2)
                 pm.recvFloodedMsg(AtoC, p.second);
-        pm.broadcastMessage(AtoC);
+        // all but the peer it came from
+        REQUIRE(pm.broadcastMessage(AtoC) == 4);
         vector<int> expected{1, 1, 0, 1, 1};
         REQUIRE(sentCounts(pm) == expected);
-        pm.broadcastMessage(AtoC);
+        REQUIRE(pm.broadcastMessage(AtoC) == 0);
         REQUIRE(sentCounts(pm) == expected);
         StellarMessage CtoD = c.tx({payment(d, 10)})->toStellarMessage();
         pm.broadcastMessage(CtoD);
         vector<int> expectedFinal{2, 2, 1, 2, 2};
         REQUIRE(sentCounts(pm) == expectedFinal);
     }
+
+    void
+    test_orderByRTT()
+    {
+        OverlayManagerStub& pm = app->getOverlayManager();
+
+        pm.storePeerList(fourPeers, false, false);
+        pm.storePeerList(threePeers, false, false);
+        auto rtt = [&](string const& peer, int ms) {
+            pm.recordPeerRTT(PeerBareAddress::resolve(peer, *app),
+                             std::chrono::milliseconds(ms));
+        };
+        rtt("127.0.0.1:2012", 300);
+        rtt("127.0.0.1:64001", 20);
+        rtt("127.0.0.1:2014", 80);
+
+        auto peers = pm.getPeersToConnectTo(4);
+        REQUIRE(peers.size() == 4);
+        // nearest first, alternating with peers not measured yet
+        REQUIRE(peers[0].toString() == "127.0.0.1:64001");
+        REQUIRE(pm.getPeerRTT(peers[1].getAddress()).count() == 0);
+        REQUIRE(peers[2].toString() == "127.0.0.1:2014");
+        REQUIRE(pm.getPeerRTT(peers[3].getAddress()).count() == 0);
+    }
 };
 
 TEST_CASE_METHOD(OverlayManagerTests, "addPeerList() adds", "[overlay]")
@@ -188,4 +213,10 @@ TEST_CASE_METHOD(OverlayManagerTests, "broadcast() broadcasts", "[overlay]")
 {
     test_broadcast();
 }
+
+TEST_CASE_METHOD(OverlayManagerTests, "nearest peers are connected to first",
+                 "[overlay]")
+{
+    test_orderByRTT();
+}
 }
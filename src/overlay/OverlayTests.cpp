@@ -5,6 +5,9 @@
 #include "BanManager.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
+#include "herder/Herder.h"
+#include "herder/TxSetFrame.h"
+#include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -12,20 +15,85 @@
 #include "overlay/OverlayManagerImpl.h"
 #include "overlay/PeerRecord.h"
 #include "overlay/TCPPeer.h"
+#include "simulation/OverlayReplay.h"
 #include "simulation/Simulation.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "util/format.h"
+#include "xdrpp/marshal.h"
 #include <numeric>
 
 using namespace stellar;
 
+TEST_CASE("authenticated message encoding", "[overlay]")
+{
+    AuthenticatedMessage amsg;
+    amsg.v0().sequence = 0x0102030405060708ULL;
+    amsg.v0().message.type(GET_SCP_STATE);
+    amsg.v0().message.getSCPLedgerSeq() = 42;
+    amsg.v0().mac.mac.fill(7);
+
+    medida::MetricsRegistry metrics;
+    MessageBufferPool pool(metrics);
+    auto encoded = Peer::encodeAuthenticatedMessage(
+        pool, amsg.v0().sequence, xdr::xdr_to_opaque(amsg.v0().message),
+        amsg.v0().mac);
+    auto expected = xdr::xdr_to_msg(amsg);
+    REQUIRE(encoded->raw_size() == expected->raw_size());
+    REQUIRE(std::equal(encoded->raw_data(),
+                       encoded->raw_data() + encoded->raw_size(),
+                       expected->raw_data()));
+}
+
+TEST_CASE("flooded message hash", "[overlay]")
+{
+    StellarMessage tx;
+    tx.type(TRANSACTION);
+    tx.transaction().tx.fee = 100;
+    auto txBytes = xdr::xdr_to_opaque(tx);
+
+    medida::MetricsRegistry metrics;
+    MessageBufferPool pool(metrics);
+    HmacSha256Mac mac;
+    mac.mac.fill(7);
+    auto first = Peer::encodeAuthenticatedMessage(pool, 1, txBytes, mac);
+    mac.mac.fill(8);
+    auto second = Peer::encodeAuthenticatedMessage(pool, 2, txBytes, mac);
+
+    MessageType type;
+    uint64_t h1, h2;
+    REQUIRE(Peer::getFloodedMessageHash(
+        ByteSlice(first->data(), first->size()), type, h1));
+    REQUIRE(type == TRANSACTION);
+    REQUIRE(Peer::getFloodedMessageHash(
+        ByteSlice(second->data(), second->size()), type, h2));
+    // same message, whatever the sequence and mac
+    REQUIRE(h1 == h2);
+
+    tx.transaction().tx.fee = 101;
+    auto other = Peer::encodeAuthenticatedMessage(
+        pool, 1, xdr::xdr_to_opaque(tx), HmacSha256Mac{});
+    REQUIRE(Peer::getFloodedMessageHash(
+        ByteSlice(other->data(), other->size()), type, h2));
+    REQUIRE(h1 != h2);
+
+    StellarMessage getState;
+    getState.type(GET_SCP_STATE);
+    getState.getSCPLedgerSeq() = 1;
+    auto notFlooded = Peer::encodeAuthenticatedMessage(
+        pool, 1, xdr::xdr_to_opaque(getState), HmacSha256Mac{});
+    REQUIRE(!Peer::getFloodedMessageHash(
+        ByteSlice(notFlooded->data(), notFlooded->size()), type, h2));
+}
+
 TEST_CASE("loopback peer hello", "[overlay]")
 {
     VirtualClock clock;
@@ -41,6 +109,278 @@ TEST_CASE("loopback peer hello", "[overlay]")
     REQUIRE(conn.getAcceptor()->isAuthenticated());
 }
 
+TEST_CASE("loopback peer hello authenticated off the main thread",
+          "[overlay]")
+{
+    // the worker threads only do it with a real time clock
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+    auto& hit = app1->getMetrics().NewMeter(
+        {"overlay", "auth-cert-cache", "hit"}, "cert");
+    auto& miss = app1->getMetrics().NewMeter(
+        {"overlay", "auth-cert-cache", "miss"}, "cert");
+
+    auto handshake = [&]() {
+        LoopbackPeerConnection conn(*app1, *app2);
+        auto end = clock.now() + std::chrono::seconds(10);
+        while (!(conn.getInitiator()->isAuthenticated() &&
+                 conn.getAcceptor()->isAuthenticated()) &&
+               clock.now() < end)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(conn.getInitiator()->isAuthenticated());
+        REQUIRE(conn.getAcceptor()->isAuthenticated());
+    };
+
+    handshake();
+    REQUIRE(miss.count() == 1);
+    REQUIRE(hit.count() == 0);
+    testutil::crankSome(clock);
+
+    // the same cert again
+    handshake();
+    REQUIRE(miss.count() == 1);
+    REQUIRE(hit.count() == 1);
+}
+
+TEST_CASE("large transaction sets are sent in chunks", "[overlay]")
+{
+    // parts are made into frames on the worker threads
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    auto const& lcl = app1->getLedgerManager().getLastClosedLedgerHeader();
+    TxSetFrame txSet(lcl.hash);
+    for (size_t i = 0; i < 2 * Peer::TX_SET_CHUNK_TXS + 1; ++i)
+    {
+        TransactionEnvelope env;
+        env.tx.seqNum = i;
+        txSet.add(TransactionFrame::makeTransactionFromWire(
+            app1->getNetworkID(), env));
+    }
+    auto hash = txSet.getContentsHash();
+    // an envelope for slot 0, discarded, only there to get the set into the
+    // herder
+    SCPQuorumSet qset;
+    qset.threshold = 1;
+    qset.validators.emplace_back(app1->getConfig().NODE_SEED.getPublicKey());
+    app1->getHerder().recvSCPEnvelope(SCPEnvelope{}, qset, txSet);
+    REQUIRE(app1->getHerder().getTxSet(hash));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+
+    auto acceptor = conn.getAcceptor();
+    acceptor->sendGetTxSet(hash);
+    auto end = clock.now() + std::chrono::seconds(10);
+    while (!acceptor->getFetchStats().hasLatency() && clock.now() < end)
+    {
+        clock.crank(false);
+    }
+    // the whole set was put back together on app2
+    REQUIRE(acceptor->getFetchStats().hasLatency());
+    REQUIRE(acceptor->isAuthenticated());
+    REQUIRE(app1->getMetrics()
+                .NewMeter({"overlay", "send", "txset-chunk"}, "message")
+                .count() == 3);
+    REQUIRE(app1->getMetrics()
+                .NewMeter({"overlay", "send", "txset"}, "message")
+                .count() == 0);
+}
+
+TEST_CASE("repeated SCP state requests are ignored", "[overlay]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config const& cfg2 = getTestConfig(1);
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    auto& ignored = app2->getMetrics().NewMeter(
+        {"overlay", "recv", "get-scp-state-ignored"}, "message");
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+
+    // the state sent on authentication covers the request that follows
+    REQUIRE(ignored.count() == 1);
+    conn.getInitiator()->sendGetScpState(1);
+    testutil::crankSome(clock);
+    REQUIRE(ignored.count() == 2);
+
+    bool slept = false;
+    VirtualTimer timer(*app1);
+    timer.expires_from_now(Peer::SCP_STATE_MIN_INTERVAL +
+                           std::chrono::seconds(1));
+    timer.async_wait([&slept]() { slept = true; },
+                     VirtualTimer::onFailureNoop);
+    while (!slept)
+    {
+        clock.crank(true);
+    }
+    conn.getInitiator()->sendGetScpState(1);
+    testutil::crankSome(clock);
+    REQUIRE(ignored.count() == 2);
+}
+
+TEST_CASE("peers measure round trip times", "[overlay]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config const& cfg2 = getTestConfig(1);
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    auto& pings =
+        app1->getMetrics().NewMeter({"overlay", "send", "ping"}, "message");
+    auto& pongs =
+        app2->getMetrics().NewMeter({"overlay", "send", "pong"}, "message");
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+
+    // both sides probe on authentication
+    REQUIRE(pings.count() == 1);
+    REQUIRE(pongs.count() == 1);
+    auto initiator = conn.getInitiator();
+    REQUIRE(initiator->getRTT().count() > 0);
+    REQUIRE(app1->getOverlayManager().getPeerRTT(initiator->getAddress()) ==
+            initiator->getRTT());
+
+    bool slept = false;
+    VirtualTimer timer(*app1);
+    timer.expires_from_now(Peer::PING_PERIOD + std::chrono::seconds(1));
+    timer.async_wait([&slept]() { slept = true; },
+                     VirtualTimer::onFailureNoop);
+    while (!slept)
+    {
+        clock.crank(true);
+    }
+    testutil::crankSome(clock);
+    REQUIRE(pings.count() == 2);
+    REQUIRE(conn.getInitiator()->isConnected());
+}
+
+TEST_CASE("peers without round trip probes are not sent any", "[overlay]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config cfg2 = getTestConfig(1);
+    cfg2.OVERLAY_PROTOCOL_VERSION = Peer::FIRST_OVERLAY_VERSION_WITH_PING - 1;
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    auto& pings =
+        app1->getMetrics().NewMeter({"overlay", "send", "ping"}, "message");
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(pings.count() == 0);
+    REQUIRE(conn.getInitiator()->getRTT().count() == 0);
+}
+
+TEST_CASE("peers compress the messages they send", "[overlay]")
+{
+    VirtualClock clock;
+    Config cfg1 = getTestConfig(0);
+    Config cfg2 = getTestConfig(1);
+    // everything after the handshake
+    cfg1.PEER_COMPRESSION = true;
+    cfg1.PEER_COMPRESSION_MIN_BYTES = 0;
+    bool both = false;
+    SECTION("one way")
+    {
+    }
+    SECTION("both ways")
+    {
+        both = true;
+        cfg2.PEER_COMPRESSION = true;
+        cfg2.PEER_COMPRESSION_MIN_BYTES = 0;
+    }
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    auto compressed = [](Application& app) {
+        return app.getMetrics()
+            .NewMeter({"overlay", "compression", "raw"}, "byte")
+            .count();
+    };
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+
+    // PINGs and PONGs, among others, made it through
+    REQUIRE(conn.getInitiator()->getRTT().count() > 0);
+    REQUIRE(conn.getAcceptor()->getRTT().count() > 0);
+    REQUIRE(compressed(*app1) > 0);
+    REQUIRE((compressed(*app2) > 0) == both);
+}
+
+TEST_CASE("messages received are captured and replayed", "[overlay]")
+{
+    TmpDir tmp("capture");
+    auto file = tmp.getName() + "/capture.xdr";
+
+    VirtualClock clock;
+    Config cfg1 = getTestConfig(0);
+    Config cfg2 = getTestConfig(1);
+    cfg2.OVERLAY_CAPTURE_FILE = file;
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+    app2->start();
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+
+    StellarMessage dontHave;
+    dontHave.type(DONT_HAVE);
+    dontHave.dontHave().type = TX_SET;
+    conn.getInitiator()->Peer::sendMessage(dontHave);
+    testutil::crankSome(clock);
+    // closes the capture
+    app2->getOverlayManager().shutdown();
+
+    std::map<MessageType, uint64_t> types;
+    uint64_t total = 0;
+    uint64_t lastOffset = 0;
+    XDRInputFileStream in;
+    in.open(file);
+    CapturedMessage captured;
+    while (in.readOne(captured))
+    {
+        REQUIRE(captured.peerID == cfg1.NODE_SEED.getPublicKey());
+        REQUIRE(captured.timeOffset >= lastOffset);
+        lastOffset = captured.timeOffset;
+        ++types[captured.message.type()];
+        ++total;
+    }
+    REQUIRE(types[DONT_HAVE] == 1);
+    REQUIRE(types.count(HELLO) == 0);
+    REQUIRE(types.count(AUTH) == 0);
+
+    VirtualClock replayClock;
+    auto app3 = createTestApplication(replayClock, getTestConfig(2));
+    app3->start();
+    OverlayReplay replay;
+    replay.mFile = file;
+    replay.mSpeed = 0;
+    auto report = replay.run(*app3);
+    REQUIRE(report["messages"].asUInt64() == total);
+    REQUIRE(report["types"]["DONT_HAVE"].asUInt64() == 1);
+    REQUIRE(report["connections"].asUInt64() == 1);
+    REQUIRE(report["metrics"].isMember("overlay.message.read"));
+}
+
 TEST_CASE("loopback peer with 0 port", "[overlay]")
 {
     VirtualClock clock;
@@ -280,6 +620,29 @@ TEST_CASE("reject banned peers", "[overlay]")
                 .count() != 0);
 }
 
+TEST_CASE("remember addresses of banned peers", "[overlay]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config cfg2 = getTestConfig(1);
+
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+    auto& banManager = app1->getBanManager();
+    banManager.banNode(cfg2.NODE_SEED.getPublicKey());
+
+    // the banned node calls, its address is then refused before any
+    // handshake
+    LoopbackPeerConnection conn(*app2, *app1);
+    testutil::crankSome(clock);
+
+    REQUIRE(!conn.getAcceptor()->isConnected());
+    REQUIRE(banManager.isAddressBanned("127.0.0.1"));
+
+    banManager.unbanNode(cfg2.NODE_SEED.getPublicKey());
+    REQUIRE(!banManager.isAddressBanned("127.0.0.1"));
+}
+
 TEST_CASE("reject peers with incompatible overlay versions", "[overlay]")
 {
     Config const& cfg1 = getTestConfig(0);
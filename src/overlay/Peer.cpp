@@ -15,11 +15,15 @@
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/LoadManager.h"
+#include "overlay/MessageCapture.h"
+#include "overlay/MessageCompression.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerAuth.h"
 #include "overlay/PeerRecord.h"
 #include "overlay/StellarXDR.h"
+#include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
+#include "util/WorkerLanes.h"
 #include "util/XDROperators.h"
 
 #include "medida/meter.h"
@@ -28,6 +32,7 @@
 
 #include "xdrpp/marshal.h"
 
+#include <sodium.h>
 #include <soci.h>
 #include <time.h>
 
@@ -40,6 +45,71 @@ namespace stellar
 using namespace std;
 using namespace soci;
 
+std::chrono::milliseconds const Peer::FLOOD_ADVERT_PERIOD{100};
+std::chrono::seconds const Peer::SCP_STATE_MIN_INTERVAL{5};
+std::chrono::seconds const Peer::PING_PERIOD{10};
+
+// bound on the item fetch requests kept for timing, see noteFetchRequest
+static size_t const MAX_FETCH_REQUESTS = 64;
+static std::chrono::seconds const FETCH_REQUEST_EXPIRY{30};
+
+// the values of `st`, in the order they are encoded
+static std::vector<Value*>
+getStatementValues(SCPStatement& st)
+{
+    std::vector<Value*> res;
+    auto& pledges = st.pledges;
+    switch (pledges.type())
+    {
+    case SCP_ST_PREPARE:
+    {
+        auto& prep = pledges.prepare();
+        res.push_back(&prep.ballot.value);
+        if (prep.prepared)
+        {
+            res.push_back(&prep.prepared->value);
+        }
+        if (prep.preparedPrime)
+        {
+            res.push_back(&prep.preparedPrime->value);
+        }
+    }
+    break;
+    case SCP_ST_CONFIRM:
+        res.push_back(&pledges.confirm().ballot.value);
+        break;
+    case SCP_ST_EXTERNALIZE:
+        res.push_back(&pledges.externalize().commit.value);
+        break;
+    case SCP_ST_NOMINATE:
+        for (auto& v : pledges.nominate().votes)
+        {
+            res.push_back(&v);
+        }
+        for (auto& v : pledges.nominate().accepted)
+        {
+            res.push_back(&v);
+        }
+        break;
+    }
+    return res;
+}
+
+// a value of an SCP_MESSAGE_COMPACT, referencing value `id`
+static size_t const VALUE_REF_SIZE = 4;
+
+static Value
+makeValueRef(uint32_t id)
+{
+    Value res;
+    res.resize(VALUE_REF_SIZE);
+    for (size_t i = 0; i < VALUE_REF_SIZE; ++i)
+    {
+        res[i] = static_cast<uint8_t>(id >> (24 - 8 * i));
+    }
+    return res;
+}
+
 medida::Meter&
 Peer::getByteReadMeter(Application& app)
 {
@@ -57,6 +127,10 @@ Peer::Peer(Application& app, PeerRole role)
     , mRole(role)
     , mState(role == WE_CALLED_REMOTE ? CONNECTING : CONNECTED)
     , mRemoteOverlayVersion(0)
+    , mAdvertTimer(app)
+    , mSentValues(SCP_COMPACT_VALUE_SLOTS)
+    , mRecvValues(SCP_COMPACT_VALUE_SLOTS)
+    , mPingTimer(app)
     , mIdleTimer(app)
     , mLastRead(app.getClock().now())
     , mLastWrite(app.getClock().now())
@@ -73,37 +147,55 @@ Peer::Peer(Application& app, PeerRole role)
           app.getMetrics().NewMeter({"overlay", "error", "write"}, "error"))
     , mTimeoutIdle(
           app.getMetrics().NewMeter({"overlay", "timeout", "idle"}, "timeout"))
-
-    , mRecvErrorTimer(app.getMetrics().NewTimer({"overlay", "recv", "error"}))
-    , mRecvHelloTimer(app.getMetrics().NewTimer({"overlay", "recv", "hello"}))
-    , mRecvAuthTimer(app.getMetrics().NewTimer({"overlay", "recv", "auth"}))
-    , mRecvDontHaveTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "dont-have"}))
-    , mRecvGetPeersTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "get-peers"}))
-    , mRecvPeersTimer(app.getMetrics().NewTimer({"overlay", "recv", "peers"}))
-    , mRecvGetTxSetTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "get-txset"}))
-    , mRecvTxSetTimer(app.getMetrics().NewTimer({"overlay", "recv", "txset"}))
-    , mRecvTransactionTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "transaction"}))
-    , mRecvGetSCPQuorumSetTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "get-scp-qset"}))
-    , mRecvSCPQuorumSetTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "scp-qset"}))
-    , mRecvSCPMessageTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "scp-message"}))
-    , mRecvGetSCPStateTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "get-scp-state"}))
-
-    , mRecvSCPPrepareTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "scp-prepare"}))
-    , mRecvSCPConfirmTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "scp-confirm"}))
-    , mRecvSCPNominateTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "scp-nominate"}))
-    , mRecvSCPExternalizeTimer(
-          app.getMetrics().NewTimer({"overlay", "recv", "scp-externalize"}))
+    , mRTTTimer(app.getMetrics().NewTimer({"overlay", "peer", "rtt"}))
+
+    , mRecvErrorTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "error"}))
+    , mRecvHelloTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "hello"}))
+    , mRecvAuthTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "auth"}))
+    , mRecvDontHaveTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "dont-have"}))
+    , mRecvGetPeersTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "get-peers"}))
+    , mRecvPeersTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "peers"}))
+    , mRecvGetTxSetTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "get-txset"}))
+    , mRecvTxSetTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "txset"}))
+    , mRecvTransactionTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "transaction"}))
+    , mRecvGetSCPQuorumSetTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "get-scp-qset"}))
+    , mRecvSCPQuorumSetTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "scp-qset"}))
+    , mRecvSCPMessageTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "scp-message"}))
+    , mRecvGetSCPStateTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "get-scp-state"}))
+    , mRecvFloodAdvertTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "flood-advert"}))
+    , mRecvFloodDemandTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "flood-demand"}))
+    , mRecvSCPMessageCompactTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "scp-message-compact"}))
+    , mRecvTxSetChunkTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "txset-chunk"}))
+    , mRecvPingTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "ping"}))
+    , mRecvPongTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "pong"}))
+
+    , mRecvSCPPrepareTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "scp-prepare"}))
+    , mRecvSCPConfirmTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "scp-confirm"}))
+    , mRecvSCPNominateTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "scp-nominate"}))
+    , mRecvSCPExternalizeTimer(app.getLatencyHistograms().NewTimer(
+          {"overlay", "recv", "scp-externalize"}))
 
     , mSendErrorMeter(
           app.getMetrics().NewMeter({"overlay", "send", "error"}, "message"))
@@ -131,6 +223,22 @@ Peer::Peer(Application& app, PeerRole role)
           {"overlay", "send", "scp-message"}, "message"))
     , mSendGetSCPStateMeter(app.getMetrics().NewMeter(
           {"overlay", "send", "get-scp-state"}, "message"))
+    , mSendFloodAdvertMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-advert"}, "message"))
+    , mSendFloodDemandMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-demand"}, "message"))
+    , mSendSCPMessageCompactMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "scp-message-compact"}, "message"))
+    , mCompactSCPSavedBytesMeter(app.getMetrics().NewMeter(
+          {"overlay", "scp-compact", "saved"}, "byte"))
+    , mSendTxSetChunkMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "txset-chunk"}, "message"))
+    , mSendPingMeter(
+          app.getMetrics().NewMeter({"overlay", "send", "ping"}, "message"))
+    , mSendPongMeter(
+          app.getMetrics().NewMeter({"overlay", "send", "pong"}, "message"))
+    , mIgnoredGetSCPStateMeter(app.getMetrics().NewMeter(
+          {"overlay", "recv", "get-scp-state-ignored"}, "message"))
     , mDropInConnectHandlerMeter(app.getMetrics().NewMeter(
           {"overlay", "drop", "connect-handler"}, "drop"))
     , mDropInRecvMessageDecodeMeter(app.getMetrics().NewMeter(
@@ -247,9 +355,13 @@ Peer::idleTimerExpired(asio::error_code const& error)
 {
     if (!error)
     {
+        refreshLastIO();
         auto now = mApp.getClock().now();
         auto timeout = std::chrono::seconds(getIOTimeoutSeconds());
-        if (((now - mLastRead) >= timeout) && ((now - mLastWrite) >= timeout))
+        // PINGs keep writing to a peer that went silent
+        bool unanswered = mPingOutstanding && (now - mPingSent) >= timeout;
+        if (unanswered ||
+            (((now - mLastRead) >= timeout) && ((now - mLastWrite) >= timeout)))
         {
             CLOG(WARNING, "Overlay") << "idle timeout";
             mTimeoutIdle.Mark();
@@ -267,6 +379,7 @@ Peer::sendAuth()
 {
     StellarMessage msg;
     msg.type(AUTH);
+    msg.auth().flags = getCompressionAuthFlags();
     sendMessage(msg);
 }
 
@@ -337,6 +450,7 @@ Peer::sendGetTxSet(uint256 const& setID)
     newMsg.type(GET_TX_SET);
     newMsg.txSetHash() = setID;
 
+    noteFetchRequest(setID);
     sendMessage(newMsg);
 }
 void
@@ -349,9 +463,207 @@ Peer::sendGetQuorumSet(uint256 const& setID)
     newMsg.type(GET_SCP_QUORUMSET);
     newMsg.qSetHash() = setID;
 
+    noteFetchRequest(setID);
+    sendMessage(newMsg);
+}
+
+void
+Peer::noteFetchRequest(Hash const& itemID)
+{
+    auto now = mApp.getClock().now();
+    if (mFetchRequests.size() >= MAX_FETCH_REQUESTS)
+    {
+        // requests this old are not going to be answered
+        for (auto it = mFetchRequests.begin(); it != mFetchRequests.end();)
+        {
+            if (now - it->second > FETCH_REQUEST_EXPIRY)
+            {
+                it = mFetchRequests.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        if (mFetchRequests.size() >= MAX_FETCH_REQUESTS)
+        {
+            return;
+        }
+    }
+    // re-asked items are timed from the first request
+    mFetchRequests.emplace(itemID, now);
+}
+
+void
+Peer::noteFetchReply(Hash const& itemID, bool had)
+{
+    auto it = mFetchRequests.find(itemID);
+    if (it == mFetchRequests.end())
+    {
+        return;
+    }
+    if (had)
+    {
+        mFetchStats.recordReply(mApp.getClock().now() - it->second);
+    }
+    else
+    {
+        mFetchStats.recordDontHave();
+    }
+    mFetchRequests.erase(it);
+}
+
+bool
+Peer::useFloodAdverts() const
+{
+    return mApp.getConfig().FLOOD_TX_PULL_MODE &&
+           mRemoteOverlayVersion >= FIRST_OVERLAY_VERSION_WITH_FLOOD_ADVERTS;
+}
+
+void
+Peer::queueFloodAdvert(Hash const& txMsgHash)
+{
+    mAdvertQueue.emplace_back(txMsgHash);
+    if (mAdvertQueue.size() >= FLOOD_ADVERT_BATCH_SIZE)
+    {
+        flushFloodAdverts();
+    }
+    else if (!mAdvertTimerArmed)
+    {
+        mAdvertTimerArmed = true;
+        std::weak_ptr<Peer> weak = shared_from_this();
+        mAdvertTimer.expires_from_now(FLOOD_ADVERT_PERIOD);
+        mAdvertTimer.async_wait(
+            [weak]() {
+                auto self = weak.lock();
+                if (self)
+                {
+                    self->mAdvertTimerArmed = false;
+                    self->flushFloodAdverts();
+                }
+            },
+            VirtualTimer::onFailureNoop);
+    }
+}
+
+void
+Peer::flushFloodAdverts()
+{
+    if (mAdvertQueue.empty() || shouldAbort())
+    {
+        mAdvertQueue.clear();
+        return;
+    }
+    StellarMessage newMsg;
+    newMsg.type(FLOOD_ADVERT);
+    newMsg.floodAdvert().txHashes.assign(mAdvertQueue.begin(),
+                                         mAdvertQueue.end());
+    mAdvertQueue.clear();
     sendMessage(newMsg);
 }
 
+void
+Peer::sendFloodDemand(std::vector<Hash> const& txMsgHashes)
+{
+    for (size_t i = 0; i < txMsgHashes.size(); i += TX_ADVERT_VECTOR_MAX_SIZE)
+    {
+        auto end = std::min<size_t>(txMsgHashes.size(),
+                                    i + TX_ADVERT_VECTOR_MAX_SIZE);
+        StellarMessage newMsg;
+        newMsg.type(FLOOD_DEMAND);
+        newMsg.floodDemand().txHashes.assign(txMsgHashes.begin() + i,
+                                             txMsgHashes.begin() + end);
+        sendMessage(newMsg);
+    }
+}
+
+bool
+Peer::useCompactSCPMessages() const
+{
+    return mApp.getConfig().COMPACT_SCP_MESSAGES &&
+           mRemoteOverlayVersion >= FIRST_OVERLAY_VERSION_WITH_COMPACT_SCP;
+}
+
+bool
+Peer::compactEnvelope(SCPEnvelope const& envelope, CompactSCPEnvelope& res)
+{
+    uint64_t const slots = SCP_COMPACT_VALUE_SLOTS;
+    res.envelope = envelope;
+    res.newValues.clear();
+    auto values = getStatementValues(res.envelope.statement);
+    // ids are never reused, and the values defined must not push out of
+    // the peer's slots those referenced by the same message
+    if (values.size() > slots / 2 ||
+        uint64_t(mNextSentValueID) + values.size() > UINT32_MAX)
+    {
+        return false;
+    }
+    // the ids still held by the peer once it got this message are at least
+    // heldFrom - slots
+    uint64_t const heldFrom = uint64_t(mNextSentValueID) + values.size();
+    for (auto v : values)
+    {
+        auto it = mSentValueIDs.find(*v);
+        uint32_t id;
+        if (it != mSentValueIDs.end() && it->second + slots >= heldFrom)
+        {
+            id = it->second;
+        }
+        else
+        {
+            id = mNextSentValueID++;
+            auto& slot = mSentValues[id % slots];
+            auto old = mSentValueIDs.find(slot);
+            if (old != mSentValueIDs.end() && old->second + slots == id)
+            {
+                mSentValueIDs.erase(old);
+            }
+            mSentValueIDs[*v] = id;
+            slot = *v;
+            SCPValueDefinition def;
+            def.id = id;
+            def.value = *v;
+            res.newValues.emplace_back(std::move(def));
+        }
+        *v = makeValueRef(id);
+    }
+    return true;
+}
+
+bool
+Peer::expandEnvelope(CompactSCPEnvelope const& compact, SCPEnvelope& res)
+{
+    uint64_t const slots = SCP_COMPACT_VALUE_SLOTS;
+    for (auto const& def : compact.newValues)
+    {
+        if (def.id != mNextRecvValueID)
+        {
+            return false;
+        }
+        mRecvValues[def.id % slots] = def.value;
+        ++mNextRecvValueID;
+    }
+    res = compact.envelope;
+    for (auto v : getStatementValues(res.statement))
+    {
+        if (v->size() != VALUE_REF_SIZE)
+        {
+            return false;
+        }
+        uint32_t id = 0;
+        for (auto b : *v)
+        {
+            id = (id << 8) | b;
+        }
+        if (id >= mNextRecvValueID || id + slots < mNextRecvValueID)
+        {
+            return false;
+        }
+        *v = mRecvValues[id % slots];
+    }
+    return true;
+}
+
 void
 Peer::sendGetPeers()
 {
@@ -384,7 +696,7 @@ Peer::sendPeers()
 
     // send top peers we know about
     vector<PeerRecord> peerList;
-    PeerRecord::loadPeerRecords(mApp.getDatabase(), 50, mApp.getClock().now(),
+    PeerRecord::loadPeerRecords(mApp.getDatabase(), mApp.getClock().now(),
                                 [&](PeerRecord const& pr) {
                                     bool r = peerList.size() < maxPeerCount;
                                     if (r)
@@ -451,6 +763,20 @@ msgSummary(StellarMessage const& msg)
         }
     case GET_SCP_STATE:
         return "GET_SCP_STATE";
+    case FLOOD_ADVERT:
+        return "FLOODADVERT";
+    case FLOOD_DEMAND:
+        return "FLOODDEMAND";
+    case SCP_MESSAGE_COMPACT:
+        return "SCP_MESSAGE_COMPACT";
+    case TX_SET_CHUNK:
+        return "TXSETCHUNK";
+    case PING:
+        return "PING";
+    case PONG:
+        return "PONG";
+    case COMPRESSED:
+        return "COMPRESSED";
     }
     return "UNKNOWN";
 }
@@ -458,6 +784,50 @@ msgSummary(StellarMessage const& msg)
 void
 Peer::sendMessage(StellarMessage const& msg)
 {
+    auto sz = mSendEncoder.encode(msg);
+    sendMessage(msg, ByteSlice(mSendEncoder.data(), sz));
+}
+
+MessageBufferPtr
+Peer::encodeAuthenticatedMessage(MessageBufferPool& pool, uint64_t sequence,
+                                 ByteSlice const& msgBytes,
+                                 HmacSha256Mac const& mac)
+{
+    // union discriminant (4 bytes), sequence (8), message, mac (32)
+    size_t const headerSize = 4 + 8;
+    auto res = pool.acquire(headerSize + msgBytes.size() + mac.mac.size());
+    auto p = reinterpret_cast<uint8_t*>(res->data());
+    std::fill(p, p + 4, uint8_t(0));
+    for (size_t i = 0; i < 8; ++i)
+    {
+        p[4 + i] = static_cast<uint8_t>(sequence >> (56 - 8 * i));
+    }
+    std::copy(msgBytes.begin(), msgBytes.end(), p + headerSize);
+    std::copy(mac.mac.begin(), mac.mac.end(),
+              p + headerSize + msgBytes.size());
+    return res;
+}
+
+void
+Peer::sendMessage(StellarMessage const& msg, ByteSlice const& msgBytes)
+{
+    if (msg.type() == SCP_MESSAGE && useCompactSCPMessages())
+    {
+        StellarMessage compact;
+        compact.type(SCP_MESSAGE_COMPACT);
+        if (compactEnvelope(msg.envelope(), compact.compactEnvelope()))
+        {
+            auto compactBytes = xdr::xdr_to_opaque(compact);
+            if (compactBytes.size() < msgBytes.size())
+            {
+                mCompactSCPSavedBytesMeter.Mark(msgBytes.size() -
+                                                compactBytes.size());
+            }
+            sendMessage(compact, compactBytes);
+            return;
+        }
+    }
+
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay")
             << "("
@@ -507,23 +877,99 @@ Peer::sendMessage(StellarMessage const& msg)
     case GET_SCP_STATE:
         mSendGetSCPStateMeter.Mark();
         break;
+    case FLOOD_ADVERT:
+        mSendFloodAdvertMeter.Mark();
+        break;
+    case FLOOD_DEMAND:
+        mSendFloodDemandMeter.Mark();
+        break;
+    case SCP_MESSAGE_COMPACT:
+        mSendSCPMessageCompactMeter.Mark();
+        break;
+    case TX_SET_CHUNK:
+        mSendTxSetChunkMeter.Mark();
+        break;
+    case PING:
+        mSendPingMeter.Mark();
+        break;
+    case PONG:
+        mSendPongMeter.Mark();
+        break;
+    case COMPRESSED:
+        // only made from other messages, see MessageCompressor
+        break;
     };
 
-    AuthenticatedMessage amsg;
-    amsg.v0().message = msg;
-    if (msg.type() != HELLO && msg.type() != ERROR_MSG)
+    auto& pool = mApp.getOverlayManager().getMessageBufferPool();
+    auto xdrBytes =
+        encodeAuthenticatedMessage(pool, 0, msgBytes, HmacSha256Mac{});
+    mApp.getOverlayManager().getLoadManager().recordSend(
+        mPeerID, msg.type(), xdrBytes->raw_size());
+    sendUnsealedMessage(std::move(xdrBytes), msg.type());
+}
+
+void
+Peer::sendUnsealedMessage(MessageBufferPtr&& xdrBytes, MessageType type)
+{
+    if (mCompressor &&
+        mCompressor->compress(
+            xdrBytes, type,
+            mApp.getOverlayManager().getMessageBufferPool()))
     {
-        amsg.v0().sequence = mSendMacSeq;
-        amsg.v0().mac =
-            hmacSha256(mSendMacKey, xdr::xdr_to_opaque(mSendMacSeq, msg));
-        ++mSendMacSeq;
+        type = COMPRESSED;
     }
-    xdr::msg_ptr xdrBytes(xdr::xdr_to_msg(amsg));
+    sealMessage(xdrBytes, type, mSendMacKey, mSendMacSeq);
     this->sendMessage(std::move(xdrBytes));
 }
 
 void
-Peer::recvMessage(xdr::msg_ptr const& msg)
+Peer::sealMessage(MessageBufferPtr& xdrBytes, MessageType type,
+                  HmacSha256Key const& macKey, uint64_t& macSeq)
+{
+    if (type == HELLO || type == ERROR_MSG)
+    {
+        // sent unauthenticated, with sequence 0 and an empty mac
+        return;
+    }
+
+    // union discriminant (4 bytes), sequence (8), message, mac (32): the mac
+    // covers the sequence and message, fill both in place
+    auto p = reinterpret_cast<uint8_t*>(xdrBytes->data());
+    auto macOffset = xdrBytes->size() - HmacSha256Mac().mac.size();
+    uint64_t sequence = macSeq++;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        p[4 + i] = static_cast<uint8_t>(sequence >> (56 - 8 * i));
+    }
+    auto mac = hmacSha256(macKey, ByteSlice(p + 4, macOffset - 4));
+    std::copy(mac.mac.begin(), mac.mac.end(), p + macOffset);
+}
+
+Peer::SendPriority
+Peer::getSendPriority(MessageType type)
+{
+    switch (type)
+    {
+    case TX_SET:
+    case TX_SET_CHUNK:
+    case GET_TX_SET:
+    case DONT_HAVE:
+        return SEND_PRIORITY_TX_SET;
+    case GET_PEERS:
+    case PEERS:
+    case FLOOD_ADVERT:
+    case FLOOD_DEMAND:
+        return SEND_PRIORITY_FLOOD;
+    case TRANSACTION:
+        return SEND_PRIORITY_TRANSACTION;
+    default:
+        // handshake, SCP messages, quorum sets and SCP state
+        return SEND_PRIORITY_SCP;
+    }
+}
+
+void
+Peer::recvMessage(MessageBufferPtr const& msg)
 {
     if (shouldAbort())
     {
@@ -532,16 +978,19 @@ Peer::recvMessage(xdr::msg_ptr const& msg)
 
     LoadManager::PeerContext loadCtx(mApp, mPeerID);
 
-    CLOG(TRACE, "Overlay") << "received xdr::msg_ptr";
+    CLOG(TRACE, "Overlay") << "received message buffer";
     try
     {
         AuthenticatedMessage am;
-        xdr::xdr_from_msg(msg, am);
+        xdr::xdr_get g(msg->data(), msg->end());
+        xdr::xdr_argpack_archive(g, am);
+        g.done();
         recvMessage(am);
     }
     catch (xdr::xdr_runtime_error& e)
     {
-        CLOG(ERROR, "Overlay") << "received corrupt xdr::msg_ptr " << e.what();
+        CLOG(ERROR, "Overlay") << "received corrupt message buffer "
+                               << e.what();
         mDropInRecvMessageDecodeMeter.Mark();
         drop();
         return;
@@ -574,34 +1023,180 @@ Peer::recvMessage(AuthenticatedMessage const& msg)
         return;
     }
 
-    if (mState >= GOT_HELLO && msg.v0().message.type() != ERROR_MSG)
+    if (mState >= GOT_HELLO && msg.v0().message.type() != ERROR_MSG &&
+        !checkRecvMac(
+            msg.v0().sequence, msg.v0().mac,
+            xdr::xdr_to_opaque(msg.v0().sequence, msg.v0().message)))
     {
-        if (msg.v0().sequence != mRecvMacSeq)
-        {
-            CLOG(ERROR, "Overlay") << "Unexpected message-auth sequence";
-            mDropInRecvMessageSeqMeter.Mark();
-            ++mRecvMacSeq;
-            drop(ERR_AUTH, "unexpected auth sequence");
-            return;
-        }
+        return;
+    }
+    recvMessage(msg.v0().message);
+}
+
+bool
+Peer::checkRecvMac(uint64_t sequence, HmacSha256Mac const& mac,
+                   ByteSlice const& macBytes)
+{
+    auto res = verifyRecvMac(sequence, mac, macBytes, mRecvMacKey, mRecvMacSeq);
+    if (res != RECV_OK)
+    {
+        recvFailed(res);
+        return false;
+    }
+    return true;
+}
+
+Peer::RecvResult
+Peer::verifyRecvMac(uint64_t sequence, HmacSha256Mac const& mac,
+                    ByteSlice const& macBytes, HmacSha256Key const& macKey,
+                    uint64_t& macSeq)
+{
+    if (sequence != macSeq++)
+    {
+        return RECV_BAD_SEQUENCE;
+    }
+    if (!hmacSha256Verify(mac, macKey, macBytes))
+    {
+        return RECV_BAD_MAC;
+    }
+    return RECV_OK;
+}
+
+Peer::RecvResult
+Peer::verifyEncodedMac(ByteSlice const& bytes, HmacSha256Key const& macKey,
+                       uint64_t& macSeq)
+{
+    // see encodeAuthenticatedMessage
+    size_t const headerSize = 4 + 8;
+    HmacSha256Mac mac;
+    if (bytes.size() < headerSize + mac.mac.size())
+    {
+        return RECV_CORRUPT;
+    }
+    auto p = bytes.data();
+    uint64_t sequence = 0;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        sequence = (sequence << 8) | p[4 + i];
+    }
+    auto macOffset = bytes.size() - mac.mac.size();
+    std::copy(p + macOffset, p + bytes.size(), mac.mac.begin());
+    return verifyRecvMac(sequence, mac, ByteSlice(p + 4, macOffset - 4),
+                         macKey, macSeq);
+}
+
+bool
+Peer::getFloodedMessageHash(ByteSlice const& bytes, MessageType& type,
+                            uint64_t& hash)
+{
+    // discriminant and sequence, then the message, starting with its type,
+    // then the mac
+    size_t const headerSize = 4 + 8;
+    size_t const macSize = HmacSha256Mac().mac.size();
+    if (bytes.size() < headerSize + 4 + macSize)
+    {
+        return false;
+    }
+    auto p = bytes.data() + headerSize;
+    uint32_t t = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+                 (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    if (t != TRANSACTION && t != SCP_MESSAGE)
+    {
+        return false;
+    }
+    type = static_cast<MessageType>(t);
+
+    // only lives in memory, so a per-process key is fine and keeps peers
+    // from choosing messages that collide
+    static std::vector<uint8_t> const sipKey =
+        randomBytes(crypto_shorthash_KEYBYTES);
+    static_assert(crypto_shorthash_BYTES == sizeof(hash),
+                  "unexpected hash size");
+    crypto_shorthash(reinterpret_cast<unsigned char*>(&hash), p,
+                     bytes.size() - headerSize - macSize, sipKey.data());
+    return true;
+}
+
+Peer::RecvResult
+Peer::decodeAndVerify(ByteSlice const& bytes, bool authenticated,
+                      HmacSha256Key const& macKey, uint64_t& macSeq,
+                      StellarMessage& msg)
+{
+    AuthenticatedMessage am;
+    try
+    {
+        xdr::xdr_get g(bytes.data(), bytes.data() + bytes.size());
+        xdr::xdr_argpack_archive(g, am);
+        g.done();
+    }
+    catch (xdr::xdr_runtime_error&)
+    {
+        return RECV_CORRUPT;
+    }
 
-        if (!hmacSha256Verify(
-                msg.v0().mac, mRecvMacKey,
-                xdr::xdr_to_opaque(msg.v0().sequence, msg.v0().message)))
+    if (authenticated && am.v0().message.type() != ERROR_MSG)
+    {
+        // the mac covers the encoded sequence and message, which follow the
+        // discriminant in what was received, see encodeAuthenticatedMessage
+        size_t const headerSize = 4;
+        auto macBytes =
+            ByteSlice(bytes.data() + headerSize,
+                      bytes.size() - headerSize - am.v0().mac.mac.size());
+        auto res = verifyRecvMac(am.v0().sequence, am.v0().mac, macBytes,
+                                 macKey, macSeq);
+        if (res != RECV_OK)
         {
-            CLOG(ERROR, "Overlay") << "Message-auth check failed";
-            mDropInRecvMessageMacMeter.Mark();
-            ++mRecvMacSeq;
-            drop(ERR_AUTH, "unexpected MAC");
-            return;
+            return res;
         }
-        ++mRecvMacSeq;
     }
-    recvMessage(msg.v0().message);
+    msg = std::move(am.v0().message);
+    return RECV_OK;
+}
+
+void
+Peer::recvFailed(RecvResult res)
+{
+    switch (res)
+    {
+    case RECV_OK:
+        break;
+    case RECV_CORRUPT:
+        CLOG(ERROR, "Overlay") << "recvMessage got a corrupt xdr";
+        mDropInRecvMessageDecodeMeter.Mark();
+        drop(ERR_DATA, "received corrupt XDR");
+        break;
+    case RECV_BAD_SEQUENCE:
+        CLOG(ERROR, "Overlay") << "Unexpected message-auth sequence";
+        mDropInRecvMessageSeqMeter.Mark();
+        drop(ERR_AUTH, "unexpected auth sequence");
+        break;
+    case RECV_BAD_MAC:
+        CLOG(ERROR, "Overlay") << "Message-auth check failed";
+        mDropInRecvMessageMacMeter.Mark();
+        drop(ERR_AUTH, "unexpected MAC");
+        break;
+    }
+}
+
+bool
+Peer::decodeAuthenticatedMessage(ByteSlice const& bytes, StellarMessage& msg)
+{
+    auto start = mApp.getClock().now();
+    auto res = decodeAndVerify(bytes, mState >= GOT_HELLO, mRecvMacKey,
+                               mRecvMacSeq, msg);
+    if (res != RECV_OK)
+    {
+        recvFailed(res);
+        return false;
+    }
+    mApp.getOverlayManager().getLoadManager().recordRecv(
+        mPeerID, msg.type(), bytes.size(), mApp.getClock().now() - start);
+    return true;
 }
 
 void
-Peer::recvMessage(StellarMessage const& stellarMsg)
+Peer::recvMessage(StellarMessage const& stellarMsg,
+                  ByteSlice const& envelopeBytes)
 {
     if (shouldAbort())
     {
@@ -629,6 +1224,15 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
     assert(isAuthenticated() || stellarMsg.type() == HELLO ||
            stellarMsg.type() == AUTH || stellarMsg.type() == ERROR_MSG);
 
+    if (auto capture = mApp.getOverlayManager().getMessageCapture())
+    {
+        if (isAuthenticated())
+        {
+            capture->capture(mPeerID, stellarMsg);
+        }
+    }
+
+    auto start = mApp.getClock().now();
     switch (stellarMsg.type())
     {
     case ERROR_MSG:
@@ -690,7 +1294,7 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
     case TRANSACTION:
     {
         auto t = mRecvTransactionTimer.TimeScope();
-        recvTransaction(stellarMsg);
+        recvTransaction(stellarMsg, envelopeBytes);
     }
     break;
 
@@ -721,12 +1325,63 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
         recvGetSCPState(stellarMsg);
     }
     break;
+
+    case FLOOD_ADVERT:
+    {
+        auto t = mRecvFloodAdvertTimer.TimeScope();
+        recvFloodAdvert(stellarMsg);
+    }
+    break;
+
+    case FLOOD_DEMAND:
+    {
+        auto t = mRecvFloodDemandTimer.TimeScope();
+        recvFloodDemand(stellarMsg);
+    }
+    break;
+
+    case SCP_MESSAGE_COMPACT:
+    {
+        auto t = mRecvSCPMessageCompactTimer.TimeScope();
+        recvSCPMessageCompact(stellarMsg);
+    }
+    break;
+
+    case TX_SET_CHUNK:
+    {
+        auto t = mRecvTxSetChunkTimer.TimeScope();
+        recvTxSetChunk(stellarMsg);
+    }
+    break;
+
+    case PING:
+    {
+        auto t = mRecvPingTimer.TimeScope();
+        recvPing(stellarMsg);
+    }
+    break;
+
+    case PONG:
+    {
+        auto t = mRecvPongTimer.TimeScope();
+        recvPong(stellarMsg);
+    }
+    break;
+
+    case COMPRESSED:
+    {
+        recvCompressed(stellarMsg);
+    }
+    break;
     }
+    mApp.getOverlayManager().getLoadManager().recordHandled(
+        mPeerID, stellarMsg.type(), mApp.getClock().now() - start);
 }
 
 void
 Peer::recvDontHave(StellarMessage const& msg)
 {
+    noteFetchReply(msg.dontHave().reqHash, false);
     mApp.getHerder().peerDoesntHave(msg.dontHave().type, msg.dontHave().reqHash,
                                     shared_from_this());
 }
@@ -741,6 +1396,12 @@ Peer::recvGetTxSet(StellarMessage const& msg)
         newMsg.type(TX_SET);
         txSet->toXDR(newMsg.txSet());
 
+        if (txSet->size() > TX_SET_CHUNK_TXS &&
+            mRemoteOverlayVersion >= FIRST_OVERLAY_VERSION_WITH_TX_SET_CHUNKS)
+        {
+            sendTxSetChunks(msg.txSetHash(), newMsg.txSet());
+            return;
+        }
         self->sendMessage(newMsg);
     }
     else
@@ -753,35 +1414,245 @@ void
 Peer::recvTxSet(StellarMessage const& msg)
 {
     TxSetFrame frame(mApp.getNetworkID(), msg.txSet());
+    noteFetchReply(frame.getContentsHash(), true);
     mApp.getHerder().recvTxSet(frame.getContentsHash(), frame);
 }
 
 void
-Peer::recvTransaction(StellarMessage const& msg)
+Peer::sendTxSetChunks(Hash const& txSetHash, TransactionSet const& txSet)
 {
-    TransactionFramePtr transaction = TransactionFrame::makeTransactionFromWire(
-        mApp.getNetworkID(), msg.transaction());
-    if (transaction)
+    auto const& txs = txSet.txs;
+    auto count = (txs.size() + TX_SET_CHUNK_TXS - 1) / TX_SET_CHUNK_TXS;
+    for (size_t i = 0; i < count; ++i)
+    {
+        StellarMessage newMsg;
+        newMsg.type(TX_SET_CHUNK);
+        auto& chunk = newMsg.txSetChunk();
+        chunk.txSetHash = txSetHash;
+        chunk.previousLedgerHash = txSet.previousLedgerHash;
+        chunk.index = static_cast<uint32>(i);
+        chunk.count = static_cast<uint32>(count);
+        auto end = std::min(txs.size(), (i + 1) * TX_SET_CHUNK_TXS);
+        chunk.txs.assign(txs.begin() + i * TX_SET_CHUNK_TXS,
+                         txs.begin() + end);
+        sendMessage(newMsg);
+    }
+}
+
+void
+Peer::recvTxSetChunk(StellarMessage const& msg)
+{
+    auto const& chunk = msg.txSetChunk();
+    auto it = mIncomingTxSets.find(chunk.txSetHash);
+    if (it == mIncomingTxSets.end())
+    {
+        if (mIncomingTxSets.size() >= MAX_INCOMING_TX_SETS)
+        {
+            CLOG(DEBUG, "Overlay") << "recvTxSetChunk ignoring "
+                                   << hexAbbrev(chunk.txSetHash)
+                                   << ", too many sets being received";
+            return;
+        }
+        if (chunk.count == 0 || chunk.count > MAX_TX_SET_CHUNKS)
+        {
+            CLOG(ERROR, "Overlay") << "recvTxSetChunk got a bad chunk count";
+            mDropInRecvMessageDecodeMeter.Mark();
+            drop(ERR_DATA, "bad tx set chunk");
+            return;
+        }
+        it = mIncomingTxSets.emplace(chunk.txSetHash, IncomingTxSet{}).first;
+        auto& incoming = it->second;
+        incoming.mPreviousLedgerHash = chunk.previousLedgerHash;
+        incoming.mReceived.resize(chunk.count, false);
+        incoming.mParts.resize(chunk.count);
+        incoming.mMissing = chunk.count;
+    }
+
+    auto& incoming = it->second;
+    if (chunk.count != incoming.mParts.size() || chunk.index >= chunk.count ||
+        incoming.mReceived[chunk.index] ||
+        !(chunk.previousLedgerHash == incoming.mPreviousLedgerHash))
+    {
+        CLOG(ERROR, "Overlay") << "recvTxSetChunk got an inconsistent chunk";
+        mDropInRecvMessageDecodeMeter.Mark();
+        drop(ERR_DATA, "bad tx set chunk");
+        return;
+    }
+    incoming.mReceived[chunk.index] = true;
+    mApp.getHerder().recvTxSetProgress(chunk.txSetHash);
+
+    // the chunk got decoded with the message; hashing its transactions is
+    // most of what is left, done on a worker thread
+    std::weak_ptr<Peer> weak = shared_from_this();
+    auto& app = mApp;
+    auto txSetHash = chunk.txSetHash;
+    auto index = chunk.index;
+    auto envelopes = std::make_shared<std::vector<TransactionEnvelope>>(
+        chunk.txs.begin(), chunk.txs.end());
+    mApp.getWorkerLanes().post(WorkerLane::CRYPTO, [&app, weak, txSetHash,
+                                                    index, envelopes]() {
+        std::vector<TransactionFramePtr> txs;
+        txs.reserve(envelopes->size());
+        for (auto const& env : *envelopes)
+        {
+            auto tx = TransactionFrame::makeTransactionFromWire(
+                app.getNetworkID(), env);
+            tx->getFullHash();
+            txs.emplace_back(tx);
+        }
+        app.getClock().getIOService().post(
+            [weak, txSetHash, index, txs = std::move(txs)]() mutable {
+                auto self = weak.lock();
+                if (self && !self->shouldAbort())
+                {
+                    self->recvTxSetPart(txSetHash, index, std::move(txs));
+                }
+            });
+    });
+}
+
+void
+Peer::recvTxSetPart(Hash const& txSetHash, uint32_t index,
+                    std::vector<TransactionFramePtr> txs)
+{
+    auto it = mIncomingTxSets.find(txSetHash);
+    if (it == mIncomingTxSets.end())
     {
-        // add it to our current set
-        // and make sure it is valid
-        auto recvRes = mApp.getHerder().recvTransaction(transaction);
+        return;
+    }
+    auto& incoming = it->second;
+    incoming.mParts[index] = std::move(txs);
+    if (--incoming.mMissing != 0)
+    {
+        return;
+    }
 
-        if (recvRes == Herder::TX_STATUS_PENDING ||
-            recvRes == Herder::TX_STATUS_DUPLICATE)
+    TxSetFrame frame(incoming.mPreviousLedgerHash);
+    for (auto const& part : incoming.mParts)
+    {
+        for (auto const& tx : part)
         {
-            // record that this peer sent us this transaction
-            mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
+            frame.add(tx);
+        }
+    }
+    mIncomingTxSets.erase(it);
+    noteFetchReply(frame.getContentsHash(), true);
+    mApp.getHerder().recvTxSet(frame.getContentsHash(), frame);
+}
+
+void
+Peer::recvTransaction(StellarMessage const& msg,
+                      ByteSlice const& envelopeBytes)
+{
+    TransactionFramePtr transaction = TransactionFrame::makeTransactionFromWire(
+        mApp.getNetworkID(), msg.transaction(), envelopeBytes);
+    if (!transaction)
+    {
+        return;
+    }
+
+    // The checks below only warm the signature cache ahead of the herder's
+    // own; signers other than the source accounts' master keys need ledger
+    // state, so nothing is rejected here. The hashes are computed now as
+    // the frame caches them lazily and is about to be shared with a worker.
+    std::vector<PubKeyUtils::SigVerification> sigs;
+    transaction->getFullHash();
+    transaction->addMasterKeySignatureVerifications(sigs);
+    if (sigs.empty() && mPendingTransactions.empty())
+    {
+        admitTransaction(msg, transaction);
+        return;
+    }
 
-            if (recvRes == Herder::TX_STATUS_PENDING)
+    mPendingTransactions.push_back({msg, transaction, false});
+    std::weak_ptr<Peer> weak = shared_from_this();
+    auto& app = mApp;
+    mApp.getWorkerLanes().post(WorkerLane::CRYPTO, [&app, weak, transaction,
+                                                    sigs]() {
+        for (auto const& sig : sigs)
+        {
+            PubKeyUtils::verifySig(sig.mKey, sig.mSignature, sig.mBin);
+        }
+        app.getClock().getIOService().post([weak, transaction]() {
+            auto self = weak.lock();
+            if (!self || self->shouldAbort())
+            {
+                return;
+            }
+            for (auto& p : self->mPendingTransactions)
             {
-                // if it's a new transaction, broadcast it
-                mApp.getOverlayManager().broadcastMessage(msg);
+                if (p.mTx == transaction)
+                {
+                    p.mVerified = true;
+                    break;
+                }
             }
+            self->processVerifiedTransactions();
+        });
+    });
+}
+
+void
+Peer::processVerifiedTransactions()
+{
+    while (!mPendingTransactions.empty() &&
+           mPendingTransactions.front().mVerified)
+    {
+        auto p = std::move(mPendingTransactions.front());
+        mPendingTransactions.pop_front();
+        admitTransaction(p.mMsg, p.mTx);
+    }
+}
+
+void
+Peer::admitTransaction(StellarMessage const& msg,
+                       TransactionFramePtr transaction)
+{
+    if (mApp.getOverlayManager().getTxAdmission().admit(shared_from_this(),
+                                                        msg, transaction))
+    {
+        processTransaction(msg, transaction);
+    }
+}
+
+void
+Peer::processTransaction(StellarMessage const& msg,
+                         TransactionFramePtr transaction)
+{
+    // add it to our current set
+    // and make sure it is valid
+    auto recvRes = mApp.getHerder().recvTransaction(transaction);
+
+    if (recvRes == Herder::TX_STATUS_PENDING ||
+        recvRes == Herder::TX_STATUS_DUPLICATE)
+    {
+        // record that this peer sent us this transaction
+        auto msgBytes = transaction->toStellarMessageBytes();
+        mApp.getOverlayManager().recvFloodedMsg(msg, msgBytes,
+                                                shared_from_this());
+
+        if (recvRes == Herder::TX_STATUS_PENDING)
+        {
+            // if it's a new transaction, broadcast it
+            mApp.getOverlayManager().broadcastMessage(msg, msgBytes);
         }
     }
 }
 
+void
+Peer::recvFloodAdvert(StellarMessage const& msg)
+{
+    mApp.getOverlayManager().recvFloodAdvert(msg.floodAdvert(),
+                                             shared_from_this());
+}
+
+void
+Peer::recvFloodDemand(StellarMessage const& msg)
+{
+    mApp.getOverlayManager().recvFloodDemand(msg.floodDemand(),
+                                             shared_from_this());
+}
+
 void
 Peer::recvGetSCPQuorumSet(StellarMessage const& msg)
 {
@@ -804,6 +1675,7 @@ void
 Peer::recvSCPQuorumSet(StellarMessage const& msg)
 {
     Hash hash = sha256(xdr::xdr_to_opaque(msg.qSet()));
+    noteFetchReply(hash, true);
     mApp.getHerder().recvSCPQuorumSet(hash, msg.qSet());
 }
 
@@ -827,7 +1699,23 @@ Peer::recvSCPMessage(StellarMessage const& msg)
                                 ? mRecvSCPExternalizeTimer.TimeScope()
                                 : (mRecvSCPNominateTimer.TimeScope()))));
 
-    mApp.getHerder().recvSCPEnvelope(envelope);
+    mApp.getHerder().queueSCPEnvelope(envelope);
+}
+
+void
+Peer::recvSCPMessageCompact(StellarMessage const& msg)
+{
+    StellarMessage expanded;
+    expanded.type(SCP_MESSAGE);
+    if (!expandEnvelope(msg.compactEnvelope(), expanded.envelope()))
+    {
+        CLOG(ERROR, "Overlay")
+            << "recvSCPMessageCompact got values not sent before";
+        mDropInRecvMessageDecodeMeter.Mark();
+        drop(ERR_DATA, "unknown compact SCP values");
+        return;
+    }
+    recvSCPMessage(expanded);
 }
 
 void
@@ -835,7 +1723,25 @@ Peer::recvGetSCPState(StellarMessage const& msg)
 {
     uint32 seq = msg.getSCPLedgerSeq();
     CLOG(TRACE, "Overlay") << "get SCP State " << seq;
-    mApp.getHerder().sendSCPStateToPeer(seq, shared_from_this());
+    sendSCPState(seq);
+}
+
+void
+Peer::sendSCPState(uint32 ledgerSeq)
+{
+    auto now = mApp.getClock().now();
+    if (mSCPStateSent && ledgerSeq >= mSCPStateSentSeq &&
+        now - mSCPStateSentTime < SCP_STATE_MIN_INTERVAL)
+    {
+        CLOG(DEBUG, "Overlay") << "ignoring repeated get SCP State "
+                               << ledgerSeq << " from " << toString();
+        mIgnoredGetSCPStateMeter.Mark();
+        return;
+    }
+    mSCPStateSent = true;
+    mSCPStateSentSeq = ledgerSeq;
+    mSCPStateSentTime = now;
+    mApp.getHerder().sendSCPStateToPeer(ledgerSeq, shared_from_this());
 }
 
 void
@@ -898,7 +1804,7 @@ Peer::noteHandshakeSuccessInPeerRecord()
 void
 Peer::recvHello(Hello const& elo)
 {
-    if (mState >= GOT_HELLO)
+    if (mState >= GOT_HELLO || mHelloPending)
     {
         CLOG(ERROR, "Overlay") << "received unexpected HELLO";
         mDropInRecvHelloUnexpectedMeter.Mark();
@@ -906,23 +1812,53 @@ Peer::recvHello(Hello const& elo)
         return;
     }
 
-    auto& peerAuth = mApp.getOverlayManager().getPeerAuth();
-    if (!peerAuth.verifyRemoteAuthCert(elo.peerID, elo.cert))
+    // not worth authenticating
+    if (mApp.getBanManager().isBanned(elo.peerID))
     {
-        CLOG(ERROR, "Overlay") << "failed to verify remote peer auth cert";
-        mDropInRecvHelloCertMeter.Mark();
+        CLOG(ERROR, "Overlay") << "Node is banned";
+        mDropInRecvHelloBanMeter.Mark();
+        // refuse its next connections from there before any handshake, see
+        // PeerDoor
+        auto address = makeAddress(elo.listeningPort);
+        if (mRole == REMOTE_CALLED_US && !address.isEmpty())
+        {
+            mApp.getBanManager().banAddressOf(elo.peerID, address.getIP());
+        }
         drop();
         return;
     }
 
-    if (mApp.getBanManager().isBanned(elo.peerID))
+    mHelloPending = true;
+    std::weak_ptr<Peer> weak = shared_from_this();
+    mApp.getOverlayManager().getPeerAuth().authenticateRemote(
+        elo.peerID, elo.cert, mRole, [weak, elo](bool valid) {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->mHelloPending = false;
+                self->recvAuthenticatedHello(elo, valid);
+                self->resumeRecv();
+            }
+        });
+}
+
+void
+Peer::recvAuthenticatedHello(Hello const& elo, bool valid)
+{
+    if (shouldAbort())
     {
-        CLOG(ERROR, "Overlay") << "Node is banned";
-        mDropInRecvHelloBanMeter.Mark();
+        return;
+    }
+
+    if (!valid)
+    {
+        CLOG(ERROR, "Overlay") << "failed to verify remote peer auth cert";
+        mDropInRecvHelloCertMeter.Mark();
         drop();
         return;
     }
 
+    auto& peerAuth = mApp.getOverlayManager().getPeerAuth();
     mRemoteOverlayMinVersion = elo.overlayMinVersion;
     mRemoteOverlayVersion = elo.overlayVersion;
     mRemoteVersion = elo.versionStr;
@@ -1052,6 +1988,8 @@ Peer::recvAuth(StellarMessage const& msg)
     }
 
     mState = GOT_AUTH;
+    // before anything else is sent, compressed maybe
+    setupCompression(msg.auth().flags);
 
     auto self = shared_from_this();
 
@@ -1070,14 +2008,135 @@ Peer::recvAuth(StellarMessage const& msg)
     }
 
     noteHandshakeSuccessInPeerRecord();
+    // a first round trip time right away, then every PING_PERIOD
+    sendPing();
+    startPingTimer();
 
     // send SCP State
     // remove when all known peers implements the next line
-    mApp.getHerder().sendSCPStateToPeer(0, self);
+    sendSCPState(0);
     // ask for SCP state if not synced
     sendGetScpState(mApp.getLedgerManager().getLastClosedLedgerNum() + 1);
 }
 
+void
+Peer::startPingTimer()
+{
+    if (shouldAbort() ||
+        mRemoteOverlayVersion < FIRST_OVERLAY_VERSION_WITH_PING)
+    {
+        return;
+    }
+
+    std::weak_ptr<Peer> weak = shared_from_this();
+    mPingTimer.expires_from_now(PING_PERIOD);
+    mPingTimer.async_wait(
+        [weak]() {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->sendPing();
+                self->startPingTimer();
+            }
+        },
+        VirtualTimer::onFailureNoop);
+}
+
+void
+Peer::sendPing()
+{
+    if (mPingOutstanding || shouldAbort() ||
+        mRemoteOverlayVersion < FIRST_OVERLAY_VERSION_WITH_PING)
+    {
+        return;
+    }
+    StellarMessage msg;
+    msg.type(PING);
+    msg.pingID() = ++mPingID;
+    mPingSent = mApp.getClock().now();
+    mPingOutstanding = true;
+    sendMessage(msg);
+}
+
+void
+Peer::recvPing(StellarMessage const& msg)
+{
+    StellarMessage newMsg;
+    newMsg.type(PONG);
+    newMsg.pongID() = msg.pingID();
+    sendMessage(newMsg);
+}
+
+void
+Peer::recvPong(StellarMessage const& msg)
+{
+    if (!mPingOutstanding || msg.pongID() != mPingID)
+    {
+        // late or unsolicited
+        return;
+    }
+    mPingOutstanding = false;
+    // at least 1us, zero standing for "not measured"
+    auto rtt = std::max(std::chrono::duration_cast<std::chrono::microseconds>(
+                            mApp.getClock().now() - mPingSent),
+                        std::chrono::microseconds{1});
+    mRTTTimer.Update(rtt);
+    // smoothed like TCP's SRTT
+    mRTT = mRTT.count() == 0 ? rtt : (7 * mRTT + rtt) / 8;
+    mApp.getOverlayManager().recordPeerRTT(mAddress, mRTT);
+}
+
+void
+Peer::setupCompression(int remoteFlags)
+{
+    CompressionFormat fmt;
+    if (!chooseCompressionFormat(getCompressionAuthFlags(), remoteFlags, fmt))
+    {
+        return;
+    }
+    mDecompressor = std::make_shared<MessageDecompressor>(fmt);
+    auto const& cfg = mApp.getConfig();
+    if (cfg.PEER_COMPRESSION)
+    {
+        mCompressor = std::make_shared<MessageCompressor>(
+            fmt, cfg.PEER_COMPRESSION_MIN_BYTES, mApp.getMetrics());
+    }
+}
+
+void
+Peer::recvCompressed(StellarMessage const& msg)
+{
+    if (!mDecompressor)
+    {
+        drop(ERR_DATA, "unexpected COMPRESSED message");
+        return;
+    }
+    StellarMessage inner;
+    std::vector<uint8_t> const* innerBytes;
+    try
+    {
+        innerBytes = &mDecompressor->decompress(msg.compressed(), inner);
+    }
+    catch (std::exception& e)
+    {
+        CLOG(ERROR, "Overlay") << "received corrupt compressed message "
+                               << e.what();
+        mDropInRecvMessageDecodeMeter.Mark();
+        drop(ERR_DATA, "received corrupt compressed message");
+        return;
+    }
+    if (inner.type() == TRANSACTION)
+    {
+        // past the message type
+        recvMessage(inner, ByteSlice(innerBytes->data() + 4,
+                                     innerBytes->size() - 4));
+    }
+    else
+    {
+        recvMessage(inner);
+    }
+}
+
 void
 Peer::recvGetPeers(StellarMessage const& msg)
 {
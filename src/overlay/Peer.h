@@ -5,12 +5,22 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "util/asio.h"
+#include "crypto/ByteSlice.h"
 #include "database/Database.h"
+#include "overlay/FetchStats.h"
+#include "overlay/MessageBufferPool.h"
 #include "overlay/PeerBareAddress.h"
 #include "overlay/StellarXDR.h"
+#include "util/HashOfHash.h"
+#include "util/LatencyHistogram.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
-#include "xdrpp/message.h"
+#include "util/XDREncoder.h"
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace medida
 {
@@ -25,6 +35,10 @@ typedef std::shared_ptr<SCPQuorumSet> SCPQuorumSetPtr;
 
 class Application;
 class LoopbackPeer;
+class MessageCompressor;
+class MessageDecompressor;
+class TransactionFrame;
+typedef std::shared_ptr<TransactionFrame> TransactionFramePtr;
 
 /*
  * Another peer out there that we are connected to
@@ -68,15 +82,87 @@ class Peer : public std::enable_shared_from_this<Peer>,
     uint64_t mSendMacSeq{0};
     uint64_t mRecvMacSeq{0};
 
+    // Set while the HELLO received is being authenticated, see
+    // PeerAuth::authenticateRemote. The messages received meanwhile are held
+    // back by the transport until resumeRecv.
+    bool mHelloPending{false};
+
     std::string mRemoteVersion;
     uint32_t mRemoteOverlayMinVersion;
     uint32_t mRemoteOverlayVersion;
     PeerBareAddress mAddress;
 
+    // Flooded transactions waiting for their signatures to be checked on a
+    // worker thread. They are handed to the herder strictly in arrival order,
+    // so a transaction only leaves once it and all those before it are done.
+    struct PendingTransaction
+    {
+        StellarMessage mMsg;
+        TransactionFramePtr mTx;
+        bool mVerified;
+    };
+    std::deque<PendingTransaction> mPendingTransactions;
+
+    // Item fetch requests sent to this peer and not answered yet, with the
+    // time they were sent, to time the answers into mFetchStats.
+    std::unordered_map<Hash, VirtualClock::time_point> mFetchRequests;
+    FetchStats mFetchStats;
+
+    // Transaction hashes waiting to be sent in a FLOOD_ADVERT, see
+    // queueFloodAdvert.
+    std::vector<Hash> mAdvertQueue;
+    VirtualTimer mAdvertTimer;
+    bool mAdvertTimerArmed{false};
+
+    // Encodes the messages passed to sendMessage(StellarMessage const&).
+    XDREncoder mSendEncoder;
+
+    // Values of SCP_MESSAGE_COMPACT messages, by id, in each direction: the
+    // last SCP_COMPACT_VALUE_SLOTS ones sent, slot id % SCP_COMPACT_VALUE_SLOTS
+    // holding value id, and the same of those received. Messages are sent and
+    // received in order, so both ends agree on which ids are still held.
+    std::map<Value, uint32_t> mSentValueIDs;
+    std::vector<Value> mSentValues;
+    uint32_t mNextSentValueID{0};
+    std::vector<Value> mRecvValues;
+    uint32_t mNextRecvValueID{0};
+
+    // Transaction sets being received as TX_SET_CHUNK messages, by contents
+    // hash: the parts received, their transactions once made into frames on
+    // a worker thread, and the number of parts not made into frames yet.
+    struct IncomingTxSet
+    {
+        Hash mPreviousLedgerHash;
+        std::vector<bool> mReceived;
+        std::vector<std::vector<TransactionFramePtr>> mParts;
+        size_t mMissing;
+    };
+    std::unordered_map<Hash, IncomingTxSet> mIncomingTxSets;
+
+    // Round trip time probes, see startPingTimer: the id of the last PING
+    // sent and when, whether its PONG is still awaited, and the smoothed
+    // round trip time (0 until the first PONG).
+    VirtualTimer mPingTimer;
+    uint64_t mPingID{0};
+    VirtualClock::time_point mPingSent;
+    bool mPingOutstanding{false};
+    std::chrono::microseconds mRTT{0};
+
+    // Compression of the messages sent (if PEER_COMPRESSION) and received,
+    // set up on authentication, see setupCompression. Transports that seal
+    // or decode messages themselves take them over.
+    std::shared_ptr<MessageCompressor> mCompressor;
+    std::shared_ptr<MessageDecompressor> mDecompressor;
+
     VirtualTimer mIdleTimer;
     VirtualClock::time_point mLastRead;
     VirtualClock::time_point mLastWrite;
 
+    // Last SCP state sent to this peer, see sendSCPState.
+    bool mSCPStateSent{false};
+    uint32 mSCPStateSentSeq{0};
+    VirtualClock::time_point mSCPStateSentTime;
+
     medida::Meter& mMessageRead;
     medida::Meter& mMessageWrite;
     medida::Meter& mByteRead;
@@ -84,25 +170,32 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Meter& mErrorRead;
     medida::Meter& mErrorWrite;
     medida::Meter& mTimeoutIdle;
-
-    medida::Timer& mRecvErrorTimer;
-    medida::Timer& mRecvHelloTimer;
-    medida::Timer& mRecvAuthTimer;
-    medida::Timer& mRecvDontHaveTimer;
-    medida::Timer& mRecvGetPeersTimer;
-    medida::Timer& mRecvPeersTimer;
-    medida::Timer& mRecvGetTxSetTimer;
-    medida::Timer& mRecvTxSetTimer;
-    medida::Timer& mRecvTransactionTimer;
-    medida::Timer& mRecvGetSCPQuorumSetTimer;
-    medida::Timer& mRecvSCPQuorumSetTimer;
-    medida::Timer& mRecvSCPMessageTimer;
-    medida::Timer& mRecvGetSCPStateTimer;
-
-    medida::Timer& mRecvSCPPrepareTimer;
-    medida::Timer& mRecvSCPConfirmTimer;
-    medida::Timer& mRecvSCPNominateTimer;
-    medida::Timer& mRecvSCPExternalizeTimer;
+    medida::Timer& mRTTTimer;
+
+    HistogramTimer mRecvErrorTimer;
+    HistogramTimer mRecvHelloTimer;
+    HistogramTimer mRecvAuthTimer;
+    HistogramTimer mRecvDontHaveTimer;
+    HistogramTimer mRecvGetPeersTimer;
+    HistogramTimer mRecvPeersTimer;
+    HistogramTimer mRecvGetTxSetTimer;
+    HistogramTimer mRecvTxSetTimer;
+    HistogramTimer mRecvTransactionTimer;
+    HistogramTimer mRecvGetSCPQuorumSetTimer;
+    HistogramTimer mRecvSCPQuorumSetTimer;
+    HistogramTimer mRecvSCPMessageTimer;
+    HistogramTimer mRecvGetSCPStateTimer;
+    HistogramTimer mRecvFloodAdvertTimer;
+    HistogramTimer mRecvFloodDemandTimer;
+    HistogramTimer mRecvSCPMessageCompactTimer;
+    HistogramTimer mRecvTxSetChunkTimer;
+    HistogramTimer mRecvPingTimer;
+    HistogramTimer mRecvPongTimer;
+
+    HistogramTimer mRecvSCPPrepareTimer;
+    HistogramTimer mRecvSCPConfirmTimer;
+    HistogramTimer mRecvSCPNominateTimer;
+    HistogramTimer mRecvSCPExternalizeTimer;
 
     medida::Meter& mSendErrorMeter;
     medida::Meter& mSendHelloMeter;
@@ -117,6 +210,14 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Meter& mSendSCPQuorumSetMeter;
     medida::Meter& mSendSCPMessageSetMeter;
     medida::Meter& mSendGetSCPStateMeter;
+    medida::Meter& mSendFloodAdvertMeter;
+    medida::Meter& mSendFloodDemandMeter;
+    medida::Meter& mSendSCPMessageCompactMeter;
+    medida::Meter& mCompactSCPSavedBytesMeter;
+    medida::Meter& mSendTxSetChunkMeter;
+    medida::Meter& mSendPingMeter;
+    medida::Meter& mSendPongMeter;
+    medida::Meter& mIgnoredGetSCPStateMeter;
 
     medida::Meter& mDropInConnectHandlerMeter;
     medida::Meter& mDropInRecvMessageDecodeMeter;
@@ -137,9 +238,49 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Meter& mDropInRecvErrorMeter;
 
     bool shouldAbort() const;
-    void recvMessage(StellarMessage const& msg);
+    // `envelopeBytes`, for a TRANSACTION, is the XDR of its envelope as
+    // received, if the caller has it.
+    void recvMessage(StellarMessage const& msg,
+                     ByteSlice const& envelopeBytes = {nullptr, 0});
     void recvMessage(AuthenticatedMessage const& msg);
-    void recvMessage(xdr::msg_ptr const& xdrBytes);
+    void recvMessage(MessageBufferPtr const& xdrBytes);
+
+    enum RecvResult
+    {
+        RECV_OK,
+        RECV_CORRUPT,
+        RECV_BAD_SEQUENCE,
+        RECV_BAD_MAC
+    };
+
+    // Decodes the encoded AuthenticatedMessage `bytes` into `msg`, checking
+    // its sequence and MAC over the bytes received. Returns false, having
+    // dropped the peer, if the message must not be processed, in which case
+    // `msg` must not be passed on to recvMessage.
+    bool decodeAuthenticatedMessage(ByteSlice const& bytes,
+                                    StellarMessage& msg);
+    bool checkRecvMac(uint64_t sequence, HmacSha256Mac const& mac,
+                      ByteSlice const& macBytes);
+    // Drops the peer for a message that failed decodeAndVerify.
+    void recvFailed(RecvResult res);
+
+    // Same as decodeAuthenticatedMessage given the receiving MAC state
+    // (checked when `authenticated`), touching nothing else of the peer so
+    // that it can run off the main thread.
+    static RecvResult decodeAndVerify(ByteSlice const& bytes,
+                                      bool authenticated,
+                                      HmacSha256Key const& macKey,
+                                      uint64_t& macSeq, StellarMessage& msg);
+    static RecvResult verifyRecvMac(uint64_t sequence,
+                                    HmacSha256Mac const& mac,
+                                    ByteSlice const& macBytes,
+                                    HmacSha256Key const& macKey,
+                                    uint64_t& macSeq);
+    // Same as the authentication part of decodeAndVerify, reading the
+    // sequence and MAC straight from the encoded AuthenticatedMessage.
+    static RecvResult verifyEncodedMac(ByteSlice const& bytes,
+                                       HmacSha256Key const& macKey,
+                                       uint64_t& macSeq);
 
     virtual void recvError(StellarMessage const& msg);
     // returns false if we should drop this peer
@@ -148,15 +289,47 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void recvDontHave(StellarMessage const& msg);
     void recvGetPeers(StellarMessage const& msg);
     void recvHello(Hello const& elo);
+    // the rest of recvHello, once the remote cert is checked
+    void recvAuthenticatedHello(Hello const& elo, bool valid);
     void recvPeers(StellarMessage const& msg);
 
     void recvGetTxSet(StellarMessage const& msg);
     void recvTxSet(StellarMessage const& msg);
-    void recvTransaction(StellarMessage const& msg);
+    void recvTxSetChunk(StellarMessage const& msg);
+    // The transactions of part `index` of an incoming transaction set.
+    void recvTxSetPart(Hash const& txSetHash, uint32_t index,
+                       std::vector<TransactionFramePtr> txs);
+    void sendTxSetChunks(Hash const& txSetHash, TransactionSet const& txSet);
+    void recvTransaction(StellarMessage const& msg,
+                         ByteSlice const& envelopeBytes);
+    // hands `transaction` to the herder, unless TxAdmission defers it
+    void admitTransaction(StellarMessage const& msg,
+                          TransactionFramePtr transaction);
+    void processTransaction(StellarMessage const& msg,
+                            TransactionFramePtr transaction);
+    void processVerifiedTransactions();
     void recvGetSCPQuorumSet(StellarMessage const& msg);
     void recvSCPQuorumSet(StellarMessage const& msg);
     void recvSCPMessage(StellarMessage const& msg);
+    void recvSCPMessageCompact(StellarMessage const& msg);
     void recvGetSCPState(StellarMessage const& msg);
+    // Sends our SCP state from ledgerSeq on, unless this peer got it (or
+    // more) less than SCP_STATE_MIN_INTERVAL ago.
+    void sendSCPState(uint32 ledgerSeq);
+    void recvFloodAdvert(StellarMessage const& msg);
+    void recvFloodDemand(StellarMessage const& msg);
+    void recvPing(StellarMessage const& msg);
+    void recvPong(StellarMessage const& msg);
+    void recvCompressed(StellarMessage const& msg);
+
+    // Sets up mCompressor and mDecompressor with the AuthFlags of the AUTH
+    // received from the peer.
+    void setupCompression(int remoteFlags);
+
+    // Sends a PING every PING_PERIOD, unless the last one is still
+    // unanswered, to peers that understand it.
+    void startPingTimer();
+    void sendPing();
 
     void sendHello();
     void sendAuth();
@@ -164,30 +337,108 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void sendDontHave(MessageType type, uint256 const& itemID);
     void sendPeers();
 
+    void noteFetchRequest(Hash const& itemID);
+    void noteFetchReply(Hash const& itemID, bool had);
+
+    void flushFloodAdverts();
+
+    // Fills `res` with `envelope` for an SCP_MESSAGE_COMPACT to this peer,
+    // assigning ids to the values it has not got yet. Returns false if the
+    // envelope has too many values to be sent that way.
+    bool compactEnvelope(SCPEnvelope const& envelope, CompactSCPEnvelope& res);
+    // The reverse, for an SCP_MESSAGE_COMPACT received; returns false if it
+    // does not follow the values received so far.
+    bool expandEnvelope(CompactSCPEnvelope const& compact, SCPEnvelope& res);
+
     // NB: This is a move-argument because the write-buffer has to travel
     // with the write-request through the async IO system, and we might have
     // several queued at once. We have carefully arranged this to not copy
-    // data more than the once necessary into this buffer, but it can't be
-    // put in a reused/non-owned buffer without having to buffer/queue
-    // messages somewhere else. The async write request will point _into_
-    // this owned buffer. This is really the best we can do.
-    virtual void sendMessage(xdr::msg_ptr&& xdrBytes) = 0;
+    // data more than the once necessary into this buffer, which is owned by
+    // the message until written and only then goes back to the
+    // MessageBufferPool to be reused. The async write request will point
+    // _into_ it.
+    virtual void sendMessage(MessageBufferPtr&& xdrBytes) = 0;
+    // Same, given an encoded AuthenticatedMessage whose sequence and mac are
+    // still to be filled in by sealMessage. Seals it right away and sends it
+    // in order by default; a transport may instead seal messages as it
+    // writes them, so that it can reorder or drop them.
+    virtual void sendUnsealedMessage(MessageBufferPtr&& xdrBytes,
+                                     MessageType type);
+    // Fills in the sequence and mac of an unsealed message of type `type`,
+    // if it is sent authenticated.
+    static void sealMessage(MessageBufferPtr& xdrBytes, MessageType type,
+                            HmacSha256Key const& macKey, uint64_t& macSeq);
     virtual void
     connected()
     {
     }
 
+    // Processes the messages held back while mHelloPending.
+    virtual void
+    resumeRecv()
+    {
+    }
+
     virtual AuthCert getAuthCert();
     virtual PeerBareAddress makeAddress(int remoteListeningPort) const = 0;
 
     void startIdleTimer();
     void idleTimerExpired(asio::error_code const& error);
+    // Called before checking for an idle timeout, to bring mLastRead and
+    // mLastWrite up to date in peers that only hear of their I/O later.
+    virtual void
+    refreshLastIO()
+    {
+    }
     size_t getIOTimeoutSeconds() const;
 
     // helper method to acknownledge that some bytes were received
     void receivedBytes(size_t byteCount, bool gotFullMessage);
 
   public:
+    // Classes of outbound messages, written in this order by transports that
+    // order them; see getSendPriority.
+    enum SendPriority
+    {
+        // handshake, SCP messages and their quorum sets, SCP state
+        SEND_PRIORITY_SCP,
+        SEND_PRIORITY_TX_SET,
+        // peers, transaction adverts and demands
+        SEND_PRIORITY_FLOOD,
+        // flooded transactions, which may be dropped under backpressure
+        SEND_PRIORITY_TRANSACTION,
+        SEND_PRIORITY_COUNT
+    };
+    static SendPriority getSendPriority(MessageType type);
+
+    // If the encoded AuthenticatedMessage `bytes` holds a flooded message
+    // (TRANSACTION or SCP_MESSAGE), sets `type` and `hash` to its type and a
+    // short hash of its encoding, which does not depend on the sequence or
+    // MAC, and returns true.
+    static bool getFloodedMessageHash(ByteSlice const& bytes,
+                                      MessageType& type, uint64_t& hash);
+
+    // First overlay version that understands FLOOD_ADVERT and FLOOD_DEMAND.
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_FLOOD_ADVERTS = 8;
+    // Hashes sent in one FLOOD_ADVERT, unless the period below elapses first.
+    static size_t const FLOOD_ADVERT_BATCH_SIZE = 100;
+    static std::chrono::milliseconds const FLOOD_ADVERT_PERIOD;
+    // First overlay version that understands SCP_MESSAGE_COMPACT.
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_COMPACT_SCP = 9;
+    // First overlay version that understands TX_SET_CHUNK.
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_TX_SET_CHUNKS = 10;
+    // Transactions sent in one TX_SET_CHUNK; larger transaction sets are
+    // sent in chunks to peers that understand them.
+    static size_t const TX_SET_CHUNK_TXS = 500;
+    // Transaction sets received in chunks at once, and most chunks of one.
+    static size_t const MAX_INCOMING_TX_SETS = 4;
+    static uint32_t const MAX_TX_SET_CHUNKS = 1000;
+    // First overlay version that understands PING and PONG.
+    static uint32_t const FIRST_OVERLAY_VERSION_WITH_PING = 11;
+    static std::chrono::seconds const PING_PERIOD;
+    // Repeated GET_SCP_STATE requests closer than this are ignored.
+    static std::chrono::seconds const SCP_STATE_MIN_INTERVAL;
+
     Peer(Application& app, PeerRole role);
 
     Application&
@@ -201,7 +452,49 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void sendGetPeers();
     void sendGetScpState(uint32 ledgerSeq);
 
+    // True if transactions are flooded to this peer by advertising their
+    // hashes for it to demand, rather than by sending them whole: when
+    // Config::FLOOD_TX_PULL_MODE is set and the peer understands it.
+    bool useFloodAdverts() const;
+    // Adds the hash of a TRANSACTION message to the next FLOOD_ADVERT.
+    void queueFloodAdvert(Hash const& txMsgHash);
+    void sendFloodDemand(std::vector<Hash> const& txMsgHashes);
+
+    // True if SCP messages are sent to this peer as SCP_MESSAGE_COMPACT:
+    // when Config::COMPACT_SCP_MESSAGES is set and the peer understands it.
+    bool useCompactSCPMessages() const;
+
+    // Outbound messages queued (including any being written), their total
+    // size, and the bytes currently being written; 0 for peers without a
+    // write queue of their own.
+    virtual size_t
+    getWriteQueueSize() const
+    {
+        return 0;
+    }
+    virtual size_t
+    getWriteQueueBytes() const
+    {
+        return 0;
+    }
+    virtual size_t
+    getBytesInFlight() const
+    {
+        return 0;
+    }
+
     void sendMessage(StellarMessage const& msg);
+    // Same, given the XDR encoding of `msg`, so that a message sent to many
+    // peers only needs encoding once; see Floodgate::broadcast.
+    void sendMessage(StellarMessage const& msg, ByteSlice const& msgBytes);
+
+    // Encodes AuthenticatedMessage v0 {sequence, message, mac} around an
+    // already encoded message, without decoding or copying it as XDR, into a
+    // buffer from `pool`.
+    static MessageBufferPtr
+    encodeAuthenticatedMessage(MessageBufferPool& pool, uint64_t sequence,
+                               ByteSlice const& msgBytes,
+                               HmacSha256Mac const& mac);
 
     PeerRole
     getRole() const
@@ -250,6 +543,20 @@ class Peer : public std::enable_shared_from_this<Peer>,
 
     std::string toString();
 
+    FetchStats const&
+    getFetchStats() const
+    {
+        return mFetchStats;
+    }
+
+    // Smoothed round trip time measured with PING messages, or 0 if none
+    // was answered yet.
+    std::chrono::microseconds
+    getRTT() const
+    {
+        return mRTT;
+    }
+
     // These exist mostly to be overridden in TCPPeer and callable via
     // shared_ptr<Peer> as a captured shared_from_this().
     virtual void connectHandler(asio::error_code const& ec);
@@ -260,12 +567,7 @@ class Peer : public std::enable_shared_from_this<Peer>,
     }
 
     virtual void
-    readHeaderHandler(asio::error_code const& error, size_t bytes_transferred)
-    {
-    }
-
-    virtual void
-    readBodyHandler(asio::error_code const& error, size_t bytes_transferred)
+    readHandler(asio::error_code const& error, size_t bytes_transferred)
     {
     }
 
@@ -279,5 +581,6 @@ class Peer : public std::enable_shared_from_this<Peer>,
     }
 
     friend class LoopbackPeer;
+    friend class TxAdmission;
 };
 }
@@ -10,9 +10,14 @@
 #include "main/Application.h"
 #include "main/Config.h"
 #include "util/Logging.h"
+#include "util/WorkerLanes.h"
+#include "overlay/OverlayManager.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
 namespace stellar
 {
 
@@ -34,12 +39,26 @@ makeAuthCert(Application& app, Curve25519Public const& pub)
     return cert;
 }
 
+static bool
+verifyAuthCertSig(Hash const& networkID, NodeID const& remoteNode,
+                  AuthCert const& cert)
+{
+    auto hash = sha256(xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_AUTH,
+                                          cert.expiration, cert.pubkey));
+    return PubKeyUtils::verifySig(remoteNode, cert.sig, hash);
+}
+
 PeerAuth::PeerAuth(Application& app)
     : mApp(app)
     , mECDHSecretKey(EcdhRandomSecret())
     , mECDHPublicKey(EcdhDerivePublic(mECDHSecretKey))
     , mCert(makeAuthCert(app, mECDHPublicKey))
     , mSharedKeyCache(0xffff)
+    , mVerifiedCertCache(0xffff)
+    , mCertCacheHit(app.getMetrics().NewMeter(
+          {"overlay", "auth-cert-cache", "hit"}, "cert"))
+    , mCertCacheMiss(app.getMetrics().NewMeter(
+          {"overlay", "auth-cert-cache", "miss"}, "cert"))
 {
 }
 
@@ -54,21 +73,86 @@ PeerAuth::getAuthCert()
 }
 
 bool
-PeerAuth::verifyRemoteAuthCert(NodeID const& remoteNode, AuthCert const& cert)
+PeerAuth::isCertVerified(NodeID const& remoteNode, AuthCert const& cert)
+{
+    if (!mVerifiedCertCache.exists(remoteNode))
+    {
+        return false;
+    }
+    // the signature covers nothing else than these
+    auto const& verified = mVerifiedCertCache.get(remoteNode);
+    return verified.expiration == cert.expiration &&
+           verified.pubkey == cert.pubkey;
+}
+
+void
+PeerAuth::authenticateRemote(NodeID const& remoteNode, AuthCert const& cert,
+                             Peer::PeerRole role,
+                             std::function<void(bool valid)> done)
 {
+    auto& mainIO = mApp.getClock().getIOService();
     if (cert.expiration < mApp.timeNow())
     {
         CLOG(ERROR, "Overlay")
             << "PeerAuth cert expired: "
             << "expired= " << cert.expiration << ", now=" << mApp.timeNow();
-        return false;
+        mainIO.post([done]() { done(false); });
+        return;
     }
-    auto hash = sha256(xdr::xdr_to_opaque(
-        mApp.getNetworkID(), ENVELOPE_TYPE_AUTH, cert.expiration, cert.pubkey));
 
-    CLOG(DEBUG, "Overlay") << "PeerAuth verifying cert hash: "
-                           << hexAbbrev(hash);
-    return PubKeyUtils::verifySig(remoteNode, cert.sig, hash);
+    bool certVerified = isCertVerified(remoteNode, cert);
+    (certVerified ? mCertCacheHit : mCertCacheMiss).Mark();
+    bool haveSharedKey =
+        mSharedKeyCache.exists(PeerSharedKeyId{cert.pubkey, role});
+    if (certVerified && haveSharedKey)
+    {
+        mainIO.post([done]() { done(true); });
+        return;
+    }
+
+    auto& app = mApp;
+    auto networkID = mApp.getNetworkID();
+    auto localSecret = mECDHSecretKey;
+    auto localPublic = mECDHPublicKey;
+    auto work = [&app, &mainIO, networkID, localSecret, localPublic,
+                 remoteNode, cert, role, done, certVerified,
+                 haveSharedKey]() {
+        bool valid =
+            certVerified || verifyAuthCertSig(networkID, remoteNode, cert);
+        HmacSha256Key sharedKey;
+        if (valid && !haveSharedKey)
+        {
+            sharedKey = EcdhDeriveSharedKey(localSecret, localPublic,
+                                            cert.pubkey,
+                                            role == Peer::WE_CALLED_REMOTE);
+        }
+        mainIO.post([&app, remoteNode, cert, role, done, valid, sharedKey,
+                     haveSharedKey]() {
+            // the caches are only touched from the main thread
+            auto& auth = app.getOverlayManager().getPeerAuth();
+            if (valid)
+            {
+                auth.mVerifiedCertCache.put(remoteNode, cert);
+                if (!haveSharedKey)
+                {
+                    auth.mSharedKeyCache.put(
+                        PeerSharedKeyId{cert.pubkey, role}, sharedKey);
+                }
+            }
+            done(valid);
+        });
+    };
+
+    // with a virtual clock, time would skip ahead while the main thread
+    // idles waiting for the worker, past the handshake timeout
+    if (mApp.getClock().getMode() == VirtualClock::REAL_TIME)
+    {
+        mApp.getWorkerLanes().post(WorkerLane::CRYPTO, work);
+    }
+    else
+    {
+        work();
+    }
 }
 
 HmacSha256Key
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "crypto/ECDH.h"
+#include "crypto/SecretKey.h"
 #include "overlay/Peer.h"
 #include "overlay/PeerSharedKeyId.h"
 #include "util/lrucache.hpp"
 #include "xdr/Stellar-types.h"
 
+#include <functional>
+
 // Copyright 2015 Stellar Development Foundation and contributors. Licensed
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
@@ -31,15 +34,31 @@ class PeerAuth
     AuthCert mCert;
 
     cache::lru_cache<PeerSharedKeyId, HmacSha256Key> mSharedKeyCache;
+    // last cert of each remote node whose signature checked out; a cert
+    // with the same expiration and key needs no checking again
+    cache::lru_cache<NodeID, AuthCert> mVerifiedCertCache;
+
+    medida::Meter& mCertCacheHit;
+    medida::Meter& mCertCacheMiss;
 
     HmacSha256Key getSharedKey(Curve25519Public const& remotePublic,
                                Peer::PeerRole role);
+    bool isCertVerified(NodeID const& remoteNode, AuthCert const& cert);
 
   public:
     PeerAuth(Application& app);
 
     AuthCert getAuthCert();
-    bool verifyRemoteAuthCert(NodeID const& remoteNode, AuthCert const& cert);
+
+    // Checks `cert`, as sent by `remoteNode`, and derives the shared key
+    // with its ECDH public key, then calls `done` on the main thread with
+    // whether the cert is valid (the MAC keys of the session then come from
+    // the cache). With a real time clock, the signature check and the key
+    // agreement run on a worker thread, unless cached already, so that a
+    // burst of handshakes does not hold up the main thread.
+    void authenticateRemote(NodeID const& remoteNode, AuthCert const& cert,
+                            Peer::PeerRole role,
+                            std::function<void(bool valid)> done);
 
     HmacSha256Key getSendingMacKey(Curve25519Public const& remotePublic,
                                    uint256 const& localNonce,
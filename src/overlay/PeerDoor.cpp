@@ -6,9 +6,13 @@
 #include "Peer.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "overlay/BanManager.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/TCPPeer.h"
 #include "util/Logging.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include <algorithm>
 #include <memory>
 
 namespace stellar
@@ -17,11 +21,106 @@ namespace stellar
 using asio::ip::tcp;
 using namespace std;
 
+// beyond that many addresses, those whose rate limit is back to full are
+// forgotten
+static const size_t MAX_ACCEPT_BUCKETS = 4096;
+
 PeerDoor::PeerDoor(Application& app)
-    : mApp(app), mAcceptor(mApp.getClock().getIOService())
+    : mApp(app)
+    , mAcceptor(mApp.getOverlayIOService())
+    , mAcceptBucket{double(app.getConfig().PEER_ACCEPT_RATE),
+                    app.getClock().now()}
+    , mAdmitted(app.getMetrics().NewMeter({"overlay", "inbound", "admit"},
+                                          "connection"))
+    , mRejectedFull(app.getMetrics().NewMeter(
+          {"overlay", "inbound", "reject-full"}, "connection"))
+    , mRejectedBanned(app.getMetrics().NewMeter(
+          {"overlay", "inbound", "reject-banned"}, "connection"))
+    , mRejectedRate(app.getMetrics().NewMeter(
+          {"overlay", "inbound", "reject-rate"}, "connection"))
+    , mRejectedIPRate(app.getMetrics().NewMeter(
+          {"overlay", "inbound", "reject-ip-rate"}, "connection"))
 {
 }
 
+bool
+PeerDoor::AcceptBucket::refill(unsigned short rate,
+                               VirtualClock::time_point now)
+{
+    if (now > mRefilled)
+    {
+        std::chrono::duration<double> elapsed = now - mRefilled;
+        mTokens = std::min<double>(rate, mTokens + elapsed.count() * rate);
+        mRefilled = now;
+    }
+    return mTokens >= 1;
+}
+
+bool
+PeerDoor::admit(std::string const& ip)
+{
+    auto const& cfg = mApp.getConfig();
+    if (mApp.getOverlayManager().getPendingPeersCount() >=
+        cfg.MAX_PENDING_CONNECTIONS)
+    {
+        mRejectedFull.Mark();
+        return false;
+    }
+    if (mApp.getBanManager().isAddressBanned(ip))
+    {
+        mRejectedBanned.Mark();
+        return false;
+    }
+
+    auto now = mApp.getClock().now();
+    if (cfg.PEER_ACCEPT_RATE != 0 &&
+        !mAcceptBucket.refill(cfg.PEER_ACCEPT_RATE, now))
+    {
+        mRejectedRate.Mark();
+        return false;
+    }
+    AcceptBucket* ipBucket = nullptr;
+    auto ipRate = cfg.PEER_ACCEPT_RATE_PER_IP;
+    if (ipRate != 0)
+    {
+        if (mAcceptBucketsByIP.size() >= MAX_ACCEPT_BUCKETS)
+        {
+            for (auto it = mAcceptBucketsByIP.begin();
+                 it != mAcceptBucketsByIP.end();)
+            {
+                it->second.refill(ipRate, now);
+                if (it->second.mTokens >= ipRate)
+                {
+                    it = mAcceptBucketsByIP.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+        ipBucket = &mAcceptBucketsByIP
+                        .emplace(ip, AcceptBucket{double(ipRate), now})
+                        .first->second;
+        if (!ipBucket->refill(ipRate, now))
+        {
+            mRejectedIPRate.Mark();
+            return false;
+        }
+    }
+
+    if (cfg.PEER_ACCEPT_RATE != 0)
+    {
+        mAcceptBucket.mTokens -= 1;
+    }
+    if (ipBucket)
+    {
+        ipBucket->mTokens -= 1;
+    }
+    mAdmitted.Mark();
+    return true;
+}
+
 void
 PeerDoor::start()
 {
@@ -40,12 +139,15 @@ PeerDoor::start()
 void
 PeerDoor::close()
 {
-    if (mAcceptor.is_open())
-    {
-        asio::error_code ec;
-        // ignore errors when closing
-        mAcceptor.close(ec);
-    }
+    // on the thread serving the acceptor, see acceptNextPeer
+    mApp.getOverlayIOService().dispatch([this]() {
+        if (mAcceptor.is_open())
+        {
+            asio::error_code ec;
+            // ignore errors when closing
+            mAcceptor.close(ec);
+        }
+    });
 }
 
 void
@@ -57,15 +159,19 @@ PeerDoor::acceptNextPeer()
     }
 
     CLOG(DEBUG, "Overlay") << "PeerDoor acceptNextPeer()";
-    auto sock =
-        make_shared<TCPPeer::SocketType>(mApp.getClock().getIOService());
-    mAcceptor.async_accept(sock->next_layer(),
-                           [this, sock](asio::error_code const& ec) {
-                               if (ec)
-                                   this->acceptNextPeer();
-                               else
-                                   this->handleKnock(sock);
-                           });
+    // accepted on the overlay IO service, which serves the sockets, then
+    // handed to the main thread
+    auto sock = make_shared<TCPPeer::SocketType>(mApp.getOverlayIOService());
+    auto& mainIO = mApp.getClock().getIOService();
+    mAcceptor.async_accept(
+        sock->next_layer(), [this, sock, &mainIO](asio::error_code const& ec) {
+            mainIO.post([this, sock, ec]() {
+                if (ec)
+                    this->acceptNextPeer();
+                else
+                    this->handleKnock(sock);
+            });
+        });
 }
 
 void
@@ -73,10 +179,22 @@ PeerDoor::handleKnock(shared_ptr<TCPPeer::SocketType> socket)
 {
     CLOG(DEBUG, "Overlay") << "PeerDoor handleKnock() @"
                            << mApp.getConfig().PEER_PORT;
-    Peer::pointer peer = TCPPeer::accept(mApp, socket);
-    if (peer)
+    asio::error_code ec;
+    auto ep = socket->next_layer().remote_endpoint(ec);
+    if (!ec && !admit(ep.address().to_string()))
+    {
+        CLOG(DEBUG, "Overlay")
+            << "PeerDoor refusing connection from " << ep.address();
+        // nothing is pending on the socket yet, it can be closed from here
+        socket->next_layer().close(ec);
+    }
+    else
     {
-        mApp.getOverlayManager().addPendingPeer(peer);
+        Peer::pointer peer = TCPPeer::accept(mApp, socket);
+        if (peer)
+        {
+            mApp.getOverlayManager().addPendingPeer(peer);
+        }
     }
     acceptNextPeer();
 }
@@ -6,11 +6,16 @@
 
 #include "util/asio.h"
 #include "TCPPeer.h"
+#include "util/Timer.h"
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 /*
 listens for peer connections.
-When found passes them to the OverlayManagerImpl
+When found passes them to the OverlayManagerImpl, unless closing them right
+away is cheaper than a handshake bound to fail or to hold up the others (see
+admit)
 */
 
 namespace stellar
@@ -24,6 +29,30 @@ class PeerDoor
     Application& mApp;
     asio::ip::tcp::acceptor mAcceptor;
 
+    // Tokens of an accept rate limit, refilled continuously, up to a
+    // second's worth.
+    struct AcceptBucket
+    {
+        double mTokens;
+        VirtualClock::time_point mRefilled;
+
+        // refills up to now, returns whether a token is left
+        bool refill(unsigned short rate, VirtualClock::time_point now);
+    };
+    AcceptBucket mAcceptBucket;
+    std::unordered_map<std::string, AcceptBucket> mAcceptBucketsByIP;
+
+    medida::Meter& mAdmitted;
+    medida::Meter& mRejectedFull;
+    medida::Meter& mRejectedBanned;
+    medida::Meter& mRejectedRate;
+    medida::Meter& mRejectedIPRate;
+
+    // Whether a connection from `ip` is worth a handshake: not once the
+    // pending connections are full, nor from an address of a banned node,
+    // nor beyond the accept rates.
+    bool admit(std::string const& ip);
+
     virtual void acceptNextPeer();
     virtual void handleKnock(std::shared_ptr<TCPPeer::SocketType> pSocket);
 
@@ -5,6 +5,7 @@
 #include "overlay/PeerRecord.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "overlay/PeerTable.h"
 #include "overlay/StellarXDR.h"
 #include "util/Logging.h"
 #include "util/must_use.h"
@@ -93,62 +94,35 @@ PeerRecord::loadPeerRecords(
     }
 }
 
+PeerTable&
+PeerRecord::loadedTable(Database& db)
+{
+    auto& table = db.getPeerTable();
+    table.ensureLoaded(
+        [&db](std::function<void(PeerRecord const&)> f) {
+            auto prep = db.getPreparedStatement(loadPeerRecordSelector);
+            loadPeerRecords(db, prep, [&f](PeerRecord const& pr) {
+                f(pr);
+                return true;
+            });
+        });
+    return table;
+}
+
 optional<PeerRecord>
 PeerRecord::loadPeerRecord(Database& db, PeerBareAddress const& address)
 {
-    std::string sql = loadPeerRecordSelector;
-    sql += "WHERE ip = :v1 AND port = :v2";
-
-    auto prep = db.getPreparedStatement(sql);
-    auto& st = prep.statement();
-
-    auto ip = address.getIP();
-    st.exchange(use(ip));
-    int port32(address.getPort());
-    st.exchange(use(port32));
-
-    optional<PeerRecord> r;
-
-    loadPeerRecords(db, prep, [&r](PeerRecord const& pr) {
-        r = make_optional<PeerRecord>(pr);
-        return false;
-    });
-
-    return r;
+    return loadedTable(db).find(address);
 }
 
 void
-PeerRecord::loadPeerRecords(Database& db, int batchSize,
+PeerRecord::loadPeerRecords(Database& db,
                             VirtualClock::time_point nextAttemptCutoff,
                             std::function<bool(PeerRecord const& pr)> pred)
 {
     try
     {
-        int offset = 0;
-        bool lastRes;
-        do
-        {
-            tm nextAttemptMax = VirtualClock::pointToTm(nextAttemptCutoff);
-
-            std::string sql = loadPeerRecordSelector;
-            sql += "WHERE nextattempt <= :nextattempt ORDER BY nextattempt "
-                   "ASC, numfailures ASC LIMIT :max OFFSET :o";
-
-            auto prep = db.getPreparedStatement(sql);
-            auto& st = prep.statement();
-
-            st.exchange(use(nextAttemptMax));
-            st.exchange(use(batchSize));
-            st.exchange(use(offset));
-
-            lastRes = false;
-
-            loadPeerRecords(db, prep, [&](PeerRecord const& pr) {
-                offset++;
-                lastRes = pred(pr);
-                return lastRes;
-            });
-        } while (lastRes);
+        loadedTable(db).forEachDue(nextAttemptCutoff, pred);
     }
     catch (soci_error& err)
     {
@@ -171,70 +145,93 @@ PeerRecord::setPreferred(bool p)
 bool
 PeerRecord::insertIfNew(Database& db)
 {
-    auto tm = VirtualClock::pointToTm(mNextAttempt);
+    return loadedTable(db).insertIfNew(*this);
+}
 
-    auto other = loadPeerRecord(db, mAddress);
+void
+PeerRecord::storePeerRecord(Database& db)
+{
+    loadedTable(db).store(*this);
+}
 
-    if (other)
+void
+PeerRecord::writePeerRecord(Database& db)
+{
+    auto tm = VirtualClock::pointToTm(mNextAttempt);
+    int flags = (mIsPreferred ? PEER_RECORD_FLAGS_PREFERRED : 0);
+    auto ip = mAddress.getIP();
+    int port = mAddress.getPort();
+
+    auto prep = db.getPreparedStatement("UPDATE peers SET "
+                                        "nextattempt = :v1, "
+                                        "numfailures = :v2, "
+                                        "flags = :v3 "
+                                        "WHERE ip = :v4 AND port = :v5");
+    auto& st = prep.statement();
+    st.exchange(use(tm));
+    st.exchange(use(mNumFailures));
+    st.exchange(use(flags));
+    st.exchange(use(ip));
+    st.exchange(use(port));
+    st.define_and_bind();
     {
-        return false;
+        auto timer = db.getUpdateTimer("peer");
+        st.execute(true);
     }
-    else
+    if (st.get_affected_rows() == 1)
     {
-        auto prep = db.getPreparedStatement(
-            "INSERT INTO peers "
-            "( ip,  port, nextattempt, numfailures, flags) VALUES "
-            "(:v1, :v2,  :v3,         :v4,          :v5)");
-        auto& st = prep.statement();
-        auto ip = mAddress.getIP();
-        st.exchange(use(ip));
-        int port = mAddress.getPort();
-        st.exchange(use(port));
-        st.exchange(use(tm));
-        st.exchange(use(mNumFailures));
-        int flags = (mIsPreferred ? PEER_RECORD_FLAGS_PREFERRED : 0);
-        st.exchange(use(flags));
+        return;
+    }
 
-        st.define_and_bind();
-        {
-            auto timer = db.getInsertTimer("peer");
-            st.execute(true);
-        }
-        return (st.get_affected_rows() == 1);
+    auto insPrep = db.getPreparedStatement(
+        "INSERT INTO peers "
+        "( ip,  port, nextattempt, numfailures, flags) VALUES "
+        "(:v1, :v2,  :v3,         :v4,          :v5)");
+    auto& ins = insPrep.statement();
+    ins.exchange(use(ip));
+    ins.exchange(use(port));
+    ins.exchange(use(tm));
+    ins.exchange(use(mNumFailures));
+    ins.exchange(use(flags));
+    ins.define_and_bind();
+    {
+        auto timer = db.getInsertTimer("peer");
+        ins.execute(true);
+    }
+    if (ins.get_affected_rows() != 1)
+    {
+        throw runtime_error("PeerRecord::writePeerRecord: failed on " +
+                            toString());
     }
 }
 
-void
-PeerRecord::storePeerRecord(Database& db)
+size_t
+PeerRecord::flush(Database& db)
 {
-    if (!insertIfNew(db))
+    auto& table = db.getPeerTable();
+    auto dirty = table.getDirty();
+    if (dirty.empty())
     {
-        auto tm = VirtualClock::pointToTm(mNextAttempt);
-        auto prep = db.getPreparedStatement("UPDATE peers SET "
-                                            "nextattempt = :v1, "
-                                            "numfailures = :v2, "
-                                            "flags = :v3 "
-                                            "WHERE ip = :v4 AND port = :v5");
-        auto& st = prep.statement();
-        st.exchange(use(tm));
-        st.exchange(use(mNumFailures));
-        int flags = (mIsPreferred ? PEER_RECORD_FLAGS_PREFERRED : 0);
-        st.exchange(use(flags));
-        auto ip = mAddress.getIP();
-        st.exchange(use(ip));
-        int port = mAddress.getPort();
-        st.exchange(use(port));
-        st.define_and_bind();
+        return 0;
+    }
+    try
+    {
+        soci::transaction sqltx(db.getSession());
+        for (auto& pr : dirty)
         {
-            auto timer = db.getUpdateTimer("peer");
-            st.execute(true);
-            if (st.get_affected_rows() != 1)
-            {
-                throw runtime_error("PeerRecord::storePeerRecord: failed on " +
-                                    toString());
-            }
+            pr.writePeerRecord(db);
         }
+        sqltx.commit();
+        table.markClean();
+    }
+    catch (std::exception& e)
+    {
+        // kept dirty, tried again on next flush
+        CLOG(ERROR, "Overlay") << "Unable to store peers: " << e.what();
+        return 0;
     }
+    CLOG(DEBUG, "Overlay") << "Stored " << dirty.size() << " peers";
+    return dirty.size();
 }
 
 void
@@ -277,6 +274,7 @@ PeerRecord::toString() const
 void
 PeerRecord::dropAll(Database& db)
 {
+    db.getPeerTable().clear();
     db.getSession() << "DROP TABLE IF EXISTS peers;";
     db.getSession() << kSQLCreateStatement;
 }
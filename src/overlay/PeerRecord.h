@@ -15,6 +15,13 @@ namespace stellar
 {
 using namespace std;
 
+class PeerTable;
+
+/**
+ * A row of the peers table. The table is kept in memory by the Database's
+ * PeerTable: loading and storing records only query the database the first
+ * time, changes are written back by flush.
+ */
 class PeerRecord
 {
   private:
@@ -52,8 +59,10 @@ class PeerRecord
     static optional<PeerRecord> loadPeerRecord(Database& db,
                                                PeerBareAddress const& address);
 
+    // Calls pred on the records whose next attempt is at or before
+    // nextAttemptCutoff, by next attempt then number of failures.
     // pred returns false if we should stop processing entries
-    static void loadPeerRecords(Database& db, int batchSize,
+    static void loadPeerRecords(Database& db,
                                 VirtualClock::time_point nextAttemptCutoff,
                                 std::function<bool(PeerRecord const& pr)> pred);
 
@@ -66,13 +75,17 @@ class PeerRecord
     void setPreferred(bool p);
     bool isPreferred() const;
 
-    // insert record in database if it's a new record
+    // insert record in the peer table if it's a new record
     // returns true if inserted
     bool insertIfNew(Database& db);
 
-    // insert or update record from database
+    // insert or update record in the peer table
     void storePeerRecord(Database& db);
 
+    // write the records changed since the last flush to the database,
+    // returns how many were written
+    static size_t flush(Database& db);
+
     void resetBackOff(VirtualClock& clock);
     void backOff(VirtualClock& clock);
 
@@ -86,6 +99,10 @@ class PeerRecord
     static void
     loadPeerRecords(Database& db, StatementContext& prep,
                     std::function<bool(PeerRecord const&)> peerRecordProcessor);
+    // the peer table, loaded from the database if needed
+    static PeerTable& loadedTable(Database& db);
+    // insert or update record in database
+    void writePeerRecord(Database& db);
     std::chrono::seconds computeBackoff(VirtualClock& clock);
     static const char* kSQLCreateStatement;
 };
@@ -7,6 +7,7 @@
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "overlay/PeerTable.h"
 #include "overlay/StellarXDR.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
@@ -70,6 +71,67 @@ TEST_CASE("toXdr", "[overlay][PeerRecord]")
     }
 }
 
+TEST_CASE("peer table", "[overlay][PeerRecord]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    auto& db = app->getDatabase();
+    auto now = clock.now();
+
+    auto countRows = [&]() {
+        int n = 0;
+        db.getSession() << "SELECT COUNT(*) FROM peers", soci::into(n);
+        return n;
+    };
+    auto dueAddresses = [&](VirtualClock::time_point cutoff) {
+        std::vector<std::string> res;
+        PeerRecord::loadPeerRecords(db, cutoff, [&](PeerRecord const& pr) {
+            res.emplace_back(pr.toString());
+            return true;
+        });
+        return res;
+    };
+
+    PeerRecord later(PeerBareAddress{"1.2.3.4", 1}, now + chrono::seconds(10));
+    PeerRecord failed(PeerBareAddress{"1.2.3.4", 2}, now, 3);
+    PeerRecord good(PeerBareAddress{"1.2.3.4", 3}, now, 1);
+    later.storePeerRecord(db);
+    failed.storePeerRecord(db);
+    good.storePeerRecord(db);
+
+    // by next attempt, then number of failures
+    REQUIRE(dueAddresses(now) ==
+            std::vector<std::string>{"1.2.3.4:3", "1.2.3.4:2"});
+    REQUIRE(dueAddresses(now + chrono::seconds(10)) ==
+            std::vector<std::string>{"1.2.3.4:3", "1.2.3.4:2", "1.2.3.4:1"});
+
+    // rescheduled records move
+    good.backOff(clock);
+    good.storePeerRecord(db);
+    REQUIRE(dueAddresses(now) == std::vector<std::string>{"1.2.3.4:2"});
+
+    // only in memory until flushed
+    REQUIRE(countRows() == 0);
+    REQUIRE(PeerRecord::flush(db) == 3);
+    REQUIRE(countRows() == 3);
+    REQUIRE(PeerRecord::flush(db) == 0);
+
+    failed.mNumFailures = 4;
+    failed.storePeerRecord(db);
+    REQUIRE(PeerRecord::flush(db) == 1);
+    REQUIRE(countRows() == 3);
+
+    SECTION("loaded again from the database")
+    {
+        db.getPeerTable().clear();
+        REQUIRE(db.getPeerTable().size() == 0);
+        auto loaded = PeerRecord::loadPeerRecord(db, failed.getAddress());
+        REQUIRE(loaded);
+        REQUIRE(loaded->mNumFailures == 4);
+        REQUIRE(db.getPeerTable().size() == 3);
+    }
+}
+
 TEST_CASE("private addresses", "[overlay][PeerRecord]")
 {
     PeerBareAddress pa("1.2.3.4", 15);
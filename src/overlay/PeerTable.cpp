@@ -0,0 +1,156 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerTable.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+
+namespace stellar
+{
+
+PeerTable::PeerTable(medida::MetricsRegistry& metrics)
+    : mSize(metrics.NewCounter({"overlay", "memory", "peer-table"}))
+{
+}
+
+PeerTable::Key
+PeerTable::key(PeerBareAddress const& address)
+{
+    return Key{address.getIP(), address.getPort()};
+}
+
+PeerTable::OrderKey
+PeerTable::orderKey(PeerRecord const& pr)
+{
+    return OrderKey{pr.mNextAttempt, pr.mNumFailures, key(pr.getAddress())};
+}
+
+void
+PeerTable::ensureLoaded(
+    std::function<void(std::function<void(PeerRecord const&)>)> loadAll)
+{
+    if (mLoaded)
+    {
+        return;
+    }
+    try
+    {
+        loadAll([this](PeerRecord const& pr) { set(pr); });
+    }
+    catch (...)
+    {
+        clear();
+        throw;
+    }
+    mLoaded = true;
+}
+
+void
+PeerTable::set(PeerRecord const& pr)
+{
+    auto k = key(pr.getAddress());
+    auto it = mRecords.find(k);
+    if (it == mRecords.end())
+    {
+        mRecords.emplace(k, pr);
+    }
+    else
+    {
+        mByNextAttempt.erase(orderKey(it->second));
+        it->second = pr;
+    }
+    mByNextAttempt.emplace(orderKey(pr));
+    mSize.set_count(mRecords.size());
+}
+
+optional<PeerRecord>
+PeerTable::find(PeerBareAddress const& address) const
+{
+    auto it = mRecords.find(key(address));
+    if (it == mRecords.end())
+    {
+        return nullopt<PeerRecord>();
+    }
+    return make_optional<PeerRecord>(it->second);
+}
+
+void
+PeerTable::forEachDue(VirtualClock::time_point nextAttemptCutoff,
+                      std::function<bool(PeerRecord const&)> f)
+{
+    std::set<Key> visited;
+    auto it = mByNextAttempt.begin();
+    while (it != mByNextAttempt.end() &&
+           std::get<0>(*it) <= nextAttemptCutoff)
+    {
+        auto current = *it;
+        auto const& k = std::get<2>(current);
+        if (visited.insert(k).second)
+        {
+            // copied: `f` may replace it
+            auto pr = mRecords.find(k)->second;
+            if (!f(pr))
+            {
+                return;
+            }
+        }
+        it = mByNextAttempt.upper_bound(current);
+    }
+}
+
+bool
+PeerTable::insertIfNew(PeerRecord const& pr)
+{
+    auto k = key(pr.getAddress());
+    if (mRecords.find(k) != mRecords.end())
+    {
+        return false;
+    }
+    set(pr);
+    mDirty.insert(k);
+    return true;
+}
+
+void
+PeerTable::store(PeerRecord const& pr)
+{
+    set(pr);
+    mDirty.insert(key(pr.getAddress()));
+}
+
+std::vector<PeerRecord>
+PeerTable::getDirty() const
+{
+    std::vector<PeerRecord> res;
+    res.reserve(mDirty.size());
+    for (auto const& k : mDirty)
+    {
+        res.emplace_back(mRecords.find(k)->second);
+    }
+    return res;
+}
+
+void
+PeerTable::markClean()
+{
+    mDirty.clear();
+}
+
+void
+PeerTable::clear()
+{
+    mLoaded = false;
+    mRecords.clear();
+    mByNextAttempt.clear();
+    mDirty.clear();
+    mSize.set_count(0);
+}
+
+size_t
+PeerTable::size() const
+{
+    return mRecords.size();
+}
+}
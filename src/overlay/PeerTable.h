@@ -0,0 +1,85 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerRecord.h"
+#include "util/NonCopyable.h"
+
+#include <functional>
+#include <map>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+/**
+ * PeerTable is the Database's copy of the peers table, kept in memory so that
+ * picking peers to connect to and recording connection attempts do not query
+ * the database every time.
+ *
+ * The whole table is loaded the first time it is used. Records are then only
+ * changed in memory and marked dirty; PeerRecord::flush writes the dirty ones
+ * back, which the OverlayManager does periodically and when shutting down.
+ * Like the rest of Database this is main-thread only.
+ */
+class PeerTable : NonMovableOrCopyable
+{
+    typedef std::pair<std::string, unsigned short> Key;
+    // same order as the peers table used to be read in: by next attempt,
+    // then by number of failures
+    typedef std::tuple<VirtualClock::time_point, int, Key> OrderKey;
+
+    static Key key(PeerBareAddress const& address);
+    static OrderKey orderKey(PeerRecord const& pr);
+
+    bool mLoaded{false};
+    std::map<Key, PeerRecord> mRecords;
+    std::set<OrderKey> mByNextAttempt;
+    std::set<Key> mDirty;
+
+    medida::Counter& mSize;
+
+    void set(PeerRecord const& pr);
+
+  public:
+    explicit PeerTable(medida::MetricsRegistry& metrics);
+
+    // Loads the table with `loadAll` (which must call its argument on every
+    // record of the peers table) if it is not loaded yet.
+    void
+    ensureLoaded(std::function<void(std::function<void(PeerRecord const&)>)>
+                     loadAll);
+
+    optional<PeerRecord> find(PeerBareAddress const& address) const;
+
+    // Calls `f` on the records due at `nextAttemptCutoff`, soonest first,
+    // until it returns false. `f` may store records, each record is visited
+    // at most once.
+    void forEachDue(VirtualClock::time_point nextAttemptCutoff,
+                    std::function<bool(PeerRecord const&)> f);
+
+    // Adds `pr` if no record has its address, returns true if it did.
+    bool insertIfNew(PeerRecord const& pr);
+    // Adds or replaces the record of the address of `pr`.
+    void store(PeerRecord const& pr);
+
+    // Records changed since the last markClean.
+    std::vector<PeerRecord> getDirty() const;
+    void markClean();
+
+    // Forgets every record, to be loaded again on next use.
+    void clear();
+
+    size_t size() const;
+};
+}
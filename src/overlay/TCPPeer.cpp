@@ -6,9 +6,11 @@
 #include "database/Database.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "overlay/LoadManager.h"
+#include "overlay/MessageCompression.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerRecord.h"
 #include "overlay/StellarXDR.h"
@@ -16,6 +18,13 @@
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+
 using namespace soci;
 
 namespace stellar
@@ -24,157 +33,590 @@ namespace stellar
 using namespace std;
 
 ///////////////////////////////////////////////////////////////////////
-// TCPPeer
+// TCPPeer::IO
 ///////////////////////////////////////////////////////////////////////
 
-TCPPeer::TCPPeer(Application& app, Peer::PeerRole role,
-                 std::shared_ptr<TCPPeer::SocketType> socket)
-    : Peer(app, role), mSocket(socket)
+struct TCPPeer::IO : public std::enable_shared_from_this<TCPPeer::IO>
+{
+    asio::io_service& mMainIOService;
+    asio::io_service::strand mStrand;
+    std::shared_ptr<SocketType> mSocket;
+    // only locked on the main thread
+    std::weak_ptr<TCPPeer> mPeer;
+
+    // Bytes read but not yet handled are [mReadBegin, mReadEnd); each read
+    // takes as much as the socket has, which may be several messages. Once
+    // mFraming, messages are decoded and authenticated here, with the
+    // receiving MAC state handed over by the peer.
+    std::vector<uint8_t> mReadBuffer;
+    size_t mReadBegin{0};
+    size_t mReadEnd{0};
+    bool mFraming{false};
+    HmacSha256Key mRecvMacKey;
+    uint64_t mRecvMacSeq{0};
+    std::shared_ptr<MessageDecompressor> mDecompressor;
+    // for the envelopes of transactions received
+    MessageBufferPool mBufferPool;
+
+    // Short hashes of the flooded messages last received or sent on this
+    // connection, oldest first: the peer sending one of them again is
+    // authenticated but not decoded, see Peer::getFloodedMessageHash. The
+    // decode cost of other flooded messages gives an estimate of the time
+    // saved.
+    std::unordered_set<uint64_t> mRecentFlooded;
+    std::deque<uint64_t> mRecentFloodedOrder;
+    uint64_t mFloodedDecodeBytes{0};
+    std::chrono::nanoseconds mFloodedDecodeTime{0};
+    medida::Meter& mDuplicateMeter;
+    medida::Meter& mDuplicateBytesMeter;
+    medida::Meter& mDuplicateSavedMeter;
+
+    // Messages waiting to be written, by SendPriority, and those being
+    // written, gathered in mWriteBuffers. Once mSealing, messages are sealed
+    // here as they are taken for writing, with the sending MAC state handed
+    // over by the peer, so that their sequence follows the order in which
+    // they are written and unsent transactions can be dropped.
+    struct Outgoing
+    {
+        MessageBufferPtr mBuf;
+        MessageType mType;
+        bool mSealed;
+    };
+
+    // Messages queued by the main thread, not yet taken in by takeQueued,
+    // and the sending MAC state (and compressor) it hands over. takeQueued
+    // is posted once for all the messages queued while it is pending, and no
+    // buffer is allocated to pass them over.
+    std::mutex mQueuedMutex;
+    std::vector<Outgoing> mQueued;
+    bool mSealingQueued{false};
+    HmacSha256Key mQueuedMacKey;
+    uint64_t mQueuedMacSeq{0};
+    std::shared_ptr<MessageCompressor> mQueuedCompressor;
+    std::vector<Outgoing> mTaken;
+
+    std::array<std::deque<Outgoing>, SEND_PRIORITY_COUNT> mWriteQueues;
+    std::vector<Outgoing> mWriteBatch;
+    std::vector<asio::const_buffer> mWriteBuffers;
+    size_t const mWriteBatchCap;
+    bool mSealing{false};
+    HmacSha256Key mSendMacKey;
+    uint64_t mSendMacSeq{0};
+    // compresses messages as they are sealed, in the order they are written
+    std::shared_ptr<MessageCompressor> mCompressor;
+    size_t mTransactionBytes{0};
+    size_t const mTransactionBytesCap;
+    medida::Meter& mDroppedTransactionMeter;
+    medida::Histogram& mWriteBatchMessagesHistogram;
+    medida::Histogram& mWriteBatchBytesHistogram;
+    bool mWriting{false};
+    bool mDelayedShutdown{false};
+    bool mShutdownScheduled{false};
+
+    // read by the main thread
+    std::atomic<size_t> mWriteQueueSize{0};
+    std::atomic<size_t> mWriteQueueBytes{0};
+    std::atomic<size_t> mWriteBatchBytes{0};
+    std::atomic<bool> mReadSinceIdleCheck{false};
+    std::atomic<bool> mWriteSinceIdleCheck{false};
+
+    IO(Application& app, std::shared_ptr<SocketType> socket);
+
+    // Runs `f` on the main thread, with the peer if it is still alive.
+    template <typename F>
+    void
+    postToPeer(F f)
+    {
+        auto peer = mPeer;
+        mMainIOService.post([peer, f]() {
+            if (auto p = peer.lock())
+            {
+                f(*p);
+            }
+        });
+    }
+
+    void read();
+    void readHandler(asio::error_code const& error, size_t bytes_transferred);
+    void frameMessages(size_t bytes_transferred);
+    void rememberFlooded(uint64_t hash);
+    // Replaces the COMPRESSED message of `r` by the one it holds.
+    RecvResult decompress(Received& r);
+    void startFraming(HmacSha256Key const& macKey, uint64_t macSeq,
+                      std::shared_ptr<MessageDecompressor> decompressor,
+                      std::vector<uint8_t> const& pending);
+
+    // main thread
+    void queue(Outgoing o);
+    void queueSealing(HmacSha256Key const& macKey, uint64_t macSeq,
+                      std::shared_ptr<MessageCompressor> compressor);
+
+    void takeQueued();
+    void enqueue(Outgoing o);
+    void messageSender();
+    void writeHandler(asio::error_code const& error, size_t bytes_transferred);
+    void shutdown();
+    void close();
+};
+
+TCPPeer::IO::IO(Application& app, std::shared_ptr<SocketType> socket)
+    : mMainIOService(app.getClock().getIOService())
+    , mStrand(app.getOverlayIOService())
+    , mSocket(socket)
+    , mBufferPool(app.getOverlayManager().getMessageBufferPool())
+    , mDuplicateMeter(app.getMetrics().NewMeter(
+          {"overlay", "recv", "duplicate-dropped"}, "message"))
+    , mDuplicateBytesMeter(app.getMetrics().NewMeter(
+          {"overlay", "recv", "duplicate-dropped-bytes"}, "byte"))
+    , mDuplicateSavedMeter(app.getMetrics().NewMeter(
+          {"overlay", "recv", "duplicate-saved-decode"}, "nanosecond"))
+    , mWriteBatchCap(app.getConfig().PEER_WRITE_BATCH_BYTES)
+    , mTransactionBytesCap(app.getConfig().PEER_FLOOD_QUEUE_BYTES)
+    , mDroppedTransactionMeter(app.getMetrics().NewMeter(
+          {"overlay", "flood", "send-dropped"}, "message"))
+    , mWriteBatchMessagesHistogram(
+          app.getMetrics().NewHistogram({"overlay", "write", "batch-messages"}))
+    , mWriteBatchBytesHistogram(
+          app.getMetrics().NewHistogram({"overlay", "write", "batch-bytes"}))
 {
 }
 
-TCPPeer::pointer
-TCPPeer::initiate(Application& app, PeerBareAddress const& address)
+void
+TCPPeer::IO::read()
 {
-    assert(address.getType() == PeerBareAddress::Type::IPv4);
+    if (mReadBuffer.empty())
+    {
+        mReadBuffer.resize(READ_BUFFER_SIZE);
+    }
+    assert(mReadEnd < mReadBuffer.size());
 
-    CLOG(DEBUG, "Overlay") << "TCPPeer:initiate"
-                           << " to " << address.toString();
-    assertThreadIsMain();
-    auto socket = make_shared<SocketType>(app.getClock().getIOService());
-    auto result = make_shared<TCPPeer>(app, WE_CALLED_REMOTE, socket);
-    result->mAddress = address;
-    result->startIdleTimer();
-    asio::ip::tcp::endpoint endpoint(
-        asio::ip::address::from_string(address.getIP()), address.getPort());
-    socket->next_layer().async_connect(
-        endpoint, [result](asio::error_code const& error) {
-            asio::error_code ec;
-            if (!error)
+    // read straight from the socket, bypassing the stream's own (small)
+    // read buffer, which nothing else reads from
+    auto self = shared_from_this();
+    mSocket->next_layer().async_read_some(
+        asio::buffer(mReadBuffer.data() + mReadEnd,
+                     mReadBuffer.size() - mReadEnd),
+        mStrand.wrap([self](asio::error_code ec, std::size_t length) {
+            self->readHandler(ec, length);
+        }));
+}
+
+void
+TCPPeer::IO::readHandler(asio::error_code const& error,
+                         size_t bytes_transferred)
+{
+    if (error)
+    {
+        postToPeer([error](TCPPeer& peer) { peer.readHandler(error, 0); });
+        return;
+    }
+
+    mReadSinceIdleCheck = true;
+    mReadEnd += bytes_transferred;
+    if (mFraming)
+    {
+        frameMessages(bytes_transferred);
+        return;
+    }
+
+    // the peer asks for the next read after handling these
+    auto bytes = std::make_shared<std::vector<uint8_t>>(
+        mReadBuffer.begin(), mReadBuffer.begin() + mReadEnd);
+    mReadEnd = 0;
+    postToPeer([bytes](TCPPeer& peer) { peer.recvBytes(*bytes); });
+}
+
+void
+TCPPeer::IO::frameMessages(size_t bytes_transferred)
+{
+    auto msgs = std::make_shared<std::vector<Received>>();
+    auto res = RECV_OK;
+    std::shared_ptr<std::vector<uint8_t>> badHeader;
+    size_t const headerSize = 4;
+    while (mReadEnd - mReadBegin >= headerSize)
+    {
+        auto header = mReadBuffer.data() + mReadBegin;
+        auto length = getIncomingMsgLength(header, true);
+        if (length == 0)
+        {
+            badHeader = std::make_shared<std::vector<uint8_t>>(
+                header, header + headerSize);
+            break;
+        }
+        size_t frameSize = headerSize + length;
+        if (mReadEnd - mReadBegin < frameSize)
+        {
+            if (mReadBuffer.size() < frameSize)
+            {
+                mReadBuffer.resize(frameSize);
+            }
+            break;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        ByteSlice body(header + headerSize, length);
+        Received r;
+        MessageType type;
+        uint64_t hash;
+        bool flooded = getFloodedMessageHash(body, type, hash);
+        if (flooded && mRecentFlooded.find(hash) != mRecentFlooded.end())
+        {
+            res = verifyEncodedMac(body, mRecvMacKey, mRecvMacSeq);
+            if (res != RECV_OK)
+            {
+                break;
+            }
+            r.mMsg.type(type);
+            r.mDuplicate = true;
+            mDuplicateMeter.Mark();
+            mDuplicateBytesMeter.Mark(frameSize);
+            if (mFloodedDecodeBytes != 0)
             {
-                asio::ip::tcp::no_delay nodelay(true);
-                result->mSocket->next_layer().set_option(nodelay, ec);
+                mDuplicateSavedMeter.Mark(static_cast<uint64_t>(
+                    double(mFloodedDecodeTime.count()) * length /
+                    mFloodedDecodeBytes));
             }
-            else
+        }
+        else
+        {
+            res = decodeAndVerify(body, true, mRecvMacKey, mRecvMacSeq,
+                                  r.mMsg);
+            if (res != RECV_OK)
             {
-                ec = error;
+                break;
             }
+            if (r.mMsg.type() == COMPRESSED)
+            {
+                res = decompress(r);
+                if (res != RECV_OK)
+                {
+                    break;
+                }
+            }
+            else if (r.mMsg.type() == TRANSACTION)
+            {
+                // after the discriminant, the sequence and the message type,
+                // before the mac; kept so that it is not encoded again
+                size_t const offset = 4 + 8 + 4;
+                size_t const macSize = HmacSha256Mac().mac.size();
+                r.mEnvelope = mBufferPool.acquire(length - offset - macSize);
+                std::copy(body.begin() + offset, body.end() - macSize,
+                          r.mEnvelope->data());
+            }
+            if (flooded)
+            {
+                rememberFlooded(hash);
+                mFloodedDecodeBytes += length;
+                mFloodedDecodeTime += std::chrono::steady_clock::now() - start;
+            }
+        }
+        r.mBytes = frameSize;
+        r.mDecodeTime = std::chrono::steady_clock::now() - start;
+        msgs->emplace_back(std::move(r));
+        mReadBegin += frameSize;
+    }
 
-            result->connectHandler(ec);
-        });
-    return result;
+    // move what is left of a partial message to the front
+    std::copy(mReadBuffer.begin() + mReadBegin, mReadBuffer.begin() + mReadEnd,
+              mReadBuffer.begin());
+    mReadEnd -= mReadBegin;
+    mReadBegin = 0;
+
+    postToPeer([bytes_transferred, msgs, res, badHeader](TCPPeer& peer) {
+        peer.recvMessages(bytes_transferred, *msgs);
+        if (badHeader)
+        {
+            peer.rejectMessageLength(badHeader->data());
+        }
+        else if (res != RECV_OK && !peer.shouldAbort())
+        {
+            peer.recvFailed(res);
+        }
+    });
+    if (!badHeader && res == RECV_OK)
+    {
+        read();
+    }
 }
 
-TCPPeer::pointer
-TCPPeer::accept(Application& app, shared_ptr<TCPPeer::SocketType> socket)
+void
+TCPPeer::IO::rememberFlooded(uint64_t hash)
 {
-    assertThreadIsMain();
-    shared_ptr<TCPPeer> result;
-    asio::error_code ec;
-
-    asio::ip::tcp::no_delay nodelay(true);
-    socket->next_layer().set_option(nodelay, ec);
+    if (!mRecentFlooded.insert(hash).second)
+    {
+        return;
+    }
+    mRecentFloodedOrder.push_back(hash);
+    if (mRecentFloodedOrder.size() > RECENT_FLOODED_MESSAGES)
+    {
+        mRecentFlooded.erase(mRecentFloodedOrder.front());
+        mRecentFloodedOrder.pop_front();
+    }
+}
 
-    if (!ec)
+Peer::RecvResult
+TCPPeer::IO::decompress(Received& r)
+{
+    if (!mDecompressor)
     {
-        CLOG(DEBUG, "Overlay") << "TCPPeer:accept"
-                               << "@" << app.getConfig().PEER_PORT;
-        result = make_shared<TCPPeer>(app, REMOTE_CALLED_US, socket);
-        result->startIdleTimer();
-        result->startRead();
+        return RECV_CORRUPT;
     }
-    else
+    StellarMessage msg;
+    try
     {
-        CLOG(DEBUG, "Overlay")
-            << "TCPPeer:accept"
-            << "@" << app.getConfig().PEER_PORT << " error " << ec.message();
+        auto const& bytes = mDecompressor->decompress(r.mMsg.compressed(), msg);
+        if (msg.type() == TRANSACTION)
+        {
+            // past the message type
+            r.mEnvelope = mBufferPool.acquire(bytes.size() - 4);
+            std::copy(bytes.begin() + 4, bytes.end(), r.mEnvelope->data());
+        }
+    }
+    catch (std::exception&)
+    {
+        return RECV_CORRUPT;
     }
+    r.mMsg = std::move(msg);
+    return RECV_OK;
+}
 
-    return result;
+void
+TCPPeer::IO::startFraming(HmacSha256Key const& macKey, uint64_t macSeq,
+                          std::shared_ptr<MessageDecompressor> decompressor,
+                          std::vector<uint8_t> const& pending)
+{
+    mFraming = true;
+    mRecvMacKey = macKey;
+    mRecvMacSeq = macSeq;
+    mDecompressor = decompressor;
+    mReadBuffer.resize(std::max(size_t(READ_BUFFER_SIZE), pending.size() + 1));
+    std::copy(pending.begin(), pending.end(), mReadBuffer.begin());
+    mReadEnd = pending.size();
+    // the pending bytes were already accounted for by the peer
+    frameMessages(0);
 }
 
-TCPPeer::~TCPPeer()
+void
+TCPPeer::IO::queue(Outgoing o)
 {
-    assertThreadIsMain();
-    mIdleTimer.cancel();
-    if (mSocket)
+    bool post;
     {
-        // Ignore: this indicates an attempt to cancel events
-        // on a not-established socket.
-        asio::error_code ec;
-
-#ifndef _WIN32
-        // This always fails on windows and ASIO won't
-        // even build it.
-        mSocket->next_layer().cancel(ec);
-#endif
-        mSocket->close(ec);
+        std::lock_guard<std::mutex> lock(mQueuedMutex);
+        // otherwise takeQueued is pending, and takes this one too
+        post = mQueued.empty();
+        mQueued.emplace_back(std::move(o));
+    }
+    if (post)
+    {
+        auto self = shared_from_this();
+        mStrand.post([self]() { self->takeQueued(); });
     }
 }
 
-PeerBareAddress
-TCPPeer::makeAddress(int remoteListeningPort) const
+void
+TCPPeer::IO::queueSealing(HmacSha256Key const& macKey, uint64_t macSeq,
+                          std::shared_ptr<MessageCompressor> compressor)
+{
+    // handed over with the messages queued, before any of them is unsealed
+    std::lock_guard<std::mutex> lock(mQueuedMutex);
+    mSealingQueued = true;
+    mQueuedMacKey = macKey;
+    mQueuedMacSeq = macSeq;
+    mQueuedCompressor = compressor;
+}
+
+void
+TCPPeer::IO::takeQueued()
 {
-    asio::error_code ec;
-    auto ep = mSocket->next_layer().remote_endpoint(ec);
-    if (ec || remoteListeningPort <= 0 || remoteListeningPort > UINT16_MAX)
     {
-        return PeerBareAddress{};
+        std::lock_guard<std::mutex> lock(mQueuedMutex);
+        if (mSealingQueued)
+        {
+            mSealingQueued = false;
+            mSealing = true;
+            mSendMacKey = mQueuedMacKey;
+            mSendMacSeq = mQueuedMacSeq;
+            mCompressor = std::move(mQueuedCompressor);
+        }
+        std::swap(mQueued, mTaken);
     }
-    else
+    for (auto& o : mTaken)
     {
-        return PeerBareAddress{
-            ep.address().to_string(),
-            static_cast<unsigned short>(remoteListeningPort)};
+        enqueue(std::move(o));
+    }
+    mTaken.clear();
+
+    if (!mWriting)
+    {
+        mWriting = true;
+        // kick off the async write chain if we're the first one
+        messageSender();
     }
 }
 
 void
-TCPPeer::sendMessage(xdr::msg_ptr&& xdrBytes)
+TCPPeer::IO::enqueue(Outgoing o)
 {
-    if (mState == CLOSING)
+    assert(o.mSealed || mSealing);
+    auto size = o.mBuf->raw_size();
+    mWriteQueueBytes += size;
+    ++mWriteQueueSize;
+    auto& queue = mWriteQueues[getSendPriority(o.mType)];
+    queue.emplace_back(std::move(o));
+
+    if (queue.back().mType == TRANSACTION)
     {
-        CLOG(ERROR, "Overlay")
-            << "Trying to send message to " << toString() << " after drop";
+        // the oldest unsent transactions are the least likely to still be
+        // useful to the peer
+        mTransactionBytes += size;
+        while (mTransactionBytesCap != 0 &&
+               mTransactionBytes > mTransactionBytesCap && queue.size() > 1)
+        {
+            auto dropped = queue.front().mBuf->raw_size();
+            mTransactionBytes -= dropped;
+            mWriteQueueBytes -= dropped;
+            --mWriteQueueSize;
+            queue.pop_front();
+            mDroppedTransactionMeter.Mark();
+        }
+    }
+}
+
+void
+TCPPeer::IO::messageSender()
+{
+    // gather as many queued messages as fit in one write, at least one, the
+    // higher priorities first; they are kept as their buffers are needed
+    // until it completes
+    mWriteBuffers.clear();
+    size_t batchBytes = 0;
+    bool full = false;
+    for (auto& queue : mWriteQueues)
+    {
+        while (!full && !queue.empty())
+        {
+            auto& o = queue.front();
+            auto size = o.mBuf->raw_size();
+            if (!mWriteBatch.empty() && batchBytes + size > mWriteBatchCap)
+            {
+                full = true;
+                break;
+            }
+            MessageType type;
+            uint64_t hash;
+            if (getFloodedMessageHash(
+                    ByteSlice(o.mBuf->data(), o.mBuf->size()), type, hash))
+            {
+                // the peer has it now, no need to decode it if it sends it
+                rememberFlooded(hash);
+            }
+            if (o.mType == TRANSACTION)
+            {
+                mTransactionBytes -= size;
+            }
+            if (!o.mSealed)
+            {
+                if (mCompressor &&
+                    mCompressor->compress(o.mBuf, o.mType, mBufferPool))
+                {
+                    // writeHandler takes the size written off the queue
+                    mWriteQueueBytes -= size;
+                    size = o.mBuf->raw_size();
+                    mWriteQueueBytes += size;
+                }
+                sealMessage(o.mBuf, o.mType, mSendMacKey, mSendMacSeq);
+            }
+            mWriteBuffers.emplace_back(o.mBuf->raw_data(), size);
+            batchBytes += size;
+            mWriteBatch.emplace_back(std::move(o));
+            queue.pop_front();
+        }
+    }
+
+    if (mWriteBatch.empty())
+    {
+        mWriting = false;
+        // there is nothing to send and delayed shutdown was requested -
+        // time to perform it
+        if (mDelayedShutdown)
+        {
+            shutdown();
+        }
         return;
     }
 
-    if (Logging::logTrace("Overlay"))
-        CLOG(TRACE, "Overlay") << "TCPPeer:sendMessage to " << toString();
-    assertThreadIsMain();
+    mWriteBatchBytes = batchBytes;
+    mWriteBatchMessagesHistogram.Update(mWriteBatch.size());
+    mWriteBatchBytesHistogram.Update(batchBytes);
 
-    // places the buffer to write into the write queue
-    auto buf = std::make_shared<xdr::msg_ptr>(std::move(xdrBytes));
+    // written straight to the socket, bypassing the stream's own (small)
+    // write buffer, which nothing else writes to
+    auto self = shared_from_this();
+    asio::async_write(
+        mSocket->next_layer(), mWriteBuffers,
+        mStrand.wrap([self](asio::error_code const& ec, std::size_t length) {
+            self->writeHandler(ec, length);
+        }));
+}
 
-    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+void
+TCPPeer::IO::writeHandler(asio::error_code const& error,
+                          size_t bytes_transferred)
+{
+    mWriteSinceIdleCheck = true;
+    auto messages = mWriteBatch.size();
+    // done with the batch, its buffers go back to the pool
+    for (auto const& o : mWriteBatch)
+    {
+        mWriteQueueBytes -= o.mBuf->raw_size();
+        --mWriteQueueSize;
+    }
+    mWriteBatch.clear();
+    mWriteBatchBytes = 0;
 
-    self->mWriteQueue.emplace(buf);
+    if (error)
+    {
+        mWriting = false;
+        if (mDelayedShutdown)
+        {
+            // delayed shutdown was requested - time to perform it
+            shutdown();
+        }
+        else
+        {
+            postToPeer([error](TCPPeer& peer) { peer.writeHandler(error, 0); });
+        }
+        return;
+    }
 
-    if (!self->mWriting)
+    if (bytes_transferred != 0)
     {
-        self->mWriting = true;
-        // kick off the async write chain if we're the first one
-        self->messageSender();
+        postToPeer([bytes_transferred, messages](TCPPeer& peer) {
+            peer.wroteBytes(bytes_transferred, messages);
+        });
     }
+    // continue processing the queue
+    messageSender();
 }
 
 void
-TCPPeer::shutdown()
+TCPPeer::IO::shutdown()
 {
     if (mShutdownScheduled)
     {
         // should not happen, leave here for debugging purposes
-        CLOG(ERROR, "Overlay") << "Double schedule of shutdown " << toString();
+        postToPeer([](TCPPeer& peer) {
+            CLOG(ERROR, "Overlay")
+                << "Double schedule of shutdown " << peer.toString();
+        });
         return;
     }
-
-    mIdleTimer.cancel();
     mShutdownScheduled = true;
-    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
 
     // To shutdown, we first queue up our desire to shutdown in the strand,
     // behind any pending read/write calls. We'll let them issue first.
-    self->getApp().getClock().getIOService().post([self]() {
+    auto self = shared_from_this();
+    mStrand.post([self]() {
         // Gracefully shut down connection: this pushes a FIN packet into TCP
         // which, if we wanted to be really polite about, we would wait for an
         // ACK from by doing repeated reads until we get a 0-read.
@@ -192,10 +634,12 @@ TCPPeer::shutdown()
             asio::ip::tcp::socket::shutdown_both, ec);
         if (ec)
         {
-            CLOG(ERROR, "Overlay")
-                << "TCPPeer::drop shutdown socket failed: " << ec.message();
+            self->postToPeer([ec](TCPPeer&) {
+                CLOG(ERROR, "Overlay")
+                    << "TCPPeer::drop shutdown socket failed: " << ec.message();
+            });
         }
-        self->getApp().getClock().getIOService().post([self]() {
+        self->mStrand.post([self]() {
             // Close fd associated with socket. Socket is already shut down, but
             // depending on platform (and apparently whether there was unread
             // data when we issued shutdown()) this call might push RST onto the
@@ -209,63 +653,210 @@ TCPPeer::shutdown()
             self->mSocket->close(ec2);
             if (ec2)
             {
-                CLOG(ERROR, "Overlay")
-                    << "TCPPeer::drop close socket failed: " << ec2.message();
+                self->postToPeer([ec2](TCPPeer&) {
+                    CLOG(ERROR, "Overlay")
+                        << "TCPPeer::drop close socket failed: "
+                        << ec2.message();
+                });
             }
         });
     });
 }
 
 void
-TCPPeer::messageSender()
+TCPPeer::IO::close()
 {
-    assertThreadIsMain();
+    // Ignore: this indicates an attempt to cancel events
+    // on a not-established socket.
+    asio::error_code ec;
 
-    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+#ifndef _WIN32
+    // This always fails on windows and ASIO won't
+    // even build it.
+    mSocket->next_layer().cancel(ec);
+#endif
+    mSocket->close(ec);
+}
 
-    // if nothing to do, flush and return
-    if (mWriteQueue.empty())
-    {
-        mSocket->async_flush([self](asio::error_code const& ec, std::size_t) {
-            self->writeHandler(ec, 0);
-            if (!ec)
-            {
-                if (!self->mWriteQueue.empty())
+///////////////////////////////////////////////////////////////////////
+// TCPPeer
+///////////////////////////////////////////////////////////////////////
+
+TCPPeer::TCPPeer(Application& app, Peer::PeerRole role,
+                 std::shared_ptr<TCPPeer::SocketType> socket)
+    : Peer(app, role)
+    , mIO(std::make_shared<IO>(app, socket))
+    , mReadBatchMessagesHistogram(
+          app.getMetrics().NewHistogram({"overlay", "read", "batch-messages"}))
+{
+}
+
+TCPPeer::pointer
+TCPPeer::initiate(Application& app, PeerBareAddress const& address)
+{
+    assert(address.getType() == PeerBareAddress::Type::IPv4);
+
+    CLOG(DEBUG, "Overlay") << "TCPPeer:initiate"
+                           << " to " << address.toString();
+    assertThreadIsMain();
+    auto socket = make_shared<SocketType>(app.getOverlayIOService());
+    auto result = make_shared<TCPPeer>(app, WE_CALLED_REMOTE, socket);
+    result->mIO->mPeer = result;
+    result->mAddress = address;
+    result->mRemoteIP = address.getIP();
+    result->startIdleTimer();
+    asio::ip::tcp::endpoint endpoint(
+        asio::ip::address::from_string(address.getIP()), address.getPort());
+    auto io = result->mIO;
+    io->mStrand.post([io, endpoint]() {
+        io->mSocket->next_layer().async_connect(
+            endpoint, io->mStrand.wrap([io](asio::error_code const& error) {
+                asio::error_code ec;
+                if (!error)
                 {
-                    self->messageSender();
+                    asio::ip::tcp::no_delay nodelay(true);
+                    io->mSocket->next_layer().set_option(nodelay, ec);
                 }
                 else
                 {
-                    self->mWriting = false;
-                    // there is nothing to send and delayed shutdown was
-                    // requested - time to perform it
-                    if (self->mDelayedShutdown)
-                    {
-                        self->shutdown();
-                    }
+                    ec = error;
                 }
-            }
-        });
+
+                io->postToPeer(
+                    [ec](TCPPeer& peer) { peer.connectHandler(ec); });
+            }));
+    });
+    return result;
+}
+
+TCPPeer::pointer
+TCPPeer::accept(Application& app, shared_ptr<TCPPeer::SocketType> socket)
+{
+    assertThreadIsMain();
+    shared_ptr<TCPPeer> result;
+    asio::error_code ec;
+
+    // nothing is pending on the socket yet, it can be used from here
+    asio::ip::tcp::no_delay nodelay(true);
+    socket->next_layer().set_option(nodelay, ec);
+    asio::error_code epEc;
+    auto ep = socket->next_layer().remote_endpoint(epEc);
+    std::string remoteIP = epEc ? std::string() : ep.address().to_string();
+
+    if (!ec)
+    {
+        CLOG(DEBUG, "Overlay") << "TCPPeer:accept"
+                               << "@" << app.getConfig().PEER_PORT;
+        result = make_shared<TCPPeer>(app, REMOTE_CALLED_US, socket);
+        result->mIO->mPeer = result;
+        result->mRemoteIP = remoteIP;
+        result->startIdleTimer();
+        result->startRead();
+    }
+    else
+    {
+        CLOG(DEBUG, "Overlay")
+            << "TCPPeer:accept"
+            << "@" << app.getConfig().PEER_PORT << " error " << ec.message();
+    }
+
+    return result;
+}
+
+TCPPeer::~TCPPeer()
+{
+    assertThreadIsMain();
+    mIdleTimer.cancel();
+    auto io = mIO;
+    io->mStrand.post([io]() { io->close(); });
+}
+
+PeerBareAddress
+TCPPeer::makeAddress(int remoteListeningPort) const
+{
+    if (mRemoteIP.empty() || remoteListeningPort <= 0 ||
+        remoteListeningPort > UINT16_MAX)
+    {
+        return PeerBareAddress{};
+    }
+    else
+    {
+        return PeerBareAddress{
+            mRemoteIP, static_cast<unsigned short>(remoteListeningPort)};
+    }
+}
+
+void
+TCPPeer::refreshLastIO()
+{
+    auto now = mApp.getClock().now();
+    if (mIO->mReadSinceIdleCheck.exchange(false))
+    {
+        mLastRead = now;
+    }
+    if (mIO->mWriteSinceIdleCheck.exchange(false))
+    {
+        mLastWrite = now;
+    }
+}
+
+void
+TCPPeer::sendMessage(MessageBufferPtr&& xdrBytes)
+{
+    // already sealed, see sendUnsealedMessage: only valid before the IO side
+    // seals messages, and written with the handshake messages
+    assert(!mSendSealingHandedOff);
+    queueMessage(std::move(xdrBytes), HELLO, true);
+}
+
+void
+TCPPeer::sendUnsealedMessage(MessageBufferPtr&& xdrBytes, MessageType type)
+{
+    if (!isAuthenticated())
+    {
+        // handshake messages, sealed here as the keys are being set up
+        sealMessage(xdrBytes, type, mSendMacKey, mSendMacSeq);
+        queueMessage(std::move(xdrBytes), type, true);
         return;
     }
 
-    // peek the buffer from the queue
-    // do not remove it yet as we need the buffer for the duration of the
-    // write operation
-    auto buf = mWriteQueue.front();
+    if (!mSendSealingHandedOff)
+    {
+        // from now on messages are sealed by the IO side
+        mSendSealingHandedOff = true;
+        mIO->queueSealing(mSendMacKey, mSendMacSeq, mCompressor);
+        mCompressor.reset();
+    }
+    queueMessage(std::move(xdrBytes), type, false);
+}
 
-    asio::async_write(*(mSocket.get()),
-                      asio::buffer((*buf)->raw_data(), (*buf)->raw_size()),
-                      [self](asio::error_code const& ec, std::size_t length) {
-                          self->writeHandler(ec, length);
-                          self->mWriteQueue.pop(); // done with front element
+void
+TCPPeer::queueMessage(MessageBufferPtr&& xdrBytes, MessageType type,
+                      bool sealed)
+{
+    if (mState == CLOSING)
+    {
+        CLOG(ERROR, "Overlay")
+            << "Trying to send message to " << toString() << " after drop";
+        return;
+    }
 
-                          // continue processing the queue/flush
-                          if (!ec)
-                          {
-                              self->messageSender();
-                          }
-                      });
+    if (Logging::logTrace("Overlay"))
+        CLOG(TRACE, "Overlay") << "TCPPeer:sendMessage to " << toString();
+    assertThreadIsMain();
+
+    // places the buffer to write into the write queue
+    mIO->queue(IO::Outgoing{std::move(xdrBytes), type, sealed});
+}
+
+void
+TCPPeer::wroteBytes(size_t bytes, size_t messages)
+{
+    assertThreadIsMain();
+    mLastWrite = mApp.getClock().now();
+    LoadManager::PeerContext loadCtx(mApp, mPeerID);
+    mMessageWrite.Mark(messages);
+    mByteWrite.Mark(bytes);
 }
 
 void
@@ -285,25 +876,28 @@ TCPPeer::writeHandler(asio::error_code const& error,
             CLOG(ERROR, "Overlay")
                 << "TCPPeer::writeHandler error to " << toString();
         }
-        if (mDelayedShutdown)
-        {
-            // delayed shutdown was requested - time to perform it
-            shutdown();
-        }
-        else
-        {
-            // no delayed shutdown - we can drop normally
-            drop();
-        }
-    }
-    else if (bytes_transferred != 0)
-    {
-        LoadManager::PeerContext loadCtx(mApp, mPeerID);
-        mMessageWrite.Mark();
-        mByteWrite.Mark(bytes_transferred);
+        drop();
     }
 }
 
+size_t
+TCPPeer::getWriteQueueSize() const
+{
+    return mIO->mWriteQueueSize;
+}
+
+size_t
+TCPPeer::getWriteQueueBytes() const
+{
+    return mIO->mWriteQueueBytes;
+}
+
+size_t
+TCPPeer::getBytesInFlight() const
+{
+    return mIO->mWriteBatchBytes;
+}
+
 void
 TCPPeer::startRead()
 {
@@ -313,50 +907,67 @@ TCPPeer::startRead()
         return;
     }
 
-    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
-
-    assert(self->mIncomingHeader.size() == 0);
-
     if (Logging::logTrace("Overlay"))
-        CLOG(TRACE, "Overlay") << "TCPPeer::startRead to " << self->toString();
+        CLOG(TRACE, "Overlay") << "TCPPeer::startRead to " << toString();
+
+    auto io = mIO;
+    if (!isAuthenticated())
+    {
+        io->mStrand.post([io]() { io->read(); });
+        return;
+    }
 
-    self->mIncomingHeader.resize(4);
-    asio::async_read(*(self->mSocket.get()),
-                     asio::buffer(self->mIncomingHeader),
-                     [self](asio::error_code ec, std::size_t length) {
-                         if (Logging::logTrace("Overlay"))
-                             CLOG(TRACE, "Overlay")
-                                 << "TCPPeer::startRead calledback " << ec
-                                 << " length:" << length;
-                         self->readHeaderHandler(ec, length);
-                     });
+    // from now on messages are framed and authenticated by the IO side,
+    // starting with what is left here of a partial one
+    auto pending = std::make_shared<std::vector<uint8_t>>(
+        mReadBuffer.begin() + mReadBegin, mReadBuffer.begin() + mReadEnd);
+    auto macKey = mRecvMacKey;
+    auto macSeq = mRecvMacSeq;
+    auto decompressor = mDecompressor;
+    mDecompressor.reset();
+    io->mStrand.post([io, pending, macKey, macSeq, decompressor]() {
+        io->startFraming(macKey, macSeq, decompressor, *pending);
+    });
+    std::vector<uint8_t>().swap(mReadBuffer);
+    mReadBegin = 0;
+    mReadEnd = 0;
 }
 
 int
-TCPPeer::getIncomingMsgLength()
+TCPPeer::getIncomingMsgLength(uint8_t const* header, bool authenticated)
 {
-    int length = mIncomingHeader[0];
+    int length = header[0];
     length &= 0x7f; // clear the XDR 'continuation' bit
     length <<= 8;
-    length |= mIncomingHeader[1];
+    length |= header[1];
     length <<= 8;
-    length |= mIncomingHeader[2];
+    length |= header[2];
     length <<= 8;
-    length |= mIncomingHeader[3];
-    if (length <= 0 ||
-        (!isAuthenticated() && (length > MAX_UNAUTH_MESSAGE_SIZE)) ||
+    length |= header[3];
+    if (length <= 0 || (!authenticated && (length > MAX_UNAUTH_MESSAGE_SIZE)) ||
         length > MAX_MESSAGE_SIZE)
     {
-        mErrorRead.Mark();
-        CLOG(ERROR, "Overlay")
-            << "TCP: message size unacceptable: " << length
-            << (isAuthenticated() ? "" : " while not authenticated");
-        drop();
         length = 0;
     }
     return (length);
 }
 
+void
+TCPPeer::rejectMessageLength(uint8_t const* header)
+{
+    if (shouldAbort())
+    {
+        return;
+    }
+    int length = (header[0] & 0x7f) << 24 | header[1] << 16 | header[2] << 8 |
+                 header[3];
+    mErrorRead.Mark();
+    CLOG(ERROR, "Overlay") << "TCP: message size unacceptable: " << length
+                           << (isAuthenticated() ? ""
+                                                 : " while not authenticated");
+    drop();
+}
+
 void
 TCPPeer::connected()
 {
@@ -364,92 +975,133 @@ TCPPeer::connected()
 }
 
 void
-TCPPeer::readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred)
+TCPPeer::readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred)
 {
     assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readHeaderHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
 
-    if (!error)
-    {
-        receivedBytes(bytes_transferred, false);
-        int length = getIncomingMsgLength();
-        if (length != 0)
-        {
-            mIncomingBody.resize(length);
-            auto self = static_pointer_cast<TCPPeer>(shared_from_this());
-            asio::async_read(*mSocket.get(), asio::buffer(mIncomingBody),
-                             [self](asio::error_code ec, std::size_t length) {
-                                 self->readBodyHandler(ec, length);
-                             });
-        }
-    }
-    else
+    if (error)
     {
         if (isConnected())
         {
             // Only emit a warning if we have an error while connected;
             // errors during shutdown or connection are common/expected.
             mErrorRead.Mark();
-            CLOG(ERROR, "Overlay")
-                << "readHeaderHandler error: " << error.message() << " :"
-                << toString();
+            CLOG(ERROR, "Overlay") << "readHandler error: " << error.message()
+                                   << " :" << toString();
         }
         drop();
     }
 }
 
 void
-TCPPeer::readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred)
+TCPPeer::recvBytes(std::vector<uint8_t> const& bytes)
 {
     assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readBodyHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
+    if (shouldAbort())
+    {
+        return;
+    }
 
-    if (!error)
+    receivedBytes(bytes.size(), false);
+    if (mReadBuffer.size() < mReadEnd + bytes.size())
     {
-        receivedBytes(bytes_transferred, true);
-        recvMessage();
-        mIncomingHeader.clear();
-        startRead();
+        mReadBuffer.resize(mReadEnd + bytes.size());
     }
-    else
+    std::copy(bytes.begin(), bytes.end(), mReadBuffer.begin() + mReadEnd);
+    mReadEnd += bytes.size();
+    processReadBuffer();
+    startRead();
+}
+
+void
+TCPPeer::processReadBuffer()
+{
+    assertThreadIsMain();
+
+    // Each message is handled as soon as it is framed, as the handshake
+    // changes how (and how large) the following ones are read; the IO side
+    // takes over once authenticated, see startRead. Nothing more is handled
+    // while a HELLO is being authenticated, until resumeRecv.
+    size_t const headerSize = 4;
+    while (!shouldAbort() && !mHelloPending &&
+           mReadEnd - mReadBegin >= headerSize)
     {
-        if (isConnected())
+        auto header = mReadBuffer.data() + mReadBegin;
+        auto length = getIncomingMsgLength(header, isAuthenticated());
+        if (length == 0)
         {
-            // Only emit a warning if we have an error while connected;
-            // errors during shutdown or connection are common/expected.
-            mErrorRead.Mark();
-            CLOG(ERROR, "Overlay")
-                << "readBodyHandler error: " << error.message() << " :"
-                << toString();
+            rejectMessageLength(header);
+            return;
+        }
+        size_t frameSize = headerSize + length;
+        if (mReadEnd - mReadBegin < frameSize)
+        {
+            break;
+        }
+
+        ByteSlice body(header + headerSize, length);
+        mReadBegin += frameSize;
+        receivedBytes(0, true);
+
+        StellarMessage msg;
+        if (!decodeAuthenticatedMessage(body, msg))
+        {
+            return;
+        }
+        Peer::recvMessage(msg);
+        if (isAuthenticated() || mHelloPending)
+        {
+            break;
         }
-        drop();
     }
+
+    // move what is left to the front
+    std::copy(mReadBuffer.begin() + mReadBegin, mReadBuffer.begin() + mReadEnd,
+              mReadBuffer.begin());
+    mReadEnd -= mReadBegin;
+    mReadBegin = 0;
 }
 
 void
-TCPPeer::recvMessage()
+TCPPeer::resumeRecv()
+{
+    // a read is still pending, which picks up from there once authenticated
+    processReadBuffer();
+}
+
+void
+TCPPeer::recvMessages(size_t bytes, std::vector<Received> const& msgs)
 {
     assertThreadIsMain();
-    try
+    if (shouldAbort())
     {
-        xdr::xdr_get g(mIncomingBody.data(),
-                       mIncomingBody.data() + mIncomingBody.size());
-        AuthenticatedMessage am;
-        xdr::xdr_argpack_archive(g, am);
-        Peer::recvMessage(am);
+        return;
+    }
+
+    receivedBytes(bytes, false);
+    if (!msgs.empty())
+    {
+        mReadBatchMessagesHistogram.Update(msgs.size());
     }
-    catch (xdr::xdr_runtime_error& e)
+    auto& load = mApp.getOverlayManager().getLoadManager();
+    for (auto const& r : msgs)
     {
-        CLOG(ERROR, "Overlay") << "recvMessage got a corrupt xdr: " << e.what();
-        Peer::drop(ERR_DATA, "received corrupt XDR");
+        if (shouldAbort())
+        {
+            return;
+        }
+        receivedBytes(0, true);
+        load.recordRecv(mPeerID, r.mMsg.type(), r.mBytes, r.mDecodeTime);
+        if (r.mDuplicate)
+        {
+            // what Floodgate would have found
+            load.recordFlooded(mPeerID, r.mMsg.type(), true);
+            continue;
+        }
+        auto const& env = r.mEnvelope;
+        Peer::recvMessage(r.mMsg, env ? ByteSlice(env->data(), env->size())
+                                      : ByteSlice(nullptr, 0));
     }
 }
 
@@ -471,13 +1123,16 @@ TCPPeer::drop(bool force)
     getApp().getOverlayManager().dropPeer(this);
 
     // if write queue is not empty, messageSender will take care of shutdown
-    if (force || !mWriting)
-    {
-        self->shutdown();
-    }
-    else
-    {
-        self->mDelayedShutdown = true;
-    }
+    auto io = mIO;
+    io->mStrand.post([io, force]() {
+        if (force || !io->mWriting)
+        {
+            io->shutdown();
+        }
+        else
+        {
+            io->mDelayedShutdown = true;
+        }
+    });
 }
 }
@@ -6,10 +6,12 @@
 
 #include "overlay/Peer.h"
 #include "util/Timer.h"
-#include <queue>
+
+#include <chrono>
 
 namespace medida
 {
+class Histogram;
 class Meter;
 }
 
@@ -20,43 +22,84 @@ static auto const MAX_UNAUTH_MESSAGE_SIZE = 0x1000;
 static auto const MAX_MESSAGE_SIZE = 0x1000000;
 
 // Peer that communicates via a TCP socket.
+//
+// The socket is served by Application::getOverlayIOService, possibly from
+// other threads than the main one: everything touching it lives in an IO
+// object, driven through a strand, which shares no state with the peer and
+// reaches it only by posting to the main thread. Until the handshake is
+// done, bytes read are handed to the main thread as they arrive and the next
+// read waits for them to be handled; after that the IO side frames, decodes
+// and authenticates messages itself, the main thread receiving them in
+// batches.
 class TCPPeer : public Peer
 {
   public:
     typedef asio::buffered_stream<asio::ip::tcp::socket> SocketType;
 
   private:
-    std::shared_ptr<SocketType> mSocket;
-    std::vector<uint8_t> mIncomingHeader;
-    std::vector<uint8_t> mIncomingBody;
-
-    std::queue<std::shared_ptr<xdr::msg_ptr>> mWriteQueue;
-    bool mWriting{false};
-    bool mDelayedShutdown{false};
-    bool mShutdownScheduled{false};
+    struct IO;
+    struct Received
+    {
+        // only the type is set for duplicates
+        StellarMessage mMsg;
+        size_t mBytes;
+        std::chrono::nanoseconds mDecodeTime;
+        // one of the flooded messages last received or sent on this
+        // connection, dropped without being decoded
+        bool mDuplicate{false};
+        // for a TRANSACTION, its envelope as received
+        MessageBufferPtr mEnvelope;
+    };
+
+    std::shared_ptr<IO> mIO;
+    std::string mRemoteIP;
+    // whether outbound messages are sealed by the IO side, see
+    // sendUnsealedMessage
+    bool mSendSealingHandedOff{false};
+
+    // Bytes read before the handshake completed, and not yet framed, are
+    // [mReadBegin, mReadEnd).
+    std::vector<uint8_t> mReadBuffer;
+    size_t mReadBegin{0};
+    size_t mReadEnd{0};
+    medida::Histogram& mReadBatchMessagesHistogram;
 
     PeerBareAddress makeAddress(int remoteListeningPort) const override;
 
-    void recvMessage();
-    void sendMessage(xdr::msg_ptr&& xdrBytes) override;
-
-    void messageSender();
-
-    int getIncomingMsgLength();
+    void refreshLastIO() override;
+    void processReadBuffer();
+    void sendMessage(MessageBufferPtr&& xdrBytes) override;
+    void sendUnsealedMessage(MessageBufferPtr&& xdrBytes,
+                             MessageType type) override;
+    void queueMessage(MessageBufferPtr&& xdrBytes, MessageType type,
+                      bool sealed);
+
+    // Length of the message whose 4-byte header is at `header`, 0 if over
+    // the limit for `authenticated` peers.
+    static int getIncomingMsgLength(uint8_t const* header, bool authenticated);
+    void rejectMessageLength(uint8_t const* header);
     virtual void connected() override;
+    void resumeRecv() override;
     void startRead();
 
+    // Main thread side of the IO object.
+    void recvBytes(std::vector<uint8_t> const& bytes);
+    void recvMessages(size_t bytes, std::vector<Received> const& msgs);
+    void wroteBytes(size_t bytes, size_t messages);
     void writeHandler(asio::error_code const& error,
                       std::size_t bytes_transferred) override;
-    void readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred) override;
-    void readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred) override;
-    void shutdown();
+    void readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred) override;
 
   public:
     typedef std::shared_ptr<TCPPeer> pointer;
 
+    // Initial size of the read buffer, grown to fit larger messages.
+    static size_t const READ_BUFFER_SIZE = 0x10000;
+    // Flooded messages remembered per connection to drop the ones the peer
+    // sends again before decoding them.
+    static size_t const RECENT_FLOODED_MESSAGES = 4096;
+
     TCPPeer(Application& app, Peer::PeerRole role,
             std::shared_ptr<SocketType> socket); // hollow
                                                  // constuctor; use
@@ -69,5 +112,9 @@ class TCPPeer : public Peer
     virtual ~TCPPeer();
 
     virtual void drop(bool force = true) override;
+
+    size_t getWriteQueueSize() const override;
+    size_t getWriteQueueBytes() const override;
+    size_t getBytesInFlight() const override;
 };
 }
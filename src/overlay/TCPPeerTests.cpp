@@ -6,6 +6,8 @@
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerBareAddress.h"
 #include "overlay/PeerDoor.h"
@@ -20,8 +22,20 @@ namespace stellar
 TEST_CASE("TCPPeer can communicate", "[overlay]")
 {
     Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
-    Simulation::pointer s =
-        std::make_shared<Simulation>(Simulation::OVER_TCP, networkID);
+    unsigned short overlayThreads = 0;
+    SECTION("on the main thread")
+    {
+    }
+    SECTION("on overlay threads")
+    {
+        overlayThreads = 2;
+    }
+    Simulation::pointer s = std::make_shared<Simulation>(
+        Simulation::OVER_TCP, networkID, [overlayThreads](int i) {
+            auto cfg = getTestConfig(i);
+            cfg.OVERLAY_IO_THREADS = overlayThreads;
+            return cfg;
+        });
 
     auto v10SecretKey = SecretKey::fromSeed(sha256("v10"));
     auto v11SecretKey = SecretKey::fromSeed(sha256("v11"));
@@ -51,6 +65,15 @@ TEST_CASE("TCPPeer can communicate", "[overlay]")
     REQUIRE(p1);
     REQUIRE(p0->isAuthenticated());
     REQUIRE(p1->isAuthenticated());
+
+    // authenticated messages, framed by the IO side
+    auto& recvGetPeers =
+        n1->getMetrics().NewTimer({"overlay", "recv", "get-peers"});
+    auto before = recvGetPeers.count();
+    p0->sendGetPeers();
+    s->crankForAtLeast(std::chrono::seconds(1), false);
+    REQUIRE(recvGetPeers.count() > before);
+    REQUIRE(p0->isAuthenticated());
     s->stopAllNodes();
 }
 }
@@ -14,10 +14,17 @@
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+
 namespace stellar
 {
 
 static std::chrono::milliseconds const MS_TO_WAIT_FOR_FETCH_REPLY{1500};
+// bounds of the time after which a peer that usually answers faster is asked
+// again, see FetchStats::getHedgeDelay
+static std::chrono::milliseconds const MIN_MS_TO_HEDGE_FETCH{100};
+// latency assumed for peers that have not answered yet
+static std::chrono::milliseconds const MS_UNKNOWN_FETCH_LATENCY{300};
 static int const MAX_REBUILD_FETCH_LIST = 1000;
 
 Tracker::Tracker(Application& app, Hash const& hash, AskPeer& askPeer)
@@ -84,6 +91,15 @@ Tracker::doesntHave(Peer::pointer peer)
     }
 }
 
+void
+Tracker::progress()
+{
+    CLOG(TRACE, "Overlay") << "Progress on " << hexAbbrev(mItemHash);
+    mTimer.expires_from_now(MS_TO_WAIT_FOR_FETCH_REPLY);
+    mTimer.async_wait([this]() { this->tryNextPeer(); },
+                      VirtualTimer::onFailureNoop);
+}
+
 void
 Tracker::tryNextPeer()
 {
@@ -107,20 +123,27 @@ Tracker::tryNextPeer()
             peersWithEnvelope.insert(s.begin(), s.end());
         }
 
-        // move the peers that have the envelope to the back,
-        // to be processed first
-        for (auto const& p :
-             mApp.getOverlayManager().getRandomAuthenticatedPeers())
-        {
-            if (peersWithEnvelope.find(p) != peersWithEnvelope.end())
-            {
-                mPeersToAsk.emplace_back(p);
-            }
-            else
-            {
-                mPeersToAsk.emplace_front(p);
-            }
-        }
+        // the peers that sent us an envelope referring to the item likely
+        // have it, so they go first; then the ones expected to answer
+        // fastest. The list is processed from the back and stays random
+        // between peers of equal cost.
+        auto peers = mApp.getOverlayManager().getRandomAuthenticatedPeers();
+        auto hasEnvelope = [&](Peer::pointer const& p) {
+            return peersWithEnvelope.find(p) != peersWithEnvelope.end();
+        };
+        auto cost = [](Peer::pointer const& p) {
+            return p->getFetchStats().getExpectedCost(
+                MS_UNKNOWN_FETCH_LATENCY);
+        };
+        std::stable_sort(peers.begin(), peers.end(),
+                         [&](Peer::pointer const& a, Peer::pointer const& b) {
+                             if (hasEnvelope(a) != hasEnvelope(b))
+                             {
+                                 return hasEnvelope(b);
+                             }
+                             return cost(a) > cost(b);
+                         });
+        mPeersToAsk.assign(peers.begin(), peers.end());
 
         mNumListRebuild++;
 
@@ -161,7 +184,13 @@ Tracker::tryNextPeer()
                                << " to " << peer->toString();
         mTryNextPeer.Mark();
         mAskPeer(peer, mItemHash);
-        nextTry = MS_TO_WAIT_FOR_FETCH_REPLY;
+        // if it is late compared to its usual answers, ask the next peer
+        // without waiting for the full timeout; a late answer is still used
+        nextTry = std::max(
+            MIN_MS_TO_HEDGE_FETCH,
+            std::min(peer->getFetchStats().getHedgeDelay(
+                         MS_TO_WAIT_FOR_FETCH_REPLY),
+                     MS_TO_WAIT_FOR_FETCH_REPLY));
     }
 
     mTimer.expires_from_now(nextTry);
@@ -199,4 +228,15 @@ Tracker::cancel()
     mTimer.cancel();
     mLastSeenSlotIndex = 0;
 }
+
+size_t
+Tracker::getMemoryBytes() const
+{
+    size_t bytes = sizeof(*this) + mPeersToAsk.size() * sizeof(Peer::pointer);
+    for (auto const& e : mWaitingEnvelopes)
+    {
+        bytes += sizeof(e) + xdr::xdr_size(e.second);
+    }
+    return bytes;
+}
 }
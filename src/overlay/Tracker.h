@@ -14,6 +14,11 @@
  *
  * For asking a AskPeer delegate is used.
  *
+ * Peers are asked in order of preference: the ones that sent envelopes
+ * referring to the data set first, then by expected time to answer (see
+ * FetchStats). A peer that is late compared to its usual answers is not waited
+ * for until the full timeout: the next one is asked as well.
+ *
  * Tracker keeps list of envelopes that requires given data set to be
  * fully resolved. When data is received each envelope is resend to Herder
  * so it can check if it has all required data and then process envelope.
@@ -85,6 +90,11 @@ class Tracker
         return mWaitingEnvelopes.size();
     }
 
+    /**
+     * Return approximate bytes held by the tracker.
+     */
+    size_t getMemoryBytes() const;
+
     /**
      * Pop envelope from stack.
      */
@@ -126,6 +136,12 @@ class Tracker
      */
     void tryNextPeer();
 
+    /**
+     * Called when part of the data arrived, from whichever peer: no other
+     * peer is asked until a full reply timeout passes without more of it.
+     */
+    void progress();
+
     /**
      * Return biggest slot index seen since last reset.
      */
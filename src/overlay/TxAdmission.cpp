@@ -0,0 +1,242 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/TxAdmission.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "overlay/LoadManager.h"
+#include "overlay/OverlayManager.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Logging.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace stellar
+{
+
+// beyond that many peers or accounts, those whose rate limit is back to full
+// are forgotten
+static const size_t MAX_ADMISSION_BUCKETS = 4096;
+
+std::chrono::milliseconds const TxAdmission::DRAIN_INTERVAL(50);
+
+TxAdmission::TxAdmission(Application& app)
+    : mApp(app)
+    , mDrainTimer(app)
+    , mAdmitted(app.getMetrics().NewMeter({"overlay", "tx-admission", "admit"},
+                                          "transaction"))
+    , mDeferredMeter(app.getMetrics().NewMeter(
+          {"overlay", "tx-admission", "defer"}, "transaction"))
+    , mDropped(app.getMetrics().NewMeter({"overlay", "tx-admission", "drop"},
+                                         "transaction"))
+    , mQueued(
+          app.getMetrics().NewCounter({"overlay", "tx-admission", "deferred"}))
+{
+}
+
+bool
+TxAdmission::Bucket::refill(uint32_t rate, VirtualClock::time_point now)
+{
+    if (now > mRefilled)
+    {
+        std::chrono::duration<double> elapsed = now - mRefilled;
+        mTokens = std::min<double>(rate, mTokens + elapsed.count() * rate);
+        mRefilled = now;
+    }
+    return mTokens >= 1;
+}
+
+TxAdmission::Bucket&
+TxAdmission::findBucket(std::map<PublicKey, Bucket>& buckets,
+                        PublicKey const& key, uint32_t rate,
+                        VirtualClock::time_point now)
+{
+    if (buckets.size() >= MAX_ADMISSION_BUCKETS)
+    {
+        for (auto it = buckets.begin(); it != buckets.end();)
+        {
+            it->second.refill(rate, now);
+            if (it->second.mTokens >= rate)
+            {
+                it = buckets.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    return buckets.emplace(key, Bucket{double(rate), now}).first->second;
+}
+
+bool
+TxAdmission::take(NodeID const& peer, AccountID const& account)
+{
+    auto const& cfg = mApp.getConfig();
+    auto now = mApp.getClock().now();
+    Bucket* peerBucket = nullptr;
+    if (cfg.TX_ADMISSION_RATE_PER_PEER != 0)
+    {
+        peerBucket = &findBucket(mPeerBuckets, peer,
+                                 cfg.TX_ADMISSION_RATE_PER_PEER, now);
+        if (!peerBucket->refill(cfg.TX_ADMISSION_RATE_PER_PEER, now))
+        {
+            return false;
+        }
+    }
+    Bucket* accountBucket = nullptr;
+    if (cfg.TX_ADMISSION_RATE_PER_ACCOUNT != 0)
+    {
+        accountBucket = &findBucket(mAccountBuckets, account,
+                                    cfg.TX_ADMISSION_RATE_PER_ACCOUNT, now);
+        if (!accountBucket->refill(cfg.TX_ADMISSION_RATE_PER_ACCOUNT, now))
+        {
+            return false;
+        }
+    }
+
+    if (peerBucket)
+    {
+        peerBucket->mTokens -= 1;
+    }
+    if (accountBucket)
+    {
+        accountBucket->mTokens -= 1;
+    }
+    return true;
+}
+
+bool
+TxAdmission::admit(Peer::pointer peer, StellarMessage const& msg,
+                   TransactionFramePtr tx)
+{
+    auto const& cfg = mApp.getConfig();
+    if (cfg.TX_ADMISSION_RATE_PER_PEER == 0 &&
+        cfg.TX_ADMISSION_RATE_PER_ACCOUNT == 0)
+    {
+        return true;
+    }
+
+    // behind the deferred transactions of the same account, if any
+    auto const& account = tx->getSourceID();
+    if (mDeferred.find(account) == mDeferred.end() &&
+        take(peer->getPeerID(), account))
+    {
+        mAdmitted.Mark();
+        return true;
+    }
+
+    mApp.getOverlayManager().getLoadManager().recordThrottled(
+        peer->getPeerID(), TRANSACTION);
+    if (cfg.TX_ADMISSION_MAX_DEFERRED != 0 &&
+        mDeferredCount >= cfg.TX_ADMISSION_MAX_DEFERRED)
+    {
+        mDropped.Mark();
+        return false;
+    }
+    mDeferred[account].push_back({peer, msg, tx});
+    ++mDeferredCount;
+    mDeferredMeter.Mark();
+    mQueued.set_count(mDeferredCount);
+    scheduleDrain();
+    return false;
+}
+
+void
+TxAdmission::scheduleDrain()
+{
+    if (mDrainArmed)
+    {
+        return;
+    }
+    mDrainArmed = true;
+    mDrainTimer.expires_from_now(DRAIN_INTERVAL);
+    mDrainTimer.async_wait(
+        [this]() {
+            mDrainArmed = false;
+            drain();
+        },
+        &VirtualTimer::onFailureNoop);
+}
+
+void
+TxAdmission::drain()
+{
+    // each pass gives every account one turn, starting after the one served
+    // last, until the rates allow none of them anything more
+    std::vector<AccountID> accounts;
+    auto start = mDeferred.upper_bound(mLastServed);
+    for (auto it = start; it != mDeferred.end(); ++it)
+    {
+        accounts.emplace_back(it->first);
+    }
+    for (auto it = mDeferred.begin(); it != start; ++it)
+    {
+        accounts.emplace_back(it->first);
+    }
+
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        for (auto const& account : accounts)
+        {
+            auto it = mDeferred.find(account);
+            if (it == mDeferred.end())
+            {
+                continue;
+            }
+            auto& queue = it->second;
+            auto peer = queue.front().mPeer.lock();
+            if (peer && peer->shouldAbort())
+            {
+                peer.reset();
+            }
+            if (peer && !take(peer->getPeerID(), account))
+            {
+                continue;
+            }
+
+            auto deferred = std::move(queue.front());
+            queue.pop_front();
+            --mDeferredCount;
+            if (queue.empty())
+            {
+                mDeferred.erase(it);
+            }
+            progress = true;
+            if (!peer)
+            {
+                mDropped.Mark();
+                continue;
+            }
+
+            mLastServed = account;
+            mAdmitted.Mark();
+            LoadManager::PeerContext context(mApp, peer->getPeerID());
+            peer->processTransaction(deferred.mMsg, deferred.mTx);
+        }
+    }
+
+    mQueued.set_count(mDeferredCount);
+    if (!mDeferred.empty())
+    {
+        scheduleDrain();
+    }
+}
+
+void
+TxAdmission::shutdown()
+{
+    mDrainTimer.cancel();
+    mDeferred.clear();
+    mDeferredCount = 0;
+    mQueued.set_count(0);
+}
+}
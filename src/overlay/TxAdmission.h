@@ -0,0 +1,107 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/Peer.h"
+#include "util/Timer.h"
+#include "xdr/Stellar-types.h"
+
+#include <chrono>
+#include <deque>
+#include <map>
+
+namespace medida
+{
+class Counter;
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * TxAdmission paces the flooded transactions peers hand to the herder, so
+ * that no one peer, nor one account, takes up the main thread with
+ * transactions to validate: each peer gets TX_ADMISSION_RATE_PER_PEER
+ * transactions a second, and each source account
+ * TX_ADMISSION_RATE_PER_ACCOUNT, in bursts of up to a second's worth.
+ *
+ * A transaction over either rate is deferred rather than dropped, until both
+ * rates allow it. Deferred transactions are kept by source account, in
+ * arrival order, so that those of an account still reach the herder in
+ * sequence number order, and the accounts take turns. Only once
+ * TX_ADMISSION_MAX_DEFERRED transactions are deferred are new ones dropped,
+ * as are those of peers that disconnected meanwhile.
+ *
+ * The LoadManager counts the transactions deferred of each peer, and is
+ * charged the time spent on them, as for any other.
+ */
+class TxAdmission
+{
+    // Tokens of a rate limit, refilled continuously, up to a second's worth.
+    struct Bucket
+    {
+        double mTokens;
+        VirtualClock::time_point mRefilled;
+
+        // refills up to now, returns whether a token is left
+        bool refill(uint32_t rate, VirtualClock::time_point now);
+    };
+
+    struct Deferred
+    {
+        std::weak_ptr<Peer> mPeer;
+        StellarMessage mMsg;
+        TransactionFramePtr mTx;
+    };
+
+    Application& mApp;
+    std::map<NodeID, Bucket> mPeerBuckets;
+    std::map<AccountID, Bucket> mAccountBuckets;
+    std::map<AccountID, std::deque<Deferred>> mDeferred;
+    size_t mDeferredCount{0};
+    // the account served last, the next one gets the first turn
+    AccountID mLastServed;
+    VirtualTimer mDrainTimer;
+    bool mDrainArmed{false};
+
+    medida::Meter& mAdmitted;
+    medida::Meter& mDeferredMeter;
+    medida::Meter& mDropped;
+    medida::Counter& mQueued;
+
+    // The bucket of `key`, a new full one if it has none; forgets the full
+    // ones first if there are too many.
+    static Bucket& findBucket(std::map<PublicKey, Bucket>& buckets,
+                              PublicKey const& key, uint32_t rate,
+                              VirtualClock::time_point now);
+    // Takes a token from the rates of `peer` and `account`, if both have one.
+    bool take(NodeID const& peer, AccountID const& account);
+    void scheduleDrain();
+    // hands the herder the deferred transactions the rates allow
+    void drain();
+
+  public:
+    // how often deferred transactions are looked at
+    static std::chrono::milliseconds const DRAIN_INTERVAL;
+
+    explicit TxAdmission(Application& app);
+
+    // Whether `peer` can hand `tx` to the herder right away. If not, it is
+    // deferred, and handed later by Peer::processTransaction, or dropped.
+    bool admit(Peer::pointer peer, StellarMessage const& msg,
+               TransactionFramePtr tx);
+
+    size_t
+    getDeferredCount() const
+    {
+        return mDeferredCount;
+    }
+
+    void shutdown();
+};
+}
@@ -0,0 +1,81 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "overlay/LoadManager.h"
+#include "overlay/LoopbackPeer.h"
+#include "overlay/OverlayManager.h"
+#include "overlay/TxAdmission.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Timer.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+using namespace stellar;
+
+TEST_CASE("flooded transactions are paced", "[overlay][txadmission]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config cfg2 = getTestConfig(1);
+    cfg2.TX_ADMISSION_RATE_PER_ACCOUNT = 2;
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+
+    auto& admission = app2->getOverlayManager().getTxAdmission();
+    auto& admitted = app2->getMetrics().NewMeter(
+        {"overlay", "tx-admission", "admit"}, "transaction");
+    auto& deferred = app2->getMetrics().NewMeter(
+        {"overlay", "tx-admission", "defer"}, "transaction");
+
+    // whether the herder takes them does not matter here
+    auto send = [&](SecretKey const& source, SequenceNumber seq) {
+        StellarMessage msg;
+        msg.type(TRANSACTION);
+        msg.transaction().tx.sourceAccount = source.getPublicKey();
+        msg.transaction().tx.fee = 100;
+        msg.transaction().tx.seqNum = seq;
+        conn.getInitiator()->sendMessage(msg);
+    };
+    auto busy = SecretKey::random();
+    auto other = SecretKey::random();
+    for (SequenceNumber seq = 1; seq <= 5; ++seq)
+    {
+        send(busy, seq);
+    }
+    send(other, 1);
+
+    while (admitted.count() + deferred.count() < 6)
+    {
+        clock.crank(false);
+    }
+    auto start = clock.now();
+
+    // a burst of two for the busy account, the other one is not held up
+    REQUIRE(admitted.count() == 3);
+    REQUIRE(deferred.count() == 3);
+    REQUIRE(admission.getDeferredCount() == 3);
+    auto costs = app2->getOverlayManager().getLoadManager().getJsonPeerCosts(
+        conn.getAcceptor()->getPeerID());
+    REQUIRE(costs["messages"]["TRANSACTION"]["throttled"].asUInt64() == 3);
+
+    // then two a second
+    while (admission.getDeferredCount() != 0)
+    {
+        REQUIRE(clock.now() < start + std::chrono::seconds(10));
+        clock.crank(false);
+    }
+    REQUIRE(admitted.count() == 6);
+    REQUIRE(clock.now() - start >= std::chrono::seconds(1));
+}
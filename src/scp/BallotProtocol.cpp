@@ -141,11 +141,65 @@ BallotProtocol::recordEnvelope(SCPEnvelope const& env)
     }
     else
     {
+        for (auto const& v : getBallotValues(oldp->second.statement))
+        {
+            auto it = mNodesByValue.find(v);
+            it->second.erase(st.nodeID);
+            if (it->second.empty())
+            {
+                mNodesByValue.erase(it);
+            }
+        }
         oldp->second = env;
     }
+    for (auto const& v : getBallotValues(st))
+    {
+        mNodesByValue[v].insert(st.nodeID);
+    }
     mSlot.recordStatement(env.statement);
 }
 
+std::set<Value>
+BallotProtocol::getBallotValues(SCPStatement const& st)
+{
+    std::set<Value> res;
+    auto const& pl = st.pledges;
+    switch (pl.type())
+    {
+    case SCP_ST_PREPARE:
+    {
+        auto const& p = pl.prepare();
+        res.emplace(p.ballot.value);
+        if (p.prepared)
+        {
+            res.emplace(p.prepared->value);
+        }
+        if (p.preparedPrime)
+        {
+            res.emplace(p.preparedPrime->value);
+        }
+    }
+    break;
+    case SCP_ST_CONFIRM:
+        res.emplace(pl.confirm().ballot.value);
+        break;
+    case SCP_ST_EXTERNALIZE:
+        res.emplace(pl.externalize().commit.value);
+        break;
+    default:
+        dbgAbort();
+    }
+    return res;
+}
+
+std::set<NodeID> const&
+BallotProtocol::getNodesWithValue(Value const& value) const
+{
+    static std::set<NodeID> const none;
+    auto it = mNodesByValue.find(value);
+    return it == mNodesByValue.end() ? none : it->second;
+}
+
 SCP::EnvelopeState
 BallotProtocol::processEnvelope(SCPEnvelope const& envelope, bool self)
 {
@@ -721,10 +775,11 @@ BallotProtocol::getPrepareCandidates(SCPStatement const& hint)
 
         auto const& val = topVote.value;
 
-        // find candidates that may have been prepared
-        for (auto const& e : mLatestEnvelopes)
+        // find candidates that may have been prepared, all of which are
+        // compatible with topVote
+        for (auto const& n : getNodesWithValue(val))
         {
-            SCPStatement const& st = e.second.statement;
+            SCPStatement const& st = mLatestEnvelopes.find(n)->second.statement;
             switch (st.pledges.type())
             {
             case SCP_ST_PREPARE:
@@ -834,6 +889,7 @@ BallotProtocol::attemptPreparedAccept(SCPStatement const& hint)
         }
 
         bool accepted = federatedAccept(
+            ballot.value,
             // checks if any node is voting for this ballot
             [&ballot](SCPStatement const& st) {
                 bool res;
@@ -941,6 +997,7 @@ BallotProtocol::attemptPreparedConfirmed(SCPStatement const& hint)
         }
 
         bool ratified = federatedRatify(
+            ballot.value,
             std::bind(&BallotProtocol::hasPreparedBallot, ballot, _1));
         if (ratified)
         {
@@ -977,6 +1034,7 @@ BallotProtocol::attemptPreparedConfirmed(SCPStatement const& hint)
                     continue;
                 }
                 bool ratified = federatedRatify(
+                    ballot.value,
                     std::bind(&BallotProtocol::hasPreparedBallot, ballot, _1));
                 if (ratified)
                 {
@@ -1117,9 +1175,9 @@ std::set<uint32>
 BallotProtocol::getCommitBoundariesFromStatements(SCPBallot const& ballot)
 {
     std::set<uint32> res;
-    for (auto const& env : mLatestEnvelopes)
+    for (auto const& n : getNodesWithValue(ballot.value))
     {
-        auto const& pl = env.second.statement.pledges;
+        auto const& pl = mLatestEnvelopes.find(n)->second.statement.pledges;
         switch (pl.type())
         {
         case SCP_ST_PREPARE:
@@ -1216,6 +1274,7 @@ BallotProtocol::attemptAcceptCommit(SCPStatement const& hint)
 
     auto pred = [&ballot, this](Interval const& cur) -> bool {
         return federatedAccept(
+            ballot.value,
             [&](SCPStatement const& st) -> bool {
                 bool res = false;
                 auto const& pl = st.pledges;
@@ -1382,8 +1441,8 @@ BallotProtocol::attemptBump()
                 break;
             }
 
-            bool vBlocking = LocalNode::isVBlocking(
-                getLocalNode()->getQuorumSet(), mLatestEnvelopes,
+            bool vBlocking = getLocalNode()->isVBlocking(
+                mLatestEnvelopes,
                 [&](SCPStatement const& st) {
                     bool res;
                     auto const& pl = st.pledges;
@@ -1477,6 +1536,7 @@ BallotProtocol::attemptConfirmCommit(SCPStatement const& hint)
 
     auto pred = [&ballot, this](Interval const& cur) -> bool {
         return federatedRatify(
+            ballot.value,
             std::bind(&BallotProtocol::commitPredicate, ballot, cur, _1));
     };
 
@@ -1791,6 +1851,38 @@ BallotProtocol::getCurrentState() const
     return res;
 }
 
+bool
+BallotProtocol::compact()
+{
+    if (mPhase != SCP_PHASE_EXTERNALIZE)
+    {
+        return false;
+    }
+    auto state = getExternalizingState();
+    mLatestEnvelopes.clear();
+    mNodesByValue.clear();
+    for (auto& e : state)
+    {
+        for (auto const& v : getBallotValues(e.statement))
+        {
+            mNodesByValue[v].insert(e.statement.nodeID);
+        }
+        mLatestEnvelopes.emplace(e.statement.nodeID, std::move(e));
+    }
+    return true;
+}
+
+size_t
+BallotProtocol::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (auto const& n : mLatestEnvelopes)
+    {
+        bytes += sizeof(n) + xdr::xdr_size(n.second);
+    }
+    return bytes;
+}
+
 std::vector<SCPEnvelope>
 BallotProtocol::getExternalizingState() const
 {
@@ -2091,16 +2183,18 @@ BallotProtocol::getLocalNode()
 }
 
 bool
-BallotProtocol::federatedAccept(StatementPredicate voted,
+BallotProtocol::federatedAccept(Value const& value, StatementPredicate voted,
                                 StatementPredicate accepted)
 {
-    return mSlot.federatedAccept(voted, accepted, mLatestEnvelopes);
+    return mSlot.federatedAccept(voted, accepted, mLatestEnvelopes,
+                                 &getNodesWithValue(value));
 }
 
 bool
-BallotProtocol::federatedRatify(StatementPredicate voted)
+BallotProtocol::federatedRatify(Value const& value, StatementPredicate voted)
 {
-    return mSlot.federatedRatify(voted, mLatestEnvelopes);
+    return mSlot.federatedRatify(voted, mLatestEnvelopes,
+                                 &getNodesWithValue(value));
 }
 
 void
@@ -2114,9 +2208,10 @@ BallotProtocol::checkHeardFromQuorum()
     // for a given counter on the local node
     if (mCurrentBallot)
     {
-        if (LocalNode::isQuorum(
-                getLocalNode()->getQuorumSet(), mLatestEnvelopes,
-                std::bind(&Slot::getQuorumSetFromStatement, &mSlot, _1),
+        if (getLocalNode()->isQuorum(
+                mLatestEnvelopes,
+                std::bind(&Slot::getCompiledQuorumSetFromStatement, &mSlot,
+                          _1),
                 [&](SCPStatement const& st) {
                     bool res;
                     if (st.pledges.type() == SCP_ST_PREPARE)
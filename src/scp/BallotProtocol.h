@@ -50,6 +50,11 @@ class BallotProtocol
     SCPPhase mPhase;                                // Phi
     std::unique_ptr<Value> mValueOverride;          // z
 
+    // nodes of M by the values of the ballots in their statement (see
+    // getBallotValues): a predicate on ballots of one value can only hold
+    // for the statements of the nodes listed under that value
+    std::map<Value, std::set<NodeID>> mNodesByValue;
+
     int mCurrentMessageLevel; // number of messages triggered in one run
 
     std::shared_ptr<SCPEnvelope>
@@ -112,6 +117,13 @@ class BallotProtocol
 
     std::vector<SCPEnvelope> getExternalizingState() const;
 
+    // if the slot externalized, drops the latest envelopes that
+    // getExternalizingState does not return; returns whether it externalized
+    bool compact();
+
+    // approximate bytes held by the latest envelopes of each node
+    size_t getMemoryBytes() const;
+
   private:
     // attempts to make progress using the latest statement as a hint
     // calls into the various attempt* methods, emits message
@@ -228,6 +240,13 @@ class BallotProtocol
     // records the statement in the state machine
     void recordEnvelope(SCPEnvelope const& env);
 
+    // values of b, p and p' for PREPARE, of b for CONFIRM and of c for
+    // EXTERNALIZE
+    static std::set<Value> getBallotValues(SCPStatement const& st);
+
+    // nodes whose latest statement has a ballot with the given value
+    std::set<NodeID> const& getNodesWithValue(Value const& value) const;
+
     // ** State related methods
 
     // helper function that updates the current ballot
@@ -257,8 +276,11 @@ class BallotProtocol
 
     std::shared_ptr<LocalNode> getLocalNode();
 
-    bool federatedAccept(StatementPredicate voted, StatementPredicate accepted);
-    bool federatedRatify(StatementPredicate voted);
+    // federated agreement on statements about ballots of `value`: the
+    // predicates must only hold for statements with such ballots
+    bool federatedAccept(Value const& value, StatementPredicate voted,
+                         StatementPredicate accepted);
+    bool federatedRatify(Value const& value, StatementPredicate voted);
 
     void startBallotProtocolTimer();
     void stopBallotProtocolTimer();
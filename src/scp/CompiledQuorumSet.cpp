@@ -0,0 +1,151 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "scp/CompiledQuorumSet.h"
+#include "util/XDROperators.h"
+
+#include <algorithm>
+#include <bitset>
+
+namespace stellar
+{
+
+size_t
+NodeIndex::getIndex(NodeID const& node)
+{
+    return mIndices.emplace(node, mIndices.size()).first->second;
+}
+
+bool
+NodeIndex::findIndex(NodeID const& node, size_t& index) const
+{
+    auto it = mIndices.find(node);
+    if (it == mIndices.end())
+    {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
+
+void
+NodeBitSet::set(size_t i)
+{
+    if (i / 64 >= mWords.size())
+    {
+        mWords.resize(i / 64 + 1);
+    }
+    mWords[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+void
+NodeBitSet::reset(size_t i)
+{
+    if (i / 64 < mWords.size())
+    {
+        mWords[i / 64] &= ~(uint64_t(1) << (i % 64));
+    }
+}
+
+bool
+NodeBitSet::test(size_t i) const
+{
+    return i / 64 < mWords.size() &&
+           (mWords[i / 64] & (uint64_t(1) << (i % 64))) != 0;
+}
+
+size_t
+NodeBitSet::countCommon(NodeBitSet const& other) const
+{
+    size_t res = 0;
+    auto n = std::min(mWords.size(), other.mWords.size());
+    for (size_t i = 0; i < n; ++i)
+    {
+        res += std::bitset<64>(mWords[i] & other.mWords[i]).count();
+    }
+    return res;
+}
+
+CompiledQuorumSet::CompiledQuorumSet(SCPQuorumSet const& qSet,
+                                     NodeIndex& index)
+    : mThreshold(qSet.threshold)
+    , mSize(qSet.validators.size() + qSet.innerSets.size())
+{
+    for (auto const& v : qSet.validators)
+    {
+        auto i = index.getIndex(v);
+        if (mValidators.test(i))
+        {
+            mRepeatedValidators.push_back(i);
+        }
+        mValidators.set(i);
+    }
+    mInnerSets.reserve(qSet.innerSets.size());
+    for (auto const& inner : qSet.innerSets)
+    {
+        mInnerSets.emplace_back(inner, index);
+    }
+}
+
+size_t
+CompiledQuorumSet::countPresent(NodeBitSet const& nodes) const
+{
+    auto res = mValidators.countCommon(nodes);
+    for (auto i : mRepeatedValidators)
+    {
+        if (nodes.test(i))
+        {
+            res++;
+        }
+    }
+    return res;
+}
+
+bool
+CompiledQuorumSet::isQuorumSlice(NodeBitSet const& nodes) const
+{
+    // like the recursive version, a set with a threshold of 0 has no slice
+    if (mThreshold == 0)
+    {
+        return false;
+    }
+    auto count = countPresent(nodes);
+    for (auto it = mInnerSets.begin();
+         count < mThreshold && it != mInnerSets.end(); ++it)
+    {
+        if (it->isQuorumSlice(nodes))
+        {
+            count++;
+        }
+    }
+    return count >= mThreshold;
+}
+
+bool
+CompiledQuorumSet::isVBlocking(NodeBitSet const& nodes) const
+{
+    // There is no v-blocking set for {\empty}
+    if (mThreshold == 0)
+    {
+        return false;
+    }
+    // blocked once fewer than threshold items are left unblocked (for
+    // thresholds larger than the set, once anything is blocked)
+    size_t leftTillBlock = 1;
+    if (mSize + 1 > mThreshold + leftTillBlock)
+    {
+        leftTillBlock = mSize + 1 - mThreshold;
+    }
+    auto count = countPresent(nodes);
+    for (auto it = mInnerSets.begin();
+         count < leftTillBlock && it != mInnerSets.end(); ++it)
+    {
+        if (it->isVBlocking(nodes))
+        {
+            count++;
+        }
+    }
+    return count >= leftTillBlock;
+}
+}
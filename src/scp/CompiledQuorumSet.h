@@ -0,0 +1,91 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdr/Stellar-SCP.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Assigns small, dense indices to the nodes that appear in compiled quorum
+ * sets, so that sets of nodes can be represented as NodeBitSets.
+ * Indices are handed out in order of first appearance and never reused
+ * until the index is cleared.
+ */
+class NodeIndex
+{
+    std::map<NodeID, size_t> mIndices;
+
+  public:
+    // returns the index of `node`, assigning one if needed
+    size_t getIndex(NodeID const& node);
+
+    // returns the index of `node` through `index` if it has one
+    bool findIndex(NodeID const& node, size_t& index) const;
+
+    size_t
+    size() const
+    {
+        return mIndices.size();
+    }
+
+    void
+    clear()
+    {
+        mIndices.clear();
+    }
+};
+
+// Set of node indices; grows as needed, bits past the end are unset.
+class NodeBitSet
+{
+    std::vector<uint64_t> mWords;
+
+  public:
+    void set(size_t i);
+    void reset(size_t i);
+    bool test(size_t i) const;
+
+    // number of nodes present in both sets
+    size_t countCommon(NodeBitSet const& other) const;
+};
+
+/**
+ * An SCPQuorumSet flattened against a NodeIndex: the validators of each
+ * (inner) set become a bitset, so that testing a set of nodes against it
+ * takes a few word operations per inner set instead of a search per
+ * validator.
+ *
+ * Gives the same answers as LocalNode::isQuorumSlice and
+ * LocalNode::isVBlocking on the original quorum set, provided the
+ * NodeBitSets tested use the same NodeIndex.
+ */
+class CompiledQuorumSet
+{
+    uint32 mThreshold;
+    NodeBitSet mValidators;
+    // indices of validators listed more than once, counted again for each
+    // extra occurrence (never the case for sane quorum sets)
+    std::vector<size_t> mRepeatedValidators;
+    size_t mSize;
+    std::vector<CompiledQuorumSet> mInnerSets;
+
+    size_t countPresent(NodeBitSet const& nodes) const;
+
+  public:
+    CompiledQuorumSet(SCPQuorumSet const& qSet, NodeIndex& index);
+
+    bool isQuorumSlice(NodeBitSet const& nodes) const;
+    bool isVBlocking(NodeBitSet const& nodes) const;
+};
+
+typedef std::shared_ptr<CompiledQuorumSet const> CompiledQuorumSetPtr;
+}
@@ -20,10 +20,15 @@ namespace stellar
 {
 LocalNode::LocalNode(NodeID const& nodeID, bool isValidator,
                      SCPQuorumSet const& qSet, SCP* scp)
-    : mNodeID(nodeID), mIsValidator(isValidator), mQSet(qSet), mSCP(scp)
+    : mNodeID(nodeID)
+    , mIsValidator(isValidator)
+    , mQSet(qSet)
+    , mSCP(scp)
+    , mCompiledQSets(1000)
 {
     normalizeQSet(mQSet);
     mQSetHash = sha256(xdr::xdr_to_opaque(mQSet));
+    compileLocalQuorumSet();
 
     CLOG(INFO, "SCP") << "LocalNode::LocalNode"
                       << "@" << KeyUtils::toShortString(mNodeID)
@@ -47,6 +52,50 @@ LocalNode::updateQuorumSet(SCPQuorumSet const& qSet)
 {
     mQSetHash = sha256(xdr::xdr_to_opaque(qSet));
     mQSet = qSet;
+    compileLocalQuorumSet();
+}
+
+void
+LocalNode::compileLocalQuorumSet()
+{
+    mCompiledQSet = std::make_shared<CompiledQuorumSet>(mQSet, mNodeIndex);
+    mCompiledQSets.put(mQSetHash, mCompiledQSet);
+}
+
+void
+LocalNode::limitNodeIndex()
+{
+    if (mNodeIndex.size() > MAX_INDEXED_NODES)
+    {
+        mCompiledQSets.clear();
+        mNodeIndex.clear();
+        compileLocalQuorumSet();
+    }
+}
+
+CompiledQuorumSetPtr
+LocalNode::getCompiledQuorumSet(Hash const& qSetHash,
+                                std::function<SCPQuorumSetPtr()> const& fetch)
+{
+    if (mCompiledQSets.exists(qSetHash))
+    {
+        return mCompiledQSets.get(qSetHash);
+    }
+    auto qSet = fetch();
+    if (!qSet)
+    {
+        return nullptr;
+    }
+    auto res = std::make_shared<CompiledQuorumSet>(*qSet, mNodeIndex);
+    mCompiledQSets.put(qSetHash, res);
+    return res;
+}
+
+CompiledQuorumSetPtr
+LocalNode::getCompiledSingletonQSet(NodeID const& nodeID)
+{
+    return std::make_shared<CompiledQuorumSet>(buildSingletonQSet(nodeID),
+                                               mNodeIndex);
 }
 
 SCPQuorumSet const&
@@ -277,6 +326,108 @@ LocalNode::isQuorum(
     return isQuorumSlice(qSet, pNodes);
 }
 
+namespace
+{
+// runs f over the entries of map, or only those of candidates if set
+template <typename F>
+void
+forEachCandidate(std::map<NodeID, SCPEnvelope> const& map,
+                 std::set<NodeID> const* candidates, F const& f)
+{
+    if (!candidates)
+    {
+        for (auto const& it : map)
+        {
+            f(it.first, it.second.statement);
+        }
+        return;
+    }
+    for (auto const& n : *candidates)
+    {
+        auto it = map.find(n);
+        if (it != map.end())
+        {
+            f(it->first, it->second.statement);
+        }
+    }
+}
+}
+
+NodeBitSet
+LocalNode::toNodeBitSet(std::map<NodeID, SCPEnvelope> const& map,
+                        std::function<bool(SCPStatement const&)> const& filter,
+                        std::set<NodeID> const* candidates)
+{
+    NodeBitSet res;
+    forEachCandidate(map, candidates,
+                     [&](NodeID const& n, SCPStatement const& st) {
+                         if (filter(st))
+                         {
+                             res.set(mNodeIndex.getIndex(n));
+                         }
+                     });
+    return res;
+}
+
+bool
+LocalNode::isVBlocking(std::map<NodeID, SCPEnvelope> const& map,
+                       std::function<bool(SCPStatement const&)> const& filter,
+                       std::set<NodeID> const* candidates)
+{
+    limitNodeIndex();
+    return mCompiledQSet->isVBlocking(toNodeBitSet(map, filter, candidates));
+}
+
+bool
+LocalNode::isQuorum(
+    std::map<NodeID, SCPEnvelope> const& map,
+    std::function<CompiledQuorumSetPtr(SCPStatement const&)> const& qfun,
+    std::function<bool(SCPStatement const&)> const& filter,
+    std::set<NodeID> const* candidates)
+{
+    limitNodeIndex();
+
+    // resolve the quorum set of each candidate once, then drop the nodes
+    // whose slices aren't satisfied until none is left to drop
+    struct Member
+    {
+        size_t mIndex;
+        CompiledQuorumSetPtr mQSet;
+    };
+    std::vector<Member> members;
+    NodeBitSet pNodes;
+    forEachCandidate(map, candidates,
+                     [&](NodeID const& n, SCPStatement const& st) {
+                         if (filter(st))
+                         {
+                             auto index = mNodeIndex.getIndex(n);
+                             members.push_back(Member{index, qfun(st)});
+                             pNodes.set(index);
+                         }
+                     });
+
+    bool removed;
+    do
+    {
+        removed = false;
+        for (auto it = members.begin(); it != members.end();)
+        {
+            if (!it->mQSet || !it->mQSet->isQuorumSlice(pNodes))
+            {
+                pNodes.reset(it->mIndex);
+                it = members.erase(it);
+                removed = true;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    } while (removed);
+
+    return mCompiledQSet->isQuorumSlice(pNodes);
+}
+
 std::vector<NodeID>
 LocalNode::findClosestVBlocking(
     SCPQuorumSet const& qset, std::map<NodeID, SCPEnvelope> const& map,
@@ -8,6 +8,8 @@
 #include <set>
 #include <vector>
 
+#include "lib/util/lrucache.hpp"
+#include "scp/CompiledQuorumSet.h"
 #include "scp/SCP.h"
 #include "util/HashOfHash.h"
 
@@ -30,6 +32,23 @@ class LocalNode
 
     SCP* mSCP;
 
+    // quorum sets compiled against mNodeIndex, including mQSet's, by hash
+    NodeIndex mNodeIndex;
+    cache::lru_cache<Hash, CompiledQuorumSetPtr> mCompiledQSets;
+    CompiledQuorumSetPtr mCompiledQSet;
+
+    // starts over with an empty mNodeIndex once it holds more than this
+    // many nodes, so that quorum sets churning through arbitrary nodes don't
+    // keep growing every NodeBitSet
+    static size_t const MAX_INDEXED_NODES = 10000;
+
+    void compileLocalQuorumSet();
+    void limitNodeIndex();
+    NodeBitSet
+    toNodeBitSet(std::map<NodeID, SCPEnvelope> const& map,
+                 std::function<bool(SCPStatement const&)> const& filter,
+                 std::set<NodeID> const* candidates);
+
   public:
     LocalNode(NodeID const& nodeID, bool isValidator, SCPQuorumSet const& qSet,
               SCP* scp);
@@ -99,6 +118,29 @@ class LocalNode
             [](SCPStatement const&) { return true; },
         NodeID const* excluded = nullptr);
 
+    // Compiled forms of quorum sets, valid until the next call to one of the
+    // member isVBlocking/isQuorum below. `fetch` is only called (and the
+    // result cached) when the quorum set for `qSetHash` isn't compiled yet;
+    // returns nullptr if it returns nullptr.
+    CompiledQuorumSetPtr
+    getCompiledQuorumSet(Hash const& qSetHash,
+                         std::function<SCPQuorumSetPtr()> const& fetch);
+    CompiledQuorumSetPtr getCompiledSingletonQSet(NodeID const& nodeID);
+
+    // Same as the static isVBlocking and isQuorum above for this node's
+    // quorum set, evaluated on compiled quorum sets. `qfun` should return
+    // quorum sets compiled by this node. If `candidates` is set, only those
+    // nodes of `map` are considered, the filter being known to reject the
+    // others.
+    bool isVBlocking(std::map<NodeID, SCPEnvelope> const& map,
+                     std::function<bool(SCPStatement const&)> const& filter,
+                     std::set<NodeID> const* candidates = nullptr);
+    bool isQuorum(
+        std::map<NodeID, SCPEnvelope> const& map,
+        std::function<CompiledQuorumSetPtr(SCPStatement const&)> const& qfun,
+        std::function<bool(SCPStatement const&)> const& filter,
+        std::set<NodeID> const* candidates = nullptr);
+
     Json::Value toJson(SCPQuorumSet const& qSet) const;
     std::string to_string(SCPQuorumSet const& qSet) const;
 
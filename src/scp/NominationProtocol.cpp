@@ -251,8 +251,14 @@ uint64
 NominationProtocol::hashValue(Value const& value)
 {
     dbgAssert(!mPreviousValue.empty());
-    return mSlot.getSCPDriver().computeValueHash(
-        mSlot.getSlotIndex(), mPreviousValue, mRoundNumber, value);
+    auto it = mValueHashes.find(value);
+    if (it == mValueHashes.end())
+    {
+        auto h = mSlot.getSCPDriver().computeValueHash(
+            mSlot.getSlotIndex(), mPreviousValue, mRoundNumber, value);
+        it = mValueHashes.emplace(value, h).first;
+    }
+    return it->second;
 }
 
 uint64
@@ -292,25 +298,24 @@ NominationProtocol::getNewValueFromNomination(SCPNomination const& nom)
     uint64 newHash = 0;
 
     applyAll(nom, [&](Value const& value) {
-        Value valueToNominate;
+        // only copy the value if it is picked
+        Value extracted;
+        Value const* valueToNominate = &value;
         auto vl = validateValue(value);
-        if (vl == SCPDriver::kFullyValidatedValue)
-        {
-            valueToNominate = value;
-        }
-        else
+        if (vl != SCPDriver::kFullyValidatedValue)
         {
-            valueToNominate = extractValidValue(value);
+            extracted = extractValidValue(value);
+            valueToNominate = &extracted;
         }
-        if (!valueToNominate.empty())
+        if (!valueToNominate->empty())
         {
-            if (mVotes.find(valueToNominate) == mVotes.end())
+            if (mVotes.find(*valueToNominate) == mVotes.end())
             {
-                uint64 curHash = hashValue(valueToNominate);
+                uint64 curHash = hashValue(*valueToNominate);
                 if (curHash >= newHash)
                 {
                     newHash = curHash;
-                    newVote = valueToNominate;
+                    newVote = *valueToNominate;
                 }
             }
         }
@@ -473,6 +478,7 @@ NominationProtocol::nominate(Value const& value, Value const& previousValue,
     mPreviousValue = previousValue;
 
     mRoundNumber++;
+    mValueHashes.clear();
     updateRoundLeaders();
 
     Value nominatingValue;
@@ -604,4 +610,28 @@ NominationProtocol::getCurrentState() const
     }
     return res;
 }
+
+void
+NominationProtocol::compact()
+{
+    stopNomination();
+    mVotes.clear();
+    mAccepted.clear();
+    mCandidates.clear();
+    mLatestNominations.clear();
+    mRoundLeaders.clear();
+    mValueHashes.clear();
+    mLastEnvelope.reset();
+}
+
+size_t
+NominationProtocol::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (auto const& n : mLatestNominations)
+    {
+        bytes += sizeof(n) + xdr::xdr_size(n.second);
+    }
+    return bytes;
+}
 }
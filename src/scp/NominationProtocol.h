@@ -39,6 +39,11 @@ class NominationProtocol
     // the value from the previous slot
     Value mPreviousValue;
 
+    // hashValue results for the current round: leaders keep renominating
+    // the same values, each of which would otherwise be hashed again for
+    // every nomination that carries it
+    std::map<Value, uint64> mValueHashes;
+
     bool isNewerStatement(NodeID const& nodeID, SCPNomination const& st);
     static bool isNewerStatement(SCPNomination const& oldst,
                                  SCPNomination const& st);
@@ -113,5 +118,11 @@ class NominationProtocol
     void setStateFromEnvelope(SCPEnvelope const& e);
 
     std::vector<SCPEnvelope> getCurrentState() const;
+
+    // drops the nomination state, once the slot externalized
+    void compact();
+
+    // approximate bytes held by the latest nominations of each node
+    size_t getMemoryBytes() const;
 };
 }
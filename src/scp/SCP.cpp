@@ -92,6 +92,31 @@ SCP::purgeSlots(uint64 maxSlotIndex)
     }
 }
 
+void
+SCP::compactSlots(uint64 maxSlotIndex)
+{
+    for (auto const& s : mKnownSlots)
+    {
+        if (s.first >= maxSlotIndex)
+        {
+            break;
+        }
+        s.second->compact();
+    }
+}
+
+void
+SCP::setMaxStatementsHistory(size_t maxStatements)
+{
+    mMaxStatementsHistory = maxStatements;
+}
+
+size_t
+SCP::getMaxStatementsHistory() const
+{
+    return mMaxStatementsHistory;
+}
+
 std::shared_ptr<LocalNode>
 SCP::getLocalNode()
 {
@@ -194,6 +219,17 @@ SCP::getCumulativeStatemtCount() const
     return c;
 }
 
+size_t
+SCP::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (auto const& s : mKnownSlots)
+    {
+        bytes += sizeof(s) + s.second->getMemoryBytes();
+    }
+    return bytes;
+}
+
 std::vector<SCPEnvelope>
 SCP::getLatestMessagesSend(uint64 slotIndex)
 {
@@ -87,6 +87,16 @@ class SCP
     // than the specified `maxSlotIndex`.
     void purgeSlots(uint64 maxSlotIndex);
 
+    // Reduces the slots whose slotIndex is smaller than the specified
+    // `maxSlotIndex` and that externalized to what getExternalizingState
+    // returns, see Slot::compact.
+    void compactSlots(uint64 maxSlotIndex);
+
+    // Most statements each slot keeps in its history (see
+    // Slot::recordStatement); 0, the default, for no limit.
+    void setMaxStatementsHistory(size_t maxStatements);
+    size_t getMaxStatementsHistory() const;
+
     // Returns whether the local node is a validator.
     bool isValidator();
 
@@ -97,6 +107,7 @@ class SCP
     // protocol to system metric reporters.
     size_t getKnownSlotsCount() const;
     size_t getCumulativeStatemtCount() const;
+    size_t getMemoryBytes() const;
 
     // returns the latest messages sent for the given slot
     std::vector<SCPEnvelope> getLatestMessagesSend(uint64 slotIndex);
@@ -136,6 +147,7 @@ class SCP
   protected:
     std::shared_ptr<LocalNode> mLocalNode;
     std::map<uint64, std::shared_ptr<Slot>> mKnownSlots;
+    size_t mMaxStatementsHistory{0};
 
     // Slot getter
     std::shared_ptr<Slot> getSlot(uint64 slotIndex, bool create);
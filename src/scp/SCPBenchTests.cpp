@@ -0,0 +1,363 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "lib/catch.hpp"
+#include "scp/SCP.h"
+#include "scp/SCPDriver.h"
+#include "util/Logging.h"
+#include "util/XDROperators.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+
+// Counts every allocation made through the global operator new, so that the
+// benchmarks below can report allocations per envelope processed. This only
+// adds a relaxed increment to each allocation of the test binary.
+namespace
+{
+std::atomic<size_t> gAllocations{0};
+}
+
+void*
+operator new(std::size_t n)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void*
+operator new[](std::size_t n)
+{
+    return ::operator new(n);
+}
+
+void
+operator delete[](void* p) noexcept
+{
+    ::operator delete(p);
+}
+
+namespace stellar
+{
+
+namespace
+{
+
+class BenchNetwork;
+
+// SCPDriver that hands envelopes to a BenchNetwork, validates everything and
+// makes the node with the lowest index the nomination leader.
+class BenchNode : public SCPDriver
+{
+    BenchNetwork& mNetwork;
+    std::map<int, std::function<void()>> mTimers;
+
+  public:
+    SCP mSCP;
+    bool mExternalized{false};
+
+    BenchNode(BenchNetwork& network, NodeID const& nodeID,
+              SCPQuorumSet const& qSet)
+        : mNetwork(network), mSCP(*this, nodeID, true, qSet)
+    {
+    }
+
+    void
+    signEnvelope(SCPEnvelope&) override
+    {
+    }
+
+    bool
+    verifyEnvelope(SCPEnvelope const&) override
+    {
+        return true;
+    }
+
+    SCPQuorumSetPtr getQSet(Hash const& qSetHash) override;
+    void emitEnvelope(SCPEnvelope const& envelope) override;
+    uint64 computeHashNode(uint64 slotIndex, Value const& prev,
+                           bool isPriority, int32_t roundNumber,
+                           NodeID const& nodeID) override;
+
+    SCPDriver::ValidationLevel
+    validateValue(uint64, Value const&, bool) override
+    {
+        return SCPDriver::kFullyValidatedValue;
+    }
+
+    uint64
+    computeValueHash(uint64, Value const&, int32_t, Value const&) override
+    {
+        return 0;
+    }
+
+    Value
+    combineCandidates(uint64, std::set<Value> const& candidates) override
+    {
+        return *candidates.rbegin();
+    }
+
+    void
+    setupTimer(uint64, int timerID, std::chrono::milliseconds,
+               std::function<void()> cb) override
+    {
+        if (cb)
+        {
+            mTimers[timerID] = cb;
+        }
+        else
+        {
+            mTimers.erase(timerID);
+        }
+    }
+
+    void
+    valueExternalized(uint64, Value const&) override
+    {
+        mExternalized = true;
+    }
+
+    // fires (and clears) all pending timers, returns how many there were
+    size_t
+    fireTimers()
+    {
+        auto timers = std::move(mTimers);
+        mTimers.clear();
+        for (auto const& t : timers)
+        {
+            t.second();
+        }
+        return timers.size();
+    }
+};
+
+// A fully connected network of BenchNodes exchanging envelopes in memory.
+class BenchNetwork
+{
+    std::map<Hash, SCPQuorumSetPtr> mQSets;
+    std::vector<std::unique_ptr<BenchNode>> mNodes;
+    std::deque<SCPEnvelope> mPending;
+
+  public:
+    std::vector<NodeID> mNodeIDs;
+
+    explicit BenchNetwork(size_t nNodes)
+    {
+        for (size_t i = 0; i < nNodes; ++i)
+        {
+            auto seed = sha256("NODE_SEED_" + std::to_string(i));
+            mNodeIDs.emplace_back(SecretKey::fromSeed(seed).getPublicKey());
+        }
+    }
+
+    // qSets[i] is the quorum set of node i
+    void
+    addNodes(std::vector<SCPQuorumSet> const& qSets)
+    {
+        for (size_t i = 0; i < qSets.size(); ++i)
+        {
+            auto qSet = std::make_shared<SCPQuorumSet>(qSets[i]);
+            mQSets[sha256(xdr::xdr_to_opaque(*qSet))] = qSet;
+            mNodes.emplace_back(
+                std::make_unique<BenchNode>(*this, mNodeIDs[i], *qSet));
+        }
+    }
+
+    SCPQuorumSetPtr
+    getQSet(Hash const& qSetHash)
+    {
+        auto it = mQSets.find(qSetHash);
+        return it == mQSets.end() ? nullptr : it->second;
+    }
+
+    void
+    broadcast(SCPEnvelope const& envelope)
+    {
+        mPending.push_back(envelope);
+    }
+
+    bool
+    allExternalized() const
+    {
+        for (auto const& n : mNodes)
+        {
+            if (!n->mExternalized)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // runs slot 1 until every node externalized, returns the number of
+    // envelopes delivered (each emitted envelope reaching every other node)
+    size_t
+    run(Value const& value)
+    {
+        size_t delivered = 0;
+        for (auto const& n : mNodes)
+        {
+            n->mSCP.nominate(1, value, Value());
+        }
+        for (int timeouts = 0; !allExternalized(); ++timeouts)
+        {
+            while (!mPending.empty())
+            {
+                auto env = std::move(mPending.front());
+                mPending.pop_front();
+                for (auto const& n : mNodes)
+                {
+                    if (!(n->mSCP.getLocalNodeID() == env.statement.nodeID))
+                    {
+                        n->mSCP.receiveEnvelope(env);
+                        delivered++;
+                    }
+                }
+            }
+            if (allExternalized())
+            {
+                break;
+            }
+            // stuck: pretend the timers fired
+            size_t fired = 0;
+            for (auto const& n : mNodes)
+            {
+                fired += n->fireTimers();
+            }
+            REQUIRE(fired != 0);
+            REQUIRE(timeouts < 20);
+        }
+        return delivered;
+    }
+};
+
+SCPQuorumSetPtr
+BenchNode::getQSet(Hash const& qSetHash)
+{
+    return mNetwork.getQSet(qSetHash);
+}
+
+void
+BenchNode::emitEnvelope(SCPEnvelope const& envelope)
+{
+    mNetwork.broadcast(envelope);
+}
+
+uint64
+BenchNode::computeHashNode(uint64, Value const&, bool isPriority, int32_t,
+                           NodeID const& nodeID)
+{
+    // every node is a neighbor, node 0 has the highest priority
+    if (!isPriority)
+    {
+        return 0;
+    }
+    return nodeID == mNetwork.mNodeIDs[0] ? 1000 : 1;
+}
+
+uint32
+twoThirds(size_t n)
+{
+    return static_cast<uint32>((2 * n + 2) / 3);
+}
+
+// every node trusts every node
+std::vector<SCPQuorumSet>
+flatTopology(std::vector<NodeID> const& nodes)
+{
+    SCPQuorumSet qSet;
+    qSet.threshold = twoThirds(nodes.size());
+    qSet.validators = nodes;
+    return std::vector<SCPQuorumSet>(nodes.size(), qSet);
+}
+
+// a core of up to 7 nodes trusting each other, every other node trusting
+// the core
+std::vector<SCPQuorumSet>
+tieredTopology(std::vector<NodeID> const& nodes)
+{
+    size_t nCore = std::min<size_t>(7, nodes.size());
+    SCPQuorumSet qSet;
+    qSet.threshold = twoThirds(nCore);
+    qSet.validators.assign(nodes.begin(), nodes.begin() + nCore);
+    return std::vector<SCPQuorumSet>(nodes.size(), qSet);
+}
+
+// nodes grouped in organizations of 3, every node trusting 2/3 of the
+// organizations, each of which through 2 of its nodes
+std::vector<SCPQuorumSet>
+hierarchicalTopology(std::vector<NodeID> const& nodes)
+{
+    SCPQuorumSet qSet;
+    for (size_t i = 0; i < nodes.size(); i += 3)
+    {
+        SCPQuorumSet org;
+        for (size_t j = i; j < std::min(i + 3, nodes.size()); ++j)
+        {
+            org.validators.emplace_back(nodes[j]);
+        }
+        org.threshold = twoThirds(org.validators.size());
+        qSet.innerSets.emplace_back(org);
+    }
+    qSet.threshold = twoThirds(qSet.innerSets.size());
+    return std::vector<SCPQuorumSet>(nodes.size(), qSet);
+}
+}
+
+TEST_CASE("SCP envelope processing benchmark", "[scpbench][bench][!hide]")
+{
+    typedef std::function<std::vector<SCPQuorumSet>(
+        std::vector<NodeID> const&)>
+        TopologyGen;
+    std::vector<std::pair<std::string, TopologyGen>> topologies = {
+        {"flat", flatTopology},
+        {"tiered", tieredTopology},
+        {"hierarchical", hierarchicalTopology}};
+    auto value = xdr::xdr_to_opaque(sha256("SCP_BENCH_VALUE"));
+
+    for (auto const& topology : topologies)
+    {
+        for (size_t nNodes : {10, 50, 100, 250, 500})
+        {
+            BenchNetwork network(nNodes);
+            network.addNodes(topology.second(network.mNodeIDs));
+
+            auto allocs = gAllocations.load();
+            auto start = std::chrono::steady_clock::now();
+            auto delivered = network.run(value);
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            allocs = gAllocations.load() - allocs;
+
+            LOG(INFO) << "SCP bench " << topology.first << " " << nNodes
+                      << " nodes: " << delivered << " envelopes in "
+                      << elapsed.count() << "s to externalize, "
+                      << (delivered / elapsed.count()) << " envelopes/s, "
+                      << (double(allocs) / delivered)
+                      << " allocations/envelope";
+        }
+    }
+}
+}
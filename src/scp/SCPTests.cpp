@@ -421,6 +421,92 @@ TEST_CASE("vblocking and quorum", "[scp]")
     REQUIRE(LocalNode::isVBlocking(qSet, nodeSet) == true);
 }
 
+TEST_CASE("compiled quorum sets match the recursive checks", "[scp]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+    SIMULATION_CREATE_NODE(3);
+    SIMULATION_CREATE_NODE(4);
+    SIMULATION_CREATE_NODE(5);
+    std::vector<SecretKey> keys = {v0SecretKey, v1SecretKey, v2SecretKey,
+                                   v3SecretKey, v4SecretKey, v5SecretKey};
+
+    SCPQuorumSet inner1;
+    inner1.threshold = 2;
+    inner1.validators = {v2NodeID, v3NodeID, v4NodeID};
+    SCPQuorumSet inner2;
+    inner2.threshold = 1;
+    inner2.validators = {v5NodeID, v1NodeID};
+    SCPQuorumSet qSet;
+    qSet.threshold = 2;
+    qSet.validators = {v0NodeID, v1NodeID};
+    qSet.innerSets = {inner1, inner2};
+
+    // v5 only needs v1, the others share v0's quorum set
+    SCPQuorumSet qSet5;
+    qSet5.threshold = 1;
+    qSet5.validators = {v1NodeID};
+
+    LocalNode local(v0NodeID, true, qSet, nullptr);
+    std::map<Hash, SCPQuorumSetPtr> qSets;
+    auto storeQSet = [&](SCPQuorumSet const& q) {
+        auto h = sha256(xdr::xdr_to_opaque(q));
+        qSets[h] = std::make_shared<SCPQuorumSet>(q);
+        return h;
+    };
+    auto qSetHash = storeQSet(local.getQuorumSet());
+    auto qSet5Hash = storeQSet(qSet5);
+
+    auto qfun = [&](SCPStatement const& st) {
+        return qSets[st.pledges.nominate().quorumSetHash];
+    };
+    auto compiledQfun = [&](SCPStatement const& st) {
+        return local.getCompiledQuorumSet(
+            st.pledges.nominate().quorumSetHash,
+            [&]() { return qfun(st); });
+    };
+    auto all = [](SCPStatement const&) { return true; };
+
+    NodeIndex index;
+    CompiledQuorumSet compiled(qSet, index);
+    for (uint32 mask = 0; mask < (1u << keys.size()); ++mask)
+    {
+        std::vector<NodeID> nodeSet;
+        NodeBitSet bits;
+        std::map<NodeID, SCPEnvelope> envs;
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (mask & (1u << i))
+            {
+                auto id = keys[i].getPublicKey();
+                nodeSet.push_back(id);
+                bits.set(index.getIndex(id));
+                envs[id] = makeNominate(keys[i], i == 5 ? qSet5Hash : qSetHash,
+                                        0, {}, {});
+            }
+        }
+
+        REQUIRE(compiled.isQuorumSlice(bits) ==
+                LocalNode::isQuorumSlice(qSet, nodeSet));
+        REQUIRE(compiled.isVBlocking(bits) ==
+                LocalNode::isVBlocking(qSet, nodeSet));
+        REQUIRE(local.isVBlocking(envs, all) ==
+                LocalNode::isVBlocking(qSet, envs));
+        REQUIRE(local.isQuorum(envs, compiledQfun, all) ==
+                LocalNode::isQuorum(local.getQuorumSet(), envs, qfun));
+    }
+
+    // {v0, v5} is a slice for the local node but not a quorum, as v5 needs
+    // v1 as well
+    std::map<NodeID, SCPEnvelope> envs;
+    envs[v0NodeID] = makeNominate(v0SecretKey, qSetHash, 0, {}, {});
+    envs[v5NodeID] = makeNominate(v5SecretKey, qSet5Hash, 0, {}, {});
+    REQUIRE(!local.isQuorum(envs, compiledQfun, all));
+    envs[v1NodeID] = makeNominate(v1SecretKey, qSetHash, 0, {}, {});
+    REQUIRE(local.isQuorum(envs, compiledQfun, all));
+}
+
 TEST_CASE("v-blocking distance", "[scp]")
 {
     SIMULATION_CREATE_NODE(0);
@@ -1886,6 +1972,24 @@ TEST_CASE("ballot protocol core5", "[scp][ballotprotocol]")
         REQUIRE(scp.mEnvs.size() == 5);
         REQUIRE(scp.mExternalizedValues.size() == 1);
 
+        SECTION("compacting keeps the externalizing state")
+        {
+            auto externalizing = scp.mSCP.getExternalizingState(0);
+            REQUIRE(!externalizing.empty());
+            auto statements = scp.mSCP.getCumulativeStatemtCount();
+            REQUIRE(statements > externalizing.size());
+
+            // only slots below the index given are compacted
+            scp.mSCP.compactSlots(0);
+            REQUIRE(scp.mSCP.getCumulativeStatemtCount() == statements);
+
+            scp.mSCP.compactSlots(1);
+            REQUIRE(scp.mSCP.getExternalizingState(0) == externalizing);
+            REQUIRE(scp.mSCP.getCurrentState(0) == externalizing);
+            REQUIRE(scp.mSCP.getCumulativeStatemtCount() ==
+                    externalizing.size());
+        }
+
         SECTION("bumpToBallot prevented once committed")
         {
             SCPBallot b2;
@@ -12,8 +12,10 @@
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
+#include <algorithm>
 #include <ctime>
 #include <functional>
+#include <stdexcept>
 
 namespace stellar
 {
@@ -101,6 +103,64 @@ Slot::recordStatement(SCPStatement const& st)
     mStatementsHistory.emplace_back(
         HistoricalStatement{std::time(nullptr), st, mFullyValidated});
 }
+void
+Slot::recordStatement(SCPStatement const& st)
+{
+    mStatementsHistory.emplace_back(
+        HistoricalStatement{std::time(nullptr), st, mFullyValidated});
+    auto maxStatements = mSCP.getMaxStatementsHistory();
+    if (maxStatements != 0 && mStatementsHistory.size() > maxStatements)
+    {
+        pruneStatementsHistory(maxStatements);
+    }
+}
+
+void
+Slot::pruneStatementsHistory(size_t maxStatements)
+{
+    // the latest statements of each node are all isNodeInQuorum needs;
+    // pruning down to half the limit keeps pruning rare
+    auto keep = std::max<size_t>(1, maxStatements / 2);
+    std::set<std::pair<NodeID, bool>> seen;
+    std::vector<HistoricalStatement> kept;
+    for (auto it = mStatementsHistory.rbegin();
+         it != mStatementsHistory.rend() && kept.size() < keep; ++it)
+    {
+        bool nominate = it->mStatement.pledges.type() ==
+                        SCPStatementType::SCP_ST_NOMINATE;
+        if (seen.emplace(it->mStatement.nodeID, nominate).second)
+        {
+            kept.emplace_back(*it);
+        }
+    }
+    std::reverse(kept.begin(), kept.end());
+    mStatementsHistory.swap(kept);
+}
+
+void
+Slot::compact()
+{
+    if (mCompacted || !mBallotProtocol.compact())
+    {
+        return;
+    }
+    mCompacted = true;
+    mNominationProtocol.compact();
+
+    auto state = mBallotProtocol.getCurrentState();
+    std::vector<HistoricalStatement> kept;
+    for (auto const& h : mStatementsHistory)
+    {
+        if (std::any_of(state.begin(), state.end(),
+                        [&](SCPEnvelope const& e) {
+                            return e.statement == h.mStatement;
+                        }))
+        {
+            kept.emplace_back(h);
+        }
+    }
+    mStatementsHistory.swap(kept);
+}
 
 SCP::EnvelopeState
 Slot::processEnvelope(SCPEnvelope const& envelope, bool self)
@@ -254,38 +314,58 @@ Slot::getStatementValues(SCPStatement const& st)
     return res;
 }
 
+namespace
+{
+Hash const&
+getQuorumSetHash(SCPStatement const& st)
+{
+    switch (st.pledges.type())
+    {
+    case SCP_ST_PREPARE:
+        return st.pledges.prepare().quorumSetHash;
+    case SCP_ST_CONFIRM:
+        return st.pledges.confirm().quorumSetHash;
+    case SCP_ST_NOMINATE:
+        return st.pledges.nominate().quorumSetHash;
+    default:
+        dbgAbort();
+        throw std::runtime_error("unexpected statement type");
+    }
+}
+}
+
 SCPQuorumSetPtr
 Slot::getQuorumSetFromStatement(SCPStatement const& st)
 {
-    SCPQuorumSetPtr res;
-    SCPStatementType t = st.pledges.type();
+    if (st.pledges.type() == SCP_ST_EXTERNALIZE)
+    {
+        return LocalNode::getSingletonQSet(st.nodeID);
+    }
+    return getSCPDriver().getQSet(getQuorumSetHash(st));
+}
 
-    if (t == SCP_ST_EXTERNALIZE)
+CompiledQuorumSetPtr
+Slot::getCompiledQuorumSetFromStatement(SCPStatement const& st)
+{
+    if (st.pledges.type() == SCP_ST_EXTERNALIZE)
     {
-        res = LocalNode::getSingletonQSet(st.nodeID);
+        return getLocalNode()->getCompiledSingletonQSet(st.nodeID);
     }
-    else
+    auto const& h = getQuorumSetHash(st);
+    return getLocalNode()->getCompiledQuorumSet(
+        h, [&]() { return getSCPDriver().getQSet(h); });
+}
+
+size_t
+Slot::getMemoryBytes() const
+{
+    size_t bytes = sizeof(*this);
+    for (auto const& h : mStatementsHistory)
     {
-        Hash h;
-        if (t == SCP_ST_PREPARE)
-        {
-            h = st.pledges.prepare().quorumSetHash;
-        }
-        else if (t == SCP_ST_CONFIRM)
-        {
-            h = st.pledges.confirm().quorumSetHash;
-        }
-        else if (t == SCP_ST_NOMINATE)
-        {
-            h = st.pledges.nominate().quorumSetHash;
-        }
-        else
-        {
-            dbgAbort();
-        }
-        res = getSCPDriver().getQSet(h);
+        bytes += sizeof(h) + xdr::xdr_size(h.mStatement);
     }
-    return res;
+    return bytes + mBallotProtocol.getMemoryBytes() +
+           mNominationProtocol.getMemoryBytes();
 }
 
 Json::Value
@@ -337,11 +417,12 @@ Slot::getJsonQuorumInfo(NodeID const& id, bool summary)
 
 bool
 Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
-                      std::map<NodeID, SCPEnvelope> const& envs)
+                      std::map<NodeID, SCPEnvelope> const& envs,
+                      std::set<NodeID> const* candidates)
 {
     // Checks if the nodes that claimed to accept the statement form a
     // v-blocking set
-    if (LocalNode::isVBlocking(getLocalNode()->getQuorumSet(), envs, accepted))
+    if (getLocalNode()->isVBlocking(envs, accepted, candidates))
     {
         return true;
     }
@@ -354,10 +435,9 @@ Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
         return res;
     };
 
-    if (LocalNode::isQuorum(
-            getLocalNode()->getQuorumSet(), envs,
-            std::bind(&Slot::getQuorumSetFromStatement, this, _1),
-            ratifyFilter))
+    if (getLocalNode()->isQuorum(
+            envs, std::bind(&Slot::getCompiledQuorumSetFromStatement, this, _1),
+            ratifyFilter, candidates))
     {
         return true;
     }
@@ -367,11 +447,12 @@ Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
 
 bool
 Slot::federatedRatify(StatementPredicate voted,
-                      std::map<NodeID, SCPEnvelope> const& envs)
+                      std::map<NodeID, SCPEnvelope> const& envs,
+                      std::set<NodeID> const* candidates)
 {
-    return LocalNode::isQuorum(
-        getLocalNode()->getQuorumSet(), envs,
-        std::bind(&Slot::getQuorumSetFromStatement, this, _1), voted);
+    return getLocalNode()->isQuorum(
+        envs, std::bind(&Slot::getCompiledQuorumSetFromStatement, this, _1),
+        voted, candidates);
 }
 
 std::shared_ptr<LocalNode>
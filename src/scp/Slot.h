@@ -45,6 +45,13 @@ class Slot : public std::enable_shared_from_this<Slot>
     // true if the Slot was fully validated
     bool mFullyValidated;
 
+    // true once compact() reduced the slot to its externalizing state
+    bool mCompacted{false};
+
+    // keeps the latest statement of each node for each protocol, then drops
+    // the oldest ones, down to half of `maxStatements`
+    void pruneStatementsHistory(size_t maxStatements);
+
   public:
     Slot(uint64 slotIndex, SCP& SCP);
 
@@ -131,6 +138,16 @@ class Slot : public std::enable_shared_from_this<Slot>
         return mStatementsHistory.size();
     }
 
+    // If the slot externalized, drops everything but what
+    // getExternalizingState needs: the envelopes that contributed to
+    // externalizing it, and their statements in the history. Envelopes
+    // received later are processed as before.
+    void compact();
+
+    // approximate bytes held by the slot: statements seen and the latest
+    // envelopes of the protocols
+    size_t getMemoryBytes() const;
+
     // returns information about the local state in JSON format
     // including historical statements if available
     Json::Value getJsonInfo();
@@ -150,6 +167,9 @@ class Slot : public std::enable_shared_from_this<Slot>
     // returns the QuorumSet that should be used for a node given the
     // statement (singleton for externalize)
     SCPQuorumSetPtr getQuorumSetFromStatement(SCPStatement const& st);
+    // same, compiled by the local node
+    CompiledQuorumSetPtr
+    getCompiledQuorumSetFromStatement(SCPStatement const& st);
 
     // wraps a statement in an envelope (sign it, etc)
     SCPEnvelope createEnvelope(SCPStatement const& statement);
@@ -158,12 +178,16 @@ class Slot : public std::enable_shared_from_this<Slot>
 
     // returns true if the statement defined by voted and accepted
     // should be accepted
+    // if candidates is set, only the statements of those nodes can satisfy
+    // voted or accepted
     bool federatedAccept(StatementPredicate voted, StatementPredicate accepted,
-                         std::map<NodeID, SCPEnvelope> const& envs);
+                         std::map<NodeID, SCPEnvelope> const& envs,
+                         std::set<NodeID> const* candidates = nullptr);
     // returns true if the statement defined by voted
     // is ratified
     bool federatedRatify(StatementPredicate voted,
-                         std::map<NodeID, SCPEnvelope> const& envs);
+                         std::map<NodeID, SCPEnvelope> const& envs,
+                         std::set<NodeID> const* candidates = nullptr);
 
     std::shared_ptr<LocalNode> getLocalNode();
 
@@ -0,0 +1,307 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/CloseBenchmark.h"
+#include "database/Database.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/http/server.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+#include "util/Math.h"
+#include "util/format.h"
+
+#include "medida/meter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <sstream>
+
+namespace stellar
+{
+
+namespace
+{
+uint32_t
+parseCount(std::map<std::string, std::string> const& map,
+           std::string const& key, uint32_t defaultVal)
+{
+    auto i = map.find(key);
+    if (i == map.end())
+    {
+        return defaultVal;
+    }
+    std::stringstream str(i->second);
+    uint32_t val;
+    str >> val;
+    if (str.fail() || !str.eof())
+    {
+        throw std::runtime_error(
+            fmt::format("Failed to parse '{}' argument", key));
+    }
+    return val;
+}
+
+// closes a ledger of `txs` on top of the last closed one, returns how long
+// closeLedger took
+std::chrono::nanoseconds
+closeLedger(Application& app, std::vector<TransactionFramePtr> const& txs)
+{
+    auto& lm = app.getLedgerManager();
+    auto const& lcl = lm.getLastClosedLedgerHeader();
+    auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+    for (auto const& tx : txs)
+    {
+        txSet->add(tx);
+    }
+    txSet->sortForHash();
+
+    StellarValue sv(txSet->getContentsHash(),
+                    lcl.header.scpValue.closeTime + 1, emptyUpgradeSteps, 0);
+    LedgerCloseData ledgerData(lcl.header.ledgerSeq + 1, txSet, sv);
+
+    auto start = std::chrono::steady_clock::now();
+    lm.closeLedger(ledgerData);
+    return std::chrono::steady_clock::now() - start;
+}
+
+// closes ledgers of at most `perLedger` of `txs` each
+void
+closeSetupLedgers(Application& app, std::vector<LoadGenerator::TxInfo>& txs,
+                  uint32_t perLedger)
+{
+    for (size_t i = 0; i < txs.size(); i += perLedger)
+    {
+        std::vector<TransactionFramePtr> frames;
+        for (size_t j = i; j < std::min(txs.size(), i + perLedger); ++j)
+        {
+            frames.push_back(txs[j].toTransactionFrame(app));
+        }
+        closeLedger(app, frames);
+    }
+}
+
+uint64_t
+percentile(std::vector<uint64_t> const& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    auto i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+}
+
+CloseBenchmark
+CloseBenchmark::parse(std::string const& spec)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(spec, map);
+
+    CloseBenchmark bench;
+    bench.mAccounts = parseCount(map, "accounts", bench.mAccounts);
+    bench.mLedgers = parseCount(map, "ledgers", bench.mLedgers);
+    bench.mTxs = parseCount(map, "txs", bench.mTxs);
+    bench.mModeParams.mOffers =
+        parseCount(map, "offers", bench.mModeParams.mOffers);
+    bench.mModeParams.mHops = parseCount(map, "hops", bench.mModeParams.mHops);
+    bench.mModeParams.mSigners =
+        parseCount(map, "signers", bench.mModeParams.mSigners);
+
+    auto mix = map.find("mix");
+    if (mix != map.end())
+    {
+        bench.mMix.clear();
+        std::stringstream str(mix->second);
+        std::string item;
+        while (std::getline(str, item, ','))
+        {
+            auto colon = item.find(':');
+            auto mode = LoadGenerator::modeFromString(item.substr(0, colon));
+            if (mode == LoadGenMode::CREATE)
+            {
+                throw std::runtime_error("Cannot mix account creations.");
+            }
+            uint32_t weight = 1;
+            if (colon != std::string::npos)
+            {
+                weight = parseCount({{"mix", item.substr(colon + 1)}}, "mix",
+                                    weight);
+            }
+            bench.mMix[mode] += weight;
+        }
+    }
+    return bench;
+}
+
+Json::Value
+CloseBenchmark::run(Application& app) const
+{
+    uint32_t totalWeight = 0;
+    for (auto const& m : mMix)
+    {
+        totalWeight += m.second;
+    }
+    if (totalWeight == 0 || mTxs == 0)
+    {
+        throw std::runtime_error("Nothing to benchmark.");
+    }
+
+    auto& lm = app.getLedgerManager();
+    LoadGenerator lg(app);
+    lg.mModeParams = mModeParams;
+    lg.updateMinBalance();
+
+    bool multisig = mMix.find(LoadGenMode::MULTISIG) != mMix.end();
+    uint32_t nMultisig = multisig ? std::max<uint32_t>(mAccounts / 10, 1) : 0;
+    if (mAccounts < nMultisig + 2)
+    {
+        throw std::runtime_error("Not enough accounts.");
+    }
+    uint32_t nRegular = mAccounts - nMultisig;
+
+    CLOG(INFO, "LoadGen") << "Setting up " << mAccounts << " accounts";
+    // new accounts start at a sequence number given by the ledger creating
+    // them, so build the transactions of each ledger when closing it
+    for (uint32_t i = 0; i < mAccounts;)
+    {
+        std::vector<TransactionFramePtr> txs;
+        for (uint32_t t = 0; t < mTxs && i < mAccounts; ++t)
+        {
+            auto n = std::min<uint32_t>(100, mAccounts - i);
+            txs.push_back(lg.creationTransaction(i, n, lm.getLedgerNum())
+                              .toTransactionFrame(app));
+            i += n;
+        }
+        closeLedger(app, txs);
+    }
+
+    // each transaction of a ledger comes from a different account, as
+    // LoadGenerator keeps track of one pending sequence number per account
+    if (mMix.find(LoadGenMode::OFFER) != mMix.end() ||
+        mMix.find(LoadGenMode::PATH_PAY) != mMix.end())
+    {
+        CLOG(INFO, "LoadGen") << "Setting up trust lines and offers";
+        for (uint32_t round = 0; round <= mModeParams.mOffers; ++round)
+        {
+            std::vector<LoadGenerator::TxInfo> txs;
+            for (uint32_t i = 0; i < nRegular; ++i)
+            {
+                txs.push_back(
+                    lg.offerTransaction(nRegular, 0, lm.getLedgerNum(), i));
+            }
+            closeSetupLedgers(app, txs, mTxs);
+        }
+    }
+    if (multisig)
+    {
+        CLOG(INFO, "LoadGen") << "Setting up signers";
+        std::vector<LoadGenerator::TxInfo> txs;
+        for (uint32_t i = nRegular; i < mAccounts; ++i)
+        {
+            txs.push_back(lg.multisigTransaction(nMultisig, nRegular,
+                                                 lm.getLedgerNum(), i));
+        }
+        closeSetupLedgers(app, txs, mTxs);
+    }
+
+    CLOG(INFO, "LoadGen") << "Closing " << mLedgers << " ledgers of " << mTxs
+                          << " transactions";
+    auto& db = app.getDatabase();
+    auto queriesBefore = db.getQueryMeter().count();
+    auto countsBefore = db.getQueryCounts();
+
+    std::vector<uint64_t> regular(nRegular);
+    std::iota(regular.begin(), regular.end(), 0);
+    std::vector<uint64_t> multisigIds(nMultisig);
+    std::iota(multisigIds.begin(), multisigIds.end(), nRegular);
+
+    std::vector<uint64_t> closeTimes;
+    std::chrono::nanoseconds total{0};
+    uint64_t nTxs = 0;
+    for (uint32_t l = 0; l < mLedgers; ++l)
+    {
+        std::shuffle(regular.begin(), regular.end(), gRandomEngine);
+        std::shuffle(multisigIds.begin(), multisigIds.end(), gRandomEngine);
+        size_t nextRegular = 0;
+        size_t nextMultisig = 0;
+
+        std::vector<TransactionFramePtr> txs;
+        for (uint32_t t = 0; t < mTxs; ++t)
+        {
+            auto w = rand_uniform<uint32_t>(0, totalWeight - 1);
+            auto mode = mMix.begin();
+            while (w >= mode->second)
+            {
+                w -= mode->second;
+                ++mode;
+            }
+            if (mode->first == LoadGenMode::MULTISIG)
+            {
+                if (nextMultisig == multisigIds.size())
+                {
+                    continue;
+                }
+                auto tx = lg.loadTransaction(mode->first, nMultisig, nRegular,
+                                             lm.getLedgerNum(),
+                                             multisigIds[nextMultisig++]);
+                txs.push_back(tx.toTransactionFrame(app));
+            }
+            else
+            {
+                if (nextRegular == regular.size())
+                {
+                    continue;
+                }
+                auto tx = lg.loadTransaction(mode->first, nRegular, 0,
+                                             lm.getLedgerNum(),
+                                             regular[nextRegular++]);
+                txs.push_back(tx.toTransactionFrame(app));
+            }
+        }
+
+        auto elapsed = closeLedger(app, txs);
+        total += elapsed;
+        nTxs += txs.size();
+        closeTimes.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+                .count());
+    }
+    std::sort(closeTimes.begin(), closeTimes.end());
+
+    Json::Value res;
+    auto seconds = std::chrono::duration<double>(total).count();
+    res["ledgers"] = mLedgers;
+    res["txs"] = static_cast<Json::UInt64>(nTxs);
+    res["seconds"] = seconds;
+    res["ledgers_per_second"] = seconds > 0 ? mLedgers / seconds : 0.0;
+    res["txs_per_second"] = seconds > 0 ? nTxs / seconds : 0.0;
+    res["close_ms"]["p50"] = percentile(closeTimes, 0.5) / 1000.0;
+    res["close_ms"]["p99"] = percentile(closeTimes, 0.99) / 1000.0;
+    res["close_ms"]["max"] =
+        closeTimes.empty() ? 0.0 : closeTimes.back() / 1000.0;
+
+    auto& sql = res["sql"];
+    sql["database"] = db.isSqlite() ? "sqlite" : "postgresql";
+    auto queries = db.getQueryMeter().count() - queriesBefore;
+    sql["queries"] = static_cast<Json::UInt64>(queries);
+    sql["queries_per_ledger"] =
+        mLedgers > 0 ? static_cast<double>(queries) / mLedgers : 0.0;
+    for (auto const& c : db.getQueryCounts())
+    {
+        auto before = countsBefore.find(c.first);
+        auto n = c.second -
+                 (before == countsBefore.end() ? 0 : before->second);
+        if (n != 0)
+        {
+            sql["by_kind"][c.first] = static_cast<Json::UInt64>(n);
+        }
+    }
+    return res;
+}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json-forwards.h"
+#include "simulation/LoadGenerator.h"
+#include <map>
+#include <string>
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Measures how fast an application closes ledgers (see --bench-close).
+ *
+ * Sets up mAccounts accounts created by LoadGenerator, with the trust lines
+ * and offers of its OFFER mode when the mix has OFFER or PATH_PAY
+ * transactions, then closes mLedgers ledgers of mTxs transactions each
+ * through LedgerManager::closeLedger, without consensus. Transactions are
+ * generated by LoadGenerator, their modes drawn from mMix by weight;
+ * MULTISIG transactions come from the last tenth of the accounts, which the
+ * other modes leave alone.
+ */
+struct CloseBenchmark
+{
+    uint32_t mAccounts{1000};
+    uint32_t mLedgers{100};
+    uint32_t mTxs{100};
+    std::map<LoadGenMode, uint32_t> mMix{{LoadGenMode::PAY, 1}};
+    LoadGenerator::ModeParams mModeParams;
+
+    // Reads the parameters from a query string such as
+    // "accounts=1000&ledgers=100&txs=100&mix=pay:6,offer:3,pathpay:1", which
+    // can also set offers, hops and signers (see /generateload).
+    static CloseBenchmark parse(std::string const& spec);
+
+    // Runs the benchmark against `app`, which must be started on a fresh
+    // database, and returns its report: ledgers/s, txs/s, close time
+    // percentiles and SQL query counts.
+    Json::Value run(Application& app) const;
+};
+}
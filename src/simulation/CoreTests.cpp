@@ -8,16 +8,22 @@
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/LedgerCmp.h"
 #include "crypto/SHA.h"
+#include "database/Database.h"
 #include "herder/Herder.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
+#include "ledger/OfferFrame.h"
 #include "lib/catch.hpp"
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "medida/stats/snapshot.h"
 #include "overlay/StellarXDR.h"
+#include "simulation/CloseBenchmark.h"
 #include "simulation/Topologies.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
@@ -68,10 +74,17 @@ TEST_CASE("3 nodes. 2 running. threshold 2", "[simulation][core3]")
         mode = Simulation::OVER_TCP;
     }
 
+    SECTION("Over loopback, threaded")
+    {
+        mode = Simulation::OVER_LOOPBACK_THREADED;
+    }
+
     {
         Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
         Simulation::pointer simulation =
             std::make_shared<Simulation>(mode, networkID);
+        // a thread each
+        simulation->setThreadCount(2);
 
         std::vector<SecretKey> keys;
         for (int i = 0; i < 3; i++)
@@ -240,13 +253,14 @@ TEST_CASE("resilience tests", "[resilience][simulation][long][!hide]")
 
 static void
 hierarchicalTopoTest(int nLedgers, int nBranches, Simulation::Mode mode,
-                     Hash const& networkID)
+                     Hash const& networkID,
+                     Simulation::ConfigGen confGen = nullptr)
 {
     LOG(DEBUG) << "starting topo test " << nLedgers << " : " << nBranches;
     auto tBegin = std::chrono::system_clock::now();
 
     Simulation::pointer sim =
-        Topologies::hierarchicalQuorum(nBranches, mode, networkID);
+        Topologies::hierarchicalQuorum(nBranches, mode, networkID, confGen);
     sim->startAllNodes();
 
     sim->crankUntil(
@@ -285,6 +299,29 @@ TEST_CASE("hierarchical topology scales 1..3", "[simulation]")
     }
 }
 
+TEST_CASE("hierarchical topology scales past 100 nodes",
+          "[simulation][long][!hide]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    // 4 core nodes and 100 middle tier ones
+    hierarchicalTopoTest(3, 100, Simulation::OVER_LOOPBACK, networkID,
+                         Simulation::lightweight());
+}
+
+TEST_CASE("lightweight simulation nodes", "[simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    hierarchicalTopoTest(2, 3, Simulation::OVER_LOOPBACK, networkID,
+                         Simulation::lightweight());
+
+    auto cfg = Simulation::lightweight()(0);
+    REQUIRE(cfg.HTTP_PORT == 0);
+    REQUIRE(cfg.WORKER_THREADS == 1);
+    VirtualClock clock;
+    auto app = createTestApplication(clock, cfg);
+    REQUIRE(app->getWorkerThreadCount() == 1);
+}
+
 static void
 hierarchicalSimplifiedTest(int nLedgers, int nbCore, int nbOuterNodes,
                            Simulation::Mode mode, Hash const& networkID)
@@ -354,7 +391,8 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
     auto nodes = simulation->getNodes();
     auto& app = *nodes[0]; // pick a node to generate load
 
-    app.getLoadGenerator().generateLoad(true, 3, 0, 0, 10, 100, false);
+    app.getLoadGenerator().generateLoad(LoadGenMode::CREATE, 3, 0, 0, 10, 100,
+                                        false);
     try
     {
         simulation->crankUntil(
@@ -367,7 +405,8 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
             },
             3 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
 
-        app.getLoadGenerator().generateLoad(false, 3, 0, 10, 10, 100, false);
+        app.getLoadGenerator().generateLoad(LoadGenMode::PAY, 3, 0, 10, 10,
+                                            100, false);
         simulation->crankUntil(
             [&]() {
                 return simulation->haveAllExternalized(8, 2) &&
@@ -384,6 +423,98 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
     LOG(INFO) << simulation->metricsSummary("database");
 }
 
+TEST_CASE("Load generation in every mode", "[simulation][loadgen]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto nodes = simulation->getNodes();
+    auto& app = *nodes[0];
+    auto& lg = app.getLoadGenerator();
+    auto& complete =
+        app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+
+    auto run = [&](LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
+                   uint32_t nTxs) {
+        auto runs = complete.count();
+        lg.generateLoad(mode, nAccounts, offset, nTxs, 10, 10, false);
+        simulation->crankUntil(
+            [&]() {
+                return complete.count() == runs + 1 &&
+                       simulation->accountsOutOfSyncWithDb(app).empty();
+            },
+            10 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+    };
+
+    lg.mModeParams.mOffers = 3;
+    lg.mModeParams.mHops = 2;
+    lg.mModeParams.mSigners = 4;
+
+    run(LoadGenMode::CREATE, 10, 0, 0);
+    // the first 8 accounts trade, the last 2 are multisig
+    run(LoadGenMode::OFFER, 8, 0, 40);
+    run(LoadGenMode::PATH_PAY, 8, 0, 10);
+    lg.mModeParams.mPoisson = true;
+    run(LoadGenMode::DATA, 8, 0, 10);
+    lg.mModeParams.mPoisson = false;
+    run(LoadGenMode::MULTISIG, 2, 8, 10);
+
+    auto& metrics = app.getMetrics();
+    REQUIRE(metrics.NewMeter({"loadgen", "offer", "any"}, "offer").count() ==
+            40);
+    REQUIRE(
+        metrics.NewMeter({"loadgen", "payment", "path"}, "payment").count() ==
+        10);
+    REQUIRE(metrics.NewMeter({"loadgen", "data", "any"}, "data").count() ==
+            10);
+    // every transaction submitted was applied: one creating the accounts and
+    // 70 others
+    REQUIRE(metrics.NewTimer({"loadgen", "tx", "latency"}).count() == 71);
+
+    auto& db = app.getDatabase();
+    REQUIRE(OfferFrame::countObjects(db.getSession()) != 0);
+    for (uint64_t i = 8; i < 10; ++i)
+    {
+        auto name = "TestAccount-" + std::to_string(i);
+        auto account = AccountFrame::loadAccount(
+            txtest::getAccount(name.c_str()).getPublicKey(), db);
+        REQUIRE(account);
+        REQUIRE(account->getAccount().signers.size() == 4);
+    }
+}
+
+TEST_CASE("Close benchmark", "[simulation][loadgen]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto& lm = app->getLedgerManager();
+
+    auto bench = CloseBenchmark::parse(
+        "accounts=20&ledgers=3&txs=10&offers=2&signers=2&"
+        "mix=pay:2,offer:2,pathpay:1,multisig:1,data:1");
+    REQUIRE(bench.mMix.size() == 5);
+    REQUIRE(bench.mMix[LoadGenMode::PAY] == 2);
+    REQUIRE_THROWS(CloseBenchmark::parse("mix=create"));
+
+    auto report = bench.run(*app);
+    // account creation, 3 rounds of OFFER and signers, then the measured ones
+    REQUIRE(lm.getLastClosedLedgerNum() > 3 + 3);
+    REQUIRE(report["ledgers"].asUInt() == 3);
+    REQUIRE(report["txs"].asUInt() > 0);
+    REQUIRE(report["txs"].asUInt() <= 30);
+    REQUIRE(report["close_ms"]["p50"].asDouble() <=
+            report["close_ms"]["max"].asDouble());
+    REQUIRE(report["sql"]["queries"].asUInt() != 0);
+    REQUIRE(report["sql"]["by_kind"].isMember("update account"));
+    REQUIRE(OfferFrame::countObjects(app->getDatabase().getSession()) != 0);
+}
+
 Application::pointer
 newLoadTestApp(VirtualClock& clock)
 {
@@ -408,7 +539,7 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][!hide]")
     VirtualClock clock(VirtualClock::REAL_TIME);
     auto appPtr = newLoadTestApp(clock);
     // Create accounts
-    appPtr->generateLoad(true, 100000, 0, 0, 10, 3, true);
+    appPtr->generateLoad(LoadGenMode::CREATE, 100000, 0, 0, 10, 3, true);
     auto& io = clock.getIOService();
     asio::io_service::work mainWork(io);
     auto& complete =
@@ -418,7 +549,7 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][!hide]")
         clock.crank();
     }
     // Generate payments
-    appPtr->generateLoad(false, 100000, 0, 100000, 10, 100, true);
+    appPtr->generateLoad(LoadGenMode::PAY, 100000, 0, 100000, 10, 100, true);
     while (!io.stopped() && complete.count() == 1)
     {
         clock.crank();
@@ -502,7 +633,7 @@ TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
     uint32_t numItems = 500000;
 
     // Create accounts
-    lg.generateLoad(true, numItems, 0, 0, 10, 100, true);
+    lg.generateLoad(LoadGenMode::CREATE, numItems, 0, 0, 10, 100, true);
 
     auto& complete =
         appPtr->getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
@@ -517,7 +648,8 @@ TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
     txtime.Clear();
 
     // Generate payment txs
-    lg.generateLoad(false, numItems, 0, numItems / 10, 10, 100, true);
+    lg.generateLoad(LoadGenMode::PAY, numItems, 0, numItems / 10, 10, 100,
+                    true);
     while (!io.stopped() && complete.count() == 1)
     {
         clock.crank();
@@ -550,7 +682,8 @@ netTopologyTest(std::string const& name,
         assert(!nodes.empty());
         auto& app = *nodes[0];
 
-        app.getLoadGenerator().generateLoad(true, 50, 0, 0, 10, 100, false);
+        app.getLoadGenerator().generateLoad(LoadGenMode::CREATE, 50, 0, 0, 10,
+                                            100, false);
         auto& complete =
             app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
 
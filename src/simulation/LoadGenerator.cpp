@@ -4,6 +4,8 @@
 
 #include "simulation/LoadGenerator.h"
 #include "herder/Herder.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
 #include "main/Config.h"
@@ -17,6 +19,8 @@
 
 #include "database/Database.h"
 
+#include "ledger/OfferFrame.h"
+#include "ledger/TrustFrame.h"
 #include "transactions/AllowTrustOpFrame.h"
 #include "transactions/ChangeTrustOpFrame.h"
 #include "transactions/CreateAccountOpFrame.h"
@@ -30,6 +34,8 @@
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
 
 #include <cmath>
 #include <iomanip>
@@ -45,18 +51,64 @@ using namespace txtest;
 const uint32_t LoadGenerator::STEP_MSECS = 100;
 //
 const uint32_t LoadGenerator::TX_SUBMIT_MAX_TRIES = 1000;
+const uint32_t LoadGenerator::TRUSTED_ASSETS = 2;
+
+namespace
+{
+// the account `step` after `accountId` among the `numAccounts` from `offset`
+uint64_t
+nextAccount(uint64_t accountId, uint64_t step, uint32_t numAccounts,
+            uint32_t offset)
+{
+    return (accountId - offset + step) % numAccounts + offset;
+}
+
+SecretKey
+signerKey(uint64_t accountId, uint32_t i)
+{
+    auto name = "TestAccount-" + to_string(accountId) + "-signer-" +
+                to_string(i);
+    return txtest::getAccount(name.c_str());
+}
+}
 
 LoadGenerator::LoadGenerator(Application& app)
-    : mMinBalance(0), mLastSecond(0), mApp(app)
+    : mMinBalance(0)
+    , mLastSecond(0)
+    , mApp(app)
+    , mTxLatency(app.getMetrics().NewTimer({"loadgen", "tx", "latency"}))
 {
     createRootAccount();
+    mLedgerClosedCallback = mApp.getLedgerManager().addLedgerClosedCallback(
+        [this](LedgerCloseData const& ledgerData, std::chrono::nanoseconds) {
+            ledgerClosed(ledgerData);
+        });
 }
 
 LoadGenerator::~LoadGenerator()
 {
+    mApp.getLedgerManager().removeLedgerClosedCallback(mLedgerClosedCallback);
     clear();
 }
 
+LoadGenMode
+LoadGenerator::modeFromString(std::string const& name)
+{
+    static std::map<std::string, LoadGenMode> const modes = {
+        {"create", LoadGenMode::CREATE},
+        {"pay", LoadGenMode::PAY},
+        {"offer", LoadGenMode::OFFER},
+        {"pathpay", LoadGenMode::PATH_PAY},
+        {"multisig", LoadGenMode::MULTISIG},
+        {"data", LoadGenMode::DATA}};
+    auto it = modes.find(name);
+    if (it == modes.end())
+    {
+        throw std::runtime_error("Unknown mode.");
+    }
+    return it->second;
+}
+
 void
 LoadGenerator::createRootAccount()
 {
@@ -108,6 +160,44 @@ LoadGenerator::getTxPerStep(uint32_t txRate)
     return txPerStep;
 }
 
+uint32_t
+LoadGenerator::getPoissonTxPerStep(uint32_t txRate)
+{
+    auto now = mApp.getClock().now();
+    std::chrono::duration<double> elapsed =
+        std::chrono::milliseconds(STEP_MSECS);
+    if (mLastStep != VirtualClock::time_point())
+    {
+        elapsed = now - mLastStep;
+    }
+    mLastStep = now;
+    auto mean = txRate * elapsed.count();
+    if (mean <= 0)
+    {
+        return 0;
+    }
+    return std::poisson_distribution<uint32_t>(mean)(gRandomEngine);
+}
+
+void
+LoadGenerator::ledgerClosed(LedgerCloseData const& ledgerData)
+{
+    if (mSubmitted.empty())
+    {
+        return;
+    }
+    auto now = mApp.getClock().now();
+    for (auto const& tx : ledgerData.getTxSet()->mTransactions)
+    {
+        auto it = mSubmitted.find(tx->getFullHash());
+        if (it != mSubmitted.end())
+        {
+            mTxLatency.Update(now - it->second);
+            mSubmitted.erase(it);
+        }
+    }
+}
+
 bool
 LoadGenerator::maybeAdjustRate(double target, double actual, uint32_t& rate,
                                bool increaseOk)
@@ -143,12 +233,16 @@ void
 LoadGenerator::clear()
 {
     mAccounts.clear();
+    mTrustingAccounts.clear();
+    mMultisigAccounts.clear();
+    mSubmitted.clear();
+    mLastStep = VirtualClock::time_point();
     mRoot.reset();
 }
 
 // Schedule a callback to generateLoad() STEP_MSECS miliseconds from now.
 void
-LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
+LoadGenerator::scheduleLoadGeneration(LoadGenMode mode, uint32_t nAccounts,
                                       uint32_t offset, uint32_t nTxs,
                                       uint32_t txRate, uint32_t batchSize,
                                       bool autoRate)
@@ -162,11 +256,11 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
     {
         mLoadTimer->expires_from_now(std::chrono::milliseconds(STEP_MSECS));
         mLoadTimer->async_wait([this, nAccounts, offset, nTxs, txRate,
-                                batchSize, isCreate,
+                                batchSize, mode,
                                 autoRate](asio::error_code const& error) {
             if (!error)
             {
-                this->generateLoad(isCreate, nAccounts, offset, nTxs, txRate,
+                this->generateLoad(mode, nAccounts, offset, nTxs, txRate,
                                    batchSize, autoRate);
             }
         });
@@ -178,11 +272,11 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
             << mApp.getState();
         mLoadTimer->expires_from_now(std::chrono::seconds(10));
         mLoadTimer->async_wait([this, nAccounts, offset, nTxs, txRate,
-                                batchSize, isCreate,
+                                batchSize, mode,
                                 autoRate](asio::error_code const& error) {
             if (!error)
             {
-                this->scheduleLoadGeneration(isCreate, nAccounts, offset, nTxs,
+                this->scheduleLoadGeneration(mode, nAccounts, offset, nTxs,
                                              txRate, batchSize, autoRate);
             }
         });
@@ -194,10 +288,11 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
 // If work remains after the current step, call scheduleLoadGeneration()
 // with the remainder.
 void
-LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
-                            uint32_t nTxs, uint32_t txRate, uint32_t batchSize,
-                            bool autoRate)
+LoadGenerator::generateLoad(LoadGenMode mode, uint32_t nAccounts,
+                            uint32_t offset, uint32_t nTxs, uint32_t txRate,
+                            uint32_t batchSize, bool autoRate)
 {
+    bool isCreate = mode == LoadGenMode::CREATE;
     soci::transaction sqltx(mApp.getDatabase().getSession());
     mApp.getDatabase().setCurrentTransactionReadOnly();
     createRootAccount();
@@ -220,7 +315,8 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
         batchSize = 1;
     }
 
-    uint32_t txPerStep = getTxPerStep(txRate);
+    uint32_t txPerStep = mModeParams.mPoisson ? getPoissonTxPerStep(txRate)
+                                              : getTxPerStep(txRate);
     auto& submitTimer =
         mApp.getMetrics().NewTimer({"loadgen", "step", "submit"});
     auto submitScope = submitTimer.TimeScope();
@@ -236,8 +332,8 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
         }
         else
         {
-            nTxs =
-                submitPaymentTx(nAccounts, offset, batchSize, ledgerNum, nTxs);
+            nTxs = submitTx(mode, nAccounts, offset, batchSize, ledgerNum,
+                            nTxs);
         }
 
         if (nAccounts == 0 || (!isCreate && nTxs == 0))
@@ -253,7 +349,7 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
         static_cast<uint64_t>(VirtualClock::to_time_t(mApp.getClock().now()));
     bool secondBoundary = now != mLastSecond;
 
-    if (autoRate && secondBoundary)
+    if (autoRate && !mModeParams.mPoisson && secondBoundary)
     {
         mLastSecond = now;
         inspectRate(ledgerNum, txRate);
@@ -262,10 +358,10 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
     // Emit a log message once per second.
     if (secondBoundary)
     {
-        logProgress(submit, isCreate, nAccounts, nTxs, batchSize, txRate);
+        logProgress(submit, mode, nAccounts, nTxs, batchSize, txRate);
     }
 
-    scheduleLoadGeneration(isCreate, nAccounts, offset, nTxs, txRate, batchSize,
+    scheduleLoadGeneration(mode, nAccounts, offset, nTxs, txRate, batchSize,
                            autoRate);
 }
 
@@ -281,7 +377,8 @@ LoadGenerator::submitCreationTx(uint32_t nAccounts, uint32_t offset,
     bool createDuplicate = false;
     int numTries = 0;
 
-    while ((status = tx.execute(mApp, true, code, batchSize)) !=
+    while ((status = tx.execute(mApp, LoadGenMode::CREATE, code,
+                                batchSize)) !=
            Herder::TX_STATUS_PENDING)
     {
         handleFailedSubmission(tx.mFrom, status, code); // Update seq num
@@ -300,6 +397,7 @@ LoadGenerator::submitCreationTx(uint32_t nAccounts, uint32_t offset,
 
     if (!createDuplicate)
     {
+        mSubmitted.emplace(tx.mHash, mApp.getClock().now());
         nAccounts -= numToProcess;
     }
 
@@ -307,24 +405,23 @@ LoadGenerator::submitCreationTx(uint32_t nAccounts, uint32_t offset,
 }
 
 uint32_t
-LoadGenerator::submitPaymentTx(uint32_t nAccounts, uint32_t offset,
-                               uint32_t batchSize, uint32_t ledgerNum,
-                               uint32_t nTxs)
+LoadGenerator::submitTx(LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
+                        uint32_t batchSize, uint32_t ledgerNum, uint32_t nTxs)
 {
     auto sourceAccountId = rand_uniform<uint64_t>(0, nAccounts - 1) + offset;
     TxInfo tx =
-        paymentTransaction(nAccounts, offset, ledgerNum, sourceAccountId);
+        loadTransaction(mode, nAccounts, offset, ledgerNum, sourceAccountId);
 
     TransactionResultCode code;
     Herder::TransactionSubmitStatus status;
     int numTries = 0;
 
-    while ((status = tx.execute(mApp, false, code, batchSize)) !=
+    while ((status = tx.execute(mApp, mode, code, batchSize)) !=
            Herder::TX_STATUS_PENDING)
     {
         handleFailedSubmission(tx.mFrom, status, code); // Update seq num
-        tx = paymentTransaction(nAccounts, offset, ledgerNum,
-                                sourceAccountId); // re-generate the tx
+        tx = loadTransaction(mode, nAccounts, offset, ledgerNum,
+                             sourceAccountId); // re-generate the tx
         if (++numTries >= TX_SUBMIT_MAX_TRIES)
         {
             CLOG(ERROR, "LoadGen") << "Error submitting tx: did you specify "
@@ -334,6 +431,7 @@ LoadGenerator::submitPaymentTx(uint32_t nAccounts, uint32_t offset,
         }
     }
 
+    mSubmitted.emplace(tx.mHash, mApp.getClock().now());
     nTxs -= 1;
     return nTxs;
 }
@@ -407,10 +505,11 @@ LoadGenerator::inspectRate(uint32_t ledgerNum, uint32_t& txRate)
 }
 
 void
-LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
-                           uint32_t nAccounts, uint32_t nTxs,
+LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer,
+                           LoadGenMode mode, uint32_t nAccounts, uint32_t nTxs,
                            uint32_t batchSize, uint32_t txRate)
 {
+    bool isCreate = mode == LoadGenMode::CREATE;
     using namespace std::chrono;
 
     auto& m = mApp.getMetrics();
@@ -435,6 +534,12 @@ LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
 
     CLOG(DEBUG, "LoadGen") << "Step timing: " << submitSteps << "ms submit.";
 
+    auto latency = mTxLatency.GetSnapshot();
+    CLOG(INFO, "LoadGen") << "Submit to apply latency: "
+                          << (uint32_t)latency.getMedian() << "ms median, "
+                          << (uint32_t)latency.get99thPercentile()
+                          << "ms p99, " << mSubmitted.size() << " txs pending.";
+
     TxMetrics txm(mApp.getMetrics());
     txm.report();
 }
@@ -568,6 +673,180 @@ LoadGenerator::paymentTransaction(uint32_t numAccounts, uint32_t offset,
     return tx;
 }
 
+LoadGenerator::TxInfo
+LoadGenerator::loadTransaction(LoadGenMode mode, uint32_t numAccounts,
+                               uint32_t offset, uint32_t ledgerNum,
+                               uint64_t sourceAccount)
+{
+    switch (mode)
+    {
+    case LoadGenMode::PAY:
+        return paymentTransaction(numAccounts, offset, ledgerNum,
+                                  sourceAccount);
+    case LoadGenMode::OFFER:
+        return offerTransaction(numAccounts, offset, ledgerNum, sourceAccount);
+    case LoadGenMode::PATH_PAY:
+        return pathPaymentTransaction(numAccounts, offset, ledgerNum,
+                                      sourceAccount);
+    case LoadGenMode::MULTISIG:
+        return multisigTransaction(numAccounts, offset, ledgerNum,
+                                   sourceAccount);
+    case LoadGenMode::DATA:
+        return manageDataTransaction(ledgerNum, sourceAccount);
+    default:
+        throw std::runtime_error("unexpected load generation mode");
+    }
+}
+
+Asset
+LoadGenerator::loadAsset(uint64_t accountId)
+{
+    auto name = "TestAccount-" + to_string(accountId);
+    return txtest::makeAsset(txtest::getAccount(name.c_str()), "LOAD");
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::offerTransaction(uint32_t numAccounts, uint32_t offset,
+                                uint32_t ledgerNum, uint64_t sourceAccount)
+{
+    auto& db = mApp.getDatabase();
+    auto from = findAccount(sourceAccount, ledgerNum);
+    auto selling = txtest::makeAsset(from->getSecretKey(), "LOAD");
+
+    if (mTrustingAccounts.insert(sourceAccount).second)
+    {
+        auto last = loadAsset(
+            nextAccount(sourceAccount, TRUSTED_ASSETS, numAccounts, offset));
+        if (!TrustFrame::loadTrustLine(from->getPublicKey(), last, db))
+        {
+            vector<Operation> ops;
+            for (uint32_t i = 1; i <= TRUSTED_ASSETS; ++i)
+            {
+                auto asset = loadAsset(
+                    nextAccount(sourceAccount, i, numAccounts, offset));
+                ops.push_back(txtest::changeTrust(asset, INT64_MAX));
+            }
+            return TxInfo{from, ops};
+        }
+    }
+
+    // prices around 1, so that path payments find their way through
+    Price price{rand_uniform<int32_t>(90, 110), 100};
+    int64_t amount = rand_uniform<int64_t>(1, 1000) * 10000;
+
+    auto offers = OfferFrame::loadOffersByAccountAndAsset(from->getPublicKey(),
+                                                          selling, db);
+    if (offers.size() < std::max<uint32_t>(mModeParams.mOffers, 1))
+    {
+        auto i = rand_uniform<uint32_t>(0, TRUSTED_ASSETS);
+        auto buying =
+            i == 0 ? txtest::makeNativeAsset()
+                   : loadAsset(nextAccount(sourceAccount, i, numAccounts,
+                                           offset));
+        return TxInfo{
+            from, {txtest::manageOffer(0, selling, buying, price, amount)}};
+    }
+
+    // update one of the offers, or delete it one time in four
+    auto const& offer = rand_element(offers)->getOffer();
+    if (rand_uniform<int>(0, 3) == 0)
+    {
+        amount = 0;
+    }
+    return TxInfo{from,
+                  {txtest::manageOffer(offer.offerID, offer.selling,
+                                       offer.buying, price, amount)}};
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::pathPaymentTransaction(uint32_t numAccounts, uint32_t offset,
+                                      uint32_t ledgerNum,
+                                      uint64_t sourceAccount)
+{
+    auto from = findAccount(sourceAccount, ledgerNum);
+
+    // native -> LOAD of `first` -> LOAD of the account before -> ... -> LOAD
+    // of the destination, which as the issuer needs no trust line; each
+    // account trusts the LOAD of the next one, so offers of every hop exist
+    auto hops = std::min<uint32_t>(mModeParams.mHops, 5);
+    auto first = rand_uniform<uint64_t>(0, numAccounts - 1) + offset;
+    std::vector<Asset> path;
+    auto current = first;
+    for (uint32_t i = 0; i < hops; ++i)
+    {
+        path.push_back(loadAsset(current));
+        current = nextAccount(current, numAccounts - 1, numAccounts, offset);
+    }
+    auto to = findAccount(current, ledgerNum);
+
+    int64_t amount = rand_uniform<int64_t>(1, 100) * 100;
+    auto op = txtest::pathPayment(
+        to->getPublicKey(), txtest::makeNativeAsset(), amount * 2,
+        txtest::makeAsset(to->getSecretKey(), "LOAD"), amount, path);
+    return TxInfo{from, {op}};
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::multisigTransaction(uint32_t numAccounts, uint32_t offset,
+                                   uint32_t ledgerNum, uint64_t sourceAccount)
+{
+    auto signers = std::min<uint32_t>(mModeParams.mSigners, 19);
+
+    auto it = mMultisigAccounts.find(sourceAccount);
+    if (it == mMultisigAccounts.end() || !it->second)
+    {
+        auto from = findAccount(sourceAccount, ledgerNum);
+        auto account =
+            AccountFrame::loadAccount(from->getPublicKey(), mApp.getDatabase());
+        bool ready = account && account->getAccount().signers.size() >= signers;
+        if (!ready && it == mMultisigAccounts.end())
+        {
+            mMultisigAccounts[sourceAccount] = false;
+            vector<Operation> ops;
+            for (uint32_t i = 0; i < signers; ++i)
+            {
+                ops.push_back(txtest::setOptions(txtest::setSigner(
+                    txtest::makeSigner(signerKey(sourceAccount, i), 1))));
+            }
+            auto all = static_cast<int>(signers) + 1;
+            ops.push_back(txtest::setOptions(txtest::setLowThreshold(all) |
+                                             txtest::setMedThreshold(all) |
+                                             txtest::setHighThreshold(all)));
+            return TxInfo{from, ops};
+        }
+        if (!ready)
+        {
+            // the signers are not there yet, so their signatures would be
+            // refused; sign with the master key alone meanwhile
+            return paymentTransaction(numAccounts, offset, ledgerNum,
+                                      sourceAccount);
+        }
+        mMultisigAccounts[sourceAccount] = true;
+    }
+
+    auto tx =
+        paymentTransaction(numAccounts, offset, ledgerNum, sourceAccount);
+    for (uint32_t i = 0; i < signers; ++i)
+    {
+        tx.mSigners.push_back(signerKey(sourceAccount, i));
+    }
+    return tx;
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::manageDataTransaction(uint32_t ledgerNum, uint64_t sourceAccount)
+{
+    auto from = findAccount(sourceAccount, ledgerNum);
+    auto name = "load-" + to_string(rand_uniform<int>(0, 3));
+    DataValue value;
+    value.resize(rand_uniform<size_t>(1, 64));
+    for (auto& b : value)
+    {
+        b = static_cast<uint8_t>(rand_uniform<int>(0, 255));
+    }
+    return TxInfo{from, {txtest::manageData(name, &value)}};
+}
+
 void
 LoadGenerator::handleFailedSubmission(TestAccountPtr sourceAccount,
                                       Herder::TransactionSubmitStatus status,
@@ -647,6 +926,9 @@ LoadGenerator::TxMetrics::TxMetrics(medida::MetricsRegistry& m)
     : mAccountCreated(m.NewMeter({"loadgen", "account", "created"}, "account"))
     , mPayment(m.NewMeter({"loadgen", "payment", "any"}, "payment"))
     , mNativePayment(m.NewMeter({"loadgen", "payment", "native"}, "payment"))
+    , mPathPayment(m.NewMeter({"loadgen", "payment", "path"}, "payment"))
+    , mManageOffer(m.NewMeter({"loadgen", "offer", "any"}, "offer"))
+    , mManageData(m.NewMeter({"loadgen", "data", "any"}, "data"))
     , mTxnAttempted(m.NewMeter({"loadgen", "txn", "attempted"}, "txn"))
     , mTxnRejected(m.NewMeter({"loadgen", "txn", "rejected"}, "txn"))
     , mTxnBytes(m.NewMeter({"loadgen", "txn", "bytes"}, "txn"))
@@ -672,29 +954,53 @@ LoadGenerator::TxMetrics::report()
                            << mNativePayment.one_minute_rate() << " na, ";
 }
 
-Herder::TransactionSubmitStatus
-LoadGenerator::TxInfo::execute(Application& app, bool isCreate,
-                               TransactionResultCode& code, int32_t batchSize)
+TransactionFramePtr
+LoadGenerator::TxInfo::toTransactionFrame(Application& app)
 {
     auto seqNum = mFrom->getLastSequenceNumber();
     mFrom->setSequenceNumber(seqNum + 1);
 
     TransactionFramePtr txf =
         transactionFromOperations(app, mFrom->getSecretKey(), seqNum + 1, mOps);
+    for (auto const& signer : mSigners)
+    {
+        txf->addSignature(signer);
+    }
+    mHash = txf->getFullHash();
+    return txf;
+}
+
+Herder::TransactionSubmitStatus
+LoadGenerator::TxInfo::execute(Application& app, LoadGenMode mode,
+                               TransactionResultCode& code, int32_t batchSize)
+{
+    auto txf = toTransactionFrame(app);
     TxMetrics txm(app.getMetrics());
 
     // Record tx metrics.
-    if (isCreate)
+    switch (mode)
     {
+    case LoadGenMode::CREATE:
         while (batchSize--)
         {
             txm.mAccountCreated.Mark();
         }
-    }
-    else
-    {
+        break;
+    case LoadGenMode::PAY:
+    case LoadGenMode::MULTISIG:
         txm.mPayment.Mark();
         txm.mNativePayment.Mark();
+        break;
+    case LoadGenMode::PATH_PAY:
+        txm.mPayment.Mark();
+        txm.mPathPayment.Mark();
+        break;
+    case LoadGenMode::OFFER:
+        txm.mManageOffer.Mark();
+        break;
+    case LoadGenMode::DATA:
+        txm.mManageData.Mark();
+        break;
     }
     txm.mTxnAttempted.Mark();
 
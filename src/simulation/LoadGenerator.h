@@ -9,7 +9,11 @@
 #include "main/Application.h"
 #include "test/TestAccount.h"
 #include "test/TxTests.h"
+#include "util/Timer.h"
 #include "xdr/Stellar-types.h"
+#include <map>
+#include <set>
+#include <unordered_map>
 #include <util/format.h>
 #include <vector>
 
@@ -24,8 +28,34 @@ class Timer;
 namespace stellar
 {
 
+class LedgerCloseData;
 class VirtualTimer;
 
+// What the transactions generated by LoadGenerator do:
+//  - CREATE: create accounts, batchSize per transaction
+//  - PAY: native payments between accounts
+//  - OFFER: ManageOffer churn: each account issues an asset, trusts the assets
+//    of the next accounts (the first transaction of each account sets up the
+//    trust lines) and keeps up to ModeParams::mOffers offers selling its asset
+//    for native or for those assets, creating, updating or deleting one per
+//    transaction
+//  - PATH_PAY: path payments from native to the asset of an account, through
+//    ModeParams::mHops assets of the accounts before it; they cross the offers
+//    left by OFFER
+//  - MULTISIG: native payments signed by ModeParams::mSigners more signers
+//    (the first transaction of each account adds them, and sets thresholds
+//    needing all of them: use accounts that are not used by other modes)
+//  - DATA: ManageData, setting one of a few entries of each account
+enum class LoadGenMode
+{
+    CREATE,
+    PAY,
+    OFFER,
+    PATH_PAY,
+    MULTISIG,
+    DATA
+};
+
 class LoadGenerator
 {
   public:
@@ -41,16 +71,40 @@ class LoadGenerator
 
     static const uint32_t STEP_MSECS;
     static const uint32_t TX_SUBMIT_MAX_TRIES;
+    // assets of the next accounts that each account trusts in OFFER mode
+    static const uint32_t TRUSTED_ASSETS;
+
+    struct ModeParams
+    {
+        uint32_t mOffers{5};
+        uint32_t mHops{2};
+        uint32_t mSigners{5};
+        // Open loop: submit a Poisson distributed number of transactions
+        // each step, of mean txRate times the time since the last step,
+        // whatever the state of the network (autoRate is ignored).
+        bool mPoisson{false};
+    };
+    ModeParams mModeParams;
 
     std::unique_ptr<VirtualTimer> mLoadTimer;
     int64 mMinBalance;
     uint64_t mLastSecond;
 
+    // the mode named `name` ("create", "pay", "offer", "pathpay", "multisig"
+    // or "data"); throws if there is none
+    static LoadGenMode modeFromString(std::string const& name);
+
     void createRootAccount();
     uint32_t getTxPerStep(uint32_t txRate);
+    uint32_t getPoissonTxPerStep(uint32_t txRate);
+
+    // Times the transactions submitted by submitCreationTx and submitTx from
+    // submission until they are applied in a ledger closed by this node, into
+    // the loadgen.tx.latency timer.
+    void ledgerClosed(LedgerCloseData const& ledgerData);
 
     // Schedule a callback to generateLoad() STEP_MSECS miliseconds from now.
-    void scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
+    void scheduleLoadGeneration(LoadGenMode mode, uint32_t nAccounts,
                                 uint32_t offset, uint32_t nTxs, uint32_t txRate,
                                 uint32_t batchSize, bool autoRate);
 
@@ -58,7 +112,7 @@ class LoadGenerator
     // given target number of accounts and txs, and a given target tx/s rate.
     // If work remains after the current step, call scheduleLoadGeneration()
     // with the remainder.
-    void generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
+    void generateLoad(LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
                       uint32_t nTxs, uint32_t txRate, uint32_t batchSize,
                       bool autoRate);
 
@@ -75,21 +129,33 @@ class LoadGenerator
                                              uint32_t offset,
                                              uint32_t ledgerNum,
                                              uint64_t sourceAccount);
+    // the transaction of `mode` (other than CREATE) from `sourceAccount`
+    TxInfo loadTransaction(LoadGenMode mode, uint32_t numAccounts,
+                           uint32_t offset, uint32_t ledgerNum,
+                           uint64_t sourceAccount);
+    TxInfo offerTransaction(uint32_t numAccounts, uint32_t offset,
+                            uint32_t ledgerNum, uint64_t sourceAccount);
+    TxInfo pathPaymentTransaction(uint32_t numAccounts, uint32_t offset,
+                                  uint32_t ledgerNum, uint64_t sourceAccount);
+    TxInfo multisigTransaction(uint32_t numAccounts, uint32_t offset,
+                               uint32_t ledgerNum, uint64_t sourceAccount);
+    TxInfo manageDataTransaction(uint32_t ledgerNum, uint64_t sourceAccount);
+    // the asset issued by the account `accountId` in OFFER and PATH_PAY
+    static Asset loadAsset(uint64_t accountId);
     void handleFailedSubmission(TestAccountPtr sourceAccount,
                                 Herder::TransactionSubmitStatus status,
                                 TransactionResultCode code);
     TxInfo creationTransaction(uint64_t startAccount, uint64_t numItems,
                                uint32_t ledgerNum);
     std::vector<TestAccountPtr> checkAccountSynced(Database& database);
-    void logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
+    void logProgress(std::chrono::nanoseconds submitTimer, LoadGenMode mode,
                      uint32_t nAccounts, uint32_t nTxs, uint32_t batchSize,
                      uint32_t txRate);
 
     uint32_t submitCreationTx(uint32_t nAccounts, uint32_t offset,
                               uint32_t batchSize, uint32_t ledgerNum);
-    uint32_t submitPaymentTx(uint32_t nAccounts, uint32_t offset,
-                             uint32_t batchSize, uint32_t ledgerNum,
-                             uint32_t nTxs);
+    uint32_t submitTx(LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
+                      uint32_t batchSize, uint32_t ledgerNum, uint32_t nTxs);
 
     void updateMinBalance();
     void waitTillComplete();
@@ -99,6 +165,9 @@ class LoadGenerator
         medida::Meter& mAccountCreated;
         medida::Meter& mPayment;
         medida::Meter& mNativePayment;
+        medida::Meter& mPathPayment;
+        medida::Meter& mManageOffer;
+        medida::Meter& mManageData;
         medida::Meter& mTxnAttempted;
         medida::Meter& mTxnRejected;
         medida::Meter& mTxnBytes;
@@ -111,7 +180,15 @@ class LoadGenerator
     {
         TestAccountPtr mFrom;
         std::vector<Operation> mOps;
-        Herder::TransactionSubmitStatus execute(Application& app, bool isCreate,
+        // signers other than mFrom
+        std::vector<SecretKey> mSigners;
+        // full hash of the transaction last built by toTransactionFrame()
+        Hash mHash;
+        // Builds and signs the transaction, with the next sequence number of
+        // mFrom.
+        TransactionFramePtr toTransactionFrame(Application& app);
+        Herder::TransactionSubmitStatus execute(Application& app,
+                                                LoadGenMode mode,
                                                 TransactionResultCode& code,
                                                 int32_t batchSize);
     };
@@ -121,5 +198,14 @@ class LoadGenerator
     TestAccountPtr mRoot;
     // Accounts cache
     std::map<uint64_t, TestAccountPtr> mAccounts;
+    // accounts known to have (or to be setting up) the trust lines of OFFER
+    std::set<uint64_t> mTrustingAccounts;
+    // accounts setting up (false) or having (true) the signers of MULTISIG
+    std::map<uint64_t, bool> mMultisigAccounts;
+    // submission times of the transactions not seen in a ledger yet
+    std::unordered_map<Hash, VirtualClock::time_point> mSubmitted;
+    uint64_t mLedgerClosedCallback;
+    VirtualClock::time_point mLastStep;
+    medida::Timer& mTxLatency;
 };
 }
@@ -0,0 +1,256 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/OverlayReplay.h"
+#include "crypto/SecretKey.h"
+#include "lib/http/server.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "overlay/LoopbackPeer.h"
+#include "overlay/StellarXDR.h"
+#include "util/Logging.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+
+namespace stellar
+{
+
+namespace
+{
+// the domains of the metrics reported
+char const* const REPORTED_DOMAINS[] = {"herder", "overlay", "scp"};
+
+class JsonMetricProcessor : public medida::MetricProcessor
+{
+    Json::Value& mOut;
+
+  public:
+    explicit JsonMetricProcessor(Json::Value& out) : mOut(out)
+    {
+    }
+
+    void
+    Process(medida::Counter& counter) override
+    {
+        mOut["count"] = static_cast<Json::Int64>(counter.count());
+    }
+
+    void
+    Process(medida::Meter& meter) override
+    {
+        mOut["count"] = static_cast<Json::UInt64>(meter.count());
+        mOut["mean_rate"] = meter.mean_rate();
+    }
+
+    void
+    Process(medida::Histogram& histogram) override
+    {
+        mOut["count"] = static_cast<Json::UInt64>(histogram.count());
+        mOut["mean"] = histogram.mean();
+        mOut["max"] = histogram.max();
+    }
+
+    void
+    Process(medida::Timer& timer) override
+    {
+        auto snapshot = timer.GetSnapshot();
+        mOut["count"] = static_cast<Json::UInt64>(timer.count());
+        mOut["mean_ms"] = timer.mean();
+        mOut["p99_ms"] = snapshot.get99thPercentile();
+        mOut["max_ms"] = timer.max();
+    }
+};
+
+// a node of its own, sending the capture: in memory, not listening
+Config
+feederConfig(Config const& cfg, std::string const& bucketDir)
+{
+    Config res = cfg;
+    res.NODE_SEED = SecretKey::random();
+    res.NODE_IS_VALIDATOR = false;
+    res.RUN_STANDALONE = true;
+    res.HTTP_PORT = 0;
+    res.DATABASE = SecretValue{"sqlite3://:memory:"};
+    res.BUCKET_DIR_PATH = bucketDir;
+    res.HISTORY.clear();
+    res.OVERLAY_CAPTURE_FILE.clear();
+    res.METADATA_OUTPUT_STREAM.clear();
+    return res;
+}
+
+bool
+isConnected(LoopbackPeerConnection const& conn)
+{
+    return conn.getInitiator()->isAuthenticated() &&
+           conn.getAcceptor()->isAuthenticated();
+}
+}
+
+OverlayReplay
+OverlayReplay::parse(std::string const& spec)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(spec, map);
+
+    OverlayReplay replay;
+    replay.mFile = map["file"];
+    if (replay.mFile.empty())
+    {
+        throw std::runtime_error("--replay-overlay needs a file parameter");
+    }
+    if (!map["speed"].empty())
+    {
+        size_t pos = 0;
+        replay.mSpeed = std::stod(map["speed"], &pos);
+        if (pos != map["speed"].size() || replay.mSpeed < 0)
+        {
+            throw std::runtime_error("Failed to parse 'speed' argument");
+        }
+    }
+    return replay;
+}
+
+Json::Value
+OverlayReplay::run(Application& app) const
+{
+    auto& clock = app.getClock();
+    bool realTime = clock.getMode() == VirtualClock::REAL_TIME;
+
+    // on a clock of its own, so that stopping it leaves `app` running
+    VirtualClock feederClock(clock.getMode());
+    auto bucketDir = app.getTmpDirManager().tmpDir("replay-feeder");
+    auto feeder = Application::create(
+        feederClock, feederConfig(app.getConfig(), bucketDir.getName()));
+    feeder->start();
+
+    auto crank = [&]() {
+        if (feederClock.crank(false) + clock.crank(false) == 0 && realTime)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    };
+
+    std::unique_ptr<LoopbackPeerConnection> conn;
+    size_t connections = 0;
+    auto connect = [&]() {
+        conn = std::make_unique<LoopbackPeerConnection>(*feeder, app);
+        ++connections;
+        while (!isConnected(*conn) && conn->getInitiator()->isConnected() &&
+               conn->getAcceptor()->isConnected())
+        {
+            crank();
+        }
+        if (!isConnected(*conn))
+        {
+            throw std::runtime_error("replaying node did not connect");
+        }
+    };
+    connect();
+
+    for (auto domain : REPORTED_DOMAINS)
+    {
+        app.clearMetrics(domain);
+    }
+    // marked as each message is received, before it is handled; the
+    // messages the feeder sends on its own count too, which only makes
+    // waiting for the ones replayed end a little early
+    auto& read =
+        app.getMetrics().NewMeter({"overlay", "message", "read"}, "message");
+    auto const readBefore = read.count();
+
+    XDRInputFileStream in;
+    in.open(mFile);
+    CapturedMessage captured;
+    std::map<std::string, uint64_t> types;
+    uint64_t messages = 0;
+    uint64_t captureMicros = 0;
+    auto waitForReads = [&]() {
+        while (read.count() < readBefore + messages && isConnected(*conn))
+        {
+            crank();
+        }
+    };
+    auto start = clock.now();
+    while (in.readOne(captured))
+    {
+        if (mSpeed > 0)
+        {
+            // due at the offset it was captured at, scaled
+            auto due = start + std::chrono::microseconds(static_cast<int64_t>(
+                                   captured.timeOffset / mSpeed));
+            while (clock.now() < due)
+            {
+                crank();
+            }
+        }
+        if (!isConnected(*conn))
+        {
+            // dropped by the node (load, errors): back with a new connection
+            conn.reset();
+            connect();
+        }
+
+        conn->getInitiator()->Peer::sendMessage(captured.message);
+        ++messages;
+        ++types[xdr::xdr_traits<MessageType>::enum_name(
+            captured.message.type())];
+        captureMicros = captured.timeOffset;
+        if (mSpeed == 0)
+        {
+            // as fast as the node handles them: one at a time
+            waitForReads();
+        }
+    }
+    waitForReads();
+    auto elapsed = clock.now() - start;
+
+    Json::Value res;
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    res["messages"] = static_cast<Json::UInt64>(messages);
+    res["seconds"] = seconds;
+    res["capture_seconds"] = captureMicros / 1e6;
+    res["messages_per_second"] = seconds > 0 ? messages / seconds : 0.0;
+    res["speed"] = mSpeed;
+    res["connections"] = static_cast<Json::UInt64>(connections);
+    for (auto const& t : types)
+    {
+        res["types"][t.first] = static_cast<Json::UInt64>(t.second);
+    }
+
+    auto& metrics = res["metrics"];
+    for (auto const& kv : app.getMetrics().GetAllMetrics())
+    {
+        auto const& name = kv.first;
+        for (auto domain : REPORTED_DOMAINS)
+        {
+            if (name.domain() == domain)
+            {
+                JsonMetricProcessor processor(
+                    metrics[name.domain() + "." + name.type() + "." +
+                            name.name()]);
+                kv.second->Process(processor);
+            }
+        }
+    }
+
+    conn.reset();
+    feeder->gracefulStop();
+    while (feederClock.crank(realTime) > 0)
+        ;
+    return res;
+}
+}
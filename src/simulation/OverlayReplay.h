@@ -0,0 +1,40 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json-forwards.h"
+#include <string>
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Replays the messages captured from the peers of a node (see
+ * MessageCapture) against an application (see --replay-overlay), to
+ * reproduce the load of a network offline.
+ *
+ * The messages are sent, in order, by a node of its own connected to the
+ * application through a LoopbackPeerConnection, at the pace they were
+ * received times mSpeed, or as fast as the application handles them if
+ * mSpeed is 0. They all come from that one peer, whichever peers sent them
+ * originally.
+ */
+struct OverlayReplay
+{
+    std::string mFile;
+    double mSpeed{1.0};
+
+    // Reads the parameters from a query string such as
+    // "file=capture.xdr&speed=10".
+    static OverlayReplay parse(std::string const& spec);
+
+    // Replays the capture against `app`, which must be started, and returns
+    // its report: the messages replayed by type, how long the replay took,
+    // and the herder and overlay metrics of `app` over the replay.
+    Json::Value run(Application& app) const;
+};
+}
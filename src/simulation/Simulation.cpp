@@ -29,19 +29,22 @@ using namespace std;
 
 Simulation::Simulation(Mode mode, Hash const& networkID, ConfigGen confGen,
                        QuorumSetAdjuster qSetAdjust)
-    : mVirtualClockMode(mode != OVER_TCP)
+    : mVirtualClockMode(mode == OVER_LOOPBACK)
     , mClock(mVirtualClockMode ? VirtualClock::VIRTUAL_TIME
                                : VirtualClock::REAL_TIME)
     , mMode(mode)
     , mConfigCount(0)
     , mConfigGen(confGen)
     , mQuorumSetAdjuster(qSetAdjust)
+    , mThreadCount(std::max(1u, std::thread::hardware_concurrency()))
 {
     mIdleApp = Application::create(mClock, newConfig());
 }
 
 Simulation::~Simulation()
 {
+    stopThreads();
+
     // kills all connections
     mLoopbackConnections.clear();
     // destroy all nodes first
@@ -54,6 +57,18 @@ Simulation::~Simulation()
         ;
 }
 
+void
+Simulation::setThreadCount(size_t n)
+{
+    if (n == 0)
+    {
+        throw runtime_error("thread count cannot be 0");
+    }
+    // started again with the new count by crankThreaded
+    stopThreads();
+    mThreadCount = n;
+}
+
 void
 Simulation::setCurrentTime(VirtualClock::time_point t)
 {
@@ -81,7 +96,7 @@ Simulation::addNode(SecretKey nodeKey, SCPQuorumSet qSet, Config const* cfg2,
         cfg->QUORUM_SET = qSet;
     }
 
-    cfg->RUN_STANDALONE = (mMode == OVER_LOOPBACK);
+    cfg->RUN_STANDALONE = isLoopback();
 
     auto clock =
         make_shared<VirtualClock>(mVirtualClockMode ? VirtualClock::VIRTUAL_TIME
@@ -127,7 +142,7 @@ Simulation::removeNode(NodeID const& id)
     {
         auto node = it->second;
         mNodes.erase(it);
-        if (mMode == OVER_LOOPBACK)
+        if (isLoopback())
         {
             dropAllConnections(id);
         }
@@ -140,7 +155,7 @@ Simulation::removeNode(NodeID const& id)
 void
 Simulation::dropAllConnections(NodeID const& id)
 {
-    if (mMode == OVER_LOOPBACK)
+    if (isLoopback())
     {
         mLoopbackConnections.erase(
             std::remove_if(mLoopbackConnections.begin(),
@@ -157,6 +172,12 @@ Simulation::dropAllConnections(NodeID const& id)
     }
 }
 
+bool
+Simulation::isLoopback() const
+{
+    return mMode == OVER_LOOPBACK || mMode == OVER_LOOPBACK_THREADED;
+}
+
 void
 Simulation::addPendingConnection(NodeID const& initiator,
                                  NodeID const& acceptor)
@@ -167,7 +188,7 @@ Simulation::addPendingConnection(NodeID const& initiator,
 void
 Simulation::addConnection(NodeID initiator, NodeID acceptor)
 {
-    if (mMode == OVER_LOOPBACK)
+    if (isLoopback())
         addLoopbackConnection(initiator, acceptor);
     else
         addTCPConnection(initiator, acceptor);
@@ -176,7 +197,7 @@ Simulation::addConnection(NodeID initiator, NodeID acceptor)
 void
 Simulation::dropConnection(NodeID initiator, NodeID acceptor)
 {
-    if (mMode == OVER_LOOPBACK)
+    if (isLoopback())
         dropLoopbackConnection(initiator, acceptor);
     else
     {
@@ -320,6 +341,22 @@ Simulation::crankAllNodes(int nbTicks)
 
     std::size_t count = 0;
 
+    if (mMode == OVER_LOOPBACK_THREADED)
+    {
+        for (int i = 0; i < nbTicks; i++)
+        {
+            if (mClock.getIOService().stopped())
+            {
+                return 0;
+            }
+            count += crankThreaded();
+            // the nodes are paused: the simulation's own timers can look
+            // at them
+            count += mClock.crank(false);
+        }
+        return count;
+    }
+
     VirtualTimer mainQuantumTimer(*mIdleApp);
 
     int i = 0;
@@ -405,6 +442,113 @@ Simulation::crankAllNodes(int nbTicks)
     return count;
 }
 
+size_t
+Simulation::crankThreaded()
+{
+    if (mThreads.empty())
+    {
+        auto n = mThreadCount;
+        for (size_t i = 0; i < n; i++)
+        {
+            mThreads.emplace_back([this, i, n]() { crankThread(i, n); });
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mThreadsMutex);
+        mThreadClocks.clear();
+        for (auto const& p : mNodes)
+        {
+            mThreadClocks.push_back(p.second.mClock);
+        }
+        mThreadsWork = 0;
+        mThreadsRunning = true;
+    }
+    mThreadsCond.notify_all();
+
+    std::this_thread::sleep_for(threadQuantum);
+    pauseThreads();
+    return mThreadsWork;
+}
+
+void
+Simulation::crankThread(size_t index, size_t count)
+{
+    std::unique_lock<std::mutex> lock(mThreadsMutex);
+    for (;;)
+    {
+        mThreadsCond.wait(
+            lock, [this]() { return mThreadsRunning || mThreadsStopping; });
+        if (mThreadsStopping)
+        {
+            return;
+        }
+        mThreadsActive++;
+        lock.unlock();
+
+        size_t work = 0;
+        try
+        {
+            for (size_t i = index; i < mThreadClocks.size(); i += count)
+            {
+                auto& clock = *mThreadClocks[i];
+                if (!clock.getIOService().stopped())
+                {
+                    work += clock.crank(false);
+                }
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> errorLock(mThreadsMutex);
+            mThreadsError = std::current_exception();
+            mThreadsRunning = false;
+        }
+        mThreadsWork += work;
+        if (work == 0)
+        {
+            // nothing ready: wait for messages from the other threads, or
+            // for timers
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        lock.lock();
+        mThreadsActive--;
+        mThreadsCond.notify_all();
+    }
+}
+
+void
+Simulation::pauseThreads()
+{
+    std::unique_lock<std::mutex> lock(mThreadsMutex);
+    mThreadsRunning = false;
+    mThreadsCond.wait(lock, [this]() { return mThreadsActive == 0; });
+    mThreadClocks.clear();
+    if (mThreadsError)
+    {
+        auto error = mThreadsError;
+        mThreadsError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void
+Simulation::stopThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(mThreadsMutex);
+        mThreadsStopping = true;
+    }
+    mThreadsCond.notify_all();
+    for (auto& t : mThreads)
+    {
+        t.join();
+    }
+    mThreads.clear();
+    mThreadsStopping = false;
+}
+
 bool
 Simulation::haveAllExternalized(uint32 num, uint32 maxSpread)
 {
@@ -601,6 +745,34 @@ Simulation::accountsOutOfSyncWithDb(Application& mainApp)
     return result;
 }
 
+Simulation::ConfigGen
+Simulation::lightweight(ConfigGen confGen)
+{
+    return [confGen](int i) {
+        Config cfg;
+        if (confGen)
+        {
+            cfg = confGen(i);
+        }
+        else
+        {
+            cfg = getTestConfig(i);
+            cfg.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+        }
+        cfg.DATABASE = SecretValue{"sqlite3://:memory:"};
+        cfg.HTTP_PORT = 0;
+        cfg.WORKER_THREADS = 1;
+        cfg.CHECKDB_THREADS = 1;
+        cfg.MERGE_SPLIT_THREADS = 1;
+        cfg.BUCKET_WRITE_BUFFER_SIZE = 0;
+        cfg.ENTRY_CACHE_SIZE = 0x100000;
+        cfg.ORDER_BOOK_CACHE_SIZE = 0;
+        cfg.FLOOD_MAP_MAX_BYTES = 0x400000;
+        cfg.PENDING_TRANSACTIONS_MAX_BYTES = 0x400000;
+        return cfg;
+    };
+}
+
 Config
 Simulation::newConfig()
 {
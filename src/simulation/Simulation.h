@@ -17,6 +17,12 @@
 #include "util/XDROperators.h"
 #include "xdr/Stellar-types.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 #define SIMULATION_CREATE_NODE(N) \
     const Hash v##N##VSeed = sha256("NODE_SEED_" #N); \
     const SecretKey v##N##SecretKey = SecretKey::fromSeed(v##N##VSeed); \
@@ -30,7 +36,13 @@ class Simulation
     enum Mode
     {
         OVER_TCP,
-        OVER_LOOPBACK
+        OVER_LOOPBACK,
+        // Loopback connections, but the nodes run in real time, cranked by
+        // a pool of threads (see setThreadCount) for as long as
+        // crankAllNodes runs: between calls, the nodes can be inspected
+        // from the calling thread. Not deterministic, for simulations of
+        // large topologies OVER_LOOPBACK would take hours to crank through.
+        OVER_LOOPBACK_THREADED
     };
 
     using pointer = std::shared_ptr<Simulation>;
@@ -39,8 +51,20 @@ class Simulation
 
     Simulation(Mode mode, Hash const& networkID, ConfigGen = nullptr,
                QuorumSetAdjuster = nullptr);
+
+    // Wraps `confGen` (or the default configuration of nodes) into
+    // configurations light enough to run a few hundred nodes in one process,
+    // for example through Topologies::hierarchicalQuorum: ledger in an
+    // in-memory SQLite database, a single worker thread, no HTTP server,
+    // and small caches and buffers.
+    static ConfigGen lightweight(ConfigGen confGen = nullptr);
     ~Simulation();
 
+    // OVER_LOOPBACK_THREADED: number of threads cranking the nodes, each
+    // cranking a share of them in turn; defaults to the number of cores.
+    // Takes effect the next time crankAllNodes is called.
+    void setThreadCount(size_t n);
+
     // updates all clocks in the simulation to the same time_point
     void setCurrentTime(VirtualClock::time_point t);
 
@@ -82,6 +106,12 @@ class Simulation
     void dropLoopbackConnection(NodeID initiator, NodeID acceptor);
     void addTCPConnection(NodeID initiator, NodeID acception);
     void dropAllConnections(NodeID const& id);
+    bool isLoopback() const;
+
+    size_t crankThreaded();
+    void crankThread(size_t index, size_t count);
+    void pauseThreads();
+    void stopThreads();
 
     bool mVirtualClockMode;
     VirtualClock mClock;
@@ -109,5 +139,21 @@ class Simulation
     QuorumSetAdjuster mQuorumSetAdjuster;
 
     std::chrono::milliseconds const quantum = std::chrono::milliseconds(100);
+
+    // OVER_LOOPBACK_THREADED: the threads only crank the clocks of
+    // mThreadClocks while mThreadsRunning, which only changes (as do the
+    // clocks) when none of them is active.
+    std::chrono::milliseconds const threadQuantum =
+        std::chrono::milliseconds(20);
+    size_t mThreadCount;
+    std::vector<std::thread> mThreads;
+    std::mutex mThreadsMutex;
+    std::condition_variable mThreadsCond;
+    bool mThreadsRunning{false};
+    bool mThreadsStopping{false};
+    size_t mThreadsActive{0};
+    std::vector<std::shared_ptr<VirtualClock>> mThreadClocks;
+    std::atomic<size_t> mThreadsWork{0};
+    std::exception_ptr mThreadsError;
 };
 }
@@ -99,6 +99,8 @@ getTestConfig(int instanceNumber, Config::TestDbMode mode)
 
         thisConfig.PEER_PORT =
             static_cast<unsigned short>(DEFAULT_PEER_PORT + instanceNumber * 2);
+        // the nodes of a test all connect from the same address
+        thisConfig.PEER_ACCEPT_RATE_PER_IP = 0;
         thisConfig.HTTP_PORT = static_cast<unsigned short>(
             DEFAULT_PEER_PORT + instanceNumber * 2 + 1);
 
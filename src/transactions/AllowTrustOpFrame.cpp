@@ -128,9 +128,7 @@ AllowTrustOpFrame::doApply(Application& app, LedgerDelta& delta,
     trustLine->setAuthorized(mAllowTrust.authorize);
     trustLine->storeChange(delta, db);
 
-    app.getMetrics()
-        .NewMeter({"op-allow-trust", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     innerResult().code(ALLOW_TRUST_SUCCESS);
     return true;
 }
@@ -172,4 +170,30 @@ AllowTrustOpFrame::doCheckValid(Application& app)
 
     return true;
 }
+
+void
+AllowTrustOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    insertAccountKey(keys, mAllowTrust.trustor);
+
+    Asset ci;
+    ci.type(mAllowTrust.asset.type());
+    if (mAllowTrust.asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
+    {
+        ci.alphaNum4().assetCode = mAllowTrust.asset.assetCode4();
+        ci.alphaNum4().issuer = getSourceID();
+    }
+    else if (mAllowTrust.asset.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
+    {
+        ci.alphaNum12().assetCode = mAllowTrust.asset.assetCode12();
+        ci.alphaNum12().issuer = getSourceID();
+    }
+    else
+    {
+        return;
+    }
+    insertTrustLineKey(keys, mAllowTrust.trustor, ci);
+}
 }
@@ -26,6 +26,8 @@ class AllowTrustOpFrame : public OperationFrame
     bool doApply(Application& app, LedgerDelta& delta,
                  LedgerManager& ledgerManager) override;
     bool doCheckValid(Application& app) override;
+    void insertLedgerKeysToPrefetch(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const override;
 
     static AllowTrustResultCode
     getInnerCode(OperationResult const& res)
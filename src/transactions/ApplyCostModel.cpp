@@ -0,0 +1,64 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/ApplyCostModel.h"
+#include "transactions/OperationFrame.h"
+#include "transactions/TransactionFrame.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+constexpr double ApplyCostModel::WEIGHT;
+constexpr std::chrono::nanoseconds ApplyCostModel::DEFAULT_COST;
+constexpr std::chrono::nanoseconds ApplyCostModel::MIN_COST;
+
+void
+ApplyCostModel::record(OperationType type, std::chrono::nanoseconds duration)
+{
+    auto d = static_cast<double>(std::max(duration, MIN_COST).count());
+    auto it = mCosts.find(type);
+    if (it == mCosts.end())
+    {
+        mCosts.emplace(type, d);
+    }
+    else
+    {
+        it->second += WEIGHT * (d - it->second);
+    }
+}
+
+std::chrono::nanoseconds
+ApplyCostModel::getOperationCost(OperationType type) const
+{
+    auto it = mCosts.find(type);
+    if (it != mCosts.end())
+    {
+        return std::chrono::nanoseconds(static_cast<int64_t>(it->second));
+    }
+    if (mCosts.empty())
+    {
+        return DEFAULT_COST;
+    }
+    double total = 0;
+    for (auto const& c : mCosts)
+    {
+        total += c.second;
+    }
+    return std::chrono::nanoseconds(
+        static_cast<int64_t>(total / mCosts.size()));
+}
+
+std::chrono::nanoseconds
+ApplyCostModel::getTransactionCost(TransactionFrame const& tx) const
+{
+    std::chrono::nanoseconds res{0};
+    for (auto const& op : tx.getEnvelope().tx.operations)
+    {
+        res += getOperationCost(op.body.type());
+    }
+    return std::max(res, MIN_COST);
+}
+}
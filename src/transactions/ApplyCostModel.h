@@ -0,0 +1,53 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdr/Stellar-transaction.h"
+
+#include <chrono>
+#include <map>
+
+namespace stellar
+{
+
+class TransactionFrame;
+
+/**
+ * Measured cost of applying each type of operation, so that transactions can
+ * be weighed by what they take to apply (a path payment crossing offers
+ * costs far more than a bump sequence) rather than by their number of
+ * operations, see TxSetFrame::applyCostFilter.
+ *
+ * The cost of a type is an exponentially weighted moving average of the
+ * apply times of its operations, as timed into the {"op-...", "apply",
+ * "time"} timers, so that it follows changes in load such as order books
+ * getting deeper. A type not applied yet costs the average of the others, or
+ * DEFAULT_COST: with no measurement, every operation costs the same.
+ *
+ * Main thread only.
+ */
+class ApplyCostModel
+{
+  public:
+    // weight of each new measurement in the average
+    static constexpr double WEIGHT = 0.05;
+    static constexpr std::chrono::nanoseconds DEFAULT_COST{
+        std::chrono::microseconds(100)};
+    // the least an operation costs, however fast it was measured
+    static constexpr std::chrono::nanoseconds MIN_COST{
+        std::chrono::microseconds(1)};
+
+    void record(OperationType type, std::chrono::nanoseconds duration);
+
+    std::chrono::nanoseconds getOperationCost(OperationType type) const;
+    // The sum of the costs of the operations of `tx`.
+    std::chrono::nanoseconds
+    getTransactionCost(TransactionFrame const& tx) const;
+
+  private:
+    // in nanoseconds
+    std::map<OperationType, double> mCosts;
+};
+}
@@ -49,9 +49,7 @@ BumpSequenceOpFrame::doApply(Application& app, LedgerDelta& delta,
 
     // Return successful results
     innerResult().code(BUMP_SEQUENCE_SUCCESS);
-    app.getMetrics()
-        .NewMeter({"op-bump-sequence", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     return true;
 }
 
@@ -83,9 +83,7 @@ ChangeTrustOpFrame::doApply(Application& app, LedgerDelta& delta,
             trustLine->getTrustLine().limit = mChangeTrust.limit;
             trustLine->storeChange(delta, db);
         }
-        app.getMetrics()
-            .NewMeter({"op-change-trust", "success", "apply"}, "operation")
-            .Mark();
+        markSuccess(app);
         innerResult().code(CHANGE_TRUST_SUCCESS);
         return true;
     }
@@ -130,9 +128,7 @@ ChangeTrustOpFrame::doApply(Application& app, LedgerDelta& delta,
         mSourceAccount->storeChange(delta, db);
         trustLine->storeAdd(delta, db);
 
-        app.getMetrics()
-            .NewMeter({"op-change-trust", "success", "apply"}, "operation")
-            .Mark();
+        markSuccess(app);
         innerResult().code(CHANGE_TRUST_SUCCESS);
         return true;
     }
@@ -175,4 +171,16 @@ ChangeTrustOpFrame::doCheckValid(Application& app)
     }
     return true;
 }
+
+void
+ChangeTrustOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    insertTrustLineKey(keys, getSourceID(), mChangeTrust.line);
+    if (mChangeTrust.line.type() != ASSET_TYPE_NATIVE)
+    {
+        insertAccountKey(keys, getIssuer(mChangeTrust.line));
+    }
+}
 }
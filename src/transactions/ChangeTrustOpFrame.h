@@ -24,6 +24,8 @@ class ChangeTrustOpFrame : public OperationFrame
     bool doApply(Application& app, LedgerDelta& delta,
                  LedgerManager& ledgerManager) override;
     bool doCheckValid(Application& app) override;
+    void insertLedgerKeysToPrefetch(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const override;
 
     static ChangeTrustResultCode
     getInnerCode(OperationResult const& res)
@@ -77,10 +77,7 @@ CreateAccountOpFrame::doApply(Application& app, LedgerDelta& delta,
 
             destAccount->storeAdd(delta, db);
 
-            app.getMetrics()
-                .NewMeter({"op-create-account", "success", "apply"},
-                          "operation")
-                .Mark();
+            markSuccess(app);
             innerResult().code(CREATE_ACCOUNT_SUCCESS);
             return true;
         }
@@ -123,4 +120,12 @@ CreateAccountOpFrame::doCheckValid(Application& app)
 
     return true;
 }
+
+void
+CreateAccountOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    insertAccountKey(keys, mCreateAccount.destination);
+}
 }
@@ -25,6 +25,8 @@ class CreateAccountOpFrame : public OperationFrame
     bool doApply(Application& app, LedgerDelta& delta,
                  LedgerManager& ledgerManager) override;
     bool doCheckValid(Application& app) override;
+    void insertLedgerKeysToPrefetch(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const override;
 
     static CreateAccountResultCode
     getInnerCode(OperationResult const& res)
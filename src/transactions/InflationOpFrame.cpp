@@ -64,6 +64,9 @@ InflationOpFrame::doApply(Application& app, LedgerDelta& delta,
     std::vector<AccountFrame::InflationVotes> winners;
     auto& db = ledgerManager.getDatabase();
 
+    // the votes are tallied by the database
+    inflationDelta.flushDeferredWrites();
+
     AccountFrame::processForInflation(
         [&](AccountFrame::InflationVotes const& votes) {
             if (votes.mVotes >= minBalance)
@@ -136,9 +139,7 @@ InflationOpFrame::doApply(Application& app, LedgerDelta& delta,
 
     inflationDelta.commit();
 
-    app.getMetrics()
-        .NewMeter({"op-inflation", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     return true;
 }
 
@@ -153,4 +154,11 @@ InflationOpFrame::getThresholdLevel() const
 {
     return ThresholdLevel::LOW;
 }
+
+bool
+InflationOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    return false;
+}
 }
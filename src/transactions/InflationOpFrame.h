@@ -25,6 +25,8 @@ class InflationOpFrame : public OperationFrame
     bool doApply(Application& app, LedgerDelta& delta,
                  LedgerManager& ledgerManager) override;
     bool doCheckValid(Application& app) override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const override;
 
     static InflationResultCode
     getInnerCode(OperationResult const& res)
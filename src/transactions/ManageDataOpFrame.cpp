@@ -91,9 +91,7 @@ ManageDataOpFrame::doApply(Application& app, LedgerDelta& delta,
 
     innerResult().code(MANAGE_DATA_SUCCESS);
 
-    app.getMetrics()
-        .NewMeter({"op-manage-data", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     return true;
 }
 
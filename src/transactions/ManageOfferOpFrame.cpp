@@ -9,6 +9,7 @@
 #include "ledger/LedgerDelta.h"
 #include "ledger/OfferFrame.h"
 #include "main/Application.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "util/Logging.h"
@@ -337,6 +338,9 @@ ManageOfferOpFrame::doApply(Application& app, LedgerDelta& delta,
                 return OfferExchange::eKeep;
             });
         assert(sheepSent >= 0);
+        app.getMetrics()
+            .NewHistogram({"op-manage-offer", "offers", "loaded"})
+            .Update(static_cast<int64_t>(oe.getOffersLoaded()));
 
         bool sheepStays;
         switch (r)
@@ -473,9 +477,7 @@ ManageOfferOpFrame::doApply(Application& app, LedgerDelta& delta,
     sqlTx.commit();
     tempDelta.commit();
 
-    app.getMetrics()
-        .NewMeter({"op-create-offer", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     return true;
 }
 
@@ -544,4 +546,11 @@ ManageOfferOpFrame::buildOffer(AccountID const& account,
     o.flags = flags;
     return o;
 }
+
+bool
+ManageOfferOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    return false;
+}
 }
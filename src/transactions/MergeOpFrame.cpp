@@ -142,9 +142,7 @@ MergeOpFrame::doApply(Application& app, LedgerDelta& delta,
         mSourceAccount->storeDelete(delta, db);
     }
 
-    app.getMetrics()
-        .NewMeter({"op-merge", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     innerResult().code(ACCOUNT_MERGE_SUCCESS);
     innerResult().sourceAccountBalance() = sourceBalance;
     return true;
@@ -165,4 +163,12 @@ MergeOpFrame::doCheckValid(Application& app)
     }
     return true;
 }
+
+void
+MergeOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    insertAccountKey(keys, mOperation.body.destination());
+}
 }
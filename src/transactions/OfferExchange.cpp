@@ -9,6 +9,8 @@
 #include "ledger/TrustFrame.h"
 #include "lib/util/uint128_t.h"
 #include "util/Logging.h"
+#include <algorithm>
+#include <unordered_set>
 
 namespace stellar
 {
@@ -565,9 +567,18 @@ applyPriceErrorThresholds(Price price, int64_t wheatReceive, int64_t sheepSend,
     return res;
 }
 
+size_t const LoadBestOfferContext::INITIAL_BATCH_SIZE = 5;
+size_t const LoadBestOfferContext::MAX_BATCH_SIZE = 640;
+
 LoadBestOfferContext::LoadBestOfferContext(Database& db, Asset const& selling,
-                                           Asset const& buying)
-    : mSelling(selling), mBuying(buying), mDb(db), mBatchIterator(mBatch.end())
+                                           Asset const& buying,
+                                           size_t& offersLoaded)
+    : mSelling(selling)
+    , mBuying(buying)
+    , mDb(db)
+    , mBatchIterator(mBatch.end())
+    , mBatchSize(INITIAL_BATCH_SIZE)
+    , mOffersLoaded(offersLoaded)
 {
     loadBatchIfNecessary();
 }
@@ -575,12 +586,53 @@ LoadBestOfferContext::LoadBestOfferContext(Database& db, Asset const& selling,
 void
 LoadBestOfferContext::loadBatchIfNecessary()
 {
-    if (mBatchIterator == mBatch.end())
+    if (mBatchIterator == mBatch.end() && !mExhausted)
     {
+        // Taken offers are deleted as we go, so every batch starts at offset
+        // 0. No offers are added to the book while crossing, so a short batch
+        // means there is nothing left to load.
+        if (!mBatch.empty())
+        {
+            mBatchSize = std::min(mBatchSize * 2, MAX_BATCH_SIZE);
+        }
         mBatch.clear();
-        OfferFrame::loadBestOffers(5, 0, mSelling, mBuying, mBatch, mDb);
+        OfferFrame::loadBestOffers(mBatchSize, 0, mSelling, mBuying, mBatch,
+                                   mDb);
+        mExhausted = mBatch.size() < mBatchSize;
+        mOffersLoaded += mBatch.size();
         mBatchIterator = mBatch.begin();
+        prefetchSellers();
+    }
+}
+
+void
+LoadBestOfferContext::prefetchSellers()
+{
+    std::unordered_set<LedgerKey, LedgerKeyHash> keys;
+    auto insertTrustLine = [&keys](AccountID const& seller,
+                                   Asset const& asset) {
+        // an issuer's own asset has no trustline in the database
+        if (asset.type() == ASSET_TYPE_NATIVE || getIssuer(asset) == seller)
+        {
+            return;
+        }
+        LedgerKey key;
+        key.type(TRUSTLINE);
+        key.trustLine().accountID = seller;
+        key.trustLine().asset = asset;
+        keys.emplace(key);
+    };
+    for (auto const& offer : mBatch)
+    {
+        auto const& o = offer->getOffer();
+        LedgerKey key;
+        key.type(ACCOUNT);
+        key.account().accountID = o.sellerID;
+        keys.emplace(key);
+        insertTrustLine(o.sellerID, o.selling);
+        insertTrustLine(o.sellerID, o.buying);
     }
+    EntryFrame::prefetch(mDb, keys);
 }
 
 OfferFrame::pointer
@@ -1044,7 +1096,7 @@ OfferExchange::convertWithOffers(
     Database& db = mLedgerManager.getDatabase();
 
     bool needMore = (maxWheatReceive > 0 && maxSheepSend > 0);
-    LoadBestOfferContext context(db, wheat, sheep);
+    LoadBestOfferContext context(db, wheat, sheep, mOffersLoaded);
     OfferFrame::pointer wheatOffer;
     while (needMore && (wheatOffer = context.loadBestOffer()))
     {
@@ -82,6 +82,13 @@ int64_t adjustOffer(Price const& price, int64_t maxWheatSend,
 bool checkPriceErrorBound(Price price, int64_t wheatReceive, int64_t sheepSend,
                           bool canFavorWheat);
 
+// Iterates over the best offers of a book, loading them in batches. Most
+// crossings only take an offer or two, so the first batch is small; each time
+// a batch is used up the next one is twice as large, so that walking a deep
+// book costs a logarithmic number of queries. The accounts and trustlines of
+// the sellers of each batch, which crossing an offer loads, are prefetched
+// along with it (see EntryFrame::prefetch), rather than queried offer by
+// offer.
 class LoadBestOfferContext
 {
     Asset const mSelling;
@@ -92,11 +99,20 @@ class LoadBestOfferContext
     std::vector<OfferFrame::pointer> mBatch;
     std::vector<OfferFrame::pointer>::iterator mBatchIterator;
 
+    size_t mBatchSize;
+    bool mExhausted{false};
+    // incremented by the number of offers read from the database
+    size_t& mOffersLoaded;
+
     void loadBatchIfNecessary();
+    void prefetchSellers();
 
   public:
+    static size_t const INITIAL_BATCH_SIZE;
+    static size_t const MAX_BATCH_SIZE;
+
     LoadBestOfferContext(Database& db, Asset const& selling,
-                         Asset const& buying);
+                         Asset const& buying, size_t& offersLoaded);
 
     OfferFrame::pointer loadBestOffer();
 
@@ -110,6 +126,7 @@ class OfferExchange
     LedgerManager& mLedgerManager;
 
     std::vector<ClaimOfferAtom> mOfferTrail;
+    size_t mOffersLoaded{0};
 
   public:
     OfferExchange(LedgerDelta& delta, LedgerManager& ledgerManager);
@@ -156,5 +173,12 @@ class OfferExchange
     {
         return mOfferTrail;
     }
+
+    // Number of offers loaded from the database by convertWithOffers.
+    size_t
+    getOffersLoaded() const
+    {
+        return mOffersLoaded;
+    }
 };
 }
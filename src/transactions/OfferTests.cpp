@@ -3,6 +3,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "database/Database.h"
+#include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "lib/util/uint128_t.h"
@@ -2935,3 +2936,103 @@ TEST_CASE("liabilities match created offer", "[tx][offers]")
     // NOTE: Starting in version 10, it is not possible to create an offer that
     // initially exceeds limits.
 }
+
+TEST_CASE("best offers are loaded in growing batches", "[tx][offers]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto& lm = app->getLedgerManager();
+    auto& db = app->getDatabase();
+    app->start();
+
+    int64_t txfee = lm.getTxFee();
+    size_t const numOffers = 40;
+
+    auto root = TestAccount::createRoot(*app);
+    auto issuer = root.create("issuer", lm.getMinBalance(numOffers) +
+                                            1000 * txfee);
+    auto cur1 = issuer.asset("CUR1");
+    auto cur2 = issuer.asset("CUR2");
+    for (size_t i = 0; i < numOffers; ++i)
+    {
+        issuer.manageOffer(0, cur1, cur2,
+                           Price{static_cast<int32_t>(numOffers - i), 1}, 100);
+    }
+
+    LedgerDelta delta(lm.getCurrentLedgerHeader(), db);
+    size_t loaded = 0;
+    LoadBestOfferContext context(db, cur1, cur2, loaded);
+    REQUIRE(loaded == LoadBestOfferContext::INITIAL_BATCH_SIZE);
+
+    // Take every offer, best first, the way convertWithOffers does.
+    size_t taken = 0;
+    Price last{0, 1};
+    while (auto offer = context.loadBestOffer())
+    {
+        REQUIRE(offer->getPrice() >= last);
+        last = offer->getPrice();
+        offer->storeDelete(delta, db);
+        context.eraseAndUpdate();
+        ++taken;
+    }
+    REQUIRE(taken == numOffers);
+
+    // Batches of 5, 10, 20 and then 40 (short, so the book is known to be
+    // exhausted): each offer is read exactly once.
+    REQUIRE(loaded == numOffers);
+}
+
+TEST_CASE("best offer batches prefetch their sellers", "[tx][offers]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto& lm = app->getLedgerManager();
+    auto& db = app->getDatabase();
+    app->start();
+
+    int64_t txfee = lm.getTxFee();
+    auto root = TestAccount::createRoot(*app);
+    auto issuer = root.create("issuer", lm.getMinBalance(0) + 100 * txfee);
+    auto cur1 = issuer.asset("CUR1");
+    auto cur2 = issuer.asset("CUR2");
+
+    std::vector<TestAccount> sellers;
+    for (int i = 0; i < 3; ++i)
+    {
+        sellers.emplace_back(root.create("seller" + std::to_string(i),
+                                         lm.getMinBalance(3) + 100 * txfee));
+        auto& seller = sellers.back();
+        seller.changeTrust(cur1, 1000);
+        seller.changeTrust(cur2, 1000);
+        issuer.pay(seller, cur1, 100);
+        seller.manageOffer(0, cur1, cur2, Price{1, 1}, 100);
+    }
+
+    auto& cache = db.getEntryCache();
+    cache.clear();
+    size_t loaded = 0;
+    LoadBestOfferContext context(db, cur1, cur2, loaded);
+    REQUIRE(loaded == sellers.size());
+
+    for (auto const& seller : sellers)
+    {
+        LedgerKey account;
+        account.type(ACCOUNT);
+        account.account().accountID = seller.getPublicKey();
+        REQUIRE(cache.contains(account));
+        for (auto const& asset : {cur1, cur2})
+        {
+            LedgerKey line;
+            line.type(TRUSTLINE);
+            line.trustLine().accountID = seller.getPublicKey();
+            line.trustLine().asset = asset;
+            REQUIRE(cache.contains(line));
+        }
+    }
+
+    // the issuer has no trustline for its own assets to prefetch
+    LedgerKey issuerAccount;
+    issuerAccount.type(ACCOUNT);
+    issuerAccount.account().accountID = issuer.getPublicKey();
+    REQUIRE(!cache.contains(issuerAccount));
+}
@@ -6,8 +6,10 @@
 #include "OperationFrame.h"
 #include "database/Database.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "transactions/AllowTrustOpFrame.h"
+#include "transactions/ApplyCostModel.h"
 #include "transactions/BumpSequenceOpFrame.h"
 #include "transactions/ChangeTrustOpFrame.h"
 #include "transactions/CreateAccountOpFrame.h"
@@ -16,6 +18,7 @@
 #include "transactions/ManageDataOpFrame.h"
 #include "transactions/ManageOfferOpFrame.h"
 #include "transactions/MergeOpFrame.h"
+#include "transactions/OperationMetrics.h"
 #include "transactions/PathPaymentOpFrame.h"
 #include "transactions/PaymentOpFrame.h"
 #include "transactions/SetOptionsOpFrame.h"
@@ -26,6 +29,7 @@
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
 namespace stellar
 {
@@ -52,6 +56,40 @@ getNeededThreshold(AccountFrame const& account, ThresholdLevel const level)
 }
 }
 
+std::string
+OperationFrame::getMetricsDomain(OperationType type)
+{
+    switch (type)
+    {
+    case CREATE_ACCOUNT:
+        return "op-create-account";
+    case PAYMENT:
+        return "op-payment";
+    case PATH_PAYMENT:
+        return "op-path-payment";
+    case MANAGE_OFFER:
+        return "op-manage-offer";
+    case CREATE_PASSIVE_OFFER:
+        return "op-create-passive-offer";
+    case SET_OPTIONS:
+        return "op-set-options";
+    case CHANGE_TRUST:
+        return "op-change-trust";
+    case ALLOW_TRUST:
+        return "op-allow-trust";
+    case ACCOUNT_MERGE:
+        return "op-merge";
+    case INFLATION:
+        return "op-inflation";
+    case MANAGE_DATA:
+        return "op-manage-data";
+    case BUMP_SEQUENCE:
+        return "op-bump-sequence";
+    default:
+        throw std::invalid_argument("unknown operation type");
+    }
+}
+
 shared_ptr<OperationFrame>
 OperationFrame::makeHelper(Operation const& op, OperationResult& res,
                            TransactionFrame& tx)
@@ -99,16 +137,38 @@ bool
 OperationFrame::apply(SignatureChecker& signatureChecker, LedgerDelta& delta,
                       Application& app)
 {
+    auto type = mOperation.body.type();
+    auto& metrics = app.getLedgerManager().getOperationMetrics().get(type);
+    auto& db = app.getDatabase();
+    auto reads = db.getReadQueryCount();
+    auto writes = db.getWriteQueryCount();
+
     bool res;
-    res = checkValid(signatureChecker, app, &delta);
-    if (res)
     {
-        res = doApply(app, delta, app.getLedgerManager());
+        auto timer = metrics.mApplyTime.TimeScope();
+        res = checkValid(signatureChecker, app, &delta);
+        if (res)
+        {
+            res = doApply(app, delta, app.getLedgerManager());
+        }
+        app.getLedgerManager().getApplyCostModel().record(
+            type, std::chrono::nanoseconds(timer.Stop()));
     }
 
+    metrics.mSQLReads.Mark(db.getReadQueryCount() - reads);
+    metrics.mSQLWrites.Mark(db.getWriteQueryCount() - writes);
     return res;
 }
 
+void
+OperationFrame::markSuccess(Application& app) const
+{
+    app.getLedgerManager()
+        .getOperationMetrics()
+        .get(mOperation.body.type())
+        .mSuccess.Mark();
+}
+
 ThresholdLevel
 OperationFrame::getThresholdLevel() const
 {
@@ -185,6 +245,48 @@ OperationFrame::loadAccount(int ledgerProtocolVersion, LedgerDelta* delta,
     return !!mSourceAccount;
 }
 
+void
+OperationFrame::insertAccountKey(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys,
+    AccountID const& accountID)
+{
+    LedgerKey key;
+    key.type(ACCOUNT);
+    key.account().accountID = accountID;
+    keys.emplace(key);
+}
+
+void
+OperationFrame::insertTrustLineKey(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys,
+    AccountID const& accountID, Asset const& asset)
+{
+    if (asset.type() == ASSET_TYPE_NATIVE || getIssuer(asset) == accountID)
+    {
+        return;
+    }
+    LedgerKey key;
+    key.type(TRUSTLINE);
+    key.trustLine().accountID = accountID;
+    key.trustLine().asset = asset;
+    keys.emplace(key);
+}
+
+void
+OperationFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    insertAccountKey(keys, getSourceID());
+}
+
+bool
+OperationFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    insertLedgerKeysToPrefetch(keys);
+    return true;
+}
+
 OperationResultCode
 OperationFrame::getResultCode() const
 {
@@ -48,7 +48,22 @@ class OperationFrame
     // returns true if the operation is supported given a protocol version
     virtual bool isVersionSupported(uint32_t protocolVersion) const;
 
+    static void
+    insertAccountKey(std::unordered_set<LedgerKey, LedgerKeyHash>& keys,
+                     AccountID const& accountID);
+    // Skips the native asset and an issuer's own asset, which have no
+    // trustline in the database.
+    static void
+    insertTrustLineKey(std::unordered_set<LedgerKey, LedgerKeyHash>& keys,
+                       AccountID const& accountID, Asset const& asset);
+
+    // Marks the {"op-...", "success", "apply"} meter of this operation's type.
+    void markSuccess(Application& app) const;
+
   public:
+    // Domain of the metrics of operations of `type`, eg. "op-payment".
+    static std::string getMetricsDomain(OperationType type);
+
     static std::shared_ptr<OperationFrame>
     makeHelper(Operation const& op, OperationResult& res,
                TransactionFrame& parentTx);
@@ -95,6 +110,20 @@ class OperationFrame
     bool apply(SignatureChecker& signatureChecker, LedgerDelta& delta,
                Application& app);
 
+    // Adds the keys of the entries this operation is expected to load when
+    // applied, so that they can be prefetched. Defaults to the source
+    // account.
+    virtual void insertLedgerKeysToPrefetch(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const;
+
+    // Adds the keys of every entry this operation may read or write when
+    // applied. Returns false if that set cannot be known before applying
+    // (crossing offers, inflation). Defaults to the prefetch keys, which
+    // suffice for operations whose other entries are all subentries of
+    // accounts already among them.
+    virtual bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const;
+
     Operation const&
     getOperation() const
     {
@@ -0,0 +1,79 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/OperationMetrics.h"
+#include "transactions/OperationFrame.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+namespace stellar
+{
+
+namespace
+{
+char const*
+getEntryMetricsName(LedgerEntryType type)
+{
+    switch (type)
+    {
+    case ACCOUNT:
+        return "account";
+    case TRUSTLINE:
+        return "trust";
+    case OFFER:
+        return "offer";
+    case DATA:
+        return "data";
+    default:
+        throw std::invalid_argument("unknown ledger entry type");
+    }
+}
+}
+
+OperationMetrics::OperationMetrics(medida::MetricsRegistry& registry)
+    : mOperationApply(registry.NewTimer({"transaction", "op", "apply"}))
+{
+    for (auto t : xdr::xdr_traits<OperationType>::enum_values())
+    {
+        auto type = static_cast<OperationType>(t);
+        auto domain = OperationFrame::getMetricsDomain(type);
+        // both kinds of offers are counted together
+        auto successDomain =
+            type == MANAGE_OFFER || type == CREATE_PASSIVE_OFFER
+                ? std::string("op-create-offer")
+                : domain;
+        mTypes.emplace(
+            type,
+            Type{registry.NewTimer({domain, "apply", "time"}),
+                 registry.NewMeter({domain, "apply", "sql-read"}, "query"),
+                 registry.NewMeter({domain, "apply", "sql-write"}, "query"),
+                 registry.NewMeter({successDomain, "success", "apply"},
+                                   "operation")});
+    }
+    for (auto t : xdr::xdr_traits<LedgerEntryType>::enum_values())
+    {
+        auto type = static_cast<LedgerEntryType>(t);
+        std::string name = getEntryMetricsName(type);
+        mEntries.emplace(
+            type,
+            Entry{registry.NewMeter({"ledger", name, "add"}, "entry"),
+                  registry.NewMeter({"ledger", name, "modify"}, "entry"),
+                  registry.NewMeter({"ledger", name, "delete"}, "entry")});
+    }
+}
+
+OperationMetrics::Type&
+OperationMetrics::get(OperationType type)
+{
+    return mTypes.at(type);
+}
+
+OperationMetrics::Entry&
+OperationMetrics::get(LedgerEntryType type)
+{
+    return mEntries.at(type);
+}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdr/Stellar-ledger-entries.h"
+#include "xdr/Stellar-transaction.h"
+
+#include <map>
+
+namespace medida
+{
+class Meter;
+class MetricsRegistry;
+class Timer;
+}
+
+namespace stellar
+{
+
+/**
+ * The metrics updated for every operation applied and every ledger entry
+ * changed, looked up in the registry once, when the LedgerManager is
+ * created, rather than by name (under the registry's lock) every time.
+ *
+ * Metrics only updated on rarer paths, such as failures, are still looked
+ * up where they are marked.
+ */
+class OperationMetrics
+{
+  public:
+    struct Type
+    {
+        // {"op-...", "apply", "time"}
+        medida::Timer& mApplyTime;
+        // {"op-...", "apply", "sql-read" / "sql-write"}
+        medida::Meter& mSQLReads;
+        medida::Meter& mSQLWrites;
+        // {"op-...", "success", "apply"}
+        medida::Meter& mSuccess;
+    };
+
+    struct Entry
+    {
+        // {"ledger", "account" / "trust" / ..., "add" / "modify" / "delete"}
+        medida::Meter& mAdd;
+        medida::Meter& mModify;
+        medida::Meter& mDelete;
+    };
+
+    explicit OperationMetrics(medida::MetricsRegistry& registry);
+
+    Type& get(OperationType type);
+    Entry& get(LedgerEntryType type);
+
+    // {"transaction", "op", "apply"}
+    medida::Timer& mOperationApply;
+
+  private:
+    std::map<OperationType, Type> mTypes;
+    std::map<LedgerEntryType, Entry> mEntries;
+};
+}
@@ -14,6 +14,7 @@
 #include <algorithm>
 
 #include "main/Application.h"
+#include "medida/histogram.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 
@@ -203,6 +204,9 @@ PathPaymentOpFrame::doApply(Application& app, LedgerDelta& delta,
             });
 
         assert(curASent >= 0);
+        // one sample per book crossed along the path
+        metrics.NewHistogram({"op-path-payment", "offers", "loaded"})
+            .Update(static_cast<int64_t>(oe.getOffersLoaded()));
 
         switch (r)
         {
@@ -343,9 +347,7 @@ PathPaymentOpFrame::doApply(Application& app, LedgerDelta& delta,
         sourceLineFrame->storeChange(delta, db);
     }
 
-    app.getMetrics()
-        .NewMeter({"op-path-payment", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
 
     return true;
 }
@@ -384,4 +386,32 @@ PathPaymentOpFrame::doCheckValid(Application& app)
     }
     return true;
 }
+
+void
+PathPaymentOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    insertAccountKey(keys, mPathPayment.destination);
+    insertTrustLineKey(keys, getSourceID(), mPathPayment.sendAsset);
+    insertTrustLineKey(keys, mPathPayment.destination, mPathPayment.destAsset);
+}
+
+bool
+PathPaymentOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    // Anything that converts between assets crosses offers.
+    if (!mPathPayment.path.empty() ||
+        !(mPathPayment.sendAsset == mPathPayment.destAsset))
+    {
+        return false;
+    }
+    insertLedgerKeysToPrefetch(keys);
+    if (mPathPayment.destAsset.type() != ASSET_TYPE_NATIVE)
+    {
+        insertAccountKey(keys, getIssuer(mPathPayment.destAsset));
+    }
+    return true;
+}
 }
@@ -3,6 +3,8 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "lib/catch.hpp"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "test/TestAccount.h"
 #include "test/TestExceptions.h"
 #include "test/TestMarket.h"
@@ -1206,6 +1208,55 @@ TEST_CASE("pathpayment", "[tx][pathpayment]")
         });
     }
 
+    SECTION("failed path payments keep the order books loaded")
+    {
+        auto& loads = app->getMetrics().NewMeter(
+            {"ledger", "order-book", "load"}, "query");
+        auto market = TestMarket{*app};
+        auto source = root.create("source", minBalance4);
+        auto destination = root.create("destination", minBalance1);
+        auto mm12 = root.create("mm12", minBalance3);
+        auto mm23 = root.create("mm23", minBalance3);
+
+        source.changeTrust(cur1, 200);
+        mm12.changeTrust(cur1, 200);
+        mm12.changeTrust(cur2, 200);
+        mm23.changeTrust(cur2, 200);
+        mm23.changeTrust(cur3, 200);
+        destination.changeTrust(cur3, 200);
+
+        gateway.pay(source, cur1, 80);
+        gateway.pay(mm12, cur2, 40);
+        gateway2.pay(mm23, cur3, 20);
+
+        market.requireChangesWithOffer({}, [&] {
+            return market.addOffer(mm12, {cur2, cur1, Price{2, 1}, 40});
+        });
+        market.requireChangesWithOffer({}, [&] {
+            return market.addOffer(mm23, {cur3, cur2, Price{2, 1}, 20});
+        });
+
+        REQUIRE_THROWS_AS(
+            source.pay(destination, cur1, 10, cur3, 10, {cur2}),
+            ex_PATH_PAYMENT_OVER_SENDMAX);
+        auto loaded = loads.count();
+        REQUIRE_THROWS_AS(
+            source.pay(destination, cur1, 10, cur3, 10, {cur2}),
+            ex_PATH_PAYMENT_OVER_SENDMAX);
+        REQUIRE(loads.count() == loaded);
+
+        // the books are still right
+        source.pay(destination, cur1, 40, cur3, 10, {cur2});
+        REQUIRE(loads.count() == loaded);
+        // clang-format off
+        market.requireBalances(
+            {{source, {{cur1, 40}, {cur2, 0}, {cur3, 0}}},
+             {mm12, {{cur1, 40}, {cur2, 20}, {cur3, 0}}},
+             {mm23, {{cur1, 0}, {cur2, 20}, {cur3, 10}}},
+             {destination, {{cur1, 0}, {cur2, 0}, {cur3, 10}}}});
+        // clang-format on
+    }
+
     SECTION("path payment to self XLM")
     {
         auto market = TestMarket{*app};
@@ -41,9 +41,7 @@ PaymentOpFrame::doApply(Application& app, LedgerDelta& delta,
                               : mPayment.destination == getSourceID();
     if (instantSuccess)
     {
-        app.getMetrics()
-            .NewMeter({"op-payment", "success", "apply"}, "operation")
-            .Mark();
+        markSuccess(app);
         innerResult().code(PAYMENT_SUCCESS);
         return true;
     }
@@ -140,9 +138,7 @@ PaymentOpFrame::doApply(Application& app, LedgerDelta& delta,
     assert(PathPaymentOpFrame::getInnerCode(ppayment.getResult()) ==
            PATH_PAYMENT_SUCCESS);
 
-    app.getMetrics()
-        .NewMeter({"op-payment", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     innerResult().code(PAYMENT_SUCCESS);
 
     return true;
@@ -171,4 +167,26 @@ PaymentOpFrame::doCheckValid(Application& app)
     }
     return true;
 }
+
+void
+PaymentOpFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    OperationFrame::insertLedgerKeysToPrefetch(keys);
+    insertAccountKey(keys, mPayment.destination);
+    insertTrustLineKey(keys, getSourceID(), mPayment.asset);
+    insertTrustLineKey(keys, mPayment.destination, mPayment.asset);
+}
+
+bool
+PaymentOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    insertLedgerKeysToPrefetch(keys);
+    if (mPayment.asset.type() != ASSET_TYPE_NATIVE)
+    {
+        insertAccountKey(keys, getIssuer(mPayment.asset));
+    }
+    return true;
+}
 }
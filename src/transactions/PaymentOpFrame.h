@@ -25,6 +25,10 @@ class PaymentOpFrame : public OperationFrame
     bool doApply(Application& app, LedgerDelta& delta,
                  LedgerManager& ledgerManager) override;
     bool doCheckValid(Application& app) override;
+    void insertLedgerKeysToPrefetch(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const override;
 
     static PaymentResultCode
     getInnerCode(OperationResult const& res)
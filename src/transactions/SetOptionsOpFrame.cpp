@@ -179,9 +179,7 @@ SetOptionsOpFrame::doApply(Application& app, LedgerDelta& delta,
         mSourceAccount->setUpdateSigners();
     }
 
-    app.getMetrics()
-        .NewMeter({"op-set-options", "success", "apply"}, "operation")
-        .Mark();
+    markSuccess(app);
     innerResult().code(SET_OPTIONS_SUCCESS);
     mSourceAccount->storeChange(delta, db);
     return true;
@@ -320,4 +318,16 @@ SetOptionsOpFrame::doCheckValid(Application& app)
 
     return true;
 }
+
+bool
+SetOptionsOpFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    insertLedgerKeysToPrefetch(keys);
+    if (mSetOptions.inflationDest)
+    {
+        insertAccountKey(keys, *mSetOptions.inflationDest);
+    }
+    return true;
+}
 }
@@ -25,6 +25,8 @@ class SetOptionsOpFrame : public OperationFrame
     bool doApply(Application& app, LedgerDelta& delta,
                  LedgerManager& ledgerManager) override;
     bool doCheckValid(Application& app) override;
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const override;
 
     static SetOptionsResultCode
     getInnerCode(OperationResult const& res)
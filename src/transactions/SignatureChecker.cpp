@@ -12,6 +12,8 @@
 #include "util/Algoritm.h"
 #include "util/XDROperators.h"
 
+#include <algorithm>
+
 namespace stellar
 {
 
@@ -23,6 +25,41 @@ SignatureChecker::SignatureChecker(
     , mSignatures{signatures}
 {
     mUsedSignatures.resize(mSignatures.size());
+    mVerified.resize(mSignatures.size());
+    for (auto const& sig : mSignatures)
+    {
+        mHints.push_back(sig.hint);
+    }
+    std::sort(mHints.begin(), mHints.end());
+}
+
+bool
+SignatureChecker::isHinted(SignerKey const& key) const
+{
+    auto hint = key.type() == SIGNER_KEY_TYPE_HASH_X
+                    ? SignatureUtils::getHint(key.hashX())
+                    : SignatureUtils::getHint(key.ed25519());
+    return std::binary_search(mHints.begin(), mHints.end(), hint);
+}
+
+bool
+SignatureChecker::verify(size_t i, Signer const& signer)
+{
+    auto& verified = mVerified[i];
+    for (auto const& v : verified)
+    {
+        if (v.first == signer.key)
+        {
+            return v.second;
+        }
+    }
+
+    auto const& sig = mSignatures[i];
+    bool res = signer.key.type() == SIGNER_KEY_TYPE_HASH_X
+                   ? SignatureUtils::verifyHashX(sig, signer.key)
+                   : SignatureUtils::verify(sig, signer.key, mContentsHash);
+    verified.emplace_back(signer.key, res);
+    return res;
 }
 
 bool
@@ -62,17 +99,20 @@ SignatureChecker::checkSignature(AccountID const& accountID,
         }
     }
 
-    using VerifyT =
-        std::function<bool(DecoratedSignature const&, Signer const&)>;
-    auto verifyAll = [&](std::vector<Signer>& signers, VerifyT verify) {
-        for (size_t i = 0; i < mSignatures.size(); i++)
-        {
-            auto const& sig = mSignatures[i];
+    auto verifyAll = [&](std::vector<Signer>& signers) {
+        // a signature matches a signer only if it has its hint
+        signers.erase(std::remove_if(signers.begin(), signers.end(),
+                                     [&](Signer const& s) {
+                                         return !isHinted(s.key);
+                                     }),
+                      signers.end());
 
+        for (size_t i = 0; i < mSignatures.size() && !signers.empty(); i++)
+        {
             for (auto it = signers.begin(); it != signers.end(); ++it)
             {
                 auto& signerKey = *it;
-                if (verify(sig, signerKey))
+                if (verify(i, signerKey))
                 {
                     mUsedSignatures[i] = true;
                     auto w = signerKey.weight;
@@ -93,21 +133,13 @@ SignatureChecker::checkSignature(AccountID const& accountID,
         return false;
     };
 
-    auto verified =
-        verifyAll(signers[SIGNER_KEY_TYPE_HASH_X],
-                  [&](DecoratedSignature const& sig, Signer const& signerKey) {
-                      return SignatureUtils::verifyHashX(sig, signerKey.key);
-                  });
+    auto verified = verifyAll(signers[SIGNER_KEY_TYPE_HASH_X]);
     if (verified)
     {
         return true;
     }
 
-    verified = verifyAll(
-        signers[SIGNER_KEY_TYPE_ED25519],
-        [&](DecoratedSignature const& sig, Signer const& signerKey) {
-            return SignatureUtils::verify(sig, signerKey.key, mContentsHash);
-        });
+    verified = verifyAll(signers[SIGNER_KEY_TYPE_ED25519]);
     if (verified)
     {
         return true;
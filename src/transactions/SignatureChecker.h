@@ -18,6 +18,16 @@ namespace stellar
 
 using UsedOneTimeSignerKeys = std::map<AccountID, std::set<SignerKey>>;
 
+/**
+ * Checks the signatures of a transaction against the signers of the accounts
+ * it uses, for the transaction and each of its operations.
+ *
+ * The hints of the signatures are indexed once, so that the signers of an
+ * account none of them can be from are skipped without a look at each
+ * signature; and the outcome of verifying a signature against a signer is
+ * kept for the other operations of the transaction, which often check the
+ * same account.
+ */
 class SignatureChecker
 {
   public:
@@ -39,5 +49,15 @@ class SignatureChecker
 
     std::vector<bool> mUsedSignatures;
     UsedOneTimeSignerKeys mUsedOneTimeSignerKeys;
+
+    // the hints of mSignatures, sorted
+    std::vector<SignatureHint> mHints;
+    // by signature, the signers it was verified against, and the outcome
+    std::vector<std::vector<std::pair<SignerKey, bool>>> mVerified;
+
+    // Whether some signature has the hint of `key`.
+    bool isHinted(SignerKey const& key) const;
+    // Verifies signature `i` against `signer`, an ed25519 or hash(x) key.
+    bool verify(size_t i, Signer const& signer);
 };
 };
@@ -14,6 +14,7 @@
 #include "invariant/InvariantManager.h"
 #include "ledger/LedgerDelta.h"
 #include "main/Application.h"
+#include "transactions/OperationMetrics.h"
 #include "transactions/SignatureChecker.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Algoritm.h"
@@ -21,6 +22,7 @@
 #include "util/Logging.h"
 #include "util/XDROperators.h"
 #include "util/XDRStream.h"
+#include "lib/util/format.h"
 #include "xdrpp/marshal.h"
 #include <string>
 
@@ -29,6 +31,7 @@
 
 #include <algorithm>
 #include <numeric>
+#include <unordered_set>
 
 namespace stellar
 {
@@ -37,9 +40,12 @@ using namespace std;
 
 TransactionFramePtr
 TransactionFrame::makeTransactionFromWire(Hash const& networkID,
-                                          TransactionEnvelope const& msg)
+                                          TransactionEnvelope const& msg,
+                                          ByteSlice const& envelopeBytes)
 {
     TransactionFramePtr res = make_shared<TransactionFrame>(networkID, msg);
+    // decoding XDR is strict, so encoding `msg` would give these bytes back
+    res->mEnvelopeBytes.assign(envelopeBytes.begin(), envelopeBytes.end());
     return res;
 }
 
@@ -54,7 +60,7 @@ TransactionFrame::getFullHash() const
 {
     if (isZero(mFullHash))
     {
-        mFullHash = sha256(xdr::xdr_to_opaque(mEnvelope));
+        mFullHash = sha256(getEnvelopeBytes());
     }
     return (mFullHash);
 }
@@ -64,18 +70,67 @@ TransactionFrame::getContentsHash() const
 {
     if (isZero(mContentsHash))
     {
-        mContentsHash = sha256(
-            xdr::xdr_to_opaque(mNetworkID, ENVELOPE_TYPE_TX, mEnvelope.tx));
+        mContentsHash = sha256(getContentsHashInput());
     }
     return (mContentsHash);
 }
 
+xdr::opaque_vec<> const&
+TransactionFrame::getEnvelopeBytes() const
+{
+    if (mEnvelopeBytes.empty())
+    {
+        mEnvelopeBytes = xdr::xdr_to_opaque(mEnvelope);
+    }
+    return mEnvelopeBytes;
+}
+
+xdr::opaque_vec<>
+TransactionFrame::getContentsHashInput() const
+{
+    auto const& envelope = getEnvelopeBytes();
+    auto txSize = envelope.size() - xdr::xdr_size(mEnvelope.signatures);
+    auto res = xdr::xdr_to_opaque(mNetworkID, ENVELOPE_TYPE_TX);
+    res.insert(res.end(), envelope.begin(), envelope.begin() + txSize);
+    return res;
+}
+
+void
+TransactionFrame::computeHashes(std::vector<TransactionFramePtr> const& txs)
+{
+    std::vector<TransactionFrame*> todo;
+    std::vector<xdr::opaque_vec<>> bodies;
+    for (auto const& tx : txs)
+    {
+        if (isZero(tx->mFullHash) || isZero(tx->mContentsHash))
+        {
+            todo.push_back(tx.get());
+            bodies.emplace_back(tx->getContentsHashInput());
+        }
+    }
+    std::vector<ByteSlice> bins;
+    bins.reserve(2 * todo.size());
+    for (size_t i = 0; i < todo.size(); ++i)
+    {
+        auto const& envelope = todo[i]->mEnvelopeBytes;
+        bins.emplace_back(envelope.data(), envelope.size());
+        bins.emplace_back(bodies[i].data(), bodies[i].size());
+    }
+    auto hashes = sha256Many(bins);
+    for (size_t i = 0; i < todo.size(); ++i)
+    {
+        todo[i]->mFullHash = hashes[2 * i];
+        todo[i]->mContentsHash = hashes[2 * i + 1];
+    }
+}
+
 void
 TransactionFrame::clearCached()
 {
     Hash zero;
     mContentsHash = zero;
     mFullHash = zero;
+    mEnvelopeBytes.clear();
 }
 
 TransactionResultPair
@@ -124,6 +179,38 @@ TransactionFrame::getMinFee(LedgerManager const& lm) const
     return lm.getTxFee() * count;
 }
 
+void
+TransactionFrame::insertLedgerKeysToPrefetch(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    LedgerKey key;
+    key.type(ACCOUNT);
+    key.account().accountID = getSourceID();
+    keys.emplace(key);
+    for (auto const& op : mOperations)
+    {
+        op->insertLedgerKeysToPrefetch(keys);
+    }
+}
+
+bool
+TransactionFrame::insertLedgerKeysToFootprint(
+    std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const
+{
+    LedgerKey key;
+    key.type(ACCOUNT);
+    key.account().accountID = getSourceID();
+    keys.emplace(key);
+    for (auto const& op : mOperations)
+    {
+        if (!op->insertLedgerKeysToFootprint(keys))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void
 TransactionFrame::addSignature(SecretKey const& secretKey)
 {
@@ -154,6 +241,71 @@ TransactionFrame::checkSignature(SignatureChecker& signatureChecker,
                                            neededWeight);
 }
 
+std::unordered_set<AccountID>
+TransactionFrame::getSourceIDs() const
+{
+    std::unordered_set<AccountID> accountIDs{getSourceID()};
+    for (auto const& op : mOperations)
+    {
+        accountIDs.emplace(op->getSourceID());
+    }
+    return accountIDs;
+}
+
+void
+TransactionFrame::addSignatureVerifications(
+    std::unordered_set<PublicKey> const& keys,
+    std::vector<PubKeyUtils::SigVerification>& sigs) const
+{
+    auto const& contentsHash = getContentsHash();
+    for (auto const& sig : mEnvelope.signatures)
+    {
+        for (auto const& key : keys)
+        {
+            if (SignatureUtils::doesHintMatch(key.ed25519(), sig.hint))
+            {
+                sigs.push_back({key, sig.signature, contentsHash});
+            }
+        }
+    }
+}
+
+void
+TransactionFrame::addMasterKeySignatureVerifications(
+    std::vector<PubKeyUtils::SigVerification>& sigs) const
+{
+    auto accountIDs = getSourceIDs();
+    std::unordered_set<PublicKey> keys(accountIDs.begin(), accountIDs.end());
+    addSignatureVerifications(keys, sigs);
+}
+
+void
+TransactionFrame::addSignatureVerifications(
+    Database& db, std::vector<PubKeyUtils::SigVerification>& sigs) const
+{
+    std::unordered_set<PublicKey> keys;
+    for (auto const& id : getSourceIDs())
+    {
+        auto account = AccountFrame::loadAccount(id, db);
+        if (!account)
+        {
+            continue;
+        }
+        if (account->getAccount().thresholds[0])
+        {
+            keys.emplace(id);
+        }
+        for (auto const& s : account->getAccount().signers)
+        {
+            if (s.key.type() == SIGNER_KEY_TYPE_ED25519)
+            {
+                keys.emplace(KeyUtils::convertKey<PublicKey>(s.key));
+            }
+        }
+    }
+    addSignatureVerifications(keys, sigs);
+}
+
 AccountFrame::pointer
 TransactionFrame::loadAccount(int ledgerProtocolVersion, LedgerDelta* delta,
                               Database& db, AccountID const& accountID)
@@ -400,17 +552,33 @@ TransactionFrame::commonValid(SignatureChecker& signatureChecker,
 void
 TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
                                    LedgerManager& ledgerManager)
+{
+    AccountFrame::pointer sourceAccount;
+    processFeeSeqNum(delta, ledgerManager, sourceAccount);
+    sourceAccount->storeChange(delta, ledgerManager.getDatabase());
+}
+
+void
+TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
+                                   LedgerManager& ledgerManager,
+                                   AccountFrame::pointer& sourceAccount)
 {
     resetSigningAccount();
     resetResults();
 
-    if (!loadAccount(ledgerManager.getCurrentLedgerVersion(), &delta,
-                     ledgerManager.getDatabase()))
+    if (sourceAccount)
+    {
+        // a copy, as before protocol 8 the signing account is reused when
+        // applying the transaction
+        mSigningAccount = makePooled<AccountFrame>(*sourceAccount);
+        delta.recordEntry(*mSigningAccount);
+    }
+    else if (!loadAccount(ledgerManager.getCurrentLedgerVersion(), &delta,
+                          ledgerManager.getDatabase()))
     {
         throw std::runtime_error("Unexpected database state");
     }
 
-    Database& db = ledgerManager.getDatabase();
     int64_t& fee = getResult().feeCharged;
 
     if (fee > 0)
@@ -433,7 +601,9 @@ TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
         }
         mSigningAccount->setSeqNum(mEnvelope.tx.seqNum);
     }
-    mSigningAccount->storeChange(delta, db);
+    mSigningAccount->touch(delta);
+    delta.modEntry(*mSigningAccount);
+    sourceAccount = mSigningAccount;
 }
 
 void
@@ -582,8 +752,9 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
         soci::transaction sqlTx(app.getDatabase().getSession());
         LedgerDelta thisTxOpsDelta(delta);
 
-        auto& opTimer =
-            app.getMetrics().NewTimer({"transaction", "op", "apply"});
+        auto& opTimer = app.getLedgerManager()
+                            .getOperationMetrics()
+                            .mOperationApply;
 
         for (auto& op : mOperations)
         {
@@ -600,7 +771,10 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
                 app.getInvariantManager().checkOnOperationApply(
                     op->getOperation(), op->getResult(), opDelta);
             }
-            meta.operations.emplace_back(opDelta.getChanges());
+            if (!app.getConfig().DISABLE_TX_META)
+            {
+                meta.operations.emplace_back(opDelta.getChanges());
+            }
             opDelta.commit();
         }
 
@@ -622,6 +796,7 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
                                             app.getLedgerManager());
             }
 
+            app.getInvariantManager().addAppliedOperations(thisTxOpsDelta);
             sqlTx.commit();
             thisTxOpsDelta.commit();
         }
@@ -659,7 +834,10 @@ TransactionFrame::apply(LedgerDelta& delta, TransactionMetaV1& meta,
         auto signaturesValid =
             cv >= (ValidationType::kInvalidPostAuth) &&
             processSignatures(signatureChecker, app, txDelta);
-        meta.txChanges = txDelta.getChanges();
+        if (!app.getConfig().DISABLE_TX_META)
+        {
+            meta.txChanges = txDelta.getChanges();
+        }
         txDelta.commit();
         valid = signaturesValid && (cv == ValidationType::kFullyValid);
     }
@@ -675,87 +853,109 @@ TransactionFrame::toStellarMessage() const
     return msg;
 }
 
-void
-TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
-                                   TransactionMeta& tm, int txindex,
-                                   TransactionResultSet& resultSet) const
+xdr::opaque_vec<>
+TransactionFrame::toStellarMessageBytes() const
 {
-    auto txBytes(xdr::xdr_to_opaque(mEnvelope));
-
-    resultSet.results.emplace_back(getResultPair());
-    auto txResultBytes(xdr::xdr_to_opaque(resultSet.results.back()));
-
-    std::string txBody;
-    txBody = decoder::encode_b64(txBytes);
-
-    std::string txResult;
-    txResult = decoder::encode_b64(txResultBytes);
-
-    xdr::opaque_vec<> txMeta(xdr::xdr_to_opaque(tm));
-
-    std::string meta;
-    meta = decoder::encode_b64(txMeta);
-
-    string txIDString(binToHex(getContentsHash()));
+    auto const& envelope = getEnvelopeBytes();
+    auto res = xdr::xdr_to_opaque(TRANSACTION);
+    res.insert(res.end(), envelope.begin(), envelope.end());
+    return res;
+}
 
-    auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txhistory "
-        "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
-        "(:id,  :seq,      :txindex, :txb,   :txres,   :meta)");
+namespace
+{
+// txhistory and txfeehistory values, see Database::isTxHistoryBinary
+std::string
+encodeHistoryValue(bool binary, xdr::opaque_vec<> const& value)
+{
+    // postgres reads BYTEA from its hex text form
+    return binary ? "\\x" + binToHex(value) : decoder::encode_b64(value);
+}
 
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txBody));
-    st.exchange(soci::use(txResult));
-    st.exchange(soci::use(meta));
-    st.define_and_bind();
+void
+decodeHistoryValue(bool binary, std::string const& value,
+                   std::vector<uint8_t>& res)
+{
+    if (binary)
     {
-        auto timer = db.getInsertTimer("txhistory");
-        st.execute(true);
+        res = hexToBin(value.substr(2));
     }
-
-    if (st.get_affected_rows() != 1)
+    else
     {
-        throw std::runtime_error("Could not update data in SQL");
+        decoder::decode_b64(value, res);
     }
 }
 
 void
-TransactionFrame::storeTransactionFee(LedgerManager& ledgerManager,
-                                      LedgerEntryChanges const& changes,
-                                      int txindex) const
+insertHistoryRows(Database& db, std::string const& tableName,
+                  std::vector<std::string> const& valueColumns,
+                  std::vector<TransactionHistoryRows::Row> const& rows)
 {
-    xdr::opaque_vec<> txChanges(xdr::xdr_to_opaque(changes));
-
-    std::string txChanges64;
-    txChanges64 = decoder::encode_b64(txChanges);
-
-    string txIDString(binToHex(getContentsHash()));
-
-    auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txfeehistory "
-        "( txid, ledgerseq, txindex,  txchanges) VALUES "
-        "(:id,  :seq,      :txindex, :txchanges)");
-
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txChanges64));
-    st.define_and_bind();
+    bool binary = db.isTxHistoryBinary();
+    std::vector<DatabaseUtils::BulkColumn> columns;
+    columns.emplace_back("txid", "TEXT");
+    columns.emplace_back("ledgerseq", "INT");
+    columns.emplace_back("txindex", "INT");
+    for (auto const& c : valueColumns)
     {
-        auto timer = db.getInsertTimer("txfeehistory");
-        st.execute(true);
+        columns.emplace_back(c, binary ? "BYTEA" : "TEXT");
     }
-
-    if (st.get_affected_rows() != 1)
+    for (auto const& row : rows)
     {
-        throw std::runtime_error("Could not update data in SQL");
+        assert(row.mValues.size() == valueColumns.size());
+        columns[0].push(row.mTxID);
+        columns[1].push(std::to_string(row.mLedgerSeq));
+        columns[2].push(std::to_string(row.mTxIndex));
+        for (size_t i = 0; i < row.mValues.size(); ++i)
+        {
+            columns[3 + i].push(encodeHistoryValue(binary, row.mValues[i]));
+        }
     }
+    DatabaseUtils::bulkInsert(db, tableName, tableName, columns);
+}
+}
+
+void
+TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
+                                   TransactionMeta& tm, int txindex,
+                                   TransactionResultSet& resultSet,
+                                   TransactionHistoryRows& rows) const
+{
+    resultSet.results.emplace_back(getResultPair());
+
+    TransactionHistoryRows::Row row;
+    row.mTxID = binToHex(getContentsHash());
+    row.mLedgerSeq = ledgerManager.getCurrentLedgerHeader().ledgerSeq;
+    row.mTxIndex = txindex;
+    row.mValues.emplace_back(getEnvelopeBytes());
+    row.mValues.emplace_back(xdr::xdr_to_opaque(resultSet.results.back()));
+    row.mValues.emplace_back(xdr::xdr_to_opaque(tm));
+    rows.mTxs.emplace_back(std::move(row));
+}
+
+void
+TransactionFrame::storeTransactionFee(LedgerManager& ledgerManager,
+                                      LedgerEntryChanges const& changes,
+                                      int txindex,
+                                      TransactionHistoryRows& rows) const
+{
+    TransactionHistoryRows::Row row;
+    row.mTxID = binToHex(getContentsHash());
+    row.mLedgerSeq = ledgerManager.getCurrentLedgerHeader().ledgerSeq;
+    row.mTxIndex = txindex;
+    row.mValues.emplace_back(xdr::xdr_to_opaque(changes));
+    rows.mFees.emplace_back(std::move(row));
+}
+
+void
+TransactionFrame::storeTransactionHistory(Database& db,
+                                          TransactionHistoryRows& rows)
+{
+    insertHistoryRows(db, "txfeehistory", {"txchanges"}, rows.mFees);
+    insertHistoryRows(db, "txhistory", {"txbody", "txresult", "txmeta"},
+                      rows.mTxs);
+    rows.mFees.clear();
+    rows.mTxs.clear();
 }
 
 static void
@@ -795,10 +995,11 @@ TransactionFrame::getTransactionHistoryResults(Database& db, uint32 ledgerSeq)
     st.exchange(soci::into(txresult64));
     st.define_and_bind();
     st.execute(true);
+    bool binary = db.isTxHistoryBinary();
     while (st.got_data())
     {
         std::vector<uint8_t> result;
-        decoder::decode_b64(txresult64, result);
+        decodeHistoryValue(binary, txresult64, result);
 
         res.results.emplace_back();
         TransactionResultPair& p = res.results.back();
@@ -825,10 +1026,11 @@ TransactionFrame::getTransactionFeeMeta(Database& db, uint32 ledgerSeq)
     st.exchange(soci::use(ledgerSeq));
     st.define_and_bind();
     st.execute(true);
+    bool binary = db.isTxHistoryBinary();
     while (st.got_data())
     {
         std::vector<uint8_t> changesRaw;
-        decoder::decode_b64(changes64, changesRaw);
+        decodeHistoryValue(binary, changes64, changesRaw);
 
         xdr::xdr_get g1(&changesRaw.front(), &changesRaw.back() + 1);
         res.emplace_back();
@@ -848,6 +1050,7 @@ TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
                                            XDROutputFileStream& txResultOut)
 {
     auto timer = db.getSelectTimer("txhistory");
+    bool binary = db.isTxHistoryBinary();
     std::string txBody, txResult, txMeta;
     uint32_t begin = ledgerSeq, end = ledgerSeq + ledgerCount;
     size_t n = 0;
@@ -886,10 +1089,10 @@ TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
         }
 
         std::vector<uint8_t> body;
-        decoder::decode_b64(txBody, body);
+        decodeHistoryValue(binary, txBody, body);
 
         std::vector<uint8_t> result;
-        decoder::decode_b64(txResult, result);
+        decodeHistoryValue(binary, txResult, result);
 
         xdr::xdr_get g1(&body.front(), &body.back() + 1);
         xdr_argpack_archive(g1, tx);
@@ -927,34 +1130,42 @@ TransactionFrame::dropAll(Database& db)
 
     db.getSession() << "DROP TABLE IF EXISTS txfeehistory";
 
-    db.getSession() << "CREATE TABLE txhistory ("
-                       "txid        CHARACTER(64) NOT NULL,"
-                       "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
-                       "txindex     INT NOT NULL,"
-                       "txbody      TEXT NOT NULL,"
-                       "txresult    TEXT NOT NULL,"
-                       "txmeta      TEXT NOT NULL,"
-                       "PRIMARY KEY (ledgerseq, txindex)"
-                       ")";
+    // raw XDR or base64
+    auto valueType = db.isTxHistoryBinary() ? "BYTEA" : "TEXT";
+
+    db.getSession() << fmt::format(
+        "CREATE TABLE txhistory ("
+        "txid        CHARACTER(64) NOT NULL,"
+        "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
+        "txindex     INT NOT NULL,"
+        "txbody      {0} NOT NULL,"
+        "txresult    {0} NOT NULL,"
+        "txmeta      {0} NOT NULL,"
+        "PRIMARY KEY (ledgerseq, txindex)"
+        ")",
+        valueType);
     db.getSession() << "CREATE INDEX histbyseq ON txhistory (ledgerseq);";
 
-    db.getSession() << "CREATE TABLE txfeehistory ("
-                       "txid        CHARACTER(64) NOT NULL,"
-                       "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
-                       "txindex     INT NOT NULL,"
-                       "txchanges   TEXT NOT NULL,"
-                       "PRIMARY KEY (ledgerseq, txindex)"
-                       ")";
+    db.getSession() << fmt::format(
+        "CREATE TABLE txfeehistory ("
+        "txid        CHARACTER(64) NOT NULL,"
+        "ledgerseq   INT NOT NULL CHECK (ledgerseq >= 0),"
+        "txindex     INT NOT NULL,"
+        "txchanges   {0} NOT NULL,"
+        "PRIMARY KEY (ledgerseq, txindex)"
+        ")",
+        valueType);
     db.getSession() << "CREATE INDEX histfeebyseq ON txfeehistory (ledgerseq);";
 }
 
-void
+uint32_t
 TransactionFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq,
                                    uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "txhistory", "ledgerseq");
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "txfeehistory", "ledgerseq");
+    auto txs = DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "txhistory", "ledgerseq");
+    auto fees = DatabaseUtils::deleteOldEntriesHelper(
+        db.getSession(), ledgerSeq, count, "txfeehistory", "ledgerseq");
+    return std::min(txs, fees);
 }
 }
@@ -4,6 +4,8 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/ByteSlice.h"
+#include "crypto/SecretKey.h"
 #include "ledger/AccountFrame.h"
 #include "overlay/StellarXDR.h"
 #include "util/types.h"
@@ -33,6 +35,24 @@ class SHA256;
 class TransactionFrame;
 using TransactionFramePtr = std::shared_ptr<TransactionFrame>;
 
+// The txhistory and txfeehistory rows of a ledger, buffered by
+// TransactionFrame::storeTransaction and storeTransactionFee until
+// TransactionFrame::storeTransactionHistory writes them with one multi-row
+// insert per table.
+struct TransactionHistoryRows
+{
+    struct Row
+    {
+        std::string mTxID;
+        uint32 mLedgerSeq;
+        int mTxIndex;
+        // txbody, txresult and txmeta, or txchanges
+        std::vector<xdr::opaque_vec<>> mValues;
+    };
+    std::vector<Row> mTxs;
+    std::vector<Row> mFees;
+};
+
 class TransactionFrame
 {
   protected:
@@ -45,6 +65,13 @@ class TransactionFrame
     Hash const& mNetworkID;     // used to change the way we compute signatures
     mutable Hash mContentsHash; // the hash of the contents
     mutable Hash mFullHash;     // the hash of the contents and the sig.
+    // The XDR of mEnvelope, as received if the frame was made from the wire,
+    // else encoded on first use; empty until then.
+    mutable xdr::opaque_vec<> mEnvelopeBytes;
+
+    // What the contents hash is the hash of: the network ID, the envelope
+    // type, and the XDR of the transaction, which starts mEnvelopeBytes.
+    xdr::opaque_vec<> getContentsHashInput() const;
 
     std::vector<std::shared_ptr<OperationFrame>> mOperations;
 
@@ -84,6 +111,9 @@ class TransactionFrame
                          TransactionMetaV1& meta, Application& app);
 
     void processSeqNum(LedgerManager& lm, LedgerDelta& delta);
+    void addSignatureVerifications(
+        std::unordered_set<PublicKey> const& keys,
+        std::vector<PubKeyUtils::SigVerification>& sigs) const;
     bool processSignatures(SignatureChecker& signatureChecker, Application& app,
                            LedgerDelta& delta);
 
@@ -93,13 +123,24 @@ class TransactionFrame
     TransactionFrame(TransactionFrame const&) = delete;
     TransactionFrame() = delete;
 
+    // `envelopeBytes`, if not empty, is the XDR `msg` was decoded from: the
+    // frame keeps it instead of encoding the envelope again.
     static TransactionFramePtr
     makeTransactionFromWire(Hash const& networkID,
-                            TransactionEnvelope const& msg);
+                            TransactionEnvelope const& msg,
+                            ByteSlice const& envelopeBytes = {nullptr, 0});
 
     Hash const& getFullHash() const;
     Hash const& getContentsHash() const;
 
+    // The XDR of the envelope, which is encoded at most once: it is what is
+    // hashed, flooded (see toStellarMessageBytes) and stored in txhistory.
+    xdr::opaque_vec<> const& getEnvelopeBytes() const;
+
+    // Computes the hashes of those of `txs` that do not have them cached
+    // yet, all in one go (see sha256Many).
+    static void computeHashes(std::vector<TransactionFramePtr> const& txs);
+
     std::vector<std::shared_ptr<OperationFrame>> const&
     getOperations() const
     {
@@ -126,6 +167,8 @@ class TransactionFrame
 
     TransactionResultPair getResultPair() const;
     TransactionEnvelope const& getEnvelope() const;
+    // Changes made through this leave the hashes and the bytes of the
+    // envelope as they were cached (see addSignature).
     TransactionEnvelope& getEnvelope();
 
     SequenceNumber
@@ -153,16 +196,51 @@ class TransactionFrame
 
     double getFeeRatio(LedgerManager const& lm) const;
 
+    // Adds the keys of the entries this transaction is expected to load,
+    // see EntryFrame::prefetch.
+    void insertLedgerKeysToPrefetch(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const;
+
+    // Adds the keys of every entry applying this transaction may touch, fee
+    // source included. Returns false if some operation's cannot be known
+    // ahead of time, see OperationFrame::insertLedgerKeysToFootprint.
+    bool insertLedgerKeysToFootprint(
+        std::unordered_set<LedgerKey, LedgerKeyHash>& keys) const;
+
     void addSignature(SecretKey const& secretKey);
     void addSignature(DecoratedSignature const& signature);
 
     bool checkSignature(SignatureChecker& signatureChecker,
                         AccountFrame& account, int32_t neededWeight);
 
+    // Adds the ed25519 checks that checkValid will make on this transaction's
+    // signatures: each one against every key of its source accounts with a
+    // matching hint. Used to run them ahead of time through
+    // PubKeyUtils::verifySigs; the entries refer to this frame's contents
+    // hash.
+    void addSignatureVerifications(
+        Database& db, std::vector<PubKeyUtils::SigVerification>& sigs) const;
+
+    // Same, restricted to the master keys of the source accounts: these are
+    // known without loading anything, so this is safe to call (and the
+    // checks safe to run) off the main thread, once the contents hash has
+    // been computed.
+    void addMasterKeySignatureVerifications(
+        std::vector<PubKeyUtils::SigVerification>& sigs) const;
+
+    // the transaction's source account and its operations' ones
+    std::unordered_set<AccountID> getSourceIDs() const;
+
     bool checkValid(Application& app, SequenceNumber current);
 
     // collect fee, consume sequence number
     void processFeeSeqNum(LedgerDelta& delta, LedgerManager& ledgerManager);
+    // same, but without storing the source account: `sourceAccount` is its
+    // state left by the transactions processed before this one (nullptr to
+    // load it), and is replaced by its updated state, which the caller stores
+    // once done with every transaction from that account
+    void processFeeSeqNum(LedgerDelta& delta, LedgerManager& ledgerManager,
+                          AccountFrame::pointer& sourceAccount);
 
     // apply this transaction to the current ledger
     // returns true if successfully applied
@@ -172,19 +250,26 @@ class TransactionFrame
     bool apply(LedgerDelta& delta, Application& app);
 
     StellarMessage toStellarMessage() const;
+    // The XDR of toStellarMessage(), from getEnvelopeBytes().
+    xdr::opaque_vec<> toStellarMessageBytes() const;
 
     AccountFrame::pointer loadAccount(int ledgerProtocolVersion,
                                       LedgerDelta* delta, Database& app,
                                       AccountID const& accountID);
 
-    // transaction history
+    // transaction history, added to `rows`
     void storeTransaction(LedgerManager& ledgerManager, TransactionMeta& tm,
-                          int txindex, TransactionResultSet& resultSet) const;
+                          int txindex, TransactionResultSet& resultSet,
+                          TransactionHistoryRows& rows) const;
 
-    // fee history
+    // fee history, added to `rows`
     void storeTransactionFee(LedgerManager& ledgerManager,
-                             LedgerEntryChanges const& changes,
-                             int txindex) const;
+                             LedgerEntryChanges const& changes, int txindex,
+                             TransactionHistoryRows& rows) const;
+
+    // writes `rows` to the history tables and clears it
+    static void storeTransactionHistory(Database& db,
+                                        TransactionHistoryRows& rows);
 
     // access to history tables
     static TransactionResultSet getTransactionHistoryResults(Database& db,
@@ -204,7 +289,7 @@ class TransactionFrame
                                            XDROutputFileStream& txResultOut);
     static void dropAll(Database& db);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                 uint32_t count);
+    static uint32_t deleteOldEntries(Database& db, uint32_t ledgerSeq,
+                                     uint32_t count);
 };
 }
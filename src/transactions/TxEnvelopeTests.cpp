@@ -4,6 +4,7 @@
 
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
+#include "crypto/SHA.h"
 #include "crypto/SignerKey.h"
 #include "crypto/SignerKeyUtils.h"
 #include "ledger/LedgerManager.h"
@@ -1365,3 +1366,36 @@ TEST_CASE("txenvelope", "[tx][envelope]")
         }
     }
 }
+
+TEST_CASE("txenvelope bytes", "[tx][envelope]")
+{
+    Config const& cfg = getTestConfig();
+    VirtualClock clock;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto tx = root.tx({payment(root, 1)});
+    auto envelopeBytes = xdr::xdr_to_opaque(tx->getEnvelope());
+    REQUIRE(tx->getEnvelopeBytes() == envelopeBytes);
+    REQUIRE(tx->toStellarMessageBytes() ==
+            xdr::xdr_to_opaque(tx->toStellarMessage()));
+
+    // the same hashes from the bytes received as from the envelope
+    auto fromWire = TransactionFrame::makeTransactionFromWire(
+        app->getNetworkID(), tx->getEnvelope(), envelopeBytes);
+    auto encoded = TransactionFrame::makeTransactionFromWire(
+        app->getNetworkID(), tx->getEnvelope());
+    REQUIRE(fromWire->getEnvelopeBytes() == envelopeBytes);
+    REQUIRE(fromWire->getFullHash() == encoded->getFullHash());
+    REQUIRE(fromWire->getContentsHash() == encoded->getContentsHash());
+    REQUIRE(fromWire->getContentsHash() ==
+            sha256(xdr::xdr_to_opaque(app->getNetworkID(), ENVELOPE_TYPE_TX,
+                                      tx->getEnvelope().tx)));
+
+    auto batched = TransactionFrame::makeTransactionFromWire(
+        app->getNetworkID(), tx->getEnvelope(), envelopeBytes);
+    TransactionFrame::computeHashes({batched});
+    REQUIRE(batched->getFullHash() == sha256(envelopeBytes));
+    REQUIRE(batched->getContentsHash() == encoded->getContentsHash());
+}
@@ -0,0 +1,193 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/AllocStats.h"
+
+#include <cstdint>
+#include <string>
+
+#ifdef USE_JEMALLOC
+#include <jemalloc/jemalloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace stellar
+{
+
+namespace
+{
+#if defined(USE_JEMALLOC) || defined(__GLIBC__)
+Json::Value
+ratios(uint64_t allocated, uint64_t active, uint64_t resident)
+{
+    Json::Value res;
+    res["fragmentation"] =
+        active == 0 ? 0.0 : 1.0 - static_cast<double>(allocated) / active;
+    res["overhead"] =
+        resident == 0 ? 0.0 : 1.0 - static_cast<double>(allocated) / resident;
+    return res;
+}
+#endif
+
+#ifdef USE_JEMALLOC
+template <typename T>
+bool
+readCtl(std::string const& name, T& val)
+{
+    size_t size = sizeof(T);
+    return mallctl(name.c_str(), &val, &size, nullptr, 0) == 0 &&
+           size == sizeof(T);
+}
+
+// Sets res[key] to the size_t mallctl `name`, scaled by `unit`; leaves it
+// out if the build of jemalloc does not have it.
+void
+addSize(Json::Value& res, char const* key, std::string const& name,
+        size_t unit = 1)
+{
+    size_t val;
+    if (readCtl(name, val))
+    {
+        res[key] = static_cast<Json::UInt64>(val * unit);
+    }
+}
+
+Json::Value
+getJemallocJson(bool arenas)
+{
+    Json::Value res;
+
+    // stats are a snapshot taken when the epoch changes
+    uint64_t epoch = 1;
+    size_t size = sizeof(epoch);
+    mallctl("epoch", &epoch, &size, &epoch, size);
+
+    bool tcache = false;
+    if (readCtl("opt.tcache", tcache))
+    {
+        res["tcache"] = tcache;
+    }
+    unsigned narenas = 0;
+    readCtl("arenas.narenas", narenas);
+    res["narenas"] = narenas;
+
+    size_t allocated = 0, active = 0, resident = 0;
+    if (!readCtl("stats.allocated", allocated) ||
+        !readCtl("stats.active", active) ||
+        !readCtl("stats.resident", resident))
+    {
+        res["error"] = "jemalloc built without --enable-stats";
+        return res;
+    }
+    auto& bytes = res["bytes"];
+    bytes["allocated"] = static_cast<Json::UInt64>(allocated);
+    bytes["active"] = static_cast<Json::UInt64>(active);
+    bytes["resident"] = static_cast<Json::UInt64>(resident);
+    addSize(bytes, "metadata", "stats.metadata");
+    addSize(bytes, "mapped", "stats.mapped");
+    addSize(bytes, "retained", "stats.retained");
+    res["ratios"] = ratios(allocated, active, resident);
+
+    // the thread the command runs on, the main thread
+    uint64_t threadAllocated, threadDeallocated;
+    if (readCtl("thread.allocated", threadAllocated) &&
+        readCtl("thread.deallocated", threadDeallocated))
+    {
+        auto& thread = res["thread"];
+        thread["allocated"] = static_cast<Json::UInt64>(threadAllocated);
+        thread["deallocated"] = static_cast<Json::UInt64>(threadDeallocated);
+    }
+
+    if (!arenas)
+    {
+        return res;
+    }
+    size_t page = 4096;
+    readCtl("arenas.page", page);
+    res["arenas"] = Json::Value(Json::arrayValue);
+    for (unsigned i = 0; i < narenas; ++i)
+    {
+        auto prefix = "stats.arenas." + std::to_string(i) + ".";
+        bool initialized = false;
+        unsigned nthreads = 0;
+        if (!readCtl("arena." + std::to_string(i) + ".initialized",
+                     initialized) ||
+            !initialized || !readCtl(prefix + "nthreads", nthreads))
+        {
+            continue;
+        }
+        Json::Value arena;
+        arena["id"] = i;
+        arena["threads"] = nthreads;
+        addSize(arena, "active", prefix + "pactive", page);
+        addSize(arena, "dirty", prefix + "pdirty", page);
+        addSize(arena, "muzzy", prefix + "pmuzzy", page);
+        addSize(arena, "small", prefix + "small.allocated");
+        addSize(arena, "large", prefix + "large.allocated");
+        // what the thread caches of its threads hold, allocated as far as
+        // the arena can tell yet free for the threads
+        addSize(arena, "tcache", prefix + "tcache_bytes");
+        res["arenas"].append(arena);
+    }
+    return res;
+}
+#elif defined(__GLIBC__)
+Json::Value
+getGlibcJson()
+{
+#if __GLIBC_PREREQ(2, 33)
+    auto mi = mallinfo2();
+#else
+    // int fields, which wrap around past 2GB
+    auto mi = mallinfo();
+#endif
+    uint64_t heap = static_cast<size_t>(mi.arena);
+    uint64_t mmapped = static_cast<size_t>(mi.hblkhd);
+    uint64_t inUse = static_cast<size_t>(mi.uordblks);
+    uint64_t unused = static_cast<size_t>(mi.fordblks);
+
+    Json::Value res;
+    auto& bytes = res["bytes"];
+    bytes["allocated"] = static_cast<Json::UInt64>(inUse + mmapped);
+    bytes["heap"] = static_cast<Json::UInt64>(heap);
+    bytes["mmapped"] = static_cast<Json::UInt64>(mmapped);
+    bytes["free"] = static_cast<Json::UInt64>(unused);
+    bytes["releasable"] =
+        static_cast<Json::UInt64>(static_cast<size_t>(mi.keepcost));
+    // the heap is all there is to the active memory: free chunks stay in it
+    res["ratios"] = ratios(inUse + mmapped, heap + mmapped, heap + mmapped);
+    return res;
+}
+#endif
+}
+
+char const*
+AllocStats::allocator()
+{
+#ifdef USE_JEMALLOC
+    return "jemalloc";
+#elif defined(__GLIBC__)
+    return "glibc";
+#else
+    return "system";
+#endif
+}
+
+Json::Value
+AllocStats::getJson(bool arenas)
+{
+#ifdef USE_JEMALLOC
+    auto res = getJemallocJson(arenas);
+#elif defined(__GLIBC__)
+    (void)arenas;
+    auto res = getGlibcJson();
+#else
+    (void)arenas;
+    Json::Value res;
+#endif
+    res["allocator"] = allocator();
+    return res;
+}
+}
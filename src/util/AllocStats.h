@@ -0,0 +1,37 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <lib/json/json.h>
+
+namespace stellar
+{
+
+/**
+ * What the allocator says about the memory of the process, for the
+ * /allocstats command: to compare, across releases, what the apply and
+ * overlay paths cost in allocations rather than in the structures counted by
+ * /memory.
+ *
+ * Built with jemalloc (configure --enable-jemalloc), the totals come from its
+ * "stats." mallctls, refreshed on each call, along with each arena in use:
+ * its threads, active and dirty pages and the bytes held by the thread
+ * caches attached to it. Fragmentation is the part of the active pages not
+ * allocated, overhead the part of the resident memory not allocated.
+ *
+ * With the glibc malloc, the totals come from mallinfo, for all its arenas
+ * together: the free bytes it reports are those kept by the heap, not given
+ * back to the system. Elsewhere only "allocator" is set.
+ */
+class AllocStats
+{
+  public:
+    // "jemalloc", "glibc" or "system".
+    static char const* allocator();
+
+    // Totals, and each arena in use if `arenas` (jemalloc only).
+    static Json::Value getJson(bool arenas);
+};
+}
@@ -0,0 +1,42 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/AllocStats.h"
+
+#include <memory>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("allocator stats", "[allocstats]")
+{
+    auto res = AllocStats::getJson(true);
+    REQUIRE(res["allocator"].asString() == AllocStats::allocator());
+    if (!res.isMember("bytes"))
+    {
+        // stats not supported by this allocator
+        return;
+    }
+
+    auto allocated = [] {
+        return AllocStats::getJson(false)["bytes"]["allocated"].asUInt64();
+    };
+    auto before = allocated();
+    std::vector<std::unique_ptr<char[]>> blocks;
+    for (int i = 0; i < 64; ++i)
+    {
+        blocks.emplace_back(new char[64 * 1024]);
+    }
+    REQUIRE(allocated() >= before + 63 * 64 * 1024);
+
+    auto ratios = AllocStats::getJson(false)["ratios"];
+    REQUIRE(ratios["fragmentation"].asDouble() >= 0.0);
+    REQUIRE(ratios["fragmentation"].asDouble() < 1.0);
+
+#ifdef USE_JEMALLOC
+    REQUIRE(res["arenas"].size() > 0);
+    REQUIRE(res["arenas"][0]["threads"].asUInt() > 0);
+#endif
+}
@@ -0,0 +1,201 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/AsyncLogSink.h"
+#include "lib/util/format.h"
+
+#include <cassert>
+#include <chrono>
+
+namespace stellar
+{
+
+namespace
+{
+size_t
+roundUpToPowerOfTwo(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+}
+
+AsyncLogSink::AsyncLogSink(size_t capacity, bool dropWhenFull,
+                           std::function<void(std::string const&)> write,
+                           std::function<void()> flush)
+    : mCells(std::make_unique<Cell[]>(roundUpToPowerOfTwo(capacity)))
+    , mMask(roundUpToPowerOfTwo(capacity) - 1)
+    , mDropWhenFull(dropWhenFull)
+    , mWrite(write)
+    , mFlush(flush)
+{
+    assert(capacity != 0);
+    for (size_t i = 0; i <= mMask; ++i)
+    {
+        mCells[i].mSeq.store(i, std::memory_order_relaxed);
+    }
+    mThread = std::thread([this]() { run(); });
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+    mStopping = true;
+    wake();
+    mThread.join();
+}
+
+// A cell is free for the push at position `pos` when its sequence number is
+// `pos`, and holds the line of that push when it is `pos + 1`; popping it
+// hands it to the push one lap later.
+bool
+AsyncLogSink::tryPush(std::string& line)
+{
+    auto pos = mPushPos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto& cell = mCells[pos & mMask];
+        auto seq = cell.mSeq.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            if (mPushPos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+            {
+                cell.mLine = std::move(line);
+                cell.mSeq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // full
+            return false;
+        }
+        else
+        {
+            pos = mPushPos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool
+AsyncLogSink::tryPop(std::string& line)
+{
+    auto& cell = mCells[mPopPos & mMask];
+    if (cell.mSeq.load(std::memory_order_acquire) != mPopPos + 1)
+    {
+        return false;
+    }
+    line = std::move(cell.mLine);
+    cell.mLine.clear();
+    cell.mSeq.store(mPopPos + mMask + 1, std::memory_order_release);
+    ++mPopPos;
+    return true;
+}
+
+void
+AsyncLogSink::wake()
+{
+    // pairs with the fence in run(): either the writer sees the new line
+    // before going to sleep or we see it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mSleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+        mWake.notify_one();
+    }
+}
+
+bool
+AsyncLogSink::push(std::string line)
+{
+    if (!tryPush(line))
+    {
+        if (mDropWhenFull)
+        {
+            ++mDropped;
+            ++mUnclaimedDropped;
+            return false;
+        }
+        do
+        {
+            wake();
+            std::this_thread::yield();
+        } while (!tryPush(line));
+    }
+    wake();
+    return true;
+}
+
+void
+AsyncLogSink::run()
+{
+    std::string line;
+    for (;;)
+    {
+        bool wrote = false;
+        while (tryPop(line))
+        {
+            auto dropped = mDropped.load();
+            if (dropped != mReportedDropped)
+            {
+                mWrite(fmt::format("{} log messages dropped as the log "
+                                   "buffer was full\n",
+                                   dropped - mReportedDropped));
+                mReportedDropped = dropped;
+            }
+            mWrite(line);
+            wrote = true;
+        }
+        if (wrote)
+        {
+            mFlush();
+            mWritten.store(mPopPos);
+            continue;
+        }
+        if (mStopping)
+        {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto& next = mCells[mPopPos & mMask];
+        if (next.mSeq.load(std::memory_order_acquire) != mPopPos + 1 &&
+            !mStopping)
+        {
+            mWake.wait_for(lock, std::chrono::seconds(1));
+        }
+        mSleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void
+AsyncLogSink::drain()
+{
+    auto target = mPushPos.load();
+    while (mWritten.load() < target)
+    {
+        wake();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+uint64_t
+AsyncLogSink::getDropped() const
+{
+    return mDropped.load();
+}
+
+uint64_t
+AsyncLogSink::takeDropped()
+{
+    return mUnclaimedDropped.exchange(0);
+}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace stellar
+{
+
+/**
+ * Hands formatted log lines over to a background thread that writes them,
+ * so that logging threads do not wait for the terminal or the disk.
+ *
+ * Lines go through a bounded ring buffer that any number of threads can push
+ * to without taking a lock (a per-slot sequence number tells writers and the
+ * reader whose turn a slot is). When it is full, push() either drops the line
+ * or waits for the writer to make room, as chosen at construction. Dropped
+ * lines are counted and a line saying how many were lost is written when the
+ * writer catches up.
+ *
+ * `write` is called with each line on the background thread, `flush` after
+ * each run of lines that emptied the buffer.
+ */
+class AsyncLogSink : private NonMovableOrCopyable
+{
+    struct Cell
+    {
+        std::atomic<size_t> mSeq;
+        std::string mLine;
+    };
+
+    std::unique_ptr<Cell[]> mCells;
+    size_t const mMask;
+    bool const mDropWhenFull;
+    std::function<void(std::string const&)> const mWrite;
+    std::function<void()> const mFlush;
+
+    std::atomic<size_t> mPushPos{0};
+    // only touched by the writer thread
+    size_t mPopPos{0};
+    uint64_t mReportedDropped{0};
+
+    std::atomic<size_t> mWritten{0};
+    std::atomic<uint64_t> mDropped{0};
+    std::atomic<uint64_t> mUnclaimedDropped{0};
+
+    std::atomic<bool> mSleeping{false};
+    std::atomic<bool> mStopping{false};
+    std::mutex mWakeMutex;
+    std::condition_variable mWake;
+    std::thread mThread;
+
+    bool tryPush(std::string& line);
+    bool tryPop(std::string& line);
+    void wake();
+    void run();
+
+  public:
+    // `capacity` is rounded up to a power of two.
+    AsyncLogSink(size_t capacity, bool dropWhenFull,
+                 std::function<void(std::string const&)> write,
+                 std::function<void()> flush);
+    // Writes what is left and stops the writer thread.
+    ~AsyncLogSink();
+
+    // Returns false when the line was dropped.
+    bool push(std::string line);
+
+    // Waits until the lines pushed so far are written and flushed.
+    void drain();
+
+    // Lines dropped since the sink was created.
+    uint64_t getDropped() const;
+    // Lines dropped since the last call.
+    uint64_t takeDropped();
+};
+}
@@ -0,0 +1,100 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/AsyncLogSink.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("async log sink writes lines of each thread in order", "[log]")
+{
+    std::vector<std::string> written;
+    size_t flushes = 0;
+    std::atomic<size_t> refused{0};
+    {
+        AsyncLogSink sink(
+            16, false,
+            [&written](std::string const& line) { written.push_back(line); },
+            [&flushes]() { ++flushes; });
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&sink, &refused, t]() {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    if (!sink.push(std::to_string(t) + " " +
+                                   std::to_string(i)))
+                    {
+                        ++refused;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        sink.drain();
+        REQUIRE(refused == 0);
+        REQUIRE(written.size() == 4000);
+        REQUIRE(flushes != 0);
+        REQUIRE(sink.getDropped() == 0);
+    }
+
+    std::map<int, int> next;
+    for (auto const& line : written)
+    {
+        auto space = line.find(' ');
+        auto t = std::stoi(line.substr(0, space));
+        auto i = std::stoi(line.substr(space + 1));
+        REQUIRE(next[t] == i);
+        ++next[t];
+    }
+}
+
+TEST_CASE("async log sink drops lines when full", "[log]")
+{
+    std::mutex blockWriter;
+    std::atomic<bool> writing{false};
+    std::vector<std::string> written;
+
+    std::unique_lock<std::mutex> blocked(blockWriter);
+    AsyncLogSink sink(4, true,
+                      [&](std::string const& line) {
+                          writing = true;
+                          std::lock_guard<std::mutex> lock(blockWriter);
+                          written.push_back(line);
+                      },
+                      []() {});
+
+    REQUIRE(sink.push("first"));
+    while (!writing)
+    {
+        std::this_thread::yield();
+    }
+    // the writer is stuck on the first line: four fit, five are dropped
+    size_t pushed = 0;
+    for (int i = 0; i < 9; ++i)
+    {
+        pushed += sink.push("more") ? 1 : 0;
+    }
+    REQUIRE(pushed == 4);
+    REQUIRE(sink.getDropped() == 5);
+
+    blocked.unlock();
+    sink.drain();
+    REQUIRE(written.size() == 6);
+    REQUIRE(written[0] == "first");
+    REQUIRE(written[1].find("5 log messages dropped") == 0);
+
+    REQUIRE(sink.takeDropped() == 5);
+    REQUIRE(sink.takeDropped() == 0);
+}
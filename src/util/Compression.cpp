@@ -0,0 +1,464 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Compression.h"
+#include "crypto/ByteSlice.h"
+#include "crypto/SHA.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace stellar
+{
+
+namespace
+{
+
+size_t const CHUNK_SIZE = 0x10000;
+
+// gzip default level; matches what the gzip command produced before.
+int const GZIP_LEVEL = 6;
+
+class GzipCodec : public StreamCodec
+{
+    z_stream mStream;
+    bool const mCompress;
+    CompressionSink mSink;
+    std::vector<char> mOut;
+    bool mStreamEnd{false};
+
+    void
+    check(int rc, char const* what)
+    {
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR)
+        {
+            std::string msg(what);
+            msg += " failed: ";
+            msg += (mStream.msg ? mStream.msg : std::to_string(rc));
+            throw std::runtime_error(msg);
+        }
+    }
+
+    // Run deflate/inflate until the current input is consumed and, when
+    // finishing a compressed stream, its trailer is written.
+    void
+    pump(int flush)
+    {
+        bool more;
+        do
+        {
+            mStream.next_out = reinterpret_cast<Bytef*>(mOut.data());
+            mStream.avail_out = static_cast<uInt>(mOut.size());
+            int rc;
+            if (mCompress)
+            {
+                rc = deflate(&mStream, flush);
+                check(rc, "deflate");
+            }
+            else
+            {
+                rc = inflate(&mStream, Z_NO_FLUSH);
+                check(rc, "inflate");
+            }
+            size_t produced = mOut.size() - mStream.avail_out;
+            if (produced != 0)
+            {
+                mSink(mOut.data(), produced);
+            }
+
+            if (mCompress)
+            {
+                more = mStream.avail_out == 0 ||
+                       (flush == Z_FINISH && rc != Z_STREAM_END);
+            }
+            else
+            {
+                if (rc == Z_STREAM_END)
+                {
+                    mStreamEnd = true;
+                    if (mStream.avail_in != 0)
+                    {
+                        // gzip files may hold several concatenated members.
+                        check(inflateReset(&mStream), "inflateReset");
+                        mStreamEnd = false;
+                    }
+                }
+                more = mStream.avail_out == 0 || mStream.avail_in != 0;
+            }
+        } while (more);
+    }
+
+  public:
+    GzipCodec(bool compress, CompressionSink sink, int level = GZIP_LEVEL)
+        : mCompress(compress), mSink(sink), mOut(CHUNK_SIZE)
+    {
+        mStream = z_stream{};
+        int rc;
+        if (mCompress)
+        {
+            // 16 + MAX_WBITS selects a gzip header rather than zlib's.
+            rc = deflateInit2(&mStream, level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                              Z_DEFAULT_STRATEGY);
+        }
+        else
+        {
+            rc = inflateInit2(&mStream, 16 + MAX_WBITS);
+        }
+        if (rc != Z_OK)
+        {
+            throw std::runtime_error("failed to initialize zlib stream");
+        }
+    }
+
+    ~GzipCodec() override
+    {
+        if (mCompress)
+        {
+            deflateEnd(&mStream);
+        }
+        else
+        {
+            inflateEnd(&mStream);
+        }
+    }
+
+    void
+    write(char const* data, size_t size) override
+    {
+        mStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        mStream.avail_in = static_cast<uInt>(size);
+        pump(Z_NO_FLUSH);
+    }
+
+    void
+    flush() override
+    {
+        if (mCompress)
+        {
+            mStream.next_in = nullptr;
+            mStream.avail_in = 0;
+            pump(Z_SYNC_FLUSH);
+        }
+    }
+
+    void
+    finish() override
+    {
+        mStream.next_in = nullptr;
+        mStream.avail_in = 0;
+        if (mCompress)
+        {
+            pump(Z_FINISH);
+        }
+        else if (!mStreamEnd)
+        {
+            throw std::runtime_error("truncated gzip stream");
+        }
+    }
+};
+
+#ifdef USE_ZSTD
+class ZstdCompressor : public StreamCodec
+{
+    ZSTD_CStream* mStream;
+    CompressionSink mSink;
+    std::vector<char> mOut;
+
+    void
+    check(size_t rc)
+    {
+        if (ZSTD_isError(rc))
+        {
+            throw std::runtime_error(std::string("zstd compression failed: ") +
+                                     ZSTD_getErrorName(rc));
+        }
+    }
+
+  public:
+    ZstdCompressor(CompressionSink sink, int level = ZSTD_CLEVEL_DEFAULT)
+        : mStream(ZSTD_createCStream())
+        , mSink(sink)
+        , mOut(ZSTD_CStreamOutSize())
+    {
+        if (!mStream)
+        {
+            throw std::runtime_error("failed to create zstd stream");
+        }
+        check(ZSTD_initCStream(mStream, level));
+    }
+
+    ~ZstdCompressor() override
+    {
+        ZSTD_freeCStream(mStream);
+    }
+
+    void
+    write(char const* data, size_t size) override
+    {
+        ZSTD_inBuffer in{data, size, 0};
+        while (in.pos < in.size)
+        {
+            ZSTD_outBuffer out{mOut.data(), mOut.size(), 0};
+            check(ZSTD_compressStream(mStream, &out, &in));
+            if (out.pos != 0)
+            {
+                mSink(mOut.data(), out.pos);
+            }
+        }
+    }
+
+    void
+    flush() override
+    {
+        size_t remaining;
+        do
+        {
+            ZSTD_outBuffer out{mOut.data(), mOut.size(), 0};
+            remaining = ZSTD_flushStream(mStream, &out);
+            check(remaining);
+            if (out.pos != 0)
+            {
+                mSink(mOut.data(), out.pos);
+            }
+        } while (remaining != 0);
+    }
+
+    void
+    finish() override
+    {
+        size_t remaining;
+        do
+        {
+            ZSTD_outBuffer out{mOut.data(), mOut.size(), 0};
+            remaining = ZSTD_endStream(mStream, &out);
+            check(remaining);
+            if (out.pos != 0)
+            {
+                mSink(mOut.data(), out.pos);
+            }
+        } while (remaining != 0);
+    }
+};
+
+class ZstdDecompressor : public StreamCodec
+{
+    ZSTD_DStream* mStream;
+    CompressionSink mSink;
+    std::vector<char> mOut;
+    // Nonzero until a complete frame has been decoded.
+    size_t mLastRc{1};
+
+  public:
+    ZstdDecompressor(CompressionSink sink)
+        : mStream(ZSTD_createDStream())
+        , mSink(sink)
+        , mOut(ZSTD_DStreamOutSize())
+    {
+        if (!mStream)
+        {
+            throw std::runtime_error("failed to create zstd stream");
+        }
+        ZSTD_initDStream(mStream);
+    }
+
+    ~ZstdDecompressor() override
+    {
+        ZSTD_freeDStream(mStream);
+    }
+
+    void
+    write(char const* data, size_t size) override
+    {
+        ZSTD_inBuffer in{data, size, 0};
+        bool more;
+        do
+        {
+            ZSTD_outBuffer out{mOut.data(), mOut.size(), 0};
+            mLastRc = ZSTD_decompressStream(mStream, &out, &in);
+            if (ZSTD_isError(mLastRc))
+            {
+                throw std::runtime_error(
+                    std::string("zstd decompression failed: ") +
+                    ZSTD_getErrorName(mLastRc));
+            }
+            if (out.pos != 0)
+            {
+                mSink(mOut.data(), out.pos);
+            }
+            // A full output buffer may mean more output is pending.
+            more = in.pos < in.size || out.pos == out.size;
+        } while (more);
+    }
+
+    void
+    flush() override
+    {
+    }
+
+    void
+    finish() override
+    {
+        // A return of 0 means the last frame was completely decoded.
+        if (mLastRc != 0)
+        {
+            throw std::runtime_error("truncated zstd stream");
+        }
+    }
+};
+#endif
+}
+
+std::string
+compressionFormatSuffix(CompressionFormat fmt)
+{
+    switch (fmt)
+    {
+    case CompressionFormat::GZIP:
+        return ".gz";
+    case CompressionFormat::ZSTD:
+        return ".zst";
+    }
+    throw std::runtime_error("unknown compression format");
+}
+
+CompressionFormat
+compressionFormatFromName(std::string const& name)
+{
+    if (name == "gzip")
+    {
+        return CompressionFormat::GZIP;
+    }
+    if (name == "zstd")
+    {
+        return CompressionFormat::ZSTD;
+    }
+    throw std::invalid_argument("unknown compression format: " + name);
+}
+
+bool
+isCompressionFormatSupported(CompressionFormat fmt)
+{
+    switch (fmt)
+    {
+    case CompressionFormat::GZIP:
+        return true;
+    case CompressionFormat::ZSTD:
+#ifdef USE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+std::unique_ptr<StreamCodec>
+StreamCodec::makeCompressor(CompressionFormat fmt, CompressionSink sink,
+                            int level)
+{
+    switch (fmt)
+    {
+    case CompressionFormat::GZIP:
+        return std::make_unique<GzipCodec>(true, sink,
+                                           level == 0 ? GZIP_LEVEL : level);
+#ifdef USE_ZSTD
+    case CompressionFormat::ZSTD:
+        return std::make_unique<ZstdCompressor>(
+            sink, level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+#endif
+    default:
+        throw std::runtime_error("compression format " +
+                                 compressionFormatSuffix(fmt) +
+                                 " not supported by this build");
+    }
+}
+
+std::unique_ptr<StreamCodec>
+StreamCodec::makeDecompressor(CompressionFormat fmt, CompressionSink sink)
+{
+    switch (fmt)
+    {
+    case CompressionFormat::GZIP:
+        return std::make_unique<GzipCodec>(false, sink);
+#ifdef USE_ZSTD
+    case CompressionFormat::ZSTD:
+        return std::make_unique<ZstdDecompressor>(sink);
+#endif
+    default:
+        throw std::runtime_error("compression format " +
+                                 compressionFormatSuffix(fmt) +
+                                 " not supported by this build");
+    }
+}
+
+static void
+runCodec(std::string const& inFile, std::string const& outFile, bool compress,
+         CompressionFormat fmt, SHA256* hasher)
+{
+    std::ifstream in(inFile, std::ifstream::binary);
+    if (!in)
+    {
+        throw std::runtime_error("failed to open " + inFile);
+    }
+    std::ofstream out(outFile, std::ofstream::binary | std::ofstream::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("failed to open " + outFile);
+    }
+
+    CompressionSink sink = [&out, &outFile, hasher](char const* data,
+                                                    size_t size) {
+        if (!out.write(data, size))
+        {
+            throw std::runtime_error("failed writing " + outFile);
+        }
+        if (hasher)
+        {
+            hasher->add(ByteSlice(data, size));
+        }
+    };
+    auto codec = compress ? StreamCodec::makeCompressor(fmt, sink)
+                          : StreamCodec::makeDecompressor(fmt, sink);
+
+    std::vector<char> buf(CHUNK_SIZE);
+    while (in)
+    {
+        in.read(buf.data(), buf.size());
+        if (in.gcount() > 0)
+        {
+            codec->write(buf.data(), static_cast<size_t>(in.gcount()));
+        }
+    }
+    if (in.bad())
+    {
+        throw std::runtime_error("failed reading " + inFile);
+    }
+    codec->finish();
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("failed writing " + outFile);
+    }
+}
+
+void
+compressFile(std::string const& inFile, std::string const& outFile,
+             CompressionFormat fmt)
+{
+    runCodec(inFile, outFile, true, fmt, nullptr);
+}
+
+void
+decompressFile(std::string const& inFile, std::string const& outFile,
+               CompressionFormat fmt, SHA256* hasher)
+{
+    runCodec(inFile, outFile, false, fmt, hasher);
+}
+}
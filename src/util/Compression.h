@@ -0,0 +1,87 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace stellar
+{
+
+class SHA256;
+
+/**
+ * In-process streaming compression, used by the history subsystem to
+ * compress and decompress bucket and checkpoint files on worker threads
+ * rather than by forking gzip for every file.
+ *
+ * gzip is always available (via zlib) and produces output interchangeable
+ * with the gzip command. zstd is available when built with libzstd
+ * (USE_ZSTD); isCompressionFormatSupported says which are usable.
+ */
+enum class CompressionFormat
+{
+    GZIP,
+    ZSTD
+};
+
+// Filename suffix for a format, including the leading dot (eg. ".gz").
+std::string compressionFormatSuffix(CompressionFormat fmt);
+
+// Parse a format name as used in config ("gzip" or "zstd"); throws on an
+// unknown name.
+CompressionFormat compressionFormatFromName(std::string const& name);
+
+bool isCompressionFormatSupported(CompressionFormat fmt);
+
+// Receives each chunk of output produced by a (de)compressor.
+using CompressionSink = std::function<void(char const* data, size_t size)>;
+
+/**
+ * A streaming (de)compressor: feed input in chunks of any size with write(),
+ * then call finish(). Output is handed to the sink as it is produced. Errors
+ * (eg. corrupt input) are thrown as std::runtime_error.
+ *
+ * A compressor can also be flush()ed to hand out, without ending the stream,
+ * everything needed to decompress what was written so far: a decompressor
+ * written that output produces all of it.
+ */
+class StreamCodec : NonMovableOrCopyable
+{
+  public:
+    virtual ~StreamCodec()
+    {
+    }
+
+    // `level` 0 is the format's default (the one of the gzip command for
+    // gzip); higher is slower and smaller.
+    static std::unique_ptr<StreamCodec>
+    makeCompressor(CompressionFormat fmt, CompressionSink sink, int level = 0);
+    static std::unique_ptr<StreamCodec>
+    makeDecompressor(CompressionFormat fmt, CompressionSink sink);
+
+    virtual void write(char const* data, size_t size) = 0;
+
+    // For a compressor, hand out all the output pending; a no-op for a
+    // decompressor, which hands it out as it is written.
+    virtual void flush() = 0;
+
+    // Flush any buffered output. For a decompressor, throws if the input
+    // ended before the end of the compressed stream.
+    virtual void finish() = 0;
+};
+
+// Compress `inFile` into `outFile`. Throws std::runtime_error on failure.
+void compressFile(std::string const& inFile, std::string const& outFile,
+                  CompressionFormat fmt);
+
+// Decompress `inFile` into `outFile`, adding the decompressed bytes to
+// `hasher` if it is non-null. Throws std::runtime_error on failure.
+void decompressFile(std::string const& inFile, std::string const& outFile,
+                    CompressionFormat fmt, SHA256* hasher = nullptr);
+}
@@ -0,0 +1,128 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHA.h"
+#include "lib/catch.hpp"
+#include "util/Compression.h"
+#include "util/TmpDir.h"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace stellar;
+
+static std::string
+readFile(std::string const& name)
+{
+    std::ifstream in(name, std::ifstream::binary);
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
+
+static void
+writeFile(std::string const& name, std::string const& data)
+{
+    std::ofstream out(name, std::ofstream::binary);
+    out.write(data.data(), data.size());
+}
+
+TEST_CASE("compression round trip", "[compression]")
+{
+    TmpDir tmp("compression");
+    std::string plain = tmp.getName() + "/plain";
+    std::string restored = tmp.getName() + "/restored";
+
+    // Large enough to span several internal chunks, and compressible.
+    std::string data;
+    for (size_t i = 0; data.size() < 0x40000; ++i)
+    {
+        data += "entry " + std::to_string(i * 7919 % 1000) + "\n";
+    }
+    writeFile(plain, data);
+
+    for (auto fmt : {CompressionFormat::GZIP, CompressionFormat::ZSTD})
+    {
+        if (!isCompressionFormatSupported(fmt))
+        {
+            continue;
+        }
+        SECTION(compressionFormatSuffix(fmt))
+        {
+            std::string packed = plain + compressionFormatSuffix(fmt);
+            compressFile(plain, packed, fmt);
+            REQUIRE(readFile(packed).size() < data.size());
+
+            auto hasher = SHA256::create();
+            decompressFile(packed, restored, fmt, hasher.get());
+            REQUIRE(readFile(restored) == data);
+            REQUIRE(hasher->finish() == sha256(data));
+
+            // A truncated file must not decompress silently.
+            auto bytes = readFile(packed);
+            writeFile(packed, bytes.substr(0, bytes.size() / 2));
+            REQUIRE_THROWS_AS(decompressFile(packed, restored, fmt),
+                              std::runtime_error);
+        }
+    }
+}
+
+TEST_CASE("gzip decompresses concatenated members", "[compression]")
+{
+    TmpDir tmp("compression");
+    std::string a = tmp.getName() + "/a";
+    std::string b = tmp.getName() + "/b";
+    writeFile(a, "hello ");
+    writeFile(b, "there");
+    compressFile(a, a + ".gz", CompressionFormat::GZIP);
+    compressFile(b, b + ".gz", CompressionFormat::GZIP);
+
+    std::string both = tmp.getName() + "/both.gz";
+    writeFile(both, readFile(a + ".gz") + readFile(b + ".gz"));
+    decompressFile(both, tmp.getName() + "/both", CompressionFormat::GZIP);
+    REQUIRE(readFile(tmp.getName() + "/both") == "hello there");
+}
+
+TEST_CASE("flushed compressed output decompresses as it comes",
+          "[compression]")
+{
+    for (auto fmt : {CompressionFormat::GZIP, CompressionFormat::ZSTD})
+    {
+        if (!isCompressionFormatSupported(fmt))
+        {
+            continue;
+        }
+        SECTION(compressionFormatSuffix(fmt))
+        {
+            std::string packed;
+            std::string restored;
+            auto compressor = StreamCodec::makeCompressor(
+                fmt,
+                [&packed](char const* data, size_t size) {
+                    packed.append(data, size);
+                },
+                1);
+            auto decompressor = StreamCodec::makeDecompressor(
+                fmt, [&restored](char const* data, size_t size) {
+                    restored.append(data, size);
+                });
+
+            std::vector<size_t> sizes;
+            for (int i = 0; i < 10; ++i)
+            {
+                std::string msg = "message " + std::to_string(i) +
+                                  std::string(200, 'a' + i % 3);
+                packed.clear();
+                restored.clear();
+                compressor->write(msg.data(), msg.size());
+                compressor->flush();
+                decompressor->write(packed.data(), packed.size());
+                REQUIRE(restored == msg);
+                sizes.push_back(packed.size());
+            }
+            // the later messages repeat the earlier ones
+            REQUIRE(sizes.back() < sizes.front());
+        }
+    }
+}
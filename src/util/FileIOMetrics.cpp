@@ -0,0 +1,36 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/FileIOMetrics.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+namespace stellar
+{
+
+FileIOMetrics::FileIOMetrics(medida::MetricsRegistry& registry,
+                             std::string const& category)
+    : mBytes(registry.NewMeter({"fs", category, "bytes"}, "byte"))
+    , mOps(registry.NewTimer({"fs", category, "op"}))
+{
+}
+
+void
+FileIOMetrics::record(size_t bytes, std::chrono::nanoseconds time)
+{
+    addBytes(bytes);
+    mOps.Update(time);
+}
+
+void
+FileIOMetrics::addBytes(size_t bytes)
+{
+    if (bytes != 0)
+    {
+        mBytes.Mark(bytes);
+    }
+}
+}
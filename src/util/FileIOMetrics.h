@@ -0,0 +1,53 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace medida
+{
+class Meter;
+class MetricsRegistry;
+class Timer;
+}
+
+namespace stellar
+{
+
+/**
+ * Throughput of one category of file I/O: the bytes moved, as the meter
+ * fs.<category>.bytes, and the count and latency of the operations moving
+ * them, as the timer fs.<category>.op.
+ *
+ * An operation is a system call where the caller makes them itself (writes
+ * through XDROutputFileStream's own buffer, fsync, rename); for a file read
+ * or written through the C++ library it is the whole file, timed over the
+ * reads or writes made into it. Bytes read from a memory mapping have no
+ * operation of their own.
+ *
+ * The categories in use are bucket-read, bucket-write, fsync and rename,
+ * owned by the BucketManager, and history-temp, for the files of history
+ * checkpoints being built, published or caught up from. Methods are
+ * threadsafe.
+ */
+class FileIOMetrics : NonMovableOrCopyable
+{
+    medida::Meter& mBytes;
+    medida::Timer& mOps;
+
+  public:
+    FileIOMetrics(medida::MetricsRegistry& registry,
+                  std::string const& category);
+
+    // One operation, which moved `bytes` bytes in `time`.
+    void record(size_t bytes, std::chrono::nanoseconds time);
+
+    // Bytes moved without an operation of their own.
+    void addBytes(size_t bytes);
+};
+}
@@ -6,6 +6,7 @@
 #include "crypto/Hex.h"
 #include "lib/util/format.h"
 #include "util/Logging.h"
+#include <fstream>
 #include <map>
 #include <regex>
 #include <sstream>
@@ -13,8 +14,10 @@
 #ifdef _WIN32
 #include <direct.h>
 #include <filesystem>
+#include <sys/stat.h>
 #else
 #include <dirent.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 #endif
@@ -342,6 +345,54 @@ processExists(long pid)
 
 #endif
 
+size_t
+size(std::string const& path)
+{
+    std::ifstream in(path, std::ifstream::binary | std::ifstream::ate);
+    if (!in)
+    {
+        return 0;
+    }
+    return static_cast<size_t>(in.tellg());
+}
+
+int64_t
+lastModified(std::string const& path)
+{
+#ifdef _WIN32
+    struct _stat64 buf;
+    if (_stat64(path.c_str(), &buf) != 0)
+#else
+    struct stat buf;
+    if (stat(path.c_str(), &buf) != 0)
+#endif
+    {
+        return -1;
+    }
+    return static_cast<int64_t>(buf.st_mtime);
+}
+
+bool
+syncFile(std::string const& path)
+{
+#ifdef _WIN32
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+#ifdef __linux__
+    bool ok = fdatasync(fd) == 0;
+#else
+    bool ok = fsync(fd) == 0;
+#endif
+    close(fd);
+    return ok;
+#endif
+}
+
 PathSplitter::PathSplitter(std::string path) : mPath{std::move(path)}, mPos{0}
 {
 }
@@ -444,6 +495,53 @@ checkNoGzipSuffix(std::string const& filename)
 
 #ifdef _WIN32
 
+MappedFile::MappedFile(std::string const& path)
+{
+    HANDLE h = ::CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("unable to open file for mapping: " + path);
+    }
+    LARGE_INTEGER sz;
+    if (!::GetFileSizeEx(h, &sz))
+    {
+        ::CloseHandle(h);
+        throw std::runtime_error("unable to get size of file: " + path);
+    }
+    mSize = static_cast<size_t>(sz.QuadPart);
+    if (mSize != 0)
+    {
+        mMapping = ::CreateFileMapping(h, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mMapping)
+        {
+            mData = static_cast<char const*>(
+                ::MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+    ::CloseHandle(h);
+    if (mSize != 0 && !mData)
+    {
+        if (mMapping)
+        {
+            ::CloseHandle(mMapping);
+        }
+        throw std::runtime_error("unable to map file: " + path);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+    {
+        ::UnmapViewOfFile(mData);
+    }
+    if (mMapping)
+    {
+        ::CloseHandle(mMapping);
+    }
+}
+
 int
 getMaxConnections()
 {
@@ -453,6 +551,49 @@ getMaxConnections()
 }
 
 #else
+
+MappedFile::MappedFile(std::string const& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        throw std::runtime_error(fmt::format(
+            "unable to open file for mapping: {}, errno {}", path, errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error(
+            fmt::format("unable to stat file: {}, errno {}", path, err));
+    }
+    mSize = static_cast<size_t>(st.st_size);
+    if (mSize != 0)
+    {
+        void* p = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            int err = errno;
+            close(fd);
+            throw std::runtime_error(
+                fmt::format("unable to map file: {}, errno {}", path, err));
+        }
+        // Purely advisory: readers walk the file front to back once.
+        madvise(p, mSize, MADV_SEQUENTIAL);
+        mData = static_cast<char const*>(p);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+    {
+        munmap(const_cast<char*>(mData), mSize);
+    }
+}
+
 int
 getMaxConnections()
 {
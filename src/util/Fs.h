@@ -33,6 +33,17 @@ void unlockFile(std::string const& path);
 // Whether a path exists
 bool exists(std::string const& path);
 
+// Size in bytes of a file, or 0 if it cannot be read
+size_t size(std::string const& path);
+
+// Last modification time of a file, in seconds since the epoch, or -1 if it
+// cannot be read
+int64_t lastModified(std::string const& path);
+
+// Flush a file written earlier to disk (fdatasync); returns false if it
+// cannot be opened or flushed. Does nothing on Windows.
+bool syncFile(std::string const& path);
+
 // Delete a path and everything inside it (if a dir)
 void deltree(std::string const& path);
 
@@ -88,5 +99,34 @@ void checkNoGzipSuffix(std::string const& filename);
 
 // returns the maximum number of connections that can be done at the same time
 int getMaxConnections();
+
+// Read-only memory mapping of a whole file, hinted for sequential access.
+// Throws if the file cannot be opened or mapped. The mapping stays valid for
+// the lifetime of the object even if the file is unlinked.
+class MappedFile
+{
+    char const* mData{nullptr};
+    size_t mSize{0};
+#ifdef _WIN32
+    void* mMapping{nullptr};
+#endif
+
+  public:
+    explicit MappedFile(std::string const& path);
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    char const*
+    data() const
+    {
+        return mData;
+    }
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+};
 }
 }
@@ -17,7 +17,13 @@ static std::thread::id mainThread = std::this_thread::get_id();
 void
 assertThreadIsMain()
 {
-    dbgAssert(mainThread == std::this_thread::get_id());
+    dbgAssert(threadIsMain());
+}
+
+bool
+threadIsMain()
+{
+    return mainThread == std::this_thread::get_id();
 }
 
 void
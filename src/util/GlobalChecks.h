@@ -7,6 +7,7 @@
 namespace stellar
 {
 void assertThreadIsMain();
+bool threadIsMain();
 
 void dbgAbort();
 
@@ -0,0 +1,189 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/LatencyHistogram.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+size_t const LatencyHistogram::BUCKETS;
+
+namespace
+{
+// the buckets of a power of two
+size_t const SUB_BUCKETS = 4;
+// the first bound is 2^MIN_POWER microseconds
+size_t const MIN_POWER = 4;
+
+std::array<int64_t, LatencyHistogram::BUCKETS - 1> const&
+bounds()
+{
+    static auto const res = []() {
+        std::array<int64_t, LatencyHistogram::BUCKETS - 1> b;
+        for (size_t i = 0; i < b.size(); ++i)
+        {
+            // (SUB_BUCKETS + j) / SUB_BUCKETS * 2^k microseconds
+            int64_t power = int64_t(1) << (MIN_POWER + i / SUB_BUCKETS);
+            auto sub = static_cast<int64_t>(SUB_BUCKETS + i % SUB_BUCKETS);
+            b[i] = sub * power / SUB_BUCKETS * 1000;
+        }
+        return b;
+    }();
+    return res;
+}
+}
+
+std::chrono::nanoseconds
+LatencyHistogram::bucketBound(size_t i)
+{
+    return std::chrono::nanoseconds(bounds().at(i));
+}
+
+size_t
+LatencyHistogram::bucketIndex(std::chrono::nanoseconds d)
+{
+    auto const& b = bounds();
+    return std::lower_bound(b.begin(), b.end(), d.count()) - b.begin();
+}
+
+void
+LatencyHistogram::Update(std::chrono::nanoseconds d)
+{
+    if (d.count() < 0)
+    {
+        d = std::chrono::nanoseconds::zero();
+    }
+    mBuckets[bucketIndex(d)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(static_cast<uint64_t>(d.count()),
+                   std::memory_order_relaxed);
+}
+
+void
+LatencyHistogram::clear()
+{
+    for (auto& b : mBuckets)
+    {
+        b.store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mSum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t
+LatencyHistogram::count() const
+{
+    return mCount.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds
+LatencyHistogram::sum() const
+{
+    return std::chrono::nanoseconds(mSum.load(std::memory_order_relaxed));
+}
+
+uint64_t
+LatencyHistogram::bucketCount(size_t i) const
+{
+    return mBuckets.at(i).load(std::memory_order_relaxed);
+}
+
+HistogramTimerContext::HistogramTimerContext(medida::Timer& timer,
+                                             LatencyHistogram& histogram)
+    : mTimer(&timer)
+    , mHistogram(&histogram)
+    , mStart(std::chrono::steady_clock::now())
+{
+}
+
+HistogramTimerContext::HistogramTimerContext(HistogramTimerContext&& other)
+    : mTimer(other.mTimer), mHistogram(other.mHistogram), mStart(other.mStart)
+{
+    other.mTimer = nullptr;
+    other.mHistogram = nullptr;
+}
+
+HistogramTimerContext::~HistogramTimerContext()
+{
+    Stop();
+}
+
+std::chrono::nanoseconds
+HistogramTimerContext::Stop()
+{
+    if (!mTimer)
+    {
+        return std::chrono::nanoseconds::zero();
+    }
+    auto d = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - mStart);
+    mTimer->Update(d);
+    mHistogram->Update(d);
+    mTimer = nullptr;
+    mHistogram = nullptr;
+    return d;
+}
+
+HistogramTimer::HistogramTimer(medida::Timer& timer,
+                               LatencyHistogram& histogram)
+    : mTimer(timer), mHistogram(histogram)
+{
+}
+
+HistogramTimerContext
+HistogramTimer::TimeScope()
+{
+    return HistogramTimerContext(mTimer, mHistogram);
+}
+
+void
+HistogramTimer::Update(std::chrono::nanoseconds d)
+{
+    mTimer.Update(d);
+    mHistogram.Update(d);
+}
+
+LatencyHistograms::LatencyHistograms(medida::MetricsRegistry& metrics)
+    : mMetrics(metrics)
+{
+}
+
+HistogramTimer
+LatencyHistograms::NewTimer(medida::MetricName const& name)
+{
+    auto& timer = mMetrics.NewTimer(name);
+    std::lock_guard<std::mutex> guard(mMutex);
+    auto& histogram = mHistograms[name];
+    if (!histogram)
+    {
+        histogram = std::make_unique<LatencyHistogram>();
+    }
+    return HistogramTimer(timer, *histogram);
+}
+
+LatencyHistogram const*
+LatencyHistograms::find(medida::MetricName const& name) const
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    auto it = mHistograms.find(name);
+    return it == mHistograms.end() ? nullptr : it->second.get();
+}
+
+void
+LatencyHistograms::clear(std::string const& domain)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    for (auto& h : mHistograms)
+    {
+        if (domain.empty() || h.first.domain() == domain)
+        {
+            h.second->clear();
+        }
+    }
+}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "medida/metric_name.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace medida
+{
+class MetricsRegistry;
+class Timer;
+}
+
+namespace stellar
+{
+
+/**
+ * Fixed bucket histogram of durations, for the latency-critical timers.
+ *
+ * medida's timers keep an exponentially decaying sample of their durations,
+ * whose tail percentiles jump around and soon forget the rare slow events.
+ * This counts every duration since the start (or the last clear) in one of a
+ * fixed set of log-linear buckets, four per power of two (upper bounds of 1,
+ * 1.25, 1.5 and 1.75 times 2^k microseconds) from 16us to 2^27us (about
+ * 134s), plus one for anything slower. Whoever scrapes the counts (see the
+ * /prometheus command) can then compute any percentile over any window to
+ * within a quarter of its value.
+ *
+ * Updates are lock free and can come from any thread.
+ */
+class LatencyHistogram
+{
+  public:
+    // the last bucket has no upper bound
+    static size_t const BUCKETS = 94;
+
+    // Upper bound of bucket `i` < BUCKETS - 1, inclusive.
+    static std::chrono::nanoseconds bucketBound(size_t i);
+    // Bucket of a duration of `d`.
+    static size_t bucketIndex(std::chrono::nanoseconds d);
+
+    void Update(std::chrono::nanoseconds d);
+    void clear();
+
+    uint64_t count() const;
+    std::chrono::nanoseconds sum() const;
+    // Durations that fell in bucket `i`, not those of the buckets below.
+    uint64_t bucketCount(size_t i) const;
+
+  private:
+    std::array<std::atomic<uint64_t>, BUCKETS> mBuckets{};
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<uint64_t> mSum{0};
+};
+
+// Times a scope, as medida::TimerContext, for a HistogramTimer.
+class HistogramTimerContext
+{
+    medida::Timer* mTimer;
+    LatencyHistogram* mHistogram;
+    std::chrono::steady_clock::time_point mStart;
+
+  public:
+    HistogramTimerContext(medida::Timer& timer, LatencyHistogram& histogram);
+    HistogramTimerContext(HistogramTimerContext&& other);
+    HistogramTimerContext(HistogramTimerContext const&) = delete;
+    HistogramTimerContext& operator=(HistogramTimerContext const&) = delete;
+    ~HistogramTimerContext();
+
+    // Records the time since construction, if not done yet, and returns it.
+    std::chrono::nanoseconds Stop();
+};
+
+// A medida::Timer whose durations also go to a LatencyHistogram, see
+// LatencyHistograms::NewTimer.
+class HistogramTimer
+{
+    medida::Timer& mTimer;
+    LatencyHistogram& mHistogram;
+
+  public:
+    HistogramTimer(medida::Timer& timer, LatencyHistogram& histogram);
+
+    HistogramTimerContext TimeScope();
+    void Update(std::chrono::nanoseconds d);
+
+    medida::Timer&
+    getTimer()
+    {
+        return mTimer;
+    }
+};
+
+/**
+ * The LatencyHistograms of an application, each kept alongside the timer of
+ * the same name in its metrics registry.
+ */
+class LatencyHistograms
+{
+    medida::MetricsRegistry& mMetrics;
+    mutable std::mutex mMutex;
+    std::map<medida::MetricName, std::unique_ptr<LatencyHistogram>>
+        mHistograms;
+
+  public:
+    explicit LatencyHistograms(medida::MetricsRegistry& metrics);
+
+    // The timer `name` of the registry, given a histogram on first use.
+    HistogramTimer NewTimer(medida::MetricName const& name);
+
+    // The histogram of the timer `name`, null if it has none.
+    LatencyHistogram const* find(medida::MetricName const& name) const;
+
+    // Clears the histograms of `domain`, or all of them if it is empty.
+    void clear(std::string const& domain);
+};
+}
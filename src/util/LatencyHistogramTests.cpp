@@ -0,0 +1,89 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/LatencyHistogram.h"
+
+#include "lib/catch.hpp"
+#include "util/PrometheusReporter.h"
+#include <chrono>
+#include <medida/counter.h>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
+#include <medida/timer.h>
+
+using namespace stellar;
+using namespace std::chrono;
+
+TEST_CASE("latency histogram buckets", "[latencyhistogram]")
+{
+    REQUIRE(LatencyHistogram::bucketBound(0) == microseconds(16));
+    REQUIRE(LatencyHistogram::bucketBound(1) == microseconds(20));
+    REQUIRE(LatencyHistogram::bucketBound(3) == microseconds(28));
+    REQUIRE(LatencyHistogram::bucketBound(4) == microseconds(32));
+    REQUIRE(LatencyHistogram::bucketBound(LatencyHistogram::BUCKETS - 2) ==
+            microseconds(1 << 27));
+
+    REQUIRE(LatencyHistogram::bucketIndex(nanoseconds(0)) == 0);
+    REQUIRE(LatencyHistogram::bucketIndex(microseconds(16)) == 0);
+    REQUIRE(LatencyHistogram::bucketIndex(microseconds(16) +
+                                          nanoseconds(1)) == 1);
+    REQUIRE(LatencyHistogram::bucketIndex(milliseconds(1)) == 24);
+    REQUIRE(LatencyHistogram::bucketIndex(hours(1)) ==
+            LatencyHistogram::BUCKETS - 1);
+
+    LatencyHistogram h;
+    h.Update(milliseconds(1));
+    h.Update(milliseconds(1));
+    h.Update(hours(1));
+    REQUIRE(h.count() == 3);
+    REQUIRE(h.sum() == milliseconds(2) + hours(1));
+    REQUIRE(h.bucketCount(24) == 2);
+    REQUIRE(h.bucketCount(LatencyHistogram::BUCKETS - 1) == 1);
+
+    h.clear();
+    REQUIRE(h.count() == 0);
+    REQUIRE(h.bucketCount(24) == 0);
+}
+
+TEST_CASE("prometheus reporter", "[latencyhistogram]")
+{
+    medida::MetricsRegistry registry;
+    LatencyHistograms histograms(registry);
+
+    auto timer = histograms.NewTimer({"ledger", "ledger", "close"});
+    timer.Update(milliseconds(1));
+    REQUIRE(registry.NewTimer({"ledger", "ledger", "close"}).count() == 1);
+    registry.NewTimer({"app", "state", "changes"}).Update(milliseconds(2));
+    registry.NewMeter({"overlay", "byte", "read"}, "byte").Mark(3);
+    registry.NewCounter({"overlay", "memory", "flood-map-bytes"})
+        .set_count(5);
+
+    auto report = PrometheusReporter(registry, histograms).Report();
+    auto has = [&](std::string const& line) {
+        return report.find(line + "\n") != std::string::npos;
+    };
+
+    REQUIRE(has("# TYPE stellar_core_ledger_ledger_close_seconds histogram"));
+    REQUIRE(has("stellar_core_ledger_ledger_close_seconds_bucket"
+                "{le=\"0.000896\"} 0"));
+    REQUIRE(has("stellar_core_ledger_ledger_close_seconds_bucket"
+                "{le=\"0.001024\"} 1"));
+    REQUIRE(has("stellar_core_ledger_ledger_close_seconds_bucket"
+                "{le=\"+Inf\"} 1"));
+    REQUIRE(has("stellar_core_ledger_ledger_close_seconds_sum 0.001"));
+    REQUIRE(has("stellar_core_ledger_ledger_close_seconds_count 1"));
+
+    REQUIRE(has("# TYPE stellar_core_app_state_changes_seconds summary"));
+    REQUIRE(has("stellar_core_app_state_changes_seconds_sum 0.002"));
+    REQUIRE(has("stellar_core_app_state_changes_seconds_count 1"));
+
+    REQUIRE(has("# TYPE stellar_core_overlay_byte_read_total counter"));
+    REQUIRE(has("stellar_core_overlay_byte_read_total 3"));
+    REQUIRE(has("# TYPE stellar_core_overlay_memory_flood_map_bytes gauge"));
+    REQUIRE(has("stellar_core_overlay_memory_flood_map_bytes 5"));
+
+    histograms.clear("ledger");
+    report = PrometheusReporter(registry, histograms).Report();
+    REQUIRE(has("stellar_core_ledger_ledger_close_seconds_count 0"));
+}
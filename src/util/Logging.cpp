@@ -4,8 +4,16 @@
 
 #include "util/Logging.h"
 #include "main/Application.h"
+#include "util/AsyncLogSink.h"
 #include "util/types.h"
 
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
 /*
 Levels:
     TRACE
@@ -25,9 +33,98 @@ namespace
 static const std::vector<std::string> kLoggers = {
     "Fs",      "SCP",    "Bucket", "Database", "History", "Process",  "Ledger",
     "Overlay", "Herder", "Tx",     "LoadGen",  "Work",    "Invariant"};
+
+// rank of the level of the default logger, then of each of kLoggers
+std::array<std::atomic<int>, 14> gPartitionRanks;
+
+// Written to by the background thread of gAsyncSink only, opened and
+// reopened by the main thread.
+std::mutex gAsyncOutputMutex;
+std::ofstream gAsyncLogFile;
+std::unique_ptr<AsyncLogSink> gAsyncSink;
+std::atomic<AsyncLogSink*> gAsyncSinkPtr{nullptr};
+
+char const* const kAsyncCallbackId = "StellarAsyncLogDispatchCallback";
+char const* const kDefaultCallbackId = "DefaultLogDispatchCallback";
+
+// Formats messages on the thread logging them and hands them to gAsyncSink,
+// in place of easylogging's DefaultLogDispatchCallback.
+class AsyncLogDispatchCallback : public el::LogDispatchCallback
+{
+  protected:
+    void
+    handle(el::LogDispatchData const* data) override
+    {
+        auto sink = gAsyncSinkPtr.load();
+        if (!sink ||
+            data->dispatchAction() != el::base::DispatchAction::NormalLog)
+        {
+            return;
+        }
+        auto msg = data->logMessage();
+        sink->push(msg->logger()->logBuilder()->build(msg, true));
+        if (msg->level() == el::Level::Fatal)
+        {
+            sink->drain();
+        }
+    }
+};
+
+void
+reopenAsyncLogFile()
+{
+    std::lock_guard<std::mutex> lock(gAsyncOutputMutex);
+    if (gAsyncLogFile.is_open())
+    {
+        gAsyncLogFile.close();
+    }
+    // easylogging resolves the %datetime in the file name and opens it, we
+    // append to the same file
+    auto tc = el::Loggers::getLogger("default")->typedConfigurations();
+    if (tc->toFile(el::Level::Info))
+    {
+        gAsyncLogFile.open(tc->filename(el::Level::Info),
+                           std::ios::out | std::ios::app);
+    }
+}
 }
 
 el::Configurations Logging::gDefaultConf;
+std::atomic<int> Logging::gMostVerboseRank{0};
+
+void
+Logging::refreshLevelCache()
+{
+    assert(gPartitionRanks.size() == kLoggers.size() + 1);
+    int mostVerbose = levelRank(getLogLevel("default"));
+    gPartitionRanks[0] = mostVerbose;
+    for (size_t i = 0; i < kLoggers.size(); ++i)
+    {
+        auto rank = levelRank(getLogLevel(kLoggers[i]));
+        gPartitionRanks[i + 1] = rank;
+        mostVerbose = std::min(mostVerbose, rank);
+    }
+    gMostVerboseRank = mostVerbose;
+}
+
+bool
+Logging::isPartitionEnabled(int rank, char const* partition)
+{
+    if (std::strcmp(partition, "default") == 0)
+    {
+        return rank >= gPartitionRanks[0].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kLoggers.size(); ++i)
+    {
+        if (kLoggers[i] == partition)
+        {
+            return rank >=
+                   gPartitionRanks[i + 1].load(std::memory_order_relaxed);
+        }
+    }
+    // not one of ours, easylogging decides
+    return true;
+}
 
 void
 Logging::setFmt(std::string const& peerID, bool timestamps)
@@ -46,6 +143,7 @@ Logging::setFmt(std::string const& peerID, bool timestamps)
     gDefaultConf.set(el::Level::Trace, el::ConfigurationType::Format, longFmt);
     gDefaultConf.set(el::Level::Fatal, el::ConfigurationType::Format, longFmt);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    refreshLevelCache();
 }
 
 void
@@ -71,6 +169,11 @@ Logging::setLoggingToFile(std::string const& filename)
     gDefaultConf.setGlobally(el::ConfigurationType::ToFile, "true");
     gDefaultConf.setGlobally(el::ConfigurationType::Filename, filename);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    refreshLevelCache();
+    if (gAsyncSink)
+    {
+        reopenAsyncLogFile();
+    }
 }
 
 el::Level
@@ -154,6 +257,7 @@ Logging::setLogLevel(el::Level level, const char* partition)
         el::Loggers::reconfigureLogger(partition, config);
     else
         el::Loggers::reconfigureAllLoggers(config);
+    refreshLevelCache();
 }
 
 std::string
@@ -228,5 +332,62 @@ Logging::rotate()
     {
         el::Loggers::getLogger(logger)->reconfigure();
     }
+    if (gAsyncSink)
+    {
+        reopenAsyncLogFile();
+    }
+}
+
+void
+Logging::setAsync(size_t bufferSize, bool dropWhenFull)
+{
+    auto defaultCallback =
+        el::Helpers::logDispatchCallback<el::base::DefaultLogDispatchCallback>(
+            kDefaultCallbackId);
+    if (gAsyncSink)
+    {
+        defaultCallback->setEnabled(true);
+        el::Helpers::uninstallLogDispatchCallback<AsyncLogDispatchCallback>(
+            kAsyncCallbackId);
+        gAsyncSinkPtr = nullptr;
+        gAsyncSink.reset();
+        std::lock_guard<std::mutex> lock(gAsyncOutputMutex);
+        gAsyncLogFile.close();
+    }
+    if (bufferSize == 0)
+    {
+        return;
+    }
+
+    reopenAsyncLogFile();
+    gAsyncSink = std::make_unique<AsyncLogSink>(
+        bufferSize, dropWhenFull,
+        [](std::string const& line) {
+            std::lock_guard<std::mutex> lock(gAsyncOutputMutex);
+            std::cout << line;
+            if (gAsyncLogFile.is_open())
+            {
+                gAsyncLogFile << line;
+            }
+        },
+        []() {
+            std::lock_guard<std::mutex> lock(gAsyncOutputMutex);
+            std::cout.flush();
+            if (gAsyncLogFile.is_open())
+            {
+                gAsyncLogFile.flush();
+            }
+        });
+    gAsyncSinkPtr = gAsyncSink.get();
+    el::Helpers::installLogDispatchCallback<AsyncLogDispatchCallback>(
+        kAsyncCallbackId);
+    defaultCallback->setEnabled(false);
+}
+
+uint64_t
+Logging::flushDroppedMessageCount()
+{
+    auto sink = gAsyncSinkPtr.load();
+    return sink ? sink->takeDropped() : 0;
 }
 }
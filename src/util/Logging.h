@@ -17,13 +17,59 @@
 //  include this file instead
 #include "lib/util/easylogging++.h"
 
+#include <atomic>
+#include <cstdint>
+
 namespace stellar
 {
 class Logging
 {
     static el::Configurations gDefaultConf;
+    // see isEnabled
+    static std::atomic<int> gMostVerboseRank;
+    static void refreshLevelCache();
+    static bool isPartitionEnabled(int rank, char const* partition);
 
   public:
+    // Trace = 0 ... Fatal = 5, None = 6
+    static int
+    levelRank(el::Level level)
+    {
+        switch (level)
+        {
+        case el::Level::Trace:
+            return 0;
+        case el::Level::Debug:
+            return 1;
+        case el::Level::Info:
+            return 2;
+        case el::Level::Warning:
+            return 3;
+        case el::Level::Error:
+            return 4;
+        case el::Level::Fatal:
+            return 5;
+        default:
+            return 6;
+        }
+    }
+
+    // Whether messages at `level` to `partition` are logged, as cached on
+    // every change of levels. Messages more verbose than every partition
+    // are turned down with a single load; CLOG checks this before building
+    // a message, so that disabled messages do not even evaluate their
+    // arguments.
+    static bool
+    isEnabled(el::Level level, char const* partition)
+    {
+        auto rank = levelRank(level);
+        if (rank < gMostVerboseRank.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        return isPartitionEnabled(rank, partition);
+    }
+
     static void init();
     static void setFmt(std::string const& peerID, bool timestamps = true);
     static void setLoggingToFile(std::string const& filename);
@@ -34,5 +80,43 @@ class Logging
     static bool logDebug(std::string const& partition);
     static bool logTrace(std::string const& partition);
     static void rotate();
+
+    // With a non zero `bufferSize`, messages are formatted by the thread
+    // logging them and written to the terminal and log file by a background
+    // thread, through a buffer of that many messages (see AsyncLogSink).
+    // When it is full, messages are dropped if `dropWhenFull` and otherwise
+    // wait for room. Fatal messages wait until they are written. A zero
+    // `bufferSize` writes messages synchronously again.
+    static void setAsync(size_t bufferSize, bool dropWhenFull);
+    // Messages dropped since the last call.
+    static uint64_t flushDroppedMessageCount();
+};
+
+// Turns the writer CLOG streams into void, the type of the branch that
+// skips it.
+struct LogVoidify
+{
+    template <typename W>
+    void
+    operator&(W&)
+    {
+    }
 };
 }
+
+#define STELLAR_LOG_LEVEL_TRACE el::Level::Trace
+#define STELLAR_LOG_LEVEL_DEBUG el::Level::Debug
+#define STELLAR_LOG_LEVEL_INFO el::Level::Info
+#define STELLAR_LOG_LEVEL_WARNING el::Level::Warning
+#define STELLAR_LOG_LEVEL_ERROR el::Level::Error
+#define STELLAR_LOG_LEVEL_FATAL el::Level::Fatal
+
+// Replaces easylogging's CLOG (and so LOG) with one that skips building the
+// message, arguments included, when it would not be logged.
+#undef CLOG
+#define CLOG(LEVEL, partition)                                                 \
+    !stellar::Logging::isEnabled(STELLAR_LOG_LEVEL_##LEVEL, partition)         \
+        ? (void)0                                                              \
+        : stellar::LogVoidify() &                                              \
+              C##LEVEL(el::base::Writer, el::base::DispatchAction::NormalLog,  \
+                       partition)
@@ -16,7 +16,9 @@ size_t rand_pareto(float alpha, size_t max);
 
 bool rand_flip();
 
-extern std::default_random_engine gRandomEngine;
+// one per thread, as threads may run nodes of their own (see
+// Simulation::OVER_LOOPBACK_THREADED)
+extern thread_local std::default_random_engine gRandomEngine;
 
 template <typename T>
 T
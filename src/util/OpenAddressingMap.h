@@ -0,0 +1,337 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Hash map keeping its entries by value in a single array of slots, with
+ * linear probing: no allocation per entry, and lookups that stay within a
+ * few neighbouring slots. The hash of each key is kept in its slot so that
+ * probing and growing never hash a key again. Erasing shifts the following
+ * entries of the probe sequence back, so no tombstones build up.
+ *
+ * Iteration order depends on the hashes: callers needing a stable order
+ * must sort. Inserting may move every entry, invalidating iterators and
+ * references; erasing invalidates them too. Keys must not be changed
+ * through iterators.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename Eq = std::equal_to<K>>
+class OpenAddressingMap
+{
+  public:
+    using value_type = std::pair<K, V>;
+
+  private:
+    struct Slot
+    {
+        size_t mHash{0};
+        bool mUsed{false};
+        value_type mValue;
+    };
+
+    std::vector<Slot> mSlots;
+    size_t mSize{0};
+    Hash mHasher;
+    Eq mEq;
+
+    size_t
+    mask() const
+    {
+        return mSlots.size() - 1;
+    }
+
+    // slot holding `key`, or the empty slot where it would go; the map must
+    // have slots
+    size_t
+    findSlot(K const& key, size_t hash) const
+    {
+        auto m = mask();
+        for (size_t i = hash & m;; i = (i + 1) & m)
+        {
+            auto const& s = mSlots[i];
+            if (!s.mUsed || (s.mHash == hash && mEq(s.mValue.first, key)))
+            {
+                return i;
+            }
+        }
+    }
+
+    void
+    rehash(size_t capacity)
+    {
+        std::vector<Slot> old(capacity);
+        old.swap(mSlots);
+        auto m = mask();
+        for (auto& s : old)
+        {
+            if (s.mUsed)
+            {
+                size_t i = s.mHash & m;
+                while (mSlots[i].mUsed)
+                {
+                    i = (i + 1) & m;
+                }
+                mSlots[i] = std::move(s);
+            }
+        }
+    }
+
+    // at most 3/4 of the slots are used
+    void
+    reserveOneMore()
+    {
+        if (mSlots.empty())
+        {
+            rehash(8);
+        }
+        else if ((mSize + 1) * 4 > mSlots.size() * 3)
+        {
+            rehash(mSlots.size() * 2);
+        }
+    }
+
+    void
+    eraseSlot(size_t i)
+    {
+        auto m = mask();
+        mSlots[i] = Slot();
+        for (size_t j = (i + 1) & m; mSlots[j].mUsed; j = (j + 1) & m)
+        {
+            // the entry in j moves back to i if i is on its probe sequence,
+            // between its home slot and j
+            size_t home = mSlots[j].mHash & m;
+            bool movable = i <= j ? (home <= i || home > j)
+                                  : (home <= i && home > j);
+            if (movable)
+            {
+                mSlots[i] = std::move(mSlots[j]);
+                mSlots[j] = Slot();
+                i = j;
+            }
+        }
+        --mSize;
+    }
+
+    template <typename MapType, typename ValueType> class IteratorT
+    {
+        friend class OpenAddressingMap;
+        MapType* mMap;
+        size_t mIndex;
+
+        void
+        skipUnused()
+        {
+            while (mIndex < mMap->mSlots.size() &&
+                   !mMap->mSlots[mIndex].mUsed)
+            {
+                ++mIndex;
+            }
+        }
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ValueType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = ValueType*;
+        using reference = ValueType&;
+
+        IteratorT(MapType* map, size_t index) : mMap(map), mIndex(index)
+        {
+            skipUnused();
+        }
+
+        // from iterator to const_iterator
+        template <typename OtherMap, typename OtherValue>
+        IteratorT(IteratorT<OtherMap, OtherValue> const& other)
+            : mMap(other.mMap), mIndex(other.mIndex)
+        {
+        }
+
+        reference operator*() const
+        {
+            return mMap->mSlots[mIndex].mValue;
+        }
+
+        pointer operator->() const
+        {
+            return &mMap->mSlots[mIndex].mValue;
+        }
+
+        IteratorT& operator++()
+        {
+            ++mIndex;
+            skipUnused();
+            return *this;
+        }
+
+        bool
+        operator==(IteratorT const& other) const
+        {
+            return mIndex == other.mIndex;
+        }
+
+        bool
+        operator!=(IteratorT const& other) const
+        {
+            return mIndex != other.mIndex;
+        }
+
+        template <typename, typename> friend class IteratorT;
+    };
+
+  public:
+    using iterator = IteratorT<OpenAddressingMap, value_type>;
+    using const_iterator =
+        IteratorT<OpenAddressingMap const, value_type const>;
+
+    iterator
+    begin()
+    {
+        return iterator(this, 0);
+    }
+    iterator
+    end()
+    {
+        return iterator(this, mSlots.size());
+    }
+    const_iterator
+    begin() const
+    {
+        return const_iterator(this, 0);
+    }
+    const_iterator
+    end() const
+    {
+        return const_iterator(this, mSlots.size());
+    }
+    const_iterator
+    cbegin() const
+    {
+        return begin();
+    }
+    const_iterator
+    cend() const
+    {
+        return end();
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+
+    bool
+    empty() const
+    {
+        return mSize == 0;
+    }
+
+    void
+    clear()
+    {
+        mSlots.clear();
+        mSize = 0;
+    }
+
+    iterator
+    find(K const& key)
+    {
+        if (mSize == 0)
+        {
+            return end();
+        }
+        auto i = findSlot(key, mHasher(key));
+        return mSlots[i].mUsed ? iterator(this, i) : end();
+    }
+
+    const_iterator
+    find(K const& key) const
+    {
+        if (mSize == 0)
+        {
+            return end();
+        }
+        auto i = findSlot(key, mHasher(key));
+        return mSlots[i].mUsed ? const_iterator(this, i) : end();
+    }
+
+    size_t
+    count(K const& key) const
+    {
+        return find(key) == end() ? 0 : 1;
+    }
+
+    V const&
+    at(K const& key) const
+    {
+        auto it = find(key);
+        if (it == end())
+        {
+            throw std::out_of_range("OpenAddressingMap::at");
+        }
+        return it->second;
+    }
+
+    // Inserts `value` for `key` unless the map has `key` already; returns
+    // the entry for `key` and whether it was inserted.
+    std::pair<iterator, bool>
+    emplace(K const& key, V value)
+    {
+        reserveOneMore();
+        auto hash = mHasher(key);
+        auto i = findSlot(key, hash);
+        auto& s = mSlots[i];
+        if (s.mUsed)
+        {
+            return std::make_pair(iterator(this, i), false);
+        }
+        s.mHash = hash;
+        s.mUsed = true;
+        s.mValue = value_type(key, std::move(value));
+        ++mSize;
+        return std::make_pair(iterator(this, i), true);
+    }
+
+    V& operator[](K const& key)
+    {
+        return emplace(key, V()).first->second;
+    }
+
+    size_t
+    erase(K const& key)
+    {
+        if (mSize == 0)
+        {
+            return 0;
+        }
+        auto i = findSlot(key, mHasher(key));
+        if (!mSlots[i].mUsed)
+        {
+            return 0;
+        }
+        eraseSlot(i);
+        return 1;
+    }
+
+    void
+    erase(const_iterator it)
+    {
+        assert(it.mMap == this && mSlots[it.mIndex].mUsed);
+        eraseSlot(it.mIndex);
+    }
+};
+}
@@ -0,0 +1,77 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/OpenAddressingMap.h"
+
+#include <map>
+#include <random>
+#include <string>
+
+using namespace stellar;
+
+namespace
+{
+// few hash values, so that probe sequences collide and wrap around
+struct CollidingHash
+{
+    size_t
+    operator()(int k) const
+    {
+        return static_cast<size_t>(k % 5);
+    }
+};
+}
+
+TEST_CASE("open addressing map basics", "[openaddressingmap]")
+{
+    OpenAddressingMap<int, std::string> m;
+    REQUIRE(m.empty());
+    REQUIRE(m.find(1) == m.end());
+    REQUIRE(m.erase(1) == 0);
+
+    REQUIRE(m.emplace(1, "one").second);
+    REQUIRE(!m.emplace(1, "uno").second);
+    REQUIRE(m.at(1) == "one");
+    m[2] = "two";
+    REQUIRE(m.size() == 2);
+    REQUIRE(m.count(2) == 1);
+    REQUIRE_THROWS_AS(m.at(3), std::out_of_range);
+
+    m.erase(m.find(1));
+    REQUIRE(m.count(1) == 0);
+    REQUIRE(m.size() == 1);
+    m.clear();
+    REQUIRE(m.empty());
+    REQUIRE(m.begin() == m.end());
+}
+
+TEST_CASE("open addressing map matches std::map", "[openaddressingmap]")
+{
+    OpenAddressingMap<int, int, CollidingHash> m;
+    std::map<int, int> expected;
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> key(0, 200);
+    for (int i = 0; i < 10000; ++i)
+    {
+        auto k = key(gen);
+        if (i % 3 == 0)
+        {
+            REQUIRE(m.erase(k) == expected.erase(k));
+        }
+        else
+        {
+            m[k] = i;
+            expected[k] = i;
+        }
+        REQUIRE(m.size() == expected.size());
+    }
+
+    std::map<int, int> got(m.begin(), m.end());
+    REQUIRE(got == expected);
+    for (auto const& e : expected)
+    {
+        REQUIRE(m.at(e.first) == e.second);
+    }
+}
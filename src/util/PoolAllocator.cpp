@@ -0,0 +1,111 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/PoolAllocator.h"
+
+#include <array>
+
+namespace stellar
+{
+
+namespace
+{
+struct FreeBlock
+{
+    FreeBlock* mNext;
+};
+
+struct FreeList
+{
+    FreeBlock* mHead{nullptr};
+    size_t mSize{0};
+};
+
+size_t const NUM_CLASSES = BlockPool::MAX_BLOCK_SIZE / BlockPool::BLOCK_ALIGN;
+
+struct FreeLists
+{
+    std::array<FreeList, NUM_CLASSES> mLists;
+    // Cleared once the thread's lists are gone, for blocks freed by objects
+    // that outlive them (statics destroyed at exit).
+    bool mAlive{true};
+
+    ~FreeLists()
+    {
+        mAlive = false;
+        for (auto& l : mLists)
+        {
+            while (l.mHead)
+            {
+                auto next = l.mHead->mNext;
+                ::operator delete(l.mHead);
+                l.mHead = next;
+            }
+        }
+    }
+};
+
+thread_local FreeLists gFreeLists;
+
+size_t
+sizeClass(size_t bytes)
+{
+    return (bytes + BlockPool::BLOCK_ALIGN - 1) / BlockPool::BLOCK_ALIGN - 1;
+}
+}
+
+void*
+BlockPool::allocate(size_t bytes)
+{
+    if (bytes == 0 || bytes > MAX_BLOCK_SIZE)
+    {
+        return ::operator new(bytes);
+    }
+    auto c = sizeClass(bytes);
+    auto& l = gFreeLists.mLists[c];
+    if (!gFreeLists.mAlive || !l.mHead)
+    {
+        return ::operator new((c + 1) * BLOCK_ALIGN);
+    }
+    auto res = l.mHead;
+    l.mHead = res->mNext;
+    l.mSize--;
+    return res;
+}
+
+void
+BlockPool::deallocate(void* p, size_t bytes)
+{
+    if (!p)
+    {
+        return;
+    }
+    if (bytes == 0 || bytes > MAX_BLOCK_SIZE || !gFreeLists.mAlive)
+    {
+        ::operator delete(p);
+        return;
+    }
+    auto& l = gFreeLists.mLists[sizeClass(bytes)];
+    if (l.mSize >= MAX_FREE_BLOCKS)
+    {
+        ::operator delete(p);
+        return;
+    }
+    auto b = static_cast<FreeBlock*>(p);
+    b->mNext = l.mHead;
+    l.mHead = b;
+    l.mSize++;
+}
+
+size_t
+BlockPool::freeBlocks()
+{
+    size_t res = 0;
+    for (auto const& l : gFreeLists.mLists)
+    {
+        res += l.mSize;
+    }
+    return res;
+}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace stellar
+{
+
+/**
+ * BlockPool keeps freed small blocks on per-size free lists instead of
+ * returning them to malloc, so that the many short-lived frames and map
+ * nodes created while closing a ledger reuse the memory of the previous
+ * ones. Blocks are rounded up to a multiple of BLOCK_ALIGN; larger requests
+ * go straight to the global operator new.
+ *
+ * Free lists are per thread and need no locking. A block freed on another
+ * thread than the one that allocated it simply joins that thread's list.
+ * Each list holds at most MAX_FREE_BLOCKS blocks, the rest are released.
+ */
+class BlockPool
+{
+  public:
+    static size_t const BLOCK_ALIGN = alignof(std::max_align_t);
+    static size_t const MAX_BLOCK_SIZE = 512;
+    static size_t const MAX_FREE_BLOCKS = 4096;
+
+    static void* allocate(size_t bytes);
+    static void deallocate(void* p, size_t bytes);
+
+    // Blocks currently on this thread's free lists, for tests.
+    static size_t freeBlocks();
+};
+
+// Standard allocator drawing single objects from BlockPool.
+template <typename T> class PoolAllocator
+{
+  public:
+    typedef T value_type;
+
+    PoolAllocator() = default;
+
+    template <typename U> PoolAllocator(PoolAllocator<U> const&)
+    {
+    }
+
+    T*
+    allocate(size_t n)
+    {
+        if (n != 1)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(BlockPool::allocate(sizeof(T)));
+    }
+
+    void
+    deallocate(T* p, size_t n)
+    {
+        if (n != 1)
+        {
+            ::operator delete(p);
+            return;
+        }
+        BlockPool::deallocate(p, sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool
+operator==(PoolAllocator<T> const&, PoolAllocator<U> const&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool
+operator!=(PoolAllocator<T> const&, PoolAllocator<U> const&)
+{
+    return false;
+}
+
+// make_shared, with the object and its control block taken from BlockPool.
+template <typename T, typename... Args>
+std::shared_ptr<T>
+makePooled(Args&&... args)
+{
+    return std::allocate_shared<T>(PoolAllocator<T>(),
+                                   std::forward<Args>(args)...);
+}
+}
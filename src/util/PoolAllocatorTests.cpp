@@ -0,0 +1,51 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/PoolAllocator.h"
+
+#include <map>
+#include <string>
+
+using namespace stellar;
+
+TEST_CASE("block pool reuses freed blocks", "[poolallocator]")
+{
+    auto before = BlockPool::freeBlocks();
+    void* a = BlockPool::allocate(40);
+    BlockPool::deallocate(a, 40);
+    REQUIRE(BlockPool::freeBlocks() == before + 1);
+
+    // same size class
+    void* b = BlockPool::allocate(33);
+    REQUIRE(b == a);
+    REQUIRE(BlockPool::freeBlocks() == before);
+    BlockPool::deallocate(b, 33);
+
+    // too large to pool
+    void* big = BlockPool::allocate(BlockPool::MAX_BLOCK_SIZE + 1);
+    BlockPool::deallocate(big, BlockPool::MAX_BLOCK_SIZE + 1);
+    REQUIRE(BlockPool::freeBlocks() == before + 1);
+}
+
+TEST_CASE("pool allocator in containers and shared pointers",
+          "[poolallocator]")
+{
+    std::map<int, std::string, std::less<int>,
+             PoolAllocator<std::pair<int const, std::string>>>
+        m;
+    for (int i = 0; i < 100; ++i)
+    {
+        m[i] = std::to_string(i);
+    }
+    REQUIRE(m.size() == 100);
+    REQUIRE(m[42] == "42");
+    m.clear();
+    REQUIRE(BlockPool::freeBlocks() >= 100);
+
+    auto p = makePooled<std::string>("pooled");
+    auto q = p;
+    p.reset();
+    REQUIRE(*q == "pooled");
+}
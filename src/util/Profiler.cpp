@@ -0,0 +1,242 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Profiler.h"
+#include "lib/util/format.h"
+#include "util/GlobalChecks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/time.h>
+#endif
+
+namespace stellar
+{
+
+namespace
+{
+thread_local char const* tProfileTag = nullptr;
+
+#ifndef _WIN32
+struct Sample
+{
+    int mDepth;
+    bool mMain;
+    char const* mTag;
+    void* mFrames[Profiler::MAX_DEPTH];
+};
+
+// frames of the signal handler and of the signal trampoline
+int const HANDLER_FRAMES = 2;
+
+std::unique_ptr<Sample[]> gSamples;
+std::atomic<size_t> gNextSample{0};
+std::atomic<size_t> gDropped{0};
+std::atomic<int> gInHandler{0};
+std::atomic<bool> gRunning{false};
+bool gHandlerInstalled{false};
+
+void
+onProfSignal(int)
+{
+    auto savedErrno = errno;
+    ++gInHandler;
+    if (gRunning)
+    {
+        auto i = gNextSample.fetch_add(1);
+        if (i < Profiler::MAX_SAMPLES)
+        {
+            auto& s = gSamples[i];
+            s.mDepth = backtrace(s.mFrames, Profiler::MAX_DEPTH);
+            s.mMain = threadIsMain();
+            s.mTag = tProfileTag;
+        }
+        else
+        {
+            ++gDropped;
+        }
+    }
+    --gInHandler;
+    errno = savedErrno;
+}
+
+std::string
+frameName(void* address)
+{
+    Dl_info info;
+    if (dladdr(address, &info) == 0)
+    {
+        return fmt::format("{}", address);
+    }
+    auto addr = reinterpret_cast<uintptr_t>(address);
+    if (info.dli_sname)
+    {
+        int status = 0;
+        auto demangled =
+            abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 ? demangled : info.dli_sname;
+        free(demangled);
+        return fmt::format("{}+{:#x}", name,
+                           addr - reinterpret_cast<uintptr_t>(info.dli_saddr));
+    }
+    std::string module = info.dli_fname ? info.dli_fname : "?";
+    auto slash = module.rfind('/');
+    if (slash != std::string::npos)
+    {
+        module = module.substr(slash + 1);
+    }
+    return fmt::format("{}+{:#x}", module,
+                       addr - reinterpret_cast<uintptr_t>(info.dli_fbase));
+}
+#endif
+}
+
+size_t const Profiler::MAX_SAMPLES;
+size_t const Profiler::MAX_DEPTH;
+
+bool
+Profiler::start(std::chrono::microseconds interval)
+{
+#ifdef _WIN32
+    return false;
+#else
+    assertThreadIsMain();
+    if (gRunning)
+    {
+        return false;
+    }
+    if (!gSamples)
+    {
+        gSamples = std::make_unique<Sample[]>(MAX_SAMPLES);
+    }
+    gNextSample = 0;
+    gDropped = 0;
+
+    // the first backtrace() loads the unwinder, which must not happen in the
+    // signal handler
+    void* warmup[1];
+    backtrace(warmup, 1);
+
+    // The handler stays installed after stop(), as a SIGPROF might still be
+    // pending then; it does nothing when not running.
+    if (!gHandlerInstalled)
+    {
+        struct sigaction action;
+        action.sa_handler = onProfSignal;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGPROF, &action, nullptr);
+        gHandlerInstalled = true;
+    }
+    gRunning = true;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval.count() / 1000000;
+    timer.it_interval.tv_usec = interval.count() % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    return true;
+#endif
+}
+
+bool
+Profiler::isRunning()
+{
+#ifdef _WIN32
+    return false;
+#else
+    return gRunning;
+#endif
+}
+
+std::string
+Profiler::stop()
+{
+#ifdef _WIN32
+    return {};
+#else
+    assertThreadIsMain();
+    if (!gRunning)
+    {
+        return {};
+    }
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    gRunning = false;
+    // wait out handlers already running on other threads
+    while (gInHandler != 0)
+    {
+        std::this_thread::yield();
+    }
+
+    auto count = std::min<size_t>(gNextSample, MAX_SAMPLES);
+    std::unordered_map<void*, std::string> names;
+    std::map<std::string, size_t> stacks;
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto const& s = gSamples[i];
+        std::string stack = s.mMain ? "main" : "worker";
+        if (s.mTag)
+        {
+            stack += ";";
+            stack += s.mTag;
+        }
+        for (int f = s.mDepth - 1; f >= HANDLER_FRAMES; --f)
+        {
+            auto& name = names[s.mFrames[f]];
+            if (name.empty())
+            {
+                name = frameName(s.mFrames[f]);
+            }
+            stack += ";";
+            stack += name;
+        }
+        ++stacks[stack];
+    }
+
+    std::string out;
+    for (auto const& kv : stacks)
+    {
+        out += fmt::format("{} {}\n", kv.first, kv.second);
+    }
+    return out;
+#endif
+}
+
+size_t
+Profiler::getDropped()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    return gDropped;
+#endif
+}
+
+ProfileScope::ProfileScope(char const* tag) : mPrevious(tProfileTag)
+{
+    tProfileTag = tag;
+    std::atomic_signal_fence(std::memory_order_release);
+}
+
+ProfileScope::~ProfileScope()
+{
+    std::atomic_signal_fence(std::memory_order_release);
+    tProfileTag = mPrevious;
+}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace stellar
+{
+
+/**
+ * In-process sampling profiler, for looking at a running node without
+ * attaching perf to it (see the /profile command).
+ *
+ * While running, the process gets a SIGPROF for every `interval` of CPU time
+ * it uses, delivered to the thread using it, main or worker alike. The
+ * handler records the thread's stack, whether it is the main thread and the
+ * innermost ProfileScope tag, into a buffer allocated by start(); samples
+ * beyond its MAX_SAMPLES are counted and dropped.
+ *
+ * stop() returns the samples collapsed into the input format of
+ * flamegraph.pl, one "main;tag;outermost;...;innermost count" line per
+ * distinct stack. Frames are named through dladdr as "symbol+0xoffset", or as
+ * "module+0xoffset" (for addr2line) when the symbol is not exported.
+ *
+ * Not available on Windows, where start() returns false.
+ */
+class Profiler
+{
+  public:
+    static size_t const MAX_SAMPLES = 0x8000;
+    static size_t const MAX_DEPTH = 48;
+
+    // Returns false if a profile is already running or profiling is not
+    // supported.
+    static bool start(std::chrono::microseconds interval =
+                          std::chrono::microseconds(10000));
+    static bool isRunning();
+    // Stops the running profile, returns its collapsed stacks.
+    static std::string stop();
+    // Samples dropped by the last profile for lack of room.
+    static size_t getDropped();
+};
+
+// Tags the samples taken on this thread while in scope with `tag`, which must
+// be a string literal. Costs a thread local store.
+class ProfileScope
+{
+    char const* mPrevious;
+
+  public:
+    explicit ProfileScope(char const* tag);
+    ~ProfileScope();
+    ProfileScope(ProfileScope const&) = delete;
+    ProfileScope& operator=(ProfileScope const&) = delete;
+};
+}
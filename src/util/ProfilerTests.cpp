@@ -0,0 +1,65 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/Profiler.h"
+
+#include <chrono>
+#include <sstream>
+
+using namespace stellar;
+
+#ifndef _WIN32
+namespace
+{
+volatile uint64_t gSink;
+
+void
+burnCpu(std::chrono::milliseconds duration)
+{
+    auto end = std::clock() + duration.count() * CLOCKS_PER_SEC / 1000;
+    uint64_t x = 1;
+    while (std::clock() < end)
+    {
+        for (int i = 0; i < 10000; ++i)
+        {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+    }
+    gSink = x;
+}
+}
+
+TEST_CASE("profiler collapses tagged stacks", "[profiler]")
+{
+    REQUIRE(Profiler::start(std::chrono::milliseconds(1)));
+    REQUIRE(Profiler::isRunning());
+    REQUIRE(!Profiler::start());
+    {
+        ProfileScope scope("test-scope");
+        burnCpu(std::chrono::milliseconds(200));
+    }
+    auto collapsed = Profiler::stop();
+    REQUIRE(!Profiler::isRunning());
+
+    size_t samples = 0;
+    size_t tagged = 0;
+    std::istringstream lines(collapsed);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        auto space = line.rfind(' ');
+        REQUIRE(space != std::string::npos);
+        auto count = std::stoul(line.substr(space + 1));
+        samples += count;
+        if (line.compare(0, 16, "main;test-scope;") == 0)
+        {
+            tagged += count;
+        }
+    }
+    REQUIRE(samples + Profiler::getDropped() > 0);
+    REQUIRE(tagged > samples / 2);
+    REQUIRE(Profiler::stop().empty());
+}
+#endif
@@ -0,0 +1,127 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/PrometheusReporter.h"
+#include "util/LatencyHistogram.h"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
+
+#include <cctype>
+
+namespace stellar
+{
+
+namespace
+{
+double const QUANTILES[] = {0.5, 0.75, 0.99, 0.999};
+
+void
+writeSummary(std::ostream& out, std::string const& name,
+             medida::stats::Snapshot const& snapshot, double sum,
+             uint64_t count, double scale)
+{
+    out << "# TYPE " << name << " summary\n";
+    for (auto q : QUANTILES)
+    {
+        out << name << "{quantile=\"" << q << "\"} "
+            << snapshot.getValue(q) * scale << "\n";
+    }
+    out << name << "_sum " << sum * scale << "\n";
+    out << name << "_count " << count << "\n";
+}
+}
+
+PrometheusReporter::PrometheusReporter(medida::MetricsRegistry& registry,
+                                       LatencyHistograms const& histograms)
+    : mRegistry(registry), mHistograms(histograms)
+{
+    mOut.precision(12);
+}
+
+std::string
+PrometheusReporter::Report()
+{
+    mOut.str("");
+    for (auto const& kv : mRegistry.GetAllMetrics())
+    {
+        mName = &kv.first;
+        kv.second->Process(*this);
+    }
+    mName = nullptr;
+    return mOut.str();
+}
+
+std::string
+PrometheusReporter::exportedName(medida::MetricName const& name)
+{
+    std::string res = "stellar_core_" + name.domain() + "_" + name.type() +
+                      "_" + name.name();
+    for (auto& c : res)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(c)))
+        {
+            c = '_';
+        }
+    }
+    return res;
+}
+
+void
+PrometheusReporter::Process(medida::Counter& counter)
+{
+    auto name = exportedName(*mName);
+    mOut << "# TYPE " << name << " gauge\n";
+    mOut << name << " " << counter.count() << "\n";
+}
+
+void
+PrometheusReporter::Process(medida::Meter& meter)
+{
+    auto name = exportedName(*mName) + "_total";
+    mOut << "# TYPE " << name << " counter\n";
+    mOut << name << " " << meter.count() << "\n";
+}
+
+void
+PrometheusReporter::Process(medida::Histogram& histogram)
+{
+    writeSummary(mOut, exportedName(*mName), histogram.GetSnapshot(),
+                 histogram.sum(), histogram.count(), 1.0);
+}
+
+void
+PrometheusReporter::Process(medida::Timer& timer)
+{
+    auto name = exportedName(*mName) + "_seconds";
+    auto latency = mHistograms.find(*mName);
+    if (!latency)
+    {
+        // medida keeps its values in the duration unit of the timer
+        double scale = timer.duration_unit().count() / 1e9;
+        writeSummary(mOut, name, timer.GetSnapshot(), timer.sum(),
+                     timer.count(), scale);
+        return;
+    }
+
+    mOut << "# TYPE " << name << " histogram\n";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i + 1 < LatencyHistogram::BUCKETS; ++i)
+    {
+        cumulative += latency->bucketCount(i);
+        mOut << name << "_bucket{le=\""
+             << LatencyHistogram::bucketBound(i).count() / 1e9 << "\"} "
+             << cumulative << "\n";
+    }
+    // the total of the buckets rather than latency->count(), which
+    // concurrent updates may have moved on from
+    cumulative += latency->bucketCount(LatencyHistogram::BUCKETS - 1);
+    mOut << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    mOut << name << "_sum " << latency->sum().count() / 1e9 << "\n";
+    mOut << name << "_count " << cumulative << "\n";
+}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "medida/metrics_registry.h"
+#include <sstream>
+#include <string>
+
+namespace stellar
+{
+
+class LatencyHistograms;
+
+/**
+ * Writes a metrics registry in the Prometheus text exposition format, for
+ * the /prometheus command.
+ *
+ * The metric {domain, type, name} is named stellar_core_domain_type_name,
+ * with anything but letters and digits replaced by '_', and exported as:
+ * - a counter: a gauge, as most of them hold a current size or state
+ * - a meter: a counter of its events, NAME_total
+ * - a timer with a LatencyHistogram: a histogram of seconds, whose buckets,
+ *   sum and count cover every duration since the start
+ * - another timer or a histogram: a summary of the 0.5, 0.75, 0.99 and 0.999
+ *   quantiles of medida's decaying sample, with the sum and count of every
+ *   value since the start; in seconds for a timer
+ */
+class PrometheusReporter : public medida::MetricProcessor
+{
+  public:
+    PrometheusReporter(medida::MetricsRegistry& registry,
+                       LatencyHistograms const& histograms);
+    ~PrometheusReporter() override = default;
+
+    std::string Report();
+
+    void Process(medida::Counter& counter) override;
+    void Process(medida::Meter& meter) override;
+    void Process(medida::Histogram& histogram) override;
+    void Process(medida::Timer& timer) override;
+
+    // The exported name of `name`, without suffix.
+    static std::string exportedName(medida::MetricName const& name);
+
+  private:
+    medida::MetricsRegistry& mRegistry;
+    LatencyHistograms const& mHistograms;
+    medida::MetricName const* mName{nullptr};
+    std::ostringstream mOut;
+};
+}
@@ -0,0 +1,49 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/TimeSlicer.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace stellar
+{
+
+TimeSlicer::TimeSlicer(VirtualClock& clock, medida::Timer& sliceTimer,
+                       std::chrono::milliseconds budget, size_t maxUnits)
+    : mClock(clock)
+    , mSliceTimer(sliceTimer)
+    , mBudget(std::chrono::duration_cast<VirtualClock::duration>(budget))
+    , mMaxUnits(std::max<size_t>(maxUnits, 1))
+{
+}
+
+size_t
+TimeSlicer::start()
+{
+    mStart = mClock.now();
+    return mUnits;
+}
+
+void
+TimeSlicer::finish(size_t units)
+{
+    auto elapsed = mClock.now() - mStart;
+    mSliceTimer.Update(elapsed);
+    if (units == 0 || elapsed <= VirtualClock::duration::zero())
+    {
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    double rate = units / seconds;
+    mRate = (mRate == 0) ? rate : 0.75 * mRate + 0.25 * rate;
+
+    double budget = std::chrono::duration<double>(mBudget).count();
+    auto target = static_cast<size_t>(std::min<double>(
+        std::round(budget * mRate), static_cast<double>(mMaxUnits)));
+    mUnits = std::max<size_t>(1, std::min(target, 2 * mUnits));
+}
+}
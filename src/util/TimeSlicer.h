@@ -0,0 +1,57 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Timer.h"
+#include <chrono>
+#include <cstddef>
+
+namespace medida
+{
+class Timer;
+}
+
+namespace stellar
+{
+
+/**
+ * Sizes the slices of a long job that runs on the main thread a few units
+ * (bucket batches, ledgers) at a time, so that each slice takes about
+ * `budget` as measured by the clock, whatever the units happen to cost.
+ *
+ * The throughput of earlier slices is smoothed and the next slice sized to
+ * fit the budget at that rate, growing at most twofold from one slice to the
+ * next. Slices that take no time on the clock (ie. in virtual time) leave the
+ * size alone. Every slice's duration goes to `sliceTimer`.
+ */
+class TimeSlicer
+{
+    VirtualClock& mClock;
+    medida::Timer& mSliceTimer;
+    VirtualClock::duration const mBudget;
+    size_t const mMaxUnits;
+
+    size_t mUnits{1};
+    // units per second, 0 until a slice has been measured
+    double mRate{0};
+    VirtualClock::time_point mStart;
+
+  public:
+    TimeSlicer(VirtualClock& clock, medida::Timer& sliceTimer,
+               std::chrono::milliseconds budget, size_t maxUnits);
+
+    // Starts a slice, returning the number of units to do in it.
+    size_t start();
+
+    // Ends the slice started last, in which `units` were done.
+    void finish(size_t units);
+
+    size_t
+    getUnits() const
+    {
+        return mUnits;
+    }
+};
+}
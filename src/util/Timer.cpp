@@ -6,6 +6,11 @@
 #include "main/Application.h"
 #include "util/GlobalChecks.h"
 #include "util/Logging.h"
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <thread>
@@ -17,6 +22,78 @@ using namespace std;
 
 static const uint32_t RECENT_CRANK_WINDOW = 1024;
 
+// Fired and cancelled events each VirtualTimer keeps around for reuse.
+static const size_t MAX_SPARE_EVENTS = 2;
+
+namespace
+{
+uint64_t
+toTick(VirtualClock::time_point t)
+{
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  t.time_since_epoch())
+                  .count();
+    return ms < 0 ? 0 : static_cast<uint64_t>(ms);
+}
+
+size_t
+lowestBit(uint64_t x)
+{
+    size_t i = 0;
+    while (!(x & 1))
+    {
+        x >>= 1;
+        ++i;
+    }
+    return i;
+}
+
+VirtualClock::time_point
+minWhen(VirtualClockEventLink const& head)
+{
+    auto least = VirtualClock::time_point::max();
+    for (auto l = head.mNext; l != &head; l = l->mNext)
+    {
+        least =
+            std::min(least, static_cast<VirtualClockEvent const*>(l)->mWhen);
+    }
+    return least;
+}
+}
+
+void
+VirtualClockEventLink::pushBack(VirtualClockEventLink& link)
+{
+    link.mPrev = mPrev;
+    link.mNext = this;
+    mPrev->mNext = &link;
+    mPrev = &link;
+}
+
+void
+VirtualClockEventLink::spliceBack(VirtualClockEventLink& head)
+{
+    if (head.empty())
+    {
+        return;
+    }
+    head.mNext->mPrev = mPrev;
+    head.mPrev->mNext = this;
+    mPrev->mNext = head.mNext;
+    mPrev = head.mPrev;
+    head.mPrev = &head;
+    head.mNext = &head;
+}
+
+void
+VirtualClockEventLink::unlink()
+{
+    mPrev->mNext = mNext;
+    mNext->mPrev = mPrev;
+    mPrev = this;
+    mNext = this;
+}
+
 VirtualClock::VirtualClock(Mode mode) : mRealTimer(mIOService), mMode(mode)
 {
     resetIdleCrankPercent();
@@ -24,6 +101,9 @@ VirtualClock::VirtualClock(Mode mode) : mRealTimer(mIOService), mMode(mode)
     {
         mNow = std::chrono::system_clock::now();
     }
+    mWheelTick = toTick(mNow);
+    mWheelOccupied.fill(0);
+    mRealTimer.expires_at(time_point::max());
 }
 
 VirtualClock::time_point
@@ -59,26 +139,175 @@ VirtualClock::maybeSetRealtimer()
     }
 }
 
+VirtualClock::time_point
+VirtualClock::next()
+{
+    assertThreadIsMain();
+    // events of the current tick come before any other
+    auto& current = mWheel[0][mWheelTick % WHEEL_SLOTS];
+    if (!current.empty())
+    {
+        return minWhen(current);
+    }
+    size_t level, slot;
+    uint64_t start;
+    if (nextOccupiedSlot(level, slot, start))
+    {
+        return minWhen(mWheel[level][slot]);
+    }
+    return minWhen(mWheelOverflow);
+}
+
+void
+VirtualClock::place(VirtualClockEvent& ev)
+{
+    auto tick = std::max(toTick(ev.mWhen), mWheelTick);
+    auto diff = tick ^ mWheelTick;
+    size_t level = 0;
+    while (level < WHEEL_LEVELS &&
+           (diff >> (WHEEL_SLOT_BITS * (level + 1))) != 0)
+    {
+        ++level;
+    }
+    if (level == WHEEL_LEVELS)
+    {
+        mWheelOverflow.pushBack(ev);
+        return;
+    }
+    auto slot = (tick >> (WHEEL_SLOT_BITS * level)) % WHEEL_SLOTS;
+    mWheel[level][slot].pushBack(ev);
+    mWheelOccupied[level] |= uint64_t(1) << slot;
+}
+
+void
+VirtualClock::cascade(VirtualClockEventLink& head)
+{
+    VirtualClockEventLink events;
+    events.spliceBack(head);
+    while (!events.empty())
+    {
+        auto ev = static_cast<VirtualClockEvent*>(events.mNext);
+        ev->unlink();
+        place(*ev);
+    }
+}
+
 bool
-VirtualClockEventCompare::operator()(shared_ptr<VirtualClockEvent> a,
-                                     shared_ptr<VirtualClockEvent> b)
+VirtualClock::nextOccupiedSlot(size_t& level, size_t& slot, uint64_t& start)
 {
-    return *a < *b;
+    // Slots past the current one at level 0 are earlier than those past the
+    // current one at level 1, and so on. Bits of slots found empty (as their
+    // events were cancelled) are cleared on the way.
+    for (level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        auto shift = WHEEL_SLOT_BITS * level;
+        auto digit = (mWheelTick >> shift) % WHEEL_SLOTS;
+        if (digit + 1 == WHEEL_SLOTS)
+        {
+            continue;
+        }
+        auto candidates = mWheelOccupied[level] & (~uint64_t(0) << (digit + 1));
+        while (candidates != 0)
+        {
+            slot = lowestBit(candidates);
+            auto bit = uint64_t(1) << slot;
+            if (mWheel[level][slot].empty())
+            {
+                mWheelOccupied[level] &= ~bit;
+                candidates &= ~bit;
+                continue;
+            }
+            auto above = shift + WHEEL_SLOT_BITS;
+            start = ((mWheelTick >> above) << above) |
+                    (static_cast<uint64_t>(slot) << shift);
+            return true;
+        }
+    }
+    return false;
 }
 
-VirtualClock::time_point
-VirtualClock::next()
+size_t
+VirtualClock::takeDueEvents(VirtualClockEventLink& slot, time_point n,
+                            VirtualClockEventLink& due)
 {
-    assertThreadIsMain();
-    VirtualClock::time_point least = time_point::max();
-    if (!mEvents.empty())
+    mDueScratch.clear();
+    for (auto l = slot.mNext; l != &slot; l = l->mNext)
     {
-        if (mEvents.top()->mWhen < least)
+        auto ev = static_cast<VirtualClockEvent*>(l);
+        if (ev->mWhen <= n)
         {
-            least = mEvents.top()->mWhen;
+            mDueScratch.push_back(ev);
         }
     }
-    return least;
+    // To break time-based ties but preserve the ordering in which events
+    // were enqueued, events also compare by sequence number.
+    std::stable_sort(mDueScratch.begin(), mDueScratch.end(),
+                     [](VirtualClockEvent* a, VirtualClockEvent* b) {
+                         return a->mWhen < b->mWhen ||
+                                (a->mWhen == b->mWhen && a->mSeq < b->mSeq);
+                     });
+    for (auto ev : mDueScratch)
+    {
+        ev->unlink();
+        due.pushBack(*ev);
+    }
+    return mDueScratch.size();
+}
+
+size_t
+VirtualClock::collectDueEvents(time_point n, VirtualClockEventLink& due)
+{
+    auto const blockShift = WHEEL_SLOT_BITS * WHEEL_LEVELS;
+    auto target = toTick(n);
+    size_t count = 0;
+    for (;;)
+    {
+        auto& current = mWheel[0][mWheelTick % WHEEL_SLOTS];
+        count += takeDueEvents(current, n, due);
+        if (!current.empty() || mWheelTick >= target)
+        {
+            break;
+        }
+
+        size_t level, slot;
+        uint64_t start;
+        if (nextOccupiedSlot(level, slot, start))
+        {
+            if (start > target)
+            {
+                mWheelTick = target;
+                break;
+            }
+            mWheelTick = start;
+            if (level != 0)
+            {
+                mWheelOccupied[level] &= ~(uint64_t(1) << slot);
+                cascade(mWheel[level][slot]);
+            }
+            continue;
+        }
+
+        // Only events beyond the range of the wheel are left, they need to
+        // be placed again once it moves into theirs.
+        if (mWheelOverflow.empty() ||
+            (target >> blockShift) == (mWheelTick >> blockShift))
+        {
+            mWheelTick = target;
+            break;
+        }
+        mWheelTick = std::min(target, toTick(minWhen(mWheelOverflow)));
+        cascade(mWheelOverflow);
+    }
+    return count;
+}
+
+void
+VirtualClock::dequeue(VirtualClockEvent& ev)
+{
+    assert(ev.mClock == this);
+    --mEventCount;
+    ev.mClock = nullptr;
+    ev.unlink();
 }
 
 VirtualClock::time_point
@@ -167,71 +396,57 @@ VirtualClock::pointToISOString(time_point point)
 }
 
 void
-VirtualClock::enqueue(shared_ptr<VirtualClockEvent> ve)
+VirtualClock::enqueue(VirtualClockEvent& ve)
 {
     if (mDestructing)
     {
         return;
     }
     assertThreadIsMain();
+    assert(!ve.mClock);
     // LOG(DEBUG) << "VirtualClock::enqueue";
-    mEvents.emplace(ve);
-    maybeSetRealtimer();
+    ve.mClock = this;
+    ++mEventCount;
+    place(ve);
+    // cancelled events are left to fire the real timer in vain, as before
+    if (mMode == REAL_TIME && ve.mWhen < mRealTimer.expires_at())
+    {
+        maybeSetRealtimer();
+    }
 }
 
-void
-VirtualClock::flushCancelledEvents()
+bool
+VirtualClock::cancelAllEvents()
 {
-    if (mDestructing)
-    {
-        return;
-    }
-    if (mFlushesIgnored <= mEvents.size())
-    {
-        // Flushing all the canceled events immediately can lead to
-        // a O(n^2) loop if many events in the queue are canceled one a time.
-        //
-        // By ignoring O(n) flushes, we batch the iterations together and
-        // restore O(n) performance.
-        mFlushesIgnored++;
-        return;
-    }
     assertThreadIsMain();
-    // LOG(DEBUG) << "VirtualClock::cancelAllEventsFrom";
-
-    auto toKeep = vector<shared_ptr<VirtualClockEvent>>();
-    toKeep.reserve(mEvents.size());
 
-    while (!mEvents.empty())
+    VirtualClockEventLink events;
+    for (auto& level : mWheel)
     {
-        auto const& e = mEvents.top();
-        if (!e->getTriggered())
+        for (auto& slot : level)
         {
-            toKeep.emplace_back(e);
+            events.spliceBack(slot);
         }
-        mEvents.pop();
     }
-    mFlushesIgnored = 0;
-    mEvents = PrQueue(toKeep.begin(), toKeep.end());
-    maybeSetRealtimer();
-}
+    events.spliceBack(mWheelOverflow);
+    mWheelOccupied.fill(0);
 
-bool
-VirtualClock::cancelAllEvents()
-{
-    assertThreadIsMain();
-
-    bool wasEmpty = mEvents.empty();
-    while (!mEvents.empty())
+    bool wasEmpty = events.empty();
+    // cancelling unlinks each event, as does destroying those that handlers
+    // of the others might drop
+    while (!events.empty())
     {
-        auto ev = mEvents.top();
-        mEvents.pop();
-        ev->cancel();
+        static_cast<VirtualClockEvent*>(events.mNext)->cancel();
     }
-    mEvents = PrQueue();
     return !wasEmpty;
 }
 
+VirtualClock::Mode
+VirtualClock::getMode() const
+{
+    return mMode;
+}
+
 void
 VirtualClock::setCurrentTime(time_point t)
 {
@@ -259,6 +474,7 @@ VirtualClock::crank(bool block)
     }
     nRealTimerCancelEvents = 0;
     size_t nWorkDone = 0;
+    auto start = std::chrono::steady_clock::now();
 
     if (mMode == REAL_TIME)
     {
@@ -287,6 +503,13 @@ VirtualClock::crank(bool block)
         nWorkDone += advanceToNext();
     }
 
+    if (mMetrics)
+    {
+        mCrankTimer->Update(std::chrono::steady_clock::now() - start);
+        mCrankHandlers->Update(static_cast<int64_t>(nWorkDone));
+        mTimersQueued->set_count(static_cast<int64_t>(mEventCount));
+    }
+
     if (block && nWorkDone == 0)
     {
         nWorkDone += mIOService.run_one();
@@ -359,6 +582,54 @@ VirtualClock::getIOService()
     return mIOService;
 }
 
+void
+VirtualClock::setMetrics(medida::MetricsRegistry* metrics)
+{
+    mMetrics = metrics;
+    mHandlerTimers.clear();
+    if (mMetrics)
+    {
+        mCrankTimer = &mMetrics->NewTimer({"clock", "crank", "duration"});
+        mCrankHandlers = &mMetrics->NewHistogram({"clock", "crank", "handlers"});
+        mTimersQueued = &mMetrics->NewCounter({"clock", "timer", "queued"});
+        mTimerLateness = &mMetrics->NewTimer({"clock", "timer", "lateness"});
+    }
+}
+
+medida::MetricsRegistry*
+VirtualClock::getMetrics() const
+{
+    return mMetrics;
+}
+
+void
+VirtualClock::runHandler(std::string const& tag,
+                         std::function<void()> const& fn)
+{
+    if (!mMetrics || tag.empty())
+    {
+        fn();
+        return;
+    }
+
+    auto i = mHandlerTimers.find(tag);
+    if (i == mHandlerTimers.end())
+    {
+        auto& timer = mMetrics->NewTimer({"clock", "handler", tag});
+        i = mHandlerTimers.emplace(tag, &timer).first;
+    }
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    i->second->Update(std::chrono::steady_clock::now() - start);
+}
+
+void
+VirtualClock::postToCurrentCrank(std::function<void()> fn,
+                                 std::string const& tag)
+{
+    mIOService.post([this, fn, tag]() { runHandler(tag, fn); });
+}
+
 VirtualClock::~VirtualClock()
 {
     mDestructing = true;
@@ -377,24 +648,23 @@ VirtualClock::advanceTo(time_point n)
     // LOG(DEBUG) << "VirtualClock::advanceTo("
     //            << n.time_since_epoch().count() << ")";
     mNow = n;
-    vector<shared_ptr<VirtualClockEvent>> toDispatch;
-    while (!mEvents.empty())
-    {
-        if (mEvents.top()->mWhen > mNow)
-            break;
-        toDispatch.push_back(mEvents.top());
-        mEvents.pop();
-    }
-    // Keep the dispatch loop separate from the pop()-ing loop
-    // so the triggered events can't mutate the priority queue
-    // from underneat us while we are looping.
-    for (auto ev : toDispatch)
+    // Collect the due events before dispatching any, so that the events
+    // handlers enqueue wait for the next advance. Events cancelled or
+    // destroyed by the handlers of earlier ones leave the list.
+    VirtualClockEventLink due;
+    auto count = collectDueEvents(mNow, due);
+    while (!due.empty())
     {
-        ev->trigger();
+        auto ev = static_cast<VirtualClockEvent*>(due.mNext);
+        if (mMetrics && mMode == REAL_TIME)
+        {
+            mTimerLateness->Update(mNow - ev->mWhen);
+        }
+        runHandler(ev->mTag, [ev]() { ev->trigger(); });
     }
     // LOG(DEBUG) << "VirtualClock::advanceTo done";
     maybeSetRealtimer();
-    return toDispatch.size();
+    return count;
 }
 
 size_t
@@ -406,7 +676,7 @@ VirtualClock::advanceToNext()
     }
     assert(mMode == VIRTUAL_TIME);
     assertThreadIsMain();
-    if (mEvents.empty())
+    if (mEventCount == 0)
     {
         return 0;
     }
@@ -415,24 +685,51 @@ VirtualClock::advanceToNext()
 
 VirtualClockEvent::VirtualClockEvent(
     VirtualClock::time_point when, size_t seq,
-    std::function<void(asio::error_code)> callback)
-    : mCallback(callback), mTriggered(false), mWhen(when), mSeq(seq)
+    std::function<void(asio::error_code)> callback, std::string const& tag)
+    : mCallback(callback), mTriggered(false), mWhen(when), mSeq(seq), mTag(tag)
 {
 }
 
+VirtualClockEvent::~VirtualClockEvent()
+{
+    if (mClock)
+    {
+        mClock->dequeue(*this);
+    }
+}
+
+void
+VirtualClockEvent::reset(VirtualClock::time_point when, size_t seq,
+                         std::function<void(asio::error_code)> callback)
+{
+    assert(mTriggered && !mClock);
+    mCallback = callback;
+    mTriggered = false;
+    mWhen = when;
+    mSeq = seq;
+}
+
 bool
 VirtualClockEvent::getTriggered()
 {
     return mTriggered;
 }
+
+// The callback is moved out before running it, which leaves the event free
+// to be reused or destroyed by it.
 void
 VirtualClockEvent::trigger()
 {
     if (!mTriggered)
     {
         mTriggered = true;
-        mCallback(asio::error_code());
+        if (mClock)
+        {
+            mClock->dequeue(*this);
+        }
+        auto callback = std::move(mCallback);
         mCallback = nullptr;
+        callback(asio::error_code());
     }
 }
 
@@ -442,33 +739,27 @@ VirtualClockEvent::cancel()
     if (!mTriggered)
     {
         mTriggered = true;
-        mCallback(asio::error::operation_aborted);
+        if (mClock)
+        {
+            mClock->dequeue(*this);
+        }
+        auto callback = std::move(mCallback);
         mCallback = nullptr;
+        callback(asio::error::operation_aborted);
     }
 }
 
-bool
-VirtualClockEvent::operator<(VirtualClockEvent const& other) const
-{
-    // For purposes of priority queue, a timer is "less than"
-    // another timer if it occurs in the future (has a higher
-    // expiry time). The "greatest" timer is timer 0.
-    // To break time-based ties (but preserve the ordering in which
-    // events were enqueued) we add an event-sequence number as well,
-    // such that a higher sequence number makes an event "less than"
-    // another.
-    return mWhen > other.mWhen || (mWhen == other.mWhen && mSeq > other.mSeq);
-}
-
-VirtualTimer::VirtualTimer(Application& app) : VirtualTimer(app.getClock())
+VirtualTimer::VirtualTimer(Application& app, std::string const& tag)
+    : VirtualTimer(app.getClock(), tag)
 {
 }
 
-VirtualTimer::VirtualTimer(VirtualClock& clock)
+VirtualTimer::VirtualTimer(VirtualClock& clock, std::string const& tag)
     : mClock(clock)
     , mExpiryTime(mClock.now())
     , mCancelled(false)
     , mDeleting(false)
+    , mTag(tag)
 {
 }
 
@@ -484,12 +775,20 @@ VirtualTimer::cancel()
     if (!mCancelled)
     {
         mCancelled = true;
-        for (auto ev : mEvents)
+        auto events = std::move(mEvents);
+        mEvents.clear();
+        for (auto& ev : events)
         {
             ev->cancel();
         }
-        mClock.flushCancelledEvents();
-        mEvents.clear();
+        for (auto& ev : events)
+        {
+            if (mSpareEvents.size() == MAX_SPARE_EVENTS)
+            {
+                break;
+            }
+            mSpareEvents.emplace_back(std::move(ev));
+        }
     }
 }
 
@@ -521,15 +820,48 @@ VirtualTimer::expires_from_now(VirtualClock::duration d)
     mCancelled = false;
 }
 
+void
+VirtualTimer::addEvent(std::function<void(asio::error_code)> fn)
+{
+    assert(!mDeleting);
+    auto s = seq();
+
+    // Fired events are only kept for seq(); recycle them.
+    auto fired = std::partition(
+        mEvents.begin(), mEvents.end(),
+        [](std::unique_ptr<VirtualClockEvent> const& ev) {
+            return !ev->getTriggered();
+        });
+    for (auto i = fired; i != mEvents.end(); ++i)
+    {
+        if (mSpareEvents.size() < MAX_SPARE_EVENTS)
+        {
+            mSpareEvents.emplace_back(std::move(*i));
+        }
+    }
+    mEvents.erase(fired, mEvents.end());
+
+    std::unique_ptr<VirtualClockEvent> ve;
+    if (mSpareEvents.empty())
+    {
+        ve = std::make_unique<VirtualClockEvent>(mExpiryTime, s, fn, mTag);
+    }
+    else
+    {
+        ve = std::move(mSpareEvents.back());
+        mSpareEvents.pop_back();
+        ve->reset(mExpiryTime, s, fn);
+    }
+    mClock.enqueue(*ve);
+    mEvents.emplace_back(std::move(ve));
+}
+
 void
 VirtualTimer::async_wait(function<void(asio::error_code)> const& fn)
 {
     if (!mCancelled)
     {
-        assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(mExpiryTime, seq(), fn);
-        mClock.enqueue(ve);
-        mEvents.push_back(ve);
+        addEvent(fn);
     }
 }
 
@@ -539,16 +871,12 @@ VirtualTimer::async_wait(std::function<void()> const& onSuccess,
 {
     if (!mCancelled)
     {
-        assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(
-            mExpiryTime, seq(), [onSuccess, onFailure](asio::error_code error) {
-                if (error)
-                    onFailure(error);
-                else
-                    onSuccess();
-            });
-        mClock.enqueue(ve);
-        mEvents.push_back(ve);
+        addEvent([onSuccess, onFailure](asio::error_code error) {
+            if (error)
+                onFailure(error);
+            else
+                onSuccess();
+        });
     }
 }
 }
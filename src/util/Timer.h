@@ -10,12 +10,22 @@
 #include "util/asio.h"
 #include "util/NonCopyable.h"
 
+#include <array>
 #include <chrono>
 #include <ctime>
 #include <functional>
 #include <map>
 #include <memory>
-#include <queue>
+#include <string>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Histogram;
+class MetricsRegistry;
+class Timer;
+}
 
 namespace stellar
 {
@@ -47,12 +57,37 @@ namespace stellar
 
 class VirtualTimer;
 class Application;
+class VirtualClock;
 class VirtualClockEvent;
-class VirtualClockEventCompare
+
+// Links of an intrusive, circular, doubly linked list of VirtualClockEvents.
+// A link on its own is the head of such a list.
+class VirtualClockEventLink
 {
   public:
-    bool operator()(std::shared_ptr<VirtualClockEvent> a,
-                    std::shared_ptr<VirtualClockEvent> b);
+    VirtualClockEventLink* mPrev;
+    VirtualClockEventLink* mNext;
+
+    VirtualClockEventLink() : mPrev(this), mNext(this)
+    {
+    }
+    VirtualClockEventLink(VirtualClockEventLink const&) = delete;
+    VirtualClockEventLink& operator=(VirtualClockEventLink const&) = delete;
+    ~VirtualClockEventLink()
+    {
+        unlink();
+    }
+
+    bool
+    empty() const
+    {
+        return mNext == this;
+    }
+    void pushBack(VirtualClockEventLink& link);
+    // Moves all the elements of the list headed by `head` to the end of this
+    // one.
+    void spliceBack(VirtualClockEventLink& head);
+    void unlink();
 };
 
 class VirtualClock
@@ -113,16 +148,48 @@ class VirtualClock
     size_t nRealTimerCancelEvents;
     time_point mNow;
 
-    using PrQueue =
-        std::priority_queue<std::shared_ptr<VirtualClockEvent>,
-                            std::vector<std::shared_ptr<VirtualClockEvent>>,
-                            VirtualClockEventCompare>;
-    PrQueue mEvents;
-    size_t mFlushesIgnored = 0;
+    // Pending events are kept in a hierarchical timer wheel of 1ms ticks:
+    // level l has WHEEL_SLOTS slots of WHEEL_SLOTS^l ticks each, covering
+    // the rest of the current slot of level l + 1. An event goes to the
+    // lowest level whose slots tell its tick apart from mWheelTick (the tick
+    // the wheel has advanced to), or to mWheelOverflow if it is too far
+    // ahead for all of them (about two years). Inserting and cancelling are
+    // O(1); advancing moves the events of the next occupied slot down a
+    // level at a time, and sorts those of a single tick by (mWhen, mSeq) as
+    // they become due.
+    static size_t const WHEEL_SLOT_BITS = 6;
+    static size_t const WHEEL_SLOTS = 1 << WHEEL_SLOT_BITS;
+    static size_t const WHEEL_LEVELS = 6;
+    uint64_t mWheelTick;
+    std::array<std::array<VirtualClockEventLink, WHEEL_SLOTS>, WHEEL_LEVELS>
+        mWheel;
+    // bit per slot, set when the slot might have events
+    std::array<uint64_t, WHEEL_LEVELS> mWheelOccupied;
+    VirtualClockEventLink mWheelOverflow;
+    size_t mEventCount{0};
+    std::vector<VirtualClockEvent*> mDueScratch;
 
     bool mDestructing{false};
 
+    // see setMetrics
+    medida::MetricsRegistry* mMetrics{nullptr};
+    medida::Timer* mCrankTimer{nullptr};
+    medida::Histogram* mCrankHandlers{nullptr};
+    medida::Counter* mTimersQueued{nullptr};
+    medida::Timer* mTimerLateness{nullptr};
+    std::map<std::string, medida::Timer*> mHandlerTimers;
+
+    void runHandler(std::string const& tag, std::function<void()> const& fn);
     void maybeSetRealtimer();
+
+    void place(VirtualClockEvent& ev);
+    void cascade(VirtualClockEventLink& head);
+    bool nextOccupiedSlot(size_t& level, size_t& slot, uint64_t& start);
+    size_t takeDueEvents(VirtualClockEventLink& slot, time_point n,
+                         VirtualClockEventLink& due);
+    size_t collectDueEvents(time_point n, VirtualClockEventLink& due);
+    void dequeue(VirtualClockEvent& ev);
+    friend class VirtualClockEvent;
     size_t advanceTo(time_point n);
     size_t advanceToNext();
     size_t advanceToNow();
@@ -140,14 +207,31 @@ class VirtualClock
     uint32_t recentIdleCrankPercent() const;
     void resetIdleCrankPercent();
     asio::io_service& getIOService();
+    Mode getMode() const;
+
+    // Records in `metrics` (nowhere when null):
+    //  - clock.crank.duration: wall time each crank spends running handlers,
+    //    not counting the wait for one when blocking
+    //  - clock.crank.handlers: handlers and timers run by each crank
+    //  - clock.timer.queued: timers waiting to fire
+    //  - clock.timer.lateness: how long after their expiry timers fire, in
+    //    real time
+    //  - clock.handler.<tag>: wall time taken by each handler given a tag (see
+    //    VirtualTimer and postToCurrentCrank); their max points at the
+    //    subsystem holding up the main thread
+    void setMetrics(medida::MetricsRegistry* metrics);
+    medida::MetricsRegistry* getMetrics() const;
+
+    // Posts `fn` to the IO service, to run in this crank or a following one,
+    // timed as clock.handler.<tag>.
+    void postToCurrentCrank(std::function<void()> fn, std::string const& tag);
 
     // Note: this is not a static method, which means that VirtualClock is
     // not an implementation of the C++ `Clock` concept; there is no global
     // virtual time. Each virtual clock has its own time.
     time_point now() noexcept;
 
-    void enqueue(std::shared_ptr<VirtualClockEvent> ve);
-    void flushCancelledEvents();
+    void enqueue(VirtualClockEvent& ve);
     bool cancelAllEvents();
 
     // only valid with VIRTUAL_TIME: sets the current value
@@ -158,20 +242,28 @@ class VirtualClock
     time_point next();
 };
 
-class VirtualClockEvent : public NonMovableOrCopyable
+class VirtualClockEvent : public VirtualClockEventLink
 {
     std::function<void(asio::error_code)> mCallback;
     bool mTriggered;
+    // set while in the timer wheel of this clock
+    VirtualClock* mClock{nullptr};
+    friend class VirtualClock;
 
   public:
     VirtualClock::time_point mWhen;
     size_t mSeq;
+    std::string const mTag;
     VirtualClockEvent(VirtualClock::time_point when, size_t seq,
-                      std::function<void(asio::error_code)> callback);
+                      std::function<void(asio::error_code)> callback,
+                      std::string const& tag = "");
+    ~VirtualClockEvent();
+    // Makes a fired or cancelled event pending again, to be reused.
+    void reset(VirtualClock::time_point when, size_t seq,
+               std::function<void(asio::error_code)> callback);
     bool getTriggered();
     void trigger();
     void cancel();
-    bool operator<(VirtualClockEvent const& other) const;
 };
 
 /**
@@ -183,13 +275,20 @@ class VirtualTimer : private NonMovableOrCopyable
 {
     VirtualClock& mClock;
     VirtualClock::time_point mExpiryTime;
-    std::vector<std::shared_ptr<VirtualClockEvent>> mEvents;
+    std::vector<std::unique_ptr<VirtualClockEvent>> mEvents;
+    // fired or cancelled events, reused by async_wait
+    std::vector<std::unique_ptr<VirtualClockEvent>> mSpareEvents;
     bool mCancelled;
     bool mDeleting;
+    std::string const mTag;
+
+    void addEvent(std::function<void(asio::error_code)> fn);
 
   public:
-    VirtualTimer(Application& app);
-    VirtualTimer(VirtualClock& app);
+    // Handlers of timers with a tag are timed under it, see
+    // VirtualClock::setMetrics.
+    VirtualTimer(Application& app, std::string const& tag = "");
+    VirtualTimer(VirtualClock& app, std::string const& tag = "");
     ~VirtualTimer();
 
     VirtualClock::time_point const& expiry_time() const;
@@ -11,7 +11,12 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Logging.h"
+#include "util/TimeSlicer.h"
 #include <chrono>
+#include <medida/counter.h>
+#include <medida/histogram.h>
+#include <medida/metrics_registry.h>
+#include <medida/timer.h>
 
 using namespace stellar;
 
@@ -221,3 +226,112 @@ TEST_CASE("timer cancels", "[timer]")
     REQUIRE(timerFired == 8);
     REQUIRE(timerCancelled == 2);
 }
+
+TEST_CASE("time slicer fits slices to budget", "[timer]")
+{
+    VirtualClock clock;
+    medida::Timer timer;
+    TimeSlicer slicer(clock, timer, std::chrono::milliseconds(100), 64);
+
+    auto runSlice = [&](std::chrono::milliseconds perUnit) {
+        auto units = slicer.start();
+        clock.setCurrentTime(clock.now() + perUnit * units);
+        slicer.finish(units);
+        return units;
+    };
+
+    // 100 units per second: grows twofold per slice up to 10
+    REQUIRE(runSlice(std::chrono::milliseconds(10)) == 1);
+    REQUIRE(runSlice(std::chrono::milliseconds(10)) == 2);
+    REQUIRE(runSlice(std::chrono::milliseconds(10)) == 4);
+    REQUIRE(runSlice(std::chrono::milliseconds(10)) == 8);
+    REQUIRE(slicer.getUnits() == 10);
+
+    // slowing down shrinks slices straight away
+    runSlice(std::chrono::milliseconds(100));
+    REQUIRE(slicer.getUnits() < 10);
+
+    // slices taking no time leave the size alone
+    auto units = slicer.getUnits();
+    slicer.finish(slicer.start());
+    REQUIRE(slicer.getUnits() == units);
+    REQUIRE(timer.count() == 6);
+}
+
+TEST_CASE("virtual clock records crank metrics", "[timer]")
+{
+    VirtualClock clock;
+    medida::MetricsRegistry metrics;
+    clock.setMetrics(&metrics);
+
+    size_t ran = 0;
+    clock.postToCurrentCrank([&ran]() { ++ran; }, "test-post");
+    clock.postToCurrentCrank([&ran]() { ++ran; }, "test-post");
+    VirtualTimer timer(clock, "test-timer");
+    timer.expires_from_now(std::chrono::seconds(1));
+    timer.async_wait([&ran]() { ++ran; }, &VirtualTimer::onFailureNoop);
+    VirtualTimer later(clock);
+    later.expires_from_now(std::chrono::seconds(2));
+    later.async_wait([]() {}, &VirtualTimer::onFailureNoop);
+
+    // the posts, then the first timer
+    clock.crank(false);
+    REQUIRE(ran == 2);
+    REQUIRE(metrics.NewCounter({"clock", "timer", "queued"}).count() == 2);
+    clock.crank(false);
+    REQUIRE(ran == 3);
+    REQUIRE(metrics.NewCounter({"clock", "timer", "queued"}).count() == 1);
+
+    REQUIRE(metrics.NewTimer({"clock", "crank", "duration"}).count() == 2);
+    auto& handlers = metrics.NewHistogram({"clock", "crank", "handlers"});
+    REQUIRE(handlers.count() == 2);
+    REQUIRE(handlers.max() == 2);
+    REQUIRE(metrics.NewTimer({"clock", "handler", "test-post"}).count() == 2);
+    REQUIRE(metrics.NewTimer({"clock", "handler", "test-timer"}).count() == 1);
+
+    clock.setMetrics(nullptr);
+    clock.crank(false);
+    REQUIRE(metrics.NewTimer({"clock", "crank", "duration"}).count() == 2);
+}
+
+TEST_CASE("virtual clock fires timers across wheel levels in order",
+          "[timer]")
+{
+    using namespace std::chrono;
+    VirtualClock clock;
+    auto start = clock.now();
+
+    // below a millisecond apart, within a slot, on every level and beyond
+    std::vector<VirtualClock::duration> delays = {
+        microseconds(1500), microseconds(1200), milliseconds(1),
+        milliseconds(63),   milliseconds(64),   milliseconds(4095),
+        seconds(70),        hours(72),          hours(24 * 1000),
+        hours(24 * 2000)};
+    std::vector<std::unique_ptr<VirtualTimer>> timers;
+    std::vector<VirtualClock::duration> fired;
+    size_t cancelled = 0;
+    auto onFailure = [&cancelled](asio::error_code const&) { ++cancelled; };
+    for (auto d : delays)
+    {
+        timers.emplace_back(std::make_unique<VirtualTimer>(clock));
+        timers.back()->expires_from_now(d);
+        auto onSuccess = [&clock, &fired, start, d]() {
+            REQUIRE(clock.now() - start == d);
+            fired.emplace_back(d);
+        };
+        timers.back()->async_wait(onSuccess, onFailure);
+    }
+    timers[4]->cancel();
+    timers[7]->cancel();
+    REQUIRE(cancelled == 2);
+    REQUIRE(clock.next() == start + milliseconds(1));
+
+    while (clock.crank(false) > 0)
+        ;
+    std::vector<VirtualClock::duration> expected = {
+        milliseconds(1),  microseconds(1200), microseconds(1500),
+        milliseconds(63), milliseconds(4095), seconds(70),
+        hours(24 * 1000), hours(24 * 2000)};
+    REQUIRE(fired == expected);
+    REQUIRE(clock.next() == VirtualClock::time_point::max());
+}
@@ -42,6 +42,20 @@ TmpDir::getName() const
     return *mPath;
 }
 
+size_t
+TmpDir::getSize() const
+{
+    size_t res = 0;
+    auto files = fs::findfiles(*mPath, [](std::string const& name) {
+        return name != "." && name != "..";
+    });
+    for (auto const& f : files)
+    {
+        res += fs::size(*mPath + "/" + f);
+    }
+    return res;
+}
+
 TmpDir::~TmpDir()
 {
     if (!mPath)
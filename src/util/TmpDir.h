@@ -18,6 +18,8 @@ class TmpDir
     TmpDir(TmpDir&&);
     ~TmpDir();
     std::string const& getName() const;
+    // Bytes taken by the files directly in the directory.
+    size_t getSize() const;
 };
 
 class TmpDirManager
@@ -0,0 +1,111 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/WorkerLanes.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+WorkerLanes::WorkerLanes(asio::io_service& workers, size_t threads,
+                         medida::MetricsRegistry& metrics)
+    : mWorkers(workers)
+{
+    for (size_t i = 0; i < mLanes.size(); ++i)
+    {
+        auto name = getLaneName(static_cast<WorkerLane>(i));
+        auto& lane = mLanes[i];
+        lane.mMaxRunning = threads;
+        lane.mDepth = &metrics.NewCounter({"worker", name, "queue"});
+        lane.mWait = &metrics.NewTimer({"worker", name, "wait"});
+    }
+    auto& background = mLanes[static_cast<size_t>(WorkerLane::BACKGROUND)];
+    background.mMaxRunning = std::max<size_t>(threads, 2) - 1;
+}
+
+char const*
+WorkerLanes::getLaneName(WorkerLane lane)
+{
+    switch (lane)
+    {
+    case WorkerLane::CRYPTO:
+        return "crypto";
+    case WorkerLane::MERGE:
+        return "merge";
+    case WorkerLane::CATCHUP:
+        return "catchup";
+    case WorkerLane::BACKGROUND:
+        return "background";
+    default:
+        return "unknown";
+    }
+}
+
+void
+WorkerLanes::post(WorkerLane lane, std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto& l = mLanes.at(static_cast<size_t>(lane));
+        l.mJobs.push_back({std::move(job), std::chrono::steady_clock::now()});
+        l.mDepth->inc();
+    }
+    mWorkers.post([this]() { runNext(); });
+}
+
+size_t
+WorkerLanes::getQueueDepth(WorkerLane lane)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLanes.at(static_cast<size_t>(lane)).mJobs.size();
+}
+
+void
+WorkerLanes::runNext()
+{
+    Lane* lane = nullptr;
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto& l : mLanes)
+        {
+            if (!l.mJobs.empty() && l.mRunning < l.mMaxRunning)
+            {
+                lane = &l;
+                break;
+            }
+        }
+        if (!lane)
+        {
+            // a capped lane: the job left is run once one of that lane's
+            // jobs finishes
+            return;
+        }
+        job = std::move(lane->mJobs.front());
+        lane->mJobs.pop_front();
+        lane->mDepth->dec();
+        ++lane->mRunning;
+    }
+
+    lane->mWait->Update(std::chrono::steady_clock::now() - job.mPosted);
+    job.mRun();
+
+    bool repost;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // the tokens of the jobs left may have found the lane full, and run
+        // nothing
+        repost = lane->mRunning-- == lane->mMaxRunning && !lane->mJobs.empty();
+    }
+    if (repost)
+    {
+        mWorkers.post([this]() { runNext(); });
+    }
+}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "util/asio.h"
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace medida
+{
+class Counter;
+class MetricsRegistry;
+class Timer;
+}
+
+namespace stellar
+{
+
+// The lanes of WorkerLanes, from the most urgent to the least.
+enum class WorkerLane
+{
+    // signature checks the herder or overlay is waiting on
+    CRYPTO = 0,
+    // merges of the shallow levels of the bucket list, needed within a few
+    // ledgers
+    MERGE,
+    // reading, unzipping and checking what catchup applies next
+    CATCHUP,
+    // deep merges, indexing, snapshots and anything else with no one waiting
+    BACKGROUND,
+    COUNT
+};
+
+/**
+ * WorkerLanes orders the jobs handed to the worker threads by lane: each
+ * thread that frees up takes the oldest job of the most urgent lane that has
+ * any, so a latency-critical job waits at most for one job to finish,
+ * whatever the backlog of the lanes below.
+ *
+ * The jobs are not posted to the worker io_service themselves, only a token
+ * per job that runs whichever is next when it comes up, so that the
+ * io_service still serves asio objects (resolvers, NTP sockets) and the
+ * threads pick up work from a single queue, without having to steal it from
+ * each other. What is posted straight to the io_service bypasses the lanes,
+ * and is run in turn with the tokens.
+ *
+ * The BACKGROUND lane never takes more than all threads but one, keeping one
+ * for the lanes above while a long deep merge runs.
+ *
+ * Each lane has a queue depth counter and a wait time timer, under
+ * worker.<lane>.
+ */
+class WorkerLanes : NonMovableOrCopyable
+{
+    struct Job
+    {
+        std::function<void()> mRun;
+        std::chrono::steady_clock::time_point mPosted;
+    };
+
+    struct Lane
+    {
+        std::deque<Job> mJobs;
+        size_t mRunning{0};
+        size_t mMaxRunning;
+        medida::Counter* mDepth;
+        medida::Timer* mWait;
+    };
+
+    asio::io_service& mWorkers;
+    std::mutex mMutex;
+    std::array<Lane, static_cast<size_t>(WorkerLane::COUNT)> mLanes;
+
+    // runs the next job, if any lane may run one
+    void runNext();
+
+  public:
+    WorkerLanes(asio::io_service& workers, size_t threads,
+                medida::MetricsRegistry& metrics);
+
+    // Runs `job` on a worker thread, after the jobs posted before it in its
+    // lane, and before those of the lanes below. Can be called from any
+    // thread.
+    void post(WorkerLane lane, std::function<void()> job);
+
+    // Jobs of `lane` waiting for a thread.
+    size_t getQueueDepth(WorkerLane lane);
+
+    static char const* getLaneName(WorkerLane lane);
+};
+}
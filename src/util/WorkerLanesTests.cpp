@@ -0,0 +1,67 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "lib/catch.hpp"
+#include "util/WorkerLanes.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+
+#include <string>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("worker lanes run the most urgent job first", "[workerlanes]")
+{
+    asio::io_service io;
+    medida::MetricsRegistry metrics;
+    WorkerLanes lanes(io, 4, metrics);
+
+    std::vector<std::string> ran;
+    auto job = [&ran](std::string name) {
+        return [&ran, name]() { ran.push_back(name); };
+    };
+    lanes.post(WorkerLane::BACKGROUND, job("deep merge"));
+    lanes.post(WorkerLane::CATCHUP, job("catchup"));
+    lanes.post(WorkerLane::MERGE, job("merge"));
+    lanes.post(WorkerLane::CRYPTO, job("crypto 1"));
+    lanes.post(WorkerLane::CRYPTO, job("crypto 2"));
+
+    REQUIRE(lanes.getQueueDepth(WorkerLane::CRYPTO) == 2);
+    REQUIRE(metrics.NewCounter({"worker", "crypto", "queue"}).count() == 2);
+
+    io.run();
+    REQUIRE(ran == std::vector<std::string>{"crypto 1", "crypto 2", "merge",
+                                            "catchup", "deep merge"});
+    REQUIRE(lanes.getQueueDepth(WorkerLane::CRYPTO) == 0);
+    REQUIRE(metrics.NewCounter({"worker", "crypto", "queue"}).count() == 0);
+}
+
+TEST_CASE("worker lanes keep a thread off background jobs", "[workerlanes]")
+{
+    asio::io_service io;
+    medida::MetricsRegistry metrics;
+    // background jobs get one of the two threads
+    WorkerLanes lanes(io, 2, metrics);
+
+    std::vector<std::string> ran;
+    std::vector<std::string> ranDuringFirst;
+    lanes.post(WorkerLane::BACKGROUND, [&]() {
+        ran.push_back("background 1");
+        // stands for the other thread, while this one is busy
+        io.poll();
+        ranDuringFirst = ran;
+    });
+    lanes.post(WorkerLane::BACKGROUND,
+               [&]() { ran.push_back("background 2"); });
+    lanes.post(WorkerLane::CRYPTO, [&]() { ran.push_back("crypto"); });
+
+    io.run();
+    REQUIRE(ranDuringFirst ==
+            std::vector<std::string>{"background 1", "crypto"});
+    REQUIRE(ran == std::vector<std::string>{"background 1", "crypto",
+                                            "background 2"});
+}
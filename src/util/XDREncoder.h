@@ -0,0 +1,73 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Encodes XDR objects into a buffer it keeps between calls, in a single pass
+ * over each object: it is encoded straight into the buffer, and its size
+ * read off where the encoding stopped. xdr::xdr_to_opaque and the like go
+ * over the object twice, once to size the output and once to encode it.
+ *
+ * Only an object that does not fit the buffer gets sized first; the buffer
+ * then grows (at least doubling) to fit it, so a stream of objects of
+ * similar sizes, such as bucket entries, soon never needs that.
+ */
+class XDREncoder
+{
+    // sizes are kept multiples of 4, as xdr_put requires
+    std::vector<char> mBuf;
+
+  public:
+    // Encodes `t` after the first `reserved` bytes of the buffer, which must
+    // be a multiple of 4, and returns the size of the encoding. The bytes
+    // before `reserved` are kept when the buffer grows.
+    template <typename T>
+    size_t
+    encode(T const& t, size_t reserved = 0)
+    {
+        assert(reserved % 4 == 0);
+        if (mBuf.size() > reserved)
+        {
+            auto start = mBuf.data() + reserved;
+            xdr::xdr_put p(start, mBuf.data() + mBuf.size());
+            try
+            {
+                xdr::xdr_argpack_archive(p, t);
+                return reinterpret_cast<char*>(p.p_) - start;
+            }
+            catch (xdr::xdr_overflow const&)
+            {
+            }
+        }
+
+        size_t sz = xdr::xdr_size(t);
+        mBuf.resize(std::max(reserved + sz, mBuf.size() * 2));
+        xdr::xdr_put p(mBuf.data() + reserved, mBuf.data() + reserved + sz);
+        xdr::xdr_argpack_archive(p, t);
+        return sz;
+    }
+
+    char*
+    data()
+    {
+        return mBuf.data();
+    }
+
+    size_t
+    capacity() const
+    {
+        return mBuf.size();
+    }
+};
+}
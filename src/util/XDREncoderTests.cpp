@@ -0,0 +1,112 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "overlay/StellarXDR.h"
+#include "util/Logging.h"
+#include "util/XDREncoder.h"
+#include "xdrpp/autocheck.h"
+#include "xdrpp/marshal.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace stellar;
+
+namespace
+{
+
+template <typename T>
+std::vector<T>
+generate(size_t n, size_t size)
+{
+    autocheck::generator<T> gen;
+    std::vector<T> res;
+    res.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        res.emplace_back(gen(size));
+    }
+    return res;
+}
+
+template <typename T>
+void
+checkSameEncoding(size_t size)
+{
+    XDREncoder encoder;
+    for (auto const& t : generate<T>(200, size))
+    {
+        auto expected = xdr::xdr_to_opaque(t);
+        auto sz = encoder.encode(t, 4);
+        REQUIRE(sz == expected.size());
+        REQUIRE(std::equal(expected.begin(), expected.end(),
+                           encoder.data() + 4));
+    }
+}
+
+template <typename T>
+void
+benchmark(std::string const& name, size_t size)
+{
+    auto objects = generate<T>(10000, size);
+    size_t const rounds = 20;
+
+    size_t genericBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        for (auto const& t : objects)
+        {
+            genericBytes += xdr::xdr_to_opaque(t).size();
+        }
+    }
+    std::chrono::duration<double> generic =
+        std::chrono::steady_clock::now() - start;
+
+    size_t fusedBytes = 0;
+    XDREncoder encoder;
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        for (auto const& t : objects)
+        {
+            fusedBytes += encoder.encode(t);
+        }
+    }
+    std::chrono::duration<double> fused =
+        std::chrono::steady_clock::now() - start;
+
+    REQUIRE(fusedBytes == genericBytes);
+    LOG(INFO) << "XDR encode bench " << name << ": " << genericBytes
+              << " bytes, size+encode " << generic.count() << "s, single pass "
+              << fused.count() << "s";
+}
+}
+
+TEST_CASE("xdr encoder matches xdr_to_opaque", "[xdrencoder]")
+{
+    checkSameEncoding<BucketEntry>(3);
+    checkSameEncoding<TransactionEnvelope>(5);
+    checkSameEncoding<SCPEnvelope>(5);
+
+    SECTION("bytes before the encoding are kept when growing")
+    {
+        XDREncoder encoder;
+        encoder.encode(uint32_t(1), 4);
+        encoder.data()[0] = 42;
+        auto big = generate<TransactionEnvelope>(1, 20).front();
+        auto sz = encoder.encode(big, 4);
+        REQUIRE(sz == xdr::xdr_size(big));
+        REQUIRE(encoder.data()[0] == 42);
+    }
+}
+
+TEST_CASE("xdr encoder benchmark", "[xdrencoder][bench][!hide]")
+{
+    benchmark<BucketEntry>("BucketEntry", 3);
+    benchmark<TransactionEnvelope>("TransactionEnvelope", 5);
+    benchmark<SCPEnvelope>("SCPEnvelope", 5);
+}
@@ -0,0 +1,254 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/XDRStream.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace stellar
+{
+
+size_t const XDROutputFileStream::BLOCK_SIZE;
+
+namespace
+{
+void
+throwFileError(char const* what, std::string const& filename, int err)
+{
+    std::string msg(what);
+    msg += ": ";
+    msg += filename;
+    msg += ", reason: ";
+    msg += std::to_string(err);
+    CLOG(FATAL, "Fs") << msg;
+    throw std::runtime_error(msg);
+}
+}
+
+XDROutputFileStream::~XDROutputFileStream()
+{
+#ifndef _WIN32
+    if (mFd >= 0)
+    {
+        writeBuffer(true);
+        ::close(mFd);
+    }
+#endif
+    if (mOptions.mMetrics && mOut.is_open())
+    {
+        mOptions.mMetrics->record(mBytesWritten, mWriteTime);
+    }
+}
+
+void
+XDROutputFileStream::open(std::string const& filename, bool append,
+                          XDRWriteOptions const& options)
+{
+    mFilename = filename;
+    mOptions = options;
+    mFailed = false;
+    mDirect = false;
+    mWriteBufUsed = 0;
+    mBytesWritten = 0;
+    mWriteTime = std::chrono::nanoseconds::zero();
+
+#ifndef _WIN32
+    if (options.mBufferSize != 0)
+    {
+        auto size = (options.mBufferSize + BLOCK_SIZE - 1) / BLOCK_SIZE *
+                    BLOCK_SIZE;
+        if (size != mWriteBufSize)
+        {
+            void* buf = nullptr;
+            if (posix_memalign(&buf, BLOCK_SIZE, size) != 0)
+            {
+                throw std::bad_alloc();
+            }
+            mWriteBuf.reset(static_cast<char*>(buf));
+            mWriteBufSize = size;
+        }
+
+        int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+#ifdef O_DIRECT
+        if (options.mDirect && !append)
+        {
+            mFd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+            // filesystems such as tmpfs refuse O_DIRECT
+            mDirect = mFd >= 0;
+        }
+#endif
+        if (mFd < 0)
+        {
+            mFd = ::open(filename.c_str(), flags, 0644);
+        }
+        if (mFd < 0)
+        {
+            throwFileError("failed to open XDR file", filename, errno);
+        }
+#ifdef F_NOCACHE
+        if (options.mDirect && !append)
+        {
+            fcntl(mFd, F_NOCACHE, 1);
+        }
+#endif
+        return;
+    }
+#endif
+
+    mOut.open(filename, std::ofstream::binary |
+                            (append ? std::ofstream::app
+                                    : std::ofstream::trunc));
+    if (!mOut)
+    {
+        throwFileError("failed to open XDR file", filename, errno);
+    }
+}
+
+void
+XDROutputFileStream::close()
+{
+#ifndef _WIN32
+    if (mFd >= 0)
+    {
+        writeBuffer(true);
+        int err = mFailed ? errno : 0;
+        if (!mFailed && mOptions.mSync)
+        {
+            auto start = std::chrono::steady_clock::now();
+#ifdef __linux__
+            mFailed = ::fdatasync(mFd) != 0;
+#else
+            mFailed = ::fsync(mFd) != 0;
+#endif
+            err = errno;
+            if (mOptions.mSyncMetrics)
+            {
+                mOptions.mSyncMetrics->record(
+                    0, std::chrono::steady_clock::now() - start);
+            }
+        }
+        ::close(mFd);
+        mFd = -1;
+        if (mFailed)
+        {
+            throwFileError("failed to write XDR file", mFilename, err);
+        }
+        return;
+    }
+#endif
+    if (mOptions.mMetrics && mOut.is_open())
+    {
+        mOptions.mMetrics->record(mBytesWritten, mWriteTime);
+    }
+    mOut.close();
+}
+
+XDROutputFileStream::operator bool() const
+{
+    return !mFailed && mOut.good();
+}
+
+void
+XDROutputFileStream::flush()
+{
+    if (mFd >= 0)
+    {
+        writeBuffer(false);
+    }
+    else
+    {
+        mOut.flush();
+    }
+}
+
+bool
+XDROutputFileStream::write(char const* data, size_t size)
+{
+    if (mFd < 0)
+    {
+        if (!mOptions.mMetrics)
+        {
+            return static_cast<bool>(mOut.write(data, size));
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool ok = static_cast<bool>(mOut.write(data, size));
+        mWriteTime += std::chrono::steady_clock::now() - start;
+        mBytesWritten += size;
+        return ok;
+    }
+    while (size != 0 && !mFailed)
+    {
+        auto n = std::min(size, mWriteBufSize - mWriteBufUsed);
+        std::memcpy(mWriteBuf.get() + mWriteBufUsed, data, n);
+        mWriteBufUsed += n;
+        data += n;
+        size -= n;
+        if (mWriteBufUsed == mWriteBufSize)
+        {
+            writeBuffer(false);
+        }
+    }
+    return !mFailed;
+}
+
+bool
+XDROutputFileStream::writeBuffer(bool all)
+{
+#ifndef _WIN32
+    if (mFailed)
+    {
+        return false;
+    }
+    auto n = mWriteBufUsed;
+    if (mDirect && n % BLOCK_SIZE != 0)
+    {
+        if (!all)
+        {
+            n -= n % BLOCK_SIZE;
+        }
+        else
+        {
+#ifdef O_DIRECT
+            // the tail of the file is not a whole block, which O_DIRECT
+            // cannot write
+            fcntl(mFd, F_SETFL, fcntl(mFd, F_GETFL) & ~O_DIRECT);
+#endif
+            mDirect = false;
+        }
+    }
+
+    size_t done = 0;
+    while (done < n)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto w = ::write(mFd, mWriteBuf.get() + done, n - done);
+        if (mOptions.mMetrics && w > 0)
+        {
+            mOptions.mMetrics->record(
+                static_cast<size_t>(w),
+                std::chrono::steady_clock::now() - start);
+        }
+        if (w < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            mFailed = true;
+            return false;
+        }
+        done += static_cast<size_t>(w);
+    }
+    std::memmove(mWriteBuf.get(), mWriteBuf.get() + n, mWriteBufUsed - n);
+    mWriteBufUsed -= n;
+#endif
+    return true;
+}
+}
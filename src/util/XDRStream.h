@@ -6,9 +6,16 @@
 
 #include "crypto/ByteSlice.h"
 #include "crypto/SHA.h"
+#include "util/FileIOMetrics.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/XDREncoder.h"
 #include "xdrpp/marshal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,6 +25,12 @@ namespace stellar
 /**
  * Helper for loading a sequence of XDR objects from a file one at a time,
  * rather than all at once.
+ *
+ * A stream opened with openMapped() reads from a read-only memory mapping
+ * of the file instead, decoding each object in place without copying it
+ * into an intermediate buffer.
+ *
+ * With setMetrics(), what was read is reported when the stream is closed.
  */
 class XDRInputFileStream
 {
@@ -25,6 +38,56 @@ class XDRInputFileStream
     std::vector<char> mBuf;
     unsigned int mSizeLimit;
 
+    std::unique_ptr<fs::MappedFile> mMapped;
+    size_t mMappedPos{0};
+
+    FileIOMetrics* mMetrics{nullptr};
+    // since the stream was opened
+    size_t mBytesRead{0};
+    std::chrono::nanoseconds mReadTime{0};
+
+    static uint32_t
+    decodeSize(char const* szBuf)
+    {
+        // Read 4 bytes of size, big-endian, with XDR 'continuation' bit cleared
+        // (high bit of high byte).
+        uint32_t sz = 0;
+        sz |= static_cast<uint8_t>(szBuf[0] & '\x7f');
+        sz <<= 8;
+        sz |= static_cast<uint8_t>(szBuf[1]);
+        sz <<= 8;
+        sz |= static_cast<uint8_t>(szBuf[2]);
+        sz <<= 8;
+        sz |= static_cast<uint8_t>(szBuf[3]);
+        return sz;
+    }
+
+    bool
+    readRawMapped(char const*& data, uint32_t& size)
+    {
+        size_t remaining = mMapped->size() - mMappedPos;
+        if (remaining < 4)
+        {
+            mMappedPos = mMapped->size();
+            return false;
+        }
+        char const* p = mMapped->data() + mMappedPos;
+        uint32_t sz = decodeSize(p);
+        if (mSizeLimit != 0 && sz > mSizeLimit)
+        {
+            return false;
+        }
+        if (sz > remaining - 4)
+        {
+            throw xdr::xdr_runtime_error("malformed XDR file");
+        }
+        data = p + 4;
+        size = sz;
+        mMappedPos += sz + 4;
+        mBytesRead += sz + 4;
+        return true;
+    }
+
   public:
     XDRInputFileStream(unsigned int sizeLimit = 0) : mSizeLimit{sizeLimit}
     {
@@ -33,7 +96,26 @@ class XDRInputFileStream
     void
     close()
     {
+        if (mMetrics && mMapped)
+        {
+            mMetrics->addBytes(mBytesRead);
+        }
+        else if (mMetrics && mIn.is_open())
+        {
+            mMetrics->record(mBytesRead, mReadTime);
+        }
+        mBytesRead = 0;
+        mReadTime = std::chrono::nanoseconds::zero();
         mIn.close();
+        mMapped.reset();
+        mMappedPos = 0;
+    }
+
+    // Report what is read to `metrics`, if not null.
+    void
+    setMetrics(FileIOMetrics* metrics)
+    {
+        mMetrics = metrics;
     }
 
     void
@@ -51,32 +133,82 @@ class XDRInputFileStream
         }
     }
 
+    void
+    openMapped(std::string const& filename)
+    {
+        try
+        {
+            mMapped = std::make_unique<fs::MappedFile>(filename);
+            mMappedPos = 0;
+        }
+        catch (std::runtime_error& e)
+        {
+            std::string msg("failed to open XDR file: ");
+            msg += filename;
+            msg += ", reason: ";
+            msg += e.what();
+            CLOG(ERROR, "Fs") << msg;
+            throw std::runtime_error(msg);
+        }
+    }
+
     operator bool() const
     {
+        if (mMapped)
+        {
+            return mMappedPos < mMapped->size();
+        }
         return mIn.good();
     }
 
-    template <typename T>
+    // Offset of the next object to be read.
+    size_t
+    pos()
+    {
+        if (mMapped)
+        {
+            return mMappedPos;
+        }
+        return static_cast<size_t>(mIn.tellg());
+    }
+
+    // Reposition the stream so the next read starts at `offset`, which must
+    // be the start of an object (eg. a value returned from pos()).
+    void
+    seek(size_t offset)
+    {
+        if (mMapped)
+        {
+            mMappedPos = std::min(offset, mMapped->size());
+            return;
+        }
+        mIn.clear();
+        mIn.seekg(offset);
+    }
+
+    // Reads the next object without decoding it, pointing `data` at its
+    // `size` bytes of XDR (not including the size header). They stay valid
+    // until the next read, or as long as the stream is open if it is mapped.
     bool
-    readOne(T& out)
+    readRaw(char const*& data, uint32_t& size)
     {
+        if (mMapped)
+        {
+            return readRawMapped(data, size);
+        }
+
+        std::chrono::steady_clock::time_point start;
+        if (mMetrics)
+        {
+            start = std::chrono::steady_clock::now();
+        }
         char szBuf[4];
         if (!mIn.read(szBuf, 4))
         {
             return false;
         }
 
-        // Read 4 bytes of size, big-endian, with XDR 'continuation' bit cleared
-        // (high bit of high byte).
-        uint32_t sz = 0;
-        sz |= static_cast<uint8_t>(szBuf[0] & '\x7f');
-        sz <<= 8;
-        sz |= static_cast<uint8_t>(szBuf[1]);
-        sz <<= 8;
-        sz |= static_cast<uint8_t>(szBuf[2]);
-        sz <<= 8;
-        sz |= static_cast<uint8_t>(szBuf[3]);
-
+        uint32_t sz = decodeSize(szBuf);
         if (mSizeLimit != 0 && sz > mSizeLimit)
         {
             return false;
@@ -89,73 +221,175 @@ class XDRInputFileStream
         {
             throw xdr::xdr_runtime_error("malformed XDR file");
         }
-        xdr::xdr_get g(mBuf.data(), mBuf.data() + sz);
+        if (mMetrics)
+        {
+            mReadTime += std::chrono::steady_clock::now() - start;
+            mBytesRead += sz + 4;
+        }
+        data = mBuf.data();
+        size = sz;
+        return true;
+    }
+
+    template <typename T>
+    bool
+    readOne(T& out)
+    {
+        char const* data;
+        uint32_t sz;
+        if (!readRaw(data, sz))
+        {
+            return false;
+        }
+        xdr::xdr_get g(data, data + sz);
         xdr::xdr_argpack_archive(g, out);
         return true;
     }
 };
 
+// How an XDROutputFileStream writes its file.
+struct XDRWriteOptions
+{
+    // Bytes gathered in an aligned buffer before each write to the file,
+    // rounded up to a multiple of XDROutputFileStream::BLOCK_SIZE; 0 leaves
+    // buffering to std::ofstream.
+    size_t mBufferSize{0};
+
+    // Write around the page cache (O_DIRECT) where the platform and the
+    // filesystem allow it. Needs mBufferSize.
+    bool mDirect{false};
+
+    // Flush the file to disk (fdatasync) when it is closed. Needs
+    // mBufferSize.
+    bool mSync{false};
+
+    // Where the writes, and the sync, are reported, if anywhere.
+    FileIOMetrics* mMetrics{nullptr};
+    FileIOMetrics* mSyncMetrics{nullptr};
+};
+
 class XDROutputFileStream
 {
     std::ofstream mOut;
-    std::vector<char> mBuf;
+    XDREncoder mEncoder;
+
+    // When opened with a buffer size, the file is written through mFd and
+    // the stream's own buffer instead of mOut (not on Windows).
+    XDRWriteOptions mOptions;
+    std::string mFilename;
+    int mFd{-1};
+    bool mDirect{false};
+    bool mFailed{false};
+    std::unique_ptr<char, void (*)(void*)> mWriteBuf{nullptr, std::free};
+    size_t mWriteBufSize{0};
+    size_t mWriteBufUsed{0};
+    // written through mOut since the file was opened, for mOptions.mMetrics
+    size_t mBytesWritten{0};
+    std::chrono::nanoseconds mWriteTime{0};
+
+    bool write(char const* data, size_t size);
+    // Write out the buffer, or with O_DIRECT only the whole blocks of it
+    // unless `all`.
+    bool writeBuffer(bool all);
 
   public:
-    void
-    close()
-    {
-        mOut.close();
-    }
+    // Alignment (and size granularity) of the writes made with O_DIRECT.
+    static size_t const BLOCK_SIZE = 4096;
 
-    void
-    open(std::string const& filename)
-    {
-        mOut.open(filename, std::ofstream::binary | std::ofstream::trunc);
-        if (!mOut)
-        {
-            std::string msg("failed to open XDR file: ");
-            msg += filename;
-            msg += ", reason: ";
-            msg += std::to_string(errno);
-            CLOG(FATAL, "Fs") << msg;
-            throw std::runtime_error(msg);
-        }
-    }
+    XDROutputFileStream() = default;
+    ~XDROutputFileStream();
+    XDROutputFileStream(XDROutputFileStream const&) = delete;
+    XDROutputFileStream& operator=(XDROutputFileStream const&) = delete;
 
-    operator bool() const
-    {
-        return mOut.good();
-    }
+    // Writes out what is buffered and closes the file, syncing it first if
+    // opened with mSync; throws if that fails.
+    void close();
+
+    // Opens `filename` for writing, appending to it if `append` and it
+    // already exists. O_DIRECT is not used when appending.
+    void open(std::string const& filename, bool append = false,
+              XDRWriteOptions const& options = XDRWriteOptions());
+
+    operator bool() const;
+
+    // hands what was written so far to the OS
+    void flush();
 
     template <typename T>
     bool
     writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
     {
-        uint32_t sz = (uint32_t)xdr::xdr_size(t);
+        // encoded after the 4 bytes of size, which are only known after
+        uint32_t sz = (uint32_t)mEncoder.encode(t, 4);
         assert(sz < 0x80000000);
+        auto buf = mEncoder.data();
 
-        if (mBuf.size() < sz + 4)
+        // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
+        // high bit of high byte.
+        buf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        buf[1] = static_cast<char>((sz >> 16) & 0xFF);
+        buf[2] = static_cast<char>((sz >> 8) & 0xFF);
+        buf[3] = static_cast<char>(sz & 0xFF);
+
+        if (!write(buf, sz + 4))
+        {
+            return false;
+        }
+        if (hasher)
+        {
+            hasher->add(ByteSlice(buf, sz + 4));
+        }
+        if (bytesPut)
         {
-            mBuf.resize(sz + 4);
+            *bytesPut += (sz + 4);
         }
+        return true;
+    }
 
-        // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
-        // high bit of high byte.
-        mBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
-        mBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
-        mBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
-        mBuf[3] = static_cast<char>(sz & 0xFF);
+    // Writes `size` bytes of objects already framed as writeOne frames them,
+    // eg. the contents of another file written by an XDROutputFileStream.
+    bool
+    writeFramed(char const* data, size_t size, SHA256* hasher = nullptr,
+                size_t* bytesPut = nullptr)
+    {
+        if (!write(data, size))
+        {
+            return false;
+        }
+        if (hasher)
+        {
+            hasher->add(ByteSlice(data, size));
+        }
+        if (bytesPut)
+        {
+            *bytesPut += size;
+        }
+        return true;
+    }
 
-        xdr::xdr_put p(mBuf.data() + 4, mBuf.data() + 4 + sz);
-        xdr_argpack_archive(p, t);
+    // Writes an object that is already XDR-encoded, as read by
+    // XDRInputFileStream::readRaw; the bytes written are the same as those
+    // writeOne would write for the decoded object.
+    bool
+    writeRaw(char const* data, uint32_t sz, SHA256* hasher = nullptr,
+             size_t* bytesPut = nullptr)
+    {
+        assert(sz < 0x80000000);
+
+        char szBuf[4];
+        szBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        szBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
+        szBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
+        szBuf[3] = static_cast<char>(sz & 0xFF);
 
-        if (!mOut.write(mBuf.data(), sz + 4))
+        if (!write(szBuf, 4) || !write(data, sz))
         {
             return false;
         }
         if (hasher)
         {
-            hasher->add(ByteSlice(mBuf.data(), sz + 4));
+            hasher->add(ByteSlice(szBuf, 4));
+            hasher->add(ByteSlice(data, sz));
         }
         if (bytesPut)
         {
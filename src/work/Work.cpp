@@ -7,6 +7,7 @@
 #include "main/Application.h"
 #include "util/Logging.h"
 #include "util/Math.h"
+#include "util/WorkerLanes.h"
 #include "work/WorkManager.h"
 #include "work/WorkParent.h"
 
@@ -36,6 +37,7 @@ Work::Work(Application& app, WorkParent& parent, std::string uniqueName,
 Work::~Work()
 {
     clearChildren();
+    releaseSlot();
 }
 
 std::string
@@ -51,6 +53,11 @@ Work::getStatus() const
     {
     case WORK_PENDING:
     {
+        if (mSlotRequested)
+        {
+            return fmt::format("Awaiting {:s} slot for: {:s}",
+                               resourceClassName(mSlotClass), getUniqueName());
+        }
         size_t i = 0;
         for (auto const& c : mChildren)
         {
@@ -104,6 +111,12 @@ Work::getMaxRetries() const
     return mMaxRetries;
 }
 
+Work::ResourceClass
+Work::getResourceClass() const
+{
+    return RESOURCE_NONE;
+}
+
 std::string
 Work::stateName(State st)
 {
@@ -126,6 +139,26 @@ Work::stateName(State st)
     }
 }
 
+std::string
+Work::resourceClassName(ResourceClass rc)
+{
+    switch (rc)
+    {
+    case RESOURCE_NONE:
+        return "none";
+    case RESOURCE_NETWORK:
+        return "network";
+    case RESOURCE_DISK:
+        return "disk";
+    case RESOURCE_CPU:
+        return "cpu";
+    case RESOURCE_DB:
+        return "db";
+    default:
+        throw std::runtime_error("Unknown Work::ResourceClass");
+    }
+}
+
 std::function<void(asio::error_code const& ec)>
 Work::callComplete()
 {
@@ -153,15 +186,55 @@ Work::scheduleRun()
         std::static_pointer_cast<Work>(shared_from_this()));
     CLOG(DEBUG, "Work") << "scheduling run of " << getUniqueName();
     mScheduled = true;
-    mApp.getClock().getIOService().post([weak]() {
-        auto self = weak.lock();
-        if (!self)
-        {
-            return;
-        }
-        self->mScheduled = false;
-        self->run();
-    });
+    mApp.getClock().postToCurrentCrank(
+        [weak]() {
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+            self->mScheduled = false;
+            self->run();
+        },
+        "work");
+}
+
+void
+Work::scheduleStart()
+{
+    auto rc = getResourceClass();
+    if (rc == RESOURCE_NONE || mHoldsSlot)
+    {
+        scheduleRun();
+        return;
+    }
+    if (mSlotRequested)
+    {
+        return;
+    }
+
+    auto& wm = mApp.getWorkManager();
+    CLOG(DEBUG, "Work") << "requesting " << resourceClassName(rc)
+                        << " slot for " << getUniqueName();
+    mSlotManager = std::static_pointer_cast<WorkManager>(wm.shared_from_this());
+    mSlotClass = rc;
+    mSlotRequested = true;
+    wm.requestSlot(std::static_pointer_cast<Work>(shared_from_this()));
+}
+
+void
+Work::releaseSlot()
+{
+    if (!mHoldsSlot)
+    {
+        return;
+    }
+    mHoldsSlot = false;
+    auto wm = mSlotManager.lock();
+    if (wm)
+    {
+        wm->releaseSlot(mSlotClass);
+    }
 }
 
 void
@@ -176,15 +249,17 @@ Work::scheduleComplete(CompleteResult result)
         std::static_pointer_cast<Work>(shared_from_this()));
     CLOG(DEBUG, "Work") << "scheduling completion of " << getUniqueName();
     mScheduled = true;
-    mApp.getClock().getIOService().post([weak, result]() {
-        auto self = weak.lock();
-        if (!self)
-        {
-            return;
-        }
-        self->mScheduled = false;
-        self->complete(result);
-    });
+    mApp.getClock().postToCurrentCrank(
+        [weak, result]() {
+            auto self = weak.lock();
+            if (!self)
+            {
+                return;
+            }
+            self->mScheduled = false;
+            self->complete(result);
+        },
+        "work");
 }
 
 void
@@ -205,7 +280,7 @@ Work::scheduleRetry()
 
     if (!mRetryTimer)
     {
-        mRetryTimer = std::make_unique<VirtualTimer>(mApp.getClock());
+        mRetryTimer = std::make_unique<VirtualTimer>(mApp.getClock(), "work");
     }
 
     std::weak_ptr<Work> weak(
@@ -236,6 +311,10 @@ void
 Work::reset()
 {
     CLOG(DEBUG, "Work") << "resetting " << getUniqueName();
+    if (mOnWorker)
+    {
+        mCancelled = true;
+    }
     setState(WORK_PENDING);
     onReset();
 }
@@ -254,7 +333,7 @@ Work::advance()
     {
         CLOG(DEBUG, "Work") << "all " << mChildren.size() << " children of "
                             << getUniqueName() << " successful, scheduling run";
-        scheduleRun();
+        scheduleStart();
     }
     else if (anyChildFatalFailure())
     {
@@ -274,6 +353,14 @@ Work::advance()
 void
 Work::run()
 {
+    if (mOnWorker)
+    {
+        CLOG(DEBUG, "Work") << "waiting for worker to return before running "
+                            << getUniqueName();
+        mRunAfterWorker = true;
+        return;
+    }
+
     if (getState() == WORK_PENDING)
     {
         CLOG(DEBUG, "Work") << "starting " << getUniqueName();
@@ -283,7 +370,62 @@ Work::run()
     CLOG(DEBUG, "Work") << "running " << getUniqueName();
     mApp.getMetrics().NewMeter({"work", "unit", "run"}, "unit").Mark();
     setState(WORK_RUNNING);
-    onRun();
+    if (runsOnWorker())
+    {
+        runOnWorker();
+    }
+    else
+    {
+        onRun();
+    }
+}
+
+void
+Work::runOnWorker()
+{
+    assert(!mOnWorker);
+    mOnWorker = std::static_pointer_cast<Work>(shared_from_this());
+    mCancelled = false;
+
+    // Only raw pointers cross threads: mOnWorker keeps the work alive, and is
+    // released on the main thread.
+    Work* self = this;
+    auto& mainIO = mApp.getClock().getIOService();
+    mApp.getWorkerLanes().post(WorkerLane::BACKGROUND, [self, &mainIO]() {
+        CompleteResult result;
+        try
+        {
+            result = self->onWorkerRun();
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(WARNING, "Work") << "worker run of " << self->getUniqueName()
+                                  << " failed: " << e.what();
+            result = WORK_COMPLETE_FAILURE;
+        }
+        mainIO.post([self, result]() { self->completeWorkerRun(result); });
+    });
+}
+
+void
+Work::completeWorkerRun(CompleteResult result)
+{
+    auto keepAlive = std::move(mOnWorker);
+    bool rerun = mRunAfterWorker;
+    mRunAfterWorker = false;
+
+    if (mCancelled)
+    {
+        CLOG(DEBUG, "Work") << "dropping result of cancelled worker run of "
+                            << getUniqueName();
+        mCancelled = false;
+        if (rerun)
+        {
+            run();
+        }
+        return;
+    }
+    complete(result);
 }
 
 void
@@ -369,6 +511,37 @@ Work::onSuccess()
     return WORK_SUCCESS;
 }
 
+bool
+Work::runsOnWorker() const
+{
+    return false;
+}
+
+Work::CompleteResult
+Work::onWorkerRun()
+{
+    return WORK_COMPLETE_OK;
+}
+
+bool
+Work::isCancelled() const
+{
+    return mCancelled;
+}
+
+void
+Work::cancel()
+{
+    if (mOnWorker)
+    {
+        mCancelled = true;
+    }
+    for (auto& c : mChildren)
+    {
+        c.second->cancel();
+    }
+}
+
 void
 Work::onFailureRetry()
 {
@@ -409,6 +582,10 @@ Work::setState(Work::State st)
                             << stateName(mState) << " -> " << stateName(st);
         mState = st;
     }
+    if (mState != WORK_RUNNING)
+    {
+        releaseSlot();
+    }
 }
 
 void
@@ -6,6 +6,7 @@
 
 #include "util/Timer.h"
 #include "work/WorkParent.h"
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -14,6 +15,7 @@ namespace stellar
 {
 
 class Application;
+class WorkManager;
 class WorkParent;
 
 /** Class 'Work' (and its friends 'WorkManager' and 'WorkParent') support
@@ -57,6 +59,22 @@ class Work : public WorkParent
         WORK_COMPLETE_FATAL
     };
 
+    // The resource a piece of work mostly uses while it runs. Work of a class
+    // other than RESOURCE_NONE only starts running (WORK_PENDING ->
+    // WORK_RUNNING) once the WorkManager grants it one of the class's slots
+    // (see WORK_NETWORK_SLOTS etc. in Config), and holds it until it leaves
+    // WORK_RUNNING. Only work that does not wait for other work of the same
+    // class while running should declare one.
+    enum ResourceClass
+    {
+        RESOURCE_NONE,
+        RESOURCE_NETWORK,
+        RESOURCE_DISK,
+        RESOURCE_CPU,
+        RESOURCE_DB,
+        RESOURCE_CLASS_COUNT
+    };
+
     Work(Application& app, WorkParent& parent, std::string uniqueName,
          size_t maxRetries = RETRY_A_FEW);
 
@@ -65,6 +83,7 @@ class Work : public WorkParent
     virtual std::string getUniqueName() const;
     virtual std::string getStatus() const;
     virtual size_t getMaxRetries() const;
+    virtual ResourceClass getResourceClass() const;
     uint64_t getRetryETA() const;
 
     // Customize work behavior via these callbacks. onReset is called
@@ -91,7 +110,25 @@ class Work : public WorkParent
     // all work items that leaded to this one will also fail without retrying.
     virtual State onSuccess();
 
+    // Work that returns true from runsOnWorker has onWorkerRun called on a
+    // worker thread in place of onRun (onStart and the other callbacks still
+    // run on the main thread), and is then completed on the main thread with
+    // the result it returns, as if by scheduleComplete. The work is kept alive
+    // meanwhile. onWorkerRun must only use state that the main thread leaves
+    // alone while it runs, and should return soon after isCancelled() turns
+    // true, which happens when the work is reset (eg. to retry it) or
+    // cancelled: its result is then dropped, and a run scheduled meanwhile
+    // waits for it to return.
+    virtual bool runsOnWorker() const;
+    virtual CompleteResult onWorkerRun();
+    bool isCancelled() const;
+
+    // Asks a running onWorkerRun of this work and of its children to stop;
+    // called on the children a parent clears.
+    void cancel();
+
     static std::string stateName(State st);
+    static std::string resourceClassName(ResourceClass rc);
     State getState() const;
     bool isDone() const;
     void advance();
@@ -105,6 +142,19 @@ class Work : public WorkParent
     State mState{WORK_PENDING};
     bool mScheduled{false};
 
+    // Set while queued for, respectively holding, a slot of the
+    // WorkManager that mSlotManager points to.
+    bool mSlotRequested{false};
+    bool mHoldsSlot{false};
+    ResourceClass mSlotClass{RESOURCE_NONE};
+    std::weak_ptr<WorkManager> mSlotManager;
+
+    // Set while onWorkerRun runs, keeping the work alive until its result
+    // is back on the main thread.
+    std::shared_ptr<Work> mOnWorker;
+    std::atomic<bool> mCancelled{false};
+    bool mRunAfterWorker{false};
+
     std::unique_ptr<VirtualTimer> mRetryTimer;
 
     std::function<void(asio::error_code const& ec)> callComplete();
@@ -113,6 +163,7 @@ class Work : public WorkParent
     void scheduleComplete(CompleteResult result = WORK_COMPLETE_OK);
     void scheduleRetry();
     void scheduleRun();
+    void scheduleStart();
     void
     scheduleSuccess()
     {
@@ -135,6 +186,11 @@ class Work : public WorkParent
     virtual void notify(std::string const& childChanged) override;
 
   private:
+    friend class WorkManagerImpl;
+
     VirtualClock::duration getRetryDelay() const;
+    void releaseSlot();
+    void runOnWorker();
+    void completeWorkerRun(CompleteResult result);
 };
 }
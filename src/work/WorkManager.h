@@ -27,6 +27,12 @@ class WorkManager : public WorkParent
     static std::shared_ptr<WorkManager> create(Application& app);
     virtual void notify(std::string const& changed) = 0;
 
+    // Slots of each Work::ResourceClass, see Work::scheduleStart. Queued work
+    // is granted slots as they are released, taking turns between the parents
+    // of the work queued so that one batch does not starve the others.
+    virtual void requestSlot(std::shared_ptr<Work> work) = 0;
+    virtual void releaseSlot(Work::ResourceClass rc) = 0;
+
     template <typename T, typename... Args>
     std::shared_ptr<T>
     executeWork(Args&&... args)
@@ -8,6 +8,7 @@
 #include "work/WorkParent.h"
 
 #include "lib/util/format.h"
+#include "main/Config.h"
 #include "util/Logging.h"
 
 #include "medida/meter.h"
@@ -26,6 +27,11 @@ WorkManager::~WorkManager()
 
 WorkManagerImpl::WorkManagerImpl(Application& app) : WorkManager(app)
 {
+    auto const& cfg = app.getConfig();
+    mSlots[Work::RESOURCE_NETWORK].mFree = cfg.WORK_NETWORK_SLOTS;
+    mSlots[Work::RESOURCE_DISK].mFree = cfg.WORK_DISK_SLOTS;
+    mSlots[Work::RESOURCE_CPU].mFree = cfg.WORK_CPU_SLOTS;
+    mSlots[Work::RESOURCE_DB].mFree = cfg.WORK_DB_SLOTS;
 }
 
 WorkManagerImpl::~WorkManagerImpl()
@@ -64,6 +70,89 @@ WorkManagerImpl::notify(std::string const& child)
     advanceChildren();
 }
 
+void
+WorkManagerImpl::requestSlot(std::shared_ptr<Work> work)
+{
+    auto rc = work->mSlotClass;
+    assert(rc != Work::RESOURCE_NONE && rc < Work::RESOURCE_CLASS_COUNT);
+    auto& q = mSlots[rc];
+    if (q.mFree > 0 && q.mParents.empty())
+    {
+        grantSlot(work);
+        return;
+    }
+
+    CLOG(DEBUG, "Work") << "queueing " << work->getUniqueName() << " for a "
+                        << Work::resourceClassName(rc) << " slot";
+    mApp.getMetrics()
+        .NewMeter({"work", "slot", "queued-" + Work::resourceClassName(rc)},
+                  "unit")
+        .Mark();
+    auto parent = work->mParent.lock().get();
+    auto& queued = q.mQueued[parent];
+    if (queued.empty())
+    {
+        q.mParents.push_back(parent);
+    }
+    queued.push_back(work);
+}
+
+void
+WorkManagerImpl::releaseSlot(Work::ResourceClass rc)
+{
+    ++mSlots[rc].mFree;
+    serveSlotQueue(rc);
+}
+
+void
+WorkManagerImpl::grantSlot(std::shared_ptr<Work> work)
+{
+    auto& q = mSlots[work->mSlotClass];
+    assert(q.mFree > 0);
+    --q.mFree;
+    CLOG(DEBUG, "Work") << "granting " << Work::resourceClassName(
+                                              work->mSlotClass)
+                        << " slot to " << work->getUniqueName();
+    work->mSlotRequested = false;
+    work->mHoldsSlot = true;
+    work->scheduleRun();
+}
+
+void
+WorkManagerImpl::serveSlotQueue(Work::ResourceClass rc)
+{
+    auto& q = mSlots[rc];
+    while (q.mFree > 0 && !q.mParents.empty())
+    {
+        auto parent = q.mParents.front();
+        q.mParents.pop_front();
+        auto i = q.mQueued.find(parent);
+        assert(i != q.mQueued.end() && !i->second.empty());
+        auto work = i->second.front().lock();
+        i->second.pop_front();
+        if (i->second.empty())
+        {
+            q.mQueued.erase(i);
+        }
+        else
+        {
+            q.mParents.push_back(parent);
+        }
+
+        if (!work)
+        {
+            continue;
+        }
+        // Work that was reset while queued asks again once it can run.
+        work->mSlotRequested = false;
+        if (work->getState() == Work::WORK_PENDING &&
+            work->allChildrenSuccessful())
+        {
+            grantSlot(work);
+        }
+    }
+}
+
 std::shared_ptr<WorkManager>
 WorkManager::create(Application& app)
 {
@@ -3,6 +3,9 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "work/WorkManager.h"
+#include <array>
+#include <deque>
+#include <map>
 
 namespace stellar
 {
@@ -13,5 +16,20 @@ class WorkManagerImpl : public WorkManager
     WorkManagerImpl(Application& app);
     virtual ~WorkManagerImpl();
     virtual void notify(std::string const&) override;
+    virtual void requestSlot(std::shared_ptr<Work> work) override;
+    virtual void releaseSlot(Work::ResourceClass rc) override;
+
+  private:
+    struct SlotQueue
+    {
+        size_t mFree{0};
+        // Parents with work queued, in the order they are served.
+        std::deque<WorkParent*> mParents;
+        std::map<WorkParent*, std::deque<std::weak_ptr<Work>>> mQueued;
+    };
+    std::array<SlotQueue, Work::RESOURCE_CLASS_COUNT> mSlots;
+
+    void grantSlot(std::shared_ptr<Work> work);
+    void serveSlotQueue(Work::ResourceClass rc);
 };
 }
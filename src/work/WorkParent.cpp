@@ -36,6 +36,10 @@ WorkParent::addChild(std::shared_ptr<Work> child)
 void
 WorkParent::clearChildren()
 {
+    for (auto& c : mChildren)
+    {
+        c.second->cancel();
+    }
     mChildren.clear();
 }
 
@@ -14,6 +14,7 @@
 #include <cstdio>
 #include <fstream>
 #include <random>
+#include <thread>
 #include <xdrpp/autocheck.h>
 
 using namespace stellar;
@@ -254,3 +255,160 @@ TEST_CASE("sub-subwork items succed at the same time", "[work]")
 
     REQUIRE(!work1->mCalledSuccessWithPendingSubwork);
 }
+
+class DiskWork : public WorkDoNothing
+{
+    std::vector<std::string>& mStarted;
+
+  public:
+    DiskWork(Application& app, WorkParent& parent,
+             std::string const& uniqueName, std::vector<std::string>& started)
+        : WorkDoNothing(app, parent, uniqueName), mStarted(started)
+    {
+    }
+
+    ResourceClass
+    getResourceClass() const override
+    {
+        return RESOURCE_DISK;
+    }
+
+    virtual void
+    onStart() override
+    {
+        mStarted.push_back(getUniqueName());
+    }
+};
+
+TEST_CASE("work waits for resource slots served across parents", "[work]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.WORK_DISK_SLOTS = 1;
+    auto app = createTestApplication(clock, cfg);
+    auto& wm = app->getWorkManager();
+
+    std::vector<std::string> started;
+    std::vector<std::shared_ptr<DiskWork>> works;
+    for (auto const& p : {"a", "b"})
+    {
+        auto w = wm.addWork<Work>(std::string("batch-") + p);
+        for (auto i : {1, 2, 3})
+        {
+            works.push_back(w->addWork<DiskWork>(
+                std::string(p) + "-" + std::to_string(i), started));
+        }
+    }
+
+    wm.advanceChildren();
+    while (!wm.allChildrenDone())
+    {
+        clock.crank(false);
+        std::vector<std::shared_ptr<DiskWork>> running;
+        for (auto const& w : works)
+        {
+            if (w->getState() == Work::WORK_RUNNING)
+            {
+                running.push_back(w);
+            }
+        }
+        REQUIRE(running.size() <= 1);
+        if (!running.empty())
+        {
+            running.front()->forceSuccess();
+        }
+    }
+
+    REQUIRE(wm.allChildrenSuccessful());
+    std::vector<std::string> expected{"a-1", "a-2", "b-1",
+                                      "a-3", "b-2", "b-3"};
+    REQUIRE(started == expected);
+}
+
+class WorkerThreadWork : public Work
+{
+    std::thread::id const mMainThread;
+
+  public:
+    std::atomic<size_t> mWorkerRuns{0};
+    std::atomic<bool> mRanOnMain{false};
+    std::atomic<bool> mSpinUntilCancelled{false};
+    std::atomic<bool> mSpinning{false};
+
+    WorkerThreadWork(Application& app, WorkParent& parent)
+        : Work(app, parent, "worker-thread-work", 0)
+        , mMainThread(std::this_thread::get_id())
+    {
+    }
+
+    bool
+    runsOnWorker() const override
+    {
+        return true;
+    }
+
+    CompleteResult
+    onWorkerRun() override
+    {
+        if (std::this_thread::get_id() == mMainThread)
+        {
+            mRanOnMain = true;
+        }
+        mSpinning = mSpinUntilCancelled.load();
+        while (mSpinUntilCancelled && !isCancelled())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        mSpinning = false;
+        ++mWorkerRuns;
+        return WORK_COMPLETE_OK;
+    }
+
+    State
+    onSuccess() override
+    {
+        return mWorkerRuns < 3 ? WORK_RUNNING : WORK_SUCCESS;
+    }
+};
+
+TEST_CASE("work runs on worker threads", "[work]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto& wm = app->getWorkManager();
+
+    SECTION("completes on the main thread")
+    {
+        auto w = wm.addWork<WorkerThreadWork>();
+        wm.advanceChildren();
+        while (!wm.allChildrenDone())
+        {
+            clock.crank();
+        }
+        REQUIRE(w->getState() == Work::WORK_SUCCESS);
+        REQUIRE(w->mWorkerRuns == 3);
+        REQUIRE(!w->mRanOnMain);
+    }
+
+    SECTION("drops the result of a cancelled run")
+    {
+        auto w = wm.addWork<WorkerThreadWork>();
+        w->mSpinUntilCancelled = true;
+        wm.advanceChildren();
+        while (!w->mSpinning)
+        {
+            clock.crank(false);
+        }
+        w->cancel();
+        while (w->mWorkerRuns == 0)
+        {
+            clock.crank(false);
+        }
+        for (size_t i = 0; i < 10; ++i)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(w->getState() == Work::WORK_RUNNING);
+        REQUIRE(w->mWorkerRuns == 1);
+    }
+}
@@ -42,11 +42,18 @@ struct Hello
     uint256 nonce;
 };
 
+// compression formats the sender of an AUTH can decompress, sent as its
+// flags (0 from peers that predate them)
+enum AuthFlags
+{
+    AUTH_COMPRESS_GZIP = 0x1,
+    AUTH_COMPRESS_ZSTD = 0x2
+};
+
 struct Auth
 {
-    // Empty message, just to confirm
-    // establishment of MAC keys.
-    int unused;
+    // Confirms the establishment of MAC keys; AuthFlags.
+    int flags;
 };
 
 enum IPAddrType
@@ -90,7 +97,24 @@ enum MessageType
     GET_SCP_STATE = 12,
 
     // new messages
-    HELLO = 13
+    HELLO = 13,
+
+    // pull mode transaction flooding (overlay version 8)
+    FLOOD_ADVERT = 14,
+    FLOOD_DEMAND = 15,
+
+    // SCP_MESSAGE referencing values sent earlier (overlay version 9)
+    SCP_MESSAGE_COMPACT = 16,
+
+    // TX_SET sent in several messages (overlay version 10)
+    TX_SET_CHUNK = 17,
+
+    // round trip time probes (overlay version 11)
+    PING = 18,
+    PONG = 19,
+
+    // a message compressed with the format negotiated in AUTH
+    COMPRESSED = 20
 };
 
 struct DontHave
@@ -99,6 +123,55 @@ struct DontHave
     uint256 reqHash;
 };
 
+// hashes of TRANSACTION messages, as computed over the whole StellarMessage
+const TX_ADVERT_VECTOR_MAX_SIZE = 1000;
+typedef Hash TxAdvertVector<TX_ADVERT_VECTOR_MAX_SIZE>;
+
+// the sender has these transactions
+struct FloodAdvert
+{
+    TxAdvertVector txHashes;
+};
+
+// the sender wants these transactions, from among those advertised
+struct FloodDemand
+{
+    TxAdvertVector txHashes;
+};
+
+// a value sent in an SCP_MESSAGE_COMPACT, that later ones on the same
+// connection can reference by id: ids follow each other from 0 on each
+// connection, and the receiver keeps the last SCP_COMPACT_VALUE_SLOTS ones
+const SCP_COMPACT_VALUE_SLOTS = 256;
+
+struct SCPValueDefinition
+{
+    uint32 id;
+    Value value;
+};
+
+// an SCPEnvelope in which every value is replaced by the 4 byte big endian
+// id of a value defined earlier or in newValues
+struct CompactSCPEnvelope
+{
+    SCPValueDefinition newValues<SCP_COMPACT_VALUE_SLOTS>;
+    SCPEnvelope envelope;
+};
+
+// part `index` of the `count` making up the transaction set whose contents
+// hash is txSetHash, answering a GET_TX_SET; the transactions of all parts,
+// in order, are those of the set
+const TX_SET_CHUNK_MAX_TXS = 1000;
+
+struct TxSetChunk
+{
+    Hash txSetHash;
+    Hash previousLedgerHash;
+    uint32 index;
+    uint32 count;
+    TransactionEnvelope txs<TX_SET_CHUNK_MAX_TXS>;
+};
+
 union StellarMessage switch (MessageType type)
 {
 case ERROR_MSG:
@@ -131,6 +204,26 @@ case SCP_MESSAGE:
     SCPEnvelope envelope;
 case GET_SCP_STATE:
     uint32 getSCPLedgerSeq; // ledger seq requested ; if 0, requests the latest
+
+case FLOOD_ADVERT:
+    FloodAdvert floodAdvert;
+case FLOOD_DEMAND:
+    FloodDemand floodDemand;
+case SCP_MESSAGE_COMPACT:
+    CompactSCPEnvelope compactEnvelope;
+case TX_SET_CHUNK:
+    TxSetChunk txSetChunk;
+
+// a PONG echoes the id of the PING it answers
+case PING:
+    uint64 pingID;
+case PONG:
+    uint64 pongID;
+
+// the XDR of a StellarMessage, compressed as part of the stream of the
+// messages sent on the connection, see MessageCompressor
+case COMPRESSED:
+    opaque compressed<>;
 };
 
 union AuthenticatedMessage switch (uint32 v)
@@ -143,4 +236,13 @@ case 0:
    HmacSha256Mac mac;
     } v0;
 };
+
+// A message received from an authenticated peer, as written to
+// OVERLAY_CAPTURE_FILE and replayed by --replay-overlay
+struct CapturedMessage
+{
+    uint64 timeOffset; // microseconds since the capture started
+    NodeID peerID;
+    StellarMessage message;
+};
 }